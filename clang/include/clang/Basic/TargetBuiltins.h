@@ -290,6 +290,16 @@ namespace clang {
     };
   }
 
+  /// Patmos builtins
+  namespace Patmos {
+    enum {
+        LastTIBuiltin = clang::Builtin::FirstTSBuiltin-1,
+#define BUILTIN(ID, TYPE, ATTRS) BI##ID,
+#include "clang/Basic/BuiltinsPatmos.def"
+        LastTSBuiltin
+    };
+  }
+
   /// Le64 builtins
   namespace Le64 {
   enum {
@@ -325,7 +335,7 @@ namespace clang {
        AArch64::LastTSBuiltin, BPF::LastTSBuiltin, PPC::LastTSBuiltin,
        NVPTX::LastTSBuiltin, AMDGPU::LastTSBuiltin, X86::LastTSBuiltin,
        Hexagon::LastTSBuiltin, Mips::LastTSBuiltin, XCore::LastTSBuiltin,
-       Le64::LastTSBuiltin, SystemZ::LastTSBuiltin,
+       Le64::LastTSBuiltin, Patmos::LastTSBuiltin, SystemZ::LastTSBuiltin,
        WebAssembly::LastTSBuiltin});
 
 } // end namespace clang.
@@ -284,6 +284,26 @@ public:
                       const JobAction *JA,
                       bool IssueErrors = false) const;
 
+private:
+  /// PrintCommand - Print the command for -v and CC_PRINT_OPTIONS.
+  ///
+  /// \return False, setting \p FailingCommand, if the log could not be opened.
+  bool PrintCommand(const Command &C, const Command *&FailingCommand) const;
+
+  /// FinishCommand - Report the result of an executed command.
+  ///
+  /// \return The result code of the subprocess.
+  int FinishCommand(const Command &C, int Res, const std::string &Error,
+                    bool ExecutionFailed,
+                    const Command *&FailingCommand) const;
+
+  /// ExecuteJobsInParallel - Execute the jobs on up to \p Threads threads,
+  /// starting every job once the jobs producing its inputs have finished.
+  void ExecuteJobsInParallel(
+      const JobList &Jobs, unsigned Threads,
+      SmallVectorImpl<std::pair<int, const Command *>> &FailingCommands) const;
+
+public:
   /// ExecuteCommand - Execute an actual command.
   ///
   /// \param FailingCommand - For non-zero results, this will be set to the
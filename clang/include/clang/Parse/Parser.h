@@ -198,6 +198,7 @@ class Parser : public CodeCompletionHandler {
   std::unique_ptr<PragmaHandler> OptimizeHandler;
   std::unique_ptr<PragmaHandler> LoopHintHandler;
   std::unique_ptr<PragmaHandler> LoopboundHandler;
+  std::unique_ptr<PragmaHandler> SinglePathHandler;
   std::unique_ptr<PragmaHandler> UnrollHintHandler;
   std::unique_ptr<PragmaHandler> NoUnrollHintHandler;
   std::unique_ptr<PragmaHandler> UnrollAndJamHintHandler;
@@ -771,6 +772,10 @@ private:
   /// #pragma loopbound
   void HandlePragmaLoopbound(Loopbound &LB);
 
+  /// \brief Handle the annotation token produced for
+  /// #pragma patmos singlepath
+  IdentifierLoc *HandlePragmaSinglePath();
+
   bool ParsePragmaAttributeSubjectMatchRuleSet(
       attr::ParsedSubjectMatchRuleSet &SubjectMatchRules,
       SourceLocation &AnyLoc, SourceLocation &LastMatchRuleEndLoc);
@@ -2115,6 +2120,10 @@ private:
                                   ParsedStmtContext StmtCtx,
                                   SourceLocation *TrailingElseLoc,
                                   ParsedAttributesWithRange &Attrs);
+  StmtResult ParsePragmaSinglePath(StmtVector &Stmts,
+                                   ParsedStmtContext StmtCtx,
+                                   SourceLocation *TrailingElseLoc,
+                                   ParsedAttributesWithRange &Attrs);
 
   /// Describes the behavior that should be taken for an __if_exists
   /// block.
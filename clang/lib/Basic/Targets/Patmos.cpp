@@ -12,12 +12,24 @@
 
 #include "Patmos.h"
 #include "clang/Basic/MacroBuilder.h"
+#include "clang/Basic/TargetBuiltins.h"
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/Support/TargetParser.h"
 
 using namespace clang;
 using namespace clang::targets;
 
+const Builtin::Info PatmosTargetInfo::BuiltinInfo[] = {
+#define BUILTIN(ID, TYPE, ATTRS)                                               \
+  {#ID, TYPE, ATTRS, nullptr, ALL_LANGUAGES, nullptr},
+#include "clang/Basic/BuiltinsPatmos.def"
+};
+
+ArrayRef<Builtin::Info> PatmosTargetInfo::getTargetBuiltins() const {
+  return llvm::makeArrayRef(BuiltinInfo, clang::Patmos::LastTSBuiltin -
+                                             Builtin::FirstTSBuiltin);
+}
+
 ArrayRef<const char *> PatmosTargetInfo::getGCCRegNames() const {
   static const char *const GCCRegNames[] = {
       // CPU register names
@@ -96,6 +108,11 @@ void PatmosTargetInfo::getTargetDefines(const LangOptions &Opts,
   Builder.defineMacro("__patmos__");
   Builder.defineMacro("__PATMOS__");
 
+  // Qualifiers of pointers to the memory types of the typed loads and stores,
+  // the default address space 0 is accessed through the data cache.
+  Builder.defineMacro("__patmos_local", "__attribute__((address_space(1)))");
+  Builder.defineMacro("__patmos_main", "__attribute__((address_space(3)))");
+
   if (SoftFloat)
     Builder.defineMacro("SOFT_FLOAT", "1");
 }
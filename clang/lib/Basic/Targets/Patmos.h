@@ -24,6 +24,7 @@ namespace targets {
 
 // Patmos Target
 class LLVM_LIBRARY_VISIBILITY PatmosTargetInfo : public TargetInfo {
+  static const Builtin::Info BuiltinInfo[];
   bool SoftFloat = true;
 public:
   PatmosTargetInfo(const llvm::Triple &Triple, const TargetOptions &)
@@ -49,7 +50,7 @@ public:
   void getTargetDefines(const LangOptions &Opts,
                         MacroBuilder &Builder) const override;
 
-  ArrayRef<Builtin::Info> getTargetBuiltins() const override { return None; }
+  ArrayRef<Builtin::Info> getTargetBuiltins() const override;
 
   BuiltinVaListKind getBuiltinVaListKind() const override {
     return TargetInfo::VoidPtrBuiltinVaList;
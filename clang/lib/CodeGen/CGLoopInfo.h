@@ -81,6 +81,9 @@ struct LoopAttributes {
 
   /// Value for whether the loop is required to make progress.
   bool MustProgress;
+
+  /// Value for llvm.loop.singlepath metadata.
+  bool SinglePath;
 };
 
 /// Information used when generating a structured loop.
@@ -285,6 +288,9 @@ public:
   /// Set no progress for the next loop pushed.
   void setMustProgress(bool P) { StagedAttrs.MustProgress = P; }
 
+  /// Set the single-path state for the next loop pushed.
+  void setSinglePath(bool S) { StagedAttrs.SinglePath = S; }
+
 private:
   /// Returns true if there is LoopInfo on the stack.
   bool hasInfo() const { return !Active.empty(); }
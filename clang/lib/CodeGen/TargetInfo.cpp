@@ -10794,6 +10794,8 @@ public:
       Fn->addFnAttr("sp-root");
       Fn->addFnAttr(llvm::Attribute::NoInline);
     }
+    if (FD->hasAttr<PatmosInterruptAttr>())
+      Fn->addFnAttr("interrupt");
   }
 };
 }
@@ -17,14 +17,19 @@
 #include "clang/Driver/Util.h"
 #include "llvm/ADT/None.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Option/ArgList.h"
 #include "llvm/Option/OptSpecifier.h"
 #include "llvm/Option/Option.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cassert>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <system_error>
 #include <utility>
@@ -161,8 +166,8 @@ bool Compilation::CleanupFileMap(const ArgStringMap &Files,
   return Success;
 }
 
-int Compilation::ExecuteCommand(const Command &C,
-                                const Command *&FailingCommand) const {
+bool Compilation::PrintCommand(const Command &C,
+                               const Command *&FailingCommand) const {
   if ((getDriver().CCPrintOptions ||
        getArgs().hasArg(options::OPT_v)) && !getDriver().CCGenDiagnostics) {
     raw_ostream *OS = &llvm::errs();
@@ -179,7 +184,7 @@ int Compilation::ExecuteCommand(const Command &C,
         getDriver().Diag(diag::err_drv_cc_print_options_failure)
             << EC.message();
         FailingCommand = &C;
-        return 1;
+        return false;
       }
       OS = OwnedStream.get();
     }
@@ -189,10 +194,12 @@ int Compilation::ExecuteCommand(const Command &C,
 
     C.Print(*OS, "\n", /*Quote=*/getDriver().CCPrintOptions);
   }
+  return true;
+}
 
-  std::string Error;
-  bool ExecutionFailed;
-  int Res = C.Execute(Redirects, &Error, &ExecutionFailed);
+int Compilation::FinishCommand(const Command &C, int Res,
+                               const std::string &Error, bool ExecutionFailed,
+                               const Command *&FailingCommand) const {
   if (PostCallback)
     PostCallback(C, Res);
   if (!Error.empty()) {
@@ -206,6 +213,17 @@ int Compilation::ExecuteCommand(const Command &C,
   return ExecutionFailed ? 1 : Res;
 }
 
+int Compilation::ExecuteCommand(const Command &C,
+                                const Command *&FailingCommand) const {
+  if (!PrintCommand(C, FailingCommand))
+    return 1;
+
+  std::string Error;
+  bool ExecutionFailed;
+  int Res = C.Execute(Redirects, &Error, &ExecutionFailed);
+  return FinishCommand(C, Res, Error, ExecutionFailed, FailingCommand);
+}
+
 using FailingCommandList = SmallVectorImpl<std::pair<int, const Command *>>;
 
 static bool ActionFailed(const Action *A,
@@ -235,8 +253,131 @@ static bool InputsOk(const Command &C,
   return !ActionFailed(&C.getSource(), FailingCommands);
 }
 
+static void CollectActions(const Action *A,
+                           llvm::SmallPtrSetImpl<const Action *> &Actions) {
+  if (!Actions.insert(A).second)
+    return;
+  for (const auto *AI : A->inputs())
+    CollectActions(AI, Actions);
+}
+
+void Compilation::ExecuteJobsInParallel(
+    const JobList &Jobs, unsigned Threads,
+    FailingCommandList &FailingCommands) const {
+  std::vector<const Command *> Commands;
+  for (const auto &Job : Jobs)
+    Commands.push_back(&Job);
+  unsigned NumJobs = Commands.size();
+
+  // A job waits for the earlier jobs of the actions it depends on, and for
+  // the earlier jobs of its own action, e.g., the llvm-link, opt and llc steps
+  // of a Patmos link. Everything else, e.g., the compilation of the single
+  // sources, is independent.
+  std::vector<SmallVector<unsigned, 4>> Dependencies(NumJobs);
+  for (unsigned I = 0; I < NumJobs; I++) {
+    llvm::SmallPtrSet<const Action *, 16> Actions;
+    CollectActions(&Commands[I]->getSource(), Actions);
+    for (unsigned J = 0; J < I; J++)
+      if (Actions.count(&Commands[J]->getSource()))
+        Dependencies[I].push_back(J);
+  }
+
+  enum JobState { Pending, Running, Finished };
+  struct JobResult {
+    int Res = 0;
+    std::string Error;
+    bool ExecutionFailed = false;
+  };
+  std::vector<JobState> States(NumJobs, Pending);
+  std::vector<JobResult> Results(NumJobs);
+  std::vector<unsigned> Completed;
+  std::mutex Mutex;
+  std::condition_variable CompletedChanged;
+  unsigned NumRunning = 0, NumFinished = 0;
+
+  // Only the commands themselves run on the pool. Printing, diagnostics and
+  // the bookkeeping of failures stay on this thread, in the order of the
+  // jobs that are started and completed.
+  llvm::ThreadPool Pool(llvm::heavyweight_hardware_concurrency(Threads));
+  while (NumFinished < NumJobs) {
+    for (unsigned I = 0; I < NumJobs && NumRunning < Threads; I++) {
+      if (States[I] != Pending ||
+          llvm::any_of(Dependencies[I],
+                       [&](unsigned J) { return States[J] != Finished; }))
+        continue;
+
+      const Command &Job = *Commands[I];
+      const Command *FailingCommand = nullptr;
+      if (!InputsOk(Job, FailingCommands) ||
+          !PrintCommand(Job, FailingCommand)) {
+        if (FailingCommand)
+          FailingCommands.push_back(std::make_pair(1, FailingCommand));
+        States[I] = Finished;
+        NumFinished++;
+        continue;
+      }
+
+      States[I] = Running;
+      NumRunning++;
+      Pool.async([&, I]() {
+        JobResult R;
+        R.Res = Commands[I]->Execute(Redirects, &R.Error, &R.ExecutionFailed);
+        std::lock_guard<std::mutex> Lock(Mutex);
+        Results[I] = std::move(R);
+        Completed.push_back(I);
+        CompletedChanged.notify_one();
+      });
+    }
+
+    // The earliest pending job only waits for finished jobs, every iteration
+    // without running jobs starts or skips it.
+    if (!NumRunning)
+      continue;
+
+    std::vector<unsigned> Done;
+    {
+      std::unique_lock<std::mutex> Lock(Mutex);
+      CompletedChanged.wait(Lock, [&]() { return !Completed.empty(); });
+      Done.swap(Completed);
+    }
+    for (unsigned I : Done) {
+      const JobResult &R = Results[I];
+      const Command *FailingCommand = nullptr;
+      if (int Res = FinishCommand(*Commands[I], R.Res, R.Error,
+                                  R.ExecutionFailed, FailingCommand))
+        FailingCommands.push_back(std::make_pair(Res, FailingCommand));
+      States[I] = Finished;
+      NumRunning--;
+      NumFinished++;
+    }
+  }
+}
+
 void Compilation::ExecuteJobs(const JobList &Jobs,
                               FailingCommandList &FailingCommands) const {
+  // The Patmos driver may run independent jobs in parallel, e.g., the front
+  // ends of many sources. The cl driver bails on the first failure and is
+  // always sequential, as is the reexecution for crash diagnostics.
+  unsigned Threads = 1;
+  if (getDefaultToolChain().getTriple().getArch() == llvm::Triple::patmos &&
+      !TheDriver.IsCLMode() && !ForDiagnostics) {
+    if (Arg *A = getArgs().getLastArg(options::OPT_mpatmos_jobs_EQ)) {
+      StringRef Value = A->getValue();
+      if (Value == "auto")
+        Threads = llvm::heavyweight_hardware_concurrency()
+                      .compute_thread_count();
+      else if (Value.getAsInteger(10, Threads) || Threads == 0) {
+        getDriver().Diag(diag::err_drv_invalid_int_value)
+            << A->getAsString(getArgs()) << Value;
+        Threads = 1;
+      }
+    }
+  }
+  if (Threads > 1 && Jobs.size() > 1) {
+    ExecuteJobsInParallel(Jobs, Threads, FailingCommands);
+    return;
+  }
+
   // According to UNIX standard, driver need to continue compiling all the
   // inputs on the command line even one of them failed.
   // In all but CLMode, execute all the jobs unless the necessary inputs for the
@@ -12,6 +12,7 @@
 #include "InputInfo.h"
 #include "clang/Driver/Compilation.h"
 #include "clang/Driver/Options.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Option/ArgList.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
@@ -35,6 +36,7 @@
 #include "llvm/Config/config.h"
 #include "llvm/Object/Archive.h"
 #include "llvm/Option/Arg.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Option/ArgList.h"
 #include "llvm/Option/Option.h"
 #include "llvm/Support/ErrorHandling.h"
@@ -98,6 +100,20 @@ void PatmosToolChain::AddClangSystemIncludeArgs(const llvm::opt::ArgList &Driver
   }
 }
 
+void PatmosToolChain::addClangTargetOptions(const ArgList &DriverArgs,
+                                            ArgStringList &CC1Args,
+                                            Action::OffloadKind) const
+{
+  // -Owcet optimizes the bitcode like -O2, unless another level is given for
+  // the front end. Loops are only unrolled by llc, based on their loop
+  // bounds, and not vectorized.
+  if (DriverArgs.hasArg(options::OPT_Owcet)) {
+    if (!DriverArgs.hasArg(options::OPT_O_Group))
+      CC1Args.push_back("-O2");
+    CC1Args.push_back("-fno-unroll-loops");
+  }
+}
+
 static bool matchesJob(const Action &action, types::ID t, Action::ActionClass a) {
   return action.getType() == t && action.getKind() == a;
 }
@@ -161,9 +177,46 @@ const char * patmos::PatmosBaseTool::CreateOutputFilename(Compilation &C,
   return filename;
 }
 
+void patmos::PatmosBaseTool::AddTimeTraceArgs(Compilation &C,
+    const ArgList &Args, const InputInfo &Output, const char *TmpPrefix,
+    ArgStringList &ToolArgs) const
+{
+  if (!TimeTraces) {
+    return;
+  }
+
+  const char *TraceFile = CreateOutputFilename(C, Output, TmpPrefix, "json",
+                                               false);
+  TimeTraces->push_back(TraceFile);
+
+  // llvm-link, opt, llc, ld.lld and -cc1patmos all use the same spelling
+  ToolArgs.push_back("-time-trace");
+  ToolArgs.push_back(Args.MakeArgString(Twine("-time-trace-file=") +
+                                        TraceFile));
+  if (Arg *A = Args.getLastArg(options::OPT_ftime_trace_granularity_EQ)) {
+    ToolArgs.push_back(Args.MakeArgString(Twine("-time-trace-granularity=") +
+                                          A->getValue()));
+  }
+}
+
+const char * patmos::PatmosBaseTool::CreateIntermediateName(Compilation &C,
+    const InputInfo &Output, const char * TmpPrefix, const char *Suffix,
+    bool InMemory) const
+{
+  const ArgList &Args = C.getArgs();
+  if (InMemory && !Args.hasArg(options::OPT_save_temps)) {
+    return Args.MakeArgString(Twine("<") + TmpPrefix + Suffix + ">");
+  }
+  return CreateOutputFilename(C, Output, TmpPrefix, Suffix, false);
+}
+
 Arg* patmos::PatmosBaseTool::GetOptLevel(const ArgList &Args, char &Lvl) const {
 
-  if (Arg *A = Args.getLastArg(options::OPT_O_Group)) {
+  if (Arg *A = Args.getLastArg(options::OPT_O_Group, options::OPT_Owcet)) {
+    if (A->getOption().matches(options::OPT_Owcet)) {
+      Lvl = 'w';
+      return A;
+    }
     std::string Opt = A->getAsString(Args);
     if (Opt.length() != 3) {
       llvm::report_fatal_error("Unsupported optimization option: " + Opt);
@@ -233,6 +286,12 @@ void patmos::PatmosBaseTool::PrepareLink3Inputs(
   //----------------------------------------------------------------------------
   // link with newlib and compiler-rt libraries
 
+  // The profile runtime writes the profile with newlib, link it first.
+  if (ToolChain::needsProfileRT(Args)) {
+    LinkInputs.push_back(Args.MakeArgString(
+        getLibPath("lib/libclang_rt.profile-patmos.a")));
+  }
+
   LinkInputs.push_back(Args.MakeArgString(getLibPath("lib/libc.a")));
   LinkInputs.push_back(Args.MakeArgString("--override=" + getLibPath("lib/libm.a")));
   LinkInputs.push_back(Args.MakeArgString(getLibPath("lib/libpatmos.a")));
@@ -243,6 +302,37 @@ void patmos::PatmosBaseTool::PrepareLink3Inputs(
   // even if they are not directly called (e.g. for soft-float operations)
   LinkInputs.push_back(Args.MakeArgString(getLibPath("lib/libsyms.o")));
 
+  // Only link the library members the program needs. The archives are
+  // linked after libsyms.o, so the symbols it keeps are needed as well. The
+  // single-path entry functions need not be referenced, they are linked
+  // regardless.
+  if (Args.hasFlag(options::OPT_mpatmos_lazy_link,
+                   options::OPT_mno_patmos_lazy_link, false)) {
+    LinkInputs.push_back("--lazy-archives");
+
+    std::string Roots;
+    for (const Arg *A : Args.filtered(options::OPT_mllvm)) {
+      for (StringRef V : A->getValues()) {
+        if (V.consume_front("--mpatmos-singlepath=") && !V.empty()) {
+          Roots += Roots.empty() ? "" : ",";
+          Roots += V.str();
+        }
+      }
+    }
+    if (Args.hasArg(options::OPT_mpatmos_enable_cet)) {
+      for (const Arg *A : Args.filtered(options::OPT_mpatmos_cet_functions)) {
+        for (StringRef V : A->getValues()) {
+          Roots += Roots.empty() ? "" : ",";
+          Roots += V.str();
+        }
+      }
+    }
+    if (!Roots.empty()) {
+      LinkInputs.push_back(Args.MakeArgString("--lazy-archive-roots=" +
+                                              Roots));
+    }
+  }
+
   if(Args.hasArg(options::OPT_v)) {
     LinkInputs.push_back("-v");
   }
@@ -286,13 +376,113 @@ static std::string get_patmos_tool(const ToolChain &TC, StringRef ToolName)
   return ToolName.str();
 }
 
+/// Append a step with the arguments of a tool to the steps of a -cc1patmos
+/// command.
+static void AppendPipelineStep(ArgStringList &Pipeline, const char *ToolName,
+                               const ArgStringList &ToolArgs)
+{
+  if (!Pipeline.empty()) {
+    Pipeline.push_back("--");
+  }
+  Pipeline.push_back(ToolName);
+  Pipeline.append(ToolArgs.begin(), ToolArgs.end());
+}
+
+/// Check whether passes that need the whole program are enabled for code
+/// generation, i.e., the single-path transformation, the stack cache analysis,
+/// the method cache layout or the PML export.
+static bool NeedsWholeProgramCodeGen(const ArgList &Args)
+{
+  if (Args.hasArg(options::OPT_mpatmos_enable_cet)) {
+    return true;
+  }
+  for (const Arg *A : Args.filtered(options::OPT_mllvm)) {
+    for (StringRef V : A->getValues()) {
+      if (V == "--mpatmos-singlepath" ||
+          V.startswith("--mpatmos-singlepath=") ||
+          V.startswith("--mpatmos-enable-stack-cache-analysis") ||
+          V.startswith("--mpatmos-enable-method-cache-analysis") ||
+          V == "--mpatmos-merge-stack-cache-reserves" ||
+          V.startswith("--mpatmos-merge-stack-cache-reserves=") ||
+          V == "--mpatmos-method-cache-layout" ||
+          V.startswith("--mpatmos-method-cache-layout=") ||
+          V == "--mpatmos-serialize" || V.startswith("--mpatmos-serialize=") ||
+          V.startswith("--mpatmos-function-splitter-stats")) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/// Return the name of a backend option without leading dashes and value.
+static StringRef GetBackendOptionName(StringRef Option)
+{
+  return Option.ltrim('-').split('=').first;
+}
+
+/// Check whether a backend option is given again by a code generation
+/// configuration, which takes precedence.
+static bool IsOverriddenByConfig(StringRef Option,
+                                 const patmos::PatmosCodeGenConfig *Config)
+{
+  if (!Config) {
+    return false;
+  }
+  StringRef Name = GetBackendOptionName(Option);
+  return llvm::any_of(Config->Options, [&](const char *O) {
+    return GetBackendOptionName(O) == Name;
+  });
+}
+
+/// Insert the name of a code generation configuration before the extension
+/// of a file name, e.g., a.pml becomes a.<name>.pml.
+static const char *GetConfigFilename(const ArgList &Args, StringRef File,
+                                     StringRef ConfigName)
+{
+  SmallString<128> Path(File);
+  llvm::sys::path::replace_extension(Path,
+      ConfigName + llvm::sys::path::extension(File));
+  return Args.MakeArgString(Path);
+}
+
+/// Collect the code generation configurations given by -mpatmos-config, as
+/// <name>:<option>[,<option>...].
+static void
+GetCodeGenConfigs(Compilation &C, const ArgList &Args,
+                  SmallVectorImpl<patmos::PatmosCodeGenConfig> &Configs)
+{
+  for (const Arg *A : Args.filtered(options::OPT_mpatmos_config_EQ)) {
+    std::pair<StringRef, StringRef> Split = StringRef(A->getValue()).split(':');
+    if (Split.first.empty() ||
+        Split.first.find_first_of("/\\.") != StringRef::npos ||
+        llvm::any_of(Configs, [&](const patmos::PatmosCodeGenConfig &Config) {
+          return Config.Name == Split.first;
+        })) {
+      C.getDriver().Diag(diag::err_drv_invalid_value)
+        << A->getAsString(Args) << A->getValue();
+      continue;
+    }
+
+    patmos::PatmosCodeGenConfig Config;
+    Config.Name = Split.first;
+    SmallVector<StringRef, 4> Options;
+    Split.second.split(Options, ',', -1, false);
+    for (StringRef Option : Options) {
+      Config.Options.push_back(Args.MakeArgString(Option));
+    }
+    Configs.push_back(std::move(Config));
+  }
+}
+
 void patmos::PatmosBaseTool::ConstructLLVMLinkJob(const Tool &Creator,
                      Compilation &C, const JobAction &JA,
                      const InputInfo &Output,
                      const InputInfoList &Inputs,
                      const char *OutputFilename,
                      const ArgStringList &LinkInputs,
-                     const ArgList &Args) const
+                     const ArgList &Args,
+                     ArgStringList *Pipeline) const
 {
   ArgStringList CmdArgs;
 
@@ -324,6 +514,13 @@ void patmos::PatmosBaseTool::ConstructLLVMLinkJob(const Tool &Creator,
   //----------------------------------------------------------------------------
   // execute the linker command
 
+  if (Pipeline) {
+    AppendPipelineStep(*Pipeline, "llvm-link", CmdArgs);
+    return;
+  }
+
+  AddTimeTraceArgs(C, Args, Output, "llvm-link-", CmdArgs);
+
   const char *Exec = Args.MakeArgString(get_patmos_tool(TC, "llvm-link"));
   C.addCommand(std::make_unique<Command>(
       JA, Creator, ResponseFileSupport::AtFileCurCP(),
@@ -336,7 +533,8 @@ bool patmos::PatmosBaseTool::ConstructOptJob(const Tool &Creator,
                      const InputInfoList &Inputs,
                      const char *OutputFilename,
                      const char *InputFilename,
-                     const ArgList &Args) const
+                     const ArgList &Args,
+                     ArgStringList *Pipeline) const
 {
   ArgStringList OptArgs;
 
@@ -351,6 +549,7 @@ bool patmos::PatmosBaseTool::ConstructOptJob(const Tool &Creator,
     case '3': OptLevel = 3; break;
     // these two need to be > 0, otherwise no opt is triggered
     case 's': case 'z': OptLevel = 7; break;
+    case 'w': OptLevel = 2; break;
     }
   }
   if(OptLevel == 0) {
@@ -359,8 +558,17 @@ bool patmos::PatmosBaseTool::ConstructOptJob(const Tool &Creator,
   //----------------------------------------------------------------------------
   // append optimization options
 
-  // pass -O level to opt verbatim
-  OptArg->renderAsInput(Args, OptArgs);
+  if (Lvl == 'w') {
+    // -Owcet optimizes like -O2, without loop transformations that create
+    // loops with unknown bounds or hide the bounds of the original loops
+    OptArgs.push_back("-O2");
+    OptArgs.push_back("--disable-loop-unrolling");
+    OptArgs.push_back("--vectorize-loops=false");
+    OptArgs.push_back("--vectorize-slp=false");
+  } else {
+    // pass -O level to opt verbatim
+    OptArg->renderAsInput(Args, OptArgs);
+  }
 
   // for some reason, we need to add this manually
   OptArgs.push_back("--internalize");
@@ -382,6 +590,13 @@ bool patmos::PatmosBaseTool::ConstructOptJob(const Tool &Creator,
   //----------------------------------------------------------------------------
   // execute opt command
 
+  if (Pipeline) {
+    AppendPipelineStep(*Pipeline, "opt", OptArgs);
+    return true;
+  }
+
+  AddTimeTraceArgs(C, Args, Output, "opt-", OptArgs);
+
   const char *OptExec = Args.MakeArgString(get_patmos_tool(TC, "opt"));
   C.addCommand(std::make_unique<Command>(
       JA, Creator, ResponseFileSupport::AtFileCurCP(),
@@ -393,7 +608,9 @@ void patmos::PatmosBaseTool::ConstructLLCJob(const Tool &Creator,
     Compilation &C, const JobAction &JA,
     const InputInfo &Output, const InputInfoList &Inputs,
     const char *OutputFilename, const char *InputFilename,
-    const ArgList &Args) const
+    const ArgList &Args, ArgStringList *Pipeline,
+    ArrayRef<const char *> PartitionOutputs,
+    const PatmosCodeGenConfig *Config) const
 {
   ArgStringList LLCArgs;
 
@@ -418,6 +635,11 @@ void patmos::PatmosBaseTool::ConstructLLCJob(const Tool &Creator,
       // LLC does not support -Os, -Oz, uses -O2 instead
       LLCArgs.push_back("-O2");
       break;
+    case 'w':
+      // The WCET pipeline is configured by llc, see PatmosPassConfig
+      LLCArgs.push_back("-O2");
+      LLCArgs.push_back("--mpatmos-wcet");
+      break;
     default:
       // LLC doesn't support -Ofast/-O4/-O5.., uses -O3 instead
       LLCArgs.push_back("-O3");
@@ -428,6 +650,24 @@ void patmos::PatmosBaseTool::ConstructLLCJob(const Tool &Creator,
     LLCArgs.push_back("-O0");
   }
 
+  // Separate sections allow lld to garbage collect (--gc-sections) and fold
+  // (--icf) whole functions. The size words of the method-cache blocks are
+  // part of their function's section, so they are folded and removed along
+  // with the code.
+  // An incremental link places every function and data object on its own.
+  bool Incremental = Args.hasFlag(options::OPT_mpatmos_incremental_link,
+                                  options::OPT_mno_patmos_incremental_link,
+                                  false);
+  if (Incremental || Args.hasFlag(options::OPT_ffunction_sections,
+                                  options::OPT_fno_function_sections, false))
+    LLCArgs.push_back("--function-sections");
+  if (Incremental || Args.hasFlag(options::OPT_fdata_sections,
+                                  options::OPT_fno_data_sections, false))
+    LLCArgs.push_back("--data-sections");
+  // Needed by --icf=safe to not fold functions whose address is compared
+  if (Args.hasFlag(options::OPT_faddrsig, options::OPT_fno_addrsig, false))
+    LLCArgs.push_back("--addrsig");
+
   bool sp_enabled = false;
   bool const_exec_enabled = false;
   for (ArgList::const_iterator
@@ -444,7 +684,16 @@ void patmos::PatmosBaseTool::ConstructLLCJob(const Tool &Creator,
             std::string(v).rfind("--debug",0) == 0
         ){
           A->claim();
-          LLCArgs.push_back(v);
+          StringRef V(v);
+          if (IsOverriddenByConfig(V, Config)) {
+            // the option of the configuration is appended below
+          } else if (Config && V.consume_front("--mpatmos-serialize=")) {
+            // every configuration exports its own PML
+            LLCArgs.push_back(Args.MakeArgString(Twine("--mpatmos-serialize=") +
+                                GetConfigFilename(Args, V, Config->Name)));
+          } else {
+            LLCArgs.push_back(v);
+          }
         }
         if(std::string(v).rfind("--mpatmos-singlepath=",0) == 0 || std::string(v) == "--mpatmos-singlepath") {
           sp_enabled = true;
@@ -480,6 +729,17 @@ void patmos::PatmosBaseTool::ConstructLLCJob(const Tool &Creator,
     }
   }
 
+  // the linker removes ensures using the summaries of all object files
+  if (Args.hasFlag(options::OPT_mpatmos_link_stack_cache_analysis,
+                   options::OPT_mno_patmos_link_stack_cache_analysis, false)) {
+    LLCArgs.push_back("--mpatmos-emit-stack-cache-summary");
+  }
+
+  // the options of the configuration, taking precedence over -mllvm
+  if (Config) {
+    LLCArgs.append(Config->Options.begin(), Config->Options.end());
+  }
+
   //----------------------------------------------------------------------------
   // generate object file
 
@@ -492,11 +752,25 @@ void patmos::PatmosBaseTool::ConstructLLCJob(const Tool &Creator,
   LLCArgs.push_back("-o");
   LLCArgs.push_back(OutputFilename);
 
+  assert((Pipeline || PartitionOutputs.empty()) &&
+         "Only the integrated backend supports partitions");
+  for (const char *PartitionOutput : PartitionOutputs) {
+    LLCArgs.push_back("-o");
+    LLCArgs.push_back(PartitionOutput);
+  }
+
   //----------------------------------------------------------------------------
   // append linked BC name as input
 
   LLCArgs.push_back(InputFilename);
 
+  if (Pipeline) {
+    AppendPipelineStep(*Pipeline, "llc", LLCArgs);
+    return;
+  }
+
+  AddTimeTraceArgs(C, Args, Output, "llc-", LLCArgs);
+
   const char *LLCExec = Args.MakeArgString(get_patmos_tool(TC, "llc"));
   C.addCommand(std::make_unique<Command>(
       JA, Creator, ResponseFileSupport::AtFileCurCP(),
@@ -525,7 +799,8 @@ void patmos::PatmosBaseTool::ConstructLLDJob(const Tool &Creator,
     Compilation &C, const JobAction &JA,
     const InputInfo &Output, const InputInfoList &Inputs,
     const char *OutputFilename, const ArgStringList &LLDInputs,
-    const ArgList &Args, bool AddStackSymbols) const
+    const ArgList &Args, bool AddStackSymbols,
+    const PatmosCodeGenConfig *Config) const
 {
   ArgStringList LDArgs;
 
@@ -551,6 +826,40 @@ void patmos::PatmosBaseTool::ConstructLLDJob(const Tool &Creator,
     LDArgs.push_back("_stack_cache_base=0x200000");
   }
 
+  // lld sizes the clusters of its call-graph ordering for the method cache.
+  auto AddCacheSize = [&](StringRef V) {
+    if (V.consume_front("--mpatmos-method-cache-size=")) {
+      LDArgs.push_back(
+          Args.MakeArgString(Twine("--patmos-method-cache-size=") + V));
+    } else if (V.consume_front("--mpatmos-stack-cache-size=")) {
+      LDArgs.push_back(
+          Args.MakeArgString(Twine("--patmos-stack-cache-size=") + V));
+    }
+  };
+  for (const Arg *A : Args.filtered(options::OPT_mllvm)) {
+    for (StringRef V : A->getValues()) {
+      if (!IsOverriddenByConfig(V, Config)) {
+        AddCacheSize(V);
+      }
+    }
+  }
+  if (Config) {
+    for (StringRef V : Config->Options) {
+      AddCacheSize(V);
+    }
+  }
+
+  if (Args.hasFlag(options::OPT_mpatmos_link_stack_cache_analysis,
+                   options::OPT_mno_patmos_link_stack_cache_analysis, false)) {
+    LDArgs.push_back("--patmos-remove-ensures");
+  }
+
+  if (Args.hasFlag(options::OPT_mpatmos_incremental_link,
+                   options::OPT_mno_patmos_incremental_link, false)) {
+    LDArgs.push_back(Args.MakeArgString(Twine("--patmos-incremental=") +
+                                        OutputFilename + ".layout"));
+  }
+
   // Do not append arguments given from the Commandline before
   // setting the defaults
   for (ArgList::const_iterator
@@ -578,6 +887,10 @@ void patmos::PatmosBaseTool::ConstructLLDJob(const Tool &Creator,
   LDArgs.append(LLDInputs.begin(), LLDInputs.end());
 
   const char *LDExec = Args.MakeArgString(get_patmos_lld(TC, C.getDriver().getDiags()));
+  // gold given by PATMOS_GOLD does not record time traces
+  if (StringRef(llvm::sys::path::filename(LDExec)).contains("lld")) {
+    AddTimeTraceArgs(C, Args, Output, "lld-", LDArgs);
+  }
   C.addCommand(std::make_unique<Command>(
       JA, Creator, ResponseFileSupport::AtFileCurCP(),
       LDExec, LDArgs, Inputs, Output));
@@ -637,55 +950,213 @@ void patmos::FinalLink::ConstructJob(Compilation &C, const JobAction &JA,
                                const ArgList &Args,
                                const char *LinkingOutput) const
 {
+  // With the integrated backend, the llvm-link, opt and llc steps are run by
+  // a single clang -cc1patmos job, which keeps the intermediate modules in
+  // memory. -Xlinker options are only understood by llvm-link itself.
+  bool Integrated = Args.hasFlag(options::OPT_mpatmos_integrated_backend,
+                                 options::OPT_mno_patmos_integrated_backend,
+                                 false) &&
+                    !Args.hasArg(options::OPT_Xlinker);
+  ArgStringList PipelineSteps;
+  ArgStringList *Pipeline = Integrated ? &PipelineSteps : nullptr;
+
+  // With -ftime-trace, every sub-job writes a trace, which are merged into
+  // one trace next to the output, along with those of the compile jobs.
+  ArgStringList LinkTimeTraces;
+  TimeTraces = Args.hasArg(options::OPT_ftime_trace) && Output.isFilename() ?
+               &LinkTimeTraces : nullptr;
+
+  // With further configurations, the program is linked and optimized once,
+  // then every configuration runs its own llc and ld.lld jobs on it. The
+  // cl::opt backend options are global, so the configurations can only be
+  // generated by separate processes, also with the integrated backend.
+  SmallVector<PatmosCodeGenConfig, 4> Configs;
+  GetCodeGenConfigs(C, Args, Configs);
+  ArgStringList *CodeGenPipeline = Configs.empty() ? Pipeline : nullptr;
+
   //////////////////////////////////////////////////////////////////////////////
   // build LINK 1 command
-  const char *link1Out = CreateOutputFilename(C, Output, "link-", "bc", false);
+  const char *link1Out = CreateIntermediateName(C, Output, "link-", "bc",
+                                                Integrated);
   ArgStringList LinkInputs;
   PrepareLink1Inputs(Args, Inputs, LinkInputs);
-  ConstructLLVMLinkJob(*this, C, JA, Output, Inputs, link1Out, LinkInputs, Args);
+  ConstructLLVMLinkJob(*this, C, JA, Output, Inputs, link1Out, LinkInputs, Args,
+                       Pipeline);
 
   //////////////////////////////////////////////////////////////////////////////
   // build LINK 2 command
-  const char *link2Out = CreateOutputFilename(C, Output, "link12-", "bc", false);
+  const char *link2Out = CreateIntermediateName(C, Output, "link12-", "bc",
+                                                Integrated);
 
   ArgStringList Link2Inputs;
   PrepareLink2Inputs(Args, link1Out, Link2Inputs);
-  ConstructLLVMLinkJob(*this, C, JA, Output, Inputs, link2Out, Link2Inputs, Args);
+  ConstructLLVMLinkJob(*this, C, JA, Output, Inputs, link2Out, Link2Inputs,
+                       Args, Pipeline);
 
   //////////////////////////////////////////////////////////////////////////////
   // build LINK 3 command
-  const char *link3Out = CreateOutputFilename(C, Output, "link2-", "bc", false);
+  const char *link3Out = CreateIntermediateName(C, Output, "link2-", "bc",
+                                                Integrated);
 
   ArgStringList Link3Inputs;
   PrepareLink3Inputs(Args, link2Out, Link3Inputs);
-  ConstructLLVMLinkJob(*this, C, JA, Output, Inputs, link3Out, Link3Inputs, Args);
+  ConstructLLVMLinkJob(*this, C, JA, Output, Inputs, link3Out, Link3Inputs,
+                       Args, Pipeline);
 
   //////////////////////////////////////////////////////////////////////////////
   // build OPT command
 
-  const char* optOut = CreateOutputFilename(C, Output, "opt-", "opt.bc", false);
-  if (!ConstructOptJob( *this, C, JA, Output, Inputs, optOut, link3Out,  Args)) {
+  const char* optOut = CreateIntermediateName(C, Output, "opt-", "opt.bc",
+                                              Integrated);
+  if (!ConstructOptJob( *this, C, JA, Output, Inputs, optOut, link3Out,  Args,
+                       Pipeline)) {
     optOut = link3Out;
   }
 
   //////////////////////////////////////////////////////////////////////////////
   // build LINK 4
-  const char *link4Out = CreateOutputFilename(C, Output, "link3-", "bc", false);
+  const char *link4Out = CreateIntermediateName(C, Output, "link3-", "bc",
+                                                CodeGenPipeline != nullptr);
 
   ArgStringList Link4Inputs;
   PrepareLink4Inputs(Args, optOut, Link4Inputs);
-  ConstructLLVMLinkJob(*this, C, JA, Output, Inputs, link4Out, Link4Inputs, Args);
+  ConstructLLVMLinkJob(*this, C, JA, Output, Inputs, link4Out, Link4Inputs,
+                       Args, Pipeline);
 
   ////////////////////////////////////////////////////////////////////////////
   // build LLC command
   const char *llcOut = CreateOutputFilename(C, Output, "llc-", "bc", false);
-  ConstructLLCJob(*this, C, JA, Output, Inputs, llcOut,
-                  link4Out, Args);
+
+  ArgStringList PartitionOutputs;
+  if (Arg *A = Args.getLastArg(options::OPT_mpatmos_codegen_partitions_EQ)) {
+    unsigned Partitions;
+    if (StringRef(A->getValue()).getAsInteger(10, Partitions) ||
+        Partitions == 0) {
+      C.getDriver().Diag(diag::err_drv_invalid_int_value)
+        << A->getAsString(Args) << A->getValue();
+    } else if (!CodeGenPipeline || NeedsWholeProgramCodeGen(Args)) {
+      auto &Diag = C.getDriver().getDiags();
+      auto DiagID = Diag.getCustomDiagID(DiagnosticsEngine::Warning,
+                       "ignoring '%0', code generation needs the whole program "
+                       "with the given options");
+      Diag.Report(DiagID) << A->getAsString(Args);
+    } else {
+      for (unsigned i = 1; i < Partitions; i++) {
+        std::string Suffix = "p" + std::to_string(i) + ".o";
+        PartitionOutputs.push_back(CreateOutputFilename(C, Output, "llc-",
+                                       Args.MakeArgString(Suffix), false));
+      }
+    }
+  }
+
+  if (CodeGenPipeline) {
+    ConstructLLCJob(*this, C, JA, Output, Inputs, llcOut,
+                    link4Out, Args, Pipeline, PartitionOutputs);
+  }
+
+  if (Integrated) {
+    ArgStringList CC1Args;
+    CC1Args.push_back("-cc1patmos");
+    if (Args.hasArg(options::OPT_save_temps)) {
+      CC1Args.push_back("-save-temps");
+    }
+    if (Arg *A = Args.getLastArg(options::OPT_mpatmos_codegen_cache_EQ)) {
+      CC1Args.push_back(Args.MakeArgString(Twine("-codegen-cache=") +
+                                           A->getValue()));
+    }
+    if (Arg *A = Args.getLastArg(options::OPT_mpatmos_pipeline_cache_EQ)) {
+      CC1Args.push_back(Args.MakeArgString(Twine("-pipeline-cache=") +
+                                           A->getValue()));
+    }
+    AddTimeTraceArgs(C, Args, Output, "cc1patmos-", CC1Args);
+    CC1Args.append(PipelineSteps.begin(), PipelineSteps.end());
+
+    const char *Exec = Args.MakeArgString(C.getDriver().getClangProgramPath());
+    C.addCommand(std::make_unique<Command>(
+        JA, *this, ResponseFileSupport::AtFileCurCP(),
+        Exec, CC1Args, Inputs, Output));
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // build LLC and LD commands of the further configurations
+
+  // Every configuration has its own action, such that its jobs only wait for
+  // the jobs of this action constructed so far, i.e., the optimized program,
+  // see Compilation::ExecuteJobs. They thus run in parallel to each other and
+  // to the code generation of the default configuration with -mpatmos-jobs.
+  ActionList TraceInputs(1, const_cast<JobAction *>(&JA));
+  for (const PatmosCodeGenConfig &Config : Configs) {
+    ActionList ConfigInputs(1, const_cast<JobAction *>(&JA));
+    JobAction *ConfigJA =
+        C.MakeAction<LinkJobAction>(ConfigInputs, types::TY_Image);
+    TraceInputs.push_back(ConfigJA);
+
+    const char *ConfigFilename = Output.isFilename() ?
+        GetConfigFilename(Args, Output.getFilename(), Config.Name) :
+        Args.MakeArgString(Twine("a.") + Config.Name + ".out");
+    InputInfo ConfigOutput(types::TY_Image, ConfigFilename,
+                           Output.getBaseInput());
+    C.addResultFile(ConfigFilename, ConfigJA);
+
+    const char *ConfigLLCOut = CreateOutputFilename(C, Output, "llc-",
+        Args.MakeArgString(Config.Name + ".o"), false);
+    ConstructLLCJob(*this, C, *ConfigJA, ConfigOutput, Inputs, ConfigLLCOut,
+                    link4Out, Args, nullptr, {}, &Config);
+
+    ArgStringList ConfigLLDInputs;
+    ConfigLLDInputs.push_back(ConfigLLCOut);
+    ConstructLLDJob(*this, C, *ConfigJA, ConfigOutput, Inputs, ConfigFilename,
+                    ConfigLLDInputs, Args, true, &Config);
+  }
+
+  if (!CodeGenPipeline) {
+    ConstructLLCJob(*this, C, JA, Output, Inputs, llcOut,
+                    link4Out, Args, nullptr, PartitionOutputs);
+  }
 
   ArgStringList LLDInputs;
   LLDInputs.push_back(llcOut);
+  LLDInputs.append(PartitionOutputs.begin(), PartitionOutputs.end());
   ConstructLLDJob(*this, C, JA, Output, Inputs, Output.getFilename(),
       LLDInputs, Args, true);
 
+  //////////////////////////////////////////////////////////////////////////////
+  // build the command merging the time traces
+
+  if (TimeTraces) {
+    TimeTraces = nullptr;
+
+    ArgStringList MergeArgs;
+    MergeArgs.push_back("-cc1patmos");
+    MergeArgs.push_back("-merge-time-traces");
+    SmallString<128> TraceFile(Output.getFilename());
+    llvm::sys::path::replace_extension(TraceFile, "json");
+    MergeArgs.push_back("-o");
+    MergeArgs.push_back(Args.MakeArgString(TraceFile));
+
+    // clang -cc1 writes the trace of a compile job next to its output
+    for (const InputInfo &Input : Inputs) {
+      if (!Input.isFilename() || !Input.getAction() ||
+          isa<InputAction>(Input.getAction())) {
+        continue;
+      }
+      SmallString<128> CompileTrace(Input.getFilename());
+      llvm::sys::path::replace_extension(CompileTrace, "json");
+      const char *CompileTraceFile = Args.MakeArgString(CompileTrace);
+      if (!Args.hasArg(options::OPT_save_temps)) {
+        C.addTempFile(CompileTraceFile);
+      }
+      MergeArgs.push_back(CompileTraceFile);
+    }
+    MergeArgs.append(LinkTimeTraces.begin(), LinkTimeTraces.end());
+
+    // The merge waits for all jobs of the link, including those of the
+    // further configurations.
+    const JobAction *TraceJA =
+        C.MakeAction<LinkJobAction>(TraceInputs, types::TY_Image);
+    const char *Exec = Args.MakeArgString(C.getDriver().getClangProgramPath());
+    C.addCommand(std::make_unique<Command>(
+        *TraceJA, *this, ResponseFileSupport::AtFileCurCP(),
+        Exec, MergeArgs, Inputs, Output));
+  }
 }
-
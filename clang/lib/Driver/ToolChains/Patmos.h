@@ -38,6 +38,9 @@ public:
   Tool *SelectTool(const JobAction &JA) const override;
   void AddClangSystemIncludeArgs(const llvm::opt::ArgList &DriverArgs,
                               llvm::opt::ArgStringList &CC1Args) const override;
+  void addClangTargetOptions(const llvm::opt::ArgList &DriverArgs,
+                             llvm::opt::ArgStringList &CC1Args,
+                             Action::OffloadKind DeviceOffloadKind) const override;
   Tool *getPatmosCompile() const;
   Tool *getPatmosFinalLink() const;
 
@@ -47,6 +50,15 @@ public:
 
 namespace tools {
 namespace patmos {
+
+/// A further code generation configuration given by -mpatmos-config. The
+/// backend options replace the -mllvm options of the same name, the program
+/// and its PML export are written to files named after the configuration.
+struct PatmosCodeGenConfig {
+  llvm::StringRef Name;
+  llvm::SmallVector<const char *, 4> Options;
+};
+
 class PatmosBaseTool {
 public:
   PatmosBaseTool(const clang::driver::toolchains::PatmosToolChain &TC): TC(TC)
@@ -60,9 +72,27 @@ protected:
                                     const char *Suffix,
                                     bool IsLastPass) const;
 
+  /// Create the name of an intermediate file of the final link. If InMemory
+  /// is set and no -save-temps is given, the file is never written and a
+  /// placeholder name is returned.
+  const char * CreateIntermediateName(Compilation &C, const InputInfo &Output,
+                                      const char * TmpPrefix,
+                                      const char *Suffix,
+                                      bool InMemory) const;
+
+  /// The time traces written by the jobs of the final link being constructed,
+  /// if -ftime-trace is given.
+  mutable llvm::opt::ArgStringList *TimeTraces = nullptr;
+
+  /// Let a sub-job of the final link write a time trace, which is merged into
+  /// the trace of the link.
+  void AddTimeTraceArgs(Compilation &C, const llvm::opt::ArgList &Args,
+                        const InputInfo &Output, const char *TmpPrefix,
+                        llvm::opt::ArgStringList &ToolArgs) const;
+
   std::string getLibPath(const char* LibName) const;
   /// Get the last -O<Lvl> optimization level specifier. If no -O option is
-  /// given, return NULL.
+  /// given, return NULL. Lvl is 'w' for -Owcet.
   llvm::opt::Arg* GetOptLevel(const llvm::opt::ArgList &Args, char &Lvl) const;
 
   void PrepareLink1Inputs(const llvm::opt::ArgList &Args,
@@ -78,13 +108,19 @@ protected:
                        const char* Input,
                        llvm::opt::ArgStringList &LinkInputs) const;
 
+  // The llvm-link, opt and llc jobs append their tool and arguments as a step
+  // to Pipeline instead, if given, see FinalLink::ConstructJob. The outputs
+  // for further code generation partitions are only supported in a Pipeline.
+  // The llc and ld.lld jobs generate code for Config instead of the default
+  // configuration, if given.
   void ConstructLLVMLinkJob(const Tool &Creator, Compilation &C,
                         const JobAction &JA,
                         const InputInfo &Output,
                         const InputInfoList &Inputs,
                         const char *OutputFilename,
                         const llvm::opt::ArgStringList &LinkInputs,
-                        const llvm::opt::ArgList &TCArgs) const;
+                        const llvm::opt::ArgList &TCArgs,
+                        llvm::opt::ArgStringList *Pipeline = nullptr) const;
 
   // Construct an optimization job
   // @IsLinkPass - If true, add standard link optimizations
@@ -94,7 +130,8 @@ protected:
                        const InputInfoList &Inputs,
                        const char *OutputFilename,
                        const char *InputFilename,
-                       const llvm::opt::ArgList &TCArgs) const;
+                       const llvm::opt::ArgList &TCArgs,
+                       llvm::opt::ArgStringList *Pipeline = nullptr) const;
 
   void ConstructLLCJob(const Tool &Creator, Compilation &C,
                     const JobAction &JA,
@@ -102,7 +139,10 @@ protected:
                     const InputInfoList &Inputs,
                     const char *OutputFilename,
                     const char *InputFilename,
-                    const llvm::opt::ArgList &TCArgs) const;
+                    const llvm::opt::ArgList &TCArgs,
+                    llvm::opt::ArgStringList *Pipeline = nullptr,
+                    llvm::ArrayRef<const char *> PartitionOutputs = {},
+                    const PatmosCodeGenConfig *Config = nullptr) const;
 
   void ConstructLLDJob(const Tool &Creator, Compilation &C,
                         const JobAction &JA,
@@ -111,7 +151,8 @@ protected:
                         const char *OutputFilename,
                         const llvm::opt::ArgStringList &LLDInputs,
                         const llvm::opt::ArgList &TCArgs,
-                        bool AddStackSymbols) const;
+                        bool AddStackSymbols,
+                        const PatmosCodeGenConfig *Config = nullptr) const;
 };
 
 class LLVM_LIBRARY_VISIBILITY Compile : public Clang, protected PatmosBaseTool
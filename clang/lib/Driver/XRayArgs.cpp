@@ -56,6 +56,8 @@ XRayArgs::XRayArgs(const ToolChain &TC, const ArgList &Args) {
       D.Diag(diag::err_drv_clang_unsupported)
           << (std::string(XRayInstrumentOption) + " on " + Triple.str());
     }
+  } else if (Triple.getArch() == llvm::Triple::patmos) {
+    // The sleds are patched by the runtime in the builtins of Patmos.
   } else if (Triple.getOS() == llvm::Triple::Fuchsia) {
     switch (Triple.getArch()) {
     case llvm::Triple::x86_64:
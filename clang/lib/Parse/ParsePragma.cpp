@@ -250,6 +250,12 @@ struct PragmaLoopboundHandler : public PragmaHandler {
                     Token &FirstToken) override;
 };
 
+struct PragmaSinglePathHandler : public PragmaHandler {
+  PragmaSinglePathHandler() : PragmaHandler("singlepath") {}
+  void HandlePragma(Preprocessor &PP, PragmaIntroducer Introducer,
+                    Token &FirstToken) override;
+};
+
 struct PragmaMSRuntimeChecksHandler : public EmptyPragmaHandler {
   PragmaMSRuntimeChecksHandler() : EmptyPragmaHandler("runtime_checks") {}
 };
@@ -407,6 +413,9 @@ void Parser::initializePragmaHandlers() {
   LoopboundHandler = std::make_unique<PragmaLoopboundHandler>();
   PP.AddPragmaHandler(LoopboundHandler.get());
 
+  SinglePathHandler = std::make_unique<PragmaSinglePathHandler>();
+  PP.AddPragmaHandler("patmos", SinglePathHandler.get());
+
   UnrollHintHandler = std::make_unique<PragmaUnrollHintHandler>("unroll");
   PP.AddPragmaHandler(UnrollHintHandler.get());
 
@@ -529,6 +538,9 @@ void Parser::resetPragmaHandlers() {
   PP.RemovePragmaHandler(LoopboundHandler.get());
   LoopboundHandler.reset();
 
+  PP.RemovePragmaHandler("patmos", SinglePathHandler.get());
+  SinglePathHandler.reset();
+
   PP.RemovePragmaHandler(UnrollHintHandler.get());
   UnrollHintHandler.reset();
 
@@ -1328,6 +1340,16 @@ void Parser::HandlePragmaLoopbound(Loopbound &LB) {
         SourceRange(Info->PragmaName.getLocation(), Info->Max.getLocation());
 }
 
+IdentifierLoc *Parser::HandlePragmaSinglePath() {
+  assert(Tok.is(tok::annot_pragma_singlepath));
+
+  Token *PragmaName = static_cast<Token *>(Tok.getAnnotationValue());
+  ConsumeAnnotationToken();
+
+  return IdentifierLoc::create(Actions.Context, PragmaName->getLocation(),
+                               PragmaName->getIdentifierInfo());
+}
+
 namespace {
 struct PragmaAttributeInfo {
   enum ActionType { Push, Pop, Attribute };
@@ -3478,6 +3500,27 @@ void PragmaLoopboundHandler::HandlePragma(Preprocessor &PP,
 
 }
 
+// #pragma patmos singlepath
+void PragmaSinglePathHandler::HandlePragma(Preprocessor &PP,
+                                           PragmaIntroducer Introducer,
+                                           Token &Tok) {
+  Token *PragmaName = new (PP.getPreprocessorAllocator()) Token(Tok);
+
+  PP.Lex(Tok);
+  if (Tok.isNot(tok::eod))
+    PP.Diag(Tok.getLocation(), diag::warn_pragma_extra_tokens_at_eol)
+        << "patmos singlepath";
+
+  auto TokenArray = std::make_unique<Token[]>(1);
+  TokenArray[0].startToken();
+  TokenArray[0].setKind(tok::annot_pragma_singlepath);
+  TokenArray[0].setLocation(Introducer.Loc);
+  TokenArray[0].setAnnotationEndLoc(PragmaName->getLocation());
+  TokenArray[0].setAnnotationValue(static_cast<void *>(PragmaName));
+  PP.EnterTokenStream(std::move(TokenArray), 1, /*DisableMacroExpansion=*/false,
+                      /*IsReinject=*/false);
+}
+
 /// Handle the Microsoft \#pragma intrinsic extension.
 ///
 /// The syntax is:
@@ -418,6 +418,10 @@ Retry:
     ProhibitAttributes(Attrs);
     return ParsePragmaLoopbound(Stmts, StmtCtx, TrailingElseLoc, Attrs);
 
+  case tok::annot_pragma_singlepath:
+    ProhibitAttributes(Attrs);
+    return ParsePragmaSinglePath(Stmts, StmtCtx, TrailingElseLoc, Attrs);
+
   case tok::annot_pragma_dump:
     HandlePragmaDump();
     return StmtEmpty();
@@ -2273,6 +2277,30 @@ StmtResult Parser::ParsePragmaLoopbound(StmtVector &Stmts,
   return S;
 }
 
+StmtResult Parser::ParsePragmaSinglePath(StmtVector &Stmts,
+                                         ParsedStmtContext StmtCtx,
+                                         SourceLocation *TrailingElseLoc,
+                                         ParsedAttributesWithRange &Attrs) {
+  // Create temporary attribute list.
+  ParsedAttributesWithRange TempAttrs(AttrFactory);
+
+  // Consume the annotated token, repeating the pragma has no further effect.
+  while (Tok.is(tok::annot_pragma_singlepath)) {
+    IdentifierLoc *PragmaNameLoc = HandlePragmaSinglePath();
+    TempAttrs.addNew(PragmaNameLoc->Ident, PragmaNameLoc->Loc, nullptr,
+                     PragmaNameLoc->Loc, nullptr, 0, ParsedAttr::AS_Pragma);
+  }
+
+  // Get the next statement.
+  MaybeParseCXX11Attributes(Attrs);
+
+  StmtResult S = ParseStatementOrDeclarationAfterAttributes(
+      Stmts, StmtCtx, TrailingElseLoc, Attrs);
+
+  Attrs.takeAllFrom(TempAttrs);
+  return S;
+}
+
 Decl *Parser::ParseFunctionStatementBody(Decl *Decl, ParseScope &BodyScope) {
   assert(Tok.is(tok::l_brace));
   SourceLocation LBraceLoc = Tok.getLocation();
@@ -225,6 +225,20 @@ static Attr *handleLoopboundAttr(Sema &S, Stmt *St, const ParsedAttr &A,
       (int) MinInt.getExtValue(), (int) MaxInt.getExtValue());
 }
 
+static Attr *handleLoopSinglePathAttr(Sema &S, Stmt *St, const ParsedAttr &A,
+                                     SourceRange Range) {
+  if (St->getStmtClass() != Stmt::DoStmtClass &&
+      St->getStmtClass() != Stmt::ForStmtClass &&
+      St->getStmtClass() != Stmt::CXXForRangeStmtClass &&
+      St->getStmtClass() != Stmt::WhileStmtClass) {
+    S.Diag(St->getBeginLoc(), diag::err_pragma_loop_precedes_nonloop)
+       << "#pragma patmos singlepath";
+    return nullptr;
+  }
+
+  return ::new (S.Context) LoopSinglePathAttr(S.Context, A);
+}
+
 namespace {
 class CallExprFinder : public ConstEvaluatedExprVisitor<CallExprFinder> {
   bool FoundCallExpr = false;
@@ -471,6 +485,8 @@ static Attr *ProcessStmtAttribute(Sema &S, Stmt *St, const ParsedAttr &A,
     return handleLoopHintAttr(S, St, A, Range);
   case ParsedAttr::AT_LoopBound:
     return handleLoopboundAttr(S, St, A, Range);
+  case ParsedAttr::AT_LoopSinglePath:
+    return handleLoopSinglePathAttr(S, St, A, Range);
   case ParsedAttr::AT_OpenCLUnrollHint:
     return handleOpenCLUnrollHint(S, St, A, Range);
   case ParsedAttr::AT_Suppress:
@@ -0,0 +1,1245 @@
+//===-- cc1patmos_main.cpp - Clang Patmos Backend Pipeline ----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This is the entry point to the clang -cc1patmos functionality, which runs
+// the llvm-link, opt and llc steps of the Patmos final link in one process,
+// on a single LLVMContext. It is used by the Patmos driver when
+// -mpatmos-integrated-backend is given.
+//
+// The arguments are a sequence of steps separated by "--". Each step is the
+// name of the tool followed by the subset of its arguments the driver uses:
+//
+//   llvm-link -o <file> [-v] [--internalize] [--override=<file>]
+//             [--lazy-archives] [--lazy-archive-roots=<list>] <file>...
+//   opt       -o <file> -O<level> [--internalize] [--globaldce]
+//             [--std-link-opts] <file>
+//   llc       -o <file> [-o <file>...] -O<level> -filetype=obj
+//             [<backend option>...] <file>
+//
+// The input of llc is its last argument. If llc is given more than one output,
+// the module is split into one partition per output, which are compiled on
+// parallel threads. With -codegen-cache=<dir> before the first step, the
+// object code of the partitions is cached in <dir> across compilations.
+//
+// With -pipeline-cache=<dir> before the first step, the outputs of whole steps
+// are cached in <dir>. A step is keyed by its options and the contents of its
+// input files, or the keys of the steps producing them, and the outputs of
+// llc include the files the backend writes besides the object code, such as
+// the PML export. Steps whose outputs are cached, and the steps only needed
+// for them, are not run.
+//
+// An input naming the output of an earlier step is taken from memory. The
+// outputs of the steps other than the last are only written if -save-temps is
+// given before the first step.
+//
+// With -time-trace before the first step, a Chrome trace of the steps and
+// their passes is written to the file given by -time-trace-file=<file>, with
+// the minimum duration of the recorded events given by
+// -time-trace-granularity=<us>, as llc does.
+//
+// Invoked as -merge-time-traces -o <file> <trace>..., the traces written by
+// the sub-jobs of a Patmos link are merged into a single trace, with one
+// process per input on a common time line. Missing inputs are skipped.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/Version.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/BinaryFormat/Magic.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/CodeGen/TargetPassConfig.h"
+#include "llvm/IR/AutoUpgrade.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/LazyArchiveLinker.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Object/Archive.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include <memory>
+using namespace llvm;
+
+namespace {
+
+/// A single tool invocation of the pipeline.
+struct PipelineStep {
+  StringRef Tool;
+  StringRef Output;
+  SmallVector<StringRef, 8> Inputs;
+  /// All options but the output file, in command line order.
+  SmallVector<StringRef, 8> Options;
+  /// Further outputs of llc, each receiving a partition of the module.
+  SmallVector<StringRef, 4> Partitions;
+};
+
+/// Backend options enabling passes that need the whole program, i.e., the
+/// single-path transformation, the stack and method cache analyses, the
+/// stack cache reserve merging, the method cache layout and the PML export, or
+/// that write a single file for the whole program.
+const char *const WholeProgramOptions[] = {
+  "mpatmos-singlepath",
+  "mpatmos-enable-stack-cache-analysis",
+  "mpatmos-enable-method-cache-analysis",
+  "mpatmos-merge-stack-cache-reserves",
+  "mpatmos-method-cache-layout",
+  "mpatmos-serialize",
+  "mpatmos-function-splitter-stats"
+};
+
+/// Backend options naming a file the backend reads, whose contents are part of
+/// the key of llc in the pipeline cache.
+const char *const BackendInputOptions[] = {
+  "mpatmos-function-splitter-wcet-profile",
+  "mpatmos-stack-cache-analysis-bounds",
+  "mpatmos-hw-config",
+  "mpatmos-sca-summaries"
+};
+
+/// Backend options naming a file the backend writes besides the object code,
+/// which the pipeline cache keeps along with it.
+const char *const BackendOutputOptions[] = {
+  "mpatmos-serialize",
+  "mpatmos-sca-serialize",
+  "mpatmos-sca-summaries",
+  "mpatmos-function-splitter-stats",
+  "mpatmos-dcache-elimination-report",
+  "mpatmos-singlepath-cycle-report"
+};
+
+/// Runs the steps of a -cc1patmos invocation.
+class PatmosPipeline {
+  const char *Argv0;
+  LLVMContext Context;
+  bool SaveTemps = false;
+
+  /// Directory caching the object code of llc partitions, if any.
+  std::string CacheDir;
+
+  /// The backend options of llc, as part of the cache key.
+  std::string BackendOptions;
+
+  /// Directory caching the outputs of whole steps, if any.
+  std::string PipelineCacheDir;
+
+  /// Record a time trace of the steps into TimeTraceFile.
+  bool TimeTrace = false;
+  std::string TimeTraceFile;
+  unsigned TimeTraceGranularity = 500;
+
+  /// The files the backend reads and writes, from the backend options.
+  SmallVector<std::string, 4> BackendInputs;
+  SmallVector<std::string, 4> BackendOutputs;
+
+  /// Outputs of earlier steps that have not been consumed yet.
+  StringMap<std::unique_ptr<Module>> Results;
+
+  bool error(const Twine &Msg) {
+    WithColor::error(errs(), Argv0) << Msg << "\n";
+    return false;
+  }
+
+  std::unique_ptr<Module> loadFile(StringRef File, bool Verbose);
+  std::unique_ptr<Module> loadArchive(std::unique_ptr<MemoryBuffer> Buffer,
+                                      bool Verbose);
+  std::unique_ptr<Module> takeInput(StringRef File, bool Verbose);
+
+  bool linkFiles(Linker &L, ArrayRef<StringRef> Files, unsigned Flags,
+                 bool Internalize, bool Verbose, LazyArchiveLinker *Lazy);
+
+  const Target *lookupTarget(Module &M);
+
+  bool runLink(const PipelineStep &S, std::unique_ptr<Module> &M);
+  bool runOpt(const PipelineStep &S, std::unique_ptr<Module> &M);
+  bool runLLC(const PipelineStep &S, std::unique_ptr<Module> &M);
+  bool runSplitLLC(const PipelineStep &S, std::unique_ptr<Module> &M,
+                   const Target *T, CodeGenOpt::Level CGLevel);
+
+  bool writeBitcode(Module &M, StringRef File);
+
+  void findBackendFiles(ArrayRef<const char *> BackendArgs);
+  bool computeStepKeys(ArrayRef<PipelineStep> Steps,
+                       SmallVectorImpl<std::string> &Keys);
+  std::string getPipelineCacheFile(StringRef Key) const;
+  void storeStep(const PipelineStep &S, Module *M, StringRef Key);
+  bool restoreStep(const PipelineStep &S, MemoryBufferRef Entry, bool IsLast);
+
+public:
+  PatmosPipeline(const char *Argv0) : Argv0(Argv0) {
+    Context.enableDebugTypeODRUniquing();
+  }
+
+  int run(ArrayRef<const char *> Argv);
+};
+
+} // end anonymous namespace
+
+/// Parse an -O<level> option of opt or llc.
+static bool parseOptLevel(StringRef Opt, unsigned &OptLevel,
+                          unsigned &SizeLevel) {
+  if (!Opt.consume_front("-O") || Opt.size() != 1)
+    return false;
+  SizeLevel = 0;
+  switch (Opt[0]) {
+  case '0': case '1': case '2': case '3':
+    OptLevel = Opt[0] - '0';
+    return true;
+  case 's': OptLevel = 2; SizeLevel = 1; return true;
+  case 'z': OptLevel = 2; SizeLevel = 2; return true;
+  }
+  return false;
+}
+
+std::unique_ptr<Module> PatmosPipeline::loadFile(StringRef File,
+                                                 bool Verbose) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      MemoryBuffer::getFileOrSTDIN(File);
+  if (!Buffer) {
+    error("cannot open '" + File + "': " + Buffer.getError().message());
+    return nullptr;
+  }
+
+  if (identify_magic((*Buffer)->getBuffer()) == file_magic::archive)
+    return loadArchive(std::move(*Buffer), Verbose);
+
+  if (Verbose)
+    errs() << "Loading '" << File << "'\n";
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = getLazyIRModule(std::move(*Buffer), Err,
+                                              Context);
+  if (!M) {
+    Err.print(Argv0, errs());
+    return nullptr;
+  }
+  if (Error E = M->materializeMetadata()) {
+    error("loading '" + File + "': " + toString(std::move(E)));
+    return nullptr;
+  }
+  UpgradeDebugInfo(*M);
+  return M;
+}
+
+/// Link all bitcode members of an archive into one module, as llvm-link
+/// does.
+std::unique_ptr<Module>
+PatmosPipeline::loadArchive(std::unique_ptr<MemoryBuffer> Buffer,
+                            bool Verbose) {
+  StringRef ArchiveName = Buffer->getBufferIdentifier();
+  if (Verbose)
+    errs() << "Reading library archive file '" << ArchiveName
+           << "' to memory\n";
+
+  Error Err = Error::success();
+  object::Archive Archive(*Buffer, Err);
+  if (Err) {
+    error("reading '" + ArchiveName + "': " + toString(std::move(Err)));
+    return nullptr;
+  }
+
+  std::unique_ptr<Module> Result(new Module("ArchiveModule", Context));
+  Linker L(*Result);
+  for (const object::Archive::Child &C : Archive.children(Err)) {
+    Expected<StringRef> Name = C.getName();
+    Expected<MemoryBufferRef> MemBuf = C.getMemoryBufferRef();
+    if (!Name || !MemBuf) {
+      consumeError(Name.takeError());
+      consumeError(MemBuf.takeError());
+      error("failed to read a member of archive '" + ArchiveName + "'");
+      return nullptr;
+    }
+    if (!isBitcode((const unsigned char *)MemBuf->getBufferStart(),
+                   (const unsigned char *)MemBuf->getBufferEnd())) {
+      error("member of archive is not a bitcode file: '" + *Name + "'");
+      return nullptr;
+    }
+
+    if (Verbose)
+      errs() << "Parsing member '" << *Name
+             << "' of archive library to module.\n";
+    SMDiagnostic ParseErr;
+    std::unique_ptr<Module> M = getLazyIRModule(
+        MemoryBuffer::getMemBuffer(*MemBuf, false), ParseErr, Context);
+    if (!M) {
+      ParseErr.print(Argv0, errs());
+      error("parsing member '" + *Name + "' of archive library failed '" +
+            ArchiveName + "'");
+      return nullptr;
+    }
+    if (Verbose)
+      errs() << "Linking member '" << *Name << "' of archive library.\n";
+    if (L.linkInModule(std::move(M)))
+      return nullptr;
+  }
+  if (Err) {
+    error("reading '" + ArchiveName + "': " + toString(std::move(Err)));
+    return nullptr;
+  }
+  return Result;
+}
+
+/// Take the output of an earlier step, or load the file from disk.
+std::unique_ptr<Module> PatmosPipeline::takeInput(StringRef File,
+                                                  bool Verbose) {
+  StringMap<std::unique_ptr<Module>>::iterator R = Results.find(File);
+  if (R == Results.end())
+    return loadFile(File, Verbose);
+
+  std::unique_ptr<Module> M = std::move(R->second);
+  Results.erase(R);
+  return M;
+}
+
+static void internalizeLinkedSymbols(Module &M, const StringSet<> &GVS) {
+  internalizeModule(M, [&GVS](const GlobalValue &GV) {
+    return !GV.hasName() || (GVS.count(GV.getName()) == 0);
+  });
+}
+
+/// Link the files in order, with the same semantics as llvm-link: flags and
+/// internalization do not apply to the first file. With Lazy, archives on disk
+/// are only added to it.
+bool PatmosPipeline::linkFiles(Linker &L, ArrayRef<StringRef> Files,
+                               unsigned Flags, bool Internalize,
+                               bool Verbose, LazyArchiveLinker *Lazy) {
+  unsigned ApplicableFlags = Flags & Linker::Flags::OverrideFromSrc;
+  bool InternalizeLinkedSymbols = false;
+  for (ArrayRef<StringRef>::iterator i = Files.begin(), ie = Files.end();
+       i != ie; ++i) {
+    file_magic Magic;
+    if (Lazy && !Results.count(*i) && !identify_magic(*i, Magic) &&
+        Magic == file_magic::archive) {
+      ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+          MemoryBuffer::getFile(*i);
+      if (!Buffer)
+        return error("cannot open '" + *i + "': " +
+                     Buffer.getError().message());
+      LazyArchiveLinker::InternalizeCallbackTy InternalizeCallback;
+      if (InternalizeLinkedSymbols)
+        InternalizeCallback = internalizeLinkedSymbols;
+      if (Error E = Lazy->addArchive(std::move(*Buffer), ApplicableFlags,
+                                     std::move(InternalizeCallback)))
+        return error("loading file '" + *i + "': " + toString(std::move(E)));
+
+      InternalizeLinkedSymbols = Internalize;
+      ApplicableFlags = Flags;
+      continue;
+    }
+
+    std::unique_ptr<Module> M = takeInput(*i, Verbose);
+    if (!M)
+      return error("loading file '" + *i + "'");
+
+    if (Verbose)
+      errs() << "Linking in '" << *i << "'\n";
+
+    bool Err;
+    if (InternalizeLinkedSymbols) {
+      Err = L.linkInModule(std::move(M), ApplicableFlags,
+                           internalizeLinkedSymbols);
+    } else {
+      Err = L.linkInModule(std::move(M), ApplicableFlags);
+    }
+    if (Err)
+      return false;
+
+    InternalizeLinkedSymbols = Internalize;
+    ApplicableFlags = Flags;
+  }
+  return true;
+}
+
+bool PatmosPipeline::runLink(const PipelineStep &S,
+                             std::unique_ptr<Module> &M) {
+  bool Internalize = false, Verbose = false, LazyArchives = false;
+  SmallVector<StringRef, 4> Overrides, Roots;
+  for (StringRef Opt : S.Options) {
+    if (Opt == "--internalize")
+      Internalize = true;
+    else if (Opt == "-v")
+      Verbose = true;
+    else if (Opt == "--lazy-archives")
+      LazyArchives = true;
+    else if (Opt.consume_front("--lazy-archive-roots="))
+      Opt.split(Roots, ',', -1, false);
+    else if (Opt.consume_front("--override="))
+      Overrides.push_back(Opt);
+    else
+      return error("unsupported llvm-link option '" + Opt + "'");
+  }
+
+  std::unique_ptr<Module> Composite(new Module("llvm-link", Context));
+  Linker L(*Composite);
+  std::unique_ptr<LazyArchiveLinker> Lazy;
+  if (LazyArchives) {
+    Lazy = std::make_unique<LazyArchiveLinker>(L, *Composite, Verbose);
+    for (StringRef Root : Roots)
+      Lazy->addRoot(Root);
+  }
+  if (!linkFiles(L, S.Inputs, Linker::Flags::None, Internalize, Verbose,
+                 Lazy.get()) ||
+      !linkFiles(L, Overrides, Linker::Flags::OverrideFromSrc, Internalize,
+                 Verbose, Lazy.get()))
+    return false;
+
+  if (Lazy) {
+    if (Error E = Lazy->link())
+      return error(toString(std::move(E)));
+  }
+
+  if (verifyModule(*Composite, &errs()))
+    return error("linked module is broken!");
+
+  M = std::move(Composite);
+  return true;
+}
+
+const Target *PatmosPipeline::lookupTarget(Module &M) {
+  std::string Err;
+  const Target *T = TargetRegistry::lookupTarget(M.getTargetTriple(), Err);
+  if (!T)
+    error(Err);
+  return T;
+}
+
+/// Run the same legacy pass pipeline as opt with the given options.
+bool PatmosPipeline::runOpt(const PipelineStep &S,
+                            std::unique_ptr<Module> &M) {
+  unsigned OptLevel = 0, SizeLevel = 0;
+  bool Internalize = false, GlobalDCE = false, StdLinkOpts = false;
+  bool DisableUnrolling = false, DisableLoopVec = false, DisableSLPVec = false;
+  for (StringRef Opt : S.Options) {
+    if (Opt == "--disable-loop-unrolling")
+      DisableUnrolling = true;
+    else if (Opt == "--vectorize-loops=false")
+      DisableLoopVec = true;
+    else if (Opt == "--vectorize-slp=false")
+      DisableSLPVec = true;
+    else if (Opt == "--internalize")
+      Internalize = true;
+    else if (Opt == "--globaldce")
+      GlobalDCE = true;
+    else if (Opt == "--std-link-opts")
+      StdLinkOpts = true;
+    else if (!parseOptLevel(Opt, OptLevel, SizeLevel))
+      return error("unsupported opt option '" + Opt + "'");
+  }
+  if (S.Inputs.size() != 1)
+    return error("opt expects a single input");
+
+  M = takeInput(S.Inputs[0], false);
+  if (!M)
+    return false;
+
+  // opt only uses a target machine if the module has a triple.
+  std::unique_ptr<TargetMachine> TM;
+  if (!M->getTargetTriple().empty()) {
+    const Target *T = lookupTarget(*M);
+    if (!T)
+      return false;
+    CodeGenOpt::Level CGLevel = SizeLevel ? CodeGenOpt::None :
+                     OptLevel == 1 ? CodeGenOpt::Less :
+                     OptLevel == 2 ? CodeGenOpt::Default :
+                     OptLevel == 3 ? CodeGenOpt::Aggressive : CodeGenOpt::None;
+    TM.reset(T->createTargetMachine(M->getTargetTriple(), "", "",
+                                    TargetOptions(), None, None, CGLevel));
+  }
+
+  legacy::PassManager Passes;
+  TargetLibraryInfoImpl TLII(Triple(M->getTargetTriple()));
+  Passes.add(new TargetLibraryInfoWrapperPass(TLII));
+  Passes.add(createTargetTransformInfoWrapperPass(
+      TM ? TM->getTargetIRAnalysis() : TargetIRAnalysis()));
+
+  legacy::FunctionPassManager FPasses(M.get());
+  FPasses.add(createTargetTransformInfoWrapperPass(
+      TM ? TM->getTargetIRAnalysis() : TargetIRAnalysis()));
+
+  if (TM)
+    Passes.add(static_cast<LLVMTargetMachine &>(*TM).createPassConfig(Passes));
+
+  // The driver gives the passes after the -O option, thus opt adds them
+  // after the optimization pipeline.
+  FPasses.add(createVerifierPass());
+  PassManagerBuilder Builder;
+  Builder.OptLevel = OptLevel;
+  Builder.SizeLevel = SizeLevel;
+  if (OptLevel > 1)
+    Builder.Inliner = createFunctionInliningPass(OptLevel, SizeLevel, false);
+  else
+    Builder.Inliner = createAlwaysInlinerLegacyPass();
+  Builder.DisableUnrollLoops = OptLevel == 0 || DisableUnrolling;
+  Builder.LoopVectorize = OptLevel > 1 && SizeLevel < 2 && !DisableLoopVec;
+  Builder.SLPVectorize = OptLevel > 1 && SizeLevel < 2 && !DisableSLPVec;
+  if (TM)
+    TM->adjustPassManager(Builder);
+  Builder.populateFunctionPassManager(FPasses);
+  Builder.populateModulePassManager(Passes);
+
+  if (Internalize)
+    Passes.add(createInternalizePass());
+  if (GlobalDCE)
+    Passes.add(createGlobalDCEPass());
+
+  // -std-link-opts is given last, thus opt adds the link passes last.
+  if (StdLinkOpts) {
+    PassManagerBuilder LinkBuilder;
+    LinkBuilder.VerifyInput = true;
+    LinkBuilder.Inliner = createFunctionInliningPass();
+    LinkBuilder.populateLTOPassManager(Passes);
+  }
+
+  FPasses.doInitialization();
+  for (Function &F : *M)
+    FPasses.run(F);
+  FPasses.doFinalization();
+
+  Passes.add(createVerifierPass());
+  Passes.run(*M);
+  return true;
+}
+
+bool PatmosPipeline::runLLC(const PipelineStep &S,
+                            std::unique_ptr<Module> &M) {
+  unsigned OptLevel = 0, SizeLevel = 0;
+  // all other options are backend options, which have been parsed before
+  // running the first step
+  for (StringRef Opt : S.Options)
+    parseOptLevel(Opt, OptLevel, SizeLevel);
+  if (SizeLevel)
+    return error("llc does not support -Os or -Oz");
+  if (S.Inputs.size() != 1)
+    return error("llc expects a single input");
+
+  M = takeInput(S.Inputs[0], false);
+  if (!M)
+    return false;
+
+  const Target *T = lookupTarget(*M);
+  if (!T)
+    return false;
+  CodeGenOpt::Level CGLevel = OptLevel == 0 ? CodeGenOpt::None :
+                              OptLevel == 1 ? CodeGenOpt::Less :
+                              OptLevel == 2 ? CodeGenOpt::Default :
+                                              CodeGenOpt::Aggressive;
+  std::unique_ptr<TargetMachine> TM(T->createTargetMachine(
+      M->getTargetTriple(), "", "", TargetOptions(), None, None, CGLevel));
+  M->setDataLayout(TM->createDataLayout());
+
+  if (!S.Partitions.empty() || !CacheDir.empty())
+    return runSplitLLC(S, M, T, CGLevel);
+
+  std::error_code EC;
+  ToolOutputFile Out(S.Output, EC, sys::fs::OF_None);
+  if (EC)
+    return error("cannot open '" + S.Output + "': " + EC.message());
+
+  legacy::PassManager PM;
+  TargetLibraryInfoImpl TLII(Triple(M->getTargetTriple()));
+  PM.add(new TargetLibraryInfoWrapperPass(TLII));
+
+  LLVMTargetMachine &LLVMTM = static_cast<LLVMTargetMachine &>(*TM);
+  MachineModuleInfoWrapperPass *MMIWP =
+      new MachineModuleInfoWrapperPass(&LLVMTM);
+  if (TM->addPassesToEmitFile(PM, Out.os(), nullptr, CGFT_ObjectFile, false,
+                              MMIWP))
+    return error("target does not support generation of object files");
+
+  PM.run(*M);
+  Out.keep();
+  M.reset();
+  return true;
+}
+
+/// Generate the object code of a module in its own context.
+static void compilePartition(const SmallString<0> &BC, raw_pwrite_stream &OS,
+                             const std::function<TargetMachine *()> &CreateTM,
+                             StringRef CacheFile) {
+  LLVMContext Ctx;
+  Expected<std::unique_ptr<Module>> M = parseBitcodeFile(
+      MemoryBufferRef(StringRef(BC.data(), BC.size()), "<split-module>"), Ctx);
+  if (!M)
+    report_fatal_error("Failed to read bitcode");
+
+  SmallString<0> Obj;
+  raw_svector_ostream ObjOS(Obj);
+  std::unique_ptr<TargetMachine> TM(CreateTM());
+  legacy::PassManager PM;
+  if (TM->addPassesToEmitFile(PM, ObjOS, nullptr, CGFT_ObjectFile))
+    report_fatal_error("Failed to setup codegen");
+  PM.run(**M);
+  OS << Obj;
+
+  if (CacheFile.empty())
+    return;
+
+  // Concurrent compilations may store the same entry, thus write it to a
+  // temporary file first.
+  SmallString<128> TmpFile;
+  int FD;
+  if (sys::fs::createUniqueFile(CacheFile + ".tmp-%%%%%%", FD, TmpFile))
+    return;
+  {
+    raw_fd_ostream TmpOS(FD, true);
+    TmpOS << Obj;
+  }
+  if (sys::fs::rename(TmpFile, CacheFile))
+    sys::fs::remove(TmpFile);
+}
+
+/// Generate code for the partitions of the module on parallel threads, each
+/// partition is written to one of the outputs of the step. With a cache
+/// directory, the object code of partitions that did not change since an
+/// earlier compilation is taken from the cache.
+bool PatmosPipeline::runSplitLLC(const PipelineStep &S,
+                                 std::unique_ptr<Module> &M, const Target *T,
+                                 CodeGenOpt::Level CGLevel) {
+  if (!S.Partitions.empty()) {
+    StringMap<cl::Option *> &Opts = cl::getRegisteredOptions();
+    for (const char *const *i = std::begin(WholeProgramOptions),
+                           *const *ie = std::end(WholeProgramOptions);
+         i != ie; ++i) {
+      StringMap<cl::Option *>::iterator O = Opts.find(*i);
+      if (O != Opts.end() && O->second->getNumOccurrences())
+        return error(Twine("-") + *i + " requires a single code generation "
+                     "partition");
+    }
+  }
+
+  if (!CacheDir.empty()) {
+    if (std::error_code EC = sys::fs::create_directories(CacheDir))
+      return error("cannot create cache directory '" + CacheDir + "': " +
+                   EC.message());
+  }
+
+  SmallVector<std::unique_ptr<ToolOutputFile>, 8> Outs;
+  SmallVector<raw_pwrite_stream *, 8> OSs;
+  SmallVector<StringRef, 8> Files(1, S.Output);
+  Files.append(S.Partitions.begin(), S.Partitions.end());
+  for (StringRef File : Files) {
+    std::error_code EC;
+    Outs.push_back(std::make_unique<ToolOutputFile>(File, EC,
+                                                    sys::fs::OF_None));
+    if (EC)
+      return error("cannot open '" + File + "': " + EC.message());
+    OSs.push_back(&Outs.back()->os());
+  }
+
+  std::string TheTriple = M->getTargetTriple();
+  std::function<TargetMachine *()> CreateTM = [&]() {
+    return T->createTargetMachine(TheTriple, "", "", TargetOptions(), None,
+                                  None, CGLevel);
+  };
+
+  // The object code of a partition only depends on the compiler, the
+  // backend options and the bitcode of the partition.
+  SHA1 Prefix;
+  Prefix.update(clang::getClangFullVersion());
+  Prefix.update(ArrayRef<uint8_t>((uint8_t)CGLevel));
+  Prefix.update(BackendOptions);
+
+  {
+    // joins the threads when leaving the scope
+    ThreadPool Threads(hardware_concurrency(OSs.size()));
+    unsigned NumPartitions = 0;
+
+    auto HandlePartition = [&](std::unique_ptr<Module> MPart) {
+      // Serialize the partition on this thread, to clone it into the context
+      // of the compiling thread without data races.
+      SmallString<0> BC;
+      raw_svector_ostream BCOS(BC);
+      WriteBitcodeToFile(*MPart, BCOS);
+      MPart.reset();
+
+      raw_pwrite_stream *OS = OSs[NumPartitions++];
+      std::string CacheFile;
+      if (!CacheDir.empty()) {
+        SHA1 Key(Prefix);
+        Key.update(BC);
+        SmallString<128> Path(CacheDir);
+        sys::path::append(Path, "llvmcache-" + toHex(Key.final()));
+        CacheFile = std::string(Path.str());
+
+        ErrorOr<std::unique_ptr<MemoryBuffer>> Cached =
+            MemoryBuffer::getFile(CacheFile);
+        if (Cached) {
+          *OS << (*Cached)->getBuffer();
+          return;
+        }
+      }
+
+      // each thread records its passes in its own time trace instance
+      bool Trace = timeTraceProfilerEnabled();
+      unsigned Granularity = TimeTraceGranularity;
+      Threads.async([OS, &CreateTM, CacheFile, Trace, Granularity](
+                        const SmallString<0> &BC) {
+        if (Trace)
+          timeTraceProfilerInitialize(Granularity, "clang -cc1patmos");
+        compilePartition(BC, *OS, CreateTM, CacheFile);
+        if (Trace)
+          timeTraceProfilerFinishThread();
+      }, std::move(BC));
+    };
+
+    if (OSs.size() == 1)
+      HandlePartition(std::move(M));
+    else
+      SplitModule(std::move(M), OSs.size(), HandlePartition);
+  }
+
+  for (std::unique_ptr<ToolOutputFile> &Out : Outs)
+    Out->keep();
+
+  if (!CacheDir.empty())
+    pruneCache(CacheDir, CachePruningPolicy());
+  return true;
+}
+
+bool PatmosPipeline::writeBitcode(Module &M, StringRef File) {
+  std::error_code EC;
+  ToolOutputFile Out(File, EC, sys::fs::OF_None);
+  if (EC)
+    return error("cannot open '" + File + "': " + EC.message());
+  WriteBitcodeToFile(M, Out.os());
+  Out.keep();
+  return true;
+}
+
+/// Get the file of a backend option given as -<Name>=<file>.
+static bool getFileOption(StringRef Arg, StringRef Name, StringRef &File) {
+  Arg = Arg.ltrim('-');
+  if (!Arg.consume_front(Name) || !Arg.consume_front("="))
+    return false;
+  File = Arg;
+  return !File.empty();
+}
+
+void PatmosPipeline::findBackendFiles(ArrayRef<const char *> BackendArgs) {
+  StringRef SCAExport, SCASummaries;
+  for (StringRef Arg : BackendArgs) {
+    StringRef File;
+    for (const char *Name : BackendInputOptions)
+      if (getFileOption(Arg, Name, File))
+        BackendInputs.push_back(File.str());
+    for (const char *Name : BackendOutputOptions)
+      if (getFileOption(Arg, Name, File))
+        BackendOutputs.push_back(File.str());
+    getFileOption(Arg, "mpatmos-sca-serialize", SCAExport);
+    getFileOption(Arg, "mpatmos-sca-summaries", SCASummaries);
+  }
+
+  // The stack cache analysis keeps its summaries next to its PML export by
+  // default.
+  if (!SCAExport.empty() && SCASummaries.empty()) {
+    BackendInputs.push_back((SCAExport + ".summaries").str());
+    BackendOutputs.push_back((SCAExport + ".summaries").str());
+  }
+}
+
+/// Add the contents of a file to a key. Missing files are part of the key as
+/// well, if they are optional.
+static bool hashFile(SHA1 &Key, StringRef File, bool Optional) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(File);
+  if (!Buffer) {
+    Key.update("<missing>");
+    return Optional;
+  }
+  Key.update((*Buffer)->getBuffer());
+  return true;
+}
+
+/// Compute the cache key of every step: the compiler, the tool, its options,
+/// and the contents of its input files or the keys of the steps producing
+/// them. The names of the outputs are not part of the key, as the driver
+/// uses temporary files for them.
+bool PatmosPipeline::computeStepKeys(ArrayRef<PipelineStep> Steps,
+                                     SmallVectorImpl<std::string> &Keys) {
+  StringMap<unsigned> Producers;
+  for (unsigned i = 0, e = Steps.size(); i != e; ++i) {
+    const PipelineStep &S = Steps[i];
+    SHA1 Key;
+    Key.update(clang::getClangFullVersion());
+    Key.update(S.Tool);
+
+    auto HashInput = [&](StringRef File) {
+      Key.update(StringRef("\0", 1));
+      StringMap<unsigned>::iterator P = Producers.find(File);
+      if (P != Producers.end()) {
+        Key.update(Keys[P->second]);
+        return true;
+      }
+      return hashFile(Key, File, false);
+    };
+
+    for (StringRef Opt : S.Options) {
+      Key.update(StringRef("\0", 1));
+      Key.update(Opt);
+      StringRef Override = Opt;
+      if (Override.consume_front("--override=") && !HashInput(Override))
+        return false;
+    }
+    for (StringRef Input : S.Inputs)
+      if (!HashInput(Input))
+        return false;
+    Key.update(utostr(S.Partitions.size()));
+    if (S.Tool == "llc")
+      for (const std::string &File : BackendInputs)
+        hashFile(Key, File, true);
+
+    Keys.push_back(toHex(Key.final()));
+    Producers[S.Output] = i;
+  }
+  return true;
+}
+
+std::string PatmosPipeline::getPipelineCacheFile(StringRef Key) const {
+  SmallString<128> Path(PipelineCacheDir);
+  sys::path::append(Path, "llvmcache-patmos-" + Key);
+  return std::string(Path.str());
+}
+
+/// The magic string at the start of an entry of the pipeline cache. The
+/// outputs follow as their size in decimal and a newline, followed by the
+/// contents, or "-" and a newline for outputs the step did not write.
+static const char PipelineCacheMagic[] = "PATMOSCACHE\n";
+
+/// Split an entry of the pipeline cache into its outputs.
+static bool
+parsePipelineCacheEntry(StringRef Entry,
+                        SmallVectorImpl<Optional<StringRef>> &Outputs) {
+  if (!Entry.consume_front(PipelineCacheMagic))
+    return false;
+  while (!Entry.empty()) {
+    StringRef Size;
+    std::tie(Size, Entry) = Entry.split('\n');
+    uint64_t N;
+    if (Size == "-")
+      Outputs.push_back(None);
+    else if (Size.getAsInteger(10, N) || N > Entry.size())
+      return false;
+    else {
+      Outputs.push_back(Entry.take_front(N));
+      Entry = Entry.drop_front(N);
+    }
+  }
+  return true;
+}
+
+/// Store the outputs of a step that has been run: the module of a step other
+/// than llc, or the object files and the backend outputs of llc.
+void PatmosPipeline::storeStep(const PipelineStep &S, Module *M,
+                               StringRef Key) {
+  SmallString<0> Entry;
+  raw_svector_ostream OS(Entry);
+  OS << PipelineCacheMagic;
+
+  auto AddOutput = [&](Optional<StringRef> Data) {
+    if (Data)
+      OS << Data->size() << '\n' << *Data;
+    else
+      OS << "-\n";
+  };
+
+  if (M) {
+    SmallString<0> BC;
+    raw_svector_ostream BCOS(BC);
+    WriteBitcodeToFile(*M, BCOS);
+    AddOutput(StringRef(BC));
+  } else {
+    SmallVector<StringRef, 8> Files(1, S.Output);
+    Files.append(S.Partitions.begin(), S.Partitions.end());
+    for (const std::string &File : BackendOutputs)
+      Files.push_back(File);
+    for (unsigned i = 0, e = Files.size(); i != e; ++i) {
+      ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+          MemoryBuffer::getFile(Files[i]);
+      // the object files must exist, the backend outputs are optional
+      if (!Buffer && i <= S.Partitions.size())
+        return;
+      AddOutput(Buffer ? Optional<StringRef>((*Buffer)->getBuffer()) : None);
+    }
+  }
+
+  // Concurrent compilations may store the same entry, thus write it to a
+  // temporary file first.
+  std::string CacheFile = getPipelineCacheFile(Key);
+  SmallString<128> TmpFile;
+  int FD;
+  if (sys::fs::createUniqueFile(CacheFile + ".tmp-%%%%%%", FD, TmpFile))
+    return;
+  {
+    raw_fd_ostream TmpOS(FD, true);
+    TmpOS << Entry;
+  }
+  if (sys::fs::rename(TmpFile, CacheFile))
+    sys::fs::remove(TmpFile);
+}
+
+/// Write a file from the pipeline cache.
+static bool writeCachedFile(StringRef File, StringRef Data) {
+  std::error_code EC;
+  ToolOutputFile Out(File, EC, sys::fs::OF_None);
+  if (EC)
+    return false;
+  Out.os() << Data;
+  Out.keep();
+  return true;
+}
+
+/// Restore the outputs of a step from its entry in the pipeline cache.
+bool PatmosPipeline::restoreStep(const PipelineStep &S, MemoryBufferRef Entry,
+                                 bool IsLast) {
+  SmallVector<Optional<StringRef>, 8> Outputs;
+  parsePipelineCacheEntry(Entry.getBuffer(), Outputs);
+
+  if (S.Tool != "llc") {
+    if ((IsLast || SaveTemps) && !writeCachedFile(S.Output, *Outputs[0]))
+      return error("cannot open '" + S.Output + "'");
+    if (!IsLast) {
+      SMDiagnostic Err;
+      std::unique_ptr<Module> M = getLazyIRModule(
+          MemoryBuffer::getMemBufferCopy(*Outputs[0], S.Output), Err, Context);
+      if (!M) {
+        Err.print(Argv0, errs());
+        return false;
+      }
+      Results[S.Output] = std::move(M);
+    }
+    return true;
+  }
+
+  SmallVector<StringRef, 8> Files(1, S.Output);
+  Files.append(S.Partitions.begin(), S.Partitions.end());
+  for (const std::string &File : BackendOutputs)
+    Files.push_back(File);
+  for (unsigned i = 0, e = Files.size(); i != e; ++i) {
+    if (Outputs[i] && !writeCachedFile(Files[i], *Outputs[i]))
+      return error("cannot open '" + Files[i] + "'");
+  }
+  return true;
+}
+
+int PatmosPipeline::run(ArrayRef<const char *> Argv) {
+  SmallVector<PipelineStep, 8> Steps;
+  SmallVector<const char *, 16> BackendArgs;
+  BackendArgs.push_back("clang (Patmos backend)");
+
+  for (ArrayRef<const char *>::iterator i = Argv.begin(), ie = Argv.end();
+       i != ie; ++i) {
+    StringRef Arg(*i);
+    if (Steps.empty() && Arg == "-save-temps") {
+      SaveTemps = true;
+      continue;
+    }
+    if (Steps.empty() && Arg.startswith("-codegen-cache=")) {
+      CacheDir = std::string(Arg.drop_front(strlen("-codegen-cache=")));
+      continue;
+    }
+    if (Steps.empty() && Arg.startswith("-pipeline-cache=")) {
+      PipelineCacheDir =
+          std::string(Arg.drop_front(strlen("-pipeline-cache=")));
+      continue;
+    }
+    if (Steps.empty() && Arg == "-time-trace") {
+      TimeTrace = true;
+      continue;
+    }
+    if (Steps.empty() && Arg.startswith("-time-trace-file=")) {
+      TimeTraceFile = std::string(Arg.drop_front(strlen("-time-trace-file=")));
+      continue;
+    }
+    if (Steps.empty() && Arg.startswith("-time-trace-granularity=")) {
+      if (Arg.drop_front(strlen("-time-trace-granularity="))
+              .getAsInteger(10, TimeTraceGranularity)) {
+        error("invalid argument '" + Arg + "'");
+        return 1;
+      }
+      continue;
+    }
+    if (Arg == "--") {
+      Steps.emplace_back();
+      continue;
+    }
+
+    if (Steps.empty())
+      Steps.emplace_back();
+    PipelineStep &S = Steps.back();
+    if (S.Tool.empty()) {
+      if (Arg != "llvm-link" && Arg != "opt" && Arg != "llc") {
+        error("unknown pipeline step '" + Arg + "'");
+        return 1;
+      }
+      S.Tool = Arg;
+    } else if (Arg == "-o" && i + 1 != ie) {
+      if (S.Output.empty())
+        S.Output = *++i;
+      else if (S.Tool == "llc")
+        S.Partitions.push_back(*++i);
+      else {
+        error(S.Tool + ": more than one output file given");
+        return 1;
+      }
+    } else if (S.Tool == "llc") {
+      // The backend options, such as -mpatmos-*, and their values are
+      // forwarded to cl::opt, the input is the last argument.
+      S.Options.push_back(Arg);
+      unsigned OptLevel, SizeLevel;
+      if (!parseOptLevel(Arg, OptLevel, SizeLevel) && Arg != "-filetype=obj")
+        BackendArgs.push_back(*i);
+    } else if (Arg.startswith("-") && Arg != "-") {
+      S.Options.push_back(Arg);
+    } else {
+      S.Inputs.push_back(Arg);
+    }
+  }
+
+  if (Steps.empty() || Steps.back().Tool.empty()) {
+    error("no pipeline steps given");
+    return 1;
+  }
+  for (unsigned i = 0, e = Steps.size(); i + 1 < e; ++i) {
+    if (Steps[i].Tool == "llc") {
+      error("llc must be the last step");
+      return 1;
+    }
+  }
+  PipelineStep &Last = Steps.back();
+  if (Last.Tool == "llc" && BackendArgs.size() > 1 &&
+      Last.Options.back() == BackendArgs.back()) {
+    Last.Inputs.push_back(BackendArgs.pop_back_val());
+    Last.Options.pop_back();
+  }
+
+  for (unsigned i = 1, e = BackendArgs.size(); i != e; ++i) {
+    BackendOptions += BackendArgs[i];
+    BackendOptions += '\0';
+  }
+
+  if (!cl::ParseCommandLineOptions(BackendArgs.size(), BackendArgs.data(),
+                                   "", &errs()))
+    return 1;
+
+  for (const PipelineStep &S : Steps) {
+    if (S.Output.empty()) {
+      error(S.Tool + ": no output file given");
+      return 1;
+    }
+  }
+
+  if (TimeTrace)
+    timeTraceProfilerInitialize(TimeTraceGranularity, "clang -cc1patmos");
+
+  // Plan the steps from the last one backwards: a step whose outputs are
+  // cached is restored, and the steps producing its inputs are not needed.
+  unsigned NumSteps = Steps.size();
+  SmallVector<std::string, 8> Keys;
+  SmallVector<bool, 8> Needed(NumSteps, false);
+  SmallVector<std::unique_ptr<MemoryBuffer>, 8> Cached;
+  Cached.resize(NumSteps);
+  Needed.back() = true;
+  if (!PipelineCacheDir.empty()) {
+    findBackendFiles(BackendArgs);
+    if (std::error_code EC = sys::fs::create_directories(PipelineCacheDir)) {
+      error("cannot create cache directory '" + PipelineCacheDir + "': " +
+            EC.message());
+      return 1;
+    }
+    if (computeStepKeys(Steps, Keys)) {
+      for (unsigned i = NumSteps; i-- > 0;) {
+        if (!Needed[i])
+          continue;
+        ErrorOr<std::unique_ptr<MemoryBuffer>> Entry =
+            MemoryBuffer::getFile(getPipelineCacheFile(Keys[i]));
+        SmallVector<Optional<StringRef>, 8> Outputs;
+        unsigned NumOutputs = 1;
+        if (Steps[i].Tool == "llc")
+          NumOutputs += Steps[i].Partitions.size() + BackendOutputs.size();
+        if (Entry && parsePipelineCacheEntry((*Entry)->getBuffer(), Outputs) &&
+            Outputs.size() == NumOutputs && Outputs[0]) {
+          Cached[i] = std::move(*Entry);
+          continue;
+        }
+        for (unsigned j = 0; j != i; ++j) {
+          const PipelineStep &P = Steps[j];
+          for (StringRef Opt : Steps[i].Options)
+            if (Opt.consume_front("--override=") && Opt == P.Output)
+              Needed[j] = true;
+          if (is_contained(Steps[i].Inputs, P.Output))
+            Needed[j] = true;
+        }
+      }
+    }
+  }
+  if (Keys.empty())
+    Needed.assign(NumSteps, true);
+
+  for (unsigned i = 0, e = Steps.size(); i != e; ++i) {
+    const PipelineStep &S = Steps[i];
+    bool IsLast = i + 1 == e;
+    if (!Needed[i])
+      continue;
+    if (Cached[i]) {
+      if (!restoreStep(S, *Cached[i], IsLast))
+        return 1;
+      continue;
+    }
+
+    TimeTraceScope StepScope(S.Tool, S.Output);
+    std::unique_ptr<Module> M;
+    bool Success;
+    if (S.Tool == "llvm-link")
+      Success = runLink(S, M);
+    else if (S.Tool == "opt")
+      Success = runOpt(S, M);
+    else
+      Success = runLLC(S, M);
+    if (!Success)
+      return 1;
+    if (!Keys.empty())
+      storeStep(S, M.get(), Keys[i]);
+
+    // llc writes its output itself
+    if (!M)
+      continue;
+    if ((IsLast || SaveTemps) && !writeBitcode(*M, S.Output))
+      return 1;
+    if (!IsLast)
+      Results[S.Output] = std::move(M);
+  }
+
+  if (!Keys.empty())
+    pruneCache(PipelineCacheDir, CachePruningPolicy());
+
+  if (timeTraceProfilerEnabled()) {
+    Error E = timeTraceProfilerWrite(TimeTraceFile, Steps.back().Output);
+    timeTraceProfilerCleanup();
+    if (E) {
+      error(toString(std::move(E)));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Merge the time traces of the sub-jobs of a link into one trace. The events
+/// of each input are moved to the common time line of the earliest input and
+/// into a process of their own.
+static int mergeTimeTraces(ArrayRef<const char *> Argv, const char *Argv0) {
+  StringRef Output;
+  SmallVector<StringRef, 8> Inputs;
+  for (unsigned i = 0, e = Argv.size(); i != e; ++i) {
+    if (StringRef(Argv[i]) == "-o" && i + 1 != e)
+      Output = Argv[++i];
+    else
+      Inputs.push_back(Argv[i]);
+  }
+  if (Output.empty()) {
+    WithColor::error(errs(), Argv0) << "no output file given\n";
+    return 1;
+  }
+
+  SmallVector<std::pair<int64_t, json::Array>, 8> Traces;
+  for (StringRef File : Inputs) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(File);
+    if (!Buffer) {
+      WithColor::warning(errs(), Argv0) << "skipping time trace '" << File
+          << "': " << Buffer.getError().message() << "\n";
+      continue;
+    }
+    Expected<json::Value> Trace = json::parse((*Buffer)->getBuffer());
+    if (!Trace) {
+      WithColor::warning(errs(), Argv0) << "skipping time trace '" << File
+          << "': " << toString(Trace.takeError()) << "\n";
+      continue;
+    }
+    json::Object *Root = Trace->getAsObject();
+    json::Array *Events = Root ? Root->getArray("traceEvents") : nullptr;
+    Optional<int64_t> Begin =
+        Root ? Root->getInteger("beginningOfTime") : None;
+    if (!Events || !Begin) {
+      WithColor::warning(errs(), Argv0) << "skipping time trace '" << File
+          << "': not a time trace\n";
+      continue;
+    }
+    Traces.emplace_back(*Begin, std::move(*Events));
+  }
+
+  int64_t Begin = 0;
+  for (unsigned i = 0, e = Traces.size(); i != e; ++i)
+    if (i == 0 || Traces[i].first < Begin)
+      Begin = Traces[i].first;
+
+  json::Array Events;
+  for (unsigned i = 0, e = Traces.size(); i != e; ++i) {
+    int64_t Shift = Traces[i].first - Begin;
+    for (json::Value &V : Traces[i].second) {
+      json::Object *Event = V.getAsObject();
+      if (!Event)
+        continue;
+      if (Optional<int64_t> TS = Event->getInteger("ts"))
+        (*Event)["ts"] = *TS + Shift;
+      (*Event)["pid"] = int64_t(i + 1);
+      Events.push_back(std::move(V));
+    }
+  }
+
+  std::error_code EC;
+  ToolOutputFile Out(Output, EC, sys::fs::OF_Text);
+  if (EC) {
+    WithColor::error(errs(), Argv0) << "cannot open '" << Output << "': "
+                                    << EC.message() << "\n";
+    return 1;
+  }
+  Out.os() << json::Value(json::Object{{"traceEvents", std::move(Events)},
+                                       {"beginningOfTime", Begin}});
+  Out.keep();
+  return 0;
+}
+
+int cc1patmos_main(ArrayRef<const char *> Argv, const char *Argv0,
+                   void *MainAddr) {
+  if (!Argv.empty() && StringRef(Argv[0]) == "-merge-time-traces")
+    return mergeTimeTraces(Argv.drop_front(), Argv0);
+
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+  InitializeAllAsmPrinters();
+  InitializeAllAsmParsers();
+
+  PatmosPipeline Pipeline(Argv0);
+  return Pipeline.run(Argv);
+}
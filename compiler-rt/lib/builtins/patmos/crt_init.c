@@ -0,0 +1,186 @@
+/* ===-- crt_init.c - Initialize the data of a program at startup ---------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file implements the initialization of the data sections for the
+ * startup code, which calls it before any constructors and main:
+ *
+ *   void __patmos_init_sections(void);
+ *
+ * The data is copied from __patmos_data_load to __patmos_data_start up to
+ * __patmos_data_end, if it is loaded elsewhere, and the bss is cleared from
+ * __patmos_bss_start up to __patmos_bss_end. The linker defines the symbols
+ * and aligns the starts to the bursts of the main memory (see
+ * --patmos-burst-size), linker scripts define them for their own layout.
+ * Sections named .noinit follow the bss and are left as they are.
+ *
+ * Both ranges are processed a burst per iteration, the loads of a copy are
+ * served by a single burst of the data cache, the stores are paired with the
+ * address updates in the bundles. Unaligned starts and the remaining words and
+ * bytes at the ends are processed one by one.
+ *
+ * Sections that the linker compressed (see --patmos-compress) are
+ * decompressed first from the image at __patmos_lz4_image. The stores do not
+ * allocate in the data cache, the matches are therefore read from a window of
+ * the last PATMOS_LZ4_WINDOW decompressed bytes in the local scratchpad, which
+ * is not used before the constructors run. Only longer distances read the
+ * main memory.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#include "../int_lib.h"
+
+/* Bytes transferred from or to the main memory in a burst. */
+#define INIT_BURST 16u
+#define INIT_BURST_WORDS (INIT_BURST / sizeof(su_int))
+
+_Static_assert(INIT_BURST_WORDS == 4, "unrolled for bursts of four words");
+
+/* weak, such that the ranges are empty if a linker script does not define
+   them, and the comparison of the addresses is not folded */
+extern char __patmos_data_start[] __attribute__((weak));
+extern char __patmos_data_end[] __attribute__((weak));
+extern char __patmos_data_load[] __attribute__((weak));
+extern char __patmos_bss_start[] __attribute__((weak));
+extern char __patmos_bss_end[] __attribute__((weak));
+extern const su_int __patmos_lz4_image[] __attribute__((weak));
+
+/* Address and size of the window, a power of two, in the scratchpad. */
+#ifndef PATMOS_LZ4_WINDOW_BASE
+#define PATMOS_LZ4_WINDOW_BASE 0u
+#endif
+#ifndef PATMOS_LZ4_WINDOW
+#define PATMOS_LZ4_WINDOW 1024u
+#endif
+
+_Static_assert((PATMOS_LZ4_WINDOW & (PATMOS_LZ4_WINDOW - 1)) == 0,
+               "the window is indexed by masks");
+
+#if defined(__patmos__)
+#define LZ4_SPM __patmos_local
+#else
+#define LZ4_SPM
+#endif
+
+static void init_copy(char *dst, const char *src, char *end) {
+  /* the words of the bursts must be aligned for both */
+  if (((su_int)dst ^ (su_int)src) & (sizeof(su_int) - 1)) {
+    while (dst < end)
+      *dst++ = *src++;
+    return;
+  }
+
+  while (dst < end && ((su_int)dst & (INIT_BURST - 1)))
+    *dst++ = *src++;
+
+  su_int *d = (su_int *)dst;
+  const su_int *s = (const su_int *)src;
+  su_int bursts = dst < end ? ((su_int)end - (su_int)dst) / INIT_BURST : 0;
+  for (su_int i = 0; i < bursts; i++) {
+    su_int w0 = s[0], w1 = s[1], w2 = s[2], w3 = s[3];
+    d[0] = w0;
+    d[1] = w1;
+    d[2] = w2;
+    d[3] = w3;
+    d += INIT_BURST_WORDS;
+    s += INIT_BURST_WORDS;
+  }
+
+  dst = (char *)d;
+  src = (const char *)s;
+  while (dst < end)
+    *dst++ = *src++;
+}
+
+static void init_clear(char *dst, char *end) {
+  while (dst < end && ((su_int)dst & (INIT_BURST - 1)))
+    *dst++ = 0;
+
+  su_int *d = (su_int *)dst;
+  su_int bursts = dst < end ? ((su_int)end - (su_int)dst) / INIT_BURST : 0;
+  for (su_int i = 0; i < bursts; i++) {
+    d[0] = 0;
+    d[1] = 0;
+    d[2] = 0;
+    d[3] = 0;
+    d += INIT_BURST_WORDS;
+  }
+
+  dst = (char *)d;
+  while (dst < end)
+    *dst++ = 0;
+}
+
+static su_int lz4_length(const unsigned char **src, su_int len) {
+  if (len == 15) {
+    su_int b;
+    do {
+      b = *(*src)++;
+      len += b;
+    } while (b == 255);
+  }
+  return len;
+}
+
+/* Decompress an LZ4 block of size bytes from src to dst. */
+static void init_decompress(unsigned char *dst, const unsigned char *src,
+                            su_int size) {
+  LZ4_SPM unsigned char *window =
+      (LZ4_SPM unsigned char *)PATMOS_LZ4_WINDOW_BASE;
+  const su_int mask = PATMOS_LZ4_WINDOW - 1;
+  const unsigned char *end = src + size;
+  su_int pos = 0;
+
+  while (src < end) {
+    su_int token = *src++;
+    for (su_int len = lz4_length(&src, token >> 4); len; len--, pos++) {
+      unsigned char b = *src++;
+      dst[pos] = b;
+      window[pos & mask] = b;
+    }
+    if (src >= end)
+      break;
+
+    su_int offset = src[0] | ((su_int)src[1] << 8);
+    src += 2;
+    su_int len = lz4_length(&src, token & 15) + 4;
+    if (offset <= PATMOS_LZ4_WINDOW) {
+      for (; len; len--, pos++) {
+        unsigned char b = window[(pos - offset) & mask];
+        dst[pos] = b;
+        window[pos & mask] = b;
+      }
+    } else {
+      for (; len; len--, pos++) {
+        unsigned char b = dst[pos - offset];
+        dst[pos] = b;
+        window[pos & mask] = b;
+      }
+    }
+  }
+}
+
+/* The image starts with the number of sections, followed by their address,
+   size, offset of their data in the image and size of their data. */
+static void init_decompress_image(const su_int *image) {
+  su_int count = image[0];
+  for (su_int i = 0; i < count; i++) {
+    const su_int *e = image + 1 + 4 * i;
+    init_decompress((unsigned char *)e[0],
+                    (const unsigned char *)image + e[2], e[3]);
+  }
+}
+
+void __patmos_init_sections(void) {
+  if (&__patmos_lz4_image[0])
+    init_decompress_image(__patmos_lz4_image);
+  if (&__patmos_data_load[0] != &__patmos_data_start[0])
+    init_copy(__patmos_data_start, __patmos_data_load, __patmos_data_end);
+  init_clear(__patmos_bss_start, __patmos_bss_end);
+}
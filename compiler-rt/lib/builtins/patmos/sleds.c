@@ -0,0 +1,128 @@
+/* ===-- sleds.c - Patch the tracing sleds of -fxray-instrument -----------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file implements the runtime of the tracing sleds, which the compiler
+ * inserts at the entries and exits of the functions and at the entries of
+ * their subfunctions for -fxray-instrument:
+ *
+ *   int __patmos_sleds_patch(void *function, int enable);
+ *
+ * enables (or disables) the sleds of the given function, or of all functions
+ * if it is null, and returns the number of patched sleds. The sleds are listed
+ * in the patmos_sleds section, enabled sleds call __patmos_sled_handler, which
+ * records the address of the sled and the cycle counter in the ring buffer
+ * __patmos_sled_log. The entry written next is __patmos_sled_log_next modulo
+ * PATMOS_SLED_LOG_SIZE, __patmos_sled_find returns the record of a sled,
+ * giving its function and kind (0: entry, 1: exit, 2: subfunction entry).
+ *
+ * The handler may be replaced. It is called by callnd, must return by retnd,
+ * and must not change any registers other than srb and sro, nor the stack
+ * cache. The address of the sled is srb + sro - 12.
+ *
+ * The sleds are patched through the data cache, the method cache is not
+ * invalidated. Code that is already in the method cache keeps running without
+ * the changes until it is evicted, the sleds are therefore best patched at
+ * startup, before the traced functions run.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#include "../int_lib.h"
+
+/* Number of entries of the ring buffer, a power of two. */
+#define PATMOS_SLED_LOG_SIZE 256u
+
+/* The encoding of a NOP, sub r0 = r0, 0. */
+#define PATMOS_SLED_NOP 0x00400000u
+
+/* Number of instructions of a sled. */
+#define PATMOS_SLED_WORDS 5
+
+struct patmos_sled {
+  su_int *sled;
+  void *function;
+  su_int kind;
+  su_int image[PATMOS_SLED_WORDS];
+};
+
+struct patmos_sled_event {
+  void *sled;
+  su_int cycles;
+};
+
+/* weak, such that programs without sleds link */
+extern struct patmos_sled __start_patmos_sleds[] __attribute__((weak));
+extern struct patmos_sled __stop_patmos_sleds[] __attribute__((weak));
+
+struct patmos_sled_event __patmos_sled_log[PATMOS_SLED_LOG_SIZE];
+su_int __patmos_sled_log_next;
+
+_Static_assert(sizeof(struct patmos_sled_event) == 8,
+               "the handler indexes the log by shifts");
+_Static_assert(PATMOS_SLED_LOG_SIZE == 256,
+               "the handler masks the index by 255");
+
+int __patmos_sleds_patch(void *function, int enable) {
+  int patched = 0;
+  for (struct patmos_sled *s = __start_patmos_sleds; s < __stop_patmos_sleds;
+       s++) {
+    if (function && s->function != function)
+      continue;
+    volatile su_int *code = s->sled;
+    for (int i = 0; i < PATMOS_SLED_WORDS; i++)
+      code[i] = enable ? s->image[i] : PATMOS_SLED_NOP;
+    patched++;
+  }
+  return patched;
+}
+
+const struct patmos_sled *__patmos_sled_find(void *sled) {
+  for (struct patmos_sled *s = __start_patmos_sleds; s < __stop_patmos_sleds;
+       s++) {
+    if (s->sled == sled)
+      return s;
+  }
+  return 0;
+}
+
+/* The registers are saved on the shadow stack, the stack cache belongs to the
+   traced function. The cycle counter is read first, the loads have a delay
+   slot. */
+void __patmos_sled_handler(void) __attribute__((naked, noinline, weak));
+void __patmos_sled_handler(void) {
+  __asm__ volatile(
+      "sub $r31 = $r31, 16;"
+      "swc [$r31 + 0] = $r1;"
+      "swc [$r31 + 1] = $r2;"
+      "swc [$r31 + 2] = $r3;"
+      "swc [$r31 + 3] = $r4;"
+      "li $r1 = 0xf0020004;" /* the low word of the cycle counter */
+      "lwl $r1 = [$r1 + 0];"
+      "li $r2 = __patmos_sled_log_next;"
+      "lwc $r3 = [$r2 + 0];"
+      "nop;"
+      "add $r4 = $r3, 1;"
+      "swc [$r2 + 0] = $r4;"
+      "and $r3 = $r3, 255;"
+      "sl $r3 = $r3, 3;"
+      "li $r2 = __patmos_sled_log;"
+      "add $r2 = $r2, $r3;"
+      "swc [$r2 + 1] = $r1;"
+      "mfs $r1 = $srb;"
+      "mfs $r3 = $sro;"
+      "add $r1 = $r1, $r3;"
+      "sub $r1 = $r1, 12;"
+      "swc [$r2 + 0] = $r1;"
+      "lwc $r1 = [$r31 + 0];"
+      "lwc $r2 = [$r31 + 1];"
+      "lwc $r3 = [$r31 + 2];"
+      "lwc $r4 = [$r31 + 3];"
+      "add $r31 = $r31, 16;"
+      "retnd;");
+}
@@ -0,0 +1,27 @@
+/* ===-- tlsf.c - Time-predictable memory allocator -----------------------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file implements a TLSF allocator for pools in main memory, with
+ * allocation and free in constant time, see tlsf_impl.inc:
+ *
+ *   void *__patmos_tlsf_create(void *mem, unsigned bytes);
+ *   void *__patmos_tlsf_malloc(void *pool, unsigned size);
+ *   void __patmos_tlsf_free(void *pool, void *ptr);
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#define TLSF_AS
+#define TLSF_NAME(n) __patmos_tlsf_##n
+
+/* blocks up to 1 GB */
+#define TLSF_FL_MAX 30
+#define TLSF_FL_COUNT 23
+
+#include "tlsf_impl.inc"
@@ -0,0 +1,27 @@
+/* ===-- tlsf_spm.c - Time-predictable memory allocator for the SPM -------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file implements a TLSF allocator for pools in the data scratchpad,
+ * accessed with local loads and stores, see tlsf_impl.inc:
+ *
+ *   _SPM void *__patmos_tlsf_spm_create(_SPM void *mem, unsigned bytes);
+ *   _SPM void *__patmos_tlsf_spm_malloc(_SPM void *pool, unsigned size);
+ *   void __patmos_tlsf_spm_free(_SPM void *pool, _SPM void *ptr);
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#define TLSF_AS __patmos_local
+#define TLSF_NAME(n) __patmos_tlsf_spm_##n
+
+/* blocks up to 64 KB, keeping the control structure small */
+#define TLSF_FL_MAX 16
+#define TLSF_FL_COUNT 9
+
+#include "tlsf_impl.inc"
@@ -0,0 +1,83 @@
+/* ===-- udivmodsi4_di.c - Dual-issue unsigned division -------------------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file implements __udivsi3_di, __umodsi3_di and __udivmodsi4_di, the
+ * hand-bundled versions of __udivsi3, __umodsi3 and __udivmodsi4 for Patmos
+ * with the second issue slot enabled.
+ *
+ * All of them perform a restoring division with exactly 32 iterations of 5
+ * cycles and no data-dependent control flow, so their execution time does not
+ * depend on the operands and they can be called from single-path code.
+ *
+ * They only clobber r1, r2, r5 (r6 for __udivmodsi4_di), p1, p2 and p3.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#include "../int_lib.h"
+
+/* One iteration of the division loop: shift bit I of n ($r3) into the
+ * remainder R, subtract d ($r4) if it fits and shift the result into the
+ * quotient Q. Counts I down to 0, the branch delay slots do the update. */
+#define UDIV_LOOP(LABEL, Q, R, I)                                   \
+		"{ li " Q " = 0; li " R " = 0 };"                           \
+		"li " I " = 31;"                                            \
+		LABEL ":;"                                                  \
+		"{ btest $p1 = $r3, " I "; sl " R " = " R ", 1 };"          \
+		"{ ($p1) or " R " = " R ", 1; sl " Q " = " Q ", 1 };"       \
+		"{ cmpult $p2 = " R ", $r4; cmpneq $p3 = " I ", 0 };"       \
+		"br ($p3) " LABEL ";"                                       \
+		"{ (!$p2) sub " R " = " R ", $r4; (!$p2) or " Q " = " Q ", 1 };" \
+		"sub " I " = " I ", 1;"
+
+/* Returns: n / d */
+COMPILER_RT_ABI su_int
+__udivsi3_di(su_int n, su_int d) __attribute__((naked,noinline));
+COMPILER_RT_ABI su_int
+__udivsi3_di(su_int n, su_int d)
+{
+    __asm__ volatile (
+		UDIV_LOOP("__udivsi3_di_loop", "$r1", "$r2", "$r5")
+		"retnd;"
+		:
+		:
+		: "r1", "r2", "r5"
+	);
+}
+
+/* Returns: n % d */
+COMPILER_RT_ABI su_int
+__umodsi3_di(su_int n, su_int d) __attribute__((naked,noinline));
+COMPILER_RT_ABI su_int
+__umodsi3_di(su_int n, su_int d)
+{
+    __asm__ volatile (
+		UDIV_LOOP("__umodsi3_di_loop", "$r2", "$r1", "$r5")
+		"retnd;"
+		:
+		:
+		: "r1", "r2", "r5"
+	);
+}
+
+/* Returns: n / d, *rem = n % d */
+COMPILER_RT_ABI su_int
+__udivmodsi4_di(su_int n, su_int d, su_int* rem) __attribute__((naked,noinline));
+COMPILER_RT_ABI su_int
+__udivmodsi4_di(su_int n, su_int d, su_int* rem)
+{
+    __asm__ volatile (
+		UDIV_LOOP("__udivmodsi4_di_loop", "$r1", "$r2", "$r6")
+		"swc [$r5] = $r2;"
+		"retnd;"
+		:
+		:
+		: "r1", "r2", "r6"
+	);
+}
@@ -19,7 +19,7 @@
 |*
 \*===----------------------------------------------------------------------===*/
 
-#if !defined(__Fuchsia__)
+#if !defined(__Fuchsia__) && !defined(__patmos__)
 
 #include <errno.h>
 #include <fcntl.h>
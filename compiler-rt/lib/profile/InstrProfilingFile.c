@@ -6,7 +6,7 @@
 |*
 \*===----------------------------------------------------------------------===*/
 
-#if !defined(__Fuchsia__)
+#if !defined(__Fuchsia__) && !defined(__patmos__)
 
 #include <errno.h>
 #include <stdio.h>
@@ -0,0 +1,171 @@
+/*===- InstrProfilingPlatformPatmos.c - Profile data Patmos platform ------===*\
+|*
+|* Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+|* See https://llvm.org/LICENSE.txt for license information.
+|* SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+|*
+\*===----------------------------------------------------------------------===*/
+/*
+ * This file implements the profiling runtime for Patmos, which has no file
+ * system to write the profile to. The sections of the profile data are found
+ * like on Linux (see InstrProfilingPlatformLinux.c), the raw profile is written
+ * to the standard output at exit instead, i.e., to the UART of the processor,
+ * which the simulator writes to its output as well. The profile is written as
+ * hexadecimal digits, 32 bytes per line, between the lines
+ *
+ *   LLVM Profile: begin <size in bytes>
+ *   LLVM Profile: end
+ *
+ * from which a host extracts it, e.g., with
+ *
+ *   sed -n '/^LLVM Profile: begin/,/^LLVM Profile: end/{//!p}' out.txt |
+ *     xxd -r -p > default.profraw
+ *
+ * The compiler may keep the counters in the local scratchpad of the processor
+ * (see -mpatmos-profile-spm). It then defines __patmos_profile_spm_flush,
+ * which copies them to the counters in main memory, and which is called
+ * before the profile is written.
+ */
+
+#if defined(__patmos__)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "InstrProfiling.h"
+#include "InstrProfilingInternal.h"
+
+/* Bytes of the profile per line of the output. */
+#define PATMOS_PROFILE_LINE 32
+
+/* weak, such that programs without counters in the scratchpad link */
+extern void __patmos_profile_spm_flush(void) __attribute__((weak));
+
+struct lprofPatmosWriterCtx {
+  /* Hexadecimal digits of the current line. */
+  char Line[2 * PATMOS_PROFILE_LINE + 1];
+  /* Number of bytes in the current line. */
+  uint32_t Bytes;
+};
+
+static void lprofPatmosPuts(const char *Str, size_t Len) {
+  while (Len) {
+    ssize_t Written = write(STDOUT_FILENO, Str, Len);
+    if (Written <= 0)
+      return;
+    Str += Written;
+    Len -= Written;
+  }
+}
+
+static void lprofPatmosEndLine(struct lprofPatmosWriterCtx *Ctx) {
+  if (!Ctx->Bytes)
+    return;
+  Ctx->Line[2 * Ctx->Bytes] = '\n';
+  lprofPatmosPuts(Ctx->Line, 2 * Ctx->Bytes + 1);
+  Ctx->Bytes = 0;
+}
+
+static void lprofPatmosPutByte(struct lprofPatmosWriterCtx *Ctx,
+                               uint8_t Byte) {
+  static const char Digits[] = "0123456789abcdef";
+  Ctx->Line[2 * Ctx->Bytes] = Digits[Byte >> 4];
+  Ctx->Line[2 * Ctx->Bytes + 1] = Digits[Byte & 0xf];
+  if (++Ctx->Bytes == PATMOS_PROFILE_LINE)
+    lprofPatmosEndLine(Ctx);
+}
+
+static uint32_t lprofPatmosWriter(ProfDataWriter *This, ProfDataIOVec *IOVecs,
+                                  uint32_t NumIOVecs) {
+  struct lprofPatmosWriterCtx *Ctx =
+      (struct lprofPatmosWriterCtx *)This->WriterCtx;
+
+  for (uint32_t I = 0; I < NumIOVecs; I++) {
+    size_t Length = IOVecs[I].ElmSize * IOVecs[I].NumElm;
+    const uint8_t *Data = (const uint8_t *)IOVecs[I].Data;
+    /* Skipped data is written as zeros as well, the stream has no offsets. */
+    for (size_t J = 0; J < Length; J++)
+      lprofPatmosPutByte(Ctx, Data ? Data[J] : 0);
+  }
+  return 0;
+}
+
+static void lprofPatmosPutSize(uint64_t Size) {
+  char Buf[24];
+  char *Str = Buf + sizeof(Buf);
+  *--Str = '\n';
+  do {
+    *--Str = '0' + Size % 10;
+    Size /= 10;
+  } while (Size);
+  lprofPatmosPuts(Str, Buf + sizeof(Buf) - Str);
+}
+
+COMPILER_RT_VISIBILITY
+int __llvm_profile_write_file(void) {
+  static const char Begin[] = "LLVM Profile: begin ";
+  static const char End[] = "LLVM Profile: end\n";
+
+  if (lprofProfileDumped()) {
+    PROF_NOTE("Profile data not written: %s.\n", "already written");
+    return 0;
+  }
+
+  /* Check if there is llvm/runtime version mismatch. */
+  if (GET_VERSION(__llvm_profile_get_version()) != INSTR_PROF_RAW_VERSION) {
+    PROF_ERR("Runtime and instrumentation version mismatch : "
+             "expected %d, but get %d\n",
+             INSTR_PROF_RAW_VERSION,
+             (int)GET_VERSION(__llvm_profile_get_version()));
+    return -1;
+  }
+
+  /* Collect the counters from the scratchpad. */
+  if (__patmos_profile_spm_flush)
+    __patmos_profile_spm_flush();
+
+  lprofPatmosPuts(Begin, sizeof(Begin) - 1);
+  lprofPatmosPutSize(__llvm_profile_get_size_for_buffer());
+
+  ProfDataWriter Writer;
+  struct lprofPatmosWriterCtx Ctx = {.Bytes = 0};
+  Writer.Write = lprofPatmosWriter;
+  Writer.WriterCtx = &Ctx;
+  int rc = lprofWriteData(&Writer, lprofGetVPDataReader(), 0);
+  lprofPatmosEndLine(&Ctx);
+
+  lprofPatmosPuts(End, sizeof(End) - 1);
+  if (rc)
+    PROF_ERR("Failed to write profile data: %d\n", rc);
+  return rc;
+}
+
+COMPILER_RT_VISIBILITY
+int __llvm_profile_dump(void) {
+  int rc = __llvm_profile_write_file();
+  lprofSetProfileDumped(1);
+  return rc;
+}
+
+static void writeFileWithoutReturn(void) { __llvm_profile_write_file(); }
+
+COMPILER_RT_VISIBILITY
+int __llvm_profile_register_write_file_atexit(void) {
+  static int HasBeenRegistered = 0;
+
+  if (HasBeenRegistered)
+    return 0;
+
+  HasBeenRegistered = 1;
+  return atexit(writeFileWithoutReturn);
+}
+
+/* This method is invoked by the runtime initialization hook
+ * InstrProfilingRuntime.o if it is linked in. */
+COMPILER_RT_VISIBILITY
+void __llvm_profile_initialize(void) {
+  __llvm_profile_register_write_file_atexit();
+}
+
+#endif
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "InputFiles.h"
+#include "OutputSections.h"
 #include "Symbols.h"
 #include "SyntheticSections.h"
 #include "Target.h"
@@ -28,6 +29,7 @@ public:
                      const uint8_t *loc) const override;
   void relocate(uint8_t *loc, const Relocation &rel,
                 uint64_t val) const override;
+  bool relocateAllocBatch(InputSectionBase &sec, uint8_t *buf) const override;
 };
 
 }
@@ -66,6 +68,18 @@ RelExpr Patmos::getRelExpr(const RelType type, const Symbol &s,
     return R_ABS;  
   case R_PATMOS_CFLI_PCREL:
     return R_PC; // Relative Address
+  case R_PATMOS_ALUI_SDA:
+  case R_PATMOS_MEMB_SDA:
+  case R_PATMOS_MEMH_SDA:
+  case R_PATMOS_MEMW_SDA:
+    // Absolute address, patched as offset to the small data base, which is
+    // defined if the program references it
+    if (!ElfSym::patmosSmallDataBase) {
+      error(getErrorLocation(loc) + "small data relocation against symbol " +
+            toString(s) + " requires _SDA_BASE_");
+      return R_NONE;
+    }
+    return R_ABS;
   default:
     error(getErrorLocation(loc) + "unknown relocation (" + Twine(type) +
           ") against symbol " + toString(s));
@@ -78,12 +92,18 @@ static uint32_t extractBits(uint64_t v, uint32_t begin, uint32_t end) {
   return (v & ((1ULL << (begin + 1)) - 1)) >> end;
 }
 
+// getSmallDataOffset - the offset of a 32 bit address to the small data base,
+// addresses below the base are out of range
+static uint64_t getSmallDataOffset(uint64_t val) {
+  return static_cast<uint32_t>(val - ElfSym::patmosSmallDataBase->getVA());
+}
 
 // relocate - patch data/instruction depending on the relocation type
 //// @param loc   Location Pointer to data/instruction where patching is needed
 //// @param rel   Relocation Type to be applied
 //// @param val   Value to be patched to the data/instruction 
-void Patmos::relocate(uint8_t *loc, const Relocation &rel, uint64_t val) const {
+static inline void relocateOne(uint8_t *loc, const Relocation &rel,
+                               uint64_t val) {
   // Relocate Types defined in /llvm/include/llvm/BinaryFormat/ELF.h
   
   switch (rel.type) {
@@ -178,11 +198,106 @@ void Patmos::relocate(uint8_t *loc, const Relocation &rel, uint64_t val) const {
     write32be(loc,insn);
     return;
   }
+  case R_PATMOS_ALUI_SDA: {
+    val = getSmallDataOffset(val);
+
+    // Relocate ALUi format (12 bit immediate), small data offset (unsigned),
+    // in bytes
+    checkUInt(loc, static_cast<int64_t>(val), 12, rel);
+
+    const uint32_t mask = 0xFFF;
+    uint32_t insn = read32be(loc) & ~(mask);
+    uint32_t imm =  extractBits(val, 11, 0);
+    insn |= imm;
+    write32be(loc,insn);
+    return;
+  }
+  case R_PATMOS_MEMB_SDA: {
+    val = getSmallDataOffset(val);
+
+    // Relocate LDT or STT format (7 bit immediate), small data offset
+    // (unsigned), in bytes
+    checkUInt(loc, static_cast<int64_t>(val), 7, rel);
+
+    const uint32_t mask = 0x7F;
+    uint32_t insn = read32be(loc) & ~(mask);
+    uint32_t imm =  extractBits(val, 6, 0);
+    insn |= imm;
+    write32be(loc,insn);
+    return;
+  }
+  case R_PATMOS_MEMH_SDA: {
+    val = getSmallDataOffset(val);
+
+    // Relocate LDT or STT format (7 bit immediate), small data offset
+    // (unsigned), in half-words
+    checkAlignment(loc, val, 2, rel);
+    checkUInt(loc, static_cast<int64_t>(val) >> 1, 7, rel);
+
+    const uint32_t mask = 0x7F;
+    uint32_t insn = read32be(loc) & ~(mask);
+    uint32_t imm =  extractBits(val, 7, 1);
+    insn |= imm;
+    write32be(loc,insn);
+    return;
+  }
+  case R_PATMOS_MEMW_SDA: {
+    val = getSmallDataOffset(val);
+
+    // Relocate LDT or STT format (7 bit immediate), small data offset
+    // (unsigned), in words
+    checkAlignment(loc, val, 4, rel);
+    checkUInt(loc, static_cast<int64_t>(val) >> 2, 7, rel);
+
+    const uint32_t mask = 0x7F;
+    uint32_t insn = read32be(loc) & ~(mask);
+    uint32_t imm =  extractBits(val, 8, 2);
+    insn |= imm;
+    write32be(loc,insn);
+    return;
+  }
   default:
     llvm_unreachable("unknown relocation");
   }
 }
 
+void Patmos::relocate(uint8_t *loc, const Relocation &rel, uint64_t val) const {
+  relocateOne(loc, rel, val);
+}
+
+// relocateAllocBatch - patch all data/instructions of an allocated section
+// The Patmos relocations are absolute or PC relative and are never relaxed, so
+// the generic per-relocation dispatch is not needed: the address of the
+// section is computed once, and the patching is not a virtual call. Large
+// sections, e.g., with data tables, thus relocate faster.
+//// @param sec   Section to be relocated
+//// @param buf   Pointer to the section in the output buffer
+bool Patmos::relocateAllocBatch(InputSectionBase &sec, uint8_t *buf) const {
+  if (!sec.jumpInstrMods.empty())
+    return false;
+  for (const Relocation &rel : sec.relocations)
+    if (rel.expr != R_NONE && rel.expr != R_ABS && rel.expr != R_PC)
+      return false;
+
+  uint64_t secAddr = sec.getOutputSection()->addr;
+  if (auto *isec = dyn_cast<InputSection>(&sec))
+    secAddr += isec->outSecOff;
+
+  for (const Relocation &rel : sec.relocations) {
+    if (rel.expr == R_NONE)
+      continue;
+
+    // Same value as in InputSectionBase::relocateAlloc, for 32 bit words
+    uint64_t val = rel.expr == R_ABS
+        ? rel.sym->getVA(rel.addend)
+        : InputSectionBase::getRelocTargetVA(sec.file, rel.type, rel.addend,
+                                             secAddr + rel.offset, *rel.sym,
+                                             rel.expr);
+    relocateOne(buf + rel.offset, rel, SignExtend64<32>(val));
+  }
+  return true;
+}
+
 TargetInfo *elf::getPatmosTargetInfo() {
   static Patmos target;
   return &target;
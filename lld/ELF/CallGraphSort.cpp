@@ -38,6 +38,13 @@
 ///   * If not, then combine the clusters.
 /// * Sort non-empty clusters by density
 ///
+/// On Patmos, the code is fetched into a method cache, a function at a time.
+/// There, a cluster is at most as large as the method cache
+/// (--patmos-method-cache-size). The functions of a cluster then occupy
+/// disjoint parts of the cache, so callers and callees that are placed
+/// together do not evict each other in a direct-mapped or set-associative
+/// method cache.
+///
 //===----------------------------------------------------------------------===//
 
 #include "CallGraphSort.h"
@@ -93,6 +100,12 @@ constexpr int MAX_DENSITY_DEGRADATION = 8;
 constexpr uint64_t MAX_CLUSTER_SIZE = 1024 * 1024;
 } // end anonymous namespace
 
+static uint64_t getMaxClusterSize() {
+  if (config->emachine == ELF::EM_PATMOS)
+    return config->patmosMethodCacheSize;
+  return MAX_CLUSTER_SIZE;
+}
+
 using SectionPair =
     std::pair<const InputSectionBase *, const InputSectionBase *>;
 
@@ -188,6 +201,7 @@ DenseMap<const InputSectionBase *, int> CallGraphSort::run() {
     return clusters[a].getDensity() > clusters[b].getDensity();
   });
 
+  uint64_t maxClusterSize = getMaxClusterSize();
   for (int l : sorted) {
     // The cluster index is the same as the index of its leader here because
     // clusters[L] has not been merged into another cluster yet.
@@ -202,7 +216,7 @@ DenseMap<const InputSectionBase *, int> CallGraphSort::run() {
       continue;
 
     Cluster *predC = &clusters[predL];
-    if (c.size + predC->size > MAX_CLUSTER_SIZE)
+    if (c.size + predC->size > maxClusterSize)
       continue;
 
     if (isNewDensityBad(*predC, c))
@@ -114,6 +114,7 @@ struct Configuration {
   llvm::Optional<uint64_t> optRemarksHotnessThreshold = 0;
   llvm::StringRef optRemarksPasses;
   llvm::StringRef optRemarksFormat;
+  llvm::StringRef patmosIncremental;
   llvm::StringRef progName;
   llvm::StringRef printArchiveStats;
   llvm::StringRef printSymbolOrder;
@@ -189,6 +190,8 @@ struct Configuration {
   bool omagic;
   bool optimizeBBJumps;
   bool optRemarksWithHotness;
+  bool patmosCompress;
+  bool patmosRemoveEnsures;
   bool picThunk;
   bool pie;
   bool printGcSections;
@@ -257,9 +260,14 @@ struct Configuration {
   ELFKind ekind = ELFNoneKind;
   uint16_t emachine = llvm::ELF::EM_NONE;
   llvm::Optional<uint64_t> imageBase;
+  llvm::Optional<uint64_t> patmosISPMBase;
   uint64_t commonPageSize;
   uint64_t maxPageSize;
   uint64_t mipsGotSize;
+  uint64_t patmosBurstSize;
+  uint64_t patmosIncrementalPadding;
+  uint64_t patmosMethodCacheSize;
+  uint64_t patmosStackCacheSize;
   uint64_t zStackSize;
   unsigned ltoPartitions;
   unsigned ltoo;
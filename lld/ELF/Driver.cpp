@@ -356,6 +356,8 @@ static void checkOptions() {
       error("-r and -pie may not be used together");
     if (config->exportDynamic)
       error("-r and --export-dynamic may not be used together");
+    if (!config->patmosIncremental.empty())
+      error("-r and --patmos-incremental may not be used together");
   }
 
   if (config->executeOnly) {
@@ -366,6 +368,22 @@ static void checkOptions() {
       error("-execute-only and -no-rosegment cannot be used together");
   }
 
+  if (!config->patmosIncremental.empty() && config->emachine != EM_PATMOS)
+    error("--patmos-incremental is only supported on Patmos targets");
+
+  if (config->patmosISPMBase && config->emachine != EM_PATMOS)
+    error("--patmos-ispm-base is only supported on Patmos targets");
+
+  if (config->patmosCompress) {
+    if (config->emachine != EM_PATMOS)
+      error("--patmos-compress is only supported on Patmos targets");
+    if (config->relocatable || config->shared)
+      error("--patmos-compress may not be used with -r or -shared");
+  }
+
+  if (!isPowerOf2_64(config->patmosBurstSize))
+    error("--patmos-burst-size: value must be a power of two");
+
   if (config->zRetpolineplt && config->zForceIbt)
     error("-z force-ibt may not be used with -z retpolineplt");
 
@@ -926,6 +944,20 @@ static void parseClangOption(StringRef opt, const Twine &msg) {
   error(msg + ": " + StringRef(err).trim());
 }
 
+static Optional<uint64_t> getPatmosISPMBase(opt::InputArgList &args) {
+  auto *arg = args.getLastArg(OPT_patmos_ispm_base);
+  if (!arg)
+    return None;
+
+  StringRef s = arg->getValue();
+  uint64_t v;
+  if (!to_integer(s, v)) {
+    error("--patmos-ispm-base: number expected, but got " + s);
+    return None;
+  }
+  return v;
+}
+
 // Initializes Config members by the command line options.
 static void readConfigs(opt::InputArgList &args) {
   errorHandler().verbose = args.hasArg(OPT_verbose);
@@ -1043,6 +1075,20 @@ static void readConfigs(opt::InputArgList &args) {
   config->optimize = args::getInteger(args, OPT_O, 1);
   config->orphanHandling = getOrphanHandling(args);
   config->outputFile = args.getLastArgValue(OPT_o);
+  config->patmosBurstSize =
+      args::getInteger(args, OPT_patmos_burst_size, 16);
+  config->patmosCompress =
+      args.hasFlag(OPT_patmos_compress, OPT_no_patmos_compress, false);
+  config->patmosIncremental = args.getLastArgValue(OPT_patmos_incremental);
+  config->patmosISPMBase = getPatmosISPMBase(args);
+  config->patmosIncrementalPadding =
+      args::getInteger(args, OPT_patmos_incremental_padding, 12);
+  config->patmosMethodCacheSize =
+      args::getInteger(args, OPT_patmos_method_cache_size, 4096);
+  config->patmosRemoveEnsures = args.hasFlag(
+      OPT_patmos_remove_ensures, OPT_no_patmos_remove_ensures, false);
+  config->patmosStackCacheSize =
+      args::getInteger(args, OPT_patmos_stack_cache_size, 4096);
   config->pie = args.hasFlag(OPT_pie, OPT_no_pie, false);
   config->printIcfSections =
       args.hasFlag(OPT_print_icf_sections, OPT_no_print_icf_sections, false);
@@ -1058,6 +1104,10 @@ static void readConfigs(opt::InputArgList &args) {
     config->shuffleSectionSeed = args::getInteger(args, OPT_shuffle_sections, 0);
   config->searchPaths = args::getStrings(args, OPT_library_path);
   config->sectionStartMap = getSectionStartMap(args);
+  // Functions placed in the Patmos instruction scratchpad are linked to its
+  // address, as with --section-start=.ispm=<address>.
+  if (config->patmosISPMBase)
+    config->sectionStartMap.try_emplace(".ispm", *config->patmosISPMBase);
   config->shared = args.hasArg(OPT_shared);
   config->singleRoRx = !args.hasFlag(OPT_rosegment, OPT_no_rosegment, true);
   config->soName = args.getLastArgValue(OPT_soname);
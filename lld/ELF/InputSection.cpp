@@ -1009,6 +1009,9 @@ void InputSectionBase::relocate(uint8_t *buf, uint8_t *bufEnd) {
 
 void InputSectionBase::relocateAlloc(uint8_t *buf, uint8_t *bufEnd) {
   assert(flags & SHF_ALLOC);
+  if (target->relocateAllocBatch(*this, buf))
+    return;
+
   const unsigned bits = config->wordsize * 8;
   uint64_t lastPPCRelaxedRelocOff = UINT64_C(-1);
 
@@ -14,6 +14,7 @@
 #include "Config.h"
 #include "InputSection.h"
 #include "OutputSections.h"
+#include "PatmosIncremental.h"
 #include "SymbolTable.h"
 #include "Symbols.h"
 #include "SyntheticSections.h"
@@ -836,8 +837,20 @@ uint64_t LinkerScript::advance(uint64_t size, unsigned alignment) {
 void LinkerScript::output(InputSection *s) {
   assert(ctx->outSec == s->getParent());
   uint64_t before = advance(0, 1);
+
+  // A Patmos incremental link keeps sections at their previous address, and
+  // leaves room after new sections.
+  bool incremental = !config->patmosIncremental.empty();
+  if (incremental) {
+    uint64_t previous = getPatmosIncrementalAddress(s);
+    if (previous > dot)
+      advance(previous - dot, 1);
+  }
+
   uint64_t pos = advance(s->getSize(), s->alignment);
   s->outSecOff = pos - s->getSize() - ctx->outSec->addr;
+  if (incremental)
+    pos = advance(getPatmosIncrementalPadding(s), 1);
 
   // Update output section size after adding each section. This is so that
   // SIZEOF works correctly in the case below:
@@ -853,6 +866,12 @@ void LinkerScript::switchTo(OutputSection *sec) {
     // The alignment is ignored.
     ctx->outSec->addr = pos;
   } else {
+    if (!config->patmosIncremental.empty()) {
+      uint64_t previous = getPatmosIncrementalAddress(sec);
+      if (previous > dot)
+        advance(previous - dot, 1);
+    }
+
     // ctx->outSec->alignment is the max of ALIGN and the maximum of input
     // section alignments.
     ctx->outSec->addr = advance(0, ctx->outSec->alignment);
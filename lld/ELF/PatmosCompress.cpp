@@ -0,0 +1,171 @@
+//===- PatmosCompress.cpp -------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the compressed boot images of Patmos
+// (--patmos-compress).
+//
+// Patmos boards load the program from a slow flash, the bootloader reads every
+// segment in full. The data sections, e.g., large constant tables, are instead
+// compressed into the .patmos.lz4 section, which follows all other sections in
+// a segment of its own, and become SHT_NOBITS. __patmos_init_sections of the
+// startup code decompresses them into place, before the data is used.
+//
+// Only the sections at the end of a segment, possibly followed by bss, can be
+// compressed, the file offsets of the others follow their addresses. Code is
+// not compressed, nor are TLS sections, the headers, or sections that do not
+// shrink. The image is:
+//
+//   count
+//   count * { address, size, offset of the data in the image, data size }
+//   the data of the sections, in the LZ4 block format
+//
+// in words of the target. The image is referenced by __patmos_lz4_image. It is
+// not a part of the program, _end precedes it and the heap reuses its memory.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosCompress.h"
+#include "Config.h"
+#include "OutputSections.h"
+#include "SyntheticSections.h"
+#include "Target.h"
+#include "Writer.h"
+#include "lld/Common/ErrorHandler.h"
+#include "llvm/Support/Endian.h"
+#include <cstring>
+
+using namespace llvm;
+using namespace llvm::ELF;
+using namespace llvm::object;
+using namespace llvm::support::endian;
+using namespace lld;
+using namespace lld::elf;
+
+// Sections smaller than this are not compressed, their images hardly shrink.
+static const uint64_t minCompressSize = 64;
+
+// The parameters of the LZ4 block format: matches have at least 4 bytes, the
+// last match starts at least 12 bytes before the end, and the last 5 bytes are
+// literals.
+static const size_t minMatch = 4;
+static const size_t matchLimit = 12;
+static const size_t lastLiterals = 5;
+static const size_t maxOffset = 65535;
+static const unsigned hashBits = 12;
+
+static uint32_t hash4(const uint8_t *p) {
+  return (read32le(p) * 2654435761u) >> (32 - hashBits);
+}
+
+static void writeLength(std::vector<uint8_t> &out, size_t len) {
+  for (; len >= 255; len -= 255)
+    out.push_back(255);
+  out.push_back(len);
+}
+
+static void writeSequence(std::vector<uint8_t> &out, ArrayRef<uint8_t> literals,
+                          size_t offset, size_t matchLen) {
+  size_t lit = literals.size();
+  size_t match = matchLen ? matchLen - minMatch : 0;
+  out.push_back((std::min<size_t>(lit, 15) << 4) | std::min<size_t>(match, 15));
+  if (lit >= 15)
+    writeLength(out, lit - 15);
+  out.insert(out.end(), literals.begin(), literals.end());
+  if (!matchLen)
+    return;
+  out.push_back(offset & 0xff);
+  out.push_back(offset >> 8);
+  if (match >= 15)
+    writeLength(out, match - 15);
+}
+
+// Greedy parsing with a hash table of the last position of every hashed four
+// bytes, the positions covered by a match are inserted as well.
+std::vector<uint8_t> elf::compressPatmosLZ4(ArrayRef<uint8_t> data) {
+  std::vector<uint8_t> out;
+  std::vector<int64_t> table(1 << hashBits, -1);
+  size_t n = data.size();
+  size_t anchor = 0;
+
+  for (size_t i = 0; i + matchLimit <= n;) {
+    uint32_t h = hash4(&data[i]);
+    int64_t cand = table[h];
+    table[h] = i;
+    if (cand < 0 || i - cand > maxOffset ||
+        memcmp(&data[cand], &data[i], minMatch)) {
+      i++;
+      continue;
+    }
+
+    size_t len = minMatch;
+    while (i + len < n - lastLiterals && data[cand + len] == data[i + len])
+      len++;
+
+    writeSequence(out, data.slice(anchor, i - anchor), i - cand, len);
+    for (size_t k = i + 1; k < i + len && k + minMatch <= n; k++)
+      table[hash4(&data[k])] = k;
+    i += len;
+    anchor = i;
+  }
+
+  writeSequence(out, data.slice(anchor), 0, 0);
+  return out;
+}
+
+void elf::compressPatmosSections() {
+  struct Entry {
+    OutputSection *sec;
+    std::vector<uint8_t> data;
+  };
+  std::vector<Entry> entries;
+  OutputSection *image = in.patmosCompressed->getParent();
+
+  for (PhdrEntry *p : mainPart->phdrs) {
+    if (p->p_type != PT_LOAD || p->firstSec == image)
+      continue;
+
+    std::vector<OutputSection *> secs;
+    for (OutputSection *sec : outputSections)
+      if (sec->ptLoad == p)
+        secs.push_back(sec);
+
+    for (OutputSection *sec : llvm::reverse(secs)) {
+      if (sec->type == SHT_NOBITS)
+        continue;
+      if (sec->type != SHT_PROGBITS ||
+          (sec->flags & (SHF_EXECINSTR | SHF_TLS)) || sec == Out::elfHeader || sec == Out::programHeaders ||
+          sec->size < minCompressSize)
+        break;
+
+      std::vector<uint8_t> buf(sec->size);
+      sec->writeTo<ELF32BE>(buf.data());
+      std::vector<uint8_t> data = compressPatmosLZ4(buf);
+      if (data.size() + 16 >= sec->size)
+        break;
+
+      sec->type = SHT_NOBITS;
+      entries.push_back({sec, std::move(data)});
+    }
+  }
+
+  std::vector<uint8_t> &content = in.patmosCompressed->content;
+  uint64_t off = 4 + 16 * entries.size();
+  content.resize(off);
+  write32(content.data(), entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    uint8_t *e = content.data() + 4 + 16 * i;
+    write32(e, entries[i].sec->addr);
+    write32(e + 4, entries[i].sec->size);
+    write32(e + 8, off);
+    write32(e + 12, entries[i].data.size());
+    off += entries[i].data.size();
+  }
+  for (Entry &e : entries)
+    content.insert(content.end(), e.data.begin(), e.data.end());
+  image->size = content.size();
+}
@@ -0,0 +1,29 @@
+//===- PatmosCompress.h -----------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLD_ELF_PATMOS_COMPRESS_H
+#define LLD_ELF_PATMOS_COMPRESS_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include <cstdint>
+#include <vector>
+
+namespace lld {
+namespace elf {
+
+// Compress data into the LZ4 block format.
+std::vector<uint8_t> compressPatmosLZ4(llvm::ArrayRef<uint8_t> data);
+
+// Replace the contents of the data sections at the ends of the segments by
+// their compressed image in .patmos.lz4 (--patmos-compress). The addresses of
+// the sections must have been assigned, but not their file offsets.
+void compressPatmosSections();
+} // namespace elf
+} // namespace lld
+
+#endif
@@ -0,0 +1,215 @@
+//===- PatmosIncremental.cpp ----------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements --patmos-incremental, which keeps the layout of a
+// Patmos program stable between links during development.
+//
+// Each link records the address, the slot (the space up to the next section)
+// and a hash of the contents of every allocated input section in a layout
+// file. The next link places each section that still fits into its slot at
+// its previous address, and each output section at its previous address if
+// it is not behind the preceding output sections. Sections that are new or
+// that outgrew their slot are placed after the others, followed by
+// --patmos-incremental-padding percent of their size to grow into. A change
+// to a function thus only changes the bytes of the function and of the code
+// that refers to it, and the output can be compared or flashed section by
+// section.
+//
+// Sections are identified by their name. The object file that results from
+// the Patmos link of the program has a different name in every build, and
+// the name of a section is unique with -ffunction-sections and
+// -fdata-sections. Sections with the same name are told apart by the order
+// of the input files.
+//
+// The layout file is a line per section:
+//
+//   output <address> <name>
+//   input <address> <slot> <hash> <name>
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosIncremental.h"
+#include "Config.h"
+#include "InputSection.h"
+#include "OutputSections.h"
+#include "SyntheticSections.h"
+#include "lld/Common/ErrorHandler.h"
+#include "lld/Common/Memory.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+using namespace llvm::ELF;
+using namespace lld;
+using namespace lld::elf;
+
+namespace {
+struct PreviousSection {
+  StringRef outputSection;
+  uint64_t addr;
+  uint64_t slot;
+  uint64_t hash;
+};
+} // namespace
+
+static StringMap<PreviousSection> previousSections;
+static StringMap<uint64_t> previousOutputSections;
+
+// The names of the sections in the layout file, and the previous addresses
+// of the sections that keep them.
+static DenseMap<const InputSectionBase *, StringRef> keys;
+static DenseMap<const InputSectionBase *, uint64_t> keptAddresses;
+
+static bool readLayout() {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> mb =
+      MemoryBuffer::getFile(config->patmosIncremental);
+  if (!mb) {
+    log(config->patmosIncremental + ": no previous layout, placing all "
+        "sections anew");
+    return false;
+  }
+  StringRef data = saver.save((*mb)->getBuffer());
+
+  StringRef outputSection;
+  while (!data.empty()) {
+    StringRef line;
+    std::tie(line, data) = data.split('\n');
+    if (line.empty())
+      continue;
+
+    StringRef kind, addr, slot, hash, name;
+    std::tie(kind, line) = line.split(' ');
+    std::tie(addr, line) = line.split(' ');
+    PreviousSection s = {outputSection, 0, 0, 0};
+    bool valid = !addr.getAsInteger(0, s.addr);
+    if (kind == "output") {
+      name = line;
+      outputSection = name;
+      previousOutputSections[name] = s.addr;
+    } else if (kind == "input") {
+      std::tie(slot, line) = line.split(' ');
+      std::tie(hash, name) = line.split(' ');
+      valid &= !slot.getAsInteger(0, s.slot) && !hash.getAsInteger(0, s.hash);
+      previousSections[name] = s;
+    } else {
+      valid = false;
+    }
+    if (!valid || name.empty()) {
+      warn(config->patmosIncremental + ": malformed layout, placing all "
+           "sections anew");
+      previousSections.clear();
+      previousOutputSections.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool isIncrementalSection(const InputSectionBase *s) {
+  return s->isLive() && (s->flags & SHF_ALLOC) && !(s->flags & SHF_TLS) &&
+         isa<InputSection>(s) && !isa<SyntheticSection>(s) &&
+         cast<InputSection>(s)->getParent();
+}
+
+DenseMap<const InputSectionBase *, int> elf::buildPatmosIncrementalOrder() {
+  bool hasLayout = readLayout();
+
+  std::vector<std::pair<uint64_t, const InputSectionBase *>> kept;
+  StringMap<unsigned> occurrences;
+  for (const InputSectionBase *s : inputSections) {
+    if (!isIncrementalSection(s))
+      continue;
+    unsigned n = occurrences[s->name]++;
+    StringRef key = n ? saver.save(s->name + "#" + Twine(n)) : s->name;
+    keys[s] = key;
+    if (!hasLayout)
+      continue;
+
+    auto it = previousSections.find(key);
+    if (it == previousSections.end())
+      continue;
+    const PreviousSection &p = it->second;
+    if (p.outputSection != cast<InputSection>(s)->getParent()->name ||
+        s->getSize() > p.slot || p.addr % s->alignment != 0)
+      continue;
+    keptAddresses[s] = p.addr;
+    kept.push_back({p.addr, s});
+  }
+
+  llvm::sort(kept, llvm::less_first());
+  DenseMap<const InputSectionBase *, int> order;
+  int priority = -kept.size();
+  for (auto &k : kept)
+    order[k.second] = priority++;
+  return order;
+}
+
+uint64_t elf::getPatmosIncrementalAddress(const InputSectionBase *sec) {
+  return keptAddresses.lookup(sec);
+}
+
+uint64_t elf::getPatmosIncrementalAddress(const OutputSection *sec) {
+  return previousOutputSections.lookup(sec->name);
+}
+
+uint64_t elf::getPatmosIncrementalPadding(const InputSection *sec) {
+  // The slot of a kept section ends at the address of the next one.
+  if (!keys.count(sec) || keptAddresses.count(sec))
+    return 0;
+  return alignTo(sec->getSize() * config->patmosIncrementalPadding / 100, 4);
+}
+
+void elf::writePatmosIncrementalLayout(const uint8_t *buf) {
+  std::error_code ec;
+  raw_fd_ostream os(config->patmosIncremental, ec, sys::fs::OF_None);
+  if (ec) {
+    error("cannot open " + config->patmosIncremental + ": " + ec.message());
+    return;
+  }
+
+  unsigned numUnchanged = 0, numChanged = 0, numMoved = 0, numNew = 0;
+  for (OutputSection *osec : outputSections) {
+    if (!(osec->flags & SHF_ALLOC) || (osec->flags & SHF_TLS))
+      continue;
+    os << "output 0x" << utohexstr(osec->addr) << ' ' << osec->name << '\n';
+
+    std::vector<InputSection *> sections = getInputSections(osec);
+    for (size_t i = 0, e = sections.size(); i != e; ++i) {
+      InputSection *isec = sections[i];
+      auto key = keys.find(isec);
+      if (key == keys.end())
+        continue;
+
+      uint64_t addr = isec->getVA(0);
+      uint64_t end =
+          i + 1 != e ? sections[i + 1]->getVA(0) : osec->addr + osec->size;
+      uint64_t hash = 0;
+      if (osec->type != SHT_NOBITS)
+        hash = xxHash64(makeArrayRef(buf + osec->offset + isec->outSecOff,
+                                     isec->getSize()));
+      os << "input 0x" << utohexstr(addr) << " 0x" << utohexstr(end - addr)
+         << " 0x" << utohexstr(hash) << ' ' << key->second << '\n';
+
+      auto p = previousSections.find(key->second);
+      if (p == previousSections.end())
+        ++numNew;
+      else if (p->second.addr != addr)
+        ++numMoved;
+      else if (p->second.hash != hash)
+        ++numChanged;
+      else
+        ++numUnchanged;
+    }
+  }
+
+  log("--patmos-incremental: " + Twine(numUnchanged) + " sections unchanged, " +
+      Twine(numChanged) + " changed in place, " + Twine(numMoved) +
+      " moved, " + Twine(numNew) + " new");
+}
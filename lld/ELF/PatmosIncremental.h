@@ -0,0 +1,37 @@
+//===- PatmosIncremental.h --------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLD_ELF_PATMOS_INCREMENTAL_H
+#define LLD_ELF_PATMOS_INCREMENTAL_H
+
+#include "llvm/ADT/DenseMap.h"
+
+namespace lld {
+namespace elf {
+class InputSection;
+class InputSectionBase;
+class OutputSection;
+
+// Read the layout of the previous link (--patmos-incremental) and return the
+// order of the sections that keep their address. All other sections are
+// placed after them.
+llvm::DenseMap<const InputSectionBase *, int> buildPatmosIncrementalOrder();
+
+// The address of a section in the previous link, or 0 if it is placed anew.
+uint64_t getPatmosIncrementalAddress(const InputSectionBase *sec);
+uint64_t getPatmosIncrementalAddress(const OutputSection *sec);
+
+// The space to leave after a section for it to grow into.
+uint64_t getPatmosIncrementalPadding(const InputSection *sec);
+
+// Record the layout of the written output for the next link.
+void writePatmosIncrementalLayout(const uint8_t *buf);
+} // namespace elf
+} // namespace lld
+
+#endif
@@ -0,0 +1,236 @@
+//===- PatmosStackCache.cpp -----------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the removal of Patmos stack cache ensures over the
+// call graph of the linked program (--patmos-remove-ensures).
+//
+// An ensure after a call refills the frame of the caller if the callee (and
+// the functions it calls) displaced it from the stack cache. The compiler
+// removes ensures for which the displacement of the callees is known to
+// leave the frame in the stack cache, but it only sees the functions of a
+// single module. With -mpatmos-emit-stack-cache-summary, the compiler emits
+// the frame size and the call sites of every function into the
+// .patmos.stackcache section, and this pass repeats the analysis for the
+// whole program:
+//
+//   displacement(f) = min(size, frame(f) + max(displacement(callee)))
+//
+// over all calls in f, or the bound of the compiler's stack cache analysis,
+// if smaller. The displacement of a function without a summary, of an
+// indirect call and of a recursion is the whole stack cache. An ensure of
+// n bytes never fills if n plus the displacement of every call it follows
+// fits into the stack cache. Its immediate is then set to 0.
+//
+// The summaries are read from the written output, where the relocations of
+// the section have been applied. Addresses whose relocation refers to a
+// discarded section are ignored.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosStackCache.h"
+#include "Config.h"
+#include "InputFiles.h"
+#include "InputSection.h"
+#include "OutputSections.h"
+#include "Symbols.h"
+#include "lld/Common/ErrorHandler.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/Endian.h"
+
+using namespace llvm;
+using namespace llvm::ELF;
+using namespace llvm::object;
+using namespace llvm::support::endian;
+using namespace lld;
+using namespace lld::elf;
+
+// The record kinds of the section, see PatmosTargetStreamer.h.
+static const uint32_t frameRecord = 1;
+static const uint32_t callRecord = 2;
+static const uint32_t displacementRecord = 3;
+
+// The encoding of an ensure with immediate (SENSi), and the bits of its
+// immediate, in words.
+static const uint32_t ensureMask = 0x07fc0000;
+static const uint32_t ensureBits = 0x03100000;
+static const uint32_t ensureImmMask = 0x0003ffff;
+
+namespace {
+struct Call {
+  // The callee and the ensure after the call, 0 if unknown or not removable.
+  uint64_t callee;
+  uint64_t ensure;
+  uint64_t ensureBytes;
+};
+
+struct Function {
+  bool hasFrame = false;
+  uint64_t frameBytes = 0;
+  // The bound of the compiler's stack cache analysis, if it ran.
+  uint64_t maxDisplacement = UINT64_MAX;
+  SmallVector<Call, 4> calls;
+};
+
+class StackCacheAnalysis {
+public:
+  StackCacheAnalysis(uint8_t *buf) : buf(buf) {}
+  void run();
+
+private:
+  void readSummaries(OutputSection *os);
+  template <class RelTy>
+  void markValidFields(InputSection *isec, ArrayRef<RelTy> rels);
+  uint64_t getDisplacement(uint64_t function);
+  void removeEnsure(uint64_t addr, uint64_t ensureBytes);
+
+  uint8_t *buf;
+  uint64_t size = config->patmosStackCacheSize;
+
+  // The offsets of the fields in the summary section that hold the address
+  // of a live symbol.
+  DenseSet<uint64_t> validFields;
+
+  DenseMap<uint64_t, Function> functions;
+  DenseMap<uint64_t, uint64_t> displacements;
+
+  unsigned numEnsures = 0;
+  unsigned numRemoved = 0;
+};
+} // namespace
+
+template <class RelTy>
+void StackCacheAnalysis::markValidFields(InputSection *isec,
+                                         ArrayRef<RelTy> rels) {
+  for (const RelTy &rel : rels) {
+    Symbol &sym = isec->getFile<ELF32BE>()->getRelocTargetSym(rel);
+    if (sym.getOutputSection())
+      validFields.insert(isec->outSecOff + rel.r_offset);
+  }
+}
+
+void StackCacheAnalysis::readSummaries(OutputSection *os) {
+  for (InputSection *isec : getInputSections(os)) {
+    if (isec->areRelocsRela)
+      markValidFields(isec, isec->template relas<ELF32BE>());
+    else
+      markValidFields(isec, isec->template rels<ELF32BE>());
+  }
+
+  const uint8_t *data = buf + os->offset;
+  auto readField = [&](uint64_t off) -> uint64_t {
+    return validFields.count(off) ? read32be(data + off) : 0;
+  };
+
+  uint64_t off = 0;
+  while (off + 4 <= os->size) {
+    uint32_t kind = read32be(data + off);
+    if (kind == frameRecord && off + 12 <= os->size) {
+      if (uint64_t function = readField(off + 4)) {
+        Function &f = functions[function];
+        f.hasFrame = true;
+        f.frameBytes = std::max<uint64_t>(f.frameBytes, read32be(data + off + 8));
+      }
+      off += 12;
+    } else if (kind == callRecord && off + 20 <= os->size) {
+      if (uint64_t caller = readField(off + 4))
+        functions[caller].calls.push_back(
+            {readField(off + 8), readField(off + 12), read32be(data + off + 16)});
+      off += 20;
+    } else if (kind == displacementRecord && off + 16 <= os->size) {
+      if (uint64_t function = readField(off + 4)) {
+        Function &f = functions[function];
+        f.maxDisplacement =
+            std::min<uint64_t>(f.maxDisplacement, read32be(data + off + 12));
+      }
+      off += 16;
+    } else {
+      warn(os->name + ": unknown stack cache summary record at offset " +
+           Twine(off) + "; ensures are kept");
+      functions.clear();
+      return;
+    }
+  }
+}
+
+uint64_t StackCacheAnalysis::getDisplacement(uint64_t function) {
+  auto it = displacements.find(function);
+  if (it != displacements.end())
+    return it->second;
+
+  auto f = functions.find(function);
+  if (function == 0 || f == functions.end() || !f->second.hasFrame)
+    return size;
+
+  // A recursion may displace the whole stack cache.
+  displacements[function] = size;
+
+  uint64_t childDisplacement = 0;
+  for (const Call &call : f->second.calls)
+    childDisplacement =
+        std::max(childDisplacement, getDisplacement(call.callee));
+
+  uint64_t displacement =
+      std::min({size, f->second.frameBytes + childDisplacement,
+                f->second.maxDisplacement});
+  displacements[function] = displacement;
+  return displacement;
+}
+
+void StackCacheAnalysis::removeEnsure(uint64_t addr, uint64_t ensureBytes) {
+  for (OutputSection *os : outputSections) {
+    if (!(os->flags & SHF_EXECINSTR) || os->type == SHT_NOBITS ||
+        addr < os->addr || addr + 4 > os->addr + os->size)
+      continue;
+
+    uint8_t *loc = buf + os->offset + (addr - os->addr);
+    uint32_t insn = read32be(loc);
+    if ((insn & ensureMask) != ensureBits ||
+        (insn & ensureImmMask) * 4 != ensureBytes) {
+      warn(os->name + ": no stack cache ensure at 0x" + utohexstr(addr) +
+           " as given by the stack cache summary");
+      return;
+    }
+    write32be(loc, insn & ~ensureImmMask);
+    ++numRemoved;
+    return;
+  }
+}
+
+void StackCacheAnalysis::run() {
+  for (OutputSection *os : outputSections)
+    if (os->name == ".patmos.stackcache" && os->type != SHT_NOBITS)
+      readSummaries(os);
+
+  // The size of an ensure, and the size it needs in the stack cache after
+  // all the calls it follows.
+  DenseMap<uint64_t, std::pair<uint64_t, uint64_t>> ensures;
+  for (auto &f : functions) {
+    for (const Call &call : f.second.calls) {
+      if (call.ensure == 0)
+        continue;
+      std::pair<uint64_t, uint64_t> &e = ensures[call.ensure];
+      e.first = call.ensureBytes;
+      e.second = std::max(e.second,
+                          call.ensureBytes + getDisplacement(call.callee));
+    }
+  }
+
+  for (auto &e : ensures) {
+    ++numEnsures;
+    if (e.second.second <= size)
+      removeEnsure(e.first, e.second.first);
+  }
+
+  log("removed " + Twine(numRemoved) + " of " + Twine(numEnsures) +
+      " Patmos stack cache ensures");
+}
+
+void elf::removePatmosEnsures(uint8_t *buf) {
+  StackCacheAnalysis(buf).run();
+}
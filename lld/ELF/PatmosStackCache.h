@@ -0,0 +1,23 @@
+//===- PatmosStackCache.h ---------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLD_ELF_PATMOS_STACK_CACHE_H
+#define LLD_ELF_PATMOS_STACK_CACHE_H
+
+#include <cstdint>
+
+namespace lld {
+namespace elf {
+
+// Remove the stack cache ensures of the written output that never fill,
+// given the call graph of the whole program (--patmos-remove-ensures).
+void removePatmosEnsures(uint8_t *buf);
+} // namespace elf
+} // namespace lld
+
+#endif
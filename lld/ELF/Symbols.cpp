@@ -61,6 +61,12 @@ Defined *ElfSym::mipsLocalGp;
 Defined *ElfSym::relaIpltStart;
 Defined *ElfSym::relaIpltEnd;
 Defined *ElfSym::riscvGlobalPointer;
+Defined *ElfSym::patmosSmallDataBase;
+Defined *ElfSym::patmosDataStart;
+Defined *ElfSym::patmosDataEnd;
+Defined *ElfSym::patmosDataLoad;
+Defined *ElfSym::patmosBssStart;
+Defined *ElfSym::patmosBssEnd;
 Defined *ElfSym::tlsModuleBase;
 DenseMap<const Symbol *, std::pair<const InputFile *, const InputFile *>>
     elf::backwardReferences;
@@ -465,6 +465,17 @@ struct ElfSym {
   // __global_pointer$ for RISC-V.
   static Defined *riscvGlobalPointer;
 
+  // _SDA_BASE_ for Patmos, the start of the small data area.
+  static Defined *patmosSmallDataBase;
+
+  // __patmos_{data,bss}_{start,end} and __patmos_data_load for Patmos, the
+  // ranges the startup code copies and clears.
+  static Defined *patmosDataStart;
+  static Defined *patmosDataEnd;
+  static Defined *patmosDataLoad;
+  static Defined *patmosBssStart;
+  static Defined *patmosBssEnd;
+
   // _TLS_MODULE_BASE_ on targets that support TLSDESC.
   static Defined *tlsModuleBase;
 };
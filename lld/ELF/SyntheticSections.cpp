@@ -3774,6 +3774,13 @@ void PartitionProgramHeadersSection<ELFT>::writeTo(uint8_t *buf) {
   writePhdrs<ELFT>(buf, getPartition());
 }
 
+PatmosCompressedSection::PatmosCompressedSection()
+    : SyntheticSection(SHF_ALLOC, SHT_PROGBITS, 4, ".patmos.lz4") {}
+
+void PatmosCompressedSection::writeTo(uint8_t *buf) {
+  memcpy(buf, content.data(), content.size());
+}
+
 PartitionIndexSection::PartitionIndexSection()
     : SyntheticSection(SHF_ALLOC, SHT_PROGBITS, 4, ".rodata") {}
 
@@ -1136,6 +1136,18 @@ public:
   void writeTo(uint8_t *buf) override;
 };
 
+// The compressed image of the Patmos data sections (--patmos-compress), see
+// PatmosCompress.cpp. It is filled once the addresses are assigned, it
+// follows all other sections and is empty until then.
+class PatmosCompressedSection final : public SyntheticSection {
+public:
+  PatmosCompressedSection();
+  size_t getSize() const override { return content.size(); }
+  void writeTo(uint8_t *buf) override;
+
+  std::vector<uint8_t> content;
+};
+
 class PartitionIndexSection : public SyntheticSection {
 public:
   PartitionIndexSection();
@@ -1209,6 +1221,7 @@ struct InStruct {
   PltSection *plt;
   IpltSection *iplt;
   PPC32Got2Section *ppc32Got2;
+  PatmosCompressedSection *patmosCompressed;
   IBTPltSection *ibtPlt;
   RelocationBaseSection *relaPlt;
   RelocationBaseSection *relaIplt;
@@ -88,6 +88,13 @@ public:
     relocate(loc, Relocation{R_NONE, type, 0, 0, nullptr}, val);
   }
 
+  // Apply all relocations of an allocated section in one go. Returns false if
+  // the target has no such path; the relocations are then applied one at a
+  // time by InputSectionBase::relocateAlloc.
+  virtual bool relocateAllocBatch(InputSectionBase &sec, uint8_t *buf) const {
+    return false;
+  }
+
   virtual void applyJumpInstrMod(uint8_t *loc, JumpModType type,
                                  JumpModType val) const {}
 
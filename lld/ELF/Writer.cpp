@@ -14,6 +14,9 @@
 #include "LinkerScript.h"
 #include "MapFile.h"
 #include "OutputSections.h"
+#include "PatmosCompress.h"
+#include "PatmosIncremental.h"
+#include "PatmosStackCache.h"
 #include "Relocations.h"
 #include "SymbolTable.h"
 #include "Symbols.h"
@@ -118,6 +121,17 @@ StringRef elf::getOutputSectionName(const InputSectionBase *s) {
   if (script->hasSectionsCommand)
     return s->name;
 
+  // Functions the compiler placed in the Patmos instruction scratchpad are
+  // linked to its address in a section of their own, see --patmos-ispm-base.
+  // Without the option, they are ordinary code.
+  if (config->emachine == EM_PATMOS && config->patmosISPMBase &&
+      isSectionPrefix(".text.ispm.", s->name))
+    return ".ispm";
+
+  // Data the Patmos startup code does not clear, see __patmos_bss_end.
+  if (config->emachine == EM_PATMOS && isSectionPrefix(".noinit.", s->name))
+    return ".noinit";
+
   // When no SECTIONS is specified, emulate GNU ld's internal linker scripts
   // by grouping sections with certain prefixes.
 
@@ -329,6 +343,16 @@ void elf::addReservedSymbols() {
   ElfSym::etext2 = add("_etext", -1);
   ElfSym::edata1 = add("edata", -1);
   ElfSym::edata2 = add("_edata", -1);
+
+  // The sections are set by setReservedSymbolSections, empty ranges stay at
+  // the ELF header.
+  if (config->emachine == EM_PATMOS && !config->shared) {
+    ElfSym::patmosDataStart = add("__patmos_data_start", 0);
+    ElfSym::patmosDataEnd = add("__patmos_data_end", 0);
+    ElfSym::patmosDataLoad = add("__patmos_data_load", 0);
+    ElfSym::patmosBssStart = add("__patmos_bss_start", 0);
+    ElfSym::patmosBssEnd = add("__patmos_bss_end", 0);
+  }
 }
 
 static OutputSection *findSection(StringRef name, unsigned partition = 1) {
@@ -507,6 +531,12 @@ template <class ELFT> void elf::createSyntheticSections() {
     add(in.ppc32Got2);
   }
 
+  if (config->patmosCompress) {
+    in.patmosCompressed = make<PatmosCompressedSection>();
+    addOptionalRegular("__patmos_lz4_image", in.patmosCompressed, 0);
+    add(in.patmosCompressed);
+  }
+
   if (config->emachine == EM_PPC64) {
     in.ppc64LongBranchTarget = make<PPC64LongBranchTargetSection>();
     add(in.ppc64LongBranchTarget);
@@ -600,6 +630,11 @@ template <class ELFT> void Writer<ELFT>::run() {
   for (OutputSection *sec : outputSections)
     sec->maybeCompress<ELFT>();
 
+  // With --patmos-compress, the data sections are replaced by their
+  // compressed image, which follows all other sections.
+  if (in.patmosCompressed)
+    compressPatmosSections();
+
   if (script->hasSectionsCommand)
     script->allocateHeaders(mainPart->phdrs);
 
@@ -648,6 +683,8 @@ template <class ELFT> void Writer<ELFT>::run() {
         writeTrapInstr();
       writeHeader();
       writeSections();
+      if (config->emachine == EM_PATMOS && config->patmosRemoveEnsures)
+        removePatmosEnsures(Out::bufferStart);
     } else {
       writeSectionsBinary();
     }
@@ -658,6 +695,9 @@ template <class ELFT> void Writer<ELFT>::run() {
     if (errorCount())
       return;
 
+    if (!config->patmosIncremental.empty())
+      writePatmosIncrementalLayout(Out::bufferStart);
+
     if (auto e = buffer->commit())
       error("failed to write to the output file: " + toString(std::move(e)));
   }
@@ -929,7 +969,10 @@ enum RankFlags {
   RF_PPC_GOT = 1 << 3,
   RF_PPC_BRANCH_LT = 1 << 2,
   RF_MIPS_GPREL = 1 << 1,
-  RF_MIPS_NOT_GOT = 1 << 0
+  RF_MIPS_NOT_GOT = 1 << 0,
+  RF_PATMOS_NOINIT = 1 << 2,
+  RF_PATMOS_SDATA = 1 << 1,
+  RF_PATMOS_NOT_SBSS = 1 << 0
 };
 
 static unsigned getSectionRank(const OutputSection *sec) {
@@ -946,6 +989,11 @@ static unsigned getSectionRank(const OutputSection *sec) {
   if (!(sec->flags & SHF_ALLOC))
     return rank | RF_NOT_ALLOC;
 
+  // The compressed image of --patmos-compress follows all other allocatable
+  // sections, in a segment of its own.
+  if (config->emachine == EM_PATMOS && sec->name == ".patmos.lz4")
+    return rank | (RF_NOT_ALLOC - 1);
+
   if (sec->type == SHT_LLVM_PART_EHDR)
     return rank;
   rank |= RF_NOT_PART_EHDR;
@@ -1055,6 +1103,21 @@ static unsigned getSectionRank(const OutputSection *sec) {
       rank |= RF_MIPS_NOT_GOT;
   }
 
+  if (config->emachine == EM_PATMOS) {
+    // The small data area is addressed by unsigned offsets to its start, keep
+    // .sdata and .sbss together, i.e., as the last SHT_PROGBITS and the first
+    // SHT_NOBITS section.
+    if (sec->name == ".sdata")
+      rank |= RF_PATMOS_SDATA;
+
+    if (sec->name != ".sbss")
+      rank |= RF_PATMOS_NOT_SBSS;
+
+    // The startup code clears the bss sections up to .noinit.
+    if (sec->name == ".noinit")
+      rank |= RF_PATMOS_NOINIT;
+  }
+
   return rank;
 }
 
@@ -1128,6 +1191,25 @@ void Writer<ELFT>::forEachRelSec(
 // appropriate time. This ensures that the value is going to be correct by the
 // time any references to these symbols are processed and is equivalent to
 // defining these symbols explicitly in the linker script.
+// Returns the first and the last output section of the writable data that the
+// Patmos startup code copies, or of the bss that it clears. Neither RELRO
+// sections nor the .noinit section following the bss are part of them.
+static std::pair<OutputSection *, OutputSection *>
+getPatmosInitRange(bool bss) {
+  OutputSection *first = nullptr;
+  OutputSection *last = nullptr;
+  for (OutputSection *os : outputSections) {
+    if (!(os->flags & SHF_ALLOC) || !(os->flags & SHF_WRITE) ||
+        (os->flags & SHF_TLS) || isRelroSection(os) ||
+        os->name == ".noinit" || (os->type == SHT_NOBITS) != bss)
+      continue;
+    if (!first)
+      first = os;
+    last = os;
+  }
+  return {first, last};
+}
+
 template <class ELFT> void Writer<ELFT>::setReservedSymbolSections() {
   if (ElfSym::globalOffsetTable) {
     // The _GLOBAL_OFFSET_TABLE_ symbol is defined by target convention usually
@@ -1153,6 +1235,11 @@ template <class ELFT> void Writer<ELFT>::setReservedSymbolSections() {
     for (PhdrEntry *p : part.phdrs) {
       if (p->p_type != PT_LOAD)
         continue;
+      // The compressed image is not a part of the program, see
+      // PatmosCompress.cpp.
+      if (in.patmosCompressed &&
+          p->firstSec == in.patmosCompressed->getParent())
+        continue;
       last = p;
       if (!(p->p_flags & PF_W))
         lastRO = p;
@@ -1192,6 +1279,23 @@ template <class ELFT> void Writer<ELFT>::setReservedSymbolSections() {
   if (ElfSym::bss)
     ElfSym::bss->section = findSection(".bss");
 
+  if (ElfSym::patmosBssStart) {
+    auto data = getPatmosInitRange(false);
+    auto bss = getPatmosInitRange(true);
+    if (data.first) {
+      // Without a linker script, the data is loaded at its address.
+      ElfSym::patmosDataStart->section = data.first;
+      ElfSym::patmosDataLoad->section = data.first;
+      ElfSym::patmosDataEnd->section = data.second;
+      ElfSym::patmosDataEnd->value = -1;
+    }
+    if (bss.first) {
+      ElfSym::patmosBssStart->section = bss.first;
+      ElfSym::patmosBssEnd->section = bss.second;
+      ElfSym::patmosBssEnd->value = -1;
+    }
+  }
+
   // Setup MIPS _gp_disp/__gnu_local_gp symbols which should
   // be equal to the _gp symbol's value.
   if (ElfSym::mipsGp) {
@@ -1313,6 +1417,13 @@ static void maybeShuffle(DenseMap<const InputSectionBase *, int> &order) {
 // Builds section order for handling --symbol-ordering-file.
 static DenseMap<const InputSectionBase *, int> buildSectionOrder() {
   DenseMap<const InputSectionBase *, int> sectionOrder;
+  // A Patmos incremental link keeps the order of the previous link.
+  if (!config->patmosIncremental.empty()) {
+    sectionOrder = buildPatmosIncrementalOrder();
+    if (!sectionOrder.empty())
+      return sectionOrder;
+  }
+
   // Use the rarely used option -call-graph-ordering-file to sort sections.
   if (!config->callGraphProfile.empty())
     return computeCallGraphProfileOrder();
@@ -1932,6 +2043,18 @@ template <class ELFT> void Writer<ELFT>::finalizeSections() {
                            0x800, STV_DEFAULT, STB_GLOBAL);
   }
 
+  // Patmos addresses the small data area relative to _SDA_BASE_, which the
+  // program entry loads into the base register. Set it to the start of the
+  // area, .sdata followed by .sbss.
+  if (config->emachine == EM_PATMOS && !config->shared) {
+    OutputSection *sec = findSection(".sdata");
+    if (!sec)
+      sec = findSection(".sbss");
+    ElfSym::patmosSmallDataBase =
+        addOptionalRegular("_SDA_BASE_", sec ? sec : Out::elfHeader, 0,
+                           STV_DEFAULT, STB_GLOBAL);
+  }
+
   if (config->emachine == EM_X86_64) {
     // On targets that support TLSDESC, _TLS_MODULE_BASE_ is defined in such a
     // way that:
@@ -2069,6 +2192,15 @@ template <class ELFT> void Writer<ELFT>::finalizeSections() {
       sec->addrExpr = [=] { return i->second; };
   }
 
+  // The Patmos startup code copies and clears the ranges in bursts from their
+  // start on.
+  if (ElfSym::patmosBssStart) {
+    for (bool bss : {false, true})
+      if (OutputSection *sec = getPatmosInitRange(bss).first)
+        sec->alignment =
+            std::max<uint32_t>(sec->alignment, config->patmosBurstSize);
+  }
+
   // With the outputSections available check for GDPLT relocations
   // and add __tls_get_addr symbol if needed.
   if (config->emachine == EM_HEXAGON && hexagonNeedsTLSSymbol(outputSections)) {
@@ -2394,7 +2526,11 @@ std::vector<PhdrEntry *> Writer<ELFT>::createPhdrs(Partition &part) {
     uint64_t newFlags = computeFlags(sec->getPhdrFlags());
     bool sameLMARegion =
         load && !sec->lmaExpr && sec->lmaRegion == load->firstSec->lmaRegion;
-    if (!(load && newFlags == flags && sec != relroEnd &&
+    // The Patmos instruction scratchpad is loaded by a segment of its own.
+    bool ispmBoundary =
+        config->emachine == EM_PATMOS && load &&
+        (sec->name == ".ispm" || load->lastSec->name == ".ispm");
+    if (!(load && newFlags == flags && sec != relroEnd && !ispmBoundary &&
           sec->memRegion == load->firstSec->memRegion &&
           (sameLMARegion || load->lastSec == Out::programHeaders))) {
       load = addHdr(PT_LOAD, newFlags);
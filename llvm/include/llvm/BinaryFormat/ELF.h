@@ -503,7 +503,11 @@ enum {
   R_PATMOS_MEMH_ABS   = 8,
   R_PATMOS_MEMW_ABS   = 9,
   R_PATMOS_ABS_32     = 10,
-  R_PATMOS_CFLI_PCREL = 12
+  R_PATMOS_CFLI_PCREL = 12,
+  R_PATMOS_ALUI_SDA   = 13,
+  R_PATMOS_MEMB_SDA   = 14,
+  R_PATMOS_MEMH_SDA   = 15,
+  R_PATMOS_MEMW_SDA   = 16
 };
 
 // Patmos symbol types.
@@ -0,0 +1,107 @@
+//===- LazyArchiveLinker.h - Link archive members on demand -----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a helper that links the members of bitcode archives the
+// way a native linker does: a member is only loaded and linked if it defines a
+// symbol the program needs.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LINKER_LAZYARCHIVELINKER_H
+#define LLVM_LINKER_LAZYARCHIVELINKER_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Linker;
+class Module;
+
+namespace object {
+class Archive;
+}
+
+/// Links the members of bitcode archives into a composite module on demand.
+///
+/// The archives are collected first, and linked by link() once all other
+/// inputs are in the composite. A member is linked if it defines a symbol that
+/// is undefined in the composite, or in a member that is linked, or that is
+/// given as a root. Members of archives added with
+/// Linker::Flags::OverrideFromSrc are also linked if they define a symbol that
+/// is defined already, which they then override.
+///
+/// The symbol table of an archive is used to find the members defining a
+/// symbol. Only the module-level records of the members that are linked are
+/// read, and their function bodies are materialized by the linker. Archives
+/// without a symbol table are indexed by reading the module-level records of
+/// all members.
+class LazyArchiveLinker {
+public:
+  using InternalizeCallbackTy =
+      std::function<void(Module &, const StringSet<> &)>;
+
+private:
+  struct Archive {
+    std::unique_ptr<MemoryBuffer> Buffer;
+    std::unique_ptr<object::Archive> Ar;
+    unsigned Flags;
+    InternalizeCallbackTy InternalizeCallback;
+  };
+
+  struct Member {
+    std::string Name;
+    MemoryBufferRef Buffer;
+    unsigned ArchiveIdx;
+    std::unique_ptr<Module> M;
+    bool Selected = false;
+  };
+
+  Linker &L;
+  Module &Composite;
+  bool Verbose;
+
+  std::vector<Archive> Archives;
+  std::vector<Member> Members;
+  SmallVector<std::string, 4> Roots;
+
+  /// For each symbol, the first member of a regular and of an overriding
+  /// archive defining it.
+  StringMap<unsigned> Providers;
+  StringMap<unsigned> OverrideProviders;
+
+  Error loadMember(Member &Mem);
+  void addProvider(StringRef Name, unsigned MemberIdx, bool Override);
+
+public:
+  LazyArchiveLinker(Linker &L, Module &Composite, bool Verbose = false);
+  ~LazyArchiveLinker();
+
+  /// Add an archive whose needed members are linked with the given flags and
+  /// internalization callback.
+  Error addArchive(std::unique_ptr<MemoryBuffer> Buffer,
+                   unsigned Flags = 0,
+                   InternalizeCallbackTy InternalizeCallback = {});
+
+  /// Link the members defining Name, even if nothing refers to it.
+  void addRoot(StringRef Name) { Roots.push_back(Name.str()); }
+
+  /// Select the needed members of all archives and link them, in the order
+  /// of the archives and of their members.
+  Error link();
+};
+
+} // End llvm namespace
+
+#endif
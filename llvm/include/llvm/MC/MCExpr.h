@@ -321,6 +321,8 @@ public:
     VK_Hexagon_IE,
     VK_Hexagon_IE_GOT,
 
+    VK_Patmos_SDA, // symbol@sda (relative to the small data base)
+
     VK_WASM_TYPEINDEX, // Reference to a symbol's type (signature)
     VK_WASM_TLSREL,    // Memory address relative to __tls_base
     VK_WASM_MBREL,     // Memory address relative to __memory_base
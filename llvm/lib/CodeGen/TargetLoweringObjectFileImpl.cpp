@@ -450,7 +450,9 @@ static SectionKind getELFKindForNamedSection(StringRef Name, SectionKind K) {
       Name == ".sbss" ||
       Name.startswith(".sbss.") ||
       Name.startswith(".gnu.linkonce.sb.") ||
-      Name.startswith(".llvm.linkonce.sb."))
+      Name.startswith(".llvm.linkonce.sb.") ||
+      Name == ".noinit" ||
+      Name.startswith(".noinit."))
     return SectionKind::getBSS();
 
   if (Name == ".tdata" ||
@@ -1542,6 +1542,7 @@ MPPassManager::runOnModule(Module &M) {
     {
       PassManagerPrettyStackEntry X(MP, M);
       TimeRegion PassTimer(getPassTimer(MP));
+      llvm::TimeTraceScope PassScope("RunPass", MP->getPassName());
 
 #ifdef EXPENSIVE_CHECKS
       uint64_t RefHash = StructuralHash(M);
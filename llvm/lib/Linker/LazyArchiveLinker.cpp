@@ -0,0 +1,204 @@
+//===- lib/Linker/LazyArchiveLinker.cpp - Link archive members on demand --===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the on-demand linking of bitcode archive members.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Linker/LazyArchiveLinker.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Object/Archive.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+/// Whether GV is a definition a member may provide or override.
+static bool isDefinition(const GlobalValue &GV) {
+  return GV.hasName() && !GV.hasLocalLinkage() && !GV.isDeclarationForLinker();
+}
+
+/// Whether GV is a reference a member may resolve.
+static bool isReference(const GlobalValue &GV) {
+  return GV.hasName() && GV.isDeclarationForLinker() &&
+         !GV.getName().startswith("llvm.");
+}
+
+LazyArchiveLinker::LazyArchiveLinker(Linker &L, Module &Composite,
+                                     bool Verbose)
+    : L(L), Composite(Composite), Verbose(Verbose) {}
+
+LazyArchiveLinker::~LazyArchiveLinker() = default;
+
+Error LazyArchiveLinker::loadMember(Member &Mem) {
+  if (Mem.M)
+    return Error::success();
+
+  if (Verbose)
+    errs() << "Parsing member '" << Mem.Name
+           << "' of archive library to module.\n";
+  Expected<std::unique_ptr<Module>> M =
+      getLazyBitcodeModule(Mem.Buffer, Composite.getContext());
+  if (!M)
+    return M.takeError();
+  Mem.M = std::move(*M);
+  return Error::success();
+}
+
+void LazyArchiveLinker::addProvider(StringRef Name, unsigned MemberIdx,
+                                    bool Override) {
+  // As in native linkers, the first definition is used.
+  (Override ? OverrideProviders : Providers).try_emplace(Name, MemberIdx);
+}
+
+Error LazyArchiveLinker::addArchive(std::unique_ptr<MemoryBuffer> Buffer,
+                                    unsigned Flags,
+                                    InternalizeCallbackTy InternalizeCallback) {
+  StringRef ArchiveName = Buffer->getBufferIdentifier();
+  if (Verbose)
+    errs() << "Reading library archive file '" << ArchiveName
+           << "' to memory\n";
+
+  Error Err = Error::success();
+  auto Ar = std::make_unique<object::Archive>(*Buffer, Err);
+  if (Err)
+    return Err;
+
+  bool Override = Flags & Linker::Flags::OverrideFromSrc;
+  unsigned ArchiveIdx = Archives.size();
+  unsigned FirstMember = Members.size();
+  DenseMap<const char *, unsigned> MemberByData;
+  for (const object::Archive::Child &C : Ar->children(Err)) {
+    Expected<StringRef> Name = C.getName();
+    if (!Name)
+      return Name.takeError();
+    Expected<MemoryBufferRef> MemBuf = C.getMemoryBufferRef();
+    if (!MemBuf)
+      return MemBuf.takeError();
+    if (!isBitcode((const unsigned char *)MemBuf->getBufferStart(),
+                   (const unsigned char *)MemBuf->getBufferEnd()))
+      return createStringError(inconvertibleErrorCode(),
+                               "member of archive is not a bitcode file: '" +
+                                   *Name + "'");
+
+    MemberByData[MemBuf->getBufferStart()] = Members.size();
+    Members.push_back({Name->str(), *MemBuf, ArchiveIdx, nullptr});
+  }
+  if (Err)
+    return Err;
+
+  if (Ar->hasSymbolTable() && !Ar->symbols().empty()) {
+    for (const object::Archive::Symbol &S : Ar->symbols()) {
+      Expected<object::Archive::Child> C = S.getMember();
+      if (!C)
+        return C.takeError();
+      Expected<MemoryBufferRef> MemBuf = C->getMemoryBufferRef();
+      if (!MemBuf)
+        return MemBuf.takeError();
+      auto Mem = MemberByData.find(MemBuf->getBufferStart());
+      if (Mem != MemberByData.end())
+        addProvider(S.getName(), Mem->second, Override);
+    }
+  } else {
+    // Without an index, the definitions are read from the members.
+    for (unsigned i = FirstMember, e = Members.size(); i != e; ++i) {
+      if (Error E = loadMember(Members[i]))
+        return E;
+      for (const GlobalValue &GV : Members[i].M->global_values())
+        if (isDefinition(GV))
+          addProvider(GV.getName(), i, Override);
+    }
+  }
+
+  Archives.push_back(
+      {std::move(Buffer), std::move(Ar), Flags, std::move(InternalizeCallback)});
+  return Error::success();
+}
+
+Error LazyArchiveLinker::link() {
+  // Symbols defined in the composite or in a selected regular member, and in
+  // a selected overriding member.
+  StringSet<> Defined, OverrideDefined;
+  // Symbols that are referenced or defined, each visited once.
+  StringSet<> Visited;
+  std::vector<std::string> Worklist;
+
+  auto Push = [&](StringRef Name) {
+    if (Visited.insert(Name).second)
+      Worklist.push_back(Name.str());
+  };
+
+  auto Select = [&](unsigned MemberIdx) -> Error {
+    Member &Mem = Members[MemberIdx];
+    if (Mem.Selected)
+      return Error::success();
+    Mem.Selected = true;
+    if (Error E = loadMember(Mem))
+      return E;
+
+    bool Override =
+        Archives[Mem.ArchiveIdx].Flags & Linker::Flags::OverrideFromSrc;
+    for (const GlobalValue &GV : Mem.M->global_values())
+      if (isDefinition(GV))
+        (Override ? OverrideDefined : Defined).insert(GV.getName());
+    for (const GlobalValue &GV : Mem.M->global_values())
+      if (isDefinition(GV) || isReference(GV))
+        Push(GV.getName());
+    return Error::success();
+  };
+
+  for (const GlobalValue &GV : Composite.global_values())
+    if (isDefinition(GV))
+      Defined.insert(GV.getName());
+  for (const GlobalValue &GV : Composite.global_values())
+    if (isDefinition(GV) || isReference(GV))
+      Push(GV.getName());
+  for (const std::string &Root : Roots)
+    Push(Root);
+
+  while (!Worklist.empty()) {
+    std::string Name = std::move(Worklist.back());
+    Worklist.pop_back();
+
+    if (!Defined.count(Name) && !OverrideDefined.count(Name)) {
+      auto P = Providers.find(Name);
+      if (P != Providers.end())
+        if (Error E = Select(P->second))
+          return E;
+    }
+    auto O = OverrideProviders.find(Name);
+    if (O != OverrideProviders.end())
+      if (Error E = Select(O->second))
+        return E;
+  }
+
+  // Overriding members are linked last, as llvm-link links the overriding
+  // files after the regular ones.
+  unsigned NumLinked = 0;
+  for (bool Override : {false, true}) {
+    for (Member &Mem : Members) {
+      const Archive &A = Archives[Mem.ArchiveIdx];
+      if (!Mem.Selected ||
+          Override != bool(A.Flags & Linker::Flags::OverrideFromSrc))
+        continue;
+      if (Verbose)
+        errs() << "Linking member '" << Mem.Name << "' of archive library.\n";
+      if (L.linkInModule(std::move(Mem.M), A.Flags, A.InternalizeCallback))
+        return createStringError(inconvertibleErrorCode(),
+                                 "linking member '" + Mem.Name + "' of '" +
+                                     A.Buffer->getBufferIdentifier() +
+                                     "' failed");
+      NumLinked++;
+    }
+  }
+  if (Verbose)
+    errs() << "Linked " << NumLinked << " of " << Members.size()
+           << " archive members.\n";
+  return Error::success();
+}
@@ -137,6 +137,8 @@ StringRef Triple::getArchTypePrefix(ArchType Kind) {
   case le32:        return "le32";
   case le64:        return "le64";
 
+  case patmos:      return "patmos";
+
   case amdil:
   case amdil64:     return "amdil";
 
@@ -79,7 +79,9 @@ public:
   void EatToEndOfStatement();
 
 private:
-  bool ParseOperand(OperandVector &Operands, unsigned OpNo);
+  /// ParseOperand - parse the OpNo'th operand of an instruction.
+  /// \param PredSrcs - if true, register sources may be negated predicates
+  bool ParseOperand(OperandVector &Operands, unsigned OpNo, bool PredSrcs);
 
   /// Parses the instruction guard, e.g. '(!$p1)', or produces the default instead.
   bool ParseGuard(SMLoc NameLoc, OperandVector &Operands);
@@ -101,12 +103,23 @@ private:
   /// ParseToken - Check if the Lexer is currently over the given token kind, and add it as operand if so.
   bool ParseToken(OperandVector &Operands, AsmToken::TokenKind Kind);
 
-  /// isPredSrcOperand - Check whether the operand might be a predicate source operand (i.e., has a negate flag)
-  bool isPredSrcOperand(StringRef Mnemonic, unsigned OpNo);
+  /// hasPredSrcOperands - Check whether the source operands of the mnemonic
+  /// might be predicate source operands (i.e., have a negate flag)
+  bool hasPredSrcOperands(StringRef Mnemonic) const;
 
   bool ParseDirectiveWord(unsigned Size, SMLoc L);
 
   bool ParseDirectiveFStart(SMLoc L);
+
+  bool ParseDirectiveLoopBound(SMLoc L);
+
+  bool ParseSymbolOrZero(SMLoc L, const MCSymbol *&Sym);
+
+  bool ParseDirectiveStackCacheFrame(SMLoc L);
+
+  bool ParseDirectiveStackCacheCall(SMLoc L);
+
+  bool ParseDirectiveStackCacheDisplacement(SMLoc L);
 };
 
 /// PatmosOperand - Instances of this class represent a parsed Patmos machine
@@ -366,9 +379,19 @@ MatchAndEmitInstruction(SMLoc IDLoc, unsigned &Opcode,
       MCOperand &MCO = Inst.getOperand( ImmOpNo );
 
       if (MCO.isExpr()) {
-        if (HasALUlVariant(Inst.getOpcode(), ALUlOpcode)){
+        // Offsets to the small data base always fit 12 bits, the linker
+        // reports them otherwise.
+        const MCSymbolRefExpr *SRE = dyn_cast<MCSymbolRefExpr>(MCO.getExpr());
+        bool IsSmallData = SRE &&
+                           SRE->getKind() == MCSymbolRefExpr::VK_Patmos_SDA;
+
+        if (!IsSmallData && HasALUlVariant(Inst.getOpcode(), ALUlOpcode)){
           if (InBundle) {
             return Error(IDLoc, "long immediate instruction cannot be in the second slot of a bundle");
+          } else if (!BundleCounter) {
+            // Keep the short form, the assembler relaxes it to ALUl if the
+            // value turns out not to fit after layout (or needs a relocation)
+            Inst.setFlags(PatmosII::MCIF_RelaxableALUi);
           } else {
             // If we have an expression and can use ALUl, do so
             Inst.setOpcode(ALUlOpcode);
@@ -624,8 +647,8 @@ ParsePredicateOperand(OperandVector &Operands, bool checkClass)  {
     PatmosOperand *Op = (PatmosOperand*)&*Operands.back();
     if (!Op->isReg()) return Error(Lexer.getLoc(), "magic happened: we found a register but the operand is not a register");
 
-    // TODO There really should be a nicer way of doing this, but we do not have access to the RegisterInfo stuff here
-    if (PatmosInstPrinter::getRegisterName(Op->getReg())[0] != 'p') {
+    const MCRegisterInfo *MRI = getParser().getContext().getRegisterInfo();
+    if (!MRI->getRegClass(Patmos::PRegsRegClassID).contains(Op->getReg())) {
       // Not a predicate register, do not emit a flag operand
       if (flag) {
         Error(StartLoc, "Negation of registers other than predicates is invalid.");
@@ -641,7 +664,7 @@ ParsePredicateOperand(OperandVector &Operands, bool checkClass)  {
 }
 
 bool PatmosAsmParser::
-ParseOperand(OperandVector &Operands, unsigned OpNo)  {
+ParseOperand(OperandVector &Operands, unsigned OpNo, bool PredSrcs)  {
   MCAsmLexer &Lexer = getLexer();
 
   // Handle all the various operand types here: Imm, reg, memory, predicate, label
@@ -656,9 +679,8 @@ ParseOperand(OperandVector &Operands, unsigned OpNo)  {
     return ParsePredicateOperand(Operands);
   }
   if (Lexer.is(AsmToken::Dollar)) {
-
-    StringRef Mnemonic = ((PatmosOperand*)&*Operands[0])->getToken();
-    if (isPredSrcOperand(Mnemonic, OpNo)) {
+    // only src operands can be predicate sources
+    if (PredSrcs && OpNo > 0) {
       return ParsePredicateOperand(Operands, true);
     }
 
@@ -801,18 +823,23 @@ ParseInstruction(ParseInstructionInfo &Info, StringRef Name, SMLoc NameLoc,
   size_t Next = Name.find('.');
   StringRef Mnemonic = Name.slice(0, Next);
 
-  Operands.insert(Operands.begin(),
+  // The prefix does not add any operands, so we can simply append here.
+  assert(Operands.empty() && "unexpected operands before the mnemonic");
+  Operands.push_back(
       std::unique_ptr<MCParsedAsmOperand>(PatmosOperand::CreateToken(Mnemonic, NameLoc)));
 
   if (Next != StringRef::npos) {
     // there is a format/modifier token in mnemonic, add as first operand
     StringRef Format = Name.slice(Next, StringRef::npos);
-    Operands.insert(Operands.begin() + 1,
+    Operands.push_back(
         std::unique_ptr<MCParsedAsmOperand>(PatmosOperand::CreateToken(Format, NameLoc)));
   }
 
   ParseGuard(NameLoc, Operands);
 
+  // Classify the mnemonic once, not for every operand
+  bool PredSrcs = hasPredSrcOperands(Mnemonic);
+
   unsigned OpNo = 0;
 
   // If there are no more operands then finish
@@ -854,7 +881,7 @@ ParseInstruction(ParseInstructionInfo &Info, StringRef Name, SMLoc NameLoc,
       return Error(TokLoc, "missing separator between operands or instructions");
     }
 
-    if (ParseOperand(Operands, OpNo)) {
+    if (ParseOperand(Operands, OpNo, PredSrcs)) {
       EatToEndOfStatement();
       return true;
     }
@@ -874,6 +901,14 @@ ParseDirective(AsmToken DirectiveID) {
     return ParseDirectiveWord(2, DirectiveID.getLoc());
   if (IDVal == ".fstart")
     return ParseDirectiveFStart(DirectiveID.getLoc());
+  if (IDVal == ".loopbound")
+    return ParseDirectiveLoopBound(DirectiveID.getLoc());
+  if (IDVal == ".scframe")
+    return ParseDirectiveStackCacheFrame(DirectiveID.getLoc());
+  if (IDVal == ".sccall")
+    return ParseDirectiveStackCacheCall(DirectiveID.getLoc());
+  if (IDVal == ".scdisp")
+    return ParseDirectiveStackCacheDisplacement(DirectiveID.getLoc());
   return true;
 }
 
@@ -957,22 +992,230 @@ bool PatmosAsmParser::ParseDirectiveFStart(SMLoc L) {
   return false;
 }
 
-bool PatmosAsmParser::isPredSrcOperand(StringRef Mnemonic, unsigned OpNo)
-{
-  // only src operands, only combine ops
-  if (OpNo == 0) return false;
+/// ParseDirectiveLoopBound
+///  ::= .loopbound [ symbol , min, max ]
+bool PatmosAsmParser::ParseDirectiveLoopBound(SMLoc L) {
+  if (getLexer().is(AsmToken::EndOfStatement)) {
+    return Error(L, "missing arguments to .loopbound directive");
+  }
+
+  const MCExpr *HeaderExpr;
+  SMLoc E;
+  if (getParser().parseExpression(HeaderExpr, E)) {
+    return true;
+  }
+  const MCSymbolRefExpr *SymRef = dyn_cast<MCSymbolRefExpr>(HeaderExpr);
+  if (!SymRef) {
+    return Error(L, "first parameter of this directive must be a symbol name");
+  }
+
+  if (getLexer().isNot(AsmToken::Comma))
+    return Error(L, "unexpected token in directive");
+  Parser.Lex();
+
+  int64_t min;
+  if (getParser().parseAbsoluteExpression(min)) {
+    return true;
+  }
+
+  if (getLexer().isNot(AsmToken::Comma))
+    return Error(L, "unexpected token in directive");
+  Parser.Lex();
+
+  int64_t max;
+  if (getParser().parseAbsoluteExpression(max)) {
+    return true;
+  }
+  if (min < 0 || max < min) {
+    return Error(L, "loop bounds must satisfy 0 <= min <= max");
+  }
+
+  if (getLexer().isNot(AsmToken::EndOfStatement)) {
+    return Error(L, "unexpected token in directive");
+  }
+  Parser.Lex();
+
+  PatmosTargetStreamer *PTS = static_cast<PatmosTargetStreamer*>(
+                                 getParser().getStreamer().getTargetStreamer());
+
+  PTS->EmitLoopBound(&SymRef->getSymbol(), min, max);
+
+  return false;
+}
+
+/// ParseSymbolOrZero - Parse a symbol name, or 0 for no symbol.
+bool PatmosAsmParser::ParseSymbolOrZero(SMLoc L, const MCSymbol *&Sym) {
+  const MCExpr *Expr;
+  SMLoc E;
+  if (getParser().parseExpression(Expr, E)) {
+    return true;
+  }
+  if (const MCSymbolRefExpr *SymRef = dyn_cast<MCSymbolRefExpr>(Expr)) {
+    Sym = &SymRef->getSymbol();
+    return false;
+  }
+  const MCConstantExpr *Zero = dyn_cast<MCConstantExpr>(Expr);
+  if (!Zero || Zero->getValue() != 0) {
+    return Error(L, "parameter of this directive must be a symbol name or 0");
+  }
+  Sym = nullptr;
+  return false;
+}
+
+/// ParseDirectiveStackCacheFrame
+///  ::= .scframe [ symbol , bytes ]
+bool PatmosAsmParser::ParseDirectiveStackCacheFrame(SMLoc L) {
+  if (getLexer().is(AsmToken::EndOfStatement)) {
+    return Error(L, "missing arguments to .scframe directive");
+  }
+
+  const MCExpr *FunctionExpr;
+  SMLoc E;
+  if (getParser().parseExpression(FunctionExpr, E)) {
+    return true;
+  }
+  const MCSymbolRefExpr *SymRef = dyn_cast<MCSymbolRefExpr>(FunctionExpr);
+  if (!SymRef) {
+    return Error(L, "first parameter of this directive must be a symbol name");
+  }
+
+  if (getLexer().isNot(AsmToken::Comma))
+    return Error(L, "unexpected token in directive");
+  Parser.Lex();
+
+  int64_t bytes;
+  if (getParser().parseAbsoluteExpression(bytes)) {
+    return true;
+  }
+  if (bytes < 0) {
+    return Error(L, "frame size must be a positive value");
+  }
+
+  if (getLexer().isNot(AsmToken::EndOfStatement)) {
+    return Error(L, "unexpected token in directive");
+  }
+  Parser.Lex();
+
+  PatmosTargetStreamer *PTS = static_cast<PatmosTargetStreamer*>(
+                                 getParser().getStreamer().getTargetStreamer());
+
+  PTS->EmitStackCacheFrame(&SymRef->getSymbol(), bytes);
+
+  return false;
+}
+
+/// ParseDirectiveStackCacheCall
+///  ::= .sccall [ symbol , symbol | 0 , symbol | 0 , bytes ]
+bool PatmosAsmParser::ParseDirectiveStackCacheCall(SMLoc L) {
+  if (getLexer().is(AsmToken::EndOfStatement)) {
+    return Error(L, "missing arguments to .sccall directive");
+  }
+
+  const MCSymbol *Caller, *Callee, *Ensure;
+  if (ParseSymbolOrZero(L, Caller)) {
+    return true;
+  }
+  if (!Caller) {
+    return Error(L, "first parameter of this directive must be a symbol name");
+  }
+
+  if (getLexer().isNot(AsmToken::Comma))
+    return Error(L, "unexpected token in directive");
+  Parser.Lex();
+
+  if (ParseSymbolOrZero(L, Callee)) {
+    return true;
+  }
 
+  if (getLexer().isNot(AsmToken::Comma))
+    return Error(L, "unexpected token in directive");
+  Parser.Lex();
+
+  if (ParseSymbolOrZero(L, Ensure)) {
+    return true;
+  }
+
+  if (getLexer().isNot(AsmToken::Comma))
+    return Error(L, "unexpected token in directive");
+  Parser.Lex();
+
+  int64_t bytes;
+  if (getParser().parseAbsoluteExpression(bytes)) {
+    return true;
+  }
+  if (bytes < 0) {
+    return Error(L, "ensure size must be a positive value");
+  }
+
+  if (getLexer().isNot(AsmToken::EndOfStatement)) {
+    return Error(L, "unexpected token in directive");
+  }
+  Parser.Lex();
+
+  PatmosTargetStreamer *PTS = static_cast<PatmosTargetStreamer*>(
+                                 getParser().getStreamer().getTargetStreamer());
+
+  PTS->EmitStackCacheCall(Caller, Callee, Ensure, bytes);
+
+  return false;
+}
+
+/// ParseDirectiveStackCacheDisplacement
+///  ::= .scdisp [ symbol , bytes , bytes ]
+bool PatmosAsmParser::ParseDirectiveStackCacheDisplacement(SMLoc L) {
+  if (getLexer().is(AsmToken::EndOfStatement)) {
+    return Error(L, "missing arguments to .scdisp directive");
+  }
+
+  const MCSymbol *Function;
+  if (ParseSymbolOrZero(L, Function)) {
+    return true;
+  }
+  if (!Function) {
+    return Error(L, "first parameter of this directive must be a symbol name");
+  }
+
+  int64_t min, max;
+  for (int64_t *bytes : {&min, &max}) {
+    if (getLexer().isNot(AsmToken::Comma))
+      return Error(L, "unexpected token in directive");
+    Parser.Lex();
+
+    if (getParser().parseAbsoluteExpression(*bytes)) {
+      return true;
+    }
+    if (*bytes < 0) {
+      return Error(L, "displacement must be a positive value");
+    }
+  }
+  if (min > max) {
+    return Error(L, "minimum displacement exceeds the maximum");
+  }
+
+  if (getLexer().isNot(AsmToken::EndOfStatement)) {
+    return Error(L, "unexpected token in directive");
+  }
+  Parser.Lex();
+
+  PatmosTargetStreamer *PTS = static_cast<PatmosTargetStreamer*>(
+                                 getParser().getStreamer().getTargetStreamer());
+
+  PTS->EmitStackCacheDisplacement(Function, min, max);
+
+  return false;
+}
+
+bool PatmosAsmParser::hasPredSrcOperands(StringRef Mnemonic) const
+{
   // We check if the src op is actually a predicate register later in the
-  // parse method
-  if (Mnemonic == "por"  || Mnemonic == "pand" ||
-      Mnemonic == "pxor") return true;
-  if (Mnemonic == "pmov" || Mnemonic == "pnot" ||
-      Mnemonic == "pset" || Mnemonic == "pclr") return true;
+  // parse method.
   // Note that mov might actually move between predicate and registers
   // (in the future)
-  if (Mnemonic == "mov") return true;
-
-  return false;
+  return StringSwitch<bool>(Mnemonic)
+    .Cases("por", "pand", "pxor", true)
+    .Cases("pmov", "pnot", "pset", "pclr", true)
+    .Case("mov", true)
+    .Default(false);
 }
 
 void PatmosAsmParser::EatToEndOfStatement() {
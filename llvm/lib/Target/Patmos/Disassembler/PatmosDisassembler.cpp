@@ -59,6 +59,10 @@ private:
   /// adjustSignedImm - convert immediates to signed by sign-extend if necessary
   void adjustSignedImm(MCInst &instr) const;
 
+  /// annotateInstruction - emit comments about the performance relevant
+  /// effects of an instruction, e.g., the stack cache space it reserves.
+  void annotateInstruction(const MCInst &instr, raw_ostream &CStream) const;
+
 };
 
 // We could use the information from PatmosGenRegisterInfo.inc here,
@@ -137,10 +141,16 @@ PatmosDisassembler::getInstruction(MCInst &instr,
   bool isBundled = (Insn >> 31);
   Insn &= ~(1<<31);
 
-  // TODO we could check the opcode for ALUl instruction format to avoid calling decode32 in that case
+  // The ALUl format is the only one using opcode 0b11111, there is no
+  // point in walking the 32bit decoder table for it.
+  bool isLong = ((Insn >> 22) & 0x1F) == 0x1F;
 
   // Calling the auto-generated decoder function.
-  Result = decodeInstruction(DecoderTablePatmos32, instr, Insn, Address, this, STI);
+  if (!isLong)
+    Result = decodeInstruction(DecoderTablePatmos32, instr, Insn, Address,
+                               this, STI);
+  else
+    Result = MCDisassembler::Fail;
 
   // Try decoding as 64bit ALUl instruction
   if (Result == MCDisassembler::Fail) {
@@ -170,6 +180,8 @@ PatmosDisassembler::getInstruction(MCInst &instr,
 
   adjustSignedImm(instr);
 
+  annotateInstruction(instr, CStream);
+
   return Result;
 }
 
@@ -196,6 +208,25 @@ void PatmosDisassembler::adjustSignedImm(MCInst &instr) const {
 
 }
 
+void PatmosDisassembler::annotateInstruction(const MCInst &instr,
+                                             raw_ostream &CStream) const {
+  const char *What;
+  switch (instr.getOpcode()) {
+  case Patmos::SRESi:  What = "reserve";  break;
+  case Patmos::SENSi:  What = "ensure";   break;
+  case Patmos::SFREEi: What = "free";     break;
+  default:
+    return;
+  }
+
+  const MCInstrDesc &MID = MII->get(instr.getOpcode());
+  unsigned ImmOpNo = getPatmosImmediateOpNo(MID.TSFlags);
+  uint64_t Words = instr.getOperand(ImmOpNo).getImm();
+
+  CStream << "\t# stack cache " << What << " "
+          << (Words << getPatmosImmediateShift(MID.TSFlags)) << " bytes";
+}
+
 static DecodeStatus DecodeRRegsRegisterClass(MCInst &Inst, unsigned RegNo, uint64_t Address,
                                              const void *Decoder)
 {
@@ -122,6 +122,11 @@ void PatmosInstPrinter::printOperand(const MCInst *MI, unsigned OpNo,
     }
   } else {
     assert(Op.isExpr() && "unknown operand kind in printOperand");
+    // symbolic offsets to a base register, e.g., to the small data base
+    if (((isLoadInst(opcode) && OpNo == 4) ||
+         (isStoreInst(opcode) && OpNo == 3)) &&
+        MI->getOperand(OpNo - 1).getReg() != Patmos::R0)
+      O << " + ";
     O << *Op.getExpr();
   }
 }
@@ -14,6 +14,7 @@
 #include "MCTargetDesc/PatmosAsmBackend.h"
 #include "MCTargetDesc/PatmosFixupKinds.h"
 #include "MCTargetDesc/PatmosMCTargetDesc.h"
+#include "PatmosInstrInfo.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/MC/MCAsmBackend.h"
 #include "llvm/MC/MCAssembler.h"
@@ -44,9 +45,11 @@ static unsigned adjustFixupValue(const MCFixup &Fixup, uint64_t Value) {
   // TODO check: do we need to shift the load/store offsets here or is this done
   // earlier in the compiler?
   case FK_Patmos_HO_7:
+  case FK_Patmos_sda_HO_7:
     Value >>= 1;
     break;
   case FK_Patmos_WO_7:
+  case FK_Patmos_sda_WO_7:
   case FK_Patmos_abs_CFLi:
   case FK_Patmos_PCrel:
     Value >>= 2;
@@ -75,8 +78,24 @@ void PatmosAsmBackend::applyFixup(const MCAssembler &Asm, const MCFixup &Fixup,
   if (!Value)
     return; // Doesn't change encoding.
 
-    unsigned TargetSize = getFixupKindInfo(Kind).TargetSize;
-    unsigned TargetOffset = getFixupKindInfo(Kind).TargetOffset;
+  const MCFixupKindInfo &Info = getFixupKindInfo(Kind);
+  unsigned TargetSize = Info.TargetSize;
+  unsigned TargetOffset = Info.TargetOffset;
+
+  // The target fixups patch a field within one big endian instruction word,
+  // update that word at once.
+  if (Kind >= FirstTargetFixupKind) {
+    assert(TargetOffset % 32 + TargetSize <= 32 && "Field crosses a word");
+
+    char *Word = &Data[Fixup.getOffset() + TargetOffset / 32 * 4];
+    uint32_t Mask = (uint32_t)((uint64_t)(-1) >> (64 - TargetSize));
+    unsigned Shift = 32 - (TargetOffset % 32 + TargetSize);
+
+    uint32_t CurVal = support::endian::read32be(Word);
+    CurVal |= ((uint32_t)Value & Mask) << Shift;
+    support::endian::write32be(Word, CurVal);
+    return;
+  }
 
     // Where do we start in the object
     unsigned Offset = Fixup.getOffset();
@@ -119,6 +138,10 @@ getFixupKindInfo(MCFixupKind Kind) const {
     { "FK_Patmos_abs_ALUl",    32,     32,   0 }, // ALU immediate, unsigned
     { "FK_Patmos_stc",         14,     18,   0 }, // 2 bit shifted, unsigned, for stack control
     { "FK_Patmos_PCrel",       10,     22,   MCFixupKindInfo::FKF_IsPCRel }, // 2 bit shifted, signed, PC relative
+    { "FK_Patmos_sda_BO_7",    25,      7,   0 }, // 0 bit shifted, unsigned, small data base relative
+    { "FK_Patmos_sda_HO_7",    25,      7,   0 }, // 1 bit shifted, unsigned, small data base relative
+    { "FK_Patmos_sda_WO_7",    25,      7,   0 }, // 2 bit shifted, unsigned, small data base relative
+    { "FK_Patmos_sda_ALUi",    20,     12,   0 }, // ALU immediate, unsigned, small data base relative
   };
 
   if (Kind < FirstTargetFixupKind)
@@ -129,6 +152,16 @@ getFixupKindInfo(MCFixupKind Kind) const {
   return Infos[Kind - FirstTargetFixupKind];
 }
 
+void PatmosAsmBackend::relaxInstruction(MCInst &Inst,
+                                        const MCSubtargetInfo &STI) const {
+  unsigned ALUlOpcode;
+  if (!HasALUlVariant(Inst.getOpcode(), ALUlOpcode))
+    llvm_unreachable("relaxable instruction without ALUl variant");
+
+  Inst.setOpcode(ALUlOpcode);
+  Inst.setFlags(Inst.getFlags() & ~PatmosII::MCIF_RelaxableALUi);
+}
+
 /// WriteNopData - Write an (optimal) nop sequence of Count bytes
 /// to the given output. If the target cannot generate such a sequence,
 /// it should return an error.
@@ -14,9 +14,12 @@
 #ifndef LLVM_LIB_TARGET_PATMOS_MCTARGETDESC_PATMOSASMBACKEND_H
 #define LLVM_LIB_TARGET_PATMOS_MCTARGETDESC_PATMOSASMBACKEND_H
 
+#include "MCTargetDesc/PatmosBaseInfo.h"
 #include "MCTargetDesc/PatmosFixupKinds.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/Support/MathExtras.h"
 
 namespace llvm {
 
@@ -51,13 +54,13 @@ public:
   /// @{
 
   /// MayNeedRelaxation - Check whether the given instruction may need
-  /// relaxation.
+  /// relaxation. Only ALUi instructions with symbolic immediates that are
+  /// not bundled are emitted in short form and relaxed if needed.
   ///
   /// \param Inst - The instruction to test.
   bool mayNeedRelaxation(const MCInst &Inst,
                          const MCSubtargetInfo &STI) const override {
-    // TODO return true for small immediates (?)
-    return false;
+    return Inst.getFlags() & PatmosII::MCIF_RelaxableALUi;
   }
 
   /// fixupNeedsRelaxation - Target specific predicate for whether a given
@@ -65,11 +68,13 @@ public:
   bool fixupNeedsRelaxation(const MCFixup &Fixup, uint64_t Value,
                             const MCRelaxableFragment *DF,
                             const MCAsmLayout &Layout) const override {
-    // FIXME.
-    llvm_unreachable("RelaxInstruction() unimplemented");
-    return false;
+    return !isUInt<12>(Value);
   }
 
+  /// relaxInstruction - Turn the ALUi instruction into its ALUl variant.
+  void relaxInstruction(MCInst &Inst,
+                        const MCSubtargetInfo &STI) const override;
+
   bool writeNopData(raw_ostream &OS, uint64_t Count) const override;
 
 }; // class PatmosAsmBackend
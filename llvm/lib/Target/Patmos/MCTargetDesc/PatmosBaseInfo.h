@@ -32,8 +32,19 @@ namespace PatmosII {
     //===------------------------------------------------------------------===//
     // Patmos Specific MachineOperand flags.
 
-    MO_NO_FLAG
+    MO_NO_FLAG,
 
+    /// The global is addressed relative to the small data base register,
+    /// printed as sym@sda.
+    MO_SDA
+
+  };
+
+  /// Target specific flags of MCInsts.
+  enum MCInstFlags {
+    /// The ALUi instruction has a symbolic immediate that may not fit 12 bits
+    /// and is relaxed to its ALUl variant by the assembler in that case.
+    MCIF_RelaxableALUi = 1
   };
 
   enum {
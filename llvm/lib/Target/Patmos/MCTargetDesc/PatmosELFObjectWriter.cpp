@@ -39,6 +39,11 @@ namespace {
       case ELF::R_PATMOS_ALUL_ABS:
       case ELF::R_PATMOS_CFLI_ABS:
       case ELF::R_PATMOS_CFLI_PCREL:
+      // the offset to the small data base is computed from the symbol
+      case ELF::R_PATMOS_ALUI_SDA:
+      case ELF::R_PATMOS_MEMB_SDA:
+      case ELF::R_PATMOS_MEMH_SDA:
+      case ELF::R_PATMOS_MEMW_SDA:
         return true;
       default:
         return false;
@@ -51,41 +56,40 @@ PatmosELFObjectWriter::PatmosELFObjectWriter(uint8_t OSABI)
   : MCELFObjectTargetWriter(false, OSABI, ELF::EM_PATMOS,
                             /*HasRelocationAddend*/ false) {}
 
+/// RelocTypes - The relocation type of each target fixup kind, in the order
+/// of Patmos::Fixups.
+static const unsigned RelocTypes[Patmos::NumTargetFixupKinds] = {
+  ELF::R_PATMOS_MEMB_ABS,   // FK_Patmos_BO_7
+  ELF::R_PATMOS_MEMH_ABS,   // FK_Patmos_HO_7
+  ELF::R_PATMOS_MEMW_ABS,   // FK_Patmos_WO_7
+  ELF::R_PATMOS_ALUI_ABS,   // FK_Patmos_abs_ALUi
+  ELF::R_PATMOS_CFLI_ABS,   // FK_Patmos_abs_CFLi
+  ELF::R_PATMOS_ALUL_ABS,   // FK_Patmos_abs_ALUl
+  // TODO do not emit STC format relocations?
+  ELF::R_PATMOS_CFLI_ABS,   // FK_Patmos_stc
+  ELF::R_PATMOS_CFLI_PCREL, // FK_Patmos_PCrel
+  ELF::R_PATMOS_MEMB_SDA,   // FK_Patmos_sda_BO_7
+  ELF::R_PATMOS_MEMH_SDA,   // FK_Patmos_sda_HO_7
+  ELF::R_PATMOS_MEMW_SDA,   // FK_Patmos_sda_WO_7
+  ELF::R_PATMOS_ALUI_SDA,   // FK_Patmos_sda_ALUi
+};
+
 unsigned PatmosELFObjectWriter::getRelocType(MCContext &Ctx,
                                              const MCValue &Target,
                                              const MCFixup &Fixup,
                                              bool IsPCRel) const {
-  // TODO determine the type of the relocation, use Patmos types
-  switch ((unsigned)Fixup.getKind()) {
-  case FK_Data_4:
+  unsigned Kind = Fixup.getKind();
+  if (Kind == FK_Data_4)
     return ELF::R_PATMOS_ABS_32;
-  case FK_Patmos_BO_7:
-    return ELF::R_PATMOS_MEMB_ABS;
-  case FK_Patmos_HO_7:
-    return ELF::R_PATMOS_MEMH_ABS;
-  case FK_Patmos_WO_7:
-    return ELF::R_PATMOS_MEMW_ABS;
-  case FK_Patmos_abs_ALUi:
-    return ELF::R_PATMOS_ALUI_ABS;
-  case FK_Patmos_abs_CFLi:
-    return ELF::R_PATMOS_CFLI_ABS;
-  case FK_Patmos_abs_ALUl:
-    return ELF::R_PATMOS_ALUL_ABS;
-  case FK_Patmos_stc:
-    // TODO do not emit STC format relocations?
-    return ELF::R_PATMOS_CFLI_ABS;
-  case FK_Patmos_PCrel:
-    return ELF::R_PATMOS_CFLI_PCREL;
-  default:
-    llvm_unreachable("invalid fixup kind!");
-  }
-}
 
+  if (Kind < FirstTargetFixupKind || Kind >= LastTargetFixupKind)
+    llvm_unreachable("invalid fixup kind!");
 
+  return RelocTypes[Kind - FirstTargetFixupKind];
+}
 
 std::unique_ptr<MCObjectTargetWriter>
 llvm::createPatmosELFObjectWriter(const Triple &TT) {
   uint8_t OSABI = MCELFObjectTargetWriter::getOSABI(TT.getOS());
-  MCELFObjectTargetWriter *MOTW = new PatmosELFObjectWriter(OSABI);
   return std::make_unique<PatmosELFObjectWriter>(OSABI);
 }
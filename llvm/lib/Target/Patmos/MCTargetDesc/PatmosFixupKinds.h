@@ -20,7 +20,7 @@ namespace Patmos {
   //
   // This table *must* be in the same order of
   // MCFixupKindInfo Infos[Patmos::NumTargetFixupKinds]
-  // in PatmosAsmBackend.cpp.
+  // in PatmosAsmBackend.cpp and of RelocTypes in PatmosELFObjectWriter.cpp.
   //
   enum Fixups {
     /// Memory offset, 7 bit unsigned immediate byte offset, resulting in R_PATMOS_MEMB_ABS
@@ -48,6 +48,22 @@ namespace Patmos {
     /// PC relative word addresses, 22 bit immediate, resulting in R_PATMOS_CFLI_PCREL
     FK_Patmos_PCrel,
 
+    /// Memory offset of a small data byte to the small data base, 7 bit
+    /// unsigned immediate byte offset, resulting in R_PATMOS_MEMB_SDA
+    FK_Patmos_sda_BO_7,
+
+    /// Memory offset of a small data half-word to the small data base, 7 bit
+    /// unsigned immediate half-word offset, resulting in R_PATMOS_MEMH_SDA
+    FK_Patmos_sda_HO_7,
+
+    /// Memory offset of a small data word to the small data base, 7 bit
+    /// unsigned immediate word offset, resulting in R_PATMOS_MEMW_SDA
+    FK_Patmos_sda_WO_7,
+
+    /// ALU 12 bit immediate byte offset of small data to the small data base,
+    /// unsigned, resulting in R_PATMOS_ALUI_SDA
+    FK_Patmos_sda_ALUi,
+
     // Marker
     LastTargetFixupKind,
     NumTargetFixupKinds = LastTargetFixupKind - FirstTargetFixupKind
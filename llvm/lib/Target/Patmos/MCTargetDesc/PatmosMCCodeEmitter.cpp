@@ -24,6 +24,7 @@
 #include "llvm/MC/MCInstrInfo.h"
 #include "llvm/MC/MCRegisterInfo.h"
 #include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/EndianStream.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
@@ -71,15 +72,14 @@ public:
 
   /****** Helper functions to emit binary code ******/
 
-  void EmitByte(unsigned char C, raw_ostream &OS) const {
-    OS << (char)C;
-  }
-
   void EmitInstruction(uint64_t Val, unsigned Size, raw_ostream &OS) const {
-    // Output the instruction encoding in big endian byte order.
-    for (unsigned i = 0; i < Size; ++i) {
-      unsigned Shift = (Size - 1 - i) * 8;
-      EmitByte((Val >> Shift) & 0xff, OS);
+    // Output the instruction encoding in big endian byte order, with a single
+    // write per instruction.
+    if (Size == 8)
+      support::endian::write<uint64_t>(OS, Val, support::big);
+    else {
+      assert(Size == 4 && "Unexpected instruction size");
+      support::endian::write<uint32_t>(OS, Val, support::big);
     }
   }
 
@@ -233,6 +233,32 @@ PatmosMCCodeEmitter::addSymbolRefFixups(const MCInst &MI, const MCOperand& MO,
   Patmos::Fixups FixupKind;
   unsigned Offset = 0;
 
+  // small data is addressed by its offset to the small data base
+  if (Expr->getKind() == MCSymbolRefExpr::VK_Patmos_SDA) {
+    switch (Format) {
+    case PatmosII::FrmLDT:
+    case PatmosII::FrmSTT:
+      switch (getPatmosImmediateShift( MID.TSFlags )) {
+      case 0: FixupKind = FK_Patmos_sda_BO_7; break;
+      case 1: FixupKind = FK_Patmos_sda_HO_7; break;
+      case 2: FixupKind = FK_Patmos_sda_WO_7; break;
+      default:
+        llvm_unreachable("Invalid shift value");
+      }
+      break;
+    case PatmosII::FrmALUi:
+      FixupKind = FK_Patmos_sda_ALUi;
+      break;
+    default:
+      llvm_unreachable("Small data offset in an instruction without short "
+                       "immediate");
+    }
+
+    Fixups.push_back(MCFixup::create(Offset, MO.getExpr(),
+                                     MCFixupKind(FixupKind)));
+    return;
+  }
+
   switch (Format) {
   case PatmosII::FrmLDT:
   case PatmosII::FrmSTT:
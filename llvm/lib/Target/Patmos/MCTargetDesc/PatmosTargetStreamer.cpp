@@ -12,6 +12,11 @@
 //===----------------------------------------------------------------------===//
 
 #include "PatmosTargetStreamer.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCObjectStreamer.h"
+#include "llvm/MC/MCSectionELF.h"
 #include "llvm/MC/MCSymbolELF.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FormattedStream.h"
@@ -33,6 +38,42 @@ void PatmosTargetAsmStreamer::EmitFStart(const MCSymbol *Start,
   OS << "\t.fstart\t" << *Start << ", " << *Size << ", " << Alignment.value() << "\n";
 }
 
+void PatmosTargetAsmStreamer::EmitLoopBound(const MCSymbol *Header,
+                                            uint64_t Min, uint64_t Max)
+{
+  OS << "\t.loopbound\t" << *Header << ", " << Min << ", " << Max << "\n";
+}
+
+void PatmosTargetAsmStreamer::EmitStackCacheFrame(const MCSymbol *Function,
+                                                  uint64_t Bytes)
+{
+  OS << "\t.scframe\t" << *Function << ", " << Bytes << "\n";
+}
+
+void PatmosTargetAsmStreamer::EmitStackCacheCall(const MCSymbol *Caller,
+                                                 const MCSymbol *Callee,
+                                                 const MCSymbol *Ensure,
+                                                 uint64_t EnsureBytes)
+{
+  OS << "\t.sccall\t" << *Caller << ", ";
+  if (Callee)
+    OS << *Callee;
+  else
+    OS << "0";
+  OS << ", ";
+  if (Ensure)
+    OS << *Ensure;
+  else
+    OS << "0";
+  OS << ", " << EnsureBytes << "\n";
+}
+
+void PatmosTargetAsmStreamer::EmitStackCacheDisplacement(
+    const MCSymbol *Function, uint64_t Min, uint64_t Max)
+{
+  OS << "\t.scdisp\t" << *Function << ", " << Min << ", " << Max << "\n";
+}
+
 PatmosTargetELFStreamer::PatmosTargetELFStreamer(MCStreamer &S)
     : PatmosTargetStreamer(S) {}
 
@@ -44,3 +85,100 @@ void PatmosTargetELFStreamer::EmitFStart(const MCSymbol *Start,
 
 }
 
+void PatmosTargetELFStreamer::ReserveCode(uint64_t Bytes)
+{
+  // The code is appended to the current data fragment until the next
+  // alignment or relaxable instruction.
+  MCObjectStreamer &S = static_cast<MCObjectStreamer&>(getStreamer());
+  SmallVectorImpl<char> &Contents = S.getOrCreateDataFragment()->getContents();
+  Contents.reserve(Contents.size() + Bytes);
+}
+
+void PatmosTargetELFStreamer::EmitLoopBound(const MCSymbol *Header,
+                                            uint64_t Min, uint64_t Max)
+{
+  MCStreamer &S = getStreamer();
+  MCContext &Ctx = S.getContext();
+
+  // The section is not allocated, it is only read by the analysis tools
+  MCSectionELF *Sec = Ctx.getELFSection(PATMOS_FLOWFACTS_SECTION,
+                                        ELF::SHT_PROGBITS, 0);
+
+  S.PushSection();
+  S.SwitchSection(Sec);
+  S.emitValueToAlignment(4);
+  S.emitIntValue(PFF_LOOPBOUND, 4);
+  S.emitValue(MCSymbolRefExpr::create(Header, Ctx), 4);
+  S.emitIntValue(Min, 4);
+  S.emitIntValue(Max, 4);
+  S.PopSection();
+}
+
+/// Emit the address of Sym, or 0 if there is no symbol.
+static void emitAddressOrZero(MCStreamer &S, const MCSymbol *Sym)
+{
+  if (Sym)
+    S.emitValue(MCSymbolRefExpr::create(Sym, S.getContext()), 4);
+  else
+    S.emitIntValue(0, 4);
+}
+
+void PatmosTargetELFStreamer::EmitStackCacheFrame(const MCSymbol *Function,
+                                                  uint64_t Bytes)
+{
+  MCStreamer &S = getStreamer();
+  MCContext &Ctx = S.getContext();
+
+  // The section is not allocated, it is only read by the linker
+  MCSectionELF *Sec = Ctx.getELFSection(PATMOS_STACKCACHE_SECTION,
+                                        ELF::SHT_PROGBITS, 0);
+
+  S.PushSection();
+  S.SwitchSection(Sec);
+  S.emitValueToAlignment(4);
+  S.emitIntValue(PSC_FRAME, 4);
+  emitAddressOrZero(S, Function);
+  S.emitIntValue(Bytes, 4);
+  S.PopSection();
+}
+
+void PatmosTargetELFStreamer::EmitStackCacheCall(const MCSymbol *Caller,
+                                                 const MCSymbol *Callee,
+                                                 const MCSymbol *Ensure,
+                                                 uint64_t EnsureBytes)
+{
+  MCStreamer &S = getStreamer();
+  MCContext &Ctx = S.getContext();
+
+  MCSectionELF *Sec = Ctx.getELFSection(PATMOS_STACKCACHE_SECTION,
+                                        ELF::SHT_PROGBITS, 0);
+
+  S.PushSection();
+  S.SwitchSection(Sec);
+  S.emitValueToAlignment(4);
+  S.emitIntValue(PSC_CALL, 4);
+  emitAddressOrZero(S, Caller);
+  emitAddressOrZero(S, Callee);
+  emitAddressOrZero(S, Ensure);
+  S.emitIntValue(EnsureBytes, 4);
+  S.PopSection();
+}
+
+void PatmosTargetELFStreamer::EmitStackCacheDisplacement(
+    const MCSymbol *Function, uint64_t Min, uint64_t Max)
+{
+  MCStreamer &S = getStreamer();
+  MCContext &Ctx = S.getContext();
+
+  MCSectionELF *Sec = Ctx.getELFSection(PATMOS_STACKCACHE_SECTION,
+                                        ELF::SHT_PROGBITS, 0);
+
+  S.PushSection();
+  S.SwitchSection(Sec);
+  S.emitValueToAlignment(4);
+  S.emitIntValue(PSC_DISPLACEMENT, 4);
+  emitAddressOrZero(S, Function);
+  S.emitIntValue(Min, 4);
+  S.emitIntValue(Max, 4);
+  S.PopSection();
+}
@@ -14,6 +14,59 @@
 #include "llvm/MC/MCStreamer.h"
 
 namespace llvm {
+
+/// Name of the non-allocated section holding flow facts for WCET analysis.
+/// The section is a sequence of 4-byte aligned records, each starting with
+/// a 4-byte record kind.
+#define PATMOS_FLOWFACTS_SECTION ".patmos.flowfacts"
+
+/// Kinds of records in the flow-fact section.
+enum PatmosFlowFactKind {
+  /// A loop bound: the address of the loop header, followed by the minimum
+  /// and maximum number of header executions per entry of the loop.
+  PFF_LOOPBOUND = 1
+};
+
+/// Name of the non-allocated section holding stack cache summaries, which
+/// the linker uses to remove ensures over the call graph of the whole
+/// program, and the compiler to analyze calls into pre-compiled libraries.
+/// The records have the same layout as in the flow-fact section.
+#define PATMOS_STACKCACHE_SECTION ".patmos.stackcache"
+
+/// Kinds of records in the stack cache summary section.
+enum PatmosStackCacheRecordKind {
+  /// A function frame: the address of the function, followed by the number
+  /// of bytes it reserves on the stack cache.
+  PSC_FRAME = 1,
+  /// A call site: the address of the calling function, the address of the
+  /// callee, the address of the ensure after the call, and the number of
+  /// bytes the ensure fills. The callee is 0 for indirect calls, the ensure
+  /// is 0 if the linker must not remove it.
+  PSC_CALL = 2,
+  /// The displacement bounds of a function computed by the stack cache
+  /// analysis: the address of the function, followed by the minimum and the
+  /// maximum number of bytes the function and its callees displace from the
+  /// stack cache.
+  PSC_DISPLACEMENT = 3
+};
+
+/// Name of the section holding the tracing sleds, which the runtime patches
+/// to enable and disable them. Being a C identifier, the linker defines
+/// __start_ and __stop_ symbols for it. The records are 4-byte aligned and
+/// consist of the address of the sled, the address of its function, the
+/// PatmosSledKind, and the instructions of the enabled sled.
+#define PATMOS_SLEDS_SECTION "patmos_sleds"
+
+/// Kinds of tracing sleds.
+enum PatmosSledKind {
+  /// The entry of a function.
+  PSLED_ENTRY = 0,
+  /// A return of a function.
+  PSLED_EXIT = 1,
+  /// The entry of a subfunction other than the first one of its function.
+  PSLED_SUBFUNCTION = 2
+};
+
 class PatmosTargetStreamer : public MCTargetStreamer {
   virtual void anchor();
 
@@ -28,6 +81,43 @@ public:
   /// \param Alignment - The alignment in bytes, should be a power of 2.
   virtual void EmitFStart(const MCSymbol *Start, const MCExpr* Size,
                           Align Alignment) = 0;
+
+  /// ReserveCode - Announce the number of bytes of code that follow, such
+  ///               that the object streamer can allocate them at once.
+  virtual void ReserveCode(uint64_t Bytes) {}
+
+  /// EmitLoopBound - Emit a loop bound record to the flow-fact section.
+  /// \param Header - The symbol of the loop header.
+  /// \param Min - The minimum number of header executions.
+  /// \param Max - The maximum number of header executions.
+  virtual void EmitLoopBound(const MCSymbol *Header, uint64_t Min,
+                             uint64_t Max) = 0;
+
+  /// EmitStackCacheFrame - Emit a function frame record to the stack cache
+  /// summary section.
+  /// \param Function - The symbol of the function.
+  /// \param Bytes - The number of bytes the function reserves.
+  virtual void EmitStackCacheFrame(const MCSymbol *Function,
+                                   uint64_t Bytes) = 0;
+
+  /// EmitStackCacheCall - Emit a call site record to the stack cache summary
+  /// section.
+  /// \param Caller - The symbol of the calling function.
+  /// \param Callee - The symbol of the callee, or null for indirect calls.
+  /// \param Ensure - The symbol of the ensure after the call, or null.
+  /// \param EnsureBytes - The number of bytes the ensure fills.
+  virtual void EmitStackCacheCall(const MCSymbol *Caller,
+                                  const MCSymbol *Callee,
+                                  const MCSymbol *Ensure,
+                                  uint64_t EnsureBytes) = 0;
+
+  /// EmitStackCacheDisplacement - Emit a displacement record to the stack
+  /// cache summary section.
+  /// \param Function - The symbol of the function.
+  /// \param Min - The minimum number of bytes displaced.
+  /// \param Max - The maximum number of bytes displaced.
+  virtual void EmitStackCacheDisplacement(const MCSymbol *Function,
+                                          uint64_t Min, uint64_t Max) = 0;
 };
 
 // This part is for ascii assembly output
@@ -39,6 +129,18 @@ public:
 
   void EmitFStart(const MCSymbol *Start, const MCExpr* Size,
                   Align Alignment) override;
+
+  void EmitLoopBound(const MCSymbol *Header, uint64_t Min,
+                     uint64_t Max) override;
+
+  void EmitStackCacheFrame(const MCSymbol *Function, uint64_t Bytes) override;
+
+  void EmitStackCacheCall(const MCSymbol *Caller, const MCSymbol *Callee,
+                          const MCSymbol *Ensure,
+                          uint64_t EnsureBytes) override;
+
+  void EmitStackCacheDisplacement(const MCSymbol *Function, uint64_t Min,
+                                  uint64_t Max) override;
 };
 
 // This part is for ELF object output
@@ -48,6 +150,20 @@ public:
 
   void EmitFStart(const MCSymbol *Start, const MCExpr* Size,
                   Align Alignment) override;
+
+  void ReserveCode(uint64_t Bytes) override;
+
+  void EmitLoopBound(const MCSymbol *Header, uint64_t Min,
+                     uint64_t Max) override;
+
+  void EmitStackCacheFrame(const MCSymbol *Function, uint64_t Bytes) override;
+
+  void EmitStackCacheCall(const MCSymbol *Caller, const MCSymbol *Callee,
+                          const MCSymbol *Ensure,
+                          uint64_t EnsureBytes) override;
+
+  void EmitStackCacheDisplacement(const MCSymbol *Function, uint64_t Min,
+                                  uint64_t Max) override;
 };
 
 }
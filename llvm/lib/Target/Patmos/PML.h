@@ -204,6 +204,30 @@ struct ScalarEnumerationTraits<BranchType> {
     io.enumCase(branchtype, "any", branch_any);
   }
 };
+/// Method cache classification of the code fetched by a call or its return
+enum MethodCacheClass { mc_none, mc_always_hit, mc_first_miss,
+                        mc_always_miss };
+template <>
+struct ScalarEnumerationTraits<MethodCacheClass> {
+  static void enumeration(IO &io, MethodCacheClass& mcclass) {
+    io.enumCase(mcclass, "", mc_none);
+    io.enumCase(mcclass, "always-hit", mc_always_hit);
+    io.enumCase(mcclass, "first-miss", mc_first_miss);
+    io.enumCase(mcclass, "always-miss", mc_always_miss);
+  }
+};
+/// Data cache classification of the data fetched by a load
+enum DataCacheClass { dc_none, dc_always_hit, dc_persistent,
+                      dc_always_miss };
+template <>
+struct ScalarEnumerationTraits<DataCacheClass> {
+  static void enumeration(IO &io, DataCacheClass& dcclass) {
+    io.enumCase(dcclass, "", dc_none);
+    io.enumCase(dcclass, "always-hit", dc_always_hit);
+    io.enumCase(dcclass, "persistent", dc_persistent);
+    io.enumCase(dcclass, "always-miss", dc_always_miss);
+  }
+};
 struct MachineInstruction : Instruction {
 
   unsigned Size;
@@ -215,6 +239,11 @@ struct MachineInstruction : Instruction {
   unsigned StackCacheArg;
   unsigned StackCacheFill;
   unsigned StackCacheSpill;
+  enum MethodCacheClass MethodCacheCall;
+  enum MethodCacheClass MethodCacheReturn;
+  enum DataCacheClass DataCache;
+  // the header block of the loop a persistent load misses once per entry of
+  int64_t DataCacheScope;
   StringValue MemType;
 
   bool Bundled;
@@ -222,6 +251,8 @@ struct MachineInstruction : Instruction {
   MachineInstruction(uint64_t Index)
   : Instruction(Index), Size(0), Address(-1), BranchType(branch_none),
     BranchDelaySlots(0), StackCacheArg(0), StackCacheFill(0), StackCacheSpill(0),
+    MethodCacheCall(mc_none), MethodCacheReturn(mc_none),
+    DataCache(dc_none), DataCacheScope(-1),
     MemType(""), Bundled(false) {}
 };
 template <>
@@ -239,6 +270,10 @@ struct MappingTraits<MachineInstruction*> {
     io.mapOptional("stack-cache-argument", Ins->StackCacheArg, 0U);
     io.mapOptional("stack-cache-fill", Ins->StackCacheFill, 0U);
     io.mapOptional("stack-cache-spill", Ins->StackCacheSpill, 0U);
+    io.mapOptional("method-cache-call", Ins->MethodCacheCall, mc_none);
+    io.mapOptional("method-cache-return", Ins->MethodCacheReturn, mc_none);
+    io.mapOptional("data-cache", Ins->DataCache, dc_none);
+    io.mapOptional("data-cache-scope", Ins->DataCacheScope, (int64_t) -1);
     io.mapOptional("memmode",   Ins->MemMode, memmode_none);
     io.mapOptional("memtype",   Ins->MemType, "");
     io.mapOptional("bundled",       Ins->Bundled, false);
@@ -257,10 +292,15 @@ struct Block {
   std::vector<NameT> Loops;
   std::vector<InstructionT*> Instructions;
   StringValue Loc;
+  /// Worst-case stack cache bytes to save and to restore when the task is
+  /// preempted at the entry of the block, or -1 if unknown.
+  int64_t StackCacheSave;
+  int64_t StackCacheRestore;
 
   typedef std::vector<InstructionT*> InstrList;
 
-  Block(NameT name) : BlockName(name), Address(-1) {}
+  Block(NameT name) : BlockName(name), Address(-1), StackCacheSave(-1),
+                      StackCacheRestore(-1) {}
   ~Block() { DELETE_PTR_VEC(Instructions); }
 
   /// Add an instruction to the block
@@ -295,6 +335,8 @@ struct MappingTraits< Block<NameT, InstructionT>* > {
     io.mapRequired("successors",   B->Successors);
     io.mapOptional("loops",        B->Loops);
     io.mapOptional("src-hint",     B->Loc, "");
+    io.mapOptional("stack-cache-save", B->StackCacheSave, (int64_t) -1);
+    io.mapOptional("stack-cache-restore", B->StackCacheRestore, (int64_t) -1);
     io.mapOptional("instructions", B->Instructions);
   }
 };
@@ -933,6 +975,10 @@ struct PMLDoc {
       TargetTriple(TargetTriple), FunctionLabel(FunctionLabel) {}
 
   ~PMLDoc() {
+    clear();
+  }
+  /// Delete all functions, relation graphs, and facts of the document
+  void clear() {
     DELETE_PTR_VEC(Functions);
     DELETE_PTR_VEC(RelationGraphs);
     DELETE_PTR_VEC(ValueFacts);
@@ -0,0 +1,775 @@
+//===-- PMLBinary.cpp - Binary encoding of PML documents. -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Encoder for the binary PML format and the conversion back to YAML.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PMLBinary.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/LEB128.h"
+
+#include <map>
+
+using namespace llvm;
+
+static const char PMLBinaryMagic[4] = { 'P', 'M', 'L', 'B' };
+
+/// Size of the header and of the trailing index offset.
+static const uint64_t PMLBinaryHeaderSize = 8;
+static const uint64_t PMLBinaryTrailerSize = 8;
+
+/// Upper bound on the nesting of nodes accepted by the converter.
+static const unsigned PMLBinaryMaxDepth = 256;
+
+bool llvm::isPMLBinary(StringRef Buffer) {
+  return Buffer.startswith(StringRef(PMLBinaryMagic, 4));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+PMLBinaryOutput::PMLBinaryOutput(raw_ostream &os, void *Ctxt)
+: IO(Ctxt), OS(os), Start(os.tell()), EnumerationMatchFound(false),
+  ElementOffset(0), ElementKey(nullptr)
+{
+  OS.write(PMLBinaryMagic, 4);
+  support::endian::write<uint32_t>(OS, PMLBinaryVersion, support::little);
+}
+
+PMLBinaryOutput::~PMLBinaryOutput()
+{
+}
+
+unsigned PMLBinaryOutput::intern(StringRef S)
+{
+  auto R = StringIDs.insert(std::make_pair(S, (unsigned)Strings.size()));
+  if (R.second)
+    Strings.push_back(R.first->getKey());
+  return R.first->second;
+}
+
+void PMLBinaryOutput::writeULEB128(uint64_t Value)
+{
+  encodeULEB128(Value, OS);
+}
+
+void PMLBinaryOutput::writeString(StringRef S, NodeKind Kind)
+{
+  writeKind(Kind);
+  writeULEB128(intern(S));
+}
+
+void PMLBinaryOutput::beginDocument()
+{
+  assert(StateStack.empty() && "Nested document");
+  Documents.push_back(OS.tell() - Start);
+}
+
+void PMLBinaryOutput::endDocument()
+{
+  assert(StateStack.empty() && "Unbalanced document");
+}
+
+void PMLBinaryOutput::finish()
+{
+  uint64_t Index = OS.tell() - Start;
+
+  encodeULEB128(Documents.size(), OS);
+  for(std::vector<uint64_t>::const_iterator i(Documents.begin()),
+      ie(Documents.end()); i != ie; i++) {
+    encodeULEB128(*i, OS);
+  }
+
+  encodeULEB128(Strings.size(), OS);
+  for(std::vector<StringRef>::const_iterator i(Strings.begin()),
+      ie(Strings.end()); i != ie; i++) {
+    encodeULEB128(i->size(), OS);
+    OS << *i;
+  }
+
+  encodeULEB128(Entries.size(), OS);
+  for(std::vector<IndexEntry>::const_iterator i(Entries.begin()),
+      ie(Entries.end()); i != ie; i++) {
+    encodeULEB128(i->List, OS);
+    encodeULEB128(i->Name, OS);
+    encodeULEB128(i->Document, OS);
+    encodeULEB128(i->Offset, OS);
+  }
+
+  support::endian::write<uint64_t>(OS, Index, support::little);
+}
+
+bool PMLBinaryOutput::mapTag(StringRef Tag, bool Use)
+{
+  if (Use)
+    report_fatal_error("Tag " + Tag + " cannot be encoded in binary PML");
+  return false;
+}
+
+void PMLBinaryOutput::beginMapping()
+{
+  writeKind(Map);
+  StateStack.push_back(InMapFirstKey);
+}
+
+void PMLBinaryOutput::endMapping()
+{
+  writeULEB128(0);
+  StateStack.pop_back();
+}
+
+bool PMLBinaryOutput::preflightKey(const char *Key, bool Required,
+                                   bool SameAsDefault, bool &UseDefault,
+                                   void *&)
+{
+  UseDefault = false;
+  if (!Required && SameAsDefault)
+    return false;
+  writeULEB128(intern(Key) + 1);
+
+  // track the keys naming the elements of the top-level lists
+  if (StateStack.size() == 1)
+    ListKey = Key;
+  else if (StateStack.size() == 3)
+    ElementKey = Key;
+  return true;
+}
+
+void PMLBinaryOutput::postflightKey(void *)
+{
+  if (StateStack.back() == InMapFirstKey)
+    StateStack.back() = InMapOtherKey;
+}
+
+std::vector<StringRef> PMLBinaryOutput::keys()
+{
+  report_fatal_error("invalid call");
+}
+
+void PMLBinaryOutput::beginFlowMapping()
+{
+  writeKind(FlowMap);
+  StateStack.push_back(InFlow);
+}
+
+void PMLBinaryOutput::endFlowMapping()
+{
+  writeULEB128(0);
+  StateStack.pop_back();
+}
+
+unsigned PMLBinaryOutput::beginSequence()
+{
+  writeKind(Seq);
+  StateStack.push_back(InSeq);
+  return 0;
+}
+
+bool PMLBinaryOutput::preflightElement(unsigned, void *&)
+{
+  if (StateStack.size() == 2 && StateStack[0] != InFlow &&
+      StateStack[1] == InSeq) {
+    ElementOffset = OS.tell() - Start;
+    ElementKey = nullptr;
+  }
+  return true;
+}
+
+void PMLBinaryOutput::endSequence()
+{
+  writeKind(End);
+  StateStack.pop_back();
+}
+
+unsigned PMLBinaryOutput::beginFlowSequence()
+{
+  writeKind(FlowSeq);
+  StateStack.push_back(InFlow);
+  return 0;
+}
+
+void PMLBinaryOutput::endFlowSequence()
+{
+  writeKind(End);
+  StateStack.pop_back();
+}
+
+bool PMLBinaryOutput::matchEnumScalar(const char *Str, bool Match)
+{
+  if (Match && !EnumerationMatchFound) {
+    writeString(Str, Enum);
+    EnumerationMatchFound = true;
+  }
+  return false;
+}
+
+bool PMLBinaryOutput::matchEnumFallback()
+{
+  if (EnumerationMatchFound)
+    return false;
+  EnumerationMatchFound = true;
+  return true;
+}
+
+void PMLBinaryOutput::endEnumScalar()
+{
+  if (!EnumerationMatchFound)
+    llvm_unreachable("bad runtime enum value");
+}
+
+bool PMLBinaryOutput::beginBitSetScalar(bool &DoClear)
+{
+  writeKind(BitSet);
+  DoClear = false;
+  return true;
+}
+
+bool PMLBinaryOutput::bitSetMatch(const char *Str, bool Matches)
+{
+  if (Matches)
+    writeULEB128(intern(Str) + 1);
+  return false;
+}
+
+void PMLBinaryOutput::endBitSetScalar()
+{
+  writeULEB128(0);
+}
+
+void PMLBinaryOutput::scalarString(StringRef &S, yaml::QuotingType MustQuote)
+{
+  // index the elements of the top-level lists by their names
+  if (ElementKey && StateStack.size() == 3 && StateStack[1] == InSeq &&
+      !S.empty() && (StringRef(ElementKey) == "name" ||
+                     StringRef(ElementKey) == "mapsto")) {
+    IndexEntry E = { intern(ListKey), intern(S), Documents.size() - 1,
+                     ElementOffset };
+    Entries.push_back(E);
+  }
+
+  switch (MustQuote) {
+  case yaml::QuotingType::None: {
+    // IDs, indices and addresses are stored as numbers if they can be
+    // printed back exactly
+    uint64_t U;
+    int64_t I;
+    if (!S.getAsInteger(10, U) && utostr(U) == S) {
+      writeKind(UInt);
+      writeULEB128(U);
+    } else if (S.startswith("-") && !S.getAsInteger(10, I) && itostr(I) == S) {
+      writeKind(SInt);
+      writeULEB128(((uint64_t)I << 1) ^ (uint64_t)(I >> 63));
+    } else {
+      writeString(S, Plain);
+    }
+    break;
+  }
+  case yaml::QuotingType::Single:
+    writeString(S, Single);
+    break;
+  case yaml::QuotingType::Double:
+    writeString(S, Double);
+    break;
+  }
+}
+
+void PMLBinaryOutput::blockScalarString(StringRef &S)
+{
+  writeString(S, Block);
+}
+
+void PMLBinaryOutput::scalarTag(std::string &Tag)
+{
+  if (!Tag.empty())
+    report_fatal_error("Tag " + Tag + " cannot be encoded in binary PML");
+}
+
+yaml::NodeKind PMLBinaryOutput::getNodeKind()
+{
+  report_fatal_error("invalid call");
+}
+
+bool PMLBinaryOutput::canElideEmptySequence()
+{
+  // see yaml::Output::canElideEmptySequence
+  if (StateStack.size() < 2 || StateStack.back() != InMapFirstKey)
+    return true;
+  return StateStack[StateStack.size() - 2] != InSeq;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace llvm {
+  /// Decodes the index of a binary PML file and replays its nodes on a
+  /// yaml::Output.
+  class PMLBinaryReader {
+  public:
+    /// The documents and node offsets of the entries, by list and name.
+    typedef std::map<std::pair<StringRef, StringRef>,
+                     std::vector<std::pair<uint64_t, uint64_t> > > EntryMap;
+
+  private:
+    StringRef Buffer;
+    std::string Error;
+
+    /// The string table, pointing into the buffer.
+    std::vector<StringRef> Strings;
+
+    /// NUL-terminated copies of the strings used as keys.
+    std::map<uint64_t, std::string> Keys;
+
+    /// The offsets of the documents, and of the index ending the last one.
+    std::vector<uint64_t> Documents;
+    uint64_t Index;
+
+    EntryMap Entries;
+    bool HasEntries;
+
+    /// The current position and the end of the current section.
+    const uint8_t *Pos, *End;
+
+    bool fail(const Twine &Msg) {
+      if (Error.empty())
+        Error = Msg.str();
+      Pos = End;
+      return false;
+    }
+
+    bool seek(uint64_t Offset, uint64_t EndOffset) {
+      if (Offset > EndOffset || EndOffset > Buffer.size())
+        return fail("section offset " + Twine(Offset) + " out of bounds");
+      Pos = Buffer.bytes_begin() + Offset;
+      End = Buffer.bytes_begin() + EndOffset;
+      return true;
+    }
+
+    bool readULEB128(uint64_t &Value) {
+      const char *Msg = nullptr;
+      unsigned N;
+      Value = decodeULEB128(Pos, &N, End, &Msg);
+      if (Msg)
+        return fail(Msg);
+      Pos += N;
+      return true;
+    }
+
+    bool readStringIndex(uint64_t &Index, bool Biased) {
+      if (!readULEB128(Index))
+        return false;
+      if (Biased && Index == 0)
+        return true;
+      if (Index - Biased >= Strings.size())
+        return fail("string index " + Twine(Index) + " out of bounds");
+      return true;
+    }
+
+    const char *getKey(uint64_t Index) {
+      std::string &Key = Keys[Index];
+      if (Key.empty())
+        Key = Strings[Index].str();
+      return Key.c_str();
+    }
+
+    bool readStringTable();
+
+    bool readEntries();
+
+    bool convertNode(yaml::Output &Out, unsigned Depth);
+
+    /// convertHeader - Replay the leading scalar keys of a document into the
+    /// current mapping.
+    bool convertHeader(yaml::Output &Out, uint64_t Document);
+
+  public:
+    PMLBinaryReader(StringRef buffer)
+    : Buffer(buffer), Index(0), HasEntries(false), Pos(nullptr), End(nullptr)
+    {}
+
+    const std::string &getError() const { return Error; }
+
+    const EntryMap &getEntries() const { return Entries; }
+
+    bool hasEntries() const { return HasEntries; }
+
+    /// readIndex - Check the header and decode the index.
+    bool readIndex();
+
+    /// convert - Write all documents.
+    bool convert(raw_ostream &OS);
+
+    /// convertEntries - Write the entries of the given list and name as a
+    /// single document.
+    bool convertEntries(StringRef List, StringRef Name, raw_ostream &OS);
+  };
+}
+
+bool PMLBinaryReader::readStringTable()
+{
+  uint64_t Count;
+  if (!readULEB128(Count))
+    return false;
+  // every string takes at least one byte
+  if (Count > (uint64_t)(End - Pos))
+    return fail("invalid string table size");
+
+  Strings.reserve(Count);
+  for(uint64_t i = 0; i < Count; i++) {
+    uint64_t Length;
+    if (!readULEB128(Length))
+      return false;
+    if (Length > (uint64_t)(End - Pos))
+      return fail("string " + Twine(i) + " out of bounds");
+    Strings.push_back(StringRef((const char*)Pos, Length));
+    Pos += Length;
+  }
+  return true;
+}
+
+bool PMLBinaryReader::readEntries()
+{
+  uint64_t Count;
+  if (!readULEB128(Count))
+    return false;
+  // every entry takes at least four bytes
+  if (Count > (uint64_t)(End - Pos) / 4)
+    return fail("invalid entry table size");
+
+  for(uint64_t i = 0; i < Count; i++) {
+    uint64_t List, Name, Document, Offset;
+    if (!readStringIndex(List, false) || !readStringIndex(Name, false) ||
+        !readULEB128(Document) || !readULEB128(Offset))
+      return false;
+    if (Document >= Documents.size() || Offset < Documents[Document] ||
+        Offset >= Index)
+      return fail("entry " + Twine(i) + " out of bounds");
+    // an element whose name and mapsto are the same is listed once
+    std::vector<std::pair<uint64_t, uint64_t> > &Found =
+                      Entries[std::make_pair(Strings[List], Strings[Name])];
+    if (Found.empty() || Found.back().second != Offset)
+      Found.push_back(std::make_pair(Document, Offset));
+  }
+  return true;
+}
+
+bool PMLBinaryReader::convertNode(yaml::Output &Out, unsigned Depth)
+{
+  if (Depth > PMLBinaryMaxDepth)
+    return fail("nodes nested too deeply");
+  if (Pos == End)
+    return fail("unexpected end of document");
+
+  PMLBinaryOutput::NodeKind Kind = (PMLBinaryOutput::NodeKind)*Pos++;
+  void *SaveInfo;
+  uint64_t Value;
+
+  switch (Kind) {
+  case PMLBinaryOutput::Map:
+  case PMLBinaryOutput::FlowMap:
+    if (Kind == PMLBinaryOutput::Map)
+      Out.beginMapping();
+    else
+      Out.beginFlowMapping();
+    while (true) {
+      if (!readStringIndex(Value, true))
+        return false;
+      if (Value == 0)
+        break;
+      bool UseDefault;
+      Out.preflightKey(getKey(Value - 1), true, false, UseDefault, SaveInfo);
+      if (!convertNode(Out, Depth + 1))
+        return false;
+      Out.postflightKey(SaveInfo);
+    }
+    if (Kind == PMLBinaryOutput::Map)
+      Out.endMapping();
+    else
+      Out.endFlowMapping();
+    return true;
+
+  case PMLBinaryOutput::Seq:
+  case PMLBinaryOutput::FlowSeq: {
+    bool Flow = Kind == PMLBinaryOutput::FlowSeq;
+    if (Flow)
+      Out.beginFlowSequence();
+    else
+      Out.beginSequence();
+    for(unsigned i = 0; ; i++) {
+      if (Pos == End)
+        return fail("unterminated sequence");
+      if (*Pos == PMLBinaryOutput::End) {
+        Pos++;
+        break;
+      }
+      if (Flow)
+        Out.preflightFlowElement(i, SaveInfo);
+      else
+        Out.preflightElement(i, SaveInfo);
+      if (!convertNode(Out, Depth + 1))
+        return false;
+      if (Flow)
+        Out.postflightFlowElement(SaveInfo);
+      else
+        Out.postflightElement(SaveInfo);
+    }
+    if (Flow)
+      Out.endFlowSequence();
+    else
+      Out.endSequence();
+    return true;
+  }
+
+  case PMLBinaryOutput::Plain:
+  case PMLBinaryOutput::Single:
+  case PMLBinaryOutput::Double:
+  case PMLBinaryOutput::Block:
+  case PMLBinaryOutput::Enum: {
+    if (!readStringIndex(Value, false))
+      return false;
+    StringRef S(Strings[Value]);
+    if (Kind == PMLBinaryOutput::Block) {
+      Out.blockScalarString(S);
+    } else if (Kind == PMLBinaryOutput::Enum) {
+      Out.beginEnumScalar();
+      Out.matchEnumScalar(getKey(Value), true);
+      Out.endEnumScalar();
+    } else {
+      Out.scalarString(S, Kind == PMLBinaryOutput::Plain ?
+                                                   yaml::QuotingType::None :
+                          Kind == PMLBinaryOutput::Single ?
+                                                   yaml::QuotingType::Single :
+                                                   yaml::QuotingType::Double);
+    }
+    return true;
+  }
+
+  case PMLBinaryOutput::BitSet: {
+    bool DoClear;
+    Out.beginBitSetScalar(DoClear);
+    while (true) {
+      if (!readStringIndex(Value, true))
+        return false;
+      if (Value == 0)
+        break;
+      Out.bitSetMatch(getKey(Value - 1), true);
+    }
+    Out.endBitSetScalar();
+    return true;
+  }
+
+  case PMLBinaryOutput::UInt:
+  case PMLBinaryOutput::SInt: {
+    if (!readULEB128(Value))
+      return false;
+    std::string Str = Kind == PMLBinaryOutput::UInt ? utostr(Value) :
+                      itostr((int64_t)(Value >> 1) ^ -(int64_t)(Value & 1));
+    StringRef S(Str);
+    Out.scalarString(S, yaml::QuotingType::None);
+    return true;
+  }
+
+  default:
+    return fail("invalid node kind " + Twine((unsigned)Kind));
+  }
+}
+
+bool PMLBinaryReader::convertHeader(yaml::Output &Out, uint64_t Document)
+{
+  if (!seek(Documents[Document], Index))
+    return false;
+  if (Pos == End || *Pos++ != PMLBinaryOutput::Map)
+    return fail("invalid document " + Twine(Document));
+
+  while (true) {
+    const uint8_t *Key = Pos;
+    uint64_t Value;
+    if (!readStringIndex(Value, true))
+      return false;
+    if (Value == 0 || Pos == End)
+      break;
+
+    PMLBinaryOutput::NodeKind Kind = (PMLBinaryOutput::NodeKind)*Pos;
+    if (Kind < PMLBinaryOutput::Plain || Kind == PMLBinaryOutput::BitSet) {
+      Pos = Key;
+      break;
+    }
+
+    void *SaveInfo;
+    bool UseDefault;
+    Out.preflightKey(getKey(Value - 1), true, false, UseDefault, SaveInfo);
+    if (!convertNode(Out, 1))
+      return false;
+    Out.postflightKey(SaveInfo);
+  }
+  return true;
+}
+
+bool PMLBinaryReader::readIndex()
+{
+  if (Buffer.size() < PMLBinaryHeaderSize + PMLBinaryTrailerSize ||
+      !isPMLBinary(Buffer))
+    return fail("not a binary PML file");
+
+  uint32_t Version = support::endian::read32le(Buffer.bytes_begin() + 4);
+  if (Version == 0 || Version > PMLBinaryVersion)
+    return fail("unsupported binary PML version " + Twine(Version));
+
+  uint64_t IndexEnd = Buffer.size() - PMLBinaryTrailerSize;
+  Index = support::endian::read64le(Buffer.bytes_begin() + IndexEnd);
+  if (Index < PMLBinaryHeaderSize || !seek(Index, IndexEnd))
+    return fail("invalid index offset");
+
+  uint64_t NumDocuments;
+  if (!readULEB128(NumDocuments))
+    return false;
+  // every offset takes at least one byte
+  if (NumDocuments > (uint64_t)(End - Pos))
+    return fail("invalid number of documents");
+  Documents.resize(NumDocuments);
+  for(uint64_t i = 0; i < NumDocuments; i++) {
+    if (!readULEB128(Documents[i]))
+      return false;
+    if (Documents[i] < PMLBinaryHeaderSize || Documents[i] >= Index)
+      return fail("invalid document offset");
+  }
+  if (!readStringTable())
+    return false;
+
+  // version 1 files have no entry table
+  HasEntries = Version >= 2;
+  if (HasEntries && !readEntries())
+    return false;
+  return true;
+}
+
+bool PMLBinaryReader::convert(raw_ostream &OS)
+{
+  if (!readIndex())
+    return false;
+
+  yaml::Output Out(OS);
+  for(uint64_t i = 0, e = Documents.size(); i < e; i++) {
+    if (!seek(Documents[i], Index))
+      return false;
+
+    // the exporters write each document on its own
+    Out.beginDocuments();
+    if (Out.preflightDocument(0)) {
+      if (!convertNode(Out, 0))
+        return false;
+      Out.postflightDocument();
+    }
+    Out.endDocuments();
+  }
+  return true;
+}
+
+bool PMLBinaryReader::convertEntries(StringRef List, StringRef Name,
+                                     raw_ostream &OS)
+{
+  EntryMap::const_iterator E = Entries.find(std::make_pair(List, Name));
+  if (E == Entries.end())
+    return true;
+
+  yaml::Output Out(OS);
+  std::string ListKey(List);
+  void *SaveInfo;
+  bool UseDefault;
+
+  Out.beginDocuments();
+  if (Out.preflightDocument(0)) {
+    Out.beginMapping();
+    if (!convertHeader(Out, E->second.front().first))
+      return false;
+
+    Out.preflightKey(ListKey.c_str(), true, false, UseDefault, SaveInfo);
+    Out.beginSequence();
+    for(unsigned i = 0, e = E->second.size(); i < e; i++) {
+      void *ElementInfo;
+      Out.preflightElement(i, ElementInfo);
+      if (!seek(E->second[i].second, Index) || !convertNode(Out, 2))
+        return false;
+      Out.postflightElement(ElementInfo);
+    }
+    Out.endSequence();
+    Out.postflightKey(SaveInfo);
+
+    Out.endMapping();
+    Out.postflightDocument();
+  }
+  Out.endDocuments();
+  return true;
+}
+
+bool llvm::convertPMLBinaryToYAML(StringRef Buffer, raw_ostream &OS,
+                                  std::string &Error)
+{
+  PMLBinaryReader Reader(Buffer);
+  if (Reader.convert(OS))
+    return true;
+  Error = Reader.getError();
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+PMLBinaryFile::PMLBinaryFile(std::unique_ptr<MemoryBuffer> buffer)
+: Buffer(std::move(buffer)), Reader(new PMLBinaryReader(Buffer->getBuffer()))
+{
+}
+
+PMLBinaryFile::~PMLBinaryFile()
+{
+}
+
+std::unique_ptr<PMLBinaryFile> PMLBinaryFile::open(StringRef Filename,
+                                                   std::string &Error)
+{
+  // large files are mapped rather than read
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer =
+                MemoryBuffer::getFile(Filename, -1, /*RequiresNullTerminator*/
+                                      false);
+  if (std::error_code EC = Buffer.getError()) {
+    Error = EC.message();
+    return nullptr;
+  }
+  return create(std::move(*Buffer), Error);
+}
+
+std::unique_ptr<PMLBinaryFile>
+PMLBinaryFile::create(std::unique_ptr<MemoryBuffer> Buffer,
+                      std::string &Error)
+{
+  std::unique_ptr<PMLBinaryFile> File(new PMLBinaryFile(std::move(Buffer)));
+  if (!File->Reader->readIndex()) {
+    Error = File->Reader->getError();
+    return nullptr;
+  }
+  if (!File->Reader->hasEntries()) {
+    Error = "binary PML file has no entry table";
+    return nullptr;
+  }
+  return File;
+}
+
+bool PMLBinaryFile::contains(StringRef List, StringRef Name) const
+{
+  return Reader->getEntries().count(std::make_pair(List, Name));
+}
+
+bool PMLBinaryFile::lookup(StringRef List, StringRef Name, raw_ostream &OS,
+                           std::string &Error)
+{
+  if (Reader->convertEntries(List, Name, OS))
+    return true;
+  Error = Reader->getError();
+  return false;
+}
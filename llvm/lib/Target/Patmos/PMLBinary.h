@@ -0,0 +1,214 @@
+//===-- PMLBinary.h - Binary encoding of PML documents. -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A compact alternative to the YAML serialization of PML documents. The
+// encoder is a yaml::IO, so it serializes the PML.h schema through the same
+// MappingTraits as yaml::Output, and the result can be converted back into
+// exactly the YAML text yaml::Output would have written.
+//
+// File layout (fixed-width fields are little endian):
+//
+//   char[4]  magic "PMLB"
+//   uint32   format version
+//   ...      the documents, one node each
+//   ...      the index: ULEB128 number of documents, the ULEB128 offset of
+//            each document, then the string table: ULEB128 count, and for
+//            each string its ULEB128 length and its bytes, then the entry
+//            table (since version 2): ULEB128 count, and for each entry the
+//            ULEB128 string indices of its list and its name, its ULEB128
+//            document number and the ULEB128 offset of its node
+//   uint64   offset of the index
+//
+// The index is written last, such that documents can be streamed out as
+// soon as they are complete.
+//
+// Entries are the elements of the lists at the top level of a document, e.g.,
+// the machine functions, that are mappings with a "name" or "mapsto" scalar.
+// An element is indexed under both, such that the entries of a function can
+// be found by its name without decoding the other documents.
+//
+// A node is a kind byte followed by its contents:
+//
+//   Map, FlowMap   pairs (ULEB128 key string + 1, node), terminated by a 0
+//   Seq, FlowSeq   nodes, terminated by an End byte
+//   Plain, Single, Double, Block, Enum
+//                  ULEB128 string index; the kind retains the quoting
+//   BitSet         ULEB128 string indices + 1, terminated by a 0
+//   UInt, SInt     ULEB128 value, zig-zag encoded for SInt; used for plain
+//                  scalars in canonical decimal notation
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOS_PMLBINARY_H_
+#define _LLVM_TARGET_PATMOS_PMLBINARY_H_
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/YAMLTraits.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+  /// Current version of the binary PML format.
+  const unsigned PMLBinaryVersion = 2;
+
+  /// isPMLBinary - Check whether Buffer starts with the binary PML magic.
+  bool isPMLBinary(StringRef Buffer);
+
+  /// convertPMLBinaryToYAML - Write the documents of a binary PML file to OS
+  /// in YAML format. Returns false and sets Error if the input is malformed.
+  bool convertPMLBinaryToYAML(StringRef Buffer, raw_ostream &OS,
+                              std::string &Error);
+
+  /// Encoder for PML documents. Documents are written to the output stream
+  /// as they are streamed in using operator<<, finish() writes the index.
+  class PMLBinaryOutput : public yaml::IO {
+  public:
+    enum NodeKind {
+      End, Map, FlowMap, Seq, FlowSeq, Plain, Single, Double, Block, Enum,
+      BitSet, UInt, SInt
+    };
+
+  private:
+    raw_ostream &OS;
+
+    /// The position of the file in OS, and the offsets of the documents.
+    uint64_t Start;
+    std::vector<uint64_t> Documents;
+
+    /// Interned strings, by index of first occurrence.
+    StringMap<unsigned> StringIDs;
+    std::vector<StringRef> Strings;
+
+    /// Open containers, to decide on eliding empty sequences the way
+    /// yaml::Output does.
+    enum State { InMapFirstKey, InMapOtherKey, InSeq, InFlow };
+    SmallVector<State, 16> StateStack;
+
+    bool EnumerationMatchFound;
+
+    /// An element of a top-level list, by the string indices of the list
+    /// key and of the element's name.
+    struct IndexEntry {
+      unsigned List, Name;
+      uint64_t Document, Offset;
+    };
+    std::vector<IndexEntry> Entries;
+
+    /// The key of the current top-level list, the start of the current
+    /// element, and the key of the element that is written.
+    StringRef ListKey;
+    uint64_t ElementOffset;
+    const char *ElementKey;
+
+    void writeKind(NodeKind Kind) { OS << (char)Kind; }
+
+    void writeString(StringRef S, NodeKind Kind);
+    void writeULEB128(uint64_t Value);
+
+    unsigned intern(StringRef S);
+
+  public:
+    PMLBinaryOutput(raw_ostream &os, void *Ctxt = nullptr);
+    ~PMLBinaryOutput() override;
+
+    void beginDocument();
+    void endDocument();
+
+    /// finish - Write the index, after the last document.
+    void finish();
+
+    bool outputting() const override { return true; }
+    bool mapTag(StringRef, bool) override;
+    void beginMapping() override;
+    void endMapping() override;
+    bool preflightKey(const char *Key, bool Required, bool SameAsDefault,
+                      bool &UseDefault, void *&) override;
+    void postflightKey(void *) override;
+    std::vector<StringRef> keys() override;
+    void beginFlowMapping() override;
+    void endFlowMapping() override;
+    unsigned beginSequence() override;
+    void endSequence() override;
+    bool preflightElement(unsigned, void *&) override;
+    void postflightElement(void *) override {}
+    unsigned beginFlowSequence() override;
+    void endFlowSequence() override;
+    bool preflightFlowElement(unsigned, void *&) override { return true; }
+    void postflightFlowElement(void *) override {}
+    void beginEnumScalar() override { EnumerationMatchFound = false; }
+    bool matchEnumScalar(const char *Str, bool Match) override;
+    bool matchEnumFallback() override;
+    void endEnumScalar() override;
+    bool beginBitSetScalar(bool &DoClear) override;
+    bool bitSetMatch(const char *Str, bool Matches) override;
+    void endBitSetScalar() override;
+    void scalarString(StringRef &S, yaml::QuotingType MustQuote) override;
+    void blockScalarString(StringRef &S) override;
+    void scalarTag(std::string &Tag) override;
+    yaml::NodeKind getNodeKind() override;
+    void setError(const Twine &message) override {}
+    bool canElideEmptySequence() override;
+  };
+
+  class PMLBinaryReader;
+
+  /// Random access to the entries of a binary PML file, e.g., to the facts
+  /// of a single function. The file is mapped into memory, opening it only
+  /// decodes the index, entries are decoded when they are looked up.
+  class PMLBinaryFile {
+    std::unique_ptr<MemoryBuffer> Buffer;
+    std::unique_ptr<PMLBinaryReader> Reader;
+
+    PMLBinaryFile(std::unique_ptr<MemoryBuffer> Buffer);
+
+  public:
+    ~PMLBinaryFile();
+
+    /// open - Map a binary PML file and read its index. Returns NULL and
+    /// sets Error if the file cannot be read, is malformed, or has no entry
+    /// table.
+    static std::unique_ptr<PMLBinaryFile> open(StringRef Filename,
+                                               std::string &Error);
+
+    /// create - Read the index of the binary PML file in Buffer.
+    static std::unique_ptr<PMLBinaryFile>
+    create(std::unique_ptr<MemoryBuffer> Buffer, std::string &Error);
+
+    /// contains - Check whether any document has an entry of the given name
+    /// in its list List.
+    bool contains(StringRef List, StringRef Name) const;
+
+    /// lookup - Write the entries of the given name in the lists List to OS,
+    /// as a YAML document holding the list, after the scalars heading the
+    /// document of the first entry, i.e., the format and the triple. Nothing
+    /// is written if there are no such entries. Returns false and sets Error
+    /// if an entry is malformed.
+    bool lookup(StringRef List, StringRef Name, raw_ostream &OS,
+                std::string &Error);
+  };
+
+  /// Encode a document, in the same way as yaml::Output's operator<< does.
+  template <typename T>
+  inline std::enable_if_t<
+      yaml::has_MappingTraits<T, yaml::EmptyContext>::value, PMLBinaryOutput &>
+  operator<<(PMLBinaryOutput &Out, T &Doc) {
+    yaml::EmptyContext Ctx;
+    Out.beginDocument();
+    yaml::yamlize(Out, Doc, true, Ctx);
+    Out.endDocument();
+    return Out;
+  }
+}
+
+#endif // _LLVM_TARGET_PATMOS_PMLBINARY_H_
@@ -29,10 +29,14 @@
 #include "llvm/CodeGen/PseudoSourceValue.h"
 #include "llvm/CodeGen/MachineDominators.h"
 #include "llvm/IR/CFG.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/CodeGen/TargetInstrInfo.h"
+#include "PMLBinary.h"
 #include "PMLExport.h"
+#include "PatmosRegionTimer.h"
 
 using namespace llvm;
 
@@ -43,6 +47,30 @@ STATISTIC( NumAnnotatedBounds,
 
 STATISTIC( NumMemExp,   "Number of exported load from array infos");
 
+namespace {
+  enum PMLFormat { PMLYAML, PMLBinary };
+}
+
+static cl::opt<PMLFormat> PMLExportFormat("mpatmos-serialize-format",
+  cl::init(PMLYAML),
+  cl::desc("Format of the exported PML file"),
+  cl::values(
+    clEnumValN(PMLYAML,   "yaml",   "YAML documents (default)"),
+    clEnumValN(PMLBinary, "binary", "Binary PML, see PMLBinary.h")));
+
+static cl::opt<bool> PMLExportStreaming("mpatmos-serialize-streaming",
+  cl::init(false),
+  cl::desc("Write the PML of each function as soon as it is exported and "
+           "free it afterwards, instead of keeping the PML of the whole "
+           "program in memory"),
+  cl::Hidden);
+
+static cl::opt<unsigned> PMLExportThreads("mpatmos-serialize-threads",
+  cl::init(1),
+  cl::desc("Number of threads building the relation graphs of the PML "
+           "export (0: use all hardware threads)"),
+  cl::Hidden);
+
 
 /// Unfortunately, the interface for accessing successors differs
 /// between machine block and bitcode block, therefore we need this
@@ -353,11 +381,33 @@ void PMLBitcodeExport::exportInstruction(yaml::Instruction* I,
 
 
 
-void PMLMachineExport::serialize(MachineFunction &MF)
+struct PMLMachineAnalyses::FunctionAnalyses {
+  MachineDominatorTree MDT;
+  MachineLoopInfo MLI;
+
+  FunctionAnalyses(MachineFunction &MF) : MDT(MF), MLI(MDT) {}
+};
+
+MachineLoopInfo &PMLMachineAnalyses::getLoopInfo(MachineFunction &MF)
 {
+  FunctionAnalyses *&FA = Functions[&MF];
+  if (!FA)
+    FA = new FunctionAnalyses(MF);
+  return FA->MLI;
+}
 
-  MachineDominatorTree MDT(MF);
-  MachineLoopInfo MLI(MDT);
+void PMLMachineAnalyses::clear()
+{
+  for (auto &F : Functions)
+    delete F.second;
+  Functions.clear();
+}
+
+
+void PMLMachineExport::serialize(MachineFunction &MF)
+{
+  assert(Analyses && "Exporter not added to an export pass");
+  MachineLoopInfo &MLI = Analyses->getLoopInfo(MF);
 
   yaml::PMLMachineFunction *PMF =
      new yaml::PMLMachineFunction(MF.getFunctionNumber());
@@ -383,6 +433,8 @@ void PMLMachineExport::serialize(MachineFunction &MF)
 
     B->MapsTo = BB->getName().str();
 
+    exportBlock(MF, B, *BB);
+
     // export loop information
     MachineLoop *Loop = MLI.getLoopFor(&*BB);
     if (Loop && Loop->getHeader() == &*BB) {
@@ -906,11 +958,61 @@ void addProgressNodes(yaml::RelationGraph *RG,
 }
 
 
+PMLRelationGraphExport::PMLRelationGraphExport(TargetMachine &TM,
+                                               ModulePass &mp)
+  : YDoc("ERROR(PMLRelationGraphExport)", TM.getTargetTriple().getTriple()),
+    P(mp)
+{
+  if (PMLExportThreads != 1)
+    Threads.reset(new ThreadPool(hardware_concurrency(PMLExportThreads)));
+}
+
+PMLRelationGraphExport::~PMLRelationGraphExport()
+{
+  collectPending();
+}
+
 void PMLRelationGraphExport::serialize(MachineFunction &MF)
+{
+  // the loops are computed here, the workers only read them
+  assert(Analyses && "Exporter not added to an export pass");
+  MachineLoopInfo &MLI = Analyses->getLoopInfo(MF);
+
+  if (!Threads) {
+    PatmosRegionTimer T("pml-relation-graph", "PML relation graph construction");
+    if (yaml::RelationGraph *RG = buildRelationGraph(MF, MLI))
+      YDoc.addRelationGraph(RG);
+    return;
+  }
+
+  Pending.push_back(0);
+  yaml::RelationGraph *&Slot = Pending.back();
+  Threads->async([this, &MF, &MLI, &Slot]() {
+    Slot = buildRelationGraph(MF, MLI);
+  });
+}
+
+void PMLRelationGraphExport::collectPending()
+{
+  if (Pending.empty())
+    return;
+
+  Threads->wait();
+  for (std::list<yaml::RelationGraph*>::iterator i = Pending.begin(),
+       ie = Pending.end(); i != ie; ++i) {
+    if (*i)
+      YDoc.addRelationGraph(*i);
+  }
+  Pending.clear();
+}
+
+yaml::RelationGraph *
+PMLRelationGraphExport::buildRelationGraph(MachineFunction &MF,
+                                           MachineLoopInfo &MLI)
 {
   auto &BF = MF.getFunction();
   if (MF.empty())
-    return;
+    return 0;
 
   // unmatched events, used as tabu list, and for error reporting
   std::set<StringRef> TabuEvents;
@@ -946,7 +1048,7 @@ void PMLRelationGraphExport::serialize(MachineFunction &MF)
     std::vector<std::pair<ProgressID, yaml::RelationNode*> > RTodo;
 
     // Build event maps using RUnmatched as tabu list
-    buildEventMaps(MF, IEventMap, MEventMap, TabuEvents);
+    buildEventMaps(MF, MLI, IEventMap, MEventMap, TabuEvents);
 
     // We first queue the entry node
     RTodo.push_back(
@@ -999,16 +1101,15 @@ void PMLRelationGraphExport::serialize(MachineFunction &MF)
     Status = yaml::rg_status_incomplete;
   }
   RG->Status = Status;
-  YDoc.addRelationGraph(RG);
+  return RG;
 }
 
 void PMLRelationGraphExport::buildEventMaps(MachineFunction &MF,
+      MachineLoopInfo &MLI,
       std::map<const BasicBlock*, StringRef> &BitcodeEventMap,
       std::map<MachineBasicBlock*, StringRef> &MachineEventMap,
       std::set<StringRef> &TabuList)
 {
-  MachineDominatorTree MDT(MF);
-  MachineLoopInfo MLI(MDT);
   BackedgeInfo BI(MLI);
 
   BitcodeEventMap.clear();
@@ -1090,13 +1191,15 @@ PMLModuleExportPass::PMLModuleExportPass(char &id, TargetMachine &TM,
                                          StringRef filename,
                                          ArrayRef<std::string> roots,
                                          bool SerializeAll)
-  : ModulePass(id), PII(0), OutFileName(filename), Roots(roots), SerializeAll(SerializeAll)
+  : ModulePass(id), PII(0), OutFileName(filename), OutFile(0), YAMLOutput(0),
+    BinaryOutput(0), Roots(roots), SerializeAll(SerializeAll)
 {
 }
 
 PMLModuleExportPass::PMLModuleExportPass(TargetMachine &TM, StringRef filename,
                               ArrayRef<std::string> roots, PMLInstrInfo *pii, bool SerializeAll)
-  : ModulePass(ID), PII(pii), OutFileName(filename), Roots(roots), SerializeAll(SerializeAll)
+  : ModulePass(ID), PII(pii), OutFileName(filename), OutFile(0),
+    YAMLOutput(0), BinaryOutput(0), Roots(roots), SerializeAll(SerializeAll)
 {
 }
 
@@ -1115,6 +1218,9 @@ bool PMLModuleExportPass::runOnModule(Module &M)
 
   FoundFunctions.clear();
   Queue.clear();
+
+  if (PMLExportStreaming && !openOutput())
+    return false;
   if (SerializeAll) {
     // Queue all functions
     for (Module::const_iterator it = M.begin(); it != M.end(); ++it) {
@@ -1143,17 +1249,28 @@ bool PMLModuleExportPass::runOnModule(Module &M)
       Exporters[i]->serialize(*MF);
     }
 
+    if (PMLExportStreaming)
+      writeOutput(true);
+
     addCalleesToQueue(M, MMI, *MF);
   }
 
   return false;
 }
 
+PMLInstrInfo::MFList
+PMLModuleExportPass::getCalledFunctions(const Module &M,
+                                        MachineModuleInfo &MMI,
+                                        MachineFunction &MF)
+{
+  return PII->getCalledFunctions(M, MMI, MF);
+}
+
 void PMLModuleExportPass::addCalleesToQueue(const Module &M,
                                             MachineModuleInfo &MMI,
                                             MachineFunction &MF)
 {
-  PMLInstrInfo::MFList Callees = PII->getCalledFunctions(M, MMI, MF);
+  PMLInstrInfo::MFList Callees = getCalledFunctions(M, MMI, MF);
   for (PMLInstrInfo::MFList::iterator it = Callees.begin(), ie = Callees.end();
        it != ie; ++it)
   {
@@ -1173,46 +1290,83 @@ bool PMLModuleExportPass::doInitialization(Module &M) {
 }
 
 bool PMLModuleExportPass::doFinalization(Module &M) {
-  ToolOutputFile *OutFile;
-  yaml::Output *Output;
+  // in streaming mode, the file has been opened for the first function
+  if (OutFile || openOutput()) {
+    for (ExportList::iterator it = Exporters.begin(), ie = Exporters.end();
+         it != ie; ++it)
+    {
+      (*it)->finalize(M);
+    }
+    writeOutput(PMLExportStreaming);
+    closeOutput();
+  }
+
+  if (!BitcodeFile.empty()) {
+    std::error_code ErrorInfo;
+    ToolOutputFile BitcodeStream(BitcodeFile, ErrorInfo, sys::fs::OpenFlags::OF_None);
+    WriteBitcodeToFile(M, BitcodeStream.os());
+    if(ErrorInfo) {
+      errs() << "[mc2yml] Writing Bitcode File " << BitcodeFile << " failed: "
+        << ErrorInfo.value() <<" \n";
+    } else {
+      BitcodeStream.keep();
+    }
+  }
+  return false;
+}
+
+bool PMLModuleExportPass::openOutput() {
   std::error_code ErrorInfo;
 
   OutFile = new ToolOutputFile(OutFileName, ErrorInfo, sys::fs::OpenFlags::OF_None);
   if (ErrorInfo) {
     delete OutFile;
+    OutFile = 0;
     errs() << "[mc2yml] Opening Export File failed: " << OutFileName << "\n";
     errs() << "[mc2yml] Reason: " << ErrorInfo.value();
     return false;
   }
-  else {
-    Output = new yaml::Output(OutFile->os());
+
+  if (PMLExportFormat == PMLBinary) {
+    BinaryOutput = new PMLBinaryOutput(OutFile->os());
+  } else {
+    YAMLOutput = new PMLYAMLOutput(OutFile->os());
   }
+  return true;
+}
 
+void PMLModuleExportPass::writeOutput(bool SkipEmpty) {
   for (ExportList::iterator it = Exporters.begin(), ie = Exporters.end();
        it != ie; ++it)
   {
-    (*it)->finalize(M);
-    (*it)->writeOutput(Output);
-  }
-
-  if (OutFile) {
-    OutFile->keep();
-    delete Output;
-    delete OutFile;
-  }
+    if (SkipEmpty && (*it)->empty())
+      continue;
 
-  if (!BitcodeFile.empty()) {
-    std::error_code ErrorInfo;
-    ToolOutputFile BitcodeStream(BitcodeFile, ErrorInfo, sys::fs::OpenFlags::OF_None);
-    WriteBitcodeToFile(M, BitcodeStream.os());
-    if(ErrorInfo) {
-      errs() << "[mc2yml] Writing Bitcode File " << BitcodeFile << " failed: "
-        << ErrorInfo.value() <<" \n";
+    if (BinaryOutput) {
+      (*it)->writeOutput(BinaryOutput);
     } else {
-      BitcodeStream.keep();
+      (*it)->writeOutput(YAMLOutput);
     }
+    (*it)->clear();
   }
-  return false;
+
+  // the workers of all exporters are done
+  Analyses.clear();
+}
+
+void PMLModuleExportPass::closeOutput() {
+  if (BinaryOutput) {
+    BinaryOutput->finish();
+    delete BinaryOutput;
+    BinaryOutput = 0;
+  }
+  if (YAMLOutput) {
+    delete YAMLOutput;
+    YAMLOutput = 0;
+  }
+  OutFile->keep();
+  delete OutFile;
+  OutFile = 0;
 }
 
 void PMLModuleExportPass::addToQueue(const Module &M, MachineModuleInfo &MMI,
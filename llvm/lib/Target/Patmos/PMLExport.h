@@ -11,6 +11,8 @@
 #define LLVM_CODEGEN_PML_EXPORT_H_
 
 #include "PML.h"
+#include "PMLBinary.h"
+#include "PMLYAML.h"
 #include "PatmosTargetMachine.h"
 #include "llvm/IR/Module.h"
 #include "llvm/ADT/StringRef.h"
@@ -20,6 +22,7 @@
 #include "llvm/CodeGen/MachineLoopInfo.h"
 
 #include <list>
+#include <map>
 
 /////////////////
 /// PML Export //
@@ -28,6 +31,7 @@
 namespace llvm {
 
   class MachineLoop;
+  class ThreadPool;
 
   /// Provides information about machine instructions, can be overloaded for
   /// specific targets.
@@ -68,11 +72,35 @@ namespace llvm {
     virtual int getSize(const MachineInstr *Instr);
   };
 
+  /// Machine-level analyses of the exported functions, computed once per
+  /// function and shared by the exporters. They are only computed by the
+  /// thread running the export pass, workers only read the results they are
+  /// handed.
+  class PMLMachineAnalyses {
+    struct FunctionAnalyses;
+
+    std::map<const MachineFunction*, FunctionAnalyses*> Functions;
+
+  public:
+    ~PMLMachineAnalyses() { clear(); }
+
+    /// getLoopInfo - Return the loops of a function, computed on first use.
+    MachineLoopInfo &getLoopInfo(MachineFunction &MF);
+
+    /// clear - Free the analyses, once no exporter refers to them anymore.
+    void clear();
+  };
+
   /// Base class for all exporters
   class PMLExport {
+  protected:
+    /// The analyses shared by the exporters of the export pass.
+    PMLMachineAnalyses *Analyses;
 
   public:
-    PMLExport() {}
+    PMLExport() : Analyses(0) {}
+
+    void setAnalyses(PMLMachineAnalyses *A) { Analyses = A; }
 
     virtual ~PMLExport() {}
 
@@ -82,7 +110,15 @@ namespace llvm {
 
     virtual void serialize(MachineFunction &MF) =0;
 
-    virtual void writeOutput(yaml::Output *Output) =0;
+    virtual void writeOutput(PMLYAMLOutput *Output) =0;
+
+    virtual void writeOutput(PMLBinaryOutput *Output) =0;
+
+    /// Check whether nothing has been exported since the last clear().
+    virtual bool empty() =0;
+
+    /// Free everything exported so far, after it has been written.
+    virtual void clear() =0;
   };
 
 
@@ -116,10 +152,18 @@ namespace llvm {
     // export module-level information during finalize()
     virtual void finalize(const Module &M) { }
 
-    virtual void writeOutput(yaml::Output *Output) {
+    virtual void writeOutput(PMLYAMLOutput *Output) {
+      auto *DocPtr = &YDoc; *Output << DocPtr;
+    }
+
+    virtual void writeOutput(PMLBinaryOutput *Output) {
       auto *DocPtr = &YDoc; *Output << DocPtr;
     }
 
+    virtual bool empty() { return YDoc.empty(); }
+
+    virtual void clear() { YDoc.clear(); }
+
     yaml::PMLDoc<yaml::BitcodeFunction,yaml::StringValue>& getPMLDoc() { return YDoc; }
 
     virtual bool doExportInstruction(const Instruction* Instr) {
@@ -162,11 +206,19 @@ namespace llvm {
 
     virtual void serialize(MachineFunction &MF);
 
-    virtual void writeOutput(yaml::Output *Output) {
+    virtual void writeOutput(PMLYAMLOutput *Output) {
     	yaml::PMLDoc<yaml::PMLMachineFunction,yaml::UnsignedValue> *DocPtr = &YDoc;
     	*Output << DocPtr;
     }
 
+    virtual void writeOutput(PMLBinaryOutput *Output) {
+      auto *DocPtr = &YDoc; *Output << DocPtr;
+    }
+
+    virtual bool empty() { return YDoc.empty(); }
+
+    virtual void clear() { YDoc.clear(); }
+
     yaml::PMLDoc<yaml::PMLMachineFunction,yaml::UnsignedValue>& getPMLDoc() { return YDoc; }
 
     virtual bool doExportInstruction(const MachineInstr *Instr) {
@@ -175,6 +227,8 @@ namespace llvm {
 
     virtual yaml::StringValue getOpcode(const MachineInstr *Instr);
 
+    virtual void exportBlock(MachineFunction &MF, yaml::MachineBlock *B,
+                             const MachineBasicBlock &MBB) { }
     virtual void exportInstruction(MachineFunction &MF,
                                    yaml::MachineInstruction *I,
                                    const MachineInstr *Instr,
@@ -206,31 +260,60 @@ namespace llvm {
     yaml::PMLDoc<yaml::BitcodeFunction,yaml::StringValue> YDoc;
     Pass &P;
 
+    /// Workers building relation graphs, if enabled.
+    std::unique_ptr<ThreadPool> Threads;
+
+    /// Relation graphs under construction by the workers, in the order of
+    /// the serialize calls. The list keeps the slots of running workers
+    /// valid while new ones are added.
+    std::list<yaml::RelationGraph*> Pending;
+
   public:
-    PMLRelationGraphExport(TargetMachine &TM, ModulePass &mp)
-      : YDoc("ERROR(PMLRelationGraphExport)", TM.getTargetTriple().getTriple()), P(mp) {}
+    PMLRelationGraphExport(TargetMachine &TM, ModulePass &mp);
 
-    virtual ~PMLRelationGraphExport() {}
+    virtual ~PMLRelationGraphExport();
 
     /// Build the Control-Flow Relation Graph connection between
     /// machine code and bitcode
     virtual void serialize(MachineFunction &MF);
 
-    virtual void writeOutput(yaml::Output *Output) {
+    virtual void writeOutput(PMLYAMLOutput *Output) {
+      collectPending();
     	auto *DocPtr = &YDoc; *Output << DocPtr;
     }
 
-    yaml::PMLDoc<yaml::BitcodeFunction,yaml::StringValue>& getPMLDoc() { return YDoc; }
+    virtual void writeOutput(PMLBinaryOutput *Output) {
+      collectPending();
+      auto *DocPtr = &YDoc; *Output << DocPtr;
+    }
+
+    virtual bool empty() { collectPending(); return YDoc.empty(); }
+
+    virtual void clear() { collectPending(); YDoc.clear(); }
+
+    yaml::PMLDoc<yaml::BitcodeFunction,yaml::StringValue>& getPMLDoc() {
+      collectPending();
+      return YDoc;
+    }
 
   private:
 
+    /// Build the relation graph of a function, returns NULL for functions
+    /// without code. Only reads MF and its bitcode function, such that graphs
+    /// of different functions can be built concurrently.
+    yaml::RelationGraph *buildRelationGraph(MachineFunction &MF,
+                                            MachineLoopInfo &MLI);
+
+    /// Wait for the workers and add their graphs to the document, in order.
+    void collectPending();
+
     /// Generate (heuristic) MachineBlock->EventName
     /// and IR-Block->EventName maps
     /// (1) if all forward-CFG predecessors of (MBB originating from BB) map to
     ///     no or a different IR block, MBB generates a BB event.
     /// (2) if there is a MBB generating a event BB, the basic block BB also
     ///     generates this event
-    void buildEventMaps(MachineFunction &MF,
+    void buildEventMaps(MachineFunction &MF, MachineLoopInfo &MLI,
                         std::map<const BasicBlock*,StringRef> &BitcodeEventMap,
                         std::map<MachineBasicBlock*,StringRef> &MachineEventMap,
                         std::set<StringRef> &TabuList);
@@ -268,12 +351,20 @@ namespace llvm {
 
     StringRef   OutFileName;
     std::string BitcodeFile;
+
+    /// The export file and the output in the selected format, while open.
+    ToolOutputFile  *OutFile;
+    PMLYAMLOutput   *YAMLOutput;
+    PMLBinaryOutput *BinaryOutput;
     StringList  Roots;
     bool        SerializeAll;
 
     MFSet   FoundFunctions;
     MFQueue Queue;
 
+    /// The analyses of the exported functions, until they are written.
+    PMLMachineAnalyses Analyses;
+
   protected:
     /// Constructor to be used by sub-classes, passes the pass ID to the super
     /// class. You need to setup a PMLInstrInfo using setPMLInstrInfo before
@@ -304,7 +395,10 @@ namespace llvm {
 
     /// Add an exporter to the pass. Exporters will be deleted when this pass
     /// is deleted.
-    void addExporter(PMLExport *PE) { Exporters.push_back(PE); }
+    void addExporter(PMLExport *PE) {
+      PE->setAnalyses(&Analyses);
+      Exporters.push_back(PE);
+    }
 
     void writeBitcode(std::string& bitcodeFile) { BitcodeFile = bitcodeFile; }
 
@@ -322,6 +416,24 @@ namespace llvm {
 
     bool doFinalization(Module &M) override;
 
+    /// openOutput - Open the export file, returns false on failure.
+    bool openOutput();
+
+    /// writeOutput - Write and free the documents of all exporters. Empty
+    /// documents are only written if SkipEmpty is not set.
+    void writeOutput(bool SkipEmpty);
+
+    /// closeOutput - Finish and close the export file.
+    void closeOutput();
+
+    /// getCalledFunctions - Return the functions called by MF, which are
+    /// exported if they are reachable from a root. By default, the calls are
+    /// found by scanning MF with the PMLInstrInfo. Targets that maintain a
+    /// call graph can look them up instead.
+    virtual PMLInstrInfo::MFList getCalledFunctions(const Module &M,
+                                                    MachineModuleInfo &MMI,
+                                                    MachineFunction &MF);
+
     void addCalleesToQueue(const Module &M, MachineModuleInfo &MMI,
                            MachineFunction &MF);
 
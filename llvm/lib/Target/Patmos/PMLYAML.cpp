@@ -0,0 +1,402 @@
+//===-- PMLYAML.cpp - Fast YAML writer for PML documents. -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The formatting follows yaml::Output token by token, see YAMLTraits.cpp.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PMLYAML.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/YAMLParser.h"
+
+using namespace llvm;
+
+/// Size of the buffered text that is written to the stream at the next line
+/// end.
+static const size_t PMLYAMLFlushSize = 64 * 1024;
+
+/// Width of the padding after keys of block mappings.
+static const unsigned PMLYAMLKeyWidth = 16;
+
+PMLYAMLOutput::PMLYAMLOutput(raw_ostream &os, void *Ctxt, int wrapColumn)
+: IO(Ctxt), OS(os), LineStart(0), WrapColumn(wrapColumn), Padding(0),
+  PaddingBeforeContainer(0), ColumnAtFlowStart(0), ColumnAtMapFlowStart(0),
+  NeedBitValueComma(false), NeedFlowSequenceComma(false),
+  EnumerationMatchFound(false)
+{
+  Buffer.reserve(PMLYAMLFlushSize + PMLYAMLFlushSize / 4);
+}
+
+PMLYAMLOutput::~PMLYAMLOutput()
+{
+  flush();
+}
+
+void PMLYAMLOutput::flush()
+{
+  // called at line ends only, the new line starts with the buffer
+  OS << Buffer;
+  Buffer.clear();
+  LineStart = 0;
+}
+
+void PMLYAMLOutput::beginDocument()
+{
+  assert(StateStack.empty() && "Nested document");
+  outputUpToEndOfLine("---");
+}
+
+void PMLYAMLOutput::endDocument()
+{
+  assert(StateStack.empty() && "Unbalanced document");
+  output("\n...\n");
+  LineStart = Buffer.size();
+  if (Buffer.size() >= PMLYAMLFlushSize)
+    flush();
+}
+
+void PMLYAMLOutput::setOtherEntry()
+{
+  State &S = StateStack.back();
+  if (S == InMapFirstKey)
+    S = InMapOtherKey;
+  else if (S == InFlowMapFirstKey)
+    S = InFlowMapOtherKey;
+  else if (S == InSeqFirstElement)
+    S = InSeqOtherElement;
+  else if (S == InFlowSeqFirstElement)
+    S = InFlowSeqOtherElement;
+}
+
+void PMLYAMLOutput::outputUpToEndOfLine(StringRef S)
+{
+  output(S);
+  if (StateStack.empty() || (!inFlowSeqAnyElement(StateStack.back()) &&
+                             !inFlowMapAnyKey(StateStack.back())))
+    Padding = NewLine;
+}
+
+void PMLYAMLOutput::outputNewLine()
+{
+  if (Buffer.size() >= PMLYAMLFlushSize)
+    flush();
+  Buffer.push_back('\n');
+  LineStart = Buffer.size();
+}
+
+void PMLYAMLOutput::newLineCheck(bool EmptySequence)
+{
+  if (Padding != NewLine) {
+    outputSpaces(Padding);
+    Padding = 0;
+    return;
+  }
+  outputNewLine();
+  Padding = 0;
+
+  if (StateStack.empty() || EmptySequence)
+    return;
+
+  unsigned Indent = StateStack.size() - 1;
+  bool OutputDash = false;
+
+  State S = StateStack.back();
+  if (inSeqAnyElement(S)) {
+    OutputDash = true;
+  } else if (StateStack.size() > 1 &&
+             (S == InMapFirstKey || inFlowSeqAnyElement(S) ||
+              S == InFlowMapFirstKey) &&
+             inSeqAnyElement(StateStack[StateStack.size() - 2])) {
+    --Indent;
+    OutputDash = true;
+  }
+
+  outputSpaces(2 * Indent);
+  if (OutputDash)
+    output("- ");
+}
+
+void PMLYAMLOutput::paddedKey(StringRef Key)
+{
+  output(Key);
+  Buffer.push_back(':');
+  Padding = Key.size() < PMLYAMLKeyWidth ? PMLYAMLKeyWidth - Key.size() : 1;
+}
+
+void PMLYAMLOutput::wrapFlow(int StartColumn)
+{
+  if (WrapColumn && column() > WrapColumn) {
+    // the wrapped line is not a line for the indentation of yaml::Output
+    Buffer.push_back('\n');
+    outputSpaces(StartColumn);
+    LineStart = Buffer.size() - StartColumn;
+    output("  ");
+  }
+}
+
+void PMLYAMLOutput::flowKey(StringRef Key)
+{
+  if (StateStack.back() == InFlowMapOtherKey)
+    output(", ");
+  wrapFlow(ColumnAtMapFlowStart);
+  output(Key);
+  output(": ");
+}
+
+bool PMLYAMLOutput::mapTag(StringRef Tag, bool Use)
+{
+  if (Use) {
+    bool SequenceElement = false;
+    if (StateStack.size() > 1) {
+      State E = StateStack[StateStack.size() - 2];
+      SequenceElement = inSeqAnyElement(E) || inFlowSeqAnyElement(E);
+    }
+    if (SequenceElement && StateStack.back() == InMapFirstKey) {
+      newLineCheck();
+    } else {
+      output(" ");
+    }
+    output(Tag);
+    if (SequenceElement) {
+      if (StateStack.back() == InMapFirstKey)
+        StateStack.back() = InMapOtherKey;
+      Padding = NewLine;
+    }
+  }
+  return Use;
+}
+
+void PMLYAMLOutput::beginMapping()
+{
+  StateStack.push_back(InMapFirstKey);
+  PaddingBeforeContainer = Padding;
+  Padding = NewLine;
+}
+
+void PMLYAMLOutput::endMapping()
+{
+  if (StateStack.back() == InMapFirstKey) {
+    Padding = PaddingBeforeContainer;
+    newLineCheck();
+    output("{}");
+    Padding = NewLine;
+  }
+  StateStack.pop_back();
+}
+
+bool PMLYAMLOutput::preflightKey(const char *Key, bool Required,
+                                 bool SameAsDefault, bool &UseDefault,
+                                 void *&)
+{
+  UseDefault = false;
+  if (!Required && SameAsDefault)
+    return false;
+
+  if (inFlowMapAnyKey(StateStack.back())) {
+    flowKey(Key);
+  } else {
+    newLineCheck();
+    paddedKey(Key);
+  }
+  return true;
+}
+
+std::vector<StringRef> PMLYAMLOutput::keys()
+{
+  report_fatal_error("invalid call");
+}
+
+void PMLYAMLOutput::beginFlowMapping()
+{
+  StateStack.push_back(InFlowMapFirstKey);
+  newLineCheck();
+  ColumnAtMapFlowStart = column();
+  output("{ ");
+}
+
+void PMLYAMLOutput::endFlowMapping()
+{
+  StateStack.pop_back();
+  outputUpToEndOfLine(" }");
+}
+
+unsigned PMLYAMLOutput::beginSequence()
+{
+  StateStack.push_back(InSeqFirstElement);
+  PaddingBeforeContainer = Padding;
+  Padding = NewLine;
+  return 0;
+}
+
+void PMLYAMLOutput::endSequence()
+{
+  if (StateStack.back() == InSeqFirstElement) {
+    Padding = PaddingBeforeContainer;
+    newLineCheck(/*EmptySequence=*/true);
+    output("[]");
+    Padding = NewLine;
+  }
+  StateStack.pop_back();
+}
+
+unsigned PMLYAMLOutput::beginFlowSequence()
+{
+  StateStack.push_back(InFlowSeqFirstElement);
+  newLineCheck();
+  ColumnAtFlowStart = column();
+  output("[ ");
+  NeedFlowSequenceComma = false;
+  return 0;
+}
+
+void PMLYAMLOutput::endFlowSequence()
+{
+  StateStack.pop_back();
+  outputUpToEndOfLine(" ]");
+}
+
+bool PMLYAMLOutput::preflightFlowElement(unsigned, void *&)
+{
+  if (NeedFlowSequenceComma)
+    output(", ");
+  wrapFlow(ColumnAtFlowStart);
+  return true;
+}
+
+bool PMLYAMLOutput::matchEnumScalar(const char *Str, bool Match)
+{
+  if (Match && !EnumerationMatchFound) {
+    newLineCheck();
+    outputUpToEndOfLine(Str);
+    EnumerationMatchFound = true;
+  }
+  return false;
+}
+
+bool PMLYAMLOutput::matchEnumFallback()
+{
+  if (EnumerationMatchFound)
+    return false;
+  EnumerationMatchFound = true;
+  return true;
+}
+
+void PMLYAMLOutput::endEnumScalar()
+{
+  if (!EnumerationMatchFound)
+    llvm_unreachable("bad runtime enum value");
+}
+
+bool PMLYAMLOutput::beginBitSetScalar(bool &DoClear)
+{
+  newLineCheck();
+  output("[ ");
+  NeedBitValueComma = false;
+  DoClear = false;
+  return true;
+}
+
+bool PMLYAMLOutput::bitSetMatch(const char *Str, bool Matches)
+{
+  if (Matches) {
+    if (NeedBitValueComma)
+      output(", ");
+    output(Str);
+    NeedBitValueComma = true;
+  }
+  return false;
+}
+
+void PMLYAMLOutput::endBitSetScalar()
+{
+  outputUpToEndOfLine(" ]");
+}
+
+void PMLYAMLOutput::scalarString(StringRef &S, yaml::QuotingType MustQuote)
+{
+  newLineCheck();
+  if (S.empty()) {
+    outputUpToEndOfLine("''");
+    return;
+  }
+
+  switch (MustQuote) {
+  case yaml::QuotingType::None:
+    outputUpToEndOfLine(S);
+    return;
+
+  case yaml::QuotingType::Single: {
+    // single quotes are escaped by doubling them
+    Buffer.push_back('\'');
+    StringRef Rest = S;
+    for (size_t Q; (Q = Rest.find('\'')) != StringRef::npos;
+         Rest = Rest.substr(Q + 1)) {
+      output(Rest.take_front(Q + 1));
+      Buffer.push_back('\'');
+    }
+    output(Rest);
+    outputUpToEndOfLine("'");
+    return;
+  }
+
+  case yaml::QuotingType::Double: {
+    auto R = Escaped.insert(std::make_pair(S, std::string()));
+    if (R.second)
+      R.first->second = yaml::escape(S, /*EscapePrintable=*/false);
+    Buffer.push_back('"');
+    output(R.first->second);
+    outputUpToEndOfLine("\"");
+    return;
+  }
+  }
+}
+
+void PMLYAMLOutput::blockScalarString(StringRef &S)
+{
+  if (!StateStack.empty())
+    newLineCheck();
+  output(" |");
+  outputNewLine();
+
+  unsigned Indent = StateStack.empty() ? 1 : StateStack.size();
+
+  // follow line_iterator: blank lines are kept, but not a trailing newline
+  StringRef Rest = S;
+  while (!Rest.empty()) {
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    Line.consume_back("\r");
+    outputSpaces(2 * Indent);
+    output(Line);
+    outputNewLine();
+  }
+}
+
+void PMLYAMLOutput::scalarTag(std::string &Tag)
+{
+  if (Tag.empty())
+    return;
+  newLineCheck();
+  output(Tag);
+  output(" ");
+}
+
+yaml::NodeKind PMLYAMLOutput::getNodeKind()
+{
+  report_fatal_error("invalid call");
+}
+
+bool PMLYAMLOutput::canElideEmptySequence()
+{
+  if (StateStack.size() < 2)
+    return true;
+  if (StateStack.back() != InMapFirstKey)
+    return true;
+  return !inSeqAnyElement(StateStack[StateStack.size() - 2]);
+}
@@ -0,0 +1,151 @@
+//===-- PMLYAML.h - Fast YAML writer for PML documents. -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A YAML writer for the PML export. It writes exactly the text yaml::Output
+// writes for the PML.h schema, but is tuned for large documents:
+//
+// - The text is collected in a large buffer and handed to the output stream
+//   in chunks, at line ends, instead of writing every token to the stream.
+// - The column is derived from the start of the current line, rather than
+//   being counted for every token, and indentation is written at once.
+// - Quoted scalars are escaped once: names of functions and blocks repeat
+//   throughout the document, so the escaped text is interned.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOS_PMLYAML_H_
+#define _LLVM_TARGET_PATMOS_PMLYAML_H_
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/YAMLTraits.h"
+
+#include <string>
+
+namespace llvm {
+
+  /// Writer for PML documents in the format of yaml::Output. Each document
+  /// streamed in using operator<< is written as a YAML document of its own,
+  /// just as with yaml::Output.
+  class PMLYAMLOutput : public yaml::IO {
+    raw_ostream &OS;
+
+    /// Text not yet written to OS, and the start of the current line in it.
+    SmallString<0> Buffer;
+    size_t LineStart;
+
+    /// Escaped double-quoted scalars.
+    StringMap<std::string> Escaped;
+
+    int WrapColumn;
+
+    enum State {
+      InSeqFirstElement, InSeqOtherElement, InFlowSeqFirstElement,
+      InFlowSeqOtherElement, InMapFirstKey, InMapOtherKey, InFlowMapFirstKey,
+      InFlowMapOtherKey
+    };
+    SmallVector<State, 16> StateStack;
+
+    /// Padding to write before the next token: a newline, or a number of
+    /// spaces.
+    static const int NewLine = -1;
+    int Padding;
+    int PaddingBeforeContainer;
+
+    int ColumnAtFlowStart;
+    int ColumnAtMapFlowStart;
+    bool NeedBitValueComma;
+    bool NeedFlowSequenceComma;
+    bool EnumerationMatchFound;
+
+    static bool inSeqAnyElement(State S) {
+      return S == InSeqFirstElement || S == InSeqOtherElement;
+    }
+    static bool inFlowSeqAnyElement(State S) {
+      return S == InFlowSeqFirstElement || S == InFlowSeqOtherElement;
+    }
+    static bool inFlowMapAnyKey(State S) {
+      return S == InFlowMapFirstKey || S == InFlowMapOtherKey;
+    }
+
+    int column() const { return Buffer.size() - LineStart; }
+
+    void output(StringRef S) { Buffer.append(S.begin(), S.end()); }
+    void outputSpaces(unsigned N) { Buffer.append(N, ' '); }
+    void outputUpToEndOfLine(StringRef S);
+    void outputNewLine();
+    void newLineCheck(bool EmptySequence = false);
+    void paddedKey(StringRef Key);
+    void flowKey(StringRef Key);
+    void wrapFlow(int StartColumn);
+
+    /// Advance the state of the innermost container past its first entry.
+    void setOtherEntry();
+
+  public:
+    PMLYAMLOutput(raw_ostream &os, void *Ctxt = nullptr, int WrapColumn = 70);
+    ~PMLYAMLOutput() override;
+
+    void beginDocument();
+    void endDocument();
+
+    /// flush - Write the buffered text to the output stream. Must only be
+    /// called at the end of a line, i.e., between documents.
+    void flush();
+
+    bool outputting() const override { return true; }
+    bool mapTag(StringRef Tag, bool Use) override;
+    void beginMapping() override;
+    void endMapping() override;
+    bool preflightKey(const char *Key, bool Required, bool SameAsDefault,
+                      bool &UseDefault, void *&) override;
+    void postflightKey(void *) override { setOtherEntry(); }
+    std::vector<StringRef> keys() override;
+    void beginFlowMapping() override;
+    void endFlowMapping() override;
+    unsigned beginSequence() override;
+    void endSequence() override;
+    bool preflightElement(unsigned, void *&) override { return true; }
+    void postflightElement(void *) override { setOtherEntry(); }
+    unsigned beginFlowSequence() override;
+    void endFlowSequence() override;
+    bool preflightFlowElement(unsigned, void *&) override;
+    void postflightFlowElement(void *) override {
+      NeedFlowSequenceComma = true;
+    }
+    void beginEnumScalar() override { EnumerationMatchFound = false; }
+    bool matchEnumScalar(const char *Str, bool Match) override;
+    bool matchEnumFallback() override;
+    void endEnumScalar() override;
+    bool beginBitSetScalar(bool &DoClear) override;
+    bool bitSetMatch(const char *Str, bool Matches) override;
+    void endBitSetScalar() override;
+    void scalarString(StringRef &S, yaml::QuotingType MustQuote) override;
+    void blockScalarString(StringRef &S) override;
+    void scalarTag(std::string &Tag) override;
+    yaml::NodeKind getNodeKind() override;
+    void setError(const Twine &message) override {}
+    bool canElideEmptySequence() override;
+  };
+
+  /// Write a document, in the same way as yaml::Output's operator<< does.
+  template <typename T>
+  inline std::enable_if_t<
+      yaml::has_MappingTraits<T, yaml::EmptyContext>::value, PMLYAMLOutput &>
+  operator<<(PMLYAMLOutput &Out, T &Doc) {
+    yaml::EmptyContext Ctx;
+    Out.beginDocument();
+    yaml::yamlize(Out, Doc, true, Ctx);
+    Out.endDocument();
+    return Out;
+  }
+}
+
+#endif // _LLVM_TARGET_PATMOS_PMLYAML_H_
@@ -30,11 +30,16 @@ namespace llvm {
 
   void initializePatmosCallGraphBuilderPass(PassRegistry&);
   void initializePatmosStackCacheAnalysisInfoPass(PassRegistry&);
+  void initializePatmosMethodCacheAnalysisInfoPass(PassRegistry&);
+  void initializePatmosDataCacheAnalysisInfoPass(PassRegistry&);
   void initializePatmosPostRASchedulerPass(PassRegistry&);
   void initializePatmosPMLProfileImportPasS(PassRegistry&);
 
   FunctionPass *createPatmosISelDag(PatmosTargetMachine &TM, llvm::CodeGenOpt::Level OptLevel);
+  ModulePass   *createPatmosSPRegionExtractPass();
+  ModulePass   *createPatmosSPSpecializePass();
   ModulePass   *createPatmosSPClonePass();
+  FunctionPass *createPatmosLoopBoundInferencePass();
   ModulePass   *createPatmosSPMarkPass(PatmosTargetMachine &tm);
   FunctionPass *createPatmosSinglePathInfoPass(const PatmosTargetMachine &tm);
   FunctionPass *createPatmosSPPreparePass(const PatmosTargetMachine &tm);
@@ -48,19 +53,53 @@ namespace llvm {
   FunctionPass *createLoopCountInsert(const PatmosTargetMachine &tm);
   FunctionPass *createVirtualizePredicates(const PatmosTargetMachine &tm);
   FunctionPass *createSinglePathLinearizer(const PatmosTargetMachine &tm);
+  FunctionPass *createSinglePathCopyElimination(const PatmosTargetMachine &tm);
+  FunctionPass *createSinglePathPredicateGVN(const PatmosTargetMachine &tm);
   FunctionPass *createSPSchedulerPass(const PatmosTargetMachine &tm);
   FunctionPass *createPatmosDelaySlotFillerPass(const PatmosTargetMachine &tm,
                                                 bool ForceDisable);
   FunctionPass *createPatmosFunctionSplitterPass(PatmosTargetMachine &tm);
   FunctionPass *createPatmosDelaySlotKillerPass(PatmosTargetMachine &tm);
+  FunctionPass *createPatmosBundlePeepholePass(PatmosTargetMachine &tm);
   FunctionPass *createPatmosEnsureAlignmentPass(PatmosTargetMachine &tm);
+  FunctionPass *createPatmosSledsPass(const PatmosTargetMachine &tm,
+                                      bool Subfunctions);
+  FunctionPass *createPatmosHyperblockFormationPass(const PatmosTargetMachine &tm);
+  FunctionPass *createPatmosGuardedSpeculationPass(const PatmosTargetMachine &tm);
+  FunctionPass *createPatmosBlockPlacementPass(const PatmosTargetMachine &tm);
+  FunctionPass *createPatmosTailDuplicationPass(const PatmosTargetMachine &tm);
   FunctionPass *createSinglePathInstructionCounter(const PatmosTargetMachine &tm);
   FunctionPass *createPatmosIntrinsicEliminationPass();
-  FunctionPass *createPatmosConstantLoopDominatorsPass();
+  FunctionPass *createPatmosAtomicLoweringPass();
+  FunctionPass *createPatmosProfileInstrumentationPass();
+  ModulePass   *createPatmosProfileSPMPass();
+  ModulePass   *createPatmosStructLayoutPass(const PatmosTargetMachine &tm);
+  ModulePass   *createPatmosSPMAllocationPass();
+  ModulePass   *createPatmosISPMAllocationPass(const PatmosTargetMachine &tm,
+                                               StringRef WCETProfile);
+  Pass         *createPatmosLoopBoundUnrollPass();
   FunctionPass *createEquivalenceClassesPass();
   ModulePass *createPatmosCallGraphBuilder();
   ModulePass *createPatmosStackCacheAnalysis(const PatmosTargetMachine &tm);
   ModulePass *createPatmosStackCacheAnalysisInfo(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosStackCacheMergingPass(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosStackCacheBudgetPass(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosStackCacheLeavesPass(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosStackCacheSpillingPass(const PatmosTargetMachine &tm);
+  FunctionPass *createPatmosEnsurePlacementPass(const PatmosTargetMachine &tm);
+  FunctionPass *createPatmosCriticalityImportPass(StringRef Filename);
+  FunctionPass *createPatmosPredicateSpillPackingPass(
+                                                const PatmosTargetMachine &tm);
+  FunctionPass *createPatmosLoopBaseSharingPass(const PatmosTargetMachine &tm);
+  FunctionPass *createPatmosLatchCompareHoistingPass(
+                                                const PatmosTargetMachine &tm);
+  FunctionPass *createPatmosIndirectCallRegUsagePass();
+  ModulePass *createPatmosMethodCacheLayoutPass(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosCallGraphProfilePass();
+  ModulePass *createPatmosMethodCacheAnalysis(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosMethodCacheAnalysisInfo(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosDataCacheAnalysis(const PatmosTargetMachine &tm);
+  ModulePass *createPatmosDataCacheAnalysisInfo(const PatmosTargetMachine &tm);
   ModulePass *createPatmosModuleExportPass(PatmosTargetMachine &TM,
                                              std::string& Filename,
                                              std::string& BitcodeFilename,
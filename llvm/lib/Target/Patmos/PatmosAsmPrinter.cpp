@@ -15,6 +15,8 @@
 #include "PatmosAsmPrinter.h"
 #include "PatmosMCInstLower.h"
 #include "PatmosMachineFunctionInfo.h"
+#include "PatmosStackCacheAnalysis.h"
+#include "PatmosStats.h"
 #include "PatmosTargetMachine.h"
 #include "TargetInfo/PatmosTargetInfo.h"
 #include "InstPrinter/PatmosInstPrinter.h"
@@ -27,6 +29,7 @@
 #include "llvm/MC/MCStreamer.h"
 #include "llvm/MC/MCExpr.h"
 #include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCSectionELF.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/MC/MCParser/MCAsmParser.h"
@@ -39,13 +42,38 @@ using namespace llvm;
 
 #define DEBUG_TYPE "asm-printer"
 
+static cl::opt<bool> EmitFlowFacts(
+  "mpatmos-emit-flow-facts",
+  cl::init(false),
+  cl::desc("Emit loop bounds into the " PATMOS_FLOWFACTS_SECTION " section of "
+           "the object file, for WCET analysis without separate PML files."));
+
+static cl::opt<bool> EmitStackCacheSummary(
+  "mpatmos-emit-stack-cache-summary",
+  cl::init(false),
+  cl::desc("Emit stack frame sizes and call sites into the "
+           PATMOS_STACKCACHE_SECTION " section of the object file, for the "
+           "removal of ensures by the linker."));
+
+static cl::opt<bool> AnnotateCycles(
+  "mpatmos-annotate-cycles",
+  cl::init(false),
+  cl::desc("Annotate the bundles in the assembly output with their issue "
+           "cycle, stalls, and stack and method cache costs."));
+
 void PatmosAsmPrinter::emitFunctionEntryLabel() {
   // Create a temp label that will be emitted at the end of the first cache block (at the end of the function
   // if the function has only one cache block)
   CurrCodeEnd = OutContext.createTempSymbol();
 
+  StackCacheCalls.clear();
+  FirstOpenCall = 0;
+  CallWithoutEnsure = false;
+  FunctionCycle = 0;
+
   // emit a function/subfunction start directive
   EmitFStart(CurrentFnSymForSize, CurrCodeEnd, FStartAlignment);
+  reserveCacheBlock(MF->front());
 
   // Now emit the normal function label
   AsmPrinter::emitFunctionEntryLabel();
@@ -93,6 +121,7 @@ void PatmosAsmPrinter::emitBasicBlockStart(const MachineBasicBlock &MBB) {
 
     // emit a function/subfunction start directive
     EmitFStart(SymStart, CurrCodeEnd, FStartAlignment);
+    reserveCacheBlock(MBB);
   }
 
   // We remove any alignment assigned to the block, to ensure
@@ -111,9 +140,33 @@ void PatmosAsmPrinter::emitBasicBlockStart(const MachineBasicBlock &MBB) {
   }
 
   emitBasicBlockBegin(MBB);
+
+  if (EmitFlowFacts) {
+    if (auto loop_bounds = getLoopBounds(&MBB)) {
+      PatmosTargetStreamer *PTS =
+            static_cast<PatmosTargetStreamer*>(OutStreamer->getTargetStreamer());
+      PTS->EmitLoopBound(platin_label, loop_bounds->first, loop_bounds->second);
+    }
+  }
 }
 
 void PatmosAsmPrinter::emitBasicBlockBegin(const MachineBasicBlock &MBB) {
+  if (AnnotateCycles && isVerbose()) {
+    BlockCycle = 0;
+    RegReady.clear();
+
+    // Entering a cache block might fetch it from the main memory
+    if (isFStart(&MBB)) {
+      uint64_t Bytes = getCacheBlockSize(MBB);
+      unsigned Cycles =
+                   PTM->getSubtargetImpl()->getMemoryTransferCycles(Bytes);
+      FunctionCycle += Cycles;
+      OutStreamer->GetCommentOS() << "cache block reload: " << Bytes
+                                  << " bytes, " << Cycles << " cycles\n";
+      OutStreamer->AddBlankLine();
+    }
+  }
+
   // Print loop bound information if needed
   if (auto loop_bounds = getLoopBounds(&MBB)){
     OutStreamer->GetCommentOS() << "Loop bound: [";
@@ -127,6 +180,7 @@ void PatmosAsmPrinter::emitBasicBlockBegin(const MachineBasicBlock &MBB) {
 
 
 void PatmosAsmPrinter::emitBasicBlockEnd(const MachineBasicBlock &MBB) {
+  closeStackCacheCalls();
 
   // EmitBasicBlockBegin emits after the label, too late for emitting .fstart,
   // so we do it at the end of the previous block of a cache block start MBB.
@@ -145,6 +199,139 @@ void PatmosAsmPrinter::emitBasicBlockEnd(const MachineBasicBlock &MBB) {
 void PatmosAsmPrinter::emitFunctionBodyEnd() {
   // Emit the end symbol of the last cache block
   OutStreamer->emitLabel(CurrCodeEnd);
+
+  if (EmitStackCacheSummary)
+    emitStackCacheSummary();
+
+  emitTracingSleds();
+}
+
+void PatmosAsmPrinter::emitEndOfAsmFile(Module &M) {
+  // all Patmos passes have run on all functions
+  writePatmosStats(M);
+}
+
+MCSymbol *PatmosAsmPrinter::recordStackCacheSummary(const MachineInstr *MI) {
+  if (MI->isCall()) {
+    const MCSymbol *Callee = nullptr;
+    for (const MachineOperand &MO : MI->operands()) {
+      if (MO.isGlobal()) {
+        Callee = getSymbol(MO.getGlobal());
+        break;
+      } else if (MO.isSymbol()) {
+        Callee = GetExternalSymbolSymbol(MO.getSymbolName());
+        break;
+      }
+    }
+    StackCacheCalls.push_back({Callee, nullptr, 0});
+    return nullptr;
+  }
+
+  // Predicated ensures are not removed, the calls remain open.
+  if (MI->getOpcode() != Patmos::SENSi ||
+      PTM->getSubtargetImpl()->getInstrInfo()->isPredicated(*MI) ||
+      FirstOpenCall == StackCacheCalls.size())
+    return nullptr;
+
+  MCSymbol *Ensure = OutContext.createTempSymbol();
+  unsigned EnsureBytes = MI->getOperand(2).getImm() * 4;
+  for (unsigned i = FirstOpenCall, e = StackCacheCalls.size(); i != e; i++) {
+    StackCacheCalls[i].Ensure = Ensure;
+    StackCacheCalls[i].EnsureBytes = EnsureBytes;
+  }
+  FirstOpenCall = StackCacheCalls.size();
+  return Ensure;
+}
+
+void PatmosAsmPrinter::closeStackCacheCalls() {
+  if (FirstOpenCall != StackCacheCalls.size())
+    CallWithoutEnsure = true;
+  FirstOpenCall = StackCacheCalls.size();
+}
+
+void PatmosAsmPrinter::emitStackCacheSummary() {
+  closeStackCacheCalls();
+
+  // Without a summary of the function, the linker treats it like a function
+  // of unknown stack usage. Stack control in inline assembly is not visible.
+  if (MF->hasInlineAsm())
+    return;
+
+  const PatmosMachineFunctionInfo *PMFI =
+                                       MF->getInfo<PatmosMachineFunctionInfo>();
+  PatmosTargetStreamer *PTS =
+            static_cast<PatmosTargetStreamer*>(OutStreamer->getTargetStreamer());
+
+  PTS->EmitStackCacheFrame(CurrentFnSym,
+      PTM->getSubtargetImpl()->getAlignedStackFrameSize(
+                                     PMFI->getStackCacheReservedBytes()));
+
+  // The ensures are only related to the calls in their basic block. If an
+  // ensure after a call has been removed already, the displacement of that
+  // call carries over to later ensures, which the linker then cannot remove.
+  for (const StackCacheCall &Call : StackCacheCalls) {
+    PTS->EmitStackCacheCall(CurrentFnSym, Call.Callee,
+                            CallWithoutEnsure ? nullptr : Call.Ensure,
+                            Call.EnsureBytes);
+  }
+
+  // The bounds of the stack cache analysis, which is more precise than the
+  // linker, as it knows the paths through the function. Pre-compiled
+  // libraries carry them for the analysis of the programs they are linked to.
+  if (PMFI->hasStackCacheDisplacement()) {
+    PTS->EmitStackCacheDisplacement(CurrentFnSym,
+                                    PMFI->getMinStackCacheDisplacement(),
+                                    PMFI->getMaxStackCacheDisplacement());
+  }
+}
+
+void PatmosAsmPrinter::emitTracingSleds() {
+  const PatmosMachineFunctionInfo *PMFI =
+                                       MF->getInfo<PatmosMachineFunctionInfo>();
+  if (PMFI->getTracingSleds().empty())
+    return;
+
+  MCSectionELF *Sec = OutContext.getELFSection(PATMOS_SLEDS_SECTION,
+                                               ELF::SHT_PROGBITS,
+                                               ELF::SHF_ALLOC);
+  const MCExpr *Handler = MCSymbolRefExpr::create(
+      OutContext.getOrCreateSymbol("__patmos_sled_handler"), OutContext);
+
+  OutStreamer->PushSection();
+  OutStreamer->SwitchSection(Sec);
+  OutStreamer->emitValueToAlignment(4);
+  for (const PatmosTracingSled &Sled : PMFI->getTracingSleds()) {
+    OutStreamer->emitSymbolValue(Sled.First->getPreInstrSymbol(), 4);
+    OutStreamer->emitSymbolValue(CurrentFnSym, 4);
+    OutStreamer->emitIntValue(Sled.Kind, 4);
+
+    // The instructions of the enabled sled, which the runtime copies over
+    // the NOPs. Neither is bundled, nor guarded.
+    MCInst Image[PatmosTracingSled::Words];
+    Image[0].setOpcode(Patmos::MFS);
+    Image[0].addOperand(MCOperand::createReg(Sled.ScratchA));
+    Image[1].setOpcode(Patmos::MFS);
+    Image[1].addOperand(MCOperand::createReg(Sled.ScratchB));
+    Image[2].setOpcode(Patmos::CALLND);
+    Image[3].setOpcode(Patmos::MTS);
+    Image[3].addOperand(MCOperand::createReg(Patmos::SRB));
+    Image[4].setOpcode(Patmos::MTS);
+    Image[4].addOperand(MCOperand::createReg(Patmos::SRO));
+    for (MCInst &MCI : Image) {
+      MCI.addOperand(MCOperand::createReg(Patmos::NoRegister));
+      MCI.addOperand(MCOperand::createImm(0));
+    }
+    Image[0].addOperand(MCOperand::createReg(Patmos::SRB));
+    Image[1].addOperand(MCOperand::createReg(Patmos::SRO));
+    Image[2].addOperand(MCOperand::createExpr(Handler));
+    Image[3].addOperand(MCOperand::createReg(Sled.ScratchA));
+    Image[4].addOperand(MCOperand::createReg(Sled.ScratchB));
+    for (MCInst &MCI : Image) {
+      MCI.addOperand(MCOperand::createImm(0));
+      EmitToStreamer(*OutStreamer, MCI);
+    }
+  }
+  OutStreamer->PopSection();
 }
 
 void PatmosAsmPrinter::emitDotSize(MCSymbol *SymStart, MCSymbol *SymEnd) {
@@ -170,6 +357,103 @@ void PatmosAsmPrinter::EmitFStart(MCSymbol *SymStart, MCSymbol *SymEnd,
   PTS->EmitFStart(SymStart, SizeExpr, Alignment);
 }
 
+uint64_t
+PatmosAsmPrinter::getCacheBlockSize(const MachineBasicBlock &MBB) const {
+  const PatmosInstrInfo *PII = PTM->getSubtargetImpl()->getInstrInfo();
+
+  uint64_t Bytes = 0;
+  const MachineBasicBlock *Block = &MBB;
+  do {
+    Bytes += PII->getBlockSize(*Block);
+    Block = Block->getNextNode();
+  } while (Block && !isFStart(Block));
+  return Bytes;
+}
+
+void PatmosAsmPrinter::reserveCacheBlock(const MachineBasicBlock &MBB) {
+  PatmosTargetStreamer *PTS =
+            static_cast<PatmosTargetStreamer*>(OutStreamer->getTargetStreamer());
+  PTS->ReserveCode(getCacheBlockSize(MBB));
+}
+
+void PatmosAsmPrinter::annotateCycles(ArrayRef<const MachineInstr*> Bundle) {
+  const PatmosSubtarget *PST = PTM->getSubtargetImpl();
+  const InstrItineraryData *Itins = PST->getInstrItineraryData();
+  PatmosStackCacheAnalysisInfo *SCA =
+                      getAnalysisIfAvailable<PatmosStackCacheAnalysisInfo>();
+  bool IsSinglePath = MF->getInfo<PatmosMachineFunctionInfo>()->isSinglePath();
+
+  // The bundle stalls until all its operands are available.
+  unsigned Stall = 0;
+  for (const MachineInstr *MI : Bundle) {
+    unsigned SchedClass = MI->getDesc().getSchedClass();
+    for (unsigned i = 0, e = MI->getNumOperands(); i != e; i++) {
+      const MachineOperand &MO = MI->getOperand(i);
+      if (!MO.isReg() || !MO.isUse() || !MO.getReg())
+        continue;
+      DenseMap<unsigned, unsigned>::iterator Ready = RegReady.find(MO.getReg());
+      if (Ready == RegReady.end())
+        continue;
+      int UseCycle = Itins->getOperandCycle(SchedClass, i);
+      unsigned Read = BlockCycle + (UseCycle < 0 ? 0 : UseCycle);
+      if (Ready->second > Read)
+        Stall = std::max(Stall, Ready->second - Read);
+    }
+  }
+  unsigned Issue = BlockCycle + Stall;
+
+  // Worst-case spills of reserves and fills of ensures, as bounded by the
+  // stack cache analysis if it was run.
+  unsigned CacheCycles = 0;
+  for (const MachineInstr *MI : Bundle) {
+    const char *Event;
+    const PatmosStackCacheAnalysisInfo::FillSpillCounts *Bounds;
+    if (MI->getOpcode() == Patmos::SRESi) {
+      Event = "sres spill";
+      Bounds = SCA ? &SCA->Reserves : nullptr;
+    } else if (MI->getOpcode() == Patmos::SENSi) {
+      Event = "sens fill";
+      Bounds = SCA ? &SCA->Ensures : nullptr;
+    } else {
+      continue;
+    }
+
+    unsigned Bytes = MI->getOperand(2).getImm() * 4;
+    if (SCA && SCA->isValid()) {
+      auto Bound = Bounds->find(MI);
+      if (Bound != Bounds->end())
+        Bytes = Bound->second;
+    }
+    unsigned Cycles = PST->getMemoryTransferCycles(Bytes);
+    CacheCycles += Cycles;
+    OutStreamer->GetCommentOS() << Event << " <= " << Bytes << " bytes ("
+                                << Cycles << " cycles)\n";
+  }
+
+  OutStreamer->GetCommentOS() << "cycle " << Issue;
+  if (Stall)
+    OutStreamer->GetCommentOS() << ", stall " << Stall;
+  FunctionCycle += 1 + Stall + CacheCycles;
+  if (IsSinglePath)
+    OutStreamer->GetCommentOS() << ", total " << FunctionCycle;
+  OutStreamer->GetCommentOS() << "\n";
+
+  // Record when the results of the bundle become available.
+  for (const MachineInstr *MI : Bundle) {
+    unsigned SchedClass = MI->getDesc().getSchedClass();
+    for (unsigned i = 0, e = MI->getNumOperands(); i != e; i++) {
+      const MachineOperand &MO = MI->getOperand(i);
+      if (!MO.isReg() || !MO.isDef() || !MO.getReg())
+        continue;
+      int DefCycle = Itins->getOperandCycle(SchedClass, i);
+      // a use reads in cycle 1 at the earliest, the result is forwarded
+      RegReady[MO.getReg()] = Issue + (DefCycle < 1 ? 1 : DefCycle);
+    }
+  }
+
+  BlockCycle = Issue + 1 + CacheCycles;
+}
+
 bool PatmosAsmPrinter::isFStart(const MachineBasicBlock *MBB) const {
   // query the machineinfo object - the PatmosFunctionSplitter, or some other
   // pass, has marked all entry blocks already.
@@ -207,6 +491,9 @@ void PatmosAsmPrinter::emitInstruction(const MachineInstr *MI) {
     BundleMIs.push_back(MI);
   }
 
+  if (AnnotateCycles && isVerbose())
+    annotateCycles(BundleMIs);
+
   // Emit all instructions in the bundle.
   for (unsigned Index = 0; Index < Size; Index++) {
     MCInst MCI;
@@ -216,6 +503,11 @@ void PatmosAsmPrinter::emitInstruction(const MachineInstr *MI) {
     bool isBundled = (Index < Size - 1);
     MCI.addOperand(MCOperand::createImm(isBundled));
 
+    if (EmitStackCacheSummary) {
+      if (MCSymbol *Label = recordStackCacheSummary(BundleMIs[Index]))
+        OutStreamer->emitLabel(Label);
+    }
+
     OutStreamer->emitInstruction(MCI, *TM.getMCSubtargetInfo());
   }
 }
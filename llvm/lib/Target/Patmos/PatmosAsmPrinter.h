@@ -18,6 +18,7 @@
 #include "PatmosTargetMachine.h"
 #include "PatmosMCInstLower.h"
 #include "llvm/CodeGen/AsmPrinter.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/MC/MCContext.h"
 
 namespace llvm {
@@ -33,6 +34,31 @@ namespace llvm {
     // symbol to use for the end of the currently emitted subfunction
     MCSymbol *CurrCodeEnd;
 
+    /// A call site of the current function, for the stack cache summary.
+    struct StackCacheCall {
+      const MCSymbol *Callee;
+      const MCSymbol *Ensure;
+      unsigned EnsureBytes;
+    };
+    SmallVector<StackCacheCall, 8> StackCacheCalls;
+
+    /// Index of the first call in StackCacheCalls that has not yet been
+    /// followed by an ensure in its basic block.
+    unsigned FirstOpenCall;
+
+    /// Whether a call of the current function may reach an ensure across
+    /// basic blocks, and thus with calls the summary does not relate to it.
+    bool CallWithoutEnsure;
+
+    /// Issue cycle of the next bundle in the current basic block, and in the
+    /// current (single-path) function, for the cycle annotations.
+    unsigned BlockCycle;
+    uint64_t FunctionCycle;
+
+    /// Cycle in the current basic block from which a register can be read
+    /// without stalling.
+    DenseMap<unsigned, unsigned> RegReady;
+
   public:
     PatmosAsmPrinter(TargetMachine &TM, std::unique_ptr<MCStreamer> Streamer)
       : AsmPrinter(TM, std::move(Streamer)), MCInstLowering(OutContext, *this), CurrCodeEnd(0)
@@ -61,6 +87,9 @@ namespace llvm {
 
     void emitFunctionBodyEnd() override;
 
+    /// emitEndOfAsmFile - Write the per-function statistics of the module.
+    void emitEndOfAsmFile(Module &M) override;
+
     // called in the framework for instruction printing
     void emitInstruction(const MachineInstr *MI) override;
 
@@ -91,6 +120,29 @@ namespace llvm {
                     Align Alignment);
 
     bool isFStart(const MachineBasicBlock *MBB) const;
+
+    /// Return the size in bytes of the cache block starting with MBB.
+    uint64_t getCacheBlockSize(const MachineBasicBlock &MBB) const;
+
+    /// Let the streamer allocate the code of the cache block starting with
+    /// MBB at once.
+    void reserveCacheBlock(const MachineBasicBlock &MBB);
+
+    /// Annotate a bundle with its issue cycle, stalls and stack cache costs.
+    void annotateCycles(ArrayRef<const MachineInstr*> Bundle);
+
+    /// Record a call or ensure for the stack cache summary. Returns the label
+    /// to emit before the instruction, if any.
+    MCSymbol *recordStackCacheSummary(const MachineInstr *MI);
+
+    /// Close the calls of a basic block that are not followed by an ensure.
+    void closeStackCacheCalls();
+
+    /// Emit the stack cache summary of the current function.
+    void emitStackCacheSummary();
+
+    /// Emit the records of the tracing sleds of the current function.
+    void emitTracingSleds();
   };
 
 } // end of llvm namespace
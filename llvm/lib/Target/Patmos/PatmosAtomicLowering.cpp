@@ -0,0 +1,290 @@
+//===-- PatmosAtomicLowering.cpp - Lower atomics to the hardware lock -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Patmos has no atomic read-modify-write instructions. Lower atomicrmw and
+// cmpxchg to critical sections guarded by a lock of the hardware lock unit of
+// the multicore, which is mapped into the I/O space of the local address
+// space. A store of 1 to the word of a lock acquires the lock, the store
+// stalls until the lock is granted, a store of 0 releases it.
+//
+// The shared memory is accessed in the critical section by loads and stores
+// that bypass the data cache, the data caches of the cores are not coherent.
+// The sections have no branches, cmpxchg always stores, the old value if the
+// comparison fails, such that the time of a section is constant apart from
+// the wait for the lock. The acquiring stores are marked, they are exported as
+// accesses of memory type "lock" to PML, where the analysis bounds the wait.
+//
+// Atomic loads and stores of at most a word are atomic as they are, they
+// bypass the data cache but take no lock. Fences are removed, all atomics
+// bypass the data cache and Patmos performs the accesses in order.
+//
+// With more than one lock, the lock is chosen by the address of the accessed
+// word, all atomics to the same word use the same lock in all modules.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-atomic-lowering"
+
+STATISTIC(NumLockedAtomics, "Number of atomics lowered to locked sections");
+STATISTIC(NumBypassAtomics, "Number of atomic loads and stores bypassed");
+STATISTIC(NumFences,        "Number of fences removed");
+
+static cl::opt<unsigned> AtomicLockBase(
+  "mpatmos-atomic-lock-base",
+  cl::init(0xF00B0000),
+  cl::desc("I/O address of the first lock of the hardware lock unit "
+           "(default: 0xf00b0000)."),
+  cl::Hidden);
+
+static cl::opt<unsigned> AtomicLocks(
+  "mpatmos-atomic-locks",
+  cl::init(1),
+  cl::desc("Number of hardware locks used for atomics, a power of two "
+           "(default: 1)."),
+  cl::Hidden);
+
+/// The address space of the local data scratchpad and the I/O devices.
+static const unsigned LocalAddressSpace = 1;
+
+/// The address space of the accesses that bypass the data cache.
+static const unsigned BypassAddressSpace = 3;
+
+namespace {
+  class PatmosAtomicLowering : public FunctionPass {
+  public:
+    static char ID;
+
+    PatmosAtomicLowering() : FunctionPass(ID) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Atomic Lowering";
+    }
+
+    bool runOnFunction(Function &F) override;
+
+  private:
+    /// Return the pointer Ptr in the bypass address space, if it points into
+    /// main memory.
+    Value *getBypassPointer(IRBuilder<> &Builder, Value *Ptr) const;
+
+    /// Return the address of the lock guarding the word Ptr points to.
+    Value *getLockAddress(IRBuilder<> &Builder, Value *Ptr) const;
+
+    /// Acquire or release the lock at LockAddr.
+    void emitLockStore(IRBuilder<> &Builder, Value *LockAddr,
+                       bool Acquire) const;
+
+    Value *lowerAtomicRMW(AtomicRMWInst *RMW) const;
+    Value *lowerCmpXchg(AtomicCmpXchgInst *CX) const;
+    Value *lowerAtomicLoad(LoadInst *LI) const;
+    void lowerAtomicStore(StoreInst *SI) const;
+  };
+}
+
+char PatmosAtomicLowering::ID = 0;
+
+FunctionPass *llvm::createPatmosAtomicLoweringPass() {
+  return new PatmosAtomicLowering();
+}
+
+Value *PatmosAtomicLowering::getBypassPointer(IRBuilder<> &Builder,
+                                              Value *Ptr) const {
+  auto *PT = cast<PointerType>(Ptr->getType());
+  if (PT->getAddressSpace() != 0)
+    return Ptr;
+  return Builder.CreateAddrSpaceCast(
+      Ptr, PT->getElementType()->getPointerTo(BypassAddressSpace));
+}
+
+Value *PatmosAtomicLowering::getLockAddress(IRBuilder<> &Builder,
+                                            Value *Ptr) const {
+  Type *Int32Ty = Builder.getInt32Ty();
+  Type *LockPtrTy = Int32Ty->getPointerTo(LocalAddressSpace);
+
+  if (AtomicLocks <= 1)
+    return ConstantExpr::getIntToPtr(
+        ConstantInt::get(Int32Ty, AtomicLockBase), LockPtrTy);
+
+  // lock = base + ((addr >> 2) & (locks - 1)) * 4
+  Value *Addr = Builder.CreatePtrToInt(Ptr, Int32Ty);
+  Value *Idx = Builder.CreateAnd(Builder.CreateLShr(Addr, 2),
+                                 AtomicLocks - 1);
+  Value *Offset = Builder.CreateShl(Idx, 2);
+  return Builder.CreateIntToPtr(Builder.CreateAdd(Offset,
+                                    Builder.getInt32(AtomicLockBase)),
+                                LockPtrTy);
+}
+
+void PatmosAtomicLowering::emitLockStore(IRBuilder<> &Builder, Value *LockAddr,
+                                         bool Acquire) const {
+  StoreInst *SI = Builder.CreateAlignedStore(Builder.getInt32(Acquire),
+                                             LockAddr, Align(4), true);
+  // Mark the acquisitions, see PatmosTargetLowering::getTargetMMOFlags.
+  if (Acquire)
+    SI->setMetadata("patmos.lock", MDNode::get(SI->getContext(), None));
+}
+
+Value *PatmosAtomicLowering::lowerAtomicRMW(AtomicRMWInst *RMW) const {
+  IRBuilder<> Builder(RMW);
+  Value *Ptr = getBypassPointer(Builder, RMW->getPointerOperand());
+  Value *Val = RMW->getValOperand();
+  Type *Ty = Val->getType();
+  Value *LockAddr = getLockAddress(Builder, RMW->getPointerOperand());
+
+  emitLockStore(Builder, LockAddr, true);
+  Value *Old = Builder.CreateAlignedLoad(Ty, Ptr, RMW->getAlign(), true);
+  Value *New;
+  switch (RMW->getOperation()) {
+  case AtomicRMWInst::Xchg: New = Val; break;
+  case AtomicRMWInst::Add:  New = Builder.CreateAdd(Old, Val); break;
+  case AtomicRMWInst::Sub:  New = Builder.CreateSub(Old, Val); break;
+  case AtomicRMWInst::And:  New = Builder.CreateAnd(Old, Val); break;
+  case AtomicRMWInst::Nand:
+    New = Builder.CreateNot(Builder.CreateAnd(Old, Val));
+    break;
+  case AtomicRMWInst::Or:   New = Builder.CreateOr(Old, Val); break;
+  case AtomicRMWInst::Xor:  New = Builder.CreateXor(Old, Val); break;
+  case AtomicRMWInst::Max:
+    New = Builder.CreateSelect(Builder.CreateICmpSGT(Old, Val), Old, Val);
+    break;
+  case AtomicRMWInst::Min:
+    New = Builder.CreateSelect(Builder.CreateICmpSLE(Old, Val), Old, Val);
+    break;
+  case AtomicRMWInst::UMax:
+    New = Builder.CreateSelect(Builder.CreateICmpUGT(Old, Val), Old, Val);
+    break;
+  case AtomicRMWInst::UMin:
+    New = Builder.CreateSelect(Builder.CreateICmpULE(Old, Val), Old, Val);
+    break;
+  case AtomicRMWInst::FAdd: New = Builder.CreateFAdd(Old, Val); break;
+  case AtomicRMWInst::FSub: New = Builder.CreateFSub(Old, Val); break;
+  default:
+    report_fatal_error("unsupported atomicrmw operation");
+  }
+  Builder.CreateAlignedStore(New, Ptr, RMW->getAlign(), true);
+  emitLockStore(Builder, LockAddr, false);
+  return Old;
+}
+
+Value *PatmosAtomicLowering::lowerCmpXchg(AtomicCmpXchgInst *CX) const {
+  IRBuilder<> Builder(CX);
+  Value *Ptr = getBypassPointer(Builder, CX->getPointerOperand());
+  Value *New = CX->getNewValOperand();
+  Value *LockAddr = getLockAddress(Builder, CX->getPointerOperand());
+
+  emitLockStore(Builder, LockAddr, true);
+  Value *Old = Builder.CreateAlignedLoad(New->getType(), Ptr, CX->getAlign(),
+                                         true);
+  Value *Success = Builder.CreateICmpEQ(Old, CX->getCompareOperand());
+  Builder.CreateAlignedStore(Builder.CreateSelect(Success, New, Old), Ptr,
+                             CX->getAlign(), true);
+  emitLockStore(Builder, LockAddr, false);
+
+  Value *Res = Builder.CreateInsertValue(UndefValue::get(CX->getType()),
+                                         Old, 0);
+  return Builder.CreateInsertValue(Res, Success, 1);
+}
+
+Value *PatmosAtomicLowering::lowerAtomicLoad(LoadInst *LI) const {
+  IRBuilder<> Builder(LI);
+  const DataLayout &DL = LI->getModule()->getDataLayout();
+  Value *Ptr = getBypassPointer(Builder, LI->getPointerOperand());
+
+  if (DL.getTypeStoreSize(LI->getType()) <= 4) {
+    NumBypassAtomics++;
+    return Builder.CreateAlignedLoad(LI->getType(), Ptr, LI->getAlign(), true);
+  }
+
+  NumLockedAtomics++;
+  Value *LockAddr = getLockAddress(Builder, LI->getPointerOperand());
+  emitLockStore(Builder, LockAddr, true);
+  Value *V = Builder.CreateAlignedLoad(LI->getType(), Ptr, LI->getAlign(),
+                                       true);
+  emitLockStore(Builder, LockAddr, false);
+  return V;
+}
+
+void PatmosAtomicLowering::lowerAtomicStore(StoreInst *SI) const {
+  IRBuilder<> Builder(SI);
+  const DataLayout &DL = SI->getModule()->getDataLayout();
+  Value *Val = SI->getValueOperand();
+  Value *Ptr = getBypassPointer(Builder, SI->getPointerOperand());
+
+  if (DL.getTypeStoreSize(Val->getType()) <= 4) {
+    NumBypassAtomics++;
+    Builder.CreateAlignedStore(Val, Ptr, SI->getAlign(), true);
+    return;
+  }
+
+  NumLockedAtomics++;
+  Value *LockAddr = getLockAddress(Builder, SI->getPointerOperand());
+  emitLockStore(Builder, LockAddr, true);
+  Builder.CreateAlignedStore(Val, Ptr, SI->getAlign(), true);
+  emitLockStore(Builder, LockAddr, false);
+}
+
+bool PatmosAtomicLowering::runOnFunction(Function &F) {
+  if (!isPowerOf2_32(AtomicLocks))
+    report_fatal_error("-mpatmos-atomic-locks must be a power of two");
+
+  SmallVector<Instruction *, 8> Atomics;
+  for (Instruction &I : instructions(F)) {
+    if (isa<AtomicRMWInst>(I) || isa<AtomicCmpXchgInst>(I) ||
+        isa<FenceInst>(I))
+      Atomics.push_back(&I);
+    else if (auto *LI = dyn_cast<LoadInst>(&I)) {
+      if (LI->isAtomic())
+        Atomics.push_back(LI);
+    } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
+      if (SI->isAtomic())
+        Atomics.push_back(SI);
+    }
+  }
+
+  for (Instruction *I : Atomics) {
+    LLVM_DEBUG(dbgs() << "Atomic lowering in " << F.getName() << ": " << *I
+                      << "\n");
+    Value *V = nullptr;
+    if (auto *RMW = dyn_cast<AtomicRMWInst>(I)) {
+      NumLockedAtomics++;
+      V = lowerAtomicRMW(RMW);
+    } else if (auto *CX = dyn_cast<AtomicCmpXchgInst>(I)) {
+      NumLockedAtomics++;
+      V = lowerCmpXchg(CX);
+    } else if (auto *LI = dyn_cast<LoadInst>(I)) {
+      V = lowerAtomicLoad(LI);
+    } else if (auto *SI = dyn_cast<StoreInst>(I)) {
+      lowerAtomicStore(SI);
+    } else {
+      NumFences++;
+    }
+    if (V) {
+      V->takeName(I);
+      I->replaceAllUsesWith(V);
+    }
+    I->eraseFromParent();
+  }
+  return !Atomics.empty();
+}
@@ -0,0 +1,325 @@
+//===-- PatmosBlockPlacement.cpp - Place blocks for fall-throughs ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Order the basic blocks of a function such that hot and worst-case edges
+// fall through.
+//
+// On Patmos, a taken branch costs its delay slots, which are often padded
+// with NOPs, while a fall-through is free. The layout also decides which
+// blocks the function splitter puts into the same subfunction: it follows
+// the fall-throughs when it grows a region, and needs an additional branch
+// for every fall-through that crosses a region boundary.
+//
+// The pass forms chains of blocks bottom-up, like Pettis and Hansen: the
+// edges are visited from the most to the least important one, and an edge
+// joins the chain ending in its source with the chain starting at its target.
+// Edges between blocks on the worst-case path, as imported by
+// PatmosCriticalityImport, come first, the others are ordered by their
+// frequency, which is the imported one, if available, or the block frequency
+// of LLVM otherwise. A chain does not grow beyond the chain size, such that
+// the splitter can put it into a single subfunction. The chain of the entry
+// block comes first, the other chains follow by the importance of their
+// first block.
+//
+// The generic MachineBlockPlacement is not used on Patmos. This pass runs
+// before the post-RA scheduler, i.e., before bundles and delay slots are
+// formed, and only rewrites the branches of blocks that analyzeBranch
+// understands. Other blocks keep their layout successor. As the generic pass
+// would, it finally aligns the top block of each loop to the preferred loop
+// alignment of the target lowering, also if the blocks are not reordered.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineBranchProbabilityInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/TargetLowering.h"
+#include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-block-placement"
+
+STATISTIC(NumFallthroughs, "Edges that fall through after block placement");
+STATISTIC(NumMoved,        "Blocks moved by block placement");
+STATISTIC(NumAlignedLoops, "Loops aligned by block placement");
+
+static cl::opt<bool> EnableBlockPlacement(
+  "mpatmos-enable-block-placement",
+  cl::init(false),
+  cl::desc("Order the blocks such that hot and worst-case edges fall through "
+           "(non-single-path functions only)."));
+
+static cl::opt<unsigned> MaxChainSize(
+  "mpatmos-block-placement-chain-size",
+  cl::init(256),
+  cl::desc("Maximum size in bytes of a chain of fall-through blocks, should "
+           "not exceed the preferred subfunction size (default: 256)."),
+  cl::Hidden);
+
+namespace {
+
+  class PatmosBlockPlacement : public MachineFunctionPass {
+  private:
+    static char ID;
+
+    const PatmosInstrInfo *TII;
+
+    /// A candidate fall-through edge.
+    struct Edge {
+      MachineBasicBlock *Src;
+      MachineBasicBlock *Dst;
+      bool Critical;
+      uint64_t Weight;
+
+      bool operator<(const Edge &O) const {
+        if (Critical != O.Critical)
+          return Critical;
+        if (Weight != O.Weight)
+          return Weight > O.Weight;
+        // determinism
+        if (Src->getNumber() != O.Src->getNumber())
+          return Src->getNumber() < O.Src->getNumber();
+        return Dst->getNumber() < O.Dst->getNumber();
+      }
+    };
+
+    /// A chain of blocks that fall through to each other.
+    struct Chain {
+      std::vector<MachineBasicBlock*> Blocks;
+      unsigned Size = 0;
+    };
+
+    /// The chain of each block.
+    DenseMap<MachineBasicBlock*, Chain*> ChainOf;
+
+    /// Return the size of a block in bytes, without caching it, the branches
+    /// change below.
+    unsigned getSize(const MachineBasicBlock &MBB) const {
+      unsigned Size = 0;
+      for (const MachineInstr &MI : MBB)
+        Size += TII->getInstrSize(&MI);
+      return Size;
+    }
+
+    /// Append the chain of Dst to the chain of Src, if Src ends its chain
+    /// and Dst starts its chain. Force ignores the chain size.
+    bool merge(MachineBasicBlock *Src, MachineBasicBlock *Dst, bool Force);
+
+    /// Order the blocks and rewrite their branches.
+    bool placeBlocks(MachineFunction &MF);
+
+    /// Align the first block of each loop in the layout.
+    bool alignLoops(MachineFunction &MF, const MachineLoopInfo &MLI);
+
+  public:
+    PatmosBlockPlacement(const PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID), TII(tm.getInstrInfo()) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Block Placement";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<MachineBlockFrequencyInfo>();
+      AU.addRequired<MachineBranchProbabilityInfo>();
+      AU.addRequired<MachineLoopInfo>();
+      AU.addPreserved<MachineLoopInfo>();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+  };
+
+  char PatmosBlockPlacement::ID = 0;
+}
+
+FunctionPass *
+llvm::createPatmosBlockPlacementPass(const PatmosTargetMachine &tm) {
+  return new PatmosBlockPlacement(tm);
+}
+
+bool PatmosBlockPlacement::merge(MachineBasicBlock *Src,
+                                 MachineBasicBlock *Dst, bool Force) {
+  Chain *SrcChain = ChainOf[Src];
+  Chain *DstChain = ChainOf[Dst];
+  if (SrcChain == DstChain || SrcChain->Blocks.back() != Src ||
+      DstChain->Blocks.front() != Dst)
+    return false;
+  if (!Force && SrcChain->Size + DstChain->Size > MaxChainSize)
+    return false;
+
+  for (MachineBasicBlock *MBB : DstChain->Blocks)
+    ChainOf[MBB] = SrcChain;
+  SrcChain->Blocks.insert(SrcChain->Blocks.end(), DstChain->Blocks.begin(),
+                          DstChain->Blocks.end());
+  SrcChain->Size += DstChain->Size;
+  DstChain->Blocks.clear();
+  return true;
+}
+
+bool PatmosBlockPlacement::runOnMachineFunction(MachineFunction &MF) {
+  bool Changed = false;
+  if (EnableBlockPlacement && MF.size() >= 3 &&
+      !MF.getInfo<PatmosMachineFunctionInfo>()->isSinglePath())
+    Changed |= placeBlocks(MF);
+  Changed |= alignLoops(MF, getAnalysis<MachineLoopInfo>());
+  return Changed;
+}
+
+bool PatmosBlockPlacement::alignLoops(MachineFunction &MF,
+                                      const MachineLoopInfo &MLI) {
+  const TargetLowering *TLI = MF.getSubtarget().getTargetLowering();
+  bool Changed = false;
+  SmallVector<MachineLoop*, 8> Worklist(MLI.begin(), MLI.end());
+  while (!Worklist.empty()) {
+    MachineLoop *L = Worklist.pop_back_val();
+    Worklist.append(L->begin(), L->end());
+
+    Align LoopAlign = TLI->getPrefLoopAlignment(L);
+    if (LoopAlign == 1)
+      continue;
+    MachineBasicBlock *Top = nullptr;
+    for (MachineBasicBlock &MBB : MF) {
+      if (L->contains(&MBB)) {
+        Top = &MBB;
+        break;
+      }
+    }
+    if (Top->getAlignment() >= LoopAlign)
+      continue;
+    Top->setAlignment(LoopAlign);
+    NumAlignedLoops++;
+    Changed = true;
+  }
+  return Changed;
+}
+
+bool PatmosBlockPlacement::placeBlocks(MachineFunction &MF) {
+  PatmosMachineFunctionInfo &PMFI = *MF.getInfo<PatmosMachineFunctionInfo>();
+  const PatmosAnalysisInfo &PAI = PMFI.getAnalysisInfo();
+  const MachineBlockFrequencyInfo &MBFI =
+      getAnalysis<MachineBlockFrequencyInfo>();
+  const MachineBranchProbabilityInfo &MBPI =
+      getAnalysis<MachineBranchProbabilityInfo>();
+
+  // One chain per block to start with, and the branches we can rewrite.
+  std::vector<Chain> Chains(MF.size());
+  DenseMap<MachineBasicBlock*, bool> Analyzable;
+  DenseMap<MachineBasicBlock*, MachineBasicBlock*> OldLayoutSucc;
+  ChainOf.clear();
+  unsigned Idx = 0;
+  for (MachineBasicBlock &MBB : MF) {
+    Chains[Idx].Blocks.push_back(&MBB);
+    Chains[Idx].Size = getSize(MBB);
+    ChainOf[&MBB] = &Chains[Idx++];
+
+    MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+    SmallVector<MachineOperand, 2> Cond;
+    Analyzable[&MBB] = !TII->analyzeBranch(MBB, TBB, FBB, Cond, false);
+    OldLayoutSucc[&MBB] = MBB.getNextNode();
+  }
+
+  // Blocks that fall through in ways we do not understand keep their
+  // successor.
+  for (MachineBasicBlock &MBB : MF) {
+    if (!Analyzable[&MBB] && MBB.getNextNode() && TII->mayFallthrough(MBB))
+      merge(&MBB, MBB.getNextNode(), true);
+  }
+
+  // Collect the edges that may become fall-throughs.
+  bool UseImported = PAI.hasFrequencies();
+  std::vector<Edge> Edges;
+  for (MachineBasicBlock &MBB : MF) {
+    if (!Analyzable[&MBB])
+      continue;
+    uint64_t Freq = UseImported ? std::max<int64_t>(PAI.getFrequency(&MBB, 0),
+                                                    0)
+                                : MBFI.getBlockFreq(&MBB).getFrequency();
+    for (MachineBasicBlock *Succ : MBB.successors()) {
+      if (Succ == &MBB || Succ == &MF.front() || Succ->isEHPad())
+        continue;
+      uint64_t Weight = UseImported
+          ? std::min<uint64_t>(Freq, std::max<int64_t>(
+                                         PAI.getFrequency(Succ, 0), 0))
+          : (MBFI.getBlockFreq(&MBB) *
+             MBPI.getEdgeProbability(&MBB, Succ)).getFrequency();
+      bool Critical = PAI.isCritical(&MBB) && PAI.isCritical(Succ);
+      Edges.push_back({&MBB, Succ, Critical, Weight});
+    }
+  }
+  std::sort(Edges.begin(), Edges.end());
+
+  for (const Edge &E : Edges) {
+    if (merge(E.Src, E.Dst, false)) {
+      LLVM_DEBUG(dbgs() << "Fall-through " << printMBBReference(*E.Src)
+                        << " -> " << printMBBReference(*E.Dst)
+                        << (E.Critical ? " (critical)" : "") << " weight "
+                        << E.Weight << "\n");
+    }
+  }
+
+  // The entry chain first, then the others by the importance of their head.
+  std::vector<Chain*> Order;
+  for (Chain &C : Chains)
+    if (!C.Blocks.empty())
+      Order.push_back(&C);
+  auto Importance = [&](const Chain *C) {
+    MachineBasicBlock *Head = C->Blocks.front();
+    uint64_t Freq = UseImported
+        ? std::max<int64_t>(PAI.getFrequency(Head, 0), 0)
+        : MBFI.getBlockFreq(Head).getFrequency();
+    return std::make_pair(PAI.isCritical(Head), Freq);
+  };
+  Chain *Entry = ChainOf[&MF.front()];
+  std::stable_sort(Order.begin(), Order.end(),
+                   [&](const Chain *A, const Chain *B) {
+                     if (A == Entry || B == Entry)
+                       return A == Entry && B != Entry;
+                     return Importance(A) > Importance(B);
+                   });
+
+  // Move the blocks, and rewrite the branches for the new layout.
+  bool Changed = false;
+  MachineBasicBlock *Prev = nullptr;
+  for (Chain *C : Order) {
+    for (MachineBasicBlock *MBB : C->Blocks) {
+      if (Prev && Prev->getNextNode() != MBB) {
+        MBB->moveAfter(Prev);
+        NumMoved++;
+        Changed = true;
+      }
+      Prev = MBB;
+    }
+  }
+  if (!Changed)
+    return false;
+
+  for (MachineBasicBlock &MBB : MF) {
+    if (!Analyzable[&MBB])
+      continue;
+    MBB.updateTerminator(OldLayoutSucc[&MBB]);
+    PMFI.invalidateBlockSize(&MBB);
+    if (MBB.getNextNode() && MBB.isSuccessor(MBB.getNextNode()))
+      NumFallthroughs++;
+  }
+  return true;
+}
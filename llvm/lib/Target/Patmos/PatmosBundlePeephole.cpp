@@ -0,0 +1,299 @@
+//===-- PatmosBundlePeephole.cpp - Late bundle-level peephole optimizations ===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A late peephole pass over the final bundles, after the delay slots have been
+// filled or killed.
+//
+// - Special-register moves (mts) to s0, sl and sh are removed if the special
+//   register is overwritten before it is read, or if they write back the value
+//   that has just been read by a mfs.
+// - Two adjacent single-issue instructions are merged into one bundle if they
+//   are independent and fit into the two issue slots.
+//
+// Both transformations remove a cycle from the code. This is only done
+// outside of delay slots, and only if no load or multiplication is issued in
+// the cycles before, so that no latency is violated by moving the following
+// instructions up. Alignments are ensured by PatmosEnsureAlignment afterwards,
+// and the sizes of the (sub-)functions are computed from labels, so the
+// method cache regions remain valid.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosRegisterInfo.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBundle.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-bundle-peephole"
+
+STATISTIC(NumDeadSRegMoves, "Number of dead special-register moves removed");
+STATISTIC(NumMergedBundles, "Number of single-issue instructions bundled");
+
+namespace {
+
+  class PatmosBundlePeephole : public MachineFunctionPass {
+  private:
+    static char ID;
+
+    const PatmosInstrInfo *TII;
+    const PatmosRegisterInfo *TRI;
+
+    /// Number of cycles before a removed cycle that must not contain loads or
+    /// multiplications.
+    static const unsigned LatencyWindow = 3;
+
+    /// Check if the cycle of II can be removed, i.e., if the following
+    /// instructions can be moved up by one cycle.
+    bool canRemoveCycle(MachineBasicBlock &MBB,
+                        MachineBasicBlock::iterator II) const;
+
+    /// Check if MI reads the special register SReg, directly or through the
+    /// predicate registers for s0.
+    bool readsSReg(const MachineInstr &MI, unsigned SReg) const;
+
+    /// Check if the mts MI is dead or writes back the value of the
+    /// special register.
+    bool isRedundantSRegMove(MachineBasicBlock &MBB,
+                             MachineBasicBlock::iterator II) const;
+
+    /// Check if the single instructions First and Second can be issued in the
+    /// same cycle, first in slot 0.
+    bool canBundle(const MachineInstr &First, const MachineInstr &Second) const;
+
+    bool removeSRegMoves(MachineBasicBlock &MBB);
+
+    bool mergeBundles(MachineBasicBlock &MBB);
+
+  public:
+    PatmosBundlePeephole(PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID),
+        TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())),
+        TRI(static_cast<const PatmosRegisterInfo*>(tm.getRegisterInfo())) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Bundle Peephole";
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override {
+      LLVM_DEBUG(dbgs() << "\n[BundlePeephole] "
+                        << MF.getFunction().getName() << "\n");
+
+      PatmosMachineFunctionInfo *PMFI = MF.getInfo<PatmosMachineFunctionInfo>();
+
+      bool Changed = false;
+      for (MachineBasicBlock &MBB : MF) {
+        bool BlockChanged = removeSRegMoves(MBB);
+        BlockChanged |= mergeBundles(MBB);
+        if (BlockChanged)
+          PMFI->invalidateBlockSize(&MBB);
+        Changed |= BlockChanged;
+      }
+      return Changed;
+    }
+  };
+
+  char PatmosBundlePeephole::ID = 0;
+} // end of anonymous namespace
+
+/// createPatmosBundlePeepholePass - Returns a pass that removes redundant
+/// special-register moves and merges single-issue instructions into bundles.
+///
+FunctionPass *llvm::createPatmosBundlePeepholePass(PatmosTargetMachine &tm) {
+  return new PatmosBundlePeephole(tm);
+}
+
+/// Check if the instruction or bundle contains a load or a multiplication.
+static bool hasLatency(const MachineInstr &MI) {
+  MachineBasicBlock::const_instr_iterator I = MI.getIterator(),
+                                          E = MI.getParent()->instr_end();
+  if (MI.isBundle())
+    ++I;
+  do {
+    unsigned Opc = I->getOpcode();
+    if (I->mayLoad() || Opc == Patmos::MUL || Opc == Patmos::MULU)
+      return true;
+    ++I;
+  } while (I != E && I->isBundledWithPred());
+  return false;
+}
+
+bool PatmosBundlePeephole::canRemoveCycle(MachineBasicBlock &MBB,
+                                    MachineBasicBlock::iterator II) const {
+  // Do not change the number of cycles in delay slots.
+  auto J = II;
+  if (TII->findPrevDelaySlotEnd(MBB, J, 0) < 0 || II->hasDelaySlot())
+    return false;
+
+  // Results of loads and multiplications must not be read earlier. At the
+  // start of a block we do not know what has been issued before.
+  auto K = II;
+  for (unsigned i = 0; i < LatencyWindow; i++) {
+    if (K == MBB.begin())
+      return false;
+    K = TII->prevNonPseudo(MBB, K);
+    if (K->isInlineAsm() || hasLatency(*K))
+      return false;
+  }
+  return true;
+}
+
+bool PatmosBundlePeephole::readsSReg(const MachineInstr &MI,
+                                     unsigned SReg) const {
+  if (MI.readsRegister(SReg, TRI))
+    return true;
+
+  // Predicates are the bits of s0, but are not modelled as sub-registers.
+  if (SReg == Patmos::S0) {
+    for (const MachineOperand &MO : MI.operands())
+      if (MO.isReg() && TRI->isPReg(MO.getReg()) &&
+          MO.getReg() != Patmos::P0)
+        return true;
+  }
+  return false;
+}
+
+bool PatmosBundlePeephole::isRedundantSRegMove(MachineBasicBlock &MBB,
+                                     MachineBasicBlock::iterator II) const {
+  MachineInstr &MTS = *II;
+  unsigned SReg = MTS.getOperand(0).getReg();
+  Register Src = MTS.getOperand(3).getReg();
+  if (!TII->isSideEffectFreeSRegAccess(&MTS))
+    return false;
+
+  bool Unpredicated = !TII->isPredicated(MTS);
+
+  // mfs r = s; ... mts s = r writes back the value of s. Look for the mfs
+  // in the previous instructions.
+  if (Unpredicated) {
+    for (MachineBasicBlock::instr_iterator I = MTS.getIterator(),
+                                           B = MBB.instr_begin(); I != B; ) {
+      --I;
+      if (I->isBundle() || I->isDebugInstr())
+        continue;
+      if (I->getOpcode() == Patmos::MFS && I->getOperand(0).getReg() == Src &&
+          I->getOperand(3).getReg() == SReg && !TII->isPredicated(*I))
+        return true;
+      if (I->isCall() || I->isInlineAsm() || I->modifiesRegister(Src, TRI) ||
+          I->modifiesRegister(SReg, TRI) ||
+          (SReg == Patmos::S0 && readsSReg(*I, SReg)))
+        break;
+    }
+  }
+
+  // Otherwise it must be overwritten before any read.
+  for (MachineBasicBlock::instr_iterator I = std::next(MTS.getIterator()),
+                                         E = MBB.instr_end(); I != E; ++I) {
+    if (I->isBundle() || I->isDebugInstr())
+      continue;
+    if (I->isCall() || I->isReturn() || I->isBranch() || I->isInlineAsm() ||
+        readsSReg(*I, SReg))
+      return false;
+    if (I->modifiesRegister(SReg, TRI)) {
+      // A guarded definition only overwrites the register for its guard.
+      return I->getOpcode() == Patmos::MTS &&
+             (!TII->isPredicated(*I) ||
+              (!Unpredicated &&
+               I->getOperand(1).getReg() == MTS.getOperand(1).getReg() &&
+               I->getOperand(2).getImm() == MTS.getOperand(2).getImm()));
+    }
+  }
+
+  // The special register might be live out of the block.
+  return false;
+}
+
+bool PatmosBundlePeephole::removeSRegMoves(MachineBasicBlock &MBB) {
+  bool Changed = false;
+  for (MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end(); I != E; ) {
+    MachineBasicBlock::iterator II = I++;
+
+    if (II->isBundle() || II->getOpcode() != Patmos::MTS ||
+        !isRedundantSRegMove(MBB, II) || !canRemoveCycle(MBB, II))
+      continue;
+
+    LLVM_DEBUG(dbgs() << "Removing redundant special-register move " << *II);
+    MBB.erase(II);
+    NumDeadSRegMoves++;
+    Changed = true;
+  }
+  return Changed;
+}
+
+bool PatmosBundlePeephole::canBundle(const MachineInstr &First,
+                                     const MachineInstr &Second) const {
+  const PatmosMachineFunctionInfo *PMFI =
+       First.getParent()->getParent()->getInfo<PatmosMachineFunctionInfo>();
+  for (const MachineInstr *MI : {&First, &Second}) {
+    if (MI->isBundled() || PMFI->isTracingSledInstr(MI) || MI->isBundle() || TII->isPseudo(MI) ||
+        MI->isInlineAsm() || MI->isCall() || MI->isReturn() ||
+        MI->isBranch() || MI->hasDelaySlot() ||
+        MI->hasUnmodeledSideEffects() || TII->isStackControl(MI) ||
+        TII->getIssueWidth(MI) != 1)
+      return false;
+    if ((MI->getOpcode() == Patmos::MTS || MI->getOpcode() == Patmos::MFS) &&
+        !TII->isSideEffectFreeSRegAccess(MI))
+      return false;
+  }
+
+  if (!TII->canIssueInSlot(&First, 0) || !TII->canIssueInSlot(&Second, 1))
+    return false;
+
+  // Memory accesses are kept in their order.
+  if (First.mayLoadOrStore() && Second.mayLoadOrStore())
+    return false;
+
+  // All operands of a bundle are read before any result is written, so
+  // only true and output dependencies prevent bundling.
+  for (const MachineOperand &MO : First.operands()) {
+    if (!MO.isReg() || !MO.isDef())
+      continue;
+    if (Second.readsRegister(MO.getReg(), TRI) ||
+        Second.modifiesRegister(MO.getReg(), TRI) ||
+        (TRI->isPReg(MO.getReg()) && readsSReg(Second, Patmos::S0)))
+      return false;
+  }
+  if (First.modifiesRegister(Patmos::S0, TRI) &&
+      readsSReg(Second, Patmos::S0))
+    return false;
+
+  return true;
+}
+
+bool PatmosBundlePeephole::mergeBundles(MachineBasicBlock &MBB) {
+  bool Changed = false;
+  for (MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end(); I != E; ) {
+    MachineBasicBlock::iterator First = I++;
+    if (I == E)
+      break;
+
+    MachineBasicBlock::iterator Second = I;
+    if (!canBundle(*First, *Second) || !canRemoveCycle(MBB, Second))
+      continue;
+
+    LLVM_DEBUG(dbgs() << "Bundling " << *First << "    with " << *Second);
+    MachineBasicBlock::instr_iterator Begin = First.getInstrIterator();
+    MachineBasicBlock::instr_iterator End =
+        std::next(Second.getInstrIterator());
+    finalizeBundle(MBB, Begin, End);
+    NumMergedBundles++;
+    Changed = true;
+
+    // Continue after the new bundle.
+    I = MachineBasicBlock::iterator(End);
+  }
+  return Changed;
+}
@@ -12,9 +12,15 @@
 //===----------------------------------------------------------------------===//
 
 #include "PatmosCallGraphBuilder.h"
+#include "PatmosLibrarySummary.h"
+#include "PatmosMachineFunctionInfo.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/CodeGen/MachineMemOperand.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -24,6 +30,16 @@ using namespace llvm;
 
 #define DEBUG_TYPE "patmos-call-graph-builder"
 
+STATISTIC(NumResolvedIndirect, "Number of indirect calls resolved to a single callee");
+
+static cl::opt<bool> ResolveIndirectCalls(
+  "mpatmos-mcg-resolve-indirect-calls",
+  cl::init(false),
+  cl::desc("Resolve indirect calls whose callee can only be a single function "
+           "(e.g., loaded from a constant function pointer) instead of "
+           "calling an unknown node in the machine-level call graph."),
+  cl::Hidden);
+
 INITIALIZE_PASS(PatmosCallGraphBuilder, "patmos-mcg",
                 "Patmos Call Graph Builder", false, true)
 
@@ -50,7 +66,9 @@ namespace llvm {
     std::string tmps;
     raw_string_ostream tmp(tmps);
 
-    if (isUnknown())
+    if (isLibrary())
+      tmp << "<LIBRARY-" << Name << ">";
+    else if (isUnknown())
       tmp << "<UNKNOWN-"<< *T << ">";
     else
       tmp << MF->getFunction().getName();
@@ -220,31 +238,33 @@ namespace llvm {
     MachineBasicBlock *MBB = MI->getParent();
     MachineFunction *MF = MBB->getParent();
 
-    for(auto i = scc_begin(MF), ie = scc_end(MF);
-        i != ie; ++i)
-    {
-      if (i.hasCycle())
+    // compute the blocks within CFG cycles only once per function
+    auto cached = CyclicBlocks.find(MF);
+    if (cached == CyclicBlocks.end()) {
+      SmallPtrSet<const MachineBasicBlock *, 16> &cyclic = CyclicBlocks[MF];
+      for(auto i = scc_begin(MF), ie = scc_end(MF);
+          i != ie; ++i)
       {
-        if (std::find(i->begin(), i->end(), MBB) != i->end())
-          return true;
+        if (i.hasCycle())
+          cyclic.insert(i->begin(), i->end());
       }
+      return cyclic.count(MBB);
     }
 
-    return false;
+    return cached->second.count(MBB);
   }
 
   MCGNode *MCallGraph::makeMCGNode(MachineFunction *MF)
   {
     // does a call graph node for the machine function exist?
-    for(MCGNodes::const_iterator i(Nodes.begin()), ie(Nodes.end()); i != ie;
-        i++) {
-      if ((*i)->getMF() == MF)
-        return *i;
-    }
+    MCGNode *&MCGN = NodeMap[MF];
+    if (MCGN)
+      return MCGN;
 
     // construct a new call graph node for the MachineFunction
     MCGNode *newMCGN = new MCGNode(MF);
     Nodes.push_back(newMCGN);
+    MCGN = newMCGN;
 
     return newMCGN;
   }
@@ -254,7 +274,7 @@ namespace llvm {
     // does a call graph node for the Type exist?
     for(MCGNodes::const_iterator i(Nodes.begin()), ie(Nodes.end()); i != ie;
         i++) {
-      if ((*i)->isUnknown()) {
+      if ((*i)->isUnknown() && !(*i)->isLibrary()) {
         if (areTypesIsomorphic((*i)->getType(), T)) {
           // mark all elements with -1 as 1
           for(equivalent_types_t::iterator j(EQ.begin()), je(EQ.end()); j != je;
@@ -283,6 +303,20 @@ namespace llvm {
     return newMCGN;
   }
 
+  MCGNode *MCallGraph::getLibraryNode(StringRef Name, Type *T)
+  {
+    // does a call graph node for the library function exist?
+    MCGNode *&MCGN = LibraryNodes[Name];
+    if (MCGN)
+      return MCGN;
+
+    MCGNode *newMCGN = new MCGNode(T, Name);
+    Nodes.push_back(newMCGN);
+    MCGN = newMCGN;
+
+    return newMCGN;
+  }
+
   MCGSite *MCallGraph::makeMCGSite(MCGNode *Caller, MachineInstr *MI,
                                    MCGNode *Callee)
   {
@@ -401,6 +435,47 @@ namespace llvm {
 
   //----------------------------------------------------------------------------
 
+  const Function *
+  PatmosCallGraphBuilder::resolveIndirectCallee(const Value *Callee)
+  {
+    if (!Callee)
+      return NULL;
+
+    Callee = Callee->stripPointerCasts();
+
+    if (const Function *F = dyn_cast<Function>(Callee))
+      return F;
+
+    // a function pointer loaded from a constant global
+    if (const LoadInst *LI = dyn_cast<LoadInst>(Callee)) {
+      const GlobalVariable *GV = dyn_cast<GlobalVariable>(
+                                   LI->getPointerOperand()->stripPointerCasts());
+      if (GV && GV->isConstant() && GV->hasDefinitiveInitializer())
+        return dyn_cast<Function>(GV->getInitializer()->stripPointerCasts());
+      return NULL;
+    }
+
+    // all alternatives have to agree on the callee
+    SmallVector<const Value *, 4> Incoming;
+    if (const SelectInst *SI = dyn_cast<SelectInst>(Callee)) {
+      Incoming.push_back(SI->getTrueValue());
+      Incoming.push_back(SI->getFalseValue());
+    }
+    else if (const PHINode *PN = dyn_cast<PHINode>(Callee)) {
+      Incoming.append(PN->op_begin(), PN->op_end());
+    }
+
+    const Function *Unique = NULL;
+    for(const Value *V : Incoming) {
+      const Function *F = dyn_cast<Function>(V->stripPointerCasts());
+      if (!F || (Unique && Unique != F))
+        return NULL;
+      Unique = F;
+    }
+
+    return Unique;
+  }
+
   void PatmosCallGraphBuilder::visitCallSites(const Module &M, MachineFunction *MF)
   {
     // get the machine-level module information.
@@ -435,14 +510,36 @@ namespace llvm {
             // try at least to get the function's type
             const Value *Callee = (*j->memoperands_begin())->getValue();
             T = Callee ? Callee->getType() : NULL;
+
+            if (!F && ResolveIndirectCalls) {
+              F = resolveIndirectCallee(Callee);
+              if (F)
+                NumResolvedIndirect++;
+            }
           }
 
           // does a MachineFunction exist for F?
           MachineFunction *MF = F ? MMI.getMachineFunction(*F) : NULL;
 
+          // otherwise, is it summarized by a pre-compiled library?
+          StringRef LibraryName;
+          if (!MF && F)
+            LibraryName = F->getName();
+          else if (!MF && MO.isSymbol())
+            LibraryName = MO.getSymbolName();
+          if (!LibraryName.empty() &&
+              !PatmosLibrarySummaries::get().lookup(LibraryName))
+            LibraryName = StringRef();
+
           // construct a new call site
-          MCG.makeMCGSite(MCGN, &*j,
-                          MF ? MCG.makeMCGNode(MF) : MCG.getUnknownNode(T));
+          MCGNode *Callee;
+          if (MF)
+            Callee = MCG.makeMCGNode(MF);
+          else if (!LibraryName.empty())
+            Callee = MCG.getLibraryNode(LibraryName, T);
+          else
+            Callee = MCG.getUnknownNode(T);
+          MCG.makeMCGSite(MCGN, &*j, Callee);
         }
       }
     }
@@ -523,6 +620,14 @@ namespace llvm {
     if (entry)
       markLive(entry);
 
+    // interrupt handlers are entries of their own
+    for(MCGNodes::const_iterator i(MCG.getNodes().begin()),
+        ie(MCG.getNodes().end()); i != ie; i++) {
+      if ((*i)->getMF() && PatmosMachineFunctionInfo::isInterruptHandler(
+                                                 (*i)->getMF()->getFunction()))
+        markLive(*i);
+    }
+
     // Mark live nodes to be within SCCs (loops or recursion)
     MCG.markNodesInSCC();
 
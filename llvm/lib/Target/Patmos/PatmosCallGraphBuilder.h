@@ -22,6 +22,7 @@
 #include "llvm/IR/Type.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
 #include "llvm/Support/DOTGraphTraits.h"
@@ -59,6 +60,11 @@ namespace llvm {
     /// is NULL.
     Type *T;
 
+    /// Name of the function of a pre-compiled library represented by this
+    /// call graph node, if MF is NULL.
+    /// \see PatmosLibrarySummaries
+    std::string Name;
+
     /// The node's call sites.
     MCGSites Sites;
 
@@ -81,6 +87,12 @@ namespace llvm {
     /// Construct a new call graph node.
     explicit MCGNode(Type *t) : MF(NULL), T(t), IsDead(true), IsInSCC(false) {}
 
+    /// Construct a new call graph node for a library function.
+    MCGNode(Type *t, StringRef name) : MF(NULL), T(t), Name(name.str()),
+        IsDead(true), IsInSCC(false)
+    {
+    }
+
     /// getMF - Return the node's MachineFunction.
     MachineFunction *getMF() const
     {
@@ -130,6 +142,20 @@ namespace llvm {
       return MF == NULL;
     }
 
+    /// isLibrary - Check whether the node represents a function of a
+    /// pre-compiled library. Library nodes are UNKNOWN nodes without call
+    /// sites, their displacement is taken from the library summaries.
+    bool isLibrary() const
+    {
+      return MF == NULL && !Name.empty();
+    }
+
+    /// getLibraryName - Return the name of the library function.
+    StringRef getLibraryName() const
+    {
+      return Name;
+    }
+
     /// isInSCC - Returns whether the node's function is called from within a
     /// strongly connected component (either from within a loop or due to
     /// recursion).
@@ -225,6 +251,17 @@ namespace llvm {
     /// The graph's call sites.
     MCGSites Sites;
 
+    /// The node of each machine function, to avoid searching all nodes.
+    DenseMap<const MachineFunction *, MCGNode *> NodeMap;
+
+    /// The node of each library function.
+    StringMap<MCGNode *> LibraryNodes;
+
+    /// The basic blocks of each machine function that are within a cycle of
+    /// its CFG, computed once per function for isInSCC.
+    DenseMap<const MachineFunction *,
+             SmallPtrSet<const MachineBasicBlock *, 16> > CyclicBlocks;
+
     typedef std::map<std::pair<Type *, Type *>, int> equivalent_types_t;
     equivalent_types_t EQ;
 
@@ -278,6 +315,12 @@ namespace llvm {
       return NULL;
     }
 
+    /// findNode - Return the call graph node of the given function, or NULL
+    /// if none was constructed yet.
+    MCGNode *findNode(const MachineFunction *MF) const {
+      return NodeMap.lookup(MF);
+    }
+
     /// makeMCGNode - Return a call graph node for the MachineFunction. The node
     /// is either newly constructed, or, if one exists, a node from the nodes
     /// set associated with the MachineFunction is returned.
@@ -287,6 +330,10 @@ namespace llvm {
     /// of the given type.
     MCGNode *getUnknownNode(Type *t);
 
+    /// getLibraryNode - Get a pseudo call graph node for a function of a
+    /// pre-compiled library.
+    MCGNode *getLibraryNode(StringRef Name, Type *t);
+
     /// makeMCGSite - Return a call site.
     MCGSite *makeMCGSite(MCGNode *Caller, MachineInstr *MI, MCGNode *Callee);
 
@@ -399,6 +446,11 @@ namespace llvm {
     /// name.
     MCGNode *getMCGNode(const Module &M, const char *name);
 
+    /// resolveIndirectCallee - Try to find the single function an indirect
+    /// call through the given callee value may target. Returns NULL if the
+    /// target is not known.
+    static const Function *resolveIndirectCallee(const Value *Callee);
+
     /// visitCallSites - Visit all call-sites of the MachineFunction and append
     /// them to a simple machine-level call graph.
     void visitCallSites(const Module &M, MachineFunction *MF);
@@ -411,12 +463,7 @@ namespace llvm {
 
     /// getMCGNode - Return the call graph node of the given function.
     MCGNode *getNode(const MachineFunction *MF) const {
-      for(MCGNodes::const_iterator i(MCG.getNodes().begin()),
-          ie(MCG.getNodes().end()); i != ie; i++) {
-        if ((*i)->getMF() == MF)
-          return *i;
-      }
-      return NULL;
+      return MCG.findNode(MF);
     }
 
     /// getMCGNode - Return the call graph node of the given function.
@@ -542,12 +589,8 @@ namespace llvm {
     }
 
     std::string getNodeLabel(const MCGNode *N, const MCallGraph &G) {
-      if (N->isUnknown()) {
-        std::string tmp;
-        raw_string_ostream s(tmp);
-        s << "<UNKNOWN-" << *N->getType() << ">";
-        return s.str();
-      }
+      if (N->isUnknown())
+        return N->getLabel();
       else
         return N->getMF()->getFunction().getName().str();
     }
@@ -672,12 +715,8 @@ namespace llvm {
     }
 
     std::string getNodeLabel(const MCGNode *N, const MCallSubGraph &G) {
-      if (N->isUnknown()) {
-        std::string tmp;
-        raw_string_ostream s(tmp);
-        s << "<UNKNOWN-" << *N->getType() << ">";
-        return s.str();
-      }
+      if (N->isUnknown())
+        return N->getLabel();
       else
         return N->getMF()->getFunction().getName().str();
     }
@@ -0,0 +1,115 @@
+//===-- PatmosCriticalityImport.cpp - Import WCET analysis results. -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Import the block frequencies and criticalities of a WCET analysis of a
+// previous compilation into the PatmosAnalysisInfo of each function, such
+// that the code of the worst-case path is optimized in the next compilation.
+// The results are read from the PML file platin writes for an
+// -mpatmos-serialize export (see PatmosWCETProfile.h).
+//
+// If the analysis does not report the criticality of a block, the blocks on
+// the worst-case path, i.e., with a non-zero frequency, are critical. Blocks
+// of analysed functions that are missing in the profile are not on the
+// worst-case path. Functions that were not analysed keep no results.
+//
+// The results are kept per machine block, the pass thus runs again after
+// passes that change the blocks, which drops the results of removed blocks.
+// Blocks are matched by the name of their IR basic block, or their number.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosTargetMachine.h"
+#include "PatmosWCETProfile.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cmath>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-criticality-import"
+
+STATISTIC(ImportedFunctions, "Functions with imported WCET analysis results");
+STATISTIC(CriticalBlocks,    "Blocks imported as on the worst-case path");
+
+namespace {
+
+  class PatmosCriticalityImport : public MachineFunctionPass {
+  private:
+    /// The PML file to read.
+    std::string Filename;
+
+    /// The results of all functions in the file.
+    wcet_profile Profile;
+
+    static char ID;
+
+  public:
+    PatmosCriticalityImport(StringRef filename)
+      : MachineFunctionPass(ID), Filename(filename.str()) {}
+
+    StringRef getPassName() const override {
+      return "Patmos WCET Criticality Import";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesAll();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool doInitialization(Module &) override {
+      readWCETProfile(Filename, Profile);
+      return false;
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override {
+      PatmosAnalysisInfo &PAI =
+                   MF.getInfo<PatmosMachineFunctionInfo>()->getAnalysisInfo();
+      PAI.clear();
+
+      wcet_profile::const_iterator F =
+                                 Profile.find(MF.getFunction().getName().str());
+      if (F == Profile.end())
+        return false;
+
+      for (const MachineBasicBlock &MBB : MF) {
+        std::map<std::string, WCETBlockResult>::const_iterator B =
+                                            F->second.find(getWCETBlockKey(MBB));
+        WCETBlockResult Result;
+        if (B != F->second.end())
+          Result = B->second;
+
+        double Criticality = Result.Criticality >= 0 ? Result.Criticality
+                                      : (Result.Frequency > 0 ? 1.0 : 0.0);
+        PAI.setFrequency(&MBB, std::llround(Result.Frequency));
+        PAI.setCriticality(&MBB, Criticality);
+
+        if (PAI.isCritical(&MBB))
+          CriticalBlocks++;
+        LLVM_DEBUG(dbgs() << "WCET results of bb." << MBB.getNumber() << " ("
+                          << getWCETBlockKey(MBB) << ") in " << MF.getName()
+                          << ": frequency " << Result.Frequency
+                          << ", criticality " << Criticality << "\n");
+      }
+      ImportedFunctions++;
+      return false;
+    }
+  };
+
+  char PatmosCriticalityImport::ID = 0;
+} // end of anonymous namespace
+
+FunctionPass *llvm::createPatmosCriticalityImportPass(StringRef Filename) {
+  return new PatmosCriticalityImport(Filename);
+}
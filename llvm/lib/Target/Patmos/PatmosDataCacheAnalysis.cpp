@@ -0,0 +1,834 @@
+//===-- PatmosDataCacheAnalysis.cpp - Analysis of data-cache usage. -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Classify the loads through the data cache based on the accessed addresses
+// and the machine-level call graph.
+//
+// The address of an access is derived from the definitions of its base
+// register, within its block and its unique predecessors: absolute addresses,
+// lines of globals and of the shadow stack frame, or an unknown line of a
+// global indexed by a register. A line is the block of memory the cache
+// fills in one burst.
+//
+// For every load:
+//   - a must analysis bounds the LRU age of the lines in every set. If the
+//     line of the load is always cached, the load always hits.
+//   - for a direct-mapped cache, lines are never cached after a load of a
+//     line that is mapped to the same set. The load then always misses.
+//   - otherwise, if a loop only loads from lines of at most as many objects
+//     as the cache has ways and each of them fits into a way, no line loaded
+//     in the loop is evicted while the loop executes: the load is persistent,
+//     it misses at most once per entry of the loop.
+// Set-associative caches are assumed to use LRU replacement. Stores write
+// through without allocating lines. Calls of functions that may load data
+// through the data cache, inline assembly and I/O stores, which might
+// control the cache, invalidate the analysis state.
+//
+// Loads that always miss are scheduled like other main memory accesses. The
+// results are exported per load instruction into the PML file.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "MachineModulePass.h"
+#include "MCTargetDesc/PatmosBaseInfo.h"
+#include "PatmosCallGraphBuilder.h"
+#include "PatmosDataCacheAnalysis.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineDominators.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <set>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-data-cache-analysis"
+
+STATISTIC(AlwaysHitLoads, "Loads that always hit in the data cache");
+STATISTIC(AlwaysMissLoads, "Loads that always miss in the data cache");
+STATISTIC(PersistentLoads, "Loads that miss at most once per loop entry");
+STATISTIC(UnclassifiedLoads, "Data cache loads that are not classified");
+
+/// Start of the I/O devices in the local address space.
+static const uint64_t IOBase = 0xF0000000;
+
+INITIALIZE_PASS(PatmosDataCacheAnalysisInfo, "dcainfo",
+                "Data Cache Analysis Info", false, true)
+
+namespace llvm {
+char PatmosDataCacheAnalysisInfo::ID = 0;
+
+ModulePass *createPatmosDataCacheAnalysisInfo(const PatmosTargetMachine &tm) {
+  return new PatmosDataCacheAnalysisInfo(tm);
+}
+}
+
+namespace {
+  /// A line of an object in the data cache.
+  struct DCBlock {
+    /// The accessed object: a global, the shadow stack frame of the
+    /// function, or null for absolute addresses.
+    const void *Object;
+
+    /// The line within the object, or the offset of the access in bytes if
+    /// the object is not aligned to the lines.
+    int64_t Index;
+
+    DCBlock() : Object(NULL), Index(0) {}
+
+    bool operator<(const DCBlock &B) const {
+      return Object < B.Object || (Object == B.Object && Index < B.Index);
+    }
+
+    bool operator==(const DCBlock &B) const {
+      return Object == B.Object && Index == B.Index;
+    }
+  };
+
+  /// The address of a data cache access, as far as it is known.
+  struct DCAccess {
+    enum AccessKind {
+      /// Any line might be accessed.
+      Unknown,
+      /// An unknown line of the object of the block is accessed.
+      Object,
+      /// The line of the block is accessed.
+      Line
+    };
+
+    AccessKind Kind;
+    DCBlock B;
+
+    DCAccess() : Kind(Unknown) {}
+  };
+
+  /// The size and alignment of an accessed object.
+  struct DCObject {
+    /// The size of the object in bytes, 0 if it is not known.
+    uint64_t Size;
+
+    /// The object is aligned to the lines of the data cache.
+    bool Aligned;
+
+    DCObject() : Size(0), Aligned(false) {}
+  };
+
+  /// The abstract state of the data cache at a program point.
+  struct DCState {
+    /// The state was reached by the analysis.
+    bool Reached;
+
+    /// Upper bounds of the LRU ages of the lines that are always cached.
+    std::map<DCBlock, unsigned> Must;
+
+    /// Lines that are never cached (direct-mapped caches only).
+    std::set<DCBlock> Evicted;
+
+    DCState() : Reached(false) {}
+
+    void clear() {
+      Must.clear();
+      Evicted.clear();
+    }
+
+    /// join - Merge the state of another path, return true if the state
+    /// changed.
+    bool join(const DCState &S) {
+      if (!Reached) {
+        *this = S;
+        Reached = true;
+        return true;
+      }
+
+      bool Changed = false;
+      for (std::map<DCBlock, unsigned>::iterator i(Must.begin());
+           i != Must.end();) {
+        std::map<DCBlock, unsigned>::const_iterator j = S.Must.find(i->first);
+        if (j == S.Must.end()) {
+          i = Must.erase(i);
+          Changed = true;
+          continue;
+        }
+        if (j->second > i->second) {
+          i->second = j->second;
+          Changed = true;
+        }
+        i++;
+      }
+
+      for (std::set<DCBlock>::iterator i(Evicted.begin());
+           i != Evicted.end();) {
+        if (!S.Evicted.count(*i)) {
+          i = Evicted.erase(i);
+          Changed = true;
+        } else {
+          i++;
+        }
+      }
+      return Changed;
+    }
+  };
+
+  /// Pass to classify the loads through the data cache.
+  class PatmosDataCacheAnalysis : public MachineModulePass {
+  private:
+    typedef std::map<const MachineInstr*, DCAccess> DCAccesses;
+
+    const PatmosSubtarget &STC;
+    const PatmosInstrInfo &TII;
+    const TargetRegisterInfo &TRI;
+
+    /// Geometry of the data cache.
+    unsigned BlockSize;
+    unsigned Ways;
+    unsigned Sets;
+
+    /// The accessed objects, by global or frame of a function.
+    std::map<const void*, DCObject> Objects;
+
+    /// Functions that may load data through the data cache, including
+    /// their callees.
+    std::set<const MCGNode*> Loading;
+
+    /// The calls of the current function that may clobber the data cache.
+    std::map<const MachineInstr*, bool> CallsLoading;
+
+    /// The data cache accesses of the current function.
+    DCAccesses Accesses;
+
+    /// The lines loaded by the current function.
+    std::set<DCBlock> Universe;
+
+    static bool isDataCacheAccess(const MachineInstr &MI) {
+      switch (MI.getOpcode()) {
+      case Patmos::LWC: case Patmos::LHC: case Patmos::LBC:
+      case Patmos::LHUC: case Patmos::LBUC:
+      case Patmos::SWC: case Patmos::SHC: case Patmos::SBC:
+        return true;
+      default:
+        return false;
+      }
+    }
+
+    static bool isLocalStore(const MachineInstr &MI) {
+      switch (MI.getOpcode()) {
+      case Patmos::SWL: case Patmos::SHL: case Patmos::SBL:
+        return true;
+      default:
+        return false;
+      }
+    }
+
+    /// getAccessSize - Return the number of bytes an access of the given
+    /// opcode transfers, by which its offset is scaled.
+    static unsigned getAccessSize(unsigned Opcode) {
+      switch (Opcode) {
+      case Patmos::LHC: case Patmos::LHUC: case Patmos::SHC:
+      case Patmos::LHL: case Patmos::LHUL: case Patmos::SHL:
+        return 2;
+      case Patmos::LBC: case Patmos::LBUC: case Patmos::SBC:
+      case Patmos::LBL: case Patmos::LBUL: case Patmos::SBL:
+        return 1;
+      default:
+        return 4;
+      }
+    }
+
+    /// fits - Check whether the lines of an object are all mapped to
+    /// different sets.
+    bool fits(const void *Object) const {
+      std::map<const void*, DCObject>::const_iterator O = Objects.find(Object);
+      if (!Object || O == Objects.end() || !O->second.Size)
+        return false;
+
+      uint64_t Span = O->second.Size + (O->second.Aligned ? 0 : BlockSize - 1);
+      return alignTo(Span, BlockSize) <= (uint64_t)Sets * BlockSize;
+    }
+
+    /// isAligned - Check whether the indices of the blocks of an object are
+    /// lines.
+    bool isAligned(const void *Object) const {
+      std::map<const void*, DCObject>::const_iterator O = Objects.find(Object);
+      return !Object || (O != Objects.end() && O->second.Aligned);
+    }
+
+    /// mayAlias - Check whether two blocks might be the same line.
+    bool mayAlias(const DCBlock &A, const DCBlock &B) const {
+      if (A.Object != B.Object)
+        return !A.Object || !B.Object;
+      if (isAligned(A.Object))
+        return A.Index == B.Index;
+      return std::abs(A.Index - B.Index) < (int64_t)BlockSize;
+    }
+
+    /// mayConflict - Check whether a different line than A is accessed by
+    /// an access to A that might be mapped to the same set as B.
+    bool mayConflict(const DCBlock &A, const DCBlock &B) const {
+      if (A.Object != B.Object)
+        return true;
+      if (fits(A.Object))
+        return false;
+      if (isAligned(A.Object))
+        return (A.Index - B.Index) % Sets == 0;
+      return true;
+    }
+
+    /// mustConflict - Check whether A and B are different lines that are
+    /// mapped to the same set.
+    bool mustConflict(const DCBlock &A, const DCBlock &B) const {
+      return A.Object == B.Object && isAligned(A.Object) &&
+             A.Index != B.Index && (A.Index - B.Index) % Sets == 0;
+    }
+
+    /// getLine - Return the access of the given offset into an object, or
+    /// an unknown access if the offset is outside of the object.
+    DCAccess getLine(const void *Object, int64_t Offset) const {
+      DCAccess A;
+      if (Object) {
+        std::map<const void*, DCObject>::const_iterator O =
+                                                        Objects.find(Object);
+        if (O == Objects.end() || !O->second.Size || Offset < 0 ||
+            (uint64_t)Offset >= O->second.Size)
+          return A;
+        A.B.Index = O->second.Aligned ? Offset / BlockSize : Offset;
+      } else {
+        A.B.Index = (uint32_t)Offset / BlockSize;
+      }
+      A.Kind = DCAccess::Line;
+      A.B.Object = Object;
+      return A;
+    }
+
+    /// addGlobal - Add a global as an accessed object, return it or null if
+    /// its storage is not known.
+    const GlobalVariable *addGlobal(const GlobalValue *GV) {
+      const GlobalVariable *Var = dyn_cast<GlobalVariable>(GV);
+      if (!Var)
+        return NULL;
+
+      DCObject &O = Objects[Var];
+      const DataLayout &DL = Var->getParent()->getDataLayout();
+      if (Var->getValueType()->isSized())
+        O.Size = DL.getTypeAllocSize(Var->getValueType());
+      O.Aligned = Var->getPointerAlignment(DL).value() >= BlockSize;
+      return Var;
+    }
+
+    /// getBundleStart - Return the first instruction of the bundle of an
+    /// instruction, whose operands are read together.
+    static MachineBasicBlock::const_instr_iterator
+    getBundleStart(MachineBasicBlock::const_instr_iterator I) {
+      while (I->isBundledWithPred())
+        I--;
+      return I;
+    }
+
+    /// getAccess - Derive the address of a data cache access from the
+    /// definitions of its base register.
+    DCAccess getAccess(const MachineInstr &MI) {
+      const MachineFunction &MF = *MI.getMF();
+      const PatmosMachineFunctionInfo &PMFI =
+                                      *MF.getInfo<PatmosMachineFunctionInfo>();
+
+      // The address follows the guard, its offset is scaled by the access'
+      // size
+      unsigned BaseIdx = MI.findFirstPredOperandIdx() + 2;
+      Register Reg = MI.getOperand(BaseIdx).getReg();
+      const MachineOperand &OffsetMO = MI.getOperand(BaseIdx + 1);
+      if (OffsetMO.isGlobal()) {
+        // a small global relative to the small data base
+        if (OffsetMO.getTargetFlags() == PatmosII::MO_SDA)
+          if (const GlobalVariable *GV = addGlobal(OffsetMO.getGlobal()))
+            return getLine(GV, OffsetMO.getOffset());
+        return DCAccess();
+      }
+      int64_t Offset = OffsetMO.getImm() * getAccessSize(MI.getOpcode());
+
+      const MachineBasicBlock *MBB = MI.getParent();
+      MachineBasicBlock::const_instr_iterator I =
+                                          getBundleStart(MI.getIterator());
+      std::set<const MachineBasicBlock*> Visited;
+      while (true) {
+        if (Reg == Patmos::R0)
+          return getLine(NULL, Offset);
+
+        // find the definition of the register, in the unique predecessors
+        const MachineInstr *Def = NULL;
+        while (!Def) {
+          if (I == MBB->instr_begin()) {
+            if (MBB->pred_size() != 1 ||
+                !Visited.insert(*MBB->pred_begin()).second)
+              break;
+            MBB = *MBB->pred_begin();
+            I = MBB->instr_end();
+            continue;
+          }
+          I--;
+          if (!I->isBundle() && I->modifiesRegister(Reg, &TRI))
+            Def = &*I;
+        }
+
+        if (Reg == Patmos::RSP) {
+          // the stack pointer is only changed by the frame setup, before
+          // the frame is released at the end of the function
+          if (MF.getFrameInfo().hasVarSizedObjects() ||
+              PMFI.isShrinkWrapped())
+            return DCAccess();
+          if (Def ? (Def->getOpcode() != Patmos::SUBi &&
+                     Def->getOpcode() != Patmos::SUBl)
+                  : MBB == &MF.front())
+            return DCAccess();
+          return getLine(&MF, Offset);
+        }
+
+        if (!Def || TII.isPredicated(*Def))
+          return DCAccess();
+
+        switch (Def->getOpcode()) {
+        case Patmos::ADDi: case Patmos::ADDl:
+          if (Def->getOperand(4).isGlobal()) {
+            // a global indexed by a register, e.g., an array access, or a
+            // small global relative to the small data base
+            DCAccess A;
+            if (const GlobalVariable *GV =
+                                    addGlobal(Def->getOperand(4).getGlobal())) {
+              if (Def->getOperand(4).getTargetFlags() == PatmosII::MO_SDA)
+                return getLine(GV, Offset + Def->getOperand(4).getOffset());
+              A.Kind = DCAccess::Object;
+              A.B.Object = GV;
+            }
+            return A;
+          }
+          if (!Def->getOperand(4).isImm())
+            return DCAccess();
+          Offset += Def->getOperand(4).getImm();
+          Reg = Def->getOperand(3).getReg();
+          I = getBundleStart(I);
+          continue;
+        case Patmos::MOV:
+          Reg = Def->getOperand(3).getReg();
+          I = getBundleStart(I);
+          continue;
+        case Patmos::LIi: case Patmos::LIl:
+          if (Def->getOperand(3).isGlobal()) {
+            if (const GlobalVariable *GV =
+                                    addGlobal(Def->getOperand(3).getGlobal()))
+              return getLine(GV, Offset + Def->getOperand(3).getOffset());
+          } else if (Def->getOperand(3).isImm()) {
+            return getLine(NULL, Offset + Def->getOperand(3).getImm());
+          }
+          return DCAccess();
+        case Patmos::LIin:
+          return getLine(NULL, Offset - Def->getOperand(3).getImm());
+        default:
+          return DCAccess();
+        }
+      }
+    }
+
+    /// isClobber - Check whether an instruction might load data through the
+    /// data cache or control the cache in some way that the analysis does
+    /// not track.
+    bool isClobber(const MachineInstr &MI) {
+      if (MI.isBundle())
+        return false;
+      if (MI.isInlineAsm())
+        return true;
+
+      if (MI.isCall()) {
+        std::map<const MachineInstr*, bool>::iterator C =
+                                                      CallsLoading.find(&MI);
+        return C == CallsLoading.end() || C->second;
+      }
+
+      // I/O devices are mapped into the local address space
+      if (isLocalStore(MI)) {
+        DCAccess A = getAccess(MI);
+        return A.Kind == DCAccess::Unknown ||
+               (!A.B.Object && (uint64_t)A.B.Index * BlockSize >= IOBase);
+      }
+      return false;
+    }
+
+    /// age - Age a line that might be mapped to the set of an accessed line.
+    void age(DCState &S, std::map<DCBlock, unsigned>::iterator &i) const {
+      if (++i->second >= Ways)
+        i = S.Must.erase(i);
+      else
+        i++;
+    }
+
+    /// update - Update the state by a data cache access.
+    void update(DCState &S, const MachineInstr &MI, const DCAccess &A) const {
+      bool Load = MI.mayLoad();
+      bool Executed = !TII.isPredicated(MI);
+
+      // write-through without allocation does not change a direct-mapped
+      // cache
+      if (!Load && Ways == 1)
+        return;
+
+      switch (A.Kind) {
+      case DCAccess::Unknown:
+        for (std::map<DCBlock, unsigned>::iterator i(S.Must.begin());
+             i != S.Must.end();)
+          age(S, i);
+        if (Load)
+          S.Evicted.clear();
+        break;
+
+      case DCAccess::Object:
+        // lines of an object that fits are not evicted by lines of the same
+        // object
+        for (std::map<DCBlock, unsigned>::iterator i(S.Must.begin());
+             i != S.Must.end();) {
+          if (i->first.Object != A.B.Object || !fits(A.B.Object))
+            age(S, i);
+          else
+            i++;
+        }
+        if (Load) {
+          for (std::set<DCBlock>::iterator i(S.Evicted.begin());
+               i != S.Evicted.end();) {
+            if (!i->Object || i->Object == A.B.Object)
+              i = S.Evicted.erase(i);
+            else
+              i++;
+          }
+        }
+        break;
+
+      case DCAccess::Line: {
+        std::map<DCBlock, unsigned>::iterator Old = S.Must.find(A.B);
+        unsigned OldAge = Old != S.Must.end() ? Old->second : Ways;
+        for (std::map<DCBlock, unsigned>::iterator i(S.Must.begin());
+             i != S.Must.end();) {
+          if (!(i->first == A.B) && i->second < OldAge &&
+              mayConflict(A.B, i->first))
+            age(S, i);
+          else
+            i++;
+        }
+
+        // a store only refreshes a cached line, a predicated access keeps
+        // the age of the line on the path it is not executed
+        if (Executed && (Load || S.Must.count(A.B)))
+          S.Must[A.B] = 0;
+
+        if (Load) {
+          for (std::set<DCBlock>::iterator i(S.Evicted.begin());
+               i != S.Evicted.end();) {
+            if (mayAlias(A.B, *i))
+              i = S.Evicted.erase(i);
+            else
+              i++;
+          }
+          if (Executed && Ways == 1) {
+            for (const DCBlock &B : Universe) {
+              if (mustConflict(A.B, B))
+                S.Evicted.insert(B);
+            }
+          }
+        }
+        break;
+      }
+      }
+    }
+
+    /// transfer - Update the state by the instructions of a block, and
+    /// classify the loads if Info is given.
+    void transfer(const MachineBasicBlock &MBB, DCState &S,
+                  PatmosDataCacheAnalysisInfo *Info) {
+      // delay slots execute before the callee
+      unsigned ClobberCycles = 0;
+      for (MachineBasicBlock::const_iterator i(MBB.begin()), ie(MBB.end());
+           i != ie; i++) {
+        bool Clobber = false;
+        MachineBasicBlock::const_instr_iterator j(i.getInstrIterator());
+        do {
+          if (isClobber(*j)) {
+            Clobber = true;
+          } else {
+            DCAccesses::const_iterator A = Accesses.find(&*j);
+            if (A != Accesses.end()) {
+              if (Info && j->mayLoad())
+                classify(S, *j, A->second, *Info);
+              update(S, *j, A->second);
+            }
+          }
+          j++;
+        } while (j != MBB.instr_end() && j->isBundledWithPred());
+
+        if (ClobberCycles) {
+          ClobberCycles--;
+          S.clear();
+        }
+        if (Clobber) {
+          S.clear();
+          ClobberCycles = i->isCall() ? STC.getDelaySlotCycles(*i) : 0;
+        }
+      }
+    }
+
+    /// classify - Classify a load by the state before it.
+    void classify(const DCState &S, const MachineInstr &MI, const DCAccess &A,
+                  PatmosDataCacheAnalysisInfo &Info) const {
+      PatmosDataCacheAnalysisInfo::LoadClass C;
+      C.Class = yaml::dc_none;
+      C.Scope = NULL;
+      if (A.Kind == DCAccess::Line) {
+        if (S.Must.count(A.B))
+          C.Class = yaml::dc_always_hit;
+        else if (S.Evicted.count(A.B))
+          C.Class = yaml::dc_always_miss;
+      }
+      Info.Loads[&MI] = C;
+    }
+
+    /// isPersistent - Check whether no line loaded in a loop is evicted
+    /// while the loop executes.
+    bool isPersistent(const MachineLoop *L) {
+      std::set<const void*> Objs;
+      std::map<int64_t, std::set<int64_t> > Absolute;
+      for (const MachineBasicBlock *MBB : L->blocks()) {
+        for (const MachineInstr &MI : MBB->instrs()) {
+          if (isClobber(MI))
+            return false;
+
+          DCAccesses::const_iterator A = Accesses.find(&MI);
+          if (A == Accesses.end() || !MI.mayLoad())
+            continue;
+          if (A->second.Kind == DCAccess::Unknown)
+            return false;
+          if (A->second.B.Object) {
+            if (!fits(A->second.B.Object))
+              return false;
+            Objs.insert(A->second.B.Object);
+          } else {
+            Absolute[A->second.B.Index % Sets].insert(A->second.B.Index);
+          }
+        }
+      }
+
+      // at most one line of every object in each set, absolute addresses
+      // might alias with them
+      unsigned Lines = 0;
+      for (const auto &Set : Absolute)
+        Lines = std::max(Lines, (unsigned)Set.second.size());
+      return Objs.size() + Lines <= Ways;
+    }
+
+    /// classifyLoops - Mark the unclassified loads of the outermost
+    /// persistent loops as persistent.
+    void classifyLoops(const MachineLoop *L,
+                       PatmosDataCacheAnalysisInfo &Info) {
+      if (!isPersistent(L)) {
+        for (const MachineLoop *SubLoop : *L)
+          classifyLoops(SubLoop, Info);
+        return;
+      }
+
+      for (const MachineBasicBlock *MBB : L->blocks()) {
+        for (const MachineInstr &MI : MBB->instrs()) {
+          PatmosDataCacheAnalysisInfo::LoadClasses::iterator C =
+                                                        Info.Loads.find(&MI);
+          if (C != Info.Loads.end() && C->second.Class == yaml::dc_none) {
+            C->second.Class = yaml::dc_persistent;
+            C->second.Scope = L->getHeader();
+          }
+        }
+      }
+    }
+
+    /// analyzeFunction - Classify the data cache loads of a function.
+    void analyzeFunction(const MCGNode *N, PatmosDataCacheAnalysisInfo &Info)
+    {
+      MachineFunction &MF = *N->getMF();
+
+      CallsLoading.clear();
+      for (const MCGSite *Site : N->getSites()) {
+        bool IsLoading = Loading.count(Site->getCallee()) != 0;
+        CallsLoading[Site->getMI()] |= IsLoading;
+      }
+
+      DCObject &Frame = Objects[&MF];
+      Frame.Size = MF.getFrameInfo().getStackSize();
+      Frame.Aligned = STC.getFrameLowering()->getStackAlign().value() >=
+                      BlockSize;
+
+      Accesses.clear();
+      Universe.clear();
+      for (const MachineBasicBlock &MBB : MF) {
+        for (const MachineInstr &MI : MBB.instrs()) {
+          if (!isDataCacheAccess(MI))
+            continue;
+          DCAccess A = getAccess(MI);
+          Accesses[&MI] = A;
+          if (MI.mayLoad() && A.Kind == DCAccess::Line)
+            Universe.insert(A.B);
+        }
+      }
+
+      // without a data cache, every load accesses the main memory
+      if (!Sets) {
+        for (const auto &A : Accesses) {
+          if (A.first->mayLoad()) {
+            PatmosDataCacheAnalysisInfo::LoadClass C;
+            C.Class = yaml::dc_always_miss;
+            C.Scope = NULL;
+            Info.Loads[A.first] = C;
+          }
+        }
+        return;
+      }
+
+      // compute the states at the block entries up to a fixpoint
+      std::map<const MachineBasicBlock*, DCState> States;
+      States[&MF.front()].Reached = true;
+      ReversePostOrderTraversal<MachineFunction*> RPOT(&MF);
+      bool Changed = true;
+      while (Changed) {
+        Changed = false;
+        for (MachineBasicBlock *MBB : RPOT) {
+          DCState S = States[MBB];
+          if (!S.Reached)
+            continue;
+          transfer(*MBB, S, NULL);
+          for (MachineBasicBlock *Succ : MBB->successors())
+            Changed |= States[Succ].join(S);
+        }
+      }
+
+      for (MachineBasicBlock *MBB : RPOT) {
+        DCState S = States[MBB];
+        if (S.Reached)
+          transfer(*MBB, S, &Info);
+      }
+
+      MachineDominatorTree MDT(MF);
+      MachineLoopInfo LI(MDT);
+      for (const MachineLoop *L : LI)
+        classifyLoops(L, Info);
+    }
+
+  public:
+    /// Pass ID
+    static char ID;
+
+    PatmosDataCacheAnalysis(const PatmosTargetMachine &tm) :
+        MachineModulePass(ID), STC(*tm.getSubtargetImpl()),
+        TII(*tm.getInstrInfo()), TRI(*STC.getRegisterInfo())
+    {
+      initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
+
+      BlockSize = STC.getDataCacheBlockSize();
+      Ways = STC.getDataCacheAssociativity();
+      Sets = STC.getDataCacheSize() / (BlockSize * Ways);
+    }
+
+    StringRef getPassName() const override {
+      return "Patmos Data Cache Analysis";
+    }
+
+    /// getAnalysisUsage - Inform the pass manager that nothing is modified.
+    void getAnalysisUsage(AnalysisUsage &AU) const override
+    {
+      AU.setPreservesAll();
+      AU.addRequired<PatmosCallGraphBuilder>();
+      AU.addRequired<PatmosDataCacheAnalysisInfo>();
+
+      ModulePass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineModule(const Module &M) override
+    {
+      PatmosCallGraphBuilder &PCGB = getAnalysis<PatmosCallGraphBuilder>();
+      PatmosDataCacheAnalysisInfo &DCAI =
+                                     getAnalysis<PatmosDataCacheAnalysisInfo>();
+      const MCGNodes &Nodes = PCGB.getNodes();
+
+      // the results of a previous run refer to instructions that might have
+      // been removed since
+      DCAI.Loads.clear();
+
+      // functions loading data themselves, and their callers
+      std::vector<const MCGNode*> WL;
+      for (const MCGNode *N : Nodes) {
+        bool Loads = N->isUnknown();
+        if (!Loads) {
+          for (const MachineBasicBlock &MBB : *N->getMF()) {
+            for (const MachineInstr &MI : MBB.instrs()) {
+              if (MI.isBundle())
+                continue;
+              if ((isDataCacheAccess(MI) && MI.mayLoad()) ||
+                  (MI.isCall() ? !N->findSite(&MI) : isClobber(MI)))
+                Loads = true;
+            }
+          }
+        }
+        if (Loads && Loading.insert(N).second)
+          WL.push_back(N);
+      }
+      while (!WL.empty()) {
+        const MCGNode *N = WL.back();
+        WL.pop_back();
+        for (const MCGSite *Site : N->getCallingSites()) {
+          if (Loading.insert(Site->getCaller()).second)
+            WL.push_back(Site->getCaller());
+        }
+      }
+
+      for (const MCGNode *N : Nodes) {
+        if (!N->isUnknown())
+          analyzeFunction(N, DCAI);
+      }
+
+      for (const auto &L : DCAI.Loads) {
+        switch (L.second.Class) {
+        case yaml::dc_always_hit:  AlwaysHitLoads++;    break;
+        case yaml::dc_always_miss: AlwaysMissLoads++;   break;
+        case yaml::dc_persistent:  PersistentLoads++;   break;
+        case yaml::dc_none:        UnclassifiedLoads++; break;
+        }
+        LLVM_DEBUG(dbgs() << "Data cache load in "
+                          << L.first->getMF()->getName() << ", bb."
+                          << L.first->getParent()->getNumber() << ": "
+                          << L.second.Class << "\t" << *L.first);
+      }
+
+      DCAI.setValid();
+
+      Objects.clear();
+      Loading.clear();
+      CallsLoading.clear();
+      Accesses.clear();
+      Universe.clear();
+
+      return false;
+    }
+  };
+
+  char PatmosDataCacheAnalysis::ID = 0;
+}
+
+/// createPatmosDataCacheAnalysis - Returns a new PatmosDataCacheAnalysis.
+ModulePass *
+llvm::createPatmosDataCacheAnalysis(const PatmosTargetMachine &tm) {
+  return new PatmosDataCacheAnalysis(tm);
+}
@@ -0,0 +1,66 @@
+//===-- PatmosDataCacheAnalysis.h - Analysis of the data-cache usage. -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Analysis results from the data cache analysis.
+// This is a dummy pass that holds analysis results when the data cache
+// analysis runs, in the same way as PatmosMethodCacheAnalysisInfo.
+//
+//===----------------------------------------------------------------------===//
+#ifndef PATMOSDATACACHEANALYSIS
+#define PATMOSDATACACHEANALYSIS
+
+#include "PML.h"
+
+namespace llvm {
+
+class PatmosDataCacheAnalysisInfo : public ImmutablePass {
+  bool Valid;
+
+public:
+  PatmosDataCacheAnalysisInfo(const TargetMachine &TM) : ImmutablePass(ID),
+    Valid(false) {
+      initializePatmosDataCacheAnalysisInfoPass(
+                                           *PassRegistry::getPassRegistry());
+    }
+
+  PatmosDataCacheAnalysisInfo()
+    : ImmutablePass(ID), Valid(false) {
+    llvm_unreachable("should not be implicitly constructed");
+  }
+
+  // the analysis info (pass) will always be available, with isValid() we can
+  // tell whether the analysis was run
+  void setValid() { Valid = true; }
+  bool isValid() const { return Valid; }
+
+  /// The classification of the data fetched by a load through the data
+  /// cache, and for persistent loads the header of the loop whose entries
+  /// the misses are counted for.
+  struct LoadClass {
+    yaml::DataCacheClass Class;
+    const MachineBasicBlock *Scope;
+  };
+
+  typedef std::map<const MachineInstr*, LoadClass> LoadClasses;
+
+  LoadClasses Loads;
+
+  /// isAlwaysMiss - Check whether a load is known to miss in the data cache,
+  /// i.e., to access the main memory.
+  bool isAlwaysMiss(const MachineInstr *MI) const {
+    LoadClasses::const_iterator it = Loads.find(MI);
+    return it != Loads.end() && it->second.Class == yaml::dc_always_miss;
+  }
+
+  static char ID; // Pass identification, replacement for typeid
+};
+
+} // End llvm namespace
+
+#endif
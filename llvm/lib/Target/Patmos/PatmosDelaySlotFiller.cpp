@@ -12,8 +12,23 @@
 // instructions. If no instructions can be moved into the delay slot, then a
 // NOP is inserted.
 //
-// At the current state, only instructions from the local basic are considered
-// (not the targets of branches).
+// Unless only delayed control-flow instructions are allowed, each instruction
+// is replaced by its non-delayed variant if that is cheaper than filling the
+// remaining delay slots with NOPs. The non-delayed variant takes as many
+// cycles as the delayed variant with NOPs, but saves their code size; the
+// instructions that would have been moved into the delay slots stay in front
+// of it and cost a cycle each. It is therefore used if no filler is found, or
+// if the function is optimized for size and not all slots can be filled.
+//
+// Instructions from the local basic block are considered first. Delay slots
+// of conditional branches left over are filled with the first instructions of
+// the branch target, if it is the likely successor, e.g., the header of a loop
+// after its latch. They are copied into the delay slots under the guard of the
+// branch, and the branch is redirected to the instructions following them, by
+// splitting the target block. The copies thus execute on the taken path only,
+// where they replace NOPs, and cost as much as the NOPs otherwise. Since the
+// target keeps the instructions for its other predecessors, this is skipped
+// when optimizing for size.
 //
 // As a post-processing step, NOPs are inserted after loads again, where
 // necessary.
@@ -34,13 +49,18 @@
 
 #include "Patmos.h"
 #include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosStats.h"
 #include "PatmosTargetMachine.h"
 #include "PatmosRegisterInfo.h"
+#include "llvm/CodeGen/MachineBranchProbabilityInfo.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineOptimizationRemarkEmitter.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/IR/Function.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
@@ -53,13 +73,19 @@ using namespace llvm;
 #define DEBUG_TYPE "delay-slot-filler"
 
 STATISTIC( FilledSlots, "Number of delay slots filled");
+STATISTIC( FilledPredSlots, "Number of delay slots filled with predicated "
+                            "instructions of the branch target");
 STATISTIC( FilledNOPs,  "Number of delay slots filled with NOPs");
+STATISTIC( NonDelayedCFLs, "Number of non-delayed control-flow instructions "
+                           "selected");
 
 STATISTIC( SkippedLoadNOPs, "Number of loads not requiring a NOP");
 STATISTIC( InsertedLoadNOPs, "Number of NOPs inserted after loads");
 
 STATISTIC( SkippedMulNOPs, "Number of muls not requiring a NOP");
 STATISTIC( InsertedMulNOPs, "Number of NOPs inserted after muls");
+STATISTIC( OverlappedMuls, "Number of muls moved into the latency of the "
+                           "previous mul");
 
 
 static cl::opt<bool> DisableDelaySlotFiller(
@@ -68,6 +94,13 @@ static cl::opt<bool> DisableDelaySlotFiller(
   cl::desc("Disable the Patmos delay slot filler."),
   cl::Hidden);
 
+static cl::opt<bool> DisablePredicatedFiller(
+  "mpatmos-disable-predicated-delay-filler",
+  cl::init(false),
+  cl::desc("Do not fill the delay slots of conditional branches with "
+           "predicated instructions of their target."),
+  cl::Hidden);
+
 namespace {
 
   class DelayHazardInfo;
@@ -76,6 +109,31 @@ namespace {
   private:
     bool ForceDisableFiller;
 
+    /// ORE - Reports the delay slots that had to be filled with NOPs.
+    MachineOptimizationRemarkEmitter *ORE;
+
+    /// MBPI - Decides whether the target of a branch is its likely successor.
+    const MachineBranchProbabilityInfo *MBPI;
+
+    /// TargetFill - A branch whose target has been copied into its delay
+    /// slots, up to and including the instruction Last, such that the branch
+    /// is redirected behind Last once all blocks are filled.
+    struct TargetFill {
+      MachineInstr *Branch;
+      MachineBasicBlock *Target;
+      MachineInstr *Last;
+    };
+    std::vector<TargetFill> TargetFills;
+
+    /// TargetCopied - The instructions copied from the start of a branch
+    /// target, which must stay in place until the target is split.
+    SmallPtrSet<MachineInstr*, 16> TargetCopied;
+
+    /// The delay slots filled with instructions and with NOPs, and the NOPs
+    /// inserted after loads and multiplications in the current function, for
+    /// the per-function statistics.
+    unsigned FnFilledSlots, FnFilledNOPs, FnHazardNOPs;
+
     static char ID;
   public:
     /// Target machine description which we query for reg. names, data
@@ -94,12 +152,23 @@ namespace {
       return "Patmos Delay Slot Filler";
     }
 
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<MachineOptimizationRemarkEmitterPass>();
+      AU.addRequired<MachineBranchProbabilityInfo>();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
     bool runOnMachineFunction(MachineFunction &F) {
+      ORE = &getAnalysis<MachineOptimizationRemarkEmitterPass>().getORE();
+      MBPI = &getAnalysis<MachineBranchProbabilityInfo>();
+
       LLVM_DEBUG(dbgs() << "\n********** Patmos Delay Slot Filler **********\n");
       LLVM_DEBUG(dbgs() << "********** Function: " << F.getFunction().getName() << "**********\n");
       LLVM_DEBUG(F.dump());
 
 
+      FnFilledSlots = FnFilledNOPs = FnHazardNOPs = 0;
+
       bool Changed = false;
       // FIXME: check if Post-RA scheduler is enabled (by option or Subtarget),
       //        skip this loop (delay slot filling) in this case.
@@ -107,11 +176,24 @@ namespace {
            FI != FE; ++FI)
         Changed |= fillDelaySlots(*FI);
 
+      // redirect the branches whose target was copied into their delay slots
+      for (const TargetFill &Fill : TargetFills)
+        splitTarget(Fill);
+      TargetFills.clear();
+      TargetCopied.clear();
+
       // insert NOPs after other instructions, if necessary
       for (MachineFunction::iterator FI = F.begin(), FE = F.end();
            FI != FE; ++FI)
         Changed |= insertNOPs(*FI);
 
+      if (arePatmosStatsEnabled()) {
+        const Function &Fn = F.getFunction();
+        addPatmosStat(Fn, "delay-slot-filler", "filled-slots", FnFilledSlots);
+        addPatmosStat(Fn, "delay-slot-filler", "nop-slots", FnFilledNOPs);
+        addPatmosStat(Fn, "delay-slot-filler", "hazard-nops", FnHazardNOPs);
+      }
+
       LLVM_DEBUG(dbgs() << "\n********** Finished Patmos Delay Slot Filler **********\n");
       LLVM_DEBUG(dbgs() << "********** Function: " << F.getFunction().getName() << "**********\n");
       LLVM_DEBUG(F.dump());
@@ -137,6 +219,16 @@ namespace {
     bool insertAfterMul(MachineBasicBlock &MBB,
                          const MachineBasicBlock::iterator I);
 
+    /// overlapNextMul - Move the next multiplication of the block into the
+    /// cycle after the multiplication I, in place of a NOP. J is the cycle
+    /// that reads the result of I. The multiplications are pipelined, the
+    /// moved one overwrites the result only after J read it. Returns false
+    /// if the result is read elsewhere or the next multiplication depends
+    /// on the instructions in between.
+    bool overlapNextMul(MachineBasicBlock &MBB,
+                        const MachineBasicBlock::iterator I,
+                        const MachineBasicBlock::iterator J);
+
     /// fillDelaySlots - Fill in delay slots for the given basic block.
     /// We assume there is only one delay slot per delayed instruction.
     ///
@@ -149,6 +241,32 @@ namespace {
                     const MachineBasicBlock::iterator I,
                     SmallSet<MachineInstr*, 16> &FillerInstrs);
 
+    /// getTargetFillers - Collect the instructions at the start of the target
+    /// of a conditional branch I that can be copied into its remaining delay
+    /// slots under the guard of the branch. None are collected if the target
+    /// is not the likely successor. Candidates are the fillers from before
+    /// the branch.
+    void getTargetFillers(MachineBasicBlock &MBB,
+                          const MachineBasicBlock::iterator I,
+                          ArrayRef<MachineInstr*> Candidates,
+                          unsigned NumSlots,
+                          SmallVectorImpl<MachineInstr*> &Fillers) const;
+
+    /// isTargetFiller - Returns true if the instruction from the target of
+    /// a branch can be executed in its delay slot, under the given guard.
+    bool isTargetFiller(const MachineInstr &MI,
+                        ArrayRef<MachineOperand> Guard) const;
+
+    /// splitTarget - Split the target of a branch behind the instructions
+    /// copied into its delay slots, and redirect the branch to the new block.
+    void splitTarget(const TargetFill &Fill);
+
+    /// useNonDelayed - Returns true if the non-delayed variant of the
+    /// control-flow instruction MI is cheaper than MI with the given number
+    /// of delay slots filled by useful instructions.
+    bool useNonDelayed(const MachineInstr &MI, unsigned NumFillers,
+                       unsigned NumSlots) const;
+
     /// insertNOPAfter - Insert a nop after an instruction I, or split the
     /// bundle I.
     void insertNOPAfter(MachineBasicBlock &MBB,
@@ -169,6 +287,7 @@ namespace {
 
     unsigned getNumCandidates() const { return Candidates.size(); }
     MachineInstr *getCandidate(unsigned idx) { return Candidates[idx]; }
+    ArrayRef<MachineInstr *> getCandidates() const { return Candidates; }
     void appendCandidate(MachineInstr *MI) { Candidates.push_back(MI); }
 
   protected:
@@ -264,6 +383,7 @@ fillSlotForCtrlFlow(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I,
 
       // we can't / don't need to scan backward further
       if ( J->hasDelaySlot() || FillerInstrs.count(&*J) ||
+           TargetCopied.count(&*J) ||
            DI.getNumCandidates() == CFLDelaySlots ||
            J->isInlineAsm() || J->isLabel() ) {
         LLVM_DEBUG( dbgs() << " -- break at: " << *J );
@@ -287,6 +407,30 @@ fillSlotForCtrlFlow(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I,
     }
   }
 
+  // fill the remaining slots of conditional branches from their target
+  SmallVector<MachineInstr *, 2> TargetFillers;
+  if (!DisableDelaySlotFiller && !ForceDisableFiller &&
+      DI.getNumCandidates() < CFLDelaySlots) {
+    getTargetFillers(MBB, I, DI.getCandidates(),
+                     CFLDelaySlots - DI.getNumCandidates(), TargetFillers);
+  }
+  unsigned NumFillers = DI.getNumCandidates() + TargetFillers.size();
+
+  if (useNonDelayed(*I, NumFillers, CFLDelaySlots)) {
+    // leave the candidates where they are
+    I->setDesc(TII->get(PatmosInstrInfo::getNonDelayedOpcode(I->getOpcode())));
+    ++NonDelayedCFLs;  // update statistics
+    LLVM_DEBUG( dbgs() << " -- non-delayed: " << *I );
+    return;
+  }
+
+  SmallVector<MachineOperand, 2> Guard;
+  if (!TargetFillers.empty()) {
+    TII->getPredicateOperands(*I, Guard);
+    TargetFills.push_back({&*I, PatmosInstrInfo::getBranchTarget(&*I),
+                           TargetFillers.back()});
+  }
+
   // move instructions / insert NOPs
   MachineBasicBlock::iterator NI = std::next(I);
   for (unsigned i=0; i<CFLDelaySlots; i++) {
@@ -295,16 +439,174 @@ fillSlotForCtrlFlow(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I,
       MBB.splice(std::next(I), &MBB, FillMI);
       FillerInstrs.insert(FillMI);
       ++FilledSlots;  // update statistics
+      ++FnFilledSlots;
       LLVM_DEBUG( dbgs() << " -- filler: " << *FillMI );
+    } else if (i < NumFillers) {
+      // the copies follow the other fillers, as in the original order
+      MachineInstr *TargetMI = TargetFillers[i - DI.getNumCandidates()];
+      MachineInstr *FillMI = MBB.getParent()->CloneMachineInstr(TargetMI);
+      FillMI->clearKillInfo();
+      TII->PredicateInstruction(*FillMI, Guard);
+      MBB.insert(NI, FillMI);
+      FillerInstrs.insert(FillMI);
+      TargetCopied.insert(TargetMI);
+      ++FilledSlots;  // update statistics
+      ++FnFilledSlots;
+      ++FilledPredSlots;
+      LLVM_DEBUG( dbgs() << " -- filler (target): " << *FillMI );
     } else {
       // we add the NOPs before the next instruction
       insertNOPAfter(MBB, I);
-      FillerInstrs.insert(&*std::prev(NI));
+      FillerInstrs.insert(&*std::next(I));
       ++FilledNOPs;  // update statistics
+      ++FnFilledNOPs;
       LLVM_DEBUG( dbgs() << " -- filler: NOP\n" );
     }
   }
 
+  if (CFLDelaySlots > NumFillers) {
+    unsigned NOPs = CFLDelaySlots - NumFillers;
+    ORE->emit([&]() {
+      return MachineOptimizationRemarkMissed(DEBUG_TYPE, "UnfilledDelaySlots",
+                                             I->getDebugLoc(), &MBB)
+             << ore::NV("NOPs", NOPs) << " unfilled delay slots after "
+             << ore::NV("Instruction", TII->getName(I->getOpcode()));
+    });
+  }
+
+}
+
+void PatmosDelaySlotFiller::
+getTargetFillers(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I,
+                 ArrayRef<MachineInstr *> Candidates, unsigned NumSlots,
+                 SmallVectorImpl<MachineInstr *> &Fillers) const
+{
+  if (DisablePredicatedFiller || I->isBundle() || !I->isBranch() ||
+      I->isIndirectBranch() || !TII->isPredicated(*I) ||
+      !I->getOperand(2).isMBB())
+    return;
+
+  // the target keeps the copied instructions, single-path code keeps the
+  // layout it was scheduled for
+  const MachineFunction &MF = *MBB.getParent();
+  if (MF.getFunction().hasOptSize() ||
+      MF.getInfo<PatmosMachineFunctionInfo>()->isSinglePath())
+    return;
+
+  // the copies must only pay off on the likely path, and the block must reach
+  // the target by this branch only
+  MachineBasicBlock *Target = PatmosInstrInfo::getBranchTarget(&*I);
+  if (!MBB.isSuccessor(Target) || MBB.isLayoutSuccessor(Target) ||
+      MBPI->getEdgeProbability(&MBB, Target) <= BranchProbability(1, 2))
+    return;
+  for (const MachineInstr &MI : MBB.instrs()) {
+    if (&MI != &*I && MI.isBranch() && !MI.isIndirectBranch() &&
+        MI.getOperand(2).isMBB() && MI.getOperand(2).getMBB() == Target)
+      return;
+  }
+  for (const TargetFill &Fill : TargetFills) {
+    if (Fill.Target == Target)
+      return;
+  }
+
+  // the copies follow the other fillers, which must not stall them
+  for (const MachineInstr *C : Candidates) {
+    if (C->mayLoad() || C->getOpcode() == Patmos::MUL ||
+        C->getOpcode() == Patmos::MULU)
+      return;
+  }
+
+  SmallVector<MachineOperand, 2> Guard;
+  TII->getPredicateOperands(*I, Guard);
+  for (MachineInstr &MI : *Target) {
+    if (Fillers.size() == NumSlots || !isTargetFiller(MI, Guard) ||
+        is_contained(Candidates, &MI))
+      break;
+    Fillers.push_back(&MI);
+  }
+}
+
+bool PatmosDelaySlotFiller::isTargetFiller(const MachineInstr &MI,
+                                           ArrayRef<MachineOperand> Guard) const
+{
+  if (MI.isBundle() || MI.isDebugInstr() || MI.isImplicitDef() ||
+      MI.isLabel() || MI.isInlineAsm() || MI.hasDelaySlot() ||
+      MI.isTerminator() || MI.isCall() || MI.isReturn())
+    return false;
+
+  // the copy is guarded by the branch, a single-issue, unguarded instruction
+  if (!MI.isPredicable() || TII->isPredicated(MI) ||
+      TII->getInstrSize(&MI) != 4)
+    return false;
+
+  // the first instructions behind the branch expect no latencies of loads
+  // and multiplications
+  if (MI.mayLoad() || MI.getOpcode() == Patmos::MUL ||
+      MI.getOpcode() == Patmos::MULU || TII->isStackControl(&MI))
+    return false;
+
+  if (MI.hasUnmodeledSideEffects() && !TII->isSideEffectFreeSRegAccess(&MI))
+    return false;
+
+  // the following copies are guarded by the same predicate
+  for (const MachineOperand &MO : MI.operands()) {
+    if (MO.isReg() && MO.isDef() && MO.getReg() &&
+        TRI->regsOverlap(MO.getReg(), Guard[0].getReg()))
+      return false;
+  }
+  return true;
+}
+
+void PatmosDelaySlotFiller::splitTarget(const TargetFill &Fill)
+{
+  MachineBasicBlock *Target = Fill.Target;
+  MachineFunction &MF = *Target->getParent();
+
+  // the copied instructions stay for the other predecessors, falling through
+  // to the rest of the block
+  MachineBasicBlock *Rest = MF.CreateMachineBasicBlock(Target->getBasicBlock());
+  MF.insert(std::next(Target->getIterator()), Rest);
+  Rest->splice(Rest->end(), Target,
+               std::next(MachineBasicBlock::iterator(Fill.Last)),
+               Target->end());
+  Rest->transferSuccessors(Target);
+  Target->addSuccessor(Rest);
+
+  for (const MachineBasicBlock::RegisterMaskPair &LI : Target->liveins())
+    Rest->addLiveIn(LI);
+  for (const MachineInstr &MI : *Target) {
+    for (const MachineOperand &MO : MI.operands()) {
+      if (MO.isReg() && MO.isDef() && MO.getReg())
+        Rest->addLiveIn(MO.getReg());
+    }
+  }
+  Rest->sortUniqueLiveIns();
+
+  // the branch moved to the new block if it branched to its own block
+  MachineBasicBlock *MBB = Fill.Branch->getParent();
+  Fill.Branch->getOperand(2).setMBB(Rest);
+  MBB->replaceSuccessor(Target, Rest);
+
+  LLVM_DEBUG( dbgs() << "Redirect branch in BB#" << MBB->getNumber()
+                     << " behind its delay slot copies, split BB#"
+                     << Target->getNumber() << " at BB#" << Rest->getNumber()
+                     << "\n" );
+}
+
+bool PatmosDelaySlotFiller::useNonDelayed(const MachineInstr &MI,
+                                          unsigned NumFillers,
+                                          unsigned NumSlots) const
+{
+  PatmosSubtarget::CFLType CFLType = TM.getSubtargetImpl()->getCFLType();
+  if (CFLType == PatmosSubtarget::CFL_DELAYED || MI.isBundle() ||
+      PatmosInstrInfo::getNonDelayedOpcode(MI.getOpcode()) == -1)
+    return false;
+
+  if (CFLType == PatmosSubtarget::CFL_NON_DELAYED || NumFillers == 0)
+    return true;
+
+  // Trade the cycles of the fillers for the size of the NOPs.
+  return NumFillers < NumSlots && MI.getMF()->getFunction().hasOptSize();
 }
 
 void PatmosDelaySlotFiller::insertNOPAfter(MachineBasicBlock &MBB,
@@ -353,6 +655,7 @@ insertAfterLoad(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I) {
     TII->insertNoop(MBB, std::next(I));
     // stats and debug output
     ++InsertedLoadNOPs;
+    ++FnHazardNOPs;
     LLVM_DEBUG( dbgs() << "NOP inserted after load: " << *I );
     LLVM_DEBUG( dbgs() << "                 before: " << *J );
     return true;
@@ -377,6 +680,7 @@ insertAfterLoad(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I) {
         TII->insertNoop(**SMBB, (*SMBB)->begin()); // insert before first instruction
         // stats and debug output
         ++InsertedLoadNOPs;
+        ++FnHazardNOPs;
         if (!inserted) {
           LLVM_DEBUG( dbgs() << "NOP inserted after load: " << *I );
           inserted = true;
@@ -408,9 +712,17 @@ insertAfterMul(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I) {
       unsigned Reg = J != MBB.end() ? MI->getOperand(3).getReg() : Patmos::SL;
 
       if (Reg == Patmos::SL || Reg == Patmos::SH) {
+        // Issue the next multiplication in the first cycle we wait for the
+        // result anyway.
+        if (J != MBB.end() && overlapNextMul(MBB, I, J)) {
+          OverlappedMuls++;
+          Latency--;
+        }
+
         while (Latency > 0) {
           insertNOPAfter(MBB, I);
           InsertedMulNOPs++;
+          FnHazardNOPs++;
           Latency--;
         }
 
@@ -428,6 +740,67 @@ insertAfterMul(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I) {
   return false;
 }
 
+/// readsMulResult - Returns true if MI, or an instruction of the bundle MI,
+/// reads the result of a multiplication.
+static bool readsMulResult(const MachineInstr &MI) {
+  MachineBasicBlock::const_instr_iterator II = MI.getIterator();
+  do {
+    if (II->readsRegister(Patmos::SL) || II->readsRegister(Patmos::SH))
+      return true;
+  } while (++II != MI.getParent()->instr_end() && II->isInsideBundle());
+  return false;
+}
+
+bool PatmosDelaySlotFiller::
+overlapNextMul(MachineBasicBlock &MBB, const MachineBasicBlock::iterator I,
+               const MachineBasicBlock::iterator J) {
+  const PatmosSubtarget &PST = *TM.getSubtargetImpl();
+  const TargetRegisterInfo *TRI = PST.getRegisterInfo();
+
+  // Do not push instructions out of the delay slots of a preceding CFL, which
+  // has at most three.
+  MachineBasicBlock::iterator P = I;
+  for (unsigned Cycles = 1; Cycles <= 3 && P != MBB.begin(); Cycles++) {
+    P = TII->prevNonPseudo(MBB, P);
+    if (PST.getDelaySlotCycles(*P) >= Cycles)
+      return false;
+  }
+
+  // Find the next multiplication, the result of I must only be read in J.
+  MachineBasicBlock::iterator K;
+  for (K = TII->nextNonPseudo(MBB, I); K != MBB.end();
+       K = TII->nextNonPseudo(MBB, K)) {
+    if (K->isCall() || K->isBranch() || K->isReturn() || K->isInlineAsm() ||
+        K->isLabel() || K->hasDelaySlot())
+      return false;
+    if (K != J && readsMulResult(*K))
+      return false;
+    if (!K->isBundle() && (K->getOpcode() == Patmos::MUL ||
+                           K->getOpcode() == Patmos::MULU))
+      break;
+    if (K->modifiesRegister(Patmos::SL, TRI) ||
+        K->modifiesRegister(Patmos::SH, TRI) ||
+        TII->hasOpcode(&*K, Patmos::MUL) || TII->hasOpcode(&*K, Patmos::MULU))
+      return false;
+  }
+  if (K == MBB.end())
+    return false;
+
+  // The operands (and guard) of the multiplication must be available in the
+  // cycle after I already.
+  for (MachineBasicBlock::instr_iterator II = I.getInstrIterator(),
+       IE = K.getInstrIterator(); II != IE; ++II) {
+    for (const MachineOperand &MO : K->uses()) {
+      if (MO.isReg() && MO.getReg() && II->modifiesRegister(MO.getReg(), TRI))
+        return false;
+    }
+  }
+
+  LLVM_DEBUG(dbgs() << "Overlapping mul: " << *K << "         with: " << *I);
+  MBB.insert(std::next(I), MBB.remove(&*K));
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // DelayHazardInfo methods
 ///////////////////////////////////////////////////////////////////////////////
@@ -441,7 +814,8 @@ void DelayHazardInfo::insertDefsUses(MachineInstr *MI) {
                       ? MCID.getNumOperands() : MI->getNumOperands();
 
   if (MI->isCall())   RegDefs.insert(Patmos::SRB);
-  if (MI->isReturn()) RegUses.insert(Patmos::SRB);
+  if (MI->isReturn())
+    RegUses.insert(MI->getOpcode() == Patmos::XRET ? Patmos::SXB : Patmos::SRB);
 
   LLVM_DEBUG(dbgs() << " ---- regs: [");
   for (unsigned i = 0; i != e; ++i) {
@@ -16,6 +16,7 @@
 
 #include "Patmos.h"
 #include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
 #include "PatmosTargetMachine.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
@@ -102,24 +103,9 @@ bool PatmosDelaySlotKiller::killDelaySlots(MachineBasicBlock &MBB) {
       MachineBasicBlock::instr_iterator MI = I.getInstrIterator();
       if (I->isBundle()) { ++MI; }
 
-      unsigned Opcode = MI->getOpcode();
-
-      if (Opcode == Patmos::BR ||
-          Opcode == Patmos::BRu ||
-          Opcode == Patmos::BRR ||
-          Opcode == Patmos::BRRu ||
-          Opcode == Patmos::BRT ||
-          Opcode == Patmos::BRTu ||
-          Opcode == Patmos::BRCF ||
-          Opcode == Patmos::BRCFu ||
-          Opcode == Patmos::BRCFR ||
-          Opcode == Patmos::BRCFRu ||
-          Opcode == Patmos::BRCFT ||
-          Opcode == Patmos::BRCFTu ||
-          Opcode == Patmos::CALL ||
-          Opcode == Patmos::CALLR ||
-          Opcode == Patmos::RET ||
-          Opcode == Patmos::XRET) {
+      int NewOpcode = PatmosInstrInfo::getNonDelayedOpcode(MI->getOpcode());
+
+      if (NewOpcode != -1) {
 
         bool onlyNops = true;
         unsigned maxCount = TM.getSubtargetImpl()->getDelaySlotCycles(*I);
@@ -132,36 +118,22 @@ bool PatmosDelaySlotKiller::killDelaySlots(MachineBasicBlock &MBB) {
           }
         }
         if (onlyNops) {
-          unsigned NewOpcode = 0;
-          switch(Opcode) {
-          case Patmos::BR:     NewOpcode = Patmos::BRND; break;
-          case Patmos::BRu:    NewOpcode = Patmos::BRNDu; break;
-          case Patmos::BRR:    NewOpcode = Patmos::BRRND; break;
-          case Patmos::BRRu:   NewOpcode = Patmos::BRRNDu; break;
-          case Patmos::BRT:    NewOpcode = Patmos::BRTND; break;
-          case Patmos::BRTu:   NewOpcode = Patmos::BRTNDu; break;
-          case Patmos::BRCF:   NewOpcode = Patmos::BRCFND; break;
-          case Patmos::BRCFu:  NewOpcode = Patmos::BRCFNDu; break;
-          case Patmos::BRCFR:  NewOpcode = Patmos::BRCFRND; break;
-          case Patmos::BRCFRu: NewOpcode = Patmos::BRCFRNDu; break;
-          case Patmos::BRCFT:  NewOpcode = Patmos::BRCFTND; break;
-          case Patmos::BRCFTu: NewOpcode = Patmos::BRCFTNDu; break;
-          case Patmos::CALL:   NewOpcode = Patmos::CALLND; break;
-          case Patmos::CALLR:  NewOpcode = Patmos::CALLRND; break;
-          case Patmos::RET:    NewOpcode = Patmos::RETND; break;
-          case Patmos::XRET:   NewOpcode = Patmos::XRETND; break;
-          }
           const MCInstrDesc &nonDelayed = TII->get(NewOpcode);
           MI->setDesc(nonDelayed);
 
           unsigned killCount = 0;
+          int killedBytes = 0;
           MachineBasicBlock::iterator K = std::next(I);
           for (MachineBasicBlock::iterator E = MBB.end();
                K != E && killCount < count; ++K, ++killCount) {
             TII->skipPseudos(MBB, K);
+            killedBytes += TII->getInstrSize(&*K);
             KilledSlots++;
           }
           MBB.erase(std::next(I), K);
+
+          MBB.getParent()->getInfo<PatmosMachineFunctionInfo>()
+                         ->adjustBlockSize(&MBB, -killedBytes);
         }
       }
       Changed = true; // pass result
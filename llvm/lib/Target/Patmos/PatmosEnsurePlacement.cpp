@@ -0,0 +1,263 @@
+//===-- PatmosEnsurePlacement.cpp - Place stack cache ensures. ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Every call is followed by a sens, which reloads the caller's stack cache
+// frame. The frame is only needed again at the next access to the stack
+// cache, though, the ensure can thus be delayed up to the next ensure or
+// access on every path.
+//
+// This pass removes the ensures that are followed by another ensure before
+// any stack cache access on all paths, e.g., the ensures between consecutive
+// calls. For loops that contain calls but do not access the stack cache, an
+// ensure is placed at the loop exits, which makes those in the loop redundant,
+// i.e., the ensures are sunk out of the loop.
+//
+// The stack cache analysis, if enabled, bounds the fill of the remaining
+// ensures afterwards.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-ensure-placement"
+
+STATISTIC(RemovedRedundantSENS, "Ensures removed before other ensures");
+STATISTIC(SunkSENS, "Ensures placed at the exits of loops with calls");
+
+namespace {
+
+  class PatmosEnsurePlacement : public MachineFunctionPass {
+  private:
+    const PatmosInstrInfo *TII;
+
+    /// Size of the ensures of the current function, in words.
+    int64_t EnsureSize;
+
+    static char ID;
+
+    /// isEnsure - Check whether the instruction unconditionally ensures the
+    /// frame of the function.
+    bool isEnsure(const MachineInstr &MI) const {
+      return MI.getOpcode() == Patmos::SENSi && !TII->isPredicated(MI);
+    }
+
+    /// needsFrame - Check whether the instruction might access the stack
+    /// cache frame of the function, or manipulates the stack cache otherwise.
+    bool needsFrame(const MachineInstr &MI) const {
+      switch (MI.getOpcode()) {
+      // ensures are handled separately, frees only move the stack top
+      case Patmos::SENSi:
+      case Patmos::SFREEi:
+        return false;
+      case Patmos::SRESi:
+      case Patmos::SENSr:
+      case Patmos::SSPILLi:
+      case Patmos::SSPILLr:
+        return true;
+      }
+
+      if (MI.isInlineAsm())
+        return true;
+
+      // callees do not access the frame of the caller, see runOnMachineFunction
+      if (MI.isCall() || MI.isBundle())
+        return false;
+
+      return (MI.mayLoad() || MI.mayStore()) &&
+             PatmosInstrInfo::getMemType(MI) == PatmosII::MEM_S;
+    }
+
+    /// transfer - Update whether the frame is needed at the beginning of MI,
+    /// given whether it is needed after MI.
+    bool transfer(const MachineInstr &MI, bool Needed) const {
+      if (needsFrame(MI))
+        return true;
+      if (isEnsure(MI))
+        return false;
+      return Needed;
+    }
+
+    /// isSinkable - Check whether the ensures of a loop can be placed at its
+    /// exits, i.e., it contains calls but no stack cache accesses, and its
+    /// exits are only entered from the loop.
+    bool isSinkable(const MachineLoop &L) const {
+      bool HasEnsure = false;
+      for (const MachineBasicBlock *MBB : L.blocks()) {
+        for (const MachineInstr &MI : MBB->instrs()) {
+          if (needsFrame(MI))
+            return false;
+          HasEnsure |= MI.getOpcode() == Patmos::SENSi;
+        }
+      }
+      if (!HasEnsure)
+        return false;
+
+      SmallVector<MachineBasicBlock*, 4> Exits;
+      L.getExitBlocks(Exits);
+      for (const MachineBasicBlock *Exit : Exits) {
+        if (Exit->isEHPad())
+          return false;
+        for (const MachineBasicBlock *Pred : Exit->predecessors())
+          if (!L.contains(Pred))
+            return false;
+      }
+      return true;
+    }
+
+    /// sinkEnsures - Place ensures at the exits of the outermost loops whose
+    /// ensures can be sunk, the ensures in the loops are removed later.
+    bool sinkEnsures(MachineLoop &L) {
+      if (!isSinkable(L)) {
+        bool Changed = false;
+        for (MachineLoop *SubLoop : L)
+          Changed |= sinkEnsures(*SubLoop);
+        return Changed;
+      }
+
+      SmallVector<MachineBasicBlock*, 4> Exits;
+      L.getUniqueExitBlocks(Exits);
+      for (MachineBasicBlock *Exit : Exits) {
+        MachineBasicBlock::iterator I = Exit->begin();
+        if (I != Exit->end() && isEnsure(*I))
+          continue;
+
+        DebugLoc DL = I != Exit->end() ? I->getDebugLoc() : DebugLoc();
+        AddDefaultPred(BuildMI(*Exit, I, DL, TII->get(Patmos::SENSi)))
+          .addImm(EnsureSize);
+        SunkSENS++;
+        LLVM_DEBUG(dbgs() << "Ensure placed at the exit bb."
+                          << Exit->getNumber() << " of loop at bb."
+                          << L.getHeader()->getNumber() << "\n");
+      }
+      return true;
+    }
+
+    /// removeRedundantEnsures - Remove the ensures after which the frame is
+    /// not needed before the next ensure on all paths.
+    bool removeRedundantEnsures(MachineFunction &MF) {
+      // whether the frame is needed at the entry of a block, computed
+      // backwards until a fixpoint is reached
+      std::map<const MachineBasicBlock*, bool> NeededIn;
+      bool Changed;
+      do {
+        Changed = false;
+        for (MachineFunction::reverse_iterator i(MF.rbegin()), ie(MF.rend());
+             i != ie; i++) {
+          bool Needed = false;
+          for (const MachineBasicBlock *Succ : i->successors())
+            Needed |= NeededIn[Succ];
+          for (MachineBasicBlock::reverse_instr_iterator j(i->instr_rbegin()),
+               je(i->instr_rend()); j != je; j++)
+            Needed = transfer(*j, Needed);
+
+          bool &In = NeededIn[&*i];
+          if (Needed && !In) {
+            In = true;
+            Changed = true;
+          }
+        }
+      } while (Changed);
+
+      bool Removed = false;
+      for (MachineBasicBlock &MBB : MF) {
+        bool Needed = false;
+        for (const MachineBasicBlock *Succ : MBB.successors())
+          Needed |= NeededIn[Succ];
+
+        for (MachineBasicBlock::reverse_instr_iterator j(MBB.instr_rbegin()),
+             je(MBB.instr_rend()); j != je; ) {
+          MachineInstr &MI = *j++;
+          if (MI.getOpcode() == Patmos::SENSi && !Needed &&
+              !MI.isBundled()) {
+            LLVM_DEBUG(dbgs() << "Redundant ensure in bb." << MBB.getNumber()
+                              << ": " << MI);
+            MI.eraseFromParent();
+            RemovedRedundantSENS++;
+            Removed = true;
+            continue;
+          }
+          Needed = transfer(MI, Needed);
+        }
+      }
+      return Removed;
+    }
+
+  public:
+    PatmosEnsurePlacement(const PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID),
+        TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())),
+        EnsureSize(0) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Stack Cache Ensure Placement";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<MachineLoopInfo>();
+      AU.addPreserved<MachineLoopInfo>();
+      AU.setPreservesCFG();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override {
+      const PatmosMachineFunctionInfo *PMFI =
+                                       MF.getInfo<PatmosMachineFunctionInfo>();
+
+      // Single-path code keeps its ensures in place, interrupt handlers
+      // ensure the frames of the interrupted code, and the callees of
+      // functions passing stack cache objects access the caller's frame.
+      if (PMFI->isSinglePath() || PMFI->isInterruptHandler() ||
+          PMFI->hasStackCacheArgumentFIs())
+        return false;
+
+      // all ensures have to reload the same frame
+      EnsureSize = 0;
+      for (MachineBasicBlock &MBB : MF) {
+        for (MachineInstr &MI : MBB.instrs()) {
+          if (MI.getOpcode() != Patmos::SENSi)
+            continue;
+          int64_t Size = MI.getOperand(2).getImm();
+          if (EnsureSize && EnsureSize != Size)
+            return false;
+          EnsureSize = Size;
+        }
+      }
+      if (!EnsureSize)
+        return false;
+
+      bool Changed = false;
+      MachineLoopInfo &MLI = getAnalysis<MachineLoopInfo>();
+      for (MachineLoop *L : MLI)
+        Changed |= sinkEnsures(*L);
+
+      Changed |= removeRedundantEnsures(MF);
+      return Changed;
+    }
+  };
+
+  char PatmosEnsurePlacement::ID = 0;
+} // end of anonymous namespace
+
+FunctionPass *
+llvm::createPatmosEnsurePlacementPass(const PatmosTargetMachine &tm) {
+  return new PatmosEnsurePlacement(tm);
+}
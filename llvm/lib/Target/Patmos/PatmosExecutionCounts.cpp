@@ -0,0 +1,105 @@
+//===-- PatmosExecutionCounts.cpp - Estimate instruction execution counts. ===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Estimate how often the instructions of the whole program are executed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosExecutionCounts.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+void PatmosExecutionCounts::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<CallGraphWrapperPass>();
+  AU.addRequired<BlockFrequencyInfoWrapperPass>();
+}
+
+void PatmosExecutionCounts::analyzeCallGraph(Module &M) {
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+
+    BlockFrequencyInfo &BFI =
+        getAnalysis<BlockFrequencyInfoWrapperPass>(F).getBFI();
+    double Entry = BFI.getEntryFreq();
+    for (BasicBlock &BB : F)
+      BlockFreqs[&BB] = BFI.getBlockFreq(&BB).getFrequency() / Entry;
+  }
+
+  CallGraph &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+
+  // Bottom-up: find the functions that might (indirectly) call unknown code.
+  std::vector<CallGraphNode *> Order;
+  DenseSet<const CallGraphNode *> CallsUnknown;
+  for (scc_iterator<CallGraph *> I = scc_begin(&CG); !I.isAtEnd(); ++I) {
+    const std::vector<CallGraphNode *> &SCC = *I;
+
+    bool Unknown = false;
+    for (CallGraphNode *N : SCC) {
+      for (const CallGraphNode::CallRecord &CR : *N) {
+        if (CR.second == CG.getCallsExternalNode() ||
+            CallsUnknown.count(CR.second))
+          Unknown = true;
+      }
+    }
+
+    for (CallGraphNode *N : SCC) {
+      if (Unknown)
+        CallsUnknown.insert(N);
+      Order.push_back(N);
+
+      Function *F = N->getFunction();
+      if (!F || F->isDeclaration() || Unknown || I.hasCycle() ||
+          F->hasAddressTaken())
+        continue;
+      NonReentrant.insert(F);
+    }
+  }
+
+  // Top-down: propagate the number of calls to the callees.
+  DenseSet<const Function *> Done;
+  for (CallGraphNode *N : reverse(Order)) {
+    Function *F = N->getFunction();
+    if (!F || F->isDeclaration())
+      continue;
+
+    double Count;
+    Function::ProfileCount EC = F->getEntryCount();
+    if (EC.hasValue())
+      Count = EC.getCount();
+    else if (FunctionCounts.count(F))
+      Count = FunctionCounts[F];
+    else
+      // Entry points, or only called through pointers.
+      Count = 1;
+    FunctionCounts[F] = Count;
+    Done.insert(F);
+
+    for (const CallGraphNode::CallRecord &CR : *N) {
+      Function *Callee = CR.second->getFunction();
+      if (!CR.first || !*CR.first || !Callee || Callee->isDeclaration() ||
+          Done.count(Callee))
+        continue;
+
+      const Instruction *Call = cast<Instruction>((Value *)*CR.first);
+      FunctionCounts[Callee] += Count * BlockFreqs.lookup(Call->getParent());
+    }
+  }
+}
+
+double PatmosExecutionCounts::getCount(const Instruction *I) const {
+  return FunctionCounts.lookup(I->getFunction()) *
+         BlockFreqs.lookup(I->getParent());
+}
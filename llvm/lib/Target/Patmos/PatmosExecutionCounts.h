@@ -0,0 +1,58 @@
+//===-- PatmosExecutionCounts.h - Estimate instruction execution counts. --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Estimate how often the instructions of the whole program are executed, for
+// the module passes placing and laying out data by its access frequency.
+//
+// The count of an instruction is the frequency of its block relative to the
+// entry of its function, scaled by the number of calls of the function. The
+// calls are taken from the profile or propagated top-down along the call
+// graph from the entry points, which are assumed to be called once.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOS_EXECUTIONCOUNTS_H_
+#define _LLVM_TARGET_PATMOS_EXECUTIONCOUNTS_H_
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Pass.h"
+
+namespace llvm {
+  class BasicBlock;
+  class Function;
+  class Instruction;
+
+  /// Estimates the execution counts of the instructions of a program, based
+  /// on the call graph.
+  class PatmosExecutionCounts : public ModulePass {
+  protected:
+    /// Block frequencies relative to the entry of their function.
+    DenseMap<const BasicBlock *, double> BlockFreqs;
+
+    /// Estimated number of calls of each function.
+    DenseMap<const Function *, double> FunctionCounts;
+
+    /// Functions whose stack objects may be allocated statically.
+    DenseSet<const Function *> NonReentrant;
+
+    /// Compute BlockFreqs, FunctionCounts and NonReentrant.
+    void analyzeCallGraph(Module &M);
+
+    /// Estimate the execution count of the instruction.
+    double getCount(const Instruction *I) const;
+
+    PatmosExecutionCounts(char &ID) : ModulePass(ID) {}
+
+  public:
+    void getAnalysisUsage(AnalysisUsage &AU) const override;
+  };
+}
+
+#endif // _LLVM_TARGET_PATMOS_EXECUTIONCOUNTS_H_
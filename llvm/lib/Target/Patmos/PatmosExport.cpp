@@ -14,9 +14,12 @@
 #define DEBUG_TYPE "patmos-export"
 
 #include "Patmos.h"
+#include "PatmosCallGraphBuilder.h"
 #include "PatmosInstrInfo.h"
 #include "PatmosMachineFunctionInfo.h"
 #include "PatmosStackCacheAnalysis.h"
+#include "PatmosMethodCacheAnalysis.h"
+#include "PatmosDataCacheAnalysis.h"
 #include "PatmosTargetMachine.h"
 #include "PMLExport.h"
 #include "InstPrinter/PatmosInstPrinter.h"
@@ -144,20 +147,36 @@ namespace llvm {
   #include "PatmosGenCallingConv.inc"
 
   class PatmosMachineExport : public PMLMachineExport {
+    /// The cache analysis results, looked up once per exported function
+    /// rather than for every block and instruction.
+    PatmosStackCacheAnalysisInfo *SCA;
+    PatmosMethodCacheAnalysisInfo *MCA;
+    PatmosDataCacheAnalysisInfo *DCA;
 
   public:
     PatmosMachineExport(PatmosTargetMachine &tm, ModulePass &mp, const TargetInstrInfo *TII,
                         PMLInstrInfo *PII)
-      : PMLMachineExport(tm, mp, TII, PII) {
+      : PMLMachineExport(tm, mp, TII, PII), SCA(0), MCA(0),
+        DCA(0) {
         // silence compiler warning
         (void)RetCC_Patmos;
       }
 
+    void serialize(MachineFunction &MF) override {
+      SCA = &P.getAnalysis<PatmosStackCacheAnalysisInfo>();
+      MCA = &P.getAnalysis<PatmosMethodCacheAnalysisInfo>();
+      DCA = &P.getAnalysis<PatmosDataCacheAnalysisInfo>();
+      PMLMachineExport::serialize(MF);
+    }
+
 
     bool doExportInstruction(const MachineInstr *Ins) override {
       return true;
     }
 
+    void exportBlock(MachineFunction &MF, yaml::MachineBlock *B,
+                     const MachineBasicBlock &MBB) override;
+
      void exportInstruction(MachineFunction &MF,
                                    yaml::MachineInstruction *I,
                                    const MachineInstr *Instr,
@@ -181,10 +200,13 @@ namespace llvm {
   class PatmosModuleExportPass : public PMLModuleExportPass {
     static char ID;
 
+    /// The call graph of the module, while the module is exported.
+    PatmosCallGraphBuilder *PCGB;
+
   public:
     PatmosModuleExportPass(PatmosTargetMachine &tm, StringRef filename,
                            ArrayRef<std::string> roots, bool SerializeAll)
-      : PMLModuleExportPass(ID, tm, filename, roots, SerializeAll)
+      : PMLModuleExportPass(ID, tm, filename, roots, SerializeAll), PCGB(0)
     {
       initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
 
@@ -202,11 +224,43 @@ namespace llvm {
     void getAnalysisUsage(AnalysisUsage &AU) const override {
       AU.setPreservesAll();
       AU.addRequired<PatmosStackCacheAnalysisInfo>();
+      AU.addRequired<PatmosMethodCacheAnalysisInfo>();
+      AU.addRequired<PatmosDataCacheAnalysisInfo>();
+      AU.addRequired<PatmosCallGraphBuilder>();
       PMLModuleExportPass::getAnalysisUsage(AU);
     }
 
     bool runOnModule(Module &M) override {
-      return PMLModuleExportPass::runOnModule(M);
+      PCGB = &getAnalysis<PatmosCallGraphBuilder>();
+      bool Changed = PMLModuleExportPass::runOnModule(M);
+      PCGB = 0;
+      return Changed;
+    }
+
+  protected:
+    /// getCalledFunctions - Look up the callees in the call graph, which
+    /// indexes the call sites of all functions once, instead of scanning the
+    /// code of every exported function. Sites the call graph could not
+    /// resolve are resolved by name, as before.
+    PMLInstrInfo::MFList getCalledFunctions(const Module &M,
+                                            MachineModuleInfo &MMI,
+                                            MachineFunction &MF) override {
+      MCGNode *N = PCGB->getNode(&MF);
+      if (!N)
+        return PMLModuleExportPass::getCalledFunctions(M, MMI, MF);
+
+      PMLInstrInfo::MFList Callees;
+      for (const MCGSite *Site : N->getSites()) {
+        MCGNode *Callee = Site->getCallee();
+        if (!Callee->isUnknown()) {
+          Callees.push_back(Callee->getMF());
+        } else if (Site->getMI()) {
+          PMLInstrInfo::MFList Named =
+                 getPMLInstrInfo()->getCallees(M, MMI, MF, Site->getMI());
+          Callees.insert(Callees.end(), Named.begin(), Named.end());
+        }
+      }
+      return Callees;
     }
   };
 
@@ -400,19 +454,34 @@ namespace llvm {
       }
     }
 
+    void PatmosMachineExport::
+    exportBlock(MachineFunction &MF, yaml::MachineBlock *B,
+                const MachineBasicBlock &MBB) {
+
+      // Export the worst-case stack cache costs of a preemption at the entry
+      // of the block (if the preemption analysis was run)
+      if (!SCA->isValid())
+        return;
+
+      PatmosStackCacheAnalysisInfo::PreemptionCosts::iterator it =
+        SCA->Preemptions.find(&MBB);
+      if (it != SCA->Preemptions.end()) {
+        B->StackCacheSave = it->second.Save;
+        B->StackCacheRestore = it->second.Restore;
+      }
+    }
+
     void PatmosMachineExport::
     exportInstruction(MachineFunction &MF,
                       yaml::MachineInstruction *I,
                       const MachineInstr *Instr,
                       bool BundledWithPred) {
 
-      PatmosStackCacheAnalysisInfo *SCA =
-       &P.getAnalysis<PatmosStackCacheAnalysisInfo>();
-
-      // Export the argument of reserve, ensure, free instructions
+      // Export the argument of reserve, ensure, free, spill instructions
       if (Instr->getOpcode() == Patmos::SENSi ||
           Instr->getOpcode() == Patmos::SRESi ||
-          Instr->getOpcode() == Patmos::SFREEi) {
+          Instr->getOpcode() == Patmos::SFREEi ||
+          Instr->getOpcode() == Patmos::SSPILLi) {
         I->StackCacheArg = Instr->getOperand(2).getImm();
       }
       // Export the worst-case spill and fill counts (if analysis available)
@@ -422,6 +491,12 @@ namespace llvm {
             SCA->Ensures.find(Instr);
           assert(it != SCA->Ensures.end());
           I->StackCacheFill = it->second;
+        } else if (Instr->getOpcode() == Patmos::SENSr) {
+          // bounded by the context switch analysis of interrupt handlers
+          PatmosStackCacheAnalysisInfo::FillSpillCounts::iterator it =
+            SCA->Ensures.find(Instr);
+          if (it != SCA->Ensures.end())
+            I->StackCacheFill = it->second;
         } else if (Instr->getOpcode() == Patmos::SRESi) {
           PatmosStackCacheAnalysisInfo::FillSpillCounts::iterator it =
             SCA->Reserves.find(Instr);
@@ -430,6 +505,27 @@ namespace llvm {
         }
       }
 
+      // Export the classification of the method cache accesses of calls
+      if (MCA->isValid() && Instr->isCall()) {
+        PatmosMethodCacheAnalysisInfo::CallSiteClasses::iterator it =
+          MCA->CallSites.find(Instr);
+        if (it != MCA->CallSites.end()) {
+          I->MethodCacheCall = it->second.Call;
+          I->MethodCacheReturn = it->second.Return;
+        }
+      }
+
+      // Export the classification of the data cache loads
+      if (DCA->isValid() && Instr->mayLoad()) {
+        PatmosDataCacheAnalysisInfo::LoadClasses::iterator it =
+          DCA->Loads.find(Instr);
+        if (it != DCA->Loads.end()) {
+          I->DataCache = it->second.Class;
+          if (it->second.Scope)
+            I->DataCacheScope = it->second.Scope->getNumber();
+        }
+      }
+
       if (!Instr->isInlineAsm() && (Instr->mayLoad() || Instr->mayStore())) {
         const PatmosInstrInfo *PII =
           static_cast<const PatmosInstrInfo*>(TM.getInstrInfo());
@@ -439,6 +535,10 @@ namespace llvm {
           case PatmosII::MEM_M: I->MemType = "memory"; break;
           case PatmosII::MEM_C: I->MemType = "cache";  break;
         }
+        // The time of a lock acquisition depends on the other cores
+        for (const MachineMemOperand *MMO : Instr->memoperands())
+          if (MMO->getFlags() & MOPatmosLockAcquire)
+            I->MemType = "lock";
       }
       return PMLMachineExport::exportInstruction(MF, I, Instr, BundledWithPred);
     }
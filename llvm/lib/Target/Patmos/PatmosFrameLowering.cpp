@@ -11,7 +11,6 @@
 //
 //===----------------------------------------------------------------------===//
 
-#define DEBUG_TYPE "patmos-framelowering"
 #include "PatmosFrameLowering.h"
 #include "PatmosInstrInfo.h"
 #include "PatmosMachineFunctionInfo.h"
@@ -19,10 +18,16 @@
 #include "PatmosSubtarget.h"
 #include "PatmosTargetMachine.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/CodeGen/MachineDominators.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/RegisterScavenging.h"
@@ -33,6 +38,8 @@
 
 using namespace llvm;
 
+#define DEBUG_TYPE "patmos-framelowering"
+
 namespace llvm {
   /// Count the number of FIs overflowing into the shadow stack
   STATISTIC(FIsNotFitSC, "FIs that did not fit in the stack cache");
@@ -50,6 +57,19 @@ static cl::opt<bool> EnableBlockAlignedStackCache
           ("mpatmos-enable-block-aligned-stack-cache", cl::init(false),
            cl::desc("Enable the use of Patmos' block-aligned stack cache"));
 
+/// EnableShrinkWrap - Command line option to set up the stack frame only on
+/// the paths that need it (disabled by default).
+static cl::opt<bool> EnableShrinkWrap
+          ("mpatmos-enable-shrink-wrap", cl::init(false),
+           cl::desc("Reserve and free the stack frame (on the stack cache and "
+                    "the shadow stack) only on the paths that need it"));
+
+/// DisableStackCacheLayout - Command line option to lay out stack cache
+/// objects in the order of their creation instead of by access frequency.
+static cl::opt<bool> DisableStackCacheLayout
+          ("mpatmos-disable-stack-cache-layout", cl::init(false),
+           cl::desc("Disable ordering stack cache objects by access frequency"));
+
 bool PatmosFrameLowering::hasFP(const MachineFunction &MF) const {
   auto MFI = MF.getFrameInfo();
 
@@ -62,6 +82,58 @@ bool PatmosFrameLowering::hasFP(const MachineFunction &MF) const {
           MFI.isFrameAddressTaken());
 }
 
+bool PatmosFrameLowering::hasReservedCallFrame(
+                                            const MachineFunction &MF) const {
+  return !MF.getFrameInfo().hasVarSizedObjects();
+}
+
+/// isGlobalStructor - Check whether a function is a global constructor or
+/// destructor, which run before and after main.
+static bool isGlobalStructor(const Function &F)
+{
+  for (const char *Name : {"llvm.global_ctors", "llvm.global_dtors"}) {
+    const GlobalVariable *GV = F.getParent()->getNamedGlobal(Name);
+    if (!GV || !GV->hasInitializer())
+      continue;
+
+    const ConstantArray *CA = dyn_cast<ConstantArray>(GV->getInitializer());
+    if (!CA)
+      continue;
+
+    for (const Use &U : CA->operands()) {
+      const ConstantStruct *CS = dyn_cast<ConstantStruct>(U.get());
+      if (CS && CS->getNumOperands() > 1 &&
+          CS->getOperand(1)->stripPointerCasts() == &F)
+        return true;
+    }
+  }
+  return false;
+}
+
+bool PatmosFrameLowering::initializesSmallDataBase(
+                                            const MachineFunction &MF) const
+{
+  const Function &F = MF.getFunction();
+  if (!STC.hasSmallData() || F.hasFnAttribute(Attribute::Naked))
+    return false;
+
+  return F.getName() == "main" ||
+         PatmosMachineFunctionInfo::isInterruptHandler(F) ||
+         isGlobalStructor(F);
+}
+
+bool PatmosFrameLowering::enableShrinkWrapping(const MachineFunction &MF) const
+{
+  // determineCalleeSaves is also called by the shrink-wrapping pass, it must
+  // thus not insert code or create frame objects.
+  // Single-path code executes all paths anyway.
+  return EnableShrinkWrap &&
+         !hasFP(MF) &&
+         !initializesSmallDataBase(MF) &&
+         !STC.getRegisterInfo()->requiresRegisterScavenging(MF) &&
+         !PatmosSinglePathInfo::isEnabled(MF);
+}
+
 static unsigned int align(unsigned int offset, unsigned int alignment) {
   return ((offset + alignment - 1) / alignment) * alignment;
 }
@@ -88,6 +160,103 @@ unsigned PatmosFrameLowering::getAlignedStackCacheFrameSize(
                                         STC.getAlignedStackFrameSize(frameSize);
 }
 
+unsigned PatmosFrameLowering::estimateStackCacheFrameSize(
+                                                    const Function &F) const
+{
+  if (DisableStackCache || F.isDeclaration())
+    return 0;
+
+  const DataLayout &DL = F.getParent()->getDataLayout();
+
+  unsigned frameSize = 0;
+  bool hasCalls = false;
+  for(Function::const_iterator i(F.begin()), ie(F.end()); i != ie; i++) {
+    for(BasicBlock::const_iterator j(i->begin()), je(i->end()); j != je; j++) {
+      if (const AllocaInst *AI = dyn_cast<AllocaInst>(&*j)) {
+        const ConstantInt *Count = dyn_cast<ConstantInt>(AI->getArraySize());
+        if (AI->isStaticAlloca() && Count) {
+          frameSize = align(frameSize, AI->getAlign().value()) +
+                      DL.getTypeAllocSize(AI->getAllocatedType()) *
+                      Count->getZExtValue();
+        }
+      }
+      else if (isa<CallBase>(&*j) && !isa<IntrinsicInst>(&*j)) {
+        hasCalls = true;
+      }
+    }
+  }
+
+  // the return base and offset are spilled around calls
+  if (hasCalls)
+    frameSize = align(frameSize, 4) + 8;
+
+  return getAlignedStackCacheFrameSize(frameSize);
+}
+
+/// Count the bytes of the objects assignFIsToStackCache will pick, without
+/// the callee saved registers, and of the return information spilled around
+/// calls.
+static unsigned countStackCacheObjectBytes(const MachineFunction &MF)
+{
+  const MachineFrameInfo &MFI = MF.getFrameInfo();
+  const PatmosMachineFunctionInfo &PMFI =
+                                  *MF.getInfo<PatmosMachineFunctionInfo>();
+
+  BitVector SCFIs(MFI.getObjectIndexEnd());
+  for (int FI : PMFI.getSinglePathFIs())
+    SCFIs.set(FI);
+  for (int FI : PMFI.getStackCacheAnalysisFIs())
+    SCFIs.set(FI);
+
+  unsigned frameSize = 0;
+  for(unsigned FI = 0, FIe = MFI.getObjectIndexEnd(); FI != FIe; FI++) {
+    if (MFI.isDeadObjectIndex(FI) ||
+        !(SCFIs[FI] || MFI.isSpillSlotObjectIndex(FI)))
+      continue;
+    frameSize = align(frameSize, MFI.getObjectAlign(FI).value()) +
+                MFI.getObjectSize(FI);
+  }
+
+  // the return base and offset are spilled around calls
+  if (MFI.hasCalls())
+    frameSize = align(frameSize, 4) + 8;
+
+  return align(frameSize, 4);
+}
+
+bool PatmosFrameLowering::hasStackCacheSpace(const MachineFunction &MF,
+                                             unsigned Size) const
+{
+  if (DisableStackCache)
+    return false;
+
+  // the callee saved registers are not known yet
+  return countStackCacheObjectBytes(MF) + Size <= getEffectiveStackCacheSize();
+}
+
+unsigned PatmosFrameLowering::estimateStackCacheFrameSize(
+                                              const MachineFunction &MF) const
+{
+  const PatmosMachineFunctionInfo &PMFI =
+                                  *MF.getInfo<PatmosMachineFunctionInfo>();
+  if (DisableStackCache || PMFI.hasStackCacheParams() ||
+      PMFI.isInterruptHandler() || PMFI.hasShadowStackFrame())
+    return 0;
+
+  unsigned frameSize = countStackCacheObjectBytes(MF);
+
+  // the general-purpose callee saved registers modified by the function
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  for (const MCPhysReg *CSR = STC.getRegisterInfo()->getCalleeSavedRegs(&MF);
+       *CSR; CSR++) {
+    if (Patmos::RRegsRegClass.contains(*CSR) && MRI.isPhysRegModified(*CSR))
+      frameSize += 4;
+  }
+
+  return std::min(getAlignedStackCacheFrameSize(frameSize),
+                  PMFI.getStackCacheLimit());
+}
+
 void PatmosFrameLowering::assignFIsToStackCache(MachineFunction &MF,
                                                 BitVector &SCFIs) const
 {
@@ -139,6 +308,73 @@ void PatmosFrameLowering::assignFIsToStackCache(MachineFunction &MF,
 
 
 
+/// Estimate how often each frame object is accessed. Every instruction
+/// referencing a FI counts once, scaled by the frequency of its block on the
+/// worst-case path if WCET analysis results were imported, or by 8 for each
+/// loop surrounding it otherwise.
+static std::vector<uint64_t> estimateFIAccesses(MachineFunction &MF)
+{
+  MachineFrameInfo &MFI = MF.getFrameInfo();
+  const PatmosAnalysisInfo &PAI =
+                   MF.getInfo<PatmosMachineFunctionInfo>()->getAnalysisInfo();
+  std::vector<uint64_t> Accesses(MFI.getObjectIndexEnd(), 0);
+
+  MachineDominatorTree MDT(MF);
+  MachineLoopInfo LI(MDT);
+
+  for (const MachineBasicBlock &MBB : MF) {
+    uint64_t Weight = PAI.hasFrequencies() ? PAI.getFrequency(&MBB, 0) :
+                      1ull << (3 * std::min(LI.getLoopDepth(&MBB), 8u));
+    for (const MachineInstr &MI : MBB) {
+      for (const MachineOperand &MO : MI.operands()) {
+        if (MO.isFI() && MO.getIndex() >= 0)
+          Accesses[MO.getIndex()] += Weight;
+      }
+    }
+  }
+  return Accesses;
+}
+
+/// Return the order in which the frame objects should be laid out.
+/// Objects to be put on the stack cache come first: objects callees expect on
+/// the stack cache, then the others by decreasing accesses per byte. Hot
+/// objects thus end up closest to the top of the stack and, if the stack cache
+/// overflows, the coldest ones are moved to the shadow stack. Ties are broken
+/// by decreasing alignment to reduce padding, and then by index.
+static std::vector<unsigned> getFrameLayoutOrder(MachineFunction &MF,
+                                                 const BitVector &SCFIs)
+{
+  MachineFrameInfo &MFI = MF.getFrameInfo();
+  PatmosMachineFunctionInfo &PMFI = *MF.getInfo<PatmosMachineFunctionInfo>();
+
+  std::vector<unsigned> Order;
+  for(unsigned FI = 0, FIe = MFI.getObjectIndexEnd(); FI != FIe; FI++) {
+    if (!MFI.isDeadObjectIndex(FI))
+      Order.push_back(FI);
+  }
+
+  if (DisableStackCacheLayout || SCFIs.none())
+    return Order;
+
+  std::vector<uint64_t> Accesses = estimateFIAccesses(MF);
+  auto density = [&](unsigned FI) {
+    return (double) Accesses[FI] / std::max<int64_t>(MFI.getObjectSize(FI), 1);
+  };
+
+  std::stable_sort(Order.begin(), Order.end(), [&](unsigned A, unsigned B) {
+    if (SCFIs[A] != SCFIs[B])
+      return (bool) SCFIs[A];
+    if (!SCFIs[A])
+      return false;
+    if (PMFI.isStackCacheArgumentFI(A) != PMFI.isStackCacheArgumentFI(B))
+      return PMFI.isStackCacheArgumentFI(A);
+    if (density(A) != density(B))
+      return density(A) > density(B);
+    return MFI.getObjectAlign(A) > MFI.getObjectAlign(B);
+  });
+  return Order;
+}
+
 unsigned PatmosFrameLowering::assignFrameObjects(MachineFunction &MF,
                                                  bool UseStackCache) const
 {
@@ -149,6 +385,10 @@ unsigned PatmosFrameLowering::assignFrameObjects(MachineFunction &MF,
   // defaults to false (all objects are assigned to shadow stack)
   BitVector SCFIs(MFI.getObjectIndexEnd());
 
+  // the stack cache budget may leave the function less than the whole cache
+  unsigned SCSize = std::min(getEffectiveStackCacheSize(),
+                             PMFI.getStackCacheLimit());
+
   if (UseStackCache) {
     assignFIsToStackCache(MF, SCFIs);
   }
@@ -158,9 +398,9 @@ unsigned PatmosFrameLowering::assignFrameObjects(MachineFunction &MF,
   // next stack slot in stack cache
   unsigned int SCOffset = 0;
   // next stack slot in shadow stack
-  // Also reserve space for the call frame if we do not use a frame pointer.
-  // This must be in sync with PatmosRegisterInfo::eliminateCallFramePseudoInstr
-  unsigned int SSOffset = (hasFP(MF) ? 0 : maxFrameSize);
+  // Also reserve space for the call frame unless there are dynamic allocas.
+  // This must be in sync with eliminateCallFramePseudoInstr
+  unsigned int SSOffset = (hasReservedCallFrame(MF) ? maxFrameSize : 0);
 
   // Indirect memory access instructions for each FI
   const auto& indirectMemAccess = PMFI.getStackCacheAnalysisFIIndirectMemInstructions();
@@ -168,10 +408,7 @@ unsigned PatmosFrameLowering::assignFrameObjects(MachineFunction &MF,
 
   LLVM_DEBUG(dbgs() << "PatmosSC: " << MF.getFunction().getName() << "\n");
   LLVM_DEBUG(MFI.print(MF, dbgs()));
-  for(unsigned FI = 0, FIe = MFI.getObjectIndexEnd(); FI != FIe; FI++) {
-    if (MFI.isDeadObjectIndex(FI))
-      continue;
-
+  for(unsigned FI : getFrameLayoutOrder(MF, SCFIs)) {
     unsigned FIalignment = MFI.getObjectAlignment(FI);
     int64_t FIsize = MFI.getObjectSize(FI);
 
@@ -189,7 +426,7 @@ unsigned PatmosFrameLowering::assignFrameObjects(MachineFunction &MF,
 
       // check if the FI still fits into the SC
       if (align(next_SCOffset + FIsize, getEffectiveStackCacheBlockSize()) <=
-          getEffectiveStackCacheSize()) {
+          SCSize) {
         LLVM_DEBUG(dbgs() << "PatmosSC: FI: " << FI << " on SC: " << next_SCOffset
                     << "(" << MFI.getObjectOffset(FI) << ")\n");
 
@@ -223,6 +460,13 @@ unsigned PatmosFrameLowering::assignFrameObjects(MachineFunction &MF,
         continue;
       }
       else {
+        // callees expect the object on the SC
+        if (PMFI.isStackCacheArgumentFI(FI)) {
+          report_fatal_error("Object passed to a callee on the stack cache "
+                             "does not fit into the stack cache in function '" +
+                             MF.getName() + "'.");
+        }
+
         // the FI did not fit in the SC -- fall-through and put it on the 
         // shadow stack
         SCFIs[FI] = false;
@@ -310,8 +554,8 @@ void PatmosFrameLowering::patchCallSites(MachineFunction &MF) const {
   for (MachineFunction::iterator i(MF.begin()), ie(MF.end()); i != ie; ++i) {
     for (MachineBasicBlock::iterator j(i->begin()), je=(i->end()); j != je;
          j++) {
-      // a call site?
-      if (j->isCall()) {
+      // a call site? Tail calls do not return here.
+      if (j->isCall() && !j->isReturn()) {
         MachineBasicBlock::iterator p(std::next(j));
         emitSTC(MF, *i, p, Patmos::SENSi);
       }
@@ -321,6 +565,7 @@ void PatmosFrameLowering::patchCallSites(MachineFunction &MF) const {
 
 void PatmosFrameLowering::emitPrologue(MachineFunction &MF, MachineBasicBlock &MBB) const {
   const TargetInstrInfo *TII = STC.getInstrInfo();
+  PatmosMachineFunctionInfo &PMFI = *MF.getInfo<PatmosMachineFunctionInfo>();
 
   MachineBasicBlock::iterator MBBI = MBB.begin();
   DebugLoc dl = MBBI != MBB.end() ? MBBI->getDebugLoc() : DebugLoc();
@@ -328,8 +573,18 @@ void PatmosFrameLowering::emitPrologue(MachineFunction &MF, MachineBasicBlock &M
   //----------------------------------------------------------------------------
   // Handle the stack cache -- if enabled.
 
-  // assign some FIs to the stack cache if possible
-  unsigned stackSize = assignFrameObjects(MF, !DisableStackCache);
+  // assign some FIs to the stack cache if possible, functions accessing the
+  // stack cache frames of their callers must not reserve any space.
+  // Interrupt handlers keep their frame on the shadow stack, their reserve
+  // would spill the stack cache of the interrupted code, as do the functions
+  // moved off the worst-case call path by PatmosStackCacheBudget.
+  unsigned stackSize = assignFrameObjects(MF, !DisableStackCache &&
+                                              !PMFI.hasStackCacheParams() &&
+                                              !PMFI.isInterruptHandler() &&
+                                              !PMFI.hasShadowStackFrame());
+
+  // the frame may be set up in a block other than the entry (shrink-wrapping)
+  PMFI.setShrinkWrapped(&MBB != &MF.front());
 
   if (!DisableStackCache) {
     // emit a reserve instruction
@@ -364,10 +619,13 @@ void PatmosFrameLowering::emitPrologue(MachineFunction &MF, MachineBasicBlock &M
 
 void PatmosFrameLowering::emitEpilogue(MachineFunction &MF,
                                        MachineBasicBlock &MBB) const {
-  MachineBasicBlock::iterator MBBI = MBB.getLastNonDebugInstr();
+  // Insert before the terminators, the block is not necessarily a return
+  // block when shrink-wrapping.
+  MachineBasicBlock::iterator MBBI = MBB.getFirstTerminator();
   MachineFrameInfo &MFI            = MF.getFrameInfo();
   const TargetInstrInfo *TII       = STC.getInstrInfo();
-  DebugLoc dl                      = MBBI->getDebugLoc();
+  DebugLoc dl                      = MBBI != MBB.end() ? MBBI->getDebugLoc()
+                                                       : DebugLoc();
 
   //----------------------------------------------------------------------------
   // Handle Stack Cache
@@ -420,6 +678,15 @@ void PatmosFrameLowering::determineCalleeSaves(MachineFunction &MF,
     return;
   }
 
+  // Local functions do not save the callee saved registers with IPRA, their
+  // callers know what they modify. The return information overwritten by
+  // their calls has to be kept anyway.
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  if (MRI.isPhysRegModified(Patmos::SRB))
+    SavedRegs.set(Patmos::SRB);
+  if (MRI.isPhysRegModified(Patmos::SRO))
+    SavedRegs.set(Patmos::SRO);
+
   if (hasFP(MF)) {
     // if framepointer enabled, set it to point to the stack pointer.
     // Set frame pointer: FP = SP
@@ -429,6 +696,16 @@ void PatmosFrameLowering::determineCalleeSaves(MachineFunction &MF,
     SavedRegs.set(Patmos::RFP);
   }
 
+  // Set up the small data base register after saving the one of the caller,
+  // the code compiled for the small data area reserves it.
+  if (initializesSmallDataBase(MF)) {
+    AddDefaultPred(BuildMI(EntryMBB, EntryMBB.begin(), DL,
+          TII->get(Patmos::LIl), Patmos::R28))
+      .addExternalSymbol("_SDA_BASE_")
+      .setMIFlag(MachineInstr::FrameSetup);
+    SavedRegs.set(Patmos::R28);
+  }
+
   // mark all predicate registers as used, for single path support
   // S0 is saved/restored as whole anyway
   if (PatmosSinglePathInfo::isEnabled(MF)) {
@@ -442,6 +719,23 @@ void PatmosFrameLowering::determineCalleeSaves(MachineFunction &MF,
     RS->addScavengingFrameIndex(fi);
     PMFI.setRegScavengingFI(fi);
   }
+
+  if (PMFI.isInterruptHandler()) {
+    // RTR is used by expansions that are only done later, and can be live
+    // at the interrupt.
+    SavedRegs.set(Patmos::RTR);
+
+    // The callees of the handler may displace the stack cache contents of
+    // the interrupted code. Keep the occupancy at the interrupt to ensure it
+    // again on return, the calls clobber R1 and R2 to compute it anyway.
+    if (MFI.hasCalls() && !DisableStackCache) {
+      const TargetRegisterClass &RC = Patmos::RRegsRegClass;
+      SavedRegs.set(Patmos::R1);
+      SavedRegs.set(Patmos::R2);
+      PMFI.setInterruptOccupancyFI(MFI.CreateStackObject(
+          TRI->getSpillSize(RC), TRI->getSpillAlign(RC), false));
+    }
+  }
 }
 
 /// Gets the general-purpose register that should be used to spill/restore
@@ -561,6 +855,26 @@ PatmosFrameLowering::spillCalleeSavedRegisters(MachineBasicBlock &MBB,
 		std::prev(MI)->setFlag(MachineInstr::FrameSetup);
   }
 
+  // Keep the stack cache occupancy of the interrupted code in words,
+  // R1 = (SS - ST) / 4, for the ensure on return.
+  PatmosMachineFunctionInfo &PMFI = *MF.getInfo<PatmosMachineFunctionInfo>();
+  if (PMFI.getInterruptOccupancyFI() != -1) {
+    TII.copyPhysReg(MBB, MI, DL, Patmos::R1, Patmos::SS, false);
+    std::prev(MI)->setFlag(MachineInstr::FrameSetup);
+    TII.copyPhysReg(MBB, MI, DL, Patmos::R2, Patmos::ST, false);
+    std::prev(MI)->setFlag(MachineInstr::FrameSetup);
+    AddDefaultPred(BuildMI(MBB, MI, DL, TII.get(Patmos::SUBr), Patmos::R1))
+      .addReg(Patmos::R1).addReg(Patmos::R2, RegState::Kill)
+      ->setFlag(MachineInstr::FrameSetup);
+    AddDefaultPred(BuildMI(MBB, MI, DL, TII.get(Patmos::SRi), Patmos::R1))
+      .addReg(Patmos::R1).addImm(2)
+      ->setFlag(MachineInstr::FrameSetup);
+    TII.storeRegToStackSlot(MBB, MI, Patmos::R1, true,
+                            PMFI.getInterruptOccupancyFI(),
+                            &Patmos::RRegsRegClass, TRI);
+    std::prev(MI)->setFlag(MachineInstr::FrameSetup);
+  }
+
   return true;
 }
 
@@ -586,6 +900,18 @@ PatmosFrameLowering::restoreCalleeSavedRegisters(MachineBasicBlock &MBB,
       .addReg(Patmos::RFP);
   }
 
+  // Ensure the stack cache contents of the interrupted code again, only the
+  // words displaced by the callees are filled. R1 is restored below.
+  if (PMFI.getInterruptOccupancyFI() != -1) {
+    TII.loadRegFromStackSlot(MBB, MI, Patmos::R1,
+                             PMFI.getInterruptOccupancyFI(),
+                             &Patmos::RRegsRegClass, TRI);
+    std::prev(MI)->setFlag(MachineInstr::FrameSetup);
+    AddDefaultPred(BuildMI(MBB, MI, DL, TII.get(Patmos::SENSr)))
+      .addReg(Patmos::R1, RegState::Kill)
+      ->setFlag(MachineInstr::FrameSetup);
+  }
+
   // We need to restore the special-purpose registers first, so sort the list of register
   // into general and special (with their frame-indices)
   std::vector<std::pair<Register, unsigned>> rregs;
@@ -643,6 +969,31 @@ PatmosFrameLowering::restoreCalleeSavedRegisters(MachineBasicBlock &MBB,
   return true;
 }
 
+/// getStackPointerAdjustment - Check whether MI is an unpredicated
+/// adjustment of the stack pointer by an immediate, and return the amount
+/// added to it in Amount.
+static bool getStackPointerAdjustment(const PatmosInstrInfo &TII,
+                                      const MachineInstr &MI, int64_t &Amount)
+{
+  switch (MI.getOpcode()) {
+  case Patmos::ADDi: case Patmos::ADDl:
+  case Patmos::SUBi: case Patmos::SUBl:
+    break;
+  default:
+    return false;
+  }
+
+  if (MI.getOperand(0).getReg() != Patmos::RSP ||
+      MI.getOperand(3).getReg() != Patmos::RSP || !MI.getOperand(4).isImm() ||
+      TII.isPredicated(MI) || MI.getFlag(MachineInstr::FrameSetup))
+    return false;
+
+  Amount = MI.getOperand(4).getImm();
+  if (MI.getOpcode() == Patmos::SUBi || MI.getOpcode() == Patmos::SUBl)
+    Amount = -Amount;
+  return true;
+}
+
 MachineBasicBlock::iterator
 PatmosFrameLowering::eliminateCallFramePseudoInstr(MachineFunction &MF,
                                                    MachineBasicBlock &MBB,
@@ -651,26 +1002,40 @@ PatmosFrameLowering::eliminateCallFramePseudoInstr(MachineFunction &MF,
 
   // We need to adjust the stack pointer here (and not in the prologue) to
   // handle alloca instructions that modify the stack pointer before ADJ*
-  // instructions. We only need to do that if we need a frame pointer, otherwise
-  // we reserve size for the call stack frame in FrameLowering in the prologue.
-  if (hasFP(MF)) {
+  // instructions. We only need to do that if there are dynamic allocas,
+  // otherwise we reserve size for the call stack frame in the prologue.
+  if (!hasReservedCallFrame(MF)) {
     MachineInstr &MI = *I;
     DebugLoc dl = MI.getDebugLoc();
-    int Size = MI.getOperand(0).getImm();
-    unsigned Opcode;
+    int64_t Amount = MI.getOperand(0).getImm();
     if (MI.getOpcode() == Patmos::ADJCALLSTACKDOWN) {
-      Opcode = (Size <= 0xFFF) ? Patmos::SUBi : Patmos::SUBl;
+      Amount = -Amount;
     }
-    else if (MI.getOpcode() == Patmos::ADJCALLSTACKUP) {
-      Opcode = (Size <= 0xFFF) ? Patmos::ADDi : Patmos::ADDl;
-    }
-    else {
+    else if (MI.getOpcode() != Patmos::ADJCALLSTACKUP) {
         llvm_unreachable("Unsupported pseudo instruction.");
     }
-    if (Size)
+
+    // Merge with the adjustment directly before, i.e., the release of the
+    // call frame of a preceding call.
+    int64_t PrevAmount;
+    MachineBasicBlock::iterator Prev = I != MBB.begin() ?
+                                       prev_nodbg(I, MBB.begin()) : I;
+    if (Amount && Prev != I && !Prev->isDebugInstr() &&
+        getStackPointerAdjustment(static_cast<const PatmosInstrInfo&>(TII),
+                                  *Prev, PrevAmount)) {
+      Amount += PrevAmount;
+      MBB.erase(Prev);
+    }
+
+    if (Amount) {
+      unsigned Size = Amount < 0 ? -Amount : Amount;
+      unsigned Opcode = Amount < 0 ?
+                          ((Size <= 0xFFF) ? Patmos::SUBi : Patmos::SUBl) :
+                          ((Size <= 0xFFF) ? Patmos::ADDi : Patmos::ADDl);
       AddDefaultPred(BuildMI(MBB, I, dl, TII.get(Opcode), Patmos::RSP))
                                                   .addReg(Patmos::RSP)
                                                   .addImm(Size);
+    }
   }
   // erase the pseudo instruction
   return MBB.erase(I);
@@ -24,22 +24,6 @@ protected:
   const PatmosTargetMachine &TM;
   const PatmosSubtarget &STC;
 
-  /// getEffectiveStackCacheSize - Return the size of the stack cache that can
-  /// be used by the compiler.
-  /// \see EnableBlockAlignedStackCache
-  unsigned getEffectiveStackCacheSize() const;
-
-  /// getEffectiveStackCacheBlockSize - Return the size of the stack cache's 
-  /// blocks as seen from the instruction set architecture.
-  /// \see EnableBlockAlignedStackCache
-  unsigned getEffectiveStackCacheBlockSize() const;
-
-  /// getAlignedStackCacheFrameSize - Return the frame size aligned to the 
-  /// effective stack cache block size.
-  /// \see EnableBlockAlignedStackCache
-  /// \see getEffectiveStackCacheBlockSize
-  unsigned getAlignedStackCacheFrameSize(unsigned frameSize) const;
-
   /// assignFIsToStackCache - Assign some FIs to the stack cache.
   /// Currently this is only done for spill slots.
   /// @param SCFIs - should be set to true for all indices of frame objects
@@ -48,6 +32,11 @@ protected:
 
   /// assignFrameObjects - Fix the layout of the stack frame, assign FIs to
   /// either stack cache or shadow stack, and update all stack offsets.
+  /// Stack cache objects are laid out by decreasing access frequency, such
+  /// that rarely accessed objects are the first to overflow to the shadow
+  /// stack, once the stack cache or the stack cache limit of the function is
+  /// exceeded.
+  /// \see PatmosMachineFunctionInfo::getStackCacheLimit
   /// Also reserves space for the call frame if no frame pointer is used.
   /// @return The final size of the shadow stack.
   unsigned assignFrameObjects(MachineFunction &MF, bool UseStackCache) const;
@@ -81,6 +70,59 @@ public:
 
   bool hasFP(const MachineFunction &MF) const override;
 
+  /// hasReservedCallFrame - The space for the arguments of calls passed on
+  /// the shadow stack is reserved in the prologue, unless the stack pointer
+  /// is moved by dynamic allocas. The frame pointer alone does not require
+  /// adjusting the stack pointer around each call.
+  bool hasReservedCallFrame(const MachineFunction &MF) const override;
+
+  /// initializesSmallDataBase - Check whether the function sets up the small
+  /// data base register on entry, i.e., main, interrupt handlers and global
+  /// constructors and destructors, which may be called from code that does
+  /// not keep the base.
+  bool initializesSmallDataBase(const MachineFunction &MF) const;
+
+  /// enableShrinkWrapping - Allow setting up the frame (sres/sfree and the
+  /// shadow stack adjustments) in blocks other than the entry and return
+  /// blocks.
+  /// \see EnableShrinkWrap
+  bool enableShrinkWrapping(const MachineFunction &MF) const override;
+
+  /// getEffectiveStackCacheSize - Return the size of the stack cache that can
+  /// be used by the compiler.
+  /// \see EnableBlockAlignedStackCache
+  unsigned getEffectiveStackCacheSize() const;
+
+  /// getEffectiveStackCacheBlockSize - Return the size of the stack cache's 
+  /// blocks as seen from the instruction set architecture.
+  /// \see EnableBlockAlignedStackCache
+  unsigned getEffectiveStackCacheBlockSize() const;
+
+  /// getAlignedStackCacheFrameSize - Return the frame size aligned to the 
+  /// effective stack cache block size.
+  /// \see EnableBlockAlignedStackCache
+  /// \see getEffectiveStackCacheBlockSize
+  unsigned getAlignedStackCacheFrameSize(unsigned frameSize) const;
+
+  /// estimateStackCacheFrameSize - Estimate the stack cache frame of a
+  /// function before instruction selection, i.e., the return information
+  /// saved by functions containing calls and the static allocas, which may be
+  /// promoted to the stack cache. Return 0 if the stack cache is disabled.
+  unsigned estimateStackCacheFrameSize(const Function &F) const;
+
+  /// estimateStackCacheFrameSize - Estimate the stack cache frame of a
+  /// function after register allocation, i.e., the objects assigned to the
+  /// stack cache by assignFIsToStackCache and the callee saved registers the
+  /// function modifies, bounded by the stack cache limit of the function.
+  /// Return 0 if the function does not use the stack cache.
+  unsigned estimateStackCacheFrameSize(const MachineFunction &MF) const;
+
+  /// hasStackCacheSpace - Return true if a new spill slot of the given size
+  /// is expected to fit into the stack cache frame of the function, judging
+  /// by the stack cache objects created so far. Return false if the stack
+  /// cache is disabled.
+  bool hasStackCacheSpace(const MachineFunction &MF, unsigned Size) const;
+
   void determineCalleeSaves(MachineFunction &MF, BitVector &SavedRegs,
                             RegScavenger *RS) const override;
   bool spillCalleeSavedRegisters(MachineBasicBlock &MBB,
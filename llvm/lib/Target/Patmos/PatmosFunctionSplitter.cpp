@@ -43,6 +43,25 @@
 //       method cache, add the entire loop to the region. Otherwise, start a new
 //       region at all successors of the header.
 //
+// With -mpatmos-function-splitter-profile, the order of the topological
+// traversal prefers blocks with a higher block frequency (which reflects
+// profile data if available), so that hot blocks join a region before it is
+// full. A block or loop that is executed much more often than the entry of the
+// current region may extend the region up to the maximum size, to avoid
+// method cache transfers in hot code.
+//
+// With -mpatmos-function-splitter-wcet-profile, the frequencies are instead
+// read from a PML file with the results of a WCET analysis of a previous
+// compilation, i.e., the frequencies of the blocks on the worst-case path as
+// written by platin for an -mpatmos-serialize export. In addition to the
+// above, blocks off the worst-case path do not join regions on it, as they
+// would only make the method cache load these regions more slowly. Blocks are
+// matched by function name and the name of their IR basic block, or by their
+// number for unnamed blocks, which requires that the function was not
+// renumbered by splitting in the previous compilation. Without this option,
+// the frequencies imported with -mpatmos-wcet-profile for all passes are used
+// the same way (see PatmosCriticalityImport).
+//
 // Jump tables require some special handling, since either all targets of the
 // table either have to be region entries or have to be in the same region as 
 // all indirect branches using that table.
@@ -65,12 +84,17 @@
 #include "PatmosAsmPrinter.h"
 #include "PatmosInstrInfo.h"
 #include "PatmosMachineFunctionInfo.h"
+#include "PatmosStats.h"
 #include "PatmosSubtarget.h"
 #include "PatmosTargetMachine.h"
+#include "PatmosTuning.h"
+#include "PatmosWCETProfile.h"
 #include "llvm/IR/Function.h"
 #include "llvm/ADT/GraphTraits.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
 #include "llvm/CodeGen/MachineDominators.h"
 #include "llvm/CodeGen/MachinePostDominators.h"
 #include "llvm/CodeGen/MachineFunction.h"
@@ -78,6 +102,7 @@
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineJumpTableInfo.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/CodeGen/MachineOptimizationRemarkEmitter.h"
 #include "llvm/MC/MCInst.h"
 #include "llvm/MC/MCInstrDesc.h"
 #include "llvm/MC/MCSectionELF.h"
@@ -89,6 +114,7 @@
 #include "llvm/Support/DOTGraphTraits.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Timer.h"
+#include "PatmosRegionTimer.h"
 #include "llvm/Target/TargetLoweringObjectFile.h"
 
 #include <map>
@@ -130,6 +156,28 @@ static cl::opt<int> MaxSubfunctionSize(
     cl::desc("Maximum size of subfunctions after function splitting, defaults "
              "to the method cache size if set to 0. (default: 1024)"));
 
+static cl::opt<bool> UseBlockFrequencies(
+    "mpatmos-function-splitter-profile",
+    cl::init(false),
+    cl::desc("Use block frequencies, which reflect profile data if available, "
+             "to keep hot code inside a subfunction."),
+    cl::Hidden);
+
+static cl::opt<double> HotRatio(
+    "mpatmos-function-splitter-hot-ratio",
+    cl::init(2.0),
+    cl::desc("Minimum ratio of the frequency of a block to the frequency of "
+             "the subfunction entry for which the subfunction is extended up "
+             "to the maximum size. (default: 2)"),
+    cl::Hidden);
+
+static cl::opt<std::string> WCETProfile(
+    "mpatmos-function-splitter-wcet-profile",
+    cl::desc("Use the frequencies of the blocks on the worst-case path from "
+             "the given PML file to keep it inside few subfunctions."),
+    cl::value_desc("filename"),
+    cl::Hidden);
+
 static cl::opt<bool> SplitCallBlocks(
     "mpatmos-split-call-blocks",
     cl::init(true),
@@ -169,6 +217,9 @@ namespace llvm {
   STATISTIC(NOPsInserted, "NOPs inserted by function splitter");
   STATISTIC(PostDomsFound, "Post dominators checked");
   STATISTIC(PostDomsAdded, "Post dominators added by increasing region size");
+  STATISTIC(HotBlocksAdded, "Hot blocks added by increasing region size");
+  STATISTIC(WCETProfileBlocks, "Blocks with a frequency from a WCET profile");
+  STATISTIC(ColdBlocks, "Regions started at blocks off the worst-case path");
 
   class ablock;
   class agraph;
@@ -230,6 +281,11 @@ namespace llvm {
     /// \see computeRegions
     ablock *Region;
 
+    /// The execution frequency of the block relative to the function entry,
+    /// or on the worst-case path, if frequencies are used. For artificial
+    /// headers, this is the highest frequency of the blocks they lead to.
+    double Frequency;
+
     /// Number of predecessors. This is computed late by countPredecessors and
     /// is used to update the ready list during the topological sorting.
     /// \see countPredecessors
@@ -243,19 +299,20 @@ namespace llvm {
     : ID(id), G(g), MBB(mbb), FallthroughTarget(0),
       HasCall(false), HasCallinSCC(false),
       NumBranches(0), Size(0),
-      SCCSize(0), Region(NULL), NumPreds(0)
+      SCCSize(0), Region(NULL), Frequency(0), NumPreds(0)
     {
       const PatmosInstrInfo *PII = PTM.getInstrInfo();
 
       // Count number of branches, size of block, and check for calls
       if (MBB) {
+        Size = PII->getBlockSize(*MBB);
+
         for(MachineBasicBlock::instr_iterator t(MBB->instr_begin()),
             te(MBB->instr_end()); t != te; t++)
         {
           MachineInstr *mi = &*t;
 
           if (mi->isBundle()) continue;
-          Size += PII->getInstrSize(mi);
 
           if (PII->hasCall(mi))
             HasCall = true;
@@ -347,7 +404,8 @@ namespace llvm {
     bool operator()(const ready_block &lhs, const ready_block &rhs) const {
       // On the ready list, we sort by highest criticality first, then
       // lowest ID first
-      if (lhs.criticality > rhs.criticality) return true;
+      if (lhs.criticality != rhs.criticality)
+        return lhs.criticality > rhs.criticality;
       return lhs.block->ID < rhs.block->ID;
     }
   } SortCritCmp;
@@ -384,27 +442,46 @@ namespace llvm {
 
     MachinePostDominatorTree &MPDT;
 
-    /// Construct a graph from a machine function.
+    /// Whether the blocks carry frequencies, and the highest frequency.
+    bool UseFrequencies;
+    double MaxFrequency;
+
+    /// Whether the frequencies are those on the worst-case path.
+    bool WCETFrequencies;
+
+    /// Construct a graph from a machine function, with the given block
+    /// frequencies, if any.
     agraph(MachineFunction *mf, PatmosTargetMachine &tm,
            MachinePostDominatorTree &mpdt, unsigned int preferredRegionSize,
-           unsigned int preferredSCCSize, unsigned int maxRegionSize)
+           unsigned int preferredSCCSize, unsigned int maxRegionSize,
+           const std::map<const MachineBasicBlock*, double> *frequencies = NULL,
+           bool wcetFrequencies = false)
     : MF(mf), PTM(tm), STC(*tm.getSubtargetImpl()),
       PII(*tm.getInstrInfo()),
       PreferredRegionSize(preferredRegionSize),
       PreferredSCCSize(preferredSCCSize), MaxRegionSize(maxRegionSize),
-      MPDT(mpdt)
+      MPDT(mpdt), UseFrequencies(frequencies != NULL), MaxFrequency(0),
+      WCETFrequencies(wcetFrequencies)
     {
       Blocks.reserve(mf->size());
 
       // create blocks
       unsigned id = 0;
-      std::map<const MachineBasicBlock*, ablock*> MBBtoA;
+      std::vector<ablock*> MBBtoA(mf->getNumBlockIDs());
       ablock *pred = 0;
       for(MachineFunction::iterator i(mf->begin()), ie(mf->end());
           i != ie; i++) {
         // make a block
         ablock *ab = new ablock(PTM, id++, this, &*i);
 
+        if (frequencies) {
+          std::map<const MachineBasicBlock*, double>::const_iterator f =
+                                                         frequencies->find(&*i);
+          if (f != frequencies->end())
+            ab->Frequency = f->second;
+          MaxFrequency = std::max(MaxFrequency, ab->Frequency);
+        }
+
         // Keep track of fallthough edges
         if (pred && mayFallThrough(PTM, pred->MBB)) {
           pred->FallthroughTarget = ab;
@@ -412,7 +489,7 @@ namespace llvm {
         pred = ab;
 
         // store block
-        MBBtoA[&*i] = ab;
+        MBBtoA[i->getNumber()] = ab;
         Blocks.push_back(ab);
       }
 
@@ -421,12 +498,12 @@ namespace llvm {
           i != ie; i++) {
 
         // get ablock of source
-        ablock *s = MBBtoA[&*i];
+        ablock *s = MBBtoA[i->getNumber()];
 
         for(MachineBasicBlock::const_succ_iterator j(i->succ_begin()),
             je(i->succ_end()); j != je; j++) {
           // get ablock of destination
-          ablock *d = MBBtoA[*j];
+          ablock *d = MBBtoA[(*j)->getNumber()];
 
           // make and store the edge
           aedge *e = new aedge(s, d);
@@ -454,7 +531,7 @@ namespace llvm {
                it = JTs[idx].MBBs.begin(), ie = JTs[idx].MBBs.end();
                it != ie; it++)
           {
-            ablock *d = MBBtoA[*it];
+            ablock *d = MBBtoA[(*it)->getNumber()];
             d->JTIDs.insert(idx);
 
             entries.insert(d);
@@ -558,15 +635,7 @@ namespace llvm {
     static unsigned int getBBSize(MachineBasicBlock *MBB,
                                   PatmosTargetMachine &PTM)
     {
-      unsigned int size = 0;
-      for(MachineBasicBlock::instr_iterator i(MBB->instr_begin()),
-          ie(MBB->instr_end()); i != ie; i++)
-      {
-        if (i->isBundle()) continue;
-        size += getInstrSize(&*i, PTM);
-      }
-
-      return size;
+      return PTM.getInstrInfo()->getBlockSize(*MBB);
     }
 
     /// hasCall - Check whether the basic block contains a call instruction.
@@ -613,6 +682,8 @@ namespace llvm {
           j != je; j++) {
         aedge *e = new aedge(header, *j);
         Edges.insert(std::make_pair(header, e));
+
+        header->Frequency = std::max(header->Frequency, (*j)->Frequency);
       }
 
       return header;
@@ -648,9 +719,10 @@ namespace llvm {
     {
       int DFS_index;
       int Low_link;
+      bool On_stack;
 
       /// Default initialization of node infos.
-      tarjan_node_info() : DFS_index(-1), Low_link(-1)
+      tarjan_node_info() : DFS_index(-1), Low_link(-1), On_stack(false)
       {
       }
     };
@@ -658,77 +730,49 @@ namespace llvm {
     /// A vector of node infos for Tarjan's SCC algorithm.
     typedef std::vector<tarjan_node_info> tarjan_node_info_set;
 
+    /// A node on the DFS stack of Tarjan's SCC algorithm, with its outgoing
+    /// edges that remain to be visited.
+    struct tarjan_frame
+    {
+      ablock *Node;
+      aedges::const_iterator Edge, EdgeEnd;
+    };
+
     /// A vector of strongly connected components, i.e., vectors of node indices.
     typedef std::vector<ablocks> scc_vector;
 
-    /// Recursive part of Tarjan's SCC algorithm.
+    /// Start visiting a node in Tarjan's SCC algorithm.
     /// \see scc_tarjan
-    /// @param node The current node visited by the DFS.
+    /// @param node The node visited by the DFS.
     /// @param dfs_index The current DFS index.
     /// @param nodes Stack holding the nodes of the SCC under construction.
     /// @param node_infos Auxiliary infos on nodes.
-    /// @param scc_result The final set of SCCs.
-    void scc_tarjan_(ablock *node, int &dfs_index, ablocks &nodes,
-                     tarjan_node_info_set &node_infos,
-                     scc_vector &scc_result) const
+    /// @param frames The DFS stack.
+    void scc_tarjan_visit(ablock *node, int &dfs_index, ablocks &nodes,
+                          tarjan_node_info_set &node_infos,
+                          std::vector<tarjan_frame> &frames) const
     {
-      unsigned node_id = node->ID;
+      tarjan_node_info &info = node_infos[node->ID];
 
       // Set depth and DFS index of current node
-      node_infos[node_id].DFS_index = dfs_index;
-      node_infos[node_id].Low_link = dfs_index;
+      info.DFS_index = dfs_index;
+      info.Low_link = dfs_index;
 
       // increment DFS index
       dfs_index++;
 
       // push the node on the stack
       nodes.push_back(node);
+      info.On_stack = true;
 
-      // visit successor nodes and check whether the current node is the root of
-      // an SCC
-      for(aedges::const_iterator i(Edges.lower_bound(node)),
-          ie(Edges.upper_bound(node)); i != ie; i++) {
-        // get destination
-        ablock *dst = i->second->Dst;
-        unsigned dst_id = dst->ID;
-        assert(i->second->Src == node);
-
-        // has the successor been visited?
-        if (node_infos[dst_id].DFS_index == -1)
-        {
-          // visit successor and update the current node's low link.
-          scc_tarjan_(dst, dfs_index, nodes, node_infos, scc_result);
-
-          node_infos[node_id].Low_link = std::min(node_infos[node_id].Low_link,
-                                                  node_infos[dst_id].Low_link);
-        }
-        else if (std::find(nodes.begin(), nodes.end(), dst) != nodes.end())
-        {
-          // i is on the stack --> update low link
-          node_infos[node_id].Low_link = std::min(node_infos[node_id].Low_link,
-                                                  node_infos[dst_id].DFS_index);
-        }
-      }
-
-      // if the current node is the root of an SCC, make a new SCC.
-      if (node_infos[node_id].Low_link == node_infos[node_id].DFS_index)
-      {
-        scc_result.resize(scc_result.size()+1);
-
-        ablock *top = NULL;
-        do
-        {
-          top = nodes.back();
-
-          // add the node to the SCC
-          scc_result.back().push_back(top);
-
-          nodes.pop_back();
-        } while (top != node);
-      }
+      tarjan_frame frame = { node, Edges.lower_bound(node),
+                             Edges.upper_bound(node) };
+      frames.push_back(frame);
     }
 
     /// Compute the set of strongly connected components of the graph.
+    /// The DFS is iterative, visiting the nodes in the same order as the
+    /// recursive formulation.
     /// \see R. Tarjan, Depth-First Search and Linear Graph Algorithms
     /// @return A set of SCCs computed by Tarjan's algorithm.
     scc_vector scc_tarjan() const
@@ -739,12 +783,67 @@ namespace llvm {
       ablocks nodes;
       nodes.reserve(Blocks.size());
 
+      std::vector<tarjan_frame> frames;
+      frames.reserve(Blocks.size());
+
       scc_vector scc_result;
 
       for(ablocks::const_iterator i(Blocks.begin()), ie(Blocks.end()); i != ie;
           i++) {
-        if (node_infos[(*i)->ID].DFS_index == -1) {
-          scc_tarjan_(*i, dfs_index, nodes, node_infos, scc_result);
+        if (node_infos[(*i)->ID].DFS_index != -1)
+          continue;
+
+        scc_tarjan_visit(*i, dfs_index, nodes, node_infos, frames);
+
+        while (!frames.empty()) {
+          tarjan_frame &frame = frames.back();
+          ablock *node = frame.Node;
+          tarjan_node_info &info = node_infos[node->ID];
+
+          // visit successor nodes
+          if (frame.Edge != frame.EdgeEnd) {
+            // get destination
+            ablock *dst = frame.Edge->second->Dst;
+            tarjan_node_info &dst_info = node_infos[dst->ID];
+            assert(frame.Edge->second->Src == node);
+            frame.Edge++;
+
+            if (dst_info.DFS_index == -1) {
+              // visit successor, the low link is updated when it is done.
+              scc_tarjan_visit(dst, dfs_index, nodes, node_infos, frames);
+            }
+            else if (dst_info.On_stack) {
+              // dst is on the stack --> update low link
+              info.Low_link = std::min(info.Low_link, dst_info.DFS_index);
+            }
+            continue;
+          }
+
+          // if the current node is the root of an SCC, make a new SCC.
+          if (info.Low_link == info.DFS_index)
+          {
+            scc_result.resize(scc_result.size()+1);
+
+            ablock *top = NULL;
+            do
+            {
+              top = nodes.back();
+
+              // add the node to the SCC
+              scc_result.back().push_back(top);
+              node_infos[top->ID].On_stack = false;
+
+              nodes.pop_back();
+            } while (top != node);
+          }
+
+          // update the low link of the node that visited the current node.
+          frames.pop_back();
+          if (!frames.empty()) {
+            tarjan_node_info &parent_info = node_infos[frames.back().Node->ID];
+            parent_info.Low_link = std::min(parent_info.Low_link,
+                                            info.Low_link);
+          }
         }
       }
 
@@ -778,9 +877,29 @@ namespace llvm {
         // compute SCCs
         scc_vector sccs(scc_tarjan());
 
-        for(scc_vector::iterator i(sccs.begin()), ie(sccs.end()); i != ie;
-            i++) {
-          ablocks &scc = *i;
+        // number the SCCs of the blocks, and collect the edges entering each
+        // SCC in a single pass over all edges. Transforming an SCC only
+        // changes edges into, or within, that SCC, so this remains valid
+        // while the SCCs are transformed one by one.
+        std::vector<unsigned> scc_ids(Blocks.size());
+        for(unsigned i = 0; i < sccs.size(); i++) {
+          for(ablocks::iterator j(sccs[i].begin()), je(sccs[i].end()); j != je;
+              j++) {
+            scc_ids[(*j)->ID] = i;
+          }
+        }
+
+        std::vector<aedge_vector> sccs_entering(sccs.size());
+        for(aedges::iterator j(Edges.begin()), je(Edges.end()); j != je;
+            j++) {
+          unsigned dst_scc = scc_ids[j->second->Dst->ID];
+          if (scc_ids[j->second->Src->ID] != dst_scc) {
+            sccs_entering[dst_scc].push_back(j->second);
+          }
+        }
+
+        for(unsigned k = 0; k < sccs.size(); k++) {
+          ablocks &scc = sccs[k];
 
           // skip trivial SCCs
           if (scc.size() == 1) {
@@ -805,16 +924,10 @@ namespace llvm {
 #endif
 
           ablock_set headers;
-          aedge_vector entering;
-          for(aedges::iterator j(Edges.begin()), je(Edges.end()); j != je;
-              j++) {
-            ablock *src = j->second->Src;
-            ablock *dst = j->second->Dst;
-            if (std::find(scc.begin(), scc.end(), src) == scc.end() &&
-                std::find(scc.begin(), scc.end(), dst) != scc.end()) {
-              headers.insert(dst);
-              entering.push_back(j->second);
-            }
+          aedge_vector &entering = sccs_entering[k];
+          for(aedge_vector::iterator j(entering.begin()), je(entering.end());
+              j != je; j++) {
+            headers.insert((*j)->Dst);
           }
 
           // check for dead code, this is not supported here.
@@ -849,21 +962,21 @@ namespace llvm {
           // remove all back-edges to any header.
           // the headers are thus no longer part of any SCC, since they only
           // have incoming edges from blocks not in SCCs.
-          for(aedges::iterator j(Edges.begin()), je(Edges.end()); j != je;) {
-            ablock *src = j->second->Src;
-            ablock *dst = j->second->Dst;
-            if (std::find(scc.begin(), scc.end(), src) != scc.end() &&
-                std::find(headers.begin(), headers.end(),
-                          dst) != headers.end())
-            {
-              BackEdges.insert(std::make_pair(j->first, j->second));
-              LLVM_DEBUG(dbgs() << "Back edge: '" << src->MBB->getNumber() << "' -> '" << dst->MBB->getNumber() << "'\n");
-              Edges.erase(j);
-              j = Edges.begin();
-              changed = true;
-            }
-            else {
-              j++;
+          for(ablocks::iterator i(scc.begin()), ie(scc.end()); i != ie; i++) {
+            for(aedges::iterator j(Edges.lower_bound(*i)),
+                je(Edges.upper_bound(*i)); j != je;) {
+              ablock *src = j->second->Src;
+              ablock *dst = j->second->Dst;
+              if (headers.count(dst))
+              {
+                BackEdges.insert(std::make_pair(j->first, j->second));
+                LLVM_DEBUG(dbgs() << "Back edge: '" << src->MBB->getNumber() << "' -> '" << dst->MBB->getNumber() << "'\n");
+                j = Edges.erase(j);
+                changed = true;
+              }
+              else {
+                j++;
+              }
             }
           }
 
@@ -932,7 +1045,10 @@ namespace llvm {
       rb.block = block;
 
 
-      rb.criticality = 1.0;
+      // prefer hot blocks, such that they are added to the region while it
+      // still has space left
+      rb.criticality = UseFrequencies && MaxFrequency > 0 ?
+                       block->Frequency / MaxFrequency : 1.0;
 
       // add the block to the sorted ready list
       ready.push_back(rb);
@@ -1153,6 +1269,26 @@ namespace llvm {
         PostDomsFound++;
       }
 
+      // Starting a new region at a block that is executed much more often
+      // than the region entry would cause more method cache transfers than
+      // entries of the region, e.g., for a hot loop. Add it in any case as
+      // long as it fits into the cache.
+      bool isHot = false;
+      if (UseFrequencies && !isPostDom && header->Frequency > 0 &&
+          header->Frequency >= region->Frequency * HotRatio)
+      {
+        maxSize = MaxRegionSize;
+        isHot = true;
+      }
+
+      // A block off the worst-case path would only enlarge a region on it
+      // and make loading the region into the method cache more expensive.
+      if (WCETFrequencies && header->Frequency == 0 && region->Frequency > 0)
+      {
+        ColdBlocks++;
+        return false;
+      }
+
       // Check for size only after we checked for headers to allow large
       // basic blocks.
       if (region_size + scc_size > maxSize) {
@@ -1178,6 +1314,7 @@ namespace llvm {
 
       // update statistics
       if (isPostDom && region_size > PreferredRegionSize) PostDomsAdded++;
+      if (isHot && region_size > preferred_size) HotBlocksAdded++;
 
       return true;
     }
@@ -1406,6 +1543,8 @@ namespace llvm {
 
         const TargetInstrInfo &TII = *MF->getSubtarget().getInstrInfo();
 
+        MF->getInfo<PatmosMachineFunctionInfo>()->invalidateBlockSize(fallthrough);
+
         if (PTM.getCodeModel() != CodeModel::Large || block->Region == target->Region) {
           // Encode branch in a single instruction
           unsigned Opc = block->Region == target->Region ? Patmos::BRu : Patmos::BRCFu;
@@ -1559,6 +1698,8 @@ namespace llvm {
                      << " branching to " << target->getName()
                      << "[" << target->getNumber() << "]\n");
 
+        MF->getInfo<PatmosMachineFunctionInfo>()->invalidateBlockSize(&MBB);
+
         MachineBasicBlock::instr_iterator II(BR);
         // move to the beginning of the BR bundle
         while (II->isBundledWithPred()) II--;
@@ -1919,6 +2060,8 @@ namespace llvm {
       unsigned int curr_size = getMaxBlockMargin(PTM, MBB->getAlignment());
 
       unsigned int cache_size = PTM.getSubtargetImpl()->getMethodCacheSize();
+      const PatmosMachineFunctionInfo *PMFI =
+                    MBB->getParent()->getInfo<PatmosMachineFunctionInfo>();
 
       unsigned int total_size = 0;
       // Note: we need to use an instr_iterator here, otherwise splice fails
@@ -1970,6 +2113,10 @@ namespace llvm {
         unsigned int delay_slot_margin = i->hasDelaySlot()
                       ? getDelaySlotSize(MBB, &*i, PTM) : 0;
 
+        // tracing sleds are patched as a whole, keep them together
+        if (i->getPreInstrSymbol() && PMFI->isTracingSledInstr(&*i))
+          tmp_live_margin += (PatmosTracingSled::Words - 1) * 4;
+
 #ifndef NDEBUG
         const MachineInstr *FirstMI = PTM.getInstrInfo()->getFirstMI(&*i);
 //        assert(!isPatmosCFL(FirstMI->getOpcode(), FirstMI->getDesc().TSFlags)
@@ -1995,6 +2142,11 @@ namespace llvm {
           // copy instructions over from the original block.
           newBB->splice(newBB->instr_begin(), MBB, MBB->instr_begin(), i);
 
+          PatmosMachineFunctionInfo *PMFI =
+                    MBB->getParent()->getInfo<PatmosMachineFunctionInfo>();
+          PMFI->invalidateBlockSize(MBB);
+          PMFI->invalidateBlockSize(newBB);
+
           // If any branch instruction were moved, update edges
           for(auto iter = newBB->instr_begin(); iter != newBB->instr_end(); iter++){
             if(iter->isBranch(MachineInstr::QueryType::IgnoreBundle)) {
@@ -2096,6 +2248,10 @@ namespace llvm {
     PatmosTargetMachine &PTM;
     const PatmosSubtarget &STC;
 
+    /// The block frequencies on the worst-case path, if a WCET profile is
+    /// given.
+    wcet_profile WCETPathFrequencies;
+
     void writeStats(StringRef Filename, MachineFunction &MF,
                     agraph &G, ablocks &order,
                     unsigned orig_size, const TimeRecord &Time)
@@ -2166,6 +2322,50 @@ namespace llvm {
       f.close();
     }
 
+    /// emitRegionRemarks - Report the size of each region as an optimization
+    /// remark, located at the region's first block.
+    void emitRegionRemarks(MachineOptimizationRemarkEmitter &ORE,
+                           ablocks &order)
+    {
+      unsigned BBs = 0;
+      unsigned RegionSize = 0;
+      MachineBasicBlock *Entry = NULL;
+      ablock *Header = *order.begin();
+
+      ablocks::iterator i(order.begin()), ie(order.end());
+
+      while (i != ie) {
+        MachineBasicBlock *MBB = (*i)->MBB;
+
+        if (MBB) {
+          if (!Entry) Entry = MBB;
+          BBs++;
+          RegionSize += agraph::getBBSize(MBB, PTM);
+        }
+
+        i++;
+
+        if (i == ie || (*i)->Region != Header) {
+          if (Entry) {
+            ORE.emit([&]() {
+              return MachineOptimizationRemarkAnalysis(DEBUG_TYPE, "SplitRegion",
+                         Entry->findDebugLoc(Entry->instr_begin()), Entry)
+                     << "split region at bb."
+                     << ore::NV("Block", Entry->getNumber())
+                     << ": " << ore::NV("Bytes", RegionSize) << " bytes, "
+                     << ore::NV("Blocks", BBs) << " blocks";
+            });
+          }
+
+          BBs = 0;
+          RegionSize = 0;
+          Entry = NULL;
+
+          if (i != ie) Header = (*i)->Region;
+        }
+      }
+    }
+
   public:
     /// PatmosFunctionSplitter - Create a new instance of the function splitter.
     PatmosFunctionSplitter(PatmosTargetMachine &tm) :
@@ -2182,6 +2382,9 @@ namespace llvm {
     void getAnalysisUsage(AnalysisUsage &AU) const override {
       AU.addRequired<MachineDominatorTree>();
       AU.addRequired<MachinePostDominatorTree>();
+      AU.addRequired<MachineOptimizationRemarkEmitterPass>();
+      if (UseBlockFrequencies)
+        AU.addRequired<MachineBlockFrequencyInfo>();
       AU.addPreserved<MachineDominatorTree>();
       AU.addPreserved<MachinePostDominatorTree>();
       MachineFunctionPass::getAnalysisUsage(AU);
@@ -2192,6 +2395,8 @@ namespace llvm {
       {
         sys::fs::remove(StatsFile.c_str());
       }
+      if (!WCETProfile.empty())
+        readWCETProfile(WCETProfile, WCETPathFrequencies);
       return false;
     }
 
@@ -2206,17 +2411,27 @@ namespace llvm {
       if (DisableFunctionSplitter)
         return false;
 
-      unsigned max_subfunc_size   = MaxSubfunctionSize  ? MaxSubfunctionSize
-                                                     : STC.getMethodCacheSize();
-      max_subfunc_size = std::min(max_subfunc_size, STC.getMethodCacheSize());
-
+      // The passes before do not keep the cached block sizes up to date, from
+      // here on the pre-emit passes adjust them as they change the code.
+      MF.getInfo<PatmosMachineFunctionInfo>()->invalidateBlockSizes();
 
+      // the sizes may be tuned for each function
+      const Function &F = MF.getFunction();
+      unsigned max_subfunc_size = getTuningParameter(F, "max-subfunction-size",
+                                                     MaxSubfunctionSize);
+      if (!max_subfunc_size)
+        max_subfunc_size = STC.getMethodCacheSize();
+      max_subfunc_size = std::min(max_subfunc_size, STC.getMethodCacheSize());
 
-      unsigned prefer_subfunc_size = PreferSubfunctionSize ?
-                                                       PreferSubfunctionSize
-                                                     : max_subfunc_size;
-      unsigned prefer_scc_size = PreferSCCSize ? PreferSCCSize
-                                               : prefer_subfunc_size;
+      unsigned prefer_subfunc_size =
+          getTuningParameter(F, "preferred-subfunction-size",
+                             PreferSubfunctionSize);
+      if (!prefer_subfunc_size)
+        prefer_subfunc_size = max_subfunc_size;
+      unsigned prefer_scc_size = getTuningParameter(F, "preferred-scc-size",
+                                                    PreferSCCSize);
+      if (!prefer_scc_size)
+        prefer_scc_size = prefer_subfunc_size;
       prefer_subfunc_size = std::min(max_subfunc_size, prefer_subfunc_size);
 
       if(prefer_subfunc_size < 64) {
@@ -2227,12 +2442,61 @@ namespace llvm {
 
       prefer_scc_size = std::min(max_subfunc_size, prefer_scc_size);
 
+      // leave room for the sleds at the subfunction entries
+      if (MF.getInfo<PatmosMachineFunctionInfo>()->hasTracingSleds()) {
+        unsigned sled_size = PatmosTracingSled::Words * 4;
+        max_subfunc_size -= sled_size;
+        prefer_subfunc_size -= sled_size;
+        prefer_scc_size -= sled_size;
+      }
+
       unsigned total_size = 0;
       bool blocks_splitted = false;
 
       MachineDominatorTree &MDT = getAnalysis<MachineDominatorTree>();
       MachinePostDominatorTree &MPDT = getAnalysis<MachinePostDominatorTree>();
 
+      // get the block frequencies before blocks are split, preferably from
+      // the WCET profile, or from the results imported for all passes
+      std::map<const MachineBasicBlock*, double> Frequencies;
+      const PatmosAnalysisInfo &PAI =
+                   MF.getInfo<PatmosMachineFunctionInfo>()->getAnalysisInfo();
+      wcet_profile::iterator WCETFunction =
+                     WCETPathFrequencies.find(MF.getFunction().getName().str());
+      bool UseWCETFrequencies = WCETFunction != WCETPathFrequencies.end() ||
+                                PAI.hasFrequencies();
+      if (WCETFunction != WCETPathFrequencies.end()) {
+        for(MachineFunction::iterator i(MF.begin()), ie(MF.end()); i != ie;
+            i++) {
+          std::map<std::string, WCETBlockResult>::iterator f =
+                                   WCETFunction->second.find(getWCETBlockKey(*i));
+          if (f != WCETFunction->second.end()) {
+            Frequencies[&*i] = f->second.Frequency;
+            WCETProfileBlocks++;
+          }
+          else
+            Frequencies[&*i] = 0;
+        }
+      }
+      else if (UseWCETFrequencies) {
+        for(MachineFunction::iterator i(MF.begin()), ie(MF.end()); i != ie;
+            i++) {
+          int64_t Frequency = PAI.getFrequency(&*i);
+          if (Frequency >= 0)
+            WCETProfileBlocks++;
+          Frequencies[&*i] = std::max(Frequency, (int64_t)0);
+        }
+      }
+      else if (UseBlockFrequencies) {
+        MachineBlockFrequencyInfo &MBFI =
+                                      getAnalysis<MachineBlockFrequencyInfo>();
+        for(MachineFunction::iterator i(MF.begin()), ie(MF.end()); i != ie;
+            i++) {
+          Frequencies[&*i] = MBFI.getBlockFreqRelativeToEntryBlock(&*i);
+        }
+      }
+      bool UseFrequencies = UseWCETFrequencies || UseBlockFrequencies;
+
       for(MachineFunction::iterator i(MF.begin()), ie(MF.end()); i != ie; i++) {
         unsigned bb_size = agraph::getBBSize(&*i, PTM);
 
@@ -2248,8 +2512,26 @@ namespace llvm {
         total_size += bb_size;
       }
 
+      // the parts of a split block are inserted before the remainder of the
+      // block, and are executed as often.
+      if (UseFrequencies && blocks_splitted) {
+        double Frequency = 0;
+        for(MachineFunction::reverse_iterator i(MF.rbegin()), ie(MF.rend());
+            i != ie; i++) {
+          std::map<const MachineBasicBlock*, double>::iterator f =
+                                                        Frequencies.find(&*i);
+          if (f != Frequencies.end())
+            Frequency = f->second;
+          else
+            Frequencies[&*i] = Frequency;
+        }
+      }
+
       TotalFunctions++;
 
+      // the number of regions, for the per-function statistics
+      unsigned num_regions = 1;
+
       // splitting needed?
       if (total_size > prefer_subfunc_size) {
 
@@ -2260,15 +2542,34 @@ namespace llvm {
 
         // construct a copy of the CFG.
         agraph G(&MF, PTM, MPDT,
-                 prefer_subfunc_size, prefer_scc_size, max_subfunc_size);
-        G.transformSCCs();
+                 prefer_subfunc_size, prefer_scc_size, max_subfunc_size,
+                 UseFrequencies ? &Frequencies : NULL, UseWCETFrequencies);
+        {
+          PatmosRegionTimer T("fs-scc", "Function splitter SCC transformation");
+          G.transformSCCs();
+        }
         // compute regions -- i.e., split the function
         ablocks order;
-        G.computeRegions(order);
+        {
+          PatmosRegionTimer T("fs-regions", "Function splitter region computation");
+          G.computeRegions(order);
+        }
         assert(order.size() == MF.size());
 
         // update the basic block order and rewrite branches
-        G.applyRegions(order);
+        {
+          PatmosRegionTimer T("fs-apply", "Function splitter code rewriting");
+          G.applyRegions(order);
+        }
+
+        emitRegionRemarks(
+            getAnalysis<MachineOptimizationRemarkEmitterPass>().getORE(), order);
+
+        for(ablocks::iterator i(std::next(order.begin())), ie(order.end());
+            i != ie; i++) {
+          if ((*i)->Region != (*std::prev(i))->Region)
+            num_regions++;
+        }
 
         if (CollectStats) {
           Time += TimeRecord::getCurrentTime(false);
@@ -2284,6 +2585,12 @@ namespace llvm {
         blocks_splitted = true;
       }
 
+      if (arePatmosStatsEnabled()) {
+        const Function &F = MF.getFunction();
+        addPatmosStat(F, "function-splitter", "size", total_size);
+        addPatmosStat(F, "function-splitter", "regions", num_regions);
+      }
+
       LLVM_DEBUG(dbgs() << "\n********** Finnishing Patmos Function Splitter **********\n");
       LLVM_DEBUG(dbgs() << "********** Function: " << MF.getFunction().getName() << "**********\n");
       LLVM_DEBUG(MF.dump());
@@ -0,0 +1,231 @@
+//===-- PatmosGuardedSpeculation.cpp - Hoist guarded code above branches --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Hoist the leading loads and ALU operations of the likely successor of a
+// conditional branch into the block of the branch, guarded by the branch
+// condition.
+//
+// Generic speculation does not hoist loads above branches, as they might
+// fault. On Patmos every instruction can be predicated, and a load whose
+// guard is false does not access the memory at all. Guarded by the condition
+// under which the successor is entered, the hoisted instructions compute
+// exactly what they computed in the successor, and they do not need any free
+// registers. In the block of the branch they are scheduled together with the
+// code computing the condition, e.g., the load of a field of a node in
+// pointer-chasing code overlaps the test of the node pointer, and they can
+// fill the delay slots of the branch.
+//
+// Only successors whose single predecessor is the branching block are
+// considered, and only along edges at least as likely as the speculation
+// threshold, as the hoisted instructions take issue slots on the other path.
+// Calls, stores, stack control and instructions that are already predicated
+// stay where they are.
+//
+// The pass runs after the if-converter on the branches that remain, and not
+// on single-path code.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineBranchProbabilityInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-guarded-speculation"
+
+STATISTIC(NumHoisted,     "Number of instructions hoisted under a guard");
+STATISTIC(NumHoistedLoads, "Number of loads hoisted under a guard");
+
+static cl::opt<bool> EnableGuardedSpeculation(
+  "mpatmos-enable-guarded-speculation",
+  cl::init(false),
+  cl::desc("Hoist loads and ALU operations of the likely successors of "
+           "branches above the branches, guarded by the branch condition "
+           "(non-single-path functions only)."));
+
+static cl::opt<unsigned> MaxSpeculated(
+  "mpatmos-guarded-speculation-size",
+  cl::init(4),
+  cl::desc("Maximum number of instructions hoisted above a branch "
+           "(default: 4)."),
+  cl::Hidden);
+
+static cl::opt<unsigned> SpeculationThreshold(
+  "mpatmos-guarded-speculation-threshold",
+  cl::init(60),
+  cl::desc("Minimum probability in percent of the edge to the successor whose "
+           "instructions are hoisted (default: 60)."),
+  cl::Hidden);
+
+namespace {
+
+  class PatmosGuardedSpeculation : public MachineFunctionPass {
+  private:
+    static char ID;
+
+    const PatmosInstrInfo *TII;
+    const TargetRegisterInfo *TRI;
+    const MachineBranchProbabilityInfo *MBPI;
+
+    /// Check if MI can be executed under the guard of the branch on CondReg
+    /// instead of at the start of its block.
+    bool isHoistable(const MachineInstr &MI, Register CondReg) const;
+
+    /// Hoist the leading instructions of Succ to the end of Head, before its
+    /// terminators, guarded by Cond.
+    bool hoist(MachineBasicBlock &Head, MachineBasicBlock &Succ,
+               ArrayRef<MachineOperand> Cond);
+
+    /// Speculate the instructions of the likely successor of the conditional
+    /// branch at the end of Head.
+    bool speculate(MachineBasicBlock &Head);
+
+  public:
+    PatmosGuardedSpeculation(const PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID), TII(tm.getInstrInfo()),
+        TRI(tm.getRegisterInfo()) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Guarded Speculation";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesCFG();
+      AU.addRequired<MachineBranchProbabilityInfo>();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+  };
+
+  char PatmosGuardedSpeculation::ID = 0;
+}
+
+FunctionPass *
+llvm::createPatmosGuardedSpeculationPass(const PatmosTargetMachine &tm) {
+  return new PatmosGuardedSpeculation(tm);
+}
+
+bool PatmosGuardedSpeculation::isHoistable(const MachineInstr &MI,
+                                           Register CondReg) const {
+  if (MI.isBundle() || MI.isTerminator() || MI.isCall() ||
+      MI.isInlineAsm() || MI.mayStore() || MI.hasUnmodeledSideEffects() ||
+      MI.isPseudo() || PatmosInstrInfo::isStackControl(&MI) ||
+      !TII->isPredicable(MI) || TII->isPredicated(MI))
+    return false;
+  // the cache analyses only handle guarded loads among the stalling
+  // instructions
+  if (TII->mayStall(&MI) && !MI.mayLoad())
+    return false;
+  // the branch reads the condition after the hoisted instructions
+  return !MI.modifiesRegister(CondReg, TRI);
+}
+
+bool PatmosGuardedSpeculation::hoist(MachineBasicBlock &Head,
+                                     MachineBasicBlock &Succ,
+                                     ArrayRef<MachineOperand> Cond) {
+  Register CondReg = Cond[0].getReg();
+  SmallVector<MachineInstr*, 4> Hoisted;
+  for (MachineInstr &MI : Succ) {
+    if (MI.isDebugInstr())
+      continue;
+    if (Hoisted.size() == MaxSpeculated || !isHoistable(MI, CondReg))
+      break;
+    Hoisted.push_back(&MI);
+  }
+  if (Hoisted.empty())
+    return false;
+
+  LLVM_DEBUG(dbgs() << "Hoisting " << Hoisted.size() << " instructions of "
+                    << printMBBReference(Succ) << " into "
+                    << printMBBReference(Head) << "\n");
+
+  // the registers live in Head before its terminators
+  MachineBasicBlock::iterator InsertPos = Head.getFirstTerminator();
+  LivePhysRegs Redefs(*TRI);
+  Redefs.addLiveIns(Head);
+  SmallVector<std::pair<MCPhysReg, const MachineOperand*>, 4> Clobbers;
+  for (MachineBasicBlock::iterator I = Head.begin(); I != InsertPos; ++I)
+    Redefs.stepForward(*I, Clobbers);
+
+  for (MachineInstr *MI : Hoisted) {
+    // the registers may still be used in Succ
+    MI->clearKillInfo();
+    TII->PredicateInstruction(*MI, Cond);
+
+    // A guarded definition keeps the old value if the other successor is
+    // taken, which must thus stay live up to here.
+    SmallVector<MCPhysReg, 4> LiveBefore;
+    for (const MachineOperand &MO : MI->operands())
+      if (MO.isReg() && MO.isDef() && Redefs.contains(MO.getReg()))
+        LiveBefore.push_back(MO.getReg());
+    Redefs.stepForward(*MI, Clobbers);
+    for (MCPhysReg Reg : LiveBefore)
+      MachineInstrBuilder(*MI->getMF(), MI).addReg(Reg, RegState::Implicit);
+
+    Head.splice(InsertPos, &Succ, MI->getIterator());
+    NumHoisted++;
+    if (MI->mayLoad())
+      NumHoistedLoads++;
+  }
+
+  // The hoisted definitions are now live into Succ, their operands may no
+  // longer be.
+  recomputeLiveIns(Succ);
+  return true;
+}
+
+bool PatmosGuardedSpeculation::speculate(MachineBasicBlock &Head) {
+  MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+  SmallVector<MachineOperand, 2> Cond;
+  if (TII->analyzeBranch(Head, TBB, FBB, Cond, false) || Cond.empty() ||
+      Head.succ_size() != 2 || !Cond[0].isReg())
+    return false;
+  if (!FBB && std::next(Head.getIterator()) != Head.getParent()->end())
+    FBB = &*std::next(Head.getIterator());
+  if (!FBB || TBB == FBB || !Head.isSuccessor(TBB) || !Head.isSuccessor(FBB))
+    return false;
+
+  // hoist from the likely successor, guarded by the condition to enter it
+  BranchProbability Threshold(SpeculationThreshold, 100);
+  MachineBasicBlock *Succ = TBB;
+  if (MBPI->getEdgeProbability(&Head, FBB) >
+      MBPI->getEdgeProbability(&Head, TBB)) {
+    Succ = FBB;
+    TII->reverseBranchCondition(Cond);
+  }
+  if (MBPI->getEdgeProbability(&Head, Succ) < Threshold ||
+      Succ == &Head || Succ->pred_size() != 1 || Succ->hasAddressTaken() ||
+      Succ->isEHPad())
+    return false;
+
+  return hoist(Head, *Succ, Cond);
+}
+
+bool PatmosGuardedSpeculation::runOnMachineFunction(MachineFunction &MF) {
+  if (!EnableGuardedSpeculation ||
+      MF.getInfo<PatmosMachineFunctionInfo>()->isSinglePath())
+    return false;
+
+  MBPI = &getAnalysis<MachineBranchProbabilityInfo>();
+
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF)
+    Changed |= speculate(MBB);
+  return Changed;
+}
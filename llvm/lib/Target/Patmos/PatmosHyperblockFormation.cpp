@@ -0,0 +1,367 @@
+//===-- PatmosHyperblockFormation.cpp - Predicate hot loop bodies ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Form hyperblocks in the innermost loops of functions that are not converted
+// to single-path code.
+//
+// The generic if-converter decides on each triangle and diamond on its own,
+// and limits the code size for the method cache. In the innermost loops, the
+// branches around small blocks are executed in every iteration, while the
+// loop body usually fits the cache anyway. This pass therefore predicates
+// the small triangles and diamonds of these loops on the branch condition,
+// and merges the straight-line chains that result, such that the loop body
+// becomes one block that is scheduled as one region.
+//
+// A triangle or diamond is converted if its blocks contain only predicable,
+// unpredicated instructions that do not stall and do not change the branch
+// condition, if the result is not larger than the hyperblock limit, and if
+// the predicated blocks do not issue in more cycles than the branches are
+// expected to need, using the if-conversion cost model of PatmosInstrInfo.
+//
+// The goal is throughput, the result is not single-path code.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineBranchProbabilityInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-hyperblock"
+
+STATISTIC(NumTriangles, "Number of triangles predicated in loops");
+STATISTIC(NumDiamonds,  "Number of diamonds predicated in loops");
+STATISTIC(NumMerged,    "Number of blocks merged into hyperblocks");
+
+static cl::opt<bool> EnableHyperblocks(
+  "mpatmos-enable-hyperblocks",
+  cl::init(false),
+  cl::desc("Predicate small triangles and diamonds in innermost loops and "
+           "schedule the loop bodies as hyperblocks (non-single-path "
+           "functions only)."));
+
+static cl::opt<unsigned> MaxHyperblockSize(
+  "mpatmos-hyperblock-size",
+  cl::init(64),
+  cl::desc("Maximum number of instructions of a hyperblock (default: 64)."),
+  cl::Hidden);
+
+namespace {
+
+  class PatmosHyperblockFormation : public MachineFunctionPass {
+  private:
+    static char ID;
+
+    const PatmosInstrInfo *TII;
+    const TargetRegisterInfo *TRI;
+    MachineLoopInfo *MLI;
+    const MachineBranchProbabilityInfo *MBPI;
+
+    /// Return the number of instructions of the blocks.
+    static unsigned getSize(ArrayRef<const MachineBasicBlock*> MBBs);
+
+    /// Return the single successor of MBB if it only ends in an
+    /// unconditional branch or falls through, or null otherwise.
+    MachineBasicBlock *getSingleSucc(MachineBasicBlock &MBB) const;
+
+    /// Check if MBB is a block of loop L that can be predicated on the
+    /// register CondReg and merged into its only predecessor.
+    bool canPredicate(MachineBasicBlock &MBB, MachineLoop *L,
+                      Register CondReg) const;
+
+    /// Predicate the instructions of MBB on Cond and move them to the end of
+    /// Head. Redefs tracks the registers live in Head.
+    void predicateInto(MachineBasicBlock &Head, MachineBasicBlock &MBB,
+                       ArrayRef<MachineOperand> Cond, LivePhysRegs &Redefs);
+
+    /// Remove the empty block MBB, which was merged into a predecessor.
+    void removeBlock(MachineBasicBlock &MBB);
+
+    /// Convert a triangle or diamond with the conditional branch at the end
+    /// of Head.
+    bool convert(MachineBasicBlock &Head, MachineLoop *L);
+
+    /// Merge the only successor of Head into it, if Head is its only
+    /// predecessor.
+    bool mergeSucc(MachineBasicBlock &Head, MachineLoop *L);
+
+    bool formHyperblocks(MachineLoop *L);
+
+  public:
+    PatmosHyperblockFormation(const PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID), TII(tm.getInstrInfo()),
+        TRI(tm.getRegisterInfo()) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Hyperblock Formation";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<MachineLoopInfo>();
+      AU.addPreserved<MachineLoopInfo>();
+      AU.addRequired<MachineBranchProbabilityInfo>();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+  };
+
+  char PatmosHyperblockFormation::ID = 0;
+}
+
+FunctionPass *
+llvm::createPatmosHyperblockFormationPass(const PatmosTargetMachine &tm) {
+  return new PatmosHyperblockFormation(tm);
+}
+
+unsigned
+PatmosHyperblockFormation::getSize(ArrayRef<const MachineBasicBlock*> MBBs) {
+  unsigned Size = 0;
+  for (const MachineBasicBlock *MBB : MBBs)
+    for (const MachineInstr &MI : *MBB)
+      if (!MI.isDebugInstr() && !MI.isTerminator())
+        Size++;
+  return Size;
+}
+
+MachineBasicBlock *
+PatmosHyperblockFormation::getSingleSucc(MachineBasicBlock &MBB) const {
+  MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+  SmallVector<MachineOperand, 2> Cond;
+  if (TII->analyzeBranch(MBB, TBB, FBB, Cond, false) || !Cond.empty() ||
+      MBB.succ_size() != 1)
+    return nullptr;
+  return *MBB.succ_begin();
+}
+
+bool PatmosHyperblockFormation::canPredicate(MachineBasicBlock &MBB,
+                                             MachineLoop *L,
+                                             Register CondReg) const {
+  if (!L->contains(&MBB) || &MBB == L->getHeader() || MBB.pred_size() != 1 ||
+      MBB.hasAddressTaken() || MBB.isEHPad() || !getSingleSucc(MBB))
+    return false;
+
+  for (const MachineInstr &MI : MBB) {
+    if (MI.isDebugInstr() || MI.isUnconditionalBranch())
+      continue;
+    if (MI.isBundle() || MI.isCall() || MI.isReturn() || MI.isInlineAsm() ||
+        !TII->isPredicable(MI) || TII->isPredicated(MI))
+      return false;
+    // the cache analyses do not handle predicated stalling instructions
+    if (TII->mayStall(&MI))
+      return false;
+    // the other block of a diamond reads the condition afterwards
+    if (MI.modifiesRegister(CondReg, TRI))
+      return false;
+  }
+  return true;
+}
+
+void PatmosHyperblockFormation::predicateInto(MachineBasicBlock &Head,
+                                              MachineBasicBlock &MBB,
+                                              ArrayRef<MachineOperand> Cond,
+                                              LivePhysRegs &Redefs) {
+  TII->removeBranch(MBB);
+  for (MachineInstr &MI : MBB) {
+    if (MI.isDebugInstr())
+      continue;
+    // the registers may be used on the other path
+    MI.clearKillInfo();
+    TII->PredicateInstruction(MI, Cond);
+
+    // A predicated definition may keep the old value, which must thus stay
+    // live up to here.
+    SmallVector<std::pair<MCPhysReg, const MachineOperand*>, 4> Clobbers;
+    SmallVector<MCPhysReg, 4> LiveBefore;
+    for (const MachineOperand &MO : MI.operands())
+      if (MO.isReg() && MO.isDef() && Redefs.contains(MO.getReg()))
+        LiveBefore.push_back(MO.getReg());
+    Redefs.stepForward(MI, Clobbers);
+    for (MCPhysReg Reg : LiveBefore)
+      MachineInstrBuilder(*MI.getMF(), &MI).addReg(Reg, RegState::Implicit);
+  }
+  Head.splice(Head.end(), &MBB, MBB.begin(), MBB.end());
+}
+
+void PatmosHyperblockFormation::removeBlock(MachineBasicBlock &MBB) {
+  assert(MBB.empty() && MBB.pred_empty() && "Block still in use");
+  while (!MBB.succ_empty())
+    MBB.removeSuccessor(MBB.succ_begin());
+  MLI->removeBlock(&MBB);
+  MBB.eraseFromParent();
+}
+
+bool PatmosHyperblockFormation::convert(MachineBasicBlock &Head,
+                                        MachineLoop *L) {
+  MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+  SmallVector<MachineOperand, 2> Cond;
+  if (TII->analyzeBranch(Head, TBB, FBB, Cond, false) || Cond.empty() ||
+      Head.succ_size() != 2 || !Cond[0].isReg())
+    return false;
+  if (!FBB && std::next(Head.getIterator()) != Head.getParent()->end())
+    FBB = &*std::next(Head.getIterator());
+  if (!FBB || TBB == FBB || !Head.isSuccessor(FBB))
+    return false;
+
+  Register CondReg = Cond[0].getReg();
+  SmallVector<MachineOperand, 2> RevCond(Cond.begin(), Cond.end());
+  TII->reverseBranchCondition(RevCond);
+
+  // the blocks to predicate, with their conditions
+  MachineBasicBlock *TMBB = nullptr, *FMBB = nullptr, *Tail = nullptr;
+  bool TPred = canPredicate(*TBB, L, CondReg);
+  bool FPred = canPredicate(*FBB, L, CondReg);
+  if (TPred && FPred && getSingleSucc(*TBB) == getSingleSucc(*FBB)) {
+    TMBB = TBB, FMBB = FBB, Tail = getSingleSucc(*TBB);
+  } else if (TPred && getSingleSucc(*TBB) == FBB) {
+    TMBB = TBB, Tail = FBB;
+  } else if (FPred && getSingleSucc(*FBB) == TBB) {
+    FMBB = FBB, Tail = TBB;
+  } else {
+    return false;
+  }
+
+  SmallVector<const MachineBasicBlock*, 3> Blocks = {&Head};
+  if (TMBB)
+    Blocks.push_back(TMBB);
+  if (FMBB)
+    Blocks.push_back(FMBB);
+  if (getSize(Blocks) > MaxHyperblockSize)
+    return false;
+
+  // cost model as for the if-converter, see PatmosInstrInfo
+  BranchProbability TProb = MBPI->getEdgeProbability(&Head, TBB);
+  unsigned CondCycles = TII->getIfCvtBranchCost(&Head);
+  unsigned Predicated, Branched;
+  if (TMBB && FMBB) {
+    bool TJumps = !TMBB->empty() &&
+                  std::prev(TMBB->end())->isUnconditionalBranch();
+    unsigned TJoin = TJumps ? TII->getIfCvtBranchCost(TMBB) : 0;
+    unsigned FJoin = TJumps ? 0 : TII->getIfCvtBranchCost(FMBB);
+    Predicated = TII->getIfCvtIssueCycles({TMBB, FMBB});
+    Branched = CondCycles +
+               TProb.scale(TII->getIfCvtIssueCycles(TMBB) + TJoin) +
+               TProb.getCompl().scale(TII->getIfCvtIssueCycles(FMBB) + FJoin);
+  } else {
+    MachineBasicBlock *MBB = TMBB ? TMBB : FMBB;
+    BranchProbability Prob = TMBB ? TProb : TProb.getCompl();
+    Predicated = TII->getIfCvtIssueCycles(MBB);
+    Branched = CondCycles + Prob.scale(Predicated);
+  }
+  if (Predicated > Branched)
+    return false;
+
+  LLVM_DEBUG(dbgs() << "Predicating " << (TMBB && FMBB ? "diamond" : "triangle")
+                    << " of " << printMBBReference(Head) << " in loop "
+                    << printMBBReference(*L->getHeader()) << "\n");
+
+  LivePhysRegs Redefs(*TRI);
+  Redefs.addLiveIns(Head);
+  SmallVector<std::pair<MCPhysReg, const MachineOperand*>, 4> Clobbers;
+  for (const MachineInstr &MI : Head)
+    Redefs.stepForward(MI, Clobbers);
+
+  TII->removeBranch(Head);
+  for (MachineBasicBlock *MBB : {TMBB, FMBB}) {
+    if (!MBB)
+      continue;
+    predicateInto(Head, *MBB, MBB == TMBB ? Cond : RevCond, Redefs);
+    Head.removeSuccessor(MBB, true);
+    MBB->removeSuccessor(Tail);
+    removeBlock(*MBB);
+  }
+  if (!Head.isSuccessor(Tail))
+    Head.addSuccessor(Tail, BranchProbability::getOne());
+  if (!Head.isLayoutSuccessor(Tail))
+    TII->insertBranch(Head, Tail, nullptr, None, DebugLoc(), nullptr);
+
+  if (TMBB && FMBB)
+    NumDiamonds++;
+  else
+    NumTriangles++;
+  return true;
+}
+
+bool PatmosHyperblockFormation::mergeSucc(MachineBasicBlock &Head,
+                                          MachineLoop *L) {
+  MachineBasicBlock *Succ = getSingleSucc(Head);
+  if (!Succ || Succ == &Head || !L->contains(Succ) ||
+      Succ == L->getHeader() || Succ->pred_size() != 1 ||
+      Succ->hasAddressTaken() || Succ->isEHPad() ||
+      getSize({&Head, Succ}) > MaxHyperblockSize)
+    return false;
+
+  // the terminators of Succ may fall through to its layout successor
+  MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+  SmallVector<MachineOperand, 2> Cond;
+  if (TII->analyzeBranch(*Succ, TBB, FBB, Cond, false))
+    return false;
+
+  LLVM_DEBUG(dbgs() << "Merging " << printMBBReference(*Succ) << " into "
+                    << printMBBReference(Head) << "\n");
+
+  auto Next = std::next(Succ->getIterator());
+  MachineBasicBlock *SuccLayoutNext =
+      Next != Head.getParent()->end() ? &*Next : nullptr;
+  TII->removeBranch(Head);
+  Head.splice(Head.end(), Succ, Succ->begin(), Succ->end());
+  Head.removeSuccessor(Succ);
+  Head.transferSuccessors(Succ);
+  removeBlock(*Succ);
+  Head.updateTerminator(SuccLayoutNext);
+
+  NumMerged++;
+  return true;
+}
+
+bool PatmosHyperblockFormation::formHyperblocks(MachineLoop *L) {
+  bool Changed = false;
+  bool Progress = true;
+  while (Progress) {
+    Progress = false;
+    // the blocks change with every conversion, start over
+    for (MachineBasicBlock *MBB : L->blocks()) {
+      if (convert(*MBB, L) || mergeSucc(*MBB, L)) {
+        Progress = Changed = true;
+        break;
+      }
+    }
+  }
+  return Changed;
+}
+
+bool PatmosHyperblockFormation::runOnMachineFunction(MachineFunction &MF) {
+  if (!EnableHyperblocks ||
+      MF.getInfo<PatmosMachineFunctionInfo>()->isSinglePath())
+    return false;
+
+  MLI = &getAnalysis<MachineLoopInfo>();
+  MBPI = &getAnalysis<MachineBranchProbabilityInfo>();
+
+  bool Changed = false;
+  SmallVector<MachineLoop*, 8> Worklist(MLI->begin(), MLI->end());
+  while (!Worklist.empty()) {
+    MachineLoop *L = Worklist.pop_back_val();
+    if (L->getSubLoops().empty())
+      Changed |= formHyperblocks(L);
+    else
+      Worklist.append(L->begin(), L->end());
+  }
+  return Changed;
+}
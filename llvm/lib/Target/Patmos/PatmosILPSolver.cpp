@@ -0,0 +1,1264 @@
+//===-- PatmosILPSolver.cpp - ILP solvers for the Patmos analyses. --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Solvers for the integer linear programs constructed by the stack cache
+// analysis.
+//
+// The builtin solver parses the subset of the CPLEX LP format produced by the
+// analysis (and the user-supplied bounds), and solves the problem using a
+// dense two-phase simplex on the LP relaxation combined with a depth-first
+// branch-and-bound. The ILPs of the stack cache analysis are small network
+// flow problems, whose relaxation is mostly integral already, such that this
+// is much cheaper than spawning an external solver for each of them.
+//
+// Solvers can be combined, e.g., to fall back to an external solver or to
+// memoize results. The cache is keyed on a normalized form of the LP, since
+// the analysis names variables after the (run-specific) call sites.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosILPSolver.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-ilp-solver"
+
+STATISTIC(ILPFallbacks, "Number of ILPs solved by the fallback solver.");
+STATISTIC(ILPCacheHits, "Number of ILPs whose solution was found in the cache.");
+
+namespace {
+  /// Tolerance used for pivoting and feasibility checks.
+  const double EPS = 1e-9;
+
+  /// Tolerance used to decide whether a value is integral.
+  const double INT_EPS = 1e-6;
+
+  const double INF = std::numeric_limits<double>::infinity();
+
+  /// Relation of a linear constraint.
+  enum Relation {
+    LE,
+    GE,
+    EQ
+  };
+
+  /// A linear constraint: sum of Terms Rel RHS.
+  struct LPRow {
+    std::vector<std::pair<unsigned, double> > Terms;
+    Relation Rel;
+    double RHS;
+  };
+
+  /// A linear program, optionally with integer variables.
+  struct LinearProgram {
+    bool Maximize;
+
+    /// Constant part of the objective function.
+    double ObjectiveConstant;
+
+    /// Objective coefficients, one per variable.
+    std::vector<double> Objective;
+
+    /// Lower and upper bounds, one per variable.
+    std::vector<double> Lower, Upper;
+
+    /// Flag indicating integer variables.
+    std::vector<bool> IsInteger;
+
+    std::vector<LPRow> Rows;
+
+    LinearProgram() : Maximize(false), ObjectiveConstant(0) {}
+
+    unsigned getNumVariables() const { return Objective.size(); }
+  };
+
+  /// Parse the CPLEX LP format subset used by the stack cache analysis.
+  class LPParser {
+    /// Kinds of tokens.
+    enum TokenKind {
+      TK_IDENT,
+      TK_NUMBER,
+      TK_SIGN,
+      TK_RELOP,
+      TK_COLON
+    };
+
+    struct Token {
+      TokenKind Kind;
+      StringRef Text;
+      double Value;
+      Relation Rel;
+    };
+
+    /// Sections of an LP file.
+    enum Section {
+      S_NONE,
+      S_OBJECTIVE,
+      S_CONSTRAINTS,
+      S_BOUNDS,
+      S_GENERALS,
+      S_BINARIES,
+      S_END
+    };
+
+    LinearProgram &LP;
+
+    StringMap<unsigned> Variables;
+
+    std::string Error;
+
+    /// Get the index of a variable, creating it on first use.
+    unsigned getVariable(StringRef Name)
+    {
+      StringMap<unsigned>::iterator tmp(Variables.find(Name));
+      if (tmp != Variables.end())
+        return tmp->second;
+
+      unsigned Idx = LP.getNumVariables();
+      Variables[Name] = Idx;
+      LP.Objective.push_back(0);
+      LP.Lower.push_back(0);
+      LP.Upper.push_back(INF);
+      LP.IsInteger.push_back(false);
+      return Idx;
+    }
+
+    static bool isIdentChar(char C)
+    {
+      return !isSpace(C) && C != '+' && C != '-' && C != '<' && C != '>' &&
+             C != '=' && C != ':' && C != '\\' && C != '*';
+    }
+
+    /// Check whether the line starts a new section.
+    static Section getSection(StringRef Line, StringRef &Rest)
+    {
+      static const struct { const char *Keyword; Section S; } Keywords[] = {
+        {"maximize", S_OBJECTIVE}, {"maximum", S_OBJECTIVE},
+        {"max", S_OBJECTIVE}, {"minimize", S_OBJECTIVE},
+        {"minimum", S_OBJECTIVE}, {"min", S_OBJECTIVE},
+        {"subject to", S_CONSTRAINTS}, {"such that", S_CONSTRAINTS},
+        {"s.t.", S_CONSTRAINTS}, {"st.", S_CONSTRAINTS},
+        {"st", S_CONSTRAINTS}, {"bounds", S_BOUNDS}, {"bound", S_BOUNDS},
+        {"generals", S_GENERALS}, {"general", S_GENERALS},
+        {"gen", S_GENERALS}, {"integers", S_GENERALS},
+        {"integer", S_GENERALS}, {"binaries", S_BINARIES},
+        {"binary", S_BINARIES}, {"bin", S_BINARIES}, {"end", S_END}
+      };
+
+      for(unsigned i = 0; i < array_lengthof(Keywords); i++) {
+        StringRef K(Keywords[i].Keyword);
+        if (Line.size() >= K.size() &&
+            Line.substr(0, K.size()).equals_lower(K) &&
+            (Line.size() == K.size() || isSpace(Line[K.size()]))) {
+          Rest = Line.substr(K.size());
+          return Keywords[i].S;
+        }
+      }
+      return S_NONE;
+    }
+
+    /// Split a line into tokens.
+    bool tokenize(StringRef Line, std::vector<Token> &Tokens)
+    {
+      size_t i = 0;
+      while(i < Line.size()) {
+        char C = Line[i];
+        Token T;
+        T.Value = 0;
+        T.Rel = EQ;
+
+        if (isSpace(C)) {
+          i++;
+          continue;
+        }
+        else if (C == '+' || C == '-') {
+          T.Kind = TK_SIGN;
+          T.Value = C == '+' ? 1 : -1;
+          T.Text = Line.substr(i, 1);
+          i++;
+        }
+        else if (C == ':') {
+          T.Kind = TK_COLON;
+          T.Text = Line.substr(i, 1);
+          i++;
+        }
+        else if (C == '<' || C == '>' || C == '=') {
+          size_t start = i;
+          while(i < Line.size() &&
+                (Line[i] == '<' || Line[i] == '>' || Line[i] == '='))
+            i++;
+          T.Kind = TK_RELOP;
+          T.Text = Line.slice(start, i);
+          if (T.Text.contains('<'))
+            T.Rel = LE;
+          else if (T.Text.contains('>'))
+            T.Rel = GE;
+          else
+            T.Rel = EQ;
+        }
+        else if (isDigit(C) || C == '.') {
+          size_t start = i;
+          while(i < Line.size() && (isDigit(Line[i]) || Line[i] == '.'))
+            i++;
+          // exponent
+          if (i + 1 < Line.size() && (Line[i] == 'e' || Line[i] == 'E')) {
+            size_t j = i + 1;
+            if (Line[j] == '+' || Line[j] == '-')
+              j++;
+            if (j < Line.size() && isDigit(Line[j])) {
+              while(j < Line.size() && isDigit(Line[j]))
+                j++;
+              i = j;
+            }
+          }
+          T.Kind = TK_NUMBER;
+          T.Text = Line.slice(start, i);
+          if (!to_float(T.Text, T.Value)) {
+            Error = ("invalid number '" + T.Text + "'").str();
+            return false;
+          }
+        }
+        else {
+          size_t start = i;
+          while(i < Line.size() && isIdentChar(Line[i]))
+            i++;
+          if (i == start) {
+            Error = ("unexpected character '" + Line.substr(i, 1) + "'").str();
+            return false;
+          }
+          T.Kind = TK_IDENT;
+          T.Text = Line.slice(start, i);
+          if (T.Text.equals_lower("inf") || T.Text.equals_lower("infinity")) {
+            T.Kind = TK_NUMBER;
+            T.Value = INF;
+          }
+        }
+
+        Tokens.push_back(T);
+      }
+      return true;
+    }
+
+    /// Parse a linear expression starting at token I. Constants are
+    /// accumulated in Constant. Parsing stops at relational operators and
+    /// constraint names.
+    void parseExpression(const std::vector<Token> &Tokens, size_t &I,
+                         std::vector<std::pair<unsigned, double> > &Terms,
+                         double &Constant)
+    {
+      while(I < Tokens.size()) {
+        // stop at a constraint name
+        if (Tokens[I].Kind == TK_IDENT && I + 1 < Tokens.size() &&
+            Tokens[I + 1].Kind == TK_COLON)
+          return;
+
+        double Coefficient = 1;
+        bool Seen = false;
+        while(I < Tokens.size() && Tokens[I].Kind == TK_SIGN) {
+          Coefficient *= Tokens[I].Value;
+          I++;
+          Seen = true;
+        }
+
+        if (I < Tokens.size() && Tokens[I].Kind == TK_NUMBER) {
+          Coefficient *= Tokens[I].Value;
+          I++;
+          Seen = true;
+
+          // a constant term
+          if (I == Tokens.size() || Tokens[I].Kind != TK_IDENT ||
+              (I + 1 < Tokens.size() && Tokens[I + 1].Kind == TK_COLON)) {
+            Constant += Coefficient;
+            continue;
+          }
+        }
+
+        if (I < Tokens.size() && Tokens[I].Kind == TK_IDENT) {
+          Terms.push_back(std::make_pair(getVariable(Tokens[I].Text),
+                                         Coefficient));
+          I++;
+        }
+        else if (!Seen) {
+          return;
+        }
+      }
+    }
+
+    /// Parse the objective function section.
+    bool parseObjective(const std::vector<Token> &Tokens)
+    {
+      size_t I = 0;
+
+      // optional name of the objective function
+      if (Tokens.size() >= 2 && Tokens[0].Kind == TK_IDENT &&
+          Tokens[1].Kind == TK_COLON)
+        I = 2;
+
+      std::vector<std::pair<unsigned, double> > Terms;
+      parseExpression(Tokens, I, Terms, LP.ObjectiveConstant);
+      if (I != Tokens.size()) {
+        Error = ("unexpected '" + Tokens[I].Text + "' in objective").str();
+        return false;
+      }
+
+      for(unsigned i = 0; i < Terms.size(); i++)
+        LP.Objective[Terms[i].first] += Terms[i].second;
+
+      return true;
+    }
+
+    /// Parse the constraints section.
+    bool parseConstraints(const std::vector<Token> &Tokens)
+    {
+      size_t I = 0;
+      while(I < Tokens.size()) {
+        // optional name of the constraint
+        if (Tokens[I].Kind == TK_IDENT && I + 1 < Tokens.size() &&
+            Tokens[I + 1].Kind == TK_COLON)
+          I += 2;
+
+        LPRow Row;
+        double Constant = 0;
+        parseExpression(Tokens, I, Row.Terms, Constant);
+
+        if (I == Tokens.size() || Tokens[I].Kind != TK_RELOP) {
+          Error = "missing relational operator in constraint";
+          return false;
+        }
+        Row.Rel = Tokens[I].Rel;
+        I++;
+
+        // right-hand side, a constant
+        double RHS;
+        if (!parseBoundValue(Tokens, I, RHS)) {
+          Error = "missing right-hand side in constraint";
+          return false;
+        }
+        Row.RHS = RHS - Constant;
+
+        LP.Rows.push_back(Row);
+      }
+      return true;
+    }
+
+    /// Parse a (signed) bound value at token I.
+    bool parseBoundValue(const std::vector<Token> &Tokens, size_t &I,
+                         double &Value)
+    {
+      double Sign = 1;
+      while(I < Tokens.size() && Tokens[I].Kind == TK_SIGN) {
+        Sign *= Tokens[I].Value;
+        I++;
+      }
+      if (I == Tokens.size() || Tokens[I].Kind != TK_NUMBER)
+        return false;
+      Value = Sign * Tokens[I].Value;
+      I++;
+      return true;
+    }
+
+    /// Apply a bound: Value Rel Variable, or Variable Rel Value.
+    void applyBound(unsigned Var, Relation Rel, double Value,
+                    bool ValueIsLeft)
+    {
+      if (Rel == EQ) {
+        LP.Lower[Var] = LP.Upper[Var] = Value;
+      }
+      else if ((Rel == LE) == ValueIsLeft) {
+        LP.Lower[Var] = Value;
+      }
+      else {
+        LP.Upper[Var] = Value;
+      }
+    }
+
+    /// Parse the bounds section.
+    bool parseBounds(const std::vector<Token> &Tokens)
+    {
+      size_t I = 0;
+      while(I < Tokens.size()) {
+        double Value;
+        size_t Start = I;
+        if (parseBoundValue(Tokens, I, Value)) {
+          // Value Rel Variable [Rel Value]
+          if (I + 1 >= Tokens.size() || Tokens[I].Kind != TK_RELOP ||
+              Tokens[I + 1].Kind != TK_IDENT) {
+            Error = "invalid bound";
+            return false;
+          }
+          Relation Rel = Tokens[I].Rel;
+          unsigned Var = getVariable(Tokens[I + 1].Text);
+          I += 2;
+          applyBound(Var, Rel, Value, true);
+
+          if (I < Tokens.size() && Tokens[I].Kind == TK_RELOP) {
+            Rel = Tokens[I].Rel;
+            I++;
+            if (!parseBoundValue(Tokens, I, Value)) {
+              Error = "invalid bound";
+              return false;
+            }
+            applyBound(Var, Rel, Value, false);
+          }
+        }
+        else {
+          I = Start;
+          if (Tokens[I].Kind != TK_IDENT) {
+            Error = ("unexpected '" + Tokens[I].Text + "' in bounds").str();
+            return false;
+          }
+          unsigned Var = getVariable(Tokens[I].Text);
+          I++;
+
+          if (I < Tokens.size() && Tokens[I].Kind == TK_IDENT &&
+              Tokens[I].Text.equals_lower("free")) {
+            LP.Lower[Var] = -INF;
+            LP.Upper[Var] = INF;
+            I++;
+          }
+          else if (I < Tokens.size() && Tokens[I].Kind == TK_RELOP) {
+            Relation Rel = Tokens[I].Rel;
+            I++;
+            if (!parseBoundValue(Tokens, I, Value)) {
+              Error = "invalid bound";
+              return false;
+            }
+            applyBound(Var, Rel, Value, false);
+          }
+          else {
+            Error = "invalid bound";
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    /// Parse a section listing integer or binary variables.
+    bool parseIntegers(const std::vector<Token> &Tokens, bool Binary)
+    {
+      for(size_t I = 0; I < Tokens.size(); I++) {
+        if (Tokens[I].Kind != TK_IDENT) {
+          Error = ("unexpected '" + Tokens[I].Text + "'").str();
+          return false;
+        }
+        unsigned Var = getVariable(Tokens[I].Text);
+        LP.IsInteger[Var] = true;
+        if (Binary) {
+          LP.Lower[Var] = 0;
+          LP.Upper[Var] = 1;
+        }
+      }
+      return true;
+    }
+
+    /// Parse the tokens collected for a section.
+    bool parseSection(Section S, const std::vector<Token> &Tokens)
+    {
+      switch(S) {
+        case S_NONE:
+          if (!Tokens.empty()) {
+            Error = "text outside of any section";
+            return false;
+          }
+          return true;
+        case S_OBJECTIVE:
+          return parseObjective(Tokens);
+        case S_CONSTRAINTS:
+          return parseConstraints(Tokens);
+        case S_BOUNDS:
+          return parseBounds(Tokens);
+        case S_GENERALS:
+          return parseIntegers(Tokens, false);
+        case S_BINARIES:
+          return parseIntegers(Tokens, true);
+        case S_END:
+          return true;
+      }
+      llvm_unreachable("unknown LP section");
+    }
+
+  public:
+    LPParser(LinearProgram &lp) : LP(lp) {}
+
+    /// parse - Parse the LP, return false on errors.
+    bool parse(StringRef Text)
+    {
+      Section Current = S_NONE;
+      std::vector<Token> Tokens;
+
+      while(!Text.empty() && Current != S_END) {
+        StringRef Line;
+        std::tie(Line, Text) = Text.split('\n');
+
+        // strip comments
+        Line = Line.substr(0, Line.find('\\')).trim();
+
+        StringRef Rest;
+        Section S = getSection(Line, Rest);
+        if (S != S_NONE) {
+          // finish the previous section
+          if (!parseSection(Current, Tokens))
+            return false;
+          Tokens.clear();
+
+          if (S == S_OBJECTIVE)
+            LP.Maximize = Line.startswith_lower("max");
+
+          Current = S;
+          Line = Rest;
+        }
+
+        if (!tokenize(Line, Tokens))
+          return false;
+      }
+
+      return parseSection(Current, Tokens);
+    }
+
+    /// normalize - Print the LP in a canonical form, dropping comments and
+    /// constraint names, and renaming variables in the order of their first
+    /// occurrence. Returns false on errors.
+    bool normalize(StringRef Text, raw_ostream &OS)
+    {
+      StringMap<unsigned> Names;
+
+      while(!Text.empty()) {
+        StringRef Line;
+        std::tie(Line, Text) = Text.split('\n');
+
+        // strip comments
+        Line = Line.substr(0, Line.find('\\')).trim();
+
+        StringRef Rest;
+        Section S = getSection(Line, Rest);
+        if (S != S_NONE) {
+          OS << '\n' << (unsigned)S;
+          if (S == S_OBJECTIVE)
+            OS << (Line.startswith_lower("max") ? "max" : "min");
+          else if (S == S_END)
+            break;
+          Line = Rest;
+        }
+
+        std::vector<Token> Tokens;
+        if (!tokenize(Line, Tokens))
+          return false;
+
+        for(size_t I = 0; I < Tokens.size(); I++) {
+          const Token &T(Tokens[I]);
+          if (T.Kind == TK_IDENT && I + 1 < Tokens.size() &&
+              Tokens[I + 1].Kind == TK_COLON) {
+            // the names of constraints do not matter
+            OS << " c:";
+            I++;
+          }
+          else if (T.Kind == TK_IDENT && !T.Text.equals_lower("free")) {
+            unsigned Idx = Names.size();
+            Idx = Names.insert(std::make_pair(T.Text, Idx)).first->second;
+            OS << " v" << Idx;
+          }
+          else
+            OS << ' ' << T.Text;
+        }
+      }
+      return true;
+    }
+
+    const std::string &getError() const { return Error; }
+  };
+
+  /// Result of solving the LP relaxation.
+  struct LPSolution {
+    PatmosILPSolver::Status Status;
+    double Objective;
+    std::vector<double> Values;
+  };
+
+  /// A dense two-phase simplex solver for the LP relaxation of a linear
+  /// program with (modified) variable bounds.
+  class Simplex {
+    /// Mapping of a variable of the linear program to tableau columns:
+    /// x = Offset + Scale * y_Column - (Split ? y_Column+1 : 0)
+    struct ColumnMap {
+      double Offset;
+      double Scale;
+      int Column;
+      bool Split;
+    };
+
+    /// The tableau, row 0 is the objective row, the last column holds the
+    /// right-hand side.
+    std::vector<std::vector<double> > Tab;
+
+    /// Basic variable of each row.
+    std::vector<unsigned> Basis;
+
+    unsigned NumColumns;
+
+    /// First artificial column.
+    unsigned FirstArtificial;
+
+    double &rhs(unsigned Row) { return Tab[Row][NumColumns]; }
+
+    void pivot(unsigned Row, unsigned Col)
+    {
+      std::vector<double> &P(Tab[Row]);
+      double Div = P[Col];
+      for(unsigned j = 0; j <= NumColumns; j++)
+        P[j] /= Div;
+      P[Col] = 1;
+
+      for(unsigned i = 0; i < Tab.size(); i++) {
+        if (i == Row)
+          continue;
+        std::vector<double> &R(Tab[i]);
+        double F = R[Col];
+        if (std::fabs(F) <= EPS) {
+          R[Col] = 0;
+          continue;
+        }
+        for(unsigned j = 0; j <= NumColumns; j++)
+          R[j] -= F * P[j];
+        R[Col] = 0;
+      }
+      Basis[Row - 1] = Col;
+    }
+
+    /// Run the simplex iterations on the current objective row, considering
+    /// only columns below Limit as entering candidates. Returns false if the
+    /// objective is unbounded.
+    bool iterate(unsigned Limit)
+    {
+      unsigned Degenerate = 0;
+      while(true) {
+        // choose entering column, use Bland's rule when the last pivots were
+        // degenerate to avoid cycling
+        bool Bland = Degenerate > 50;
+        int Col = -1;
+        double Best = -EPS;
+        for(unsigned j = 0; j < Limit; j++) {
+          if (Tab[0][j] < Best) {
+            Col = j;
+            if (Bland)
+              break;
+            Best = Tab[0][j];
+          }
+        }
+        if (Col < 0)
+          return true;
+
+        // ratio test
+        int Row = -1;
+        double Ratio = INF;
+        for(unsigned i = 1; i < Tab.size(); i++) {
+          double A = Tab[i][Col];
+          if (A > EPS) {
+            double R = rhs(i) / A;
+            if (R < Ratio - EPS ||
+                (R < Ratio + EPS && Row >= 0 &&
+                 Basis[i - 1] < Basis[Row - 1])) {
+              Ratio = R;
+              Row = i;
+            }
+          }
+        }
+        if (Row < 0)
+          return false;
+
+        Degenerate = Ratio <= EPS ? Degenerate + 1 : 0;
+        pivot(Row, Col);
+      }
+    }
+
+  public:
+    /// solve - Solve the LP relaxation using the bounds Lower/Upper instead
+    /// of those of the linear program.
+    LPSolution solve(const LinearProgram &LP, const std::vector<double> &Lower,
+                     const std::vector<double> &Upper)
+    {
+      LPSolution Result;
+      Result.Status = PatmosILPSolver::INFEASIBLE;
+      Result.Objective = 0;
+
+      unsigned N = LP.getNumVariables();
+
+      // map variables to non-negative columns
+      std::vector<ColumnMap> Map(N);
+      unsigned NumStructural = 0;
+      std::vector<std::pair<unsigned, double> > UpperRows;
+      for(unsigned j = 0; j < N; j++) {
+        if (Lower[j] > Upper[j] + EPS)
+          return Result;
+
+        ColumnMap &M = Map[j];
+        M.Column = NumStructural++;
+        M.Split = false;
+        if (Lower[j] != -INF) {
+          M.Offset = Lower[j];
+          M.Scale = 1;
+          if (Upper[j] != INF)
+            UpperRows.push_back(std::make_pair(M.Column, Upper[j] - Lower[j]));
+        }
+        else if (Upper[j] != INF) {
+          M.Offset = Upper[j];
+          M.Scale = -1;
+        }
+        else {
+          M.Offset = 0;
+          M.Scale = 1;
+          M.Split = true;
+          NumStructural++;
+        }
+      }
+
+      // build constraint rows over the structural columns
+      unsigned NumRows = LP.Rows.size() + UpperRows.size();
+      std::vector<std::vector<double> > A(NumRows,
+                                          std::vector<double>(NumStructural));
+      std::vector<double> B(NumRows);
+      std::vector<Relation> Rel(NumRows);
+      for(unsigned i = 0; i < LP.Rows.size(); i++) {
+        const LPRow &R(LP.Rows[i]);
+        double RHS = R.RHS;
+        for(unsigned k = 0; k < R.Terms.size(); k++) {
+          const ColumnMap &M(Map[R.Terms[k].first]);
+          double C = R.Terms[k].second;
+          RHS -= C * M.Offset;
+          A[i][M.Column] += C * M.Scale;
+          if (M.Split)
+            A[i][M.Column + 1] -= C;
+        }
+        B[i] = RHS;
+        Rel[i] = R.Rel;
+      }
+      for(unsigned k = 0; k < UpperRows.size(); k++) {
+        unsigned i = LP.Rows.size() + k;
+        A[i][UpperRows[k].first] = 1;
+        B[i] = UpperRows[k].second;
+        Rel[i] = LE;
+      }
+
+      // normalize to non-negative right-hand sides and count extra columns
+      unsigned NumSlack = 0, NumArtificial = 0;
+      for(unsigned i = 0; i < NumRows; i++) {
+        if (B[i] < 0) {
+          B[i] = -B[i];
+          for(unsigned j = 0; j < NumStructural; j++)
+            A[i][j] = -A[i][j];
+          if (Rel[i] != EQ)
+            Rel[i] = Rel[i] == LE ? GE : LE;
+        }
+        if (Rel[i] != EQ)
+          NumSlack++;
+        if (Rel[i] != LE)
+          NumArtificial++;
+      }
+
+      // set up the tableau
+      NumColumns = NumStructural + NumSlack + NumArtificial;
+      FirstArtificial = NumStructural + NumSlack;
+      Tab.assign(NumRows + 1, std::vector<double>(NumColumns + 1));
+      Basis.assign(NumRows, 0);
+      unsigned Slack = NumStructural, Artificial = FirstArtificial;
+      for(unsigned i = 0; i < NumRows; i++) {
+        std::vector<double> &T(Tab[i + 1]);
+        std::copy(A[i].begin(), A[i].end(), T.begin());
+        T[NumColumns] = B[i];
+        if (Rel[i] == LE) {
+          T[Slack] = 1;
+          Basis[i] = Slack++;
+        }
+        else {
+          if (Rel[i] == GE)
+            T[Slack++] = -1;
+          T[Artificial] = 1;
+          Basis[i] = Artificial++;
+        }
+      }
+
+      // phase 1: minimize the sum of the artificial variables
+      if (NumArtificial) {
+        std::vector<double> &Obj(Tab[0]);
+        for(unsigned i = 0; i < NumRows; i++) {
+          if (Basis[i] >= FirstArtificial) {
+            for(unsigned j = 0; j <= NumColumns; j++)
+              Obj[j] -= Tab[i + 1][j];
+          }
+        }
+        for(unsigned j = FirstArtificial; j < NumColumns; j++)
+          Obj[j] = 0;
+
+        iterate(FirstArtificial);
+
+        if (rhs(0) < -INT_EPS)
+          return Result;
+
+        // drive remaining artificial variables out of the basis
+        for(unsigned i = 0; i < NumRows; i++) {
+          if (Basis[i] < FirstArtificial)
+            continue;
+          for(unsigned j = 0; j < FirstArtificial; j++) {
+            if (std::fabs(Tab[i + 1][j]) > EPS) {
+              pivot(i + 1, j);
+              break;
+            }
+          }
+          // otherwise the row is redundant, the artificial variable remains
+          // basic at zero and never leaves since its column never enters.
+        }
+      }
+
+      // phase 2: optimize the actual objective, maximizing internally
+      std::vector<double> &Obj(Tab[0]);
+      std::fill(Obj.begin(), Obj.end(), 0);
+      double Sign = LP.Maximize ? 1 : -1;
+      double Constant = LP.ObjectiveConstant;
+      for(unsigned j = 0; j < N; j++) {
+        const ColumnMap &M(Map[j]);
+        double C = Sign * LP.Objective[j];
+        Constant += LP.Objective[j] * M.Offset;
+        Obj[M.Column] -= C * M.Scale;
+        if (M.Split)
+          Obj[M.Column + 1] += C;
+      }
+      for(unsigned i = 0; i < NumRows; i++) {
+        double F = Obj[Basis[i]];
+        if (F != 0) {
+          for(unsigned j = 0; j <= NumColumns; j++)
+            Obj[j] -= F * Tab[i + 1][j];
+        }
+      }
+
+      if (!iterate(FirstArtificial)) {
+        Result.Status = PatmosILPSolver::UNBOUNDED;
+        return Result;
+      }
+
+      // extract the solution
+      std::vector<double> Y(NumColumns, 0);
+      for(unsigned i = 0; i < NumRows; i++)
+        Y[Basis[i]] = rhs(i + 1);
+
+      Result.Status = PatmosILPSolver::OPTIMAL;
+      Result.Objective = Sign * rhs(0) + Constant;
+      Result.Values.resize(N);
+      for(unsigned j = 0; j < N; j++) {
+        const ColumnMap &M(Map[j]);
+        Result.Values[j] = M.Offset + M.Scale * Y[M.Column] -
+                           (M.Split ? Y[M.Column + 1] : 0);
+      }
+      return Result;
+    }
+  };
+
+  /// In-process solver based on simplex and branch-and-bound.
+  class BuiltinILPSolver : public PatmosILPSolver {
+    unsigned MaxNodes;
+
+    /// A node of the branch-and-bound tree, i.e., modified variable bounds.
+    struct BBNode {
+      std::vector<double> Lower, Upper;
+    };
+
+  public:
+    BuiltinILPSolver(unsigned maxnodes) : MaxNodes(maxnodes) {}
+
+    Status solve(StringRef Text, double &Objective) override
+    {
+      LinearProgram LP;
+      LPParser Parser(LP);
+      if (!Parser.parse(Text)) {
+        LLVM_DEBUG(dbgs() << "ILP: failed to parse LP: " << Parser.getError()
+                          << "\n");
+        return UNKNOWN;
+      }
+
+      // integral objective coefficients on integer variables only allow to
+      // prune nodes that cannot improve the incumbent by at least 1.
+      bool IntegralObjective = std::floor(LP.ObjectiveConstant) ==
+                               LP.ObjectiveConstant;
+      for(unsigned j = 0; j < LP.getNumVariables(); j++) {
+        if (LP.Objective[j] != 0 && (!LP.IsInteger[j] ||
+            std::floor(LP.Objective[j]) != LP.Objective[j]))
+          IntegralObjective = false;
+      }
+
+      double Sign = LP.Maximize ? 1 : -1;
+      bool HaveIncumbent = false;
+      double Incumbent = -INF;
+
+      std::vector<BBNode> Stack(1);
+      Stack.back().Lower = LP.Lower;
+      Stack.back().Upper = LP.Upper;
+
+      unsigned NumNodes = 0;
+      Simplex S;
+      while(!Stack.empty()) {
+        if (NumNodes++ >= MaxNodes) {
+          LLVM_DEBUG(dbgs() << "ILP: giving up after " << MaxNodes
+                            << " nodes\n");
+          return UNKNOWN;
+        }
+
+        BBNode Node;
+        std::swap(Node, Stack.back());
+        Stack.pop_back();
+
+        LPSolution R(S.solve(LP, Node.Lower, Node.Upper));
+        if (R.Status == UNBOUNDED)
+          return UNBOUNDED;
+        else if (R.Status != OPTIMAL)
+          continue;
+
+        // prune nodes that cannot improve the incumbent
+        double Bound = Sign * R.Objective;
+        if (IntegralObjective)
+          Bound = std::floor(Bound + INT_EPS);
+        if (HaveIncumbent && Bound <= Incumbent + INT_EPS)
+          continue;
+
+        // find the most fractional integer variable
+        int Var = -1;
+        double Fraction = INT_EPS;
+        for(unsigned j = 0; j < LP.getNumVariables(); j++) {
+          if (!LP.IsInteger[j])
+            continue;
+          double V = R.Values[j];
+          double F = std::fabs(V - std::floor(V + 0.5));
+          if (F > Fraction) {
+            Fraction = F;
+            Var = j;
+          }
+        }
+
+        if (Var < 0) {
+          // integer solution
+          HaveIncumbent = true;
+          Incumbent = Sign * R.Objective;
+          continue;
+        }
+
+        // branch, explore the branch closer to the relaxed value first
+        double V = R.Values[Var];
+        BBNode Down(Node), Up(Node);
+        Down.Upper[Var] = std::floor(V);
+        Up.Lower[Var] = std::ceil(V);
+        if (V - std::floor(V) < 0.5) {
+          Stack.push_back(std::move(Up));
+          Stack.push_back(std::move(Down));
+        }
+        else {
+          Stack.push_back(std::move(Down));
+          Stack.push_back(std::move(Up));
+        }
+      }
+
+      if (!HaveIncumbent)
+        return INFEASIBLE;
+
+      Objective = Sign * Incumbent;
+      if (IntegralObjective)
+        Objective = std::floor(Objective + 0.5);
+      return OPTIMAL;
+    }
+
+    StringRef getName() const override { return "builtin"; }
+  };
+
+  /// Solver invoking an external program.
+  class ExternalILPSolver : public PatmosILPSolver {
+    std::string Program;
+
+  public:
+    ExternalILPSolver(StringRef program) : Program(program) {}
+
+    Status solve(StringRef LP, double &Objective) override
+    {
+      // open LP file.
+      SmallString<1024> LPdir;
+      std::error_code err = sys::fs::createUniqueDirectory("stack", LPdir);
+      if (err) {
+        report_fatal_error("creating temp .lp file: " + err.message());
+      }
+
+      SmallString<1024> LPname(LPdir);
+      sys::path::append(LPname, "scc.lp");
+
+      {
+        std::error_code ErrCode;
+        raw_fd_ostream OS(LPname.c_str(), ErrCode);
+        if (ErrCode) {
+          report_fatal_error("Failed to open file '" + LPname.str() +
+                             "' for writing: " + ErrCode.message());
+        }
+        OS << LP;
+      }
+
+      std::vector<StringRef> args;
+      args.push_back(Program);
+      args.push_back(LPname);
+
+      std::string ErrMsg;
+      auto progName = sys::findProgramByName(Program);
+      if (!progName) {
+        report_fatal_error("calling ILP solver (" + Program + "): " +
+                           progName.getError().message());
+      }
+      if (sys::ExecuteAndWait(StringRef(*progName),
+                              llvm::ArrayRef<StringRef>(args),
+                              llvm::None,
+                              llvm::ArrayRef<Optional<StringRef>>(),
+                              0,0,&ErrMsg)) {
+        report_fatal_error("calling ILP solver (" + Program + "): " + ErrMsg);
+      }
+
+      // read solution
+      // construct name of solution
+      std::string SOLname(LPname.str());
+      SOLname += ".sol";
+
+      if (!sys::fs::exists(SOLname))
+        report_fatal_error("Failed to read ILP solution");
+
+      double tmp;
+      {
+        std::ifstream IS(SOLname.c_str());
+        assert(IS.good());
+
+        // read the result value
+        IS >> tmp;
+      }
+
+      sys::fs::remove(SOLname);
+      sys::fs::remove(LPname);
+      sys::fs::remove(LPdir);
+
+      // the solver reports failure as -1
+      if (tmp == -1.)
+        return UNKNOWN;
+
+      Objective = tmp;
+      return OPTIMAL;
+    }
+
+    StringRef getName() const override { return Program; }
+  };
+
+  /// Solver passing ILPs on to a second solver when the first one gives up.
+  class FallbackILPSolver : public PatmosILPSolver {
+    std::unique_ptr<PatmosILPSolver> Primary;
+
+    std::unique_ptr<PatmosILPSolver> Fallback;
+
+  public:
+    FallbackILPSolver(std::unique_ptr<PatmosILPSolver> primary,
+                      std::unique_ptr<PatmosILPSolver> fallback)
+        : Primary(std::move(primary)), Fallback(std::move(fallback)) {}
+
+    Status solve(StringRef LP, double &Objective) override
+    {
+      Status S = Primary->solve(LP, Objective);
+      if (S != UNKNOWN)
+        return S;
+
+      LLVM_DEBUG(dbgs() << "ILP: " << Primary->getName()
+                        << " solver gave up, using "
+                        << Fallback->getName() << "\n");
+      ILPFallbacks++;
+      return Fallback->solve(LP, Objective);
+    }
+
+    StringRef getName() const override { return Primary->getName(); }
+  };
+
+  /// Solver memoizing the results of another solver in memory and,
+  /// optionally, on disk.
+  ///
+  /// Cache files hold the status and the objective value on the first line,
+  /// followed by the normalized LP, which is compared on lookup to rule out
+  /// hash collisions.
+  class CachingILPSolver : public PatmosILPSolver {
+    typedef std::pair<Status, double> Result;
+
+    std::unique_ptr<PatmosILPSolver> Solver;
+
+    /// Directory of the cache files, no files are used if empty.
+    std::string Dir;
+
+    /// Protect the in-memory cache from concurrent accesses.
+    std::mutex Lock;
+
+    /// Results of solved LPs, keyed on the normalized LP.
+    StringMap<Result> Results;
+
+    /// getCacheFile - Get the name of the cache file of a normalized LP.
+    std::string getCacheFile(StringRef Key) const
+    {
+      MD5 Hash;
+      Hash.update(Key);
+      MD5::MD5Result Digest;
+      Hash.final(Digest);
+
+      SmallString<128> Name(Dir);
+      sys::path::append(Name, Digest.digest() + ".ilp");
+      return Name.str().str();
+    }
+
+    /// readCacheFile - Look up the result of a normalized LP in the cache
+    /// directory.
+    bool readCacheFile(StringRef Key, Result &R) const
+    {
+      ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer =
+                                        MemoryBuffer::getFile(getCacheFile(Key));
+      if (!Buffer)
+        return false;
+
+      StringRef Header, Text;
+      std::tie(Header, Text) = (*Buffer)->getBuffer().split('\n');
+      if (Text != Key)
+        return false;
+
+      StringRef StatusText, ValueText;
+      std::tie(StatusText, ValueText) = Header.split(' ');
+      unsigned S;
+      if (StatusText.getAsInteger(10, S) || S >= UNKNOWN ||
+          !to_float(ValueText, R.second))
+        return false;
+
+      R.first = (Status)S;
+      return true;
+    }
+
+    /// writeCacheFile - Store the result of a normalized LP in the cache
+    /// directory. Errors are ignored, the result is just not cached then.
+    void writeCacheFile(StringRef Key, const Result &R) const
+    {
+      if (sys::fs::create_directories(Dir))
+        return;
+
+      // write to a temporary file first, other compilations might access the
+      // cache concurrently.
+      SmallString<128> Model(Dir), TmpName;
+      sys::path::append(Model, "ilp-%%%%%%%%.tmp");
+      int FD;
+      if (sys::fs::createUniqueFile(Model, FD, TmpName))
+        return;
+
+      {
+        raw_fd_ostream OS(FD, true);
+        OS << (unsigned)R.first << ' ' << format("%.17g", R.second) << '\n'
+           << Key;
+      }
+
+      if (sys::fs::rename(TmpName, getCacheFile(Key)))
+        sys::fs::remove(TmpName);
+    }
+
+  public:
+    CachingILPSolver(std::unique_ptr<PatmosILPSolver> solver, StringRef dir)
+        : Solver(std::move(solver)), Dir(dir) {}
+
+    Status solve(StringRef LP, double &Objective) override
+    {
+      std::string Key(normalizePatmosLP(LP));
+
+      {
+        std::lock_guard<std::mutex> Guard(Lock);
+        StringMap<Result>::const_iterator tmp(Results.find(Key));
+        if (tmp != Results.end()) {
+          ILPCacheHits++;
+          Objective = tmp->second.second;
+          return tmp->second.first;
+        }
+      }
+
+      Result R(UNKNOWN, 0);
+      if (!Dir.empty() && readCacheFile(Key, R)) {
+        ILPCacheHits++;
+      }
+      else {
+        R.first = Solver->solve(LP, R.second);
+
+        // the solver gave up, maybe it has more luck next time
+        if (R.first == UNKNOWN)
+          return UNKNOWN;
+
+        if (!Dir.empty())
+          writeCacheFile(Key, R);
+      }
+
+      {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Results[Key] = R;
+      }
+
+      Objective = R.second;
+      return R.first;
+    }
+
+    StringRef getName() const override { return Solver->getName(); }
+  };
+}
+
+std::unique_ptr<PatmosILPSolver>
+llvm::createPatmosBuiltinILPSolver(unsigned MaxNodes) {
+  return std::make_unique<BuiltinILPSolver>(MaxNodes);
+}
+
+std::unique_ptr<PatmosILPSolver>
+llvm::createPatmosExternalILPSolver(StringRef Program) {
+  return std::make_unique<ExternalILPSolver>(Program);
+}
+
+std::unique_ptr<PatmosILPSolver>
+llvm::createPatmosFallbackILPSolver(std::unique_ptr<PatmosILPSolver> Primary,
+                                    std::unique_ptr<PatmosILPSolver> Fallback) {
+  return std::make_unique<FallbackILPSolver>(std::move(Primary),
+                                             std::move(Fallback));
+}
+
+std::unique_ptr<PatmosILPSolver>
+llvm::createPatmosCachingILPSolver(std::unique_ptr<PatmosILPSolver> Solver,
+                                   StringRef Dir) {
+  return std::make_unique<CachingILPSolver>(std::move(Solver), Dir);
+}
+
+std::string llvm::normalizePatmosLP(StringRef LP) {
+  LinearProgram Dummy;
+  LPParser Parser(Dummy);
+
+  std::string Result;
+  raw_string_ostream OS(Result);
+  if (!Parser.normalize(LP, OS)) {
+    // the LP is invalid anyway, keep it as it is
+    return LP.str();
+  }
+  return OS.str();
+}
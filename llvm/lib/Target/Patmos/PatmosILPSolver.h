@@ -0,0 +1,87 @@
+//===-- PatmosILPSolver.h - ILP solvers for the Patmos analyses. ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Solvers for the (small) integer linear programs constructed by the stack
+// cache analysis. The ILPs are exchanged in CPLEX LP format, which allows to
+// either solve them in-process or to hand them to an external solver program.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOSILPSOLVER_H_
+#define _LLVM_TARGET_PATMOSILPSOLVER_H_
+
+#include "llvm/ADT/StringRef.h"
+
+#include <memory>
+#include <string>
+
+namespace llvm {
+
+  /// Interface of an ILP solver. Implementations have to be thread-safe, i.e.,
+  /// solve may be invoked concurrently for different ILPs.
+  class PatmosILPSolver
+  {
+  public:
+    /// Outcome of solving an ILP.
+    enum Status {
+      /// An optimal integer solution was found.
+      OPTIMAL,
+      /// The problem has no (integer) solution.
+      INFEASIBLE,
+      /// The objective function is not bounded.
+      UNBOUNDED,
+      /// The solver gave up, e.g., due to exhausted resources.
+      UNKNOWN
+    };
+
+    virtual ~PatmosILPSolver() {}
+
+    /// solve - Solve the ILP given in CPLEX LP format. The value of the
+    /// objective function is returned in Objective if the solution is optimal.
+    virtual Status solve(StringRef LP, double &Objective) = 0;
+
+    /// getName - Return a short name of the solver for diagnostics.
+    virtual StringRef getName() const = 0;
+  };
+
+  /// createPatmosBuiltinILPSolver - Create an in-process solver, using the
+  /// simplex method and branch-and-bound. MaxNodes limits the number of
+  /// branch-and-bound nodes before the solver gives up.
+  std::unique_ptr<PatmosILPSolver>
+  createPatmosBuiltinILPSolver(unsigned MaxNodes);
+
+  /// createPatmosExternalILPSolver - Create a solver that writes the LP to a
+  /// temporary file and invokes the given program with the file name as its
+  /// only argument. The program is expected to write the numeric value of the
+  /// solution to a file with the same name and the suffix .sol appended, or
+  /// -1 if the problem is infeasible or unbounded.
+  std::unique_ptr<PatmosILPSolver>
+  createPatmosExternalILPSolver(StringRef Program);
+
+  /// createPatmosFallbackILPSolver - Create a solver that passes an ILP on to
+  /// Fallback whenever Primary gives up on it.
+  std::unique_ptr<PatmosILPSolver>
+  createPatmosFallbackILPSolver(std::unique_ptr<PatmosILPSolver> Primary,
+                                std::unique_ptr<PatmosILPSolver> Fallback);
+
+  /// createPatmosCachingILPSolver - Create a solver that memoizes the results
+  /// of Solver, keyed on the normalized text of the LP. If Dir is not empty,
+  /// results are also stored in files in that directory, named after a hash
+  /// of the normalized LP, such that they are reused across compilations.
+  std::unique_ptr<PatmosILPSolver>
+  createPatmosCachingILPSolver(std::unique_ptr<PatmosILPSolver> Solver,
+                               StringRef Dir);
+
+  /// normalizePatmosLP - Return a canonical form of an LP, which does not
+  /// depend on comments, white space, constraint names, or variable names.
+  /// LPs with the same canonical form have the same solution.
+  std::string normalizePatmosLP(StringRef LP);
+}
+
+#endif // _LLVM_TARGET_PATMOSILPSOLVER_H_
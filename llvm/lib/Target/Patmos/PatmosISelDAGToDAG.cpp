@@ -24,6 +24,8 @@
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/SelectionDAG.h"
 #include "llvm/CodeGen/SelectionDAGISel.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
@@ -31,6 +33,17 @@
 
 using namespace llvm;
 
+#define DEBUG_TYPE "patmos-isel"
+
+STATISTIC(SharedLongImms, "Long immediates loaded once instead of folded");
+
+/// DisableLongImmSharing - Option to fold 32-bit constants into every
+/// instruction using them.
+static cl::opt<bool> DisableLongImmSharing("mpatmos-disable-long-imm-sharing",
+  cl::init(false),
+  cl::desc("Fold 32-bit constants into every ALU instruction using them "
+           "instead of loading constants used repeatedly into a register."),
+  cl::Hidden);
 
 /// PatmosDAGToDAGISel - Patmos specific code to select Patmos machine
 /// instructions for SelectionDAG operations.
@@ -54,6 +67,10 @@ namespace {
   private:
     void Select(SDNode *N) override;
 
+    /// PreprocessISelDAG - Load long immediates used repeatedly in a block
+    /// into a register.
+    void PreprocessISelDAG() override;
+
     // These functions create a predicate operand from an i1 value
     bool SelectPred(SDValue N, SDValue &Reg, SDValue &Inv);
     bool SelectPredInv(SDValue N, SDValue &Reg, SDValue &Inv);
@@ -93,6 +110,79 @@ void PatmosDAGToDAGISel::Select(SDNode *Node) {
 
 }
 
+/// isShortImm - Check whether a constant fits the immediate of an ALUi
+/// instruction, or of li.
+static bool isShortImm(int64_t Value) {
+  return isUInt<12>(Value) || isUInt<12>(-Value);
+}
+
+void PatmosDAGToDAGISel::PreprocessISelDAG() {
+  if (DisableLongImmSharing || OptLevel == CodeGenOpt::None)
+    return;
+
+  // A 32-bit constant is folded into each ALU instruction using it, every one
+  // of them then occupies both issue slots of its bundle. Loading it once
+  // with li takes both slots as well, but the ALUr instructions using it can
+  // be bundled with other instructions. This pays off from the second
+  // folding use, or from the first one if the constant needs a register
+  // for another use anyway.
+  SmallVector<ConstantSDNode*, 8> Shared;
+  for (SDNode &N : CurDAG->allnodes()) {
+    ConstantSDNode *C = dyn_cast<ConstantSDNode>(&N);
+    if (!C || C->getValueType(0) != MVT::i32 ||
+        isShortImm(C->getSExtValue()))
+      continue;
+
+    uint32_t Value = C->getZExtValue();
+    unsigned Folded = 0, InRegister = 0;
+    bool Supported = true;
+    for (SDNode::use_iterator UI = C->use_begin(), UE = C->use_end();
+         UI != UE && Supported; ++UI) {
+      switch (UI->getOpcode()) {
+      case ISD::AND:
+        // and with a single cleared bit is a bclr
+        if (!isPowerOf2_32(~Value))
+          Folded++;
+        break;
+      case ISD::OR:
+        // or with a single set bit is a bset
+        if (!isPowerOf2_32(Value))
+          Folded++;
+        break;
+      case ISD::ADD: case ISD::SUB: case ISD::XOR:
+        if (UI.getOperandNo() == 1)
+          Folded++;
+        else
+          InRegister++;
+        break;
+      case ISD::MUL: case ISD::SETCC: case ISD::SELECT:
+      case ISD::LOAD: case ISD::STORE: case ISD::CopyToReg:
+        InRegister++;
+        break;
+      default:
+        Supported = false;
+        break;
+      }
+    }
+
+    if (Supported && (Folded >= 2 || (Folded >= 1 && InRegister >= 1)))
+      Shared.push_back(C);
+  }
+
+  for (ConstantSDNode *C : Shared) {
+    SDLoc dl(C);
+    SDValue Ops[] = { CurDAG->getRegister(Patmos::NoRegister, MVT::i1),
+                      CurDAG->getTargetConstant(0, dl, MVT::i1),
+                      CurDAG->getTargetConstant(C->getZExtValue(), dl,
+                                                MVT::i32) };
+    SDNode *LI = CurDAG->getMachineNode(Patmos::LIl, dl, MVT::i32, Ops);
+    LLVM_DEBUG(dbgs() << "Sharing long immediate " << C->getSExtValue()
+                      << "\n");
+    CurDAG->ReplaceAllUsesOfValueWith(SDValue(C, 0), SDValue(LI, 0));
+    SharedLongImms++;
+  }
+}
+
 bool PatmosDAGToDAGISel::SelectPred(SDValue N, SDValue &Reg, SDValue &Inv) {
   SDLoc dl(N);
   if (ConstantSDNode *Imm = dyn_cast<ConstantSDNode>(N.getNode())) {
@@ -17,16 +17,24 @@
 #include "PatmosMachineFunctionInfo.h"
 #include "PatmosTargetMachine.h"
 #include "PatmosSubtarget.h"
+#include "SinglePath/PatmosSinglePathInfo.h"
+#include "MCTargetDesc/PatmosBaseInfo.h"
+#include "llvm/BinaryFormat/ELF.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/IntrinsicsPatmos.h"
 #include "llvm/IR/CallingConv.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/CodeGen/CallingConvLower.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/PseudoSourceValue.h"
 #include "llvm/CodeGen/SelectionDAGISel.h"
@@ -35,9 +43,142 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/MC/MCContext.h"
 #include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCSectionELF.h"
 using namespace llvm;
 
+/// InlineDivision - Option to expand divisions by a variable inline instead of
+/// calling the runtime library.
+static cl::opt<bool> InlineDivision("mpatmos-inline-division",
+  cl::init(false),
+  cl::desc("Expand 32-bit divisions by a variable to an inline restoring "
+           "division with a fixed latency instead of a library call."));
+
+/// MaxInlineByValCopySize - Byval arguments up to this size are copied with
+/// inline loads and stores instead of calling memcpy.
+static cl::opt<unsigned> MaxInlineByValCopySize(
+  "mpatmos-byval-inline-copy-size",
+  cl::init(256),
+  cl::desc("Maximum size in bytes of a byval argument copied inline at the "
+           "call site (default: 256)."),
+  cl::Hidden);
+
+/// CycleCounterAddress - Base address of the memory mapped cycle counter of
+/// the timer device. The low word is at offset 4, the high word at offset 0.
+static cl::opt<unsigned> CycleCounterAddress("mpatmos-cycle-counter-address",
+  cl::init(0xF0020000),
+  cl::desc("Address of the memory mapped cycle counter read by "
+           "llvm.readcyclecounter."),
+  cl::Hidden);
+
+/// InlineFloatCompare - Option to expand floating point comparisons inline
+/// without an FPU, instead of calling the soft-float library.
+static cl::opt<bool> InlineFloatCompare("mpatmos-inline-float-compare",
+  cl::init(true),
+  cl::desc("Expand floating point comparisons without an FPU to branchless "
+           "integer sequences instead of soft-float library calls."));
+
+/// NoCDMAAddress - Base address of the DMA table of the network-on-chip. Each
+/// channel has two words: the control and status word, and the pointers.
+static cl::opt<unsigned> NoCDMAAddress("mpatmos-noc-dma-address",
+  cl::init(0xE8000000),
+  cl::desc("Address of the DMA table of the network-on-chip used by the "
+           "llvm.patmos.noc intrinsics."),
+  cl::Hidden);
+
+/// Bits of the control and status word of a DMA channel: a valid transfer
+/// is started, and is finished.
+static const unsigned NoCValidBit = 0x8000;
+static const unsigned NoCDoneShift = 14;
+
+/// JumpTableMinEntries - A jump table costs a bounds check, a load and an
+/// indirect branch to another method cache region, which is about as
+/// expensive as a binary search over eight cases.
+static cl::opt<unsigned> JumpTableMinEntries("mpatmos-jump-table-min-entries",
+  cl::init(8),
+  cl::desc("Minimum number of cases of a switch to be lowered to a jump "
+           "table (default: 8)."),
+  cl::Hidden);
+
+/// JumpTableMaxTargetSize - All targets of a jump table are placed in the same
+/// method cache region by the function splitter.
+static cl::opt<unsigned> JumpTableMaxTargetSize(
+  "mpatmos-jump-table-max-target-size",
+  cl::init(512),
+  cl::desc("Maximum estimated code size in bytes of all targets of a jump "
+           "table, if a method cache is used (default: 512)."),
+  cl::Hidden);
+
+/// AlignLoops - Align innermost loops such that a small loop does not cross a
+/// burst boundary of the method cache, and a larger loop starts at one.
+static cl::opt<bool> AlignLoops("mpatmos-align-loops",
+  cl::init(false),
+  cl::desc("Align innermost loops to the block size of the method cache "
+           "(default: false)."),
+  cl::Hidden);
+
+/// DisableTailCalls - Option to lower all calls in tail position to calls
+/// followed by a return.
+static cl::opt<bool> DisableTailCalls("mpatmos-disable-tail-calls",
+  cl::init(false),
+  cl::desc("Do not lower calls in tail position to branches to the callee."),
+  cl::Hidden);
+
+/// EnableSWAR - Option to compute the operations on <4 x i8> and <2 x i16>
+/// vectors on whole words instead of on the scalarized elements.
+static cl::opt<bool> EnableSWAR("mpatmos-swar",
+  cl::init(true),
+  cl::desc("Lower operations on <4 x i8> and <2 x i16> vectors to word "
+           "operations within a register (SWAR)."),
+  cl::Hidden);
+
+
+void PatmosTargetObjectFile::Initialize(MCContext &Ctx,
+                                        const TargetMachine &TM) {
+  TargetLoweringObjectFileELF::Initialize(Ctx, TM);
+  InitializeELF(true); // set UseInitArray to true
+
+  SmallDataSection = getContext().getELFSection(".sdata", ELF::SHT_PROGBITS,
+                                            ELF::SHF_WRITE | ELF::SHF_ALLOC);
+  SmallBSSSection = getContext().getELFSection(".sbss", ELF::SHT_NOBITS,
+                                            ELF::SHF_WRITE | ELF::SHF_ALLOC);
+}
+
+bool PatmosTargetObjectFile::isGlobalInSmallSection(const GlobalObject *GO,
+                                              const TargetMachine &TM) const {
+  const PatmosSubtarget &STC =
+               *static_cast<const PatmosTargetMachine&>(TM).getSubtargetImpl();
+  if (!STC.hasSmallData())
+    return false;
+
+  // Functions, thread-local globals, globals in other address spaces, e.g.,
+  // on the scratchpad, and globals in explicit sections are not small data.
+  const GlobalVariable *GV = dyn_cast_or_null<GlobalVariable>(GO);
+  if (!GV || GV->isThreadLocal() || GV->hasSection() ||
+      GV->getAddressSpace() != 0 || GV->getName().startswith("llvm."))
+    return false;
+
+  Type *Ty = GV->getValueType();
+  if (!Ty->isSized())
+    return false;
+
+  uint64_t Size = GV->getParent()->getDataLayout().getTypeAllocSize(Ty);
+  return Size != 0 && Size <= STC.getSmallDataLimit();
+}
+
+MCSection *
+PatmosTargetObjectFile::SelectSectionForGlobal(const GlobalObject *GO,
+                                               SectionKind Kind,
+                                               const TargetMachine &TM) const {
+  // Read-only small data is placed in .sdata as well, declarations of
+  // constants are addressed the same way.
+  if (isGlobalInSmallSection(GO, TM))
+    return Kind.isBSS() ? SmallBSSSection : SmallDataSection;
+
+  return TargetLoweringObjectFileELF::SelectSectionForGlobal(GO, Kind, TM);
+}
+
 
 PatmosTargetLowering::PatmosTargetLowering(const PatmosTargetMachine &tm,
                                            const PatmosSubtarget &STI) :
@@ -60,6 +201,11 @@ PatmosTargetLowering::PatmosTargetLowering(const PatmosTargetMachine &tm,
   setStackPointerRegisterToSaveRestore(Patmos::RSP);
   setBooleanContents(ZeroOrOneBooleanContent);
 
+  // Conditions stay in the predicate registers across blocks, instead of
+  // being recomputed at their uses by CodeGenPrepare or split into sequences
+  // of selects.
+  setHasMultipleConditionRegisters();
+
   // Allow rather aggressive inlining of memcpy and friends
   MaxStoresPerMemset = 32;
   MaxStoresPerMemsetOptSize = 8;
@@ -71,6 +217,7 @@ PatmosTargetLowering::PatmosTargetLowering(const PatmosTargetMachine &tm,
   // We require word alignment at least (in log2 bytes here), if code requires 
   // an other alignment, e.g., due to the method-cache, it will be handled 
   // later.
+  setMinimumJumpTableEntries(JumpTableMinEntries);
   setMinFunctionAlignment(Align(2));
   setPrefFunctionAlignment(Subtarget.getMinSubfunctionAlignment());
 
@@ -80,6 +227,13 @@ PatmosTargetLowering::PatmosTargetLowering(const PatmosTargetMachine &tm,
   setLibcallName(RTLIB::SDIVREM_I64, "__divmoddi4");
   setLibcallName(RTLIB::UDIVREM_I64, "__udivmoddi4");
 
+  // Use the hand-bundled, constant-time divisions if bundling is enabled.
+  if (PatmosSubtarget::enableBundling()) {
+    setLibcallName(RTLIB::UDIV_I32, "__udivsi3_di");
+    setLibcallName(RTLIB::UREM_I32, "__umodsi3_di");
+    setLibcallName(RTLIB::UDIVREM_I32, "__udivmodsi4_di");
+  }
+
   setOperationAction(ISD::LOAD,   MVT::i1, Custom);
   for (MVT VT : MVT::integer_valuetypes()) {
     setLoadExtAction(ISD::EXTLOAD, VT, MVT::i1, Promote);
@@ -107,29 +261,44 @@ PatmosTargetLowering::PatmosTargetLowering(const PatmosTargetMachine &tm,
   setOperationAction(ISD::UREM, MVT::i32, Expand);
   setOperationAction(ISD::SDIVREM, MVT::i32, Expand);
   setOperationAction(ISD::UDIVREM, MVT::i32, Expand);
+  // Divisions by constants are turned into multiplications by the DAG
+  // combiner using S/UMUL_LOHI, all others can be expanded inline.
+  if (InlineDivision) {
+    setOperationAction(ISD::SDIV, MVT::i32, Custom);
+    setOperationAction(ISD::UDIV, MVT::i32, Custom);
+    setOperationAction(ISD::SREM, MVT::i32, Custom);
+    setOperationAction(ISD::UREM, MVT::i32, Custom);
+    setOperationAction(ISD::SDIVREM, MVT::i32, Custom);
+    setOperationAction(ISD::UDIVREM, MVT::i32, Custom);
+  }
 
   // we don't have carry setting add/sub instructions.
-  // TODO custom lowering with predicates?
   setOperationAction(ISD::CARRY_FALSE, MVT::i32, Expand);
   setOperationAction(ISD::ADDC, MVT::i32, Expand);
   setOperationAction(ISD::SUBC, MVT::i32, Expand);
   setOperationAction(ISD::ADDE, MVT::i32, Expand);
   setOperationAction(ISD::SUBE, MVT::i32, Expand);
+  // Carries are kept in predicates instead, i64 add/sub are expanded to
+  // UADDO/ADDCARRY and USUBO/SUBCARRY.
+  setOperationAction(ISD::UADDO, MVT::i32, Custom);
+  setOperationAction(ISD::USUBO, MVT::i32, Custom);
+  setOperationAction(ISD::ADDCARRY, MVT::i32, Custom);
+  setOperationAction(ISD::SUBCARRY, MVT::i32, Custom);
   // add/sub/mul with overflow
   setOperationAction(ISD::SADDO, MVT::i32, Expand);
-  setOperationAction(ISD::UADDO, MVT::i32, Expand);
   setOperationAction(ISD::SSUBO, MVT::i32, Expand);
-  setOperationAction(ISD::USUBO, MVT::i32, Expand);
   setOperationAction(ISD::SMULO, MVT::i32, Expand);
   setOperationAction(ISD::UMULO, MVT::i32, Expand);
 
   // no bit-fiddling
   setOperationAction(ISD::BSWAP, MVT::i32, Expand);
   setOperationAction(ISD::CTTZ , MVT::i32, Expand);
-  setOperationAction(ISD::CTLZ , MVT::i32, Expand);
   setOperationAction(ISD::CTTZ_ZERO_UNDEF, MVT::i32, Expand);
-  setOperationAction(ISD::CTLZ_ZERO_UNDEF, MVT::i32, Expand);
-  setOperationAction(ISD::CTPOP, MVT::i32, Expand);
+  // The generic expansions of CTLZ and CTTZ are based on CTPOP, which
+  // multiplies. Use shorter branchless sequences instead; CTTZ uses CTPOP.
+  setOperationAction(ISD::CTLZ , MVT::i32, Custom);
+  setOperationAction(ISD::CTLZ_ZERO_UNDEF, MVT::i32, Custom);
+  setOperationAction(ISD::CTPOP, MVT::i32, Custom);
 
   setOperationAction(ISD::SIGN_EXTEND, MVT::i8,  Expand);
   setOperationAction(ISD::SIGN_EXTEND, MVT::i16, Expand);
@@ -147,9 +316,10 @@ PatmosTargetLowering::PatmosTargetLowering(const PatmosTargetMachine &tm,
   setOperationAction(ISD::ROTL , MVT::i32, Expand);
   setOperationAction(ISD::ROTR , MVT::i32, Expand);
 
-  setOperationAction(ISD::SHL_PARTS, MVT::i32,   Expand);
-  setOperationAction(ISD::SRA_PARTS, MVT::i32,   Expand);
-  setOperationAction(ISD::SRL_PARTS, MVT::i32,   Expand);
+  // i64 shifts by a variable amount, instead of __ashldi3 and friends
+  setOperationAction(ISD::SHL_PARTS, MVT::i32,   Custom);
+  setOperationAction(ISD::SRA_PARTS, MVT::i32,   Custom);
+  setOperationAction(ISD::SRL_PARTS, MVT::i32,   Custom);
 
   setOperationAction(ISD::SELECT_CC, MVT::i1,    Expand);
   setOperationAction(ISD::SELECT_CC, MVT::i8,    Expand);
@@ -164,6 +334,10 @@ PatmosTargetLowering::PatmosTargetLowering(const PatmosTargetMachine &tm,
 
   setOperationAction(ISD::DYNAMIC_STACKALLOC, MVT::i32, Expand);
 
+  // globals in the small data area are addressed relative to its base
+  if (Subtarget.hasSmallData())
+    setOperationAction(ISD::GlobalAddress, MVT::i32, Custom);
+
   // handling of variadic parameters
   setOperationAction(ISD::VASTART     , MVT::Other, Custom);
   setOperationAction(ISD::VAARG       , MVT::Other, Expand);
@@ -174,6 +348,40 @@ PatmosTargetLowering::PatmosTargetLowering(const PatmosTargetMachine &tm,
   setOperationAction(ISD::STACKRESTORE, MVT::Other, Expand);
 
   setOperationAction(ISD::PCMARKER,  MVT::Other, Expand);
+
+  // Read the cycle counter of the timer device
+  setOperationAction(ISD::READCYCLECOUNTER, MVT::i64, Custom);
+
+  // Negation, absolute value and copysign of soft-float values are bit
+  // operations already, comparisons are expanded before they are softened.
+  if (!Subtarget.hasFPU() && InlineFloatCompare)
+    setTargetDAGCombine(ISD::SETCC);
+
+  // Logic on zero-extended conditions is done on the predicates.
+  setTargetDAGCombine(ISD::AND);
+  setTargetDAGCombine(ISD::OR);
+  setTargetDAGCombine(ISD::XOR);
+
+  // Small vectors are not legal, but are kept in a word before the types are
+  // legalized, see combineSWAR.
+  if (EnableSWAR) {
+    setTargetDAGCombine(ISD::LOAD);
+    setTargetDAGCombine(ISD::STORE);
+    setTargetDAGCombine(ISD::ADD);
+    setTargetDAGCombine(ISD::SUB);
+    setTargetDAGCombine(ISD::SHL);
+    setTargetDAGCombine(ISD::SRL);
+    setTargetDAGCombine(ISD::BUILD_VECTOR);
+    setTargetDAGCombine(ISD::SCALAR_TO_VECTOR);
+    setTargetDAGCombine(ISD::EXTRACT_VECTOR_ELT);
+    setTargetDAGCombine(ISD::INSERT_VECTOR_ELT);
+    setTargetDAGCombine(ISD::VECTOR_SHUFFLE);
+    setTargetDAGCombine(ISD::VSELECT);
+  }
+
+  // Program the DMA channels of the network-on-chip
+  setOperationAction(ISD::INTRINSIC_VOID, MVT::Other, Custom);
+  setOperationAction(ISD::INTRINSIC_W_CHAIN, MVT::Other, Custom);
   // TODO expand floating point stuff?
 
 }
@@ -186,19 +394,596 @@ SDValue PatmosTargetLowering::LowerOperation(SDValue Op,
     case ISD::STORE:              return LowerSTORE(Op,DAG);
     case ISD::SMUL_LOHI:
     case ISD::UMUL_LOHI:          return LowerMUL_LOHI(Op, DAG);
+    case ISD::SDIV:
+    case ISD::UDIV:
+    case ISD::SREM:
+    case ISD::UREM:
+    case ISD::SDIVREM:
+    case ISD::UDIVREM:            return LowerDIVREM(Op, DAG);
+    case ISD::UADDO:
+    case ISD::USUBO:              return LowerUADDSUBO(Op, DAG);
+    case ISD::ADDCARRY:
+    case ISD::SUBCARRY:           return LowerADDSUBCARRY(Op, DAG);
+    case ISD::SHL_PARTS:
+    case ISD::SRA_PARTS:
+    case ISD::SRL_PARTS:          return LowerShiftParts(Op, DAG);
+    case ISD::CTPOP:              return LowerCTPOP(Op, DAG);
+    case ISD::CTLZ:
+    case ISD::CTLZ_ZERO_UNDEF:    return LowerCTLZ(Op, DAG);
+    case ISD::GlobalAddress:      return LowerGlobalAddress(Op, DAG);
     case ISD::VASTART:            return LowerVASTART(Op, DAG);
     case ISD::FRAMEADDR:          return LowerFRAMEADDR(Op, DAG);
     case ISD::RETURNADDR:         return LowerRETURNADDR(Op, DAG);
+    case ISD::INTRINSIC_VOID:
+    case ISD::INTRINSIC_W_CHAIN:  return LowerNoCIntrinsic(Op, DAG);
     default:
       llvm_unreachable("unimplemented operation");
   }
 }
 
+void PatmosTargetLowering::ReplaceNodeResults(SDNode *N,
+                                              SmallVectorImpl<SDValue> &Results,
+                                              SelectionDAG &DAG) const {
+  switch (N->getOpcode()) {
+    case ISD::READCYCLECOUNTER: {
+      SDValue V = LowerREADCYCLECOUNTER(SDValue(N, 0), DAG);
+      Results.push_back(V.getValue(0));
+      Results.push_back(V.getValue(1));
+      return;
+    }
+    default:
+      llvm_unreachable("unimplemented result type expansion");
+  }
+}
+
+SDValue PatmosTargetLowering::PerformDAGCombine(SDNode *N,
+                                                DAGCombinerInfo &DCI) const {
+  switch (N->getOpcode()) {
+    case ISD::SETCC:
+      // Expand while the operands are still floating point values.
+      if (DCI.isBeforeLegalize())
+        return expandFloatSETCC(N, DCI.DAG);
+      break;
+    case ISD::AND:
+    case ISD::OR:
+    case ISD::XOR:
+      if (SDValue Res = combinePredicateLogic(N, DCI.DAG))
+        return Res;
+      LLVM_FALLTHROUGH;
+    default:
+      // Combine while the vectors are still of the original types.
+      if (DCI.isBeforeLegalize())
+        return combineSWAR(N, DCI);
+      break;
+  }
+  return SDValue();
+}
+
+SDValue PatmosTargetLowering::combinePredicateLogic(SDNode *N,
+                                                    SelectionDAG &DAG) const {
+  if (N->getValueType(0) != MVT::i32)
+    return SDValue();
+
+  auto getCondition = [](SDValue V) {
+    if (V.getOpcode() == ISD::ZERO_EXTEND &&
+        V.getOperand(0).getValueType() == MVT::i1)
+      return V.getOperand(0);
+    return SDValue();
+  };
+
+  SDLoc dl(N);
+  SDValue LHS = getCondition(N->getOperand(0));
+  if (!LHS)
+    return SDValue();
+
+  // (xor (zext p), 1) negates the condition
+  SDValue RHS;
+  ConstantSDNode *C = dyn_cast<ConstantSDNode>(N->getOperand(1));
+  if (C && C->isOne() && N->getOpcode() == ISD::XOR)
+    RHS = DAG.getConstant(1, dl, MVT::i1);
+  else
+    RHS = getCondition(N->getOperand(1));
+  if (!RHS)
+    return SDValue();
+
+  SDValue Cond = DAG.getNode(N->getOpcode(), dl, MVT::i1, LHS, RHS);
+  return DAG.getNode(ISD::ZERO_EXTEND, dl, MVT::i32, Cond);
+}
+
+bool PatmosTargetLowering::isSWARType(EVT VT) const {
+  return EnableSWAR && (VT == MVT::v4i8 || VT == MVT::v2i16);
+}
+
+/// getSWARSplat - Return a word with the given bits in every lane.
+static uint32_t getSWARSplat(uint32_t Bits, unsigned LaneBits) {
+  uint32_t Word = 0;
+  for (unsigned i = 0; i < 32; i += LaneBits)
+    Word |= Bits << i;
+  return Word;
+}
+
+/// getSWARLaneShift - Return the position of a lane in the word. Patmos is
+/// big-endian, lane 0 is thus in the most significant bits.
+static unsigned getSWARLaneShift(EVT VT, unsigned Lane) {
+  return (VT.getVectorNumElements() - 1 - Lane) * VT.getScalarSizeInBits();
+}
+
+/// isSWARUser - Check whether combineSWAR handles a user of a vector.
+static bool isSWARUser(const SDNode *User) {
+  switch (User->getOpcode()) {
+  case ISD::ADD: case ISD::SUB:
+  case ISD::AND: case ISD::OR: case ISD::XOR:
+  case ISD::SHL: case ISD::SRL:
+  case ISD::STORE: case ISD::BITCAST:
+  case ISD::EXTRACT_VECTOR_ELT: case ISD::INSERT_VECTOR_ELT:
+  case ISD::VECTOR_SHUFFLE: case ISD::VSELECT:
+    return true;
+  case ISD::SETCC: {
+    ISD::CondCode CC = cast<CondCodeSDNode>(User->getOperand(2))->get();
+    return CC == ISD::SETEQ || CC == ISD::SETNE;
+  }
+  default:
+    return false;
+  }
+}
+
+/// hasOnlySWARUsers - Check whether all users of the vector result of N are
+/// handled by combineSWAR. Otherwise, the word would have to be converted
+/// back to a vector, which is done via the stack.
+static bool hasOnlySWARUsers(const SDNode *N) {
+  for (SDNode::use_iterator UI = N->use_begin(), UE = N->use_end(); UI != UE;
+       ++UI) {
+    if (UI.getUse().getResNo() == 0 && !isSWARUser(*UI))
+      return false;
+  }
+  return true;
+}
+
+bool PatmosTargetLowering::isSWARWord(SDValue V) const {
+  // Loads and vectors built from scalars become words once they are combined
+  // themselves. Until then, their users are not combined, as the combiner
+  // would move the word operations on them back to vectors.
+  switch (V.getOpcode()) {
+  case ISD::UNDEF:
+    return true;
+  case ISD::BITCAST: {
+    SDValue Src = V.getOperand(0);
+    return Src.getValueType() == MVT::i32 ||
+           (isSWARType(Src.getValueType()) && isSWARWord(Src));
+  }
+  default:
+    return false;
+  }
+}
+
+/// getSWARWord - Return the word of a vector accepted by isSWARWord.
+static SDValue getSWARWord(SDValue V, SelectionDAG &DAG) {
+  while (V.getOpcode() == ISD::BITCAST)
+    V = V.getOperand(0);
+  if (V.isUndef())
+    return DAG.getUNDEF(MVT::i32);
+  assert(V.getValueType() == MVT::i32 && "Vector is not a word");
+  return V;
+}
+
+/// getSWARLaneMask - Return a word with all bits of the lanes set in which A
+/// and B differ.
+static SDValue getSWARLaneMask(SDValue A, SDValue B, unsigned LaneBits,
+                               const SDLoc &dl, SelectionDAG &DAG) {
+  uint32_t High = getSWARSplat(1u << (LaneBits - 1), LaneBits);
+  SDValue X = DAG.getNode(ISD::XOR, dl, MVT::i32, A, B);
+
+  // the high bit of a lane is set if any bit of the lane of X is set, adding
+  // the low bits of the lanes does not carry into the next lane
+  SDValue Low = DAG.getConstant(~High, dl, MVT::i32);
+  SDValue T = DAG.getNode(ISD::ADD, dl, MVT::i32,
+                          DAG.getNode(ISD::AND, dl, MVT::i32, X, Low), Low);
+  T = DAG.getNode(ISD::AND, dl, MVT::i32,
+                  DAG.getNode(ISD::OR, dl, MVT::i32, T, X),
+                  DAG.getConstant(High, dl, MVT::i32));
+
+  // spread the high bits over their lanes: (h - (h >> (n-1))) | h
+  SDValue Ones = DAG.getNode(ISD::SRL, dl, MVT::i32, T,
+                             DAG.getConstant(LaneBits - 1, dl, MVT::i32));
+  return DAG.getNode(ISD::OR, dl, MVT::i32,
+                     DAG.getNode(ISD::SUB, dl, MVT::i32, T, Ones), T);
+}
+
+SDValue PatmosTargetLowering::combineSWAR(SDNode *N,
+                                          DAGCombinerInfo &DCI) const {
+  SelectionDAG &DAG = DCI.DAG;
+  SDLoc dl(N);
+
+  // Stores of words and extracted elements do not produce vectors.
+  if (N->getOpcode() == ISD::STORE) {
+    StoreSDNode *ST = cast<StoreSDNode>(N);
+    SDValue Val = ST->getValue();
+    if (!isSWARType(Val.getValueType()) || ST->isTruncatingStore() ||
+        !ST->isUnindexed() || !ST->isSimple() ||
+        Val.getOpcode() != ISD::BITCAST || !isSWARWord(Val))
+      return SDValue();
+    return DAG.getStore(ST->getChain(), dl, getSWARWord(Val, DAG),
+                        ST->getBasePtr(), ST->getMemOperand());
+  }
+  if (N->getOpcode() == ISD::EXTRACT_VECTOR_ELT) {
+    SDValue Vec = N->getOperand(0);
+    ConstantSDNode *Idx = dyn_cast<ConstantSDNode>(N->getOperand(1));
+    EVT VecVT = Vec.getValueType();
+    if (!isSWARType(VecVT) || !Idx ||
+        Idx->getZExtValue() >= VecVT.getVectorNumElements() ||
+        !isSWARWord(Vec))
+      return SDValue();
+    SDValue Lane = DAG.getNode(ISD::SRL, dl, MVT::i32,
+        getSWARWord(Vec, DAG),
+        DAG.getConstant(getSWARLaneShift(VecVT, Idx->getZExtValue()), dl,
+                        MVT::i32));
+    return DAG.getAnyExtOrTrunc(Lane, dl, N->getValueType(0));
+  }
+
+  EVT VT = N->getValueType(0);
+  if (!isSWARType(VT) || !hasOnlySWARUsers(N))
+    return SDValue();
+
+  unsigned NumLanes = VT.getVectorNumElements();
+  unsigned LaneBits = VT.getScalarSizeInBits();
+  uint32_t LaneMask = (1u << LaneBits) - 1;
+  uint32_t High = getSWARSplat(1u << (LaneBits - 1), LaneBits);
+
+  auto Word = [&](SDValue V) { return getSWARWord(V, DAG); };
+  auto Const = [&](uint32_t C) { return DAG.getConstant(C, dl, MVT::i32); };
+
+  SDValue Res;
+  switch (N->getOpcode()) {
+  case ISD::LOAD: {
+    LoadSDNode *LD = cast<LoadSDNode>(N);
+    if (!ISD::isNormalLoad(LD) || !LD->isSimple())
+      return SDValue();
+    SDValue Load = DAG.getLoad(MVT::i32, dl, LD->getChain(), LD->getBasePtr(),
+                               LD->getMemOperand());
+    return DCI.CombineTo(N, DAG.getBitcast(VT, Load), Load.getValue(1));
+  }
+
+  case ISD::BUILD_VECTOR:
+    Res = Const(0);
+    for (unsigned i = 0; i < NumLanes; i++) {
+      SDValue Elt = N->getOperand(i);
+      if (Elt.isUndef())
+        continue;
+      Elt = DAG.getNode(ISD::AND, dl, MVT::i32,
+                        DAG.getAnyExtOrTrunc(Elt, dl, MVT::i32),
+                        Const(LaneMask));
+      Res = DAG.getNode(ISD::OR, dl, MVT::i32, Res,
+                        DAG.getNode(ISD::SHL, dl, MVT::i32, Elt,
+                                    Const(getSWARLaneShift(VT, i))));
+    }
+    break;
+
+  case ISD::SCALAR_TO_VECTOR:
+    Res = DAG.getNode(ISD::SHL, dl, MVT::i32,
+                      DAG.getAnyExtOrTrunc(N->getOperand(0), dl, MVT::i32),
+                      Const(getSWARLaneShift(VT, 0)));
+    break;
+
+  case ISD::INSERT_VECTOR_ELT: {
+    ConstantSDNode *Idx = dyn_cast<ConstantSDNode>(N->getOperand(2));
+    if (!Idx || Idx->getZExtValue() >= NumLanes ||
+        !isSWARWord(N->getOperand(0)))
+      return SDValue();
+    unsigned Shift = getSWARLaneShift(VT, Idx->getZExtValue());
+    SDValue Elt = DAG.getNode(ISD::AND, dl, MVT::i32,
+                      DAG.getAnyExtOrTrunc(N->getOperand(1), dl, MVT::i32),
+                      Const(LaneMask));
+    Res = DAG.getNode(ISD::OR, dl, MVT::i32,
+              DAG.getNode(ISD::AND, dl, MVT::i32, Word(N->getOperand(0)),
+                          Const(~(LaneMask << Shift))),
+              DAG.getNode(ISD::SHL, dl, MVT::i32, Elt, Const(Shift)));
+    break;
+  }
+
+  case ISD::AND:
+  case ISD::OR:
+  case ISD::XOR:
+    if (!isSWARWord(N->getOperand(0)) || !isSWARWord(N->getOperand(1)))
+      return SDValue();
+    Res = DAG.getNode(N->getOpcode(), dl, MVT::i32, Word(N->getOperand(0)),
+                      Word(N->getOperand(1)));
+    break;
+
+  case ISD::ADD: {
+    if (!isSWARWord(N->getOperand(0)) || !isSWARWord(N->getOperand(1)))
+      return SDValue();
+    // add the low bits of the lanes without carrying into the next lane,
+    // then add the high bits without carry: ((a & ~H) + (b & ~H)) ^ ((a^b) & H)
+    SDValue A = Word(N->getOperand(0)), B = Word(N->getOperand(1));
+    SDValue Low = DAG.getNode(ISD::ADD, dl, MVT::i32,
+                              DAG.getNode(ISD::AND, dl, MVT::i32, A,
+                                          Const(~High)),
+                              DAG.getNode(ISD::AND, dl, MVT::i32, B,
+                                          Const(~High)));
+    Res = DAG.getNode(ISD::XOR, dl, MVT::i32, Low,
+                      DAG.getNode(ISD::AND, dl, MVT::i32,
+                                  DAG.getNode(ISD::XOR, dl, MVT::i32, A, B),
+                                  Const(High)));
+    break;
+  }
+
+  case ISD::SUB: {
+    if (!isSWARWord(N->getOperand(0)) || !isSWARWord(N->getOperand(1)))
+      return SDValue();
+    // setting the high bits of a keeps borrows within the lanes:
+    // ((a | H) - (b & ~H)) ^ ((a ^ ~b) & H)
+    SDValue A = Word(N->getOperand(0)), B = Word(N->getOperand(1));
+    SDValue Low = DAG.getNode(ISD::SUB, dl, MVT::i32,
+                              DAG.getNode(ISD::OR, dl, MVT::i32, A,
+                                          Const(High)),
+                              DAG.getNode(ISD::AND, dl, MVT::i32, B,
+                                          Const(~High)));
+    Res = DAG.getNode(ISD::XOR, dl, MVT::i32, Low,
+                      DAG.getNode(ISD::AND, dl, MVT::i32,
+                                  DAG.getNode(ISD::XOR, dl, MVT::i32, A,
+                                              DAG.getNOT(dl, B, MVT::i32)),
+                                  Const(High)));
+    break;
+  }
+
+  case ISD::SHL:
+  case ISD::SRL: {
+    // only shifts of all lanes by the same amount stay within the lanes
+    ConstantSDNode *Amt = isConstOrConstSplat(N->getOperand(1));
+    if (!Amt || Amt->getZExtValue() >= LaneBits ||
+        !isSWARWord(N->getOperand(0)))
+      return SDValue();
+    unsigned Shift = Amt->getZExtValue();
+    uint32_t Kept = N->getOpcode() == ISD::SHL ? (LaneMask << Shift) & LaneMask
+                                               : LaneMask >> Shift;
+    Res = DAG.getNode(ISD::AND, dl, MVT::i32,
+                      DAG.getNode(N->getOpcode(), dl, MVT::i32,
+                                  Word(N->getOperand(0)), Const(Shift)),
+                      Const(getSWARSplat(Kept, LaneBits)));
+    break;
+  }
+
+  case ISD::VECTOR_SHUFFLE: {
+    ShuffleVectorSDNode *SVN = cast<ShuffleVectorSDNode>(N);
+    if (!isSWARWord(N->getOperand(0)) || !isSWARWord(N->getOperand(1)))
+      return SDValue();
+
+    // Group the lanes moved by the same distance from the same operand, each
+    // group costs a shift, an and, and an or.
+    struct LaneGroup { unsigned Op; int Shift; uint32_t Mask; };
+    SmallVector<LaneGroup, 4> Groups;
+    for (unsigned i = 0; i < NumLanes; i++) {
+      int Elt = SVN->getMaskElt(i);
+      if (Elt < 0)
+        continue;
+      unsigned Op = Elt / NumLanes;
+      int Shift = (int)getSWARLaneShift(VT, i) -
+                  (int)getSWARLaneShift(VT, Elt % NumLanes);
+      uint32_t Mask = LaneMask << getSWARLaneShift(VT, i);
+      auto G = std::find_if(Groups.begin(), Groups.end(),
+                            [&](const LaneGroup &G) {
+                              return G.Op == Op && G.Shift == Shift;
+                            });
+      if (G == Groups.end())
+        Groups.push_back({Op, Shift, Mask});
+      else
+        G->Mask |= Mask;
+    }
+
+    Res = Const(0);
+    for (const LaneGroup &G : Groups) {
+      SDValue Src = Word(N->getOperand(G.Op));
+      if (G.Shift > 0)
+        Src = DAG.getNode(ISD::SHL, dl, MVT::i32, Src, Const(G.Shift));
+      else if (G.Shift < 0)
+        Src = DAG.getNode(ISD::SRL, dl, MVT::i32, Src, Const(-G.Shift));
+      Res = DAG.getNode(ISD::OR, dl, MVT::i32, Res,
+                        DAG.getNode(ISD::AND, dl, MVT::i32, Src,
+                                    Const(G.Mask)));
+    }
+    break;
+  }
+
+  case ISD::VSELECT: {
+    // select lanes by the mask of equal lanes: (a & m) | (b & ~m)
+    SDValue Cond = N->getOperand(0);
+    if (Cond.getOpcode() != ISD::SETCC ||
+        Cond.getOperand(0).getValueType() != VT ||
+        !isSWARWord(Cond.getOperand(0)) || !isSWARWord(Cond.getOperand(1)) ||
+        !isSWARWord(N->getOperand(1)) || !isSWARWord(N->getOperand(2)))
+      return SDValue();
+    ISD::CondCode CC = cast<CondCodeSDNode>(Cond.getOperand(2))->get();
+    if (CC != ISD::SETEQ && CC != ISD::SETNE)
+      return SDValue();
+
+    SDValue Mask = getSWARLaneMask(Word(Cond.getOperand(0)),
+                                   Word(Cond.getOperand(1)), LaneBits, dl,
+                                   DAG);
+    if (CC == ISD::SETEQ)
+      Mask = DAG.getNOT(dl, Mask, MVT::i32);
+    Res = DAG.getNode(ISD::OR, dl, MVT::i32,
+              DAG.getNode(ISD::AND, dl, MVT::i32, Word(N->getOperand(1)),
+                          Mask),
+              DAG.getNode(ISD::AND, dl, MVT::i32, Word(N->getOperand(2)),
+                          DAG.getNOT(dl, Mask, MVT::i32)));
+    break;
+  }
+
+  default:
+    return SDValue();
+  }
+
+  return DAG.getBitcast(VT, Res);
+}
+
+SDValue PatmosTargetLowering::expandFloatSETCC(SDNode *N,
+                                               SelectionDAG &DAG) const {
+  EVT OpVT = N->getOperand(0).getValueType();
+  if (OpVT != MVT::f32 && OpVT != MVT::f64)
+    return SDValue();
+
+  SDLoc dl(N);
+  EVT VT = N->getValueType(0);
+  unsigned Bits = OpVT.getSizeInBits();
+  EVT IntVT = EVT::getIntegerVT(*DAG.getContext(), Bits);
+  ISD::CondCode CC = cast<CondCodeSDNode>(N->getOperand(2))->get();
+
+  // The comparison of the finite values and infinities, with both zeros
+  // being equal.
+  ISD::CondCode IntCC = ISD::SETCC_INVALID;
+  switch (CC) {
+    case ISD::SETOEQ: case ISD::SETUEQ: case ISD::SETEQ:
+      IntCC = ISD::SETEQ; break;
+    case ISD::SETONE: case ISD::SETUNE: case ISD::SETNE:
+      IntCC = ISD::SETNE; break;
+    case ISD::SETOLT: case ISD::SETULT: case ISD::SETLT:
+      IntCC = ISD::SETLT; break;
+    case ISD::SETOLE: case ISD::SETULE: case ISD::SETLE:
+      IntCC = ISD::SETLE; break;
+    case ISD::SETOGT: case ISD::SETUGT: case ISD::SETGT:
+      IntCC = ISD::SETGT; break;
+    case ISD::SETOGE: case ISD::SETUGE: case ISD::SETGE:
+      IntCC = ISD::SETGE; break;
+    case ISD::SETO:   case ISD::SETUO:
+      break;
+    default:
+      return SDValue();
+  }
+
+  APInt SignMask = APInt::getSignMask(Bits);
+  SDValue MagnitudeMask = DAG.getConstant(~SignMask, dl, IntVT);
+  SDValue Infinity =
+      DAG.getConstant(APFloat::getInf(OpVT == MVT::f32 ? APFloat::IEEEsingle()
+                                                       : APFloat::IEEEdouble())
+                          .bitcastToAPInt(),
+                      dl, IntVT);
+
+  // Map the sign-magnitude values to integers with the same order, i.e.,
+  // negate the magnitude of negative values: (M ^ S) - S.
+  SDValue Keys[2];
+  SDValue Ordered;
+  for (unsigned i = 0; i < 2; i++) {
+    SDValue X = DAG.getNode(ISD::BITCAST, dl, IntVT, N->getOperand(i));
+    SDValue M = DAG.getNode(ISD::AND, dl, IntVT, X, MagnitudeMask);
+    SDValue S = DAG.getNode(ISD::SRA, dl, IntVT, X,
+                            DAG.getShiftAmountConstant(Bits - 1, IntVT, dl,
+                                                       false));
+    Keys[i] = DAG.getNode(ISD::SUB, dl, IntVT,
+                          DAG.getNode(ISD::XOR, dl, IntVT, M, S), S);
+
+    // A NaN has a magnitude above infinity.
+    SDValue NotNaN = DAG.getSetCC(dl, VT, M, Infinity, ISD::SETULE);
+    Ordered = i ? DAG.getNode(ISD::AND, dl, VT, Ordered, NotNaN) : NotNaN;
+  }
+
+  if (CC == ISD::SETO)
+    return Ordered;
+  if (CC == ISD::SETUO)
+    return DAG.getNOT(dl, Ordered, VT);
+
+  SDValue Cmp = DAG.getSetCC(dl, VT, Keys[0], Keys[1], IntCC);
+
+  // If NaNs do not matter, the comparison of the keys is just as good.
+  switch (ISD::getUnorderedFlavor(CC)) {
+    case 0:  return DAG.getNode(ISD::AND, dl, VT, Cmp, Ordered);
+    case 1:  return DAG.getNode(ISD::OR, dl, VT, Cmp,
+                                DAG.getNOT(dl, Ordered, VT));
+    default: return Cmp;
+  }
+}
+
+SDValue PatmosTargetLowering::LowerREADCYCLECOUNTER(SDValue Op,
+                                                    SelectionDAG &DAG) const {
+  SDLoc dl(Op);
+  SDValue Chain = Op.getOperand(0);
+
+  // Access the I/O device through the local address space, the local loads
+  // bypass the caches and have a fixed latency.
+  MachinePointerInfo PtrInfo(1);
+  auto Flags = MachineMemOperand::MOVolatile;
+
+  // Reading the low word latches the high word, so the order matters.
+  SDValue Lo = DAG.getLoad(MVT::i32, dl, Chain,
+                           DAG.getConstant(CycleCounterAddress + 4, dl,
+                                           MVT::i32),
+                           PtrInfo, Align(4), Flags);
+  SDValue Hi = DAG.getLoad(MVT::i32, dl, Lo.getValue(1),
+                           DAG.getConstant(CycleCounterAddress, dl, MVT::i32),
+                           PtrInfo, Align(4), Flags);
+
+  SDValue Vals[] = { DAG.getNode(ISD::BUILD_PAIR, dl, MVT::i64, Lo, Hi),
+                     Hi.getValue(1) };
+  return DAG.getMergeValues(Vals, dl);
+}
+
+SDValue PatmosTargetLowering::LowerNoCIntrinsic(SDValue Op,
+                                                SelectionDAG &DAG) const {
+  unsigned IntNo = cast<ConstantSDNode>(Op.getOperand(1))->getZExtValue();
+  if (IntNo != Intrinsic::patmos_noc_send &&
+      IntNo != Intrinsic::patmos_noc_poll)
+    return SDValue();
+
+  SDLoc dl(Op);
+  SDValue Chain = Op.getOperand(0);
+
+  // The DMA table is accessed through the local address space, so each
+  // access is a single local load or store with a fixed latency.
+  MachinePointerInfo PtrInfo(1);
+  auto Flags = MachineMemOperand::MOVolatile;
+
+  SDValue Entry = DAG.getNode(ISD::ADD, dl, MVT::i32,
+                              DAG.getConstant(NoCDMAAddress, dl, MVT::i32),
+                              DAG.getNode(ISD::SHL, dl, MVT::i32,
+                                          Op.getOperand(2),
+                                          DAG.getConstant(3, dl, MVT::i32)));
+
+  if (IntNo == Intrinsic::patmos_noc_poll) {
+    SDValue Status = DAG.getLoad(MVT::i32, dl, Chain, Entry, PtrInfo,
+                                 Align(4), Flags);
+    SDValue Done = DAG.getNode(ISD::AND, dl, MVT::i32,
+                               DAG.getNode(ISD::SRL, dl, MVT::i32, Status,
+                                           DAG.getConstant(NoCDoneShift, dl,
+                                                           MVT::i32)),
+                               DAG.getConstant(1, dl, MVT::i32));
+    SDValue Vals[] = { Done, Status.getValue(1) };
+    return DAG.getMergeValues(Vals, dl);
+  }
+
+  // The DMA reads the data from the scratchpad itself, the pointers are
+  // double word offsets into the scratchpads.
+  auto Offset = [&](SDValue Ptr) {
+    return DAG.getNode(ISD::AND, dl, MVT::i32,
+                       DAG.getNode(ISD::SRL, dl, MVT::i32, Ptr,
+                                   DAG.getConstant(3, dl, MVT::i32)),
+                       DAG.getConstant(0xFFFF, dl, MVT::i32));
+  };
+  SDValue Ptrs = DAG.getNode(ISD::OR, dl, MVT::i32,
+                             DAG.getNode(ISD::SHL, dl, MVT::i32,
+                                         Offset(Op.getOperand(4)),
+                                         DAG.getConstant(16, dl, MVT::i32)),
+                             Offset(Op.getOperand(3)));
+  SDValue Control = DAG.getNode(ISD::OR, dl, MVT::i32,
+                                DAG.getNode(ISD::SHL, dl, MVT::i32,
+                                            Op.getOperand(5),
+                                            DAG.getConstant(16, dl, MVT::i32)),
+                                DAG.getConstant(NoCValidBit, dl, MVT::i32));
+
+  // Writing the control word starts the transfer, so it is written last.
+  Chain = DAG.getStore(Chain, dl, Ptrs,
+                       DAG.getNode(ISD::ADD, dl, MVT::i32, Entry,
+                                   DAG.getConstant(4, dl, MVT::i32)),
+                       PtrInfo, Align(4), Flags);
+  return DAG.getStore(Chain, dl, Control, Entry, PtrInfo, Align(4), Flags);
+}
+
 EVT PatmosTargetLowering::getSetCCResultType(const DataLayout &DL,
                                              LLVMContext &Context,
                                              EVT VT) const
 {
-  // All our compare results should be i1
+  // All our compare results should be i1, vector compares are only combined
+  // into masks before the types are legalized
+  if (VT.isVector())
+    return VT.changeVectorElementTypeToInteger();
   return MVT::i1;
 }
 
@@ -211,6 +996,86 @@ const MCExpr * PatmosTargetLowering::LowerCustomJumpTableEntry(
   return MCSymbolRefExpr::create(MBB->getSymbol(), OutContext);
 }
 
+bool PatmosTargetLowering::isLegalAddressingMode(const DataLayout &DL,
+                                                 const AddrMode &AM, Type *Ty,
+                                                 unsigned AddrSpace,
+                                                 Instruction *I) const
+{
+  if (AM.BaseGV) {
+    // only small globals, without offsets folded into their address
+    const GlobalObject *GO = AM.BaseGV->getBaseObject();
+    const TargetMachine &TM = getTargetMachine();
+    return !AM.HasBaseReg && !AM.Scale && !AM.BaseOffs && GO &&
+           static_cast<const PatmosTargetObjectFile*>(
+                   TM.getObjFileLowering())->isGlobalInSmallSection(GO, TM);
+  }
+
+  // a single register, scaling is only legal in place of the base register
+  if (AM.Scale < 0 || AM.Scale > 1 || (AM.Scale == 1 && AM.HasBaseReg))
+    return false;
+
+  // Words are the largest accesses, wider values are accessed word by word,
+  // which all need to be reachable by the offset. Accesses of unknown size
+  // have byte offsets.
+  uint64_t Bytes = Ty && Ty->isSized() ? DL.getTypeStoreSize(Ty) : 1;
+  uint64_t Size = Bytes >= 4 ? 4 : (Bytes >= 2 ? 2 : 1);
+  int64_t Last = AM.BaseOffs + (int64_t)alignTo(Bytes, Size) - (int64_t)Size;
+  return AM.BaseOffs >= 0 && AM.BaseOffs % Size == 0 &&
+         isUInt<7>(Last / Size);
+}
+
+MachineMemOperand::Flags
+PatmosTargetLowering::getTargetMMOFlags(const Instruction &I) const {
+  if (I.getMetadata("patmos.lock"))
+    return MOPatmosLockAcquire;
+  return MachineMemOperand::MONone;
+}
+
+bool PatmosTargetLowering::isSuitableForJumpTable(const SwitchInst *SI,
+                                                  uint64_t NumCases,
+                                                  uint64_t Range,
+                                                  ProfileSummaryInfo *PSI,
+                                                  BlockFrequencyInfo *BFI) const
+{
+  if (!TargetLowering::isSuitableForJumpTable(SI, NumCases, Range, PSI, BFI))
+    return false;
+
+  if (!Subtarget.hasMethodCache())
+    return true;
+
+  // Estimate the size of the targets with one instruction word per IR
+  // instruction. Comparisons keep the targets free to be split into separate
+  // regions.
+  SmallPtrSet<const BasicBlock *, 16> Targets;
+  uint64_t Size = 0;
+  for (const BasicBlock *Succ : successors(SI->getParent()))
+    if (Targets.insert(Succ).second)
+      Size += 4 * Succ->sizeWithoutDebug();
+
+  return Size <= JumpTableMaxTargetSize;
+}
+
+Align PatmosTargetLowering::getPrefLoopAlignment(MachineLoop *ML) const {
+  if (!AlignLoops || !ML || !ML->getSubLoops().empty())
+    return TargetLowering::getPrefLoopAlignment(ML);
+
+  const PatmosInstrInfo *PII = Subtarget.getInstrInfo();
+  uint64_t Size = 0;
+  for (const MachineBasicBlock *MBB : ML->blocks())
+    Size += PII->getBlockSize(*MBB);
+
+  // A loop not fitting into the method cache is evicted on each iteration
+  // anyway, padding it only costs code size.
+  if (Size == 0 ||
+      (Subtarget.hasMethodCache() && Size > Subtarget.getMethodCacheSize()))
+    return TargetLowering::getPrefLoopAlignment(ML);
+
+  // The padding is counted by the function splitter, which runs later and
+  // sees the alignment of the loop header.
+  uint64_t BlockSize = Subtarget.getMethodCacheBlockSize();
+  return Align(std::min<uint64_t>(PowerOf2Ceil(Size), BlockSize));
+}
+
 //===----------------------------------------------------------------------===//
 //                      Custom Lower Operation
 //===----------------------------------------------------------------------===//
@@ -274,6 +1139,271 @@ SDValue PatmosTargetLowering::LowerMUL_LOHI(SDValue Op,
   return DAG.getMergeValues(Vals, dl);
 }
 
+SDValue PatmosTargetLowering::LowerUADDSUBO(SDValue Op,
+                                            SelectionDAG &DAG) const {
+  SDLoc dl(Op);
+  EVT Ty = Op.getValueType();
+  SDValue LHS = Op.getOperand(0);
+  SDValue RHS = Op.getOperand(1);
+  bool IsAdd = Op.getOpcode() == ISD::UADDO;
+
+  // The carry of an add is set if the sum wraps below an operand, the borrow
+  // of a sub if the subtrahend is larger. Both are a single compare next to
+  // the add or sub.
+  SDValue Res = DAG.getNode(IsAdd ? ISD::ADD : ISD::SUB, dl, Ty, LHS, RHS);
+  SDValue Carry = IsAdd ? DAG.getSetCC(dl, MVT::i1, Res, LHS, ISD::SETULT)
+                        : DAG.getSetCC(dl, MVT::i1, LHS, RHS, ISD::SETULT);
+
+  SDValue Vals[] = { Res, Carry };
+  return DAG.getMergeValues(Vals, dl);
+}
+
+SDValue PatmosTargetLowering::LowerADDSUBCARRY(SDValue Op,
+                                               SelectionDAG &DAG) const {
+  SDLoc dl(Op);
+  EVT Ty = Op.getValueType();
+  SDValue LHS = Op.getOperand(0);
+  SDValue RHS = Op.getOperand(1);
+  SDValue CarryIn = Op.getOperand(2);
+  bool IsAdd = Op.getOpcode() == ISD::ADDCARRY;
+  unsigned Opc = IsAdd ? ISD::ADD : ISD::SUB;
+
+  // The incoming carry guards an add or sub of 1, which is selected to a
+  // predicated instruction:
+  //       add  rd = rs1, rs2
+  //  (pc) add  rd = rd, 1
+  SDValue Res = DAG.getNode(Opc, dl, Ty, LHS, RHS);
+  Res = DAG.getSelect(dl, Ty, CarryIn,
+                      DAG.getNode(Opc, dl, Ty, Res, DAG.getConstant(1, dl, Ty)),
+                      Res);
+
+  // With a carry in, the result may also be equal to the first operand, or
+  // the subtrahend equal to the minuend. Not needed for the upper half of
+  // an i64, where this is dead.
+  SDValue Carry;
+  if (IsAdd)
+    Carry = DAG.getSelect(dl, MVT::i1, CarryIn,
+                          DAG.getSetCC(dl, MVT::i1, Res, LHS, ISD::SETULE),
+                          DAG.getSetCC(dl, MVT::i1, Res, LHS, ISD::SETULT));
+  else
+    Carry = DAG.getSelect(dl, MVT::i1, CarryIn,
+                          DAG.getSetCC(dl, MVT::i1, LHS, RHS, ISD::SETULE),
+                          DAG.getSetCC(dl, MVT::i1, LHS, RHS, ISD::SETULT));
+
+  SDValue Vals[] = { Res, Carry };
+  return DAG.getMergeValues(Vals, dl);
+}
+
+SDValue PatmosTargetLowering::LowerShiftParts(SDValue Op,
+                                              SelectionDAG &DAG) const {
+  SDLoc dl(Op);
+  EVT Ty = Op.getValueType();
+  SDValue Lo = Op.getOperand(0);
+  SDValue Hi = Op.getOperand(1);
+  SDValue Amt = Op.getOperand(2);
+  EVT ShTy = Amt.getValueType();
+  unsigned Opc = Op.getOpcode();
+
+  assert(Ty == MVT::i32 && "Unexpected type for shift parts");
+
+  // Both the shift within the halves (Amt < 32) and the shift across them
+  // (Amt >= 32) are computed, the predicate Amt < 32 selects one of them.
+  // The shifts of the second case end up as predicated shifts:
+  //   Amt < 32:  shl: Lo = Lo << Amt
+  //                   Hi = (Hi << Amt) | ((Lo >> 1) >> (31 - Amt))
+  //              shr: Lo = (Lo >> Amt) | ((Hi << 1) << (31 - Amt))
+  //                   Hi = Hi >> Amt
+  //   Amt >= 32: shl: Lo = 0, Hi = Lo << (Amt - 32)
+  //              shr: Lo = Hi >> (Amt - 32), Hi = 0 or Hi >>s 31
+  SDValue One = DAG.getConstant(1, dl, ShTy);
+  SDValue AmtMinus32 = DAG.getNode(ISD::SUB, dl, ShTy, Amt,
+                                   DAG.getConstant(32, dl, ShTy));
+  SDValue ThirtyOneMinusAmt = DAG.getNode(ISD::SUB, dl, ShTy,
+                                          DAG.getConstant(31, dl, ShTy), Amt);
+  SDValue IsShort = DAG.getSetCC(dl, MVT::i1, Amt,
+                                 DAG.getConstant(32, dl, ShTy), ISD::SETULT);
+
+  SDValue LoShort, HiShort, LoLong, HiLong;
+  if (Opc == ISD::SHL_PARTS) {
+    SDValue Carried = DAG.getNode(ISD::SRL, dl, Ty,
+                                  DAG.getNode(ISD::SRL, dl, Ty, Lo, One),
+                                  ThirtyOneMinusAmt);
+    LoShort = DAG.getNode(ISD::SHL, dl, Ty, Lo, Amt);
+    HiShort = DAG.getNode(ISD::OR, dl, Ty,
+                          DAG.getNode(ISD::SHL, dl, Ty, Hi, Amt), Carried);
+    LoLong = DAG.getConstant(0, dl, Ty);
+    HiLong = DAG.getNode(ISD::SHL, dl, Ty, Lo, AmtMinus32);
+  } else {
+    unsigned ShrOpc = Opc == ISD::SRA_PARTS ? ISD::SRA : ISD::SRL;
+    SDValue Carried = DAG.getNode(ISD::SHL, dl, Ty,
+                                  DAG.getNode(ISD::SHL, dl, Ty, Hi, One),
+                                  ThirtyOneMinusAmt);
+    LoShort = DAG.getNode(ISD::OR, dl, Ty,
+                          DAG.getNode(ISD::SRL, dl, Ty, Lo, Amt), Carried);
+    HiShort = DAG.getNode(ShrOpc, dl, Ty, Hi, Amt);
+    LoLong = DAG.getNode(ShrOpc, dl, Ty, Hi, AmtMinus32);
+    HiLong = Opc == ISD::SRA_PARTS
+                 ? DAG.getNode(ISD::SRA, dl, Ty, Hi,
+                               DAG.getConstant(31, dl, ShTy))
+                 : DAG.getConstant(0, dl, Ty);
+  }
+
+  SDValue Vals[] = { DAG.getSelect(dl, Ty, IsShort, LoShort, LoLong),
+                     DAG.getSelect(dl, Ty, IsShort, HiShort, HiLong) };
+  return DAG.getMergeValues(Vals, dl);
+}
+
+SDValue PatmosTargetLowering::LowerCTPOP(SDValue Op,
+                                         SelectionDAG &DAG) const {
+  SDLoc dl(Op);
+  EVT Ty = Op.getValueType();
+  EVT ShTy = getShiftAmountTy(Ty, DAG.getDataLayout());
+  SDValue V = Op.getOperand(0);
+
+  assert(Ty == MVT::i32 && "Unexpected type for CTPOP");
+
+  auto Shift = [&](SDValue X, unsigned Amt) {
+    return DAG.getNode(ISD::SRL, dl, Ty, X, DAG.getConstant(Amt, dl, ShTy));
+  };
+  auto Mask = [&](SDValue X, uint32_t M) {
+    return DAG.getNode(ISD::AND, dl, Ty, X, DAG.getConstant(M, dl, Ty));
+  };
+
+  // Count bits in pairs, nibbles and bytes, then add up the bytes with shifts
+  // instead of a multiplication.
+  V = DAG.getNode(ISD::SUB, dl, Ty, V, Mask(Shift(V, 1), 0x55555555));
+  V = DAG.getNode(ISD::ADD, dl, Ty, Mask(V, 0x33333333),
+                                    Mask(Shift(V, 2), 0x33333333));
+  V = Mask(DAG.getNode(ISD::ADD, dl, Ty, V, Shift(V, 4)), 0x0F0F0F0F);
+  V = DAG.getNode(ISD::ADD, dl, Ty, V, Shift(V, 8));
+  V = DAG.getNode(ISD::ADD, dl, Ty, V, Shift(V, 16));
+  return Mask(V, 0x3F);
+}
+
+SDValue PatmosTargetLowering::LowerCTLZ(SDValue Op,
+                                        SelectionDAG &DAG) const {
+  SDLoc dl(Op);
+  EVT Ty = Op.getValueType();
+  EVT ShTy = getShiftAmountTy(Ty, DAG.getDataLayout());
+  unsigned Bits = Ty.getSizeInBits();
+  SDValue X = Op.getOperand(0);
+
+  assert(Ty == MVT::i32 && "Unexpected type for CTLZ");
+
+  // Binary search for the highest set bit: if the upper S bits are zero,
+  // shift them out and count them. The compare is shared by the two selects,
+  // which can be issued together.
+  SDValue N = DAG.getConstant(0, dl, Ty);
+  for (unsigned S = Bits / 2; S > 0; S /= 2) {
+    SDValue Zeros = DAG.getSetCC(dl, MVT::i1, X,
+                                 DAG.getConstant(1u << (Bits - S), dl, Ty),
+                                 ISD::SETULT);
+    X = DAG.getSelect(dl, Ty, Zeros,
+                      DAG.getNode(ISD::SHL, dl, Ty, X,
+                                  DAG.getConstant(S, dl, ShTy)), X);
+    N = DAG.getSelect(dl, Ty, Zeros,
+                      DAG.getNode(ISD::ADD, dl, Ty, N,
+                                  DAG.getConstant(S, dl, Ty)), N);
+  }
+
+  // The search yields Bits - 1 for zero.
+  if (Op.getOpcode() == ISD::CTLZ) {
+    SDValue IsZero = DAG.getSetCC(dl, MVT::i1, X, DAG.getConstant(0, dl, Ty),
+                                  ISD::SETEQ);
+    N = DAG.getSelect(dl, Ty, IsZero, DAG.getConstant(Bits, dl, Ty), N);
+  }
+  return N;
+}
+
+std::pair<SDValue, SDValue>
+PatmosTargetLowering::expandUDivRem(SDValue N, SDValue D, const SDLoc &dl,
+                                    SelectionDAG &DAG) const {
+  EVT Ty = N.getValueType();
+  EVT ShTy = getShiftAmountTy(Ty, DAG.getDataLayout());
+  unsigned Bits = Ty.getSizeInBits();
+
+  SDValue Zero = DAG.getConstant(0, dl, Ty);
+  SDValue One  = DAG.getConstant(1, dl, Ty);
+  SDValue Q = Zero;
+  SDValue R = Zero;
+
+  // One step per bit, without branches, so that the latency does not depend
+  // on the operands.
+  for (int i = Bits - 1; i >= 0; i--) {
+    // Shift the next bit of the dividend into the remainder.
+    SDValue Bit = DAG.getNode(ISD::AND, dl, Ty,
+                     DAG.getNode(ISD::SRL, dl, Ty, N,
+                                 DAG.getConstant(i, dl, ShTy)), One);
+    R = DAG.getNode(ISD::OR, dl, Ty,
+                    DAG.getNode(ISD::SHL, dl, Ty, R,
+                                DAG.getConstant(1, dl, ShTy)), Bit);
+
+    // Subtract the divisor if it fits and set the quotient bit.
+    SDValue Fits = DAG.getSetCC(dl, MVT::i1, R, D, ISD::SETUGE);
+    R = DAG.getSelect(dl, Ty, Fits, DAG.getNode(ISD::SUB, dl, Ty, R, D), R);
+    Q = DAG.getNode(ISD::OR, dl, Ty, Q,
+                    DAG.getSelect(dl, Ty, Fits,
+                                  DAG.getConstant(1u << i, dl, Ty), Zero));
+  }
+
+  return std::make_pair(Q, R);
+}
+
+SDValue PatmosTargetLowering::LowerDIVREM(SDValue Op,
+                                          SelectionDAG &DAG) const {
+  SDLoc dl(Op);
+  EVT Ty = Op.getValueType();
+  SDValue N = Op.getOperand(0);
+  SDValue D = Op.getOperand(1);
+
+  assert(Ty == MVT::i32 && "Unexpected type for DIV");
+
+  // Leave divisions by constants that were not turned into multiplications
+  // to the default expansion.
+  if (isa<ConstantSDNode>(D))
+    return SDValue();
+
+  unsigned Opc = Op.getOpcode();
+  bool IsSigned = Opc == ISD::SDIV || Opc == ISD::SREM || Opc == ISD::SDIVREM;
+
+  SDValue Q, R;
+  if (IsSigned) {
+    // Divide the absolute values, then fix the signs: the quotient is negative
+    // if the signs differ, the remainder has the sign of the dividend.
+    SDValue Shift = DAG.getConstant(Ty.getSizeInBits() - 1, dl,
+                                    getShiftAmountTy(Ty, DAG.getDataLayout()));
+    SDValue SignN = DAG.getNode(ISD::SRA, dl, Ty, N, Shift);
+    SDValue SignD = DAG.getNode(ISD::SRA, dl, Ty, D, Shift);
+    SDValue AbsN = DAG.getNode(ISD::SUB, dl, Ty,
+                               DAG.getNode(ISD::XOR, dl, Ty, N, SignN), SignN);
+    SDValue AbsD = DAG.getNode(ISD::SUB, dl, Ty,
+                               DAG.getNode(ISD::XOR, dl, Ty, D, SignD), SignD);
+
+    std::tie(Q, R) = expandUDivRem(AbsN, AbsD, dl, DAG);
+
+    SDValue SignQ = DAG.getNode(ISD::XOR, dl, Ty, SignN, SignD);
+    Q = DAG.getNode(ISD::SUB, dl, Ty,
+                    DAG.getNode(ISD::XOR, dl, Ty, Q, SignQ), SignQ);
+    R = DAG.getNode(ISD::SUB, dl, Ty,
+                    DAG.getNode(ISD::XOR, dl, Ty, R, SignN), SignN);
+  } else {
+    std::tie(Q, R) = expandUDivRem(N, D, dl, DAG);
+  }
+
+  switch (Opc) {
+    case ISD::SDIV:
+    case ISD::UDIV:
+      return Q;
+    case ISD::SREM:
+    case ISD::UREM:
+      return R;
+    default: {
+      SDValue Vals[] = { Q, R };
+      return DAG.getMergeValues(Vals, dl);
+    }
+  }
+}
+
 SDValue PatmosTargetLowering::LowerRETURNADDR(SDValue Op, SelectionDAG &DAG) const {
   auto MFI = DAG.getMachineFunction().getFrameInfo();
   MFI.setReturnAddressIsTaken(true);
@@ -356,8 +1486,6 @@ PatmosTargetLowering::LowerCall(CallLoweringInfo &CLI,
     }
   }
 
-  // Patmos target does not yet support tail call optimization.
-  CLI.IsTailCall = false;
   switch (CLI.CallConv) {
   default:
     llvm_unreachable("Unsupported calling convention");
@@ -367,6 +1495,57 @@ PatmosTargetLowering::LowerCall(CallLoweringInfo &CLI,
   }
 }
 
+bool PatmosTargetLowering::mayBeEmittedAsTailCall(const CallInst *CI) const {
+  return CI->isTailCall() && !DisableTailCalls;
+}
+
+/// getCalleeGlobal - Return the global called directly, or null for calls of
+/// external symbols and indirect calls.
+static const GlobalValue *getCalleeGlobal(SDValue Callee) {
+  if (const GlobalAddressSDNode *G = dyn_cast<GlobalAddressSDNode>(Callee))
+    return G->getGlobal();
+  return nullptr;
+}
+
+bool PatmosTargetLowering::isEligibleForTailCall(CallLoweringInfo &CLI,
+                                                 CCState &CCInfo) const {
+  MachineFunction &MF = CLI.DAG.getMachineFunction();
+  const Function &Caller = MF.getFunction();
+  const PatmosMachineFunctionInfo &PMFI =
+                                       *MF.getInfo<PatmosMachineFunctionInfo>();
+
+  if (DisableTailCalls || PatmosSinglePathInfo::isEnabled())
+    return false;
+
+  // Interrupt handlers return with xret, functions accessing the stack cache
+  // of their callers must keep it for the callee.
+  if (PMFI.isInterruptHandler() || PMFI.hasStackCacheParams() ||
+      Caller.hasFnAttribute(Attribute::Naked))
+    return false;
+
+  if (CLI.IsVarArg || CLI.CallConv != Caller.getCallingConv() ||
+      Caller.hasStructRetAttr())
+    return false;
+
+  // Only direct calls are branched to, with an absolute target.
+  if (!isa<GlobalAddressSDNode>(CLI.Callee) &&
+      !isa<ExternalSymbolSDNode>(CLI.Callee))
+    return false;
+  if (getTargetMachine().getCodeModel() == CodeModel::Large)
+    return false;
+  if (Subtarget.needsLongCall(Caller, getCalleeGlobal(CLI.Callee)))
+    return false;
+
+  // The arguments on the shadow stack would be in the freed frame.
+  if (CCInfo.getNextStackOffset() != 0)
+    return false;
+  for (const ISD::OutputArg &Out : CLI.Outs)
+    if (Out.Flags.isByVal() || Out.Flags.isSRet())
+      return false;
+
+  return true;
+}
+
 /// LowerCCCArguments - transform physical registers into virtual registers and
 /// generate load operations for arguments places on the stack.
 // FIXME: struct return stuff
@@ -493,7 +1672,11 @@ PatmosTargetLowering::LowerReturn(SDValue Chain,
     RetOps.push_back(DAG.getRegister(VA.getLocReg(), VA.getLocVT()));
   }
 
-  auto Opc = PatmosISD::RET_FLAG;
+  // interrupt handlers return through the exception return registers
+  const PatmosMachineFunctionInfo &PMFI =
+    *DAG.getMachineFunction().getInfo<PatmosMachineFunctionInfo>();
+  auto Opc = PMFI.isInterruptHandler() ? PatmosISD::XRET_FLAG
+                                       : PatmosISD::RET_FLAG;
 
   RetOps[0] = Chain;  // Update chain.
 
@@ -504,6 +1687,10 @@ PatmosTargetLowering::LowerReturn(SDValue Chain,
   return DAG.getNode(Opc, dl, MVT::Other, RetOps);
 }
 
+bool PatmosTargetLowering::isInlineByValCopy(uint64_t Size) {
+  return Size <= MaxInlineByValCopySize;
+}
+
 /// LowerCCCCallTo - functions arguments are copied from virtual regs to
 /// (physical regs)/(stack frame), CALLSEQ_START and CALLSEQ_END are emitted.
 /// TODO: sret.
@@ -530,7 +1717,41 @@ PatmosTargetLowering::LowerCCCCallTo(CallLoweringInfo &CLI,
   // Get a count of how many bytes are to be pushed on the stack.
   unsigned NumBytes = CCInfo.getNextStackOffset();
 
-  Chain = DAG.getCALLSEQ_START(Chain, NumBytes, 0, dl);
+  bool IsTailCall = CLI.IsTailCall && isEligibleForTailCall(CLI, CCInfo);
+  if (!IsTailCall && CLI.CB && CLI.CB->isMustTailCall())
+    report_fatal_error("failed to perform tail call elimination on a call "
+                       "site marked musttail");
+  CLI.IsTailCall = IsTailCall;
+
+  // Byval arguments are passed as a pointer to a copy on the frame of the
+  // caller, the callee may modify it. Calls with byval arguments are never
+  // tail calls (see isEligibleForTailCall).
+  MachineFunction &MF = DAG.getMachineFunction();
+  PatmosMachineFunctionInfo &PMFI = *MF.getInfo<PatmosMachineFunctionInfo>();
+  const Function *CalledFn = CLI.CB ? CLI.CB->getCalledFunction() : nullptr;
+  for (unsigned i = 0, e = Outs.size(); i != e; ++i) {
+    ISD::ArgFlagsTy Flags = Outs[i].Flags;
+    if (!Flags.isByVal())
+      continue;
+
+    unsigned Size = Flags.getByValSize();
+    Align Alignment = std::max(Flags.getNonZeroByValAlign(), Align(4));
+    int FI = MF.getFrameInfo().CreateStackObject(Size, Alignment, false);
+    SDValue FIPtr = DAG.getFrameIndex(FI, getPointerTy(DAG.getDataLayout()));
+    Chain = DAG.getMemcpy(Chain, dl, FIPtr, OutVals[i],
+                          DAG.getConstant(Size, dl, MVT::i32), Alignment,
+                          false, isInlineByValCopy(Size), false,
+                          MachinePointerInfo(), MachinePointerInfo());
+    OutVals[i] = FIPtr;
+
+    // the stack cache promotion may place the copy on the stack cache
+    PMFI.addByValArgumentFI(FI, CalledFn, Outs[i].OrigArgIndex);
+  }
+
+  if (IsTailCall)
+    MF.getFrameInfo().setHasTailCall();
+  else
+    Chain = DAG.getCALLSEQ_START(Chain, NumBytes, 0, dl);
 
   SmallVector<std::pair<unsigned, SDValue>, 4> RegsToPass;
   SmallVector<SDValue, 12> MemOpChains;
@@ -594,11 +1815,22 @@ PatmosTargetLowering::LowerCCCCallTo(CallLoweringInfo &CLI,
   // If the callee is a GlobalAddress node (quite common, every direct call is)
   // turn it into a TargetGlobalAddress node so that legalize doesn't hack it.
   // Likewise ExternalSymbol -> TargetExternalSymbol.
+  bool IsDirect = isa<GlobalAddressSDNode>(Callee) ||
+                  isa<ExternalSymbolSDNode>(Callee);
   if (GlobalAddressSDNode *G = dyn_cast<GlobalAddressSDNode>(Callee))
     Callee = DAG.getTargetGlobalAddress(G->getGlobal(), dl, MVT::i32);
   else if (ExternalSymbolSDNode *E = dyn_cast<ExternalSymbolSDNode>(Callee))
     Callee = DAG.getTargetExternalSymbol(E->getSymbol(), MVT::i32);
 
+  // Calls between the instruction scratchpad and the main memory that are out
+  // of reach load the address of the callee as a long immediate.
+  const Function &Caller = DAG.getMachineFunction().getFunction();
+  if (IsDirect && Subtarget.needsLongCall(Caller, getCalleeGlobal(CLI.Callee))) {
+    SDValue Ops[] = { DAG.getRegister(Patmos::NoRegister, MVT::i1),
+                      DAG.getTargetConstant(0, dl, MVT::i1), Callee };
+    Callee = SDValue(DAG.getMachineNode(Patmos::LIl, dl, MVT::i32, Ops), 0);
+  }
+
   // Returns a chain & a flag for retval copy to use.
   SDVTList NodeTys = DAG.getVTList(MVT::Other, MVT::Glue);
   SmallVector<SDValue, 8> Ops;
@@ -611,12 +1843,29 @@ PatmosTargetLowering::LowerCCCCallTo(CallLoweringInfo &CLI,
     Ops.push_back(DAG.getRegister(RegsToPass[i].first,
                                   RegsToPass[i].second.getValueType()));
 
+  // The registers the callee may clobber, refined by IPRA once the callee is
+  // compiled.
+  if (!IsTailCall) {
+    const TargetRegisterInfo *TRI = Subtarget.getRegisterInfo();
+    Ops.push_back(DAG.getRegisterMask(TRI->getCallPreservedMask(MF, CallConv)));
+  }
+
   if (InFlag.getNode())
     Ops.push_back(InFlag);
 
-  // attach machine-level aliasing information
-  int FI = DAG.getMachineFunction().getFrameInfo().CreateFixedObject(4, 0, true);
-  MachinePointerInfo MPO = MachinePointerInfo::getFixedStack(DAG.getMachineFunction(), FI);
+  // The callee returns to our caller, there is no result to copy.
+  if (IsTailCall)
+    return DAG.getNode(PatmosISD::TAILCALL, dl, MVT::Other, Ops);
+
+  // attach machine-level aliasing information, the called value gives the
+  // call graph the type and possibly the target of indirect calls
+  MachinePointerInfo MPO;
+  if (CLI.CB)
+    MPO = MachinePointerInfo(CLI.CB->getCalledOperand());
+  else {
+    int FI = DAG.getMachineFunction().getFrameInfo().CreateFixedObject(4, 0, true);
+    MPO = MachinePointerInfo::getFixedStack(DAG.getMachineFunction(), FI);
+  }
   MachineMemOperand *MMO = 
       DAG.getMachineFunction().getMachineMemOperand(MPO,
 	                                            MachineMemOperand::MOLoad,
@@ -727,6 +1976,29 @@ getRegForInlineAsmConstraint(const TargetRegisterInfo *TRI,
   return TargetLowering::getRegForInlineAsmConstraint(TRI, Constraint, VT);
 }
 
+SDValue
+PatmosTargetLowering::LowerGlobalAddress(SDValue Op, SelectionDAG &DAG) const {
+  const GlobalAddressSDNode *N = cast<GlobalAddressSDNode>(Op);
+  const TargetMachine &TM = getTargetMachine();
+  const PatmosTargetObjectFile &TLOF =
+                *static_cast<const PatmosTargetObjectFile*>(
+                                                   TM.getObjFileLowering());
+
+  // other globals are selected to an absolute address as they are
+  const GlobalObject *GO = N->getGlobal()->getBaseObject();
+  if (!GO || !TLOF.isGlobalInSmallSection(GO, TM))
+    return Op;
+
+  // Offsets are not folded into global addresses, the offset of the base
+  // register to the global needs no addend in its relocation.
+  assert(N->getOffset() == 0 && "unexpected offset of small data address");
+
+  SDLoc dl(Op);
+  SDValue GA = DAG.getTargetGlobalAddress(N->getGlobal(), dl, MVT::i32, 0,
+                                          PatmosII::MO_SDA);
+  return DAG.getNode(PatmosISD::SDA_ADDR, dl, MVT::i32, GA);
+}
+
 SDValue
 PatmosTargetLowering::LowerVASTART(SDValue Op, SelectionDAG &DAG) const {
   MachineFunction &MF = DAG.getMachineFunction();
@@ -750,7 +2022,10 @@ const char *PatmosTargetLowering::getTargetNodeName(unsigned Opcode) const {
   switch (Opcode) {
   default: return NULL;
   case PatmosISD::RET_FLAG:           return "PatmosISD::RET_FLAG";
+  case PatmosISD::XRET_FLAG:          return "PatmosISD::XRET_FLAG";
   case PatmosISD::CALL:               return "PatmosISD::CALL";
+  case PatmosISD::TAILCALL:           return "PatmosISD::TAILCALL";
+  case PatmosISD::SDA_ADDR:           return "PatmosISD::SDA_ADDR";
   case PatmosISD::MUL:                return "PatmosISD::MUL";
   case PatmosISD::MULU:               return "PatmosISD::MULU";
   case PatmosISD::LOOP_BOUND:         return "PatmosISD::LOOP_BOUND";
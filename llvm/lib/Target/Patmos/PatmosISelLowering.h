@@ -29,11 +29,22 @@ namespace llvm {
       /// Return with a flag operand. Operand 0 is the chain operand.
       RET_FLAG,
 
+      /// Return from an interrupt handler, with a flag operand.
+      XRET_FLAG,
+
       /// multiplication
       MUL, MULU,
 
       LOOP_BOUND,
 
+      /// Tail call, a branch with cache fill to the callee. Operand 0 is the
+      /// chain operand, operand 1 the callee.
+      TAILCALL,
+
+      /// Address of a global in the small data area, relative to the small
+      /// data base register. Operand 0 is the target global address.
+      SDA_ADDR,
+
       /// CALL - These operations represent an abstract call
       /// instruction, which includes a bunch of information.
       CALL = ISD::FIRST_TARGET_MEMORY_OPCODE
@@ -44,11 +55,22 @@ namespace llvm {
   class PatmosTargetMachine;
 
   class PatmosTargetObjectFile : public TargetLoweringObjectFileELF {
+    /// The sections of the small data area, .sdata and .sbss.
+    MCSection *SmallDataSection;
+    MCSection *SmallBSSSection;
+
   public:
-    void Initialize(MCContext &Ctx, const TargetMachine &TM) {
-      TargetLoweringObjectFileELF::Initialize(Ctx, TM);
-      InitializeELF(true); // set UseInitArray to true
-    }
+    void Initialize(MCContext &Ctx, const TargetMachine &TM) override;
+
+    /// isGlobalInSmallSection - Check whether a global is placed in the small
+    /// data area and addressed relative to the small data base register.
+    /// External declarations are decided by the size of their type, the
+    /// same way as their definitions.
+    bool isGlobalInSmallSection(const GlobalObject *GO,
+                                const TargetMachine &TM) const;
+
+    MCSection *SelectSectionForGlobal(const GlobalObject *GO, SectionKind Kind,
+                                      const TargetMachine &TM) const override;
   };
 
   class PatmosTargetLowering : public TargetLowering {
@@ -59,6 +81,14 @@ namespace llvm {
     /// LowerOperation - Provide custom lowering hooks for some operations.
     SDValue LowerOperation(SDValue Op, SelectionDAG &DAG) const override;
 
+    /// ReplaceNodeResults - Expand operations with illegal result types.
+    void ReplaceNodeResults(SDNode *N, SmallVectorImpl<SDValue> &Results,
+                            SelectionDAG &DAG) const override;
+
+    /// PerformDAGCombine - Expand floating point comparisons inline for the
+    /// soft-float configurations, and compute small vectors in words.
+    SDValue PerformDAGCombine(SDNode *N, DAGCombinerInfo &DCI) const override;
+
     /// getTargetNodeName - This method returns the name of a target specific
     /// DAG node.
     const char *getTargetNodeName(unsigned Opcode) const override;
@@ -66,6 +96,25 @@ namespace llvm {
     EVT getSetCCResultType(const DataLayout &DL, LLVMContext &Context,
                            EVT VT) const override;
 
+    /// isSWARType - Check whether operations on vectors of the type are
+    /// computed on words in a single register.
+    bool isSWARType(EVT VT) const;
+
+    /// isInlineByValCopy - Check whether the copy of a byval argument of the
+    /// given size is made with inline loads and stores at the call site.
+    static bool isInlineByValCopy(uint64_t Size);
+
+    /// isLoadBitCastBeneficial - Never turn loads of words back into loads of
+    /// the vectors computed in words.
+    bool isLoadBitCastBeneficial(EVT LoadVT, EVT BitcastVT,
+                                 const SelectionDAG &DAG,
+                                 const MachineMemOperand &MMO) const override {
+      if (isSWARType(BitcastVT))
+        return false;
+      return TargetLowering::isLoadBitCastBeneficial(LoadVT, BitcastVT, DAG,
+                                                     MMO);
+    }
+
     unsigned getByValTypeAlignment(Type *Ty,
                                    const DataLayout &DL) const override {
       // Align any type passed by value on the stack to words
@@ -83,6 +132,23 @@ namespace llvm {
       return false;
     }
 
+    /// isLegalAddressingMode - Loads and stores address [reg + offset] with an
+    /// unsigned 7-bit offset scaled by the access size, or small globals
+    /// relative to the small data base. There is no [reg + reg] addressing.
+    bool isLegalAddressingMode(const DataLayout &DL, const AddrMode &AM,
+                               Type *Ty, unsigned AddrSpace,
+                               Instruction *I = nullptr) const override;
+
+    /// isLegalAddImmediate - Additions and subtractions of unsigned 12-bit
+    /// immediates are ALUi instructions, others need a long immediate.
+    bool isLegalAddImmediate(int64_t Imm) const override {
+      return isUInt<12>(Imm) || isUInt<12>(-Imm);
+    }
+
+    /// getTargetMMOFlags - Mark the stores that acquire a hardware lock.
+    MachineMemOperand::Flags
+    getTargetMMOFlags(const Instruction &I) const override;
+
     /******************************************************************
      * Jump Tables
      ******************************************************************/
@@ -99,6 +165,18 @@ namespace llvm {
                               const MachineBasicBlock * MBB, unsigned uid,
                               MCContext &OutContext) const override;
 
+    /// isSuitableForJumpTable - In addition to the density of the cases,
+    /// reject jump tables whose targets are too large to be kept in one
+    /// method cache region together.
+    bool isSuitableForJumpTable(const SwitchInst *SI, uint64_t NumCases,
+                                uint64_t Range, ProfileSummaryInfo *PSI,
+                                BlockFrequencyInfo *BFI) const override;
+
+    /// getPrefLoopAlignment - Align small innermost loops to the next power
+    /// of two of their size, up to the block size of the method cache, such
+    /// that the loop body is fetched with as few bursts as possible.
+    Align getPrefLoopAlignment(MachineLoop *ML) const override;
+
     /******************************************************************
      * Inline asm support
      ******************************************************************/
@@ -115,6 +193,10 @@ namespace llvm {
     SDValue LowerCCCCallTo(CallLoweringInfo &CLI,
                            SmallVectorImpl<SDValue> &InVals) const;
 
+    /// isEligibleForTailCall - Check whether a call can be lowered to a
+    /// branch to the callee after the epilogue of the caller.
+    bool isEligibleForTailCall(CallLoweringInfo &CLI, CCState &CCInfo) const;
+
     SDValue LowerCCCArguments(SDValue Chain,
                               CallingConv::ID CallConv,
                               bool isVarArg,
@@ -132,6 +214,8 @@ namespace llvm {
     SDValue LowerCall(CallLoweringInfo &CLI,
                       SmallVectorImpl<SDValue> &InVals) const override;
 
+    bool mayBeEmittedAsTailCall(const CallInst *CI) const override;
+
     SDValue LowerFormalArguments(SDValue Chain, CallingConv::ID CallConv, bool isVarArg,
                                  const SmallVectorImpl<ISD::InputArg> &Ins,
                                  const SDLoc &dl, SelectionDAG &DAG,
@@ -143,6 +227,10 @@ namespace llvm {
                         const SmallVectorImpl<SDValue> &OutVals,
                         const SDLoc &dl, SelectionDAG &DAG) const override;
 
+    /// LowerGlobalAddress - Lower the addresses of globals in the small data
+    /// area relative to the small data base register.
+    SDValue LowerGlobalAddress(SDValue Op, SelectionDAG &DAG) const;
+
     /// LowerVASTART - Lower the va_start intrinsic to access parameters of
     /// variadic functions.
     SDValue LowerVASTART(SDValue Op, SelectionDAG &DAG) const;
@@ -156,6 +244,60 @@ namespace llvm {
     /// LowerMUL_LOHI - Lower Lo/Hi multiplications.
     SDValue LowerMUL_LOHI(SDValue Op, SelectionDAG &DAG) const;
 
+    /// LowerDIVREM - Lower divisions by a variable to an unrolled restoring
+    /// division with a fixed latency.
+    SDValue LowerDIVREM(SDValue Op, SelectionDAG &DAG) const;
+
+    /// LowerUADDSUBO - Lower add/sub with unsigned overflow to an add/sub
+    /// and a compare setting a predicate.
+    SDValue LowerUADDSUBO(SDValue Op, SelectionDAG &DAG) const;
+
+    /// LowerADDSUBCARRY - Lower add/sub with a carry in a predicate to an
+    /// add/sub and a predicated add/sub of 1.
+    SDValue LowerADDSUBCARRY(SDValue Op, SelectionDAG &DAG) const;
+
+    /// LowerShiftParts - Lower i64 shifts by a variable amount to shifts of
+    /// the halves, selected by a predicate.
+    SDValue LowerShiftParts(SDValue Op, SelectionDAG &DAG) const;
+
+    /// LowerCTPOP - Lower population count to a shift-and-add sequence
+    /// without multiplication.
+    SDValue LowerCTPOP(SDValue Op, SelectionDAG &DAG) const;
+
+    /// LowerCTLZ - Lower count leading zeros to a branchless binary search.
+    SDValue LowerCTLZ(SDValue Op, SelectionDAG &DAG) const;
+
+    /// LowerREADCYCLECOUNTER - Lower llvm.readcyclecounter to uncached loads
+    /// from the memory mapped timer device.
+    SDValue LowerREADCYCLECOUNTER(SDValue Op, SelectionDAG &DAG) const;
+
+    /// expandFloatSETCC - Expand a comparison of soft-float values to a
+    /// branchless sequence of integer operations on their bits.
+    SDValue expandFloatSETCC(SDNode *N, SelectionDAG &DAG) const;
+
+    /// combinePredicateLogic - Replace and/or/xor of zero-extended
+    /// conditions by the extension of the predicate logic on the conditions.
+    SDValue combinePredicateLogic(SDNode *N, SelectionDAG &DAG) const;
+
+    /// isSWARWord - Check whether a small vector is available as a word
+    /// without going through memory.
+    bool isSWARWord(SDValue V) const;
+
+    /// combineSWAR - Replace loads, stores and operations of <4 x i8> and
+    /// <2 x i16> vectors by operations on words with masked carries, before
+    /// the vectors are scalarized by the type legalization.
+    SDValue combineSWAR(SDNode *N, DAGCombinerInfo &DCI) const;
+
+    /// LowerNoCIntrinsic - Lower the llvm.patmos.noc intrinsics to local
+    /// loads and stores to the DMA table of the network-on-chip.
+    SDValue LowerNoCIntrinsic(SDValue Op, SelectionDAG &DAG) const;
+
+    /// Emit an unrolled unsigned restoring division, return the quotient and
+    /// the remainder.
+    std::pair<SDValue, SDValue> expandUDivRem(SDValue N, SDValue D,
+                                              const SDLoc &dl,
+                                              SelectionDAG &DAG) const;
+
     /// LowerSTORE - Promote i1 store operations to i8.
     SDValue LowerSTORE(SDValue Op, SelectionDAG &DAG) const;
 
@@ -0,0 +1,117 @@
+//===-- PatmosIndirectCallRegUsage.cpp - IPRA for indirect calls. ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Propagate the register usage collected by the interprocedural register
+// allocation to the indirect calls whose single target is known.
+//
+// RegUsageInfoPropagation only refines the register masks of calls naming
+// their callee. The call lowering attaches the called value to the memory
+// operand of every call, from which PatmosCallGraphBuilder resolves function
+// pointers loaded from constant tables or selected among a single function.
+// The register mask of such a call is replaced by the usage of the target,
+// if the target was already compiled, such that the caller only saves the
+// registers the target modifies around the call.
+//
+// The pass runs right after RegUsageInfoPropagation, before the register
+// allocation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosCallGraphBuilder.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/RegisterUsageInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-indirect-call-reg-usage"
+
+STATISTIC(NumRefinedCalls, "Indirect calls with a refined register mask");
+
+namespace {
+
+  class PatmosIndirectCallRegUsage : public MachineFunctionPass {
+  private:
+    static char ID;
+
+    /// getCallee - Return the single function the indirect call MI may
+    /// target, or NULL if the target is not known.
+    static const Function *getCallee(const MachineInstr &MI) {
+      // direct calls are handled by RegUsageInfoPropagation
+      for (const MachineOperand &MO : MI.operands())
+        if (MO.isGlobal() || MO.isSymbol())
+          return NULL;
+
+      if (!MI.hasOneMemOperand())
+        return NULL;
+
+      const Value *Callee = (*MI.memoperands_begin())->getValue();
+      return PatmosCallGraphBuilder::resolveIndirectCallee(Callee);
+    }
+
+  public:
+    PatmosIndirectCallRegUsage() : MachineFunctionPass(ID) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Indirect Call Register Usage Propagation";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<PhysicalRegisterUsageInfo>();
+      AU.setPreservesAll();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override {
+      if (!MF.getFrameInfo().hasCalls())
+        return false;
+
+      PhysicalRegisterUsageInfo &PRUI = getAnalysis<PhysicalRegisterUsageInfo>();
+
+      bool Changed = false;
+      for (MachineBasicBlock &MBB : MF) {
+        for (MachineInstr &MI : MBB) {
+          if (!MI.isCall())
+            continue;
+
+          const Function *F = getCallee(MI);
+          if (!F || !F->isDefinitionExact())
+            continue;
+
+          // the usage is only known once the target was compiled
+          ArrayRef<uint32_t> RegMask = PRUI.getRegUsageInfo(*F);
+          if (RegMask.empty())
+            continue;
+
+          for (MachineOperand &MO : MI.operands()) {
+            if (MO.isRegMask()) {
+              MO.setRegMask(RegMask.data());
+              Changed = true;
+            }
+          }
+
+          LLVM_DEBUG(dbgs() << "Indirect call to " << F->getName()
+                            << " with refined register mask: " << MI);
+          NumRefinedCalls++;
+        }
+      }
+      return Changed;
+    }
+  };
+
+  char PatmosIndirectCallRegUsage::ID = 0;
+} // end of anonymous namespace
+
+FunctionPass *llvm::createPatmosIndirectCallRegUsagePass() {
+  return new PatmosIndirectCallRegUsage();
+}
@@ -16,6 +16,8 @@
 #include "PatmosInstrInfo.h"
 #include "PatmosMachineFunctionInfo.h"
 #include "PatmosTargetMachine.h"
+#include "SinglePath/PatmosSinglePathInfo.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
 #include "llvm/CodeGen/DFAPacketizer.h"
@@ -35,7 +37,8 @@ using namespace llvm;
 #include "PatmosGenDFAPacketizer.inc"
 
 PatmosInstrInfo::PatmosInstrInfo(const PatmosTargetMachine &tm)
-  : PatmosGenInstrInfo(Patmos::ADJCALLSTACKDOWN, Patmos::ADJCALLSTACKUP),
+  : PatmosGenInstrInfo(Patmos::ADJCALLSTACKDOWN, Patmos::ADJCALLSTACKUP, ~0u,
+                       Patmos::RET),
     PTM(tm), RI(tm, *this), PST(*tm.getSubtargetImpl()) {}
 
 bool PatmosInstrInfo::findCommutedOpIndices(const MachineInstr &MI,
@@ -331,6 +334,31 @@ bool PatmosInstrInfo::fixOpcodeForGuard(MachineInstr &MI) const {
   return false;
 }
 
+int PatmosInstrInfo::getNonDelayedOpcode(unsigned Opcode) {
+  using namespace Patmos;
+
+  switch (Opcode) {
+    case BR:     return BRND;
+    case BRu:    return BRNDu;
+    case BRR:    return BRRND;
+    case BRRu:   return BRRNDu;
+    case BRT:    return BRTND;
+    case BRTu:   return BRTNDu;
+    case BRCF:   return BRCFND;
+    case BRCFu:  return BRCFNDu;
+    case BRCFR:  return BRCFRND;
+    case BRCFRu: return BRCFRNDu;
+    case BRCFT:  return BRCFTND;
+    case BRCFTu: return BRCFTNDu;
+    case CALL:   return CALLND;
+    case CALLR:  return CALLRND;
+    case TCBRCF: return TCBRCFND;
+    case RET:    return RETND;
+    case XRET:   return XRETND;
+    default:     return -1;
+  }
+}
+
 int PatmosInstrInfo::findPrevDelaySlotEnd(MachineBasicBlock &MBB,
                                           MachineBasicBlock::iterator &II,
                                           int Cycles) const
@@ -580,6 +608,19 @@ PatmosII::MemType PatmosInstrInfo::getMemType(const MachineInstr &MI) {
 
 }
 
+bool PatmosInstrInfo::isMainMemoryAccess(const MachineInstr &MI) {
+  unsigned Format = getPatmosFormat(MI.getDesc().TSFlags);
+  if (MI.isBundle() || (Format != PatmosII::FrmLDT &&
+                        Format != PatmosII::FrmSTT))
+    return false;
+
+  switch (getMemType(MI)) {
+  case PatmosII::MEM_M: return true;
+  case PatmosII::MEM_C: return MI.mayStore();
+  default:              return false;
+  }
+}
+
 bool PatmosInstrInfo::isPseudo(const MachineInstr *MI) const {
 
   if (MI->isBundle()) {
@@ -724,19 +765,68 @@ PatmosInstrInfo::createPatmosInstrAnalyzer(MCContext &Ctx,
   return PIA;
 }
 
-unsigned int PatmosInstrInfo::getInstrSize(const MachineInstr *MI) const {
-  if (MI->isInlineAsm()) {
-    PatmosAsmPrinter PAP((PatmosTargetMachine&)PTM,
-        createPatmosInstrAnalyzer(MI->getMF()->getContext(), *PTM.getInstrInfo()));
-    PAP.setMachineModuleInfo(&MI->getMF()->getMMI());
+bool PatmosInstrInfo::getInlineAsmSizeKey(const MachineInstr *MI,
+                                          std::string &Key) {
+  raw_string_ostream OS(Key);
+  for (const MachineOperand &MO : MI->operands()) {
+    switch (MO.getType()) {
+    case MachineOperand::MO_Register:
+      // the choice of register does not change the size of an instruction
+      OS << "r,";
+      break;
+    case MachineOperand::MO_Immediate:
+      OS << "i" << MO.getImm() << ",";
+      break;
+    case MachineOperand::MO_ExternalSymbol:
+      // this includes the asm string
+      OS << "s" << MO.getSymbolName() << '\0';
+      break;
+    case MachineOperand::MO_GlobalAddress:
+      OS << "g" << MO.getGlobal()->getName() << '\0' << MO.getOffset() << ",";
+      break;
+    case MachineOperand::MO_MachineBasicBlock:
+      OS << "b,";
+      break;
+    case MachineOperand::MO_Metadata:
+      // source location
+      break;
+    default:
+      return false;
+    }
+  }
+  OS.flush();
+  return true;
+}
+
+unsigned PatmosInstrInfo::computeInlineAsmSize(const MachineInstr *MI) const {
+  PatmosAsmPrinter PAP((PatmosTargetMachine&)PTM,
+      createPatmosInstrAnalyzer(MI->getMF()->getContext(), *PTM.getInstrInfo()));
+  PAP.setMachineModuleInfo(&MI->getMF()->getMMI());
 
-    // This call will parse the inline asm and emit each instruction through PatmosInstrAnalyzer.
-    // PatmosInstrAnalyzer doesn't actually emit the instructions, instead it just sums their sizes.
-    PAP.mockEmitInlineAsmForSizeCount(MI);
+  // This call will parse the inline asm and emit each instruction through PatmosInstrAnalyzer.
+  // PatmosInstrAnalyzer doesn't actually emit the instructions, instead it just sums their sizes.
+  PAP.mockEmitInlineAsmForSizeCount(MI);
 
-    // we then get back the PatmosInstrAnalyzer which now has summed
-    // the size of the instructions in the inline asm.
-    return ((PatmosInstrAnalyzer*)PAP.OutStreamer.get())->getSize();
+  // we then get back the PatmosInstrAnalyzer which now has summed
+  // the size of the instructions in the inline asm.
+  return ((PatmosInstrAnalyzer*)PAP.OutStreamer.get())->getSize();
+}
+
+unsigned int PatmosInstrInfo::getInstrSize(const MachineInstr *MI) const {
+  if (MI->isInlineAsm()) {
+    // The splitter and the cache analyses ask for the sizes of the same
+    // statements over and over, so parse each of them only once.
+    std::string Key;
+    if (!getInlineAsmSizeKey(MI, Key))
+      return computeInlineAsmSize(MI);
+
+    auto Entry = InlineAsmSizes.find(Key);
+    if (Entry != InlineAsmSizes.end())
+      return Entry->second;
+
+    unsigned Size = computeInlineAsmSize(MI);
+    InlineAsmSizes[Key] = Size;
+    return Size;
   }
   else if (MI->isBundle()) {
     // Bundles can only be made up of 2 4-byte instructions
@@ -751,6 +841,24 @@ unsigned int PatmosInstrInfo::getInstrSize(const MachineInstr *MI) const {
   }
 }
 
+unsigned int PatmosInstrInfo::getBlockSize(const MachineBasicBlock &MBB) const {
+  const PatmosMachineFunctionInfo *PMFI =
+                          MBB.getParent()->getInfo<PatmosMachineFunctionInfo>();
+  int Cached = PMFI->getCachedBlockSize(&MBB);
+  if (Cached >= 0)
+    return Cached;
+
+  unsigned int Size = 0;
+  for (MachineBasicBlock::const_instr_iterator I = MBB.instr_begin(),
+       E = MBB.instr_end(); I != E; ++I) {
+    // count the bundled instructions instead of the bundle
+    if (I->isBundle()) continue;
+    Size += getInstrSize(&*I);
+  }
+  PMFI->setCachedBlockSize(&MBB, Size);
+  return Size;
+}
+
 bool PatmosInstrInfo::hasCall(const MachineInstr *MI) const {
   if (MI->isInlineAsm()) {
     return MI->getDesc().isCall();
@@ -1141,6 +1249,350 @@ reverseBranchCondition(SmallVectorImpl<MachineOperand> &Cond) const {
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Software pipelining
+//
+
+/// getConstantValue - Get the value of a register that is set to a constant
+/// by a (copy of a) load-immediate. Return true on success.
+static bool getConstantValue(const MachineRegisterInfo &MRI,
+                             const PatmosInstrInfo &TII, Register Reg,
+                             int64_t &Value) {
+  if (Reg == Patmos::R0) {
+    Value = 0;
+    return true;
+  }
+  if (!Reg.isVirtual())
+    return false;
+
+  const MachineInstr *Def = MRI.getUniqueVRegDef(Reg);
+  if (!Def || TII.isPredicated(*Def))
+    return false;
+
+  switch (Def->getOpcode()) {
+  case TargetOpcode::COPY:
+    return getConstantValue(MRI, TII, Def->getOperand(1).getReg(), Value);
+  case Patmos::LIi:
+  case Patmos::LIl:
+    Value = Def->getOperand(3).getImm();
+    return true;
+  case Patmos::LIin:
+    Value = -Def->getOperand(3).getImm();
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// getIncrement - Get the amount the instruction adds to the register in
+/// Src. Return true if MI is an unpredicated add/sub of an immediate to Src.
+static bool getIncrement(const PatmosInstrInfo &TII, const MachineInstr &MI,
+                         Register Src, int64_t &Step) {
+  if (TII.isPredicated(MI) || !MI.getOperand(3).isReg() ||
+      MI.getOperand(3).getReg() != Src)
+    return false;
+
+  switch (MI.getOpcode()) {
+  case Patmos::ADDi:
+  case Patmos::ADDl:
+    Step = MI.getOperand(4).getImm();
+    return true;
+  case Patmos::SUBi:
+  case Patmos::SUBl:
+    Step = -MI.getOperand(4).getImm();
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// getAffineValue - Express the value of a compare operand in the k-th
+/// iteration (counting from 0) of the loop as Base + k * Step. The operand
+/// has to be a constant, an induction variable with a constant initial value
+/// or the increment of such an induction variable.
+static bool getAffineValue(const MachineRegisterInfo &MRI,
+                           const PatmosInstrInfo &TII,
+                           const MachineBasicBlock *LoopBB,
+                           const MachineOperand &MO,
+                           int64_t &Base, int64_t &Step) {
+  Step = 0;
+  if (MO.isImm()) {
+    Base = MO.getImm();
+    return true;
+  }
+  if (!MO.isReg())
+    return false;
+  if (getConstantValue(MRI, TII, MO.getReg(), Base))
+    return true;
+  if (!MO.getReg().isVirtual())
+    return false;
+
+  const MachineInstr *Def = MRI.getUniqueVRegDef(MO.getReg());
+  if (!Def || Def->getParent() != LoopBB)
+    return false;
+
+  // the operand is the increment of an induction variable
+  bool IsIncrement = !Def->isPHI();
+  const MachineInstr *Phi = Def;
+  if (IsIncrement) {
+    if (!Def->getOperand(3).isReg() || !Def->getOperand(3).getReg().isVirtual())
+      return false;
+    Phi = MRI.getUniqueVRegDef(Def->getOperand(3).getReg());
+    if (!Phi || !Phi->isPHI() || Phi->getParent() != LoopBB)
+      return false;
+  }
+
+  // a PHI in a single-block loop has one incoming value from the preheader
+  // and one from the loop itself
+  if (Phi->getNumOperands() != 5)
+    return false;
+
+  Register Init, Next;
+  for (unsigned i = 1; i < 5; i += 2) {
+    if (Phi->getOperand(i + 1).getMBB() == LoopBB)
+      Next = Phi->getOperand(i).getReg();
+    else
+      Init = Phi->getOperand(i).getReg();
+  }
+  if (!Init || !Next || !Next.isVirtual())
+    return false;
+
+  const MachineInstr *NextDef = MRI.getUniqueVRegDef(Next);
+  if (!NextDef || NextDef->getParent() != LoopBB ||
+      (IsIncrement && NextDef != Def) ||
+      !getIncrement(TII, *NextDef, Phi->getOperand(0).getReg(), Step) ||
+      !getConstantValue(MRI, TII, Init, Base))
+    return false;
+
+  if (IsIncrement)
+    Base += Step;
+  return true;
+}
+
+/// evaluateCompare - Evaluate a compare instruction on 32-bit operands.
+static bool evaluateCompare(unsigned Opcode, uint32_t A, uint32_t B) {
+  switch (Opcode) {
+  case Patmos::CMPEQ:  case Patmos::CMPIEQ:  return A == B;
+  case Patmos::CMPNEQ: case Patmos::CMPINEQ: return A != B;
+  case Patmos::CMPLT:  case Patmos::CMPILT:  return (int32_t)A < (int32_t)B;
+  case Patmos::CMPLE:  case Patmos::CMPILE:  return (int32_t)A <= (int32_t)B;
+  case Patmos::CMPULT: case Patmos::CMPIULT: return A < B;
+  case Patmos::CMPULE: case Patmos::CMPIULE: return A <= B;
+  case Patmos::BTEST:  case Patmos::BTESTI:  return (A >> (B & 31)) & 1;
+  default:
+    llvm_unreachable("Unknown compare instruction.");
+  }
+}
+
+namespace {
+  /// PatmosPipelinerLoopInfo - Describes a single-block loop with a constant
+  /// trip count to the MachinePipeliner and rewrites the exit condition of
+  /// the kernel once the loop has been pipelined.
+  class PatmosPipelinerLoopInfo : public TargetInstrInfo::PipelinerLoopInfo {
+    const PatmosInstrInfo &TII;
+
+    /// The preheader and exit block of the loop before pipelining.
+    MachineBasicBlock *Preheader, *Exit;
+
+    /// The block preceding the kernel after pipelining.
+    MachineBasicBlock *NewPreheader;
+
+    /// The number of times the loop body is executed.
+    int64_t TripCount;
+
+    /// updateLoopBounds - Visit the prolog, kernel and epilog blocks between
+    /// the preheader and the exit of the loop. The loop bound of the original
+    /// loop is shifted by Adjust in the Kernel and removed everywhere else.
+    void updateLoopBounds(MachineBasicBlock *Kernel, int Adjust) {
+      if (Preheader->succ_size() != 1)
+        return;
+
+      SmallPtrSet<MachineBasicBlock*, 8> Visited;
+      MachineBasicBlock *MBB = *Preheader->succ_begin();
+      while (MBB && MBB != Exit && Visited.insert(MBB).second) {
+        for (MachineBasicBlock::iterator i(MBB->begin()), ie(MBB->end());
+             i != ie;) {
+          MachineInstr &MI = *i++;
+          if (MI.getOpcode() != Patmos::PSEUDO_LOOPBOUND)
+            continue;
+
+          if (MBB == Kernel) {
+            int64_t Min = MI.getOperand(0).getImm();
+            int64_t Max = Min + MI.getOperand(1).getImm();
+            Min = std::max<int64_t>(Min + Adjust, 0);
+            Max = std::max<int64_t>(Max + Adjust, Min);
+            MI.getOperand(0).setImm(Min);
+            MI.getOperand(1).setImm(Max - Min);
+          } else {
+            MI.eraseFromParent();
+          }
+        }
+
+        // the blocks form a chain, apart from the back edge of the kernel
+        MachineBasicBlock *Succ = nullptr;
+        for (MachineBasicBlock::succ_iterator s(MBB->succ_begin()),
+             se(MBB->succ_end()); s != se; s++) {
+          if (*s == MBB)
+            continue;
+          if (Succ && Succ != *s) {
+            Succ = nullptr;
+            break;
+          }
+          Succ = *s;
+        }
+        MBB = Succ;
+      }
+    }
+
+  public:
+    PatmosPipelinerLoopInfo(const PatmosInstrInfo &tii,
+                            MachineBasicBlock *preheader,
+                            MachineBasicBlock *exit, int64_t tripCount)
+      : TII(tii), Preheader(preheader), Exit(exit), NewPreheader(preheader),
+        TripCount(tripCount) {}
+
+    bool shouldIgnoreForPipelining(const MachineInstr *MI) const override {
+      return MI->isTerminator();
+    }
+
+    Optional<bool>
+    createTripCountGreaterCondition(int TC, MachineBasicBlock &MBB,
+                           SmallVectorImpl<MachineOperand> &Cond) override {
+      return TripCount > TC;
+    }
+
+    void setPreheader(MachineBasicBlock *MBB) override {
+      NewPreheader = MBB;
+    }
+
+    /// adjustTripCount - The compare of the kernel still tests the original
+    /// induction variable, which may be computed in any stage. Instead of
+    /// rewriting it, count the kernel iterations down in a fresh register.
+    void adjustTripCount(int TripCountAdjust) override {
+      assert(NewPreheader->succ_size() == 1 && "Prolog not a chain?");
+      MachineBasicBlock *Kernel = *NewPreheader->succ_begin();
+      assert(Kernel->isSuccessor(Kernel) && "Kernel is not a loop?");
+
+      int64_t Count = TripCount + TripCountAdjust;
+      assert(Count > 0 && "Kernel is never executed?");
+
+      MachineBasicBlock::iterator Br = Kernel->getFirstTerminator();
+      while (Br != Kernel->end() && !TII.isPredicated(*Br))
+        Br++;
+      assert(Br != Kernel->end() && Br->isBranch() &&
+             "Kernel without conditional branch?");
+      bool ContinueOnTrue = PatmosInstrInfo::getBranchTarget(&*Br) == Kernel;
+
+      MachineRegisterInfo &MRI = Kernel->getParent()->getRegInfo();
+      Register Init = MRI.createVirtualRegister(&Patmos::RRegsRegClass);
+      Register Cnt = MRI.createVirtualRegister(&Patmos::RRegsRegClass);
+      Register Next = MRI.createVirtualRegister(&Patmos::RRegsRegClass);
+      Register Pred = MRI.createVirtualRegister(&Patmos::PRegsRegClass);
+      DebugLoc DL = Br->getDebugLoc();
+
+      AddDefaultPred(BuildMI(*NewPreheader, NewPreheader->getFirstTerminator(),
+                             DL, TII.get(isUInt<12>(Count) ? Patmos::LIi
+                                                          : Patmos::LIl),
+                             Init))
+        .addImm(Count);
+      BuildMI(*Kernel, Kernel->begin(), DL, TII.get(TargetOpcode::PHI), Cnt)
+        .addReg(Init).addMBB(NewPreheader)
+        .addReg(Next).addMBB(Kernel);
+      AddDefaultPred(BuildMI(*Kernel, Kernel->getFirstTerminator(), DL,
+                             TII.get(Patmos::SUBi), Next))
+        .addReg(Cnt).addImm(1);
+      AddDefaultPred(BuildMI(*Kernel, Kernel->getFirstTerminator(), DL,
+                             TII.get(Patmos::CMPINEQ), Pred))
+        .addReg(Next).addImm(0);
+
+      int i = Br->findFirstPredOperandIdx();
+      Register OldPred = Br->getOperand(i).getReg();
+      Br->getOperand(i).setReg(Pred);
+      Br->getOperand(i + 1).setImm(ContinueOnTrue ? 0 : -1);
+
+      // the original compare is dead now, unless the loop uses its result
+      if (OldPred.isVirtual() && MRI.use_nodbg_empty(OldPred)) {
+        MachineInstr *OldCmp = MRI.getUniqueVRegDef(OldPred);
+        if (OldCmp && OldCmp->getParent() == Kernel)
+          OldCmp->eraseFromParent();
+      }
+
+      updateLoopBounds(Kernel, TripCountAdjust);
+    }
+
+    void disposed() override {
+      updateLoopBounds(nullptr, 0);
+    }
+  };
+}
+
+std::unique_ptr<TargetInstrInfo::PipelinerLoopInfo>
+PatmosInstrInfo::analyzeLoopForPipelining(MachineBasicBlock *LoopBB) const {
+  // Upper bound for the trip count computed by simulating the exit condition.
+  const int64_t MaxTripCount = 1 << 20;
+
+  if (LoopBB->pred_size() != 2 || LoopBB->succ_size() != 2)
+    return nullptr;
+
+  MachineBasicBlock *Preheader = *LoopBB->pred_begin();
+  if (Preheader == LoopBB)
+    Preheader = *std::next(LoopBB->pred_begin());
+  MachineBasicBlock *Exit = *LoopBB->succ_begin();
+  if (Exit == LoopBB)
+    Exit = *std::next(LoopBB->succ_begin());
+  if (Preheader == LoopBB || Exit == LoopBB)
+    return nullptr;
+
+  MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+  SmallVector<MachineOperand, 2> Cond;
+  if (analyzeBranch(*LoopBB, TBB, FBB, Cond) || Cond.size() != 2 ||
+      !Cond[0].isReg() || !Cond[0].getReg().isVirtual() || !Cond[1].isImm())
+    return nullptr;
+  if (TBB != LoopBB && FBB && FBB != LoopBB)
+    return nullptr;
+  bool ContinueOnTaken = TBB == LoopBB;
+  bool Negated = Cond[1].getImm() != 0;
+
+  // the exit condition is a compare in the loop
+  const MachineRegisterInfo &MRI = LoopBB->getParent()->getRegInfo();
+  const MachineInstr *Cmp = MRI.getUniqueVRegDef(Cond[0].getReg());
+  if (!Cmp || Cmp->getParent() != LoopBB || isPredicated(*Cmp))
+    return nullptr;
+
+  switch (Cmp->getOpcode()) {
+  case Patmos::CMPEQ:  case Patmos::CMPIEQ:
+  case Patmos::CMPNEQ: case Patmos::CMPINEQ:
+  case Patmos::CMPLT:  case Patmos::CMPILT:
+  case Patmos::CMPLE:  case Patmos::CMPILE:
+  case Patmos::CMPULT: case Patmos::CMPIULT:
+  case Patmos::CMPULE: case Patmos::CMPIULE:
+  case Patmos::BTEST:  case Patmos::BTESTI:
+    break;
+  default:
+    return nullptr;
+  }
+
+  int64_t BaseA, StepA, BaseB, StepB;
+  if (!getAffineValue(MRI, *this, LoopBB, Cmp->getOperand(3), BaseA, StepA) ||
+      !getAffineValue(MRI, *this, LoopBB, Cmp->getOperand(4), BaseB, StepB))
+    return nullptr;
+
+  // find the first iteration that leaves the loop
+  for (int64_t k = 0; k < MaxTripCount; k++) {
+    uint32_t A = (uint32_t)(BaseA + k * StepA);
+    uint32_t B = (uint32_t)(BaseB + k * StepB);
+    bool Taken = evaluateCompare(Cmp->getOpcode(), A, B) != Negated;
+    if (Taken != ContinueOnTaken) {
+      return std::make_unique<PatmosPipelinerLoopInfo>(*this, Preheader, Exit,
+                                                       k + 1);
+    }
+  }
+
+  return nullptr;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Predication and If-Conversion
@@ -1289,3 +1741,307 @@ bool PatmosInstrInfo::ClobbersPredicate(MachineInstr &MI,
   }
   return flag;
 }
+
+/// Returns true if the last instruction of the block is a return or a call,
+/// such blocks are never predicated.
+static bool endsInReturnOrCall(const MachineBasicBlock &MBB) {
+  const MCInstrDesc &MCID = std::prev(MBB.end())->getDesc();
+  return MCID.isReturn() || MCID.isCall();
+}
+
+/// Returns the single predecessor of the block, or null if there is none.
+static const MachineBasicBlock *getSinglePred(const MachineBasicBlock &MBB) {
+  return MBB.pred_size() == 1 ? *MBB.pred_begin() : nullptr;
+}
+
+/// Returns the probability of executing TMBB on the worst-case path known from
+/// a WCET analysis: one if TMBB is on the path, zero if OtherMBB is on the
+/// path instead, or the given probability otherwise. Predication thus only
+/// has to pay off on the worst-case path.
+static BranchProbability
+getWorstCaseProbability(const MachineBasicBlock &TMBB,
+                        const MachineBasicBlock *OtherMBB,
+                        BranchProbability Probability) {
+  const PatmosAnalysisInfo &PAI =
+      TMBB.getParent()->getInfo<PatmosMachineFunctionInfo>()->getAnalysisInfo();
+  if (PAI.isCritical(&TMBB))
+    return BranchProbability::getOne();
+  if (OtherMBB && PAI.isCritical(OtherMBB))
+    return BranchProbability::getZero();
+  return Probability;
+}
+
+unsigned PatmosInstrInfo::
+getIfCvtIssueCycles(ArrayRef<const MachineBasicBlock*> MBBs) const {
+  unsigned Width = PST.enableBundling() ? PST.getSchedModel().IssueWidth : 1;
+  unsigned Slots = 0, FirstSlotOnly = 0;
+
+  for (const MachineBasicBlock *MBB : MBBs) {
+    for (const MachineInstr &MI : *MBB) {
+      if (MI.isTerminator() || MI.isDebugInstr() || MI.isPseudo())
+        continue;
+
+      Slots += getIssueWidth(&MI);
+      // instructions restricted to the first slot serialize the bundles
+      if (Width > 1 && !canIssueInSlot(&MI, 1))
+        FirstSlotOnly++;
+    }
+  }
+  return std::max(FirstSlotOnly, (Slots + Width - 1) / Width);
+}
+
+unsigned PatmosInstrInfo::
+getIfCvtBranchCost(const MachineBasicBlock *MBB) const {
+  unsigned DelaySlots = PST.getCFLDelaySlotCycles(true);
+  unsigned Fillable = 0;
+
+  if (MBB) {
+    for (const MachineInstr &MI : *MBB) {
+      if (!MI.isTerminator() && !MI.isDebugInstr() && !MI.isPseudo())
+        Fillable++;
+    }
+  }
+  return 1 + DelaySlots - std::min(DelaySlots, Fillable);
+}
+
+bool PatmosInstrInfo::isProfitableToIfCvt(MachineBasicBlock &MBB,
+                                          unsigned NumCycles,
+                                          unsigned ExtraPredCycles,
+                                          BranchProbability Probability) const {
+  if (endsInReturnOrCall(MBB))
+    return false;
+  // keep the code size in check for the method cache
+  if (NumCycles > 8)
+    return false;
+
+  // We do not handle predicated instructions that may stall the pipeline
+  // properly in the cache analyses, so we do not convert them for now.
+  if (mayStall(MBB))
+    return false;
+
+  // the block executes with the given probability, the branch around it
+  // always costs its unfilled delay slots
+  unsigned Cycles = getIfCvtIssueCycles(&MBB);
+  unsigned BranchCycles = getIfCvtBranchCost(getSinglePred(MBB));
+  Probability = getWorstCaseProbability(MBB, getSinglePred(MBB), Probability);
+
+  unsigned Predicated = Cycles + ExtraPredCycles;
+  unsigned Branched = Probability.scale(Cycles) + BranchCycles;
+
+  return Predicated <= Branched;
+}
+
+bool PatmosInstrInfo::isProfitableToIfCvt(MachineBasicBlock &TMBB,
+                                          unsigned NumTCycles,
+                                          unsigned ExtraTCycles,
+                                          MachineBasicBlock &FMBB,
+                                          unsigned NumFCycles,
+                                          unsigned ExtraFCycles,
+                                          BranchProbability Probability) const {
+  if (endsInReturnOrCall(TMBB) || endsInReturnOrCall(FMBB))
+    return false;
+  // keep the code size in check for the method cache
+  if ((NumTCycles + NumFCycles) > 16)
+    return false;
+
+  // We do not handle predicated instructions that may stall the pipeline
+  // properly in the cache analyses, so we do not convert them for now.
+  if (mayStall(TMBB) || mayStall(FMBB))
+    return false;
+
+  unsigned TCycles = getIfCvtIssueCycles(&TMBB);
+  unsigned FCycles = getIfCvtIssueCycles(&FMBB);
+
+  // the conditional branch is always executed, the branch joining the paths
+  // is executed on the path that does not fall through
+  unsigned CondCycles = getIfCvtBranchCost(getSinglePred(TMBB));
+  bool TJumps = !TMBB.empty() && std::prev(TMBB.end())->isUnconditionalBranch();
+  unsigned TJoin = TJumps ? getIfCvtBranchCost(&TMBB) : 0;
+  unsigned FJoin = TJumps ? 0 : getIfCvtBranchCost(&FMBB);
+
+  Probability = getWorstCaseProbability(TMBB, &FMBB, Probability);
+
+  unsigned Predicated = getIfCvtIssueCycles({&TMBB, &FMBB}) +
+                        std::max(ExtraTCycles, ExtraFCycles);
+  unsigned Branched = CondCycles +
+                      Probability.scale(TCycles + TJoin) +
+                      Probability.getCompl().scale(FCycles + FJoin);
+
+  return Predicated <= Branched;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Machine Outliner
+//
+
+/// Constructions of outlined functions and their calls.
+enum MachineOutlinerConstruction {
+  MachineOutlinerDefault ///< Call with callnd, return with retnd.
+};
+
+bool PatmosInstrInfo::isFunctionSafeToOutlineFrom(MachineFunction &MF,
+                                        bool OutlineFromLinkOnceODRs) const {
+  const Function &F = MF.getFunction();
+
+  if (!OutlineFromLinkOnceODRs && F.hasLinkOnceODRLinkage())
+    return false;
+
+  if (F.hasFnAttribute(Attribute::Naked) ||
+      MF.getInfo<PatmosMachineFunctionInfo>()->isInterruptHandler())
+    return false;
+
+  // Single-path code has to keep its constant execution time and layout.
+  return !PatmosSinglePathInfo::isEnabled(MF);
+}
+
+/// isColdBlock - Check whether the block belongs to a cold function or calls
+/// a cold function, as assumed by the branch probabilities.
+static bool isColdBlock(const MachineBasicBlock &MBB) {
+  if (MBB.getParent()->getFunction().hasFnAttribute(Attribute::Cold))
+    return true;
+
+  for (const MachineInstr &MI : MBB) {
+    if (!MI.isCall())
+      continue;
+    for (const MachineOperand &MO : MI.operands()) {
+      if (!MO.isGlobal())
+        continue;
+      const Function *Callee = dyn_cast<Function>(MO.getGlobal());
+      if (Callee && Callee->hasFnAttribute(Attribute::Cold))
+        return true;
+    }
+  }
+
+  // Blocks created by the code generator have no IR block.
+  if (const BasicBlock *BB = MBB.getBasicBlock()) {
+    for (const Instruction &I : *BB) {
+      const CallBase *CB = dyn_cast<CallBase>(&I);
+      if (CB && CB->hasFnAttr(Attribute::Cold))
+        return true;
+    }
+  }
+  return false;
+}
+
+bool PatmosInstrInfo::isMBBSafeToOutlineFrom(MachineBasicBlock &MBB,
+                                             unsigned &Flags) const {
+  return isColdBlock(MBB);
+}
+
+outliner::OutlinedFunction PatmosInstrInfo::getOutliningCandidateInfo(
+    std::vector<outliner::Candidate> &RepeatedSequenceLocs) const {
+  const TargetRegisterInfo &TRI = getRegisterInfo();
+
+  // The call overwrites the return information. The caller thus has to have
+  // saved it in its entry block, and must not be about to return.
+  auto ClobbersReturnInfo = [&](outliner::Candidate &C) {
+    const MachineFrameInfo &MFI = C.getMF()->getFrameInfo();
+    if (!MFI.isCalleeSavedInfoValid() || MFI.getSavePoint() ||
+        MFI.getRestorePoint())
+      return true;
+
+    unsigned NumSaved = 0;
+    for (const CalleeSavedInfo &CSI : MFI.getCalleeSavedInfo())
+      if (CSI.getReg() == Patmos::SRB || CSI.getReg() == Patmos::SRO)
+        NumSaved++;
+    if (NumSaved != 2)
+      return true;
+
+    C.initLRU(TRI);
+    return !C.LRU.available(Patmos::SRB) || !C.LRU.available(Patmos::SRO);
+  };
+  erase_if(RepeatedSequenceLocs, ClobbersReturnInfo);
+
+  if (RepeatedSequenceLocs.size() < 2)
+    return outliner::OutlinedFunction();
+
+  outliner::Candidate &First = RepeatedSequenceLocs.front();
+  unsigned SequenceSize = 0;
+  for (auto I = First.front(), E = std::next(First.back()); I != E; ++I)
+    SequenceSize += getInstrSize(&*I);
+
+  for (outliner::Candidate &C : RepeatedSequenceLocs)
+    C.setCallInfo(MachineOutlinerDefault, get(Patmos::CALLND).getSize());
+
+  // The return, the size word in front of each function loaded by the
+  // method cache, and on average half of the alignment padding.
+  unsigned FrameOverhead = get(Patmos::RETND).getSize() + 4 +
+                           PST.getMinSubfunctionAlignment().value() / 2;
+
+  return outliner::OutlinedFunction(RepeatedSequenceLocs, SequenceSize,
+                                    FrameOverhead, MachineOutlinerDefault);
+}
+
+outliner::InstrType
+PatmosInstrInfo::getOutliningType(MachineBasicBlock::iterator &MIT,
+                                  unsigned Flags) const {
+  MachineInstr &MI = *MIT;
+
+  if (MI.isDebugInstr() || MI.isKill())
+    return outliner::InstrType::Invisible;
+
+  // Delay slots and bundles are only formed after outlining, there should be
+  // none yet. The outlined code is a leaf function without control flow.
+  if (MI.isBundled() || MI.isBundle() || MI.isPosition() ||
+      MI.isInlineAsm() || MI.isTerminator() || MI.isCall() ||
+      MI.hasDelaySlot())
+    return outliner::InstrType::Illegal;
+
+  // The prologue and epilogue set up the stack cache frame and save the
+  // return information.
+  if (MI.getFlag(MachineInstr::FrameSetup) ||
+      MI.getFlag(MachineInstr::FrameDestroy))
+    return outliner::InstrType::Illegal;
+
+  for (const MachineOperand &MO : MI.operands()) {
+    if (MO.isMBB() || MO.isJTI() || MO.isCPI() || MO.isFI() ||
+        MO.isBlockAddress() || MO.isTargetIndex() || MO.isCFIIndex())
+      return outliner::InstrType::Illegal;
+
+    if (!MO.isReg())
+      continue;
+
+    switch (MO.getReg()) {
+    // The stack cache control instructions and the return information
+    // belong to the frame of the function.
+    case Patmos::SS:
+    case Patmos::ST:
+    case Patmos::SRB:
+    case Patmos::SRO:
+    case Patmos::SXB:
+    case Patmos::SXO:
+      return outliner::InstrType::Illegal;
+    default:
+      break;
+    }
+  }
+
+  return outliner::InstrType::Legal;
+}
+
+void PatmosInstrInfo::buildOutlinedFrame(MachineBasicBlock &MBB,
+                                         MachineFunction &MF,
+                                const outliner::OutlinedFunction &OF) const {
+  // The outlined function is made of cold code only.
+  MF.getFunction().addFnAttr(Attribute::Cold);
+
+  AddDefaultPred(BuildMI(MBB, MBB.end(), DebugLoc(), get(Patmos::RETND)));
+}
+
+MachineBasicBlock::iterator PatmosInstrInfo::insertOutlinedCall(
+    Module &M, MachineBasicBlock &MBB, MachineBasicBlock::iterator &It,
+    MachineFunction &MF, const outliner::Candidate &C) const {
+  // The outliner adds the registers used and defined by the sequence, the
+  // call itself only overwrites the return information.
+  MachineFunction &Caller = *MBB.getParent();
+  MachineInstr *Call = Caller.CreateMachineInstr(get(Patmos::CALLND),
+                                                 DebugLoc(), true);
+  AddDefaultPred(MachineInstrBuilder(Caller, Call))
+    .addGlobalAddress(M.getNamedValue(MF.getName()))
+    .addReg(Patmos::SRB, RegState::ImplicitDefine)
+    .addReg(Patmos::SRO, RegState::ImplicitDefine);
+
+  It = MBB.insert(It, Call);
+  return It;
+}
@@ -15,6 +15,7 @@
 #define _LLVM_TARGET_PATMOS_INSTRINFO_H_
 
 #include "llvm/ADT/SmallSet.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/CodeGen/TargetInstrInfo.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/MC/MCContext.h"
@@ -117,10 +118,28 @@ public:
   }
 };
 
+/// Memory operand flag of the stores that acquire a lock of the hardware lock
+/// unit, see PatmosAtomicLowering.
+static const MachineMemOperand::Flags MOPatmosLockAcquire =
+    MachineMemOperand::MOTargetFlag1;
+
 class PatmosInstrInfo : public PatmosGenInstrInfo {
   const PatmosTargetMachine &PTM;
   const PatmosRegisterInfo RI;
   const PatmosSubtarget &PST;
+
+  /// Sizes of the inline asm statements seen by getInstrSize, keyed by
+  /// getInlineAsmSizeKey.
+  mutable StringMap<unsigned> InlineAsmSizes;
+
+  /// getInlineAsmSizeKey - Build the key of an inline asm statement in the
+  /// size cache from its asm string and all operands except registers.
+  /// \return false if the statement has operands the key cannot describe.
+  static bool getInlineAsmSizeKey(const MachineInstr *MI, std::string &Key);
+
+  /// computeInlineAsmSize - Parse an inline asm statement and sum the sizes
+  /// of its instructions.
+  unsigned computeInlineAsmSize(const MachineInstr *MI) const;
 public:
   explicit PatmosInstrInfo(const PatmosTargetMachine &TM);
 
@@ -190,6 +209,10 @@ public:
   /// Returns true iff the instruction was rewritten.
   bool fixOpcodeForGuard(MachineInstr &MI) const;
 
+  /// getNonDelayedOpcode - Return the opcode of the non-delayed variant of
+  /// the delayed control-flow instruction Opcode, or -1 if there is none.
+  static int getNonDelayedOpcode(unsigned Opcode);
+
   /// findPrevDelaySlotEnd - Find the end of the previous delay slot, if any.
   /// \param II - The instruction from where to start, will be set to the last
   ///             checked instruction, i.e. the branch if a delay slot is found.
@@ -246,6 +269,11 @@ public:
   /// MI must be either a load or a store instruction.
   static PatmosII::MemType getMemType(const MachineInstr &MI);
 
+  /// isMainMemoryAccess - Return true if MI is a typed load or store that
+  /// always accesses main memory, i.e., bypasses the caches or is a store,
+  /// which is written through the data cache.
+  static bool isMainMemoryAccess(const MachineInstr &MI);
+
   /// isPseudo - check if the given machine instruction is emitted, i.e.,
   /// if the instruction is either inline asm or has some FU assigned to it.
   bool isPseudo(const MachineInstr *MI) const;
@@ -293,9 +321,14 @@ public:
                                                  const MCInstrInfo &MII) const;
 
   /// getInstrSize - get the size of an instruction.
-  /// Correctly deals with inline assembler and bundles.
+  /// Correctly deals with inline assembler and bundles. The size of inline
+  /// assembler is only computed once for each asm string and operands.
   unsigned int getInstrSize(const MachineInstr *MI) const;
 
+  /// getBlockSize - get the size of a basic block in bytes. The size is
+  /// cached in the PatmosMachineFunctionInfo of the function.
+  unsigned int getBlockSize(const MachineBasicBlock &MBB) const;
+
   /// hasCall - check if there is a call in this instruction.
   /// Correctly deals with inline assembler and bundles.
   bool hasCall(const MachineInstr *MI) const;
@@ -368,6 +401,12 @@ public:
   bool reverseBranchCondition(SmallVectorImpl<MachineOperand> &Cond)
                               const override;
 
+  /// analyzeLoopForPipelining - Accept single-block loops whose exit
+  /// condition compares an induction variable against a constant, so that
+  /// the trip count is known at compile time, as in single-path code.
+  std::unique_ptr<PipelinerLoopInfo>
+  analyzeLoopForPipelining(MachineBasicBlock *LoopBB) const override;
+
   /////////////////////////////////////////////////////////////////////////////
   // Predication and IfConversion
   /////////////////////////////////////////////////////////////////////////////
@@ -413,20 +452,12 @@ public:
   /// of the specified basic block, where the probability of the instructions
   /// being executed is given by Probability, and Confidence is a measure
   /// of our confidence that it will be properly predicted.
+  /// The decision compares the expected cycles of the branch (including its
+  /// unfilled delay slots) and the block against the cycles needed to issue
+  /// the predicated block in the available slots.
   bool isProfitableToIfCvt(MachineBasicBlock &MBB, unsigned NumCycles,
                            unsigned ExtraPredCycles,
-                           BranchProbability Probability) const override {
-
-    const MCInstrDesc &MCID = std::prev(MBB.end())->getDesc();
-    if (MCID.isReturn() || MCID.isCall())
-      return false;
-    if (NumCycles > 8)
-      return false;
-
-    // We do not handle predicated instructions that may stall the pipeline
-    // properly in the cache analyses, so we do not convert them for now.
-    return !mayStall(MBB);
-  }
+                           BranchProbability Probability) const override;
 
   /// Second variant of isProfitableToIfCvt. This one
   /// checks for the case where two basic blocks from true and false path
@@ -434,24 +465,24 @@ public:
   /// predicates, where the probability of the true path being taken is given
   /// by Probability, and Confidence is a measure of our confidence that it
   /// will be properly predicted.
+  /// Converting a diamond removes both the conditional branch and the branch
+  /// joining the two paths, but the instructions of both blocks then share
+  /// the issue slots.
   bool isProfitableToIfCvt(MachineBasicBlock &TMBB,
                       unsigned NumTCycles, unsigned ExtraTCycles,
                       MachineBasicBlock &FMBB,
                       unsigned NumFCycles, unsigned ExtraFCycles,
-                      BranchProbability Probability) const override {
-    const MCInstrDesc &TMCID = std::prev(TMBB.end())->getDesc();
-    if (TMCID.isReturn() || TMCID.isCall())
-      return false;
-    const MCInstrDesc &FMCID = std::prev(FMBB.end())->getDesc();
-    if (FMCID.isReturn() || FMCID.isCall())
-      return false;
-    if ((NumTCycles + NumFCycles) > 16)
-      return false;
+                      BranchProbability Probability) const override;
 
-    // We do not handle predicated instructions that may stall the pipeline
-    // properly in the cache analyses, so we do not convert them for now.
-    return !mayStall(TMBB) && !mayStall(FMBB);
-  }
+  /// getIfCvtIssueCycles - Estimate the number of cycles needed to issue the
+  /// non-branch instructions of the given blocks, when they are predicated
+  /// and freely interleaved in the issue slots.
+  unsigned getIfCvtIssueCycles(ArrayRef<const MachineBasicBlock*> MBBs) const;
+
+  /// getIfCvtBranchCost - Estimate the number of cycles of a local branch at
+  /// the end of the given block (if any), assuming its delay slots are filled
+  /// with the other instructions of the block.
+  unsigned getIfCvtBranchCost(const MachineBasicBlock *MBB) const;
 
   /// isProfitableToDupForIfCvt - Return true if it's profitable for
   /// if-converter to duplicate instructions of specified accumulated
@@ -467,6 +498,44 @@ public:
     return NumCycles <= 4;
   }
 
+  /////////////////////////////////////////////////////////////////////////////
+  // Machine Outliner
+  /////////////////////////////////////////////////////////////////////////////
+
+  /// isFunctionSafeToOutlineFrom - Single-path functions, interrupt handlers
+  /// and naked functions are never outlined from.
+  bool isFunctionSafeToOutlineFrom(MachineFunction &MF,
+                                   bool OutlineFromLinkOnceODRs) const override;
+
+  bool shouldOutlineFromFunctionByDefault(MachineFunction &MF) const override {
+    return true;
+  }
+
+  /// isMBBSafeToOutlineFrom - Only outline from cold code, i.e., blocks of
+  /// cold functions and blocks calling cold functions, so that the outlined
+  /// functions do not compete with hot code for the method cache.
+  bool isMBBSafeToOutlineFrom(MachineBasicBlock &MBB,
+                              unsigned &Flags) const override;
+
+  /// getOutliningCandidateInfo - Outlined sequences are called with callnd
+  /// and end in retnd. Candidates where the call would clobber live return
+  /// information are dropped.
+  outliner::OutlinedFunction getOutliningCandidateInfo(
+      std::vector<outliner::Candidate> &RepeatedSequenceLocs) const override;
+
+  /// getOutliningType - Control flow, instructions with delay slots, stack
+  /// cache control and accesses to the return information are not outlined.
+  outliner::InstrType getOutliningType(MachineBasicBlock::iterator &MIT,
+                                       unsigned Flags) const override;
+
+  void buildOutlinedFrame(MachineBasicBlock &MBB, MachineFunction &MF,
+                          const outliner::OutlinedFunction &OF) const override;
+
+  MachineBasicBlock::iterator
+  insertOutlinedCall(Module &M, MachineBasicBlock &MBB,
+                     MachineBasicBlock::iterator &It, MachineFunction &MF,
+                     const outliner::Candidate &C) const override;
+
 }; // PatmosInstrInfo
 
 static inline
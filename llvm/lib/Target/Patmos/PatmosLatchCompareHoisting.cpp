@@ -0,0 +1,230 @@
+//===-- PatmosLatchCompareHoisting.cpp - Hoist loop exit compares. --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Compute the exit condition of a rotated loop from the induction variable
+// before its increment, and move the compare to the top of the latch.
+//
+// After loop rotation, the latch of a counted loop typically ends in
+//
+//   %next = add %iv, s
+//   %p    = cmpneq %next, %n
+//   (%p) br header
+//
+// which is a chain of three dependent bundles at the end of every iteration.
+// The compare has to wait for the increment, and the branch for the
+// predicate, so neither the scheduler nor the delay slot filler can overlap
+// them with the rest of the body. Equalities are invariant under adding a
+// constant in two's complement, so the compare can test %iv against n - s
+// instead. The compare then only depends on the value the iteration started
+// with, and it is moved up to its definition, such that the latency of the
+// predicate overlaps the body and the increment is free for the delay slots.
+//
+// A constant bound is adjusted in place as long as it fits into the compare,
+// other loop-invariant bounds are adjusted once in the preheader. Only
+// equality compares are rewritten, for ordered compares the adjusted bound
+// could wrap around. Rotating the loops themselves is left to the loop
+// rotation of the middle end and the block placement.
+//
+// The pass runs on machine SSA code, before the register allocation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosTargetMachine.h"
+#include "SinglePath/PatmosSinglePathInfo.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-latch-compare-hoisting"
+
+STATISTIC(HoistedCompares, "Loop exit compares computed before the increment");
+STATISTIC(AdjustedBounds,  "Loop bounds adjusted in the preheader");
+
+namespace {
+
+  class PatmosLatchCompareHoisting : public MachineFunctionPass {
+  private:
+    const PatmosInstrInfo *TII;
+
+    static char ID;
+
+    /// getAddend - Return the constant a register is incremented by with an
+    /// unpredicated addition, or false if MI is none.
+    bool getAddend(const MachineInstr &MI, int64_t &Addend) const {
+      switch (MI.getOpcode()) {
+      case Patmos::ADDi: case Patmos::ADDl:
+      case Patmos::SUBi: case Patmos::SUBl:
+        break;
+      default:
+        return false;
+      }
+      if (TII->isPredicated(MI) || !MI.getOperand(3).isReg() ||
+          !MI.getOperand(4).isImm())
+        return false;
+
+      bool IsSub = MI.getOpcode() == Patmos::SUBi ||
+                   MI.getOpcode() == Patmos::SUBl;
+      Addend = IsSub ? -MI.getOperand(4).getImm() : MI.getOperand(4).getImm();
+      return true;
+    }
+
+    /// adjustBound - Compute Bound - Addend in the preheader of the loop.
+    Register adjustBound(MachineBasicBlock &Preheader, Register Bound,
+                         int64_t Addend, MachineRegisterInfo &MRI) const {
+      int64_t Diff = -Addend;
+      unsigned Opcode = Patmos::ADDl;
+      if (isUInt<12>(Diff))
+        Opcode = Patmos::ADDi;
+      else if (Diff < 0 && isUInt<12>(-Diff)) {
+        Opcode = Patmos::SUBi;
+        Diff = -Diff;
+      }
+
+      Register Adjusted = MRI.createVirtualRegister(&Patmos::RRegsRegClass);
+      MachineBasicBlock::iterator I = Preheader.getFirstTerminator();
+      DebugLoc DL = I != Preheader.end() ? I->getDebugLoc() : DebugLoc();
+      AddDefaultPred(BuildMI(Preheader, I, DL, TII->get(Opcode), Adjusted))
+        .addReg(Bound).addImm(Diff);
+      MRI.clearKillFlags(Bound);
+      AdjustedBounds++;
+      return Adjusted;
+    }
+
+    /// hoistCompare - Rewrite the compare computing the exit condition of the
+    /// latch of a loop to use the value of the induction variable before its
+    /// increment.
+    bool hoistCompare(MachineLoop &L, MachineRegisterInfo &MRI) {
+      MachineBasicBlock *Latch = L.getLoopLatch();
+      MachineBasicBlock *Preheader = L.getLoopPreheader();
+      if (!Latch || !Preheader || !L.isLoopExiting(Latch))
+        return false;
+
+      MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+      SmallVector<MachineOperand, 2> Cond;
+      if (TII->analyzeBranch(*Latch, TBB, FBB, Cond, false) || Cond.empty() ||
+          !Cond[0].isReg() || !Cond[0].getReg().isVirtual())
+        return false;
+
+      MachineInstr *Cmp = MRI.getUniqueVRegDef(Cond[0].getReg());
+      if (!Cmp || Cmp->getParent() != Latch || TII->isPredicated(*Cmp))
+        return false;
+      bool IsImm;
+      switch (Cmp->getOpcode()) {
+      case Patmos::CMPEQ:  case Patmos::CMPNEQ:  IsImm = false; break;
+      case Patmos::CMPIEQ: case Patmos::CMPINEQ: IsImm = true;  break;
+      default:
+        return false;
+      }
+
+      // Find the incremented operand, equalities are symmetric.
+      for (unsigned Idx : {3u, 4u}) {
+        MachineOperand &Next = Cmp->getOperand(Idx);
+        MachineOperand &Bound = Cmp->getOperand(Idx == 3 ? 4 : 3);
+        if (!Next.isReg() || !Next.getReg().isVirtual() ||
+            (IsImm && Idx == 4))
+          continue;
+
+        MachineInstr *Inc = MRI.getUniqueVRegDef(Next.getReg());
+        int64_t Addend;
+        if (!Inc || !L.contains(Inc) || !getAddend(*Inc, Addend))
+          continue;
+        Register IV = Inc->getOperand(3).getReg();
+        if (!IV.isVirtual() ||
+            !MRI.constrainRegClass(IV, &Patmos::RRegsRegClass))
+          continue;
+
+        if (IsImm) {
+          int64_t Adjusted = Bound.getImm() - Addend;
+          if (!isUInt<5>(Adjusted))
+            continue;
+          Bound.setImm(Adjusted);
+        } else {
+          // The bound has to be loop-invariant to be adjusted once.
+          if (!Bound.getReg().isVirtual())
+            continue;
+          MachineInstr *BoundDef = MRI.getUniqueVRegDef(Bound.getReg());
+          if (!BoundDef || L.contains(BoundDef))
+            continue;
+          Bound.setReg(adjustBound(*Preheader, Bound.getReg(), Addend, MRI));
+        }
+
+        LLVM_DEBUG(dbgs() << "Latch compare hoisting: " << *Cmp
+                          << "  now tests " << printReg(IV) << " in "
+                          << printMBBReference(*Latch) << "\n");
+        Next.setReg(IV);
+        MRI.clearKillFlags(IV);
+
+        // Move the compare up to the definition of the induction variable,
+        // but not above calls, which would keep the predicate alive across
+        // them.
+        MachineBasicBlock::iterator Pos = Latch->getFirstNonPHI();
+        for (MachineBasicBlock::iterator I = Pos, E = Cmp->getIterator();
+             I != E; ++I) {
+          if (I->isCall() || I->definesRegister(IV))
+            Pos = std::next(I);
+        }
+        if (Pos != Cmp->getIterator())
+          Latch->splice(Pos, Latch, Cmp->getIterator());
+
+        HoistedCompares++;
+        return true;
+      }
+      return false;
+    }
+
+  public:
+    PatmosLatchCompareHoisting(const PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID),
+        TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Latch Compare Hoisting";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesCFG();
+      AU.addRequired<MachineLoopInfo>();
+      AU.addPreserved<MachineLoopInfo>();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override {
+      MachineRegisterInfo &MRI = MF.getRegInfo();
+      MachineLoopInfo &MLI = getAnalysis<MachineLoopInfo>();
+      // The single-path transformation derives the iteration counts of the
+      // loops itself.
+      if (MLI.empty() || !MRI.isSSA() || PatmosSinglePathInfo::isEnabled(MF))
+        return false;
+
+      bool Changed = false;
+      SmallVector<MachineLoop*, 8> Worklist(MLI.begin(), MLI.end());
+      while (!Worklist.empty()) {
+        MachineLoop *L = Worklist.pop_back_val();
+        Worklist.append(L->begin(), L->end());
+        Changed |= hoistCompare(*L, MRI);
+      }
+      return Changed;
+    }
+  };
+
+  char PatmosLatchCompareHoisting::ID = 0;
+} // end of anonymous namespace
+
+FunctionPass *
+llvm::createPatmosLatchCompareHoistingPass(const PatmosTargetMachine &tm) {
+  return new PatmosLatchCompareHoisting(tm);
+}
@@ -0,0 +1,297 @@
+//===-- PatmosLibrarySummary.cpp - Summaries of pre-compiled libraries. ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Read the stack cache summary sections of pre-compiled libraries.
+//
+// The fields of the records holding addresses are relocated against the
+// symbols of the functions, or against a section symbol with an implicit
+// addend for local functions. The fields are resolved to the names of the
+// functions, local functions being qualified by their object file. Fields
+// referring to other symbols, e.g., the labels of ensures, are ignored.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosLibrarySummary.h"
+#include "MCTargetDesc/PatmosTargetStreamer.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/BinaryFormat/Magic.h"
+#include "llvm/Object/Archive.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <climits>
+#include <map>
+
+using namespace llvm;
+using namespace llvm::object;
+
+/// LibrarySummaryFiles - Pre-compiled libraries whose functions are bounded
+/// by their summaries instead of being unknown to the call graph.
+static cl::list<std::string> LibrarySummaryFiles(
+  "mpatmos-library-summaries",
+  cl::CommaSeparated,
+  cl::desc("Read the stack cache summaries of the functions of pre-compiled "
+           "libraries from the given object files or archives, built with "
+           "-mpatmos-emit-stack-cache-summary."),
+  cl::value_desc("file"));
+
+/// getSymbolName - Return the name of a function symbol in the summaries,
+/// qualified by the object file for local functions.
+static std::string getSymbolName(const ELFSymbolRef &Sym, StringRef Name,
+                                 unsigned ObjectID) {
+  if (Sym.getBinding() == ELF::STB_LOCAL)
+    return (Twine(ObjectID) + ":" + Name).str();
+  return Name.str();
+}
+
+/// readObject - Read the summary section of an object file.
+static void readObject(MemoryBufferRef Buffer, unsigned ObjectID,
+                       StringMap<PatmosLibraryFunction> &Functions) {
+  Expected<std::unique_ptr<ObjectFile>> ObjOrErr =
+      ObjectFile::createObjectFile(Buffer);
+  if (!ObjOrErr)
+    report_fatal_error("cannot read library summaries of '" +
+                       Buffer.getBufferIdentifier() + "': " +
+                       toString(ObjOrErr.takeError()));
+
+  const ELF32BEObjectFile *Obj = dyn_cast<ELF32BEObjectFile>(ObjOrErr->get());
+  if (!Obj)
+    report_fatal_error("'" + Buffer.getBufferIdentifier() +
+                       "' is not a Patmos object file");
+
+  // find the summary section, objects without one have no summaries
+  section_iterator Summary = Obj->section_end();
+  for (section_iterator S = Obj->section_begin(), SE = Obj->section_end();
+       S != SE; ++S) {
+    Expected<StringRef> Name = S->getName();
+    if (Name && *Name == PATMOS_STACKCACHE_SECTION) {
+      Summary = S;
+      break;
+    }
+    consumeError(Name.takeError());
+  }
+  if (Summary == Obj->section_end())
+    return;
+
+  Expected<StringRef> ContentsOrErr = Summary->getContents();
+  if (!ContentsOrErr)
+    report_fatal_error(toString(ContentsOrErr.takeError()));
+  StringRef Contents = *ContentsOrErr;
+  const uint8_t *Data = Contents.bytes_begin();
+
+  // the functions by their section and address, for relocations against
+  // section symbols
+  std::map<std::pair<uint64_t, uint64_t>, std::string> LocalFunctions;
+  for (const ELFSymbolRef &Sym : Obj->symbols()) {
+    if (Sym.getELFType() != ELF::STT_FUNC)
+      continue;
+    Expected<StringRef> Name = Sym.getName();
+    Expected<uint64_t> Value = Sym.getValue();
+    Expected<section_iterator> Sec = Sym.getSection();
+    if (!Name || !Value || !Sec || *Sec == Obj->section_end()) {
+      consumeError(Name.takeError());
+      consumeError(Value.takeError());
+      consumeError(Sec.takeError());
+      continue;
+    }
+    LocalFunctions[std::make_pair((*Sec)->getIndex(), *Value)] =
+        getSymbolName(Sym, *Name, ObjectID);
+  }
+
+  // resolve the relocated fields of the records to function names
+  DenseMap<uint64_t, std::string> Fields;
+  for (const SectionRef &RelSec : Obj->sections()) {
+    Expected<section_iterator> Target = RelSec.getRelocatedSection();
+    if (!Target) {
+      consumeError(Target.takeError());
+      continue;
+    }
+    if (*Target != Summary)
+      continue;
+
+    for (const RelocationRef &R : RelSec.relocations()) {
+      uint64_t Offset = R.getOffset();
+      symbol_iterator SI = R.getSymbol();
+      if (SI == Obj->symbol_end() || Offset + 4 > Contents.size())
+        continue;
+
+      ELFSymbolRef Sym(*SI);
+      Expected<StringRef> Name = Sym.getName();
+      if (!Name) {
+        consumeError(Name.takeError());
+        continue;
+      }
+
+      if (Sym.getELFType() == ELF::STT_SECTION) {
+        // the relocations are without addend, it is kept in the field
+        Expected<section_iterator> Sec = Sym.getSection();
+        if (!Sec) {
+          consumeError(Sec.takeError());
+          continue;
+        }
+        uint64_t Addend = support::endian::read32be(Data + Offset);
+        auto F = LocalFunctions.find(std::make_pair((*Sec)->getIndex(),
+                                                    Addend));
+        if (F != LocalFunctions.end())
+          Fields[Offset] = F->second;
+      } else if (Sym.getELFType() == ELF::STT_FUNC ||
+                 Sym.getELFType() == ELF::STT_NOTYPE) {
+        // undefined callees have no type
+        if (!Name->empty())
+          Fields[Offset] = getSymbolName(Sym, *Name, ObjectID);
+      }
+    }
+  }
+
+  auto readField = [&](uint64_t Offset) -> StringRef {
+    auto F = Fields.find(Offset);
+    return F == Fields.end() ? StringRef() : StringRef(F->second);
+  };
+
+  // the records, see PatmosStackCacheRecordKind
+  uint64_t Offset = 0;
+  while (Offset + 4 <= Contents.size()) {
+    uint32_t Kind = support::endian::read32be(Data + Offset);
+    if (Kind == PSC_FRAME && Offset + 12 <= Contents.size()) {
+      StringRef Function = readField(Offset + 4);
+      if (!Function.empty()) {
+        PatmosLibraryFunction &F = Functions[Function];
+        F.HasFrame = true;
+        F.FrameBytes = std::max<unsigned>(F.FrameBytes,
+                            support::endian::read32be(Data + Offset + 8));
+      }
+      Offset += 12;
+    } else if (Kind == PSC_CALL && Offset + 20 <= Contents.size()) {
+      StringRef Caller = readField(Offset + 4);
+      if (!Caller.empty()) {
+        PatmosLibraryFunction &F = Functions[Caller];
+        StringRef Callee = readField(Offset + 8);
+        if (Callee.empty())
+          F.HasUnknownCallees = true;
+        else
+          F.Callees.push_back(Callee.str());
+      }
+      Offset += 20;
+    } else if (Kind == PSC_DISPLACEMENT && Offset + 16 <= Contents.size()) {
+      StringRef Function = readField(Offset + 4);
+      if (!Function.empty()) {
+        PatmosLibraryFunction &F = Functions[Function];
+        F.HasDisplacement = true;
+        F.MinDisplacement = support::endian::read32be(Data + Offset + 8);
+        F.MaxDisplacement = support::endian::read32be(Data + Offset + 12);
+      }
+      Offset += 16;
+    } else {
+      report_fatal_error("unknown stack cache summary record in '" +
+                         Buffer.getBufferIdentifier() + "'");
+    }
+  }
+}
+
+PatmosLibrarySummaries::PatmosLibrarySummaries(
+                                         const std::vector<std::string> &Files)
+{
+  for (const std::string &File : Files)
+    readFile(File);
+
+  for (const auto &F : Functions)
+    computeMaxDisplacement(F.getKey());
+}
+
+void PatmosLibrarySummaries::readFile(StringRef File) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(File);
+  if (!Buffer)
+    report_fatal_error("cannot open library '" + File + "': " +
+                       Buffer.getError().message());
+
+  // the objects are numbered to tell their local functions apart
+  static unsigned NumObjects = 0;
+
+  MemoryBufferRef Ref = (*Buffer)->getMemBufferRef();
+  if (identify_magic(Ref.getBuffer()) != file_magic::archive) {
+    readObject(Ref, NumObjects++, Functions);
+    return;
+  }
+
+  Expected<std::unique_ptr<Archive>> ArchiveOrErr = Archive::create(Ref);
+  if (!ArchiveOrErr)
+    report_fatal_error("cannot read library '" + File + "': " +
+                       toString(ArchiveOrErr.takeError()));
+
+  Error Err = Error::success();
+  for (const Archive::Child &C : (*ArchiveOrErr)->children(Err)) {
+    Expected<MemoryBufferRef> Member = C.getMemoryBufferRef();
+    if (!Member)
+      report_fatal_error("cannot read library '" + File + "': " +
+                         toString(Member.takeError()));
+    // skip the symbol tables and the like
+    if (identify_magic(Member->getBuffer()) == file_magic::elf_relocatable)
+      readObject(*Member, NumObjects++, Functions);
+  }
+  if (Err)
+    report_fatal_error("cannot read library '" + File + "': " +
+                       toString(std::move(Err)));
+}
+
+unsigned PatmosLibrarySummaries::computeMaxDisplacement(StringRef Name) {
+  auto D = MaxDisplacements.find(Name);
+  if (D != MaxDisplacements.end())
+    return D->second;
+
+  // A recursion, an unknown function or a function without a frame record,
+  // e.g., containing inline assembly, is not bounded.
+  MaxDisplacements[Name] = UINT_MAX;
+  auto F = Functions.find(Name);
+  if (F == Functions.end() || !F->second.HasFrame ||
+      F->second.HasUnknownCallees)
+    return UINT_MAX;
+
+  uint64_t Displacement = 0;
+  for (const std::string &Callee : F->second.Callees)
+    Displacement = std::max<uint64_t>(Displacement,
+                                      computeMaxDisplacement(Callee));
+  Displacement = std::min<uint64_t>(Displacement + F->second.FrameBytes,
+                                    UINT_MAX);
+
+  MaxDisplacements[Name] = Displacement;
+  return Displacement;
+}
+
+const PatmosLibrarySummaries &PatmosLibrarySummaries::get() {
+  static const PatmosLibrarySummaries Summaries(LibrarySummaryFiles);
+  return Summaries;
+}
+
+const PatmosLibraryFunction *
+PatmosLibrarySummaries::lookup(StringRef Name) const {
+  auto F = Functions.find(Name);
+  return F == Functions.end() ? NULL : &F->second;
+}
+
+unsigned PatmosLibrarySummaries::getMinDisplacement(StringRef Name) const {
+  const PatmosLibraryFunction *F = lookup(Name);
+  return F && F->HasDisplacement ? F->MinDisplacement : 0;
+}
+
+unsigned PatmosLibrarySummaries::getMaxDisplacement(StringRef Name,
+                                              unsigned StackCacheSize) const {
+  unsigned Displacement = MaxDisplacements.lookup(Name);
+  if (!MaxDisplacements.count(Name))
+    Displacement = UINT_MAX;
+
+  // the stack cache analysis knows the paths through the function
+  const PatmosLibraryFunction *F = lookup(Name);
+  if (F && F->HasDisplacement)
+    Displacement = std::min(Displacement, F->MaxDisplacement);
+
+  return std::min(Displacement, StackCacheSize);
+}
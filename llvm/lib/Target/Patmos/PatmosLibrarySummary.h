@@ -0,0 +1,107 @@
+//===-- PatmosLibrarySummary.h - Summaries of pre-compiled libraries. -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Read the stack cache summaries of the functions of pre-compiled libraries,
+// i.e., of object files and archives built with
+// -mpatmos-emit-stack-cache-summary, such that whole-program analyses can
+// bound calls into the libraries instead of compiling them from bitcode with
+// every program.
+//
+// A function of a library is summarized by the frame size and the call sites
+// from its frame and call records, and by the bounds of the stack cache
+// analysis from its displacement record, if the analysis ran on the library.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOS_LIBRARYSUMMARY_H_
+#define _LLVM_TARGET_PATMOS_LIBRARYSUMMARY_H_
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+  /// The summary of a function of a pre-compiled library.
+  struct PatmosLibraryFunction {
+    /// Flag indicating whether a frame record of the function was found.
+    bool HasFrame;
+
+    /// Number of bytes the function reserves on the stack cache.
+    unsigned FrameBytes;
+
+    /// Names of the functions called by the function. Local functions of the
+    /// library are qualified by the object file defining them.
+    std::vector<std::string> Callees;
+
+    /// Flag indicating whether the function calls unknown functions, e.g.,
+    /// through function pointers.
+    bool HasUnknownCallees;
+
+    /// Bounds of the displacement of the function and its callees found by
+    /// the stack cache analysis, if HasDisplacement is set.
+    bool HasDisplacement;
+    unsigned MinDisplacement;
+    unsigned MaxDisplacement;
+
+    PatmosLibraryFunction() : HasFrame(false), FrameBytes(0),
+        HasUnknownCallees(false), HasDisplacement(false), MinDisplacement(0),
+        MaxDisplacement(0)
+    {
+    }
+  };
+
+  /// The summaries of the functions of the libraries given by
+  /// -mpatmos-library-summaries.
+  class PatmosLibrarySummaries {
+  private:
+    /// Summaries of the library functions by name.
+    StringMap<PatmosLibraryFunction> Functions;
+
+    /// Upper bounds of the displacement of the library functions, including
+    /// the displacement of their callees, ignoring the size of the stack
+    /// cache. UINT_MAX if the displacement is not bounded.
+    StringMap<unsigned> MaxDisplacements;
+
+    explicit PatmosLibrarySummaries(const std::vector<std::string> &Files);
+
+    /// readFile - Read the summaries of an object file or of the members of
+    /// an archive. Errors are fatal.
+    void readFile(StringRef File);
+
+    /// computeMaxDisplacement - Compute the upper bound of the displacement
+    /// of a library function over the call graph of the libraries.
+    unsigned computeMaxDisplacement(StringRef Name);
+
+  public:
+    /// get - Return the summaries of the libraries given on the command line,
+    /// which are read on the first call.
+    static const PatmosLibrarySummaries &get();
+
+    /// empty - Check whether no library function is summarized.
+    bool empty() const { return Functions.empty(); }
+
+    /// lookup - Return the summary of the library function with the given
+    /// name, or NULL if there is none.
+    const PatmosLibraryFunction *lookup(StringRef Name) const;
+
+    /// getMinDisplacement - Return a lower bound of the number of bytes the
+    /// library function and its callees displace from the stack cache.
+    unsigned getMinDisplacement(StringRef Name) const;
+
+    /// getMaxDisplacement - Return an upper bound of the number of bytes the
+    /// library function and its callees displace from a stack cache of the
+    /// given size.
+    unsigned getMaxDisplacement(StringRef Name, unsigned StackCacheSize) const;
+  };
+}
+
+#endif // _LLVM_TARGET_PATMOS_LIBRARYSUMMARY_H_
@@ -0,0 +1,161 @@
+//===-- PatmosLoopBaseSharing.cpp - Share base registers of loop accesses. ===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Fold the constant additions to the base registers of memory accesses in
+// loops into the scaled offsets of the accesses, such that the accesses
+// relative to the same pointer share one base register.
+//
+// The instruction selection folds additions into the offsets of accesses in
+// the same block only. Loop strength reduction and LICM, however, compute the
+// addresses of the accesses of an iteration in the preheader or the loop
+// header, e.g., p+4 and p+8 for the accesses to p[1] and p[2], which then
+// occupy one register and one ALU slot each. As long as the offset is a
+// multiple of the access size and reachable by the 7-bit unsigned offset of
+// the access, the access uses the original pointer instead. Additions left
+// without uses are removed.
+//
+// The pass runs on machine SSA code, before the register allocation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosTargetMachine.h"
+#include "MCTargetDesc/PatmosBaseInfo.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-loop-base-sharing"
+
+STATISTIC(FoldedOffsets, "Loop accesses whose base addition was folded");
+STATISTIC(RemovedAdds,   "Base additions removed after folding");
+
+namespace {
+
+  class PatmosLoopBaseSharing : public MachineFunctionPass {
+  private:
+    const PatmosInstrInfo *TII;
+
+    static char ID;
+
+    /// getAddend - Return the constant a base register is incremented by
+    /// with an unpredicated addition, or false if MI is none.
+    bool getAddend(const MachineInstr &MI, int64_t &Addend) const {
+      switch (MI.getOpcode()) {
+      case Patmos::ADDi: case Patmos::ADDl: case Patmos::SUBi:
+        break;
+      default:
+        return false;
+      }
+      if (TII->isPredicated(MI) || !MI.getOperand(3).isReg() ||
+          !MI.getOperand(4).isImm())
+        return false;
+
+      Addend = MI.getOpcode() == Patmos::SUBi ? -MI.getOperand(4).getImm()
+                                              : MI.getOperand(4).getImm();
+      return true;
+    }
+
+    /// foldBase - Fold the additions defining the base register of a memory
+    /// access into its offset, as long as the offset is reachable.
+    bool foldBase(MachineInstr &MI, MachineRegisterInfo &MRI) {
+      uint64_t TSFlags = MI.getDesc().TSFlags;
+      unsigned Format = getPatmosFormat(TSFlags);
+      if (Format != PatmosII::FrmLDT && Format != PatmosII::FrmSTT)
+        return false;
+
+      // The address follows the guard, its offset is scaled by the access'
+      // size
+      unsigned BaseIdx = MI.findFirstPredOperandIdx() + 2;
+      MachineOperand &Base = MI.getOperand(BaseIdx);
+      MachineOperand &Offset = MI.getOperand(BaseIdx + 1);
+      if (!Base.isReg() || !Offset.isImm())
+        return false;
+
+      unsigned Shift = getPatmosImmediateShift(TSFlags);
+      unsigned Size = getPatmosImmediateSize(TSFlags);
+      bool Changed = false;
+      while (Base.getReg().isVirtual()) {
+        MachineInstr *Def = MRI.getUniqueVRegDef(Base.getReg());
+        int64_t Addend;
+        if (!Def || !getAddend(*Def, Addend))
+          break;
+
+        Register Src = Def->getOperand(3).getReg();
+        int64_t Bytes = (Offset.getImm() << Shift) + Addend;
+        if (Bytes < 0 || Bytes % (1 << Shift) ||
+            !isUIntN(Size, Bytes >> Shift))
+          break;
+        if (Src.isPhysical() ? Src != Patmos::R0
+            : !MRI.constrainRegClass(Src, &Patmos::RRegsRegClass))
+          break;
+
+        LLVM_DEBUG(dbgs() << "Loop base sharing: folding " << *Def
+                          << "  into " << MI);
+        Base.setReg(Src);
+        MRI.clearKillFlags(Src);
+        Offset.setImm(Bytes >> Shift);
+        FoldedOffsets++;
+        Changed = true;
+
+        if (MRI.use_empty(Def->getOperand(0).getReg())) {
+          Def->eraseFromParent();
+          RemovedAdds++;
+        }
+      }
+      return Changed;
+    }
+
+  public:
+    PatmosLoopBaseSharing(const PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID),
+        TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Loop Base Sharing";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesCFG();
+      AU.addRequired<MachineLoopInfo>();
+      AU.addPreserved<MachineLoopInfo>();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override {
+      MachineRegisterInfo &MRI = MF.getRegInfo();
+      MachineLoopInfo &MLI = getAnalysis<MachineLoopInfo>();
+      if (MLI.empty() || !MRI.isSSA())
+        return false;
+
+      bool Changed = false;
+      for (MachineBasicBlock &MBB : MF) {
+        if (!MLI.getLoopFor(&MBB))
+          continue;
+
+        for (MachineInstr &MI : MBB)
+          Changed |= foldBase(MI, MRI);
+      }
+      return Changed;
+    }
+  };
+
+  char PatmosLoopBaseSharing::ID = 0;
+} // end of anonymous namespace
+
+FunctionPass *
+llvm::createPatmosLoopBaseSharingPass(const PatmosTargetMachine &tm) {
+  return new PatmosLoopBaseSharing(tm);
+}
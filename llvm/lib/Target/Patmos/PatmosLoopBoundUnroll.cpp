@@ -0,0 +1,284 @@
+//===-- PatmosLoopBoundUnroll.cpp - Unroll loops using their loop bounds ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Unroll innermost loops using the iteration counts of their
+// '#pragma loopbound'.
+//
+// Bounds are carried by calls to "llvm.loop.bound" in the loop header, where
+// the arguments (a, b) denote a minimum of a+1 and a maximum of a+b+1
+// executions of the header. The call is marked noduplicate, so that the bound
+// stays attached to its loop; this also keeps the generic unroller from
+// touching the loop, even though it often cannot compute a trip count itself.
+//
+// Loops with a small bound are unrolled a+b+1 times, keeping the exit
+// conditions of all copies unless the bound is exact. Once the loop is gone,
+// its bound is no longer needed, loops that are not unrolled keep their bound
+// for the single-path transformation and the PML export.
+//
+// Single-path loops always execute their maximum iteration count and pay for
+// the loop counter and the predicates of every iteration, they are therefore
+// fully unrolled up to a larger bound. Loops are single-path if their function
+// is a single-path root or if they are marked with '#pragma patmos singlepath',
+// callees of single-path roots are not known before the single-path cloning.
+//
+// Other loops are unrolled partially, to give the scheduler independent
+// operations for the second issue slot. The copies keep their exit conditions,
+// unless the exact bound is a multiple of the unroll count, and the bound of
+// the loop is divided by the unroll count. Single-path loops are only unrolled
+// partially if the exit conditions can be removed.
+//
+// The unrolled size is limited by the thresholds of the unrolling preferences
+// of the target, which keep the loop small enough to fit into the method cache
+// together with its surrounding code.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/UnrollLoop.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-loopbound-unroll"
+
+STATISTIC(NumUnrolled, "Number of loops fully unrolled using their loop bound");
+STATISTIC(NumPartiallyUnrolled,
+          "Number of loops partially unrolled using their loop bound");
+
+static cl::opt<bool> DisableLoopBoundUnroll(
+  "mpatmos-disable-loopbound-unroll",
+  cl::init(false),
+  cl::desc("Do not fully unroll loops with a small '#pragma loopbound'."),
+  cl::Hidden);
+
+static cl::opt<unsigned> LoopBoundUnrollMaxCount(
+  "mpatmos-loopbound-unroll-max-count",
+  cl::init(8),
+  cl::desc("Maximum number of header executions of a loop to be fully "
+           "unrolled using its loop bound (default: 8)."),
+  cl::Hidden);
+
+static cl::opt<unsigned> LoopBoundUnrollSPMaxCount(
+  "mpatmos-loopbound-unroll-sp-max-count",
+  cl::init(32),
+  cl::desc("Maximum number of header executions of a single-path loop to be "
+           "fully unrolled using its loop bound (default: 32)."),
+  cl::Hidden);
+
+static cl::opt<unsigned> LoopBoundUnrollPartialCount(
+  "mpatmos-loopbound-unroll-partial-count",
+  cl::init(2),
+  cl::desc("Number of copies of the body of loops that are partially unrolled "
+           "using their loop bound, 0 or 1 to disable (default: 2)."),
+  cl::Hidden);
+
+static cl::opt<unsigned> LoopBoundUnrollMaxSize(
+  "mpatmos-loopbound-unroll-max-size",
+  cl::init(128),
+  cl::desc("Maximum number of instructions of a loop after it has been fully "
+           "unrolled using its loop bound (default: 128)."),
+  cl::Hidden);
+
+namespace {
+  class PatmosLoopBoundUnroll : public LoopPass {
+  public:
+    static char ID;
+
+    PatmosLoopBoundUnroll() : LoopPass(ID) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Loop Bound Unrolling";
+    }
+
+    bool runOnLoop(Loop *L, LPPassManager &LPM) override;
+
+  private:
+    /// Unroll the loop Count times, with the loop bound Bound removed while
+    /// unrolling. Returns false if the loop was not modified.
+    bool unroll(Loop *L, CallInst *Bound, unsigned Count, unsigned TripCount,
+                unsigned TripMultiple, bool PreserveCondBr);
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<AssumptionCacheTracker>();
+      AU.addRequired<TargetTransformInfoWrapperPass>();
+      getLoopAnalysisUsage(AU);
+    }
+  };
+}
+
+char PatmosLoopBoundUnroll::ID = 0;
+
+Pass *llvm::createPatmosLoopBoundUnrollPass() {
+  return new PatmosLoopBoundUnroll();
+}
+
+/// Return whether the loop is converted to single-path code.
+static bool isSinglePath(const Loop *L) {
+  const Function *F = L->getHeader()->getParent();
+  if (F->hasFnAttribute("sp-root"))
+    return true;
+
+  for (; L; L = L->getParentLoop())
+    if (findOptionMDForLoop(L, "llvm.loop.singlepath"))
+      return true;
+  return false;
+}
+
+/// Return the llvm.loop.bound call in the given block, or null if there is
+/// none.
+static CallInst *findLoopBound(BasicBlock *BB) {
+  for (Instruction &I : *BB) {
+    if (CallInst *CI = dyn_cast<CallInst>(&I)) {
+      Function *Callee = CI->getCalledFunction();
+      if (Callee && Callee->getName() == "llvm.loop.bound")
+        return CI;
+    }
+  }
+  return nullptr;
+}
+
+bool PatmosLoopBoundUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
+  if (DisableLoopBoundUnroll || skipLoop(L) || !L->isInnermost() ||
+      !L->isLoopSimplifyForm())
+    return false;
+
+  CallInst *Bound = findLoopBound(L->getHeader());
+  if (!Bound)
+    return false;
+
+  ConstantInt *Min = dyn_cast<ConstantInt>(Bound->getArgOperand(0));
+  ConstantInt *Diff = dyn_cast<ConstantInt>(Bound->getArgOperand(1));
+  if (!Min || !Diff || Min->isNegative() || Diff->isNegative())
+    return false;
+
+  uint64_t MinCount = Min->getZExtValue() + 1;
+  uint64_t Count = MinCount + Diff->getZExtValue();
+  bool Exact = Diff->isZero();
+  bool SinglePath = isSinglePath(L);
+
+  // The other instructions must be clonable, the bound itself is removed.
+  for (BasicBlock *BB : L->blocks()) {
+    for (Instruction &I : *BB) {
+      if (&I == Bound)
+        continue;
+      if (auto *CB = dyn_cast<CallBase>(&I))
+        if (CB->cannotDuplicate() || CB->isConvergent())
+          return false;
+    }
+  }
+
+  unsigned Size = 0;
+  for (BasicBlock *BB : L->blocks())
+    Size += BB->sizeWithoutDebug();
+
+  // Let the target limit the size of the unrolled loop.
+  Function &F = *L->getHeader()->getParent();
+  ScalarEvolution &SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+  const TargetTransformInfo &TTI =
+      getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+  TargetTransformInfo::UnrollingPreferences UP;
+  UP.Threshold = LoopBoundUnrollMaxSize;
+  UP.PartialThreshold = LoopBoundUnrollMaxSize;
+  TTI.getUnrollingPreferences(L, SE, UP);
+
+  unsigned MaxCount = SinglePath ? LoopBoundUnrollSPMaxCount
+                                 : LoopBoundUnrollMaxCount;
+  if (Count <= MaxCount && Size * Count <= UP.Threshold) {
+    LLVM_DEBUG(dbgs() << "Fully unrolling loop bounded by " << Count
+                      << " header executions in " << F.getName() << "\n");
+
+    // Only keep the exit conditions if the loop may exit early.
+    if (!unroll(L, Bound, Count, Count, 1, !Exact))
+      return false;
+
+    Bound->deleteValue();
+
+    NumUnrolled++;
+    LPM.markLoopAsDeleted(*L);
+    return true;
+  }
+
+  // Unroll partially, keeping the loop and its bound.
+  unsigned PartialCount = LoopBoundUnrollPartialCount;
+  if (PartialCount < 2 || Count < PartialCount || F.hasOptSize() ||
+      F.hasFnAttribute(Attribute::Cold) ||
+      Size * PartialCount > UP.PartialThreshold)
+    return false;
+
+  // If the exact bound is a multiple of the count, only the last copy needs
+  // an exit condition.
+  bool Multiple = Exact && Count % PartialCount == 0;
+  if (SinglePath && !Multiple)
+    return false;
+
+  LLVM_DEBUG(dbgs() << "Partially unrolling loop bounded by " << Count
+                    << " header executions " << PartialCount << " times in "
+                    << F.getName() << "\n");
+
+  if (!unroll(L, Bound, PartialCount, 0, Multiple ? PartialCount : 1, true))
+    return false;
+
+  // The header of the unrolled loop is executed once per PartialCount
+  // executions of the original header, with a partial last iteration.
+  uint64_t NewMin = divideCeil(MinCount, PartialCount);
+  uint64_t NewMax = divideCeil(Count, PartialCount);
+  Bound->setArgOperand(0, ConstantInt::get(Min->getType(), NewMin - 1));
+  Bound->setArgOperand(1, ConstantInt::get(Diff->getType(), NewMax - NewMin));
+  Bound->insertBefore(L->getHeader()->getTerminator());
+
+  NumPartiallyUnrolled++;
+  return true;
+}
+
+bool PatmosLoopBoundUnroll::unroll(Loop *L, CallInst *Bound, unsigned Count,
+                                   unsigned TripCount, unsigned TripMultiple,
+                                   bool PreserveCondBr) {
+  Function &F = *L->getHeader()->getParent();
+  LoopInfo *LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  ScalarEvolution *SE = &getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+  DominatorTree *DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+  AssumptionCache *AC =
+      &getAnalysis<AssumptionCacheTracker>().getAssumptionCache(F);
+  const TargetTransformInfo *TTI =
+      &getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+  OptimizationRemarkEmitter ORE(&F);
+  bool PreserveLCSSA = mustPreserveAnalysisID(LCSSAID);
+
+  Bound->removeFromParent();
+
+  LoopUnrollResult Result = UnrollLoop(
+      L, {Count, TripCount, /*Force=*/true,
+          /*AllowRuntime=*/false, /*AllowExpensiveTripCount=*/false,
+          PreserveCondBr, /*PreserveOnlyFirst=*/false,
+          TripMultiple, /*PeelCount=*/0, /*UnrollRemainder=*/false,
+          /*ForgetAllSCEV=*/false},
+      LI, SE, DT, AC, TTI, &ORE, PreserveLCSSA);
+
+  if (Result == LoopUnrollResult::Unmodified) {
+    // Put the bound back, the loop remains a loop.
+    Bound->insertBefore(L->getHeader()->getTerminator());
+    return false;
+  }
+
+  assert((Result == LoopUnrollResult::FullyUnrolled) == (TripCount != 0) &&
+         "unexpected unrolling result");
+  return true;
+}
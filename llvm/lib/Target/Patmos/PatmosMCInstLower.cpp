@@ -33,7 +33,9 @@ MCOperand PatmosMCInstLower::LowerSymbolOperand(const MachineOperand &MO, unsign
   MCSymbolRefExpr::VariantKind Kind;
   const MCSymbol *Symbol;
 
-  Kind = MCSymbolRefExpr::VK_None;
+  // globals in the small data area are addressed relative to its base
+  Kind = MO.getTargetFlags() == PatmosII::MO_SDA ?
+           MCSymbolRefExpr::VK_Patmos_SDA : MCSymbolRefExpr::VK_None;
 
   // Note: jump table entries (refs to BBs) are lowered in
   // PatmosISelLowering::LowerCustomJumpTableEntry
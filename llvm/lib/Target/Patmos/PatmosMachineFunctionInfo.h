@@ -15,9 +15,13 @@
 #define _PATMOS_MACHINEFUNCTIONINFO_H_
 
 #include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/IR/Function.h"
 
 #include <limits>
+#include <memory>
 #include <set>
 #include <vector>
 #include <map>
@@ -25,6 +29,8 @@
 
 namespace llvm {
 
+class SPScope;
+
 /// PatmosAnalysisInfo - Store information from different analyses and from
 /// (WCET) profiling.
 /// TODO There might be one instance per context, provide functions to manage
@@ -42,8 +48,13 @@ private:
 
 public:
 
-  double getCriticality(const MachineBasicBlock *MBB, double Default = -1.0) {
-    CritMap::iterator it = BlockCriticalitites.find(MBB);
+  /// Minimum criticality of the blocks on the worst-case path. Criticalities
+  /// are relative to the WCET, blocks on the worst-case path are at 1.0.
+  static constexpr double CriticalThreshold = 0.99;
+
+  double getCriticality(const MachineBasicBlock *MBB,
+                        double Default = -1.0) const {
+    CritMap::const_iterator it = BlockCriticalitites.find(MBB);
     if (it != BlockCriticalitites.end()) {
       return it->second;
     }
@@ -51,11 +62,22 @@ public:
   }
 
   void setCriticality(const MachineBasicBlock *MBB, double Crit) {
-    BlockCriticalitites.insert(std::make_pair(MBB, Crit));
+    BlockCriticalitites[MBB] = Crit;
   }
 
-  int64_t getFrequency(const MachineBasicBlock *MBB, int64_t Default = -1) {
-    FreqMap::iterator it = BlockFrequencies.find(MBB);
+  /// hasCriticalities - Check whether the criticalities of the blocks of the
+  /// function are known.
+  bool hasCriticalities() const { return !BlockCriticalitites.empty(); }
+
+  /// isCritical - Check whether the block is known to be on the worst-case
+  /// path.
+  bool isCritical(const MachineBasicBlock *MBB) const {
+    return getCriticality(MBB, 0.0) >= CriticalThreshold;
+  }
+
+  int64_t getFrequency(const MachineBasicBlock *MBB,
+                       int64_t Default = -1) const {
+    FreqMap::const_iterator it = BlockFrequencies.find(MBB);
     if (it != BlockFrequencies.end()) {
       return it->second;
     }
@@ -63,9 +85,37 @@ public:
   }
 
   void setFrequency(const MachineBasicBlock *MBB, uint64_t Freq) {
-    BlockFrequencies.insert(std::make_pair(MBB, Freq));
+    BlockFrequencies[MBB] = Freq;
   }
 
+  /// hasFrequencies - Check whether the frequencies of the blocks of the
+  /// function are known.
+  bool hasFrequencies() const { return !BlockFrequencies.empty(); }
+
+  /// clear - Forget all results, e.g., before they are imported again for
+  /// the current blocks of the function.
+  void clear() {
+    BlockCriticalitites.clear();
+    BlockFrequencies.clear();
+  }
+
+};
+
+/// PatmosTracingSled - A sequence of NOPs that the runtime patches to call a
+/// tracing handler, see PatmosSleds.cpp.
+struct PatmosTracingSled {
+  /// Number of instructions of a sled.
+  static constexpr unsigned Words = 5;
+
+  /// The first instruction of the sled, labelled by its pre-instr symbol.
+  const MachineInstr *First;
+
+  /// The PatmosSledKind of the sled.
+  unsigned Kind;
+
+  /// Dead registers keeping srb and sro during the call of the handler.
+  Register ScratchA;
+  Register ScratchB;
 };
 
 /// PatmosMachineFunctionInfo - This class is derived from MachineFunction and
@@ -108,15 +158,48 @@ class PatmosMachineFunctionInfo : public MachineFunctionInfo {
   /// FIs with Indirect load or store instructions
   std::unordered_map<int, std::vector<MachineInstr*>> StackCacheAnalysisFIIndirectMemInstructions;
 
+  /// FIs whose address is passed to callees accessing them on the stack cache
+  std::vector<int> StackCacheArgumentFIs;
+
+  /// Copies of byval arguments made for calls, with the called function (if
+  /// known) and the number of the parameter
+  std::map<int, std::pair<const Function*, unsigned>> ByValArgumentFIs;
+
+  /// True if this function accesses objects of its callers on the stack cache
+  /// through pointer parameters, and thus must not reserve stack cache space
+  bool StackCacheParams;
+
+  /// True if the frame of this function is placed on the shadow stack, to
+  /// leave the stack cache to the functions on the worst-case call path
+  bool ShadowStackFrame;
+
+  /// Upper bound of the stack cache frame of this function in bytes, the
+  /// coldest objects exceeding it are placed on the shadow stack instead
+  unsigned StackCacheLimit;
+
+  /// Bounds of the stack cache displacement of this function and its callees
+  /// in bytes, computed by the stack cache analysis. The maximum is UINT_MAX
+  /// if the analysis did not run.
+  unsigned MinStackCacheDisplacement;
+  unsigned MaxStackCacheDisplacement;
+
+  /// True if the stack frame is set up in a block other than the entry block,
+  /// such that some paths through the function do not reserve it
+  bool ShrinkWrapped;
+
+  /// True if this function is an interrupt handler, returning with xret
+  bool InterruptHandler;
+
+  /// FrameIndex keeping the stack cache occupancy of the interrupted code,
+  /// or -1 if the interrupt handler does not displace any of it.
+  int InterruptOccupancyFI;
+
   // Index to the SinglePathFIs where the S0 spill slots start
   unsigned SPS0SpillOffset;
 
   // Index to the SinglePathFIs where the excess spill slots start
   unsigned SPExcessSpillOffset;
 
-  // Index to the SinglePathFIs where the call spill slots start (R9)
-  unsigned SPCallSpillOffset;
-
   /// Set of entry blocks to code regions that are potentially cached by the
   /// method cache.
   std::set<const MachineBasicBlock*> MethodCacheRegionEntries;
@@ -124,16 +207,51 @@ class PatmosMachineFunctionInfo : public MachineFunctionInfo {
   /// Store analysis results per function.
   PatmosAnalysisInfo AnalysisInfo;
 
+  /// SinglePathScopes - The SPScope tree of a single-path function, shared
+  /// between the instances of PatmosSinglePathInfo.
+  std::shared_ptr<SPScope> SinglePathScopes;
+
+  /// SinglePathScopesHash - Hash of the function SinglePathScopes was built
+  /// from, the tree is stale once it no longer matches.
+  hash_code SinglePathScopesHash;
+
+  /// BlockSizes - Sizes of basic blocks in bytes, filled in by
+  /// PatmosInstrInfo::getBlockSize. Passes that change the instructions of a
+  /// block after the function splitter must adjust or invalidate its size.
+  mutable DenseMap<const MachineBasicBlock*, unsigned> BlockSizes;
+
+  /// True if the function is traced by sleds, such that its subfunctions
+  /// get sleds as well, which the function splitter must leave room for.
+  bool TracingSledsEnabled;
+
+  /// TracingSleds - The tracing sleds of the function, in insertion order.
+  std::vector<PatmosTracingSled> TracingSleds;
+
+  /// TracingSledInstrs - The instructions of the tracing sleds, which must
+  /// neither be moved, bundled nor separated.
+  std::set<const MachineInstr*> TracingSledInstrs;
+
   // do not provide any default constructor.
   PatmosMachineFunctionInfo();
 public:
   explicit PatmosMachineFunctionInfo(MachineFunction &MF) :
     StackCacheReservedBytes(0), StackReservedBytes(0), VarArgsFI(0),
     RegScavengingFI(0), S0SpillReg(0),
-    SinglePathConvert(false), SinglePathPseudoRoot(false), SPS0SpillOffset(0), SPExcessSpillOffset(0),
-    SPCallSpillOffset(0)
+    SinglePathConvert(false), SinglePathPseudoRoot(false),
+    StackCacheParams(false), ShadowStackFrame(false), StackCacheLimit(UINT_MAX),
+    MinStackCacheDisplacement(0), MaxStackCacheDisplacement(UINT_MAX),
+    ShrinkWrapped(false),
+    InterruptHandler(isInterruptHandler(MF.getFunction())),
+    InterruptOccupancyFI(-1), SPS0SpillOffset(0), SPExcessSpillOffset(0),
+    SinglePathScopesHash(0), TracingSledsEnabled(false)
     {}
 
+  /// isInterruptHandler - Check whether the function has the interrupt
+  /// attribute.
+  static bool isInterruptHandler(const Function &F) {
+    return F.hasFnAttribute("interrupt");
+  }
+
   /// getStackCacheReservedBytes - Get the number of bytes reserved on the
   /// stack cache.
   unsigned getStackCacheReservedBytes() const {
@@ -146,6 +264,18 @@ public:
     StackCacheReservedBytes = newSize;
   }
 
+  /// isShrinkWrapped - Check whether the stack frame is only set up on some
+  /// paths through the function.
+  bool isShrinkWrapped() const {
+    return ShrinkWrapped;
+  }
+
+  /// setShrinkWrapped - Mark whether the stack frame is only set up on some
+  /// paths through the function.
+  void setShrinkWrapped(bool shrinkWrapped) {
+    ShrinkWrapped = shrinkWrapped;
+  }
+
   /// getStackReservedBytes - Get the number of bytes reserved on the shadow 
   /// stack.
   unsigned getStackReservedBytes() const {
@@ -238,10 +368,6 @@ public:
     SPExcessSpillOffset = SinglePathFIs.size();
   }
 
-  void startSinglePathCallSpill(void) {
-    SPCallSpillOffset = SinglePathFIs.size();
-  }
-
   int getSinglePathLoopCntFI(unsigned num) const {
     return SinglePathFIs[0 + num];
   }
@@ -254,10 +380,6 @@ public:
     return SinglePathFIs[SPExcessSpillOffset + num];
   }
 
-  int getSinglePathCallSpillFI(void) const {
-    return SinglePathFIs[SPCallSpillOffset + 0];
-  }
-
   const std::vector<int>& getSinglePathFIs(void) const {
     return SinglePathFIs;
   }
@@ -289,10 +411,184 @@ public:
     StackCacheAnalysisFIIndirectMemInstructions[FI] = indirectMemInstructions;
   }
 
+  /// addStackCacheArgumentFI - Mark an FI whose address is passed to a callee
+  /// accessing it on the stack cache.
+  void addStackCacheArgumentFI(int fi) {
+    StackCacheArgumentFIs.push_back(fi);
+  }
+
+  /// isStackCacheArgumentFI - Check whether the FI has to be placed on the
+  /// stack cache, since a callee accesses it there.
+  bool isStackCacheArgumentFI(int fi) const {
+    return std::find(StackCacheArgumentFIs.begin(), StackCacheArgumentFIs.end(),
+                     fi) != StackCacheArgumentFIs.end();
+  }
+
+  /// hasStackCacheArgumentFIs - Check whether the function passes objects on
+  /// its stack cache frame to callees.
+  bool hasStackCacheArgumentFIs() const {
+    return !StackCacheArgumentFIs.empty();
+  }
+
+  /// addByValArgumentFI - Record an FI holding the copy of a byval argument
+  /// passed to parameter Param of Callee.
+  void addByValArgumentFI(int fi, const Function *Callee, unsigned Param) {
+    ByValArgumentFIs[fi] = std::make_pair(Callee, Param);
+  }
+
+  /// getByValArgument - Get the callee and the parameter an FI holding the
+  /// copy of a byval argument is passed to, or null if it is no such copy.
+  const std::pair<const Function*, unsigned> *getByValArgument(int fi) const {
+    auto I = ByValArgumentFIs.find(fi);
+    return I == ByValArgumentFIs.end() ? nullptr : &I->second;
+  }
+
+  /// setStackCacheParams - Mark the function as accessing objects of its
+  /// callers on the stack cache through its parameters.
+  void setStackCacheParams(bool params=true) {
+    StackCacheParams = params;
+  }
+
+  /// hasStackCacheParams - Check whether the function accesses objects of its
+  /// callers on the stack cache, it then must not reserve stack cache space.
+  bool hasStackCacheParams() const {
+    return StackCacheParams;
+  }
+
+  /// setShadowStackFrame - Place the whole frame of the function on the
+  /// shadow stack, it then does not reserve stack cache space.
+  void setShadowStackFrame(bool shadow=true) {
+    ShadowStackFrame = shadow;
+  }
+
+  /// hasShadowStackFrame - Check whether the whole frame of the function is
+  /// placed on the shadow stack.
+  bool hasShadowStackFrame() const {
+    return ShadowStackFrame;
+  }
+
+  /// setStackCacheLimit - Limit the stack cache frame of the function to the
+  /// given number of bytes, the remaining objects are placed on the shadow
+  /// stack.
+  void setStackCacheLimit(unsigned Bytes) {
+    StackCacheLimit = Bytes;
+  }
+
+  /// getStackCacheLimit - Return the upper bound of the stack cache frame of
+  /// the function in bytes, or UINT_MAX if it is not limited.
+  unsigned getStackCacheLimit() const {
+    return StackCacheLimit;
+  }
+
+  /// setStackCacheDisplacement - Record the bounds of the number of bytes the
+  /// function and its callees displace from the stack cache.
+  void setStackCacheDisplacement(unsigned Min, unsigned Max) {
+    MinStackCacheDisplacement = Min;
+    MaxStackCacheDisplacement = Max;
+  }
+
+  /// hasStackCacheDisplacement - Check whether the stack cache analysis
+  /// bounded the displacement of the function.
+  bool hasStackCacheDisplacement() const {
+    return MaxStackCacheDisplacement != UINT_MAX;
+  }
+
+  unsigned getMinStackCacheDisplacement() const {
+    return MinStackCacheDisplacement;
+  }
+
+  unsigned getMaxStackCacheDisplacement() const {
+    return MaxStackCacheDisplacement;
+  }
+
+  /// isInterruptHandler - Check whether the function is an interrupt handler.
+  bool isInterruptHandler() const {
+    return InterruptHandler;
+  }
+
+  /// getInterruptOccupancyFI - Get the FI keeping the stack cache occupancy
+  /// of the interrupted code, -1 if there is none.
+  int getInterruptOccupancyFI() const {
+    return InterruptOccupancyFI;
+  }
+
+  /// setInterruptOccupancyFI - Set the FI keeping the stack cache occupancy
+  /// of the interrupted code.
+  void setInterruptOccupancyFI(int fi) {
+    InterruptOccupancyFI = fi;
+  }
+
   PatmosAnalysisInfo &getAnalysisInfo() { return AnalysisInfo; }
 
   const PatmosAnalysisInfo &getAnalysisInfo() const { return AnalysisInfo; }
 
+  /// getSinglePathScopes - Return the SPScope tree built for the function
+  /// with the given hash, or null if it has to be rebuilt.
+  std::shared_ptr<SPScope> getSinglePathScopes(hash_code hash) const {
+    return hash == SinglePathScopesHash ? SinglePathScopes : nullptr;
+  }
+
+  /// setSinglePathScopes - Cache the SPScope tree built for the function
+  /// with the given hash.
+  void setSinglePathScopes(std::shared_ptr<SPScope> scopes, hash_code hash) {
+    SinglePathScopes = scopes;
+    SinglePathScopesHash = hash;
+  }
+
+  /// getCachedBlockSize - Get the cached size of a basic block in bytes, -1
+  /// if it is not known.
+  int getCachedBlockSize(const MachineBasicBlock *MBB) const {
+    auto it = BlockSizes.find(MBB);
+    return it != BlockSizes.end() ? (int)it->second : -1;
+  }
+
+  /// setCachedBlockSize - Cache the size of a basic block in bytes.
+  void setCachedBlockSize(const MachineBasicBlock *MBB, unsigned size) const {
+    BlockSizes[MBB] = size;
+  }
+
+  /// adjustBlockSize - Account for instructions of the given total size
+  /// inserted into (positive) or removed from (negative) a basic block.
+  void adjustBlockSize(const MachineBasicBlock *MBB, int delta) {
+    auto it = BlockSizes.find(MBB);
+    if (it != BlockSizes.end()) {
+      assert((int)it->second + delta >= 0 && "Negative block size");
+      it->second += delta;
+    }
+  }
+
+  /// invalidateBlockSize - Drop the cached size of a basic block.
+  void invalidateBlockSize(const MachineBasicBlock *MBB) {
+    BlockSizes.erase(MBB);
+  }
+
+  /// invalidateBlockSizes - Drop the cached sizes of all basic blocks.
+  void invalidateBlockSizes() {
+    BlockSizes.clear();
+  }
+
+  /// hasTracingSleds - Check whether the function is traced by sleds.
+  bool hasTracingSleds() const { return TracingSledsEnabled; }
+
+  /// setTracingSleds - Mark the function as traced by sleds.
+  void setTracingSleds(bool enabled = true) { TracingSledsEnabled = enabled; }
+
+  /// addTracingSled - Record a sled of the function and its instructions.
+  void addTracingSled(const PatmosTracingSled &Sled,
+                      ArrayRef<const MachineInstr*> Instrs) {
+    TracingSleds.push_back(Sled);
+    TracingSledInstrs.insert(Instrs.begin(), Instrs.end());
+  }
+
+  const std::vector<PatmosTracingSled> &getTracingSleds() const {
+    return TracingSleds;
+  }
+
+  /// isTracingSledInstr - Check whether the instruction belongs to a sled.
+  bool isTracingSledInstr(const MachineInstr *MI) const {
+    return TracingSledInstrs.count(MI);
+  }
+
 };
 
 } // End llvm namespace
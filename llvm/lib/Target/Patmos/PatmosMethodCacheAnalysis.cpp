@@ -0,0 +1,295 @@
+//===-- PatmosMethodCacheAnalysis.cpp - Analysis of method-cache usage. ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Classify the method cache accesses of calls and returns based on an
+// machine-level call graph.
+//
+// The footprint of a function is the size of its code and the code of all
+// functions it may call, directly or indirectly; it is unbounded if an unknown
+// function may be called. Code sizes are rounded up to the subfunction
+// alignment, to account for the allocation granularity of the method cache.
+//
+// A call fetches the entry region of the callee, a return fetches the region
+// of the call site again. For every call site:
+//   - if the footprint of the caller fits into the method cache, the code
+//     fetched by the call and the return is loaded at most once per
+//     activation of the caller: first-miss. Once loaded, only code of that
+//     footprint is fetched until the caller returns, which does not evict it,
+//     neither under FIFO nor under LRU replacement.
+//   - with LRU replacement, the region of the call site is the most recently
+//     used one when the call is executed. If it fits into the method cache
+//     together with the footprint of the callee, the return always hits.
+//   - otherwise, the access may miss every time: always-miss.
+//
+// The results are exported per call instruction into the PML file.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "MachineModulePass.h"
+#include "PatmosCallGraphBuilder.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosMethodCacheAnalysis.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <set>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-method-cache-analysis"
+
+STATISTIC(AlwaysHitReturns, "Returns that always hit in the method cache");
+STATISTIC(FirstMissCalls, "Calls that miss at most once per caller activation");
+STATISTIC(FirstMissReturns,
+          "Returns that miss at most once per caller activation");
+STATISTIC(AlwaysMissCalls, "Calls that may always miss in the method cache");
+STATISTIC(AlwaysMissReturns,
+          "Returns that may always miss in the method cache");
+
+/// Footprint of a call graph node, if it is unbounded.
+static const unsigned Unbounded = ~0U;
+
+namespace {
+  /// Replacement policies of the method cache.
+  enum MethodCachePolicy { MCP_FIFO, MCP_LRU };
+}
+
+static cl::opt<MethodCachePolicy> Policy(
+  "mpatmos-method-cache-policy",
+  cl::init(MCP_FIFO),
+  cl::desc("Replacement policy of the method cache assumed by the method "
+           "cache analysis."),
+  cl::values(clEnumValN(MCP_FIFO, "fifo", "FIFO replacement (default)"),
+             clEnumValN(MCP_LRU, "lru", "LRU replacement")),
+  cl::Hidden);
+
+INITIALIZE_PASS(PatmosMethodCacheAnalysisInfo, "mcainfo",
+                "Method Cache Analysis Info", false, true)
+
+namespace llvm {
+char PatmosMethodCacheAnalysisInfo::ID = 0;
+
+ModulePass *createPatmosMethodCacheAnalysisInfo(const PatmosTargetMachine &tm) {
+  return new PatmosMethodCacheAnalysisInfo(tm);
+}
+}
+
+namespace {
+  /// Pass to classify the method cache accesses of calls and returns.
+  class PatmosMethodCacheAnalysis : public MachineModulePass {
+  private:
+    const PatmosSubtarget &STC;
+    const PatmosInstrInfo &TII;
+
+    /// The code size of each function.
+    std::map<const MCGNode*, unsigned> Sizes;
+
+    /// The footprint of each function.
+    std::map<const MCGNode*, unsigned> Footprints;
+
+    /// getAllocatedSize - Size of code in the method cache.
+    unsigned getAllocatedSize(unsigned Size) const
+    {
+      return alignTo(Size, STC.getMinSubfunctionAlignment().value());
+    }
+
+    /// getRegionSizes - Compute the allocated size of the region of every
+    /// block of a function, and return the size of the function.
+    unsigned getRegionSizes(const MachineFunction &MF,
+                        std::map<const MachineBasicBlock*, unsigned> &Regions)
+    {
+      const PatmosMachineFunctionInfo *PMFI =
+                                       MF.getInfo<PatmosMachineFunctionInfo>();
+
+      unsigned Total = 0;
+      std::vector<const MachineBasicBlock*> Region;
+      unsigned RegionSize = 0;
+      for(MachineFunction::const_iterator i(MF.begin()), ie(MF.end());
+          i != ie; i++) {
+        if (i != MF.begin() && PMFI->isMethodCacheRegionEntry(&*i)) {
+          Total += getAllocatedSize(RegionSize);
+          for(std::vector<const MachineBasicBlock*>::iterator
+              j(Region.begin()), je(Region.end()); j != je; j++) {
+            Regions[*j] = getAllocatedSize(RegionSize);
+          }
+          Region.clear();
+          RegionSize = 0;
+        }
+
+        Region.push_back(&*i);
+        RegionSize += TII.getBlockSize(*i);
+      }
+
+      Total += getAllocatedSize(RegionSize);
+      for(std::vector<const MachineBasicBlock*>::iterator j(Region.begin()),
+          je(Region.end()); j != je; j++) {
+        Regions[*j] = getAllocatedSize(RegionSize);
+      }
+      return Total;
+    }
+
+    /// getFootprint - Return the footprint of a call graph node.
+    unsigned getFootprint(const MCGNode *N)
+    {
+      std::map<const MCGNode*, unsigned>::iterator F = Footprints.find(N);
+      if (F != Footprints.end())
+        return F->second;
+
+      // collect all functions reachable from N
+      std::set<const MCGNode*> Reachable;
+      std::vector<const MCGNode*> WL(1, N);
+      unsigned Footprint = 0;
+      while (!WL.empty()) {
+        const MCGNode *M = WL.back();
+        WL.pop_back();
+
+        if (!Reachable.insert(M).second)
+          continue;
+
+        std::map<const MCGNode*, unsigned>::iterator S = Sizes.find(M);
+        if (M->isUnknown() || S == Sizes.end()) {
+          Footprint = Unbounded;
+          break;
+        }
+        Footprint += S->second;
+
+        for(MCGSites::const_iterator i(M->getSites().begin()),
+            ie(M->getSites().end()); i != ie; i++) {
+          WL.push_back((*i)->getCallee());
+        }
+      }
+
+      Footprints[N] = Footprint;
+      return Footprint;
+    }
+
+    /// fits - Check whether code of the given sizes fits into the cache.
+    bool fits(unsigned A, unsigned B = 0) const
+    {
+      unsigned Size = STC.getMethodCacheSize();
+      return A != Unbounded && B != Unbounded && A <= Size && B <= Size - A;
+    }
+
+  public:
+    /// Pass ID
+    static char ID;
+
+    PatmosMethodCacheAnalysis(const PatmosTargetMachine &tm) :
+        MachineModulePass(ID), STC(*tm.getSubtargetImpl()),
+        TII(*tm.getInstrInfo())
+    {
+      initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
+    }
+
+    StringRef getPassName() const override {
+      return "Patmos Method Cache Analysis";
+    }
+
+    /// getAnalysisUsage - Inform the pass manager that nothing is modified.
+    void getAnalysisUsage(AnalysisUsage &AU) const override
+    {
+      AU.setPreservesAll();
+      AU.addRequired<PatmosCallGraphBuilder>();
+      AU.addRequired<PatmosMethodCacheAnalysisInfo>();
+
+      ModulePass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineModule(const Module &M) override
+    {
+      PatmosCallGraphBuilder &PCGB = getAnalysis<PatmosCallGraphBuilder>();
+      PatmosMethodCacheAnalysisInfo &MCAI =
+                                   getAnalysis<PatmosMethodCacheAnalysisInfo>();
+
+      // the size of every function, and the region sizes of its blocks
+      std::map<const MachineBasicBlock*, unsigned> Regions;
+      const MCGNodes &Nodes = PCGB.getNodes();
+      for(MCGNodes::const_iterator i(Nodes.begin()), ie(Nodes.end());
+          i != ie; i++) {
+        if (!(*i)->isUnknown())
+          Sizes[*i] = getRegionSizes(*(*i)->getMF(), Regions);
+      }
+
+      for(MCGNodes::const_iterator i(Nodes.begin()), ie(Nodes.end());
+          i != ie; i++) {
+        const MCGNode *Caller = *i;
+        if (Caller->isUnknown())
+          continue;
+
+        bool CallerFits = fits(getFootprint(Caller));
+
+        const MachineFunction *MF = Caller->getMF();
+        for(MachineFunction::const_iterator j(MF->begin()), je(MF->end());
+            j != je; j++) {
+          for(MachineBasicBlock::const_instr_iterator k(j->instr_begin()),
+              ke(j->instr_end()); k != ke; k++) {
+            if (k->isBundle() || !k->isCall())
+              continue;
+
+            MCGSite *Site = Caller->findSite(&*k);
+            unsigned CalleeFootprint = Site ?
+                                  getFootprint(Site->getCallee()) : Unbounded;
+
+            PatmosMethodCacheAnalysisInfo::CallSiteClass C;
+            yaml::MethodCacheClass Persistent = CallerFits ?
+                               yaml::mc_first_miss : yaml::mc_always_miss;
+            C.Call = Persistent;
+            C.Return = Persistent;
+            if (Policy == MCP_LRU && fits(Regions[&*j], CalleeFootprint))
+              C.Return = yaml::mc_always_hit;
+
+            if (C.Call == yaml::mc_first_miss) FirstMissCalls++;
+            else AlwaysMissCalls++;
+            if (C.Return == yaml::mc_always_hit) AlwaysHitReturns++;
+            else if (C.Return == yaml::mc_first_miss) FirstMissReturns++;
+            else AlwaysMissReturns++;
+
+            MCAI.CallSites[&*k] = C;
+          }
+        }
+      }
+
+      LLVM_DEBUG(
+        for(MCGNodes::const_iterator i(Nodes.begin()), ie(Nodes.end());
+            i != ie; i++) {
+          if ((*i)->isUnknown())
+            continue;
+          dbgs() << "Method cache footprint of " << (*i)->getLabel() << ": ";
+          if (Footprints[*i] == Unbounded)
+            dbgs() << "unbounded\n";
+          else
+            dbgs() << Footprints[*i] << " bytes\n";
+        }
+      );
+
+      MCAI.setValid();
+
+      Sizes.clear();
+      Footprints.clear();
+
+      return false;
+    }
+  };
+
+  char PatmosMethodCacheAnalysis::ID = 0;
+}
+
+/// createPatmosMethodCacheAnalysis - Returns a new PatmosMethodCacheAnalysis.
+ModulePass *
+llvm::createPatmosMethodCacheAnalysis(const PatmosTargetMachine &tm) {
+  return new PatmosMethodCacheAnalysis(tm);
+}
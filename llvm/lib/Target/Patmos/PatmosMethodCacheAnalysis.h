@@ -0,0 +1,58 @@
+//===-- PatmosMethodCacheAnalysis.h - Analysis of the method-cache usage. -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Analysis results from the method cache analysis.
+// This is a dummy pass that holds analysis results when the method cache
+// analysis runs, in the same way as PatmosStackCacheAnalysisInfo.
+//
+//===----------------------------------------------------------------------===//
+#ifndef PATMOSMETHODCACHEANALYSIS
+#define PATMOSMETHODCACHEANALYSIS
+
+#include "PML.h"
+
+namespace llvm {
+
+class PatmosMethodCacheAnalysisInfo : public ImmutablePass {
+  bool Valid;
+
+public:
+  PatmosMethodCacheAnalysisInfo(const TargetMachine &TM) : ImmutablePass(ID),
+    Valid(false) {
+      initializePatmosMethodCacheAnalysisInfoPass(
+                                           *PassRegistry::getPassRegistry());
+    }
+
+  PatmosMethodCacheAnalysisInfo()
+    : ImmutablePass(ID), Valid(false) {
+    llvm_unreachable("should not be implicitly constructed");
+  }
+
+  // the analysis info (pass) will always be available, with isValid() we can
+  // tell whether the analysis was run
+  void setValid() { Valid = true; }
+  bool isValid() const { return Valid; }
+
+  /// The classification of the callee's entry region fetched by a call, and
+  /// of the caller's region fetched again on return.
+  struct CallSiteClass {
+    yaml::MethodCacheClass Call;
+    yaml::MethodCacheClass Return;
+  };
+
+  typedef std::map<const MachineInstr*, CallSiteClass> CallSiteClasses;
+
+  CallSiteClasses CallSites;
+
+  static char ID; // Pass identification, replacement for typeid
+};
+
+} // End llvm namespace
+
+#endif
@@ -0,0 +1,415 @@
+//===-- PatmosMethodCacheLayout.cpp - Order functions for the method cache-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass decides the order of the functions of a module in memory, based
+// on the machine-level call graph.
+//
+// Callers and callees are merged into chains of functions, starting with the
+// pairs with the most call sites, where a call site inside a loop or a
+// recursion counts -mpatmos-method-cache-layout-loop-weight times. Chains are
+// only merged while the size of the merged chain does not exceed the method
+// cache, so the functions of a chain, including their subfunctions, occupy
+// disjoint parts of a cache of that size, and callers and callees of a chain do
+// not evict each other in a direct-mapped or set-associative cache. Within a
+// chain, the caller and the callee are placed as close as possible. The chains
+// are then emitted with the most frequent callers first; functions without
+// calls keep their original order.
+//
+// A fully associative method cache with FIFO or LRU replacement does not
+// depend on the addresses of the functions. The layout then still keeps the
+// code that is executed together close in memory.
+//
+// When the functions are placed by the linker instead, e.g., when the program
+// is compiled in partitions, the weights of the calls are emitted as the
+// call-graph profile of the object file (.llvm.call-graph-profile). The linker
+// clusters the function sections of callers and callees by these weights,
+// again within the size of the method cache. A call-graph profile from PGO is
+// kept as it is.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosCallGraphBuilder.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-method-cache-layout"
+
+STATISTIC(MergedChains, "Callers and callees placed next to each other");
+STATISTIC(TooLargeChains, "Chains not merged as they exceed the cache size");
+STATISTIC(ProfileEdges,   "Caller-callee pairs in the call-graph profile");
+
+static cl::opt<unsigned> LoopCallWeight(
+  "mpatmos-method-cache-layout-loop-weight",
+  cl::init(10),
+  cl::desc("Weight of a call site inside a loop or a recursion, relative to "
+           "other call sites, when ordering functions (default: 10)."),
+  cl::Hidden);
+
+/// getCallWeight - Return the weight of a call site.
+static unsigned getCallWeight(const MCGSite &Site)
+{
+  return Site.isInSCC() ? LoopCallWeight : 1;
+}
+
+namespace {
+
+  /// A sequence of functions that are placed next to each other.
+  struct FunctionChain {
+    /// The indices of the functions of the chain, in memory order.
+    std::vector<unsigned> Functions;
+
+    /// The code size of the chain in bytes.
+    unsigned Size;
+
+    /// The weight of the calls merged into the chain.
+    unsigned Weight;
+
+    FunctionChain() : Size(0), Weight(0) {}
+  };
+
+  /// A caller and a callee, by increasing function index, and the weight of
+  /// the call sites between them.
+  struct ChainEdge {
+    unsigned A, B;
+    unsigned Weight;
+
+    bool operator<(const ChainEdge &o) const {
+      // highest weight first, deterministic otherwise
+      if (Weight != o.Weight)
+        return Weight > o.Weight;
+      if (A != o.A)
+        return A < o.A;
+      return B < o.B;
+    }
+  };
+
+  class PatmosMethodCacheLayout : public ModulePass {
+  private:
+    const PatmosSubtarget &STC;
+    const PatmosInstrInfo &TII;
+
+    /// The functions with machine code, in their original order, and their
+    /// sizes.
+    std::vector<Function*> Functions;
+    std::vector<unsigned> Sizes;
+
+    /// The chain of every function.
+    std::vector<unsigned> ChainOf;
+    std::vector<FunctionChain> Chains;
+
+    /// getCodeSize - Return the size of a function in memory in bytes,
+    /// including the size words and the alignment of its subfunctions.
+    unsigned getCodeSize(const MachineFunction &MF) const
+    {
+      const PatmosMachineFunctionInfo *PMFI =
+                                       MF.getInfo<PatmosMachineFunctionInfo>();
+      unsigned Align = STC.getMinSubfunctionAlignment().value();
+
+      unsigned Size = 0;
+      for(MachineFunction::const_iterator i(MF.begin()), ie(MF.end());
+          i != ie; i++) {
+        if (i == MF.begin() || PMFI->isMethodCacheRegionEntry(&*i)) {
+          Size = alignTo(Size + 4, Align);
+        }
+        Size += TII.getBlockSize(*i);
+      }
+      return Size;
+    }
+
+    /// getOffset - Return the offset of a function within its chain.
+    unsigned getOffset(const FunctionChain &C, unsigned F) const
+    {
+      unsigned Offset = 0;
+      for(std::vector<unsigned>::const_iterator i(C.Functions.begin()),
+          ie(C.Functions.end()); i != ie && *i != F; i++) {
+        Offset += Sizes[*i];
+      }
+      return Offset;
+    }
+
+    /// mergeChains - Try to place the chain of B next to the chain of A, such
+    /// that A and B are close to each other.
+    void mergeChains(const ChainEdge &E)
+    {
+      unsigned CA = ChainOf[E.A], CB = ChainOf[E.B];
+      if (CA == CB)
+        return;
+
+      FunctionChain &First = Chains[CA], &Second = Chains[CB];
+      if (First.Size + Second.Size > STC.getMethodCacheSize()) {
+        TooLargeChains++;
+        return;
+      }
+
+      // the distance of A and B for the chain of B after the chain of A, and
+      // for the chain of A after the chain of B
+      unsigned AAfterB = getOffset(First, E.A) +
+                         Second.Size - getOffset(Second, E.B);
+      unsigned BAfterA = getOffset(Second, E.B) +
+                         First.Size - getOffset(First, E.A);
+
+      FunctionChain Merged;
+      const FunctionChain &Head = BAfterA <= AAfterB ? First : Second;
+      const FunctionChain &Tail = BAfterA <= AAfterB ? Second : First;
+      Merged.Functions = Head.Functions;
+      Merged.Functions.insert(Merged.Functions.end(), Tail.Functions.begin(),
+                              Tail.Functions.end());
+      Merged.Size = First.Size + Second.Size;
+      Merged.Weight = First.Weight + Second.Weight + E.Weight;
+
+      for(std::vector<unsigned>::iterator i(Second.Functions.begin()),
+          ie(Second.Functions.end()); i != ie; i++) {
+        ChainOf[*i] = CA;
+      }
+      Chains[CA] = Merged;
+      Chains[CB] = FunctionChain();
+
+      MergedChains++;
+    }
+
+  public:
+    /// Pass ID
+    static char ID;
+
+    PatmosMethodCacheLayout(const PatmosTargetMachine &tm) :
+        ModulePass(ID), STC(*tm.getSubtargetImpl()), TII(*tm.getInstrInfo())
+    {
+      initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
+    }
+
+    StringRef getPassName() const override {
+      return "Patmos Method Cache Layout";
+    }
+
+    /// getAnalysisUsage - The pass only changes the order of the functions.
+    void getAnalysisUsage(AnalysisUsage &AU) const override
+    {
+      AU.setPreservesAll();
+      AU.addRequired<MachineModuleInfoWrapperPass>();
+      AU.addRequired<PatmosCallGraphBuilder>();
+
+      ModulePass::getAnalysisUsage(AU);
+    }
+
+    bool runOnModule(Module &M) override
+    {
+      MachineModuleInfo &MMI =
+                         getAnalysis<MachineModuleInfoWrapperPass>().getMMI();
+      PatmosCallGraphBuilder &PCGB = getAnalysis<PatmosCallGraphBuilder>();
+
+      Functions.clear();
+      Sizes.clear();
+      std::map<const MachineFunction*, unsigned> Index;
+      for(Module::iterator i(M.begin()), ie(M.end()); i != ie; i++) {
+        if (MachineFunction *MF = MMI.getMachineFunction(*i)) {
+          Index[MF] = Functions.size();
+          Functions.push_back(&*i);
+          Sizes.push_back(getCodeSize(*MF));
+        }
+      }
+
+      // collect the weights of calls between pairs of functions
+      std::map<std::pair<unsigned, unsigned>, unsigned> Weights;
+      const MCGSites &Sites = PCGB.getSites();
+      for(MCGSites::const_iterator i(Sites.begin()), ie(Sites.end()); i != ie;
+          i++) {
+        MCGNode *Caller = (*i)->getCaller(), *Callee = (*i)->getCallee();
+        if (Caller->isUnknown() || Callee->isUnknown() ||
+            Caller == Callee) {
+          continue;
+        }
+
+        std::map<const MachineFunction*, unsigned>::iterator A =
+                                                  Index.find(Caller->getMF());
+        std::map<const MachineFunction*, unsigned>::iterator B =
+                                                  Index.find(Callee->getMF());
+        if (A == Index.end() || B == Index.end())
+          continue;
+
+        std::pair<unsigned, unsigned> Key(std::min(A->second, B->second),
+                                          std::max(A->second, B->second));
+        Weights[Key] += getCallWeight(**i);
+      }
+
+      std::vector<ChainEdge> Edges;
+      for(std::map<std::pair<unsigned, unsigned>, unsigned>::iterator
+          i(Weights.begin()), ie(Weights.end()); i != ie; i++) {
+        ChainEdge E = { i->first.first, i->first.second, i->second };
+        Edges.push_back(E);
+      }
+      std::sort(Edges.begin(), Edges.end());
+
+      // start with a chain per function, merge along the heaviest calls
+      ChainOf.resize(Functions.size());
+      Chains.assign(Functions.size(), FunctionChain());
+      for(unsigned i = 0; i < Functions.size(); i++) {
+        ChainOf[i] = i;
+        Chains[i].Functions.push_back(i);
+        Chains[i].Size = Sizes[i];
+      }
+
+      for(std::vector<ChainEdge>::iterator i(Edges.begin()), ie(Edges.end());
+          i != ie; i++) {
+        mergeChains(*i);
+      }
+
+      // order the chains by weight, keeping the original order otherwise
+      std::vector<unsigned> Order;
+      for(unsigned i = 0; i < Chains.size(); i++) {
+        if (!Chains[i].Functions.empty())
+          Order.push_back(i);
+      }
+      std::stable_sort(Order.begin(), Order.end(),
+                       [this](unsigned a, unsigned b) {
+                         return Chains[a].Weight > Chains[b].Weight;
+                       });
+
+      // move the functions to the end of the module in the new order
+      bool Changed = false;
+      unsigned Position = 0;
+      Module::FunctionListType &FL = M.getFunctionList();
+      for(std::vector<unsigned>::iterator i(Order.begin()), ie(Order.end());
+          i != ie; i++) {
+        const std::vector<unsigned> &C = Chains[*i].Functions;
+        for(std::vector<unsigned>::const_iterator j(C.begin()), je(C.end());
+            j != je; j++) {
+          Changed |= *j != Position++;
+          FL.splice(FL.end(), FL, Functions[*j]->getIterator());
+
+          LLVM_DEBUG(dbgs() << "Method cache layout: "
+                            << Functions[*j]->getName() << " ("
+                            << Sizes[*j] << " bytes)\n");
+        }
+      }
+
+      return Changed;
+    }
+  };
+
+  char PatmosMethodCacheLayout::ID = 0;
+
+  /// Emits the weights of the calls as the call-graph profile of the module,
+  /// which the linker uses to order the function sections.
+  class PatmosCallGraphProfile : public ModulePass {
+  private:
+    /// getCallee - Return the function called by a call site, also if no
+    /// machine code exists for it in this module.
+    Function *getCallee(Module &M, const MCGSite &Site) const
+    {
+      MCGNode *Callee = Site.getCallee();
+      if (!Callee->isUnknown())
+        return &Callee->getMF()->getFunction();
+
+      const MachineOperand &MO = Site.getMI()->getOperand(2);
+      if (MO.isGlobal())
+        return M.getFunction(MO.getGlobal()->getName());
+      if (MO.isSymbol())
+        return M.getFunction(MO.getSymbolName());
+      return NULL;
+    }
+
+  public:
+    /// Pass ID
+    static char ID;
+
+    PatmosCallGraphProfile() : ModulePass(ID)
+    {
+      initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
+    }
+
+    StringRef getPassName() const override {
+      return "Patmos Call Graph Profile";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override
+    {
+      AU.setPreservesAll();
+      AU.addRequired<MachineModuleInfoWrapperPass>();
+      AU.addRequired<PatmosCallGraphBuilder>();
+
+      ModulePass::getAnalysisUsage(AU);
+    }
+
+    bool runOnModule(Module &M) override
+    {
+      // measured weights are better than ours
+      if (M.getModuleFlag("CG Profile"))
+        return false;
+
+      PatmosCallGraphBuilder &PCGB = getAnalysis<PatmosCallGraphBuilder>();
+
+      MapVector<std::pair<Function*, Function*>, uint64_t> Counts;
+      const MCGSites &Sites = PCGB.getSites();
+      for(MCGSites::const_iterator i(Sites.begin()), ie(Sites.end()); i != ie;
+          i++) {
+        MCGNode *Caller = (*i)->getCaller();
+        if (Caller->isUnknown())
+          continue;
+
+        Function *From = &Caller->getMF()->getFunction();
+        Function *To = getCallee(M, **i);
+        if (!To || From == To)
+          continue;
+
+        Counts[std::make_pair(From, To)] += getCallWeight(**i);
+      }
+
+      if (Counts.empty())
+        return false;
+
+      LLVMContext &Context = M.getContext();
+      MDBuilder MDB(Context);
+      std::vector<Metadata*> Nodes;
+      for(MapVector<std::pair<Function*, Function*>, uint64_t>::iterator
+          i(Counts.begin()), ie(Counts.end()); i != ie; i++) {
+        Metadata *Vals[] = {ValueAsMetadata::get(i->first.first),
+                            ValueAsMetadata::get(i->first.second),
+                            MDB.createConstant(ConstantInt::get(
+                                Type::getInt64Ty(Context), i->second))};
+        Nodes.push_back(MDNode::get(Context, Vals));
+      }
+      M.addModuleFlag(Module::Append, "CG Profile",
+                      MDNode::get(Context, Nodes));
+      ProfileEdges += Nodes.size();
+      return true;
+    }
+  };
+
+  char PatmosCallGraphProfile::ID = 0;
+} // end of anonymous namespace
+
+/// createPatmosMethodCacheLayoutPass - Returns a new PatmosMethodCacheLayout
+/// \see PatmosMethodCacheLayout
+ModulePass *
+llvm::createPatmosMethodCacheLayoutPass(const PatmosTargetMachine &tm) {
+  return new PatmosMethodCacheLayout(tm);
+}
+
+/// createPatmosCallGraphProfilePass - Returns a new PatmosCallGraphProfile
+/// \see PatmosCallGraphProfile
+ModulePass *llvm::createPatmosCallGraphProfilePass() {
+  return new PatmosCallGraphProfile();
+}
@@ -22,6 +22,7 @@
 
 #include "Patmos.h"
 #include "PatmosPostRAScheduler.h"
+#include "PatmosDataCacheAnalysis.h"
 #include "PatmosSchedStrategy.h"
 #include "PatmosTargetMachine.h"
 #include "PatmosMachineFunctionInfo.h"
@@ -59,6 +60,7 @@ STATISTIC(NumFixedAnti, "Number of fixed anti-dependencies");
 STATISTIC(NumBundled, "Number of bundles with size > 1");
 STATISTIC(NumNotBundled, "Number of instructions not bundled");
 STATISTIC(NumRescheduled, "Number of rescheduled instructions");
+STATISTIC(NumSuccFilled,  "Number of delay slots filled from successor blocks");
 
 static cl::opt<bool> ViewPostRASchedDAGs("view-postra-sched-dags", cl::Hidden,
   cl::desc("Pop up a window to show PostRASched dags after they are processed"));
@@ -70,6 +72,20 @@ EnableAntiDepBreaking("mpatmos-break-anti-dependencies",
                                "\"critical\", \"all\", or \"none\""),
                       cl::Hidden);
 
+static cl::opt<bool> ClusterCacheBlocks(
+  "mpatmos-sched-cluster-cache-blocks",
+  cl::init(false),
+  cl::desc("Schedule the first load of a data cache block before the other "
+           "loads of the block, which then hit behind its miss."),
+  cl::Hidden);
+
+static cl::opt<bool> DisableSuccessorDelayFill(
+  "mpatmos-disable-successor-delay-fill",
+  cl::init(false),
+  cl::desc("Do not move instructions from successor blocks into NOP delay "
+           "slots of branches."),
+  cl::Hidden);
+
 
 // DAG subtrees must have at least this many nodes.
 static const unsigned MinSubtreeSize = 8;
@@ -132,6 +148,165 @@ nextIfDebug(MachineBasicBlock::iterator I, MachineBasicBlock::iterator End) {
 }
 
 
+/// Mark the register and all its aliases in the set.
+static void markRegister(BitVector &Set, Register Reg,
+                         const TargetRegisterInfo *TRI) {
+  for (MCRegAliasIterator AI(Reg, TRI, true); AI.isValid(); ++AI)
+    Set.set(*AI);
+}
+
+/// Check if the bundle at the start of Succ can be executed in a delay slot
+/// of its predecessor instead. Defs and Uses contain the registers written
+/// and read by the predecessor. If Other is set, the delay slot is also
+/// executed on the path to Other, so the bundle must not have side effects
+/// and must not clobber any register live into Other.
+static bool canMoveIntoDelaySlot(MachineBasicBlock::iterator Bundle,
+                                 const BitVector &Defs, const BitVector &Uses,
+                                 const MachineBasicBlock *Other,
+                                 const TargetRegisterInfo *TRI)
+{
+  MachineBasicBlock::instr_iterator MI = Bundle.getInstrIterator();
+  do {
+    if (MI->isDebugInstr() || MI->isLabel() || MI->isCFIInstruction() ||
+        MI->isInlineAsm() || MI->isPseudo() || MI->hasDelaySlot() ||
+        MI->isTerminator() || MI->isCall() ||
+        MI->hasUnmodeledSideEffects() ||
+        PatmosInstrInfo::isStackControl(&*MI) ||
+        MI->getFlag(MachineInstr::FrameSetup)) {
+      return false;
+    }
+
+    if (Other && (MI->mayLoad() || MI->mayStore()))
+      return false;
+
+    for (const MachineOperand &MO : MI->operands()) {
+      if (!MO.isReg() || !MO.getReg()) continue;
+      Register Reg = MO.getReg();
+
+      // The predecessor's results are only guaranteed to be available at the
+      // end of the block, and must not be overwritten before its instructions
+      // have completed.
+      if (Defs.test(Reg)) return false;
+      if (MO.isDef() && Uses.test(Reg)) return false;
+
+      if (MO.isDef() && Other) {
+        for (MCRegAliasIterator AI(Reg, TRI, true); AI.isValid(); ++AI) {
+          if (Other->isLiveIn(*AI)) return false;
+        }
+      }
+    }
+  } while ((MI++)->isBundledWithSucc());
+
+  return true;
+}
+
+/// Replace NOPs in the delay slots of the branch at the end of MBB with the
+/// first bundles of a successor that has MBB as its only predecessor. The
+/// bundles are independent of MBB, so moving them up does not violate any
+/// latency.
+static bool fillDelaySlotsFromSuccessor(MachineBasicBlock &MBB,
+                                        const PatmosTargetMachine &PTM)
+{
+  const PatmosSubtarget &PST = *PTM.getSubtargetImpl();
+  const PatmosInstrInfo &PII = *PTM.getInstrInfo();
+  const TargetRegisterInfo *TRI = PTM.getRegisterInfo();
+
+  // Find the only instruction with delay slots in the block.
+  MachineBasicBlock::iterator CFLBundle = MBB.end();
+  MachineInstr *CFL = NULL;
+  for (MachineBasicBlock::instr_iterator MI = MBB.instr_begin(),
+         ME = MBB.instr_end(); MI != ME; ++MI) {
+    if (!MI->hasDelaySlot()) continue;
+    if (CFL) return false;
+    CFL = &*MI;
+    CFLBundle = getBundleStart(MI);
+  }
+
+  if (!CFL || !CFL->isBranch() || CFL->isIndirectBranch() ||
+      CFL->isCall() || CFL->isReturn()) {
+    return false;
+  }
+
+  // The delay slots must end the block.
+  SmallVector<MachineBasicBlock::iterator, 4> NOPs;
+  MachineBasicBlock::iterator Slot = std::next(CFLBundle);
+  for (unsigned i = 0, e = PST.getDelaySlotCycles(*CFL); i < e; i++, Slot++) {
+    if (Slot == MBB.end()) return false;
+    if (Slot->getOpcode() == Patmos::NOP && !Slot->isBundled())
+      NOPs.push_back(Slot);
+  }
+  if (Slot != MBB.end() || NOPs.empty()) return false;
+
+  // Collect the candidate successors. The delay slots of a conditional branch
+  // are executed on both paths.
+  MachineBasicBlock *Target = PII.getBranchTarget(CFL);
+  MachineBasicBlock *Other = NULL;
+  if (PII.isPredicated(*CFL)) {
+    if (MBB.succ_size() != 2) return false;
+    Other = *MBB.succ_begin() == Target ? *std::next(MBB.succ_begin())
+                                        : *MBB.succ_begin();
+  } else if (MBB.succ_size() != 1) {
+    return false;
+  }
+
+  BitVector Defs(TRI->getNumRegs()), Uses(TRI->getNumRegs());
+  for (const MachineInstr &MI : MBB.instrs()) {
+    for (const MachineOperand &MO : MI.operands()) {
+      if (!MO.isReg() || !MO.getReg()) continue;
+      markRegister(MO.isDef() ? Defs : Uses, MO.getReg(), TRI);
+    }
+  }
+
+  std::pair<MachineBasicBlock*, MachineBasicBlock*> Candidates[] = {
+    std::make_pair(Target, Other), std::make_pair(Other, Target)
+  };
+
+  for (auto &C : Candidates) {
+    MachineBasicBlock *Succ = C.first;
+    if (!Succ || Succ == &MBB || Succ->pred_size() != 1 ||
+        Succ->hasAddressTaken() || Succ->isEHPad()) {
+      continue;
+    }
+
+    unsigned Filled = 0;
+    for (MachineBasicBlock::iterator NOP : NOPs) {
+      if (Succ->empty() ||
+          !canMoveIntoDelaySlot(Succ->begin(), Defs, Uses, C.second, TRI)) {
+        break;
+      }
+
+      MachineBasicBlock::iterator Bundle = Succ->begin();
+      LLVM_DEBUG(dbgs() << "Filling delay slot of " << *CFL << "  with "
+                        << *Bundle);
+
+      // The results of the moved bundle are now live into the successor.
+      MachineBasicBlock::instr_iterator MI = Bundle.getInstrIterator();
+      do {
+        MI->clearKillInfo();
+        for (const MachineOperand &MO : MI->operands()) {
+          if (MO.isReg() && MO.isDef() && MO.getReg() &&
+              !Succ->isLiveIn(MO.getReg())) {
+            Succ->addLiveIn(MO.getReg());
+          }
+        }
+      } while ((MI++)->isBundledWithSucc());
+
+      MBB.splice(NOP, Succ, Bundle);
+      MBB.erase(NOP);
+      Filled++;
+    }
+
+    if (Filled) {
+      Succ->sortUniqueLiveIns();
+      NumSuccFilled += Filled;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
 bool PatmosPostRAScheduler::runOnMachineFunction(MachineFunction &mf) {
 
   if( mf.getInfo<PatmosMachineFunctionInfo>()->isSinglePath()){
@@ -176,10 +351,20 @@ bool PatmosPostRAScheduler::runOnMachineFunction(MachineFunction &mf) {
   // TODO this should be created by some factory..
   const PatmosTargetMachine *PTM =
                       static_cast<const PatmosTargetMachine*>(&mf.getTarget());
-  PostRASchedStrategy *S = new PatmosPostRASchedStrategy(*PTM);
+  PatmosPostRASchedStrategy *S = new PatmosPostRASchedStrategy(*PTM);
+
+  // Space the loads known to miss in the data cache like other main memory
+  // accesses.
+  PatmosDataCacheAnalysisInfo *DCA =
+                         getAnalysisIfAvailable<PatmosDataCacheAnalysisInfo>();
+  if (DCA && DCA->isValid())
+    S->setDataCacheAnalysis(DCA);
 
   std::unique_ptr<ScheduleDAGPostRA> Scheduler(new ScheduleDAGPostRA(this, S));
 
+  if (ClusterCacheBlocks)
+    Scheduler->addMutation(new PatmosCacheBlockClustering(*PTM));
+
   // Visit all machine basic blocks.
   for (MachineFunction::iterator MBB = MF->begin(), MBBEnd = MF->end();
        MBB != MBBEnd; ++MBB) {
@@ -262,6 +447,14 @@ bool PatmosPostRAScheduler::runOnMachineFunction(MachineFunction &mf) {
     assert(EndIndex == 0 && "Instruction count mismatch!");
     Scheduler->finishBlock();
   }
+
+  // The scheduler only fills delay slots from within the region, try to fill
+  // the remaining NOPs with instructions from the successors.
+  if (!DisableSuccessorDelayFill) {
+    for (MachineBasicBlock &MBB : *MF)
+      fillDelaySlotsFromSuccessor(MBB, *PTM);
+  }
+
   Scheduler->finalizeSchedule();
 
   LLVM_DEBUG( dbgs() << "\n********** Finnishing PatmosPostRAScheduler **********\n");
@@ -311,7 +504,7 @@ ScheduleDAGPostRA::~ScheduleDAGPostRA() {
   for (MutationList::iterator it = Mutations.begin(), ie = Mutations.end();
        it != ie; it++)
   {
-    delete &*it;
+    delete *it;
   }
   delete AntiDepBreak;
   delete SchedImpl;
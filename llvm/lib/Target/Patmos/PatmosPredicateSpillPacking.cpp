@@ -0,0 +1,247 @@
+//===-- PatmosPredicateSpillPacking.cpp - Pack predicate spill slots. -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Predicates are spilled by the register allocator to a stack slot of their
+// own, a full word per predicate. This pass packs the predicate spill slots
+// of a function into as few words as possible, one bit per slot, similar to
+// the excess spill slots of single-path code (see PatmosSPReduce).
+//
+// A reload from a packed slot loads the word and tests the bit, a spill sets
+// or clears the bit in the loaded word and stores it back. Consecutive
+// spills to or reloads from the same word share the load and store, which
+// saves memory accesses where several predicates are spilled at once, e.g.,
+// around calls. Packing also shrinks the stack cache frame of the function.
+//
+// The packed words are accessed via RTR, which is also used to compute large
+// frame offsets. Functions with large frames are thus not packed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-predicate-spill-packing"
+
+STATISTIC(PackedSlots, "Predicate spill slots packed into shared words");
+STATISTIC(PackedWords, "Words holding packed predicate spill slots");
+STATISTIC(SharedAccesses, "Predicate spill memory accesses saved by sharing");
+
+namespace {
+
+  class PatmosPredicateSpillPacking : public MachineFunctionPass {
+  private:
+    const PatmosInstrInfo *TII;
+
+    /// The word and bit position of each packed spill slot.
+    std::map<int, std::pair<int, unsigned> > PackedLocs;
+
+    static char ID;
+
+    /// getSlot - Return the frame index of a predicate spill or reload.
+    static int getSlot(const MachineInstr &MI) {
+      return MI.getOperand(
+          MI.getOpcode() == Patmos::PSEUDO_PREG_SPILL ? 0 : 1).getIndex();
+    }
+
+    /// getDisplacement - Return the word displacement of a predicate spill or
+    /// reload relative to its slot.
+    static int64_t getDisplacement(const MachineInstr &MI) {
+      return MI.getOperand(
+          MI.getOpcode() == Patmos::PSEUDO_PREG_SPILL ? 1 : 2).getImm();
+    }
+
+    /// isPacked - Check whether MI spills to or reloads from a packed slot.
+    bool isPacked(const MachineInstr &MI, unsigned Opcode) const {
+      return MI.getOpcode() == Opcode && PackedLocs.count(getSlot(MI));
+    }
+
+    /// collectSlots - Find all spill slots that are only accessed by
+    /// predicate spills and reloads.
+    void collectSlots(MachineFunction &MF, std::vector<int> &Slots) const {
+      const MachineFrameInfo &MFI = MF.getFrameInfo();
+      BitVector Candidates(MFI.getObjectIndexEnd());
+      BitVector Excluded(MFI.getObjectIndexEnd());
+
+      for (MachineBasicBlock &MBB : MF) {
+        for (MachineInstr &MI : MBB.instrs()) {
+          for (const MachineOperand &MO : MI.operands()) {
+            if (!MO.isFI() || MO.getIndex() < 0)
+              continue;
+            int FI = MO.getIndex();
+            bool IsPredSpill = (MI.getOpcode() == Patmos::PSEUDO_PREG_SPILL ||
+                                MI.getOpcode() == Patmos::PSEUDO_PREG_RELOAD)
+                               && !MI.isBundled() && getSlot(MI) == FI &&
+                               getDisplacement(MI) == 0;
+            if (IsPredSpill && MFI.isSpillSlotObjectIndex(FI))
+              Candidates.set(FI);
+            else
+              Excluded.set(FI);
+          }
+        }
+      }
+
+      Candidates.reset(Excluded);
+      for (int FI : Candidates.set_bits())
+        Slots.push_back(FI);
+    }
+
+    /// packRun - Replace a run of spills or reloads of the same packed word
+    /// by a single load, the bit operations and, for spills, a single store.
+    void packRun(MachineBasicBlock &MBB, MachineBasicBlock::iterator First,
+                 MachineBasicBlock::iterator Last, int WordFI, bool IsSpill) {
+      DebugLoc DL = First->getDebugLoc();
+
+      AddDefaultPred(BuildMI(MBB, First, DL, TII->get(Patmos::LWC),
+                             Patmos::RTR))
+        .addFrameIndex(WordFI).addImm(0);
+
+      unsigned Count = 0;
+      for (MachineBasicBlock::iterator I = First; I != Last; ) {
+        MachineInstr &MI = *I++;
+        unsigned Bit = PackedLocs[getSlot(MI)].second;
+
+        if (IsSpill) {
+          const MachineOperand &Src = MI.getOperand(2);
+          Register Pred = Src.getReg();
+
+          // if (pred) RTR |= (1 << bit)
+          uint32_t Mask = 1u << Bit;
+          unsigned OrOpc = isUInt<12>(Mask) ? Patmos::ORi : Patmos::ORl;
+          BuildMI(MBB, MI, MI.getDebugLoc(), TII->get(OrOpc), Patmos::RTR)
+            .addReg(Pred).addImm(0)
+            .addReg(Patmos::RTR).addImm(Mask);
+          // if (!pred) RTR &= ~(1 << bit), not needed for $p0
+          if (Pred != Patmos::P0) {
+            BuildMI(MBB, MI, MI.getDebugLoc(), TII->get(Patmos::ANDl),
+                    Patmos::RTR)
+              .addReg(Pred, getKillRegState(Src.isKill())).addImm(1)
+              .addReg(Patmos::RTR).addImm(~Mask);
+          }
+        } else {
+          AddDefaultPred(BuildMI(MBB, MI, MI.getDebugLoc(),
+                                 TII->get(Patmos::BTESTI),
+                                 MI.getOperand(0).getReg()))
+            .addReg(Patmos::RTR).addImm(Bit);
+        }
+        MI.eraseFromParent();
+        Count++;
+      }
+
+      if (IsSpill) {
+        MachineMemOperand *MMO = MBB.getParent()->getMachineMemOperand(
+            MachinePointerInfo::getFixedStack(*MBB.getParent(), WordFI),
+            MachineMemOperand::MOStore, 4, Align(4));
+        AddDefaultPred(BuildMI(MBB, Last, DL, TII->get(Patmos::SWC)))
+          .addFrameIndex(WordFI).addImm(0)
+          .addReg(Patmos::RTR, RegState::Kill)
+          .addMemOperand(MMO);
+      }
+
+      // a spill used to be two predicated stores, a reload a single load
+      SharedAccesses += IsSpill ? 2 * Count - 2 : Count - 1;
+    }
+
+    /// packBlock - Rewrite the accesses to packed slots in a basic block,
+    /// sharing the memory accesses of consecutive ones.
+    void packBlock(MachineBasicBlock &MBB) {
+      MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end();
+      while (I != E) {
+        bool IsSpill = isPacked(*I, Patmos::PSEUDO_PREG_SPILL);
+        if (!IsSpill && !isPacked(*I, Patmos::PSEUDO_PREG_RELOAD)) {
+          I++;
+          continue;
+        }
+
+        unsigned Opcode = I->getOpcode();
+        int WordFI = PackedLocs[getSlot(*I)].first;
+        MachineBasicBlock::iterator Last = std::next(I);
+        while (Last != E && isPacked(*Last, Opcode) &&
+               PackedLocs[getSlot(*Last)].first == WordFI)
+          Last++;
+
+        packRun(MBB, I, Last, WordFI, IsSpill);
+        I = Last;
+      }
+    }
+
+  public:
+    PatmosPredicateSpillPacking(const PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID),
+        TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Predicate Spill Packing";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesCFG();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override {
+      const PatmosMachineFunctionInfo *PMFI =
+                                       MF.getInfo<PatmosMachineFunctionInfo>();
+      MachineFrameInfo &MFI = MF.getFrameInfo();
+
+      // Single-path code spills its predicates in PatmosSPReduce.
+      if (PMFI->isSinglePath())
+        return false;
+
+      // All word offsets must fit the load and store instructions, RTR
+      // holds the packed word.
+      if (MFI.estimateStackSize(MF) >= 63 * 4)
+        return false;
+
+      std::vector<int> Slots;
+      collectSlots(MF, Slots);
+      if (Slots.size() < 2)
+        return false;
+
+      PackedLocs.clear();
+      int WordFI = -1;
+      for (unsigned i = 0, e = Slots.size(); i != e; i++) {
+        if (i % 32 == 0) {
+          WordFI = MFI.CreateSpillStackObject(4, Align(4));
+          PackedWords++;
+        }
+        PackedLocs[Slots[i]] = std::make_pair(WordFI, i % 32);
+        LLVM_DEBUG(dbgs() << "Packing predicate spill slot FI#" << Slots[i]
+                          << " into bit " << (i % 32) << " of FI#" << WordFI
+                          << " in " << MF.getName() << "\n");
+      }
+
+      for (MachineBasicBlock &MBB : MF)
+        packBlock(MBB);
+
+      for (int FI : Slots)
+        MFI.RemoveStackObject(FI);
+      PackedSlots += Slots.size();
+      return true;
+    }
+  };
+
+  char PatmosPredicateSpillPacking::ID = 0;
+} // end of anonymous namespace
+
+FunctionPass *
+llvm::createPatmosPredicateSpillPackingPass(const PatmosTargetMachine &tm) {
+  return new PatmosPredicateSpillPacking(tm);
+}
@@ -0,0 +1,172 @@
+//===-- PatmosProfileInstrumentation.cpp - Record cycle counts of functions ===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Instrument function entries and exits with reads of the cycle counter.
+//
+// Each event is written into the ring buffer __patmos_profile_buffer, indexed
+// by __patmos_profile_index, which counts all recorded events. An event
+// consists of the address of the function, with bit 0 set for exits, and the
+// 64bit cycle count. The cycle counter is read by llvm.readcyclecounter, which
+// is lowered to uncached loads from the timer device and thus does not
+// disturb the caches.
+//
+// Both globals are weak, the runtime may provide its own buffer, but its size
+// must then match -mpatmos-profile-buffer-size.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-profile"
+
+STATISTIC(NumProfiled, "Number of functions instrumented with cycle counts");
+
+static cl::opt<bool> EnableProfile(
+  "mpatmos-profile-functions",
+  cl::init(false),
+  cl::desc("Record the cycle counter at function entries and exits into a "
+           "ring buffer."));
+
+static cl::list<std::string> ProfileFunctions(
+  "mpatmos-profile-function",
+  cl::desc("Only instrument the given function(s) with "
+           "-mpatmos-profile-functions."),
+  cl::CommaSeparated, cl::Hidden);
+
+static cl::opt<unsigned> ProfileBufferSize(
+  "mpatmos-profile-buffer-size",
+  cl::init(256),
+  cl::desc("Number of events in the profile ring buffer, must be a power of "
+           "two (default: 256)."),
+  cl::Hidden);
+
+namespace {
+  class PatmosProfileInstrumentation : public FunctionPass {
+  private:
+    /// The event record type, { event, cycles }.
+    StructType *EventTy = nullptr;
+
+    GlobalVariable *Buffer = nullptr;
+    GlobalVariable *Index = nullptr;
+
+    /// Emit code to record an event at the insertion point of the builder.
+    void emitEvent(IRBuilder<> &Builder, Function &F, bool IsExit);
+
+    /// Check if the function should be instrumented.
+    bool isProfiled(const Function &F) const;
+
+  public:
+    static char ID;
+
+    PatmosProfileInstrumentation() : FunctionPass(ID) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Profile Instrumentation";
+    }
+
+    bool doInitialization(Module &M) override;
+
+    bool runOnFunction(Function &F) override;
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesCFG();
+    }
+  };
+}
+
+char PatmosProfileInstrumentation::ID = 0;
+
+FunctionPass *llvm::createPatmosProfileInstrumentationPass() {
+  return new PatmosProfileInstrumentation();
+}
+
+bool PatmosProfileInstrumentation::isProfiled(const Function &F) const {
+  if (F.isDeclaration() || F.hasFnAttribute(Attribute::Naked))
+    return false;
+
+  if (ProfileFunctions.empty())
+    return true;
+
+  return is_contained(ProfileFunctions, F.getName());
+}
+
+bool PatmosProfileInstrumentation::doInitialization(Module &M) {
+  if (!EnableProfile)
+    return false;
+
+  if (!isPowerOf2_32(ProfileBufferSize))
+    report_fatal_error("-mpatmos-profile-buffer-size must be a power of two");
+
+  LLVMContext &Ctx = M.getContext();
+  Type *Int32Ty = Type::getInt32Ty(Ctx);
+
+  EventTy = StructType::get(Int32Ty, Type::getInt64Ty(Ctx));
+  ArrayType *BufferTy = ArrayType::get(EventTy, ProfileBufferSize);
+
+  Buffer = new GlobalVariable(M, BufferTy, false, GlobalValue::WeakAnyLinkage,
+                              ConstantAggregateZero::get(BufferTy),
+                              "__patmos_profile_buffer");
+  Index = new GlobalVariable(M, Int32Ty, false, GlobalValue::WeakAnyLinkage,
+                             ConstantInt::get(Int32Ty, 0),
+                             "__patmos_profile_index");
+  return true;
+}
+
+void PatmosProfileInstrumentation::emitEvent(IRBuilder<> &Builder, Function &F,
+                                             bool IsExit) {
+  Module *M = F.getParent();
+  Type *Int32Ty = Builder.getInt32Ty();
+
+  Function *ReadCycles = Intrinsic::getDeclaration(M,
+                                                   Intrinsic::readcyclecounter);
+  Value *Cycles = Builder.CreateCall(ReadCycles);
+
+  Value *Event = Builder.CreatePtrToInt(&F, Int32Ty);
+  if (IsExit)
+    Event = Builder.CreateOr(Event, 1);
+
+  // Index the buffer with the event counter, wrapping around.
+  Value *Count = Builder.CreateLoad(Int32Ty, Index);
+  Value *Slot = Builder.CreateAnd(Count, ProfileBufferSize - 1);
+  Value *Entry = Builder.CreateInBoundsGEP(Buffer->getValueType(), Buffer,
+                                           {Builder.getInt32(0), Slot});
+
+  Builder.CreateStore(Event, Builder.CreateStructGEP(EventTy, Entry, 0));
+  Builder.CreateStore(Cycles, Builder.CreateStructGEP(EventTy, Entry, 1));
+  Builder.CreateStore(Builder.CreateAdd(Count, Builder.getInt32(1)), Index);
+}
+
+bool PatmosProfileInstrumentation::runOnFunction(Function &F) {
+  if (!EnableProfile || !isProfiled(F))
+    return false;
+
+  IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
+  emitEvent(Builder, F, false);
+
+  for (BasicBlock &BB : F) {
+    if (ReturnInst *RI = dyn_cast<ReturnInst>(BB.getTerminator())) {
+      Builder.SetInsertPoint(RI);
+      emitEvent(Builder, F, true);
+    }
+  }
+
+  NumProfiled++;
+  return true;
+}
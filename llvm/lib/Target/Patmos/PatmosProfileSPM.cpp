@@ -0,0 +1,274 @@
+//===-- PatmosProfileSPM.cpp - Keep profile counters in the scratchpad ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Move the counters of -fprofile-instr-generate into the local data
+// scratchpad (SPM), such that their updates become lwl/swl, which never miss
+// in the data cache and thus distort the timing of the instrumented program
+// little. A counter update then is a local load, an addition and a local
+// store, which the scheduler bundles with the code of the block.
+//
+// The counters in main memory are kept, the profile data refers to them and
+// the runtime writes them. The pass therefore defines
+//
+//   void __patmos_profile_spm_flush(void);
+//
+// which copies the counters from the scratchpad to main memory, and which the
+// profile runtime calls before it writes the profile. The scratchpad is not
+// initialized by the loader, the counters in the scratchpad are cleared by a
+// constructor.
+//
+// By default, the counters in the scratchpad are 32bit wide and wrap around,
+// which halves their size and spares the carry of the additions. Counter
+// arrays are placed in the order of the module until the scratchpad area is
+// full, the others stay in main memory. Counters that are updated atomically
+// or whose address is used otherwise by the code stay in main memory as well.
+//
+// The scratchpad area must not overlap with the one of -mpatmos-spm-alloc.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Pass.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-profile-spm"
+
+STATISTIC(NumSPMCounters, "Number of profile counters placed in the SPM");
+STATISTIC(NumSPMUpdates,  "Number of profile counter accesses made local");
+
+static cl::opt<bool> EnableProfileSPM(
+  "mpatmos-profile-spm",
+  cl::init(false),
+  cl::desc("Keep the counters of -fprofile-instr-generate in the data "
+           "scratchpad."));
+
+static cl::opt<unsigned> ProfileSPMBase(
+  "mpatmos-profile-spm-base",
+  cl::init(0),
+  cl::desc("First address of the SPM area available for profile counters "
+           "(default: 0)."),
+  cl::Hidden);
+
+static cl::opt<unsigned> ProfileSPMSize(
+  "mpatmos-profile-spm-size",
+  cl::init(1024),
+  cl::desc("Size in bytes of the SPM area available for profile counters "
+           "(default: 1024)."),
+  cl::Hidden);
+
+static cl::opt<bool> ProfileSPMWide(
+  "mpatmos-profile-spm-wide",
+  cl::init(false),
+  cl::desc("Keep 64bit counters in the scratchpad instead of 32bit counters, "
+           "which wrap around."),
+  cl::Hidden);
+
+/// The address space of the local data scratchpad.
+static const unsigned SPMAddressSpace = 1;
+
+/// The size in bytes of the counters in main memory.
+static const uint64_t CounterSize = 8;
+
+namespace {
+  class PatmosProfileSPM : public ModulePass {
+  public:
+    static char ID;
+
+    PatmosProfileSPM() : ModulePass(ID) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Profile Counters in SPM";
+    }
+
+    bool runOnModule(Module &M) override;
+  };
+}
+
+char PatmosProfileSPM::ID = 0;
+
+ModulePass *llvm::createPatmosProfileSPMPass() {
+  return new PatmosProfileSPM();
+}
+
+/// Return the index of the counter of GV accessed by a load or store of type
+/// Ty through Ptr, or -1 if Ptr does not point to a whole counter of GV.
+static int64_t getCounterIndex(Value *Ptr, Type *Ty, GlobalVariable *GV,
+                               const DataLayout &DL) {
+  if (!Ty->isIntegerTy(CounterSize * 8))
+    return -1;
+
+  APInt Offset(DL.getIndexTypeSizeInBits(Ptr->getType()), 0);
+  if (Ptr->stripAndAccumulateConstantOffsets(DL, Offset, false) != GV)
+    return -1;
+
+  uint64_t Size = DL.getTypeAllocSize(GV->getValueType());
+  if (Offset.isNegative() || Offset.getZExtValue() % CounterSize ||
+      Offset.getZExtValue() + CounterSize > Size)
+    return -1;
+
+  return Offset.getZExtValue() / CounterSize;
+}
+
+/// Collect the loads and stores of the counters of GV through the pointer V.
+/// Return false if the code uses the counters otherwise, e.g., by atomic
+/// updates, or if their address escapes. Uses by the initializers of other
+/// globals, i.e., the profile data, are kept, if InData no code may use V.
+static bool collectAccesses(Value *V, GlobalVariable *GV, const DataLayout &DL,
+                            SmallVectorImpl<Instruction *> &Accesses,
+                            bool InData) {
+  for (User *U : V->users()) {
+    if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+      bool IsPtr = isa<GEPOperator>(CE) ||
+                   CE->getOpcode() == Instruction::BitCast;
+      if (!collectAccesses(CE, GV, DL, Accesses, InData || !IsPtr))
+        return false;
+    } else if (isa<Constant>(U)) {
+      continue;
+    } else if (InData) {
+      return false;
+    } else if (auto *LI = dyn_cast<LoadInst>(U)) {
+      if (!LI->isSimple() ||
+          getCounterIndex(V, LI->getType(), GV, DL) < 0)
+        return false;
+      Accesses.push_back(LI);
+    } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+      if (!SI->isSimple() || SI->getValueOperand() == V ||
+          getCounterIndex(V, SI->getValueOperand()->getType(), GV, DL) < 0)
+        return false;
+      Accesses.push_back(SI);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PatmosProfileSPM::runOnModule(Module &M) {
+  if (!EnableProfileSPM)
+    return false;
+
+  const DataLayout &DL = M.getDataLayout();
+  LLVMContext &Ctx = M.getContext();
+  uint64_t CounterBytes = ProfileSPMWide ? 8 : 4;
+  Type *CounterTy = Type::getIntNTy(Ctx, CounterBytes * 8);
+  Type *Int64Ty = Type::getInt64Ty(Ctx);
+  Type *IntPtrTy = DL.getIntPtrType(Ctx, SPMAddressSpace);
+
+  // The counters placed in the scratchpad, with their addresses there.
+  SmallVector<std::pair<GlobalVariable *, uint64_t>, 16> Placed;
+
+  uint64_t Offset = 0;
+  for (GlobalVariable &GV : M.globals()) {
+    if (!GV.getName().startswith(getInstrProfCountersVarPrefix()) ||
+        !GV.hasInitializer() || GV.getAddressSpace() != 0)
+      continue;
+
+    uint64_t Size = DL.getTypeAllocSize(GV.getValueType());
+    uint64_t SPMBytes = Size / CounterSize * CounterBytes;
+    if (Offset + SPMBytes > ProfileSPMSize)
+      continue;
+
+    SmallVector<Instruction *, 8> Accesses;
+    if (!collectAccesses(&GV, &GV, DL, Accesses, false) || Accesses.empty())
+      continue;
+
+    uint64_t Addr = ProfileSPMBase + Offset;
+    LLVM_DEBUG(dbgs() << "Profile SPM: placing " << GV.getName() << " ("
+                      << Size / CounterSize << " counters, "
+                      << Accesses.size() << " accesses) at " << Addr << "\n");
+
+    for (Instruction *I : Accesses) {
+      Value *Ptr = getLoadStorePointerOperand(I);
+      Type *Ty = isa<LoadInst>(I) ? I->getType()
+                 : cast<StoreInst>(I)->getValueOperand()->getType();
+      int64_t Idx = getCounterIndex(Ptr, Ty, &GV, DL);
+      Constant *SPMPtr = ConstantExpr::getIntToPtr(
+          ConstantInt::get(IntPtrTy, Addr + Idx * CounterBytes),
+          CounterTy->getPointerTo(SPMAddressSpace));
+
+      IRBuilder<> Builder(I);
+      if (auto *LI = dyn_cast<LoadInst>(I)) {
+        Value *V = Builder.CreateAlignedLoad(CounterTy, SPMPtr,
+                                             Align(CounterBytes));
+        V = Builder.CreateZExt(V, Ty);
+        V->takeName(LI);
+        LI->replaceAllUsesWith(V);
+      } else {
+        auto *SI = cast<StoreInst>(I);
+        Builder.CreateAlignedStore(
+            Builder.CreateTrunc(SI->getValueOperand(), CounterTy), SPMPtr,
+            Align(CounterBytes));
+      }
+      I->eraseFromParent();
+    }
+
+    Placed.push_back(std::make_pair(&GV, Addr));
+    NumSPMCounters += Size / CounterSize;
+    NumSPMUpdates += Accesses.size();
+    Offset += SPMBytes;
+  }
+
+  if (Placed.empty())
+    return false;
+
+  // The runtime refers to the flush by a weak declaration, if linked already.
+  FunctionType *FnTy = FunctionType::get(Type::getVoidTy(Ctx), false);
+  Function *Flush = M.getFunction("__patmos_profile_spm_flush");
+  if (!Flush)
+    Flush = Function::Create(FnTy, GlobalValue::ExternalLinkage,
+                             "__patmos_profile_spm_flush", M);
+  else if (!Flush->isDeclaration())
+    report_fatal_error("__patmos_profile_spm_flush is already defined");
+  Flush->setLinkage(GlobalValue::ExternalLinkage);
+
+  Function *Init = Function::Create(FnTy, GlobalValue::InternalLinkage,
+                                    "__patmos_profile_spm_init", M);
+
+  // Neither is a loop, the size of the code is bounded by the scratchpad and
+  // it needs no loop bound.
+  IRBuilder<> FlushBuilder(BasicBlock::Create(Ctx, "entry", Flush));
+  IRBuilder<> InitBuilder(BasicBlock::Create(Ctx, "entry", Init));
+  for (const std::pair<GlobalVariable *, uint64_t> &P : Placed) {
+    GlobalVariable *GV = P.first;
+    Value *Counters = FlushBuilder.CreateBitCast(GV, Int64Ty->getPointerTo());
+    uint64_t Size = DL.getTypeAllocSize(GV->getValueType());
+    for (uint64_t Idx = 0; Idx != Size / CounterSize; Idx++) {
+      Constant *SPMPtr = ConstantExpr::getIntToPtr(
+          ConstantInt::get(IntPtrTy, P.second + Idx * CounterBytes),
+          CounterTy->getPointerTo(SPMAddressSpace));
+
+      Value *V = FlushBuilder.CreateAlignedLoad(CounterTy, SPMPtr,
+                                                Align(CounterBytes));
+      FlushBuilder.CreateStore(FlushBuilder.CreateZExt(V, Int64Ty),
+          FlushBuilder.CreateConstGEP1_64(Int64Ty, Counters, Idx));
+
+      InitBuilder.CreateAlignedStore(ConstantInt::get(CounterTy, 0), SPMPtr,
+                                     Align(CounterBytes));
+    }
+  }
+  FlushBuilder.CreateRetVoid();
+  InitBuilder.CreateRetVoid();
+
+  // Run before all other constructors, which might be instrumented.
+  appendToGlobalCtors(M, Init, 0);
+  return true;
+}
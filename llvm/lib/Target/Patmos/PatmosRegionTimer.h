@@ -0,0 +1,39 @@
+//===-- PatmosRegionTimer.h - Timing regions of Patmos passes -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Helper to account the compile time of expensive phases within Patmos passes.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOS_REGIONTIMER_H_
+#define _LLVM_TARGET_PATMOS_REGIONTIMER_H_
+
+#include "llvm/Pass.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+
+namespace llvm {
+
+  /// PatmosRegionTimer - Time the enclosing scope. The time is reported in the
+  /// "Patmos Backend" group with -time-passes, and as a region of its own
+  /// with -time-trace. Must only be used on the pass manager's thread.
+  class PatmosRegionTimer {
+    NamedRegionTimer Timer;
+    TimeTraceScope Trace;
+
+  public:
+    PatmosRegionTimer(StringRef Name, StringRef Description)
+      : Timer(Name, Description, "patmos", "Patmos Backend",
+              TimePassesIsEnabled),
+        Trace(Description) {}
+  };
+
+} // end of namespace llvm
+
+#endif // _LLVM_TARGET_PATMOS_REGIONTIMER_H_
@@ -19,13 +19,17 @@
 #include "SinglePath/PatmosSinglePathInfo.h"
 #include "PatmosTargetMachine.h"
 #include "llvm/IR/Function.h"
+#include "llvm/CodeGen/LiveInterval.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/CodeGen/VirtRegMap.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SmallSet.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 
 #include "llvm/Support/Debug.h"
@@ -36,6 +40,19 @@
 
 using namespace llvm;
 
+/// DisableBundleHints - Option to disable the allocation hints that keep
+/// neighbouring instructions free of anti- and output-dependencies.
+static cl::opt<bool> DisableBundleHints("mpatmos-disable-bundle-hints",
+                 cl::init(false),
+                 cl::desc("Disable register allocation hints for bundling."));
+
+/// DisableSpillDeferral - Option to disable deferring spills that would end
+/// up on the shadow stack.
+static cl::opt<bool> DisableSpillDeferral("mpatmos-disable-spill-deferral",
+                 cl::init(false),
+                 cl::desc("Do not defer spills that do not fit into the "
+                          "stack cache."));
+
 // FIXME: Provide proper call frame setup / destroy opcodes.
 PatmosRegisterInfo::PatmosRegisterInfo(const PatmosTargetMachine &tm,
                                        const TargetInstrInfo &tii)
@@ -44,25 +61,43 @@ PatmosRegisterInfo::PatmosRegisterInfo(const PatmosTargetMachine &tm,
 const uint32_t *PatmosRegisterInfo::getCallPreservedMask(const MachineFunction &MF,
                                      CallingConv::ID) const
 {
-  llvm_unreachable("Unimplemented");
+  return CSR_Patmos_RegMask;
+}
+
+ArrayRef<MCPhysReg>
+PatmosRegisterInfo::getIntraCallClobberedRegs(const MachineFunction *MF) const {
+  // The caller saved registers of CSR_Patmos.
+  static const MCPhysReg CallerSavedRegs[] = {
+    Patmos::R1, Patmos::R2, Patmos::R3, Patmos::R4, Patmos::R5,
+    Patmos::R6, Patmos::R7, Patmos::R8, Patmos::R9, Patmos::R10,
+    Patmos::R11, Patmos::R12, Patmos::R13, Patmos::R14, Patmos::R15,
+    Patmos::R16, Patmos::R17, Patmos::R18, Patmos::R19, Patmos::R20,
+    Patmos::SL, Patmos::SH, Patmos::SXB, Patmos::SXO,
+    Patmos::S11, Patmos::S12, Patmos::S13, Patmos::S14, Patmos::S15
+  };
+
+  // Code added after the register usage of the function is collected may
+  // use any of the caller saved registers: the single-path transformation
+  // rewrites the function after register allocation, and the tracing sleds
+  // use dead caller saved registers at the entries and exits.
+  const Function &F = MF->getFunction();
+  if (MF->getInfo<PatmosMachineFunctionInfo>()->isSinglePath() ||
+      F.hasFnAttribute("function-instrument") ||
+      F.hasFnAttribute("xray-instruction-threshold"))
+    return CallerSavedRegs;
+
+  return {};
 }
 
 const MCPhysReg*
 PatmosRegisterInfo::getCalleeSavedRegs(const MachineFunction *MF) const {
-  const TargetFrameLowering *TFI = MF->getSubtarget().getFrameLowering();
+  // interrupt handlers save everything they modify
+  if (MF->getInfo<PatmosMachineFunctionInfo>()->isInterruptHandler())
+    return CSR_Interrupt_SaveList;
 
+  // The frame pointer is allocated like the other callee saved registers in
+  // functions that do not need it.
   static const uint16_t CalleeSavedRegs[] = {
-    // Special regs
-    Patmos::S0, Patmos::SRB, Patmos::SRO,
-    // GPR
-    Patmos::R21, Patmos::R22, Patmos::R23, Patmos::R24,
-    Patmos::R25, Patmos::R26, Patmos::R27, Patmos::R28,
-    // Predicate regs
-    Patmos::P1, Patmos::P2, Patmos::P3, Patmos::P4,
-    Patmos::P5, Patmos::P6, Patmos::P7,
-    0
-  };
-  static const uint16_t CalleeSavedRegsFP[] = {
     // Special regs
     Patmos::S0, Patmos::SRB, Patmos::SRO,
     // GPR
@@ -75,7 +110,7 @@ PatmosRegisterInfo::getCalleeSavedRegs(const MachineFunction *MF) const {
     0
   };
 
-  return (TFI->hasFP(*MF)) ? CalleeSavedRegsFP : CalleeSavedRegs;
+  return CalleeSavedRegs;
 }
 
 BitVector PatmosRegisterInfo::getReservedRegs(const MachineFunction &MF) const {
@@ -105,14 +140,16 @@ BitVector PatmosRegisterInfo::getReservedRegs(const MachineFunction &MF) const {
 
   // stack pointer
   Reserved.set(Patmos::RSP);
-  // frame pointer
-  Reserved.set(Patmos::RFP);
   // reserved temp register
   Reserved.set(Patmos::RTR);
   // Mark frame pointer as reserved if needed.
   if (TFI->hasFP(MF))
     Reserved.set(Patmos::RFP);
 
+  // base of the small data area
+  if (MF.getSubtarget<PatmosSubtarget>().hasSmallData())
+    Reserved.set(Patmos::R28);
+
   if (PatmosSinglePathInfo::isEnabled(MF)) {
     // Additionally reserved for single-path support
     Reserved.set(Patmos::R26);
@@ -421,6 +458,102 @@ bool PatmosRegisterInfo::hasReservedSpillSlot(const MachineFunction &MF,
   return false;
 }
 
+bool
+PatmosRegisterInfo::getRegAllocationHints(Register VirtReg,
+                                          ArrayRef<MCPhysReg> Order,
+                                          SmallVectorImpl<MCPhysReg> &Hints,
+                                          const MachineFunction &MF,
+                                          const VirtRegMap *VRM,
+                                          const LiveRegMatrix *Matrix) const
+{
+  bool HintsOnly = TargetRegisterInfo::getRegAllocationHints(VirtReg, Order,
+                                                     Hints, MF, VRM, Matrix);
+  if (HintsOnly || DisableBundleHints || !VRM)
+    return HintsOnly;
+
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+
+  // Collect the registers of the other values accessed by the instructions
+  // right before and after a definition of VirtReg, i.e., those the
+  // scheduler would like to put into the same bundle.
+  SmallSet<MCPhysReg, 8> Neighbours;
+  auto addNeighbour = [&](const MachineInstr &MI) {
+    for (const MachineOperand &MO : MI.operands()) {
+      if (!MO.isReg() || !MO.getReg() || MO.getReg() == VirtReg)
+        continue;
+      Register Reg = MO.getReg();
+      if (Reg.isVirtual()) {
+        if (!VRM->hasPhys(Reg))
+          continue;
+        Reg = VRM->getPhys(Reg);
+      }
+      Neighbours.insert(Reg);
+    }
+  };
+  for (const MachineInstr &MI : MRI.def_instructions(VirtReg)) {
+    if (MI.isDebugInstr())
+      continue;
+    const MachineBasicBlock &MBB = *MI.getParent();
+    MachineBasicBlock::const_iterator I = MI.getIterator();
+    if (I != MBB.begin()) {
+      MachineBasicBlock::const_iterator Prev = prev_nodbg(I, MBB.begin());
+      if (!Prev->isDebugInstr())
+        addNeighbour(*Prev);
+    }
+    MachineBasicBlock::const_iterator Next = next_nodbg(std::next(I),
+                                                        MBB.end());
+    if (Next != MBB.end())
+      addNeighbour(*Next);
+  }
+  if (Neighbours.empty())
+    return false;
+
+  // Copy hints removing a copy are worth more than a shorter schedule, keep
+  // them but try the ones without a dependency first.
+  std::stable_partition(Hints.begin(), Hints.end(), [&](MCPhysReg Reg) {
+    return !Neighbours.count(Reg);
+  });
+
+  // Move the neighbours behind the other registers of the allocation order
+  // by hinting all registers in front of the last of them.
+  unsigned Last = 0;
+  for (unsigned i = 0, e = Order.size(); i != e; i++)
+    if (Neighbours.count(Order[i]))
+      Last = i;
+  for (unsigned i = 0; i < Last; i++)
+    if (!Neighbours.count(Order[i]) && !is_contained(Hints, Order[i]))
+      Hints.push_back(Order[i]);
+
+  return false;
+}
+
+unsigned PatmosRegisterInfo::getCSRFirstUseCost() const
+{
+  // The first use of a callee saved register costs a store and a load on the
+  // stack cache per call, and a word of stack cache that sres and sens may
+  // have to spill and fill. Charge it as two accesses at the entry frequency
+  // (1 << 14), so that only colder values are spilled or split instead.
+  return 2 << 14;
+}
+
+bool PatmosRegisterInfo::shouldUseDeferredSpillingForVirtReg(
+                                          const MachineFunction &MF,
+                                          const LiveInterval &VirtReg) const
+{
+  if (DisableSpillDeferral)
+    return false;
+
+  // Predicates are spilled via S0, which has its own slot.
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  const TargetRegisterClass *RC = MRI.getRegClass(VirtReg.reg());
+  if (RC == &Patmos::PRegsRegClass)
+    return false;
+
+  const PatmosFrameLowering *PFL = static_cast<const PatmosFrameLowering *>(
+                                      MF.getSubtarget().getFrameLowering());
+  return !PFL->hasStackCacheSpace(MF, getSpillSize(*RC));
+}
+
 bool
 PatmosRegisterInfo::requiresRegisterScavenging(const MachineFunction &MF) const
 {
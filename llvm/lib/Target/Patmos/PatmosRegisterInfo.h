@@ -46,6 +46,12 @@ public:
   const uint32_t *getCallPreservedMask(const MachineFunction &MF,
                                        CallingConv::ID) const override;
 
+  /// getIntraCallClobberedRegs - Return the registers that calls to the
+  /// function may clobber in addition to those it is seen to modify, which
+  /// IPRA adds to the collected register usage.
+  ArrayRef<MCPhysReg>
+  getIntraCallClobberedRegs(const MachineFunction *MF) const override;
+
   /// get the associate patmos target machine
   const PatmosTargetMachine& getTargetMachine() const { return TM; }
 
@@ -86,6 +92,28 @@ public:
     return true;
   }
 
+  /// getRegAllocationHints - Add the generic copy hints, then move the
+  /// registers of the values used or defined right before or after a
+  /// definition of VirtReg behind the other registers. Reusing them would add
+  /// anti- or output-dependencies that keep the instructions from being
+  /// bundled.
+  bool getRegAllocationHints(Register VirtReg, ArrayRef<MCPhysReg> Order,
+                             SmallVectorImpl<MCPhysReg> &Hints,
+                             const MachineFunction &MF,
+                             const VirtRegMap *VRM,
+                             const LiveRegMatrix *Matrix) const override;
+
+  /// getCSRFirstUseCost - Return the cost of the save and restore of a
+  /// callee-saved register and of the stack cache word it occupies.
+  unsigned getCSRFirstUseCost() const override;
+
+  /// shouldUseDeferredSpillingForVirtReg - Defer spilling VirtReg if its
+  /// spill slot would not fit into the stack cache and thus end up on the
+  /// shadow stack in main memory, such that cheaper evictions are tried
+  /// first.
+  bool shouldUseDeferredSpillingForVirtReg(const MachineFunction &MF,
+                               const LiveInterval &VirtReg) const override;
+
   void eliminateFrameIndex(MachineBasicBlock::iterator II,
                            int SPAdj, unsigned FIOperandNum,
 		                   RegScavenger *RS = nullptr) const override;
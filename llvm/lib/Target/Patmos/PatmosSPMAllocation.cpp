@@ -0,0 +1,545 @@
+//===-- PatmosSPMAllocation.cpp - Place hot data and code in scratchpads --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Place frequently accessed data objects of the program in the local data
+// scratchpad memory (SPM), such that their accesses become lwl/swl and never
+// miss in the data cache.
+//
+// The pass expects the module to contain the whole program, as it is the case
+// for the Patmos tool chain. Candidates are
+//  - global variables with local linkage, including constant tables, and
+//  - fixed-size stack arrays of functions that cannot be re-entered, i.e.,
+//    that are neither recursive nor address-taken and that do not call unknown
+//    code, which might call them again.
+// All uses of a candidate must be loads and stores, possibly through GEPs and
+// bitcasts, so that its address never escapes into code that would access it
+// in main memory.
+//
+// The number of accesses of each candidate is estimated from its profile or,
+// without one, statically from the block frequencies, scaled by the number of
+// calls of the function propagated top-down along the call graph. The
+// candidates are then selected by solving the 0/1 knapsack problem, i.e.,
+// the ILP maximizing the saved accesses under the size of the scratchpad,
+// exactly by dynamic programming.
+//
+// Selected objects get fixed addresses in the scratchpad address space (1),
+// the selector then emits the local load and store instructions for them. The
+// scratchpad is not initialized by the loader, initialized globals are
+// therefore copied from their original image in main memory by a constructor.
+//
+// Likewise, frequently executed functions are placed in the instruction
+// scratchpad (ISPM), where they are fetched from without method cache misses.
+// Every entry of a function, by a call or by a return from one of its callees,
+// is assumed to fill its whole code into the method cache otherwise. The
+// entries are counted as above, or taken from the frequencies of a WCET
+// analysis (see PatmosWCETProfile.h), in which case the functions on the
+// worst-case path are placed. The code size is estimated from the number of
+// instructions, a part of the ISPM is left free for the estimation errors.
+// Functions are placed with all their subfunctions, in the .text.ispm section,
+// which the linker places at the address of the ISPM. Calls between the ISPM
+// and the main memory that are out of reach of an absolute call are emitted as
+// long calls, see PatmosSubtarget::needsLongCall.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosExecutionCounts.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "PatmosWCETProfile.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-spm-alloc"
+
+STATISTIC(NumSPMGlobals, "Number of global variables placed in the SPM");
+STATISTIC(NumSPMAllocas, "Number of stack objects placed in the SPM");
+STATISTIC(SPMBytes,      "Number of bytes allocated in the SPM");
+STATISTIC(NumISPMFunctions, "Number of functions placed in the ISPM");
+STATISTIC(ISPMBytes,     "Estimated number of bytes of code in the ISPM");
+
+static cl::opt<unsigned> SPMBase(
+  "mpatmos-spm-alloc-base",
+  cl::init(0),
+  cl::desc("First address of the SPM area available for data objects "
+           "(default: 0)."),
+  cl::Hidden);
+
+static cl::opt<unsigned> SPMSize(
+  "mpatmos-spm-alloc-size",
+  cl::init(2048),
+  cl::desc("Size in bytes of the SPM area available for data objects "
+           "(default: 2048)."),
+  cl::Hidden);
+
+static cl::opt<unsigned> ISPMFill(
+  "mpatmos-ispm-alloc-fill",
+  cl::init(75),
+  cl::desc("Part of the instruction scratchpad to fill with functions, in "
+           "percent of its size, leaving the rest for the errors of the code "
+           "size estimates (default: 75)."),
+  cl::Hidden);
+
+/// The address space of the local data scratchpad.
+static const unsigned SPMAddressSpace = 1;
+
+namespace {
+  /// An object that may be placed in the scratchpad.
+  struct SPMCandidate {
+    /// The global variable or the alloca instruction.
+    Value *Object;
+
+    /// The size in bytes, a multiple of the alignment.
+    uint64_t Size;
+
+    Align Alignment;
+
+    /// The estimated number of accesses saved by placing the object in the
+    /// scratchpad.
+    double Benefit;
+  };
+
+  /// A function that may be placed in the instruction scratchpad.
+  struct ISPMCandidate {
+    Function *F;
+
+    /// The estimated code size in bytes, a multiple of words.
+    uint64_t Size;
+
+    /// The estimated number of words saved from being filled into the
+    /// method cache.
+    double Benefit;
+  };
+
+  class PatmosSPMAllocation : public PatmosExecutionCounts {
+  private:
+    /// Return the candidate for the object if all its uses can access the
+    /// scratchpad and it is worth it.
+    Optional<SPMCandidate> getCandidate(Value *Object, Type *Ty,
+                                        MaybeAlign Alignment, bool NeedsCopy,
+                                        const DataLayout &DL) const;
+
+  public:
+    static char ID;
+
+    PatmosSPMAllocation() : PatmosExecutionCounts(ID) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Scratchpad Allocation";
+    }
+
+    bool runOnModule(Module &M) override;
+  };
+
+  class PatmosISPMAllocation : public PatmosExecutionCounts {
+  private:
+    const PatmosSubtarget &STC;
+
+    /// The PML file to read the frequencies of the blocks from, if any.
+    std::string WCETProfileFile;
+
+    /// The block frequencies on the worst-case path, by function.
+    wcet_profile Profile;
+
+    /// Return the number of executions of the block, on the worst-case path
+    /// if a WCET profile is given, estimated otherwise.
+    double getCount(const BasicBlock *BB) const;
+
+    /// Return the candidate for the function if it is worth it.
+    Optional<ISPMCandidate> getCandidate(Function &F) const;
+
+  public:
+    static char ID;
+
+    PatmosISPMAllocation(const PatmosTargetMachine &tm, StringRef wcetProfile)
+      : PatmosExecutionCounts(ID), STC(*tm.getSubtargetImpl()),
+        WCETProfileFile(wcetProfile.str()) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Instruction Scratchpad Allocation";
+    }
+
+    bool runOnModule(Module &M) override;
+  };
+}
+
+char PatmosSPMAllocation::ID = 0;
+char PatmosISPMAllocation::ID = 0;
+
+ModulePass *llvm::createPatmosSPMAllocationPass() {
+  return new PatmosSPMAllocation();
+}
+
+ModulePass *
+llvm::createPatmosISPMAllocationPass(const PatmosTargetMachine &tm,
+                                     StringRef WCETProfile) {
+  return new PatmosISPMAllocation(tm, WCETProfile);
+}
+
+/// Collect the loads and stores through the pointer. Returns false if the
+/// pointer is used in any other way, e.g., if it escapes.
+static bool collectAccesses(Value *Ptr,
+                            SmallVectorImpl<Instruction *> &Accesses) {
+  for (User *U : Ptr->users()) {
+    if (auto *LI = dyn_cast<LoadInst>(U)) {
+      Accesses.push_back(LI);
+    } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+      // Storing the pointer itself lets it escape.
+      if (SI->getValueOperand() == Ptr)
+        return false;
+      Accesses.push_back(SI);
+    } else if (isa<GEPOperator>(U) || isa<BitCastOperator>(U)) {
+      if (!U->getType()->isPointerTy() || !collectAccesses(U, Accesses))
+        return false;
+    } else if (auto *I = dyn_cast<Instruction>(U)) {
+      // Lifetime markers are simply dropped.
+      if (!I->isLifetimeStartOrEnd())
+        return false;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Return the pointer type of the scratchpad address space with the same
+/// element type.
+static PointerType *getSPMPointerType(Type *Ty) {
+  return PointerType::get(cast<PointerType>(Ty)->getElementType(),
+                          SPMAddressSpace);
+}
+
+/// Replace the pointer Old by New, which points to the same object in the
+/// scratchpad address space, rewriting all pointers derived from it.
+static void rewriteUses(Value *Old, Value *New) {
+  SmallVector<User *, 8> Users(Old->users());
+  for (User *U : Users) {
+    if (auto *LI = dyn_cast<LoadInst>(U)) {
+      LI->setOperand(LI->getPointerOperandIndex(), New);
+    } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+      SI->setOperand(SI->getPointerOperandIndex(), New);
+    } else if (auto *GEP = dyn_cast<GetElementPtrInst>(U)) {
+      SmallVector<Value *, 4> Indices(GEP->indices());
+      GetElementPtrInst *NewGEP = GetElementPtrInst::Create(
+          GEP->getSourceElementType(), New, Indices, "", GEP);
+      NewGEP->setIsInBounds(GEP->isInBounds());
+      NewGEP->takeName(GEP);
+      rewriteUses(GEP, NewGEP);
+      GEP->eraseFromParent();
+    } else if (auto *BC = dyn_cast<BitCastInst>(U)) {
+      BitCastInst *NewBC =
+          new BitCastInst(New, getSPMPointerType(BC->getType()), "", BC);
+      NewBC->takeName(BC);
+      rewriteUses(BC, NewBC);
+      BC->eraseFromParent();
+    } else if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+      Constant *NewCE;
+      if (auto *GEP = dyn_cast<GEPOperator>(CE)) {
+        SmallVector<Constant *, 4> Indices;
+        for (unsigned i = 1, e = CE->getNumOperands(); i != e; ++i)
+          Indices.push_back(CE->getOperand(i));
+        NewCE = ConstantExpr::getGetElementPtr(GEP->getSourceElementType(),
+                                               cast<Constant>(New), Indices,
+                                               GEP->isInBounds());
+      } else {
+        NewCE = ConstantExpr::getBitCast(cast<Constant>(New),
+                                         getSPMPointerType(CE->getType()));
+      }
+      rewriteUses(CE, NewCE);
+      CE->destroyConstant();
+    } else {
+      cast<Instruction>(U)->eraseFromParent();
+    }
+  }
+}
+
+Optional<SPMCandidate>
+PatmosSPMAllocation::getCandidate(Value *Object, Type *Ty,
+                                  MaybeAlign Alignment, bool NeedsCopy,
+                                  const DataLayout &DL) const {
+  if (!Ty->isSized())
+    return None;
+
+  SmallVector<Instruction *, 16> Accesses;
+  if (!collectAccesses(Object, Accesses) || Accesses.empty())
+    return None;
+
+  SPMCandidate C;
+  C.Object = Object;
+  C.Alignment = std::max(Align(4), DL.getValueOrABITypeAlignment(Alignment,
+                                                                 Ty));
+  C.Size = alignTo(DL.getTypeAllocSize(Ty), C.Alignment);
+  if (C.Size == 0 || C.Size > SPMSize)
+    return None;
+
+  C.Benefit = 0;
+  for (Instruction *I : Accesses)
+    C.Benefit += getCount(I);
+
+  // Every word has to be copied into the scratchpad once.
+  if (NeedsCopy)
+    C.Benefit -= C.Size / 4;
+
+  if (C.Benefit <= 0)
+    return None;
+  return C;
+}
+
+/// Select the candidates to place in Capacity bytes, in order to maximize the
+/// benefit, by solving the knapsack problem in units of words.
+template <typename CandidateT>
+static std::vector<CandidateT> select(ArrayRef<CandidateT> Candidates,
+                                      uint64_t Capacity) {
+  Capacity /= 4;
+  unsigned N = Candidates.size();
+
+  // Best[w] is the best benefit using at most w words of the candidates seen
+  // so far, Taken[i][w] tells if candidate i is part of that solution.
+  std::vector<double> Best(Capacity + 1, 0);
+  std::vector<std::vector<bool>> Taken(N, std::vector<bool>(Capacity + 1));
+  for (unsigned i = 0; i < N; i++) {
+    unsigned Words = Candidates[i].Size / 4;
+    for (unsigned w = Capacity; w >= Words; w--) {
+      double With = Best[w - Words] + Candidates[i].Benefit;
+      if (With > Best[w]) {
+        Best[w] = With;
+        Taken[i][w] = true;
+      }
+    }
+  }
+
+  std::vector<CandidateT> Selected;
+  unsigned w = Capacity;
+  for (unsigned i = N; i > 0; i--) {
+    if (Taken[i - 1][w]) {
+      Selected.push_back(Candidates[i - 1]);
+      w -= Candidates[i - 1].Size / 4;
+    }
+  }
+  return Selected;
+}
+
+/// Emit code to copy Size bytes from Src in main memory to Dst in the
+/// scratchpad, or to clear Dst if Src is null. The code is not a loop, its
+/// size is bounded by the scratchpad and it needs no loop bound.
+static void emitCopy(IRBuilder<> &Builder, Value *Dst, Value *Src,
+                     uint64_t Size) {
+  uint64_t Offset = 0;
+  for (unsigned Bytes : {4, 1}) {
+    Type *Ty = Builder.getIntNTy(Bytes * 8);
+    Value *DstPtr = Builder.CreateBitCast(Dst, Ty->getPointerTo(
+                                                   SPMAddressSpace));
+    Value *SrcPtr = Src ? Builder.CreateBitCast(Src, Ty->getPointerTo())
+                        : nullptr;
+    for (; Offset + Bytes <= Size; Offset += Bytes) {
+      uint64_t Idx = Offset / Bytes;
+      Value *V = SrcPtr ? static_cast<Value *>(Builder.CreateLoad(Ty,
+                             Builder.CreateConstGEP1_64(Ty, SrcPtr, Idx)))
+                        : ConstantInt::get(Ty, 0);
+      Builder.CreateStore(V, Builder.CreateConstGEP1_64(Ty, DstPtr, Idx));
+    }
+  }
+}
+
+bool PatmosSPMAllocation::runOnModule(Module &M) {
+  const DataLayout &DL = M.getDataLayout();
+
+  analyzeCallGraph(M);
+
+  std::vector<SPMCandidate> Candidates;
+  for (GlobalVariable &GV : M.globals()) {
+    if (!GV.hasLocalLinkage() || !GV.hasInitializer() ||
+        GV.isThreadLocal() || GV.hasSection() ||
+        GV.getAddressSpace() != 0)
+      continue;
+
+    bool NeedsCopy = !isa<UndefValue>(GV.getInitializer());
+    if (Optional<SPMCandidate> C = getCandidate(&GV, GV.getValueType(),
+                                                GV.getAlign(), NeedsCopy, DL))
+      Candidates.push_back(*C);
+  }
+
+  for (Function &F : M) {
+    if (!NonReentrant.count(&F))
+      continue;
+
+    for (Instruction &I : F.getEntryBlock()) {
+      AllocaInst *AI = dyn_cast<AllocaInst>(&I);
+      if (!AI || !AI->isStaticAlloca() || AI->isArrayAllocation() ||
+          !AI->getAllocatedType()->isAggregateType())
+        continue;
+
+      if (Optional<SPMCandidate> C = getCandidate(AI, AI->getAllocatedType(),
+                                                  AI->getAlign(), false, DL))
+        Candidates.push_back(*C);
+    }
+  }
+
+  if (Candidates.empty())
+    return false;
+
+  std::vector<SPMCandidate> Selected =
+      select(makeArrayRef(Candidates), SPMSize);
+  if (Selected.empty())
+    return false;
+
+  // Place objects with larger alignment first, so that no padding is needed.
+  llvm::stable_sort(Selected, [](const SPMCandidate &A, const SPMCandidate &B) {
+    return A.Alignment > B.Alignment;
+  });
+
+  Function *Init = nullptr;
+  IRBuilder<> Builder(M.getContext());
+
+  uint64_t Offset = 0;
+  for (const SPMCandidate &C : Selected) {
+    Type *IntPtrTy = DL.getIntPtrType(M.getContext(), SPMAddressSpace);
+    Constant *Addr = ConstantExpr::getIntToPtr(
+        ConstantInt::get(IntPtrTy, SPMBase + Offset),
+        getSPMPointerType(C.Object->getType()));
+
+    LLVM_DEBUG(dbgs() << "SPM: placing " << C.Object->getName() << " ("
+                      << C.Size << " bytes, " << C.Benefit
+                      << " accesses) at " << SPMBase + Offset << "\n");
+
+    if (GlobalVariable *GV = dyn_cast<GlobalVariable>(C.Object)) {
+      rewriteUses(GV, Addr);
+
+      if (isa<UndefValue>(GV->getInitializer())) {
+        GV->eraseFromParent();
+      } else {
+        if (!Init) {
+          Init = Function::Create(
+              FunctionType::get(Builder.getVoidTy(), false),
+              GlobalValue::InternalLinkage, "__patmos_spm_init", M);
+          Builder.SetInsertPoint(BasicBlock::Create(M.getContext(), "entry",
+                                                    Init));
+        }
+
+        // Keep initial values that are not zero as an image to copy them
+        // from.
+        GlobalVariable *Image = nullptr;
+        if (!GV->getInitializer()->isNullValue()) {
+          Image = GV;
+          Image->setName(GV->getName() + ".spm_image");
+          Image->setConstant(true);
+          Image->setLinkage(GlobalValue::PrivateLinkage);
+          Image->setAlignment(C.Alignment);
+          // The debug information would show the stale initial values.
+          Image->eraseMetadata(LLVMContext::MD_dbg);
+        }
+        emitCopy(Builder, Addr, Image, DL.getTypeAllocSize(GV->getValueType()));
+
+        if (!Image)
+          GV->eraseFromParent();
+      }
+      NumSPMGlobals++;
+    } else {
+      AllocaInst *AI = cast<AllocaInst>(C.Object);
+      rewriteUses(AI, Addr);
+      AI->eraseFromParent();
+      NumSPMAllocas++;
+    }
+
+    Offset += C.Size;
+  }
+  SPMBytes += Offset;
+
+  if (Init) {
+    Builder.CreateRetVoid();
+    // Run before all other constructors, which might use the objects.
+    appendToGlobalCtors(M, Init, 0);
+  }
+  return true;
+}
+
+double PatmosISPMAllocation::getCount(const BasicBlock *BB) const {
+  const Function *F = BB->getParent();
+  if (WCETProfileFile.empty())
+    return FunctionCounts.lookup(F) * BlockFreqs.lookup(BB);
+
+  // Functions and blocks missing in the profile are not on the worst-case
+  // path.
+  wcet_profile::const_iterator P = Profile.find(F->getName().str());
+  if (P == Profile.end())
+    return 0;
+  std::map<std::string, WCETBlockResult>::const_iterator B =
+                                             P->second.find(BB->getName().str());
+  return B != P->second.end() ? B->second.Frequency : 0;
+}
+
+Optional<ISPMCandidate>
+PatmosISPMAllocation::getCandidate(Function &F) const {
+  if (F.isDeclaration() || F.hasSection())
+    return None;
+
+  // The function is filled when it is called, and again on every return
+  // from one of its callees. The size word precedes the code.
+  ISPMCandidate C;
+  C.F = &F;
+  C.Size = 4;
+  double Entries = getCount(&F.getEntryBlock());
+  for (const BasicBlock &BB : F) {
+    for (const Instruction &I : BB) {
+      C.Size += 4;
+      const CallBase *CB = dyn_cast<CallBase>(&I);
+      if (CB && !isa<IntrinsicInst>(CB) && !CB->isInlineAsm())
+        Entries += getCount(&BB);
+    }
+  }
+
+  C.Benefit = Entries * (C.Size / 4);
+  if (C.Benefit <= 0)
+    return None;
+  return C;
+}
+
+bool PatmosISPMAllocation::runOnModule(Module &M) {
+  uint64_t Capacity = (uint64_t)STC.getISPMSize() * ISPMFill / 100;
+  if (Capacity < 4)
+    return false;
+
+  analyzeCallGraph(M);
+  if (!WCETProfileFile.empty())
+    readWCETProfile(WCETProfileFile, Profile);
+
+  std::vector<ISPMCandidate> Candidates;
+  for (Function &F : M) {
+    Optional<ISPMCandidate> C = getCandidate(F);
+    if (C && C->Size <= Capacity)
+      Candidates.push_back(*C);
+  }
+
+  std::vector<ISPMCandidate> Selected =
+      select(makeArrayRef(Candidates), Capacity);
+  for (const ISPMCandidate &C : Selected) {
+    LLVM_DEBUG(dbgs() << "ISPM: placing " << C.F->getName() << " (about "
+                      << C.Size << " bytes, " << C.Benefit
+                      << " words filled)\n");
+    C.F->setSection(PatmosSubtarget::getISPMSectionName());
+    NumISPMFunctions++;
+    ISPMBytes += C.Size;
+  }
+  return !Selected.empty();
+}
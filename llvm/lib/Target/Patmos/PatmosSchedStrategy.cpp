@@ -8,16 +8,20 @@
 //===----------------------------------------------------------------------===//
 //
 // PatmosPostRASchedStrategy implements the scheduling strategy for the post-RA
-// scheduler. 
+// scheduler, PatmosVLIWSchedStrategy the slot-aware strategy for the pre-RA
+// MachineScheduler.
 //
-// TODO merge this somehow with the pre-RA MachineSchedStrategy?
+// TODO share the bundle selection between the two strategies.
 //
 //===----------------------------------------------------------------------===//
 
 #include "PatmosSchedStrategy.h"
+#include "PatmosDataCacheAnalysis.h"
 #include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
 #include "PatmosRegisterInfo.h"
 #include "PatmosTargetMachine.h"
+#include "PatmosTuning.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/AliasAnalysis.h"
@@ -30,11 +34,41 @@
 #include "llvm/Target/TargetMachine.h"
 
 #include <algorithm>
+#include <map>
+#include <tuple>
 
 using namespace llvm;
 
 #define DEBUG_TYPE "post-RA-sched"
 
+STATISTIC(CriticalPairBundles, "Bundles selected as pairs on the critical path");
+STATISTIC(ClusteredLoads, "Data cache loads ordered behind a load of the "
+                          "same cache block");
+
+/// PairBundles - Option to select the instructions of a bundle as a pair.
+static cl::opt<bool> PairBundles(
+  "mpatmos-sched-pair-bundles",
+  cl::init(false),
+  cl::desc("Select the instructions of a bundle as the best pair regarding "
+           "the issue slots and the critical path, instead of greedily."),
+  cl::Hidden);
+
+/// ScheduleAcrossCalls - Option to schedule regions across calls.
+static cl::opt<bool> ScheduleAcrossCalls(
+  "mpatmos-sched-across-calls",
+  cl::init(false),
+  cl::desc("Do not end scheduling regions at calls, which allows moving "
+           "independent instructions over them and into their delay slots."),
+  cl::Hidden);
+
+/// PairLookahead - Number of available instructions considered for pairs.
+static cl::opt<unsigned> PairLookahead(
+  "mpatmos-sched-pair-lookahead",
+  cl::init(8),
+  cl::desc("Number of available instructions considered for a pair "
+           "(default 8)."),
+  cl::Hidden);
+
 bool ILPOrder::operator()(const SUnit *A, const SUnit *B) const {
   // Always prefer instructions with ScheduleLow flag.
   if (A->isScheduleLow != B->isScheduleLow) {
@@ -81,6 +115,8 @@ void PatmosLatencyQueue::clear()
 {
   PendingQueue.clear();
   AvailableQueue.clear();
+  CurrCycle = 0;
+  HasMainMemoryAccess = false;
 }
 
 bool PatmosLatencyQueue::empty()
@@ -127,14 +163,13 @@ bool PatmosLatencyQueue::selectBundle(std::vector<SUnit*> &Bundle)
   // scheduled only with a single other instruction in this queue, or if there
   // is any instruction in the queue that can only be scheduled with the highest
   // ones. Pick them in any case
+  if (SelectPairs && Bundle.empty() && IssueWidth > 1) {
+    selectCriticalPair(Bundle, Selected, CurrWidth);
+  }
 
-
-
-  // TODO magic goes here..
-
-
-
-  // Try to fill up the bundle with instructions from the queue by best effort
+  // Try to fill up the bundle with instructions from the queue by best effort,
+  // keeping main memory accesses apart as long as anything else is available.
+  bool Deferred = false;
   for (unsigned i = 0; i < AvailableQueue.size() && CurrWidth < IssueWidth; i++)
   {
     if (Selected[i]) continue;
@@ -145,15 +180,113 @@ bool PatmosLatencyQueue::selectBundle(std::vector<SUnit*> &Bundle)
     unsigned width = PII.getIssueWidth(SU->getInstr());
     if (!Bundle.empty() && CurrWidth + width > IssueWidth) continue;
 
-    addToBundle(Bundle, SU, CurrWidth);
+    if (isWithinTDMPeriod(SU)) {
+      Deferred = true;
+      continue;
+    }
+
+    if (addToBundle(Bundle, SU, CurrWidth)) {
+      Selected[i] = true;
+    }
+  }
+
+  // Only deferred accesses are available, issue them rather than a NOP.
+  if (Deferred && Bundle.empty()) {
+    for (unsigned i = 0; i < AvailableQueue.size() && CurrWidth < IssueWidth;
+         i++)
+    {
+      if (!Selected[i])
+        addToBundle(Bundle, AvailableQueue[i], CurrWidth);
+    }
+  }
+
+  return true;
+}
+
+unsigned PatmosLatencyQueue::getCriticalBound() const
+{
+  // Pending instructions become available at their height, the lookahead
+  // keeps their paths from being extended by the current bundle.
+  unsigned Bound = 0;
+  for (SUnit *SU : AvailableQueue)
+    Bound = std::max(Bound, CurrCycle + SU->getDepth());
+  for (SUnit *SU : PendingQueue)
+    Bound = std::max(Bound, SU->getHeight() + SU->getDepth());
+  return Bound;
+}
+
+bool PatmosLatencyQueue::selectCriticalPair(std::vector<SUnit*> &Bundle,
+                                            std::vector<bool> &Selected,
+                                            unsigned &CurrWidth)
+{
+  unsigned Bound = getCriticalBound();
+
+  // The candidates in priority order, pseudos are issued on their own.
+  std::vector<unsigned> Candidates;
+  for (unsigned i = 0; i < AvailableQueue.size() &&
+                       Candidates.size() < PairCandidates; i++)
+  {
+    SUnit *SU = AvailableQueue[i];
+    if (Selected[i] || SU->getInstr()->isPseudo() ||
+        SU->getInstr()->isInlineAsm() || isWithinTDMPeriod(SU))
+      continue;
+    Candidates.push_back(i);
+  }
+  if (Candidates.size() < 2)
+    return false;
+
+  // Rank the bundles by the number of instructions on the critical path,
+  // i.e., that extend the bound if they are delayed by a cycle, then by the
+  // slots they fill, then by their depths. The first candidate on its own
+  // is the bundle the greedy selection starts with.
+  auto isCritical = [&](unsigned i) {
+    return CurrCycle + AvailableQueue[i]->getDepth() >= Bound;
+  };
+  auto rank = [&](unsigned i, unsigned Width) {
+    return std::make_tuple((unsigned)isCritical(i), Width,
+                           AvailableQueue[i]->getDepth());
+  };
+
+  unsigned First = Candidates[0];
+  auto Best = rank(First, PII.getIssueWidth(AvailableQueue[First]->getInstr()));
+  int BestA = -1, BestB = -1;
+
+  for (unsigned a = 0; a < Candidates.size(); a++) {
+    for (unsigned b = a + 1; b < Candidates.size(); b++) {
+      unsigned i = Candidates[a], j = Candidates[b];
+      std::vector<SUnit*> Pair;
+      unsigned Width = 0;
+      if (!addToBundle(Pair, AvailableQueue[i], Width) ||
+          !addToBundle(Pair, AvailableQueue[j], Width))
+        continue;
+
+      auto RankA = rank(i, 0), RankB = rank(j, 0);
+      auto Rank = std::make_tuple(std::get<0>(RankA) + std::get<0>(RankB),
+                                  Width,
+                                  std::get<2>(RankA) + std::get<2>(RankB));
+      if (Rank > Best) {
+        Best = Rank;
+        BestA = i;
+        BestB = j;
+      }
+    }
   }
+  if (BestA < 0)
+    return false;
 
+  // add both in priority order, addToBundle assigns the slots
+  addToBundle(Bundle, AvailableQueue[BestA], CurrWidth);
+  addToBundle(Bundle, AvailableQueue[BestB], CurrWidth);
+  Selected[BestA] = Selected[BestB] = true;
+  CriticalPairBundles++;
   return true;
 }
 
 /// Go back one cycle and update availability queue.
 void PatmosLatencyQueue::recedeCycle(unsigned CurrCycle)
 {
+  this->CurrCycle = CurrCycle;
+
   unsigned avail = 0;
   for (unsigned i = 0; i < PendingQueue.size() - avail; i++) {
     SUnit *SU = PendingQueue[i];
@@ -180,6 +313,14 @@ void PatmosLatencyQueue::scheduled(SUnit *SU, unsigned CurrCycle)
 {
   SU->setHeightToAtLeast(CurrCycle);
 
+  // A call may miss in the method cache, which then loads the callee from
+  // the main memory.
+  if (TDMPeriod && SU->getInstr() &&
+      (isMainMemoryAccess(*SU->getInstr()) || SU->getInstr()->isCall())) {
+    MainMemoryCycle = CurrCycle;
+    HasMainMemoryAccess = true;
+  }
+
   AvailableQueue.erase(std::remove(AvailableQueue.begin(), AvailableQueue.end(),
                                    SU), AvailableQueue.end());
 }
@@ -205,6 +346,23 @@ bool PatmosLatencyQueue::canIssueInSlot(SUnit *SU, unsigned Slot)
   return PII.canIssueInSlot(MI, Slot);
 }
 
+bool PatmosLatencyQueue::isWithinTDMPeriod(SUnit *SU) const
+{
+  if (!TDMPeriod || !HasMainMemoryAccess || !SU->getInstr() ||
+      SU->isScheduleLow)
+    return false;
+
+  // We schedule bottom-up, the access scheduled last is the later one.
+  return CurrCycle - MainMemoryCycle < TDMPeriod &&
+         isMainMemoryAccess(*SU->getInstr());
+}
+
+bool PatmosLatencyQueue::isMainMemoryAccess(const MachineInstr &MI) const
+{
+  return PatmosInstrInfo::isMainMemoryAccess(MI) ||
+         (DCA && DCA->isAlwaysMiss(&MI));
+}
+
 bool PatmosLatencyQueue::addToBundle(std::vector<SUnit *> &Bundle, SUnit *SU,
                                      unsigned &CurrWidth)
 {
@@ -279,6 +437,159 @@ void PatmosLatencyQueue::dump()
 #endif
 
 
+/// Bottom-up priority of the pre-RA strategy: prefer instructions that must
+/// be scheduled low, then the ones on the longest path from the region entry,
+/// then keep the original order.
+static bool hasHigherBotPriority(const SUnit *A, const SUnit *B)
+{
+  if (A->isScheduleLow != B->isScheduleLow)
+    return A->isScheduleLow;
+
+  if (A->getDepth() != B->getDepth())
+    return A->getDepth() > B->getDepth();
+
+  return A->NodeNum > B->NodeNum;
+}
+
+PatmosVLIWSchedStrategy::PatmosVLIWSchedStrategy(
+                                            const PatmosTargetMachine &PTM)
+: PII(*PTM.getInstrInfo()), CurrCycle(0)
+{
+  const PatmosSubtarget &PST = *PTM.getSubtargetImpl();
+
+  IssueWidth = PatmosSubtarget::enableBundling() ?
+               PST.getSchedModel().IssueWidth : 1;
+}
+
+void PatmosVLIWSchedStrategy::initialize(ScheduleDAGMI *dag)
+{
+  PendingQueue.clear();
+  AvailableQueue.clear();
+  CurrBundle.clear();
+  CurrCycle = 0;
+}
+
+SUnit *PatmosVLIWSchedStrategy::pickNode(bool &IsTopNode)
+{
+  IsTopNode = false;
+
+  if (CurrBundle.empty()) {
+    if (AvailableQueue.empty() && PendingQueue.empty())
+      return NULL;
+
+    // Go back cycle by cycle until something can be issued.
+    while (true) {
+      updateAvailable();
+      selectBundle();
+      if (!CurrBundle.empty()) break;
+      CurrCycle++;
+    }
+  }
+
+  // We schedule bottom-up, so hand out the last slot first to get the bundle
+  // in issue order.
+  SUnit *SU = CurrBundle.back();
+  CurrBundle.pop_back();
+
+  LLVM_DEBUG(dbgs() << "Cycle " << CurrCycle << ": SU(" << SU->NodeNum
+                    << ")\n");
+  return SU;
+}
+
+void PatmosVLIWSchedStrategy::schedNode(SUnit *SU, bool IsTopNode)
+{
+  // The predecessors will be released relative to this cycle.
+  SU->BotReadyCycle = std::max(SU->BotReadyCycle, CurrCycle);
+
+  if (CurrBundle.empty())
+    CurrCycle++;
+}
+
+void PatmosVLIWSchedStrategy::releaseBottomNode(SUnit *SU)
+{
+  PendingQueue.push_back(SU);
+}
+
+void PatmosVLIWSchedStrategy::updateAvailable()
+{
+  unsigned avail = 0;
+  for (unsigned i = 0; i < PendingQueue.size() - avail; i++) {
+    SUnit *SU = PendingQueue[i];
+
+    if (SU->BotReadyCycle <= CurrCycle) {
+      avail++;
+      PendingQueue[i] = *(PendingQueue.end() - avail);
+      // revisit the moved instruction
+      i--;
+
+      AvailableQueue.push_back(SU);
+    }
+  }
+
+  PendingQueue.resize(PendingQueue.size() - avail);
+
+  std::sort(AvailableQueue.begin(), AvailableQueue.end(),
+            hasHigherBotPriority);
+}
+
+void PatmosVLIWSchedStrategy::selectBundle()
+{
+  assert(CurrBundle.empty());
+
+  unsigned CurrWidth = 0;
+  for (unsigned i = 0; i < AvailableQueue.size() && CurrWidth < IssueWidth;
+       i++)
+  {
+    addToBundle(AvailableQueue[i], CurrWidth);
+  }
+
+  for (SUnit *SU : CurrBundle) {
+    AvailableQueue.erase(std::find(AvailableQueue.begin(),
+                                   AvailableQueue.end(), SU));
+  }
+}
+
+bool PatmosVLIWSchedStrategy::addToBundle(SUnit *SU, unsigned &CurrWidth)
+{
+  MachineInstr *MI = SU->getInstr();
+
+  // check the width. ignore the width for the first instruction to allow
+  // ALUl even when bundling is disabled.
+  unsigned Width = PII.getIssueWidth(MI);
+  if (!CurrBundle.empty() && CurrWidth + Width > IssueWidth) {
+    return false;
+  }
+
+  // Inline Asm and pseudos that are not just register moves always get
+  // scheduled on their own.
+  if (MI->isInlineAsm() || (MI->isPseudo() && !MI->isTransient())) {
+    if (!CurrBundle.empty())
+      return false;
+    CurrBundle.push_back(SU);
+    CurrWidth = IssueWidth;
+    return true;
+  }
+
+  if (PII.canIssueInSlot(MI, CurrBundle.size())) {
+    CurrBundle.push_back(SU);
+    CurrWidth += Width;
+    return true;
+  }
+
+  // Same quick hack as in the post-RA scheduler: try to swap with the
+  // instruction in the first slot.
+  if (!CurrBundle.empty() && PII.canIssueInSlot(MI, 0) &&
+      PII.canIssueInSlot(CurrBundle[0]->getInstr(), CurrBundle.size())) {
+    CurrBundle.push_back(CurrBundle[0]);
+    CurrBundle[0] = SU;
+    CurrWidth += Width;
+    return true;
+  }
+
+  return false;
+}
+
+
 PatmosPostRASchedStrategy::PatmosPostRASchedStrategy(
                                             const PatmosTargetMachine &PTM)
 : PTM(PTM), PII(*PTM.getInstrInfo()), PRI(PII.getPatmosRegisterInfo()),
@@ -304,7 +615,11 @@ bool PatmosPostRASchedStrategy::isSchedulingBoundary(const MachineInstr *MI,
   if (MI->isInlineAsm())
     return true;
 
-  // All CFL instructions are boundaries, we only handle one CFL per region.
+  // All CFL instructions are boundaries, we only handle one CFL per region,
+  // besides the calls above it if enabled.
+  if (MI->isCall() && !MI->isBarrier())
+    return !getTuningParameter(MF.getFunction(), "sched-across-calls",
+                               ScheduleAcrossCalls);
   return MI->isBarrier() || MI->isBranch() || MI->isCall() || MI->isReturn();
 }
 
@@ -332,6 +647,27 @@ void PatmosPostRASchedStrategy::postprocessDAG(ScheduleDAGPostRA *dag)
     }
   }
 
+  // Likewise, keep the latency of multiplications whose result is only read
+  // after the region, by an mfs in a following block.
+  for (SUnit &SU : DAG->SUnits) {
+    MachineInstr *MI = SU.getInstr();
+    if (!MI || (MI->getOpcode() != Patmos::MUL &&
+                MI->getOpcode() != Patmos::MULU))
+      continue;
+
+    bool ReadInRegion = false;
+    for (const SDep &Succ : SU.Succs) {
+      if (Succ.getKind() == SDep::Data &&
+          (Succ.getReg() == Patmos::SL || Succ.getReg() == Patmos::SH))
+        ReadInRegion = true;
+    }
+    if (!ReadInRegion) {
+      SDep Dep(&SU, SDep::Artificial);
+      Dep.setLatency(PTM.getSubtargetImpl()->getMULLatency() + 1);
+      DAG->ExitSU.addPred(Dep);
+    }
+  }
+
   // Find the branch/call/ret instruction if available
   for (std::vector<SUnit>::reverse_iterator it = DAG->SUnits.rbegin(),
        ie = DAG->SUnits.rend(); it != ie; it++)
@@ -409,6 +745,10 @@ void PatmosPostRASchedStrategy::postprocessDAG(ScheduleDAGPostRA *dag)
     }
   }
 
+  if (CFL) {
+    constrainInnerCalls(*CFL);
+  }
+
   // Add an exit delay between loads and inline asm, in case asm is empty
   if (Asm) {
     std::vector<SUnit*> PredLoads;
@@ -443,8 +783,8 @@ void PatmosPostRASchedStrategy::postprocessDAG(ScheduleDAGPostRA *dag)
   // TODO SWS and LWS do not have ST as implicit def edges
   // TODO CALL has chain edges to all SWS/.. instructions, remove
 
-  // TODO remove edges from MUL to other MULs to overlap MUL and MFS for
-  //      pipelined muls.
+  // Overlapping MULs with the MFS of a previous MUL is done by the delay slot
+  // filler, see PatmosDelaySlotFiller::overlapNextMul.
 }
 
 
@@ -455,6 +795,18 @@ void PatmosPostRASchedStrategy::initialize(ScheduleDAGPostRA *dag)
   CurrBundle.clear();
   ReadyQ.clear();
 
+  // Shorten the schedules of the blocks on the worst-case path, as known
+  // from a WCET analysis.
+  const PatmosAnalysisInfo &PAI =
+           DAG->MF.getInfo<PatmosMachineFunctionInfo>()->getAnalysisInfo();
+  ReadyQ.setMaximizeILP(DAG->begin() != DAG->end() &&
+                        PAI.isCritical(DAG->begin()->getParent()));
+
+  const Function &F = DAG->MF.getFunction();
+  ReadyQ.setPairSelection(
+      getTuningParameter(F, "sched-pair-bundles", PairBundles),
+      getTuningParameter(F, "sched-pair-lookahead", PairLookahead));
+
   DAG->computeDFSResult();
   ReadyQ.setDFSResult(DAG);
 }
@@ -569,6 +921,54 @@ void PatmosPostRASchedStrategy::releaseBottomNode(SUnit *SU)
 /// value registers, arguments or callee saved regs. Does not remove
 /// dependencies to return info registers.
 /// This can be done since call and return are scheduling boundaries.
+void PatmosPostRASchedStrategy::constrainInnerCalls(SUnit &CFL)
+{
+  const PatmosSubtarget *PST = PTM.getSubtargetImpl();
+
+  // The closest CFL below the current call in program order.
+  SUnit *Next = &CFL;
+
+  for (std::vector<SUnit>::reverse_iterator it = DAG->SUnits.rbegin(),
+       ie = DAG->SUnits.rend(); it != ie; it++)
+  {
+    MachineInstr *MI = it->getInstr();
+    if (!MI || &*it == &CFL || !MI->isCall()) continue;
+
+    unsigned DelaySlot = PST->getDelaySlotCycles(*MI);
+
+    // The instructions depending on the call must not execute in its delay
+    // slots, i.e., before the callee. The implicit uses of the arguments are
+    // kept, other than for the last CFL, as the region continues below the
+    // delay slots.
+    SmallVector<SUnit*, 8> Succs;
+    for (SUnit::succ_iterator s = it->Succs.begin(), se = it->Succs.end();
+         s != se; s++)
+    {
+      if (s->getSUnit() && s->getLatency() < DelaySlot + 1)
+        Succs.push_back(s->getSUnit());
+    }
+    for (SUnit *Succ : Succs) {
+      SDep Dep(&*it, SDep::Artificial);
+      Dep.setLatency(DelaySlot + 1);
+      Succ->addPred(Dep);
+    }
+
+    // The delay slots of the call end before the next CFL and the region.
+    SDep NextDep(&*it, SDep::Artificial);
+    NextDep.setLatency(DelaySlot + 1);
+    Next->addPred(NextDep);
+
+    SDep ExitDep(&*it, SDep::Artificial);
+    ExitDep.setLatency(DelaySlot + 1);
+    DAG->ExitSU.addPred(ExitDep);
+
+    // Issue the call as late as possible, independent instructions are thus
+    // scheduled ahead of it.
+    it->isScheduleLow = true;
+    Next = &*it;
+  }
+}
+
 void PatmosPostRASchedStrategy::removeImplicitCFLDeps(SUnit &SU)
 {
   assert(SU.getInstr()->isCall() || SU.getInstr()->isReturn());
@@ -735,3 +1135,99 @@ unsigned PatmosPostRASchedStrategy::computeExitLatency(SUnit &SU) {
 
   return Latency;
 }
+
+PatmosCacheBlockClustering::PatmosCacheBlockClustering(
+                                            const PatmosTargetMachine &PTM)
+  : BlockSize(PTM.getSubtargetImpl()->getDataCacheBlockSize())
+{
+}
+
+/// Return the number of bytes by which the offset of a load is scaled.
+static unsigned getLoadSize(unsigned Opcode) {
+  switch (Opcode) {
+  case Patmos::LHC: case Patmos::LHUC: return 2;
+  case Patmos::LBC: case Patmos::LBUC: return 1;
+  default:                             return 4;
+  }
+}
+
+bool PatmosCacheBlockClustering::getBlockAccess(SUnit &SU, Register &Base,
+                                                SUnit *&BaseDef,
+                                                int64_t &Offset) const
+{
+  const MachineInstr *MI = SU.getInstr();
+  if (!MI || MI->isBundle() || !MI->mayLoad() || MI->hasOrderedMemoryRef() ||
+      getPatmosFormat(MI->getDesc().TSFlags) != PatmosII::FrmLDT ||
+      PatmosInstrInfo::getMemType(*MI) != PatmosII::MEM_C)
+    return false;
+
+  // The address follows the guard, its offset is scaled by the access' size.
+  unsigned BaseIdx = MI->findFirstPredOperandIdx() + 2;
+  const MachineOperand &OffsetMO = MI->getOperand(BaseIdx + 1);
+  if (!OffsetMO.isImm())
+    return false;
+  Base = MI->getOperand(BaseIdx).getReg();
+  Offset = OffsetMO.getImm() * getLoadSize(MI->getOpcode());
+
+  // Loads reading the base register defined by the same node, or live into
+  // the region, use the same base address.
+  BaseDef = nullptr;
+  for (const SDep &Pred : SU.Preds) {
+    if (Pred.getKind() == SDep::Data && Pred.getReg() == Base)
+      BaseDef = Pred.getSUnit();
+  }
+  return true;
+}
+
+void PatmosCacheBlockClustering::apply(ScheduleDAGPostRA *DAG)
+{
+  if (!BlockSize)
+    return;
+
+  // Group the loads by base address and guard, in program order.
+  typedef std::tuple<unsigned, SUnit*, unsigned, int64_t> GroupKey;
+  std::map<GroupKey, std::vector<BlockAccess> > Groups;
+  for (SUnit &SU : DAG->SUnits) {
+    Register Base;
+    SUnit *BaseDef;
+    int64_t Offset;
+    if (!getBlockAccess(SU, Base, BaseDef, Offset))
+      continue;
+
+    const MachineInstr *MI = SU.getInstr();
+    unsigned PredIdx = MI->findFirstPredOperandIdx();
+    GroupKey Key(Base, BaseDef, MI->getOperand(PredIdx).getReg(),
+                 MI->getOperand(PredIdx + 1).getImm());
+    Groups[Key].push_back({&SU, Offset});
+  }
+
+  for (auto &G : Groups) {
+    std::vector<BlockAccess> &Accesses = G.second;
+    std::vector<bool> Clustered(Accesses.size(), false);
+
+    for (unsigned i = 0, e = Accesses.size(); i != e; i++) {
+      if (Clustered[i])
+        continue;
+      BlockAccess &First = Accesses[i];
+
+      // The base is not known to be aligned, thus accesses less than a block
+      // apart are assumed to share the block of the first one.
+      for (unsigned j = i + 1; j != e; j++) {
+        BlockAccess &Next = Accesses[j];
+        int64_t Distance = Next.Offset - First.Offset;
+        if (Clustered[j] || Distance <= -(int64_t)BlockSize ||
+            Distance >= (int64_t)BlockSize)
+          continue;
+
+        // Memory accesses are only issued in the first slot, so the later
+        // loads end up in bundles of their own behind the first one.
+        SDep Dep(First.SU, SDep::Artificial);
+        Dep.setLatency(1);
+        if (DAG->addEdge(Next.SU, Dep)) {
+          Clustered[j] = true;
+          ClusteredLoads++;
+        }
+      }
+    }
+  }
+}
@@ -27,9 +27,9 @@
 //     Uses a MaschineSchedStrategy to pick nodes and set scheduling direction.
 //
 //     - PatmosVLIWSchedStrategy: Implements the MachineSchedStrategy for the
-//       generic ScheduleDAGMI pre-RA scheduler. TBD. Should order code so that
-//       the RegAlloc does not introduce pseudo dependencies, i.e. be bundling
-//       aware. Do bottom-up scheduling
+//       generic ScheduleDAGMI pre-RA scheduler. Schedules bottom-up cycle by
+//       cycle and only groups instructions into a cycle that fit into the
+//       issue slots, so that the post-RA scheduler can bundle them.
 //
 //     - ConvergingSchedStrategy, ..: generic LLVM scheduling strategies.
 //
@@ -52,6 +52,8 @@
 //   PostRAScheduler, works post-RA. Uses ScheduleDAGPostRA and
 //   PatmosPostRASchedStrategy to schedule, create bundles and fill delay slots.
 //   Post-RA version of the MachineScheduler pass.
+//   Delay slots that remain NOPs after scheduling are filled with independent
+//   instructions from successor blocks that have a single predecessor.
 //   TODO use a scheduler registry similar to MachineScheduler to select
 //   schedulers at runtime
 //   TODO PatmosPostRAScehduler and ScheduleDAGPostRA should be moved into the
@@ -84,6 +86,8 @@
 
 namespace llvm {
 
+  class PatmosDataCacheAnalysisInfo;
+
   /// Order nodes by the ILP metric. Copied from MachineScheduler.
   struct ILPOrder {
     const SchedDFSResult *DFSResult;
@@ -118,22 +122,62 @@ namespace llvm {
     /// AvailableQueue - The priority queue to use for the available SUnits.
     std::vector<SUnit*> AvailableQueue;
 
+    /// The period of the TDM arbiter of the main memory, or 0 if the main
+    /// memory is not arbitrated. Main memory accesses are kept a period apart
+    /// if other instructions are available, which then execute while the
+    /// later access waits for the slot of the core.
+    unsigned TDMPeriod;
+
+    /// The current cycle, and the cycle of the main memory access scheduled
+    /// last, i.e., the next one in program order, if any.
+    unsigned CurrCycle;
+    unsigned MainMemoryCycle;
+    bool HasMainMemoryAccess;
+
+    /// The classification of the data cache loads, if the data cache
+    /// analysis was run. Loads that always miss access the main memory.
+    const PatmosDataCacheAnalysisInfo *DCA;
+
+    /// Select bundles as the best pair of the first PairCandidates available
+    /// instructions, if SelectPairs is set.
+    bool SelectPairs;
+    unsigned PairCandidates;
+
   public:
     PatmosLatencyQueue(const PatmosTargetMachine &PTM)
-    : PII(*PTM.getInstrInfo()), Cmp(false)
+    : PII(*PTM.getInstrInfo()), Cmp(false), CurrCycle(0), MainMemoryCycle(0),
+      HasMainMemoryAccess(false), DCA(0), SelectPairs(false),
+      PairCandidates(0)
     {
       const PatmosSubtarget &PST = *PTM.getSubtargetImpl();
 
       IssueWidth = PatmosSubtarget::enableBundling() ?
                    PST.getSchedModel().IssueWidth : 1;
+
+      TDMPeriod = PST.hasTDMArbiter() ? PST.getTDMPeriod() : 0;
     }
 
     unsigned getIssueWidth() const { return IssueWidth; }
 
     void setIssueWidth(unsigned width) { IssueWidth = width; }
 
+    /// Prefer the subtrees with a higher ILP, to shorten the schedule.
+    void setMaximizeILP(bool MaxILP) { Cmp.MaximizeILP = MaxILP; }
+
+    /// Select the bundles as critical-path pairs of the given number of
+    /// available instructions.
+    void setPairSelection(bool Pairs, unsigned Candidates) {
+      SelectPairs = Pairs;
+      PairCandidates = Candidates;
+    }
+
     void setDFSResult(ScheduleDAGPostRA *DAG);
 
+    /// Use the classification of the data cache loads, or none if null.
+    void setDataCacheAnalysis(const PatmosDataCacheAnalysisInfo *Info) {
+      DCA = Info;
+    }
+
     void clear();
 
     bool empty();
@@ -165,35 +209,85 @@ namespace llvm {
   protected:
     bool canIssueInSlot(SUnit *SU, unsigned Slot);
 
+    /// Return true if SU accesses main memory within a TDM period of the
+    /// main memory access scheduled last.
+    bool isWithinTDMPeriod(SUnit *SU) const;
+
+    /// Return true if MI accesses the main memory, including the data cache
+    /// loads known to always miss.
+    bool isMainMemoryAccess(const MachineInstr &MI) const;
+
     /// Try to add an instruction to the bundle, return true if succeeded.
     /// \param Width the current width of the bundle, will be updated.
     bool addToBundle(std::vector<SUnit *> &Bundle, SUnit *SU, unsigned &Width);
+
+    /// Return the length of the longest path from the region entry to the
+    /// current cycle, through the available and the pending instructions.
+    unsigned getCriticalBound() const;
+
+    /// Select the best pair of available instructions that fit into a bundle
+    /// together, preferring the instructions on the critical path. Return
+    /// false if no pair is better than the highest priority instruction
+    /// alone.
+    bool selectCriticalPair(std::vector<SUnit*> &Bundle,
+                            std::vector<bool> &Selected, unsigned &CurrWidth);
   };
 
   class  PatmosTargetMachine;
   struct PatmosRegisterInfo;
 
 
-  // TODO implement, share code with PostRASchedStrategy if possible.
+  /// Pre-RA bottom-up list scheduling strategy for the generic ScheduleDAGMI.
+  /// Instructions are grouped into cycles that respect the issue width and
+  /// the issue slots of Patmos, so that instructions which can be bundled by
+  /// the post-RA scheduler are placed next to each other before register
+  /// allocation. No actual bundles are created.
   class PatmosVLIWSchedStrategy : public MachineSchedStrategy {
+  private:
+    const PatmosInstrInfo &PII;
+
+    /// Max number of slots to fill in one cycle.
+    unsigned IssueWidth;
+
+    /// Instructions whose successors have all been scheduled, but whose
+    /// results are not yet available in the current cycle.
+    std::vector<SUnit*> PendingQueue;
+
+    /// Instructions that can be scheduled in the current cycle.
+    std::vector<SUnit*> AvailableQueue;
+
+    /// Already scheduled cycles to the end of the region.
+    unsigned CurrCycle;
 
-    //const TargetSchedModel *SchedModel;
-    //const TargetRegisterInfo *TRI;
+    /// The instructions selected for the current cycle that have not been
+    /// handed out yet, in issue order.
+    std::vector<SUnit*> CurrBundle;
 
   public:
+    PatmosVLIWSchedStrategy(const PatmosTargetMachine &PTM);
+
+    void initialize(ScheduleDAGMI *dag) override;
 
-    PatmosVLIWSchedStrategy() {}
+    SUnit *pickNode(bool &IsTopNode) override;
 
-    virtual void initialize(ScheduleDAGMI *dag) {}
+    void schedNode(SUnit *SU, bool IsTopNode) override;
 
-    virtual SUnit *pickNode(bool &IsTopNode) { return 0; }
+    void releaseTopNode(SUnit *SU) override {}
 
-    virtual void schedNode(SUnit *SU, bool IsTopNode) {}
+    void releaseBottomNode(SUnit *SU) override;
 
-    virtual void releaseTopNode(SUnit *SU) {}
+  private:
+    /// Move pending instructions that are ready in the current cycle to the
+    /// available queue.
+    void updateAvailable();
 
-    virtual void releaseBottomNode(SUnit *SU) {}
+    /// Select the instructions to issue in the current cycle.
+    void selectBundle();
 
+    /// Try to add an instruction to the current bundle, return true if
+    /// succeeded.
+    /// \param Width the current width of the bundle, will be updated.
+    bool addToBundle(SUnit *SU, unsigned &Width);
   };
 
 
@@ -241,6 +335,12 @@ namespace llvm {
     /// Initialize the strategy after building the DAG for a new region.
     virtual void initialize(ScheduleDAGPostRA *DAG);
 
+    /// Use the classification of the data cache loads for the function
+    /// being scheduled, or none if null.
+    void setDataCacheAnalysis(const PatmosDataCacheAnalysisInfo *Info) {
+      ReadyQ.setDataCacheAnalysis(Info);
+    }
+
     virtual void finalize(ScheduleDAGPostRA *DAG);
 
     /// Notify this strategy that all roots have been released (including those
@@ -273,6 +373,10 @@ namespace llvm {
 
   private:
 
+    /// Order the calls of the region above its last CFL, such that their
+    /// delay slots only contain independent instructions.
+    void constrainInnerCalls(SUnit &CFL);
+
     /// Remove dependencies to a call or return due to implicit uses of the
     /// return values, arguments or caller saved registers.
     /// Does not remove dependencies to return info registers.
@@ -295,6 +399,35 @@ namespace llvm {
     unsigned computeExitLatency(SUnit &SU);
   };
 
+  /// Cluster the data cache loads of a region by the cache block they access.
+  ///
+  /// Loads relative to the same value of a base register, under the same
+  /// guard, whose offsets lie within a cache block are grouped. The first load
+  /// of a group in program order is scheduled before the others, such that it
+  /// takes the miss of the block and the others hit in later bundles, instead
+  /// of being interleaved with the accesses to other blocks.
+  class PatmosCacheBlockClustering : public ScheduleDAGPostRAMutation {
+  private:
+    unsigned BlockSize;
+
+    /// A data cache load of the region.
+    struct BlockAccess {
+      SUnit *SU;
+      int64_t Offset;
+    };
+
+    /// Get the base register, the node defining its value in the region, if
+    /// any, and the byte offset of a data cache load. Return false if SU is
+    /// not such a load.
+    bool getBlockAccess(SUnit &SU, Register &Base, SUnit *&BaseDef,
+                        int64_t &Offset) const;
+
+  public:
+    PatmosCacheBlockClustering(const PatmosTargetMachine &PTM);
+
+    void apply(ScheduleDAGPostRA *DAG) override;
+  };
+
 }
 
 #endif
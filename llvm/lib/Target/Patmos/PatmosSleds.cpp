@@ -0,0 +1,368 @@
+//===-- PatmosSleds.cpp - Insert patchable sleds for tracing. -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Insert sleds for the tracing of function entries, function exits and
+// subfunction entries, for the XRay attributes of -fxray-instrument. The
+// generic XRay pass is disabled for Patmos, its pseudo instructions are not
+// lowered by the Patmos backend.
+//
+// A sled is a sequence of five NOPs, which the runtime in the builtins
+// patches into
+//
+//   mfs    $rA = $srb
+//   mfs    $rB = $sro
+//   callnd __patmos_sled_handler
+//   mts    $srb = $rA
+//   mts    $sro = $rB
+//
+// to enable it, i.e., a call of the handler that keeps the return information
+// of the function in two dead registers. The handler finds the sled by the
+// return information of its call. The sleds are listed in the
+// PATMOS_SLEDS_SECTION by the AsmPrinter, along with the instructions of their
+// enabled form. Disabled, they cost five cycles and their size, they are part
+// of the code like any other instructions, also in the PML export.
+//
+// The pass runs twice. Before the function splitter, it inserts the sleds at
+// the entry and the returns of the functions, where the sleds are not in the
+// delay slots of branches and calls. The splitter keeps the sleds in one
+// subfunction and leaves room for the sleds of the subfunctions, which the
+// second instance inserts at the entries of the method cache regions after
+// the bundle peephole, which does not bundle the NOPs of sleds.
+//
+// Sleds are only inserted where two caller-saved registers are dead, i.e., are
+// written in the block before they are read again, or are not read until the
+// function returns. Predicated returns, naked functions, interrupt handlers and
+// single-path code do not get sleds.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "MCTargetDesc/PatmosTargetStreamer.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineDominators.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-sleds"
+
+STATISTIC(NumEntrySleds,       "Number of function entry sleds");
+STATISTIC(NumExitSleds,        "Number of function exit sleds");
+STATISTIC(NumSubfunctionSleds, "Number of subfunction entry sleds");
+STATISTIC(NumSkippedSleds,     "Number of sleds skipped for lack of dead "
+                               "registers or at predicated returns");
+
+/// The caller-saved registers for the sleds, the argument and return
+/// registers last.
+static const MCPhysReg SledScratchRegs[] = {
+  Patmos::R9,  Patmos::R10, Patmos::R11, Patmos::R12, Patmos::R13,
+  Patmos::R14, Patmos::R15, Patmos::R16, Patmos::R17, Patmos::R18,
+  Patmos::R19, Patmos::R20, Patmos::R8,  Patmos::R7,  Patmos::R6,
+  Patmos::R5,  Patmos::R4,  Patmos::R3,  Patmos::R2,  Patmos::R1
+};
+
+namespace {
+  class PatmosSleds : public MachineFunctionPass {
+  private:
+    const PatmosInstrInfo *TII;
+    const PatmosSubtarget *STC;
+    const TargetRegisterInfo *TRI;
+
+    /// Insert the sleds of the subfunctions instead of the sleds of the
+    /// function entry and exits.
+    bool Subfunctions;
+
+    static char ID;
+
+    /// isTraced - Check whether the function gets sleds, following the
+    /// attributes of the generic XRay pass.
+    bool isTraced(MachineFunction &MF) const;
+
+    /// isDeadAt - Check whether the register is dead at the bundle I, i.e.,
+    /// it is not read in the block before it is written, or before the
+    /// function returns.
+    bool isDeadAt(MachineBasicBlock &MBB, MachineBasicBlock::iterator I,
+                  Register Reg) const;
+
+    /// findScratchRegs - Find two registers for a sled before I. Returns
+    /// false if there are not enough dead registers.
+    bool findScratchRegs(MachineBasicBlock &MBB, MachineBasicBlock::iterator I,
+                         Register &A, Register &B) const;
+
+    /// insertSled - Insert a sled of the given kind before I.
+    void insertSled(MachineBasicBlock &MBB, MachineBasicBlock::iterator I,
+                    unsigned Kind, Register A, Register B) const;
+
+    bool insertFunctionSleds(MachineFunction &MF) const;
+
+    bool insertSubfunctionSleds(MachineFunction &MF) const;
+
+  public:
+    PatmosSleds(const PatmosTargetMachine &tm, bool subfunctions)
+      : MachineFunctionPass(ID),
+        TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())),
+        STC(tm.getSubtargetImpl()),
+        TRI(tm.getSubtargetImpl()->getRegisterInfo()),
+        Subfunctions(subfunctions)
+    {
+    }
+
+    StringRef getPassName() const override {
+      return Subfunctions ? "Patmos Subfunction Sleds" : "Patmos Sleds";
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override {
+      return Subfunctions ? insertSubfunctionSleds(MF)
+                          : insertFunctionSleds(MF);
+    }
+  };
+
+  char PatmosSleds::ID = 0;
+} // end of anonymous namespace
+
+bool PatmosSleds::isTraced(MachineFunction &MF) const {
+  const Function &F = MF.getFunction();
+  const PatmosMachineFunctionInfo *PMFI =
+                                       MF.getInfo<PatmosMachineFunctionInfo>();
+
+  // The sleds change the timing of single-path code, naked functions and
+  // interrupt handlers manage the registers themselves.
+  if (PMFI->isSinglePath() || PMFI->isInterruptHandler(F) ||
+      F.hasFnAttribute(Attribute::Naked))
+    return false;
+
+  Attribute InstrAttr = F.getFnAttribute("function-instrument");
+  bool AlwaysInstrument = InstrAttr.isStringAttribute() &&
+                          InstrAttr.getValueAsString() == "xray-always";
+  bool NeverInstrument = InstrAttr.isStringAttribute() &&
+                         InstrAttr.getValueAsString() == "xray-never";
+  if (NeverInstrument && !AlwaysInstrument)
+    return false;
+  if (AlwaysInstrument)
+    return true;
+
+  Attribute ThresholdAttr = F.getFnAttribute("xray-instruction-threshold");
+  unsigned Threshold = 0;
+  if (!ThresholdAttr.isStringAttribute() ||
+      ThresholdAttr.getValueAsString().getAsInteger(10, Threshold))
+    return false;
+
+  uint64_t MICount = 0;
+  for (const MachineBasicBlock &MBB : MF)
+    MICount += MBB.size();
+  if (MICount >= Threshold)
+    return true;
+
+  if (F.hasFnAttribute("xray-ignore-loops"))
+    return false;
+
+  // too small, traced only if it has loops
+  MachineDominatorTree MDT;
+  MDT.getBase().recalculate(MF);
+  MachineLoopInfo MLI;
+  MLI.getBase().analyze(MDT.getBase());
+  return !MLI.empty();
+}
+
+bool PatmosSleds::isDeadAt(MachineBasicBlock &MBB,
+                           MachineBasicBlock::iterator I, Register Reg) const {
+  bool Returns = false;
+  // bundles until a write by a call or load takes effect
+  int Pending = -1;
+  for (MachineBasicBlock::iterator ie = MBB.end(); I != ie; ++I) {
+    SmallVector<const MachineInstr*, 2> Instrs;
+    if (I->isBundle()) {
+      for (MachineBasicBlock::const_instr_iterator
+           i = std::next(I->getIterator()), e = MBB.instr_end();
+           i != e && i->isInsideBundle(); ++i)
+        Instrs.push_back(&*i);
+    } else {
+      Instrs.push_back(&*I);
+    }
+
+    // all operands of a bundle are read before any result is written
+    for (const MachineInstr *MI : Instrs) {
+      if (MI->readsRegister(Reg, TRI) || MI->isInlineAsm())
+        return false;
+    }
+
+    if (Pending > 0 && --Pending == 0)
+      return true;
+    if (Returns || Pending >= 0)
+      continue;
+
+    for (const MachineInstr *MI : Instrs) {
+      if (MI->isReturn() && !TII->isPredicated(*MI)) {
+        // the delay slots still may read the register
+        Returns = true;
+      } else if (MI->isBranch() || MI->isReturn()) {
+        // the paths leaving the block are not followed
+        return false;
+      } else if (TII->isPredicated(*MI)) {
+        continue;
+      } else if (MI->isCall()) {
+        for (const MachineOperand &MO : MI->operands()) {
+          if ((MO.isRegMask() && MO.clobbersPhysReg(Reg)) ||
+              (MO.isReg() && MO.isDef() && TRI->regsOverlap(MO.getReg(), Reg)))
+            Pending = STC->getDelaySlotCycles(*MI);
+        }
+      } else if (MI->definesRegister(Reg, TRI)) {
+        Pending = MI->mayLoad() ? 1 : 0;
+      }
+    }
+    if (Pending == 0)
+      return true;
+  }
+
+  // the caller-saved registers are dead when the function returns
+  return Returns;
+}
+
+bool PatmosSleds::findScratchRegs(MachineBasicBlock &MBB,
+                                  MachineBasicBlock::iterator I,
+                                  Register &A, Register &B) const {
+  const MachineFunction &MF = *MBB.getParent();
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  bool AtEntry = &MBB == &MF.front() && I == MBB.begin();
+
+  A = B = Patmos::NoRegister;
+  for (MCPhysReg Reg : SledScratchRegs) {
+    if (MRI.isReserved(Reg))
+      continue;
+    // registers that are not passed to the function are dead at its entry
+    bool Dead = AtEntry ? !MBB.isLiveIn(Reg) : isDeadAt(MBB, I, Reg);
+    if (!Dead)
+      continue;
+    if (!A) {
+      A = Reg;
+    } else {
+      B = Reg;
+      return true;
+    }
+  }
+  return false;
+}
+
+void PatmosSleds::insertSled(MachineBasicBlock &MBB,
+                             MachineBasicBlock::iterator I,
+                             unsigned Kind, Register A, Register B) const {
+  MachineFunction &MF = *MBB.getParent();
+  PatmosMachineFunctionInfo *PMFI = MF.getInfo<PatmosMachineFunctionInfo>();
+  DebugLoc DL = I != MBB.end() ? I->getDebugLoc() : DebugLoc();
+
+  SmallVector<const MachineInstr*, PatmosTracingSled::Words> Instrs;
+  MachineInstr *First = nullptr;
+  for (unsigned i = 0; i < PatmosTracingSled::Words; i++) {
+    MachineInstr *MI =
+        AddDefaultPred(BuildMI(MBB, I, DL, TII->get(Patmos::NOP))).getInstr();
+    if (!First)
+      First = MI;
+    Instrs.push_back(MI);
+  }
+  First->setPreInstrSymbol(MF, MF.getContext().createTempSymbol());
+
+  LLVM_DEBUG(dbgs() << "Sled of kind " << Kind << " in "
+                    << printMBBReference(MBB) << " using "
+                    << printReg(A, TRI) << ", " << printReg(B, TRI) << "\n");
+  PMFI->addTracingSled({First, Kind, A, B}, Instrs);
+}
+
+bool PatmosSleds::insertFunctionSleds(MachineFunction &MF) const {
+  if (MF.empty() || !isTraced(MF))
+    return false;
+
+  MF.getInfo<PatmosMachineFunctionInfo>()->setTracingSleds();
+
+  const Function &F = MF.getFunction();
+  bool Changed = false;
+  Register A, B;
+
+  if (!F.hasFnAttribute("xray-skip-exit")) {
+    for (MachineBasicBlock &MBB : MF) {
+      for (MachineBasicBlock::iterator I = MBB.begin(), ie = MBB.end();
+           I != ie; ++I) {
+        if (!I->isReturn())
+          continue;
+
+        const MachineInstr *Ret = &*I;
+        if (I->isBundle()) {
+          for (MachineBasicBlock::instr_iterator
+               i = std::next(I->getIterator()), e = MBB.instr_end();
+               i != e && i->isInsideBundle(); ++i) {
+            if (i->isReturn())
+              Ret = &*i;
+          }
+        }
+        if (TII->isPredicated(*Ret) || !findScratchRegs(MBB, I, A, B)) {
+          NumSkippedSleds++;
+          continue;
+        }
+        insertSled(MBB, I, PSLED_EXIT, A, B);
+        NumExitSleds++;
+        Changed = true;
+      }
+    }
+  }
+
+  // A function entry in a loop would be traced on every iteration.
+  MachineBasicBlock &Entry = MF.front();
+  if (!F.hasFnAttribute("xray-skip-entry") && Entry.pred_empty()) {
+    if (findScratchRegs(Entry, Entry.begin(), A, B)) {
+      insertSled(Entry, Entry.begin(), PSLED_ENTRY, A, B);
+      NumEntrySleds++;
+      Changed = true;
+    } else {
+      NumSkippedSleds++;
+    }
+  }
+
+  return Changed;
+}
+
+bool PatmosSleds::insertSubfunctionSleds(MachineFunction &MF) const {
+  PatmosMachineFunctionInfo *PMFI = MF.getInfo<PatmosMachineFunctionInfo>();
+  if (!PMFI->hasTracingSleds())
+    return false;
+
+  bool Changed = false;
+  Register A, B;
+  for (MachineBasicBlock &MBB : MF) {
+    if (&MBB == &MF.front() || !PMFI->isMethodCacheRegionEntry(&MBB))
+      continue;
+
+    if (!findScratchRegs(MBB, MBB.begin(), A, B)) {
+      NumSkippedSleds++;
+      continue;
+    }
+    insertSled(MBB, MBB.begin(), PSLED_SUBFUNCTION, A, B);
+    PMFI->adjustBlockSize(&MBB, PatmosTracingSled::Words * 4);
+    NumSubfunctionSleds++;
+    Changed = true;
+  }
+  return Changed;
+}
+
+/// createPatmosSledsPass - Returns a new PatmosSleds
+/// \see PatmosSleds
+FunctionPass *llvm::createPatmosSledsPass(const PatmosTargetMachine &tm,
+                                          bool Subfunctions) {
+  return new PatmosSleds(tm, Subfunctions);
+}
@@ -27,18 +27,32 @@
 #undef PATMOS_TRACE_DETAILED_RESULTS
 
 #include "PatmosCallGraphBuilder.h"
+#include "PatmosRegionTimer.h"
+#include "PatmosILPSolver.h"
+#include "PatmosLibrarySummary.h"
 #include "PatmosMachineFunctionInfo.h"
 #include "PatmosStackCacheAnalysis.h"
+#include "PatmosStats.h"
 #include "PatmosSubtarget.h"
 #include "PatmosTargetMachine.h"
+#include "PatmosTuning.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/CodeGen/MachineOptimizationRemarkEmitter.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/Debug.h"
-#include "llvm/Support/Program.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <limits>
 #include <map>
 #include <set>
 #include <fstream>
@@ -77,6 +91,57 @@ static cl::opt<std::string> Solve_ilp(
   cl::desc("Path to an ILP solver."),
   cl::Hidden);
 
+/// Kinds of ILP solvers available to the stack cache analysis.
+enum ILPSolverKind {
+  ILP_BUILTIN,
+  ILP_EXTERNAL
+};
+
+/// ILPSolverMode - Option to select the ILP solver. The builtin solver falls
+/// back to the external program when it gives up on an ILP.
+static cl::opt<ILPSolverKind> ILPSolverMode(
+  "mpatmos-ilp-solver-mode",
+  cl::init(ILP_BUILTIN),
+  cl::desc("ILP solver used by the stack cache analysis."),
+  cl::values(
+    clEnumValN(ILP_BUILTIN, "builtin",
+               "(default) In-process simplex and branch-and-bound"),
+    clEnumValN(ILP_EXTERNAL, "external",
+               "Invoke the program given by -mpatmos-ilp-solver")),
+  cl::Hidden);
+
+/// ILPSolverMaxNodes - Limit on the branch-and-bound nodes explored by the
+/// builtin ILP solver.
+static cl::opt<unsigned> ILPSolverMaxNodes(
+  "mpatmos-ilp-solver-max-nodes",
+  cl::init(10000),
+  cl::desc("Maximum number of branch-and-bound nodes of the builtin ILP "
+           "solver before falling back to the external solver."),
+  cl::Hidden);
+
+/// ILPSolverThreads - Number of threads used to solve independent ILPs
+/// concurrently.
+static cl::opt<unsigned> ILPSolverThreads(
+  "mpatmos-ilp-solver-threads",
+  cl::init(1),
+  cl::desc("Number of threads solving independent ILPs of the stack cache "
+           "analysis (0: use all hardware threads)."),
+  cl::Hidden);
+
+/// EnableILPCache - Option to memoize the solutions of ILPs.
+static cl::opt<bool> EnableILPCache(
+  "mpatmos-ilp-cache",
+  cl::init(true),
+  cl::desc("Reuse the solutions of ILPs that are equal up to renaming."),
+  cl::Hidden);
+
+/// ILPCacheDir - Directory keeping solutions of ILPs across compilations.
+static cl::opt<std::string> ILPCacheDir(
+  "mpatmos-ilp-cache-dir",
+  cl::desc("Directory to store the solutions of ILPs of the stack cache "
+           "analysis, which are then reused by later compilations."),
+  cl::Hidden);
+
 /// Option to specify a file containing user-supplied bounds when solving ILP
 /// problems (for regions of the call graph with recursion).
 static cl::opt<std::string> BoundsFile(
@@ -84,6 +149,25 @@ static cl::opt<std::string> BoundsFile(
   cl::desc("File containing bounds for the stack cache analysis."),
   cl::Hidden);
 
+/// Option to infer the bounds of simple self-recursive functions, which are
+/// used if the bounds file does not provide any.
+static cl::opt<bool> EnableInferRecursionBounds(
+  "mpatmos-sca-infer-recursion",
+  cl::init(true),
+  cl::desc("Infer the recursion depth of self-recursive functions that "
+           "decrement a parameter toward a constant (default: true)."),
+  cl::Hidden);
+
+/// Option to limit the number of calling contexts per function in the Spill
+/// Cost Analysis graph.
+static cl::opt<unsigned> MaxSCAContexts(
+  "mpatmos-sca-max-contexts",
+  cl::init(0),
+  cl::desc("Maximum number of stack occupancy contexts per function in the "
+           "Spill Cost Analysis graph, further contexts are merged into the "
+           "worst case (default: 0, no limit)."),
+  cl::Hidden);
+
 /// EnableViewSCAGraph - Option to enable the rendering of the Spill Cost
 /// Analysis graph.
 static cl::opt<bool> EnableViewSCAGraph(
@@ -117,7 +201,7 @@ static cl::opt<bool> EnableEnsureOpt(
 /// EnableLazyPointer - Option to enable lazy pointer analysis
 static cl::opt<bool> EnableLazyPointer(
   "mpatmos-sca-lp",
-  cl::init(false),
+  cl::init(true),
   cl::desc("Enable lazy pointer (spill-cost-saving) analysis."),
   cl::Hidden);
 
@@ -139,6 +223,31 @@ static cl::opt<std::string> SCAPMLExport("mpatmos-sca-serialize",
    cl::desc("Export PML specification of generated machine code to FILE"),
    cl::init(""));
 
+/// SCASummaryFile - File keeping per-function summaries of the analysis
+/// results, such that later compilations only need to re-analyze functions
+/// that changed or call changed functions.
+static cl::opt<std::string> SCASummaryFile("mpatmos-sca-summaries",
+   cl::desc("File keeping per-function summaries of the Stack Cache Analysis "
+            "for later compilations (default: FILE.summaries, given "
+            "-mpatmos-sca-serialize=FILE)."),
+   cl::Hidden);
+
+/// downsizeEnsures - Check whether the ensures of a function are down-sized,
+/// which may be tuned per function.
+static bool downsizeEnsures(const MachineFunction &MF)
+{
+  return getTuningParameter(MF.getFunction(), "sca-downsize-ensures",
+                            EnableEnsureDwn);
+}
+
+/// removeEnsures - Check whether the unnecessary ensures of a function are
+/// removed, which may be tuned per function.
+static bool removeEnsures(const MachineFunction &MF)
+{
+  return getTuningParameter(MF.getFunction(), "sca-remove-ensures",
+                            EnableEnsureOpt);
+}
+
 namespace llvm {
   /// Count the number of SENS instructions removed.
   STATISTIC(RemovedSENS, "SENS instructions removed (zero fills).");
@@ -169,12 +278,22 @@ namespace llvm {
   /// Count the total number of nodes in the pruned SCA graph.
   STATISTIC(PrunedSCAGraphSize, "Pruned SCA graph size.");
 
+  /// Count the number of calling contexts merged into the worst case.
+  STATISTIC(MergedSCAContexts, "Calling contexts merged (SCA graph).");
+
+  /// Count the number of recursive functions whose bounds were inferred.
+  STATISTIC(InferredRecursionBounds, "Recursion bounds inferred.");
+
   /// Count the total number of ILPs solved.
   STATISTIC(ILPs, "Number of ILPs solved.");
 
   /// Count the total number of functions (excluding dead functions).
   STATISTIC(Functions, "Number of machine functions.");
 
+  /// Count the number of functions whose summary was reused from a previous
+  /// compilation.
+  STATISTIC(ReusedSummaries, "Number of reused function summaries.");
+
   /// Count the number of stores considered during lazy pointer analysis.
   STATISTIC(StoresAnalyzed, "Number of stores analyzed (LP analysis).");
 
@@ -221,6 +340,41 @@ namespace llvm {
   // vs. lazy spill costs.
   typedef std::pair<unsigned int, unsigned int> CostPair;
 
+  /// Summary of the effect of a basic block on the lowest position of the
+  /// lazy pointer, i.e., min(max(x, Lo), Hi).
+  /// Stores raise the position, calls lower it, and a sequence of both always
+  /// can be represented by a single lower and upper bound.
+  struct LPTransfer {
+    unsigned int Lo;
+    unsigned int Hi;
+
+    LPTransfer() : Lo(0), Hi(std::numeric_limits<unsigned int>::max()) {}
+
+    /// applyMax - Append x -> max(x, Bound) to the summary.
+    void applyMax(unsigned int Bound)
+    {
+      if (Bound >= Hi)
+        Lo = Hi = Bound;
+      else
+        Lo = std::max(Lo, Bound);
+    }
+
+    /// applyMin - Append x -> min(x, Bound) to the summary.
+    void applyMin(unsigned int Bound)
+    {
+      if (Bound <= Lo)
+        Lo = Hi = Bound;
+      else
+        Hi = std::min(Hi, Bound);
+    }
+
+    /// apply - Evaluate the summary for a position at the block entry.
+    unsigned int apply(unsigned int x) const
+    {
+      return std::min(std::max(x, Lo), Hi);
+    }
+  };
+
   // forward definition.
   class SCANode;
   class SCAEdge;
@@ -228,14 +382,11 @@ namespace llvm {
   bool operator <(const SCAEdge &a, const SCAEdge &b);
   llvm::raw_ostream &operator <<(llvm::raw_ostream &O, ilp_prefix Prefix);
 
-  /// Set of SCANodes.
-  typedef std::set<SCANode*> SCANodeSet;
+  /// List of SCANodes.
+  typedef std::vector<SCANode*> SCANodes;
 
-  /// Set of SCAEdges.
-  typedef std::set<SCAEdge> SCAEdgeSet;
-
-  /// Map call graph nodes to spill cost information.
-  typedef std::map<std::pair<MCGNode*, CostPair>, SCANode*> MCGSCANodeMap;
+  /// Map call graph nodes and occupancies to spill cost information.
+  typedef DenseMap<std::pair<MCGNode*, CostPair>, SCANode*> MCGSCANodeMap;
 
   /// Link context-sensitive information on the spill costs at a call graph
   /// nodes to calling contexts.
@@ -278,7 +429,11 @@ namespace llvm {
   /// Context-sensitive information on the spill costs at a call graph node.
   class SCANode
   {
+    friend class SpillCostAnalysisGraph;
   private:
+    /// Dense ID of the node within the SCA graph.
+    unsigned int ID;
+
     /// Call graph node associated with spill costs.
     MCGNode *Node;
 
@@ -301,12 +456,6 @@ namespace llvm {
     /// a path without calls.
     bool HasCallFreePath;
 
-    /// The parent calling contexts of this node.
-    SCAEdgeSet Parents;
-
-    /// The calling contexts originating from this node.
-    SCAEdgeSet Children;
-
     /// Flag indicating whether this node should be visualized in DOT dumps.
     bool IsVisible;
 
@@ -314,15 +463,32 @@ namespace llvm {
     /// from the root node to the node exists that fits into the root node's
     /// maximum displacement (which is not limited by the stack cache size).
     bool IsValid;
+
+    /// The parent calling contexts of this node, available once the graph is
+    /// finalized.
+    /// \see SpillCostAnalysisGraph::finalize
+    ArrayRef<SCAEdge> Parents;
+
+    /// The calling contexts originating from this node, available once the
+    /// graph is finalized.
+    /// \see SpillCostAnalysisGraph::finalize
+    ArrayRef<SCAEdge> Children;
   public:
-    SCANode(MCGNode *node, const CostPair &occupancy,
+    SCANode(unsigned int id, MCGNode *node, const CostPair &occupancy,
             unsigned int maxdisplacment, const CostPair &spillcost,
             bool hascallfreepath) :
-        Node(node), Occupancy(occupancy), MaxDisplacement(maxdisplacment),
-        RemainingOccupancy(0), SpillCost(spillcost),
-        HasCallFreePath(hascallfreepath), IsVisible(false), IsValid(false)
+        ID(id), Node(node), Occupancy(occupancy),
+        MaxDisplacement(maxdisplacment), RemainingOccupancy(0),
+        SpillCost(spillcost), HasCallFreePath(hascallfreepath),
+        IsVisible(false), IsValid(false)
     {}
 
+    /// Returns the node's ID, i.e., its index in the graph's node list.
+    unsigned int getID() const
+    {
+      return ID;
+    }
+
     /// Returns the associated call graph node.
     MCGNode *getMCGNode() const
     {
@@ -391,8 +557,8 @@ namespace llvm {
         IsVisible = true;
 
         /// propagate to parents
-        for(SCAEdgeSet::const_iterator i(Parents.begin()), ie(Parents.end());
-            i != ie; i++) {
+        for(ArrayRef<SCAEdge>::const_iterator i(Parents.begin()),
+            ie(Parents.end()); i != ie; i++) {
           i->getCaller()->setVisible();
         }
       }
@@ -417,35 +583,14 @@ namespace llvm {
       return IsValid;
     }
 
-    /// addParent - Create a link between this node and its parent.
-    void addParent(SCANode *parent, MCGSite *site)
-    {
-      SCAEdge newEdge(parent, this, site);
-
-      parent->Children.insert(newEdge);
-      Parents.insert(newEdge);
-    }
-
-    /// Return the parents of this node.
-    SCAEdgeSet &getParents()
-    {
-      return Parents;
-    }
-
     /// Return the parents of this node.
-    const SCAEdgeSet &getParents() const
+    ArrayRef<SCAEdge> getParents() const
     {
       return Parents;
     }
 
     /// Return the children of this node.
-    SCAEdgeSet &getChildren()
-    {
-      return Children;
-    }
-
-    /// Return the children of this node.
-    const SCAEdgeSet &getChildren() const
+    ArrayRef<SCAEdge> getChildren() const
     {
       return Children;
     }
@@ -453,12 +598,35 @@ namespace llvm {
 
   /// A graph representing context-sensitive information on the spill costs at
   /// call graph nodes -- aka SCA graph or SC-SCA graph.
+  ///
+  /// The graph may become very large for deep call graphs. Nodes are thus
+  /// allocated from an arena and identified by dense IDs. Edges are collected
+  /// in a flat list while the graph is constructed, and are then arranged in
+  /// compact adjacency arrays, sorted by caller and by callee respectively,
+  /// once the graph is finalized.
   class SpillCostAnalysisGraph
   {
   private:
+    /// Memory of the SCA nodes.
+    SpecificBumpPtrAllocator<SCANode> Allocator;
+
+    /// The nodes of the graph, indexed by their IDs.
+    SCANodes Nodes;
+
     /// Spill cost information available for individual call graph nodes and
-    /// calling contexts.
-    MCGSCANodeMap Nodes;
+    /// calling contexts, only available until the graph is finalized.
+    MCGSCANodeMap NodeMap;
+
+    /// Number of calling contexts of the call graph nodes, only available
+    /// until the graph is finalized.
+    DenseMap<MCGNode*, unsigned int> NumContexts;
+
+    /// The edges of the graph, while the graph is constructed. Afterwards, all
+    /// edges sorted by their callers.
+    std::vector<SCAEdge> ChildEdges;
+
+    /// All edges sorted by their callees, once the graph is finalized.
+    std::vector<SCAEdge> ParentEdges;
 
     /// The root node of the spill cost graph.
     SCANode *Root;
@@ -466,8 +634,63 @@ namespace llvm {
     /// Subtarget information (stack cache sizes)
     const PatmosSubtarget &STC;
 
+    /// Order edges by their callers (or callees).
+    template<bool ByCallee>
+    static bool compareEdges(const SCAEdge &a, const SCAEdge &b)
+    {
+      unsigned int aFirst = ByCallee ? a.getCallee()->getID() :
+                                       a.getCaller()->getID();
+      unsigned int bFirst = ByCallee ? b.getCallee()->getID() :
+                                       b.getCaller()->getID();
+      if (aFirst != bFirst)
+        return aFirst < bFirst;
+      else
+        return a < b;
+    }
+
+    /// buildAdjacency - Sort the edges and assign the nodes' parents and
+    /// children.
+    void buildAdjacency()
+    {
+      std::sort(ChildEdges.begin(), ChildEdges.end(), compareEdges<false>);
+      ChildEdges.erase(std::unique(ChildEdges.begin(), ChildEdges.end(),
+                                   [](const SCAEdge &a, const SCAEdge &b) {
+                                     return !(a < b) && !(b < a);
+                                   }), ChildEdges.end());
+      ChildEdges.shrink_to_fit();
+
+      ParentEdges = ChildEdges;
+      std::sort(ParentEdges.begin(), ParentEdges.end(), compareEdges<true>);
+
+      for(SCANodes::const_iterator i(Nodes.begin()), ie(Nodes.end()); i != ie;
+          i++) {
+        (*i)->Children = ArrayRef<SCAEdge>();
+        (*i)->Parents = ArrayRef<SCAEdge>();
+      }
+
+      // the edges of each node are consecutive
+      for(size_t i = 0, e = ChildEdges.size(); i != e;) {
+        size_t j = i + 1;
+        while(j != e && ChildEdges[j].getCaller() == ChildEdges[i].getCaller())
+          j++;
+        ChildEdges[i].getCaller()->Children =
+                                  makeArrayRef(ChildEdges).slice(i, j - i);
+        i = j;
+      }
+
+      for(size_t i = 0, e = ParentEdges.size(); i != e;) {
+        size_t j = i + 1;
+        while(j != e &&
+              ParentEdges[j].getCallee() == ParentEdges[i].getCallee())
+          j++;
+        ParentEdges[i].getCallee()->Parents =
+                                 makeArrayRef(ParentEdges).slice(i, j - i);
+        i = j;
+      }
+    }
+
   public:
-    SpillCostAnalysisGraph(const PatmosSubtarget &s) : STC(s) {}
+    SpillCostAnalysisGraph(const PatmosSubtarget &s) : Root(NULL), STC(s) {}
 
     /// makeRoot - Construct the root node of the SCA graph.
     SCANode *makeRoot(MCGNode *node, unsigned int maxdisplacment,
@@ -479,11 +702,8 @@ namespace llvm {
       CostPair spillCosts(0, 0);
 
       // create the root node.
-      Root = new SCANode(node, occupancyCosts, maxdisplacment, spillCosts,
-                         hascallfreepath);
-
-      // store the root node.
-      Nodes[std::make_pair(node, occupancyCosts)] = Root;
+      makeNode(node, occupancyCosts, spillCosts, maxdisplacment,
+               hascallfreepath, Root);
 
       return Root;
     }
@@ -495,57 +715,118 @@ namespace llvm {
                   const CostPair &spillcost, unsigned int maxdisplacment,
                   bool hascallfreepath, SCANode *&result)
     {
-      MCGSCANodeMap::iterator tmp(Nodes.find(
-          std::make_pair(node, occupancy)));
+      std::pair<MCGSCANodeMap::iterator, bool> tmp(NodeMap.insert(
+          std::make_pair(std::make_pair(node, occupancy), (SCANode*)NULL)));
 
-      result = NULL;
-      if (tmp == Nodes.end()) {
+      if (tmp.second) {
 
 #ifdef PATMOS_TRACE_DETAILED_RESULTS
         LLVM_DEBUG(
-          dbgs() << "makeNode[" << yamlId << "]: " << *node
-            << " spill=" << spillcost.get() << " occ=" << occupancy.get() << "\n";
+          dbgs() << "makeNode[" << Nodes.size() << "]: " << *node
+            << " spill=" << spillcost.first << " occ=" << occupancy.first
+            << "\n";
         );
 #endif // PATMOS_TRACE_DETAILED_RESULTS
 
         // create a new node
-        result = new SCANode(node, occupancy, maxdisplacment, spillcost,
-                             hascallfreepath);
+        result = new (Allocator.Allocate()) SCANode(Nodes.size(), node,
+                                                    occupancy, maxdisplacment,
+                                                    spillcost, hascallfreepath);
 
         // store the newly created node
-        Nodes[std::make_pair(node, occupancy)] = result;
+        Nodes.push_back(result);
+        tmp.first->second = result;
+        NumContexts[node]++;
 
         return true;
       }
       else {
         // use the existing node
-        result = tmp->second;
+        result = tmp.first->second;
 
         return false;
       }
     }
 
-    /// deleteNode - Free the node and remove it from the node list as well as
-    /// parent/children lists.
-    void deleteNode(SCANode *N)
+    /// hasContext - Check whether a node exists for the call graph node in the
+    /// calling context given by the occupancy.
+    bool hasContext(MCGNode *node, const CostPair &occupancy) const
+    {
+      return NodeMap.count(std::make_pair(node, occupancy));
+    }
+
+    /// getNumContexts - Return the number of calling contexts constructed for
+    /// a call graph node so far.
+    unsigned int getNumContexts(MCGNode *node) const
+    {
+      return NumContexts.lookup(node);
+    }
+
+    /// addEdge - Create a link between a node and its parent.
+    void addEdge(SCANode *parent, SCANode *child, MCGSite *site)
+    {
+      assert(NodeMap.size() == Nodes.size() && "graph finalized already");
+      ChildEdges.push_back(SCAEdge(parent, child, site));
+    }
+
+    /// finalize - Remove UNKNOWN nodes from the graph, redirecting their
+    /// parent/child relations, and make the parents and children of all
+    /// nodes available. No nodes or edges can be added afterwards.
+    void finalize()
     {
-      // remove the node from the node list
-      Nodes.erase(std::make_pair(N->getMCGNode(), N->getOccupancyCosts()));
+      // the node map is not needed anymore
+      MCGSCANodeMap().swap(NodeMap);
+      DenseMap<MCGNode*, unsigned int>().swap(NumContexts);
+
+      buildAdjacency();
+
+      // link the parents of UNKNOWN nodes to their children
+      bool hasUnknown = false;
+      std::vector<SCAEdge> edges;
+      for(SCANodes::const_iterator i(Nodes.begin()), ie(Nodes.end()); i != ie;
+          i++) {
+        if (!(*i)->getMCGNode()->isUnknown())
+          continue;
+        hasUnknown = true;
+
+        for(ArrayRef<SCAEdge>::const_iterator j((*i)->Children.begin()),
+            je((*i)->Children.end()); j != je; j++) {
+          for(ArrayRef<SCAEdge>::const_iterator k((*i)->Parents.begin()),
+              ke((*i)->Parents.end()); k != ke; k++) {
+            edges.push_back(SCAEdge(k->getCaller(), j->getCallee(),
+                                    k->getSite()));
+          }
+        }
+      }
+
+      if (!hasUnknown)
+        return;
 
-      // remove all edges leading to the node in its parent's children lists
-      for(SCAEdgeSet::const_iterator i(N->getParents().begin()),
-          ie(N->getParents().end()); i != ie; i++) {
-        i->getCaller()->getChildren().erase(*i);
+      // keep all other edges not involving UNKNOWN nodes
+      for(std::vector<SCAEdge>::const_iterator i(ChildEdges.begin()),
+          ie(ChildEdges.end()); i != ie; i++) {
+        edges.push_back(*i);
+      }
+      ChildEdges.clear();
+      for(std::vector<SCAEdge>::const_iterator i(edges.begin()),
+          ie(edges.end()); i != ie; i++) {
+        if (!i->getCaller()->getMCGNode()->isUnknown() &&
+            !i->getCallee()->getMCGNode()->isUnknown())
+          ChildEdges.push_back(*i);
       }
 
-      // remove all edges originating from the node in its children's parents
-      // lists
-      for(SCAEdgeSet::const_iterator i(N->getChildren().begin()),
-          ie(N->getChildren().end()); i != ie; i++) {
-        i->getCallee()->getParents().erase(*i);
+      // remove the UNKNOWN nodes, their memory is freed with the graph
+      SCANodes nodes;
+      for(SCANodes::const_iterator i(Nodes.begin()), ie(Nodes.end()); i != ie;
+          i++) {
+        if (!(*i)->getMCGNode()->isUnknown()) {
+          (*i)->ID = nodes.size();
+          nodes.push_back(*i);
+        }
       }
+      Nodes.swap(nodes);
 
-      delete N;
+      buildAdjacency();
     }
 
     /// Return the graph's root node.
@@ -556,19 +837,10 @@ namespace llvm {
 
     /// getNodes - Return the nodes of the SCA graph.
     /// @return The nodes of the SCA graph.
-    const MCGSCANodeMap &getNodes() const
+    const SCANodes &getNodes() const
     {
       return Nodes;
     }
-
-    /// Free all SCA nodes associated with this graph.
-    ~SpillCostAnalysisGraph()
-    {
-      for(MCGSCANodeMap::iterator i(Nodes.begin()), ie(Nodes.end()); i != ie;
-          i++) {
-        delete i->second;
-      }
-    }
   };
 
   /// Information concerning a specific SCC.
@@ -728,8 +1000,291 @@ namespace llvm {
       SCCInfos::const_iterator tmp(Infos.find(function));
       return tmp != Infos.end();
     }
+
+    /// addInfo - Add inferred information for a specific SCC represented by a
+    /// function.
+    void addInfo(const std::string &function, const SCCInfo &info) {
+      assert(!hasInfo(function));
+      Infos[function] = info;
+    }
+  };
+
+  /// getDecrement - Check whether V is the parameter Arg decremented by a
+  /// positive constant, which is returned in Dec.
+  static bool getDecrement(const Value *V, const Argument *Arg, int64_t &Dec)
+  {
+    const BinaryOperator *BO = dyn_cast<BinaryOperator>(V);
+    if (!BO || BO->getOperand(0) != Arg)
+      return false;
+
+    const ConstantInt *C = dyn_cast<ConstantInt>(BO->getOperand(1));
+    if (!C)
+      return false;
+
+    if (BO->getOpcode() == Instruction::Sub)
+      Dec = C->getSExtValue();
+    else if (BO->getOpcode() == Instruction::Add)
+      Dec = -C->getSExtValue();
+    else
+      return false;
+
+    return Dec > 0;
+  }
+
+  /// getRecursionGuard - Find a branch dominating the recursive call CB that
+  /// only leads to it if the parameter Arg is greater than a constant, or
+  /// different from it if NE is set. The constant is returned in Bound.
+  static bool getRecursionGuard(const DominatorTree &DT, const CallBase *CB,
+                                const Argument *Arg, bool &Signed, bool &NE,
+                                int64_t &Bound)
+  {
+    const BasicBlock *BB = CB->getParent();
+    for(const DomTreeNode *D = DT.getNode(BB)->getIDom(); D;
+        D = D->getIDom()) {
+      const BasicBlock *DB = D->getBlock();
+      const BranchInst *Br = dyn_cast<BranchInst>(DB->getTerminator());
+      if (!Br || !Br->isConditional())
+        continue;
+
+      const ICmpInst *Cmp = dyn_cast<ICmpInst>(Br->getCondition());
+      if (!Cmp)
+        continue;
+
+      for(unsigned int s = 0; s != 2; s++) {
+        if (!DT.dominates(BasicBlockEdge(DB, Br->getSuccessor(s)), BB))
+          continue;
+
+        // the condition holding on the way to the call, Arg on the left
+        CmpInst::Predicate P = s == 0 ? Cmp->getPredicate() :
+                                        Cmp->getInversePredicate();
+        const Value *L = Cmp->getOperand(0);
+        const Value *R = Cmp->getOperand(1);
+        if (R == Arg) {
+          std::swap(L, R);
+          P = CmpInst::getSwappedPredicate(P);
+        }
+
+        const ConstantInt *C = dyn_cast<ConstantInt>(R);
+        if (L != Arg || !C)
+          continue;
+
+        NE = P == CmpInst::ICMP_NE;
+        Signed = NE || CmpInst::isSigned(P);
+        Bound = Signed ? C->getSExtValue() : (int64_t)C->getZExtValue();
+        switch (P) {
+        case CmpInst::ICMP_SGT:
+        case CmpInst::ICMP_UGT:
+        case CmpInst::ICMP_NE:
+          return true;
+        case CmpInst::ICMP_SGE:
+        case CmpInst::ICMP_UGE:
+          Bound--;
+          return true;
+        default:
+          break;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  /// inferRecursionBound - Bound the activations of a self-recursive function
+  /// along a chain of calls, given that all recursive calls decrement the
+  /// parameter Arg, guarded by a comparison of Arg with a constant, and that
+  /// all other calls pass a constant for Arg.
+  static bool inferRecursionBound(const DominatorTree &DT, const Argument *Arg,
+                                  ArrayRef<const CallBase*> Recursive,
+                                  ArrayRef<const CallBase*> Entries,
+                                  uint64_t &Activations)
+  {
+    unsigned int Idx = Arg->getArgNo();
+    unsigned int Width = Arg->getType()->getIntegerBitWidth();
+
+    // the smallest bound and decrement of all recursive calls
+    bool Signed = true, NE = false;
+    int64_t Bound = 0, Dec = 0;
+    for(ArrayRef<const CallBase*>::iterator i(Recursive.begin()),
+        ie(Recursive.end()); i != ie; i++) {
+      bool S, N;
+      int64_t B, D;
+      if (!getDecrement((*i)->getArgOperand(Idx), Arg, D) ||
+          !getRecursionGuard(DT, *i, Arg, S, N, B))
+        return false;
+
+      // the decremented parameter must not wrap around, a parameter compared
+      // for inequality must meet the bound
+      int64_t Min = S ? -(INT64_C(1) << (Width - 1)) : 0;
+      if (B + 1 - D < Min || (N && D != 1))
+        return false;
+
+      if (i == Recursive.begin()) {
+        Signed = S;
+        NE = N;
+        Bound = B;
+        Dec = D;
+      }
+      else if (S != Signed || N != NE || (NE && B != Bound))
+        return false;
+
+      Bound = std::min(Bound, B);
+      Dec = std::min(Dec, D);
+    }
+
+    // the largest initial value of the parameter
+    int64_t Start = std::numeric_limits<int64_t>::min();
+    for(ArrayRef<const CallBase*>::iterator i(Entries.begin()),
+        ie(Entries.end()); i != ie; i++) {
+      const ConstantInt *C = dyn_cast<ConstantInt>((*i)->getArgOperand(Idx));
+      if (!C)
+        return false;
+
+      int64_t V = Signed ? C->getSExtValue() : (int64_t)C->getZExtValue();
+      if (NE && V < Bound)
+        return false;
+
+      Start = std::max(Start, V);
+    }
+
+    // each activation but the last has a parameter above the bound
+    Activations = Start > Bound ? (Start - Bound + Dec - 1) / Dec + 1 : 1;
+    return true;
+  }
+
+  /// inferRecursionBound - Bound the activations of the self-recursive
+  /// function F along a chain of calls, if F decrements one of its parameters
+  /// toward a constant and is called with a constant for it otherwise.
+  static bool inferRecursionBound(const Function &F, uint64_t &Activations)
+  {
+    if (F.isDeclaration() || F.isVarArg() || F.hasAddressTaken())
+      return false;
+
+    // all uses are direct calls, which are recursive or enter the recursion
+    SmallVector<const CallBase*, 4> Recursive, Entries;
+    for(const User *U : F.users()) {
+      const CallBase *CB = dyn_cast<CallBase>(U);
+      if (!CB)
+        return false;
+      else if (CB->getFunction() == &F)
+        Recursive.push_back(CB);
+      else
+        Entries.push_back(CB);
+    }
+
+    if (Recursive.empty() || Entries.empty())
+      return false;
+
+    DominatorTree DT(const_cast<Function&>(F));
+    for(const Argument &A : F.args()) {
+      if (A.getType()->isIntegerTy() &&
+          A.getType()->getIntegerBitWidth() <= 32 &&
+          inferRecursionBound(DT, &A, Recursive, Entries, Activations))
+        return true;
+    }
+
+    return false;
+  }
+
+  /// Analysis results of a function that only depend on the function itself
+  /// and the functions it (transitively) calls.
+  struct SCASummary {
+    /// Fingerprint of the code of the function and its callees, as well as of
+    /// the analysis parameters.
+    std::string Fingerprint;
+
+    /// Flag indicating whether the function has a call-free path.
+    bool IsCallFree;
+
+    /// Minimum displacement of the function, including its callees.
+    unsigned int MinDisplacement;
+
+    /// Maximum displacement of the function, including its callees.
+    unsigned int MaxDisplacement;
+
+    /// Worst-case filling of the function's SENS instructions, in program
+    /// order.
+    std::vector<unsigned int> Ensures;
+
+    SCASummary() : IsCallFree(false), MinDisplacement(0), MaxDisplacement(0)
+    {
+    }
   };
 
+  /// Map function names to summaries.
+  typedef std::map<std::string, SCASummary> SCASummaries;
+
+  /// readSummaries - Read function summaries from a file, as written by
+  /// writeSummaries. Missing files and malformed lines are ignored.
+  static void readSummaries(const std::string &filename,
+                            SCASummaries &Summaries)
+  {
+    ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer =
+                                                MemoryBuffer::getFile(filename);
+    if (!Buffer)
+      return;
+
+    // the format of a line is:
+    // [fingerprint] [call-free] [min] [max] [#ensures] [ensures]* [name]\n
+    StringRef Text((*Buffer)->getBuffer());
+    while(!Text.empty()) {
+      StringRef Line;
+      std::tie(Line, Text) = Text.split('\n');
+      if (Line.empty() || Line.startswith("#"))
+        continue;
+
+      SmallVector<StringRef, 16> Fields;
+      Line.split(Fields, ' ', -1, false);
+
+      SCASummary S;
+      unsigned int callfree, numEnsures;
+      if (Fields.size() < 6 || Fields[1].getAsInteger(10, callfree) ||
+          Fields[2].getAsInteger(10, S.MinDisplacement) ||
+          Fields[3].getAsInteger(10, S.MaxDisplacement) ||
+          Fields[4].getAsInteger(10, numEnsures) ||
+          Fields.size() != 6 + numEnsures) {
+        errs() << "Warning: Invalid line in stack cache analysis summaries: "
+               << Line << ".\n";
+        continue;
+      }
+
+      S.Fingerprint = Fields[0].str();
+      S.IsCallFree = callfree != 0;
+      S.Ensures.resize(numEnsures);
+      bool valid = true;
+      for(unsigned int i = 0; i < numEnsures; i++)
+        valid &= !Fields[5 + i].getAsInteger(10, S.Ensures[i]);
+
+      if (valid)
+        Summaries[Fields.back().str()] = S;
+    }
+  }
+
+  /// writeSummaries - Write function summaries to a file.
+  static void writeSummaries(const std::string &filename,
+                             const SCASummaries &Summaries)
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(filename, EC);
+    if (EC) {
+      errs() << "Error: Failed to write to file '" << filename << "': "
+             << EC.message() << ".\n";
+      return;
+    }
+
+    OS << "# Patmos stack cache analysis summaries\n";
+    for(SCASummaries::const_iterator i(Summaries.begin()),
+        ie(Summaries.end()); i != ie; i++) {
+      const SCASummary &S(i->second);
+      OS << S.Fingerprint << ' ' << S.IsCallFree << ' ' << S.MinDisplacement
+         << ' ' << S.MaxDisplacement << ' ' << S.Ensures.size();
+      for(std::vector<unsigned int>::const_iterator j(S.Ensures.begin()),
+          je(S.Ensures.end()); j != je; j++) {
+        OS << ' ' << *j;
+      }
+      OS << ' ' << i->first << '\n';
+    }
+  }
+
   /// Pass to analyze the occupancy and displacement of Patmos' stack cache.
   class PatmosStackCacheAnalysis : public MachineModulePass {
   private:
@@ -873,7 +1428,23 @@ namespace llvm {
     SpillCostAnalysisGraph SCAGraph;
 
     /// Bounds to solve ILPs during stack cache analysis.
-    const BoundsInformation BI;
+    BoundsInformation BI;
+
+    /// Solver used for the ILPs of the analysis.
+    std::unique_ptr<PatmosILPSolver> Solver;
+
+    /// Threads solving independent ILPs, created on first use.
+    std::unique_ptr<ThreadPool> ILPThreads;
+
+    /// Function summaries of a previous compilation.
+    SCASummaries OldSummaries;
+
+    /// Function summaries of the current compilation.
+    SCASummaries NewSummaries;
+
+    /// Summaries of a previous compilation that are still valid, i.e., the
+    /// function and its callees did not change.
+    std::map<const MCGNode*, const SCASummary*> ReusableSummaries;
 
     MInstrIndex MiMap;
   public:
@@ -885,6 +1456,18 @@ namespace llvm {
         TII(*tm.getInstrInfo()), SCAGraph(STC), BI(BoundsFile)
     {
       initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
+
+      if (ILPSolverMode == ILP_EXTERNAL)
+        Solver = createPatmosExternalILPSolver(Solve_ilp);
+      else {
+        // the builtin solver may give up on large ILPs
+        Solver = createPatmosFallbackILPSolver(
+                           createPatmosBuiltinILPSolver(ILPSolverMaxNodes),
+                           createPatmosExternalILPSolver(Solve_ilp));
+      }
+
+      if (EnableILPCache || !ILPCacheDir.empty())
+        Solver = createPatmosCachingILPSolver(std::move(Solver), ILPCacheDir);
     }
 
     /// getAnalysisUsage - Inform the pass manager that nothing is modified.
@@ -1009,6 +1592,19 @@ namespace llvm {
       }
     }
 
+    /// getMinBytesReserved - Get the number of bytes a call graph node reserves
+    /// on every path through it. Functions whose frame was shrink-wrapped
+    /// may return without reserving anything.
+    unsigned int getMinBytesReserved(const MCGNode *Node) const
+    {
+      if (Node->isUnknown())
+        return 0;
+
+      const PatmosMachineFunctionInfo *PMFI =
+                                 Node->getMF()->getInfo<PatmosMachineFunctionInfo>();
+      return PMFI->isShrinkWrapped() ? 0 : getBytesReserved(Node);
+    }
+
     /// getGlobalEnsureFilling - Worst-case number of blocks that need to be
     /// loaded by ensures of the node and its callers in the case of a
     /// preemption.
@@ -1045,16 +1641,18 @@ namespace llvm {
 
     /// computeMinMaxDisplacement - Visit a call graph node and determine its
     /// minimum/maximum displacement, including all its children in the call
-    /// graph.
+    /// graph. The displacement of nodes within SCCs is taken from ILPResults.
     void computeMinMaxDisplacement(MCGNodeSCC &SCCMap, MCGNode *Node,
                                    MCGNodeUInt &succCount, MCGNodes &WL,
+                                   const MCGNodeUInt &ILPResults,
                                    bool Maximize)
     {
       // keep track of the total displacement of the node and its children
       unsigned int totalDisplacment;
 
       // get the local stack displacement of the call graph node
-      unsigned int nodeDisplacement = getBytesReserved(Node);
+      unsigned int nodeDisplacement = Maximize ? getBytesReserved(Node) :
+                                                 getMinBytesReserved(Node);
 
       // handle some cases:
       // (1) dead functions (2) SCCs, and (3) regular nodes
@@ -1062,12 +1660,23 @@ namespace llvm {
         // ok, dead nodes don't do anything
         return;
       }
+      else if (Node->isLibrary()) {
+        // known from the summaries of a pre-compiled library
+        const PatmosLibrarySummaries &L(PatmosLibrarySummaries::get());
+        StringRef Name(Node->getLibraryName());
+        totalDisplacment = Maximize ?
+                         L.getMaxDisplacement(Name, STC.getStackCacheSize()) :
+                         L.getMinDisplacement(Name);
+      }
+      else if (const SCASummary *S = getReusableSummary(Node)) {
+        // known from a previous compilation
+        totalDisplacment = Maximize ? S->MaxDisplacement : S->MinDisplacement;
+      }
       else if (SCCMap[Node]->second) {
-        // the node is in an SCC! -> make an ILP
-        // note: we know here that all successors of the entire SCC have been
-        // handled
-        totalDisplacment = computeMinMaxDisplacementILP(SCCMap[Node]->first,
-                                                        Node, Maximize);
+        // the node is in an SCC! -> the ILP has been solved already
+        MCGNodeUInt::const_iterator tmp(ILPResults.find(Node));
+        assert(tmp != ILPResults.end());
+        totalDisplacment = tmp->second;
         assert(totalDisplacment >= nodeDisplacement);
       }
       else {
@@ -1141,8 +1750,10 @@ namespace llvm {
     ///
     /// Note that SCCs are considered as if they were collapsed into a single
     /// node. Within SCCs an ILP formulation is used to bound the displacement.
+    /// All nodes on the work list are independent of each other, their ILPs
+    /// are thus solved as a batch, potentially concurrently.
     ///
-    /// \see computeMinMaxDisplacementILP
+    /// \see makeMinMaxDisplacementILP
     void computeMinMaxDisplacement(const MCallGraph &G, bool Maximize)
     {
       // list of SCCs in the call graph and mapping to/from call graph nodes
@@ -1205,12 +1816,20 @@ namespace llvm {
 
       // process nodes in topological order
       while(!WL.empty()) {
-        // pop some node from the work list
-        MCGNode *tmp = WL.back();
-        WL.pop_back();
+        // take all nodes from the work list
+        MCGNodes Ready;
+        Ready.swap(WL);
 
-        // compute its displacement
-        computeMinMaxDisplacement(SCCMap, tmp, succCount, WL, Maximize);
+        // solve the ILPs of the nodes within SCCs
+        MCGNodeUInt ILPResults;
+        solveMinMaxDisplacementILPs(SCCMap, Ready, ILPResults, Maximize);
+
+        // compute their displacement
+        for(MCGNodes::reverse_iterator i(Ready.rbegin()), ie(Ready.rend());
+            i != ie; i++) {
+          computeMinMaxDisplacement(SCCMap, *i, succCount, WL, ILPResults,
+                                    Maximize);
+        }
       }
 
 #ifdef PATMOS_TRACE_CG_DISPLACMENT
@@ -1362,7 +1981,7 @@ namespace llvm {
 
 
           // actually update the sizes of the ensure instructions.
-          if (EnableEnsureDwn) {
+          if (downsizeEnsures(*MF)) {
             for(SIZEs::const_iterator i(ENSs.begin()), ie(ENSs.end()); i != ie;
                 i++) {
               i->first->getOperand(2).setImm(i->second);
@@ -1561,7 +2180,8 @@ namespace llvm {
     /// at the ensure instruction of all the callers of a call graph node
     /// downwards through the call graph.
     void propagateGlobalEnsureFilling(MCGNodeSCC &SCCMap, MCGNode *Node,
-                                      MCGNodeUInt &succCount, MCGNodes &WL)
+                                      MCGNodeUInt &succCount, MCGNodes &WL,
+                                      const MCGNodeUInt &ILPResults)
     {
       // keep track of the total ensure cost of the node and its parent
       unsigned int totalCost = 0;
@@ -1578,11 +2198,10 @@ namespace llvm {
           GlobalEnsureFillingILPFree++;
         }
         else {
-          // the node is in an SCC! -> make an ILP
-          // note: we know here that all predecessors of the entire SCC have been
-          // handled
-          totalCost = propagateGlobalEnsureFillingILP(SCCMap[Node]->first,
-                                                      Node);
+          // the node is in an SCC! -> the ILP has been solved already
+          MCGNodeUInt::const_iterator tmp(ILPResults.find(Node));
+          assert(tmp != ILPResults.end());
+          totalCost = tmp->second;
           GlobalEnsureFillingILP++;
         }
       }
@@ -1640,34 +2259,50 @@ namespace llvm {
       }
     }
 
-    /// propagateGlobalEnsureFillingILP - Propagate the worst-case filling
-    /// caused at the ensure instruction of all the callers of a call graph node
-    /// downwards through the call graph.
-    unsigned int propagateGlobalEnsureFillingILP(const MCGNodes &SCC,
-                                                 MCGNode *N)
+    /// solveGlobalEnsureFillingILPs - Construct and solve the ILPs bounding
+    /// the worst-case filling of the nodes within SCCs among the given nodes.
+    /// All predecessors of these nodes outside of their SCCs have to be
+    /// handled already.
+    void solveGlobalEnsureFillingILPs(MCGNodeSCC &SCCMap, const MCGNodes &Nodes,
+                                      MCGNodeUInt &ILPResults)
     {
-      assert(std::find(SCC.begin(), SCC.end(), N) != SCC.end());
+      PatmosRegionTimer T("sca-ensure-ilp", "SCA global ensure-filling ILPs");
+      MCGNodes ILPNodes;
+      std::vector<std::string> LPs;
+      for(MCGNodes::const_iterator i(Nodes.begin()), ie(Nodes.end()); i != ie;
+          i++) {
+        if (!(*i)->isDead() && SCCMap[*i]->second &&
+            getMinDisplacement(*i) < STC.getStackCacheSize()) {
+          ILPNodes.push_back(*i);
+          LPs.push_back(makeGlobalEnsureFillingILP(SCCMap[*i]->first, *i));
+        }
+      }
 
-      // get user-supplied bounds to solve the ILP.
-      const SCCInfo &BInfo(BI.getInfo(SCC));
+      std::vector<unsigned int> Results;
+      solve_ilps(LPs, Results);
 
-      // open LP file.
-      SmallString<1024> LPname;
-      std::error_code err = sys::fs::createUniqueDirectory("stack", LPname);
-      if (err) {
-        errs() << "Error creating temp .lp file: " << err.message() << "\n";
-        return std::numeric_limits<unsigned int>::max();
+      for(unsigned int i = 0; i < ILPNodes.size(); i++) {
+        ILPResults[ILPNodes[i]] = Results[i];
+
+#ifdef PATMOS_TRACE_CG_ENS_COST_ILP
+        dbgs() << "ILP: " << *ILPNodes[i] << ": " << Results[i] << "\n";
+#endif // PATMOS_TRACE_CG_ENS_COST_ILP
       }
+    }
 
-      sys::path::append(LPname, "scc.lp");
+    /// makeGlobalEnsureFillingILP - Construct an ILP modeling the worst-case
+    /// filling caused at the ensure instruction of all the callers of a call
+    /// graph node.
+    std::string makeGlobalEnsureFillingILP(const MCGNodes &SCC, MCGNode *N)
+    {
+      assert(std::find(SCC.begin(), SCC.end(), N) != SCC.end());
 
-      std::error_code ErrMsg;
-      raw_fd_ostream OS(LPname.c_str(), ErrMsg);
-      if (!ErrMsg) {
-        errs() << "Error: Failed to open file '" << LPname.str()
-               << "' for writing!\n";
-        return std::numeric_limits<unsigned int>::max();
-      }
+      // get user-supplied bounds to solve the ILP.
+      const SCCInfo &BInfo(BI.getInfo(SCC));
+
+      // construct the LP in memory, the solver decides where it goes.
+      std::string LP;
+      raw_string_ostream OS(LP);
 
       // find entry and exit call sites
       typedef std::set<MCGSite*> MCGSiteSet;
@@ -1907,20 +2542,7 @@ namespace llvm {
 
       OS << "End\n";
 
-      OS.close();
-
-      // solve the ILP
-      unsigned int result = solve_ilp(LPname.c_str(), true);
-
-#ifdef PATMOS_TRACE_CG_ENS_COST_ILP
-      dbgs() << "ILP: " << *N << ": " << result << "\n";
-#endif // PATMOS_TRACE_CG_ENS_COST_ILP
-
-      // remove LP file
-      // TODO do we need to remove the temp dir??
-      sys::fs::remove(LPname.str());
-
-      return result;
+      return OS.str();
     }
 
     /// propagateGlobalEnsureFilling - Propagate the worst-case filling caused
@@ -1981,10 +2603,17 @@ namespace llvm {
       }
 
       while(!WL.empty()) {
-          MCGNode *tmp = WL.back();
-          WL.pop_back();
+        // take all nodes from the work list, their ILPs are independent
+        MCGNodes Ready;
+        Ready.swap(WL);
 
-          propagateGlobalEnsureFilling(SCCMap, tmp, predCount, WL);
+        MCGNodeUInt ILPResults;
+        solveGlobalEnsureFillingILPs(SCCMap, Ready, ILPResults);
+
+        for(MCGNodes::reverse_iterator i(Ready.rbegin()), ie(Ready.rend());
+            i != ie; i++) {
+          propagateGlobalEnsureFilling(SCCMap, *i, predCount, WL, ILPResults);
+        }
       }
     }
 
@@ -2192,44 +2821,141 @@ namespace llvm {
       }
     }
 
-    /// analyzeEnsures - Does what it says.
-    /// SENS instructions can be removed if
-    /// the preceding calls plus the current frame on the stack cache fit into
-    /// the stack cache.
-    void analyzeEnsures(const MCallGraph &G)
+    /// analyzeContextSwitches - Bound the filling of the ensures restoring the
+    /// stack cache contents of the interrupted code on return from interrupt
+    /// handlers. The handlers do not reserve stack cache space themselves, at
+    /// most the maximum displacement of their callees is filled.
+    void analyzeContextSwitches(const MCallGraph &G)
     {
-      const MCGNodes &nodes(G.getNodes());
-
-      // we store analysis results in a pseudo pass
       PatmosStackCacheAnalysisInfo *info =
        &getAnalysis<PatmosStackCacheAnalysisInfo>();
-      info->setValid();
 
-      // visit all functions
+      const MCGNodes &nodes(G.getNodes());
       for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
           i++) {
-        if (!(*i)->isUnknown() && !(*i)->isDead()) {
-          MBBs WL;
+        if ((*i)->isUnknown() || (*i)->isDead())
+          continue;
+
+        MachineFunction *MF = (*i)->getMF();
+        if (!MF->getInfo<PatmosMachineFunctionInfo>()->isInterruptHandler())
+          continue;
+
+        unsigned int fill = getMaxDisplacement(*i);
+        for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
+            j++) {
+          for(MachineBasicBlock::instr_iterator k(j->instr_begin()),
+              ke(j->instr_end()); k != ke; k++) {
+            if (k->getOpcode() == Patmos::SENSr &&
+                k->getFlag(MachineInstr::FrameSetup)) {
+              info->Ensures[&*k] = fill;
+              if (fill == 0)
+                NonFillingSENS++;
+              else
+                FillingSENS++;
+            }
+          }
+        }
+      }
+    }
+
+    /// analyzeEnsures - Does what it says.
+    /// SENS instructions can be removed if
+    /// the preceding calls plus the current frame on the stack cache fit into
+    /// the stack cache.
+    void analyzeEnsures(const MCallGraph &G)
+    {
+      const MCGNodes &nodes(G.getNodes());
+
+      // we store analysis results in a pseudo pass
+      PatmosStackCacheAnalysisInfo *info =
+       &getAnalysis<PatmosStackCacheAnalysisInfo>();
+      info->setValid();
+
+      // visit all functions
+      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
+          i++) {
+        if (!(*i)->isUnknown() && !(*i)->isDead()) {
+          MBBs WL;
           SIZEs ENSs;
           MBBUInt INs;
           MachineFunction *MF = (*i)->getMF();
 
-          // initialize work list (yeah, reverse post order would be optimal,
-          // but this works too).
-          for(MachineFunction::iterator j(MF->begin()), je(MF->end()); j != je;
-              j++) {
-            WL.insert(&*j);
+          if (const SCASummary *S = getReusableSummary(*i)) {
+            // the filling is known from a previous compilation
+            std::vector<unsigned int>::const_iterator f(S->Ensures.begin());
+            for(MachineFunction::iterator j(MF->begin()), je(MF->end());
+                j != je; j++) {
+              for(MachineBasicBlock::instr_iterator k(j->instr_begin()),
+                  ke(j->instr_end()); k != ke; k++) {
+                if (k->getOpcode() == Patmos::SENSi) {
+                  assert(f != S->Ensures.end());
+                  ENSs[&*k] = WorstCaseEnsureBound[&*k] = *f++;
+                }
+              }
+            }
+            assert(f == S->Ensures.end());
           }
+          else {
+            // initialize work list (yeah, reverse post order would be optimal,
+            // but this works too).
+            for(MachineFunction::iterator j(MF->begin()), je(MF->end());
+                j != je; j++) {
+              WL.insert(&*j);
+            }
 
-          // process until the work list becomes empty
-          while (!WL.empty()) {
-            // get some basic block
-            MachineBasicBlock *MBB = *WL.begin();
-            WL.erase(WL.begin());
+            // process until the work list becomes empty
+            while (!WL.empty()) {
+              // get some basic block
+              MachineBasicBlock *MBB = *WL.begin();
+              WL.erase(WL.begin());
 
-            // update the basic block's information, potentially putting any of
-            // its successors on the work list.
-            analyzeEnsures(WL, INs, ENSs, *i, MBB);
+              // update the basic block's information, potentially putting any
+              // of its successors on the work list.
+              analyzeEnsures(WL, INs, ENSs, *i, MBB);
+            }
+          }
+
+          // keep the filling in program order for later compilations
+          if (!getSummaryFile().empty()) {
+            SCASummary &S(NewSummaries[MF->getFunction().getName().str()]);
+            for(MachineFunction::iterator j(MF->begin()), je(MF->end());
+                j != je; j++) {
+              for(MachineBasicBlock::instr_iterator k(j->instr_begin()),
+                  ke(j->instr_end()); k != ke; k++) {
+                if (k->getOpcode() == Patmos::SENSi) {
+                  assert(ENSs.count(&*k));
+                  S.Ensures.push_back(ENSs[&*k]);
+                }
+              }
+            }
+          }
+
+          // report the filling of each ensure in program order
+          MachineOptimizationRemarkEmitter ORE(*MF, nullptr);
+          for(MachineFunction::iterator j(MF->begin()), je(MF->end());
+              j != je; j++) {
+            for(MachineBasicBlock::instr_iterator k(j->instr_begin()),
+                ke(j->instr_end()); k != ke; k++) {
+              if (k->getOpcode() != Patmos::SENSi || !ENSs.count(&*k))
+                continue;
+              unsigned int fill = ENSs[&*k];
+              unsigned int ensure = k->getOperand(2).getImm() * 4;
+              if (fill == 0 && removeEnsures(*MF))
+                ORE.emit([&]() {
+                  return MachineOptimizationRemark(DEBUG_TYPE, "EnsureRemoved",
+                                                   k->getDebugLoc(), &*j)
+                         << "sens removed: " << ore::NV("Fill", fill)
+                         << " fill";
+                });
+              else
+                ORE.emit([&]() {
+                  return MachineOptimizationRemarkMissed(DEBUG_TYPE,
+                                                         "EnsureKept",
+                                                         k->getDebugLoc(), &*j)
+                         << "sens kept: " << ore::NV("Fill", fill) << " of "
+                         << ore::NV("Ensure", ensure) << " bytes fill";
+                });
+            }
           }
 
           // actually remove ensure instructions (if requested)
@@ -2248,8 +2974,9 @@ namespace llvm {
 #endif // PATMOS_TRACE_DETAILED_RESULTS
 
             if (i->second == 0) {
-              if (EnableEnsureOpt) {
+              if (removeEnsures(*MF)) {
                 i->first->getParent()->erase(i->first);
+                info->setRemovedEnsures();
                 RemovedSENS++;
               } else {
                 NonFillingSENS++;
@@ -2305,86 +3032,370 @@ namespace llvm {
       return tmp.str();
     }
 
-    /// solve_ilp - solve the ILP problem.
-    static unsigned int solve_ilp(const char *LPname, bool Maximize)
+    /// addStats - Add the bounds of the bytes spilled by the reserves and
+    /// filled by the ensures of each function to the per-function statistics.
+    void addStats()
     {
-      unsigned int result = Maximize ? std::numeric_limits<unsigned int>::max():
-                                       std::numeric_limits<unsigned int>::min();
+      const PatmosStackCacheAnalysisInfo &info =
+                                  getAnalysis<PatmosStackCacheAnalysisInfo>();
+
+      // removed ensures fill nothing, they are not accessed
+      for(const auto &R : info.Reserves) {
+        if (R.second)
+          addPatmosStat(R.first->getMF()->getFunction(),
+                        "stack-cache-analysis", "spill-bound", R.second);
+      }
+      for(const auto &E : info.Ensures) {
+        if (E.second)
+          addPatmosStat(E.first->getMF()->getFunction(),
+                        "stack-cache-analysis", "fill-bound", E.second);
+      }
+    }
 
-      std::vector<StringRef> args;
-      args.push_back(Solve_ilp);
-      args.push_back(LPname);
-      args.push_back("\0");
+    /// inferRecursionBounds - Bound the number of activations of the
+    /// self-recursive functions without user-supplied bounds, where the
+    /// pattern of their recursion allows it.
+    void inferRecursionBounds(const MCallGraph &G)
+    {
+      typedef scc_iterator<MCallGraph> PCGSCC_iterator;
+      for(PCGSCC_iterator s(scc_begin(G)); !s.isAtEnd(); ++s) {
+        if (!s.hasCycle() || s->size() != 1)
+          continue;
+
+        MCGNode *N = s->front();
+        if (N->isUnknown() || N->isDead())
+          continue;
 
-      std::string ErrMsg;
-      auto progName = sys::findProgramByName(Solve_ilp);
-    if (progName && sys::ExecuteAndWait(StringRef(*progName),
-                              llvm::ArrayRef<StringRef>(args),
-                              llvm::None,
-                              llvm::ArrayRef<Optional<StringRef>>(),
-                              0,0,&ErrMsg)) {
-        report_fatal_error("calling ILP solver (" + Solve_ilp + "): " + ErrMsg);
+        const Function &F(N->getMF()->getFunction());
+        if (BI.hasInfo(F.getName().str()))
+          continue;
+
+        // the arguments of calls through function pointers are unknown
+        bool isKnown = true;
+        for(MCGSites::const_iterator cs(N->getCallingSites().begin()),
+            cse(N->getCallingSites().end()); cs != cse; cs++) {
+          isKnown &= !(*cs)->getCaller()->isUnknown();
+        }
+
+        uint64_t Activations;
+        if (!isKnown || !inferRecursionBound(F, Activations))
+          continue;
+
+        std::string Constraint;
+        raw_string_ostream OS(Constraint);
+        OS << "rec:\t + " << ilp_name(X, N) << " <= " << Activations << "\n";
+
+        SCCInfo Info = {"", OS.str(), ""};
+        BI.addInfo(F.getName().str(), Info);
+        InferredRecursionBounds++;
+
+        LLVM_DEBUG(dbgs() << "SCA: inferred at most " << Activations
+                          << " activations of " << F.getName() << "\n");
       }
-      else {
-        // read solution
-        // construct name of solution
-        std::string SOLname(LPname);
-        SOLname += ".sol";
+    }
 
-        //SmallString<1024> SOLname(LPname);
-        //sys::path::replace_extension(SOLname, ".sol");
+    /// getSummaryFile - Get the name of the file keeping function summaries,
+    /// or an empty string if summaries are disabled.
+    static std::string getSummaryFile()
+    {
+      if (!SCASummaryFile.empty())
+        return SCASummaryFile;
+      else if (!SCAPMLExport.empty())
+        return SCAPMLExport + ".summaries";
+      else
+        return "";
+    }
 
-        if (!sys::fs::exists(SOLname))
-          report_fatal_error("Failed to read ILP solution");
+    /// getReusableSummary - Get the valid summary of a previous compilation
+    /// for a call graph node, or NULL.
+    const SCASummary *getReusableSummary(const MCGNode *Node) const
+    {
+      std::map<const MCGNode*, const SCASummary*>::const_iterator tmp(
+                                                ReusableSummaries.find(Node));
+      return tmp == ReusableSummaries.end() ? NULL : tmp->second;
+    }
 
-        std::ifstream IS(SOLname.c_str());
-        assert(IS.good());
+    /// printCode - Print the code of a call graph node as far as it is
+    /// relevant to the analysis. This is used to fingerprint the node.
+    void printCode(raw_ostream &OS, const MCGNode *Node) const
+    {
+      if (Node->isLibrary()) {
+        const PatmosLibrarySummaries &L(PatmosLibrarySummaries::get());
+        StringRef Name(Node->getLibraryName());
+        OS << "library " << Name << ' ' << L.getMinDisplacement(Name) << ' '
+           << L.getMaxDisplacement(Name, STC.getStackCacheSize()) << "\n";
+        return;
+      }
+      if (Node->isUnknown()) {
+        OS << "unknown " << *Node->getType() << "\n";
+        return;
+      }
 
-        // read the result value
-        double tmp;
-        IS >> tmp;
-        result = tmp;
+      const MachineFunction *MF = Node->getMF();
+      OS << MF->getFunction().getName() << ' ' << Node->isDead() << ' '
+         << getBytesReserved(Node) << ' ' << downsizeEnsures(*MF) << ' '
+         << removeEnsures(*MF) << "\n";
 
-        // don't go ahead when solving has failed
-        if (tmp == -1.)
-          assert(0 && "unbounded/infeasible ILP");
+      for(MachineFunction::const_iterator i(MF->begin()), ie(MF->end());
+          i != ie; i++) {
+        OS << "BB" << i->getNumber() << ":";
+        for(MachineBasicBlock::const_succ_iterator j(i->succ_begin()),
+            je(i->succ_end()); j != je; j++) {
+          OS << ' ' << (*j)->getNumber();
+        }
+        OS << "\n";
+
+        for(MachineBasicBlock::const_instr_iterator j(i->instr_begin()),
+            je(i->instr_end()); j != je; j++) {
+          OS << j->getOpcode();
+          for(const MachineOperand &MO : j->operands()) {
+            switch(MO.getType()) {
+              case MachineOperand::MO_Register:
+                OS << " r" << MO.getReg().id();
+                break;
+              case MachineOperand::MO_Immediate:
+                OS << " i" << MO.getImm();
+                break;
+              case MachineOperand::MO_MachineBasicBlock:
+                OS << " b" << MO.getMBB()->getNumber();
+                break;
+              case MachineOperand::MO_GlobalAddress:
+                OS << " g" << MO.getGlobal()->getName() << '+'
+                   << MO.getOffset();
+                break;
+              case MachineOperand::MO_ExternalSymbol:
+                OS << " s" << MO.getSymbolName();
+                break;
+              default:
+                OS << " o" << (unsigned int)MO.getType();
+                break;
+            }
+          }
+          OS << "\n";
+        }
+      }
+    }
 
-        sys::fs::remove(SOLname);
+    /// loadSummaries - Fingerprint all call graph nodes and find the
+    /// summaries of a previous compilation that remain valid.
+    ///
+    /// The fingerprint of a node covers its own code and the fingerprints of
+    /// its callees, its summary thus remains valid as long as neither the
+    /// node nor any function it (transitively) calls changed. Nodes in SCCs
+    /// share the fingerprint of their SCC, including the user-supplied
+    /// bounds.
+    void loadSummaries(const MCallGraph &G)
+    {
+      readSummaries(getSummaryFile(), OldSummaries);
+
+      // analysis parameters that might change the results
+      std::string Config;
+      raw_string_ostream CS(Config);
+      CS << "v1 " << STC.getStackCacheSize() << ' '
+         << STC.getStackCacheBlockSize() << ' ' << EnableEnsureDwn << ' '
+         << EnableEnsureOpt;
+      CS.flush();
+
+      // fingerprints of the nodes
+      std::map<const MCGNode*, std::string> Fingerprints;
+
+      // visit SCCs bottom-up, i.e., callees first
+      typedef scc_iterator<MCallGraph> PCGSCC_iterator;
+      for(PCGSCC_iterator s(scc_begin(G)); !s.isAtEnd(); ++s) {
+        const MCGNodes &SCC(*s);
+
+        std::string Text;
+        raw_string_ostream OS(Text);
+        OS << Config << "\n";
+
+        // the code of the SCC's nodes and the fingerprints of their callees
+        std::set<std::string> callees;
+        bool isLive = false;
+        for(MCGNodes::const_iterator n(SCC.begin()), ne(SCC.end()); n != ne;
+            n++) {
+          printCode(OS, *n);
+          isLive |= !(*n)->isDead();
+
+          for(MCGSites::const_iterator cs((*n)->getSites().begin()),
+              cse((*n)->getSites().end()); cs != cse; cs++) {
+            MCGNode *callee = (*cs)->getCallee();
+            if (std::find(SCC.begin(), SCC.end(), callee) == SCC.end()) {
+              assert(Fingerprints.count(callee));
+              callees.insert(Fingerprints[callee]);
+            }
+          }
+        }
+
+        for(std::set<std::string>::const_iterator i(callees.begin()),
+            ie(callees.end()); i != ie; i++) {
+          OS << *i << "\n";
+        }
+
+        // the user-supplied bounds of recursive SCCs
+        if (s.hasCycle() && isLive) {
+          const SCCInfo &BInfo(BI.getInfo(SCC));
+          OS << BInfo.ObjectiveFunction << "\n" << BInfo.Constraints << "\n"
+             << BInfo.Variables << "\n";
+        }
+
+        MD5 Hash;
+        Hash.update(OS.str());
+        MD5::MD5Result Digest;
+        Hash.final(Digest);
+        std::string Fingerprint(Digest.digest().str());
+
+        // summaries are reused for entire SCCs only
+        bool isReusable = true;
+        std::vector<const SCASummary*> summaries;
+        for(MCGNodes::const_iterator n(SCC.begin()), ne(SCC.end()); n != ne;
+            n++) {
+          Fingerprints[*n] = Fingerprint;
+
+          if ((*n)->isUnknown()) {
+            isReusable = false;
+          }
+          else if (!(*n)->isDead()) {
+            std::string name((*n)->getMF()->getFunction().getName().str());
+            NewSummaries[name].Fingerprint = Fingerprint;
+
+            SCASummaries::const_iterator tmp(OldSummaries.find(name));
+            if (tmp == OldSummaries.end() ||
+                tmp->second.Fingerprint != Fingerprint)
+              isReusable = false;
+            else
+              summaries.push_back(&tmp->second);
+          }
+        }
+
+        if (isReusable) {
+          for(MCGNodes::const_iterator n(SCC.begin()), ne(SCC.end()); n != ne;
+              n++) {
+            if ((*n)->isDead())
+              continue;
+
+            ReusableSummaries[*n] = summaries.front();
+            summaries.erase(summaries.begin());
+            ReusedSummaries++;
+          }
+        }
       }
+    }
 
-      ILPs++;
+    /// storeSummaries - Write the summaries of all live functions for later
+    /// compilations.
+    void storeSummaries(const MCallGraph &G)
+    {
+      const MCGNodes &nodes(G.getNodes());
+      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
+          i++) {
+        if ((*i)->isUnknown() || (*i)->isDead())
+          continue;
 
-      return result;
+        MachineFunction *MF = (*i)->getMF();
+        SCASummary &S(NewSummaries[MF->getFunction().getName().str()]);
+        S.IsCallFree = IsCallFree[*i];
+        S.MinDisplacement = MinDisplacement[*i];
+        S.MaxDisplacement = MaxDisplacement[*i];
+      }
+
+      writeSummaries(getSummaryFile(), NewSummaries);
     }
 
-    /// computeMinMaxDisplacementILP - Construct an ILP modeling the
-    /// displacement of an SCC within the call graph, write it to an LP file,
-    /// and solve it.
-    unsigned int computeMinMaxDisplacementILP(const MCGNodes &SCC,
-                                              const MCGNode *N, bool Maximize)
+    /// solve_ilp - solve the ILP problem.
+    unsigned int solve_ilp(StringRef LP)
     {
-      assert(std::find(SCC.begin(), SCC.end(), N) != SCC.end());
+      double tmp;
+      PatmosILPSolver::Status status = Solver->solve(LP, tmp);
+
+      // don't go ahead when solving has failed
+      if (status != PatmosILPSolver::OPTIMAL) {
+        report_fatal_error(Twine("unbounded/infeasible ILP during stack cache "
+                                 "analysis (") +
+                           (status == PatmosILPSolver::UNBOUNDED ?
+                              "unbounded, missing bounds?" : "no solution") +
+                           ")");
+      }
 
-      // get user-supplied bounds to solve the ILP.
-      const SCCInfo &BInfo(BI.getInfo(SCC));
+      ILPs++;
 
-      // open LP file.
-      SmallString<1024> LPname;
-      std::error_code err = sys::fs::createUniqueDirectory("stack", LPname);
-      if (err) {
-        errs() << "Error creating temp .lp file: " << err.message() << "\n";
+      // the objective is a (non-negative) number of bytes
+      assert(tmp >= 0 && "negative ILP solution");
+      if (tmp >= std::numeric_limits<unsigned int>::max())
         return std::numeric_limits<unsigned int>::max();
+
+      return (unsigned int)tmp;
+    }
+
+    /// solve_ilps - solve a batch of independent ILP problems, concurrently if
+    /// enabled.
+    void solve_ilps(const std::vector<std::string> &LPs,
+                    std::vector<unsigned int> &Results)
+    {
+      Results.resize(LPs.size());
+
+      if (ILPSolverThreads == 1 || LPs.size() < 2) {
+        for(unsigned int i = 0; i < LPs.size(); i++)
+          Results[i] = solve_ilp(LPs[i]);
+        return;
       }
 
-      sys::path::append(LPname, "scc.lp");
+      if (!ILPThreads)
+        ILPThreads.reset(new ThreadPool(
+                                    hardware_concurrency(ILPSolverThreads)));
 
-      std::error_code ErrCode;
-      raw_fd_ostream OS(LPname.c_str(), ErrCode);
-      if (!ErrCode) {
-        errs() << "Error: Failed to open file '" << LPname.str()
-               << "' for writing!\n";
-        return std::numeric_limits<unsigned int>::max();
+      for(unsigned int i = 0; i < LPs.size(); i++) {
+        ILPThreads->async([this, &LPs, &Results, i]() {
+          Results[i] = solve_ilp(LPs[i]);
+        });
       }
+      ILPThreads->wait();
+    }
+
+    /// solveMinMaxDisplacementILPs - Construct and solve the ILPs bounding
+    /// the displacement of the nodes within SCCs among the given nodes. All
+    /// successors of these nodes outside of their SCCs have to be handled
+    /// already.
+    void solveMinMaxDisplacementILPs(MCGNodeSCC &SCCMap, const MCGNodes &Nodes,
+                                     MCGNodeUInt &ILPResults, bool Maximize)
+    {
+      PatmosRegionTimer T("sca-disp-ilp", "SCA min/max displacement ILPs");
+      MCGNodes ILPNodes;
+      std::vector<std::string> LPs;
+      for(MCGNodes::const_iterator i(Nodes.begin()), ie(Nodes.end()); i != ie;
+          i++) {
+        if (!(*i)->isDead() && SCCMap[*i]->second &&
+            !getReusableSummary(*i)) {
+          ILPNodes.push_back(*i);
+          LPs.push_back(makeMinMaxDisplacementILP(SCCMap[*i]->first, *i,
+                                                  Maximize));
+        }
+      }
+
+      std::vector<unsigned int> Results;
+      solve_ilps(LPs, Results);
+
+      for(unsigned int i = 0; i < ILPNodes.size(); i++) {
+        ILPResults[ILPNodes[i]] = Results[i];
+
+#ifdef PATMOS_TRACE_CG_DISPLACMENT_ILP
+        dbgs() << "ILP: " << *ILPNodes[i] << ": " << Results[i] << "\n";
+#endif // PATMOS_TRACE_CG_DISPLACMENT_ILP
+      }
+    }
+
+    /// makeMinMaxDisplacementILP - Construct an ILP modeling the
+    /// displacement of an SCC within the call graph.
+    std::string makeMinMaxDisplacementILP(const MCGNodes &SCC,
+                                          const MCGNode *N, bool Maximize)
+    {
+      assert(std::find(SCC.begin(), SCC.end(), N) != SCC.end());
+
+      // get user-supplied bounds to solve the ILP.
+      const SCCInfo &BInfo(BI.getInfo(SCC));
+
+      // construct the LP in memory, the solver decides where it goes.
+      std::string LP;
+      raw_string_ostream OS(LP);
 
       // find entry and exit call sites
       typedef std::set<MCGSite*> MCGSiteSet;
@@ -2418,7 +3429,9 @@ namespace llvm {
       // nodes in the SCC
       for(MCGNodes::const_iterator n(SCC.begin()), ne(SCC.end()); n != ne;
           n++) {
-        OS << "\n + " << getBytesReserved(*n) << " " << ilp_name(W, *n);
+        OS << "\n + " << (Maximize ? getBytesReserved(*n) :
+                                      getMinBytesReserved(*n))
+           << " " << ilp_name(W, *n);
       }
 
       // exit sites
@@ -2603,20 +3616,7 @@ namespace llvm {
 
       OS << "End\n";
 
-      OS.close();
-
-      // solve the ILP
-      unsigned int result = solve_ilp(LPname.c_str(), Maximize);
-
-#ifdef PATMOS_TRACE_CG_DISPLACMENT_ILP
-      dbgs() << "ILP: " << *N << ": " << result << "\n";
-#endif // PATMOS_TRACE_CG_DISPLACMENT_ILP
-
-      // remove LP file
-      // TODO do we need to remove the temp dir??
-      sys::fs::remove(LPname.str());
-
-      return result;
+      return OS.str();
     }
 
     /// checkCallFreePaths - Check whether functions have call free paths.
@@ -2660,8 +3660,12 @@ namespace llvm {
 
         bool is_call_free = false;
 
+        if (const SCASummary *S = getReusableSummary(*i)) {
+          // known from a previous compilation
+          is_call_free = S->IsCallFree;
+        }
         // ignore unknown functions here
-        if (!(*i)->isUnknown() && !(*i)->isDead()) {
+        else if (!(*i)->isUnknown() && !(*i)->isDead()) {
           MBBs WL;
           MBBBool OUTs;
           MachineFunction *MF = (*i)->getMF();
@@ -2753,12 +3757,73 @@ namespace llvm {
       }
     }
 
-    void propagateLPSaving(MBBs &WL, MBBUInt &INs,
-                           MCGNode *Node,
-                           MachineBasicBlock *MBB)
+    /// getLPStoreBound - Return true if the instruction is a stack cache store
+    /// that may alter the data preserved by the lazy pointer, and set Bound to
+    /// the lowest position of the lazy pointer after the store.
+    bool getLPStoreBound(const MachineInstr &MI, unsigned int Reserved,
+                         unsigned int &Bound) const
+    {
+      unsigned int scale;
+      switch(MI.getOpcode()) {
+      case Patmos::SWS: scale = 4; break;
+      case Patmos::SHS: scale = 2; break;
+      case Patmos::SBS: scale = 1; break;
+      default:
+        return false;
+      }
+
+      unsigned B = MI.getOperand(2).getReg();
+      if (MI.getOperand(3).isImm() && B == Patmos::R0)
+        Bound = scale * (MI.getOperand(3).getImm() + 1);
+      else
+        Bound = Reserved;
+
+      return true;
+    }
+
+    /// getLPCallBound - Return the lowest position of the lazy pointer after
+    /// returning from an unpredicated call at a call site.
+    unsigned int getLPCallBound(MCGSite *site) const
     {
-      unsigned int worstSpillDirty = INs[MBB];
       unsigned int SCSize = STC.getStackCacheSize();
+      unsigned int minDisplacement = getMinDisplacement(site->getCallee());
+      return SCSize - std::min(SCSize, minDisplacement);
+    }
+
+    /// summarizeLPSaving - Summarize the effect of a basic block on the lowest
+    /// position of the lazy pointer, such that the work list algorithm does
+    /// not need to visit the instructions again.
+    LPTransfer summarizeLPSaving(MCGNode *Node, MachineBasicBlock *MBB) const
+    {
+      unsigned int Reserved = getBytesReserved(Node);
+      LPTransfer T;
+
+      for(MachineBasicBlock::instr_iterator i(MBB->instr_begin()),
+          ie(MBB->instr_end()); i != ie; i++) {
+        unsigned int Bound;
+        if (i->isCall()) {
+          if (!TII.isPredicated(*i)) {
+            MCGSite *site = Node->findSite(&*i);
+            assert(site);
+            T.applyMin(getLPCallBound(site));
+          }
+        }
+        else if (getLPStoreBound(*i, Reserved, Bound)) {
+          // stores above the reserved area are ignored, and thus do not lower
+          // the position any further
+          T.applyMax(Bound);
+        }
+      }
+
+      return T;
+    }
+
+    /// propagateLPSaving - Given the final lowest position of the lazy
+    /// pointer at the entry of a basic block, record the positions at the
+    /// block's call sites.
+    void propagateLPSaving(MCGNode *Node, MachineBasicBlock *MBB,
+                           unsigned int worstSpillDirty)
+    {
       unsigned int Reserved = getBytesReserved(Node);
 
       /// keep track of coherent data for the current basic block assuming a
@@ -2770,6 +3835,7 @@ namespace llvm {
       // propagate the lowest position of the LP through the basic block
       for(MachineBasicBlock::instr_iterator i(MBB->instr_begin()),
           ie(MBB->instr_end()); i != ie; i++) {
+        unsigned int Bound;
         if (i->isCall()) {
           // find call site
           MCGSite *site = Node->findSite(&*i);
@@ -2780,65 +3846,88 @@ namespace llvm {
           WorstCaseSpillDirty[site] = worstSpillDirty;
 
           if (!TII.isPredicated(*i)) {
-            unsigned int minDisplacement= getMinDisplacement(site->getCallee());
-
             // update the LP's position
-            worstSpillDirty = std::min(worstSpillDirty, SCSize -
-                                       std::min(SCSize, minDisplacement));
+            worstSpillDirty = std::min(worstSpillDirty, getLPCallBound(site));
 
 #ifdef PATMOS_TRACE_WORST_SITE_OCCUPANCY
-            if (minDisplacement)
-              dbgs() << "LP-disp[" << *site->getCallee() << "](" << minDisplacement
-                << "), new dirty: " << worstSpillDirty << "\n";
+            dbgs() << "LP-disp[" << *site->getCallee() << "], new dirty: "
+                   << worstSpillDirty << "\n";
 #endif
           }
-        } else {
-          unsigned int scale = 1;
-          switch(i->getOpcode()) {
-          case Patmos::SWS:
-            scale = 2;
-          case Patmos::SHS:
-            scale <<= 1;
-          case Patmos::SBS:
-            // no LP-preserved region that could be altered by a store
-            if (worstSpillDirty >= Reserved) {
-              ++StoresIgnored;
-              continue;
-            }
+        }
+        else if (getLPStoreBound(*i, Reserved, Bound)) {
+          // no LP-preserved region that could be altered by a store
+          if (worstSpillDirty >= Reserved) {
+            ++StoresIgnored;
+            continue;
+          }
 
-            unsigned B = i->getOperand(2).getReg();
-            if (i->getOperand(3).isImm() && B == Patmos::R0) {
-              unsigned int bytes = scale * (i->getOperand(3).getImm() + 1);
 #ifdef PATMOS_TRACE_WORST_SITE_OCCUPANCY
-              i->dump();
-              dbgs() << worstSpillDirty << ".."
-                << "([" << i->getOperand(3).getImm() << "],"
-                << bytes <<   ") => "
-                << std::max(worstSpillDirty, bytes) << "\n";
+          i->dump();
+          dbgs() << worstSpillDirty << ".." << Bound << " => "
+                 << std::max(worstSpillDirty, Bound) << "\n";
 #endif
-              worstSpillDirty = std::max(worstSpillDirty, bytes);
-            } else
-              worstSpillDirty = Reserved;
-
-            ++StoresAnalyzed;
-            break;
-          }
+          worstSpillDirty = std::max(worstSpillDirty, Bound);
+          ++StoresAnalyzed;
         }
       }
+    }
+
+    /// propagateLPSaving - Compute the lowest position of the lazy pointer at
+    /// the entry of every basic block and at every call site of a function.
+    ///
+    /// Every basic block is summarized once by a transfer function, the work
+    /// list algorithm then only evaluates the summaries until a fixpoint is
+    /// reached. The instructions are visited a second time to record the
+    /// results at the call sites.
+    void propagateLPSaving(MCGNode *Node)
+    {
+      MachineFunction *MF = Node->getMF();
+
+      std::map<MachineBasicBlock*, LPTransfer> Summaries;
+      for(MachineFunction::iterator i(MF->begin()), ie(MF->end()); i != ie;
+          i++) {
+        Summaries[&*i] = summarizeLPSaving(Node, &*i);
+      }
+
+      // initialize work list.
+      MBBs WL;
+      MBBUInt INs;
+      INs[&*MF->begin()] = STC.getStackCacheSize();
+      WL.insert(&*MF->begin());
+
+#ifdef PATMOS_TRACE_WORST_SITE_OCCUPANCY
+      dbgs() << "\\\\\\\\\\\\\\\\\\\\\\\\\\\\ "
+             << MF->getFunction().getName()
+             << " (" << getBytesReserved(Node) << ")\n";
+#endif // PATMOS_TRACE_WORST_SITE_OCCUPANCY
+
+      // process until the work list becomes empty
+      while (!WL.empty()) {
+        // get some basic block
+        MachineBasicBlock *MBB = *WL.begin();
+        WL.erase(WL.begin());
+
+        unsigned int worstSpillDirty = Summaries[MBB].apply(INs[MBB]);
 
-      // propagate to CFG successors
-      for(MachineBasicBlock::succ_iterator i(MBB->succ_begin()),
-          ie(MBB->succ_end()); i != ie; i++) {
         // propagate worst-case value and put successors on the work list
-        if (INs.find(*i) == INs.end()) {
-          INs[*i] = worstSpillDirty;
-          WL.insert(*i);
-        } else if (INs[*i] < worstSpillDirty) {
-          INs[*i] = worstSpillDirty;
-          WL.insert(*i);
+        for(MachineBasicBlock::succ_iterator i(MBB->succ_begin()),
+            ie(MBB->succ_end()); i != ie; i++) {
+          MBBUInt::iterator IN = INs.find(*i);
+          if (IN == INs.end()) {
+            INs[*i] = worstSpillDirty;
+            WL.insert(*i);
+          } else if (IN->second < worstSpillDirty) {
+            IN->second = worstSpillDirty;
+            WL.insert(*i);
+          }
         }
       }
 
+      // record the results of reachable blocks
+      for(MBBUInt::iterator i(INs.begin()), ie(INs.end()); i != ie; i++) {
+        propagateLPSaving(Node, i->first, i->second);
+      }
     }
 
     /// computeWorstCaseSavingOccupancy - Compute the worst-case amount of stack
@@ -2848,8 +3937,9 @@ namespace llvm {
     {
       // worst-case amount of dirty data (lowest position of the LP) -- coherent
       // data can be excluded from context saving anyways.
-      unsigned int lp = std::min(WorstCaseBlockLP[MBB],
-                                 getMaxEffectiveOccupancy(Node));
+      unsigned int lp = getMaxEffectiveOccupancy(Node);
+      if (WorstCaseBlockLP.count(MBB))
+        lp = std::min(WorstCaseBlockLP[MBB], lp);
 
       // minimal amount of dead data -- can be excluded from contexts saving as
       // well
@@ -2922,10 +4012,8 @@ namespace llvm {
       // keep result for later use
       WorstCaseBlockRestoring[MBB] = toRestore;
 
-#ifdef PATMOS_TRACE_WORST_RESTORING_REGION
-      unsigned int reserved = getBytesReserved(Node);
-      unsigned int naive_restoring = std::min(WorstCaseBlockOccupancy[MBB],
-                                              getMaxOccupancy(Node));
+      // the blocks filled by the ensures of the function and its callers
+      // after the preemption, minus the spilling saved at reserves
       int reserveGain = ReserveGain[MBB];
       unsigned int localEnsure = safeUIntDiff(WorstCaseLocalEnsureFilling[MBB],
                                               rp);
@@ -2937,6 +4025,17 @@ namespace llvm {
                              globalEnsure);
       int optimized_restoring = optimized_costs - reserveGain;
 
+      // update the analysis info pseudo pass
+      PatmosStackCacheAnalysisInfo::PreemptionCost &Cost =
+        getAnalysis<PatmosStackCacheAnalysisInfo>().Preemptions[MBB];
+      Cost.Save = WorstCaseBlockSaving[MBB];
+      Cost.Restore = std::max(optimized_restoring, 0);
+
+#ifdef PATMOS_TRACE_WORST_RESTORING_REGION
+      unsigned int reserved = getBytesReserved(Node);
+      unsigned int naive_restoring = std::min(WorstCaseBlockOccupancy[MBB],
+                                              getMaxOccupancy(Node));
+
           LLVM_DEBUG(
             dbgs() << "Restoring \\\\\\\\\\\\\\\\\\\\\\ "
                    << MBB->getFullName()
@@ -3046,35 +4145,13 @@ namespace llvm {
       }
 
       // lazy pointer analysis: visit all functions again
-      for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
-          i++) {
-        if ((*i)->isDead() || (*i)->isUnknown())
-          continue;
-
-        MBBs WL;
-        MBBUInt INs;
-        MachineFunction *MF = (*i)->getMF();
-
-        // initialize work list.
-        INs[&*MF->begin()] = STC.getStackCacheSize();
-        WL.insert(&*MF->begin());
-
-#ifdef PATMOS_TRACE_WORST_SITE_OCCUPANCY
-        dbgs() << "\\\\\\\\\\\\\\\\\\\\\\\\\\\\ "
-               << MF->getFunction()->getName()
-               << " (" << getBytesReserved(*i) << ")\n";
-#endif // PATMOS_TRACE_WORST_SITE_OCCUPANCY
-
-
-        // process until the work list becomes empty
-        while (!WL.empty()) {
-          // get some basic block
-          MachineBasicBlock *MBB = *WL.begin();
-          WL.erase(WL.begin());
+      if (EnableLazyPointer) {
+        for(MCGNodes::const_iterator i(nodes.begin()), ie(nodes.end());
+            i != ie; i++) {
+          if ((*i)->isDead() || (*i)->isUnknown())
+            continue;
 
-          // update the basic block's information, potentially putting any of
-          // its successors on the work list.
-          propagateLPSaving(WL, INs, *i, MBB);
+          propagateLPSaving(*i);
         }
       }
 
@@ -3094,7 +4171,6 @@ namespace llvm {
         unsigned int Displacement = getMinDisplacement(j->first->getCallee());
         std::stringstream SpillDirty; // worst-case lazy-pointer saving
         MCGSiteUInt::const_iterator it = WorstCaseSpillDirty.find(j->first);
-        assert(it != WorstCaseSpillDirty.end());
         if (it == WorstCaseSpillDirty.end())
           SpillDirty << "*";
         else
@@ -3140,8 +4216,9 @@ namespace llvm {
                                                  maxDisplacment);
 
           // visit the children in the graph
-          for(SCAEdgeSet::iterator i(N->getChildren().begin()),
-              ie(N->getChildren().end()); i != ie; i++) {
+          ArrayRef<SCAEdge> children(N->getChildren());
+          for(ArrayRef<SCAEdge>::const_iterator i(children.begin()),
+              ie(children.end()); i != ie; i++) {
             pruneNodes(i->getCallee(), remainingOccupancy);
           }
         }
@@ -3153,42 +4230,14 @@ namespace llvm {
     /// spills, or that do not lead to a valid stack cache state, can be pruned.
     void markSCAGraphVisible()
     {
-      const MCGSCANodeMap &nodes(SCAGraph.getNodes());
+      // eliminate UNKNOWN nodes from the graph and make the edges available
+      SCAGraph.finalize();
+
+      const SCANodes &nodes(SCAGraph.getNodes());
 
       // keep statistics of the initial SCA graph size.
       TotalSCAGraphSize += nodes.size();
 
-      // eliminate UNKNOWN nodes from the graph
-      SCANodeSet cleanup;
-      for(MCGSCANodeMap::const_iterator i(nodes.begin()), ie(nodes.end());
-          i != ie; i++) {
-        MCGNode *mcgNode = i->second->getMCGNode();
-        if (mcgNode->isUnknown()) {
-          cleanup.insert(i->second);
-          // remove the node and redirect its parent/child relations
-          for(SCAEdgeSet::iterator j(i->second->getChildren().begin()),
-              je(i->second->getChildren().end()); j != je; j++) {
-
-            SCANode *calleeNode = j->getCallee();
-
-            for(SCAEdgeSet::const_iterator k(i->second->getParents().begin()),
-                ke(i->second->getParents().end()); k != ke; k++) {
-
-              SCANode *callerNode = k->getCaller();
-
-              SCAEdge newEdge(callerNode, calleeNode, k->getSite());
-              calleeNode->getParents().insert(newEdge);
-              callerNode->getChildren().insert(newEdge);
-            }
-          }
-        }
-      }
-
-      // remove the UNKNOWN nodes from the graph and free them
-      std::for_each(cleanup.begin(), cleanup.end(),
-                 std::bind1st(std::mem_fun(&SpillCostAnalysisGraph::deleteNode),
-                             &SCAGraph));
-
       // get unbounded (!) displacement of root node
       unsigned int maxDisplacment = getMinMaxDisplacement(
                                         SCAGraph.getRoot()->getMCGNode(), true);
@@ -3199,10 +4248,10 @@ namespace llvm {
 
       // mark only those nodes visible that have non-zero spill costs or have a
       // descendent with non-zero spill costs.
-      for(MCGSCANodeMap::const_iterator i(nodes.begin()), ie(nodes.end());
-          i != ie; i++) {
-        if (i->second->getSpillCost()) {
-          i->second->setVisible();
+      for(SCANodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
+          i++) {
+        if ((*i)->getSpillCost()) {
+          (*i)->setVisible();
         }
       }
     }
@@ -3224,7 +4273,7 @@ namespace llvm {
     /// We only need to propagate the minimum of the two.
     ///
     /// \see propagateWorstCaseOccupancyAtSite
-    void propagateMaxOccupancy(SCANode *Node, SCANodeSet &WL)
+    void propagateMaxOccupancy(SCANode *Node, SCANodes &WL)
     {
       // get the call graph node and occupancy
       MCGNode *mcgNode = Node->getMCGNode();
@@ -3255,15 +4304,6 @@ namespace llvm {
         unsigned int siteOccupancy = std::min(nodeOccupancy,
                                               worstSiteOccupancy);
 
-        // compute the occupancy after the child's reserve
-        unsigned int childOccupancy = getBytesReserved(callee) +
-                                            siteOccupancy;
-
-        // compute the spill caused by the child's reserve
-        unsigned int spillCost =
-            childOccupancy <= STC.getStackCacheSize() ? 0 :
-                                  childOccupancy - STC.getStackCacheSize();
-
         // compute again only considering dirty spill region below lazy pointer
         //assert(WorstCaseSpillDirty.count(site));
         unsigned int lpWorstSiteOccupancy = STC.getStackCacheSize();
@@ -3274,6 +4314,25 @@ namespace llvm {
         unsigned int lpSiteOccupancy = std::min(lpNodeOccupancy,
                                                 lpWorstSiteOccupancy);
 
+        // beyond the limit of contexts, new contexts of the callee are merged
+        // into the one of a full stack cache, which covers all others
+        if (MaxSCAContexts &&
+            SCAGraph.getNumContexts(callee) >= MaxSCAContexts &&
+            !SCAGraph.hasContext(callee,
+                                 CostPair(siteOccupancy, lpSiteOccupancy))) {
+          siteOccupancy = lpSiteOccupancy = STC.getStackCacheSize();
+          MergedSCAContexts++;
+        }
+
+        // compute the occupancy after the child's reserve
+        unsigned int childOccupancy = getBytesReserved(callee) +
+                                            siteOccupancy;
+
+        // compute the spill caused by the child's reserve
+        unsigned int spillCost =
+            childOccupancy <= STC.getStackCacheSize() ? 0 :
+                                  childOccupancy - STC.getStackCacheSize();
+
 
         unsigned int lpChildOccupancy = getBytesReserved(callee) +
                                               lpSiteOccupancy;
@@ -3296,11 +4355,11 @@ namespace llvm {
                                            IsCallFree[callee], calleeSCANode);
 
         // make a link to the parent context
-        calleeSCANode->addParent(Node, site);
+        SCAGraph.addEdge(Node, calleeSCANode, site);
 
         // if the node did not exist before, append it to the work list
         if (isNewNode) {
-          WL.insert(calleeSCANode);
+          WL.push_back(calleeSCANode);
         }
       }
     }
@@ -3325,14 +4384,15 @@ namespace llvm {
     void propagateMaxOccupancy(const MCallGraph &G, MCGNode *main)
     {
       // initialize the work list and calling context information
-      SCANodeSet WL;
-      WL.insert(SCAGraph.makeRoot(main, getMaxDisplacement(main),
-                                  IsCallFree[main]));
+      // each node is put on the work list only once, when it is created
+      SCANodes WL;
+      WL.push_back(SCAGraph.makeRoot(main, getMaxDisplacement(main),
+                                     IsCallFree[main]));
 
       while (!WL.empty()) {
         // pop current call graph node
-        SCANode *Node =  *WL.begin();
-        WL.erase(Node);
+        SCANode *Node = WL.back();
+        WL.pop_back();
 
         // propagate to callees through call sites
         if (!Node->getMCGNode()->isDead()) {
@@ -3343,25 +4403,25 @@ namespace llvm {
       // mark cost-relevant nodes; nodes not relevant for analysis remain hidden
       markSCAGraphVisible();
 
-      const MCGSCANodeMap &nodes(SCAGraph.getNodes());
+      const SCANodes &nodes(SCAGraph.getNodes());
 #ifdef PATMOS_TRACE_DETAILED_RESULTS
-      for(MCGSCANodeMap::const_iterator i(nodes.begin()), ie(nodes.end());
-          i != ie; i++) {
-        if (i->second->isVisible()) {
-          MCGNode *N = i->first.first;
-          dbgs() << "CTXT: " << N->getMF()->getFunction()->getName()
+      for(SCANodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
+          i++) {
+        if ((*i)->isVisible()) {
+          MCGNode *N = (*i)->getMCGNode();
+          dbgs() << "CTXT: " << N->getMF()->getFunction().getName()
                 << ": k=" << getBytesReserved(N)
-                << ", s=" << i->second->getSpillCostPair().Cost // without lp
-                << ", slp=" << i->second->getSpillCostPair().OptCost //with lp
-                << ", o=" << i->first.second << "; ";
+                << ", s=" << (*i)->getSpillCostPair().first // without lp
+                << ", slp=" << (*i)->getSpillCostPair().second //with lp
+                << ", o=" << (*i)->getOccupancy() << "; ";
           dbgs() << "sca-ctxt:"
-            << N->getMF()->getFunction()->getName() << ","
-            << i->second->getSpillCost();
-          SCAEdgeSet P = i->second->getParents();
-          for(SCAEdgeSet::const_iterator j(P.begin()), je(P.end());
+            << N->getMF()->getFunction().getName() << ","
+            << (*i)->getSpillCost();
+          ArrayRef<SCAEdge> P((*i)->getParents());
+          for(ArrayRef<SCAEdge>::const_iterator j(P.begin()), je(P.end());
               j != je; j++) {
             dbgs() << "," <<
-              j->getCaller()->getMCGNode()->getMF()->getFunction()->getName();
+              j->getCaller()->getMCGNode()->getMF()->getFunction().getName();
           }
           dbgs() << "\n";
         }
@@ -3370,12 +4430,12 @@ namespace llvm {
 
       // keep statistics of the pruned SCA graph size.
       MCGNodeUInt Spilling;
-      for(MCGSCANodeMap::const_iterator i(nodes.begin()), ie(nodes.end());
-          i != ie; i++) {
-        if (i->second->isVisible()) {
+      for(SCANodes::const_iterator i(nodes.begin()), ie(nodes.end()); i != ie;
+          i++) {
+        if ((*i)->isVisible()) {
           PrunedSCAGraphSize++;
-          Spilling[i->first.first] = std::max(Spilling[i->first.first],
-                                              i->second->getSpillCost());
+          MCGNode *N = (*i)->getMCGNode();
+          Spilling[N] = std::max(Spilling[N], (*i)->getSpillCost());
         }
       }
 
@@ -3425,6 +4485,16 @@ namespace llvm {
       const MCallGraph &G(*PCGB.getCallGraph());
       MCGNode *main = G.getEntryNode();
 
+      // complement the user-supplied bounds, they are part of the summaries
+      if (EnableInferRecursionBounds)
+        inferRecursionBounds(G);
+
+      // find the summaries of a previous compilation that are still valid,
+      // before the code is modified by the analysis
+      bool keepSummaries = !getSummaryFile().empty();
+      if (keepSummaries)
+        loadSummaries(G);
+
       // find out whether a call free path exists in each function
       checkCallFreePaths(G);
 
@@ -3432,21 +4502,48 @@ namespace llvm {
       propagateLiveArea(G);
 
       // compute call-graph-level information on maximal displacement
-      computeMinMaxDisplacement(G, true);
+      {
+        PatmosRegionTimer T("sca-max-disp", "SCA maximum displacement");
+        computeMinMaxDisplacement(G, true);
+      }
 
       // compute ensure behavior and optionally remove useless SENS instructions
-      analyzeEnsures(G);
+      {
+        PatmosRegionTimer T("sca-ensures", "SCA ensure analysis");
+        analyzeEnsures(G);
+      }
 
       // compute call-graph-level information on minimal displacement
-      computeMinMaxDisplacement(G, false);
+      {
+        PatmosRegionTimer T("sca-min-disp", "SCA minimum displacement");
+        computeMinMaxDisplacement(G, false);
+      }
+
+      // keep the bounds for the summaries of the functions, unless the whole
+      // stack cache is displaced, which is a bound for this size only
+      for (MCGNode *N : G.getNodes()) {
+        if (N->isUnknown() || N->isDead() ||
+            getMaxDisplacement(N) >= STC.getStackCacheSize())
+          continue;
+        N->getMF()->getInfo<PatmosMachineFunctionInfo>()->
+            setStackCacheDisplacement(getMinDisplacement(N),
+                                      getMaxDisplacement(N));
+      }
 
       // propagate the worst-case stack occupancy at call sites locally within
       // functions, assuming a full stack cache at function entry.
-      propagateWorstCaseOccupancyAtSite(G);
+      // Then propagate the maximum stack occupancy on the call graph and
+      // analyze the worst-case spilling at reserves.
+      {
+        PatmosRegionTimer T("sca-occupancy", "SCA stack occupancy");
+        propagateWorstCaseOccupancyAtSite(G);
+        propagateMaxOccupancy(G, main);
+      }
 
-      // propagate the maximum stack occupancy on the call graph and analyze
-      // the worst-case spilling at reserves.
-      propagateMaxOccupancy(G, main);
+      // bound the restoring of the stack cache at the return of interrupt
+      // handlers
+      if (EnableContextSwitchAnalysis)
+        analyzeContextSwitches(G);
 
       // Analysis of worst-case preemption costs for context saving and
       // restoration.
@@ -3467,6 +4564,13 @@ namespace llvm {
         computeWorstCaseRestoringOccupancy(G);
       }
 
+      if (arePatmosStatsEnabled())
+        addStats();
+
+      // keep the summaries for later compilations
+      if (keepSummaries)
+        storeSummaries(G);
+
       return false;
     }
 
@@ -3525,9 +4629,9 @@ namespace llvm {
   bool operator <(const SCAEdge &a, const SCAEdge &b)
   {
     if (a.getCaller() != b.getCaller())
-      return (a.getCaller() < b.getCaller());
+      return (a.getCaller()->getID() < b.getCaller()->getID());
     else if (a.getCallee() != b.getCallee())
-      return (a.getCallee() < b.getCallee());
+      return (a.getCallee()->getID() < b.getCallee()->getID());
     else
       return (a.getSite() < b.getSite());
   }
@@ -3539,16 +4643,16 @@ namespace llvm {
     typedef SCANode NodeType;
     class ChildIteratorType
     {
-      SCAEdgeSet::const_iterator I;
+      ArrayRef<SCAEdge>::const_iterator I;
 
     public:
-      typedef SCAEdgeSet::const_iterator::iterator_category iterator_category;
-      typedef SCAEdgeSet::const_iterator::difference_type difference_type;
-      typedef SCAEdgeSet::const_iterator::pointer pointer;
-      typedef SCAEdgeSet::const_iterator::reference reference;
+      typedef std::forward_iterator_tag iterator_category;
+      typedef std::ptrdiff_t difference_type;
+      typedef const SCAEdge *pointer;
+      typedef const SCAEdge &reference;
       typedef NodeType value_type;
 
-      ChildIteratorType(SCAEdgeSet::const_iterator i) : I(i)
+      ChildIteratorType(ArrayRef<SCAEdge>::const_iterator i) : I(i)
       {
       }
 
@@ -3592,15 +4696,15 @@ namespace llvm {
 
     class nodes_iterator
     {
-      MCGSCANodeMap::const_iterator I;
+      SCANodes::const_iterator I;
 
     public:
-      typedef MCGSCANodeMap::const_iterator::iterator_category iterator_category;
-      typedef MCGSCANodeMap::const_iterator::difference_type difference_type;
-      typedef MCGSCANodeMap::const_iterator::pointer pointer;
-      typedef MCGSCANodeMap::const_iterator::reference reference;
+      typedef SCANodes::const_iterator::iterator_category iterator_category;
+      typedef SCANodes::const_iterator::difference_type difference_type;
+      typedef SCANodes::const_iterator::pointer pointer;
+      typedef SCANodes::const_iterator::reference reference;
 
-      nodes_iterator(MCGSCANodeMap::const_iterator i) : I(i)
+      nodes_iterator(SCANodes::const_iterator i) : I(i)
       {
       }
 
@@ -3618,7 +4722,7 @@ namespace llvm {
 
       NodeType *operator*()
       {
-        return I->second;
+        return *I;
       }
     };
 
@@ -3645,7 +4749,8 @@ namespace llvm {
       return "scagraph";
     }
 
-    static bool isNodeHidden(const SCANode *N, const SpillCostAnalysisGraph G)
+    static bool isNodeHidden(const SCANode *N,
+                             const SpillCostAnalysisGraph &G)
     {
       return !N->isVisible();
     }
@@ -23,15 +23,16 @@ namespace llvm {
 
 class PatmosStackCacheAnalysisInfo : public ImmutablePass {
   bool Valid;
+  bool RemovedEnsures;
 
 public:
   PatmosStackCacheAnalysisInfo(const TargetMachine &TM) : ImmutablePass(ID),
-    Valid(false) {
+    Valid(false), RemovedEnsures(false) {
       initializePatmosStackCacheAnalysisInfoPass(*PassRegistry::getPassRegistry());
     }
 
   PatmosStackCacheAnalysisInfo()
-    : ImmutablePass(ID), Valid(false) {
+    : ImmutablePass(ID), Valid(false), RemovedEnsures(false) {
     llvm_unreachable("should not be implicitly constructed");
   }
 
@@ -40,12 +41,29 @@ public:
   void setValid() { Valid = true; }
   bool isValid() const { return Valid; }
 
+  // with hasRemovedEnsures() we can tell whether frames may be accessed after
+  // a call without an ensure, as the analysis found that it would not fill
+  void setRemovedEnsures() { RemovedEnsures = true; }
+  bool hasRemovedEnsures() const { return RemovedEnsures; }
+
   typedef std::map<const MachineInstr*, unsigned int> FillSpillCounts;
   typedef std::map<const MachineInstr*, int> CallMap;
 
   FillSpillCounts Reserves;
   FillSpillCounts Ensures;
 
+  /// Worst-case number of bytes to save when the task is preempted at the
+  /// entry of a basic block, and to restore (by the context switch and the
+  /// following ensures) when it is resumed there.
+  struct PreemptionCost {
+    unsigned int Save;
+    unsigned int Restore;
+  };
+  typedef std::map<const MachineBasicBlock*, PreemptionCost> PreemptionCosts;
+
+  /// Preemption costs, if the preemption analysis was enabled.
+  PreemptionCosts Preemptions;
+
   CallMap CallIDs;
 
   static char ID; // Pass identification, replacement for typeid
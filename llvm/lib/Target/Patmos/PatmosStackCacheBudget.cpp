@@ -0,0 +1,289 @@
+//===-- PatmosStackCacheBudget.cpp - Budget the stack cache per program. --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Decide which functions keep their frames in the stack cache, based on the
+// machine-level call graph of the whole program.
+//
+// The frame lowering places the spill slots and promoted objects of every
+// function in the stack cache. Once the frames along a call path exceed the
+// stack cache size, the reserves of the deeper functions spill the frames of
+// their callers, which are filled again by the ensures after the calls. This
+// pass estimates the stack cache frame of each function after register
+// allocation, and computes the worst-case occupancy of the call paths. As long
+// as the worst-case path does not fit, the largest frame of a cold function on
+// the path, i.e., a function not called from within a loop or a recursion, is
+// shrunk by the excess: its stack cache limit keeps its most frequently
+// accessed objects, typically the spill slots in loops, on the stack cache and
+// places the rest on the shadow stack in main memory. A frame left without
+// any stack cache space is placed on the shadow stack as a whole.
+//
+// Functions in recursions, and the paths through them, are not budgeted, their
+// occupancy is unbounded anyway. Calls of unknown functions are assumed to not
+// use any stack cache space.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "MachineModulePass.h"
+#include "PatmosCallGraphBuilder.h"
+#include "PatmosFrameLowering.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <set>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-stack-cache-budget"
+
+STATISTIC(ShadowStackFrames,
+          "Functions whose frame is moved from the stack cache to the shadow "
+          "stack");
+STATISTIC(LimitedFrames,
+          "Functions whose stack cache frame is partially moved to the shadow "
+          "stack");
+STATISTIC(ShadowStackBytes,
+          "Bytes of stack cache frames moved to the shadow stack");
+STATISTIC(OverfullPaths,
+          "Worst-case call paths still exceeding the stack cache");
+
+namespace {
+  /// Pass to budget the stack cache frames along the call paths of a program.
+  class PatmosStackCacheBudget : public MachineModulePass {
+  private:
+    /// Map call graph nodes to an unsigned integer.
+    typedef std::map<const MCGNode*, unsigned int> MCGNodeUInt;
+
+    /// Set of call graph nodes.
+    typedef std::set<MCGNode*> MCGNodeSet;
+
+    /// Subtarget information (stack cache size)
+    const PatmosSubtarget &STC;
+
+    /// The estimated stack cache frame of each function, in bytes.
+    MCGNodeUInt Frames;
+
+    /// The worst-case occupancy of the call paths starting at each function,
+    /// in bytes, for the functions not in a recursion.
+    MCGNodeUInt Occupancy;
+
+    /// The callee on the worst-case call path of each function.
+    std::map<const MCGNode*, MCGNode*> WorstCallee;
+
+    /// getFrameLowering - Return the frame lowering knowing the effective
+    /// stack cache size.
+    const PatmosFrameLowering &getFrameLowering() const
+    {
+      return *static_cast<const PatmosFrameLowering*>(
+                                                     STC.getFrameLowering());
+    }
+
+    /// getCallers - Collect the distinct callers of a function.
+    static void getCallers(const MCGNode *N, MCGNodeSet &Callers)
+    {
+      for (const MCGSite *Site : N->getCallingSites())
+        Callers.insert(Site->getCaller());
+    }
+
+    /// getCallees - Collect the distinct known callees of a function.
+    static void getCallees(const MCGNode *N, MCGNodeSet &Callees)
+    {
+      for (const MCGSite *Site : N->getSites()) {
+        if (!Site->getCallee()->isUnknown())
+          Callees.insert(Site->getCallee());
+      }
+    }
+
+    /// isMovable - Check whether the frame of a function can be placed on the
+    /// shadow stack, i.e., the function is cold and its objects are not
+    /// required to be on the stack cache.
+    static bool isMovable(const MCGNode *N)
+    {
+      const PatmosMachineFunctionInfo *PMFI =
+                               N->getMF()->getInfo<PatmosMachineFunctionInfo>();
+
+      // callees expect the arguments on the stack cache, single-path code
+      // keeps its frame where the transformation planned it
+      if (PMFI->hasStackCacheArgumentFIs() || PMFI->isSinglePath())
+        return false;
+
+      // the reserve of a cold function spills rarely
+      return !N->isInSCC();
+    }
+
+    /// computeOccupancy - Compute the worst-case occupancy of the call paths
+    /// bottom-up, once all callees of a function are known. Functions in
+    /// recursions and their callers are never decided.
+    void computeOccupancy(const MCGNodes &Nodes)
+    {
+      Occupancy.clear();
+      WorstCallee.clear();
+
+      MCGNodeUInt Pending;
+      std::vector<MCGNode*> WL;
+      for (MCGNode *N : Nodes) {
+        if (N->isUnknown() || N->isDead())
+          continue;
+
+        MCGNodeSet Callees;
+        getCallees(N, Callees);
+        Pending[N] = Callees.size();
+        if (Callees.empty())
+          WL.push_back(N);
+      }
+
+      while (!WL.empty()) {
+        MCGNode *N = WL.back();
+        WL.pop_back();
+
+        MCGNodeSet Callees;
+        getCallees(N, Callees);
+        unsigned Worst = 0;
+        MCGNode *Callee = NULL;
+        for (MCGNode *C : Callees) {
+          if (!Callee || Occupancy[C] > Worst) {
+            Worst = Occupancy[C];
+            Callee = C;
+          }
+        }
+        Occupancy[N] = Frames[N] + Worst;
+        WorstCallee[N] = Callee;
+
+        MCGNodeSet Callers;
+        getCallers(N, Callers);
+        for (MCGNode *C : Callers) {
+          if (Pending.count(C) && --Pending[C] == 0)
+            WL.push_back(C);
+        }
+      }
+    }
+
+    /// moveFrame - Move the given number of bytes of the frame of a cold
+    /// function on the worst-case call path starting at the given function to
+    /// the shadow stack, or its whole frame if it is not larger. Return false
+    /// if the path has no such function.
+    bool moveFrame(MCGNode *Root, unsigned Excess)
+    {
+      MCGNode *Cold = NULL;
+      for (MCGNode *N = Root; N; N = WorstCallee[N]) {
+        if (Frames[N] && isMovable(N) && (!Cold || Frames[N] > Frames[Cold]))
+          Cold = N;
+      }
+      if (!Cold)
+        return false;
+
+      // keep the frame aligned to the stack cache blocks
+      unsigned Moved = getFrameLowering().getAlignedStackCacheFrameSize(
+                                                                      Excess);
+      unsigned Limit = Frames[Cold] > Moved ? Frames[Cold] - Moved : 0;
+
+      LLVM_DEBUG(dbgs() << "Stack cache budget: " << Cold->getMF()->getName()
+                        << " (" << Frames[Cold] << " bytes) limited to "
+                        << Limit << " bytes, path from "
+                        << Root->getMF()->getName() << " needs "
+                        << Occupancy[Root] << " bytes\n");
+
+      PatmosMachineFunctionInfo *PMFI =
+                            Cold->getMF()->getInfo<PatmosMachineFunctionInfo>();
+      if (Limit) {
+        PMFI->setStackCacheLimit(Limit);
+        LimitedFrames++;
+      } else {
+        PMFI->setShadowStackFrame();
+        ShadowStackFrames++;
+      }
+      ShadowStackBytes += Frames[Cold] - Limit;
+      Frames[Cold] = Limit;
+      return true;
+    }
+
+  public:
+    /// Pass ID
+    static char ID;
+
+    PatmosStackCacheBudget(const PatmosTargetMachine &tm) :
+        MachineModulePass(ID), STC(*tm.getSubtargetImpl())
+    {
+      initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
+    }
+
+    StringRef getPassName() const override {
+      return "Patmos Stack Cache Budget";
+    }
+
+    /// getAnalysisUsage - The call graph is not modified.
+    void getAnalysisUsage(AnalysisUsage &AU) const override
+    {
+      AU.setPreservesAll();
+      AU.addRequired<PatmosCallGraphBuilder>();
+
+      ModulePass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineModule(const Module &M) override
+    {
+      PatmosCallGraphBuilder &PCGB = getAnalysis<PatmosCallGraphBuilder>();
+      const MCGNodes &Nodes = PCGB.getCallGraph()->getNodes();
+      unsigned Size = getFrameLowering().getEffectiveStackCacheSize();
+
+      for (MCGNode *N : Nodes) {
+        if (!N->isUnknown() && !N->isDead())
+          Frames[N] = getFrameLowering().estimateStackCacheFrameSize(
+                                                                *N->getMF());
+      }
+
+      // every move shrinks a frame on the worst-case path, until it fits
+      bool Changed = false;
+      while (true) {
+        computeOccupancy(Nodes);
+
+        MCGNode *Root = NULL;
+        for (MCGNodeUInt::iterator i(Occupancy.begin()), ie(Occupancy.end());
+             i != ie; i++) {
+          if (!Root || i->second > Occupancy[Root])
+            Root = const_cast<MCGNode*>(i->first);
+        }
+        if (!Root || Occupancy[Root] <= Size)
+          break;
+
+        if (!moveFrame(Root, Occupancy[Root] - Size)) {
+          LLVM_DEBUG(dbgs() << "Stack cache budget: path from "
+                            << Root->getMF()->getName() << " needs "
+                            << Occupancy[Root] << " bytes, no cold frame "
+                            << "left to move\n");
+          OverfullPaths++;
+          break;
+        }
+        Changed = true;
+      }
+
+      Frames.clear();
+      Occupancy.clear();
+      WorstCallee.clear();
+
+      return Changed;
+    }
+  };
+
+  char PatmosStackCacheBudget::ID = 0;
+}
+
+/// createPatmosStackCacheBudgetPass - Returns a new PatmosStackCacheBudget
+/// \see PatmosStackCacheBudget
+ModulePass *
+llvm::createPatmosStackCacheBudgetPass(const PatmosTargetMachine &tm) {
+  return new PatmosStackCacheBudget(tm);
+}
@@ -0,0 +1,232 @@
+//===-- PatmosStackCacheLeaves.cpp - Remove ensures after frameless calls. ===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Remove the stack cache ensures following calls of functions that never
+// reserve any stack cache space, based on the machine-level call graph.
+//
+// The frame lowering emits no sres and sfree for functions without a stack
+// cache frame, e.g., leaf functions keeping their values in registers. Their
+// callers nevertheless emit a sens after every call, which is redundant: the
+// frame of the caller cannot be spilled if neither the callee nor any of the
+// functions it calls reserves stack cache space. Such functions are called
+// frameless here, and decided bottom-up once all their callees are known.
+//
+// Functions in recursions, functions calling unknown functions and functions
+// containing inline assembly are never frameless. The stack cache analysis
+// derives a zero displacement for frameless functions from their reserved
+// bytes, the removed ensures are thus not missed by its results.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "MachineModulePass.h"
+#include "PatmosCallGraphBuilder.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <set>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-stack-cache-leaves"
+
+STATISTIC(FramelessFunctions,
+          "Functions reserving no stack cache space, including their callees");
+STATISTIC(RemovedFramelessSENS,
+          "Ensures removed after calls of frameless functions");
+
+namespace {
+  /// Pass to remove the ensures after calls of frameless functions.
+  class PatmosStackCacheLeaves : public MachineModulePass {
+  private:
+    /// Set of call graph nodes.
+    typedef std::set<const MCGNode*> MCGNodeSet;
+
+    /// The frameless functions decided so far.
+    MCGNodeSet Frameless;
+
+    /// getCallees - Collect the distinct callees of a function.
+    static void getCallees(const MCGNode *N, MCGNodeSet &Callees)
+    {
+      for (const MCGSite *Site : N->getSites())
+        Callees.insert(Site->getCallee());
+    }
+
+    /// getCallers - Collect the distinct callers of a function.
+    static void getCallers(const MCGNode *N, MCGNodeSet &Callers)
+    {
+      for (const MCGSite *Site : N->getCallingSites())
+        Callers.insert(Site->getCaller());
+    }
+
+    /// isFrameless - Check whether a function, once all its callees are
+    /// decided, never reserves stack cache space.
+    bool isFrameless(const MCGNode *N) const
+    {
+      const MachineFunction *MF = N->getMF();
+      const PatmosMachineFunctionInfo *PMFI =
+                                       MF->getInfo<PatmosMachineFunctionInfo>();
+      if (PMFI->getStackCacheReservedBytes())
+        return false;
+
+      for (const MCGSite *Site : N->getSites()) {
+        if (!Frameless.count(Site->getCallee()))
+          return false;
+      }
+
+      // inline assembly might reserve stack cache space
+      for (const MachineBasicBlock &MBB : *MF) {
+        for (const MachineInstr &MI : MBB.instrs()) {
+          if (MI.isInlineAsm() || MI.getOpcode() == Patmos::SRESi)
+            return false;
+        }
+      }
+      return true;
+    }
+
+    /// removeEnsures - Remove the ensures following calls that only reach
+    /// frameless functions.
+    bool removeEnsures(MCGNode *C)
+    {
+      MachineFunction *MF = C->getMF();
+
+      // single-path code keeps the stack cache operations it was planned with
+      if (MF->getInfo<PatmosMachineFunctionInfo>()->isSinglePath())
+        return false;
+
+      // find the calls of which all callees are frameless
+      std::map<const MachineInstr*, bool> CallsFrameless;
+      for (const MCGSite *Site : C->getSites()) {
+        const MachineInstr *MI = Site->getMI();
+        bool IsFrameless = Frameless.count(Site->getCallee()) != 0;
+        if (CallsFrameless.count(MI))
+          CallsFrameless[MI] &= IsFrameless;
+        else
+          CallsFrameless[MI] = IsFrameless;
+      }
+
+      bool Changed = false;
+      for (MachineBasicBlock &MBB : *MF) {
+        for (MachineBasicBlock::instr_iterator j(MBB.instr_begin()),
+             je(MBB.instr_end()); j != je; j++) {
+          std::map<const MachineInstr*, bool>::iterator Call =
+                                                     CallsFrameless.find(&*j);
+          if (Call == CallsFrameless.end() || !Call->second)
+            continue;
+
+          // the ensure of the call follows before any other call
+          for (MachineBasicBlock::instr_iterator k(std::next(j)); k != je;
+               k++) {
+            if (k->isCall())
+              break;
+            if (k->getOpcode() == Patmos::SENSi) {
+              LLVM_DEBUG(dbgs() << "Stack cache leaves: sens removed in "
+                                << MF->getName() << " after call in bb."
+                                << MBB.getNumber() << "\n");
+              MBB.erase(k);
+              RemovedFramelessSENS++;
+              Changed = true;
+              break;
+            }
+          }
+        }
+      }
+      return Changed;
+    }
+
+  public:
+    /// Pass ID
+    static char ID;
+
+    PatmosStackCacheLeaves(const PatmosTargetMachine &tm) :
+        MachineModulePass(ID)
+    {
+      initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
+    }
+
+    StringRef getPassName() const override {
+      return "Patmos Stack Cache Leaf Ensure Removal";
+    }
+
+    /// getAnalysisUsage - The call graph is not modified.
+    void getAnalysisUsage(AnalysisUsage &AU) const override
+    {
+      AU.setPreservesAll();
+      AU.addRequired<PatmosCallGraphBuilder>();
+
+      ModulePass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineModule(const Module &M) override
+    {
+      PatmosCallGraphBuilder &PCGB = getAnalysis<PatmosCallGraphBuilder>();
+      const MCGNodes &Nodes = PCGB.getCallGraph()->getNodes();
+
+      // decide the functions bottom-up, once all their callees are decided.
+      // Functions in recursions are never decided, unknown functions are
+      // never frameless.
+      std::map<const MCGNode*, unsigned> Pending;
+      std::vector<const MCGNode*> WL;
+      for (MCGNode *N : Nodes) {
+        if (N->isUnknown() || N->isDead())
+          continue;
+
+        MCGNodeSet Callees;
+        getCallees(N, Callees);
+        Pending[N] = Callees.size();
+        if (Callees.empty())
+          WL.push_back(N);
+      }
+
+      while (!WL.empty()) {
+        const MCGNode *N = WL.back();
+        WL.pop_back();
+
+        if (!isFrameless(N))
+          continue;
+        Frameless.insert(N);
+        FramelessFunctions++;
+
+        MCGNodeSet Callers;
+        getCallers(N, Callers);
+        for (const MCGNode *C : Callers) {
+          if (Pending.count(C) && --Pending[C] == 0)
+            WL.push_back(C);
+        }
+      }
+
+      bool Changed = false;
+      if (!Frameless.empty()) {
+        for (MCGNode *N : Nodes) {
+          if (!N->isUnknown() && !N->isDead())
+            Changed |= removeEnsures(N);
+        }
+      }
+
+      Frameless.clear();
+      return Changed;
+    }
+  };
+
+  char PatmosStackCacheLeaves::ID = 0;
+}
+
+/// createPatmosStackCacheLeavesPass - Returns a new PatmosStackCacheLeaves
+/// \see PatmosStackCacheLeaves
+ModulePass *
+llvm::createPatmosStackCacheLeavesPass(const PatmosTargetMachine &tm) {
+  return new PatmosStackCacheLeaves(tm);
+}
@@ -0,0 +1,463 @@
+//===-- PatmosStackCacheMerging.cpp - Merge stack cache reservations. -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Merge the stack cache reservations of functions into the reservations of
+// their callers, based on the machine-level call graph.
+//
+// A function is merged if it is local to the module, its address is not
+// taken, all its callees are merged, and it is called from within a loop or a
+// recursion. Each of its callers then reserves space for the function's frame
+// below its own frame, i.e., all stack cache accesses of the caller are moved
+// up by the largest frame of its merged callees. The merged function no longer
+// executes sres and sfree, its frame is already reserved when it is called.
+// Since neither a merged function nor its callees reserve any stack cache
+// space, the sens following calls to merged functions are removed.
+//
+// Callers only reserve for their callees if the stack cache offsets of their
+// accesses and the resulting frame still fit, so the transformation is
+// limited to functions without stack cache data accessed through pointers,
+// and to frames up to -mpatmos-merge-stack-cache-reserves-max-size bytes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "MachineModulePass.h"
+#include "PatmosCallGraphBuilder.h"
+#include "PatmosFrameLowering.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <set>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-stack-cache-merging"
+
+STATISTIC(MergedReserves,
+          "Functions whose stack cache frame is reserved by their callers");
+STATISTIC(AbsorbingReserves,
+          "Functions reserving stack cache space for their callees");
+STATISTIC(RemovedMergedSENS, "Ensures removed after calls of merged functions");
+
+static cl::opt<unsigned> MaxMergedSize(
+  "mpatmos-merge-stack-cache-reserves-max-size",
+  cl::init(256),
+  cl::desc("Maximum size in bytes of a stack cache frame, including the "
+           "frames of its callees, that is reserved by the callers "
+           "(default: 256)."),
+  cl::Hidden);
+
+namespace {
+  /// Pass to merge stack cache reservations along call chains.
+  class PatmosStackCacheMerging : public MachineModulePass {
+  private:
+    /// Map call graph nodes to an unsigned integer.
+    typedef std::map<const MCGNode*, unsigned int> MCGNodeUInt;
+
+    /// Set of call graph nodes.
+    typedef std::set<MCGNode*> MCGNodeSet;
+
+    /// Subtarget information (stack cache size)
+    const PatmosSubtarget &STC;
+
+    /// The space reserved by each function for its merged callees, in bytes.
+    MCGNodeUInt Extra;
+
+    /// The merged functions and the space their callers reserve for them, in
+    /// bytes.
+    MCGNodeUInt Merged;
+
+    /// getFrameLowering - Return the frame lowering knowing the effective
+    /// stack cache size.
+    const PatmosFrameLowering &getFrameLowering() const
+    {
+      return *static_cast<const PatmosFrameLowering*>(
+                                                     STC.getFrameLowering());
+    }
+
+    /// isStackCacheAccess - Check whether the instruction accesses the stack
+    /// cache, and return the scaling of its immediate offset.
+    static bool isStackCacheAccess(const MachineInstr &MI, unsigned &Shift)
+    {
+      switch (MI.getOpcode()) {
+        case Patmos::LWS: case Patmos::SWS:
+          Shift = 2;
+          return true;
+        case Patmos::LHS: case Patmos::LHUS: case Patmos::SHS:
+          Shift = 1;
+          return true;
+        case Patmos::LBS: case Patmos::LBUS: case Patmos::SBS:
+          Shift = 0;
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    /// getBaseOperand - Return the index of the base register operand of a
+    /// stack cache access, the immediate offset follows it.
+    static unsigned getBaseOperand(const MachineInstr &MI)
+    {
+      // loads define a register, stores do not
+      return MI.mayStore() ? 2 : 3;
+    }
+
+    /// getReserved - Return the bytes reserved by the sres of a function.
+    unsigned getReserved(const MCGNode *N) const
+    {
+      const PatmosMachineFunctionInfo *PMFI =
+                               N->getMF()->getInfo<PatmosMachineFunctionInfo>();
+      return getFrameLowering().getAlignedStackCacheFrameSize(
+                                           PMFI->getStackCacheReservedBytes());
+    }
+
+    /// getCallers - Collect the distinct callers of a function.
+    static void getCallers(const MCGNode *N, MCGNodeSet &Callers)
+    {
+      const MCGSites &Sites = N->getCallingSites();
+      for(MCGSites::const_iterator i(Sites.begin()), ie(Sites.end()); i != ie;
+          i++) {
+        Callers.insert((*i)->getCaller());
+      }
+    }
+
+    /// isTransformable - Check whether the stack cache instructions of a
+    /// function are all known and can be rewritten.
+    bool isTransformable(const MCGNode *N) const
+    {
+      const MachineFunction *MF = N->getMF();
+      const PatmosMachineFunctionInfo *PMFI =
+                                       MF->getInfo<PatmosMachineFunctionInfo>();
+
+      // stack cache data might be accessed through pointers
+      if (PMFI->isSinglePath() || !PMFI->getStackCacheAnalysisFIs().empty())
+        return false;
+
+      unsigned SRESs = 0;
+      for(MachineFunction::const_iterator i(MF->begin()), ie(MF->end());
+          i != ie; i++) {
+        for(MachineBasicBlock::const_instr_iterator j(i->instr_begin()),
+            je(i->instr_end()); j != je; j++) {
+          // inline assembly might manipulate the stack cache
+          if (j->isInlineAsm())
+            return false;
+
+          if (j->getOpcode() == Patmos::SRESi) {
+            if (i != MF->begin())
+              return false;
+            SRESs++;
+          }
+        }
+      }
+
+      // the reservation has to be done by a single sres at function entry
+      return SRESs == (getReserved(N) ? 1 : 0);
+    }
+
+    /// canAbsorb - Check whether a function can reserve the given number of
+    /// bytes for its callees below its stack cache frame.
+    bool canAbsorb(const MCGNode *C, unsigned Bytes) const
+    {
+      if (Bytes == 0)
+        return true;
+
+      unsigned Own = getReserved(C);
+      unsigned Size = getFrameLowering().getEffectiveStackCacheSize();
+      if (Own == 0 || Own + Bytes > Size)
+        return false;
+
+      if (!isTransformable(C))
+        return false;
+
+      // all stack cache accesses have to be relative to the stack top, and
+      // their offsets have to fit after moving them
+      const MachineFunction *MF = C->getMF();
+      for(MachineFunction::const_iterator i(MF->begin()), ie(MF->end());
+          i != ie; i++) {
+        for(MachineBasicBlock::const_instr_iterator j(i->instr_begin()),
+            je(i->instr_end()); j != je; j++) {
+          unsigned Shift;
+          if (!isStackCacheAccess(*j, Shift))
+            continue;
+
+          unsigned Base = getBaseOperand(*j);
+          const MachineOperand &Reg = j->getOperand(Base);
+          const MachineOperand &Imm = j->getOperand(Base + 1);
+          if (!Reg.isReg() || Reg.getReg() != Patmos::R0 || !Imm.isImm() ||
+              !isUInt<7>(Imm.getImm() + (Bytes >> Shift))) {
+            return false;
+          }
+        }
+      }
+
+      return true;
+    }
+
+    /// isMergeable - Check whether the reservation of a function and its
+    /// callees can be left to its callers.
+    bool isMergeable(const MCGNode *N, unsigned Total) const
+    {
+      const Function &F = N->getMF()->getFunction();
+      if (!F.hasLocalLinkage() || F.hasAddressTaken())
+        return false;
+
+      if (Total > MaxMergedSize || !isTransformable(N))
+        return false;
+
+      // all callees have to be merged, i.e., they do not reserve anything
+      const MCGSites &Sites = N->getSites();
+      for(MCGSites::const_iterator i(Sites.begin()), ie(Sites.end()); i != ie;
+          i++) {
+        if (!Merged.count((*i)->getCallee()))
+          return false;
+      }
+
+      // only merge functions that are called repeatedly
+      bool IsHot = false;
+      const MCGSites &CallingSites = N->getCallingSites();
+      for(MCGSites::const_iterator i(CallingSites.begin()),
+          ie(CallingSites.end()); i != ie; i++) {
+        IsHot |= (*i)->isInSCC();
+      }
+      return IsHot;
+    }
+
+    /// planMerge - Decide whether the reservation of a function is merged
+    /// into its callers, once all its callees are decided.
+    void planMerge(MCGNode *N)
+    {
+      unsigned Total = getReserved(N) + Extra[N];
+      if (!isMergeable(N, Total))
+        return;
+
+      // every caller has to reserve the frame
+      MCGNodeSet Callers;
+      getCallers(N, Callers);
+      for(MCGNodeSet::iterator i(Callers.begin()), ie(Callers.end()); i != ie;
+          i++) {
+        if (!canAbsorb(*i, std::max(Extra[*i], Total)))
+          return;
+      }
+
+      for(MCGNodeSet::iterator i(Callers.begin()), ie(Callers.end()); i != ie;
+          i++) {
+        Extra[*i] = std::max(Extra[*i], Total);
+      }
+      Merged[N] = Total;
+
+      LLVM_DEBUG(dbgs() << "Stack cache merging: " << N->getMF()->getName()
+                        << " (" << Total << " bytes)\n");
+    }
+
+    /// absorb - Reserve the given number of bytes below the stack cache frame
+    /// of a function.
+    void absorb(MCGNode *C, unsigned Bytes)
+    {
+      MachineFunction *MF = C->getMF();
+      for(MachineFunction::iterator i(MF->begin()), ie(MF->end()); i != ie;
+          i++) {
+        for(MachineBasicBlock::instr_iterator j(i->instr_begin()),
+            je(i->instr_end()); j != je; j++) {
+          unsigned Shift;
+          if (isStackCacheAccess(*j, Shift)) {
+            MachineOperand &Imm = j->getOperand(getBaseOperand(*j) + 1);
+            Imm.setImm(Imm.getImm() + (Bytes >> Shift));
+          }
+          else if (j->getOpcode() == Patmos::SRESi ||
+                   j->getOpcode() == Patmos::SFREEi ||
+                   j->getOpcode() == Patmos::SENSi) {
+            // STC instructions are specified in words
+            MachineOperand &Imm = j->getOperand(2);
+            Imm.setImm(Imm.getImm() + Bytes / 4);
+          }
+        }
+      }
+
+      PatmosMachineFunctionInfo *PMFI =
+                                       MF->getInfo<PatmosMachineFunctionInfo>();
+      PMFI->setStackCacheReservedBytes(getReserved(C) + Bytes);
+      AbsorbingReserves++;
+    }
+
+    /// removeReserve - Remove the sres and sfree instructions of a function.
+    void removeReserve(MCGNode *N)
+    {
+      MachineFunction *MF = N->getMF();
+      for(MachineFunction::iterator i(MF->begin()), ie(MF->end()); i != ie;
+          i++) {
+        for(MachineBasicBlock::instr_iterator j(i->instr_begin()),
+            je(i->instr_end()); j != je; ) {
+          if (j->getOpcode() == Patmos::SRESi ||
+              j->getOpcode() == Patmos::SFREEi) {
+            j = i->erase(j);
+          }
+          else
+            j++;
+        }
+      }
+
+      PatmosMachineFunctionInfo *PMFI =
+                                       MF->getInfo<PatmosMachineFunctionInfo>();
+      PMFI->setStackCacheReservedBytes(0);
+      MergedReserves++;
+    }
+
+    /// removeEnsures - Remove the ensures following calls that only reach
+    /// merged functions.
+    void removeEnsures(MCGNode *C)
+    {
+      // find the calls of which all callees are merged
+      std::map<const MachineInstr*, bool> CallsMerged;
+      const MCGSites &Sites = C->getSites();
+      for(MCGSites::const_iterator i(Sites.begin()), ie(Sites.end()); i != ie;
+          i++) {
+        const MachineInstr *MI = (*i)->getMI();
+        bool IsMerged = Merged.count((*i)->getCallee()) != 0;
+        if (CallsMerged.count(MI))
+          CallsMerged[MI] &= IsMerged;
+        else
+          CallsMerged[MI] = IsMerged;
+      }
+
+      MachineFunction *MF = C->getMF();
+      for(MachineFunction::iterator i(MF->begin()), ie(MF->end()); i != ie;
+          i++) {
+        for(MachineBasicBlock::instr_iterator j(i->instr_begin()),
+            je(i->instr_end()); j != je; j++) {
+          std::map<const MachineInstr*, bool>::iterator Call =
+                                                        CallsMerged.find(&*j);
+          if (Call == CallsMerged.end() || !Call->second)
+            continue;
+
+          // the ensure of the call follows before any other call
+          for(MachineBasicBlock::instr_iterator k(std::next(j)); k != je;
+              k++) {
+            if (k->isCall())
+              break;
+            if (k->getOpcode() == Patmos::SENSi) {
+              i->erase(k);
+              RemovedMergedSENS++;
+              break;
+            }
+          }
+        }
+      }
+    }
+
+  public:
+    /// Pass ID
+    static char ID;
+
+    PatmosStackCacheMerging(const PatmosTargetMachine &tm) :
+        MachineModulePass(ID), STC(*tm.getSubtargetImpl())
+    {
+      initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
+    }
+
+    StringRef getPassName() const override {
+      return "Patmos Stack Cache Reserve Merging";
+    }
+
+    /// getAnalysisUsage - The call graph is not modified.
+    void getAnalysisUsage(AnalysisUsage &AU) const override
+    {
+      AU.setPreservesAll();
+      AU.addRequired<PatmosCallGraphBuilder>();
+
+      ModulePass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineModule(const Module &M) override
+    {
+      PatmosCallGraphBuilder &PCGB = getAnalysis<PatmosCallGraphBuilder>();
+      const MCGNodes &Nodes = PCGB.getCallGraph()->getNodes();
+
+      // decide the functions bottom-up, once all their callees are decided.
+      // Functions in recursions and calling unknown functions are never
+      // decided, thus not merged.
+      MCGNodeUInt Pending;
+      std::vector<MCGNode*> WL;
+      for(MCGNodes::const_iterator i(Nodes.begin()), ie(Nodes.end());
+          i != ie; i++) {
+        if ((*i)->isUnknown())
+          continue;
+
+        MCGNodeSet Callees;
+        const MCGSites &Sites = (*i)->getSites();
+        for(MCGSites::const_iterator j(Sites.begin()), je(Sites.end());
+            j != je; j++) {
+          Callees.insert((*j)->getCallee());
+        }
+
+        Pending[*i] = Callees.size();
+        if (Callees.empty())
+          WL.push_back(*i);
+      }
+
+      while (!WL.empty()) {
+        MCGNode *N = WL.back();
+        WL.pop_back();
+
+        planMerge(N);
+
+        MCGNodeSet Callers;
+        getCallers(N, Callers);
+        for(MCGNodeSet::iterator i(Callers.begin()), ie(Callers.end());
+            i != ie; i++) {
+          if (--Pending[*i] == 0)
+            WL.push_back(*i);
+        }
+      }
+
+      bool Changed = !Merged.empty();
+      if (Changed) {
+        for(MCGNodeUInt::iterator i(Extra.begin()), ie(Extra.end()); i != ie;
+            i++) {
+          if (i->second)
+            absorb(const_cast<MCGNode*>(i->first), i->second);
+        }
+
+        for(MCGNodeUInt::iterator i(Merged.begin()), ie(Merged.end());
+            i != ie; i++) {
+          removeReserve(const_cast<MCGNode*>(i->first));
+        }
+
+        for(MCGNodes::const_iterator i(Nodes.begin()), ie(Nodes.end());
+            i != ie; i++) {
+          if (!(*i)->isUnknown())
+            removeEnsures(*i);
+        }
+      }
+
+      Extra.clear();
+      Merged.clear();
+
+      return Changed;
+    }
+  };
+
+  char PatmosStackCacheMerging::ID = 0;
+}
+
+/// createPatmosStackCacheMergingPass - Returns a new PatmosStackCacheMerging
+/// \see PatmosStackCacheMerging
+ModulePass *
+llvm::createPatmosStackCacheMergingPass(const PatmosTargetMachine &tm) {
+  return new PatmosStackCacheMerging(tm);
+}
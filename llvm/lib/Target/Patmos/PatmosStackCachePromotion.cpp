@@ -12,12 +12,17 @@
 //===----------------------------------------------------------------------===//
 
 #include "PatmosStackCachePromotion.h"
+#include "PatmosISelLowering.h"
 #include "PatmosMachineFunctionInfo.h"
+#include "PatmosStats.h"
+#include "SinglePath/PatmosSinglePathInfo.h"
 #include "TargetInfo/PatmosTargetInfo.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include <queue>
 #include <unordered_map>
 #include <unordered_set>
@@ -28,6 +33,9 @@ using namespace llvm;
 
 STATISTIC(StackPromoLocValues, "Number of local variables promoted to the stack cache");
 STATISTIC(StackPromoArrays, "Number of Arrays promoted to the stack cache");
+STATISTIC(StackPromoArgs, "Number of objects promoted to the stack cache "
+                          "although passed to callees");
+STATISTIC(StackPromoParams, "Number of parameters accessing the stack cache");
 
 static cl::opt<bool> EnableStackCachePromotion(
     "mpatmos-enable-stack-cache-promotion", cl::init(false),
@@ -37,6 +45,23 @@ static cl::opt<bool> EnableArrayStackCachePromotion(
     "mpatmos-enable-array-stack-cache-promotion", cl::init(false),
     cl::desc("Enable the compiler to promote arrays to the stack cache"));
 
+static cl::opt<bool> EnableArgStackCachePromotion(
+    "mpatmos-enable-arg-stack-cache-promotion", cl::init(false),
+    cl::desc("Enable the compiler to promote arrays passed to leaf functions "
+             "to the stack cache (requires array promotion)"));
+
+static cl::opt<bool> EnableByValStackCachePromotion(
+    "mpatmos-enable-byval-stack-cache-promotion", cl::init(false),
+    cl::desc("Enable the compiler to place the copies of byval arguments "
+             "passed to leaf functions on the stack cache (requires argument "
+             "promotion)"));
+
+static cl::opt<unsigned> MaxArgStackCachePromotionSize(
+    "mpatmos-arg-stack-cache-promotion-max-size", cl::init(256),
+    cl::desc("Maximum size in bytes of an object passed to a callee that is "
+             "promoted to the stack cache (default: 256)"),
+    cl::Hidden);
+
 char PatmosStackCachePromotion::ID = 0;
 
 /// createDataCacheAccessEliminationPass - Returns a new
@@ -169,7 +194,285 @@ namespace {
       return Inst->isCall() || Inst->isReturn();
     });
   }
+
+  typedef std::set<std::pair<const Function*, unsigned>> ParamSet;
+
+  /// Check whether a pointer to an object on the stack cache is only used to
+  /// access the object, possibly after address arithmetic, and is only passed
+  /// to callees as one of the given parameters. A null Params allows no calls.
+  bool isStackCacheSafe(const Value *V, const ParamSet *Params) {
+    for (const User *U : V->users()) {
+      if (const LoadInst *LI = dyn_cast<LoadInst>(U)) {
+        if (LI->isVolatile())
+          return false;
+      } else if (const StoreInst *SI = dyn_cast<StoreInst>(U)) {
+        // the pointer itself must not be stored
+        if (SI->isVolatile() || SI->getValueOperand() == V)
+          return false;
+      } else if (const GetElementPtrInst *GEP =
+                     dyn_cast<GetElementPtrInst>(U)) {
+        if (GEP->getPointerOperand() != V || !isStackCacheSafe(GEP, Params))
+          return false;
+      } else if (const BitCastInst *BC = dyn_cast<BitCastInst>(U)) {
+        if (!isStackCacheSafe(BC, Params))
+          return false;
+      } else if (const IntrinsicInst *II = dyn_cast<IntrinsicInst>(U)) {
+        if (!isa<DbgInfoIntrinsic>(II) && !II->isLifetimeStartOrEnd())
+          return false;
+      } else if (const CallInst *CI = dyn_cast<CallInst>(U)) {
+        const Function *Callee = CI->getCalledFunction();
+        if (!Params || !Callee || CI->getCalledOperand() == V)
+          return false;
+        for (unsigned i = 0, ie = CI->arg_size(); i != ie; i++) {
+          if (CI->getArgOperand(i) == V &&
+              !Params->count(std::make_pair(Callee, i)))
+            return false;
+        }
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Check whether a function may access objects of its callers on the stack
+  /// cache, i.e., it is only called directly from within the module, and it
+  /// is a leaf, so the stack cache is not changed until it returns.
+  bool isStackCacheCallee(const Function &F) {
+    if (F.isDeclaration() || !F.hasLocalLinkage() || F.hasAddressTaken() ||
+        F.isVarArg())
+      return false;
+
+    for (const Instruction &I : instructions(F)) {
+      if (isa<CallBase>(I) && !isa<IntrinsicInst>(I))
+        return false;
+    }
+    return true;
+  }
+
+  /// Check whether a parameter is passed in one of the argument registers
+  /// R3 to R8. Only simple 32-bit parameters are considered, byval parameters
+  /// are passed as a pointer to a copy of the caller.
+  bool isRegisterParam(const Function &F, unsigned Param) {
+    if (Param >= 6 || Param >= F.arg_size())
+      return false;
+
+    for (unsigned i = 0; i <= Param; i++) {
+      Type *T = F.getArg(i)->getType();
+      if (F.hasParamAttribute(i, Attribute::StructRet) ||
+          !(T->isPointerTy() ||
+            (T->isIntegerTy() && T->getIntegerBitWidth() <= 32)))
+        return false;
+    }
+    return true;
+  }
+
+  /// Get the object on the stack cache passed to a parameter at a call site,
+  /// or null.
+  const AllocaInst *getStackCacheArg(const CallInst &CI, unsigned Param,
+                                     const ParamSet &Params) {
+    const AllocaInst *AI =
+        dyn_cast<AllocaInst>(getUnderlyingObject(CI.getArgOperand(Param)));
+    if (!AI || !AI->isStaticAlloca())
+      return nullptr;
+
+    const DataLayout &DL = AI->getModule()->getDataLayout();
+    Optional<TypeSize> Size = AI->getAllocationSizeInBits(DL);
+    if (!Size || Size->isScalable() ||
+        Size->getFixedSize() > MaxArgStackCachePromotionSize * 8)
+      return nullptr;
+
+    return isStackCacheSafe(AI, &Params) ? AI : nullptr;
+  }
+
+  /// Check whether the copies of a byval parameter made by the callers can
+  /// be placed on the stack cache. They are copied inline (see
+  /// PatmosTargetLowering::LowerCCCCallTo), the callee accesses them through
+  /// the pointer only.
+  bool isStackCacheByValParam(const Function &F, unsigned Param) {
+    Type *T = F.getParamByValType(Param);
+    if (!EnableByValStackCachePromotion || !T || !T->isSized())
+      return false;
+
+    uint64_t Size = F.getParent()->getDataLayout().getTypeAllocSize(T);
+    return Size <= MaxArgStackCachePromotionSize &&
+           PatmosTargetLowering::isInlineByValCopy(Size);
+  }
+
+  /// Check whether a call site passes an argument to a parameter that can be
+  /// accessed on the stack cache.
+  bool isStackCacheArg(const CallInst &CI, const Function &F, unsigned Param,
+                       const ParamSet &Params) {
+    if (F.hasParamAttribute(Param, Attribute::ByVal))
+      return CI.isByValArgument(Param) &&
+             CI.getParamByValType(Param) == F.getParamByValType(Param);
+    return getStackCacheArg(CI, Param, Params);
+  }
 } // namespace
+
+void PatmosStackCachePromotion::findStackCacheParams(const Module &M) {
+  StackCacheParams.clear();
+  StackCacheArgs.clear();
+
+  // start with all parameters only used to access memory in leaf functions
+  for (const Function &F : M) {
+    if (!isStackCacheCallee(F))
+      continue;
+
+    for (unsigned i = 0, ie = F.arg_size(); i != ie; i++) {
+      const Argument *A = F.getArg(i);
+      if (F.hasParamAttribute(i, Attribute::ByVal) &&
+          !isStackCacheByValParam(F, i))
+        continue;
+
+      if (A->getType()->isPointerTy() && isRegisterParam(F, i) &&
+          isStackCacheSafe(A, nullptr))
+        StackCacheParams.insert(std::make_pair(&F, i));
+    }
+  }
+
+  // drop parameters with call sites not passing objects that can be placed on
+  // the stack cache, until all remaining call sites do
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (ParamSet::iterator i(StackCacheParams.begin()),
+         ie(StackCacheParams.end()); i != ie; ) {
+      bool Safe = true;
+      for (const User *U : i->first->users()) {
+        const CallInst *CI = dyn_cast<CallInst>(U);
+        if (!CI ||
+            !isStackCacheArg(*CI, *i->first, i->second, StackCacheParams)) {
+          Safe = false;
+          break;
+        }
+      }
+
+      if (Safe)
+        i++;
+      else {
+        i = StackCacheParams.erase(i);
+        Changed = true;
+      }
+    }
+  }
+
+  for (const auto &P : StackCacheParams) {
+    LLVM_DEBUG(dbgs() << "Stack cache parameter " << P.second << " of "
+                      << P.first->getName() << "\n");
+
+    // the copies of byval arguments are only made by LowerCCCCallTo, they
+    // are found through PatmosMachineFunctionInfo::getByValArgument
+    if (P.first->hasParamAttribute(P.second, Attribute::ByVal))
+      continue;
+
+    for (const User *U : P.first->users()) {
+      StackCacheArgs.insert(
+          getStackCacheArg(*cast<CallInst>(U), P.second, StackCacheParams));
+    }
+  }
+}
+
+void PatmosStackCachePromotion::promoteStackCacheParams(MachineFunction &MF) {
+  const Function &F = MF.getFunction();
+  MachineRegisterInfo &MRI = MF.getRegInfo();
+
+  const std::unordered_map<unsigned, unsigned> Mappings = {
+    {Patmos::LWC, Patmos::LWS},   {Patmos::LHC, Patmos::LHS},
+    {Patmos::LBC, Patmos::LBS},   {Patmos::LHUC, Patmos::LHUS},
+    {Patmos::LBUC, Patmos::LBUS},
+    {Patmos::LWM, Patmos::LWS},   {Patmos::LHM, Patmos::LHS},
+    {Patmos::LBM, Patmos::LBS},   {Patmos::LHUM, Patmos::LHUS},
+    {Patmos::LBUM, Patmos::LBUS},
+
+    {Patmos::SWC, Patmos::SWS},   {Patmos::SHC, Patmos::SHS},
+    {Patmos::SBC, Patmos::SBS},
+    {Patmos::SWM, Patmos::SWS},   {Patmos::SHM, Patmos::SHS},
+    {Patmos::SBM, Patmos::SBS},
+  };
+
+  std::unordered_set<unsigned> StackCacheOpcodes;
+  for (const auto &M : Mappings)
+    StackCacheOpcodes.insert(M.second);
+
+  // see isRegisterParam
+  const unsigned ParamRegs[] = {
+    Patmos::R3, Patmos::R4, Patmos::R5, Patmos::R6, Patmos::R7, Patmos::R8
+  };
+
+  for (unsigned i = 0, ie = F.arg_size(); i != ie; i++) {
+    if (!StackCacheParams.count(std::make_pair(&F, i)))
+      continue;
+
+    Register Param = MRI.getLiveInVirtReg(ParamRegs[i]);
+    if (!Param)
+      continue;
+
+    // follow the address arithmetic on the parameter to the memory accesses
+    std::set<Register> Visited;
+    std::set<MachineInstr *> Accesses;
+    std::vector<Register> WL(1, Param);
+    while (!WL.empty()) {
+      Register Reg = WL.back();
+      WL.pop_back();
+      if (!Visited.insert(Reg).second)
+        continue;
+
+      for (MachineInstr &MI : MRI.use_nodbg_instructions(Reg)) {
+        if (MI.mayLoadOrStore()) {
+          // the pointer is not stored (checked on the IR), so it is the
+          // address of the access
+          Accesses.insert(&MI);
+          continue;
+        }
+
+        for (const MachineOperand &MO : MI.defs()) {
+          if (MO.isReg() && Register::isVirtualRegister(MO.getReg()))
+            WL.push_back(MO.getReg());
+        }
+      }
+    }
+
+    for (MachineInstr *MI : Accesses) {
+      if (MI->getDesc().mayStore() && MI->getOperand(4).isReg() &&
+          Visited.count(MI->getOperand(4).getReg())) {
+        report_fatal_error("Stack cache parameter stored to memory in "
+                           "function '" + MF.getName() + "'.");
+      }
+
+      if (Mappings.find(MI->getOpcode()) != Mappings.end())
+        MI->setDesc(TII->get(Mappings.at(MI->getOpcode())));
+      else if (!StackCacheOpcodes.count(MI->getOpcode())) {
+        report_fatal_error("Unexpected access through a stack cache "
+                           "parameter in function '" + MF.getName() + "'.");
+      }
+    }
+
+    StackPromoParams++;
+    if (arePatmosStatsEnabled())
+      addPatmosStat(MF.getFunction(), "stack-cache-promotion", "params", 1);
+  }
+
+  // the objects of the callers are addressed relative to their stack top
+  MF.getInfo<PatmosMachineFunctionInfo>()->setStackCacheParams();
+}
+
+/// getObjectDebugLoc - The location of the alloca of frame object FI, or of
+/// the function entry if it has none.
+static DebugLoc getObjectDebugLoc(MachineFunction &MF, int FI) {
+  if (const AllocaInst *AI = MF.getFrameInfo().getObjectAllocation(FI))
+    if (AI->getDebugLoc())
+      return AI->getDebugLoc();
+  return MF.front().findDebugLoc(MF.front().instr_begin());
+}
+
+bool PatmosStackCachePromotion::doInitialization(Module &M) {
+  if (EnableStackCachePromotion && EnableArrayStackCachePromotion &&
+      EnableArgStackCachePromotion && !PatmosSinglePathInfo::isEnabled())
+    findStackCacheParams(M);
+  return false;
+}
+
 bool PatmosStackCachePromotion::runOnMachineFunction(MachineFunction &MF) {
   if (EnableStackCachePromotion) {
     LLVM_DEBUG(dbgs() << "Enabled Stack Cache promotion for: "
@@ -177,6 +480,40 @@ bool PatmosStackCachePromotion::runOnMachineFunction(MachineFunction &MF) {
 
     MachineFrameInfo &MFI = MF.getFrameInfo();
     PatmosMachineFunctionInfo &PMFI = *MF.getInfo<PatmosMachineFunctionInfo>();
+    MachineOptimizationRemarkEmitter &ORE =
+        getAnalysis<MachineOptimizationRemarkEmitterPass>().getORE();
+    auto Promoted = [&](int FI, StringRef Kind) {
+      if (arePatmosStatsEnabled()) {
+        addPatmosStat(MF.getFunction(), "stack-cache-promotion", "objects", 1);
+        addPatmosStat(MF.getFunction(), "stack-cache-promotion", "bytes",
+                      MFI.getObjectSize(FI));
+      }
+      ORE.emit([&]() {
+        return MachineOptimizationRemark(DEBUG_TYPE, "Promoted",
+                                         getObjectDebugLoc(MF, FI), &MF.front())
+               << Kind << " of " << ore::NV("Bytes", MFI.getObjectSize(FI))
+               << " bytes promoted to the stack cache";
+      });
+    };
+    auto NotPromoted = [&](int FI, StringRef Reason) {
+      ORE.emit([&]() {
+        return MachineOptimizationRemarkMissed(DEBUG_TYPE, "NotPromoted",
+                                               getObjectDebugLoc(MF, FI),
+                                               &MF.front())
+               << "object of " << ore::NV("Bytes", MFI.getObjectSize(FI))
+               << " bytes not promoted to the stack cache: " << Reason;
+      });
+    };
+
+    // functions accessing the stack cache of their callers do not get a stack
+    // cache frame of their own
+    const Function &F = MF.getFunction();
+    for (unsigned i = 0, ie = F.arg_size(); i != ie; i++) {
+      if (StackCacheParams.count(std::make_pair(&F, i))) {
+        promoteStackCacheParams(MF);
+        return true;
+      }
+    }
 
     std::unordered_set<unsigned> StillPossibleFIs;
     for (unsigned FI = 0, FIe = MFI.getObjectIndexEnd(); FI != FIe; FI++) {
@@ -184,6 +521,7 @@ bool PatmosStackCachePromotion::runOnMachineFunction(MachineFunction &MF) {
         if (!isFrameIndexUsedAsPointer(MF, FI)) {
           PMFI.addStackCacheAnalysisFI(FI);
 		      StackPromoLocValues++;
+          Promoted(FI, "local value");
         } else {
           StillPossibleFIs.insert(FI);
         }
@@ -198,14 +536,25 @@ bool PatmosStackCachePromotion::runOnMachineFunction(MachineFunction &MF) {
         if (MFI.getObjectSize(FI) == 0)
         {
           LLVM_DEBUG(dbgs() << "Disabled Stack Cache promotion for: " << MF.getFunction().getName() << " as it is a variable sized object\n");
+          NotPromoted(FI, "variable sized object");
           continue;
         }
 
         const auto &Uses = findIndirectUses(MF, FI);
 
-        if (!isAllLocal(Uses))
+        // objects passed to callees that access them on the stack cache
+        // have to be promoted, the callees rely on it
+        const auto *ByVal = PMFI.getByValArgument(FI);
+        bool IsArg = StackCacheArgs.count(MFI.getObjectAllocation(FI)) ||
+                     (ByVal && StackCacheParams.count(*ByVal));
+        if (IsArg) {
+          PMFI.addStackCacheArgumentFI(FI);
+          StackPromoArgs++;
+        }
+        else if (!isAllLocal(Uses))
         {
           LLVM_DEBUG(dbgs() << "Disabled Stack Cache promotion for: " << MF.getFunction().getName() << " as not all indirect references are local\n");
+          NotPromoted(FI, "not all indirect references are local");
           continue;
         }
         
@@ -225,6 +574,7 @@ bool PatmosStackCachePromotion::runOnMachineFunction(MachineFunction &MF) {
         PMFI.addStackCacheAnalysisFI(FI);
         PMFI.addStackCacheAnalysisFIIndirectMemInstructions(FI, IndirectMemAccess);
         StackPromoArrays++;
+        Promoted(FI, IsArg ? "argument" : "array");
       }
     }
 
@@ -18,6 +18,9 @@
 
 #include <llvm/IR/Module.h>
 #include <llvm/CodeGen/MachineFunctionPass.h>
+#include <llvm/CodeGen/MachineOptimizationRemarkEmitter.h>
+
+#include <set>
 
 #define DEBUG_TYPE "patmos-stack-cache-promotion"
 
@@ -32,6 +35,21 @@ private:
   const PatmosInstrInfo *TII;
   const PatmosRegisterInfo *TRI;
 
+  /// Pointer parameters of callees that are only passed objects on the stack
+  /// cache, and only accessed by the callee.
+  std::set<std::pair<const Function*, unsigned>> StackCacheParams;
+
+  /// Objects whose address is passed to the parameters in StackCacheParams,
+  /// they have to be placed on the stack cache.
+  std::set<const AllocaInst*> StackCacheArgs;
+
+  /// findStackCacheParams - Find the pointer parameters of callees and the
+  /// objects passed to them that can be placed on the stack cache.
+  void findStackCacheParams(const Module &M);
+
+  /// promoteStackCacheParams - Access the stack cache through the pointer
+  /// parameters of a callee in StackCacheParams.
+  void promoteStackCacheParams(MachineFunction &MF);
 
 public:
   static char ID;
@@ -47,6 +65,13 @@ public:
     return "Patmos StackCache-Promotion pass (machine code)";
   }
 
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<MachineOptimizationRemarkEmitterPass>();
+    MachineFunctionPass::getAnalysisUsage(AU);
+  }
+
+  bool doInitialization(Module &M) override;
+
   bool runOnMachineFunction(MachineFunction &MF) override ;
 };
 
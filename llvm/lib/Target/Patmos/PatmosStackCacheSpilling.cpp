@@ -0,0 +1,246 @@
+//===-- PatmosStackCacheSpilling.cpp - Spill ahead of spilling calls. -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Spill the stack cache ahead of calls whose callee spills on its reserve,
+// based on the results of the stack cache analysis.
+//
+// The reserve at the entry of a function spills the stack cache when the
+// frames of its callers occupy too much of it, which stalls the pipeline right
+// before the function starts executing. For calls of functions whose reserve
+// spills by the bound of the analysis, a sspill of that amount is placed as
+// early as possible before the call instead, i.e., right after the last access
+// of the caller to its stack cache frame in the block of the call. The spill
+// then starts while the caller still computes, e.g., sets up the arguments of
+// the call, and the reserve finds the space already free. The spilled data is
+// the data the reserve would have spilled, and is filled by the ensure after
+// the call as before.
+//
+// Every call site uses the smallest bound of its callees. Calls without an
+// ensure directly following them in their block are not handled, neither are
+// functions in which the analysis removed ensures, as their frames may be
+// accessed without an ensure after a call.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "MachineModulePass.h"
+#include "PatmosCallGraphBuilder.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosStackCacheAnalysis.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-stack-cache-spilling"
+
+STATISTIC(InsertedSSPILL,
+          "Spills inserted ahead of calls of spilling reserves");
+STATISTIC(SpilledAheadBytes, "Bytes spilled ahead of calls");
+
+static cl::opt<unsigned> SpillMinDistance(
+  "mpatmos-stack-cache-spill-distance",
+  cl::init(4),
+  cl::desc("Minimum number of instructions between a spill ahead of a call "
+           "and the call (default: 4)."),
+  cl::Hidden);
+
+namespace {
+  /// Pass to spill the stack cache ahead of calls of spilling reserves.
+  class PatmosStackCacheSpilling : public MachineModulePass {
+  private:
+    const PatmosInstrInfo *TII;
+
+    /// The worst-case spill of the reserves of the callee nodes, in bytes.
+    typedef std::map<const MCGNode*, unsigned> MCGNodeUInt;
+    MCGNodeUInt Spills;
+
+    /// needsFrame - Check whether the instruction might access the stack
+    /// cache frame of the function, or manipulates the stack cache otherwise.
+    bool needsFrame(const MachineInstr &MI) const
+    {
+      if (MI.isInlineAsm() || MI.isBundle() || MI.isCall() ||
+          TII->isStackControl(&MI))
+        return true;
+
+      return (MI.mayLoad() || MI.mayStore()) &&
+             PatmosInstrInfo::getMemType(MI) == PatmosII::MEM_S;
+    }
+
+    /// getSpill - Return the worst-case spill of the reserve of a function,
+    /// as bounded by the stack cache analysis.
+    unsigned getSpill(const MCGNode *N, PatmosStackCacheAnalysisInfo &SCA)
+    {
+      MCGNodeUInt::iterator Known = Spills.find(N);
+      if (Known != Spills.end())
+        return Known->second;
+
+      unsigned Spill = 0;
+      if (!N->isUnknown() && !N->isDead()) {
+        for (const MachineInstr &MI : N->getMF()->front().instrs()) {
+          if (MI.getOpcode() == Patmos::SRESi) {
+            PatmosStackCacheAnalysisInfo::FillSpillCounts::iterator Bound =
+                                                       SCA.Reserves.find(&MI);
+            if (Bound != SCA.Reserves.end())
+              Spill = Bound->second;
+            break;
+          }
+        }
+      }
+      return Spills[N] = Spill;
+    }
+
+    /// getEnsure - Return the ensure directly following a call in its block,
+    /// or null if there is none.
+    MachineInstr *getEnsure(MachineInstr *Call) const
+    {
+      MachineBasicBlock *MBB = Call->getParent();
+      for (MachineBasicBlock::instr_iterator i(std::next(Call->getIterator())),
+           ie(MBB->instr_end()); i != ie; i++) {
+        if (i->getOpcode() == Patmos::SENSi)
+          return TII->isPredicated(*i) ? nullptr : &*i;
+        if (needsFrame(*i))
+          return nullptr;
+      }
+      return nullptr;
+    }
+
+    /// spillAhead - Insert a spill of the given number of bytes as early as
+    /// possible before a call, behind the last use of the stack cache frame
+    /// in its block. Return false if the call follows too closely.
+    bool spillAhead(MachineInstr *Call, unsigned Bytes)
+    {
+      MachineBasicBlock *MBB = Call->getParent();
+      MachineBasicBlock::iterator I(Call);
+      unsigned Distance = 0;
+      while (I != MBB->begin() && !needsFrame(*std::prev(I))) {
+        I--;
+        if (!I->isDebugInstr() && !I->isCFIInstruction())
+          Distance++;
+      }
+      if (Distance < SpillMinDistance)
+        return false;
+
+      // skip block labels
+      while (I != MachineBasicBlock::iterator(Call) && I->isPosition())
+        I++;
+
+      LLVM_DEBUG(dbgs() << "Stack cache spilling: " << Bytes
+                        << " bytes spilled " << Distance << " instructions "
+                        << "ahead of " << *Call);
+      AddDefaultPred(BuildMI(*MBB, I, Call->getDebugLoc(),
+                             TII->get(Patmos::SSPILLi)))
+        .addImm(Bytes / 4);
+      InsertedSSPILL++;
+      SpilledAheadBytes += Bytes;
+      return true;
+    }
+
+    /// spillCalls - Insert the spills ahead of the calls of a function.
+    bool spillCalls(MCGNode *N, PatmosStackCacheAnalysisInfo &SCA)
+    {
+      MachineFunction *MF = N->getMF();
+
+      // single-path code keeps the stack cache operations it was planned with
+      if (MF->getInfo<PatmosMachineFunctionInfo>()->isSinglePath())
+        return false;
+
+      // the smallest spill of the callees of each call
+      std::map<MachineInstr*, unsigned> CallSpills;
+      for (const MCGSite *Site : N->getSites()) {
+        MachineInstr *MI = Site->getMI();
+        unsigned Spill = getSpill(Site->getCallee(), SCA);
+        if (CallSpills.count(MI))
+          CallSpills[MI] = std::min(CallSpills[MI], Spill);
+        else
+          CallSpills[MI] = Spill;
+      }
+
+      bool Changed = false;
+      for (const std::pair<MachineInstr* const, unsigned> &Call : CallSpills) {
+        if (!Call.second || Call.first->isBundled() ||
+            TII->isPredicated(*Call.first) || !isUInt<18>(Call.second / 4))
+          continue;
+
+        MachineInstr *Ensure = getEnsure(Call.first);
+        if (!Ensure || !spillAhead(Call.first, Call.second))
+          continue;
+
+        // the ensure fills the spilled data, which the reserve might not
+        // have spilled for this call
+        SCA.Ensures[Ensure] = Ensure->getOperand(2).getImm() * 4;
+        Changed = true;
+      }
+      return Changed;
+    }
+
+  public:
+    /// Pass ID
+    static char ID;
+
+    PatmosStackCacheSpilling(const PatmosTargetMachine &tm) :
+        MachineModulePass(ID),
+        TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo()))
+    {
+      initializePatmosCallGraphBuilderPass(*PassRegistry::getPassRegistry());
+    }
+
+    StringRef getPassName() const override {
+      return "Patmos Stack Cache Spilling";
+    }
+
+    /// getAnalysisUsage - The call graph is not modified.
+    void getAnalysisUsage(AnalysisUsage &AU) const override
+    {
+      AU.setPreservesAll();
+      AU.addRequired<PatmosCallGraphBuilder>();
+      AU.addRequired<PatmosStackCacheAnalysisInfo>();
+
+      ModulePass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineModule(const Module &M) override
+    {
+      PatmosStackCacheAnalysisInfo &SCA =
+                                   getAnalysis<PatmosStackCacheAnalysisInfo>();
+      if (!SCA.isValid() || SCA.hasRemovedEnsures())
+        return false;
+
+      PatmosCallGraphBuilder &PCGB = getAnalysis<PatmosCallGraphBuilder>();
+      const MCGNodes &Nodes = PCGB.getCallGraph()->getNodes();
+
+      bool Changed = false;
+      for (MCGNode *N : Nodes) {
+        if (!N->isUnknown() && !N->isDead())
+          Changed |= spillCalls(N, SCA);
+      }
+
+      Spills.clear();
+      return Changed;
+    }
+  };
+
+  char PatmosStackCacheSpilling::ID = 0;
+}
+
+/// createPatmosStackCacheSpillingPass - Returns a new PatmosStackCacheSpilling
+/// \see PatmosStackCacheSpilling
+ModulePass *
+llvm::createPatmosStackCacheSpillingPass(const PatmosTargetMachine &tm) {
+  return new PatmosStackCacheSpilling(tm);
+}
@@ -0,0 +1,103 @@
+//===-- PatmosStats.cpp - Per-function statistics of the Patmos passes. ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Collect and write the statistics, see PatmosStats.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosStats.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <string>
+
+using namespace llvm;
+
+/// StatsFile - Option to write the per-function statistics to a file.
+static cl::opt<std::string> StatsFile(
+  "mpatmos-stats",
+  cl::desc("Write the statistics of the Patmos passes for each function as "
+           "JSON to the given file."),
+  cl::Hidden);
+
+static cl::opt<bool> AppendStatsFile(
+  "mpatmos-stats-append",
+  cl::desc("Append to the statistics file instead of recreating it."),
+  cl::Hidden);
+
+namespace {
+  /// The statistics by function, pass and name, ordered for stable output.
+  typedef std::map<std::string, int64_t> pass_stats;
+  typedef std::map<std::string, std::map<std::string, pass_stats> >
+          function_stats;
+
+  function_stats &getStats()
+  {
+    static function_stats Stats;
+    return Stats;
+  }
+}
+
+bool llvm::arePatmosStatsEnabled()
+{
+  return !StatsFile.empty();
+}
+
+void llvm::addPatmosStat(const Function &F, StringRef Pass, StringRef Name,
+                         int64_t Value)
+{
+  getStats()[F.getName().str()][Pass.str()][Name.str()] += Value;
+}
+
+void llvm::printPatmosStats(const Module &M, raw_ostream &OS)
+{
+  function_stats &Stats = getStats();
+
+  json::OStream J(OS);
+  J.object([&] {
+    J.attribute("module", M.getModuleIdentifier());
+    J.attributeObject("functions", [&] {
+      for (const auto &Fn : Stats) {
+        J.attributeObject(Fn.first, [&] {
+          for (const auto &Pass : Fn.second) {
+            J.attributeObject(Pass.first, [&] {
+              for (const auto &Stat : Pass.second)
+                J.attribute(Stat.first, Stat.second);
+            });
+          }
+        });
+      }
+    });
+  });
+  OS << "\n";
+
+  Stats.clear();
+}
+
+void llvm::writePatmosStats(const Module &M)
+{
+  if (StatsFile.empty())
+    return;
+
+  std::error_code EC;
+  raw_fd_ostream OS(StatsFile, EC,
+                    AppendStatsFile ? sys::fs::OF_Append | sys::fs::OF_Text
+                                    : sys::fs::OF_Text);
+  if (EC)
+    report_fatal_error("Cannot open Patmos statistics file '" + StatsFile +
+                       "': " + EC.message());
+
+  printPatmosStats(M, OS);
+}
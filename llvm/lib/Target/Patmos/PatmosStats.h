@@ -0,0 +1,54 @@
+//===-- PatmosStats.h - Per-function statistics of the Patmos passes. -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Collect statistics of the Patmos passes for individual functions and write
+// them as JSON to the file given by -mpatmos-stats, one line per module:
+//
+//   {"module":"<id>","functions":{"<function>":{"<pass>":{"<name>":<value>}}}}
+//
+// Unlike STATISTIC, which sums over the module and is only available in builds
+// with assertions or statistics enabled, the statistics are attributed to
+// functions and are available in all builds. With -mpatmos-stats-append, the
+// lines of several compilations are collected in the same file.
+//
+// The statistics must only be added on the pass manager's thread.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOS_STATS_H_
+#define _LLVM_TARGET_PATMOS_STATS_H_
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+
+namespace llvm {
+  class Function;
+  class Module;
+  class raw_ostream;
+
+  /// arePatmosStatsEnabled - Check whether the statistics are written, such
+  /// that passes only compute them if needed.
+  bool arePatmosStatsEnabled();
+
+  /// addPatmosStat - Add Value to the statistic Name of the pass Pass for the
+  /// function F.
+  void addPatmosStat(const Function &F, StringRef Pass, StringRef Name,
+                     int64_t Value);
+
+  /// printPatmosStats - Print the statistics of the module M as a line of JSON
+  /// and clear them.
+  void printPatmosStats(const Module &M, raw_ostream &OS);
+
+  /// writePatmosStats - Write the statistics of the module M to the file given
+  /// by -mpatmos-stats, if any. Errors writing the file are fatal.
+  void writePatmosStats(const Module &M);
+}
+
+#endif // _LLVM_TARGET_PATMOS_STATS_H_
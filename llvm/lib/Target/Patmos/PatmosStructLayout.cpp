@@ -0,0 +1,495 @@
+//===-- PatmosStructLayout.cpp - Split structs into hot and cold fields ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Split the structs of the program by the access frequency of their fields,
+// such that the hot fields share as few data cache blocks as possible, and
+// such that the hot scalars of structs on the stack are promoted to the stack
+// cache.
+//
+// The pass expects the module to contain the whole program, as it is the case
+// for the Patmos tool chain. Candidates are global variables with local
+// linkage and static allocas of struct type, whose address is only used to
+// compute the addresses of their fields by GEPs with constant indices. The
+// addresses of the fields, and of the elements within the fields, must only be
+// loaded from, stored to, or passed to memory intrinsics not exceeding them, so
+// that the struct never escapes. The fields of such a struct are separate
+// objects to the program, indexing an array field out of its bounds being
+// undefined in C. Struct types are not changed, objects referenced through
+// pointers, e.g., on the heap, keep their layout.
+//
+// The accesses of each field are estimated as for the scratchpad allocation,
+// see PatmosExecutionCounts.h. Fields accessed at least
+// -mpatmos-struct-layout-hot percent as often as the hottest field of their
+// object are hot.
+//  - Globals larger than a data cache block are split into a struct of the
+//    hot fields, ordered by decreasing frequency and aligned to the smaller of
+//    the block size and its own size, such that it spans as few blocks as
+//    possible, and a struct of the cold fields in their original order.
+//  - The hot scalar fields of allocas become allocas of their own. They are
+//    only loaded and stored, and are thus promoted to the stack cache as local
+//    values by PatmosStackCachePromotion. The remaining fields stay together,
+//    only promoted as arrays, and do not occupy the stack cache otherwise.
+// The lifetime markers and debug information of split objects are dropped.
+//
+// The pass runs before the scratchpad allocation, whose candidates then are
+// the parts of the structs.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosExecutionCounts.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-struct-layout"
+
+STATISTIC(NumSplitGlobals, "Number of globals split into hot and cold fields");
+STATISTIC(NumSplitAllocas, "Number of stack structs split into hot and cold "
+                           "fields");
+STATISTIC(NumHotScalars,   "Number of hot scalar fields split off from stack "
+                           "structs");
+
+static cl::opt<unsigned> HotFieldPercent(
+  "mpatmos-struct-layout-hot",
+  cl::init(10),
+  cl::desc("Minimum number of accesses of a hot field of a struct, in percent "
+           "of the accesses of its hottest field (default: 10)."),
+  cl::Hidden);
+
+namespace {
+  /// A struct object whose fields may be placed separately.
+  struct StructCandidate {
+    /// The global variable or the alloca instruction.
+    Value *Object;
+
+    StructType *Ty;
+
+    /// The GEPs computing the addresses of the fields, instructions or
+    /// constant expressions.
+    SmallVector<GEPOperator *, 8> FieldAddrs;
+
+    /// The lifetime markers of the object and the bitcasts feeding them.
+    SmallVector<Instruction *, 4> Markers;
+
+    /// The estimated number of accesses of each field.
+    SmallVector<double, 8> Accesses;
+
+    /// Check whether field i is accessed often enough to be hot.
+    bool isHot(unsigned i) const {
+      double Max = *std::max_element(Accesses.begin(), Accesses.end());
+      return Accesses[i] > 0 && Accesses[i] * 100 >= Max * HotFieldPercent;
+    }
+  };
+
+  /// The new object holding a field, and the index of the field in it, or -1
+  /// if the object is the field itself.
+  struct FieldPlacement {
+    Value *Object;
+    Type *Ty;
+    int Index;
+  };
+
+  class PatmosStructLayout : public PatmosExecutionCounts {
+  private:
+    /// The size of a data cache block in bytes.
+    unsigned BlockSize;
+
+    /// Add the accesses through the address Ptr within a field to Count.
+    /// Returns false if the address is used in any other way, e.g., if it
+    /// escapes.
+    bool collectFieldAccesses(Value *Ptr, const DataLayout &DL,
+                              double &Count) const;
+
+    /// Return the candidate for the object if all its uses access its fields
+    /// and the fields are accessed at all.
+    Optional<StructCandidate> getCandidate(Value *Object, StructType *Ty,
+                                           const DataLayout &DL) const;
+
+    /// Split a global into its hot and cold fields.
+    bool splitGlobal(GlobalVariable &GV, StructCandidate &C,
+                     const DataLayout &DL);
+
+    /// Split the hot scalar fields off from a struct on the stack.
+    bool splitAlloca(AllocaInst &AI, StructCandidate &C,
+                     const DataLayout &DL);
+
+  public:
+    static char ID;
+
+    PatmosStructLayout(const PatmosTargetMachine &tm)
+      : PatmosExecutionCounts(ID),
+        BlockSize(tm.getSubtargetImpl()->getDataCacheBlockSize()) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Struct Layout";
+    }
+
+    bool runOnModule(Module &M) override;
+  };
+}
+
+char PatmosStructLayout::ID = 0;
+
+ModulePass *llvm::createPatmosStructLayoutPass(const PatmosTargetMachine &tm) {
+  return new PatmosStructLayout(tm);
+}
+
+/// Check whether V is the constant zero.
+static bool isZeroIndex(const Value *V) {
+  const ConstantInt *CI = dyn_cast<ConstantInt>(V);
+  return CI && CI->isZero();
+}
+
+/// Check whether the memory intrinsic only accesses the object Ptr points
+/// to, and does not use Ptr otherwise.
+static bool isWithinObject(const MemIntrinsic *MI, const Value *Ptr,
+                           uint64_t Size) {
+  const ConstantInt *Length = dyn_cast<ConstantInt>(MI->getLength());
+  if (MI->isVolatile() || !Length || Length->getZExtValue() > Size)
+    return false;
+
+  // the pointer must not be the length, or the value of a memset
+  for (unsigned i = 0, e = MI->arg_size(); i != e; i++) {
+    if (MI->getArgOperand(i) != Ptr)
+      continue;
+    if (i != 0 && !(isa<MemTransferInst>(MI) && i == 1))
+      return false;
+  }
+  return true;
+}
+
+bool PatmosStructLayout::collectFieldAccesses(Value *Ptr,
+                                              const DataLayout &DL,
+                                              double &Count) const {
+  for (User *U : Ptr->users()) {
+    if (auto *LI = dyn_cast<LoadInst>(U)) {
+      Count += getCount(LI);
+    } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+      // Storing the pointer itself lets it escape.
+      if (SI->getValueOperand() == Ptr)
+        return false;
+      Count += getCount(SI);
+    } else if (auto *GEP = dyn_cast<GetElementPtrInst>(U)) {
+      // Only addresses within the field, see above.
+      if (GEP->getPointerOperand() != Ptr || GEP->getNumIndices() == 0 ||
+          !isZeroIndex(GEP->getOperand(1)) ||
+          !collectFieldAccesses(GEP, DL, Count))
+        return false;
+    } else if (auto *BC = dyn_cast<BitCastInst>(U)) {
+      // Casts to i8* for memset and memcpy.
+      uint64_t Size = DL.getTypeAllocSize(
+          cast<PointerType>(Ptr->getType())->getElementType());
+      for (User *BU : BC->users()) {
+        auto *MI = dyn_cast<MemIntrinsic>(BU);
+        if (!MI || !isWithinObject(MI, BC, Size))
+          return false;
+        Count += getCount(MI);
+      }
+    } else if (auto *MI = dyn_cast<MemIntrinsic>(U)) {
+      uint64_t Size = DL.getTypeAllocSize(
+          cast<PointerType>(Ptr->getType())->getElementType());
+      if (!isWithinObject(MI, Ptr, Size))
+        return false;
+      Count += getCount(MI);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+Optional<StructCandidate>
+PatmosStructLayout::getCandidate(Value *Object, StructType *Ty,
+                                 const DataLayout &DL) const {
+  if (Ty->isOpaque() || Ty->isPacked() || Ty->getNumElements() < 2)
+    return None;
+
+  StructCandidate C;
+  C.Object = Object;
+  C.Ty = Ty;
+  C.Accesses.assign(Ty->getNumElements(), 0);
+
+  for (User *U : Object->users()) {
+    if (auto *GEP = dyn_cast<GEPOperator>(U)) {
+      // The address of a field, possibly of an element of it.
+      if (GEP->getPointerOperand() != Object ||
+          GEP->getSourceElementType() != Ty || GEP->getNumIndices() < 2 ||
+          !isZeroIndex(GEP->getOperand(1)) ||
+          !isa<ConstantInt>(GEP->getOperand(2)))
+        return None;
+
+      // Constant addresses must be used by instructions only, they are not
+      // followed into initializers.
+      if (isa<ConstantExpr>(GEP) &&
+          llvm::any_of(GEP->users(),
+                       [](const User *GU) { return !isa<Instruction>(GU); }))
+        return None;
+
+      uint64_t Field = cast<ConstantInt>(GEP->getOperand(2))->getZExtValue();
+      if (!collectFieldAccesses(GEP, DL, C.Accesses[Field]))
+        return None;
+      C.FieldAddrs.push_back(GEP);
+    } else if (auto *BC = dyn_cast<BitCastInst>(U)) {
+      // Lifetime markers are simply dropped.
+      for (User *BU : BC->users()) {
+        auto *II = dyn_cast<IntrinsicInst>(BU);
+        if (!II || !II->isLifetimeStartOrEnd())
+          return None;
+        C.Markers.push_back(II);
+      }
+      C.Markers.push_back(BC);
+    } else if (auto *II = dyn_cast<IntrinsicInst>(U)) {
+      if (!II->isLifetimeStartOrEnd())
+        return None;
+      C.Markers.push_back(II);
+    } else {
+      return None;
+    }
+  }
+
+  if (*std::max_element(C.Accesses.begin(), C.Accesses.end()) <= 0)
+    return None;
+  return C;
+}
+
+/// Create a struct of the given fields of Ty, named after Ty.
+static StructType *createPart(StructType *Ty, ArrayRef<unsigned> Fields,
+                              StringRef Suffix) {
+  SmallVector<Type *, 8> Elements;
+  for (unsigned i : Fields)
+    Elements.push_back(Ty->getElementType(i));
+
+  if (!Ty->hasName())
+    return StructType::get(Ty->getContext(), Elements);
+  return StructType::create(Ty->getContext(), Elements,
+                            (Ty->getName() + Suffix).str());
+}
+
+/// Replace the objects of a split candidate by the new objects holding its
+/// fields, rewriting the addresses of the fields.
+static void rewriteFields(StructCandidate &C,
+                          ArrayRef<FieldPlacement> Placements) {
+  for (GEPOperator *GEP : C.FieldAddrs) {
+    uint64_t Field = cast<ConstantInt>(GEP->getOperand(2))->getZExtValue();
+    const FieldPlacement &P = Placements[Field];
+
+    // Keep the indices into the field.
+    SmallVector<Value *, 4> Indices;
+    Indices.push_back(GEP->getOperand(1));
+    if (P.Index >= 0)
+      Indices.push_back(ConstantInt::get(GEP->getOperand(2)->getType(),
+                                         P.Index));
+    for (unsigned i = 3, e = GEP->getNumOperands(); i != e; ++i)
+      Indices.push_back(GEP->getOperand(i));
+
+    if (auto *CE = dyn_cast<ConstantExpr>(GEP)) {
+      Constant *NewCE = P.Index < 0 && Indices.size() == 1
+          ? cast<Constant>(P.Object)
+          : ConstantExpr::getGetElementPtr(P.Ty, cast<Constant>(P.Object),
+                                           Indices, GEP->isInBounds());
+      CE->replaceAllUsesWith(NewCE);
+      CE->destroyConstant();
+    } else {
+      auto *I = cast<GetElementPtrInst>(GEP);
+      if (P.Index < 0 && Indices.size() == 1) {
+        I->replaceAllUsesWith(P.Object);
+      } else {
+        GetElementPtrInst *NewGEP =
+            GetElementPtrInst::Create(P.Ty, P.Object, Indices, "", I);
+        NewGEP->setIsInBounds(I->isInBounds());
+        NewGEP->takeName(I);
+        I->replaceAllUsesWith(NewGEP);
+      }
+      I->eraseFromParent();
+    }
+  }
+
+  for (Instruction *I : C.Markers)
+    I->eraseFromParent();
+
+  SmallVector<DbgVariableIntrinsic *, 4> DbgUsers;
+  findDbgUsers(DbgUsers, C.Object);
+  for (DbgVariableIntrinsic *DII : DbgUsers)
+    DII->eraseFromParent();
+}
+
+bool PatmosStructLayout::splitGlobal(GlobalVariable &GV, StructCandidate &C,
+                                     const DataLayout &DL) {
+  // A block is filled at once, the layout within it does not matter.
+  if (DL.getTypeAllocSize(C.Ty) <= BlockSize)
+    return false;
+
+  SmallVector<unsigned, 8> Hot, Cold;
+  for (unsigned i = 0, e = C.Ty->getNumElements(); i != e; i++) {
+    if (C.isHot(i))
+      Hot.push_back(i);
+    else
+      Cold.push_back(i);
+  }
+  if (Hot.empty() || Cold.empty())
+    return false;
+
+  llvm::stable_sort(Hot, [&C](unsigned A, unsigned B) {
+    return C.Accesses[A] > C.Accesses[B];
+  });
+
+  Constant *Init = GV.getInitializer();
+  SmallVector<Constant *, 8> HotInit, ColdInit;
+  for (unsigned i : Hot)
+    HotInit.push_back(Init->getAggregateElement(i));
+  for (unsigned i : Cold)
+    ColdInit.push_back(Init->getAggregateElement(i));
+  if (is_contained(HotInit, nullptr) || is_contained(ColdInit, nullptr))
+    return false;
+
+  StructType *HotTy = createPart(C.Ty, Hot, ".hot");
+  StructType *ColdTy = createPart(C.Ty, Cold, ".cold");
+
+  auto createGlobal = [&](StructType *Ty, ArrayRef<Constant *> Elements,
+                          StringRef Suffix, Align Alignment) {
+    GlobalVariable *NewGV = new GlobalVariable(
+        *GV.getParent(), Ty, GV.isConstant(), GV.getLinkage(),
+        ConstantStruct::get(Ty, Elements), GV.getName() + Suffix, &GV,
+        GV.getThreadLocalMode(), GV.getAddressSpace());
+    NewGV->setUnnamedAddr(GV.getUnnamedAddr());
+    NewGV->setAlignment(Alignment);
+    return NewGV;
+  };
+
+  Align Alignment = DL.getValueOrABITypeAlignment(GV.getAlign(), C.Ty);
+  uint64_t HotSize = DL.getTypeAllocSize(HotTy);
+  Align HotAlignment = std::max(Alignment,
+                                Align(std::min<uint64_t>(PowerOf2Ceil(HotSize),
+                                                         BlockSize)));
+  GlobalVariable *HotGV = createGlobal(HotTy, HotInit, ".hot", HotAlignment);
+  GlobalVariable *ColdGV = createGlobal(ColdTy, ColdInit, ".cold", Alignment);
+
+  SmallVector<FieldPlacement, 8> Placements(C.Ty->getNumElements());
+  for (unsigned i = 0, e = Hot.size(); i != e; i++)
+    Placements[Hot[i]] = FieldPlacement{HotGV, HotTy, (int)i};
+  for (unsigned i = 0, e = Cold.size(); i != e; i++)
+    Placements[Cold[i]] = FieldPlacement{ColdGV, ColdTy, (int)i};
+
+  LLVM_DEBUG(dbgs() << "Struct layout: splitting " << GV.getName() << " into "
+                    << Hot.size() << " hot fields (" << HotSize
+                    << " bytes) and " << Cold.size() << " cold fields\n");
+
+  rewriteFields(C, Placements);
+  GV.eraseFromParent();
+  NumSplitGlobals++;
+  return true;
+}
+
+bool PatmosStructLayout::splitAlloca(AllocaInst &AI, StructCandidate &C,
+                                     const DataLayout &DL) {
+  SmallVector<unsigned, 8> Scalars, Rest;
+  for (unsigned i = 0, e = C.Ty->getNumElements(); i != e; i++) {
+    if (C.isHot(i) && C.Ty->getElementType(i)->isSingleValueType())
+      Scalars.push_back(i);
+    else
+      Rest.push_back(i);
+  }
+  if (Scalars.empty())
+    return false;
+
+  // A single remaining field becomes an alloca of its own as well.
+  if (Rest.size() == 1) {
+    Scalars.push_back(Rest.front());
+    Rest.clear();
+  }
+
+  const StructLayout *Layout = DL.getStructLayout(C.Ty);
+  Align Alignment = AI.getAlign();
+  unsigned AddrSpace = AI.getType()->getAddressSpace();
+
+  SmallVector<FieldPlacement, 8> Placements(C.Ty->getNumElements());
+  for (unsigned i : Scalars) {
+    Type *FieldTy = C.Ty->getElementType(i);
+    Align FieldAlignment = std::max(DL.getABITypeAlign(FieldTy),
+        commonAlignment(Alignment, Layout->getElementOffset(i)));
+    AllocaInst *NewAI = new AllocaInst(FieldTy, AddrSpace, nullptr,
+                                       FieldAlignment,
+                                       AI.getName() + "." + Twine(i), &AI);
+    Placements[i] = FieldPlacement{NewAI, FieldTy, -1};
+  }
+
+  if (!Rest.empty()) {
+    StructType *RestTy = createPart(C.Ty, Rest, ".cold");
+    AllocaInst *NewAI = new AllocaInst(RestTy, AddrSpace, nullptr, Alignment,
+                                       AI.getName() + ".cold", &AI);
+    for (unsigned i = 0, e = Rest.size(); i != e; i++)
+      Placements[Rest[i]] = FieldPlacement{NewAI, RestTy, (int)i};
+  }
+
+  LLVM_DEBUG(dbgs() << "Struct layout: splitting " << Scalars.size()
+                    << " fields off from " << AI.getName() << " in "
+                    << AI.getFunction()->getName() << "\n");
+
+  rewriteFields(C, Placements);
+  AI.eraseFromParent();
+  NumSplitAllocas++;
+  NumHotScalars += Scalars.size();
+  return true;
+}
+
+bool PatmosStructLayout::runOnModule(Module &M) {
+  const DataLayout &DL = M.getDataLayout();
+
+  analyzeCallGraph(M);
+
+  bool Changed = false;
+
+  SmallVector<GlobalVariable *, 16> Globals;
+  for (GlobalVariable &GV : M.globals()) {
+    if (GV.hasLocalLinkage() && GV.hasInitializer() &&
+        !GV.isExternallyInitialized() && !GV.hasSection() &&
+        GV.getAddressSpace() == 0 && isa<StructType>(GV.getValueType()))
+      Globals.push_back(&GV);
+  }
+
+  for (GlobalVariable *GV : Globals) {
+    if (Optional<StructCandidate> C =
+            getCandidate(GV, cast<StructType>(GV->getValueType()), DL))
+      Changed |= splitGlobal(*GV, *C, DL);
+  }
+
+  for (Function &F : M) {
+    if (F.isDeclaration() || F.hasOptNone())
+      continue;
+
+    SmallVector<AllocaInst *, 8> Allocas;
+    for (Instruction &I : F.getEntryBlock()) {
+      AllocaInst *AI = dyn_cast<AllocaInst>(&I);
+      if (AI && AI->isStaticAlloca() && !AI->isArrayAllocation() &&
+          isa<StructType>(AI->getAllocatedType()))
+        Allocas.push_back(AI);
+    }
+
+    for (AllocaInst *AI : Allocas) {
+      if (Optional<StructCandidate> C =
+              getCandidate(AI, cast<StructType>(AI->getAllocatedType()), DL))
+        Changed |= splitAlloca(*AI, *C, DL);
+    }
+  }
+  return Changed;
+}
@@ -18,6 +18,9 @@
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include <math.h>
 
 using namespace llvm;
@@ -46,6 +49,71 @@ static cl::opt<unsigned> MethodCacheSize("mpatmos-method-cache-size",
                      cl::desc("Total size of the instruction cache in bytes "
                               "(default 4096)"));
 
+/// DataCacheSize - Total size of the data cache in bytes.
+static cl::opt<unsigned> DataCacheSize("mpatmos-data-cache-size",
+                     cl::init(2048),
+                     cl::desc("Total size of the data cache in bytes "
+                              "(default 2048)"));
+
+/// DataCacheAssoc - Number of ways of the data cache, assuming LRU
+/// replacement for set-associative caches.
+static cl::opt<unsigned> DataCacheAssoc("mpatmos-data-cache-assoc",
+                     cl::init(1),
+                     cl::desc("Associativity of the data cache (default 1, "
+                              "i.e., direct-mapped)"));
+
+/// SmallDataLimit - Size limit of the globals placed in the small data area,
+/// which is addressed relative to a reserved base register.
+static cl::opt<unsigned> SmallDataLimit("mpatmos-small-data-limit",
+                     cl::init(0),
+                     cl::desc("Place globals of up to the given size in bytes "
+                              "in the small data area, addressed relative to "
+                              "r28. All code of the program must be compiled "
+                              "with the same limit (default 0, i.e., "
+                              "disabled)."));
+
+/// ISPMBase - Address of the instruction scratchpad.
+static cl::opt<unsigned> ISPMBase("mpatmos-ispm-base",
+                     cl::init(0x10000),
+                     cl::desc("Address of the instruction scratchpad "
+                              "(default 0x10000)."));
+
+/// ISPMSize - Size of the instruction scratchpad in bytes.
+static cl::opt<unsigned> ISPMSize("mpatmos-ispm-size",
+                     cl::init(0),
+                     cl::desc("Size of the instruction scratchpad in bytes "
+                              "(default 0, i.e., no instruction "
+                              "scratchpad)."));
+
+/// HardwareConfig - Patmos hardware configuration (XML) to take the cache
+/// geometries and the pipeline configuration from.
+static cl::opt<std::string> HardwareConfig("mpatmos-hw-config",
+                     cl::init(""),
+                     cl::desc("Read the cache sizes and pipeline configuration "
+                              "from the given Patmos hardware configuration "
+                              "file. Explicit options take precedence."));
+
+/// TDMCores - Number of cores sharing the main memory through a TDM arbiter,
+/// as in multicore T-CREST configurations.
+static cl::opt<unsigned> TDMCores("mpatmos-tdm-cores",
+                     cl::init(1),
+                     cl::desc("Number of cores sharing the main memory through "
+                              "a TDM arbiter (default 1, i.e., no arbiter)."));
+
+/// TDMSlotCycles - Length of the slot of a core in the TDM schedule of the
+/// main memory arbiter.
+static cl::opt<unsigned> TDMSlotCycles("mpatmos-tdm-slot-cycles",
+                     cl::init(6),
+                     cl::desc("Length of the TDM slot of a core at the main "
+                              "memory arbiter in cycles (default 6)."));
+
+/// BurstBytes - Number of bytes the main memory transfers in a burst, i.e.,
+/// in one slot of the core.
+static cl::opt<unsigned> BurstBytes("mpatmos-burst-bytes",
+                     cl::init(16),
+                     cl::desc("Number of bytes transferred in a burst from or "
+                              "to the main memory (default 16)."));
+
 static cl::opt<unsigned> MinSubfunctionAlign("mpatmos-subfunction-align",
                    cl::init(16),
                    cl::desc("Alignment for functions and subfunctions (including "
@@ -101,7 +169,11 @@ static cl::opt<PatmosSubtarget::CFLType> PatmosCFLType("mpatmos-cfl",
 PatmosSubtarget::PatmosSubtarget(const Triple &TT,
                                  StringRef CPU,
                                  StringRef FS, const PatmosTargetMachine &TM, CodeGenOpt::Level L) :
-  PatmosGenSubtargetInfo(TT, CPU, CPU, FS), TSInfo(),InstrInfo(new PatmosInstrInfo(TM)),
+  PatmosGenSubtargetInfo(TT, CPU, CPU, FS),
+  StackCacheBytes(StackCacheSize), MethodCacheBytes(MethodCacheSize),
+  DataCacheBytes(DataCacheSize), DataCacheWays(DataCacheAssoc),
+  NumTDMCores(TDMCores),
+  TSInfo(),InstrInfo(new PatmosInstrInfo(TM)),
   FrameLowering(new PatmosFrameLowering(TM,*this, TM.getDataLayout())),
   TLInfo(new PatmosTargetLowering(TM, *this)), OptLevel(L)
 {
@@ -111,9 +183,118 @@ PatmosSubtarget::PatmosSubtarget(const Triple &TT,
   // Parse features string.
   ParseSubtargetFeatures(CPUName, CPUName, FS);
 
+  CPUName = applyHardwareConfig(CPUName, FS);
+
   InstrItins = getInstrItineraryForCPU(CPUName);
 }
 
+/// Strip XML comments from the configuration.
+static std::string stripXMLComments(StringRef XML) {
+  std::string Result;
+  while (!XML.empty()) {
+    size_t Begin = XML.find("<!--");
+    Result += XML.substr(0, Begin).str();
+    if (Begin == StringRef::npos) break;
+    size_t End = XML.find("-->", Begin);
+    if (End == StringRef::npos) break;
+    XML = XML.substr(End + 3);
+  }
+  return Result;
+}
+
+/// Get the value of an attribute of the first element with the given name,
+/// or None if there is no such element or attribute.
+static Optional<StringRef> getXMLAttribute(StringRef XML, StringRef Element,
+                                           StringRef Attribute) {
+  std::string Open = ("<" + Element).str();
+  for (size_t Pos = XML.find(Open); Pos != StringRef::npos;
+       Pos = XML.find(Open, Pos + 1)) {
+    StringRef Tag = XML.substr(Pos + Open.size());
+    // Make sure we do not match a prefix of a longer element name.
+    if (Tag.empty() || !(isSpace(Tag[0]) || Tag[0] == '/' || Tag[0] == '>'))
+      continue;
+    Tag = Tag.substr(0, Tag.find('>'));
+
+    SmallVector<StringRef, 8> Attrs;
+    SplitString(Tag, Attrs, " \t\r\n");
+    for (StringRef A : Attrs) {
+      std::pair<StringRef, StringRef> NameValue = A.split('=');
+      if (NameValue.first == Attribute)
+        return NameValue.second.trim("\"/");
+    }
+    return None;
+  }
+  return None;
+}
+
+/// Parse a size as used in the hardware configuration, e.g. "2k" or "4M".
+static unsigned parseHWSize(StringRef Value, StringRef Element) {
+  Value = Value.trim();
+  unsigned Scale = 1;
+  if (Value.endswith_lower("k")) {
+    Scale = 1024;
+  } else if (Value.endswith_lower("m")) {
+    Scale = 1024 * 1024;
+  }
+  if (Scale != 1) Value = Value.drop_back();
+
+  unsigned Size;
+  if (Value.getAsInteger(10, Size))
+    report_fatal_error("Invalid size '" + Value + "' for " + Element +
+                       " in the Patmos hardware configuration");
+  return Size * Scale;
+}
+
+StringRef PatmosSubtarget::applyHardwareConfig(StringRef CPU, StringRef FS) {
+  if (HardwareConfig.empty())
+    return CPU;
+
+  auto Buffer = MemoryBuffer::getFile(HardwareConfig);
+  if (!Buffer)
+    report_fatal_error("Cannot read the Patmos hardware configuration '" +
+                       HardwareConfig + "': " + Buffer.getError().message());
+
+  std::string XML = stripXMLComments((*Buffer)->getBuffer());
+
+  if (StackCacheSize.getNumOccurrences() == 0) {
+    if (auto Size = getXMLAttribute(XML, "SCache", "size"))
+      StackCacheBytes = parseHWSize(*Size, "SCache");
+  }
+
+  if (auto Type = getXMLAttribute(XML, "ICache", "type")) {
+    if (!FS.contains("methodcache"))
+      HasMethodCache = Type->equals_lower("method");
+  }
+
+  if (MethodCacheSize.getNumOccurrences() == 0) {
+    if (auto Size = getXMLAttribute(XML, "ICache", "size"))
+      MethodCacheBytes = parseHWSize(*Size, "ICache");
+  }
+
+  if (DataCacheSize.getNumOccurrences() == 0) {
+    if (auto Size = getXMLAttribute(XML, "DCache", "size"))
+      DataCacheBytes = parseHWSize(*Size, "DCache");
+  }
+
+  if (DataCacheAssoc.getNumOccurrences() == 0) {
+    if (auto Assoc = getXMLAttribute(XML, "DCache", "assoc"))
+      DataCacheWays = std::max(1u, parseHWSize(*Assoc, "DCache"));
+  }
+
+  if (TDMCores.getNumOccurrences() == 0) {
+    if (auto Count = getXMLAttribute(XML, "cores", "count"))
+      NumTDMCores = std::max(1u, parseHWSize(*Count, "cores"));
+  }
+
+  // Without the second pipeline, use the single-issue scheduling model.
+  if (auto Dual = getXMLAttribute(XML, "pipeline", "dual")) {
+    if (CPU == "generic" && Dual->equals_lower("false"))
+      return "single-issue";
+  }
+
+  return CPU;
+}
+
 bool PatmosSubtarget::enablePostRAScheduler() const {
   return hasPostRAScheduler(OptLevel);
 }
@@ -182,6 +363,20 @@ bool PatmosSubtarget::allowBranchInsideCFLDelaySots() const
   return BranchInsideCFLDelaySlots;
 }
 
+unsigned PatmosSubtarget::getMULLatency() const {
+  const MCInstrDesc &MUL = InstrInfo->get(Patmos::MUL);
+  const MCInstrDesc &MFS = InstrInfo->get(Patmos::MFS);
+
+  // SL is the first implicit def of MUL, MFS reads the special register
+  // after its def and guard operands.
+  int Latency = InstrItins.getOperandLatency(MUL.getSchedClass(),
+                                             MUL.getNumOperands(),
+                                             MFS.getSchedClass(), 3);
+  if (Latency < 1)
+    return 1;
+  return Latency - 1;
+}
+
 unsigned PatmosSubtarget::getIssueWidth(unsigned SchedClass) const {
   return InstrItins.getNumMicroOps(SchedClass);
 }
@@ -198,7 +393,7 @@ Align PatmosSubtarget::getMinSubfunctionAlignment() const {
 }
 
 unsigned PatmosSubtarget::getStackCacheSize() const {
-  return StackCacheSize;
+  return StackCacheBytes;
 }
 
 unsigned PatmosSubtarget::getStackCacheBlockSize() const {
@@ -206,7 +401,71 @@ unsigned PatmosSubtarget::getStackCacheBlockSize() const {
 }
 
 unsigned PatmosSubtarget::getMethodCacheSize() const {
-  return MethodCacheSize;
+  return MethodCacheBytes;
+}
+
+unsigned PatmosSubtarget::getMethodCacheBlockSize() const {
+  return BurstBytes;
+}
+
+unsigned PatmosSubtarget::getDataCacheSize() const {
+  return DataCacheBytes;
+}
+
+unsigned PatmosSubtarget::getDataCacheAssociativity() const {
+  return std::max(1u, DataCacheWays);
+}
+
+unsigned PatmosSubtarget::getDataCacheBlockSize() const {
+  return BurstBytes;
+}
+
+unsigned PatmosSubtarget::getSmallDataLimit() const {
+  return SmallDataLimit;
+}
+
+unsigned PatmosSubtarget::getISPMBase() const {
+  return ISPMBase;
+}
+
+unsigned PatmosSubtarget::getISPMSize() const {
+  return ISPMSize;
+}
+
+StringRef PatmosSubtarget::getISPMSectionName() {
+  return ".text.ispm";
+}
+
+bool PatmosSubtarget::isInISPM(const GlobalValue *GV) {
+  const GlobalObject *GO = GV ? GV->getBaseObject() : nullptr;
+  return GO && isa<Function>(GO) && GO->getSection() == getISPMSectionName();
+}
+
+bool PatmosSubtarget::needsLongCall(const Function &Caller,
+                                    const GlobalValue *Callee) const {
+  // Calls target absolute word addresses of 22 bits. Main memory code is
+  // within reach unless the large code model is used, which never uses
+  // direct calls anyway.
+  if (isInISPM(&Caller) == isInISPM(Callee))
+    return false;
+  return !isUInt<24>((uint64_t)getISPMBase() + getISPMSize());
+}
+
+unsigned PatmosSubtarget::getTDMPeriod() const {
+  return NumTDMCores * TDMSlotCycles;
+}
+
+unsigned PatmosSubtarget::getMainMemoryLatency() const {
+  // Without an arbiter the access is served at once, otherwise it might just
+  // miss the slot of the core and wait for the next period.
+  if (!hasTDMArbiter())
+    return TDMSlotCycles;
+  return getTDMPeriod() + TDMSlotCycles;
+}
+
+unsigned PatmosSubtarget::getMemoryTransferCycles(unsigned Bytes) const {
+  unsigned Bursts = (Bytes + BurstBytes - 1) / BurstBytes;
+  return Bursts * getMainMemoryLatency();
 }
 
 unsigned PatmosSubtarget::getAlignedStackFrameSize(unsigned frameSize) const {
@@ -34,6 +34,16 @@ class PatmosSubtarget final : public PatmosGenSubtargetInfo {
   bool HasFPU;
   bool HasMethodCache;
 
+  /// Cache geometries in bytes, from the command line or the hardware
+  /// configuration file.
+  unsigned StackCacheBytes;
+  unsigned MethodCacheBytes;
+  unsigned DataCacheBytes;
+  unsigned DataCacheWays;
+
+  /// Number of cores sharing the main memory through a TDM arbiter.
+  unsigned NumTDMCores;
+
   InstrItineraryData InstrItins;
   CodeGenOpt::Level OptLevel;
 
@@ -48,6 +58,11 @@ public:
   ///
   PatmosSubtarget(const Triple &TT, StringRef CPU, StringRef FS, const PatmosTargetMachine &TM, CodeGenOpt::Level L);
 
+  /// Read the Patmos hardware configuration file given on the command line,
+  /// if any, and update the cache parameters and features. Explicitly given
+  /// options take precedence. Returns the CPU to use for scheduling.
+  StringRef applyHardwareConfig(StringRef CPU, StringRef FS);
+
   /// ParseSubtargetFeatures - Parses features string setting specified
   /// subtarget options.  Definition of function is auto generated by tblgen.
   void ParseSubtargetFeatures(StringRef CPU, StringRef TuneCPU, StringRef FS);
@@ -114,8 +129,9 @@ public:
   /// instructions.
   bool allowBranchInsideCFLDelaySots() const;
 
-  /// Return the latency of MUL instructions
-  unsigned getMULLatency() const { return 1; }
+  /// Return the number of cycles between a MUL and the first MFS that can
+  /// read its result, as defined by the itineraries.
+  unsigned getMULLatency() const;
 
   /// Get the width of an instruction.
   unsigned getIssueWidth(unsigned SchedClass) const;
@@ -133,6 +149,60 @@ public:
 
   unsigned getMethodCacheSize() const;
 
+  /// Return the block size of the method cache in bytes, a block is filled
+  /// by a single burst from the main memory.
+  unsigned getMethodCacheBlockSize() const;
+
+  unsigned getDataCacheSize() const;
+
+  unsigned getDataCacheAssociativity() const;
+
+  /// Return the block size of the data cache in bytes, a block is filled by
+  /// a single burst from the main memory.
+  unsigned getDataCacheBlockSize() const;
+
+  /// Return the size limit of the globals in the small data area, zero if
+  /// globals are not placed in a small data area.
+  /// \see PatmosTargetObjectFile::isGlobalInSmallSection
+  unsigned getSmallDataLimit() const;
+
+  /// Return true if small globals are addressed relative to the small data
+  /// base register, which is then reserved.
+  bool hasSmallData() const { return getSmallDataLimit() != 0; }
+
+  /// Return the address and the size of the instruction scratchpad in bytes,
+  /// the size is zero if there is none.
+  unsigned getISPMBase() const;
+  unsigned getISPMSize() const;
+
+  /// Return the section of the functions placed in the instruction
+  /// scratchpad.
+  static StringRef getISPMSectionName();
+
+  /// Return true if GV is a function placed in the instruction scratchpad.
+  static bool isInISPM(const GlobalValue *GV);
+
+  /// Return true if a direct call from Caller cannot reach Callee, i.e., if
+  /// one of them is in an instruction scratchpad outside the range of the
+  /// call. Callee is null for calls of external symbols, e.g., libcalls.
+  bool needsLongCall(const Function &Caller, const GlobalValue *Callee) const;
+
+  /// Return true if the main memory is shared with other cores through a TDM
+  /// arbiter, i.e., for multicore T-CREST configurations.
+  bool hasTDMArbiter() const { return NumTDMCores > 1; }
+
+  /// Return the period of the TDM schedule of the main memory arbiter in
+  /// cycles, after which the slot of this core comes again.
+  unsigned getTDMPeriod() const;
+
+  /// Return the worst-case latency of a main memory access in cycles,
+  /// including the wait for the TDM slot of this core.
+  unsigned getMainMemoryLatency() const;
+
+  /// Return the worst-case number of cycles to transfer the given number of
+  /// bytes from or to the main memory, in bursts.
+  unsigned getMemoryTransferCycles(unsigned Bytes) const;
+
   /// Return the actual size of a stack cache frame in bytes.
   /// @param frameSize the required frame size in bytes.
   unsigned getAlignedStackFrameSize(unsigned frameSize) const;
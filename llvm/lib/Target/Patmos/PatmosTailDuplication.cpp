@@ -0,0 +1,269 @@
+//===-- PatmosTailDuplication.cpp - Duplicate small blocks for branches ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Duplicate small return and join blocks into the predecessors that branch to
+// them unconditionally.
+//
+// An unconditional branch costs its delay slots, which the delay slot filler
+// often pads with NOPs, as there is nothing to move into them at the end of a
+// block. Copying a short tail block into such a predecessor removes the branch
+// altogether. If the tail ends in a return or a branch itself, its delay slots
+// can then be filled with the code of the predecessor.
+//
+// The generic tail duplication runs before the block layout is known and does
+// not count the delay slots. This pass runs after PatmosBlockPlacement, only
+// duplicates into predecessors that actually branch, the hottest ones first,
+// and limits the code growth per function. A function that fits into the
+// method cache is not grown beyond it, such that the duplication does not
+// cause method cache misses or an additional subfunction.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-tail-duplication"
+
+STATISTIC(NumDuplicated, "Tail blocks duplicated into branching predecessors");
+STATISTIC(NumRemoved,    "Tail blocks removed after duplication");
+
+static cl::opt<bool> EnableTailDuplication(
+  "mpatmos-enable-tail-duplication",
+  cl::init(false),
+  cl::desc("Duplicate small blocks into predecessors that branch to them, "
+           "to remove the branches and their delay slots."));
+
+static cl::opt<unsigned> MaxTailSize(
+  "mpatmos-tail-duplication-size",
+  cl::init(4),
+  cl::desc("Maximum number of instructions of a duplicated block, without "
+           "its branches (default: 4)."),
+  cl::Hidden);
+
+static cl::opt<unsigned> MaxGrowth(
+  "mpatmos-tail-duplication-growth",
+  cl::init(64),
+  cl::desc("Maximum code growth in bytes per function (default: 64)."),
+  cl::Hidden);
+
+namespace {
+
+  class PatmosTailDuplication : public MachineFunctionPass {
+  private:
+    static char ID;
+
+    const PatmosTargetMachine &PTM;
+    const PatmosInstrInfo *TII;
+
+    /// A predecessor that branches unconditionally to a tail block.
+    struct Candidate {
+      MachineBasicBlock *Pred;
+      MachineBasicBlock *Tail;
+      uint64_t Freq;
+    };
+
+    /// Return the size of a block in bytes, and the number of instructions
+    /// without branches in Count.
+    unsigned getSize(const MachineBasicBlock &MBB, unsigned &Count) const;
+
+    /// Check if MBB can be copied into its predecessors.
+    bool isDuplicableTail(const MachineBasicBlock &MBB,
+                          const MachineLoopInfo &MLI) const;
+
+    /// Return true if Pred ends in a single unconditional branch to Tail.
+    bool branchesTo(MachineBasicBlock &Pred, MachineBasicBlock &Tail) const;
+
+    /// Replace the branch of Pred by a copy of Tail.
+    void duplicateInto(MachineBasicBlock &Pred, MachineBasicBlock &Tail);
+
+  public:
+    PatmosTailDuplication(const PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID), PTM(tm), TII(tm.getInstrInfo()) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Tail Duplication";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<MachineBlockFrequencyInfo>();
+      AU.addRequired<MachineLoopInfo>();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+  };
+
+  char PatmosTailDuplication::ID = 0;
+}
+
+FunctionPass *
+llvm::createPatmosTailDuplicationPass(const PatmosTargetMachine &tm) {
+  return new PatmosTailDuplication(tm);
+}
+
+unsigned PatmosTailDuplication::getSize(const MachineBasicBlock &MBB,
+                                        unsigned &Count) const {
+  unsigned Size = 0;
+  Count = 0;
+  for (const MachineInstr &MI : MBB) {
+    Size += TII->getInstrSize(&MI);
+    if (!MI.isDebugInstr() && !MI.isBranch() && !TII->isPseudo(&MI))
+      Count++;
+  }
+  return Size;
+}
+
+bool PatmosTailDuplication::isDuplicableTail(const MachineBasicBlock &MBB,
+                                             const MachineLoopInfo &MLI) const {
+  const MachineFunction &MF = *MBB.getParent();
+  if (&MBB == &MF.front() || MBB.isEHPad() || MBB.hasAddressTaken() ||
+      MBB.isSuccessor(&MBB) || MLI.isLoopHeader(&MBB))
+    return false;
+
+  unsigned Count;
+  getSize(MBB, Count);
+  if (Count > MaxTailSize)
+    return false;
+
+  // Calls and stack control would change what the stack cache analysis and
+  // the call graph see, keep the tails simple.
+  for (const MachineInstr &MI : MBB) {
+    if (MI.isCall() || MI.isInlineAsm() || MI.isNotDuplicable() ||
+        MI.isIndirectBranch() || MI.isBundle() ||
+        PatmosInstrInfo::isStackControl(&MI))
+      return false;
+  }
+
+  // Returns are copied as they are, other terminators have to be rewritten
+  // for the new layout.
+  if (MBB.succ_empty())
+    return !MBB.empty() && MBB.back().isReturn();
+  MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+  SmallVector<MachineOperand, 2> Cond;
+  return !TII->analyzeBranch(const_cast<MachineBasicBlock&>(MBB), TBB, FBB,
+                             Cond, false);
+}
+
+bool PatmosTailDuplication::branchesTo(MachineBasicBlock &Pred,
+                                       MachineBasicBlock &Tail) const {
+  if (&Pred == &Tail || Pred.succ_size() != 1 || !Pred.isSuccessor(&Tail) ||
+      Pred.getNextNode() == &Tail)
+    return false;
+  MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+  SmallVector<MachineOperand, 2> Cond;
+  return !TII->analyzeBranch(Pred, TBB, FBB, Cond, false) && Cond.empty() &&
+         TBB == &Tail && !FBB;
+}
+
+void PatmosTailDuplication::duplicateInto(MachineBasicBlock &Pred,
+                                          MachineBasicBlock &Tail) {
+  MachineFunction &MF = *Pred.getParent();
+
+  TII->removeBranch(Pred);
+  for (MachineInstr &MI : Tail)
+    Pred.insert(Pred.end(), MF.CloneMachineInstr(&MI));
+
+  Pred.removeSuccessor(&Tail);
+  for (auto I = Tail.succ_begin(), E = Tail.succ_end(); I != E; ++I)
+    Pred.copySuccessor(&Tail, I);
+
+  // The copied branches of the tail assumed that it falls through to its
+  // layout successor.
+  if (!Pred.succ_empty())
+    Pred.updateTerminator(Tail.getNextNode());
+
+  MF.getInfo<PatmosMachineFunctionInfo>()->invalidateBlockSize(&Pred);
+}
+
+bool PatmosTailDuplication::runOnMachineFunction(MachineFunction &MF) {
+  if (!EnableTailDuplication ||
+      MF.getInfo<PatmosMachineFunctionInfo>()->isSinglePath())
+    return false;
+
+  const MachineBlockFrequencyInfo &MBFI =
+      getAnalysis<MachineBlockFrequencyInfo>();
+  const MachineLoopInfo &MLI = getAnalysis<MachineLoopInfo>();
+  const PatmosSubtarget &STC = *PTM.getSubtargetImpl();
+
+  // The budget of the function, which must keep fitting into the method
+  // cache if it fits now.
+  unsigned FunctionSize = 0, Count;
+  for (const MachineBasicBlock &MBB : MF)
+    FunctionSize += getSize(MBB, Count);
+  unsigned Budget = MaxGrowth;
+  if (STC.hasMethodCache() && FunctionSize <= STC.getMethodCacheSize())
+    Budget = std::min(Budget, STC.getMethodCacheSize() - FunctionSize);
+
+  std::vector<Candidate> Candidates;
+  for (MachineBasicBlock &Tail : MF) {
+    if (!isDuplicableTail(Tail, MLI))
+      continue;
+    for (MachineBasicBlock *Pred : Tail.predecessors())
+      if (branchesTo(*Pred, Tail))
+        Candidates.push_back({Pred, &Tail,
+                              MBFI.getBlockFreq(Pred).getFrequency()});
+  }
+  // the hottest branches first, deterministically
+  std::stable_sort(Candidates.begin(), Candidates.end(),
+                   [](const Candidate &A, const Candidate &B) {
+                     return A.Freq > B.Freq;
+                   });
+
+  bool Changed = false;
+  SmallPtrSet<MachineBasicBlock*, 8> Tails;
+  for (const Candidate &C : Candidates) {
+    // an earlier duplication may have changed the predecessor
+    if (!branchesTo(*C.Pred, *C.Tail))
+      continue;
+
+    // the copy replaces the branch of the predecessor
+    unsigned BranchSize = 0;
+    for (auto I = C.Pred->getFirstTerminator(); I != C.Pred->end(); ++I)
+      BranchSize += TII->getInstrSize(&*I);
+    unsigned TailSize = getSize(*C.Tail, Count);
+    unsigned Growth = TailSize > BranchSize ? TailSize - BranchSize : 0;
+    if (Growth > Budget)
+      continue;
+    Budget -= Growth;
+
+    LLVM_DEBUG(dbgs() << "Duplicate " << printMBBReference(*C.Tail)
+                      << " into " << printMBBReference(*C.Pred) << "\n");
+    duplicateInto(*C.Pred, *C.Tail);
+    Tails.insert(C.Tail);
+    NumDuplicated++;
+    Changed = true;
+  }
+
+  // Remove the tails that are no longer reached.
+  for (MachineBasicBlock *Tail : Tails) {
+    if (!Tail->pred_empty())
+      continue;
+    while (!Tail->succ_empty())
+      Tail->removeSuccessor(Tail->succ_begin());
+    Tail->eraseFromParent();
+    NumRemoved++;
+  }
+
+  return Changed;
+}
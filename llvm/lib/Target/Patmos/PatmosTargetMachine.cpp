@@ -13,9 +13,11 @@
 
 #include "Patmos.h"
 #include "PatmosTargetMachine.h"
+#include "SinglePath/ConstantLoopDominators.h"
 #include "SinglePath/PatmosSinglePathInfo.h"
 #include "PatmosSchedStrategy.h"
 #include "PatmosStackCacheAnalysis.h"
+#include "PatmosTargetTransformInfo.h"
 #include "TargetInfo/PatmosTargetInfo.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/CodeGen/Passes.h"
@@ -25,6 +27,7 @@
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Utils/UnifyFunctionExitNodes.h"
 #include "llvm/Transforms/Utils.h"
@@ -34,14 +37,22 @@ using namespace llvm;
 extern "C" LLVM_EXTERNAL_VISIBILITY void LLVMInitializePatmosTarget() {
   // Register the target.
   RegisterTargetMachine<PatmosTargetMachine> X(getThePatmosTarget());
+
+  // Register the analyses that passes only require, such that the pass
+  // manager can schedule them.
+  PassRegistry &PR = *PassRegistry::getPassRegistry();
+  initializePatmosLoopBoundInfoPass(PR);
+  initializeConstantLoopDominatorsPass(PR);
 }
 
 static ScheduleDAGInstrs *createPatmosVLIWMachineSched(MachineSchedContext *C) {
-  // TODO instead of the generic ScheduleDAGMI, we might want to use a different
-  // scheduler that allows for VLIW bundling or something, similar to the
-  // PatmosPostRAScheduler. Should still be split into a generic ScheduleDAG
-  // scheduler and a specialised PatmosSchedStrategy.
-  ScheduleDAGMI *PS = new ScheduleDAGMI(C, std::make_unique<PatmosVLIWSchedStrategy>(), false);
+  // The generic ScheduleDAGMI takes care of building the DAG and moving the
+  // instructions, the strategy groups them into issue cycles so that the
+  // post-RA scheduler can bundle them.
+  const PatmosTargetMachine &PTM =
+    static_cast<const PatmosTargetMachine &>(C->MF->getTarget());
+  ScheduleDAGMI *PS = new ScheduleDAGMI(C,
+                        std::make_unique<PatmosVLIWSchedStrategy>(PTM), false);
   return PS;
 }
 
@@ -58,6 +69,166 @@ namespace {
     cl::init(false),
     cl::desc("Enable the Patmos stack cache analysis."),
     cl::Hidden);
+  /// EnableStackCacheMerging - Option to let callers reserve the stack cache
+  /// frames of their hot callees.
+  static cl::opt<bool> EnableStackCacheMerging(
+    "mpatmos-merge-stack-cache-reserves",
+    cl::init(false),
+    cl::desc("Merge the stack cache reservations of hot, non-recursive "
+             "callees into their callers."),
+    cl::Hidden);
+  /// EnableStackCacheBudget - Option to move the frames of cold functions to
+  /// the shadow stack, until the worst-case call path fits the stack cache.
+  static cl::opt<bool> EnableStackCacheBudget(
+    "mpatmos-stack-cache-budget",
+    cl::init(false),
+    cl::desc("Place the frames of cold functions on the shadow stack, until "
+             "the frames along the worst-case call path fit into the stack "
+             "cache."),
+    cl::Hidden);
+  /// EnableLeafEnsureRemoval - Option to remove the ensures after calls of
+  /// functions that reserve no stack cache space, including their callees.
+  static cl::opt<bool> EnableLeafEnsureRemoval(
+    "mpatmos-remove-leaf-ensures",
+    cl::init(true),
+    cl::desc("Remove the stack cache ensures after calls of functions that, "
+             "like their callees, reserve no stack cache space."),
+    cl::Hidden);
+  /// EnableEnsurePlacement - Option to remove ensures that are followed by
+  /// other ensures, and to sink ensures out of loops.
+  static cl::opt<bool> EnableEnsurePlacement(
+    "mpatmos-enable-ensure-placement",
+    cl::init(false),
+    cl::desc("Delay the stack cache ensures after calls up to the next stack "
+             "cache access, merging the ensures of consecutive calls and "
+             "sinking them out of loops."),
+    cl::Hidden);
+
+  /// EnableStackCacheSpilling - Option to spill the stack cache ahead of
+  /// calls whose callee spills on its reserve.
+  static cl::opt<bool> EnableStackCacheSpilling(
+    "mpatmos-enable-stack-cache-spilling",
+    cl::init(false),
+    cl::desc("Spill the stack cache ahead of calls whose callee spills on its "
+             "reserve, bounded by the stack cache analysis, overlapping the "
+             "spill with the code before the call."),
+    cl::Hidden);
+
+  /// EnablePredicateSpillPacking - Option to spill predicates to single bits
+  /// of shared stack slots.
+  static cl::opt<bool> EnablePredicateSpillPacking(
+    "mpatmos-pack-predicate-spills",
+    cl::init(false),
+    cl::desc("Pack the predicate spill slots of a function into shared words, "
+             "one bit per slot."),
+    cl::Hidden);
+
+  /// EnableMethodCacheAnalysis - Option to enable the classification of
+  /// Patmos' method cache accesses at calls and returns.
+  static cl::opt<bool> EnableMethodCacheAnalysis(
+    "mpatmos-enable-method-cache-analysis",
+    cl::init(false),
+    cl::desc("Enable the Patmos method cache analysis."),
+    cl::Hidden);
+
+  /// EnableDataCacheAnalysis - Option to enable the classification of
+  /// Patmos' data cache loads.
+  static cl::opt<bool> EnableDataCacheAnalysis(
+    "mpatmos-enable-data-cache-analysis",
+    cl::init(false),
+    cl::desc("Enable the Patmos data cache analysis, whose results are used "
+             "by the scheduler and exported to PML."),
+    cl::Hidden);
+  /// EnableMethodCacheLayout - Option to order the functions of a module
+  /// based on the call graph and the method cache size.
+  static cl::opt<bool> EnableMethodCacheLayout(
+    "mpatmos-method-cache-layout",
+    cl::init(false),
+    cl::desc("Place callers and callees next to each other in memory, as long "
+             "as they fit into the method cache together."),
+    cl::Hidden);
+  /// EnableCallGraphProfile - Option to emit the weights of the calls for
+  /// the function ordering of the linker.
+  static cl::opt<bool> EnableCallGraphProfile(
+    "mpatmos-call-graph-profile",
+    cl::init(false),
+    cl::desc("Emit the call-graph profile, used by the linker to place "
+             "callers and callees next to each other."),
+    cl::Hidden);
+  /// EnablePipeliner - Option to software pipeline single-block loops with
+  /// constant trip counts, such as the loops of single-path code.
+  static cl::opt<bool> EnablePipeliner(
+    "mpatmos-enable-pipeliner",
+    cl::init(false),
+    cl::desc("Enable software pipelining of loops with constant trip counts "
+             "for Patmos."),
+    cl::Hidden);
+  /// EnableLoopBaseSharing - Option to let the memory accesses of loops
+  /// share the base registers of their pointers.
+  static cl::opt<bool> EnableLoopBaseSharing(
+    "mpatmos-share-loop-bases",
+    cl::init(true),
+    cl::desc("Fold the constant additions to the base registers of memory "
+             "accesses in loops into the offsets of the accesses."),
+    cl::Hidden);
+  /// EnableLatchCompareHoisting - Option to compute the exit conditions of
+  /// loops from the induction variables before their increments.
+  static cl::opt<bool> EnableLatchCompareHoisting(
+    "mpatmos-hoist-latch-compares",
+    cl::init(true),
+    cl::desc("Compute the exit compares of loop latches from the induction "
+             "variables before their increments, early in the latch."),
+    cl::Hidden);
+  /// EnableIPRA - Option to allocate the registers of calls to compiled
+  /// functions according to the registers they actually modify.
+  static cl::opt<bool> EnableIPRA(
+    "mpatmos-enable-ipra",
+    cl::init(false),
+    cl::desc("Enable the interprocedural register allocation for Patmos, "
+             "local functions then save no callee saved registers."),
+    cl::Hidden);
+  /// EnableStructLayout - Option to split structs into their hot and cold
+  /// fields.
+  static cl::opt<bool> EnableStructLayout(
+    "mpatmos-struct-layout",
+    cl::init(false),
+    cl::desc("Split the non-escaping structs of the whole program by the "
+             "access frequency of their fields, for the data cache and the "
+             "stack cache."),
+    cl::Hidden);
+  /// EnableSPMAllocation - Option to place hot data objects in the local
+  /// data scratchpad.
+  static cl::opt<bool> EnableSPMAllocation(
+    "mpatmos-spm-alloc",
+    cl::init(false),
+    cl::desc("Place frequently accessed globals and stack arrays of the whole "
+             "program in the data scratchpad."),
+    cl::Hidden);
+  /// EnableISPMAllocation - Option to place hot functions in the instruction
+  /// scratchpad.
+  static cl::opt<bool> EnableISPMAllocation(
+    "mpatmos-ispm-alloc",
+    cl::init(false),
+    cl::desc("Place frequently executed functions of the whole program, or "
+             "those on the worst-case path of -mpatmos-wcet-profile, in the "
+             "instruction scratchpad of -mpatmos-ispm-size bytes."),
+    cl::Hidden);
+  /// EnableBundlePeephole - Option to run the late peephole optimizations on
+  /// the final bundles.
+  static cl::opt<bool> EnableBundlePeephole(
+    "mpatmos-bundle-peephole",
+    cl::init(false),
+    cl::desc("Remove dead special-register moves and merge single-issue "
+             "instructions into bundles after delay slots have been handled."),
+    cl::Hidden);
+  /// EnableOutliner - Option to outline repeated sequences of cold code, to
+  /// leave more of the method cache to hot code.
+  static cl::opt<bool> EnableOutliner(
+    "mpatmos-enable-outliner",
+    cl::init(false),
+    cl::desc("Outline repeated instruction sequences of cold code into "
+             "functions for Patmos."),
+    cl::Hidden);
   static cl::opt<bool> DisableIfConverter(
       "mpatmos-disable-ifcvt",
       cl::init(false),
@@ -70,6 +241,61 @@ namespace {
   static cl::list<std::string>SerializeRoots("mpatmos-serialize-functions",
      cl::desc("Export only given method (default: 'main') and those reachable from them"),
      cl::CommaSeparated);
+  /// EnableWCETPipeline - Option to tune the code generation for a low and
+  /// analyzable worst-case execution time, see applyWCETDefaults.
+  static cl::opt<bool> EnableWCETPipeline(
+    "mpatmos-wcet",
+    cl::init(false),
+    cl::desc("Tune the code generation for the worst-case execution time "
+             "(used by the -Owcet pipeline of the driver)."),
+    cl::Hidden);
+
+  /// WCETProfile - Option to optimize the worst-case path of a previous
+  /// compilation, see PatmosCriticalityImport.
+  static cl::opt<std::string> WCETProfile(
+    "mpatmos-wcet-profile",
+    cl::desc("Import the block criticalities and frequencies of a WCET "
+             "analysis from the given PML file, and optimize for the "
+             "worst-case path."),
+    cl::value_desc("filename"),
+    cl::Hidden);
+
+  /// applyWCETDefaults - Set the options of the WCET pipeline, unless they
+  /// are given explicitly. The pipeline bounds the stack cache fills and
+  /// removes the ensures that never fill, keeps the likely worst-case path
+  /// within few subfunctions, promotes data to the stack cache, and predicates
+  /// only small regions of innermost loops. Tail calls, which turn calls into
+  /// branches between functions, are not used, the loops are only unrolled
+  /// based on their loop bounds.
+  static void applyWCETDefaults() {
+    static const struct {
+      const char *Name;
+      const char *Value;
+    } Defaults[] = {
+      { "mpatmos-enable-stack-cache-analysis", "true" },
+      { "mpatmos-sca-remove-ensures", "true" },
+      { "mpatmos-enable-ensure-placement", "true" },
+      { "mpatmos-enable-stack-cache-promotion", "true" },
+      { "mpatmos-function-splitter-profile", "true" },
+      { "mpatmos-enable-hyperblocks", "true" },
+      { "mpatmos-enable-block-placement", "true" },
+      { "mpatmos-enable-tail-duplication", "true" },
+      { "mpatmos-hyperblock-size", "32" },
+      { "mpatmos-disable-loopbound-unroll", "false" },
+      { "mpatmos-disable-tail-calls", "true" },
+      { "mpatmos-enable-pipeliner", "false" },
+      { "mpatmos-enable-outliner", "false" },
+    };
+
+    StringMap<cl::Option*> &Opts = cl::getRegisteredOptions();
+    for (const auto &D : Defaults) {
+      auto I = Opts.find(D.Name);
+      // options given on the command line take precedence
+      if (I == Opts.end() || I->second->getNumOccurrences())
+        continue;
+      I->second->addOccurrence(0, D.Name, D.Value);
+    }
+  }
 
 
 
@@ -83,6 +309,9 @@ namespace {
     PatmosPassConfig(PatmosTargetMachine &TM, PassManagerBase &PM)
      : TargetPassConfig(TM, PM)
     {
+      if (EnableWCETPipeline)
+        applyWCETDefaults();
+
       if( PatmosSinglePathInfo::isConstant() && !PatmosSinglePathInfo::isEnabled() ) {
           report_fatal_error("The 'mpatmos-enable-cet' option "
               "requires the 'mpatmos-singlepath' option to also be set.");
@@ -100,6 +329,9 @@ namespace {
         initializePatmosPostRASchedulerPass(*PassRegistry::getPassRegistry());
         substitutePass(&PostRASchedulerID, &PatmosPostRASchedulerID);
       }
+
+      // The sleds of -fxray-instrument are inserted by PatmosSleds.
+      disablePass(&XRayInstrumentationID);
     }
 
     PatmosTargetMachine &getPatmosTargetMachine() const {
@@ -129,18 +361,49 @@ namespace {
     /// addPreISelPasses - This method should add any "last minute" LLVM->LLVM
     /// passes (which are run just before instruction selector).
     bool addPreISel() override {
+      // Lower atomics to sections guarded by the hardware lock. The sections
+      // have no branches, such that the single-path code may contain them.
+      addPass(createPatmosAtomicLoweringPass());
+      // Record cycle counts of functions, if enabled. This must come before
+      // the single-path transformation, which expects a single exit node.
+      addPass(createPatmosProfileInstrumentationPass());
+      // Keep the counters of -fprofile-instr-generate in the scratchpad, if
+      // enabled.
+      addPass(createPatmosProfileSPMPass());
+
+      // Split structs before the scratchpad allocation, which then places
+      // their parts separately.
+      if (EnableStructLayout)
+        addPass(createPatmosStructLayoutPass(getPatmosTargetMachine()));
+
+      if (EnableSPMAllocation)
+        addPass(createPatmosSPMAllocationPass());
+
       if (PatmosSinglePathInfo::isEnabled()) {
+        // Outline loops marked for single-path code into roots of their own
+        addPass(createPatmosSPRegionExtractPass());
+        // Specialize callees of single-path code for constant loop bounds
+        if (getOptLevel() != CodeGenOpt::None)
+          addPass(createPatmosSPSpecializePass());
         // Single-path transformation requires a single exit node
         addPass(createUnifyFunctionExitNodesPass());
         // Single-path transformation currently cannot deal with
         // switch/jumptables -> lower them to ITEs
         addPass(createLowerSwitchPass());
         addPass(createPatmosSPClonePass());
+        // Tighten the bounds of single-path loops where they can be inferred
+        addPass(createPatmosLoopBoundInferencePass());
       }
       // This pass must be after SPClone to ensure we know which functions are
       // singlepath, so that we can report errors when needed
       addPass(createPatmosIntrinsicEliminationPass());
 
+      // Decide the sections of the functions before their calls are lowered,
+      // calls between the sections may need to be long calls.
+      if (EnableISPMAllocation && getOptLevel() != CodeGenOpt::None)
+        addPass(createPatmosISPMAllocationPass(getPatmosTargetMachine(),
+                                               WCETProfile));
+
       return PatmosSinglePathInfo::isEnabled();
     }
 
@@ -148,8 +411,21 @@ namespace {
     /// run passes immediately before register allocation. This should return
     /// true if -print-machineinstrs should print after these passes.
     void addPreRegAlloc() override {
+      // Refine the indirect calls after RegUsageInfoPropagation did the
+      // direct ones.
+      if (TM->Options.EnableIPRA)
+        addPass(createPatmosIndirectCallRegUsagePass());
+
       addPass(createPatmosStackCachePromotionPass(getPatmosTargetMachine()));
 
+      if (EnableLoopBaseSharing && getOptLevel() != CodeGenOpt::None) {
+        addPass(createPatmosLoopBaseSharingPass(getPatmosTargetMachine()));
+      }
+
+      if (EnableLatchCompareHoisting && getOptLevel() != CodeGenOpt::None) {
+        addPass(createPatmosLatchCompareHoistingPass(getPatmosTargetMachine()));
+      }
+
       // For -O0, add a pass that removes dead instructions to avoid issues
       // with spill code in naked functions containing function calls with
       // unused return values.
@@ -157,6 +433,11 @@ namespace {
         addPass(&DeadMachineInstructionElimID);
       }
 
+      // Pipeline loops before the single-path passes look at the loop bounds.
+      if (EnablePipeliner && getOptLevel() >= CodeGenOpt::Default) {
+        addPass(&MachinePipelinerID);
+      }
+
       if (PatmosSinglePathInfo::isConstant()) {
         addPass(createDataCacheAccessEliminationPass(getPatmosTargetMachine()));
       }
@@ -167,7 +448,6 @@ namespace {
         	addPass(createPatmosSPPreparePass(getPatmosTargetMachine()));
         }
         if (PatmosSinglePathInfo::isConstant()) {
-          addPass(createPatmosConstantLoopDominatorsPass());
           addPass(createMemoryAccessNormalizationPass(getPatmosTargetMachine()));
         }
         if(PatmosSinglePathInfo::useNewSinglePathTransform()) {
@@ -200,9 +480,11 @@ namespace {
 			// Assign predicates to instructions and initialize predicate definitions
         	addPass(createPreRegallocReduce(getPatmosTargetMachine()));
 
+			// Merge equal predicate definitions inserted for different scopes
+			addPass(createSinglePathPredicateGVN(getPatmosTargetMachine()));
+
 			addPass(createPatmosSinglePathInfoPass(getPatmosTargetMachine()));
 			if (PatmosSinglePathInfo::isConstant()) {
-			  addPass(createPatmosConstantLoopDominatorsPass());
 			  addPass(createOppositePredicateCompensationPass(getPatmosTargetMachine()));
 			}
 
@@ -242,6 +524,9 @@ namespace {
 				// were not coalesced.
 				addPass(&MachineCopyPropagationID);
 
+				// Remove the guarded copies the copy propagation does not handle.
+				addPass(createSinglePathCopyElimination(getPatmosTargetMachine()));
+
 				// Run post-ra machine LICM to hoist reloads / remats.
 				//
 				// FIXME: can this move into MachineLateOptimization?
@@ -249,6 +534,21 @@ namespace {
 			}
 			// End of copy from TargetPassConfig::addOptimizedRegAlloc()
 			///////////////
+		} else if (EnablePredicateSpillPacking &&
+		           getOptLevel() != CodeGenOpt::None) {
+			addPass(createPatmosPredicateSpillPackingPass(getPatmosTargetMachine()));
+		}
+
+		// The frame layout places the objects accessed most frequently on the
+		// worst-case path on the stack cache.
+		if (!WCETProfile.empty() && getOptLevel() != CodeGenOpt::None) {
+			addPass(createPatmosCriticalityImportPass(WCETProfile));
+		}
+
+		// Budget the stack cache of the whole program, once the spill slots of
+		// all functions are known.
+		if (EnableStackCacheBudget && getOptLevel() != CodeGenOpt::None) {
+			addPass(createPatmosStackCacheBudgetPass(getPatmosTargetMachine()));
 		}
 	}
 
@@ -262,7 +562,6 @@ namespace {
         if(!PatmosSinglePathInfo::useNewSinglePathTransform()) {
         	addPass(createPatmosSinglePathInfoPass(getPatmosTargetMachine()));
             if (PatmosSinglePathInfo::isConstant()) {
-              addPass(createPatmosConstantLoopDominatorsPass());
               addPass(createOppositePredicateCompensationPass(getPatmosTargetMachine()));
             }
 			addPass(createPatmosSPBundlingPass(getPatmosTargetMachine()));
@@ -270,12 +569,50 @@ namespace {
         }
         addPass(createSPSchedulerPass(getPatmosTargetMachine()));
       } else {
+        if (!WCETProfile.empty() && getOptLevel() != CodeGenOpt::None) {
+          addPass(createPatmosCriticalityImportPass(WCETProfile));
+        }
+        if (getOptLevel() != CodeGenOpt::None) {
+          // Predicate hot loop bodies first, the if-converter handles the
+          // remaining branches
+          addPass(createPatmosHyperblockFormationPass(getPatmosTargetMachine()));
+        }
         if (getOptLevel() != CodeGenOpt::None && !DisableIfConverter) {
           addPass(&IfConverterID);
           // If-converter might create unreachable blocks (bug?), need to be
           // removed before function splitter
           addPass(&UnreachableMachineBlockElimID);
         }
+        if (getOptLevel() != CodeGenOpt::None) {
+          // Guard the likely successors' leading code above the branches the
+          // if-converter left.
+          addPass(createPatmosGuardedSpeculationPass(getPatmosTargetMachine()));
+        }
+        // Outline before the stack cache passes see the calls, and before
+        // delay slots and subfunctions are formed.
+        if (EnableOutliner && getOptLevel() != CodeGenOpt::None) {
+          addPass(createMachineOutlinerPass(false));
+        }
+        // Place the blocks before bundles and delay slots are formed, the
+        // generic block placement is disabled below.
+        if (getOptLevel() != CodeGenOpt::None) {
+          addPass(createPatmosBlockPlacementPass(getPatmosTargetMachine()));
+          // Needs the final layout to see which branches remain.
+          addPass(createPatmosTailDuplicationPass(getPatmosTargetMachine()));
+        }
+      }
+
+      if (EnableStackCacheMerging) {
+        addPass(createPatmosStackCacheMergingPass(getPatmosTargetMachine()));
+      }
+
+      // after merging, merged functions no longer reserve their frames
+      if (EnableLeafEnsureRemoval && getOptLevel() != CodeGenOpt::None) {
+        addPass(createPatmosStackCacheLeavesPass(getPatmosTargetMachine()));
+      }
+
+      if (EnableEnsurePlacement && getOptLevel() != CodeGenOpt::None) {
+        addPass(createPatmosEnsurePlacementPass(getPatmosTargetMachine()));
       }
 
       // this is pseudo pass that may hold results from SC analysis
@@ -284,6 +621,23 @@ namespace {
 
       if (EnableStackCacheAnalysis) {
         addPass(createPatmosStackCacheAnalysis(getPatmosTargetMachine()));
+
+        // merged callees access the frames of their callers without ensures
+        if (EnableStackCacheSpilling && !EnableStackCacheMerging &&
+            getOptLevel() != CodeGenOpt::None) {
+          addPass(createPatmosStackCacheSpillingPass(
+                                                   getPatmosTargetMachine()));
+        }
+      }
+
+      // this is pseudo pass that may hold results from the data cache
+      // analysis (for the scheduler and the PML export)
+      addPass(createPatmosDataCacheAnalysisInfo(getPatmosTargetMachine()));
+
+      // classify the loads for the scheduler, the classification is
+      // repeated below for the final code
+      if (EnableDataCacheAnalysis) {
+        addPass(createPatmosDataCacheAnalysis(getPatmosTargetMachine()));
       }
     }
 
@@ -291,7 +645,8 @@ namespace {
       // We leave this function empty to avoid LLVM's default
       // probabilistic block placement pass, as it seems to
       // mess with terminating instructions on some blocks,
-      // resulting in invalid branch targets.
+      // resulting in invalid branch targets. PatmosBlockPlacement
+      // runs in addPreSched2 instead.
     }
 
     /// addPreEmitPass - This pass may be implemented by targets that want to run
@@ -309,14 +664,49 @@ namespace {
       // All passes below this line must handle delay slots and bundles
       // correctly.
 
+      addPass(createPatmosSledsPass(getPatmosTargetMachine(), false));
+
       if (getPatmosSubtarget().hasMethodCache()) {
+        // the if-converter merged and removed blocks since the first import
+        if (!WCETProfile.empty() && getOptLevel() != CodeGenOpt::None) {
+          addPass(createPatmosCriticalityImportPass(WCETProfile));
+        }
         addPass(createPatmosFunctionSplitterPass(getPatmosTargetMachine()));
       }
 
       addPass(createPatmosDelaySlotKillerPass(getPatmosTargetMachine()));
 
+      // Removes cycles, alignment is re-established below.
+      if (EnableBundlePeephole && getOptLevel() != CodeGenOpt::None) {
+        addPass(createPatmosBundlePeepholePass(getPatmosTargetMachine()));
+      }
+
+      if (getPatmosSubtarget().hasMethodCache()) {
+        addPass(createPatmosSledsPass(getPatmosTargetMachine(), true));
+      }
+
       addPass(createPatmosEnsureAlignmentPass(getPatmosTargetMachine()));
 
+      if (EnableMethodCacheLayout) {
+        addPass(createPatmosMethodCacheLayoutPass(getPatmosTargetMachine()));
+      }
+
+      if (EnableCallGraphProfile) {
+        addPass(createPatmosCallGraphProfilePass());
+      }
+
+      // this is pseudo pass that may hold results from the method cache
+      // analysis (currently for PML export)
+      addPass(createPatmosMethodCacheAnalysisInfo(getPatmosTargetMachine()));
+
+      if (EnableMethodCacheAnalysis) {
+        addPass(createPatmosMethodCacheAnalysis(getPatmosTargetMachine()));
+      }
+
+      if (EnableDataCacheAnalysis) {
+        addPass(createPatmosDataCacheAnalysis(getPatmosTargetMachine()));
+      }
+
       // Serialize machine code
       if (!SerializeMachineCode.empty()) {
         std::string empty("");
@@ -362,7 +752,24 @@ PatmosTargetMachine::PatmosTargetMachine(const Target &T,
   initAsmInfo();
 }
 
+bool PatmosTargetMachine::useIPRA() const {
+  return EnableIPRA;
+}
+
 TargetPassConfig *PatmosTargetMachine::createPassConfig(PassManagerBase &PM) {
   return new PatmosPassConfig(*this, PM);
 }
 
+TargetTransformInfo
+PatmosTargetMachine::getTargetTransformInfo(const Function &F) {
+  return TargetTransformInfo(PatmosTTIImpl(this, F));
+}
+
+void PatmosTargetMachine::adjustPassManager(PassManagerBuilder &PMB) {
+  // Unroll loops using their loop bounds, the generic unroller does not know
+  // about the bounds and cannot clone the llvm.loop.bound calls.
+  PMB.addExtension(PassManagerBuilder::EP_LoopOptimizerEnd,
+      [](const PassManagerBuilder &, legacy::PassManagerBase &PM) {
+        PM.add(createPatmosLoopBoundUnrollPass());
+      });
+}
@@ -21,6 +21,7 @@
 #include "PatmosSelectionDAGInfo.h"
 #include "PatmosRegisterInfo.h"
 #include "PatmosSubtarget.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/Target/TargetMachine.h"
 
@@ -65,9 +66,21 @@ public:
     return true;
   }
 
+  /// useIPRA - Return true if the interprocedural register allocation is
+  /// enabled with -mpatmos-enable-ipra.
+  bool useIPRA() const override;
+
   /// createPassConfig - Create a pass configuration object to be used by
   /// addPassToEmitX methods for generating a pipeline of CodeGen passes.
   TargetPassConfig *createPassConfig(PassManagerBase &PM) override;
+
+  /// getTargetTransformInfo - Return the Patmos specific TTI, which makes the
+  /// inliner aware of the stack cache and the method cache.
+  TargetTransformInfo getTargetTransformInfo(const Function &F) override;
+
+  /// adjustPassManager - Add the Patmos specific bitcode optimizations to the
+  /// standard optimization pipeline.
+  void adjustPassManager(PassManagerBuilder &PMB) override;
 }; // PatmosTargetMachine.
 
 } // end namespace llvm
@@ -0,0 +1,457 @@
+//===-- PatmosTargetTransformInfo.cpp - Patmos specific TTI ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Keeping a call costs a bounded number of cycles on Patmos: the callee
+// reserves its own stack cache frame, and the caller ensures its frame after
+// the call, filling at most the part of it that was spilled. The method cache
+// loads the callee and reloads the caller at most once if they fit.
+// Inlining instead merges the frames, so the sres of a caller can exceed the
+// stack cache and spill on every call of the caller, and it grows the code of
+// the caller, which may then no longer fit into the method cache.
+//
+// In single-path code a call is more expensive: it is predicated and executed
+// on every path, also on the inactive ones, and needs the return information
+// and the stack cache handling of the single-path transformation. Calls in
+// single-path roots therefore get a higher inlining threshold, as long as the
+// root keeps fitting into the method cache.
+//
+// The frame sizes are estimated by PatmosFrameLowering, the code size is
+// estimated from the number of instructions.
+//
+// The instruction costs describe the sequences the operations are lowered to.
+// Independent ALU operations of such sequences can be issued in pairs, so in
+// terms of throughput they cost half an instruction each. Additions and
+// subtractions of <4 x i8> and <2 x i16> vectors are computed in words with
+// masked carries, see PatmosTargetLowering::combineSWAR, other operations on
+// them are scalarized.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosTargetTransformInfo.h"
+#include "SinglePath/PatmosSinglePathInfo.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmostti"
+
+STATISTIC(StackCacheInlineRejects,
+          "Calls not inlined as the frames would exceed the stack cache");
+STATISTIC(MethodCacheInlineRejects,
+          "Calls not inlined as the code would exceed the method cache");
+STATISTIC(SinglePathInlineBonuses,
+          "Calls in single-path roots given a higher inlining threshold");
+
+/// DisableCacheAwareInlining - Option to disable the stack cache and method
+/// cache limits of the inliner.
+static cl::opt<bool> DisableCacheAwareInlining(
+  "mpatmos-disable-cache-aware-inlining",
+  cl::init(false),
+  cl::desc("Do not limit inlining by the Patmos stack and method cache sizes."),
+  cl::Hidden);
+
+/// SinglePathInlineBonus - Option to set the threshold bonus of calls in
+/// single-path roots.
+static cl::opt<unsigned> SinglePathInlineBonus(
+  "mpatmos-singlepath-inline-bonus",
+  cl::init(400),
+  cl::desc("Inlining threshold bonus of calls in single-path roots, which "
+           "are executed on all paths (default: 400)."),
+  cl::Hidden);
+
+/// exceeds - Check whether A and B fit into a cache of the given size, but
+/// their sum does not.
+static bool exceeds(unsigned A, unsigned B, unsigned Size)
+{
+  return A <= Size && B <= Size && A + B > Size;
+}
+
+bool PatmosTTIImpl::areInlineCompatible(const Function *Caller,
+                                        const Function *Callee) const
+{
+  if (!BaseT::areInlineCompatible(Caller, Callee))
+    return false;
+
+  if (DisableCacheAwareInlining)
+    return true;
+
+  const PatmosFrameLowering *PFL = getFrameLowering();
+  unsigned CallerFrame = PFL->estimateStackCacheFrameSize(*Caller);
+  unsigned CalleeFrame = PFL->estimateStackCacheFrameSize(*Callee);
+  if (exceeds(CallerFrame, CalleeFrame, PFL->getEffectiveStackCacheSize())) {
+    LLVM_DEBUG(dbgs() << "Patmos TTI: not inlining " << Callee->getName()
+                      << " into " << Caller->getName() << ", stack frames of "
+                      << CallerFrame << " and " << CalleeFrame
+                      << " bytes exceed the stack cache\n");
+    StackCacheInlineRejects++;
+    return false;
+  }
+
+  if (ST->hasMethodCache()) {
+    unsigned CallerSize = Caller->getInstructionCount() * 4;
+    unsigned CalleeSize = Callee->getInstructionCount() * 4;
+    if (exceeds(CallerSize, CalleeSize, ST->getMethodCacheSize())) {
+      LLVM_DEBUG(dbgs() << "Patmos TTI: not inlining " << Callee->getName()
+                        << " into " << Caller->getName() << ", code of "
+                        << CallerSize << " and " << CalleeSize
+                        << " bytes exceeds the method cache\n");
+      MethodCacheInlineRejects++;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+unsigned PatmosTTIImpl::adjustInliningThreshold(const CallBase *CB) const
+{
+  const Function *Caller = CB->getCaller();
+  const Function *Callee = CB->getCalledFunction();
+  if (!Callee || !PatmosSinglePathInfo::isRoot(*Caller))
+    return 0;
+
+  // Only grow the root as long as it fits into the method cache, a root that
+  // does not fit gets no bonus.
+  if (ST->hasMethodCache() && !DisableCacheAwareInlining) {
+    unsigned CallerSize = Caller->getInstructionCount() * 4;
+    unsigned CalleeSize = Callee->getInstructionCount() * 4;
+    if (CallerSize + CalleeSize > ST->getMethodCacheSize())
+      return 0;
+  }
+
+  LLVM_DEBUG(dbgs() << "Patmos TTI: single-path inlining bonus for "
+                    << Callee->getName() << " in " << Caller->getName()
+                    << "\n");
+  SinglePathInlineBonuses++;
+  return SinglePathInlineBonus;
+}
+
+unsigned PatmosTTIImpl::getNumberOfRegisters(unsigned ClassID) const
+{
+  switch (ClassID) {
+  case GPRClass:  return 28;
+  case PredClass: return 7;
+  // vectors are computed in the general purpose registers
+  case VectorClass: return isSWARType(nullptr) ? 28 : 0;
+  default:        return 0;
+  }
+}
+
+unsigned PatmosTTIImpl::getRegisterBitWidth(bool Vector) const
+{
+  if (Vector)
+    return isSWARType(nullptr) ? 32 : 0;
+  return 32;
+}
+
+unsigned PatmosTTIImpl::getCacheLineSize() const
+{
+  return ST->getDataCacheBlockSize();
+}
+
+Optional<unsigned>
+PatmosTTIImpl::getCacheSize(TTI::CacheLevel Level) const
+{
+  if (Level != TTI::CacheLevel::L1D || !ST->getDataCacheSize())
+    return None;
+  return ST->getDataCacheSize();
+}
+
+Optional<unsigned>
+PatmosTTIImpl::getCacheAssociativity(TTI::CacheLevel Level) const
+{
+  if (Level != TTI::CacheLevel::L1D || !ST->getDataCacheSize())
+    return None;
+  return ST->getDataCacheAssociativity();
+}
+
+bool PatmosTTIImpl::isSWARType(Type *Ty) const
+{
+  // Without a type, check whether SWAR is enabled at all.
+  if (!Ty)
+    return TLI->isSWARType(MVT::v4i8);
+  EVT VT = TLI->getValueType(DL, Ty, true);
+  return VT.isSimple() && TLI->isSWARType(VT);
+}
+
+unsigned PatmosTTIImpl::getRegisterClassForType(bool Vector, Type *Ty) const
+{
+  if (Vector)
+    return VectorClass;
+  return Ty && Ty->isIntegerTy(1) ? PredClass : GPRClass;
+}
+
+const char *PatmosTTIImpl::getRegisterClassName(unsigned ClassID) const
+{
+  switch (ClassID) {
+  case GPRClass:  return "Patmos::RRegs";
+  case PredClass: return "Patmos::PRegs";
+  default:        return "Patmos::Vector";
+  }
+}
+
+/// getSequenceCost - Return the cost of a sequence of Ops instructions with
+/// the given latency in cycles, which is dual-issued where possible.
+static unsigned getSequenceCost(TargetTransformInfo::TargetCostKind CostKind,
+                                unsigned Ops, unsigned Latency)
+{
+  switch (CostKind) {
+  case TargetTransformInfo::TCK_RecipThroughput: return (Ops + 1) / 2;
+  case TargetTransformInfo::TCK_Latency:         return Latency;
+  default:                       return Ops;
+  }
+}
+
+unsigned PatmosTTIImpl::getArithmeticInstrCost(
+    unsigned Opcode, Type *Ty, TTI::TargetCostKind CostKind,
+    TTI::OperandValueKind Opd1Info, TTI::OperandValueKind Opd2Info,
+    TTI::OperandValueProperties Opd1PropInfo,
+    TTI::OperandValueProperties Opd2PropInfo, ArrayRef<const Value *> Args,
+    const Instruction *CxtI)
+{
+  if (isSWARType(Ty)) {
+    switch (Opcode) {
+    case Instruction::Add: return getSequenceCost(CostKind, 6, 3);
+    case Instruction::Sub: return getSequenceCost(CostKind, 7, 4);
+    case Instruction::And:
+    case Instruction::Or:
+    case Instruction::Xor: return getSequenceCost(CostKind, 1, 1);
+    case Instruction::Shl:
+    case Instruction::LShr:
+      // shifts of all lanes by the same constant, followed by a mask
+      if (Opd2Info == TTI::OK_UniformConstantValue)
+        return getSequenceCost(CostKind, 2, 2);
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Smaller types are promoted, larger ones are split by the base class.
+  if (Ty->isIntegerTy() && Ty->getIntegerBitWidth() <= 32) {
+    switch (Opcode) {
+    case Instruction::Mul:
+      // The result is moved from sl once the multiplier is done.
+      return getSequenceCost(CostKind, 2, 4);
+
+    case Instruction::SDiv:
+    case Instruction::UDiv:
+    case Instruction::SRem:
+    case Instruction::URem:
+      if (Opd2Info == TTI::OK_UniformConstantValue ||
+          Opd2Info == TTI::OK_NonUniformConstantValue) {
+        // Shifts, or a multiplication with the reciprocal.
+        if (Opd2PropInfo == TTI::OP_PowerOf2)
+          return getSequenceCost(CostKind, 3, 3);
+        return getSequenceCost(CostKind, 6, 7);
+      }
+
+      // A restoring division, 32 steps of 5 operations, either inline or in
+      // the runtime library.
+      if (TLI->getOperationAction(ISD::UDIV, MVT::i32) ==
+          TargetLowering::Custom)
+        return getSequenceCost(CostKind, 32 * 5, 32 * 3);
+      if (CostKind == TTI::TCK_CodeSize || CostKind == TTI::TCK_SizeAndLatency)
+        return 4;
+      return 32 * 3 + 10;
+    }
+  }
+
+  return BaseT::getArithmeticInstrCost(Opcode, Ty, CostKind, Opd1Info,
+                                       Opd2Info, Opd1PropInfo, Opd2PropInfo,
+                                       Args, CxtI);
+}
+
+unsigned PatmosTTIImpl::getMemoryOpCost(unsigned Opcode, Type *Src,
+                                        MaybeAlign Alignment,
+                                        unsigned AddressSpace,
+                                        TTI::TargetCostKind CostKind,
+                                        const Instruction *I)
+{
+  if (isSWARType(Src) && Alignment && *Alignment >= Align(4))
+    return 1;
+  return BaseT::getMemoryOpCost(Opcode, Src, Alignment, AddressSpace, CostKind,
+                                I);
+}
+
+unsigned PatmosTTIImpl::getShuffleCost(TTI::ShuffleKind Kind, VectorType *Tp,
+                                       int Index, VectorType *SubTp)
+{
+  // At most a shift, an and and an or for each lane.
+  if (isSWARType(Tp)) {
+    unsigned Lanes = cast<FixedVectorType>(Tp)->getNumElements();
+    return getSequenceCost(TTI::TCK_RecipThroughput, 3 * Lanes, 3);
+  }
+  return BaseT::getShuffleCost(Kind, Tp, Index, SubTp);
+}
+
+unsigned PatmosTTIImpl::getVectorInstrCost(unsigned Opcode, Type *Val,
+                                           unsigned Index)
+{
+  if (isSWARType(Val) && Index != -1U) {
+    // A shift, or an and, a shift and an or.
+    if (Opcode == Instruction::ExtractElement)
+      return 1;
+    if (Opcode == Instruction::InsertElement)
+      return 2;
+  }
+  return BaseT::getVectorInstrCost(Opcode, Val, Index);
+}
+
+unsigned PatmosTTIImpl::getCmpSelInstrCost(unsigned Opcode, Type *ValTy,
+                                           Type *CondTy,
+                                           CmpInst::Predicate VecPred,
+                                           TTI::TargetCostKind CostKind,
+                                           const Instruction *I)
+{
+  // The mask of the lanes that differ, see getSWARLaneMask, and two ands and
+  // an or to select. The compare is folded into the select.
+  if (isSWARType(ValTy) &&
+      (VecPred == CmpInst::ICMP_EQ || VecPred == CmpInst::ICMP_NE)) {
+    if (Opcode == Instruction::Select)
+      return getSequenceCost(CostKind, 10, 7);
+    if (Opcode == Instruction::ICmp && I && I->hasOneUse() &&
+        isa<SelectInst>(*I->user_begin()))
+      return 0;
+  }
+  return BaseT::getCmpSelInstrCost(Opcode, ValTy, CondTy, VecPred, CostKind,
+                                   I);
+}
+
+/// isShortImm - Check whether a constant fits the immediate of an ALUi
+/// instruction, or of li.
+static bool isShortImm(int64_t Value)
+{
+  return isUInt<12>(Value) || isUInt<12>(-Value);
+}
+
+int PatmosTTIImpl::getIntImmCost(const APInt &Imm, Type *Ty,
+                                 TTI::TargetCostKind CostKind)
+{
+  assert(Ty->isIntegerTy());
+  unsigned Bits = Ty->getPrimitiveSizeInBits();
+  if (Bits == 0 || Bits > 64)
+    return TTI::TCC_Basic;
+
+  // A li with a short immediate takes one issue slot, with a long one both
+  // slots of the bundle. 64-bit constants are loaded word by word.
+  APInt Val = Imm.sextOrTrunc(64);
+  int Cost = 0;
+  for (unsigned Word = 0; Word * 32 < Bits; Word++) {
+    int64_t W = (int32_t)Val.extractBitsAsZExtValue(32, Word * 32);
+    Cost += isShortImm(W) ? TTI::TCC_Basic : 2 * TTI::TCC_Basic;
+  }
+  return Cost;
+}
+
+int PatmosTTIImpl::getIntImmCostInst(unsigned Opcode, unsigned Idx,
+                                     const APInt &Imm, Type *Ty,
+                                     TTI::TargetCostKind CostKind,
+                                     Instruction *Inst)
+{
+  assert(Ty->isIntegerTy());
+  if (Ty->getPrimitiveSizeInBits() > 32)
+    return getIntImmCost(Imm, Ty, CostKind);
+
+  int64_t Value = Imm.getSExtValue();
+  uint32_t Bits = Imm.getZExtValue();
+  switch (Opcode) {
+  case Instruction::Sub:
+    if (Idx != 1)
+      return getIntImmCost(Imm, Ty, CostKind);
+    LLVM_FALLTHROUGH;
+  case Instruction::Add:
+  case Instruction::Xor:
+    // Short immediates are encoded in ALUi instructions. Long immediates
+    // occupy the second issue slot, for every use.
+    return isShortImm(Value) ? (int)TTI::TCC_Free : 2 * TTI::TCC_Basic;
+  case Instruction::And:
+    if (isShortImm(Value) || isPowerOf2_32(~Bits))
+      return TTI::TCC_Free;
+    return 2 * TTI::TCC_Basic;
+  case Instruction::Or:
+    if (isShortImm(Value) || isPowerOf2_32(Bits))
+      return TTI::TCC_Free;
+    return 2 * TTI::TCC_Basic;
+  case Instruction::Shl:
+  case Instruction::LShr:
+  case Instruction::AShr:
+    // shift amounts always fit
+    if (Idx == 1)
+      return TTI::TCC_Free;
+    return getIntImmCost(Imm, Ty, CostKind);
+  case Instruction::ICmp:
+    if (Idx == 1 && isUInt<5>(Bits))
+      return TTI::TCC_Free;
+    return getIntImmCost(Imm, Ty, CostKind);
+  case Instruction::Mul:
+  case Instruction::Store:
+  case Instruction::Select:
+    return getIntImmCost(Imm, Ty, CostKind);
+  default:
+    return TTI::TCC_Free;
+  }
+}
+
+unsigned PatmosTTIImpl::getIntrinsicInstrCost(const IntrinsicCostAttributes &ICA,
+                                              TTI::TargetCostKind CostKind)
+{
+  if (ICA.getReturnType()->isIntegerTy(32)) {
+    // See PatmosTargetLowering::LowerCTPOP and LowerCTLZ, CTTZ is based on
+    // CTPOP.
+    switch (ICA.getID()) {
+    case Intrinsic::ctpop: return getSequenceCost(CostKind, 16, 12);
+    case Intrinsic::ctlz:  return getSequenceCost(CostKind, 22, 12);
+    case Intrinsic::cttz:  return getSequenceCost(CostKind, 19, 14);
+    default:               break;
+    }
+  }
+
+  return BaseT::getIntrinsicInstrCost(ICA, CostKind);
+}
+
+unsigned PatmosTTIImpl::getCFInstrCost(unsigned Opcode,
+                                       TTI::TargetCostKind CostKind)
+{
+  // A taken branch costs up to 2 cycles for its delay slots, predicated code
+  // does not.
+  if (Opcode == Instruction::Br && (CostKind == TTI::TCK_RecipThroughput ||
+                                    CostKind == TTI::TCK_Latency))
+    return 3;
+
+  return BaseT::getCFInstrCost(Opcode, CostKind);
+}
+
+void PatmosTTIImpl::getUnrollingPreferences(Loop *L, ScalarEvolution &SE,
+                                            TTI::UnrollingPreferences &UP)
+{
+  BaseT::getUnrollingPreferences(L, SE, UP);
+
+  // Partial unrolling gives the scheduler independent operations for the
+  // second issue slot.
+  UP.Partial = true;
+
+  // Runtime unrolling creates remainder loops, which have no loop bounds for
+  // the WCET analysis.
+  UP.Runtime = false;
+
+  // A loop should take at most a quarter of the method cache once unrolled,
+  // so that it still fits together with its surrounding code.
+  if (ST->hasMethodCache()) {
+    unsigned Limit = ST->getMethodCacheSize() / 4 / 4;
+    UP.Threshold = std::min(UP.Threshold, Limit);
+    UP.PartialThreshold = std::min(UP.PartialThreshold, Limit);
+  }
+}
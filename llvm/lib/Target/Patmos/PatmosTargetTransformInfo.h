@@ -0,0 +1,151 @@
+//===-- PatmosTargetTransformInfo.h - Patmos specific TTI -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the Patmos specific TargetTransformInfo implementation.
+// It lets the inliner take the stack cache and the method cache into account,
+// and describes the costs of instructions lowered to libcalls or longer
+// sequences, branches, unrolling and the register files of Patmos.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOS_TARGETTRANSFORMINFO_H_
+#define _LLVM_TARGET_PATMOS_TARGETTRANSFORMINFO_H_
+
+#include "Patmos.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/CodeGen/BasicTTIImpl.h"
+
+namespace llvm {
+
+class PatmosTTIImpl : public BasicTTIImplBase<PatmosTTIImpl> {
+  typedef BasicTTIImplBase<PatmosTTIImpl> BaseT;
+  typedef TargetTransformInfo TTI;
+  friend BaseT;
+
+  const PatmosSubtarget *ST;
+  const PatmosTargetLowering *TLI;
+
+  const PatmosSubtarget *getST() const { return ST; }
+  const PatmosTargetLowering *getTLI() const { return TLI; }
+
+  /// getFrameLowering - Return the frame lowering providing the stack cache
+  /// frame size estimates.
+  const PatmosFrameLowering *getFrameLowering() const {
+    return static_cast<const PatmosFrameLowering*>(ST->getFrameLowering());
+  }
+
+public:
+  explicit PatmosTTIImpl(const PatmosTargetMachine *TM, const Function &F)
+    : BaseT(TM, F.getParent()->getDataLayout()), ST(TM->getSubtargetImpl(F)),
+      TLI(ST->getTargetLowering()) {}
+
+  /// areInlineCompatible - Reject inlining a callee if the stack cache frame
+  /// or the code of the caller fit into the respective cache, but would no
+  /// longer fit after inlining.
+  bool areInlineCompatible(const Function *Caller,
+                           const Function *Callee) const;
+
+  /// adjustInliningThreshold - Raise the threshold of calls in single-path
+  /// roots, which are executed on all paths, while the root keeps fitting into
+  /// the method cache.
+  unsigned adjustInliningThreshold(const CallBase *CB) const;
+
+  /// \name Register files
+  /// There are 32 general purpose registers, of which r0 and the stack,
+  /// frame and temp registers are reserved, and 8 predicates, of which p0 is
+  /// always true. There are no vector registers, but <4 x i8> and <2 x i16>
+  /// vectors are computed in general purpose registers (SWAR).
+  /// @{
+  enum PatmosRegisterClass { GPRClass, VectorClass, PredClass };
+
+  unsigned getNumberOfRegisters(unsigned ClassID) const;
+  unsigned getRegisterClassForType(bool Vector, Type *Ty = nullptr) const;
+  const char *getRegisterClassName(unsigned ClassID) const;
+  unsigned getRegisterBitWidth(bool Vector) const;
+  /// @}
+
+  /// \name Data cache
+  /// The data cache of the subtarget is the only data cache level, e.g., for
+  /// the tile sizes of Polly. The scratchpads are not reported.
+  /// @{
+  unsigned getCacheLineSize() const;
+  Optional<unsigned> getCacheSize(TTI::CacheLevel Level) const;
+  Optional<unsigned> getCacheAssociativity(TTI::CacheLevel Level) const;
+  /// @}
+
+  /// isSWARType - Check whether the type is a vector computed in a word.
+  bool isSWARType(Type *Ty) const;
+
+  /// getArithmeticInstrCost - Account for multiplications, which need to move
+  /// their result from a special register, for divisions, which are library
+  /// calls or long inline sequences, and for vectors computed in words.
+  unsigned getArithmeticInstrCost(
+      unsigned Opcode, Type *Ty,
+      TTI::TargetCostKind CostKind = TTI::TCK_RecipThroughput,
+      TTI::OperandValueKind Opd1Info = TTI::OK_AnyValue,
+      TTI::OperandValueKind Opd2Info = TTI::OK_AnyValue,
+      TTI::OperandValueProperties Opd1PropInfo = TTI::OP_None,
+      TTI::OperandValueProperties Opd2PropInfo = TTI::OP_None,
+      ArrayRef<const Value *> Args = ArrayRef<const Value *>(),
+      const Instruction *CxtI = nullptr);
+
+  /// getMemoryOpCost - Vectors computed in words are loaded and stored as
+  /// words if they are aligned.
+  unsigned getMemoryOpCost(unsigned Opcode, Type *Src, MaybeAlign Alignment,
+                           unsigned AddressSpace, TTI::TargetCostKind CostKind,
+                           const Instruction *I = nullptr);
+
+  /// getShuffleCost - Shuffles of vectors in words shift, mask and combine
+  /// their lanes.
+  unsigned getShuffleCost(TTI::ShuffleKind Kind, VectorType *Tp, int Index,
+                          VectorType *SubTp);
+
+  /// getVectorInstrCost - Lanes of vectors in words are extracted by shifts
+  /// and inserted by masks.
+  unsigned getVectorInstrCost(unsigned Opcode, Type *Val, unsigned Index);
+
+  /// getCmpSelInstrCost - Selects between vectors in words based on equality
+  /// are computed by masks.
+  unsigned getCmpSelInstrCost(unsigned Opcode, Type *ValTy, Type *CondTy,
+                              CmpInst::Predicate VecPred,
+                              TTI::TargetCostKind CostKind,
+                              const Instruction *I = nullptr);
+
+  /// \name Immediates
+  /// Constants that do not fit the short immediates of ALUi instructions are
+  /// folded as long immediates, which take both issue slots of a bundle.
+  /// Constant hoisting thus hoists those used repeatedly into registers, see
+  /// also PatmosDAGToDAGISel::PreprocessISelDAG.
+  /// @{
+  int getIntImmCost(const APInt &Imm, Type *Ty, TTI::TargetCostKind CostKind);
+  int getIntImmCostInst(unsigned Opcode, unsigned Idx, const APInt &Imm,
+                        Type *Ty, TTI::TargetCostKind CostKind,
+                        Instruction *Inst = nullptr);
+  /// @}
+
+  /// getIntrinsicInstrCost - Account for the bit counting intrinsics, which
+  /// are expanded to branchless sequences.
+  unsigned getIntrinsicInstrCost(const IntrinsicCostAttributes &ICA,
+                                 TTI::TargetCostKind CostKind);
+
+  /// getCFInstrCost - Branches that are taken stall the pipeline unless
+  /// their delay slots can be filled.
+  unsigned getCFInstrCost(unsigned Opcode, TTI::TargetCostKind CostKind);
+
+  /// getUnrollingPreferences - Keep unrolled loops within the method cache
+  /// and never create remainder loops, which would lack a loop bound.
+  void getUnrollingPreferences(Loop *L, ScalarEvolution &SE,
+                               TTI::UnrollingPreferences &UP);
+};
+
+} // end namespace llvm
+
+#endif // _LLVM_TARGET_PATMOS_TARGETTRANSFORMINFO_H_
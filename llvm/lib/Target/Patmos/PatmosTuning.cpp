@@ -0,0 +1,100 @@
+//===-- PatmosTuning.cpp - Per-function tuning of backend parameters. -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Read the tuning database, see PatmosTuning.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosTuning.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+/// TuningDatabase - Option to read the parameters of functions from a file.
+static cl::opt<std::string> TuningDatabase(
+  "mpatmos-tuning-db",
+  cl::desc("Read the backend parameters of individual functions from the "
+           "given tuning database, as written by patmos-autotune."),
+  cl::Hidden);
+
+namespace {
+  /// The parameters of each function, by function and parameter name.
+  typedef StringMap<StringMap<unsigned> > tuning_db;
+
+  /// readTuningDatabase - Read the database given on the command line.
+  /// Malformed lines are ignored.
+  void readTuningDatabase(StringRef Filename, tuning_db &DB)
+  {
+    ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer =
+                                                MemoryBuffer::getFile(Filename);
+    if (std::error_code EC = Buffer.getError())
+      report_fatal_error("Failed to read tuning database '" + Filename +
+                         "': " + EC.message());
+
+    StringRef Text((*Buffer)->getBuffer());
+    while (!Text.empty()) {
+      StringRef Line;
+      std::tie(Line, Text) = Text.split('\n');
+      Line = Line.trim();
+      if (Line.empty() || Line.startswith("#"))
+        continue;
+
+      SmallVector<StringRef, 8> Fields;
+      Line.split(Fields, ' ', -1, false);
+
+      StringMap<unsigned> &Parameters = DB[Fields[0]];
+      for (unsigned i = 1, e = Fields.size(); i < e; i++) {
+        StringRef Name, Value;
+        std::tie(Name, Value) = Fields[i].split('=');
+        unsigned V;
+        if (Name.empty() || Value.getAsInteger(10, V)) {
+          errs() << "Warning: Invalid parameter in tuning database: "
+                 << Fields[i] << ".\n";
+          continue;
+        }
+        Parameters[Name] = V;
+      }
+    }
+  }
+
+  const tuning_db &getTuningDatabase()
+  {
+    static const tuning_db DB = []() {
+      tuning_db Result;
+      if (!TuningDatabase.empty())
+        readTuningDatabase(TuningDatabase, Result);
+      return Result;
+    }();
+    return DB;
+  }
+}
+
+unsigned llvm::getTuningParameter(const Function &F, StringRef Name,
+                                  unsigned Default)
+{
+  if (TuningDatabase.empty())
+    return Default;
+
+  const tuning_db &DB = getTuningDatabase();
+  for (StringRef Key : { F.getName(), StringRef("*") }) {
+    tuning_db::const_iterator Fn = DB.find(Key);
+    if (Fn == DB.end())
+      continue;
+    StringMap<unsigned>::const_iterator P = Fn->second.find(Name);
+    if (P != Fn->second.end())
+      return P->second;
+  }
+  return Default;
+}
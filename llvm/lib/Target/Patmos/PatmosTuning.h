@@ -0,0 +1,45 @@
+//===-- PatmosTuning.h - Per-function tuning of backend parameters. -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Read the parameters of the backend passes for individual functions from a
+// tuning database (-mpatmos-tuning-db), as written by patmos-autotune. Values
+// in the database override the command-line options of the same name for the
+// listed functions. Each line of the database lists a function followed by
+// its parameters:
+//
+//   # comment
+//   <function> <name>=<value> ...
+//   * <name>=<value> ...
+//
+// The function '*' sets the parameters of all functions that do not set them
+// on their own. Supported parameters are named after the options, without
+// the 'mpatmos-' prefix:
+//
+//   preferred-subfunction-size, preferred-scc-size, max-subfunction-size,
+//   sched-pair-bundles, sched-pair-lookahead, sched-across-calls,
+//   sca-downsize-ensures, sca-remove-ensures
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOS_TUNING_H_
+#define _LLVM_TARGET_PATMOS_TUNING_H_
+
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+  class Function;
+
+  /// getTuningParameter - Return the value of a parameter for the given
+  /// function from the tuning database, or Default if the database does not
+  /// set it. Errors reading the database are fatal.
+  unsigned getTuningParameter(const Function &F, StringRef Name,
+                              unsigned Default);
+}
+
+#endif // _LLVM_TARGET_PATMOS_TUNING_H_
@@ -0,0 +1,311 @@
+//===-- PatmosWCETProfile.cpp - Read WCET analysis results from PML. -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Read the timing profiles of a PML file, see PatmosWCETProfile.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosWCETProfile.h"
+#include "PMLBinary.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/CodeGen/MachineBasicBlock.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+  /// The parts of a PML document that are needed to read the frequencies and
+  /// criticalities of machine blocks. Function and block names are kept
+  /// as strings, as references use the same yaml::StringValue notation.
+  struct WCETProfileReference {
+    std::string Function;
+    std::string Block;
+    std::string Instruction;
+  };
+
+  struct WCETProfileEntry {
+    WCETProfileReference Reference;
+    uint64_t WCETFrequency;
+    double Criticality;
+  };
+
+  struct WCETProfileTiming {
+    std::string Level;
+    std::vector<WCETProfileEntry> Profile;
+  };
+
+  struct WCETProfileBlock {
+    std::string Name;
+    std::string MapsTo;
+  };
+
+  struct WCETProfileFunction {
+    std::string Name;
+    std::string MapsTo;
+    std::vector<WCETProfileBlock> Blocks;
+  };
+
+  struct WCETProfileDoc {
+    std::vector<WCETProfileFunction> Functions;
+    std::vector<WCETProfileTiming> Timings;
+  };
+}
+
+namespace llvm {
+  namespace yaml {
+    template <>
+    struct MappingTraits<WCETProfileReference> {
+      static void mapping(IO &io, WCETProfileReference &R) {
+        io.mapOptional("function",    R.Function);
+        io.mapOptional("block",       R.Block);
+        io.mapOptional("instruction", R.Instruction);
+      }
+    };
+
+    template <>
+    struct MappingTraits<WCETProfileEntry> {
+      static void mapping(IO &io, WCETProfileEntry &E) {
+        io.mapRequired("reference",      E.Reference);
+        io.mapOptional("wcet-frequency", E.WCETFrequency, (uint64_t)0);
+        io.mapOptional("criticality",    E.Criticality, -1.0);
+      }
+    };
+
+    template <>
+    struct MappingTraits<WCETProfileTiming> {
+      static void mapping(IO &io, WCETProfileTiming &T) {
+        io.mapOptional("level",   T.Level, std::string("machinecode"));
+        io.mapOptional("profile", T.Profile);
+      }
+    };
+
+    template <>
+    struct MappingTraits<WCETProfileBlock> {
+      static void mapping(IO &io, WCETProfileBlock &B) {
+        io.mapRequired("name",   B.Name);
+        io.mapOptional("mapsto", B.MapsTo);
+      }
+    };
+
+    template <>
+    struct MappingTraits<WCETProfileFunction> {
+      static void mapping(IO &io, WCETProfileFunction &F) {
+        io.mapRequired("name",   F.Name);
+        io.mapOptional("mapsto", F.MapsTo);
+        io.mapOptional("blocks", F.Blocks);
+      }
+    };
+
+    template <>
+    struct MappingTraits<WCETProfileDoc> {
+      static void mapping(IO &io, WCETProfileDoc &D) {
+        io.mapOptional("machine-functions", D.Functions);
+        io.mapOptional("timing",            D.Timings);
+      }
+    };
+
+    template <> struct SequenceElementTraits<WCETProfileEntry> {
+      static const bool flow = false;
+    };
+    template <> struct SequenceElementTraits<WCETProfileTiming> {
+      static const bool flow = false;
+    };
+    template <> struct SequenceElementTraits<WCETProfileBlock> {
+      static const bool flow = false;
+    };
+    template <> struct SequenceElementTraits<WCETProfileFunction> {
+      static const bool flow = false;
+    };
+  }
+}
+
+std::string llvm::getWCETBlockKey(StringRef MapsTo, StringRef Number) {
+  return MapsTo.empty() ? "#" + Number.str() : MapsTo.str();
+}
+
+std::string llvm::getWCETBlockKey(const MachineBasicBlock &MBB) {
+  return getWCETBlockKey(MBB.getName(), utostr(MBB.getNumber()));
+}
+
+/// handleWCETProfileDiag - keep the first error while reading a WCET
+/// profile. Warnings are about the parts of the PML schema not read here.
+static void handleWCETProfileDiag(const SMDiagnostic &Diag, void *Context) {
+  std::string &Error = *static_cast<std::string*>(Context);
+  if (Diag.getKind() == SourceMgr::DK_Error && Error.empty())
+    Error = Diag.getMessage().str();
+}
+
+/// isWCETProfileKey - check whether a top-level key of a PML document is
+/// read for the WCET profile.
+static bool isWCETProfileKey(StringRef Key) {
+  return Key == "machine-functions" || Key == "timing";
+}
+
+/// selectWCETProfileDocuments - split a YAML stream into its documents and
+/// return those that may contain machine functions or timings. PML files
+/// are dominated by bitcode functions, relation graphs and flow facts,
+/// which would otherwise be tokenized completely by yaml::Input just to be
+/// skipped. Only the lines starting in the first column are inspected,
+/// documents whose top-level structure is not a plain block mapping are
+/// always kept.
+static void selectWCETProfileDocuments(StringRef Text,
+                                       SmallVectorImpl<StringRef> &Docs) {
+  const char *DocStart = Text.begin();
+  bool HasKeys = false, Keep = false;
+
+  auto closeDocument = [&](const char *DocEnd) {
+    StringRef Doc(DocStart, DocEnd - DocStart);
+    if (Keep || (!HasKeys && !Doc.trim().empty()))
+      Docs.push_back(Doc);
+    DocStart = DocEnd;
+    HasKeys = Keep = false;
+  };
+
+  for (StringRef Rest = Text; !Rest.empty(); ) {
+    const char *LineStart = Rest.begin();
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    Line.consume_back("\r");
+
+    if (Line.empty() || Line[0] == ' ' || Line[0] == '\t' || Line[0] == '#')
+      continue;
+
+    if (Line[0] == '%') {
+      // directives apply to the following documents, keep it simple
+      Docs.assign(1, Text);
+      return;
+    }
+
+    if (Line.startswith("---") &&
+        (Line.size() == 3 || Line[3] == ' ' || Line[3] == '\t')) {
+      closeDocument(LineStart);
+      // content on the marker line, e.g., a flow mapping or a tag
+      Keep = !Line.drop_front(3).trim().empty();
+      continue;
+    }
+
+    if (Line == "...") {
+      closeDocument(Rest.begin());
+      continue;
+    }
+
+    // a top-level key of a block mapping
+    size_t Colon = Line.find(':');
+    StringRef Key = Line.take_front(Colon);
+    if (Colon != StringRef::npos && !Key.empty() && isAlnum(Key[0]) &&
+        Key.find_first_of(" \t\"'{}[],") == StringRef::npos) {
+      HasKeys = true;
+      Keep |= isWCETProfileKey(Key);
+    } else {
+      Keep = true;
+    }
+  }
+  closeDocument(Text.end());
+}
+
+void llvm::readWCETProfile(StringRef Filename, wcet_profile &Profile) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+                                            MemoryBuffer::getFile(Filename);
+  if (std::error_code EC = Buffer.getError())
+    report_fatal_error("Failed to read WCET profile '" + Filename + "': " +
+                       EC.message());
+
+  StringRef Text = (*Buffer)->getBuffer();
+  std::string Converted, Error;
+  if (isPMLBinary(Text)) {
+    raw_string_ostream OS(Converted);
+    if (!convertPMLBinaryToYAML(Text, OS, Error))
+      report_fatal_error("Failed to read WCET profile '" + Filename +
+                         "': " + Error);
+    Text = OS.str();
+  }
+
+  // the names of the functions and the timings may be in other documents
+  SmallVector<StringRef, 8> Selected;
+  selectWCETProfileDocuments(Text, Selected);
+
+  std::vector<WCETProfileDoc> Docs;
+  for (StringRef Doc : Selected) {
+    yaml::Input In(Doc, NULL, handleWCETProfileDiag, &Error);
+    In.setAllowUnknownKeys(true);
+    do {
+      Docs.push_back(WCETProfileDoc());
+      In >> Docs.back();
+      if (In.error())
+        report_fatal_error("Failed to read WCET profile '" + Filename +
+                           "': " + Error);
+    } while (In.nextDocument());
+  }
+
+  // names of the machine functions and blocks
+  std::map<std::string, std::string> FunctionNames;
+  std::map<std::string, std::map<std::string, std::string> > BlockKeys;
+  for(std::vector<WCETProfileDoc>::iterator d(Docs.begin()), de(Docs.end());
+      d != de; d++) {
+    for(std::vector<WCETProfileFunction>::iterator i(d->Functions.begin()),
+        ie(d->Functions.end()); i != ie; i++) {
+      if (!i->MapsTo.empty())
+        FunctionNames[i->Name] = i->MapsTo;
+      std::map<std::string, std::string> &Keys = BlockKeys[i->Name];
+      for(std::vector<WCETProfileBlock>::iterator j(i->Blocks.begin()),
+          je(i->Blocks.end()); j != je; j++) {
+        Keys[j->Name] = getWCETBlockKey(j->MapsTo, j->Name);
+      }
+    }
+  }
+
+  for(std::vector<WCETProfileDoc>::iterator d(Docs.begin()), de(Docs.end());
+      d != de; d++) {
+    for(std::vector<WCETProfileTiming>::iterator i(d->Timings.begin()),
+        ie(d->Timings.end()); i != ie; i++) {
+      if (i->Level != "machinecode")
+        continue;
+
+      wcet_profile Timing;
+      for(std::vector<WCETProfileEntry>::iterator j(i->Profile.begin()),
+          je(i->Profile.end()); j != je; j++) {
+        const WCETProfileReference &R = j->Reference;
+        if (R.Block.empty() || !R.Instruction.empty())
+          continue;
+
+        std::map<std::string, std::string>::iterator F =
+                                            FunctionNames.find(R.Function);
+        std::string Function = F != FunctionNames.end() ? F->second
+                                                        : R.Function;
+        std::map<std::string, std::string> &Keys = BlockKeys[R.Function];
+        std::map<std::string, std::string>::iterator K = Keys.find(R.Block);
+        std::string Key = K != Keys.end() ? K->second
+                                          : getWCETBlockKey("", R.Block);
+        WCETBlockResult &Result = Timing[Function][Key];
+        Result.Frequency += j->WCETFrequency;
+        Result.Criticality = std::max(Result.Criticality, j->Criticality);
+      }
+
+      for(wcet_profile::iterator j(Timing.begin()), je(Timing.end());
+          j != je; j++) {
+        std::map<std::string, WCETBlockResult> &Blocks = Profile[j->first];
+        for(std::map<std::string, WCETBlockResult>::iterator
+            k(j->second.begin()), ke(j->second.end()); k != ke; k++) {
+          WCETBlockResult &Result = Blocks[k->first];
+          Result.Frequency = std::max(Result.Frequency, k->second.Frequency);
+          Result.Criticality = std::max(Result.Criticality,
+                                        k->second.Criticality);
+        }
+      }
+    }
+  }
+}
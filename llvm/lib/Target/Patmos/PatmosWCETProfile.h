@@ -0,0 +1,64 @@
+//===-- PatmosWCETProfile.h - Read WCET analysis results from PML. --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Read the results of a WCET analysis of the machine code, i.e., the timing
+// profiles platin writes to PML files, for the machine blocks of the program.
+//
+// Profile entries refer to machine functions and blocks by their PML names.
+// The machine functions of the same PML file map these names to the names of
+// the bitcode functions and blocks, which are used to find the blocks of the
+// functions being compiled.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOS_WCETPROFILE_H_
+#define _LLVM_TARGET_PATMOS_WCETPROFILE_H_
+
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <string>
+
+namespace llvm {
+  class MachineBasicBlock;
+
+  /// The results of a WCET analysis for a machine block.
+  struct WCETBlockResult {
+    /// The execution frequency of the block on the worst-case path.
+    double Frequency;
+
+    /// The criticality of the block, i.e., the ratio of the longest path
+    /// through the block to the WCET, or -1 if it is not reported.
+    double Criticality;
+
+    WCETBlockResult() : Frequency(0), Criticality(-1.0) {}
+  };
+
+  /// Results of the blocks in a WCET profile, by function name and by block
+  /// key.
+  /// \see getWCETBlockKey
+  typedef std::map<std::string, std::map<std::string, WCETBlockResult> >
+                                                                  wcet_profile;
+
+  /// getWCETBlockKey - the key of a block in a WCET profile, the name of its
+  /// IR basic block, if any, or its number otherwise.
+  std::string getWCETBlockKey(StringRef MapsTo, StringRef Number);
+
+  /// getWCETBlockKey - the key of a machine block in a WCET profile.
+  std::string getWCETBlockKey(const MachineBasicBlock &MBB);
+
+  /// readWCETProfile - read the results of the blocks on the worst-case path
+  /// from a PML file in YAML or binary format. Frequencies of references in
+  /// different contexts are added up, criticalities are maximized. The
+  /// highest value of a block in any of the timing results is used. Errors
+  /// are fatal.
+  void readWCETProfile(StringRef Filename, wcet_profile &Profile);
+}
+
+#endif // _LLVM_TARGET_PATMOS_WCETPROFILE_H_
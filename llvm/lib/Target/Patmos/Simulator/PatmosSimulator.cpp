@@ -0,0 +1,1323 @@
+//===-- PatmosSimulator.cpp - Embeddable Patmos ISA simulator. -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The core of the simulator: the predecoder, the handlers of the operations,
+// and the models of the caches.
+//
+// A block starts at the target of a control flow instruction, or after the
+// end of another block, and ends after the delay slots of its first control
+// flow instruction. Branches therefore only take effect at the end of a block,
+// where the successor block is looked up through a link cached in the block.
+//
+// The operations of a bundle read the registers before any of them writes. A
+// bundle whose second operation reads a register written by the first is
+// executed in the other order, or, if both read what the other writes, from a
+// copy of the registers.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosSimulator.h"
+#include "MCTargetDesc/PatmosBaseInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCDisassembler/MCDisassembler.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCInstrItineraries.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/Object/ELF.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+using namespace llvm;
+
+/// MemorySize - Size of the simulated main memory.
+static cl::opt<unsigned> MemorySize("mpatmos-sim-memory-size",
+  cl::init(64 << 20),
+  cl::desc("Size of the main memory of the simulator in bytes "
+           "(default: 64 MiB)."),
+  cl::Hidden);
+
+/// LocalMemorySize - Size of the simulated local data scratchpad.
+static cl::opt<unsigned> LocalMemorySize("mpatmos-sim-local-memory-size",
+  cl::init(64 << 10),
+  cl::desc("Size of the local data scratchpad of the simulator in bytes, a "
+           "power of two (default: 64 KiB)."),
+  cl::Hidden);
+
+/// The I/O devices, in the local address space.
+static const uint32_t IOBase = 0xF0000000;
+static const uint32_t TimerBase = 0xF0020000;
+static const uint32_t UARTBase = 0xF0080000;
+
+/// The initial stacks, unless the start code sets them: the stack cache grows
+/// down from the end of the main memory, the shadow stack below it.
+static const uint32_t StackCacheArea = 1 << 20;
+
+/// The address a single function is loaded to by loadFunction, the memory
+/// below it is left to the data of the function.
+static const uint32_t FunctionBase = 1 << 16;
+
+/// The maximal number of bundles of a block without control flow.
+static const unsigned MaxBlockBundles = 256;
+
+namespace llvm {
+  struct SimOp;
+
+  typedef void (*SimHandler)(PatmosSimulatorImpl &S, const SimOp &O);
+
+  /// A predecoded operation.
+  struct SimOp {
+    SimHandler Exec;
+    /// Guard, the predicate register in bits 2-0, negated if bit 3 is set.
+    uint8_t Guard;
+    /// Register numbers, predicates are encoded like the guard.
+    uint8_t Dst, Src1, Src2;
+    /// Bundles until the result is visible, or the stall of a taken
+    /// non-delayed branch.
+    uint8_t Delay;
+    /// Immediate, shifted, or the absolute target of a branch.
+    uint32_t Imm;
+  };
+
+  /// A bundle, the operations it executes in a block.
+  struct SimBundle {
+    uint16_t First, Count;
+    /// Flag indicating whether the operations read a copy of the registers.
+    bool Snapshot;
+  };
+
+  /// A predecoded block.
+  struct SimBlock {
+    uint32_t Start, End;
+    std::vector<SimOp> Ops;
+    std::vector<SimBundle> Bundles;
+    /// Instructions of the block, including nops, which have no operation.
+    unsigned NumInstructions = 0;
+    /// The last successors, at the end of the block and at the branch target.
+    SimBlock *FallThrough = nullptr;
+    SimBlock *Taken = nullptr;
+    uint64_t Executions = 0;
+    uint64_t Cycles = 0;
+  };
+
+  struct SimRegisters {
+    uint32_t R[32];
+    uint32_t S[16];
+    bool P[8];
+  };
+
+  /// A result that becomes visible after a number of bundles.
+  struct SimPendingWrite {
+    uint32_t Value;
+    uint8_t Reg;
+    uint8_t Remaining;
+    bool Special;
+  };
+}
+
+namespace {
+  /// Numbers of the special registers.
+  enum {
+    SReg_S0 = 0, SReg_SL = 2, SReg_SH = 3, SReg_SS = 5, SReg_ST = 6,
+    SReg_SRB = 7, SReg_SRO = 8, SReg_SXB = 9, SReg_SXO = 10
+  };
+
+  enum AluFunc {
+    ALU_ADD, ALU_SUB, ALU_XOR, ALU_SL, ALU_SR, ALU_SRA, ALU_OR, ALU_AND,
+    ALU_NOR, ALU_SHADD, ALU_SHADD2
+  };
+
+  enum CmpFunc {
+    CMP_EQ, CMP_NEQ, CMP_LT, CMP_LE, CMP_ULT, CMP_ULE, CMP_BTEST
+  };
+
+  enum PredFunc { PRED_OR, PRED_AND, PRED_XOR };
+
+  /// The memory an access goes to, by the type of the load or store.
+  enum MemKind { MEM_STACK, MEM_LOCAL, MEM_CACHED, MEM_MAIN };
+
+  enum BranchKind {
+    BRANCH_LOCAL, BRANCH_METHOD, BRANCH_CALL, BRANCH_RETURN
+  };
+}
+
+class llvm::PatmosSimulatorImpl {
+public:
+  const PatmosSubtarget &STI;
+  const MCInstrInfo &MII;
+  const MCRegisterInfo &MRI;
+  std::unique_ptr<MCContext> Ctx;
+  std::unique_ptr<MCDisassembler> Disasm;
+  raw_ostream &UART;
+
+  // The configuration, from the subtarget.
+  unsigned LoadDelayConsumer;
+  unsigned MULDelay;
+  unsigned LocalBranchDelay, CacheFillDelay;
+  unsigned StackCacheSize, StackCacheBlockSize;
+  bool HasMethodCache;
+  unsigned MethodCacheBlocks, MethodCacheBlockSize;
+  unsigned DataCacheSets, DataCacheWays, DataCacheBlockSize;
+  unsigned DataCacheFillCycles, WordCycles;
+  uint32_t ISPMBase, ISPMEnd;
+
+  // The state of the core.
+  std::vector<uint8_t> Memory, LocalMemory;
+  uint32_t LocalMask;
+  SimRegisters Regs, Shadow;
+  const SimRegisters *In;
+  SmallVector<SimPendingWrite, 4> Pending;
+  uint32_t PC, MethodBase;
+  bool Loaded, Halted, Failed;
+  std::string FailMessage;
+
+  // The branch taken in the current block.
+  bool Branched;
+  BranchKind Branch;
+  uint32_t BranchTarget, BranchBase;
+  unsigned BranchStall;
+
+  PatmosSimulatorStats Stats;
+
+  /// The predecoded blocks by their address.
+  DenseMap<uint32_t, std::unique_ptr<SimBlock>> Blocks;
+
+  /// The methods in the method cache, in FIFO order, with their blocks.
+  std::deque<std::pair<uint32_t, unsigned>> Methods;
+  unsigned MethodBlocksUsed;
+
+  /// Tags of the data cache by set, most recently used first, 0 if empty.
+  std::vector<uint32_t> DataCacheTags;
+
+  PatmosSimulatorImpl(const PatmosTargetMachine &TM, raw_ostream &UART);
+
+  void fail(const Twine &Message) {
+    if (!Failed)
+      FailMessage = Message.str();
+    Failed = true;
+  }
+
+  void stall(uint64_t &Category, unsigned Cycles) {
+    Category += Cycles;
+    Stats.Cycles += Cycles;
+  }
+
+  void writeR(const SimOp &O, uint32_t Value) {
+    if (O.Delay)
+      Pending.push_back({Value, O.Dst, uint8_t(O.Delay + 1), false});
+    else
+      Regs.R[O.Dst] = Value;
+  }
+
+  void writeS(unsigned Reg, uint32_t Value, unsigned Delay) {
+    if (Delay)
+      Pending.push_back({Value, uint8_t(Reg), uint8_t(Delay + 1), true});
+    else if (Reg == SReg_S0) {
+      for (unsigned i = 1; i < 8; i++)
+        Regs.P[i] = (Value >> i) & 1;
+    } else
+      Regs.S[Reg] = Value;
+  }
+
+  uint32_t readS(unsigned Reg) const {
+    if (Reg != SReg_S0)
+      return In->S[Reg];
+    uint32_t Value = 0;
+    for (unsigned i = 0; i < 8; i++)
+      Value |= (uint32_t)In->P[i] << i;
+    return Value;
+  }
+
+  void retire();
+
+  uint8_t *getMain(uint32_t Addr, unsigned Size) {
+    if (LLVM_UNLIKELY((uint64_t)Addr + Size > Memory.size())) {
+      fail("access of 0x" + Twine::utohexstr(Addr) + " outside the memory");
+      return nullptr;
+    }
+    return &Memory[Addr];
+  }
+
+  uint8_t *getLocal(uint32_t Addr, unsigned Size) {
+    Addr &= LocalMask;
+    if (LLVM_UNLIKELY((uint64_t)Addr + Size > LocalMemory.size())) {
+      fail("misaligned local access of 0x" + Twine::utohexstr(Addr));
+      return nullptr;
+    }
+    return &LocalMemory[Addr];
+  }
+
+  uint32_t readIO(uint32_t Addr);
+  void writeIO(uint32_t Addr, uint32_t Value);
+  void loadCached(uint32_t Addr);
+  void storeCached(uint32_t Addr);
+
+  template <unsigned Size, MemKind K> uint32_t readMem(uint32_t Addr);
+  template <unsigned Size, MemKind K> void writeMem(uint32_t Addr,
+                                                    uint32_t Value);
+
+  void reserve(uint32_t Bytes);
+  void ensure(uint32_t Bytes);
+  void release(uint32_t Bytes);
+  void spill(uint32_t Bytes);
+
+  void enterMethod(uint32_t Base);
+
+  void branch(BranchKind K, uint32_t Target, uint32_t Base, const SimOp &O) {
+    Branched = true;
+    Branch = K;
+    BranchTarget = Target;
+    BranchBase = Base;
+    BranchStall = O.Delay;
+  }
+
+  uint64_t getRegMask(unsigned Reg) const;
+  unsigned getDefDelay(const MCInstrDesc &D) const;
+  int translate(const MCInst &MI, uint32_t Addr, SimOp &O, uint64_t &Reads,
+                uint64_t &Writes) const;
+  std::unique_ptr<SimBlock> decodeBlock(uint32_t Addr) const;
+
+  SimBlock *getBlock(uint32_t Addr) {
+    std::unique_ptr<SimBlock> &B = Blocks[Addr];
+    if (!B)
+      B = decodeBlock(Addr);
+    return B.get();
+  }
+
+  void execute(SimBlock &B);
+
+  void resetMemory();
+  void reset(uint32_t Entry);
+
+  Error load(MemoryBufferRef Buffer);
+  Error loadFunction(ArrayRef<uint8_t> Code, ArrayRef<uint32_t> Args);
+  Error run(uint64_t MaxCycles);
+};
+
+//===----------------------------------------------------------------------===//
+// Handlers
+//===----------------------------------------------------------------------===//
+
+static inline bool readPred(const SimRegisters *In, uint8_t P) {
+  return In->P[P & 7] != (bool)(P >> 3);
+}
+
+template <AluFunc F> static inline uint32_t alu(uint32_t A, uint32_t B) {
+  switch (F) {
+  case ALU_ADD:    return A + B;
+  case ALU_SUB:    return A - B;
+  case ALU_XOR:    return A ^ B;
+  case ALU_SL:     return A << (B & 31);
+  case ALU_SR:     return A >> (B & 31);
+  case ALU_SRA:    return (uint32_t)((int32_t)A >> (B & 31));
+  case ALU_OR:     return A | B;
+  case ALU_AND:    return A & B;
+  case ALU_NOR:    return ~(A | B);
+  case ALU_SHADD:  return (A << 1) + B;
+  case ALU_SHADD2: return (A << 2) + B;
+  }
+  llvm_unreachable("unknown ALU function");
+}
+
+template <CmpFunc F> static inline bool cmp(uint32_t A, uint32_t B) {
+  switch (F) {
+  case CMP_EQ:    return A == B;
+  case CMP_NEQ:   return A != B;
+  case CMP_LT:    return (int32_t)A < (int32_t)B;
+  case CMP_LE:    return (int32_t)A <= (int32_t)B;
+  case CMP_ULT:   return A < B;
+  case CMP_ULE:   return A <= B;
+  case CMP_BTEST: return (A >> (B & 31)) & 1;
+  }
+  llvm_unreachable("unknown compare function");
+}
+
+template <AluFunc F>
+static void execALUr(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.writeR(O, alu<F>(S.In->R[O.Src1], S.In->R[O.Src2]));
+}
+
+template <AluFunc F>
+static void execALUi(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.writeR(O, alu<F>(S.In->R[O.Src1], O.Imm));
+}
+
+template <bool Signed>
+static void execMUL(PatmosSimulatorImpl &S, const SimOp &O) {
+  uint32_t A = S.In->R[O.Src1], B = S.In->R[O.Src2];
+  uint64_t Product = Signed ? (uint64_t)((int64_t)(int32_t)A *
+                                         (int64_t)(int32_t)B)
+                            : (uint64_t)A * B;
+  S.writeS(SReg_SL, (uint32_t)Product, O.Delay);
+  S.writeS(SReg_SH, (uint32_t)(Product >> 32), O.Delay);
+}
+
+template <CmpFunc F>
+static void execCMPr(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.Regs.P[O.Dst] = cmp<F>(S.In->R[O.Src1], S.In->R[O.Src2]);
+}
+
+template <CmpFunc F>
+static void execCMPi(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.Regs.P[O.Dst] = cmp<F>(S.In->R[O.Src1], O.Imm);
+}
+
+template <PredFunc F>
+static void execALUp(PatmosSimulatorImpl &S, const SimOp &O) {
+  bool A = readPred(S.In, O.Src1), B = readPred(S.In, O.Src2);
+  switch (F) {
+  case PRED_OR:  S.Regs.P[O.Dst] = A || B; break;
+  case PRED_AND: S.Regs.P[O.Dst] = A && B; break;
+  case PRED_XOR: S.Regs.P[O.Dst] = A != B; break;
+  }
+}
+
+static void execBCOPY(PatmosSimulatorImpl &S, const SimOp &O) {
+  uint32_t Bit = O.Imm & 31;
+  S.writeR(O, (S.In->R[O.Src1] & ~(1u << Bit)) |
+              ((uint32_t)readPred(S.In, O.Src2) << Bit));
+}
+
+static void execMTS(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.writeS(O.Dst, S.In->R[O.Src1], 0);
+}
+
+static void execMFS(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.writeR(O, S.readS(O.Src1));
+}
+
+template <unsigned Size, bool Signed, MemKind K>
+static void execLoad(PatmosSimulatorImpl &S, const SimOp &O) {
+  uint32_t Addr = S.In->R[O.Src1] + O.Imm;
+  if (K == MEM_STACK)
+    Addr += S.In->S[SReg_ST];
+  uint32_t Value = S.readMem<Size, K>(Addr);
+  if (Signed)
+    Value = SignExtend32<Size * 8>(Value);
+  S.writeR(O, Value);
+}
+
+template <unsigned Size, MemKind K>
+static void execStore(PatmosSimulatorImpl &S, const SimOp &O) {
+  uint32_t Addr = S.In->R[O.Src1] + O.Imm;
+  if (K == MEM_STACK)
+    Addr += S.In->S[SReg_ST];
+  S.writeMem<Size, K>(Addr, S.In->R[O.Src2]);
+}
+
+static void execSRES(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.reserve(O.Imm);
+}
+
+static void execSENS(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.ensure(O.Imm);
+}
+
+static void execSENSr(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.ensure(S.In->R[O.Src1] << 2);
+}
+
+static void execSFREE(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.release(O.Imm);
+}
+
+static void execSSPILL(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.spill(O.Imm);
+}
+
+static void execSSPILLr(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.spill(S.In->R[O.Src1] << 2);
+}
+
+static void execBR(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.branch(BRANCH_LOCAL, O.Imm, 0, O);
+}
+
+static void execBRR(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.branch(BRANCH_LOCAL, S.In->R[O.Src1], 0, O);
+}
+
+static void execBRCF(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.branch(BRANCH_METHOD, O.Imm, O.Imm, O);
+}
+
+static void execBRCFR(PatmosSimulatorImpl &S, const SimOp &O) {
+  uint32_t Base = S.In->R[O.Src1];
+  S.branch(BRANCH_METHOD, Base + S.In->R[O.Src2], Base, O);
+}
+
+static void execCALL(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.branch(BRANCH_CALL, O.Imm, O.Imm, O);
+}
+
+static void execCALLR(PatmosSimulatorImpl &S, const SimOp &O) {
+  uint32_t Target = S.In->R[O.Src1];
+  S.branch(BRANCH_CALL, Target, Target, O);
+}
+
+static void execRET(PatmosSimulatorImpl &S, const SimOp &O) {
+  uint32_t Base = S.In->S[SReg_SRB];
+  S.branch(BRANCH_RETURN, Base + S.In->S[SReg_SRO], Base, O);
+}
+
+static void execXRET(PatmosSimulatorImpl &S, const SimOp &O) {
+  uint32_t Base = S.In->S[SReg_SXB];
+  S.branch(BRANCH_RETURN, Base + S.In->S[SReg_SXO], Base, O);
+}
+
+static void execTRAP(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.fail("trap " + Twine(O.Imm) + " is not supported");
+}
+
+static void execIllegal(PatmosSimulatorImpl &S, const SimOp &O) {
+  S.fail("illegal instruction at 0x" + Twine::utohexstr(O.Imm));
+}
+
+//===----------------------------------------------------------------------===//
+// Memories and caches
+//===----------------------------------------------------------------------===//
+
+template <unsigned Size> static inline uint32_t readBE(const uint8_t *P) {
+  switch (Size) {
+  case 1: return *P;
+  case 2: return support::endian::read16be(P);
+  default: return support::endian::read32be(P);
+  }
+}
+
+template <unsigned Size> static inline void writeBE(uint8_t *P,
+                                                    uint32_t Value) {
+  switch (Size) {
+  case 1: *P = Value; break;
+  case 2: support::endian::write16be(P, Value); break;
+  default: support::endian::write32be(P, Value); break;
+  }
+}
+
+uint32_t PatmosSimulatorImpl::readIO(uint32_t Addr) {
+  switch (Addr) {
+  case TimerBase:     return (uint32_t)(Stats.Cycles >> 32);
+  case TimerBase + 4: return (uint32_t)Stats.Cycles;
+  // the UART is always ready to transmit
+  case UARTBase:      return 1;
+  default:            return 0;
+  }
+}
+
+void PatmosSimulatorImpl::writeIO(uint32_t Addr, uint32_t Value) {
+  if (Addr == UARTBase + 4)
+    UART << (char)Value;
+}
+
+void PatmosSimulatorImpl::loadCached(uint32_t Addr) {
+  if (!DataCacheWays) {
+    stall(Stats.MemoryStalls, WordCycles);
+    return;
+  }
+
+  uint32_t Tag = Addr / DataCacheBlockSize + 1;
+  uint32_t *Ways = &DataCacheTags[((Tag - 1) % DataCacheSets) *
+                                  DataCacheWays];
+  for (unsigned i = 0; i < DataCacheWays; i++) {
+    if (Ways[i] == Tag) {
+      std::rotate(Ways, Ways + i, Ways + i + 1);
+      Stats.DataCacheHits++;
+      return;
+    }
+  }
+
+  std::rotate(Ways, Ways + DataCacheWays - 1, Ways + DataCacheWays);
+  Ways[0] = Tag;
+  Stats.DataCacheMisses++;
+  stall(Stats.DataCacheStalls, DataCacheFillCycles);
+}
+
+void PatmosSimulatorImpl::storeCached(uint32_t Addr) {
+  // write-through without allocation, the cached copy is updated in place
+  stall(Stats.MemoryStalls, WordCycles);
+}
+
+template <unsigned Size, MemKind K>
+uint32_t PatmosSimulatorImpl::readMem(uint32_t Addr) {
+  const uint8_t *P;
+  switch (K) {
+  case MEM_LOCAL:
+    if (Addr >= IOBase)
+      return readIO(Addr);
+    P = getLocal(Addr, Size);
+    break;
+  case MEM_CACHED:
+    loadCached(Addr);
+    P = getMain(Addr, Size);
+    break;
+  case MEM_MAIN:
+    stall(Stats.MemoryStalls, WordCycles);
+    P = getMain(Addr, Size);
+    break;
+  case MEM_STACK:
+    P = getMain(Addr, Size);
+    break;
+  }
+  return P ? readBE<Size>(P) : 0;
+}
+
+template <unsigned Size, MemKind K>
+void PatmosSimulatorImpl::writeMem(uint32_t Addr, uint32_t Value) {
+  uint8_t *P;
+  switch (K) {
+  case MEM_LOCAL:
+    if (Addr >= IOBase) {
+      writeIO(Addr, Value);
+      return;
+    }
+    P = getLocal(Addr, Size);
+    break;
+  case MEM_CACHED:
+    storeCached(Addr);
+    P = getMain(Addr, Size);
+    break;
+  case MEM_MAIN:
+    stall(Stats.MemoryStalls, WordCycles);
+    P = getMain(Addr, Size);
+    break;
+  case MEM_STACK:
+    P = getMain(Addr, Size);
+    break;
+  }
+  if (P)
+    writeBE<Size>(P, Value);
+}
+
+// The stack cache holds the frames between the stack top ST and the spill
+// pointer SS, the stack grows down.
+
+void PatmosSimulatorImpl::reserve(uint32_t Bytes) {
+  uint32_t &ST = Regs.S[SReg_ST], &SS = Regs.S[SReg_SS];
+  ST -= Bytes;
+  uint32_t Occupied = SS - ST;
+  if (Occupied > StackCacheSize) {
+    uint32_t Spill = Occupied - StackCacheSize;
+    SS -= Spill;
+    Stats.StackCacheSpillBytes += Spill;
+    stall(Stats.StackCacheStalls,
+          STI.getMemoryTransferCycles(alignTo(Spill, StackCacheBlockSize)));
+  }
+}
+
+void PatmosSimulatorImpl::ensure(uint32_t Bytes) {
+  uint32_t &ST = Regs.S[SReg_ST], &SS = Regs.S[SReg_SS];
+  uint32_t Occupied = SS - ST;
+  if (Occupied < Bytes) {
+    uint32_t Fill = Bytes - Occupied;
+    SS += Fill;
+    Stats.StackCacheFillBytes += Fill;
+    stall(Stats.StackCacheStalls,
+          STI.getMemoryTransferCycles(alignTo(Fill, StackCacheBlockSize)));
+  }
+}
+
+void PatmosSimulatorImpl::release(uint32_t Bytes) {
+  uint32_t &ST = Regs.S[SReg_ST], &SS = Regs.S[SReg_SS];
+  ST += Bytes;
+  // freed frames that were spilled are dropped from the memory stack
+  if ((int32_t)(SS - ST) < 0)
+    SS = ST;
+}
+
+void PatmosSimulatorImpl::spill(uint32_t Bytes) {
+  uint32_t &ST = Regs.S[SReg_ST], &SS = Regs.S[SReg_SS];
+  uint32_t Spill = std::min(Bytes, SS - ST);
+  if (!Spill)
+    return;
+  SS -= Spill;
+  Stats.StackCacheSpillBytes += Spill;
+  stall(Stats.StackCacheStalls,
+        STI.getMemoryTransferCycles(alignTo(Spill, StackCacheBlockSize)));
+}
+
+void PatmosSimulatorImpl::enterMethod(uint32_t Base) {
+  MethodBase = Base;
+  if (!HasMethodCache || (Base >= ISPMBase && Base < ISPMEnd))
+    return;
+
+  for (const auto &M : Methods) {
+    if (M.first == Base) {
+      Stats.MethodCacheHits++;
+      return;
+    }
+  }
+
+  // the size of the method is emitted in front of it
+  uint32_t Size = 0;
+  if (Base >= 4 && Base <= Memory.size())
+    Size = support::endian::read32be(&Memory[Base - 4]);
+  unsigned NumBlocks = std::max(1u, (unsigned)divideCeil(Size,
+                                                     MethodCacheBlockSize));
+
+  Stats.MethodCacheMisses++;
+  stall(Stats.MethodCacheStalls,
+        STI.getMemoryTransferCycles(NumBlocks * MethodCacheBlockSize));
+
+  // methods larger than the cache are streamed, and not kept
+  if (NumBlocks > MethodCacheBlocks)
+    return;
+  while (MethodBlocksUsed + NumBlocks > MethodCacheBlocks) {
+    MethodBlocksUsed -= Methods.front().second;
+    Methods.pop_front();
+  }
+  Methods.push_back(std::make_pair(Base, NumBlocks));
+  MethodBlocksUsed += NumBlocks;
+}
+
+//===----------------------------------------------------------------------===//
+// Predecoding
+//===----------------------------------------------------------------------===//
+
+PatmosSimulatorImpl::PatmosSimulatorImpl(const PatmosTargetMachine &TM,
+                                         raw_ostream &UART)
+  : STI(*TM.getSubtargetImpl()), MII(*TM.getMCInstrInfo()),
+    MRI(*TM.getMCRegisterInfo()), UART(UART), In(&Regs), Loaded(false),
+    Halted(false), Failed(false), Branched(false), MethodBlocksUsed(0)
+{
+  Ctx.reset(new MCContext(TM.getMCAsmInfo(), &MRI, nullptr));
+  Disasm.reset(TM.getTarget().createMCDisassembler(*TM.getMCSubtargetInfo(),
+                                                   *Ctx));
+  if (!Disasm)
+    report_fatal_error("the Patmos disassembler is not initialized");
+
+  // the reader of loaded registers, see getDefDelay
+  LoadDelayConsumer = MII.get(Patmos::ADDr).getSchedClass();
+  MULDelay = STI.getMULLatency();
+  LocalBranchDelay = STI.getCFLDelaySlotCycles(true);
+  CacheFillDelay = STI.getCFLDelaySlotCycles(false);
+
+  StackCacheSize = STI.getStackCacheSize();
+  StackCacheBlockSize = std::max(1u, STI.getStackCacheBlockSize());
+
+  HasMethodCache = STI.hasMethodCache();
+  MethodCacheBlockSize = std::max(1u, STI.getMethodCacheBlockSize());
+  MethodCacheBlocks = STI.getMethodCacheSize() / MethodCacheBlockSize;
+
+  DataCacheBlockSize = std::max(1u, STI.getDataCacheBlockSize());
+  DataCacheWays = STI.getDataCacheAssociativity();
+  unsigned DataCacheBlocks = STI.getDataCacheSize() / DataCacheBlockSize;
+  if (DataCacheWays > DataCacheBlocks)
+    DataCacheWays = DataCacheBlocks;
+  DataCacheSets = DataCacheWays ? DataCacheBlocks / DataCacheWays : 0;
+  DataCacheFillCycles = STI.getMemoryTransferCycles(DataCacheBlockSize);
+  WordCycles = STI.getMemoryTransferCycles(4);
+
+  ISPMBase = STI.getISPMBase();
+  ISPMEnd = ISPMBase + STI.getISPMSize();
+}
+
+uint64_t PatmosSimulatorImpl::getRegMask(unsigned Reg) const {
+  // bits 31-0 are the general purpose registers, bits 47-32 the special
+  // registers and bits 55-48 the predicates, which are also in s0
+  if (Reg == Patmos::NoRegister)
+    return 0;
+  unsigned Num = getPatmosRegisterNumbering(Reg);
+  if (MRI.getRegClass(Patmos::PRegsRegClassID).contains(Reg))
+    return 1ULL << (48 + Num);
+  if (MRI.getRegClass(Patmos::SRegsRegClassID).contains(Reg))
+    return Num == SReg_S0 ? (0xFFULL << 48) | (1ULL << 32)
+                          : 1ULL << (32 + Num);
+  return 1ULL << Num;
+}
+
+unsigned PatmosSimulatorImpl::getDefDelay(const MCInstrDesc &D) const {
+  // The bundles reading the old value of the first def, i.e., the latency
+  // to an ALU instruction reading the register as its first operand, less
+  // the bundle it is visible in.
+  const InstrItineraryData *Itins = STI.getInstrItineraryData();
+  int Latency = Itins->getOperandLatency(D.getSchedClass(), 0,
+                                         LoadDelayConsumer, 3);
+  return Latency > 1 ? Latency - 1 : 0;
+}
+
+/// translate - Predecode an instruction into O. Returns the number of delay
+/// slots of a control flow instruction, or -1 for other instructions.
+int PatmosSimulatorImpl::translate(const MCInst &MI, uint32_t Addr, SimOp &O,
+                                   uint64_t &Reads, uint64_t &Writes) const {
+  const MCInstrDesc &D = MII.get(MI.getOpcode());
+  const MCRegisterClass &PRegs = MRI.getRegClass(Patmos::PRegsRegClassID);
+  bool IsCFL = isPatmosCFL(MI.getOpcode(), D.TSFlags);
+
+  // the last operand is the bundle flag of the disassembler
+  unsigned NumOps = MI.getNumOperands() - 1;
+  unsigned NumDefs = D.getNumDefs();
+
+  Reads = Writes = 0;
+  for (unsigned i = 0; i < NumOps; i++) {
+    const MCOperand &MO = MI.getOperand(i);
+    if (MO.isReg())
+      (i < NumDefs ? Writes : Reads) |= getRegMask(MO.getReg());
+  }
+  // the implicit SL/SH of multiplications and SS/ST of the stack cache
+  if (!IsCFL) {
+    for (const MCPhysReg *R = D.getImplicitUses(); R && *R; ++R)
+      Reads |= getRegMask(*R);
+    for (const MCPhysReg *R = D.getImplicitDefs(); R && *R; ++R)
+      Writes |= getRegMask(*R);
+  }
+
+  auto getPred = [&](unsigned i) -> uint8_t {
+    return getPatmosRegisterNumbering(MI.getOperand(i).getReg()) |
+           (MI.getOperand(i + 1).getImm() ? 8 : 0);
+  };
+
+  O = SimOp();
+  O.Exec = nullptr;
+  unsigned Idx = 0;
+  if (NumDefs)
+    O.Dst = getPatmosRegisterNumbering(MI.getOperand(Idx++).getReg());
+  O.Guard = getPred(Idx);
+  Idx += 2;
+
+  SmallVector<uint8_t, 3> Srcs;
+  int64_t RawImm = 0;
+  for (; Idx < NumOps; Idx++) {
+    const MCOperand &MO = MI.getOperand(Idx);
+    if (MO.isReg() && PRegs.contains(MO.getReg())) {
+      Srcs.push_back(getPred(Idx));
+      Idx++;
+    } else if (MO.isReg())
+      Srcs.push_back(getPatmosRegisterNumbering(MO.getReg()));
+    else if (MO.isImm())
+      RawImm = MO.getImm();
+  }
+  O.Src1 = Srcs.size() > 0 ? Srcs[0] : 0;
+  O.Src2 = Srcs.size() > 1 ? Srcs[1] : 0;
+  O.Imm = (uint32_t)RawImm << getPatmosImmediateShift(D.TSFlags);
+
+  if (NumDefs && !IsCFL &&
+      MRI.getRegClass(Patmos::RRegsRegClassID).contains(MI.getOperand(0)
+                                                          .getReg()))
+    O.Delay = getDefDelay(D);
+
+  #define ALU_ILR(NAME, F) \
+    case Patmos::NAME##i: case Patmos::NAME##l: O.Exec = execALUi<F>; break; \
+    case Patmos::NAME##r: O.Exec = execALUr<F>; break;
+  #define ALU_LR(NAME, F) \
+    case Patmos::NAME##l: O.Exec = execALUi<F>; break; \
+    case Patmos::NAME##r: O.Exec = execALUr<F>; break;
+  #define CMP(NAME, F) \
+    case Patmos::CMP##NAME:  O.Exec = execCMPr<F>; break; \
+    case Patmos::CMPI##NAME: O.Exec = execCMPi<F>; break;
+  #define LOAD(NAME, SIZE, SIGNED) \
+    case Patmos::NAME##S: O.Exec = execLoad<SIZE, SIGNED, MEM_STACK>;  break; \
+    case Patmos::NAME##L: O.Exec = execLoad<SIZE, SIGNED, MEM_LOCAL>;  break; \
+    case Patmos::NAME##C: O.Exec = execLoad<SIZE, SIGNED, MEM_CACHED>; break; \
+    case Patmos::NAME##M: O.Exec = execLoad<SIZE, SIGNED, MEM_MAIN>;   break;
+  #define STORE(NAME, SIZE) \
+    case Patmos::NAME##S: O.Exec = execStore<SIZE, MEM_STACK>;  break; \
+    case Patmos::NAME##L: O.Exec = execStore<SIZE, MEM_LOCAL>;  break; \
+    case Patmos::NAME##C: O.Exec = execStore<SIZE, MEM_CACHED>; break; \
+    case Patmos::NAME##M: O.Exec = execStore<SIZE, MEM_MAIN>;   break;
+
+  switch (MI.getOpcode()) {
+  ALU_ILR(ADD, ALU_ADD)
+  ALU_ILR(SUB, ALU_SUB)
+  ALU_ILR(XOR, ALU_XOR)
+  ALU_ILR(SL,  ALU_SL)
+  ALU_ILR(SR,  ALU_SR)
+  ALU_ILR(SRA, ALU_SRA)
+  ALU_ILR(OR,  ALU_OR)
+  ALU_ILR(AND, ALU_AND)
+  ALU_LR(NOR,    ALU_NOR)
+  ALU_LR(SHADD,  ALU_SHADD)
+  ALU_LR(SHADD2, ALU_SHADD2)
+
+  // the aliases, missing registers are r0 and missing immediates 0
+  case Patmos::MOV:
+  case Patmos::CLR:
+  case Patmos::LIi:
+  case Patmos::LIl:  O.Exec = execALUi<ALU_ADD>; break;
+  case Patmos::LIin: O.Exec = execALUi<ALU_SUB>; break;
+  case Patmos::NEG:
+    O.Src2 = O.Src1;
+    O.Src1 = 0;
+    O.Exec = execALUr<ALU_SUB>;
+    break;
+  case Patmos::NOT:  O.Exec = execALUr<ALU_NOR>; break;
+  case Patmos::NOP:  break;
+
+  case Patmos::MUL:
+    O.Delay = MULDelay;
+    O.Exec = execMUL<true>;
+    break;
+  case Patmos::MULU:
+    O.Delay = MULDelay;
+    O.Exec = execMUL<false>;
+    break;
+
+  CMP(EQ,  CMP_EQ)
+  CMP(NEQ, CMP_NEQ)
+  CMP(LT,  CMP_LT)
+  CMP(LE,  CMP_LE)
+  CMP(ULT, CMP_ULT)
+  CMP(ULE, CMP_ULE)
+  case Patmos::BTEST:  O.Exec = execCMPr<CMP_BTEST>; break;
+  case Patmos::BTESTI: O.Exec = execCMPi<CMP_BTEST>; break;
+  case Patmos::ISODD:  O.Exec = execCMPr<CMP_BTEST>; break;
+  case Patmos::MOVrp:  O.Exec = execCMPr<CMP_NEQ>;   break;
+
+  // missing predicates are p0, or !p0 for pmov
+  case Patmos::POR:  O.Exec = execALUp<PRED_OR>;  break;
+  case Patmos::PAND: O.Exec = execALUp<PRED_AND>; break;
+  case Patmos::PXOR: O.Exec = execALUp<PRED_XOR>; break;
+  case Patmos::PMOV:
+    O.Src2 = 8;
+    O.Exec = execALUp<PRED_OR>;
+    break;
+  case Patmos::PNOT: O.Exec = execALUp<PRED_XOR>; break;
+  case Patmos::PSET: O.Exec = execALUp<PRED_OR>;  break;
+  case Patmos::PCLR: O.Exec = execALUp<PRED_XOR>; break;
+
+  case Patmos::BCOPY: O.Exec = execBCOPY; break;
+  case Patmos::MOVpr:
+    O.Src2 = O.Src1;
+    O.Src1 = 0;
+    O.Exec = execBCOPY;
+    break;
+
+  case Patmos::MTS:  O.Exec = execMTS; break;
+  case Patmos::MFS:  O.Exec = execMFS; break;
+
+  LOAD(LW,  4, false)
+  LOAD(LH,  2, true)
+  LOAD(LB,  1, true)
+  LOAD(LHU, 2, false)
+  LOAD(LBU, 1, false)
+  STORE(SW, 4)
+  STORE(SH, 2)
+  STORE(SB, 1)
+
+  case Patmos::SRESi:   O.Exec = execSRES;    break;
+  case Patmos::SENSi:   O.Exec = execSENS;    break;
+  case Patmos::SENSr:   O.Exec = execSENSr;   break;
+  case Patmos::SFREEi:  O.Exec = execSFREE;   break;
+  case Patmos::SSPILLi: O.Exec = execSSPILL;  break;
+  case Patmos::SSPILLr: O.Exec = execSSPILLr; break;
+
+  // the delay slots of delayed branches, the stall of non-delayed ones
+  case Patmos::BR:
+  case Patmos::BRND:
+    O.Imm = Addr + ((uint32_t)SignExtend32<22>(RawImm) << 2);
+    O.Exec = execBR;
+    break;
+  case Patmos::BRR:
+  case Patmos::BRRND:   O.Exec = execBRR;   break;
+  case Patmos::BRCF:
+  case Patmos::BRCFND:
+    O.Imm = ((uint32_t)RawImm & 0x3FFFFF) << 2;
+    O.Exec = execBRCF;
+    break;
+  case Patmos::BRCFR:
+  case Patmos::BRCFRND: O.Exec = execBRCFR; break;
+  case Patmos::CALL:
+  case Patmos::CALLND:
+    O.Imm = ((uint32_t)RawImm & 0x3FFFFF) << 2;
+    O.Exec = execCALL;
+    break;
+  case Patmos::CALLR:
+  case Patmos::CALLRND: O.Exec = execCALLR; break;
+  case Patmos::RET:
+  case Patmos::RETND:   O.Exec = execRET;   break;
+  case Patmos::XRET:
+  case Patmos::XRETND:  O.Exec = execXRET;  break;
+  case Patmos::TRAP:
+    O.Imm = RawImm;
+    O.Exec = execTRAP;
+    break;
+
+  default:
+    O.Guard = 0;
+    O.Imm = Addr;
+    O.Exec = execIllegal;
+    return 0;
+  }
+
+  #undef ALU_ILR
+  #undef ALU_LR
+  #undef CMP
+  #undef LOAD
+  #undef STORE
+
+  if (!IsCFL || MI.getOpcode() == Patmos::TRAP)
+    return -1;
+
+  bool Local = MI.getOpcode() == Patmos::BR || MI.getOpcode() == Patmos::BRND ||
+               MI.getOpcode() == Patmos::BRR ||
+               MI.getOpcode() == Patmos::BRRND;
+  unsigned DelaySlots = Local ? LocalBranchDelay : CacheFillDelay;
+  if (D.hasDelaySlot())
+    return DelaySlots;
+  O.Delay = DelaySlots;
+  return 0;
+}
+
+std::unique_ptr<SimBlock> PatmosSimulatorImpl::decodeBlock(uint32_t Addr)
+  const
+{
+  std::unique_ptr<SimBlock> B(new SimBlock());
+  B->Start = Addr;
+
+  // bundles left until the end of the block, -1 before a branch
+  int DelaySlots = -1;
+  bool Illegal = false;
+  uint32_t PC = Addr;
+  do {
+    SimOp Ops[2];
+    uint64_t Reads[2], Writes[2];
+    unsigned NumOps = 0;
+    int Delay = -1;
+
+    for (bool Bundled = true; Bundled && NumOps < 2; ) {
+      MCInst MI;
+      uint64_t Size = 0;
+      if (PC >= Memory.size() ||
+          Disasm->getInstruction(MI, Size, makeArrayRef(Memory).slice(PC), PC,
+                                 nulls()) != MCDisassembler::Success) {
+        // fails when executed, and ends the block
+        Ops[NumOps] = SimOp();
+        Ops[NumOps].Imm = PC;
+        Ops[NumOps].Exec = execIllegal;
+        Reads[NumOps] = Writes[NumOps] = 0;
+        NumOps++;
+        B->NumInstructions++;
+        Illegal = true;
+        break;
+      }
+
+      Bundled = MI.getOperand(MI.getNumOperands() - 1).getImm();
+      B->NumInstructions++;
+      PC += Size;
+
+      int D = translate(MI, PC - Size, Ops[NumOps], Reads[NumOps],
+                        Writes[NumOps]);
+      if (D >= 0)
+        Delay = D;
+      // nops have no operation
+      if (Ops[NumOps].Exec)
+        NumOps++;
+    }
+
+    SimBundle Bundle;
+    Bundle.First = B->Ops.size();
+    Bundle.Count = NumOps;
+    Bundle.Snapshot = false;
+    if (NumOps == 2 && (Writes[0] & Reads[1])) {
+      if (Writes[1] & Reads[0])
+        Bundle.Snapshot = true;
+      else
+        std::swap(Ops[0], Ops[1]);
+    }
+    B->Ops.insert(B->Ops.end(), Ops, Ops + NumOps);
+    B->Bundles.push_back(Bundle);
+
+    if (DelaySlots > 0)
+      DelaySlots--;
+    else if (Delay >= 0)
+      DelaySlots = Delay;
+  } while (!Illegal && DelaySlots != 0 &&
+           (DelaySlots > 0 || B->Bundles.size() < MaxBlockBundles));
+
+  B->End = PC;
+  return B;
+}
+
+//===----------------------------------------------------------------------===//
+// Execution
+//===----------------------------------------------------------------------===//
+
+void PatmosSimulatorImpl::retire() {
+  for (unsigned i = 0; i < Pending.size(); ) {
+    SimPendingWrite &W = Pending[i];
+    if (--W.Remaining) {
+      i++;
+      continue;
+    }
+    if (W.Special)
+      writeS(W.Reg, W.Value, 0);
+    else if (W.Reg)
+      Regs.R[W.Reg] = W.Value;
+    Pending.erase(Pending.begin() + i);
+  }
+}
+
+void PatmosSimulatorImpl::execute(SimBlock &B) {
+  const SimOp *Ops = B.Ops.data();
+  for (const SimBundle &Bundle : B.Bundles) {
+    if (LLVM_UNLIKELY(Bundle.Snapshot)) {
+      Shadow = Regs;
+      In = &Shadow;
+    }
+    for (const SimOp *O = Ops + Bundle.First, *E = O + Bundle.Count; O != E;
+         ++O) {
+      if (readPred(In, O->Guard))
+        O->Exec(*this, *O);
+    }
+    In = &Regs;
+    Regs.R[0] = 0;
+    Regs.P[0] = true;
+    if (!Pending.empty())
+      retire();
+    Stats.Cycles++;
+    if (LLVM_UNLIKELY(Failed))
+      return;
+  }
+  Stats.Bundles += B.Bundles.size();
+  Stats.Instructions += B.NumInstructions;
+  PC = B.End;
+
+  if (!Branched)
+    return;
+  Branched = false;
+  if (BranchStall)
+    stall(Stats.BranchStalls, BranchStall);
+
+  if (BranchTarget == 0) {
+    Halted = true;
+    return;
+  }
+
+  switch (Branch) {
+  case BRANCH_LOCAL:
+    break;
+  case BRANCH_CALL:
+    // the return address follows the delay slots, which end the block
+    Regs.S[SReg_SRB] = MethodBase;
+    Regs.S[SReg_SRO] = PC - MethodBase;
+    LLVM_FALLTHROUGH;
+  case BRANCH_METHOD:
+  case BRANCH_RETURN:
+    enterMethod(BranchBase);
+    break;
+  }
+  PC = BranchTarget;
+}
+
+void PatmosSimulatorImpl::resetMemory() {
+  Memory.assign(MemorySize, 0);
+  LocalMemory.assign(PowerOf2Floor(std::max(4u, (unsigned)LocalMemorySize)),
+                     0);
+  LocalMask = LocalMemory.size() - 1;
+}
+
+void PatmosSimulatorImpl::reset(uint32_t Entry) {
+  Blocks.clear();
+  Methods.clear();
+  MethodBlocksUsed = 0;
+  DataCacheTags.assign(DataCacheSets * DataCacheWays, 0);
+  Pending.clear();
+  Stats = PatmosSimulatorStats();
+
+  Regs = SimRegisters();
+  Regs.P[0] = true;
+  Regs.S[SReg_ST] = Regs.S[SReg_SS] = Memory.size();
+  Regs.R[31] = Memory.size() - StackCacheArea;
+  In = &Regs;
+
+  Halted = Failed = Branched = false;
+  PC = Entry;
+  enterMethod(PC);
+  Loaded = true;
+}
+
+Error PatmosSimulatorImpl::load(MemoryBufferRef Buffer) {
+  Loaded = false;
+
+  Expected<object::ELF32BEFile> ELF =
+      object::ELF32BEFile::create(Buffer.getBuffer());
+  if (!ELF)
+    return ELF.takeError();
+  if (ELF->getHeader().e_machine != ELF::EM_PATMOS)
+    return createStringError(inconvertibleErrorCode(),
+                             "'%s' is not a Patmos executable",
+                             Buffer.getBufferIdentifier().str().c_str());
+
+  resetMemory();
+
+  auto Headers = ELF->program_headers();
+  if (!Headers)
+    return Headers.takeError();
+  for (const auto &Phdr : *Headers) {
+    if (Phdr.p_type != ELF::PT_LOAD)
+      continue;
+    if ((uint64_t)Phdr.p_vaddr + Phdr.p_memsz > Memory.size() ||
+        (uint64_t)Phdr.p_offset + Phdr.p_filesz > Buffer.getBufferSize() ||
+        Phdr.p_filesz > Phdr.p_memsz)
+      return createStringError(inconvertibleErrorCode(),
+                               "segment at 0x%x does not fit into the memory",
+                               (unsigned)Phdr.p_vaddr);
+    std::copy_n(Buffer.getBuffer().bytes_begin() + Phdr.p_offset,
+                (size_t)Phdr.p_filesz, Memory.begin() + Phdr.p_vaddr);
+  }
+
+  reset(ELF->getHeader().e_entry);
+  return Error::success();
+}
+
+Error PatmosSimulatorImpl::loadFunction(ArrayRef<uint8_t> Code,
+                                        ArrayRef<uint32_t> Args) {
+  Loaded = false;
+
+  resetMemory();
+  if (FunctionBase + Code.size() > Memory.size())
+    return createStringError(inconvertibleErrorCode(),
+                             "function of %u bytes does not fit into the memory",
+                             (unsigned)Code.size());
+  if (Args.size() > 6)
+    return createStringError(inconvertibleErrorCode(),
+                             "at most 6 arguments are passed in registers");
+
+  // the size of the method precedes it, see enterMethod
+  support::endian::write32be(&Memory[FunctionBase - 4], Code.size());
+  std::copy(Code.begin(), Code.end(), Memory.begin() + FunctionBase);
+
+  reset(FunctionBase);
+
+  // called with an empty return base, the program halts when the function
+  // returns; the frames of the caller fill the stack cache
+  for (unsigned i = 0; i < Args.size(); i++)
+    Regs.R[3 + i] = Args[i];
+  Regs.S[SReg_ST] = Memory.size() - StackCacheSize;
+  return Error::success();
+}
+
+Error PatmosSimulatorImpl::run(uint64_t MaxCycles) {
+  if (!Loaded)
+    return createStringError(inconvertibleErrorCode(), "no program loaded");
+  if (Failed)
+    return createStringError(inconvertibleErrorCode(), FailMessage);
+
+  SimBlock *B = getBlock(PC);
+  while (!Halted && (!MaxCycles || Stats.Cycles < MaxCycles)) {
+    uint64_t Start = Stats.Cycles;
+    uint32_t FallThrough = B->End;
+    execute(*B);
+    B->Executions++;
+    B->Cycles += Stats.Cycles - Start;
+
+    if (LLVM_UNLIKELY(Failed))
+      return createStringError(inconvertibleErrorCode(), FailMessage);
+    if (Halted)
+      break;
+
+    SimBlock *&Next = PC == FallThrough ? B->FallThrough : B->Taken;
+    if (!Next || Next->Start != PC)
+      Next = getBlock(PC);
+    B = Next;
+  }
+  return Error::success();
+}
+
+//===----------------------------------------------------------------------===//
+// PatmosSimulator
+//===----------------------------------------------------------------------===//
+
+PatmosSimulator::PatmosSimulator(const PatmosTargetMachine &TM,
+                                 raw_ostream &UART)
+  : Impl(new PatmosSimulatorImpl(TM, UART))
+{
+}
+
+PatmosSimulator::~PatmosSimulator() = default;
+
+extern "C" void LLVMInitializePatmosTargetInfo();
+extern "C" void LLVMInitializePatmosTarget();
+extern "C" void LLVMInitializePatmosTargetMC();
+extern "C" void LLVMInitializePatmosDisassembler();
+
+std::unique_ptr<PatmosTargetMachine>
+PatmosSimulator::createTargetMachine(std::string &Message) {
+  LLVMInitializePatmosTargetInfo();
+  LLVMInitializePatmosTarget();
+  LLVMInitializePatmosTargetMC();
+  LLVMInitializePatmosDisassembler();
+
+  Triple TT("patmos-unknown-unknown-elf");
+  const Target *T = TargetRegistry::lookupTarget(TT.str(), Message);
+  if (!T)
+    return nullptr;
+
+  TargetMachine *TM = T->createTargetMachine(TT.str(), "", "",
+                                             TargetOptions(), None);
+  if (!TM) {
+    Message = "cannot create the Patmos target machine";
+    return nullptr;
+  }
+  return std::unique_ptr<PatmosTargetMachine>(
+      static_cast<PatmosTargetMachine *>(TM));
+}
+
+Error PatmosSimulator::load(MemoryBufferRef Buffer) {
+  return Impl->load(Buffer);
+}
+
+Error PatmosSimulator::load(StringRef Filename) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      MemoryBuffer::getFile(Filename);
+  if (std::error_code EC = Buffer.getError())
+    return createStringError(EC, "%s: %s", Filename.str().c_str(),
+                             EC.message().c_str());
+  return Impl->load((*Buffer)->getMemBufferRef());
+}
+
+Error PatmosSimulator::loadFunction(ArrayRef<uint8_t> Code,
+                                    ArrayRef<uint32_t> Args) {
+  return Impl->loadFunction(Code, Args);
+}
+
+Error PatmosSimulator::run(uint64_t MaxCycles) {
+  return Impl->run(MaxCycles);
+}
+
+bool PatmosSimulator::hasHalted() const {
+  return Impl->Halted;
+}
+
+uint32_t PatmosSimulator::getExitCode() const {
+  return Impl->Regs.R[1];
+}
+
+const PatmosSimulatorStats &PatmosSimulator::getStats() const {
+  return Impl->Stats;
+}
+
+void PatmosSimulator::forEachBlock(function_ref<void(uint32_t, uint32_t,
+                                                     uint64_t,
+                                                     uint64_t)> Fn) const {
+  std::vector<const SimBlock *> Executed;
+  for (const auto &B : Impl->Blocks) {
+    if (B.second && B.second->Executions)
+      Executed.push_back(B.second.get());
+  }
+  std::sort(Executed.begin(), Executed.end(),
+            [](const SimBlock *A, const SimBlock *B) {
+              return A->Start < B->Start;
+            });
+  for (const SimBlock *B : Executed)
+    Fn(B->Start, B->End, B->Executions, B->Cycles);
+}
@@ -0,0 +1,138 @@
+//===-- PatmosSimulator.h - Embeddable Patmos ISA simulator. -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Simulate Patmos programs in-process and cycle-approximately, e.g., for the
+// benchmark loops of the autotuner, which otherwise start pasim for every run
+// and read its trace back from a file.
+//
+// The bundles of the program are decoded by the Patmos disassembler once per
+// basic block, and predecoded into operations holding their handler and their
+// register numbers and immediates. The blocks are cached by their address and
+// executed by calling the handlers in turn (direct threading).
+//
+// A bundle takes one cycle. Stalls are added for misses in the method cache,
+// spills and fills of the stack cache, misses in the data cache, accesses of
+// the main memory bypassing the caches, and non-delayed branches. The geometry
+// of the caches and the timing of the main memory are those of the
+// PatmosSubtarget, i.e., of the -mpatmos-* options and -mpatmos-hw-config.
+// Results become visible after their latency in the itineraries of
+// PatmosSchedule.td, e.g., the delay slot of a load still sees the old value
+// of its destination, as on the hardware.
+//
+// The contents of the stack cache are kept in the main memory at their
+// addresses, spilling and filling the stack cache only takes time. Interrupts,
+// exceptions and the instruction cache are not simulated. The program halts
+// when it branches or returns to address 0, with its exit code in r1.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _LLVM_TARGET_PATMOS_SIMULATOR_H_
+#define _LLVM_TARGET_PATMOS_SIMULATOR_H_
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llvm {
+  class PatmosSimulatorImpl;
+  class PatmosTargetMachine;
+  class raw_ostream;
+
+  /// Statistics of a simulation, in events and cycles.
+  struct PatmosSimulatorStats {
+    /// Cycles, including all stalls.
+    uint64_t Cycles = 0;
+
+    /// Executed bundles and instructions, including those whose guard was
+    /// false.
+    uint64_t Bundles = 0;
+    uint64_t Instructions = 0;
+
+    /// Method cache hits and misses, and the cycles spent filling it.
+    uint64_t MethodCacheHits = 0;
+    uint64_t MethodCacheMisses = 0;
+    uint64_t MethodCacheStalls = 0;
+
+    /// Bytes spilled and filled by the stack cache, and the cycles spent.
+    uint64_t StackCacheSpillBytes = 0;
+    uint64_t StackCacheFillBytes = 0;
+    uint64_t StackCacheStalls = 0;
+
+    /// Data cache load hits and misses, and the cycles spent on misses.
+    uint64_t DataCacheHits = 0;
+    uint64_t DataCacheMisses = 0;
+    uint64_t DataCacheStalls = 0;
+
+    /// Cycles spent on stores and uncached loads of the main memory.
+    uint64_t MemoryStalls = 0;
+
+    /// Cycles spent on taken non-delayed branches.
+    uint64_t BranchStalls = 0;
+  };
+
+  /// A simulator of a Patmos core, configured by the subtarget of a target
+  /// machine.
+  class PatmosSimulator {
+  private:
+    std::unique_ptr<PatmosSimulatorImpl> Impl;
+
+  public:
+    /// Create a simulator for the subtarget of TM, writing the output of the
+    /// program to the UART into UART.
+    PatmosSimulator(const PatmosTargetMachine &TM, raw_ostream &UART);
+    ~PatmosSimulator();
+
+    /// createTargetMachine - Create a Patmos target machine with the
+    /// subtarget given on the command line, initializing the Patmos target
+    /// and its disassembler. Returns null and sets Message on failure.
+    static std::unique_ptr<PatmosTargetMachine>
+      createTargetMachine(std::string &Message);
+
+    /// load - Load the segments of an ELF executable into the main memory and
+    /// reset the core to its entry point.
+    Error load(MemoryBufferRef Buffer);
+    Error load(StringRef Filename);
+
+    /// loadFunction - Load the code of a single function, without the size
+    /// word in front of it, into an otherwise empty main memory, and reset the
+    /// core to call it with Args in r3 and the following registers. The
+    /// program halts when the function returns. The memory below the
+    /// function is free for its data, e.g., for code snippets measured by
+    /// llvm-exegesis.
+    Error loadFunction(ArrayRef<uint8_t> Code, ArrayRef<uint32_t> Args);
+
+    /// run - Run the program until it halts, or for at most MaxCycles cycles
+    /// if not zero. Returns an error for illegal instructions and accesses.
+    Error run(uint64_t MaxCycles = 0);
+
+    /// hasHalted - Check whether the program halted.
+    bool hasHalted() const;
+
+    /// getExitCode - Return the exit code of the halted program.
+    uint32_t getExitCode() const;
+
+    /// getStats - Return the statistics since the program was loaded.
+    const PatmosSimulatorStats &getStats() const;
+
+    /// forEachBlock - Call Fn for every block that was executed, with the
+    /// address range of the block, the number of its executions and the
+    /// cycles spent on them, including the stalls.
+    void forEachBlock(function_ref<void(uint32_t Start, uint32_t End,
+                                        uint64_t Executions,
+                                        uint64_t Cycles)> Fn) const;
+  };
+}
+
+#endif // _LLVM_TARGET_PATMOS_SIMULATOR_H_
@@ -357,7 +357,8 @@ static std::deque<const MachineBasicBlock*> fcfg_topo_sort(
 /// MachineBasicBlock and MachineLoopInfo.
 template<
 	typename MachineBasicBlock,
-	typename MachineLoopInfo
+	typename MachineLoopInfo,
+	typename ConstantBounds
 >
 static std::tuple<
 	DomMap<MachineBasicBlock>,
@@ -367,7 +368,7 @@ static std::tuple<
 constantLoopDominatorsAnalysisImpl(
 		const MachineBasicBlock *start_mbb,
 		const MachineLoopInfo *LI,
-		bool (*constantBounds)(const MachineBasicBlock *mbb)
+		ConstantBounds constantBounds
 ) {
 	LLVM_DEBUG(dbgs() << "\nStarting Bounded Dominator Analysis: "<< start_mbb->getName() << "\n");
 	DomMap<MachineBasicBlock> dominators;
@@ -569,13 +570,14 @@ constantLoopDominatorsAnalysisImpl(
 /// MachineBasicBlock and MachineLoopInfo.
 template<
 	typename MachineBasicBlock,
-	typename MachineLoopInfo
+	typename MachineLoopInfo,
+	typename ConstantBounds
 >
 DomMap<MachineBasicBlock>
 constantLoopDominatorsAnalysis(
 		const MachineBasicBlock *start_mbb,
 		const MachineLoopInfo *LI,
-		bool (*constantBounds)(const MachineBasicBlock *mbb),
+		ConstantBounds constantBounds,
 		bool end_doms_only = true
 ) {
 	assert(start_mbb->pred_size() == 0
@@ -17,39 +17,58 @@
 #include "ConstantLoopDominators.h"
 #include "TargetInfo/PatmosTargetInfo.h"
 #include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/InitializePasses.h"
 
 using namespace llvm;
 
+INITIALIZE_PASS_BEGIN(ConstantLoopDominators, "patmos-constant-loop-dominators",
+                      "Patmos Constant-Loop Dominators", true, true)
+INITIALIZE_PASS_DEPENDENCY(MachineLoopInfo)
+INITIALIZE_PASS_DEPENDENCY(PatmosLoopBoundInfo)
+INITIALIZE_PASS_END(ConstantLoopDominators, "patmos-constant-loop-dominators",
+                    "Patmos Constant-Loop Dominators", true, true)
 
 char ConstantLoopDominators::ID = 0;
 
-/// createDataCacheAccessEliminationPass - Returns a new DataCacheAccessElimination
-/// \see DataCacheAccessElimination
-FunctionPass *llvm::createPatmosConstantLoopDominatorsPass() {
-  return new ConstantLoopDominators();
-}
-
-static bool constantBounds(const MachineBasicBlock *mbb) {
-  if(auto bounds = getLoopBounds(mbb)) {
-    return bounds->first == bounds->second;
-  }
-  return false;
-}
-
-void ConstantLoopDominators::calculate(MachineFunction &MF, MachineLoopInfo &LI) {
+void ConstantLoopDominators::calculate(MachineFunction &MF, MachineLoopInfo &LI,
+                                       const PatmosLoopBoundInfo &LBI) {
+  releaseMemory();
   if(PatmosSinglePathInfo::isEnabled(MF)) {
+    auto constantBounds = [&](const MachineBasicBlock *mbb) {
+      if(auto bounds = LBI.getLoopBounds(mbb)) {
+        return bounds->first == bounds->second;
+      }
+      return false;
+    };
     dominators = constantLoopDominatorsAnalysis(MF.getBlockNumbered(0), &LI, constantBounds);
     assert(dominators.size() == 1 && "Single-path code must have only 1 end block");
+
+    for(auto &MBB: MF) {
+      uint64_t count = 1;
+      bool bounded = true;
+      for(auto *loop = LI.getLoopFor(&MBB); loop && bounded; loop = loop->getParentLoop()) {
+        if(auto bounds = LBI.getLoopBounds(loop->getHeader())) {
+          count *= bounds->second;
+        } else {
+          bounded = false;
+        }
+      }
+      if(bounded) {
+        MaxExecutionCounts[&MBB] = count;
+      }
+    }
   }
 }
 
 bool ConstantLoopDominators::runOnMachineFunction(MachineFunction &MF) {
-  calculate(MF, getAnalysis<MachineLoopInfo>());
+  calculate(MF, getAnalysis<MachineLoopInfo>(),
+            getAnalysis<PatmosLoopBoundInfo>());
   return false;
 }
 
 void ConstantLoopDominators::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequired<MachineLoopInfo>();
+  AU.addRequired<PatmosLoopBoundInfo>();
   AU.setPreservesAll();
   MachineFunctionPass::getAnalysisUsage(AU);
 }
@@ -15,37 +15,79 @@
 #define _PATMOS_CONSTANTLOOPDOMINATORS_H_
 
 #include "PatmosTargetMachine.h"
+#include "TargetInfo/PatmosTargetInfo.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/ADT/DenseMap.h"
 
 #include <set>
 #include <map>
 
 namespace llvm {
 
+void initializeConstantLoopDominatorsPass(PassRegistry &);
+
+/// Analysis of the blocks that dominate the end of a single-path function,
+/// with only loops of constant bounds in between. Such blocks are executed
+/// the same number of times in every execution of the function.
 ///
+/// The analysis is required by the passes that need it, and is recomputed
+/// once a pass in between does not preserve it.
 class ConstantLoopDominators : public MachineFunctionPass {
 public:
   std::map<const MachineBasicBlock*, std::set<const MachineBasicBlock*>> dominators;
+
+private:
+  /// Maximum execution count of each block per execution of the function,
+  /// for blocks all of whose loops have bounds.
+  DenseMap<const MachineBasicBlock*, uint64_t> MaxExecutionCounts;
+
+public:
   /// Pass ID
   static char ID;
 
-  ConstantLoopDominators() : MachineFunctionPass(ID){};
+  ConstantLoopDominators() : MachineFunctionPass(ID) {
+    initializeConstantLoopDominatorsPass(*PassRegistry::getPassRegistry());
+  }
 
-  explicit ConstantLoopDominators(MachineFunction &MF, MachineLoopInfo &LI)
-        : MachineFunctionPass(ID) {
-      calculate(MF, LI);
+  explicit ConstantLoopDominators(MachineFunction &MF, MachineLoopInfo &LI,
+                                  const PatmosLoopBoundInfo &LBI)
+        : ConstantLoopDominators() {
+      calculate(MF, LI, LBI);
     }
 
   ConstantLoopDominators(const ConstantLoopDominators &) = delete;
   ConstantLoopDominators &operator=(const ConstantLoopDominators &) = delete;
 
-  void calculate(MachineFunction &MF, MachineLoopInfo &LI);
+  void calculate(MachineFunction &MF, MachineLoopInfo &LI,
+                 const PatmosLoopBoundInfo &LBI);
+
+  /// hasConstantExecutionCount - Check whether the block is executed the
+  /// same number of times in every execution of the function, i.e., whether
+  /// it constant-loop dominates the end block.
+  bool hasConstantExecutionCount(const MachineBasicBlock *MBB) const {
+    return !dominators.empty() && dominators.begin()->second.count(MBB);
+  }
+
+  /// getMaxExecutionCount - Get the maximum number of times the block is
+  /// executed per execution of the function, the product of the maximum
+  /// bounds of its loops. None if one of the loops has no bound.
+  Optional<uint64_t> getMaxExecutionCount(const MachineBasicBlock *MBB) const {
+    auto it = MaxExecutionCounts.find(MBB);
+    if (it == MaxExecutionCounts.end())
+      return None;
+    return it->second;
+  }
 
   /// getAnalysisUsage - Specify which passes this pass depends on
   void getAnalysisUsage(AnalysisUsage &AU) const override;
 
+  void releaseMemory() override {
+    dominators.clear();
+    MaxExecutionCounts.clear();
+  }
+
   /// runOnMachineFunction - Run the SP converter on the given function.
   bool runOnMachineFunction(MachineFunction &MF) override;
 
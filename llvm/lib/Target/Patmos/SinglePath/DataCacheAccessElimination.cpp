@@ -1,100 +1,335 @@
-//===-- DataCacheAccessElimination.cpp - Remove unused function declarations ------------===//
-//
-//                     The LLVM Compiler Infrastructure
-//
-// This file is distributed under the University of Illinois Open Source
-// License. See LICENSE.TXT for details.
-//
-//===----------------------------------------------------------------------===//
-//
-// This pass makes the single-pat code utilitize Patmos' dual issue pipeline.
-// TODO: more description
-//
-//===----------------------------------------------------------------------===//
-
-#include "DataCacheAccessElimination.h"
-#include "llvm/ADT/Statistic.h"
-#include "llvm/CodeGen/MachineInstrBuilder.h"
-
-using namespace llvm;
-
-STATISTIC(LoadsConverted,     "Number of data-cache loads converted to direct main memory loads");
-STATISTIC(SavesConverted,     "Number of data-cache saves converted to direct main memory saves");
-
-char DataCacheAccessElimination::ID = 0;
-
-/// createDataCacheAccessEliminationPass - Returns a new DataCacheAccessElimination
-/// \see DataCacheAccessElimination
-FunctionPass *llvm::createDataCacheAccessEliminationPass(const PatmosTargetMachine &tm) {
-  return new DataCacheAccessElimination(tm);
-}
-
-bool DataCacheAccessElimination::runOnMachineFunction(MachineFunction &MF) {
-  // only convert function if marked
-  if ( PatmosSinglePathInfo::isEnabled(MF) ) {
-    eliminateDCAccesses(MF);
-  }
-
-  return true;
-}
-
-void DataCacheAccessElimination::eliminateDCAccesses(MachineFunction &MF)
-{
-  for(auto BB_iter = MF.begin(), BB_iter_end = MF.end(); BB_iter != BB_iter_end; ++BB_iter){
-    for(auto instr_iter = BB_iter->begin(), instr_iter_end = BB_iter->end(); instr_iter != instr_iter_end; ++instr_iter){
-      unsigned convert_to;
-      switch( instr_iter->getOpcode() ){
-        case Patmos::LWC:
-          LoadsConverted++;
-          convert_to = Patmos::LWM;
-          break;
-        case Patmos::LHC:
-          LoadsConverted++;
-          convert_to = Patmos::LHM;
-          break;
-        case Patmos::LBC:
-          LoadsConverted++;
-          convert_to = Patmos::LBM;
-          break;
-        case Patmos::LHUC:
-          LoadsConverted++;
-          convert_to = Patmos::LHUM;
-          break;
-        case Patmos::LBUC:
-          LoadsConverted++;
-          convert_to = Patmos::LBUM;
-          break;
-        case Patmos::SWC:
-          SavesConverted++;
-          convert_to = Patmos::SWM;
-          break;
-        case Patmos::SHC:
-          SavesConverted++;
-          convert_to = Patmos::SHM;
-          break;
-        case Patmos::SBC:
-          SavesConverted++;
-          convert_to = Patmos::SBM;
-          break;
-        default:
-          // Not a data cache accesses, ignore
-          continue;
-      }
-
-      // Create new instruction accessing main memory instead
-      auto *new_instr = MF.CreateMachineInstr( TII->get(convert_to), instr_iter->getDebugLoc());
-      MachineInstrBuilder new_instr_builder(MF, new_instr);
-
-      // Give it the same operands
-      for(auto op: instr_iter->operands()) {
-        new_instr_builder.add(op);
-      }
-
-      // Replace old instruction by new one in BB
-      BB_iter->insertAfter(instr_iter, new_instr);
-      instr_iter = BB_iter->erase(&*instr_iter);
-    }
-  }
-}
-
-
+//===-- DataCacheAccessElimination.cpp - Remove unused function declarations ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Converts the data-cache accesses of single-path code to main-memory
+// accesses, whose latency does not depend on the state of the cache.
+//
+// Loads of constant globals, whose address is found by following the
+// definitions of the base register, are replaced by the loaded value instead,
+// as no other function can change it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DataCacheAccessElimination.h"
+#include "MCTargetDesc/PatmosBaseInfo.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+STATISTIC(LoadsConverted,     "Number of data-cache loads converted to direct main memory loads");
+STATISTIC(SavesConverted,     "Number of data-cache saves converted to direct main memory saves");
+STATISTIC(LoadsFolded,        "Number of data-cache loads of constant globals replaced by their value");
+
+static cl::opt<std::string> DCEliminationReport(
+  "mpatmos-dcache-elimination-report",
+  cl::init(""),
+  cl::desc("Write the data-cache accesses eliminated in single-path functions "
+           "and the addresses they use as JSON to the given file."),
+  cl::Hidden);
+
+char DataCacheAccessElimination::ID = 0;
+
+/// createDataCacheAccessEliminationPass - Returns a new DataCacheAccessElimination
+/// \see DataCacheAccessElimination
+FunctionPass *llvm::createDataCacheAccessEliminationPass(const PatmosTargetMachine &tm) {
+  return new DataCacheAccessElimination(tm);
+}
+
+bool DataCacheAccessElimination::runOnMachineFunction(MachineFunction &MF) {
+  // only convert function if marked
+  if ( PatmosSinglePathInfo::isEnabled(MF) ) {
+    eliminateDCAccesses(MF);
+  }
+
+  return true;
+}
+
+bool DataCacheAccessElimination::doFinalization(Module &M) {
+  if (!DCEliminationReport.empty()) {
+    std::error_code EC;
+    raw_fd_ostream OS(DCEliminationReport, EC, sys::fs::OF_Text);
+    if (EC) {
+      report_fatal_error("Cannot open data-cache elimination report '" +
+                         DCEliminationReport + "': " + EC.message());
+    }
+    json::Value value(json::Object{{"accesses", std::move(Report)}});
+    OS << formatv("{0:2}", value) << "\n";
+    Report = json::Array();
+  }
+  return false;
+}
+
+DataCacheAccessElimination::AccessedAddress
+DataCacheAccessElimination::getAccessedAddress(const MachineInstr &MI,
+                                               unsigned Size) const {
+  const MachineRegisterInfo &MRI = MI.getMF()->getRegInfo();
+  AccessedAddress result;
+
+  // The address follows the guard, its offset is scaled by the access' size
+  auto base_idx = MI.findFirstPredOperandIdx() + 2;
+  auto &base = MI.getOperand(base_idx);
+  auto &offset_op = MI.getOperand(base_idx + 1);
+  if (offset_op.isGlobal()) {
+    // A small global relative to the small data base
+    if (offset_op.getTargetFlags() == PatmosII::MO_SDA) {
+      result.Kind = AccessedAddress::Global;
+      result.GV = offset_op.getGlobal();
+      result.Offset = offset_op.getOffset();
+    }
+    return result;
+  }
+  int64_t offset = offset_op.getImm() * Size;
+
+  if (base.isFI()) {
+    result.Kind = AccessedAddress::Frame;
+    result.FI = base.getIndex();
+    result.Offset = offset;
+    return result;
+  }
+
+  // Follow the (SSA) definitions of the base register, accumulating constant
+  // offsets, until the address is found.
+  Register reg = base.getReg();
+  while (reg.isVirtual()) {
+    auto *def = MRI.getUniqueVRegDef(reg);
+    if (!def) {
+      return result;
+    }
+
+    switch (def->getOpcode()) {
+    case Patmos::COPY:
+      reg = def->getOperand(1).getReg();
+      continue;
+    case Patmos::ADDi: case Patmos::ADDl:
+      if (def->getOperand(4).isGlobal()) {
+        // A global indexed by a register, e.g. an array access
+        result.Kind = AccessedAddress::Global;
+        result.GV = def->getOperand(4).getGlobal();
+        if (def->getOperand(4).getTargetFlags() == PatmosII::MO_SDA) {
+          // A small global relative to the small data base
+          result.Offset = offset + def->getOperand(4).getOffset();
+        }
+        return result;
+      }
+      if (!def->getOperand(4).isImm()) {
+        return result;
+      }
+      offset += def->getOperand(4).getImm();
+      reg = def->getOperand(3).getReg();
+      continue;
+    case Patmos::LIi: case Patmos::LIl:
+      if (def->getOperand(3).isGlobal()) {
+        result.Kind = AccessedAddress::Global;
+        result.GV = def->getOperand(3).getGlobal();
+        result.Offset = offset + def->getOperand(3).getOffset();
+      } else if (def->getOperand(3).isImm()) {
+        result.Kind = AccessedAddress::Absolute;
+        result.Offset = offset + def->getOperand(3).getImm();
+      }
+      return result;
+    case Patmos::LIin:
+      result.Kind = AccessedAddress::Absolute;
+      result.Offset = offset - def->getOperand(3).getImm();
+      return result;
+    default:
+      return result;
+    }
+  }
+
+  if (reg == Patmos::R0) {
+    result.Kind = AccessedAddress::Absolute;
+    result.Offset = offset;
+  }
+  return result;
+}
+
+Optional<uint32_t>
+DataCacheAccessElimination::getLoadedConstant(const MachineFunction &MF,
+                                              const AccessedAddress &Address,
+                                              unsigned Size,
+                                              bool Signed) const {
+  if (Address.Kind != AccessedAddress::Global || !Address.Offset) {
+    return None;
+  }
+
+  // Constant globals cannot be written by any function of the program, so
+  // their initializer is the value of every load from them.
+  auto *GV = dyn_cast<GlobalVariable>(const_cast<GlobalValue*>(Address.GV));
+  if (!GV || !GV->isConstant() || !GV->hasDefinitiveInitializer()) {
+    return None;
+  }
+
+  // Only fold loads within the bounds of the global
+  auto &DL = MF.getDataLayout();
+  if (*Address.Offset < 0 ||
+      *Address.Offset + Size > DL.getTypeAllocSize(GV->getValueType())) {
+    return None;
+  }
+
+  auto &C = GV->getContext();
+  auto *type = Type::getIntNTy(C, Size * 8);
+  auto *ptr = ConstantExpr::getGetElementPtr(Type::getInt8Ty(C),
+      ConstantExpr::getBitCast(GV, Type::getInt8PtrTy(C, GV->getAddressSpace())),
+      ConstantInt::get(Type::getInt32Ty(C), *Address.Offset));
+  ptr = ConstantExpr::getBitCast(ptr, type->getPointerTo(GV->getAddressSpace()));
+
+  auto *value = dyn_cast_or_null<ConstantInt>(
+      ConstantFoldLoadFromConstPtr(ptr, type, DL));
+  if (!value) {
+    return None;
+  }
+  return (uint32_t)(Signed ? value->getSExtValue() : value->getZExtValue());
+}
+
+json::Object
+DataCacheAccessElimination::describeAddress(const MachineFunction &MF,
+                                            const AccessedAddress &Address) {
+  json::Object result;
+  switch (Address.Kind) {
+  case AccessedAddress::Unknown:
+    result["kind"] = "unknown";
+    break;
+  case AccessedAddress::Absolute:
+    result["kind"] = "absolute";
+    break;
+  case AccessedAddress::Frame:
+    result["kind"] = "frame";
+    result["frame-index"] = Address.FI;
+    break;
+  case AccessedAddress::Global:
+    result["kind"] = "global";
+    result["symbol"] = Address.GV->getName();
+    result["size"] = (int64_t)MF.getDataLayout().getTypeAllocSize(Address.GV->getValueType());
+    break;
+  }
+  if (Address.Offset) {
+    result["offset"] = *Address.Offset;
+  }
+  return result;
+}
+
+void DataCacheAccessElimination::eliminateDCAccesses(MachineFunction &MF)
+{
+  for(auto BB_iter = MF.begin(), BB_iter_end = MF.end(); BB_iter != BB_iter_end; ++BB_iter){
+    for(auto instr_iter = BB_iter->begin(), instr_iter_end = BB_iter->end(); instr_iter != instr_iter_end; ++instr_iter){
+      unsigned convert_to;
+      unsigned size;
+      bool is_signed = false;
+      switch( instr_iter->getOpcode() ){
+        case Patmos::LWC:
+          convert_to = Patmos::LWM;
+          size = 4;
+          break;
+        case Patmos::LHC:
+          convert_to = Patmos::LHM;
+          size = 2;
+          is_signed = true;
+          break;
+        case Patmos::LBC:
+          convert_to = Patmos::LBM;
+          size = 1;
+          is_signed = true;
+          break;
+        case Patmos::LHUC:
+          convert_to = Patmos::LHUM;
+          size = 2;
+          break;
+        case Patmos::LBUC:
+          convert_to = Patmos::LBUM;
+          size = 1;
+          break;
+        case Patmos::SWC:
+          SavesConverted++;
+          convert_to = Patmos::SWM;
+          size = 4;
+          break;
+        case Patmos::SHC:
+          SavesConverted++;
+          convert_to = Patmos::SHM;
+          size = 2;
+          break;
+        case Patmos::SBC:
+          SavesConverted++;
+          convert_to = Patmos::SBM;
+          size = 1;
+          break;
+        default:
+          // Not a data cache accesses, ignore
+          continue;
+      }
+
+      auto address = getAccessedAddress(*instr_iter, size);
+      Optional<uint32_t> constant;
+      if (instr_iter->mayLoad()) {
+        constant = getLoadedConstant(MF, address, size, is_signed);
+      }
+
+      if (!DCEliminationReport.empty()) {
+        Report.push_back(json::Object{
+          {"function", MF.getFunction().getName()},
+          {"block", BB_iter->getNumber()},
+          {"instruction", TII->getName(instr_iter->getOpcode())},
+          {"address", describeAddress(MF, address)},
+          {"replacement", constant ? StringRef("constant") :
+                                     TII->getName(convert_to)}
+        });
+      }
+
+      MachineInstr *new_instr;
+      if (constant) {
+        // The load always reads the same value, so no memory is accessed at all
+        LoadsFolded++;
+        unsigned li_opcode;
+        int64_t imm;
+        if (isUInt<12>(*constant)) {
+          li_opcode = Patmos::LIi;
+          imm = *constant;
+        } else if (isUInt<12>(-*constant)) {
+          li_opcode = Patmos::LIin;
+          imm = -*constant;
+        } else {
+          li_opcode = Patmos::LIl;
+          imm = (int32_t)*constant;
+        }
+        new_instr = MF.CreateMachineInstr( TII->get(li_opcode), instr_iter->getDebugLoc());
+        MachineInstrBuilder(MF, new_instr)
+          .add(instr_iter->getOperand(0))
+          .add(instr_iter->getOperand(1))
+          .add(instr_iter->getOperand(2))
+          .addImm(imm);
+      } else {
+        if (instr_iter->mayLoad()) {
+          LoadsConverted++;
+        }
+
+        // Create new instruction accessing main memory instead
+        new_instr = MF.CreateMachineInstr( TII->get(convert_to), instr_iter->getDebugLoc());
+        MachineInstrBuilder new_instr_builder(MF, new_instr);
+
+        // Give it the same operands
+        for(auto op: instr_iter->operands()) {
+          new_instr_builder.add(op);
+        }
+      }
+
+      // Replace old instruction by new one in BB
+      BB_iter->insertAfter(instr_iter, new_instr);
+      instr_iter = BB_iter->erase(&*instr_iter);
+    }
+  }
+}
@@ -1,55 +1,87 @@
-#ifndef TARGET_PATMOS_SINGLEPATH_DATACACHEACCESSELIMINATION_H_
-#define TARGET_PATMOS_SINGLEPATH_DATACACHEACCESSELIMINATION_H_
-
-#include "Patmos.h"
-#include "PatmosSinglePathInfo.h"
-
-#define DEBUG_TYPE "patmos-singlepath"
-
-namespace llvm {
-
-class DataCacheAccessElimination : public MachineFunctionPass {
-
-private:
-
-  const PatmosTargetMachine &TM;
-  const PatmosSubtarget &STC;
-  const PatmosInstrInfo *TII;
-  const PatmosRegisterInfo *TRI;
-
-  void eliminateDCAccesses(MachineFunction &MF);
-
-public:
-  static char ID;
-  DataCacheAccessElimination(const PatmosTargetMachine &tm):
-       MachineFunctionPass(ID), TM(tm),
-       STC(*tm.getSubtargetImpl()),
-       TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())),
-       TRI(static_cast<const PatmosRegisterInfo*>(tm.getRegisterInfo()))
-  {}
-
-  /// getPassName - Return the pass' name.
-  StringRef getPassName() const override {
-    return "Patmos Single-Path Data-Cache Access elimination (machine code)";
-  }
-
-  /// getAnalysisUsage - Specify which passes this pass depends on
-  void getAnalysisUsage(AnalysisUsage &AU) const override {
-    MachineFunctionPass::getAnalysisUsage(AU);
-  }
-
-  bool doInitialization(Module &M) override {
-    return false;
-  }
-
-  bool doFinalization(Module &M) override {
-    return false;
-  }
-
-  bool runOnMachineFunction(MachineFunction &MF) override ;
-
- };
-
-}
-
-#endif /* TARGET_PATMOS_SINGLEPATH_DATACACHEACCESSELIMINATION_H_ */
+#ifndef TARGET_PATMOS_SINGLEPATH_DATACACHEACCESSELIMINATION_H_
+#define TARGET_PATMOS_SINGLEPATH_DATACACHEACCESSELIMINATION_H_
+
+#include "Patmos.h"
+#include "PatmosSinglePathInfo.h"
+#include "llvm/Support/JSON.h"
+
+#define DEBUG_TYPE "patmos-singlepath"
+
+namespace llvm {
+
+class DataCacheAccessElimination : public MachineFunctionPass {
+
+private:
+
+  const PatmosTargetMachine &TM;
+  const PatmosSubtarget &STC;
+  const PatmosInstrInfo *TII;
+  const PatmosRegisterInfo *TRI;
+
+  /// What is known about the address a data-cache access uses.
+  struct AccessedAddress {
+    enum { Unknown, Absolute, Frame, Global } Kind = Unknown;
+
+    /// The accessed global, if the kind is 'Global'
+    const GlobalValue *GV = nullptr;
+
+    /// The accessed frame index, if the kind is 'Frame'
+    int FI = 0;
+
+    /// The byte offset of the access from the global, the frame object or
+    /// address 0, if it is constant.
+    Optional<int64_t> Offset;
+  };
+
+  /// The eliminated accesses of all functions, reported in doFinalization
+  json::Array Report;
+
+  /// Finds the address the given access uses by following the definitions of
+  /// its base register. Size is the number of bytes it accesses.
+  AccessedAddress getAccessedAddress(const MachineInstr &MI,
+                                     unsigned Size) const;
+
+  /// Returns the value the given load reads, if it reads a constant global
+  /// whose initializer is known.
+  Optional<uint32_t> getLoadedConstant(const MachineFunction &MF,
+                                       const AccessedAddress &Address,
+                                       unsigned Size, bool Signed) const;
+
+  /// Returns a JSON description of the given address for the report.
+  static json::Object describeAddress(const MachineFunction &MF,
+                                      const AccessedAddress &Address);
+
+  void eliminateDCAccesses(MachineFunction &MF);
+
+public:
+  static char ID;
+  DataCacheAccessElimination(const PatmosTargetMachine &tm):
+       MachineFunctionPass(ID), TM(tm),
+       STC(*tm.getSubtargetImpl()),
+       TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())),
+       TRI(static_cast<const PatmosRegisterInfo*>(tm.getRegisterInfo()))
+  {}
+
+  /// getPassName - Return the pass' name.
+  StringRef getPassName() const override {
+    return "Patmos Single-Path Data-Cache Access elimination (machine code)";
+  }
+
+  /// getAnalysisUsage - Specify which passes this pass depends on
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    MachineFunctionPass::getAnalysisUsage(AU);
+  }
+
+  bool doInitialization(Module &M) override {
+    return false;
+  }
+
+  bool doFinalization(Module &M) override;
+
+  bool runOnMachineFunction(MachineFunction &MF) override ;
+
+ };
+
+}
+
+#endif /* TARGET_PATMOS_SINGLEPATH_DATACACHEACCESSELIMINATION_H_ */
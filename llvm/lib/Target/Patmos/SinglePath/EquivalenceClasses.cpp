@@ -5,6 +5,7 @@
 #include "SinglePath/ConstantLoopDominatorAnalysis.h" // for "get_intersection"
 #include "SinglePath/FCFGPostDom.h"
 #include "TargetInfo/PatmosTargetInfo.h"
+#include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/GraphTraits.h"
 #include "llvm/ADT/DepthFirstIterator.h"
 #include "llvm/ADT/Statistic.h"
@@ -65,29 +66,39 @@ bool EquivalenceClasses::runOnMachineFunction(MachineFunction &MF) {
 	);
 
 	// Find equivalence classes
-	// Blocks are in the same equivalence class when they have the same control dependencies
-	unsigned next_class_number = 0;
+	// Blocks are in the same equivalence class when they have the same control dependencies,
+	// so the dependency sets are used as keys to find the class of each block.
+	std::map<
+		std::set<std::pair<Optional<MachineBasicBlock*>,MachineBasicBlock*>>,
+		unsigned
+	> class_of_deps;
 	classes.clear();
+	block_classes.clear();
 
 	std::for_each(MF.begin(), MF.end(), [&](auto &mbb){
-		// Check if class already exists
-		auto found = std::find_if(classes.begin(), classes.end(), [&](auto entry){
-			return deps[&mbb] == entry.second.first;
-		});
+		auto &mbb_deps = deps[&mbb];
+		auto found = class_of_deps.find(mbb_deps);
 
-		if(found != classes.end()) {
-			found->second.second.insert(&mbb);
+		unsigned class_nr;
+		if(found != class_of_deps.end()) {
+			class_nr = found->second;
 		} else {
-			classes[next_class_number++] = std::make_pair(deps[&mbb], std::set<MachineBasicBlock*>({&mbb}));
+			class_nr = classes.size();
+			class_of_deps[mbb_deps] = class_nr;
+			classes.push_back(EqClass{class_nr, mbb_deps, {}});
 		}
+		classes[class_nr].members.insert(&mbb);
+		block_classes[&mbb] = class_nr;
 	});
 	NrEquivalenceClasses += classes.size();
 
+	computeClassDependencies(MF, LI);
+
 	LLVM_DEBUG(
 		dbgs() << "Equivalence Classes:\n";
-		for(auto entry: classes){
-			dbgs() << "(" << entry.first << "):\n\tControl Dependencies: {";
-			for(auto edge: entry.second.first){
+		for(auto &eq_class: classes){
+			dbgs() << "(" << eq_class.number << "):\n\tControl Dependencies: {";
+			for(auto edge: eq_class.dependencies){
 				dbgs() << "(";
 				if(edge.first) {
 					dbgs() << "bb." << (*edge.first)->getNumber() ;
@@ -95,12 +106,11 @@ bool EquivalenceClasses::runOnMachineFunction(MachineFunction &MF) {
 				dbgs() << " -> bb." << edge.second->getNumber()  << "), ";
 			}
 			dbgs() << "}\n\tBlocks:{";
-			for(auto block: entry.second.second){
+			for(auto block: eq_class.members){
 				dbgs() << "bb." << block->getNumber()  << ", ";
 			}
 			dbgs() << "}\n";
 		}
-		auto class_dependencies = getAllClassDependencies();
 		dbgs() << "Equivalence Class Dependencies:\n";
 		for(auto entry: class_dependencies) {
 			dbgs() << entry.first << ": ";
@@ -114,87 +124,105 @@ bool EquivalenceClasses::runOnMachineFunction(MachineFunction &MF) {
 	return false;
 }
 
-std::vector<EqClass> EquivalenceClasses::getAllClasses() const {
-	std::vector<EqClass> result;
-
-	for(auto entry: classes){
-		result.push_back( EqClass{
-			entry.first, entry.second.first, entry.second.second
-		});
-	}
-
-	return result;
+const std::vector<EqClass> &EquivalenceClasses::getAllClasses() const {
+	return classes;
 }
 
-EqClass EquivalenceClasses::getClassFor(MachineBasicBlock *mbb) const{
-	auto found = std::find_if(classes.begin(), classes.end(), [&](auto entry){
-		return entry.second.second.count(mbb);
-	});
+const EqClass &EquivalenceClasses::getClassFor(MachineBasicBlock *mbb) const{
+	auto found = block_classes.find(mbb);
 
-	assert(found != classes.end() && "No class for block");
+	assert(found != block_classes.end() && "No class for block");
 
-	return EqClass{
-		found->first, found->second.first, found->second.second
-	};
+	return classes[found->second];
 }
 
-std::map<unsigned, std::set<unsigned>> EquivalenceClasses::getAllClassDependencies() const {
+void EquivalenceClasses::computeClassDependencies(MachineFunction &MF, MachineLoopInfo &LI) {
 	// Two classes are dependent if either of them is reachable from the other without
 	// taking any back edges
 
-	MachineDominatorTree MDT(*(*classes.begin()->second.second.begin())->getParent());
-	MachineLoopInfo LI(MDT);
-
-	std::map<unsigned, std::set<unsigned>> dependencies;
-
-	// For each class we use breadth first search while ignoring back edges.
-	// For any pair of classes reachable become dependent on each other.
-	for(auto entry: classes) {
-		auto class_nr = entry.first;
-		auto class_blocks = entry.second.second;
-
-		// Start from all the class's blocks
-		std::deque<MachineBasicBlock*> worklist;
-		for(auto block: class_blocks) {
-			worklist.push_back(block);
+	// returns whether the edge between the two blocks is a back edge.
+	auto is_back_edge = [&](auto source, auto target){
+		if(LI.isLoopHeader(target)) {
+			if(auto target_loop = LI.getLoopFor(target)) {
+				auto preheader = PatmosSinglePathInfo::getPreHeaderUnilatch(target_loop).first;
+				return source != preheader;
+			} else {
+				// Root loop (NULL) cannot have back edge
+			}
+		} else {
+			// Back edges must target a header
 		}
+		return false;
+	};
 
-		std::set<MachineBasicBlock*> donelist;
-		while(!worklist.empty()) {
-			auto block = worklist.front();
-			worklist.pop_front();
-			if(donelist.count(block)) continue;
-			donelist.insert(block);
-
-			auto block_class_nr = EquivalenceClasses::getClassFor(block).number;
-			dependencies[class_nr].insert(block_class_nr);
-			dependencies[block_class_nr].insert(class_nr);
-
-			// returns whether the edge between the two blocks is a back edge.
-			auto is_back_edge = [&](auto source, auto target){
-				if(LI.isLoopHeader(target)) {
-					if(auto target_loop = LI.getLoopFor(target)) {
-						auto preheader = PatmosSinglePathInfo::getPreHeaderUnilatch(target_loop).first;
-						return source != preheader;
-					} else {
-						// Root loop (NULL) cannot have back edge
-					}
-				} else {
-					// Back edges must target a header
-				}
-				return false;
-			};
+	// Order the blocks such that the successors of a block in the forward CFG
+	// come before it, using an iterative depth-first search.
+	std::vector<MachineBasicBlock*> post_order;
+	std::set<MachineBasicBlock*> visited;
+	for(auto &root: MF) {
+		if(visited.count(&root)) continue;
+		std::vector<std::pair<MachineBasicBlock*, MachineBasicBlock::succ_iterator>> stack;
+		visited.insert(&root);
+		stack.push_back(std::make_pair(&root, root.succ_begin()));
+		while(!stack.empty()) {
+			auto &top = stack.back();
+			if(top.second == top.first->succ_end()) {
+				post_order.push_back(top.first);
+				stack.pop_back();
+				continue;
+			}
+			auto succ = *(top.second++);
+			if(!is_back_edge(top.first, succ) && !visited.count(succ)) {
+				visited.insert(succ);
+				stack.push_back(std::make_pair(succ, succ->succ_begin()));
+			}
+		}
+	}
 
-			// Continue search through successors
+	// The classes reachable from each block, including its own.
+	// On the forward CFG one pass suffices, the fixpoint only guards
+	// against cycles without a proper back edge.
+	std::map<MachineBasicBlock*, BitVector> reachable;
+	for(auto block: post_order) {
+		reachable[block] = BitVector(classes.size());
+		reachable[block].set(block_classes[block]);
+	}
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		for(auto block: post_order) {
+			auto &reach = reachable[block];
 			for(auto succ: block->successors()) {
-				if(!is_back_edge(block, succ) && !donelist.count(succ)) {
-					worklist.push_back(succ);
+				if(!is_back_edge(block, succ)) {
+					auto &succ_reach = reachable[succ];
+					if(succ_reach.test(reach)) {
+						reach |= succ_reach;
+						changed = true;
+					}
 				}
 			}
 		}
 	}
 
-	return dependencies;
+	// Any pair of classes where one is reachable from the other become
+	// dependent on each other.
+	std::vector<BitVector> dependent(classes.size(), BitVector(classes.size()));
+	for(auto block: post_order) {
+		auto class_nr = block_classes[block];
+		auto &reach = reachable[block];
+		dependent[class_nr] |= reach;
+		for(auto dep: reach.set_bits()) {
+			dependent[dep].set(class_nr);
+		}
+	}
+
+	class_dependencies.clear();
+	for(unsigned class_nr = 0; class_nr < classes.size(); class_nr++) {
+		auto &deps = class_dependencies[class_nr];
+		for(auto dep: dependent[class_nr].set_bits()) {
+			deps.insert(dep);
+		}
+	}
 }
 
 static MDNode* unsigned_md(unsigned x, LLVMContext &C) {
@@ -309,7 +337,7 @@ Optional<unsigned> EquivalenceClasses::getEqClassNr(const MachineInstr* MI) {
 
 bool EquivalenceClasses::dependentInstructions(
 		const MachineInstr* instr1,const MachineInstr* instr2,
-		std::map<unsigned, std::set<unsigned>> &class_dependencies
+		const std::map<unsigned, std::set<unsigned>> &class_dependencies
 ){
 	auto predicate_negated = [](const MachineInstr* instr){
 		if(instr->isPredicable()) {
@@ -330,8 +358,8 @@ bool EquivalenceClasses::dependentInstructions(
 			// predicate negation flag is enabled and the other disabled.
 			return neg1 == neg2;
 		} else {
-			auto deps1 = class_dependencies[*class1];
-			return class_dependencies[*class1].count(*class2) ||
+			auto deps1 = class_dependencies.find(*class1);
+			return (deps1 != class_dependencies.end() && deps1->second.count(*class2)) ||
 				// If they aren't dependent on each other's classes, they are still
 				// dependent if one or both are negated
 				(predicate_negated(instr1) || predicate_negated(instr2));
@@ -14,7 +14,9 @@
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/MachineLoopInfo.h"
 
+#include <map>
 #include <set>
+#include <vector>
 
 namespace llvm {
 
@@ -35,21 +37,26 @@ namespace llvm {
 
 	class EquivalenceClasses : public MachineFunctionPass {
 	private:
-		std::map<
-			// Unique number of the class
-			unsigned,
-			std::pair<
-				// The control dependencies of the class.
-				// If the source is 'None' it is a dependency on the entry to the loop.
-				// (the target is then the header)
-				std::set<std::pair<Optional<MachineBasicBlock*>,MachineBasicBlock*>>,
-				// The blocks in the class
-				std::set<MachineBasicBlock*>
-			>
-		> classes;
+		// The classes of the function, indexed by their unique number.
+		// If the source of a control dependency is 'None' it is a dependency on
+		// the entry to the loop (the target is then the header).
+		std::vector<EqClass> classes;
+
+		// The number of the class of each block
+		std::map<const MachineBasicBlock*, unsigned> block_classes;
+
+		// Which classes depend on which classes (including self-dependence).
+		// Computed once per function, as all users share the same result.
+		std::map<unsigned, std::set<unsigned>> class_dependencies;
+
+		// Computes 'class_dependencies' from the reachability of the classes in
+		// the forward CFG, using one bit vector of classes per block.
+		void computeClassDependencies(MachineFunction &MF, MachineLoopInfo &LI);
 
 		// Returns a map of which classes depend on which classes (including self-dependence)
-		std::map<unsigned, std::set<unsigned>> getAllClassDependencies() const;
+		const std::map<unsigned, std::set<unsigned>> &getAllClassDependencies() const {
+			return class_dependencies;
+		}
 
 	public:
 		static char ID;
@@ -70,9 +77,9 @@ namespace llvm {
 
 		bool runOnMachineFunction(MachineFunction &MF) override;
 
-		std::vector<EqClass> getAllClasses() const;
+		const std::vector<EqClass> &getAllClasses() const;
 
-		EqClass getClassFor(MachineBasicBlock*mbb) const;
+		const EqClass &getClassFor(MachineBasicBlock*mbb) const;
 		// Exports the equivalence class predecessor relations as metadata connected to the given function
 		void exportClassDependenciesToModule(MachineFunction &MF);
 
@@ -89,7 +96,7 @@ namespace llvm {
 		/// Returns whether the two given instructions are independent.
 		/// If two instruction are dependent, it means they may be enabled at the same time.
 		/// E.g., an if-else statement's two alternatives will be mutually independent but dependent on the class surrounding them.
-		static bool dependentInstructions(const MachineInstr* instr1,const MachineInstr* instr2, std::map<unsigned, std::set<unsigned>> &class_predecessors);
+		static bool dependentInstructions(const MachineInstr* instr1,const MachineInstr* instr2, const std::map<unsigned, std::set<unsigned>> &class_predecessors);
 	};
 }
 
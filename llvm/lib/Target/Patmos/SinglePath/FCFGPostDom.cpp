@@ -2,7 +2,6 @@
 #include "FCFGPostDom.h"
 #include "Patmos.h"
 #include "SinglePath/PatmosSPReduce.h"
-#include "SinglePath/ConstantLoopDominatorAnalysis.h" // for "get_intersection"
 #include "TargetInfo/PatmosTargetInfo.h"
 #include "llvm/ADT/GraphTraits.h"
 #include "llvm/ADT/DepthFirstIterator.h"
@@ -11,10 +10,10 @@
 #include "llvm/Support/MathExtras.h"
 #include "llvm/IR/Dominators.h"
 
-#include <deque>
-
 using namespace llvm;
 
+const unsigned FCFGPostDom::none;
+
 MachineBasicBlock* FCFGPostDom::outermost_inner_loop_header(MachineLoop *inner) {
 	assert(inner && "Inner loop was null");
 
@@ -56,6 +55,44 @@ Optional<MachineBasicBlock*> FCFGPostDom::fcfg_successor(MachineBasicBlock *succ
 	}
 }
 
+void FCFGPostDom::fcfg_successors(MachineBasicBlock *block,
+		std::set<MachineBasicBlock*> &roots, SmallVectorImpl<unsigned> &succs) {
+	if(roots.count(block)) {
+		// Roots are only post dominated by themselves
+		succs.push_back(blocks.size());
+		return;
+	}
+
+	auto add_succ = [&](MachineBasicBlock *succ){
+		auto found = ids.find(succ);
+		assert(found != ids.end() && "Successor not in the FCFG");
+		if(!is_contained(succs, found->second)) {
+			succs.push_back(found->second);
+		}
+	};
+
+	if(LI.isLoopHeader(block) && (!loop || loop->getHeader() != block)) {
+		// Block is header of inner loop
+		auto blocks_loop = LI.getLoopFor(block);
+		assert(blocks_loop);
+		assert(blocks_loop->getParentLoop() == loop);
+
+		SmallVector<std::pair<MachineBasicBlock*, MachineBasicBlock*>> exits;
+		blocks_loop->getExitEdges(exits);
+		for(auto edge: exits) {
+			if(!loop || loop->contains(edge.second)) {
+				add_succ(edge.second);
+			}
+		}
+	} else {
+		std::for_each(block->succ_begin(), block->succ_end(), [&](auto succ){
+			auto fcfg_succ = fcfg_successor(succ);
+			assert(fcfg_succ && "Exit from a block that is not a root");
+			add_succ(*fcfg_succ);
+		});
+	}
+}
+
 void FCFGPostDom::calculate(std::set<MachineBasicBlock*> roots) {
 	assert(std::all_of(roots.begin(), roots.end(), [&](auto root){
 		return
@@ -65,69 +102,131 @@ void FCFGPostDom::calculate(std::set<MachineBasicBlock*> roots) {
 			(LI.getLoopFor(root)->getParentLoop() == loop && LI.getLoopFor(root)->getHeader() == root);
 	}) && "All roots not in the same loop");
 
-	std::deque<MachineBasicBlock*> worklist;
-
-	auto add_preds_to_worklist = [&](auto current){
-		std::for_each(current->pred_begin(), current->pred_end(), [&](auto pred){
-			auto fcfg_pred = fcfg_predecessor(pred);
-			if(fcfg_pred) {
-				worklist.push_back(*fcfg_pred);
-			}
-		});
+	// The blocks of the FCFG are the blocks of the loop, and the headers of
+	// the inner loops.
+	auto add_block = [&](MachineBasicBlock *block){
+		auto block_loop = LI.getLoopFor(block);
+		if(block_loop == loop ||
+			(block_loop->getParentLoop() == loop && block_loop->getHeader() == block)
+		) {
+			ids[block] = blocks.size();
+			blocks.push_back(block);
+		}
 	};
+	if(loop) {
+		std::for_each(loop->block_begin(), loop->block_end(), add_block);
+	} else {
+		for(auto &block: *(*roots.begin())->getParent()) {
+			add_block(&block);
+		}
+	}
 
-	// Initial post dominators: roots are only post dominated by themselves
-	for(auto root: roots) {
-		post_doms[root] = {root};
-		add_preds_to_worklist(root);
+	unsigned exit = blocks.size();
+	std::vector<SmallVector<unsigned, 2>> succs(exit), preds(exit + 1);
+	for(unsigned i = 0; i < exit; i++) {
+		fcfg_successors(blocks[i], roots, succs[i]);
+		for(auto succ: succs[i]) {
+			preds[succ].push_back(i);
+		}
 	}
 
-	while(!worklist.empty()) {
-		auto current = worklist.front();
-		worklist.pop_front();
-		if(post_doms.count(current)) {
-			// already did it
-			continue;
+	// Number the blocks in postorder of the reverse FCFG, starting at the exit.
+	// Blocks not reaching the exit are not numbered.
+	std::vector<unsigned> po_num(exit + 1, none), order;
+	std::vector<std::pair<unsigned, unsigned>> stack;
+	po_num[exit] = 0;
+	stack.push_back(std::make_pair(exit, 0));
+	while(!stack.empty()) {
+		auto current = stack.back().first;
+		auto next = stack.back().second;
+		if(next < preds[current].size()) {
+			stack.back().second++;
+			auto pred = preds[current][next];
+			if(po_num[pred] == none) {
+				po_num[pred] = 0;
+				stack.push_back(std::make_pair(pred, 0));
+			}
+		} else {
+			po_num[current] = order.size();
+			order.push_back(current);
+			stack.pop_back();
 		}
+	}
 
-		std::set<MachineBasicBlock*> succs;
-		if(LI.isLoopHeader(current) && (!loop || loop->getHeader() != current)) {
-			// Current is header of inner loop
-			auto currents_loop = LI.getLoopFor(current);
-			assert(currents_loop);
-			assert(currents_loop->getParentLoop() == loop);
-
-			SmallVector<std::pair<MachineBasicBlock*, MachineBasicBlock*>> exits;
-			currents_loop->getExitEdges(exits);
-			for(auto edge: exits) {
-				if(!loop || loop->contains(edge.second)) {
-					succs.insert(edge.second);
+	// Cooper K.D., Harvey T.J. & Kennedy K. (2001). A simple, fast dominance
+	// algorithm; on the reverse FCFG, as in SPScope
+	auto intersect = [&](unsigned finger1, unsigned finger2){
+		while(finger1 != finger2) {
+			while(po_num[finger1] < po_num[finger2]) finger1 = ipdom[finger1];
+			while(po_num[finger2] < po_num[finger1]) finger2 = ipdom[finger2];
+		}
+		return finger1;
+	};
+	ipdom.assign(exit + 1, none);
+	ipdom[exit] = exit;
+	// The FCFG is acyclic, so the second iteration only confirms the first
+	for(bool changed = true; changed; ) {
+		changed = false;
+		for(auto i = std::next(order.rbegin()), e = order.rend(); i != e; ++i) {
+			unsigned new_ipdom = none;
+			for(auto succ: succs[*i]) {
+				if(ipdom[succ] != none) {
+					new_ipdom = new_ipdom == none ? succ : intersect(succ, new_ipdom);
 				}
 			}
-		} else {
-			std::for_each(current->succ_begin(), current->succ_end(), [&](auto succ){
-				return succs.insert(*fcfg_successor(succ));
-			});
+			if(ipdom[*i] != new_ipdom) {
+				ipdom[*i] = new_ipdom;
+				changed = true;
+			}
 		}
+	}
 
-		auto all_succs_done = std::all_of(succs.begin(), succs.end(), [&](auto succ){
-			return post_doms.count(succ);
-		});
-		if(all_succs_done) {
-			auto doms = post_doms[*succs.begin()];
-			std::for_each(succs.begin(), succs.end(), [&](auto succ){
-				doms = get_intersection(doms, post_doms[succ]);
-			});
-			doms.insert(current);
-			post_doms[current] = doms;
-			add_preds_to_worklist(current);
+	// Number the post dominator tree in preorder, such that the blocks a block
+	// post dominates are a range of 'tree_order'.
+	std::vector<SmallVector<unsigned, 2>> children(exit + 1);
+	for(unsigned i = 0; i < exit; i++) {
+		if(ipdom[i] != none) {
+			children[ipdom[i]].push_back(i);
+		}
+	}
+	tree_begin.assign(exit, none);
+	tree_end.assign(exit, none);
+	stack.push_back(std::make_pair(exit, 0));
+	while(!stack.empty()) {
+		auto current = stack.back().first;
+		auto next = stack.back().second;
+		if(next < children[current].size()) {
+			stack.back().second++;
+			auto child = children[current][next];
+			tree_begin[child] = tree_order.size();
+			tree_order.push_back(blocks[child]);
+			stack.push_back(std::make_pair(child, 0));
 		} else {
-			// Wait for all successors to be done
-			worklist.push_back(current);
+			if(current != exit) {
+				tree_end[current] = tree_order.size();
+			}
+			stack.pop_back();
 		}
 	}
 }
 
+unsigned FCFGPostDom::get_id(MachineBasicBlock *block) const {
+	auto found = ids.find(block);
+	if(found == ids.end() || ipdom[found->second] == none) {
+		return none;
+	}
+	return found->second;
+}
+
+FCFGPostDom *FCFGPostDom::inner_dom_of(MachineBasicBlock *block) {
+	for(auto &inner: inner_doms) {
+		if(inner.loop->contains(block)) {
+			return &inner;
+		}
+	}
+	return nullptr;
+}
+
 FCFGPostDom::FCFGPostDom(MachineLoop *l, MachineLoopInfo &LI): loop(l), LI(LI){
 	assert(loop);
 	SmallVector<std::pair<MachineBasicBlock*, MachineBasicBlock*>> exits;
@@ -158,14 +257,14 @@ FCFGPostDom::FCFGPostDom(MachineLoop *l, MachineLoopInfo &LI): loop(l), LI(LI){
 }
 
 void FCFGPostDom::get_post_dominees(MachineBasicBlock *dominator, std::set<MachineBasicBlock*> &dominees) {
-	for(auto entry: post_doms) {
-		if(entry.second.count(dominator)){
-			dominees.insert(entry.first);
-		}
+	auto id = get_id(dominator);
+	if(id != none) {
+		dominees.insert(tree_order.begin() + tree_begin[id], tree_order.begin() + tree_end[id]);
 	}
 
-	for(auto inner: inner_doms) {
-		inner.get_post_dominees(dominator, dominees);
+	// Only the header of an inner loop is also in the inner FCFG
+	if(auto inner = inner_dom_of(dominator)) {
+		inner->get_post_dominees(dominator, dominees);
 	}
 }
 
@@ -182,29 +281,37 @@ FCFGPostDom::FCFGPostDom(MachineFunction &MF, MachineLoopInfo &LI) : loop(nullpt
 
 void FCFGPostDom::print(raw_ostream &O, unsigned indent) {
 	if(indent == 0) O << "Post Dominators:\n";
-	for(auto entry: post_doms) {
-		auto block = entry.first;
-		auto dominees = entry.second;
+	for(unsigned id = 0; id < blocks.size(); id++) {
+		if(ipdom[id] == none) continue;
 
 		for(int i = 0; i<indent; i++) O << "\t";
-		O << "bb." << block->getNumber() << ": [";
-		for(auto dominee: dominees) {
-			O << "bb." << dominee->getNumber() << ", ";
+		O << "bb." << blocks[id]->getNumber() << ": [";
+		for(auto dom = id; dom != blocks.size(); dom = ipdom[dom]) {
+			O << "bb." << blocks[dom]->getNumber() << ", ";
 		}
 		O << "]\n";
 	}
-	for(auto inner: inner_doms) {
+	for(auto &inner: inner_doms) {
 		inner.print(O, indent+1);
 	}
 }
 
 bool FCFGPostDom::post_dominates(MachineBasicBlock *dominator, MachineBasicBlock *dominee) {
-	return post_doms[dominee].count(dominator) ||
-		std::any_of(inner_doms.begin(), inner_doms.end(),
-			[&](auto inner){ return inner.post_dominates(dominator, dominee);});
+	auto dominator_id = get_id(dominator);
+	auto dominee_id = get_id(dominee);
+	if(dominator_id != none && dominee_id != none &&
+		tree_begin[dominator_id] <= tree_begin[dominee_id] &&
+		tree_end[dominee_id] <= tree_end[dominator_id]
+	) {
+		return true;
+	}
+
+	// Only the inner FCFG containing the dominee can have it as a block
+	auto inner = inner_dom_of(dominee);
+	return inner && inner->post_dominates(dominator, dominee);
 }
 
-void FCFGPostDom::get_control_dependencies(
+void FCFGPostDom::get_local_control_dependencies(
 	std::map<
 		// X
 		MachineBasicBlock*,
@@ -212,21 +319,19 @@ void FCFGPostDom::get_control_dependencies(
 		std::set<std::pair<Optional<MachineBasicBlock*>,MachineBasicBlock*>>
 	> &deps
 ) {
-	for(auto entry: post_doms) {
-		auto block = entry.first;
+	for(unsigned id = 0; id < blocks.size(); id++) {
+		if(ipdom[id] == none) continue;
+		auto block = blocks[id];
 
 		if(LI.isLoopHeader(block)) {
 			// headers can only be dependent on the loop entry
 			deps[block].insert(std::make_pair(None, block));
 		} else {
-			std::set<MachineBasicBlock*> dominees;
-			get_post_dominees(block, dominees);
 			// x is control dependent on (y->z) if x post-doms z but not y.
 			// 'block' is control dependent on ('pred'->'dominee') if 'block' post-doms 'dominee' but not 'pred'.
-			for(auto dominee: dominees){
+			// 'block' is not a header, so it only post-doms blocks of this FCFG.
+			std::for_each(tree_order.begin() + tree_begin[id], tree_order.begin() + tree_end[id], [&](auto dominee){
 				// 'block' post-doms 'dominee'
-				auto dominee_loop = LI.getLoopFor(dominee);
-
 				if(dominee->pred_size() == 0 || (loop && loop->getHeader() == dominee)) {
 					// dominee is the entry to the loop (header).
 					// If you post dominate the entry, you are control dependent on the entry edge
@@ -256,15 +361,34 @@ void FCFGPostDom::get_control_dependencies(
 						}
 					});
 				}
-			}
+			});
 		}
 	}
-	for(auto inner: inner_doms) {
+}
+
+void FCFGPostDom::get_control_dependencies(
+	std::map<
+		// X
+		MachineBasicBlock*,
+		// Set of {Y->Z} control dependencies of X
+		std::set<std::pair<Optional<MachineBasicBlock*>,MachineBasicBlock*>>
+	> &deps
+) {
+	if(!local_deps) {
+		local_deps.emplace();
+		get_local_control_dependencies(*local_deps);
+	}
+	for(auto &entry: *local_deps) {
+		deps[entry.first].insert(entry.second.begin(), entry.second.end());
+	}
+	for(auto &inner: inner_doms) {
 		inner.get_control_dependencies(deps);
 	}
 
+	// Checked once all FCFGs are done
 	assert(
-		std::all_of(deps.begin(), deps.end(), [&](auto entry){
+		(loop ||
+		std::all_of(deps.begin(), deps.end(), [&](auto &entry){
 			return std::all_of(entry.second.begin(), entry.second.end(), [&](auto edge){
 				if(edge.first) {
 					// Edge exists
@@ -276,14 +400,7 @@ void FCFGPostDom::get_control_dependencies(
 					return LI.isLoopHeader(edge.second) || edge.second->pred_size() == 0;
 				}
 			});
-		})
+		}))
 		&& "Not all dependencies are valid"
 	);
 }
-
-
-
-
-
-
-
@@ -2,21 +2,37 @@
 #ifndef TARGET_PATMOS_SINGLEPATH_FCFGPOSTDOM_H_
 #define TARGET_PATMOS_SINGLEPATH_FCFGPOSTDOM_H_
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineLoopInfo.h"
 
+#include <map>
 #include <set>
+#include <vector>
 
 namespace llvm {
 
 /// Calculate the postdominators for the forward CFG (FCFG) of a function.
 class FCFGPostDom {
 private:
-	std::map<
-		MachineBasicBlock*,
-		// Blocks that post dominate this block
-		std::set<MachineBasicBlock*>
-	> post_doms;
+	/// The blocks of the FCFG by their dense ids. Inner loops are represented
+	/// by their headers. The virtual exit, which all roots lead to, has the
+	/// id 'blocks.size()'.
+	std::vector<MachineBasicBlock*> blocks;
+
+	/// The dense ids of the blocks of the FCFG
+	DenseMap<MachineBasicBlock*, unsigned> ids;
+
+	/// Immediate post dominator of each block, or 'none' if the block does
+	/// not reach the virtual exit.
+	std::vector<unsigned> ipdom;
+
+	/// The blocks in preorder of the post dominator tree. The blocks a block
+	/// post dominates are the range [tree_begin, tree_end) of it.
+	std::vector<MachineBasicBlock*> tree_order;
+	std::vector<unsigned> tree_begin, tree_end;
+
+	static const unsigned none = ~0u;
 
 	/// The loop of the FCFG
 	MachineLoop *loop;
@@ -27,13 +43,35 @@ private:
 	/// FCFG doms of inner loops
 	std::vector<FCFGPostDom> inner_doms;
 
+	/// Control dependencies of the blocks of this FCFG, computed on first use.
+	Optional<std::map<
+		MachineBasicBlock*,
+		std::set<std::pair<Optional<MachineBasicBlock*>,MachineBasicBlock*>>
+	>> local_deps;
+
 	/// Calculate the post dominators for this FCFG. Does not calculate for inner loops.
 	void calculate(std::set<MachineBasicBlock*> roots);
 
+	/// Returns the FCFG successors of the given block, given the roots of the FCFG.
+	void fcfg_successors(MachineBasicBlock *block, std::set<MachineBasicBlock*> &roots,
+			SmallVectorImpl<unsigned> &succs);
+
+	/// Returns the id of the block if it is in this FCFG and reaches its exit, 'none' otherwise.
+	unsigned get_id(MachineBasicBlock *block) const;
+
+	/// Returns the inner FCFG containing the given block, if any.
+	FCFGPostDom *inner_dom_of(MachineBasicBlock *block);
+
 	/// Returns (through 'dominees') the blocks that the given block post dominates in the FCFG.
 	/// This looks at inner loops too.
 	void get_post_dominees(MachineBasicBlock *dominator, std::set<MachineBasicBlock*> &dominees);
 
+	/// Calculate control dependencies of the blocks of this FCFG only.
+	void get_local_control_dependencies(std::map<
+			MachineBasicBlock*,
+			std::set<std::pair<Optional<MachineBasicBlock*>,MachineBasicBlock*>>
+		> &deps);
+
 public:
 
 	/// Create the FCFG post dominators for the given loop.
@@ -1,6 +1,15 @@
 #include "InstructionCounter.h"
 #include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosStats.h"
+#include "TargetInfo/PatmosTargetInfo.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
 
@@ -15,17 +24,228 @@ FunctionPass *llvm::createSinglePathInstructionCounter(const PatmosTargetMachine
 STATISTIC(SPInstructions, "Number of single instructions in single-path code (in final binary)");
 STATISTIC(SPInstructionSize, "Instruction bytes in single-path code (in final binary)");
 
+static cl::opt<std::string> SPCycleReport(
+  "mpatmos-singlepath-cycle-report",
+  cl::init(""),
+  cl::desc("Write the cycles of all single-path functions and their loops "
+           "as JSON to the given file."),
+  cl::Hidden);
+
+/// Returns true for control-flow instructions that stall the pipeline
+/// instead of executing delay slots.
+static bool isNonDelayed(unsigned Opcode) {
+  switch (Opcode) {
+  case Patmos::BRNDu: case Patmos::BRND:
+  case Patmos::BRRNDu: case Patmos::BRRND:
+  case Patmos::BRTNDu: case Patmos::BRTND:
+  case Patmos::BRCFNDu: case Patmos::BRCFND:
+  case Patmos::BRCFRNDu: case Patmos::BRCFRND:
+  case Patmos::BRCFTNDu: case Patmos::BRCFTND:
+  case Patmos::CALLND: case Patmos::CALLRND:
+  case Patmos::RETND: case Patmos::XRETND:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void InstructionCounter::Cost::add(const Cost &Other, uint64_t Times) {
+  Cycles += Other.Cycles * Times;
+  Instructions += Other.Instructions * Times;
+  Bytes += Other.Bytes * Times;
+  for (unsigned i = 0; i < 4; i++) {
+    Loads[i] += Other.Loads[i] * Times;
+    Stores[i] += Other.Stores[i] * Times;
+  }
+  Reserved += Other.Reserved * Times;
+  Ensured += Other.Ensured * Times;
+  Freed += Other.Freed * Times;
+  for (auto &call: Other.Calls) {
+    Calls[call.first] += call.second * Times;
+  }
+}
+
+json::Object InstructionCounter::Cost::toJSON() const {
+  auto memTypes = [](const uint64_t (&counts)[4]) {
+    return json::Object{
+      {"stack", (int64_t)counts[PatmosII::MEM_S]},
+      {"local", (int64_t)counts[PatmosII::MEM_L]},
+      {"cache", (int64_t)counts[PatmosII::MEM_C]},
+      {"main", (int64_t)counts[PatmosII::MEM_M]}
+    };
+  };
+  json::Array calls;
+  for (auto &call: Calls) {
+    calls.push_back(json::Object{
+      {"callee", call.first}, {"count", (int64_t)call.second}
+    });
+  }
+  return json::Object{
+    {"cycles", (int64_t)Cycles},
+    {"instructions", (int64_t)Instructions},
+    {"bytes", (int64_t)Bytes},
+    {"loads", memTypes(Loads)},
+    {"stores", memTypes(Stores)},
+    {"stack-cache", json::Object{
+      {"reserve", (int64_t)Reserved},
+      {"ensure", (int64_t)Ensured},
+      {"free", (int64_t)Freed}
+    }},
+    {"calls", std::move(calls)}
+  };
+}
+
+void InstructionCounter::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineLoopInfo>();
+  AU.addRequired<PatmosLoopBoundInfo>();
+  AU.setPreservesAll();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+InstructionCounter::Cost
+InstructionCounter::getBlockCost(const MachineBasicBlock &MBB) const {
+  Cost cost;
+  for (auto &instr: MBB.instrs()) {
+    // Every bundle and every instruction outside of bundles takes a cycle
+    if (instr.isBundle()) {
+      if (!TII->isPseudo(&instr)) cost.Cycles++;
+      continue;
+    }
+    if (instr.isPseudo() || instr.isInlineAsm()) continue;
+    if (!instr.isInsideBundle()) cost.Cycles++;
+
+    cost.Instructions++;
+    cost.Bytes += instr.getDesc().getSize();
+
+    if (instr.mayLoad() || instr.mayStore()) {
+      auto type = PatmosInstrInfo::getMemType(instr);
+      if (instr.mayLoad()) cost.Loads[type]++;
+      if (instr.mayStore()) cost.Stores[type]++;
+    }
+
+    switch (instr.getOpcode()) {
+    case Patmos::SRESi: cost.Reserved += instr.getOperand(2).getImm(); break;
+    case Patmos::SENSi: cost.Ensured += instr.getOperand(2).getImm(); break;
+    case Patmos::SFREEi: cost.Freed += instr.getOperand(2).getImm(); break;
+    default: break;
+    }
+
+    if (instr.isCall()) {
+      const Function *callee = TII->getCallee(instr);
+      cost.Calls[callee ? callee->getName().str() : "<indirect>"]++;
+    }
+
+    if (isNonDelayed(instr.getOpcode())) {
+      cost.Cycles += STC.getDelaySlotCycles(instr);
+    }
+  }
+  return cost;
+}
+
+bool InstructionCounter::reportLoop(const MachineLoop *L, uint64_t Count,
+                                    json::Array &Loops) {
+  // Single-path loops always execute their maximum number of iterations
+  auto bounds = getAnalysis<PatmosLoopBoundInfo>().getLoopBounds(L->getHeader());
+  uint64_t bound = bounds ? bounds->second : 1;
+  uint64_t headerCount = Count * bound;
+
+  // Blocks of subloops are updated again by the subloops
+  for (auto *MBB: L->blocks()) {
+    Blocks[MBB].second = headerCount;
+  }
+
+  bool bounded = bounds.hasValue();
+  json::Array subloops;
+  for (auto *subloop: *L) {
+    bounded &= reportLoop(subloop, headerCount, subloops);
+  }
+
+  Cost total;
+  for (auto *MBB: L->blocks()) {
+    total.add(Blocks[MBB].first, Blocks[MBB].second);
+  }
+
+  json::Object loop{
+    {"header", L->getHeader()->getNumber()},
+    {"depth", (int64_t)L->getLoopDepth()},
+    {"bound", (int64_t)bound},
+    {"bounded", bounds.hasValue()},
+    {"cycles-per-iteration",
+     (int64_t)(headerCount ? total.Cycles / headerCount : 0)},
+    {"total", total.toJSON()},
+    {"loops", std::move(subloops)}
+  };
+  Loops.push_back(std::move(loop));
+  return bounded;
+}
+
 bool InstructionCounter::runOnMachineFunction(MachineFunction &MF) {
 	if (PatmosSinglePathInfo::isEnabled(MF)) {
+		int64_t instructions = 0, bundles = 0, nops = 0;
 		for(auto &block: MF) {
 			std::for_each(block.instr_begin(), block.instr_end(), [&](auto &instr){
 				if(!instr.isPseudo() && !instr.isInlineAsm() ){
 					SPInstructions++;
 					SPInstructionSize += instr.getDesc().getSize();
+					instructions++;
+					if (instr.getOpcode() == Patmos::NOP) nops++;
 				}
+				if (instr.isBundle()) bundles++;
+			});
+		}
+
+		if (arePatmosStatsEnabled()) {
+			const Function &F = MF.getFunction();
+			addPatmosStat(F, "single-path", "instructions", instructions);
+			addPatmosStat(F, "single-path", "bundles", bundles);
+			addPatmosStat(F, "single-path", "nops", nops);
+		}
+
+		if (!SPCycleReport.empty()) {
+			// Single-path code executes every block once per iteration of the
+			// loops containing it.
+			Blocks.clear();
+			for (auto &block: MF) {
+				Blocks[&block] = std::make_pair(getBlockCost(block), 1);
+			}
+
+			auto &LI = getAnalysis<MachineLoopInfo>();
+			bool bounded = true;
+			json::Array loops;
+			for (auto *loop: LI) {
+				bounded &= reportLoop(loop, 1, loops);
+			}
+
+			Cost total;
+			for (auto &entry: Blocks) {
+				total.add(entry.second.first, entry.second.second);
+			}
+
+			LLVM_DEBUG(dbgs() << "Single-path cycles of " << MF.getName() << ": "
+			                  << total.Cycles << (bounded ? "\n" : " (unbounded)\n"));
+
+			Report.push_back(json::Object{
+				{"function", MF.getFunction().getName()},
+				{"bounded", bounded},
+				{"total", total.toJSON()},
+				{"loops", std::move(loops)}
 			});
 		}
 	}
 	return false;
 }
 
+bool InstructionCounter::doFinalization(Module &M) {
+	if (!SPCycleReport.empty()) {
+		std::error_code EC;
+		raw_fd_ostream OS(SPCycleReport, EC, sys::fs::OF_Text);
+		if (EC) {
+			report_fatal_error("Cannot open single-path cycle report '" +
+			                   SPCycleReport + "': " + EC.message());
+		}
+		json::Value value(json::Object{{"functions", std::move(Report)}});
+		OS << formatv("{0:2}", value) << "\n";
+		Report = json::Array();
+	}
+	return MachineFunctionPass::doFinalization(M);
+}
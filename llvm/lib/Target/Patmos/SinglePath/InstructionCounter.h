@@ -1,12 +1,16 @@
-
 #ifndef TARGET_PATMOS_SINGLEPATH_INSTRUCTIONCOUNTER_H_
 #define TARGET_PATMOS_SINGLEPATH_INSTRUCTIONCOUNTER_H_
 
 #include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/Support/JSON.h"
 #include "PatmosSinglePathInfo.h"
 
+#include <map>
+
 namespace llvm {
 
+	class MachineLoop;
+
 	class InstructionCounter : public MachineFunctionPass {
 	private:
 		const PatmosTargetMachine &TM;
@@ -14,6 +18,41 @@ namespace llvm {
 		const PatmosInstrInfo *TII;
 		const PatmosRegisterInfo *TRI;
 
+		/// The cost of executing a piece of single-path code once.
+		struct Cost {
+			/// Cycles spent in the pipeline, i.e. one per bundle (including
+			/// explicit delay slot nops) plus the stalls of non-delayed
+			/// control-flow instructions.
+			uint64_t Cycles = 0;
+			uint64_t Instructions = 0;
+			uint64_t Bytes = 0;
+			/// Loads and stores by memory type (PatmosII::MemType).
+			uint64_t Loads[4] = {0, 0, 0, 0};
+			uint64_t Stores[4] = {0, 0, 0, 0};
+			/// Words reserved, ensured and freed in the stack cache.
+			uint64_t Reserved = 0, Ensured = 0, Freed = 0;
+			/// Number of calls to each callee.
+			std::map<std::string, uint64_t> Calls;
+
+			void add(const Cost &Other, uint64_t Times);
+			json::Object toJSON() const;
+		};
+
+		/// The cost of each block for one execution, and the number of times
+		/// it is executed in one execution of the function.
+		std::map<const MachineBasicBlock*, std::pair<Cost, uint64_t>> Blocks;
+
+		/// The reports of all single-path functions seen so far.
+		json::Array Report;
+
+		/// Compute the cost of a single execution of the block.
+		Cost getBlockCost(const MachineBasicBlock &MBB) const;
+
+		/// Add the report of the loop and its subloops to Loops.
+		/// Returns false if a loop has no bound.
+		bool reportLoop(const MachineLoop *L, uint64_t Count,
+		                json::Array &Loops);
+
 	public:
 		static char ID;
 
@@ -28,11 +67,12 @@ namespace llvm {
 			return "Patmos Single-Path Instruction Counter";
 		}
 
-		void getAnalysisUsage(AnalysisUsage &AU) const override {
-			MachineFunctionPass::getAnalysisUsage(AU);
-		}
+		void getAnalysisUsage(AnalysisUsage &AU) const override;
 
 		bool runOnMachineFunction(MachineFunction &MF) override;
+
+		/// Write the cycle report, if requested.
+		bool doFinalization(Module &M) override;
 	};
 }
 
@@ -6,11 +6,19 @@
 #include "llvm/ADT/GraphTraits.h"
 #include "llvm/ADT/DepthFirstIterator.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
 
 #define DEBUG_TYPE "patmos-singlepath"
 
+static cl::opt<bool> DisableBlockInterleaving(
+	"mpatmos-disable-sp-block-interleaving",
+	cl::init(false),
+	cl::desc("Linearize single-path blocks in topological order only, "
+			"without placing blocks of exclusive predicates next to each other."),
+	cl::Hidden);
+
 char Linearizer::ID = 0;
 
 FunctionPass *llvm::createSinglePathLinearizer(const PatmosTargetMachine &tm) {
@@ -108,6 +116,18 @@ bool Linearizer::runOnMachineFunction(MachineFunction &MF) {
 			}
 		}
 
+		// Find the classes before the blocks are linearized
+		BlockClasses.clear();
+		ClassDependencies = EquivalenceClasses::importClassDependenciesFromModule(MF);
+		for(auto &mbb: MF) {
+			auto found = std::find_if(mbb.instr_begin(), mbb.instr_end(), [&](auto &instr){
+				return EquivalenceClasses::getEqClassNr(&instr).hasValue();
+			});
+			if(found != mbb.instr_end()) {
+				BlockClasses[&mbb] = *EquivalenceClasses::getEqClassNr(&*found);
+			}
+		}
+
 		linearizeScope(getAnalysis<PatmosSinglePathInfo>().getRootScope());
 		mergeMBBs(MF);
 
@@ -137,9 +157,28 @@ bool Linearizer::runOnMachineFunction(MachineFunction &MF) {
 }
 
 
+bool Linearizer::interleaves(const PredicatedBlock *first, const PredicatedBlock *second) const
+{
+	auto class1 = BlockClasses.find(first->getMBB());
+	auto class2 = BlockClasses.find(second->getMBB());
+	if(class1 == BlockClasses.end() || class2 == BlockClasses.end() ||
+		class1->second == class2->second
+	) {
+		return false;
+	}
+	auto depends = [&](unsigned c1, unsigned c2){
+		auto deps = ClassDependencies.find(c1);
+		return deps != ClassDependencies.end() && deps->second.count(c2);
+	};
+	return !depends(class1->second, class2->second) && !depends(class2->second, class1->second);
+}
+
 MachineBasicBlock* Linearizer::linearizeScope(SPScope *S, MachineBasicBlock* last_block)
 {
-	auto blocks = S->getBlocksTopoOrd();
+	// Blocks of exclusive predicates are placed next to each other where possible,
+	// such that the scheduler can bundle their instructions after they are merged.
+	auto blocks = DisableBlockInterleaving ? S->getBlocksTopoOrd() :
+		S->getBlocksTopoOrd([&](auto first, auto second){ return interleaves(first, second); });
 
 	for(auto block: blocks){
 	    auto MBB = block->getMBB();
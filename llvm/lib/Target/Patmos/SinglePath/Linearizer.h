@@ -7,6 +7,9 @@
 #include "PatmosSinglePathInfo.h"
 #include "PatmosMachineFunctionInfo.h"
 
+#include <map>
+#include <set>
+
 namespace llvm {
 
 	class Linearizer : public MachineFunctionPass {
@@ -16,6 +19,15 @@ namespace llvm {
 		const PatmosInstrInfo *TII;
 		const PatmosRegisterInfo *TRI;
 
+		/// The equivalence class of the instructions of each block, if any.
+		std::map<const MachineBasicBlock*, unsigned> BlockClasses;
+
+		/// Which equivalence classes depend on which classes.
+		std::map<unsigned, std::set<unsigned>> ClassDependencies;
+
+		/// Whether the second block may follow the first to be scheduled with it,
+		/// i.e., both are predicated by classes that are never enabled together.
+		bool interleaves(const PredicatedBlock *first, const PredicatedBlock *second) const;
 
 		MachineBasicBlock* linearizeScope(SPScope *S, MachineBasicBlock* last_block = nullptr);
 
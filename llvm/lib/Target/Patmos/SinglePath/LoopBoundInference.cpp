@@ -0,0 +1,180 @@
+//===-- LoopBoundInference.cpp - Infer bounds of single-path loops --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass infers loop bounds of functions to be converted to single-path
+// code on bitcode level using scalar evolution.
+//
+// Single-path loops always execute their maximum number of iterations, so a
+// loose bound given through '#pragma loopbound' costs padding on every
+// execution. If scalar evolution can prove a lower maximum trip count, the
+// bound is tightened and a warning is emitted. Loops without a bound get the
+// inferred one.
+//
+// Bounds are carried by calls to "llvm.loop.bound" in the loop header, where
+// the arguments (a, b) denote a minimum of a+1 and a maximum of a+b+1
+// executions of the header.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosSinglePathInfo.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-singlepath"
+
+STATISTIC(NumBoundsTightened, "Number of loop bounds tightened by inference");
+STATISTIC(NumBoundsInferred,  "Number of loop bounds inferred for unbounded "
+                              "loops");
+
+static cl::opt<bool> DisableLoopBoundInference(
+    "mpatmos-disable-loop-bound-inference",
+    cl::init(false),
+    cl::desc("Do not tighten or infer the bounds of single-path loops."),
+    cl::Hidden);
+
+namespace {
+
+class PatmosLoopBoundInference : public FunctionPass {
+private:
+
+  /// Infer the bound of the loop and its subloops, updating or inserting the
+  /// llvm.loop.bound calls in the headers.
+  bool inferBounds(Function &F, ScalarEvolution &SE, Loop *L);
+
+public:
+  static char ID; // Pass identification, replacement for typeid
+
+  PatmosLoopBoundInference() : FunctionPass(ID) {}
+
+  /// getPassName - Return the pass' name.
+  StringRef getPassName() const override {
+    return "Patmos Single-Path Loop Bound Inference (bitcode)";
+  }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<ScalarEvolutionWrapperPass>();
+    AU.setPreservesCFG();
+  }
+
+  bool runOnFunction(Function &F) override;
+};
+
+} // end anonymous namespace
+
+char PatmosLoopBoundInference::ID = 0;
+
+
+FunctionPass *llvm::createPatmosLoopBoundInferencePass() {
+  return new PatmosLoopBoundInference();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/// Return the llvm.loop.bound call in the given block, or null if there is
+/// none.
+static CallInst *findLoopBound(BasicBlock *BB) {
+  for (Instruction &I : *BB) {
+    if (CallInst *CI = dyn_cast<CallInst>(&I)) {
+      Function *Callee = CI->getCalledFunction();
+      if (Callee && Callee->getName() == "llvm.loop.bound")
+        return CI;
+    }
+  }
+  return nullptr;
+}
+
+/// Return the declaration of llvm.loop.bound, declaring it if needed.
+static Function *getLoopBoundFunction(Module &M) {
+  if (Function *F = M.getFunction("llvm.loop.bound"))
+    return F;
+
+  std::vector<Type*> BoundTypes(2, Type::getInt32Ty(M.getContext()));
+  FunctionType *FT = FunctionType::get(Type::getVoidTy(M.getContext()),
+                                       BoundTypes, false);
+  return Function::Create(FT, Function::ExternalLinkage, "llvm.loop.bound", &M);
+}
+
+bool PatmosLoopBoundInference::runOnFunction(Function &F) {
+  if (DisableLoopBoundInference || !PatmosSinglePathInfo::isEnabled(F))
+    return false;
+
+  LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  ScalarEvolution &SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+
+  bool Changed = false;
+  for (Loop *L : LI) {
+    Changed |= inferBounds(F, SE, L);
+  }
+  return Changed;
+}
+
+bool PatmosLoopBoundInference::inferBounds(Function &F, ScalarEvolution &SE,
+                                           Loop *L) {
+  bool Changed = false;
+  for (Loop *SubLoop : *L) {
+    Changed |= inferBounds(F, SE, SubLoop);
+  }
+
+  // maximum number of executions of the header, 0 if unknown
+  uint64_t Inferred = SE.getSmallConstantMaxTripCount(L);
+  if (Inferred == 0)
+    return Changed;
+
+  BasicBlock *Header = L->getHeader();
+  CallInst *Bound = findLoopBound(Header);
+
+  if (!Bound) {
+    LLVM_DEBUG(dbgs() << "  Infer bound of loop '" << Header->getName()
+                      << "' in " << F.getName() << ": " << Inferred << "\n");
+
+    uint64_t Exact = SE.getSmallConstantTripCount(L);
+    uint64_t Min = Exact ? Exact : 1;
+
+    IRBuilder<> Builder(Header->getTerminator());
+    Builder.CreateCall(getLoopBoundFunction(*F.getParent()),
+                       {Builder.getInt32(Min - 1),
+                        Builder.getInt32(Inferred - Min)});
+    NumBoundsInferred++;
+    return true;
+  }
+
+  auto *MinArg = dyn_cast<ConstantInt>(Bound->getArgOperand(0));
+  auto *MaxArg = dyn_cast<ConstantInt>(Bound->getArgOperand(1));
+  if (!MinArg || !MaxArg)
+    return Changed;
+
+  uint64_t Min = MinArg->getZExtValue() + 1;
+  uint64_t Max = Min + MaxArg->getZExtValue();
+  if (Inferred >= Max)
+    return Changed;
+
+  // the bounds of specializations are loose for the constants by design
+  if (!F.hasFnAttribute("sp-specialized"))
+    errs() << "Warning: loop '" << Header->getName() << "' in '"
+           << F.getName() << "' is bounded to " << Max << " header "
+           << "executions, but executes it at most " << Inferred << " times; "
+           << "using the inferred bound.\n";
+
+  Min = std::min(Min, Inferred);
+  Bound->setArgOperand(0, ConstantInt::get(MinArg->getType(), Min - 1));
+  Bound->setArgOperand(1, ConstantInt::get(MaxArg->getType(), Inferred - Min));
+  NumBoundsTightened++;
+  return true;
+}
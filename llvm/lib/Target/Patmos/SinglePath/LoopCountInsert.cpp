@@ -84,7 +84,7 @@ void LoopCountInsert::classifyLoops(MachineFunction &MF){
 
 		auto header_mbb = loop->getHeader();
 
-		auto loop_bounds = getLoopBounds(header_mbb);
+		auto loop_bounds = getAnalysis<PatmosLoopBoundInfo>().getLoopBounds(header_mbb);
 
 		if(	loop_bounds && (loop_bounds->first == loop_bounds->second) ){
 			auto parent_header = loop->getParentLoop()? loop->getParentLoop()->getHeader():&*MF.begin();
@@ -100,6 +100,7 @@ void LoopCountInsert::classifyLoops(MachineFunction &MF){
 
 void LoopCountInsert::doFunction(MachineFunction &MF){
 	auto &LI = getAnalysis<MachineLoopInfo>();
+	auto &LBI = getAnalysis<PatmosLoopBoundInfo>();
 
 	classifyLoops(MF);
 
@@ -107,7 +108,7 @@ void LoopCountInsert::doFunction(MachineFunction &MF){
 		if(!LI.isLoopHeader(&header_mbb)) continue;
 
 		auto loop = LI.getLoopFor(&header_mbb);
-		auto loop_bounds = getLoopBounds(&header_mbb);
+		auto loop_bounds = LBI.getLoopBounds(&header_mbb);
 		if(!loop_bounds) {
 			report_fatal_error(
 				  "Single-path code generation failed! "
@@ -206,6 +207,11 @@ void LoopCountInsert::doFunction(MachineFunction &MF){
 			latch->ReplaceUsesOfBlockWith(&header_mbb, unilatch);
 		}
 
+		// The induction variables of the loop cannot replace the counter: they
+		// are not updated once the loop is disabled, but the loop still iterates
+		// up to its bound. Loops that exit exactly at their bound use their own
+		// exit condition instead, see classifyLoops. Counters of sibling loops
+		// share registers after register allocation.
 		if(PatmosSinglePathInfo::needsCounter(loop)) {
 			SPLoopCounters++;
 
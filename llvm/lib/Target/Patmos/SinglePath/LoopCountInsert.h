@@ -15,6 +15,7 @@
 #include "PatmosSubtarget.h"
 #include "PatmosSinglePathInfo.h"
 #include "PatmosMachineFunctionInfo.h"
+#include "TargetInfo/PatmosTargetInfo.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 
 namespace llvm {
@@ -45,6 +46,9 @@ namespace llvm {
 
 		void getAnalysisUsage(AnalysisUsage &AU) const override {
 			AU.addRequired<MachineLoopInfo>();
+			// New blocks are never headers, so the loop bounds remain valid.
+			AU.addRequired<PatmosLoopBoundInfo>();
+			AU.addPreserved<PatmosLoopBoundInfo>();
 			MachineFunctionPass::getAnalysisUsage(AU);
 		}
 
@@ -116,7 +116,8 @@ std::pair<unsigned, unsigned> minMaxForAll(
 /// We template such that we can use mocked MBBs when testing it.
 template<
   typename MachineBasicBlock,
-  typename MachineLoopInfo
+  typename MachineLoopInfo,
+  typename LoopBounds
 >
 std::pair<
   // The minimum/maximum number of accesses on any path leading to the block
@@ -128,7 +129,7 @@ memoryAccessAnalysis(
     const MachineBasicBlock *start_mbb,
     const MachineLoopInfo *LI,
     unsigned (*countAccesses)(const MachineBasicBlock *mbb),
-    std::pair<uint64_t, uint64_t> (*loopBounds)(const MachineBasicBlock *mbb)
+    LoopBounds loopBounds
 ) {
   LLVM_DEBUG(dbgs() << "\nStarting Memory Access Analysis\n");
 
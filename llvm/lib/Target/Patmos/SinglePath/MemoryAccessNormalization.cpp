@@ -26,6 +26,7 @@
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
+#include "llvm/Support/CommandLine.h"
 
 #include <deque>
 #include <set>
@@ -39,6 +40,44 @@ STATISTIC(OppositeComp, "Number of functions using 'opposite' algorithm for cons
 STATISTIC(NoComp, "Number of functions not needing any compensation for constant execution time");
 STATISTIC(CntCmpInstr, "Number of non-phi instructions added by the 'counter' compensation algorithm");
 
+/// MinimizeAccesses - Option to make the hybrid algorithm choose the
+/// compensation that performs the fewest main-memory accesses at runtime.
+static cl::opt<bool> MinimizeAccesses(
+    "mpatmos-cet-minimize-accesses",
+    cl::init(false),
+    cl::desc("Make the 'hybrid' constant execution-time algorithm choose the "
+             "compensation with the fewest main-memory accesses instead of "
+             "the fewest estimated cycles."),
+    cl::Hidden);
+
+/// AccessCycles - Option to set the latency of a main-memory access assumed
+/// by the cost model of the hybrid algorithm.
+static cl::opt<unsigned> AccessCycles(
+    "mpatmos-cet-access-cycles",
+    cl::init(21),
+    cl::desc("Cycles of a main-memory access assumed when choosing the "
+             "constant execution-time compensation algorithm (default 21)."),
+    cl::Hidden);
+
+/// InlineCompensation - Option to set up to which maximum compensation the
+/// 'counter' algorithm compensates inline instead of calling the
+/// compensation function.
+static cl::opt<unsigned> InlineCompensation(
+    "mpatmos-cet-inline-compensation",
+    cl::init(8),
+    cl::desc("Maximum compensation the 'counter' constant execution-time "
+             "algorithm performs inline, instead of calling the compensation "
+             "function (default 8)."),
+    cl::Hidden);
+
+/// Estimated cycles of calling and returning from the compensation function,
+/// on top of the accesses it performs.
+static const unsigned COMPENSATION_CALL_CYCLES = 10;
+
+/// Estimated cycles the compensation function spends on each access it may
+/// perform, besides the access itself.
+static const unsigned COMPENSATION_LOOP_CYCLES = 2;
+
 char MemoryAccessNormalization::ID = 0;
 
 FunctionPass *llvm::createMemoryAccessNormalizationPass(const PatmosTargetMachine &tm) {
@@ -69,16 +108,28 @@ static unsigned countAccesses(const MachineBasicBlock *mbb){
 
 /// Returns the maximum loop bound of the given block, assuming it is
 /// the header of a loop
-static std::pair<uint64_t,uint64_t> getLoopBoundMax(const MachineBasicBlock *mbb){
-  auto bounds = getLoopBounds(mbb);
+static std::pair<uint64_t,uint64_t> getLoopBoundMax(
+    const PatmosLoopBoundInfo &LBI, const MachineBasicBlock *mbb){
+  auto bounds = LBI.getLoopBounds(mbb);
   assert(bounds && "No bounds were given");
   return *bounds;
 }
 
+/// Returns whether the 'counter' algorithm compensates the given maximum
+/// inline. The inline sequence compares with an unsigned 5-bit immediate.
+static bool compensatesInline(unsigned max_compensation) {
+  return max_compensation <= InlineCompensation && isUInt<5>(max_compensation);
+}
+
+/// Returns how often the given block is executed in single-path code,
+/// where loops always run their maximum iteration count.
 /// Returns the minimum/maximum possible main memory accesses the function can do
 std::pair<unsigned,unsigned> MemoryAccessNormalization::getAccessBounds(MachineFunction &MF, llvm::MachineLoopInfo &LI) {
+  auto &LBI = getAnalysis<PatmosLoopBoundInfo>();
   auto accesses_counts = memoryAccessAnalysis(MF.getBlockNumbered(0), &LI,
-      countAccesses, getLoopBoundMax);
+      countAccesses, [&](const MachineBasicBlock *mbb){
+        return getLoopBoundMax(LBI, mbb);
+      });
 
   // Find the min/max number of accesses among all final blocks in the function
   unsigned max_end_accesses;
@@ -150,22 +201,48 @@ bool MemoryAccessNormalization::runOnMachineFunction(MachineFunction &MF) {
         auto counter_algo_instr_need = counter_compensate(MF, max_accesses, min_accesses, false);
 
         // Get the number of instructions the opposite predicate compensation algorithm
-        // would add to the function
+        // would add to the function, and how often they are executed.
+        // Every access is executed in each iteration of its loops and is then either
+        // performed or compensated, so all of them count as performed accesses.
         auto isPseudoRoot = MF.getInfo<PatmosMachineFunctionInfo>()->isSinglePathPseudoRoot();
-        auto &cldoms = getAnalysis<ConstantLoopDominators>().dominators;
+        auto &CLD = getAnalysis<ConstantLoopDominators>();
         auto opposite_algo_instr_need = 0;
+        uint64_t opposite_algo_instr_executed = 0;
+        uint64_t opposite_algo_accesses = 0;
         std::for_each(MF.begin(), MF.end(), [&](auto &BB){
-          if(!isPseudoRoot || !cldoms.begin()->second.count(&BB)){
+          auto iterations = CLD.getMaxExecutionCount(&BB);
+          assert(iterations && "No bounds were given");
+          opposite_algo_accesses += countAccesses(&BB) * *iterations;
+          if(!isPseudoRoot || !CLD.hasConstantExecutionCount(&BB)){
             opposite_algo_instr_need += countAccesses(&BB);
+            opposite_algo_instr_executed += countAccesses(&BB) * *iterations;
           }
         });
 
+        // The 'counter' algorithm compensates all at once at the end of the function,
+        // such that the function always performs exactly its maximum accesses.
+        // Its counter updates are approximated by the instructions it adds.
+        uint64_t counter_algo_cycles = (uint64_t) max_accesses * AccessCycles + counter_algo_instr_need;
+        if(!compensatesInline(max_accesses - min_accesses)) {
+          counter_algo_cycles += COMPENSATION_CALL_CYCLES +
+              (uint64_t) (max_accesses - min_accesses) * COMPENSATION_LOOP_CYCLES;
+        }
+        uint64_t opposite_algo_cycles = opposite_algo_accesses * AccessCycles + opposite_algo_instr_executed;
+
         LLVM_DEBUG(
             dbgs() << "\nInstructions needed (at least) for the 'counter' compensation algorithm:"<< counter_algo_instr_need << "\n";
             dbgs() << "Instructions needed (at least) for the 'opposite' compensation algorithm:"<< opposite_algo_instr_need << "\n";
+            dbgs() << "Accesses performed by the 'counter' compensation algorithm:"<< max_accesses << "\n";
+            dbgs() << "Accesses performed by the 'opposite' compensation algorithm:"<< opposite_algo_accesses << "\n";
+            dbgs() << "Estimated cycles of the 'counter' compensation algorithm:"<< counter_algo_cycles << "\n";
+            dbgs() << "Estimated cycles of the 'opposite' compensation algorithm:"<< opposite_algo_cycles << "\n";
         );
 
-        if(counter_algo_instr_need < opposite_algo_instr_need ||
+        bool counter_is_better = MinimizeAccesses ?
+            max_accesses < opposite_algo_accesses :
+            counter_algo_cycles < opposite_algo_cycles;
+
+        if(counter_is_better ||
             PatmosSinglePathInfo::getCETCompAlgo() == CompensationAlgo::counter
         ) {
           CounterComp++;
@@ -221,8 +298,8 @@ unsigned MemoryAccessNormalization::counter_compensate(MachineFunction &MF, unsi
   DebugLoc DL;
 
   auto compensation = memoryAccessCompensation(MF.getBlockNumbered(0), &LI, countAccesses);
-  auto &cldoms = getAnalysis<ConstantLoopDominators>().dominators;;
-  assert(cldoms.size() == 1 && "Constant-Loop Dominator Analysis didn't find a unique end block.");
+  assert(getAnalysis<ConstantLoopDominators>().dominators.size() == 1 &&
+         "Constant-Loop Dominator Analysis didn't find a unique end block.");
 
   LLVM_DEBUG(
     dbgs() << "\nMemory Access Compensation Results:\n";
@@ -454,6 +531,8 @@ unsigned MemoryAccessNormalization::compensateMerge(
 }
 
 /// Adds the final call to the compensation function in the end block.
+/// If the maximum compensation is small, the compensation is instead performed
+/// by an inline sequence of predicated loads.
 /// If there are multiple blocks returning from the function, throws an error.
 ///
 /// Returns the number of instructions added
@@ -471,15 +550,19 @@ unsigned MemoryAccessNormalization::compensateEnd(
   assert(end != MF.end() && "Couldn't find end block");
   auto *BB = &*end;
 
+  auto inline_compensation = compensatesInline(max_compensation);
+
   if (should_insert) {
 
-	// Put the max possible into r23 as input
 	auto max_opcode = max_compensation > 4095 ? Patmos::LIl : Patmos::LIi;
-	BuildMI(*BB, BB->getFirstTerminator(), DL, TII->get(max_opcode),
-	  Patmos::R23)
-	  .addReg(Patmos::NoRegister).addImm(0)
-	  .addImm(max_compensation)
-	  .setMIFlags(MachineInstr::FrameSetup);
+	if (!inline_compensation) {
+	  // Put the max possible into r23 as input
+	  BuildMI(*BB, BB->getFirstTerminator(), DL, TII->get(max_opcode),
+	    Patmos::R23)
+	    .addReg(Patmos::NoRegister).addImm(0)
+	    .addImm(max_compensation)
+	    .setMIFlags(MachineInstr::FrameSetup);
+	}
 
 	assert(block_regs.count(BB) && "End block doesn't have a counter register");
 
@@ -498,6 +581,27 @@ unsigned MemoryAccessNormalization::compensateEnd(
 		.addImm(max_compensation);
 	}
 
+	if (inline_compensation) {
+	  // Perform the i'th load only if at least i accesses are missing, i.e. if
+	  // r24 is not lower than i.
+	  // Like the call, the sequence is never predicated by the single-path transformation.
+	  for (unsigned i = 1; i <= max_compensation; i++) {
+	    auto lower = createVirtualRegisterWithHint(MF.getRegInfo());
+	    BuildMI(*BB, BB->getFirstTerminator(), DL, TII->get(Patmos::CMPIULT), lower)
+	      .addReg(Patmos::NoRegister).addImm(0)
+	      .addReg(Patmos::R24).addImm(i)
+	      .setMIFlags(MachineInstr::FrameSetup);
+	    BuildMI(*BB, BB->getFirstTerminator(), DL, TII->get(Patmos::LWM), Patmos::R0)
+	      .addReg(lower).addImm(1)
+	      .addReg(Patmos::R0).addImm(0)
+	      .setMIFlags(MachineInstr::FrameSetup);
+	  }
+
+	  LLVM_DEBUG(
+	    dbgs() << "\nInserted " << max_compensation << " inline compensation loads in '" << BB->getName() << "'\n");
+	  return 1 + 2 * max_compensation;
+	}
+
 	// Insert call. Since the compensation function doesn't follow usual calling convention,
 	// manually set use definitions
 	// We use r23 and r24 for input to ensure the prologue/epilogue will ensure they aren't
@@ -520,5 +624,5 @@ unsigned MemoryAccessNormalization::compensateEnd(
 	  dbgs() << "\nInserted call to __patmos_main_mem_access_compensation in '" << BB->getName() << "'\n");
   }
 
-  return 3;
+  return inline_compensation ? 1 + 2 * max_compensation : 3;
 }
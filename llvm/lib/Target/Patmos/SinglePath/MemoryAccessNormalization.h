@@ -5,6 +5,7 @@
 #include "PatmosTargetMachine.h"
 #include "llvm/CodeGen/MachineLoopInfo.h"
 #include "ConstantLoopDominators.h"
+#include "TargetInfo/PatmosTargetInfo.h"
 
 #define DEBUG_TYPE "patmos-const-exec"
 
@@ -49,6 +50,7 @@ public:
   /// getAnalysisUsage - Specify which passes this pass depends on
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.addRequired<MachineLoopInfo>();
+    AU.addRequired<PatmosLoopBoundInfo>();
     AU.addRequired<ConstantLoopDominators>();
     AU.addPreserved<ConstantLoopDominators>();
     MachineFunctionPass::getAnalysisUsage(AU);
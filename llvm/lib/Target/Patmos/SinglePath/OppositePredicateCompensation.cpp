@@ -64,11 +64,11 @@ bool OppositePredicateCompensation::runOnMachineFunction(MachineFunction &MF) {
 
 void OppositePredicateCompensation::compensate(MachineFunction &MF)
 {
-  auto &cldoms = getAnalysis<ConstantLoopDominators>().dominators;
+  auto &CLD = getAnalysis<ConstantLoopDominators>();
 
   std::for_each(MF.begin(), MF.end(), [&](auto &BB){
     auto dominates = PatmosSinglePathInfo::isRootLike(MF)  &&
-        cldoms.begin()->second.count(&BB);
+        CLD.hasConstantExecutionCount(&BB);
 
     for(auto instr_iter = BB.begin(); instr_iter != BB.end(); ++instr_iter){
       if( !dominates &&
@@ -19,15 +19,23 @@
 // The calls inserted by lowering and unnecessarily cloned functions are
 // rewritten and removed, respectively, in the PatmosSPMark pass.
 //
+// With -mpatmos-singlepath-share, callees that are time-predictable already
+// (without data-dependent branches, without side effects and calling only
+// such functions) are not cloned. They are marked with the attribute
+// "sp-shared" and called by conventional and single-path code alike.
+//
 //===----------------------------------------------------------------------===//
 
 
 #include "PatmosSinglePathInfo.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/SmallSet.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/IntrinsicsPatmos.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Pass.h"
@@ -44,6 +52,10 @@ using namespace llvm;
 
 STATISTIC(NumSPRoots,     "Number of single-path roots");
 STATISTIC(NumSPClone,     "Number of function clones");
+STATISTIC(NumSPShared,    "Number of time-predictable functions shared instead "
+                          "of cloned");
+STATISTIC(NumSPSharedInstrs, "Number of bitcode instructions not cloned due to "
+                             "sharing");
 
 namespace {
 
@@ -67,6 +79,9 @@ private:
   /// Used to detect cycles in the call graph.
   std::set<Function*> ExploreFinished;
 
+  /// Functions known to be (or not to be) time-predictable
+  std::map<const Function*, bool> TimePredictable;
+
   void loadFromGlobalVariable(SmallSet<StringRef, 32> &Result,
                               const GlobalVariable *GV) const;
 
@@ -78,6 +93,23 @@ private:
    */
   void cloneAndMark(Function *F);
 
+  /**
+   * Check whether F can be called from single-path code without being
+   * converted: its branches do not depend on data, it does not write memory
+   * other than its own locals, does not contain operations that are lowered
+   * to library calls, and only calls functions satisfying the same.
+   */
+  bool isTimePredictable(const Function *F);
+
+  /**
+   * Collect the instructions of F that compute the same values in every
+   * call, provided that all branches of F do: instructions on constants and
+   * on such instructions, e.g., the induction variables of loops with
+   * constant bounds, but not on the arguments or on memory.
+   */
+  void collectInvariants(const Function *F,
+                         SmallPtrSetImpl<const Value*> &Invariants) const;
+
   /**
    * Iterate through all instructions of F.
    * Explore callees of F and rewrite the calls.
@@ -251,6 +283,19 @@ void PatmosSPClone::explore(Function *F) {
         // skip LLVM intrinsics
         if (Callee->isIntrinsic()) continue;
 
+        // call time-predictable functions as they are
+        if (PatmosSinglePathInfo::shareTimePredictable() &&
+            isTimePredictable(Callee)) {
+          if (!PatmosSinglePathInfo::isShared(*Callee)) {
+            LLVM_DEBUG( dbgs() << "  Share function: " << Callee->getName()
+                               << "\n");
+            Callee->addFnAttr("sp-shared");
+            NumSPShared++;
+            NumSPSharedInstrs += Callee->getInstructionCount();
+          }
+          continue;
+        }
+
         Function *SPCallee;
         if (!ClonedFunctions.count(Callee)) {
           // clone function
@@ -270,3 +315,113 @@ void PatmosSPClone::explore(Function *F) {
   }
   ExploreFinished.insert(F);
 }
+
+void PatmosSPClone::collectInvariants(const Function *F,
+                              SmallPtrSetImpl<const Value*> &Invariants) const {
+  // optimistically assume all computations to be invariant, the cycles of
+  // the induction variables are invariant if their start and steps are
+  for (const Instruction &I : instructions(F)) {
+    if (isa<PHINode>(I) || isa<BinaryOperator>(I) || isa<CmpInst>(I) ||
+        isa<SelectInst>(I) || isa<CastInst>(I) || isa<FreezeInst>(I))
+      Invariants.insert(&I);
+  }
+
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (const Instruction &I : instructions(F)) {
+      if (!Invariants.count(&I))
+        continue;
+      if (std::any_of(I.op_begin(), I.op_end(), [&](const Use &U) {
+            return !isa<Constant>(U) && !Invariants.count(U);
+          })) {
+        Invariants.erase(&I);
+        Changed = true;
+      }
+    }
+  }
+}
+
+bool PatmosSPClone::isTimePredictable(const Function *F) {
+  auto Known = TimePredictable.find(F);
+  if (Known != TimePredictable.end())
+    return Known->second;
+
+  // recursive functions are not shared
+  TimePredictable[F] = false;
+
+  if (F->isDeclaration() || F->isVarArg() ||
+      PatmosSinglePathInfo::isEnabled(*F))
+    return false;
+
+  // Branches that do not depend on data take the same path in every call,
+  // e.g., the branches of loops with constant bounds.
+  SmallPtrSet<const Value*, 32> Invariants;
+  collectInvariants(F, Invariants);
+  auto IsInvariant = [&](const Value *V) {
+    return isa<Constant>(V) || Invariants.count(V);
+  };
+
+  for (const BasicBlock &BB : *F) {
+    const Instruction *Term = BB.getTerminator();
+    if (const BranchInst *Br = dyn_cast<BranchInst>(Term)) {
+      if (Br->isConditional() && !IsInvariant(Br->getCondition()))
+        return false;
+    } else if (const SwitchInst *SI = dyn_cast<SwitchInst>(Term)) {
+      if (!IsInvariant(SI->getCondition()))
+        return false;
+    } else if (!isa<ReturnInst>(Term)) {
+      return false;
+    }
+
+    for (const Instruction &I : BB) {
+      // floating-point and division are lowered to library calls
+      if (I.getType()->isFPOrFPVectorTy() ||
+          std::any_of(I.op_begin(), I.op_end(), [](const Use &U) {
+            return U->getType()->isFPOrFPVectorTy();
+          }))
+        return false;
+
+      switch (I.getOpcode()) {
+      case Instruction::UDiv: case Instruction::SDiv:
+      case Instruction::URem: case Instruction::SRem:
+        return false;
+      case Instruction::Shl: case Instruction::LShr: case Instruction::AShr:
+        // wide shifts by a variable amount are expanded with branches
+        if (I.getType()->getScalarSizeInBits() > 32 &&
+            !isa<Constant>(I.getOperand(1)))
+          return false;
+        break;
+      default:
+        break;
+      }
+
+      if (const LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+        if (LI->isVolatile())
+          return false;
+      }
+      else if (const StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+        // storing to its own locals is harmless on a disabled path
+        if (SI->isVolatile() ||
+            !isa<AllocaInst>(getUnderlyingObject(SI->getPointerOperand())))
+          return false;
+      }
+      else if (const CallBase *CB = dyn_cast<CallBase>(&I)) {
+        const Function *Callee = CB->getCalledFunction();
+        if (CB->isInlineAsm() || !Callee || isa<MemIntrinsic>(CB))
+          return false;
+        // starting a transfer on a disabled path is not harmless, polling is
+        if (Callee->getIntrinsicID() == Intrinsic::patmos_noc_send)
+          return false;
+        if (!Callee->isIntrinsic() && !isTimePredictable(Callee))
+          return false;
+      }
+      else if (I.mayWriteToMemory()) {
+        return false;
+      }
+    }
+  }
+
+  TimePredictable[F] = true;
+  return true;
+}
@@ -58,6 +58,8 @@ STATISTIC(NumSPPseudo,  "Number of functions marked as pseudo-root");
 STATISTIC(NumSPCall,  "Number of call instructions from & to single-path functions");
 STATISTIC(NumSPPseudoCall,  "Number of call instructions from & to pseudo-root functions");
 STATISTIC(NumSPCleared, "Number of sp-maybe functions deleted");
+STATISTIC(NumSPSharedBytes, "Estimated bytes of code saved by sharing "
+                            "time-predictable functions");
 
 namespace {
 
@@ -100,6 +102,15 @@ private:
    */
   void scanAndRewriteCalls(MachineFunction *MF, Worklist &W);
 
+  /// Shared functions whose code size was already accounted for.
+  std::set<const MachineFunction*> SharedFunctions;
+
+  /**
+   * Account for the code size of a shared function called by single-path
+   * code and of the shared functions it calls in turn.
+   */
+  void accountShared(MachineFunction *MF);
+
   /**
    * Remove all cloned 'sp-maybe' machine functions that are not marked as
    * single-path in PatmosMachineFunctionInfo.
@@ -213,9 +224,9 @@ void PatmosSPMark::scanAndRewriteCalls(MachineFunction *MF, Worklist &W) {
 
   MachineDominatorTree MDT(*MF);
   MachineLoopInfo LI(MDT);
-  ConstantLoopDominators CLD(*MF, LI);
-
-  auto &bounded_doms = CLD.dominators;
+  PatmosLoopBoundInfo LBI;
+  LBI.runOnMachineFunction(*MF);
+  ConstantLoopDominators CLD(*MF, LI, LBI);
 
   for (MachineFunction::iterator MBB = MF->begin(), MBBE = MF->end();
                                  MBB != MBBE; ++MBB) {
@@ -225,10 +236,17 @@ void PatmosSPMark::scanAndRewriteCalls(MachineFunction *MF, Worklist &W) {
       if (MI->isCall()) {
         auto *original_target_MF = getCallTargetMFOrAbort(MI,MBB);
 
+        // time-predictable functions are called as they are
+        if (PatmosSinglePathInfo::isShared(original_target_MF->getFunction())) {
+          LLVM_DEBUG(dbgs() << "Call to shared function: "; MI->dump());
+          accountShared(original_target_MF);
+          continue;
+        }
+
         auto *original_PMFI = original_target_MF->getInfo<PatmosMachineFunctionInfo>();
 
         auto pseudo_target = PatmosSinglePathInfo::usePseudoRoots() &&
-                              bounded_doms.begin()->second.count(&*MBB) &&
+                              CLD.hasConstantExecutionCount(&*MBB) &&
                               MF->getInfo<PatmosMachineFunctionInfo>()->isSinglePathPseudoRoot();
         if(pseudo_target) {
           LLVM_DEBUG(dbgs() << "Call to pseudo-root: "; MI->dump());
@@ -294,6 +312,25 @@ void PatmosSPMark::rewriteCall(MachineInstr *MI, bool pseudo_root_target) {
   if(pseudo_root_target) NumSPPseudoCall++;
 }
 
+void PatmosSPMark::accountShared(MachineFunction *MF) {
+  if (!SharedFunctions.insert(MF).second)
+    return;
+
+  const PatmosInstrInfo *TII = TM.getInstrInfo();
+  for (MachineBasicBlock &MBB : *MF) {
+    for (MachineInstr &MI : MBB) {
+      NumSPSharedBytes += TII->getInstrSize(&MI);
+
+      if (MI.isCall()) {
+        if (MachineFunction *Callee = getCallTargetMF(&MI)) {
+          if (PatmosSinglePathInfo::isShared(Callee->getFunction()))
+            accountShared(Callee);
+        }
+      }
+    }
+  }
+}
+
 void PatmosSPMark::removeUncalledSPFunctions(Module &M) {
   for(auto F = M.begin(); F != M.end(); ++F) {
     if (F->hasFnAttribute("sp-maybe") || F->hasFnAttribute("sp-pseudo")) {
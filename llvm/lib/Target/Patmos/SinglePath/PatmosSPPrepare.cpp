@@ -195,12 +195,9 @@ void PatmosSPPrepare::doPrepareFunction(MachineFunction &MF) {
     PMFI.addSinglePathFI(fi);
   }
 
-  // if another (_sp_-)function is called, reserve space for re-/storing R9
-  if (MFI.hasCalls()) {
-    PMFI.startSinglePathCallSpill();
-    int fi = MFI.CreateStackObject(TRI->getSpillSize(RC), TRI->getSpillAlign(RC), false);
-    PMFI.addSinglePathFI(fi);
-  }
+  // The return information of functions containing calls is saved by the
+  // frame setup, which is never predicated, i.e., exactly once per call of
+  // the function. Leaf functions keep it in SRB/SRO, no slot is needed.
 }
 
 
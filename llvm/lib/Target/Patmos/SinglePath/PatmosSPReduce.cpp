@@ -16,13 +16,13 @@
 #include "PatmosMachineFunctionInfo.h"
 #include "PatmosSubtarget.h"
 #include "PatmosTargetMachine.h"
+#include "PatmosRegionTimer.h"
 #include "TargetInfo/PatmosTargetInfo.h"
 #include "llvm/IR/Function.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/GraphTraits.h"
 #include "llvm/ADT/DepthFirstIterator.h"
 #include "llvm/ADT/PostOrderIterator.h"
-#include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineDominators.h"
@@ -434,13 +434,14 @@ void PatmosSPReduce::doReduceFunction(MachineFunction &MF) {
 
   LLVM_DEBUG( dbgs() << "RegAlloc\n" );
   RAInfos.clear();
-  RAInfos = RAInfo::computeRegAlloc(RootScope, AvailPredRegs.size());
+  {
+    PatmosRegionTimer T("sp-regalloc", "Single-path predicate register allocation");
+    RAInfos = RAInfo::computeRegAlloc(RootScope, AvailPredRegs.size());
+  }
 
-  // before inserting code, we need to obtain additional instructions that are
-  // spared from predication (i.e. need to execute unconditionally)
-  // -> instructions that store/restore return information
-  // NB: we execute the whole frame setup unconditionally!
-  //collectReturnInfoInsts(MF);
+  // The whole frame setup executes unconditionally, including the save and
+  // restore of the return information (s7+s8), which are thus not predicated
+  // below. Functions without calls do not save it at all.
 
   // Guard the instructions (no particular order necessary)
   for (auto iter = df_begin(RootScope), end = df_end(RootScope);
@@ -468,8 +469,11 @@ void PatmosSPReduce::doReduceFunction(MachineFunction &MF) {
   // Following walk of the SPScope tree linearizes the CFG structure,
   // inserting MBBs as required (preheader, spill/restore, loop counts, ...)
   LLVM_DEBUG( dbgs() << "Linearize MBBs\n" );
-  LinearizeWalker LW(*this, MF);
-  RootScope->walk(LW);
+  {
+    PatmosRegionTimer T("sp-linearize", "Single-path linearization");
+    LinearizeWalker LW(*this, MF);
+    RootScope->walk(LW);
+  }
 
   // Following function merges MBBs in the linearized CFG in order to
   // simplify it
@@ -943,10 +947,6 @@ void PatmosSPReduce::applyPredicates(SPScope *S, MachineFunction &MF) {
           continue;
           DEBUG_TRACE(dbgs() << "    skip frame setup: " << *MI);
       }
-      if (ReturnInfoInsts.count(&*MI)) {
-          DEBUG_TRACE(dbgs() << "    skip return info (re-)storing: " << *MI);
-          continue;
-      }
 
       assert(instrPreds.count(&(*MI)));
       auto instrPred = instrPreds[&(*MI)].first;
@@ -1212,80 +1212,6 @@ void PatmosSPReduce::mergeMBBs(MachineFunction &MF) {
   order.clear();
 }
 
-void PatmosSPReduce::collectReturnInfoInsts(MachineFunction &MF) {
-  LLVM_DEBUG( dbgs() << "Collect return info insts\n" );
-
-  ReturnInfoInsts.clear();
-
-  SmallSet<unsigned, 4> SpecialRegs;
-  SpecialRegs.insert(Patmos::SRB);
-  SpecialRegs.insert(Patmos::SRO);
-  SpecialRegs.insert(Patmos::S0);
-
-  for (MachineFunction::iterator MBB = MF.begin(), MBBe = MF.end();
-      MBB != MBBe; ++MBB) {
-    for (MachineBasicBlock::iterator MI = MBB->begin(), MIe = MBB->end();
-        MI != MIe; ++MI) {
-
-      if (!MI->getFlag(MachineInstr::FrameSetup)) continue;
-
-      if (MI->getOpcode() == Patmos::MFS &&
-          SpecialRegs.count(MI->getOperand(3).getReg())) {
-        // store return info in prologue (reads SRB/SRO)
-        ReturnInfoInsts.insert(&*MI);
-        LLVM_DEBUG(dbgs() << "   in MBB#" << MBB->getNumber() << ": "; MI->dump());
-        // get reg it defines
-        unsigned reg = MI->getOperand(0).getReg();
-        // search down for first use of reg (store to stack slot)
-        MachineBasicBlock::iterator UMI = MI;
-        bool found = false;
-        while (++UMI != MIe && !found) {
-          // if UMI uses reg
-          for (unsigned i = 0; i < UMI->getNumOperands(); i++) {
-            const MachineOperand &MO = UMI->getOperand(i);
-            if ( MO.isReg() && MO.getReg() == reg) {
-
-              assert(UMI->getFlag(MachineInstr::FrameSetup));
-              ReturnInfoInsts.insert(&*UMI);
-              LLVM_DEBUG(dbgs() << "         #" << MBB->getNumber() << ": ";
-                  UMI->dump());
-              found = true;
-              break;
-            }
-          }
-        } // end inner loop
-        continue;
-      }
-      if (MI->getOpcode() == Patmos::MTS &&
-          SpecialRegs.count(MI->getOperand(0).getReg())) {
-        // restore return info in epilogue (writes SRB/SRO)
-        ReturnInfoInsts.insert(&*MI);
-        LLVM_DEBUG(dbgs() << "   in MBB#" << MBB->getNumber() << ": "; MI->dump());
-        // get reg it uses
-        unsigned reg = MI->getOperand(3).getReg();
-        // search up for def of reg (load from stack slot)
-        MachineBasicBlock::iterator DMI = std::prev(MI);
-        bool found = false;
-        while (!found) {
-          // if DMI defines reg
-          if (DMI->definesRegister(reg)) {
-            assert(DMI->getFlag(MachineInstr::FrameSetup));
-            ReturnInfoInsts.insert(&*DMI);
-            LLVM_DEBUG(dbgs() << "         #" << MBB->getNumber() << ": ";
-                DMI->dump());
-            found = true;
-            break;
-          }
-          if (DMI == MBB->begin()) break;
-          --DMI;
-        } // end inner loop
-        continue;
-      }
-    }
-
-  }
-}
-
 void PatmosSPReduce::eliminateFrameIndices(MachineFunction &MF) {
 
   for (MachineFunction::iterator MBB = MF.begin(), MBBe = MF.end();
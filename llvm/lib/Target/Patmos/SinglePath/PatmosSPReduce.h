@@ -160,10 +160,6 @@ namespace llvm {
     /// mergeMBBs - Merge the linear sequence of MBBs as possible
     void mergeMBBs(MachineFunction &MF);
 
-    /// collectReturnInfoInsts - Collect instructions that store/restore
-    /// return information in ReturnInfoInsts
-    void collectReturnInfoInsts(MachineFunction &MF);
-
     /// eliminateFrameIndices - Batch call TRI->eliminateFrameIndex() on the
     /// collected stack store and load indices
     void eliminateFrameIndices(MachineFunction &MF);
@@ -194,11 +190,6 @@ namespace llvm {
     // conditions before the branch will be set the kill flag
     std::map<MachineBasicBlock *, MachineOperand> KilledCondRegs;
 
-    // To preserve the call hierarchy (calls are unconditional in single-path
-    // code) instructions that store/restore return information (s7+s8)
-    // need to be excluded from predication
-    std::set<const MachineInstr *> ReturnInfoInsts;
-
   public:
     /// Pass ID
     static char ID;
@@ -0,0 +1,135 @@
+//===-- PatmosSPRegionExtract.cpp - Outline single-path loops -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass outlines loops marked for single-path code generation on bitcode
+// level into functions of their own, which become single-path roots.
+// Only these kernels are then converted to single-path code, while the code
+// surrounding them stays conventional.
+//
+// Loops are marked by the loop metadata "llvm.loop.singlepath", which clang
+// emits for '#pragma patmos singlepath'. Of nested marked loops, only the
+// outermost one is outlined. Loops in functions that are converted to
+// single-path code anyway are left untouched.
+//
+// The pass must run before PatmosSPClone, which then handles the outlined
+// functions like any other root marked with the "sp-root" attribute.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosSinglePathInfo.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-singlepath"
+
+STATISTIC(NumSPRegions, "Number of loops outlined as single-path roots");
+
+namespace {
+
+class PatmosSPRegionExtract : public ModulePass {
+private:
+
+  /// Return the outermost loop of the function marked for single-path code
+  /// generation, or null if there is none.
+  Loop *findMarkedLoop(LoopInfo &LI) const;
+
+  /// Outline all loops of the function marked for single-path code
+  /// generation. Returns true if any loop was outlined.
+  bool extractRegions(Function &F);
+
+public:
+  static char ID; // Pass identification, replacement for typeid
+
+  PatmosSPRegionExtract() : ModulePass(ID) {}
+
+  /// getPassName - Return the pass' name.
+  StringRef getPassName() const override {
+    return "Patmos Single-Path Region Extraction (bitcode)";
+  }
+
+  bool runOnModule(Module &M) override;
+};
+
+} // end anonymous namespace
+
+char PatmosSPRegionExtract::ID = 0;
+
+
+ModulePass *llvm::createPatmosSPRegionExtractPass() {
+  return new PatmosSPRegionExtract();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool PatmosSPRegionExtract::runOnModule(Module &M) {
+  LLVM_DEBUG( dbgs() <<
+         "[Single-Path] Outline loops marked for single-path code\n");
+
+  // Outlining adds functions to the module, collect the candidates first.
+  std::vector<Function*> Candidates;
+  for (Function &F : M) {
+    if (!F.isDeclaration() && !PatmosSinglePathInfo::isEnabled(F))
+      Candidates.push_back(&F);
+  }
+
+  bool Changed = false;
+  for (Function *F : Candidates) {
+    Changed |= extractRegions(*F);
+  }
+  return Changed;
+}
+
+Loop *PatmosSPRegionExtract::findMarkedLoop(LoopInfo &LI) const {
+  // Outer loops precede their inner loops in preorder.
+  for (Loop *L : LI.getLoopsInPreorder()) {
+    if (findOptionMDForLoop(L, "llvm.loop.singlepath"))
+      return L;
+  }
+  return nullptr;
+}
+
+bool PatmosSPRegionExtract::extractRegions(Function &F) {
+  bool Changed = false;
+
+  // Outlining invalidates the analyses, recompute them for every loop.
+  while (true) {
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+
+    Loop *L = findMarkedLoop(LI);
+    if (!L)
+      break;
+
+    CodeExtractor CE(DT, *L, false, nullptr, nullptr, nullptr, "sp_region");
+    CodeExtractorAnalysisCache CEAC(F);
+    Function *Region = CE.isEligible() ? CE.extractCodeRegion(CEAC) : nullptr;
+    if (!Region) {
+      report_fatal_error("Single-path code generation failed due to a loop "
+                         "that could not be outlined in '" + F.getName() +
+                         "'!");
+    }
+
+    LLVM_DEBUG( dbgs() << "  Outline loop '" << L->getHeader()->getName()
+                       << "' of " << F.getName() << " -> "
+                       << Region->getName() << "\n");
+
+    Region->addFnAttr("sp-root");
+    NumSPRegions++;
+    Changed = true;
+  }
+  return Changed;
+}
@@ -0,0 +1,296 @@
+//===-- PatmosSPSpecialize.cpp - Specialize single-path callees -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass specializes the functions called by single-path code on bitcode
+// level for the constant arguments they are called with, if the arguments
+// determine the trip count of a loop of the callee.
+//
+// Single-path loops always execute their maximum number of iterations. A loop
+// iterating up to an argument is thus bounded by its '#pragma loopbound' for
+// every caller, also for callers passing a small constant. In a specialized
+// clone the argument is replaced by the constant, of which
+// PatmosLoopBoundInference derives the exact bound.
+//
+// Starting at the single-path roots, calls passing constant integers for such
+// arguments are redirected to a clone, which is shared by all calls passing
+// the same constants. The calls of the clones are specialized in turn, also
+// for arguments that are only passed on to loops of other functions. Every
+// clone occupies method cache space of its own, the callees are thus limited
+// in size and in their number of clones.
+//
+// The pass must run before PatmosSPClone, which then clones the specialized
+// functions for single-path code as any other callee of the roots.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosSinglePathInfo.h"
+#include "llvm/ADT/SmallBitVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <map>
+#include <set>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-singlepath"
+
+STATISTIC(NumSPSpecialized, "Number of functions specialized for the "
+                            "constant arguments of single-path calls");
+STATISTIC(NumSPSpecializedCalls, "Number of single-path calls redirected to "
+                                 "specialized functions");
+
+static cl::opt<bool> DisableSPSpecialize(
+    "mpatmos-disable-sp-specialize",
+    cl::init(false),
+    cl::desc("Do not specialize the callees of single-path code for "
+             "constant loop bound arguments."),
+    cl::Hidden);
+
+static cl::opt<unsigned> SPSpecializeMaxSize(
+    "mpatmos-sp-specialize-max-size",
+    cl::init(200),
+    cl::desc("Maximum number of bitcode instructions of a function that is "
+             "specialized for single-path calls (default: 200)."),
+    cl::Hidden);
+
+static cl::opt<unsigned> SPSpecializeMaxClones(
+    "mpatmos-sp-specialize-max-clones",
+    cl::init(4),
+    cl::desc("Maximum number of specializations of a function for "
+             "single-path calls (default: 4)."),
+    cl::Hidden);
+
+namespace {
+
+class PatmosSPSpecialize : public ModulePass {
+private:
+  /// The constant arguments a function is specialized for, by their index.
+  typedef std::vector<std::pair<unsigned, ConstantInt*> > ConstantArgs;
+
+  /// The names of the roots given on the command line, PatmosSPClone marks
+  /// them later on.
+  std::set<StringRef> RootNames;
+
+  /// The specializations created so far, by function and constants.
+  std::map<std::pair<Function*, ConstantArgs>, Function*> Specializations;
+
+  /// The number of specializations of each function.
+  std::map<Function*, unsigned> NumClones;
+
+  /// The arguments of each function that determine a loop trip count.
+  std::map<Function*, SmallBitVector> BoundArgs;
+
+  /// Return the arguments of a function that determine the trip count of a
+  /// loop, directly or by a call. Functions in recursions have none.
+  const SmallBitVector &getBoundArgs(Function *F);
+
+  /// Check whether a value determines the exit condition of a loop, or an
+  /// argument of a call that does so.
+  bool isBoundValue(Value *V, LoopInfo &LI);
+
+  /// Return the specialization of a function for the given constants,
+  /// creating it if the limits allow. Returns null otherwise.
+  Function *getSpecialization(Function *F, const ConstantArgs &Args);
+
+  /// Redirect the calls of a function with constant bound arguments to
+  /// specializations, which are added to the worklist.
+  bool specializeCalls(Function *F, std::vector<Function*> &WL);
+
+public:
+  static char ID; // Pass identification, replacement for typeid
+
+  PatmosSPSpecialize() : ModulePass(ID) {}
+
+  /// getPassName - Return the pass' name.
+  StringRef getPassName() const override {
+    return "Patmos Single-Path Callee Specialization (bitcode)";
+  }
+
+  bool runOnModule(Module &M) override;
+};
+
+} // end anonymous namespace
+
+char PatmosSPSpecialize::ID = 0;
+
+
+ModulePass *llvm::createPatmosSPSpecializePass() {
+  return new PatmosSPSpecialize();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool PatmosSPSpecialize::runOnModule(Module &M) {
+  if (DisableSPSpecialize)
+    return false;
+
+  LLVM_DEBUG( dbgs() <<
+         "[Single-Path] Specialize callees for constant loop bounds\n");
+
+  PatmosSinglePathInfo::getRootNames(RootNames);
+
+  std::vector<Function*> WL;
+  for (Function &F : M) {
+    if (!F.isDeclaration() &&
+        (PatmosSinglePathInfo::isRoot(F) || RootNames.count(F.getName())))
+      WL.push_back(&F);
+  }
+
+  bool Changed = false;
+  while (!WL.empty()) {
+    Function *F = WL.back();
+    WL.pop_back();
+    Changed |= specializeCalls(F, WL);
+  }
+
+  RootNames.clear();
+  Specializations.clear();
+  NumClones.clear();
+  BoundArgs.clear();
+  return Changed;
+}
+
+bool PatmosSPSpecialize::isBoundValue(Value *V, LoopInfo &LI) {
+  SmallPtrSet<Value*, 16> Visited;
+  std::vector<Value*> Values(1, V);
+  while (!Values.empty()) {
+    Value *Cur = Values.back();
+    Values.pop_back();
+
+    for (User *U : Cur->users()) {
+      Instruction *I = dyn_cast<Instruction>(U);
+      if (!I || !Visited.insert(I).second)
+        continue;
+
+      if (auto *Cmp = dyn_cast<ICmpInst>(I)) {
+        for (User *CmpUser : Cmp->users()) {
+          auto *Br = dyn_cast<BranchInst>(CmpUser);
+          if (!Br)
+            continue;
+          Loop *L = LI.getLoopFor(Br->getParent());
+          if (L && L->isLoopExiting(Br->getParent()))
+            return true;
+        }
+      } else if (auto *CI = dyn_cast<CallInst>(I)) {
+        Function *Callee = CI->getCalledFunction();
+        if (!Callee || Callee->isDeclaration() || Callee->isVarArg())
+          continue;
+        const SmallBitVector &CalleeArgs = getBoundArgs(Callee);
+        for (unsigned i = 0, e = CI->arg_size(); i != e; i++) {
+          if (CI->getArgOperand(i) == Cur && CalleeArgs.test(i))
+            return true;
+        }
+      } else if (isa<PHINode>(I) || isa<CastInst>(I) ||
+                 isa<BinaryOperator>(I) || isa<SelectInst>(I)) {
+        Values.push_back(I);
+      }
+    }
+  }
+  return false;
+}
+
+const SmallBitVector &PatmosSPSpecialize::getBoundArgs(Function *F) {
+  std::map<Function*, SmallBitVector>::iterator Known = BoundArgs.find(F);
+  if (Known != BoundArgs.end())
+    return Known->second;
+
+  // functions in a recursion see no bound arguments of each other
+  BoundArgs[F] = SmallBitVector(F->arg_size());
+
+  DominatorTree DT(*F);
+  LoopInfo LI(DT);
+  SmallBitVector Args(F->arg_size());
+  for (Argument &A : F->args()) {
+    if (A.getType()->isIntegerTy() && isBoundValue(&A, LI))
+      Args.set(A.getArgNo());
+  }
+  return BoundArgs[F] = Args;
+}
+
+Function *PatmosSPSpecialize::getSpecialization(Function *F,
+                                                const ConstantArgs &Args) {
+  std::pair<Function*, ConstantArgs> Key(F, Args);
+  auto Known = Specializations.find(Key);
+  if (Known != Specializations.end())
+    return Known->second;
+
+  if (F->getInstructionCount() > SPSpecializeMaxSize ||
+      NumClones[F] >= SPSpecializeMaxClones)
+    return nullptr;
+
+  ValueToValueMapTy VMap;
+  Function *Spec = CloneFunction(F, VMap, NULL);
+  Spec->setName(F->getName() + Twine(".spec"));
+  Spec->setLinkage(GlobalValue::InternalLinkage);
+  Spec->addFnAttr("sp-specialized");
+  for (const std::pair<unsigned, ConstantInt*> &Arg : Args) {
+    Spec->getArg(Arg.first)->replaceAllUsesWith(Arg.second);
+  }
+
+  LLVM_DEBUG( dbgs() << "  Specialize function: " << F->getName()
+                     << " -> " << Spec->getName() << "\n");
+  NumClones[F]++;
+  NumSPSpecialized++;
+  return Specializations[Key] = Spec;
+}
+
+bool PatmosSPSpecialize::specializeCalls(Function *F,
+                                         std::vector<Function*> &WL) {
+  bool Changed = false;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    CallInst *Call = dyn_cast<CallInst>(&*I);
+    if (!Call || Call->isInlineAsm())
+      continue;
+
+    Function *Callee = Call->getCalledFunction();
+    if (!Callee || Callee->isIntrinsic() || Callee->isDeclaration() ||
+        Callee->isVarArg() || Callee == F ||
+        PatmosSinglePathInfo::isRoot(*Callee) ||
+        RootNames.count(Callee->getName()))
+      continue;
+
+    const SmallBitVector &Bound = getBoundArgs(Callee);
+    ConstantArgs Args;
+    for (unsigned i = 0, e = Call->arg_size(); i != e; i++) {
+      auto *C = dyn_cast<ConstantInt>(Call->getArgOperand(i));
+      if (C && Bound.test(i))
+        Args.push_back(std::make_pair(i, C));
+    }
+    if (Args.empty())
+      continue;
+
+    bool IsNew = !Specializations.count(std::make_pair(Callee, Args));
+    Function *Spec = getSpecialization(Callee, Args);
+    if (!Spec)
+      continue;
+
+    LLVM_DEBUG( dbgs() << "  Specialize call in " << F->getName() << ": "
+                       << Callee->getName() << " -> " << Spec->getName()
+                       << "\n");
+    Call->setCalledFunction(Spec);
+    NumSPSpecializedCalls++;
+    Changed = true;
+
+    if (IsNew)
+      WL.push_back(Spec);
+  }
+  return Changed;
+}
@@ -21,6 +21,7 @@
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineDominators.h"
 #include "llvm/CodeGen/MachineFunction.h"
@@ -38,6 +39,9 @@
 using namespace llvm;
 
 #define DEBUG_TYPE "patmos-singlepath"
+
+STATISTIC(SPScopeTreesReused, "Number of SPScope trees reused from an earlier analysis");
+
 /// SPRootList - Option to enable single-path code generation and specify entry
 ///              functions. This option needs to be present even when all
 ///              roots are specified via attributes.
@@ -72,6 +76,13 @@ static cl::opt<bool> DisablePseudoRoots(
     cl::desc("All non-root functions' code generations assumes they might be called from a disabled path."),
     cl::Hidden);
 
+static cl::opt<bool> ShareTimePredictable(
+    "mpatmos-singlepath-share",
+    cl::init(false),
+    cl::desc("Call side-effect-free functions without data-dependent branches "
+             "from single-path code instead of cloning them."),
+    cl::Hidden);
+
 static cl::opt<std::string> CetCompFun(
     "mpatmos-cet-compensation-function",
     cl::init(""),
@@ -112,6 +123,10 @@ bool PatmosSinglePathInfo::usePseudoRoots() {
   return !DisablePseudoRoots;
 }
 
+bool PatmosSinglePathInfo::shareTimePredictable() {
+  return ShareTimePredictable;
+}
+
 bool PatmosSinglePathInfo::isConstant() {
   return EnableCET != CompensationAlgo::disabled;
 }
@@ -174,6 +189,10 @@ bool PatmosSinglePathInfo::isRootLike(const MachineFunction &MF) {
   return isRootLike(MF.getFunction());
 }
 
+bool PatmosSinglePathInfo::isShared(const Function &F) {
+  return F.hasFnAttribute("sp-shared");
+}
+
 void PatmosSinglePathInfo::getRootNames(std::set<StringRef> &S) {
   S.insert( SPRootList.begin(), SPRootList.end() );
   S.erase("");
@@ -192,7 +211,7 @@ bool PatmosSinglePathInfo::useCountlessLoops(){
 PatmosSinglePathInfo::PatmosSinglePathInfo(const PatmosTargetMachine &tm)
   : MachineFunctionPass(ID), TM(tm),
     STC(*tm.getSubtargetImpl()),
-    TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())), Root(0) {}
+    TII(static_cast<const PatmosInstrInfo*>(tm.getInstrInfo())) {}
 
 
 bool PatmosSinglePathInfo::doInitialization(Module &M) {
@@ -201,25 +220,20 @@ bool PatmosSinglePathInfo::doInitialization(Module &M) {
 
 
 bool PatmosSinglePathInfo::doFinalization(Module &M) {
-  if (Root) {
-    delete Root;
-    Root = NULL;
-  }
+  Root.reset();
   return false;
 }
 
 void PatmosSinglePathInfo::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequired<MachineLoopInfo>();
   AU.addRequired<MachineDominatorTree>();
+  AU.addRequired<PatmosLoopBoundInfo>();
   AU.setPreservesAll();
   MachineFunctionPass::getAnalysisUsage(AU);
 }
 
 bool PatmosSinglePathInfo::runOnMachineFunction(MachineFunction &MF) {
-  if (Root) {
-    delete Root;
-    Root = NULL;
-  }
+  Root.reset();
 
   // only consider function actually marked for conversion
   auto curfunc = MF.getFunction().getName();
@@ -232,7 +246,39 @@ bool PatmosSinglePathInfo::runOnMachineFunction(MachineFunction &MF) {
 }
 
 
+/// Hash everything the SPScope tree is built from: the blocks, their
+/// successors and their instructions, including the predicate registers and
+/// loop bounds read from the instructions' operands.
+static hash_code hashFunction(const MachineFunction &MF) {
+  hash_code hash = hash_value(&MF);
+  for (const MachineBasicBlock &MBB : MF) {
+    hash = hash_combine(hash, &MBB, MBB.getNumber());
+    for (const MachineBasicBlock *Succ : MBB.successors()) {
+      hash = hash_combine(hash, Succ);
+    }
+    for (const MachineInstr &MI : MBB.instrs()) {
+      hash = hash_combine(hash, &MI, MI.getOpcode());
+      for (const MachineOperand &MO : MI.operands()) {
+        hash = hash_combine(hash, MO);
+      }
+    }
+  }
+  return hash;
+}
+
 void PatmosSinglePathInfo::analyzeFunction(MachineFunction &MF) {
+  // Reuse the tree of an earlier instance of this pass if the function has
+  // not changed since. Passes that update the tree along with the function
+  // change the function too, so the tree is then rebuilt.
+  auto *PMFI = MF.getInfo<PatmosMachineFunctionInfo>();
+  hash_code hash = hashFunction(MF);
+  Root = PMFI->getSinglePathScopes(hash);
+  if (Root) {
+    SPScopeTreesReused++;
+    LLVM_DEBUG( print(dbgs()) );
+    return;
+  }
+
   // we cannot handle irreducibility yet
   checkIrreducibility(MF);
 
@@ -240,7 +286,9 @@ void PatmosSinglePathInfo::analyzeFunction(MachineFunction &MF) {
   // we could use a custom algorithm (e.g. Havlak's algorithm)
   // that also checks irreducibility.
   // build the SPScope tree
-  Root = SPScope::createSPScopeTree(MF, getAnalysis<MachineLoopInfo>(), TII);
+  Root.reset(SPScope::createSPScopeTree(MF, getAnalysis<MachineLoopInfo>(),
+                                       getAnalysis<PatmosLoopBoundInfo>(), TII));
+  PMFI->setSinglePathScopes(Root, hash);
 
   LLVM_DEBUG( print(dbgs()) );
 
@@ -52,8 +52,9 @@ namespace llvm {
       /// Set of functions yet to be analyzed
       std::set<std::string> FuncsRemain;
 
-      /// Root SPScope
-      SPScope *Root;
+      /// Root SPScope, owned together with the function's
+      /// PatmosMachineFunctionInfo
+      std::shared_ptr<SPScope> Root;
 
       /// Analyze a given MachineFunction
       void analyzeFunction(MachineFunction &MF);
@@ -91,6 +92,10 @@ namespace llvm {
       static bool isRootLike(const Function &F);
       static bool isRootLike(const MachineFunction &MF);
 
+      /// isShared - Return true if the function is called by single-path
+      /// code without being converted, as it is time-predictable already.
+      static bool isShared(const Function &F);
+
       static const char* getCompensationFunction();
 
       /// isConstant - Return true if should produce constant execution-time,
@@ -110,6 +115,10 @@ namespace llvm {
       /// from an enabled path of a root or another pseudo-root.
       static bool usePseudoRoots();
 
+      /// Whether time-predictable callees of single-path functions are
+      /// shared with conventional code instead of being cloned.
+      static bool shareTimePredictable();
+
       /// Whether should use the new Single-Path transformation.
       static bool useNewSinglePathTransform();
 
@@ -162,7 +171,7 @@ namespace llvm {
       bool isToConvert(MachineFunction &MF) const;
 
       /// getRootScope - Return the Root SPScope for this function
-      SPScope *getRootScope() const { return Root; }
+      SPScope *getRootScope() const { return Root.get(); }
 
       /// getScopeFor - Return the innermost scope of an MBB
       SPScope *getScopeFor(const PredicatedBlock *MBB) const;
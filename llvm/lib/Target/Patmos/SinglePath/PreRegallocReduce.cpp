@@ -4,11 +4,21 @@
 #include "TargetInfo/PatmosTargetInfo.h"
 #include "llvm/CodeGen/MachineLoopInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
 
 #define DEBUG_TYPE "patmos-singlepath"
 
+STATISTIC(NumHoistedGuards, "Number of loop-invariant guard computations hoisted out of single-path loops");
+
+static cl::opt<bool> DisableGuardHoisting(
+	"mpatmos-disable-sp-guard-hoisting",
+	cl::init(false),
+	cl::desc("Don't hoist loop-invariant guard computations out of single-path loops."),
+	cl::Hidden);
+
 char PreRegallocReduce::ID = 0;
 
 FunctionPass *llvm::createPreRegallocReduce(const PatmosTargetMachine &tm) {
@@ -29,6 +39,10 @@ bool PreRegallocReduce::runOnMachineFunction(MachineFunction &MF) {
 		LI = &getAnalysis<MachineLoopInfo>();
 		vreg_map.clear(); // make sure other functions' maps aren't used
 
+		if(!DisableGuardHoisting) {
+			hoistInvariantGuards(MF);
+		}
+
 		applyPredicates(&MF);
 
 		insertPredDefinitions(&MF);
@@ -47,7 +61,76 @@ bool PreRegallocReduce::runOnMachineFunction(MachineFunction &MF) {
 	return changed;
 }
 
-Register PreRegallocReduce::getVreg(EqClass &eq_class)
+bool PreRegallocReduce::isHoistableGuard(MachineLoop *loop, MachineInstr &MI) {
+	if(MI.isPHI() || MI.isTerminator() || MI.isCall() || MI.mayLoadOrStore() ||
+		MI.hasUnmodeledSideEffects() || MI.getNumOperands() != MI.getNumExplicitOperands() ||
+		MI.getNumExplicitDefs() != 1
+	) {
+		return false;
+	}
+
+	// Only unpredicated instructions, as applyPredicates hasn't run yet
+	int pred_op_idx = MI.findFirstPredOperandIdx();
+	if(pred_op_idx == -1 || MI.getOperand(pred_op_idx).getReg() != Patmos::NoRegister) {
+		return false;
+	}
+
+	auto def = MI.getOperand(0).getReg();
+	if(!def.isVirtual() || RI->getRegClass(def) != &Patmos::PRegsRegClass || !RI->hasOneDef(def)) {
+		return false;
+	}
+
+	for(auto &use: MI.explicit_uses()) {
+		if(!use.isReg()) {
+			continue;
+		}
+		auto reg = use.getReg();
+		if(reg == Patmos::NoRegister || reg == Patmos::P0 || reg == Patmos::R0) {
+			continue;
+		}
+		if(!reg.isVirtual() || !RI->hasOneDef(reg) ||
+			loop->contains(RI->def_instr_begin(reg)->getParent())
+		) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void PreRegallocReduce::hoistInvariantGuards(MachineFunction &MF) {
+	// Visit inner loops before their parents, such that guards hoisted into an inner
+	// preheader may be hoisted further
+	auto loops = LI->getBase().getLoopsInPreorder();
+	for(auto loop_iter = loops.rbegin(); loop_iter != loops.rend(); loop_iter++) {
+		auto loop = *loop_iter;
+		auto preheader = PatmosSinglePathInfo::getPreHeaderUnilatch(loop).first;
+
+		// Hoisting a guard may make the ones using it invariant, so iterate until stable
+		bool changed = true;
+		while(changed) {
+			changed = false;
+			for(auto *mbb: loop->blocks()) {
+				for(auto instr_iter = mbb->instr_begin(); instr_iter != mbb->getFirstInstrTerminator(); ) {
+					auto &MI = *instr_iter++;
+					if(isHoistableGuard(loop, MI)) {
+						LLVM_DEBUG(
+							dbgs() << "Hoisting loop-invariant guard from bb." << mbb->getNumber() << "." << mbb->getName()
+								<< " into bb." << preheader->getNumber() << "." << preheader->getName() << ":\n\t";
+							MI.dump();
+						);
+						// Once predicated in the preheader, the guard is computed whenever the loop
+						// is entered. Any use inside the loop is disabled or already saw the same value.
+						preheader->splice(preheader->getFirstTerminator(), mbb, MI.getIterator());
+						NumHoistedGuards++;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+}
+
+Register PreRegallocReduce::getVreg(const EqClass &eq_class)
 {
 	if (vreg_map.count(eq_class.number)) {
 		return vreg_map[eq_class.number];
@@ -64,7 +147,7 @@ void PreRegallocReduce::applyPredicates(MachineFunction *MF) {
 	auto &C = MF->getFunction().getContext();
 
 	for(auto &mbb: *MF){
-		auto eq_class = EQ->getClassFor(&mbb);
+		auto &eq_class = EQ->getClassFor(&mbb);
 		auto predVreg = getVreg(eq_class);
 
 		LLVM_DEBUG(
@@ -159,14 +242,14 @@ MachineBasicBlock* PreRegallocReduce::get_header_of(MachineBasicBlock*mbb) {
 	return loop? loop->getHeader() : entry;
 }
 
-MachineBasicBlock* PreRegallocReduce::get_header_of(EqClass &eq_class) {
+MachineBasicBlock* PreRegallocReduce::get_header_of(const EqClass &eq_class) {
 	assert(std::all_of(eq_class.members.begin(), eq_class.members.end(), [&](auto mem){
 		return get_header_of(*eq_class.members.begin()) == get_header_of(mem);
 	}) && "Not all members in class have the same header");
 	return get_header_of(*eq_class.members.begin());
 }
 
-Optional<MachineBasicBlock*> PreRegallocReduce::get_header_in_class(EqClass &eq_class) {
+Optional<MachineBasicBlock*> PreRegallocReduce::get_header_in_class(const EqClass &eq_class) {
 	auto header_in_class = std::find_if(eq_class.members.begin(), eq_class.members.end(),
 			[&](auto member){ return LI->isLoopHeader(member) || (member->pred_size() == 0);});
 	if(header_in_class != eq_class.members.end()) {
@@ -177,7 +260,7 @@ Optional<MachineBasicBlock*> PreRegallocReduce::get_header_in_class(EqClass &eq_
 }
 
 void PreRegallocReduce::insertEntryDependencyDefinition(
-	EqClass &eq_class, MachineFunction *MF
+	const EqClass &eq_class, MachineFunction *MF
 ) {
 	assert(std::count_if(eq_class.dependencies.begin(), eq_class.dependencies.end(), [&](auto dep){
 		return !dep.first;
@@ -190,7 +273,7 @@ void PreRegallocReduce::insertEntryDependencyDefinition(
 		// It is the function entry
 		initial_preg = PatmosSinglePathInfo::isRootLike(*MF)? Patmos::P0 : Patmos::P7;
 	} else {
-		auto header_class = EQ->getClassFor(header);
+		auto &header_class = EQ->getClassFor(header);
 		initial_preg = getVreg(header_class);
 	}
 
@@ -204,7 +287,7 @@ void PreRegallocReduce::insertEntryDependencyDefinition(
 }
 
 void PreRegallocReduce::insertHeaderClassPredDefinitions(
-	EqClass &eq_class, MachineFunction*MF
+	const EqClass &eq_class, MachineFunction*MF
 ){
 	auto header_in_class = *get_header_in_class(eq_class);
 
@@ -221,7 +304,7 @@ void PreRegallocReduce::insertHeaderClassPredDefinitions(
 		// of a class containing a header.
 		MachineBasicBlock *preheader, *unilatch;
 		std::tie(preheader, unilatch) = PatmosSinglePathInfo::getPreHeaderUnilatch(loop);
-		auto preheader_class = EQ->getClassFor(preheader);
+		auto &preheader_class = EQ->getClassFor(preheader);
 
 		// Initialize in preheader
 		auto preheader_vreg = getVreg(preheader_class);
@@ -233,7 +316,7 @@ void PreRegallocReduce::insertHeaderClassPredDefinitions(
 					<< " in preheader bb." << preheader->getNumber() << "." << preheader->getName() <<":\n\t";
 			def.getInstr()->dump();
 		);
-		auto unilatch_class = EQ->getClassFor(unilatch);
+		auto &unilatch_class = EQ->getClassFor(unilatch);
 		// Initialize in unilatch
 		auto unilatch_vreg = getVreg(unilatch_class);
 		def = BuildMI(*unilatch, unilatch->getFirstTerminator(), DebugLoc(),
@@ -250,7 +333,7 @@ void PreRegallocReduce::insertHeaderClassPredDefinitions(
 void PreRegallocReduce::insertPredDefinitions(
 	MachineFunction*MF
 ) {
-	for(auto eq_class: EQ->getAllClasses()) {
+	for(auto &eq_class: EQ->getAllClasses()) {
 		assert(eq_class.members.size() >= 1);
 		assert(eq_class.dependencies.size() >= 1);
 
@@ -275,11 +358,11 @@ void PreRegallocReduce::insertPredDefinitions(
 			}
 			auto source = *dep_edge.first;
 			auto sink = dep_edge.second;
-			auto source_class = EQ->getClassFor(source);
+			auto &source_class = EQ->getClassFor(source);
 			auto source_vreg = getVreg(source_class);
 
 			if(!eq_class.members.count(sink)) {
-				auto sink_class = EQ->getClassFor(sink);
+				auto &sink_class = EQ->getClassFor(sink);
 				// The edge doesn't go straight into the class.
 				// Therefore, copy the target's class's predicate into this class'es predicate
 				auto sink_vreg = getVreg(sink_class);
@@ -429,7 +512,7 @@ void PreRegallocReduce::removeUnusedPreds(MachineFunction &MF) {
 	bool any_removals = true;
 	while(any_removals) {
 		any_removals = false;
-		for(auto eq_class: EQ->getAllClasses()) {
+		for(auto &eq_class: EQ->getAllClasses()) {
 			auto vreg = getVreg(eq_class);
 			if(!is_used(vreg, MF)) {
 				if(remove_defs(vreg, MF) > 0){
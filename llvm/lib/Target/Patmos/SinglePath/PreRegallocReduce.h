@@ -43,6 +43,15 @@ namespace llvm {
 		// Assign each predicate (equivalence class number) to a virtual predicate register
 		std::map<unsigned, Register> vreg_map;
 
+		/// hoistInvariantGuards - Move unpredicated computations of predicates
+		/// that only depend on loop-invariant values into the preheader of their loop.
+		/// Linearized loops otherwise recompute these guards in every iteration.
+		void hoistInvariantGuards(MachineFunction &MF);
+
+		/// Whether the given instruction is a guard computation of the loop
+		/// whose operands are all defined outside of it.
+		bool isHoistableGuard(MachineLoop *loop, MachineInstr &MI);
+
 		/// applyPredicates - Predicate instructions of MBBs in the given SPScope.
 		void applyPredicates(MachineFunction *MF);
 
@@ -52,25 +61,25 @@ namespace llvm {
 
 		/// Insert predicate register definitions for the given class assuming
 		/// it is the class of a loop header
-		void insertHeaderClassPredDefinitions(EqClass &eq_class, MachineFunction*MF);
+		void insertHeaderClassPredDefinitions(const EqClass &eq_class, MachineFunction*MF);
 
 		/// Gets the header of the given block's loop.
 		/// If the block is not in a loop, the entry block is its header.
 		MachineBasicBlock* get_header_of(MachineBasicBlock*mbb);
 
 		/// Gets the header of the loop containing the equivalence class
-		MachineBasicBlock* get_header_of(EqClass &eq_class);
+		MachineBasicBlock* get_header_of(const EqClass &eq_class);
 
 		/// If the class contains the header, returns it.
-		Optional<MachineBasicBlock*> get_header_in_class(EqClass &eq_class);
+		Optional<MachineBasicBlock*> get_header_in_class(const EqClass &eq_class);
 
 		/// Returns whether this edge exits any loop
 		bool is_exit_edge(std::pair<Optional<MachineBasicBlock*>, MachineBasicBlock*> edge);
 
-		Register getVreg(EqClass &eq_class);
+		Register getVreg(const EqClass &eq_class);
 
 		/// Inserts the definition of a class predicate at the entry
-		void insertEntryDependencyDefinition(EqClass &eq_class, MachineFunction *MF);
+		void insertEntryDependencyDefinition(const EqClass &eq_class, MachineFunction *MF);
 
 		/// For each equivalence class, checks to see if its predicate is actually used
 		/// to predicate any instruction. If not, removes all definitions of it.
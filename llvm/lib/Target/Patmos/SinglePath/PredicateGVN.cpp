@@ -0,0 +1,431 @@
+//===-- PredicateGVN.cpp - Value numbering of single-path predicates ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Merge equivalent predicate computations of single-path code.
+//
+// After the predicates are virtualized and their definitions are inserted,
+// the same guard is often computed several times, e.g., by the conjunctions
+// of a block predicate with a select condition. MachineCSE does not run at
+// this point and would not see through the predicate operations anyway.
+//
+// The unguarded predicate operations (PAND, POR, PXOR, PMOV, PNOT, PSET,
+// PCLR and predicate COPYs) defining a virtual register only once are value
+// numbered in dominator tree order:
+// - OR is numbered as the negated AND of the negated operands, XOR is
+//   numbered without the negations of its operands, and the operands of
+//   both are ordered, such that equal guards get the same number regardless
+//   of how they are written.
+// - Conjunctions with P0 or of a predicate with itself or its negation are
+//   simplified to the other operand or to a constant.
+// - A register defined only once by an instruction that dominates the use
+//   has the value of its definition everywhere. Other registers, i.e., the
+//   predicates of the equivalence classes and the virtualized physical
+//   predicates, are only numbered within a block up to their next
+//   definition.
+// A definition with the same value as a dominating one is removed, and its
+// register replaced. Definitions that were simplified are rewritten to
+// PSET, PCLR or PMOV.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosTargetMachine.h"
+#include "SinglePath/EquivalenceClasses.h"
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineDominators.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#include <map>
+#include <tuple>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-singlepath"
+
+STATISTIC(NumMergedPreds,     "Number of redundant predicate definitions "
+                              "removed");
+STATISTIC(NumSimplifiedPreds, "Number of predicate definitions simplified");
+
+static cl::opt<bool> DisablePredicateGVN(
+  "mpatmos-disable-sp-predicate-gvn",
+  cl::init(false),
+  cl::desc("Do not merge equivalent predicate definitions of single-path "
+           "code."),
+  cl::Hidden);
+
+namespace {
+  class PredicateGVN : public MachineFunctionPass {
+  private:
+    /// A value number and whether the value is negated. Number 0 is P0,
+    /// i.e., true, and its negation false.
+    typedef std::pair<unsigned, bool> PredValue;
+
+    /// A combination of two operand values, AND or XOR.
+    typedef std::tuple<unsigned, PredValue, PredValue> PredExpr;
+
+    const PatmosInstrInfo *TII;
+    MachineRegisterInfo *MRI;
+    MachineDominatorTree *MDT;
+
+    unsigned NextValue;
+
+    /// Values of the registers that are defined only once.
+    std::map<Register, PredValue> RegValues;
+
+    /// Values of other registers within a block, by the number of
+    /// definitions of the register that precede the use in the block.
+    std::map<std::tuple<const MachineBasicBlock *, Register, unsigned>,
+             unsigned> LocalValues;
+
+    std::map<PredExpr, unsigned> ExprValues;
+
+    /// The definitions of registers defined only once, by their value.
+    std::map<PredValue, SmallVector<MachineInstr *, 2>> Leaders;
+
+    /// The number of definitions of each register seen so far in the
+    /// current block.
+    std::map<Register, unsigned> DefCounts;
+
+    PredValue newValue() { return PredValue(NextValue++, false); }
+
+    /// Return whether MI is an unguarded predicate operation whose
+    /// destination is a virtual register defined only by MI.
+    bool isCandidate(const MachineInstr &MI) const;
+
+    /// Return whether all uses of the register defined by MI are dominated
+    /// by MI.
+    bool dominatesUses(const MachineInstr &MI) const;
+
+    /// Get the value of the predicate register Reg read by MI.
+    PredValue getOperandValue(const MachineInstr &MI, Register Reg,
+                              bool Negated);
+
+    /// Get the value of a combination of two predicate values.
+    PredValue getExprValue(unsigned Opcode, PredValue A, PredValue B);
+
+    /// Get the value defined by the candidate MI.
+    PredValue getValue(const MachineInstr &MI);
+
+    /// Rewrite MI to define the value V, if that is simpler than MI.
+    bool simplify(MachineInstr &MI, PredValue V);
+
+    bool runOnMachineBasicBlock(MachineBasicBlock &MBB);
+
+  public:
+    static char ID;
+
+    PredicateGVN(const PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID), TII(tm.getInstrInfo()) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Single-Path Predicate Value Numbering";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesCFG();
+      AU.addRequired<MachineDominatorTree>();
+      AU.addPreserved<MachineDominatorTree>();
+      AU.addPreserved<MachineLoopInfo>();
+      AU.addPreserved<EquivalenceClasses>();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+  };
+}
+
+char PredicateGVN::ID = 0;
+
+FunctionPass *llvm::createSinglePathPredicateGVN(const PatmosTargetMachine &tm) {
+  return new PredicateGVN(tm);
+}
+
+bool PredicateGVN::isCandidate(const MachineInstr &MI) const {
+  switch (MI.getOpcode()) {
+  case Patmos::COPY:
+    break;
+  case Patmos::PAND:
+  case Patmos::POR:
+  case Patmos::PXOR:
+  case Patmos::PMOV:
+  case Patmos::PNOT:
+  case Patmos::PSET:
+  case Patmos::PCLR: {
+    // Guarded definitions keep the old value if disabled.
+    Register Guard = MI.getOperand(1).getReg();
+    if ((Guard != Patmos::P0 && Guard != Patmos::NoRegister) ||
+        MI.getOperand(2).getImm() != 0)
+      return false;
+    break;
+  }
+  default:
+    return false;
+  }
+
+  if (MI.getNumOperands() != MI.getNumExplicitOperands())
+    return false;
+
+  Register Dst = MI.getOperand(0).getReg();
+  if (!Dst.isVirtual() || MRI->getRegClass(Dst) != &Patmos::PRegsRegClass ||
+      !MRI->hasOneDef(Dst))
+    return false;
+
+  // Copies from general-purpose registers are not predicate operations.
+  if (MI.isCopy()) {
+    Register Src = MI.getOperand(1).getReg();
+    return Src == Patmos::P0 || Patmos::PRegsRegClass.contains(Src) ||
+           (Src.isVirtual() &&
+            MRI->getRegClass(Src) == &Patmos::PRegsRegClass);
+  }
+  return true;
+}
+
+bool PredicateGVN::dominatesUses(const MachineInstr &MI) const {
+  for (const MachineInstr &Use :
+       MRI->use_nodbg_instructions(MI.getOperand(0).getReg()))
+    if (!MDT->dominates(&MI, &Use))
+      return false;
+  return true;
+}
+
+PredicateGVN::PredValue PredicateGVN::getOperandValue(const MachineInstr &MI,
+                                                      Register Reg,
+                                                      bool Negated) {
+  PredValue V;
+  if (Reg == Patmos::P0) {
+    V = PredValue(0, false);
+  } else if (Reg.isVirtual() && MRI->hasOneDef(Reg) &&
+             MDT->dominates(&*MRI->def_instr_begin(Reg), &MI)) {
+    auto R = RegValues.insert(std::make_pair(Reg, PredValue()));
+    if (R.second)
+      R.first->second = newValue();
+    V = R.first->second;
+  } else {
+    auto Key = std::make_tuple(MI.getParent(), Reg, DefCounts[Reg]);
+    auto R = LocalValues.insert(std::make_pair(Key, 0u));
+    if (R.second)
+      R.first->second = newValue().first;
+    V = PredValue(R.first->second, false);
+  }
+  V.second ^= Negated;
+  return V;
+}
+
+PredicateGVN::PredValue PredicateGVN::getExprValue(unsigned Opcode,
+                                                   PredValue A, PredValue B) {
+  const PredValue True(0, false), False(0, true);
+
+  bool Negated = false;
+  if (Opcode == Patmos::POR) {
+    // a | b == !(!a & !b)
+    A.second = !A.second;
+    B.second = !B.second;
+    Negated = true;
+    Opcode = Patmos::PAND;
+  }
+
+  if (Opcode == Patmos::PAND) {
+    PredValue V;
+    if (A == True)
+      V = B;
+    else if (B == True)
+      V = A;
+    else if (A == False || B == False)
+      V = False;
+    else if (A.first == B.first)
+      V = A.second == B.second ? A : False;
+    else {
+      if (B < A)
+        std::swap(A, B);
+      auto R = ExprValues.insert(
+          std::make_pair(PredExpr(Opcode, A, B), 0u));
+      if (R.second)
+        R.first->second = newValue().first;
+      V = PredValue(R.first->second, false);
+    }
+    V.second ^= Negated;
+    return V;
+  }
+
+  assert(Opcode == Patmos::PXOR);
+  // !a ^ b == !(a ^ b)
+  Negated = A.second != B.second;
+  A.second = B.second = false;
+
+  PredValue V;
+  if (A.first == 0)
+    V = PredValue(B.first, true);
+  else if (B.first == 0)
+    V = PredValue(A.first, true);
+  else if (A.first == B.first)
+    V = False;
+  else {
+    if (B < A)
+      std::swap(A, B);
+    auto R = ExprValues.insert(std::make_pair(PredExpr(Opcode, A, B), 0u));
+    if (R.second)
+      R.first->second = newValue().first;
+    V = PredValue(R.first->second, false);
+  }
+  V.second ^= Negated;
+  return V;
+}
+
+PredicateGVN::PredValue PredicateGVN::getValue(const MachineInstr &MI) {
+  switch (MI.getOpcode()) {
+  case Patmos::COPY:
+    return getOperandValue(MI, MI.getOperand(1).getReg(), false);
+  case Patmos::PMOV:
+    return getOperandValue(MI, MI.getOperand(3).getReg(),
+                           MI.getOperand(4).getImm());
+  case Patmos::PNOT:
+    return getOperandValue(MI, MI.getOperand(3).getReg(),
+                           !MI.getOperand(4).getImm());
+  case Patmos::PSET:
+    return PredValue(0, false);
+  case Patmos::PCLR:
+    return PredValue(0, true);
+  default:
+    return getExprValue(MI.getOpcode(),
+                        getOperandValue(MI, MI.getOperand(3).getReg(),
+                                        MI.getOperand(4).getImm()),
+                        getOperandValue(MI, MI.getOperand(5).getReg(),
+                                        MI.getOperand(6).getImm()));
+  }
+}
+
+bool PredicateGVN::simplify(MachineInstr &MI, PredValue V) {
+  unsigned Opcode = MI.getOpcode();
+  if (Opcode != Patmos::PAND && Opcode != Patmos::POR &&
+      Opcode != Patmos::PXOR && Opcode != Patmos::PMOV &&
+      Opcode != Patmos::PNOT && Opcode != Patmos::COPY)
+    return false;
+
+  MachineBasicBlock &MBB = *MI.getParent();
+  Register Dst = MI.getOperand(0).getReg();
+  MachineInstr *NewMI;
+  if (V.first == 0) {
+    NewMI = BuildMI(MBB, MI, MI.getDebugLoc(),
+                    TII->get(V.second ? Patmos::PCLR : Patmos::PSET), Dst)
+                .addReg(Patmos::P0).addImm(0);
+  } else if (Opcode == Patmos::PAND || Opcode == Patmos::POR ||
+             Opcode == Patmos::PXOR) {
+    // Keep the operand the combination was simplified to.
+    unsigned OpIdx = 0;
+    bool Negated = false;
+    for (unsigned Idx : {3, 5}) {
+      PredValue OpV = getOperandValue(MI, MI.getOperand(Idx).getReg(),
+                                      MI.getOperand(Idx + 1).getImm());
+      if (OpV.first == V.first) {
+        OpIdx = Idx;
+        Negated = MI.getOperand(Idx + 1).getImm() != (OpV.second != V.second);
+        break;
+      }
+    }
+    if (!OpIdx)
+      return false;
+    Register Src = MI.getOperand(OpIdx).getReg();
+    MRI->clearKillFlags(Src);
+    NewMI = BuildMI(MBB, MI, MI.getDebugLoc(), TII->get(Patmos::PMOV), Dst)
+                .addReg(Patmos::P0).addImm(0)
+                .addReg(Src).addImm(Negated);
+  } else {
+    return false;
+  }
+
+  if (Optional<unsigned> Class = EquivalenceClasses::getEqClassNr(&MI))
+    EquivalenceClasses::addClassMetaData(NewMI, *Class);
+  LLVM_DEBUG(dbgs() << "  simplify " << MI << "    to " << *NewMI);
+  MI.eraseFromParent();
+  NumSimplifiedPreds++;
+  return true;
+}
+
+bool PredicateGVN::runOnMachineBasicBlock(MachineBasicBlock &MBB) {
+  bool Changed = false;
+  DefCounts.clear();
+  for (auto I = MBB.begin(), E = MBB.end(); I != E; ) {
+    MachineInstr &MI = *I++;
+
+    if (isCandidate(MI)) {
+      Register Dst = MI.getOperand(0).getReg();
+      PredValue V = getValue(MI);
+
+      MachineInstr *Leader = nullptr;
+      for (MachineInstr *L : Leaders[V])
+        if (MDT->dominates(L, &MI)) {
+          Leader = L;
+          break;
+        }
+
+      if (Leader && dominatesUses(MI)) {
+        Register LeaderReg = Leader->getOperand(0).getReg();
+        LLVM_DEBUG(dbgs() << "  replace " << MI << "    by " << *Leader);
+        MRI->clearKillFlags(LeaderReg);
+        MRI->replaceRegWith(Dst, LeaderReg);
+        MI.eraseFromParent();
+        NumMergedPreds++;
+        Changed = true;
+        continue;
+      }
+
+      RegValues[Dst] = V;
+      MachineInstr *Def = &MI;
+      if (simplify(MI, V)) {
+        Def = &*std::prev(I);
+        Changed = true;
+      }
+      Leaders[V].push_back(Def);
+      DefCounts[Dst]++;
+      continue;
+    }
+
+    for (const MachineOperand &MO : MI.operands()) {
+      if (MO.isReg() && MO.isDef() && MO.getReg())
+        DefCounts[MO.getReg()]++;
+      else if (MO.isRegMask())
+        for (MCPhysReg Reg : Patmos::PRegsRegClass)
+          if (MO.clobbersPhysReg(Reg))
+            DefCounts[Reg]++;
+    }
+  }
+  return Changed;
+}
+
+bool PredicateGVN::runOnMachineFunction(MachineFunction &MF) {
+  if (DisablePredicateGVN ||
+      !MF.getInfo<PatmosMachineFunctionInfo>()->isSinglePath())
+    return false;
+
+  LLVM_DEBUG(dbgs() << "[Single-Path] Predicate value numbering of "
+                    << MF.getName() << "\n");
+
+  MRI = &MF.getRegInfo();
+  MDT = &getAnalysis<MachineDominatorTree>();
+  NextValue = 1;
+  RegValues.clear();
+  LocalValues.clear();
+  ExprValues.clear();
+  Leaders.clear();
+
+  // Dominating definitions are numbered first.
+  bool Changed = false;
+  for (MachineDomTreeNode *Node : depth_first(MDT->getRootNode()))
+    Changed |= runOnMachineBasicBlock(*Node->getBlock());
+  return Changed;
+}
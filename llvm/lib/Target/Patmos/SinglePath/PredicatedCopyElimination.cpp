@@ -0,0 +1,256 @@
+//===-- PredicatedCopyElimination.cpp - Remove predicated copies ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Remove register copies of single-path code after register allocation.
+//
+// Copies are expanded to MOV and PMOV instructions before the predicates are
+// assigned, so that they can be guarded by the predicate of their block.
+// Neither the register coalescer nor the machine copy propagation handle these
+// guarded moves, so they survive into the final code.
+//
+// Within each block of the linearized function, a guarded move is
+// - removed if it copies a register to itself,
+// - forwarded to the following readers of the copy that use the same guard,
+//   as long as the guard and both registers are not redefined in between,
+// - removed if all following readers of the copy up to its next definition
+//   are guarded by predicates that are mutually exclusive with the guard of
+//   the move, and the copy is not live out of the block. The readers then see
+//   the old value of the register regardless of the move.
+// Mutual exclusion of predicates is derived from the equivalence classes the
+// instructions are tagged with, see EquivalenceClasses::dependentInstructions.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosMachineFunctionInfo.h"
+#include "PatmosTargetMachine.h"
+#include "SinglePath/EquivalenceClasses.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "patmos-singlepath"
+
+STATISTIC(NumIdentityCopies, "Number of predicated self-copies removed");
+STATISTIC(NumForwardedUses,  "Number of uses of predicated copies forwarded");
+STATISTIC(NumDeadCopies,     "Number of predicated copies removed as dead "
+                             "under disjoint predicates");
+
+static cl::opt<bool> DisableCopyElimination(
+  "mpatmos-disable-sp-copy-elim",
+  cl::init(false),
+  cl::desc("Do not remove predicated copies from single-path code."),
+  cl::Hidden);
+
+namespace {
+  class PredicatedCopyElimination : public MachineFunctionPass {
+  private:
+    const TargetRegisterInfo *TRI;
+
+    /// Which equivalence classes depend on which classes.
+    std::map<unsigned, std::set<unsigned>> ClassDependencies;
+
+    /// Return whether MI is a guarded register copy that can be handled.
+    bool isGuardedCopy(const MachineInstr &MI) const;
+
+    /// Return whether the two instructions have the same guard.
+    bool sameGuard(const MachineInstr &MI1, const MachineInstr &MI2) const;
+
+    /// Return whether Reg is redefined by MI, regardless of its guard.
+    bool redefines(const MachineInstr &MI, Register Reg) const;
+
+    /// Forward the source of Copy to the following readers with the same
+    /// guard.
+    bool forwardCopy(MachineInstr &Copy);
+
+    /// Return whether the value written by Copy is never observed.
+    bool isDeadCopy(MachineInstr &Copy) const;
+
+    bool runOnMachineBasicBlock(MachineBasicBlock &MBB);
+
+  public:
+    static char ID;
+
+    PredicatedCopyElimination(const PatmosTargetMachine &tm)
+      : MachineFunctionPass(ID), TRI(tm.getRegisterInfo()) {}
+
+    StringRef getPassName() const override {
+      return "Patmos Single-Path Predicated Copy Elimination";
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesCFG();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+  };
+}
+
+char PredicatedCopyElimination::ID = 0;
+
+FunctionPass *
+llvm::createSinglePathCopyElimination(const PatmosTargetMachine &tm) {
+  return new PredicatedCopyElimination(tm);
+}
+
+bool PredicatedCopyElimination::isGuardedCopy(const MachineInstr &MI) const {
+  switch (MI.getOpcode()) {
+  case Patmos::MOV:
+    return true;
+  case Patmos::PMOV:
+    // Negated copies are not copies.
+    return MI.getOperand(4).getImm() == 0;
+  default:
+    return false;
+  }
+}
+
+bool PredicatedCopyElimination::sameGuard(const MachineInstr &MI1,
+                                          const MachineInstr &MI2) const {
+  int Idx1 = MI1.findFirstPredOperandIdx();
+  int Idx2 = MI2.findFirstPredOperandIdx();
+  if (Idx1 == -1 || Idx2 == -1)
+    return false;
+  return MI1.getOperand(Idx1).getReg() == MI2.getOperand(Idx2).getReg() &&
+         MI1.getOperand(Idx1 + 1).getImm() == MI2.getOperand(Idx2 + 1).getImm();
+}
+
+bool PredicatedCopyElimination::redefines(const MachineInstr &MI,
+                                          Register Reg) const {
+  for (const MachineOperand &MO : MI.operands()) {
+    if (MO.isRegMask() && MO.clobbersPhysReg(Reg))
+      return true;
+    if (MO.isReg() && MO.isDef() && TRI->regsOverlap(MO.getReg(), Reg))
+      return true;
+  }
+  return false;
+}
+
+bool PredicatedCopyElimination::forwardCopy(MachineInstr &Copy) {
+  Register Dst = Copy.getOperand(0).getReg();
+  Register Src = Copy.getOperand(3).getReg();
+  Register Guard = Copy.getOperand(1).getReg();
+
+  // The source is read later than before, so its kills up to the last
+  // forwarded use are no longer valid.
+  SmallVector<MachineInstr *, 16> Scanned = {&Copy};
+
+  bool Changed = false;
+  for (MachineBasicBlock::iterator I = std::next(Copy.getIterator()),
+                                   E = Copy.getParent()->end();
+       I != E; ++I) {
+    if (I->isDebugInstr())
+      continue;
+
+    if (sameGuard(Copy, *I) && !I->isCall() && !I->isTerminator()) {
+      for (MachineOperand &MO : I->operands()) {
+        if (MO.isReg() && MO.isUse() && !MO.isImplicit() && !MO.isTied() &&
+            MO.getReg() == Dst) {
+          LLVM_DEBUG(dbgs() << "  forward " << printReg(Src, TRI) << " to "
+                            << *I);
+          MO.setReg(Src);
+          NumForwardedUses++;
+          Changed = true;
+
+          for (MachineInstr *MI : Scanned)
+            MI->clearRegisterKills(Src, TRI);
+          Scanned.clear();
+        }
+      }
+    }
+    Scanned.push_back(&*I);
+
+    if (redefines(*I, Dst) || redefines(*I, Src) || redefines(*I, Guard))
+      break;
+  }
+  return Changed;
+}
+
+bool PredicatedCopyElimination::isDeadCopy(MachineInstr &Copy) const {
+  Register Dst = Copy.getOperand(0).getReg();
+  MachineBasicBlock *MBB = Copy.getParent();
+
+  for (MachineBasicBlock::iterator I = std::next(Copy.getIterator()),
+                                   E = MBB->end(); I != E; ++I) {
+    if (I->isDebugInstr())
+      continue;
+
+    if (I->readsRegister(Dst, TRI) &&
+        EquivalenceClasses::dependentInstructions(&Copy, &*I,
+                                                  ClassDependencies))
+      return false;
+
+    if (redefines(*I, Dst)) {
+      // A partial redefinition under another predicate keeps the copy alive.
+      if (!EquivalenceClasses::getEqClassNr(&*I) || sameGuard(Copy, *I))
+        return !I->isCall();
+    }
+  }
+
+  // Blocks without successors return or end the program, their readers are
+  // the terminators scanned above.
+  for (MachineBasicBlock *Succ : MBB->successors())
+    for (MCRegAliasIterator AI(Dst, TRI, true); AI.isValid(); ++AI)
+      if (Succ->isLiveIn(*AI))
+        return false;
+  return true;
+}
+
+bool PredicatedCopyElimination::runOnMachineBasicBlock(MachineBasicBlock &MBB) {
+  bool Changed = false;
+  for (auto I = MBB.begin(), E = MBB.end(); I != E; ) {
+    MachineInstr &MI = *I++;
+    if (!isGuardedCopy(MI))
+      continue;
+
+    if (MI.getOperand(0).getReg() == MI.getOperand(3).getReg()) {
+      LLVM_DEBUG(dbgs() << "  remove self-copy " << MI);
+      MI.eraseFromParent();
+      NumIdentityCopies++;
+      Changed = true;
+      continue;
+    }
+
+    // Only copies guarded by a single-path predicate carry a class.
+    if (!EquivalenceClasses::getEqClassNr(&MI))
+      continue;
+
+    if (MI.getOpcode() == Patmos::MOV)
+      Changed |= forwardCopy(MI);
+
+    if (isDeadCopy(MI)) {
+      LLVM_DEBUG(dbgs() << "  remove dead copy " << MI);
+      MI.eraseFromParent();
+      NumDeadCopies++;
+      Changed = true;
+    }
+  }
+  return Changed;
+}
+
+bool PredicatedCopyElimination::runOnMachineFunction(MachineFunction &MF) {
+  if (DisableCopyElimination ||
+      !MF.getInfo<PatmosMachineFunctionInfo>()->isSinglePath())
+    return false;
+
+  LLVM_DEBUG(dbgs() << "[Single-Path] Eliminating predicated copies in "
+                    << MF.getName() << "\n");
+
+  ClassDependencies = EquivalenceClasses::importClassDependenciesFromModule(MF);
+
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF)
+    Changed |= runOnMachineBasicBlock(MBB);
+  return Changed;
+}
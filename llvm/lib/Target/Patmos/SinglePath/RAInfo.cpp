@@ -200,9 +200,15 @@ public:
   // The maximum number of location used by any child.
   unsigned ChildrenMaxCumLocs;
 
-  /// The index of the first register this instance can use.
-  /// The registers below the index are used by a parent scope.
-  unsigned FirstUsableReg;
+  /// The registers this instance can use, i.e. the register with index i
+  /// in this scope is the register UsableRegs[i] of the function.
+  /// Registers not in the list hold predicates of an ancestor scope
+  /// that are live across this scope.
+  std::vector<unsigned> UsableRegs;
+
+  /// The registers (indices in this scope) that hold predicates of this
+  /// scope while a subscope executes, by header of the subscope.
+  map<const MachineBasicBlock*, std::set<unsigned>> LiveAcrossRegs;
 
   /// The index of the first stack spill slot this instance can use.
   /// The slots below the index are used by a parent scope.
@@ -235,8 +241,11 @@ public:
 
   Impl(RAInfo *pub, SPScope *S, unsigned availRegs):
     Pub(*pub), MaxRegs(availRegs), NumLocs(0), ChildrenMaxCumLocs(0),
-    FirstUsableReg(0), FirstUsableStackSlot(0),NeedsScopeSpill(true)
+    FirstUsableStackSlot(0),NeedsScopeSpill(true)
   {
+    for (unsigned i = 0; i < MaxRegs; i++) {
+      UsableRegs.push_back(i);
+    }
     createLiveRanges();
     assignLocations();
   }
@@ -368,6 +377,17 @@ public:
           );
         }
       }
+
+      // (4) remember which registers must survive the subscope, i.e. the
+      //     predicates that are live across it or defined on its exits
+      if (Pub.Scope->isSubheader(block)) {
+        std::set<unsigned> &live = LiveAcrossRegs[MBB];
+        for(auto pair: curLocs){
+          if (pair.second.isRegister()) {
+            live.insert(pair.second.getLoc());
+          }
+        }
+      }
       LLVM_DEBUG(dbgs() << "\n");
     } // end of forall MBB
 
@@ -395,12 +415,12 @@ public:
 
   /// Converts a register index into a global index that takes parent
   /// into account.
-  unsigned unifyRegister(unsigned idx){
-    LLVM_DEBUG(dbgs() << "Unifying register: (" << idx << ") with (" << FirstUsableReg << ")\n");
-    // We don't have to check whether the result is larger that the number
-    // of available registers, because we know the parent will spill
-    // if that is the case.
-    return idx + FirstUsableReg;
+  unsigned unifyRegister(unsigned idx) const {
+    // Scopes that need a scope spill use all registers in order, so any
+    // index beyond the usable registers is left as it is.
+    unsigned reg = idx < UsableRegs.size() ? UsableRegs[idx] : idx;
+    LLVM_DEBUG(dbgs() << "Unifying register: (" << idx << ") to (" << reg << ")\n");
+    return reg;
   }
 
   /// Converts a Stack spill slot index into a global index that takes parent
@@ -413,18 +433,31 @@ public:
   /// and where its spill slots are.
   void unifyWithParent(const RAInfo::Impl &parent, int parentSpillLocCnt, bool topLevel){
 
-      // We can avoid a spill if the total number of locations
-      // used by the parent, this instance, and any child is less
-      // than/equal to the number of registers available to the function.
-      if ( !topLevel && parent.NumLocs + getCumLocs() <= MaxRegs ) {
-
-        // Compute the first register not used by an ancestor.
-        FirstUsableReg = parent.FirstUsableReg + parent.NumLocs;
+      if (!topLevel) {
+        // Only the registers holding predicates of the parent that are live
+        // across this scope must be preserved; any other register the
+        // parent can use is free while this scope executes.
+        std::set<unsigned> reserved;
+        auto live = parent.LiveAcrossRegs.find(Pub.Scope->getHeader()->getMBB());
+        if (live != parent.LiveAcrossRegs.end()) {
+          for(auto idx: live->second){
+            reserved.insert(parent.unifyRegister(idx));
+          }
+        }
+        std::vector<unsigned> candidates;
+        for(auto reg: parent.UsableRegs){
+          if (!reserved.count(reg)) {
+            candidates.push_back(reg);
+          }
+        }
 
-        // If the total number of locations the parent, myself, and my children need
-        // are less than/equal to the number of available registers
-        // we do not have to spill any predicates.
-        NeedsScopeSpill = false;
+        // If all locations of this scope fit into the free registers,
+        // we do not have to spill any predicates. Children must fit into
+        // what is left for them themselves, or spill.
+        if (NumLocs <= candidates.size()) {
+          UsableRegs = candidates;
+          NeedsScopeSpill = false;
+        }
       }
 
     if (NumLocs > MaxRegs) {
@@ -735,9 +768,13 @@ void RAInfo::dump(raw_ostream& os, unsigned indent) const{
   os << "\n";
 
   os.indent(indent) << "  NumLocs:      " << Priv->NumLocs << "\n"
-            "  CumLocs:      " << Priv->getCumLocs() << "\n"
-            "  Offset:       " << Priv->FirstUsableReg  << "\n"
-            "  SpillOffset:  " << Priv->FirstUsableStackSlot  << "\n";
+            "  CumLocs:      " << Priv->getCumLocs() << "\n";
+  os.indent(indent) << "  Registers:   ";
+  for(auto reg: Priv->UsableRegs){
+    os << " " << reg;
+  }
+  os << "\n";
+  os.indent(indent) << "  SpillOffset:  " << Priv->FirstUsableStackSlot  << "\n";
 }
 
 std::map<const SPScope*, RAInfo> RAInfo::computeRegAlloc(SPScope *rootScope, unsigned AvailPredRegs){
@@ -763,7 +800,7 @@ std::map<const SPScope*, RAInfo> RAInfo::computeRegAlloc(SPScope *rootScope, uns
 
 
   // Visit all scopes in depth-first order to compute offsets:
-  // - Offset is inherited during traversal
+  // - Usable registers are inherited during traversal
   // - SpillOffset is assigned increased depth-first, from left to right
   unsigned spillLocCnt = 0;
   for (auto iter = df_begin(rootScope), end = df_end(rootScope);
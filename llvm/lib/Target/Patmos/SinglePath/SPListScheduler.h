@@ -3,6 +3,7 @@
 
 #include "llvm/Support/Debug.h"
 #include "llvm/ADT/APInt.h"
+#include <algorithm>
 #include <map>
 #include <set>
 #include <deque>
@@ -40,12 +41,16 @@ public:
   /// Successors in the graph
   std::set<std::shared_ptr<Node>> succs;
 
+  /// Length in cycles of the longest path from this node to the end of the
+  /// graph, including this node's own latency.
+  unsigned height;
+
   Node(unsigned idx, unsigned latency, bool may_second_slot, bool is_long,
       std::map<std::shared_ptr<Node>, bool> preds,
       std::set<std::shared_ptr<Node>> succs
   )
     : idx(idx), latency(latency), may_second_slot(may_second_slot), is_long(is_long),
-      preds(preds), succs(succs) {}
+      preds(preds), succs(succs), height(0) {}
 
   static void dump_graph(std::set<std::shared_ptr<Node>> roots, raw_ostream& os){
     os << "Instruction Dependence Graph:\n";
@@ -77,7 +82,8 @@ public:
         for(auto succ: next->succs) {
           os << succ->idx << ", ";
         }
-        os << "] Latency[" << next->latency << "] MaySecondSlot["
+        os << "] Latency[" << next->latency << "] Height["
+            << next->height << "] MaySecondSlot["
             << next->may_second_slot << "] IsLong[" << next->is_long << "]\n";
         to_print.insert(next->succs.begin(), next->succs.end());
       }
@@ -291,6 +297,22 @@ std::set<std::shared_ptr<Node>> dependence_graph(
     all_nodes.push_back(node);
   }
 
+  // Compute the critical path heights. Successors always come later in the
+  // instruction order, so a single backwards pass suffices.
+  // A strong successor can only start after this node finished executing,
+  // while a weak one may be scheduled in the same cycle.
+  for(auto iter = all_nodes.rbegin(); iter != all_nodes.rend(); iter++) {
+    auto node = *iter;
+    node->height = node->latency + 1;
+    for(auto succ: node->succs) {
+      if(succ->preds[node]) {
+        node->height = std::max(node->height, node->latency + 1 + succ->height);
+      } else {
+        node->height = std::max(node->height, succ->height);
+      }
+    }
+  }
+
   return roots;
 }
 
@@ -317,6 +339,39 @@ bool more_successors(std::shared_ptr<Node> node1, std::shared_ptr<Node> node2, v
 bool earlier(std::shared_ptr<Node> node1, std::shared_ptr<Node> node2, void*){
   return node1->idx < node2->idx;
 };
+bool longer_critical_path(std::shared_ptr<Node> node1, std::shared_ptr<Node> node2, void* enable){
+  if(*((bool*)enable)) {
+    return node1->height > node2->height;
+  } else {
+    return false;
+  }
+};
+
+/// Configures the optional improvements of the list scheduler.
+/// The default-constructed options give the plain greedy list scheduler.
+struct ListScheduleOptions {
+  /// Prioritize instructions on the longest path through the dependence graph
+  /// before any other priority.
+  bool critical_path;
+
+  /// With dual-issue, how many of the highest-priority ready instructions are
+  /// considered for the first issue slot, preferring the first one that
+  /// leaves an instruction for the second issue slot.
+  /// 0 and 1 always choose the highest-priority instruction.
+  unsigned lookahead;
+
+  /// Blocks with at most this many instructions are additionally scheduled by
+  /// a bounded search over the choices of the list scheduler, keeping the
+  /// shortest schedule found. 0 disables the search.
+  unsigned exact_max_instrs;
+
+  /// How many schedules the bounded search may try per block.
+  unsigned exact_budget;
+
+  ListScheduleOptions()
+    : critical_path(false), lookahead(0), exact_max_instrs(0), exact_budget(0)
+  {}
+};
 
 /// Returns whether 'next' should be prioritized over 'previous' given
 /// a list of priority functions (predicates) and where to start in the list.
@@ -357,6 +412,11 @@ bool prioritize(
 ///
 /// If enable_dual_issue is given, returns the next ready node that may
 /// scheduled in the second issue slot
+///
+/// The candidates are ranked by priority. By default, the highest-priority one
+/// is returned, otherwise the one at position 'choice' (or the lowest-priority
+/// one, if there are fewer candidates). If 'candidates' is given, it is set to
+/// the number of candidates.
 template<
   typename Instruction,
   typename InstrIter,
@@ -374,7 +434,10 @@ Optional<std::shared_ptr<Node>> get_next_ready(
     bool requesting_second_slot,
     bool can_be_long,
     Bundleable bundleable,
-	Independent independent
+	Independent independent,
+	bool critical_path = false,
+	unsigned choice = 0,
+	unsigned *candidates = nullptr
 ) {
   assert(requesting_second_slot? !can_be_long:true
       && "Cannot request long instruction in second slot");
@@ -441,22 +504,27 @@ Optional<std::shared_ptr<Node>> get_next_ready(
   bool use_longer_instr_prio = enable_second_slot && !requesting_second_slot;
   // Set priority list
   std::vector<std::pair<bool(*)(std::shared_ptr<Node>, std::shared_ptr<Node>, void*), void*>> priorities;
+  priorities.push_back(std::make_pair(longer_critical_path, &critical_path));
   priorities.push_back(std::make_pair(longer_delay, nullptr));
   priorities.push_back(std::make_pair(ineligible_for_second, &enable_second_slot));
   priorities.push_back(std::make_pair(more_successors, nullptr));
   priorities.push_back(std::make_pair(longer_instr, &use_longer_instr_prio));
   priorities.push_back(std::make_pair(earlier, nullptr));
 
+  if(candidates) {
+    *candidates = unpoisoned.size();
+  }
+
   Optional<std::shared_ptr<Node>> result = None;
   if(unpoisoned.size() != 0) {
-    auto choice = unpoisoned.begin();
-    for(auto unpoisoned_iter = std::next(unpoisoned.begin()); unpoisoned_iter != unpoisoned.end(); unpoisoned_iter++) {
-	  if(prioritize(*unpoisoned_iter, *choice, 0, priorities)) {
-        choice = unpoisoned_iter;
-      }
-    }
-    result = *choice;
-    ready.erase(*choice);
+    // The priorities end with the instruction order, so they totally order
+    // the candidates
+    std::vector<std::shared_ptr<Node>> ranked(unpoisoned.begin(), unpoisoned.end());
+    std::sort(ranked.begin(), ranked.end(), [&](auto node1, auto node2){
+      return prioritize(node1, node2, 0, priorities);
+    });
+    result = ranked[std::min(choice, (unsigned)ranked.size() - 1)];
+    ready.erase(*result);
   }
 
   LLVM_DEBUG(
@@ -472,60 +540,16 @@ Optional<std::shared_ptr<Node>> get_next_ready(
   return result;
 }
 
-/// Schedules the given block's instructions.
-///
-/// Returns a mapping from the new schedule to the original one.
-/// I.e. [(0,1), (1,0)] means the first instruction in the new schedule
-/// should be the second instruction in the old schedule. Likewise, the second
-/// instruction in the new schedule should be the first in the original one.
-///
-/// If dual-issue is requested, the new schedule indices are divided in 2:
-/// Odd indices for the first instructions in each bundle, and even indices
-/// for the second instruction. If a bundle doesn't have a second instruction,
-/// its even index will not be occupied.
-/// E.g. [(0,1), (1,0)] means the first instruction in the first bundle in the new
-/// schedule should be the second instruction in the old schedule. The second instruction
-/// in the first bundle should then be the first instruction in the old schedule.
-///
-/// If a target schedule index does not have a mapping, it means that index must be given a Nop.
-///
-/// Arguments:
-/// * mbb: The block to schedule
-/// * reads: given an instruction, returns the operands that instruction reads from.
-/// * writes: given an instruction, returns the operands that instruction writes to.
-/// * poisons: given an instruction, returns whether the write operands are poisoned
-///      poisoned until the instruction finishes executing. Poisoned operands can't be used
-///      by any other instruction while the poisoning instruction is executing.
-///      E.g. Patmos's loads poison the target register in the delay slot.
-///      On the other hand, the multiply instruction doesn't poison the sl and sh registers.
-/// * memory_access: given an instruction, returns whether either reads or writes to memory.
-/// * latency: given an instruction, returns how many cycles above 1 it takes to execute.
-///           E.g. Patmos' loads have a latency of 1, while delayed branches have 2.
-///           The usual instruction like add have 0
-/// * is_constant: given an operand, returns whether that operand is always constant.
-///               E.g. Patmos' r0 and p0
-/// * conditional_branch: Whether this instruction is a conditional branch our of the block.
-///                 E.g. Patmos::BR. Call instructions don't count.
-/// * enable_dual_issue: If given, enables dual issue code and contains
-///					1) a value that is passed as the first argument to 2)
-///                 2) a function that should return true if the given instruction may be
-///                    scheduled in the second issue slot. Otherwise false.
-///                 3) a function that should return true if the instruction takes
-///                    up both issue slots. Otherwise false.
-///                 4) a function that should return true the two given instructions
-///                    may be scheduled in the same bundle without restriction.
-///                    If this returns false, the instructions will only be bundled if they
-///                    have independent equivalence classes.
-/// * dependent_eq_classes: Given two instructions, returns whether they have dependent equivalence classes.
-///                         See EquivalenceClass::dependentClasses
+/// Runs the list scheduler once on the given dependence graph.
 ///
-/// This scheduler can handle conditional branch instructions in the middle of the instruction
-/// list however does not attempt to occupy their delay slots nor add Nops.
-/// Therefore, post-processing is needed to ensure delayed branches/calls get at least Nops after them.
+/// 'choices' overrides the rank of the instruction chosen for the first issue
+/// slot, for as many scheduling steps as it has entries (see get_next_ready).
+/// If given, 'taken' and 'branching' receive the rank chosen and the number of
+/// candidates of every step.
+/// 'pending' gives the operands that are still in use by the instructions
+/// preceding the region, see list_schedule.
 ///
-/// Note: Does not account for inter-functional scheduling requirements.
-/// 	  E.g. if a blocks ends with high-latency instruction and falls through
-///       to a block that uses the poisoned or written-to registers in the first instruction.
+/// See list_schedule for the other arguments.
 template<
   typename Instruction,
   typename InstrIter,
@@ -533,34 +557,27 @@ template<
   typename MAY_SECOND_SLOT_EXTRA,
   typename DEPENDENT_EQ_CLASSES
 >
-std::map<unsigned, unsigned> list_schedule(
+std::map<unsigned, unsigned> list_schedule_run(
   InstrIter instr_begin, InstrIter instr_end,
+  std::set<std::shared_ptr<Node>> dependence_roots,
   std::set<Operand> (*reads)(const Instruction *),
   std::set<Operand> (*writes)(const Instruction *),
-  Optional<Operand> (*uses_predicate)(const Instruction *),
   bool (*poisons)(const Instruction *),
-  bool (*memory_access)(const Instruction *),
-  unsigned (*latency)(const Instruction *),
   bool (*is_constant)(Operand),
-  bool (*conditional_branch)(const Instruction *),
   Optional<std::tuple<
     MAY_SECOND_SLOT_EXTRA,
     bool (*)(MAY_SECOND_SLOT_EXTRA, const Instruction *),
     bool (*)(const Instruction *),
     bool (*)(const Instruction *,const Instruction *)
   >> enable_dual_issue,
-  DEPENDENT_EQ_CLASSES dependent_eq_classes
+  DEPENDENT_EQ_CLASSES dependent_eq_classes,
+  const ListScheduleOptions &options,
+  const std::map<Operand, unsigned> &pending,
+  const std::vector<unsigned> &choices,
+  std::vector<unsigned> *taken,
+  std::vector<unsigned> *branching
 ) {
   std::map<unsigned, unsigned> result;
-  if(std::distance(instr_begin, instr_end) == 0) {
-    return result;
-  }
-
-  auto dependence_roots = dependence_graph(instr_begin, instr_end,
-      reads, writes, uses_predicate, poisons, memory_access, latency,
-	  is_constant, conditional_branch, enable_dual_issue,
-	  dependent_eq_classes);
-  LLVM_DEBUG(Node::dump_graph(dependence_roots, dbgs()));
 
   // Instructions that have already been scheduled and finished executing
   std::set<std::shared_ptr<Node>> scheduled;
@@ -569,6 +586,15 @@ std::map<unsigned, unsigned> list_schedule(
   // The value is how many more cycles the execution lasts.
   // The set is the operands that are poisoned while the execution lasts
   std::map<std::shared_ptr<Node>, std::pair<unsigned, std::set<Operand>>> executing;
+
+  // Operands used by instructions before the region are poisoned by nodes
+  // that don't represent any instruction of the region.
+  for(auto entry: pending) {
+    if(entry.second != 0 && !is_constant(entry.first)) {
+      std::shared_ptr<Node> preceding(new Node(~0u, entry.second - 1, false, false, {}, {}));
+      executing[preceding] = std::make_pair(entry.second - 1, std::set<Operand>{entry.first});
+    }
+  }
   auto update_executing = [&](){
 
     // Any executing that only have 0 left need to be moved to scheduled
@@ -653,56 +679,114 @@ std::map<unsigned, unsigned> list_schedule(
     return ready;
   };
 
+
+  /// Returns the operands poisoned while the given node is executing.
+  auto poison_set = [&](std::shared_ptr<Node> node){
+    auto *instr = &(*std::next(instr_begin, node->idx));
+    std::set<Operand> new_poisons;
+    if(poisons(instr)) {
+      new_poisons = writes(instr);
+      // Make sure to not include the constant operands in the poison set
+      for(auto iter = new_poisons.begin(); iter != new_poisons.end();){
+        if(is_constant(*iter)) {
+          new_poisons.erase(iter);
+          iter = new_poisons.begin();
+        } else {
+          iter++;
+        }
+      }
+    }
+    return new_poisons;
+  };
+
+  /// Returns the next ready node for the first issue slot.
+  auto next_first = [&](std::set<std::shared_ptr<Node>> &ready_first,
+      unsigned choice, unsigned *candidates){
+    return get_next_ready(instr_begin, instr_end, ready_first, executing, reads, writes,
+        enable_dual_issue.hasValue(), false, true, [](auto instr){ return true;},
+        [](auto instr){ return true;}, options.critical_path, choice, candidates
+    );
+  };
+
+  /// Returns the next ready node that may be bundled with the given node
+  /// in the first issue slot.
+  auto next_second = [&](std::set<std::shared_ptr<Node>> &ready_second,
+      std::shared_ptr<Node> first){
+    auto *first_instr = &(*std::next(instr_begin, first->idx));
+    return get_next_ready(instr_begin, instr_end, ready_second, executing, reads, writes,
+      enable_dual_issue.hasValue(), !first->may_second_slot, false,
+      [&](auto instr){
+        if(enable_dual_issue) {
+          return std::get<3>(*enable_dual_issue)(first_instr, instr);
+        } else {
+          return true;
+        }
+      },
+      [&](auto instr){
+        return !dependent_eq_classes(first_instr, instr);
+      },
+      options.critical_path
+    );
+  };
+
+  /// With lookahead, returns the rank of the first of the highest-priority
+  /// candidates that leaves an instruction for the second issue slot.
+  auto lookahead_choice = [&](std::set<std::shared_ptr<Node>> &ready,
+      unsigned candidates){
+    if(enable_dual_issue) {
+      for(unsigned k = 0; k < std::min(options.lookahead, candidates); k++) {
+        auto ready_copy = ready;
+        auto first = next_first(ready_copy, k, nullptr);
+        if((*first)->is_long) continue;
+
+        // Pretend the candidate has been scheduled
+        executing[*first] = std::make_pair((*first)->latency, poison_set(*first));
+        auto ready_second = ready_nodes();
+        auto second = next_second(ready_second, *first);
+        executing.erase(*first);
+
+        if(second) {
+          return k;
+        }
+      }
+    }
+    return 0u;
+  };
+
+  unsigned step = 0;
   std::set<std::shared_ptr<Node>> ready = ready_nodes();
   for(unsigned idx = 0; (ready.size() + executing.size()) > 0; idx++, ready = ready_nodes()) {
     auto schedule_instruction = [&](auto next_node, unsigned idx){
-      auto *next_instr = &(*std::next(instr_begin, next_node->idx));
-
       // Schedule instruction
       assert(!result.count(idx) && "Schedule position already assigned");
       result[idx] = next_node->idx;
+      executing[next_node] = std::make_pair(next_node->latency, poison_set(next_node));
+    };
 
-      std::set<Operand> new_poisons;
-      if(poisons(next_instr)) {
-        new_poisons = writes(next_instr);
-        // Make sure to not include the constant operands in the poison set
-        for(auto iter = new_poisons.begin(); iter != new_poisons.end();){
-          if(is_constant(*iter)) {
-            new_poisons.erase(iter);
-            iter = new_poisons.begin();
-          } else {
-            iter++;
-          }
-        }
+    unsigned candidates = 0;
+    unsigned choice = 0;
+    if(step < choices.size() || taken || branching || options.lookahead > 1) {
+      auto ready_copy = ready;
+      next_first(ready_copy, 0, &candidates);
+
+      if(step < choices.size()) {
+        choice = std::min(choices[step], candidates? candidates - 1: 0);
+      } else if(options.lookahead > 1) {
+        choice = lookahead_choice(ready, candidates);
       }
-      executing[next_node] = std::make_pair(next_node->latency, new_poisons);
-    };
+    }
 
-    auto next = get_next_ready(instr_begin, instr_end, ready, executing, reads, writes,
-        enable_dual_issue.hasValue(), false, true, [](auto instr){ return true;},
-    	[](auto instr){ return true;}
-    );
+    auto next = next_first(ready, choice, nullptr);
     if(next) {
+      if(taken) taken->push_back(choice);
+      if(branching) branching->push_back(candidates);
+      step++;
+
       schedule_instruction(*next, enable_dual_issue? idx*2: idx);
 
       if(enable_dual_issue && !(*next)->is_long) {
         ready = ready_nodes();
-        auto next2 = get_next_ready(instr_begin, instr_end, ready, executing, reads, writes,
-          enable_dual_issue.hasValue(), !(*next)->may_second_slot, false,
-          [&](auto instr){
-            if(enable_dual_issue) {
-              return std::get<3>(*enable_dual_issue)(
-                &*(std::next(instr_begin, (*next)->idx)),
-                instr
-              );
-            } else {
-              return true;
-            }
-          },
-          [&](auto instr){
-            return !dependent_eq_classes(&*(std::next(instr_begin, (*next)->idx)), instr);
-          }
-        );
+        auto next2 = next_second(ready, *next);
         if(next2) {
           assert(!(*next2)->is_long);
           assert(!(!(*next)->may_second_slot && !(*next2)->may_second_slot)
@@ -722,6 +806,167 @@ std::map<unsigned, unsigned> list_schedule(
     update_executing();
   }
 
+  return result;
+}
+/// Schedules the given block's instructions.
+///
+/// Returns a mapping from the new schedule to the original one.
+/// I.e. [(0,1), (1,0)] means the first instruction in the new schedule
+/// should be the second instruction in the old schedule. Likewise, the second
+/// instruction in the new schedule should be the first in the original one.
+///
+/// If dual-issue is requested, the new schedule indices are divided in 2:
+/// Odd indices for the first instructions in each bundle, and even indices
+/// for the second instruction. If a bundle doesn't have a second instruction,
+/// its even index will not be occupied.
+/// E.g. [(0,1), (1,0)] means the first instruction in the first bundle in the new
+/// schedule should be the second instruction in the old schedule. The second instruction
+/// in the first bundle should then be the first instruction in the old schedule.
+///
+/// If a target schedule index does not have a mapping, it means that index must be given a Nop.
+///
+/// Arguments:
+/// * mbb: The block to schedule
+/// * reads: given an instruction, returns the operands that instruction reads from.
+/// * writes: given an instruction, returns the operands that instruction writes to.
+/// * poisons: given an instruction, returns whether the write operands are poisoned
+///      poisoned until the instruction finishes executing. Poisoned operands can't be used
+///      by any other instruction while the poisoning instruction is executing.
+///      E.g. Patmos's loads poison the target register in the delay slot.
+///      On the other hand, the multiply instruction doesn't poison the sl and sh registers.
+/// * memory_access: given an instruction, returns whether either reads or writes to memory.
+/// * latency: given an instruction, returns how many cycles above 1 it takes to execute.
+///           E.g. Patmos' loads have a latency of 1, while delayed branches have 2.
+///           The usual instruction like add have 0
+/// * is_constant: given an operand, returns whether that operand is always constant.
+///               E.g. Patmos' r0 and p0
+/// * conditional_branch: Whether this instruction is a conditional branch our of the block.
+///                 E.g. Patmos::BR. Call instructions don't count.
+/// * enable_dual_issue: If given, enables dual issue code and contains
+///					1) a value that is passed as the first argument to 2)
+///                 2) a function that should return true if the given instruction may be
+///                    scheduled in the second issue slot. Otherwise false.
+///                 3) a function that should return true if the instruction takes
+///                    up both issue slots. Otherwise false.
+///                 4) a function that should return true the two given instructions
+///                    may be scheduled in the same bundle without restriction.
+///                    If this returns false, the instructions will only be bundled if they
+///                    have independent equivalence classes.
+/// * dependent_eq_classes: Given two instructions, returns whether they have dependent equivalence classes.
+///                         See EquivalenceClass::dependentClasses
+/// * options: Optional improvements of the scheduler, see ListScheduleOptions.
+/// * pending: Operands that instructions preceding the block (e.g. the end of a
+///            block falling through to this one) are still producing, and for
+///            how many cycles no instruction of the block may access them.
+///            This lets the schedule hide their latency instead of the preceding
+///            block being padded with Nops.
+///
+/// This scheduler can handle conditional branch instructions in the middle of the instruction
+/// list however does not attempt to occupy their delay slots nor add Nops.
+/// Therefore, post-processing is needed to ensure delayed branches/calls get at least Nops after them.
+///
+/// Note: Does not account for inter-functional scheduling requirements.
+/// 	  E.g. if a blocks ends with high-latency instruction and falls through
+///       to a block that uses the poisoned or written-to registers in the first instruction.
+template<
+  typename Instruction,
+  typename InstrIter,
+  typename Operand,
+  typename MAY_SECOND_SLOT_EXTRA,
+  typename DEPENDENT_EQ_CLASSES
+>
+std::map<unsigned, unsigned> list_schedule(
+  InstrIter instr_begin, InstrIter instr_end,
+  std::set<Operand> (*reads)(const Instruction *),
+  std::set<Operand> (*writes)(const Instruction *),
+  Optional<Operand> (*uses_predicate)(const Instruction *),
+  bool (*poisons)(const Instruction *),
+  bool (*memory_access)(const Instruction *),
+  unsigned (*latency)(const Instruction *),
+  bool (*is_constant)(Operand),
+  bool (*conditional_branch)(const Instruction *),
+  Optional<std::tuple<
+    MAY_SECOND_SLOT_EXTRA,
+    bool (*)(MAY_SECOND_SLOT_EXTRA, const Instruction *),
+    bool (*)(const Instruction *),
+    bool (*)(const Instruction *,const Instruction *)
+  >> enable_dual_issue,
+  DEPENDENT_EQ_CLASSES dependent_eq_classes,
+  const ListScheduleOptions &options = ListScheduleOptions(),
+  const std::map<Operand, unsigned> &pending = std::map<Operand, unsigned>()
+) {
+  std::map<unsigned, unsigned> result;
+  auto instr_count = std::distance(instr_begin, instr_end);
+  if(instr_count == 0) {
+    return result;
+  }
+
+  auto dependence_roots = dependence_graph(instr_begin, instr_end,
+      reads, writes, uses_predicate, poisons, memory_access, latency,
+	  is_constant, conditional_branch, enable_dual_issue,
+	  dependent_eq_classes);
+  LLVM_DEBUG(Node::dump_graph(dependence_roots, dbgs()));
+
+  auto run = [&](const std::vector<unsigned> &choices,
+      std::vector<unsigned> *taken, std::vector<unsigned> *branching){
+    return list_schedule_run(instr_begin, instr_end, dependence_roots,
+        reads, writes, poisons, is_constant, enable_dual_issue,
+        dependent_eq_classes, options, pending, choices, taken, branching);
+  };
+
+  std::vector<unsigned> taken, branching;
+  result = run({}, &taken, &branching);
+
+  if(options.exact_max_instrs != 0 && instr_count <= options.exact_max_instrs) {
+    // The number of bundles of a schedule
+    auto length = [&](const std::map<unsigned, unsigned> &schedule){
+      auto last = schedule.rbegin()->first;
+      return enable_dual_issue? (last/2) + 1 : last + 1;
+    };
+
+    // No schedule can be shorter than issuing every instruction without nops
+    unsigned lower_bound = instr_count;
+    if(enable_dual_issue) {
+      unsigned slots = 0;
+      for(auto iter = instr_begin; iter != instr_end; iter++) {
+        slots += std::get<2>(*enable_dual_issue)(&*iter)? 2 : 1;
+      }
+      lower_bound = (slots + 1) / 2;
+    }
+
+    // Depth-first search over the choices in the first issue slot, trying
+    // every other candidate at every step of the schedules found so far.
+    std::vector<std::vector<unsigned>> work_list;
+    auto branch = [&](unsigned prefix_size, const std::vector<unsigned> &taken,
+        const std::vector<unsigned> &branching){
+      for(unsigned s = prefix_size; s < branching.size(); s++) {
+        for(unsigned k = 0; k < branching[s]; k++) {
+          if(k == taken[s] || work_list.size() >= options.exact_budget) continue;
+          std::vector<unsigned> choices(taken.begin(), std::next(taken.begin(), s));
+          choices.push_back(k);
+          work_list.push_back(choices);
+        }
+      }
+    };
+    branch(0, taken, branching);
+
+    unsigned tries = 0;
+    while(!work_list.empty() && tries < options.exact_budget &&
+        length(result) > lower_bound) {
+      auto choices = work_list.back();
+      work_list.pop_back();
+      tries++;
+
+      std::vector<unsigned> try_taken, try_branching;
+      auto schedule = run(choices, &try_taken, &try_branching);
+      if(length(schedule) < length(result)) {
+        LLVM_DEBUG(dbgs() << "Bounded search improved schedule from "
+            << length(result) << " to " << length(schedule) << " bundles\n");
+        result = schedule;
+      }
+      branch(choices.size(), try_taken, try_branching);
+    }
+  }
   // Various schedule validity checks
 
   // Check long instruction aren't in second slot
@@ -737,6 +982,7 @@ std::map<unsigned, unsigned> list_schedule(
 	  }
   }
 
+
   return result;
 }
 
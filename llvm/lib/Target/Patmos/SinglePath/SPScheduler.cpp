@@ -13,11 +13,11 @@
 #include "SPScheduler.h"
 #include "SPListScheduler.h"
 #include "EquivalenceClasses.h"
+#include "PatmosRegionTimer.h"
 #include "TargetInfo/PatmosTargetInfo.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/MachineInstr.h"
-#include <sstream>
 
 
 using namespace llvm;
@@ -40,6 +40,36 @@ static cl::opt<bool> SPDisableSchedulerEqClass(
     cl::desc("Enables the Single-path scheduler to disregard dependencies between instructions of independent equivalence classes."),
     cl::Hidden);
 
+static cl::opt<bool> SPSchedulerCriticalPath(
+    "mpatmos-singlepath-scheduler-critical-path",
+    cl::init(true),
+    cl::desc("Prioritize instructions on the critical path of the dependence graph in the single-path scheduler."),
+    cl::Hidden);
+
+static cl::opt<unsigned> SPSchedulerLookahead(
+    "mpatmos-singlepath-scheduler-lookahead",
+    cl::init(4),
+    cl::desc("Number of ready instructions the single-path scheduler considers for the first issue slot to also fill the second one (default: 4)."),
+    cl::Hidden);
+
+static cl::opt<unsigned> SPSchedulerExactSize(
+    "mpatmos-singlepath-scheduler-exact-size",
+    cl::init(12),
+    cl::desc("Blocks with at most this many instructions are additionally scheduled by a bounded search in the single-path scheduler. 0 disables the search (default: 12)."),
+    cl::Hidden);
+
+static cl::opt<unsigned> SPSchedulerExactBudget(
+    "mpatmos-singlepath-scheduler-exact-budget",
+    cl::init(256),
+    cl::desc("Number of schedules the bounded search of the single-path scheduler may try per block (default: 256)."),
+    cl::Hidden);
+
+static cl::opt<bool> SPDisableSchedulerCrossBlock(
+    "mpatmos-disable-singlepath-scheduler-cross-block",
+    cl::init(false),
+    cl::desc("Disables hiding the latencies at the end of a single-path block in the block it falls through to."),
+    cl::Hidden);
+
 STATISTIC(SPInstructions,     "Number of instruction bundles in single-path code (both single and double)");
 STATISTIC(SPLongInstructions,     "Number of instruction in single-path code that are long");
 STATISTIC(SPFirstSlotInstructions,     "Number of instruction in single-path code that can only use the first issue slot (counted before scheduling)");
@@ -51,31 +81,40 @@ FunctionPass *llvm::createSPSchedulerPass(const PatmosTargetMachine &tm) {
   return new SPScheduler(tm);
 }
 
-static std::tuple<std::string,int,unsigned,unsigned> split_SPSchedulerConfig()
+/// Parses the scheduler configuration once, as it is queried for every block.
+static const std::tuple<std::string,int,unsigned,unsigned> &split_SPSchedulerConfig()
 {
-	std::stringstream stream(SPSchedulerConfig.getValue());
+	static Optional<std::tuple<std::string,int,unsigned,unsigned>> config;
+	if(config) {
+		return *config;
+	}
 
 	std::string fn_name = "";
 	int block_nr = -1;
 	unsigned ignore_count = 0;
 	unsigned sched_count = 0;
 
-	int i = 0;
-	while (stream.good()) {
-		std::string substr;
-		std::getline(stream, substr, ',');
+	SmallVector<StringRef, 4> fields;
+	StringRef(SPSchedulerConfig.getValue()).split(fields, ',');
+	if(fields.size() > 4) {
+		report_fatal_error("Too many fields in '--mpatmos-singlepath-scheduler-config'");
+	}
 
+	bool invalid = false;
+	for(unsigned i = 0; i < fields.size(); i++) {
 		switch(i){
-		case 0:  fn_name = substr; break;
-		case 1:  block_nr = std::stoi(substr); break;
-		case 2:  ignore_count = std::stoul(substr); break;
-		case 3:  sched_count = std::stoul(substr); break;
-		default: assert(false);
+		case 0:  fn_name = fields[i].str(); break;
+		case 1:  invalid |= fields[i].getAsInteger(10, block_nr); break;
+		case 2:  invalid |= fields[i].getAsInteger(10, ignore_count); break;
+		case 3:  invalid |= fields[i].getAsInteger(10, sched_count); break;
 		}
-		i++;
+	}
+	if(invalid) {
+		report_fatal_error("Invalid number in '--mpatmos-singlepath-scheduler-config'");
 	}
 
-	return std::make_tuple(fn_name, block_nr, ignore_count, sched_count);
+	config = std::make_tuple(fn_name, block_nr, ignore_count, sched_count);
+	return *config;
 }
 
 static bool config_schedule_for_fn(const MachineFunction *mf) {
@@ -163,6 +202,13 @@ std::set<Register> writes(const MachineInstr *instr){
   std::for_each(instr->operands_begin(), instr->operands_end(), [&](auto op){
     if(op.isReg() && op.isDef()) {
       result.insert(op.getReg());
+    } else if(op.isRegMask()) {
+      // The registers a call clobbers
+      for(unsigned reg = 1; reg < Patmos::NUM_TARGET_REGS; reg++) {
+        if(op.clobbersPhysReg(reg)) {
+          result.insert(reg);
+        }
+      }
     }
   });
   convert_s0_to_p(result);
@@ -328,6 +374,15 @@ bool SPScheduler::runOnMachineFunction(MachineFunction &mf){
 
   LLVM_DEBUG( dbgs() << "Running SPScheduler on function '" <<  mf.getName() << "'\n");
 
+  // Import the class dependencies once for the whole function, as the
+  // scheduler checks many pairs of instructions in every block
+  ClassDependencies.clear();
+  if(PatmosSinglePathInfo::useNewSinglePathTransform() && !SPDisableSchedulerEqClass) {
+    ClassDependencies = EquivalenceClasses::importClassDependenciesFromModule(mf);
+  }
+
+  auto &ORE = getAnalysis<MachineOptimizationRemarkEmitterPass>().getORE();
+
   for(auto &mbb: mf){
     LLVM_DEBUG( dbgs() << "MBB before scheduling: \n"; mbb.dump());
 
@@ -342,7 +397,10 @@ bool SPScheduler::runOnMachineFunction(MachineFunction &mf){
     bool disable = DisableSPScheduler || disable_schedule_for_fn(&mf) || disable_schedule_for_block(&mbb);
 
     if(!disable) {
-      runListSchedule(&mbb);
+      // Blocks are scheduled in layout order, so the block falling through to
+      // this one has already been scheduled. Its remaining latencies are
+      // hidden by this block's schedule.
+      runListSchedule(&mbb, pendingAtEntry(&mbb));
     } else {
       LLVM_DEBUG( dbgs() << "Disabled SPScheduler for '" << mf.getName() << "' block: " << mbb.getNumber() << "\n");
     }
@@ -358,6 +416,20 @@ bool SPScheduler::runOnMachineFunction(MachineFunction &mf){
 	  }
 	  instrIter = std::next(instrIter, 1+latency); // Make sure to skip the newly added noops
     }
+
+    unsigned nops = 0, bundles = 0;
+    for(auto &instr: mbb) {
+      bundles++;
+      if(instr.getOpcode() == Patmos::NOP) nops++;
+    }
+    if(nops > 0) {
+      ORE.emit([&]() {
+        return MachineOptimizationRemarkAnalysis(DEBUG_TYPE, "NOPFill",
+                   mbb.findDebugLoc(mbb.instr_begin()), &mbb)
+               << ore::NV("NOPs", nops) << " of " << ore::NV("Bundles", bundles)
+               << " bundles filled with NOPs";
+      });
+    }
   }
 
   // Look for any fall-through that has a load at the end and ensure
@@ -418,7 +490,50 @@ unsigned SPScheduler::calculateLatency(MachineBasicBlock::iterator instr, bool b
   }
 }
 
-void SPScheduler::runListSchedule(MachineBasicBlock *mbb) {
+std::map<Register, unsigned>
+SPScheduler::pendingAtEntry(MachineBasicBlock *mbb) const {
+  std::map<Register, unsigned> pending;
+  if(SPDisableSchedulerCrossBlock || mbb == &mbb->getParent()->front()) {
+    return pending;
+  }
+
+  auto *pred = &*std::prev(mbb->getIterator());
+  if(!pred->canFallThrough() || pred->getFallThrough() != mbb) {
+    return pending;
+  }
+
+  // Find the last bundle, skipping any pseudo instructions moved to the end
+  auto last = pred->instr_rbegin();
+  while(last != pred->instr_rend() && last->isPseudo()) {
+    last++;
+  }
+
+  for(; last != pred->instr_rend(); last++) {
+    auto instr_latency = latency(&*last);
+    if(instr_latency != 0) {
+      for(auto reg: writes(&*last)) {
+        if(!is_constant(reg)) {
+          pending[reg] = std::max(pending[reg], instr_latency);
+        }
+      }
+    }
+    if(!last->isBundledWithPred()) {
+      break;
+    }
+  }
+
+  LLVM_DEBUG(
+    for(auto entry: pending) {
+      dbgs() << "Pending at entry of bb." << mbb->getNumber() << ": "
+             << printReg(entry.first) << " for " << entry.second << " cycles\n";
+    }
+  );
+  return pending;
+}
+
+void SPScheduler::runListSchedule(MachineBasicBlock *mbb,
+                                  const std::map<Register, unsigned> &pending) {
+  PatmosRegionTimer T("sp-list-schedule", "Single-path list scheduling");
   // Scheduler cannot handle the PSEUDO_LOOPBOUND pseudo-instruction,
   // so if it's there, move it to the end of the instruction list
   // so its skipped
@@ -488,13 +603,14 @@ void SPScheduler::runListSchedule(MachineBasicBlock *mbb) {
   }
 
 
+  bool use_eq_classes = PatmosSinglePathInfo::useNewSinglePathTransform() && !SPDisableSchedulerEqClass;
+
   auto is_dependent = [&](const MachineInstr* instr1,const MachineInstr* instr2){
     bool dep;
-    if(!PatmosSinglePathInfo::useNewSinglePathTransform() || SPDisableSchedulerEqClass)  {
+    if(!use_eq_classes)  {
     	dep = true;
     } else {
-    	auto class_dependencies = EquivalenceClasses::importClassDependenciesFromModule(*mbb->getParent());
-    	dep = EquivalenceClasses::dependentInstructions(instr1, instr2,class_dependencies);
+    	dep = EquivalenceClasses::dependentInstructions(instr1, instr2, ClassDependencies);
     }
 	LLVM_DEBUG(
 		dbgs() << "Checking Instructions dependence:\n";
@@ -505,10 +621,16 @@ void SPScheduler::runListSchedule(MachineBasicBlock *mbb) {
 	return dep;
   };
 
+  ListScheduleOptions options;
+  options.critical_path = SPSchedulerCriticalPath;
+  options.lookahead = SPSchedulerLookahead;
+  options.exact_max_instrs = SPSchedulerExactSize;
+  options.exact_budget = SPSchedulerExactBudget;
+
   auto schedule = list_schedule(
     mbb->instr_begin(), last_to_schedule,
     reads, writes, uses_predicate, poisons, memory_access, latency, is_constant, conditional_branch, enable_dual_issue,
-	is_dependent
+	is_dependent, options, pending
   );
   LLVM_DEBUG(
     dbgs() << "List Schedule (New Order <- old order):\n";
@@ -14,6 +14,7 @@
 #define TARGET_PATMOS_SINGLEPATH_SPSCHEDULER_H_
 
 #include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineOptimizationRemarkEmitter.h"
 
 #include "PatmosTargetMachine.h"
 #include "PatmosSPReduce.h"
@@ -39,6 +40,7 @@ public:
 
   /// getAnalysisUsage - Specify which passes this pass depends on
   void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<MachineOptimizationRemarkEmitterPass>();
     MachineFunctionPass::getAnalysisUsage(AU);
   }
 
@@ -46,6 +48,9 @@ private:
 
   const PatmosTargetMachine &TM;
 
+  /// The dependencies between the equivalence classes of the current function.
+  std::map<unsigned, std::set<unsigned>> ClassDependencies;
+
   /// Calculates the latency that must be observed between these two instructions.
   /// E.g. if the first instruction loads a value into a register and the
   /// second instruction uses that value the latency is 1, and there must be at
@@ -55,9 +60,16 @@ private:
   /// If boolean is true, latency is only returned for control flow instructions.
   unsigned calculateLatency(MachineBasicBlock::iterator, bool) const;
 
+  /// Returns the registers the block falling through to the given block (if
+  /// any) is still producing at the end of its schedule, and for how many
+  /// cycles they are unavailable.
+  std::map<Register, unsigned> pendingAtEntry(MachineBasicBlock *mbb) const;
+
   /// Runs a list scheduler on the given block to avoid empty delay slots
   /// in non-control-flow instructions.
-  void runListSchedule(MachineBasicBlock *mbb);
+  /// Registers in 'pending' are not accessed until they become available.
+  void runListSchedule(MachineBasicBlock *mbb,
+                       const std::map<Register, unsigned> &pending);
 };
 
 }
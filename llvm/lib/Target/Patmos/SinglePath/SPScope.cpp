@@ -372,6 +372,8 @@ public:
   void decompose(CD_map_t &CD, FCFG &fcfg, const PatmosInstrInfo* instrInfo) {
     BlockPredicates blockPreds;
     std::map<unsigned, CD_map_entry_t> K;
+    // the predicate of each dependence set in K
+    std::map<CD_map_entry_t, unsigned> KPred;
 
     int p;
     if(!Pub.isTopLevel()){
@@ -383,26 +385,22 @@ public:
 
     auto blocks = Pub.getBlocksTopoOrd();
     for(auto block: blocks){
-      CD_map_entry_t t = CD.at(block);
-      int q=-1;
+      const CD_map_entry_t &t = CD.at(block);
       // try to lookup the control dependence
-      for (auto pair: K) {
-        if ( t == pair.second ) {
-          q = pair.first;
-          break;
-        }
-      }
+      auto q = KPred.find(t);
 
-      if (q != -1) {
+      if (q != KPred.end()) {
         // we already have handled this dependence
-        blockPreds[block] = q;
+        blockPreds[block] = q->second;
       } else {
         // new dependence set:
         if(!Pub.isTopLevel() && block == Pub.getHeader()){
           K.insert(make_pair(*Pub.getHeader()->getBlockPredicates().begin(), t));
+          KPred.insert(make_pair(t, *Pub.getHeader()->getBlockPredicates().begin()));
           blockPreds[block] = *Pub.getHeader()->getBlockPredicates().begin();
         }else{
           K.insert(make_pair(p, t));
+          KPred.insert(make_pair(t, p));
           blockPreds[block] = p++;
         }
       }
@@ -749,7 +747,8 @@ SPScope::SPScope(bool isRootFunc, MachineFunction &MF, MachineLoopInfo &LI)
   : Priv(spimpl::make_unique_impl<Impl>(this, (SPScope *)NULL, isRootFunc, (MachineLoop*)NULL, &MF.front(), MF, LI))
 {}
 
-SPScope::SPScope(SPScope *parent, MachineLoop &loop, MachineFunction &MF, MachineLoopInfo &LI)
+SPScope::SPScope(SPScope *parent, MachineLoop &loop, MachineFunction &MF, MachineLoopInfo &LI,
+                 const PatmosLoopBoundInfo &LBI)
   : Priv(spimpl::make_unique_impl<Impl>(this, parent, parent->Priv->RootFunc, &loop, loop.getHeader(), MF, LI))
 {
   parent->Priv->Subscopes.push_back(this);
@@ -769,7 +768,7 @@ SPScope::SPScope(SPScope *parent, MachineLoop &loop, MachineFunction &MF, Machin
     }
   }
 
-  if( auto bounds = getLoopBounds(header) ) {
+  if( auto bounds = LBI.getLoopBounds(header) ) {
       Priv->LoopBound = bounds->second;
   }
 
@@ -901,6 +900,69 @@ std::vector<PredicatedBlock*> SPScope::getBlocksTopoOrd() const
   return PO;
 }
 
+std::vector<PredicatedBlock*> SPScope::getBlocksTopoOrd(
+  function_ref<bool(const PredicatedBlock *, const PredicatedBlock *)> interleaves) const
+{
+  auto fcfg = Priv->buildfcfg();
+
+  // the reverse postorder decides between equally good choices
+  std::vector<Node *> RPO(po_begin(&fcfg), po_end(&fcfg));
+  std::reverse(RPO.begin(), RPO.end());
+  std::map<Node *, unsigned> index;
+  for (unsigned i = 0; i < RPO.size(); i++) {
+    index[RPO[i]] = i;
+  }
+
+  // number of predecessors not yet ordered of each node
+  std::vector<unsigned> pending(RPO.size(), 0);
+  for (auto n: RPO) {
+    for (auto I = n->succs_begin(), E = n->succs_end(); I != E; ++I) {
+      pending[index.at(*I)]++;
+    }
+  }
+
+  auto header = getHeader()->getMBB();
+  auto is_last = [&](const PredicatedBlock *block) {
+    auto MBB = block->getMBB();
+    return isTopLevel() ? MBB->succ_empty() : MBB->isSuccessor(header);
+  };
+
+  std::vector<PredicatedBlock *> order;
+  std::set<unsigned> ready = {0};
+  while (!ready.empty()) {
+    auto next = ready.end();
+    auto fallback = ready.end();
+    for (auto I = ready.begin(), E = ready.end(); I != E; ++I) {
+      auto block = RPO[*I]->Block;
+      if (block && is_last(block)) {
+        continue;
+      }
+      if (fallback == E) {
+        fallback = I;
+      }
+      if (!block || (!order.empty() && interleaves(order.back(), block))) {
+        next = I;
+        break;
+      }
+    }
+    if (next == ready.end()) {
+      next = fallback != ready.end() ? fallback : ready.begin();
+    }
+
+    auto n = RPO[*next];
+    ready.erase(next);
+    if (n->Block) {
+      order.push_back(const_cast<PredicatedBlock*>(n->Block));
+    }
+    for (auto I = n->succs_begin(), E = n->succs_end(); I != E; ++I) {
+      if (--pending[index.at(*I)] == 0) {
+        ready.insert(index.at(*I));
+      }
+    }
+  }
+  return order;
+}
+
 unsigned SPScope::getNumberOfFcfgBlocks() const
 {
   return Priv->Blocks.size()
@@ -945,24 +1007,26 @@ bool SPScope::hasMultDefEdges(unsigned pred) const
 
 // build the SPScope tree in DFS order, creating new SPScopes preorder
 static
-void createSPScopeSubtree(MachineLoop *loop, SPScope *parent, MachineFunction &MF, MachineLoopInfo &LI) {
+void createSPScopeSubtree(MachineLoop *loop, SPScope *parent, MachineFunction &MF, MachineLoopInfo &LI,
+                          const PatmosLoopBoundInfo &LBI) {
 
-  SPScope *subScope = new SPScope(parent, *loop, MF, LI);
+  SPScope *subScope = new SPScope(parent, *loop, MF, LI, LBI);
 
   // visit subloops
   std::for_each(loop->begin(), loop->end(), [&](auto subLoop){
-    createSPScopeSubtree(subLoop, subScope, MF, LI);
+    createSPScopeSubtree(subLoop, subScope, MF, LI, LBI);
   });
 }
 
-SPScope * SPScope::createSPScopeTree(MachineFunction &MF, MachineLoopInfo &LI, const PatmosInstrInfo* instrInfo) {
+SPScope * SPScope::createSPScopeTree(MachineFunction &MF, MachineLoopInfo &LI,
+                                     const PatmosLoopBoundInfo &LBI, const PatmosInstrInfo* instrInfo) {
 
   SPScope *Root = new SPScope(PatmosSinglePathInfo::isRoot(MF) || PatmosSinglePathInfo::isPseudoRoot(MF), MF, LI);
 
   // iterate over top-level loops
   for (MachineLoopInfo::iterator I=LI.begin(), E=LI.end(); I!=E; ++I) {
     MachineLoop *Loop = *I;
-    createSPScopeSubtree(Loop, Root, MF, LI);
+    createSPScopeSubtree(Loop, Root, MF, LI, LBI);
   }
 
   Root->Priv->assignSuccessors();
@@ -23,12 +23,14 @@
 #ifndef TARGET_PATMOS_SINGLEPATH_SPSCOPE_H_
 #define TARGET_PATMOS_SINGLEPATH_SPSCOPE_H_
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineLoopInfo.h"
 #include "llvm/Support/Debug.h"
 #include "spimpl.h"
 #include "PredicatedBlock.h"
 #include "PatmosInstrInfo.h"
+#include "TargetInfo/PatmosTargetInfo.h"
 
 // define for more detailed debugging output
 #define PATMOS_SINGLEPATH_TRACE
@@ -76,7 +78,9 @@ namespace llvm {
 
       /// Create a subscope of the given parent scope that represents the given loop in the function.
       /// The given loop must be nested inside the loop represented by the parent.
-      explicit SPScope(SPScope *parent, MachineLoop &loop, MachineFunction &MF, MachineLoopInfo &LI);
+      /// Its bound is taken from the given loop bound information.
+      explicit SPScope(SPScope *parent, MachineLoop &loop, MachineFunction &MF, MachineLoopInfo &LI,
+                       const PatmosLoopBoundInfo &LBI);
 
       /// Deletes the scope and all its subscopes.
       ~SPScope();
@@ -136,6 +140,16 @@ namespace llvm {
       /// It is sorted in topological order.
       std::vector<PredicatedBlock*> getBlocksTopoOrd() const;
 
+      /// Returns the blocks like getBlocksTopoOrd(), but chooses among the
+      /// blocks whose predecessors are already ordered. The next block is
+      /// preferably one that 'interleaves' with the previous one, i.e., for
+      /// which interleaves(previous, next) is true. Otherwise, and among these
+      /// blocks, the order of getBlocksTopoOrd() is kept.
+      /// The latches of the scope, or the exits of the top-level scope, are
+      /// still ordered last.
+      std::vector<PredicatedBlock*> getBlocksTopoOrd(
+        function_ref<bool(const PredicatedBlock *, const PredicatedBlock *)> interleaves) const;
+
       /// Returns the number of blocks that are in this scope and
       /// are subheaders of the scope.
       unsigned getNumberOfFcfgBlocks() const;
@@ -171,7 +185,8 @@ namespace llvm {
 
       /// Create an SPScope tree, return the top-level scope.
       /// The tree needs to be destroyed by the client, by deleting the top-level scope.
-      static SPScope * createSPScopeTree(MachineFunction &MF, MachineLoopInfo &LI, const PatmosInstrInfo*);
+      static SPScope * createSPScopeTree(MachineFunction &MF, MachineLoopInfo &LI,
+                                         const PatmosLoopBoundInfo &LBI, const PatmosInstrInfo*);
 
       /// Returns all the predicates use by the blocks in this scope. (including subheaders)
       std::set<unsigned> getAllPredicates() const;
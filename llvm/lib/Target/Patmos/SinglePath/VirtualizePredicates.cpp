@@ -15,6 +15,9 @@ using namespace llvm;
 
 #define DEBUG_TYPE "patmos-singlepath"
 
+STATISTIC(SPSharedCounterSpills,
+          "Number of prologue spills of loop counters shared between loops");
+
 char VirtualizePredicates::ID = 0;
 
 FunctionPass *llvm::createVirtualizePredicates(const PatmosTargetMachine &tm) {
@@ -94,6 +97,7 @@ bool VirtualizePredicates::runOnMachineFunction(MachineFunction &MF) {
 /// caller's register (which they didn't spill since the paths is disabled).
 void VirtualizePredicates::unpredicateCounterSpillReload(MachineFunction &MF) {
 	auto &LI = getAnalysis<MachineLoopInfo>();
+	auto &LBI = getAnalysis<PatmosLoopBoundInfo>();
 
 	// registers used for loop counter management and their loop
 	std::set<std::pair<Register, MachineLoop*>> counter_mgmt_regs;
@@ -103,8 +107,8 @@ void VirtualizePredicates::unpredicateCounterSpillReload(MachineFunction &MF) {
 		auto loop = LI.getLoopFor(header);
 		if(!LI.isLoopHeader(header) || !PatmosSinglePathInfo::needsCounter(loop)) continue;
 
-		assert(getLoopBounds(header));
-		auto loop_bound = getLoopBounds(header)->second;
+		assert(LBI.getLoopBounds(header));
+		auto loop_bound = LBI.getLoopBounds(header)->second;
 		MachineBasicBlock *preheader, *unilatch;
 		std::tie(preheader, unilatch) = PatmosSinglePathInfo::getPreHeaderUnilatch(loop);
 
@@ -279,10 +283,17 @@ void VirtualizePredicates::unpredicateCounterSpillReload(MachineFunction &MF) {
 		}
 	}
 
-	// Add registers to prologue/epilogue
+	// Add registers to prologue/epilogue.
+	// The counters of sibling loops, and of loops in different nests, often
+	// get the same register, which is then saved only once for all of them.
 	if(!PatmosSinglePathInfo::isRootLike(MF)) {
+		std::set<Register> counter_regs;
 		for(auto entry: counter_mgmt_regs) {
-			auto reg = entry.first;
+			if(!counter_regs.insert(entry.first).second) {
+				SPSharedCounterSpills++;
+			}
+		}
+		for(auto reg: counter_regs) {
 			LLVM_DEBUG(dbgs() << "Adding loop counter " << printReg(reg, TRI) << " to prologue/epilogue\n");
 			auto frame_idx = MF.getFrameInfo().CreateSpillStackObject(4, Align(4));
 
@@ -17,6 +17,7 @@
 #include "PatmosSubtarget.h"
 #include "PatmosSinglePathInfo.h"
 #include "PatmosMachineFunctionInfo.h"
+#include "TargetInfo/PatmosTargetInfo.h"
 
 namespace llvm {
 
@@ -51,6 +52,8 @@ namespace llvm {
 		void getAnalysisUsage(AnalysisUsage &AU) const override {
 			AU.addRequired<MachineLoopInfo>();
 			AU.addPreserved<MachineLoopInfo>();
+			AU.addRequired<PatmosLoopBoundInfo>();
+			AU.addPreserved<PatmosLoopBoundInfo>();
 			MachineFunctionPass::getAnalysisUsage(AU);
 		}
 
@@ -18,6 +18,8 @@
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/PassRegistry.h"
 
 using namespace llvm;
 
@@ -58,6 +60,37 @@ Optional<std::pair<uint64_t, uint64_t>> llvm::getLoopBounds(const MachineBasicBl
   return None;
 }
 
+INITIALIZE_PASS(PatmosLoopBoundInfo, "patmos-loop-bounds",
+                "Patmos Loop Bound Information", true, true)
+
+char PatmosLoopBoundInfo::ID = 0;
+
+PatmosLoopBoundInfo::PatmosLoopBoundInfo() : MachineFunctionPass(ID) {
+  initializePatmosLoopBoundInfoPass(*PassRegistry::getPassRegistry());
+}
+
+bool PatmosLoopBoundInfo::runOnMachineFunction(MachineFunction &MF) {
+  Bounds.clear();
+  for (const MachineBasicBlock &MBB : MF) {
+    if (auto MBBBounds = llvm::getLoopBounds(&MBB))
+      Bounds[&MBB] = *MBBBounds;
+  }
+  return false;
+}
+
+void PatmosLoopBoundInfo::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.setPreservesAll();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+Optional<std::pair<uint64_t, uint64_t>>
+PatmosLoopBoundInfo::getLoopBounds(const MachineBasicBlock *MBB) const {
+  auto It = Bounds.find(MBB);
+  if (It == Bounds.end())
+    return None;
+  return It->second;
+}
+
 Target &llvm::getThePatmosTarget() {
   static Target ThePatmosTarget;
   return ThePatmosTarget;
@@ -236,7 +269,9 @@ bool llvm::isControlFlowCFInst(unsigned opcode) {
     case Patmos::CALLRND:
     case Patmos::RET:
     case Patmos::RETND:
-    // TODO: traps, interrupts
+    case Patmos::XRET:
+    case Patmos::XRETND:
+    // TODO: traps
       return true;
   }
 }
@@ -11,6 +11,8 @@
 
 #include "llvm/IR/Function.h"
 #include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallString.h"
 
 namespace llvm {
@@ -33,6 +35,34 @@ void getMBBIRName(const MachineBasicBlock *MBB,
 /// The second element is the maximum iteration count.
 Optional<std::pair<uint64_t, uint64_t>> getLoopBounds(const MachineBasicBlock * MBB);
 
+void initializePatmosLoopBoundInfoPass(PassRegistry &);
+
+/// Analysis of the loop bounds of a machine function, which allows to look up
+/// the bounds of a block in constant time instead of scanning it for the
+/// PSEUDO_LOOPBOUND instruction as getLoopBounds does.
+///
+/// Passes that neither remove blocks nor change loop bounds may preserve the
+/// analysis, blocks added later on have no bounds.
+class PatmosLoopBoundInfo : public MachineFunctionPass {
+  DenseMap<const MachineBasicBlock *, std::pair<uint64_t, uint64_t>> Bounds;
+
+public:
+  static char ID;
+
+  PatmosLoopBoundInfo();
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+  void releaseMemory() override { Bounds.clear(); }
+
+  /// Return the minimum and maximum iteration count of the loop with the
+  /// given header, see getLoopBounds.
+  Optional<std::pair<uint64_t, uint64_t>>
+  getLoopBounds(const MachineBasicBlock *MBB) const;
+};
+
 const Function *getCallTarget(const MachineInstr *MI);
 
 MachineFunction *getCallTargetMF(const MachineInstr *MI);
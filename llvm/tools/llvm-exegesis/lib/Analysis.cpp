@@ -8,11 +8,15 @@
 
 #include "Analysis.h"
 #include "BenchmarkResult.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCInstrItineraries.h"
 #include "llvm/MC/MCTargetOptions.h"
 #include "llvm/Support/FormatVariadic.h"
+#include <cmath>
 #include <limits>
+#include <map>
 #include <unordered_set>
 #include <vector>
 
@@ -531,6 +535,70 @@ tr.bad-cluster td.measurement span.minmax {
 </head>
 )";
 
+template <>
+Error Analysis::run<Analysis::PrintItineraryLatencies>(raw_ostream &OS) const {
+  if (Clustering_.getPoints().empty())
+    return Error::success();
+
+  // The best latency and inverse throughput measured for each opcode, in
+  // cycles per instruction.
+  struct OpcodeTiming {
+    Optional<double> Latency;
+    Optional<double> InverseThroughput;
+  };
+  std::map<unsigned, OpcodeTiming> Timings;
+  for (const InstructionBenchmark &Point : Clustering_.getPoints()) {
+    if (!Point.Error.empty() || Point.Key.Instructions.empty() ||
+        Point.Measurements.empty())
+      continue;
+    Optional<double> *Value;
+    switch (Point.Mode) {
+    case InstructionBenchmark::Latency:
+      Value = &Timings[Point.keyInstruction().getOpcode()].Latency;
+      break;
+    case InstructionBenchmark::InverseThroughput:
+      Value = &Timings[Point.keyInstruction().getOpcode()].InverseThroughput;
+      break;
+    default:
+      continue;
+    }
+    double Measured = Point.Measurements.front().PerInstructionValue;
+    if (!*Value || Measured < **Value)
+      *Value = Measured;
+  }
+
+  const InstrItineraryData ItinData =
+      SubtargetInfo_->getInstrItineraryForCPU(
+          Clustering_.getPoints().front().CpuName);
+
+  OS << "opcode_name" << kCsvSep << "itinerary_class" << kCsvSep
+     << "itinerary_latency" << kCsvSep << "measured_latency" << kCsvSep
+     << "measured_inverse_throughput" << kCsvSep << "suggested_latency"
+     << "\n";
+  for (const auto &OpcodeAndTiming : Timings) {
+    const unsigned Opcode = OpcodeAndTiming.first;
+    const OpcodeTiming &Timing = OpcodeAndTiming.second;
+    const unsigned ItinClass = InstrInfo_->get(Opcode).getSchedClass();
+    writeEscaped<kEscapeCsv>(OS, InstrInfo_->getName(Opcode));
+    OS << kCsvSep << ItinClass << kCsvSep;
+    if (!ItinData.isEmpty())
+      OS << ItinData.getStageLatency(ItinClass);
+    OS << kCsvSep;
+    if (Timing.Latency)
+      writeMeasurementValue<kEscapeCsv>(OS, *Timing.Latency);
+    OS << kCsvSep;
+    if (Timing.InverseThroughput)
+      writeMeasurementValue<kEscapeCsv>(OS, *Timing.InverseThroughput);
+    OS << kCsvSep;
+    // A serial chain of an instruction takes its latency per instruction, but
+    // at least one cycle.
+    if (Timing.Latency)
+      OS << std::max(1, static_cast<int>(std::ceil(*Timing.Latency - 0.05)));
+    OS << "\n";
+  }
+  return Error::success();
+}
+
 template <>
 Error Analysis::run<Analysis::PrintSchedClassInconsistencies>(
     raw_ostream &OS) const {
@@ -45,6 +45,9 @@ public:
   struct PrintClusters {};
   // Find potential errors in the scheduling information given measurements.
   struct PrintSchedClassInconsistencies {};
+  // Prints a csv of the measured and the itinerary latency and throughput of
+  // each opcode, for targets that are modelled by itineraries.
+  struct PrintItineraryLatencies {};
 
   template <typename Pass> Error run(raw_ostream &OS) const;
 
@@ -240,6 +240,8 @@ Error assembleToStream(const ExegesisTarget &ET,
        {"postrapseudos", "machineverifier", "prologepilog"})
     if (addPass(PM, PassName, *TPC))
       return make_error<Failure>("Unable to add a mandatory pass");
+  // Add target-specific passes on the final code.
+  ET.addTargetSpecificPreEmitPasses(PM, *TM);
   TPC->setInitialized();
 
   // AsmPrinter is responsible for generating the assembly into AsmBuffer.
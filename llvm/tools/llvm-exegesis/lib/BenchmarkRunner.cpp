@@ -126,6 +126,10 @@ private:
     return CounterValues;
   }
 
+  StringRef getFunctionBytes() const override {
+    return Function.getFunctionBytes();
+  }
+
   const LLVMState &State;
   const ExecutableFunction Function;
   BenchmarkRunner::ScratchSpace *const Scratch;
@@ -179,9 +183,8 @@ Expected<InstructionBenchmark> BenchmarkRunner::runConfiguration(
               OS)) {
         return std::move(E);
       }
-      const ExecutableFunction EF(State.createTargetMachine(),
-                                  getObjectFromBuffer(OS.str()));
-      const auto FnBytes = EF.getFunctionBytes();
+      const auto EF = createFunctionExecutor(getObjectFromBuffer(OS.str()));
+      const auto FnBytes = EF->getFunctionBytes();
       llvm::append_range(InstrBenchmark.AssembledSnippet, FnBytes);
     }
 
@@ -211,9 +214,8 @@ Expected<InstructionBenchmark> BenchmarkRunner::runConfiguration(
       ObjectFile = getObjectFromBuffer(OS.str());
     }
 
-    const FunctionExecutorImpl Executor(State, std::move(ObjectFile),
-                                        Scratch.get());
-    auto NewMeasurements = runMeasurements(Executor);
+    const auto Executor = createFunctionExecutor(std::move(ObjectFile));
+    auto NewMeasurements = runMeasurements(*Executor);
     if (Error E = NewMeasurements.takeError()) {
       if (!E.isA<SnippetCrash>())
         return std::move(E);
@@ -256,6 +258,17 @@ Expected<InstructionBenchmark> BenchmarkRunner::runConfiguration(
   return InstrBenchmark;
 }
 
+std::unique_ptr<BenchmarkRunner::FunctionExecutor>
+BenchmarkRunner::createFunctionExecutor(
+    object::OwningBinary<object::ObjectFile> Obj) const {
+  // Let the target measure the snippet if it does not run on the host.
+  if (auto Executor = State.getExegesisTarget().createFunctionExecutor(
+          State, std::move(Obj)))
+    return Executor;
+  return std::make_unique<FunctionExecutorImpl>(State, std::move(Obj),
+                                                Scratch.get());
+}
+
 Expected<std::string>
 BenchmarkRunner::writeObjectFile(const BenchmarkCode &BC,
                                  const FillFunction &FillFunction) const {
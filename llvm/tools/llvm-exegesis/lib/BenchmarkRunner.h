@@ -71,6 +71,9 @@ public:
 
     virtual Expected<llvm::SmallVector<int64_t, 4>>
     runAndSample(const char *Counters) const = 0;
+
+    // Retrieves the function as an array of bytes.
+    virtual StringRef getFunctionBytes() const = 0;
   };
 
 protected:
@@ -84,6 +87,9 @@ private:
   Expected<std::string> writeObjectFile(const BenchmarkCode &Configuration,
                                         const FillFunction &Fill) const;
 
+  std::unique_ptr<FunctionExecutor>
+  createFunctionExecutor(object::OwningBinary<object::ObjectFile> Obj) const;
+
   const std::unique_ptr<ScratchSpace> Scratch;
 };
 
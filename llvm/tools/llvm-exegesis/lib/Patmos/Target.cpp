@@ -0,0 +1,473 @@
+//===-- Target.cpp ----------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The Patmos exegesis target. Patmos snippets cannot run on the host, they are
+// measured on the in-process Patmos simulator, or on a board through an
+// external runner program.
+//
+// Patmos does not interlock: the results of loads and multiplications are
+// only visible after their delay slots, and calls return after theirs. The
+// snippets are therefore completed like llc does, the delay slot filler pads
+// them with NOPs where the itineraries require it. A serial chain thus takes
+// the latency of the itineraries plus the stalls of the memories, which is
+// what the itineraries and the cache timing have to be checked against.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../Error.h"
+#include "../Target.h"
+#include "MCTargetDesc/PatmosBaseInfo.h"
+#include "MCTargetDesc/PatmosMCTargetDesc.h"
+#include "Patmos.h"
+#include "PatmosInstrInfo.h"
+#include "PatmosSubtarget.h"
+#include "PatmosTargetMachine.h"
+#include "Simulator/PatmosSimulator.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineInstrBundle.h"
+#include "llvm/MC/MCInstBuilder.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Program.h"
+
+extern "C" void LLVMInitializePatmosTargetInfo();
+extern "C" void LLVMInitializePatmosTarget();
+extern "C" void LLVMInitializePatmosTargetMC();
+extern "C" void LLVMInitializePatmosAsmPrinter();
+extern "C" void LLVMInitializePatmosAsmParser();
+extern "C" void LLVMInitializePatmosDisassembler();
+
+namespace llvm {
+namespace exegesis {
+
+static cl::OptionCategory
+    BenchmarkOptions("llvm-exegesis benchmark patmos-options");
+
+static cl::opt<std::string> Runner(
+    "patmos-exegesis-runner",
+    cl::desc("Measure the snippets with this program instead of the "
+             "simulator, e.g., on a board. It is called with a file holding "
+             "the code of the snippet function, and prints the cycles of a "
+             "call."),
+    cl::cat(BenchmarkOptions), cl::init(""));
+
+static cl::opt<bool> BundleSnippets(
+    "patmos-exegesis-bundle",
+    cl::desc("Bundle independent instructions of the snippets (default: "
+             "true)."),
+    cl::cat(BenchmarkOptions), cl::init(true));
+
+/// The maximal number of cycles a snippet may run on the simulator.
+static const uint64_t MaxSnippetCycles = 1ull << 30;
+
+/// The counters of the simulator.
+static const PfmCountersInfo PatmosSimulatorCounters = {
+    "cycles", // Cycles of the snippet, without filling the method cache.
+    nullptr,  // There are no uops, every instruction issues once.
+    nullptr,
+    0};
+
+static const CpuAndPfmCounters PatmosCpuPfmCounters[] = {
+    {"", &PatmosSimulatorCounters}};
+
+namespace {
+
+/// Complete the snippet before it is verified: the return added by the
+/// assembler has no guard yet.
+class PatmosSnippetFinalizer : public MachineFunctionPass {
+public:
+  static char ID;
+
+  PatmosSnippetFinalizer() : MachineFunctionPass(ID) {}
+
+  StringRef getPassName() const override {
+    return "Patmos Exegesis Snippet Finalizer";
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override {
+    bool Changed = false;
+    for (MachineBasicBlock &MBB : MF) {
+      for (MachineInstr &MI : MBB) {
+        if (MI.getOpcode() == Patmos::RET && !MI.getNumExplicitOperands()) {
+          AddDefaultPred(MachineInstrBuilder(MF, MI));
+          Changed = true;
+        }
+      }
+    }
+    return Changed;
+  }
+};
+
+char PatmosSnippetFinalizer::ID = 0;
+
+/// Bundle pairs of consecutive independent instructions, like the post-RA
+/// scheduler would, so that the throughput of the second slot is measured.
+class PatmosSnippetBundler : public MachineFunctionPass {
+public:
+  static char ID;
+
+  PatmosSnippetBundler() : MachineFunctionPass(ID) {}
+
+  StringRef getPassName() const override {
+    return "Patmos Exegesis Snippet Bundler";
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+private:
+  bool canBundle(const PatmosInstrInfo &PII, const TargetRegisterInfo &TRI,
+                 const MachineInstr &First, const MachineInstr &Second) const;
+};
+
+char PatmosSnippetBundler::ID = 0;
+
+} // end anonymous namespace
+
+bool PatmosSnippetBundler::canBundle(const PatmosInstrInfo &PII,
+                                     const TargetRegisterInfo &TRI,
+                                     const MachineInstr &First,
+                                     const MachineInstr &Second) const {
+  for (const MachineInstr *MI : {&First, &Second}) {
+    if (MI->isBundled() || MI->isTerminator() || MI->isCall() ||
+        MI->isReturn() || MI->isInlineAsm() || PII.isPseudo(MI) ||
+        PII.getIssueWidth(MI) != 1)
+      return false;
+  }
+  if (!PII.canIssueInSlot(&Second, 1))
+    return false;
+
+  // The second instruction must neither read nor write what the first
+  // writes, nor write what it reads.
+  for (const MachineOperand &MO : First.operands()) {
+    if (!MO.isReg() || !MO.getReg())
+      continue;
+    if (MO.isDef() && (Second.readsRegister(MO.getReg(), &TRI) ||
+                       Second.modifiesRegister(MO.getReg(), &TRI)))
+      return false;
+    if (MO.isUse() && Second.modifiesRegister(MO.getReg(), &TRI))
+      return false;
+  }
+  return true;
+}
+
+bool PatmosSnippetBundler::runOnMachineFunction(MachineFunction &MF) {
+  if (!BundleSnippets || !PatmosSubtarget::enableBundling())
+    return false;
+
+  const PatmosInstrInfo &PII =
+      *static_cast<const PatmosInstrInfo *>(MF.getSubtarget().getInstrInfo());
+  const TargetRegisterInfo &TRI = *MF.getSubtarget().getRegisterInfo();
+
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF) {
+    for (auto I = MBB.instr_begin(), E = MBB.instr_end(); I != E; ++I) {
+      auto Next = std::next(I);
+      if (Next == E || !canBundle(PII, TRI, *I, *Next))
+        continue;
+      finalizeBundle(MBB, I, std::next(Next));
+      // skip over the new bundle
+      I = Next;
+      Changed = true;
+    }
+  }
+  return Changed;
+}
+
+namespace {
+
+/// Measure a snippet on the simulator or with the external runner.
+class PatmosFunctionExecutor : public BenchmarkRunner::FunctionExecutor {
+public:
+  PatmosFunctionExecutor(const LLVMState &State,
+                         object::OwningBinary<object::ObjectFile> &&Obj);
+
+  Error init();
+
+private:
+  Expected<int64_t> runAndMeasure(const char *Counters) const override {
+    auto ResultOrError = runAndSample(Counters);
+    if (ResultOrError)
+      return ResultOrError.get()[0];
+    return ResultOrError.takeError();
+  }
+
+  Expected<SmallVector<int64_t, 4>>
+  runAndSample(const char *Counters) const override;
+
+  StringRef getFunctionBytes() const override { return FunctionBytes; }
+
+  Expected<int64_t> simulate(StringRef CounterName) const;
+  Expected<int64_t> runExternal(StringRef CounterName) const;
+
+  const PatmosTargetMachine &TM;
+  object::OwningBinary<object::ObjectFile> Obj;
+  StringRef FunctionBytes;
+};
+
+} // end anonymous namespace
+
+PatmosFunctionExecutor::PatmosFunctionExecutor(
+    const LLVMState &State, object::OwningBinary<object::ObjectFile> &&Obj)
+    : TM(static_cast<const PatmosTargetMachine &>(State.getTargetMachine())),
+      Obj(std::move(Obj)) {}
+
+Error PatmosFunctionExecutor::init() {
+  // The object holds only the snippet function.
+  for (const object::SymbolRef &Sym : Obj.getBinary()->symbols()) {
+    Expected<object::SymbolRef::Type> Type = Sym.getType();
+    if (!Type)
+      return Type.takeError();
+    if (*Type != object::SymbolRef::ST_Function)
+      continue;
+
+    Expected<object::section_iterator> Section = Sym.getSection();
+    if (!Section)
+      return Section.takeError();
+    Expected<StringRef> Contents = (*Section)->getContents();
+    if (!Contents)
+      return Contents.takeError();
+    Expected<uint64_t> Address = Sym.getAddress();
+    if (!Address)
+      return Address.takeError();
+
+    uint64_t Offset = *Address - (*Section)->getAddress();
+    uint64_t Size = object::ELFSymbolRef(Sym).getSize();
+    if (!Size || Offset + Size > Contents->size())
+      Size = Contents->size() - Offset;
+    FunctionBytes = Contents->substr(Offset, Size);
+    return Error::success();
+  }
+  return make_error<Failure>("no function in the assembled snippet");
+}
+
+Expected<SmallVector<int64_t, 4>>
+PatmosFunctionExecutor::runAndSample(const char *Counters) const {
+  // Several counters are summed up, like for a ProcRes measured by several
+  // hardware counters.
+  SmallVector<StringRef, 2> CounterNames;
+  StringRef(Counters).split(CounterNames, '+');
+  int64_t Value = 0;
+  for (StringRef CounterName : CounterNames) {
+    Expected<int64_t> CounterValue = Runner.empty()
+                                         ? simulate(CounterName.trim())
+                                         : runExternal(CounterName.trim());
+    if (!CounterValue)
+      return CounterValue.takeError();
+    Value += *CounterValue;
+  }
+  return SmallVector<int64_t, 4>{Value};
+}
+
+Expected<int64_t>
+PatmosFunctionExecutor::simulate(StringRef CounterName) const {
+  PatmosSimulator Sim(TM, nulls());
+  ArrayRef<uint8_t> Code(FunctionBytes.bytes_begin(), FunctionBytes.size());
+  if (Error E = Sim.loadFunction(Code, {}))
+    return std::move(E);
+  if (Error E = Sim.run(MaxSnippetCycles))
+    return make_error<SnippetCrash>(toString(std::move(E)));
+  if (!Sim.hasHalted())
+    return make_error<SnippetCrash>("snippet did not return");
+
+  const PatmosSimulatorStats &S = Sim.getStats();
+  // A snippet is larger than the method cache, streaming its code is not
+  // part of the cost of its instructions.
+  Optional<uint64_t> Value =
+      StringSwitch<Optional<uint64_t>>(CounterName)
+          .Case("cycles", S.Cycles - S.MethodCacheStalls)
+          .Case("bundles", S.Bundles)
+          .Case("instructions", S.Instructions)
+          .Case("method-cache-stalls", S.MethodCacheStalls)
+          .Case("stack-cache-stalls", S.StackCacheStalls)
+          .Case("data-cache-stalls", S.DataCacheStalls)
+          .Case("memory-stalls", S.MemoryStalls)
+          .Case("branch-stalls", S.BranchStalls)
+          .Default(None);
+  if (!Value)
+    return make_error<Failure>("unknown Patmos simulator counter '" +
+                               CounterName + "'");
+  return *Value;
+}
+
+Expected<int64_t>
+PatmosFunctionExecutor::runExternal(StringRef CounterName) const {
+  if (CounterName != "cycles")
+    return make_error<Failure>("counter '" + CounterName +
+                               "' is only available in the simulator");
+
+  ErrorOr<std::string> Program = sys::findProgramByName(Runner);
+  if (!Program)
+    return make_error<Failure>("cannot find " + Twine(Runner));
+
+  SmallString<128> CodeFile, OutputFile;
+  int CodeFD;
+  if (std::error_code EC =
+          sys::fs::createTemporaryFile("snippet", "bin", CodeFD, CodeFile))
+    return errorCodeToError(EC);
+  FileRemover CodeRemover(CodeFile);
+  {
+    raw_fd_ostream OS(CodeFD, /*shouldClose=*/true);
+    OS << FunctionBytes;
+  }
+  if (std::error_code EC =
+          sys::fs::createTemporaryFile("snippet", "out", OutputFile))
+    return errorCodeToError(EC);
+  FileRemover OutputRemover(OutputFile);
+
+  StringRef Args[] = {*Program, CodeFile};
+  Optional<StringRef> Redirects[] = {None, StringRef(OutputFile), None};
+  std::string ErrMsg;
+  int Result = sys::ExecuteAndWait(*Program, Args, None, Redirects, 0, 0,
+                                   &ErrMsg);
+  if (Result != 0)
+    return make_error<SnippetCrash>(
+        Twine(Runner) + " failed: " +
+        (ErrMsg.empty() ? "exit code " + std::to_string(Result) : ErrMsg));
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Output =
+      MemoryBuffer::getFile(OutputFile);
+  if (!Output)
+    return errorCodeToError(Output.getError());
+  uint64_t Cycles;
+  if ((*Output)->getBuffer().trim().getAsInteger(10, Cycles))
+    return make_error<Failure>(
+        Twine(Runner) + " did not print the cycles of the snippet");
+  return Cycles;
+}
+
+namespace {
+
+class ExegesisPatmosTarget : public ExegesisTarget {
+public:
+  ExegesisPatmosTarget() : ExegesisTarget(PatmosCpuPfmCounters) {}
+
+private:
+  std::vector<MCInst> setRegTo(const MCSubtargetInfo &STI, unsigned Reg,
+                               const APInt &Value) const override;
+
+  void addTargetSpecificPasses(PassManagerBase &PM) const override {
+    PM.add(new PatmosSnippetFinalizer());
+  }
+
+  void addTargetSpecificPreEmitPasses(PassManagerBase &PM,
+                                      LLVMTargetMachine &TM) const override {
+    PM.add(new PatmosSnippetBundler());
+    // Only insert NOPs, keep the snippet out of the delay slots of the return.
+    PM.add(createPatmosDelaySlotFillerPass(
+        static_cast<const PatmosTargetMachine &>(TM), true));
+  }
+
+  std::unique_ptr<BenchmarkRunner::FunctionExecutor> createFunctionExecutor(
+      const LLVMState &State,
+      object::OwningBinary<object::ObjectFile> &&Obj) const override;
+
+  std::vector<InstructionTemplate>
+  generateInstructionVariants(const Instruction &Instr,
+                              unsigned MaxConfigsPerOpcode) const override;
+
+  bool matchesArch(Triple::ArchType Arch) const override {
+    return Arch == Triple::patmos;
+  }
+};
+
+} // end anonymous namespace
+
+std::vector<MCInst> ExegesisPatmosTarget::setRegTo(const MCSubtargetInfo &STI,
+                                                   unsigned Reg,
+                                                   const APInt &Value) const {
+  if (Patmos::RRegsRegClass.contains(Reg)) {
+    uint32_t Imm = Value.getZExtValue();
+    return {MCInstBuilder(isUInt<12>(Imm) ? Patmos::LIi : Patmos::LIl)
+                .addReg(Reg)
+                .addReg(Patmos::NoRegister)
+                .addImm(0)
+                .addImm(Imm)};
+  }
+  if (Patmos::PRegsRegClass.contains(Reg)) {
+    // r0 is equal to itself
+    return {MCInstBuilder(Value.isNullValue() ? Patmos::CMPNEQ : Patmos::CMPEQ)
+                .addReg(Reg)
+                .addReg(Patmos::NoRegister)
+                .addImm(0)
+                .addReg(Patmos::R0)
+                .addReg(Patmos::R0)};
+  }
+  // The special registers, e.g., the stack pointers of the stack cache, are
+  // set up by the caller of the snippet.
+  return {};
+}
+
+std::vector<InstructionTemplate>
+ExegesisPatmosTarget::generateInstructionVariants(
+    const Instruction &Instr, unsigned MaxConfigsPerOpcode) const {
+  InstructionTemplate IT(&Instr);
+  const MCInstrDesc &Desc = Instr.Description;
+
+  // Execute the instruction unconditionally, unless its guard can be one of
+  // the predicates it defines, which serializes compares. Disabled
+  // instructions take the same time, but do not access the memory.
+  int GuardIdx = Desc.findFirstPredOperandIdx();
+  bool DefinesPredicate = any_of(Instr.Operands, [](const Operand &Op) {
+    return Op.isReg() && Op.isDef() && Op.isExplicit() &&
+           Op.getExplicitOperandInfo().RegClass == Patmos::PRegsRegClassID;
+  });
+  if (GuardIdx >= 0 && !DefinesPredicate) {
+    IT.getValueFor(Instr.Operands[GuardIdx]) =
+        MCOperand::createReg(Patmos::NoRegister);
+    IT.getValueFor(Instr.Operands[GuardIdx + 1]) = MCOperand::createImm(0);
+  }
+
+  // Measure reserving, ensuring and freeing a word, a typical frame and a
+  // large frame of the stack cache.
+  if (getPatmosFormat(Desc.TSFlags) == PatmosII::FrmSTCi) {
+    std::vector<InstructionTemplate> Variants;
+    const Operand &Imm = Instr.Operands[getPatmosImmediateOpNo(Desc.TSFlags)];
+    for (int64_t Words : {1, 16, 256}) {
+      if (Variants.size() >= MaxConfigsPerOpcode)
+        break;
+      IT.getValueFor(Imm) = MCOperand::createImm(Words);
+      Variants.push_back(IT);
+    }
+    return Variants;
+  }
+  return {IT};
+}
+
+std::unique_ptr<BenchmarkRunner::FunctionExecutor>
+ExegesisPatmosTarget::createFunctionExecutor(
+    const LLVMState &State,
+    object::OwningBinary<object::ObjectFile> &&Obj) const {
+  auto Executor = std::make_unique<PatmosFunctionExecutor>(State,
+                                                           std::move(Obj));
+  if (Error E = Executor->init())
+    report_fatal_error(toString(std::move(E)));
+  return std::move(Executor);
+}
+
+static ExegesisTarget *getTheExegesisPatmosTarget() {
+  static ExegesisPatmosTarget Target;
+  return &Target;
+}
+
+void InitializePatmosExegesisTarget() {
+  LLVMInitializePatmosTargetInfo();
+  LLVMInitializePatmosTarget();
+  LLVMInitializePatmosTargetMC();
+  LLVMInitializePatmosAsmPrinter();
+  LLVMInitializePatmosAsmParser();
+  LLVMInitializePatmosDisassembler();
+  ExegesisTarget::registerTarget(getTheExegesisPatmosTarget());
+}
+
+} // namespace exegesis
+} // namespace llvm
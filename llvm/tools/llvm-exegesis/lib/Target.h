@@ -74,6 +74,21 @@ public:
   // Targets can use this to add target-specific passes in assembleToStream();
   virtual void addTargetSpecificPasses(PassManagerBase &PM) const {}
 
+  // Targets can use this to add passes that run after the prologue and
+  // epilogue are inserted in assembleToStream(), e.g., to fill delay slots.
+  virtual void addTargetSpecificPreEmitPasses(PassManagerBase &PM,
+                                              LLVMTargetMachine &TM) const {}
+
+  // Targets that do not run the snippets on the host, e.g., because they
+  // measure them on a simulator, return an executor for the assembled
+  // snippet here, taking Obj. Returns nullptr and leaves Obj alone to execute
+  // the snippet natively.
+  virtual std::unique_ptr<BenchmarkRunner::FunctionExecutor>
+  createFunctionExecutor(const LLVMState &State,
+                         object::OwningBinary<object::ObjectFile> &&Obj) const {
+    return nullptr;
+  }
+
   // Generates code to move a constant into a the given register.
   // Precondition: Value must fit into Reg.
   virtual std::vector<MCInst> setRegTo(const MCSubtargetInfo &STI, unsigned Reg,
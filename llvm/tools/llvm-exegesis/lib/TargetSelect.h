@@ -34,6 +34,18 @@ inline bool InitializeNativeExegesisTarget() {
 #endif
 }
 
+#ifdef LLVM_EXEGESIS_HAVE_PATMOS
+void InitializePatmosExegesisTarget();
+#endif
+
+// Initializes the exegesis targets whose snippets do not run on the host, but
+// on a simulator or an external board.
+inline void InitializeCrossExegesisTargets() {
+#ifdef LLVM_EXEGESIS_HAVE_PATMOS
+  InitializePatmosExegesisTarget();
+#endif
+}
+
 } // namespace exegesis
 } // namespace llvm
 
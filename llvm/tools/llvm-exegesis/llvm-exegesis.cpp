@@ -38,6 +38,7 @@
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include <algorithm>
+#include <memory>
 #include <string>
 
 namespace llvm {
@@ -160,6 +161,12 @@ static cl::opt<std::string>
                                       cl::desc(""), cl::cat(AnalysisOptions),
                                       cl::init(""));
 
+static cl::opt<std::string> AnalysisItinerariesOutputFile(
+    "analysis-itineraries-output-file",
+    cl::desc("prints the measured and the itinerary latencies of each opcode, "
+             "for targets modelled by itineraries"),
+    cl::cat(AnalysisOptions), cl::init(""));
+
 static cl::opt<bool> AnalysisDisplayUnstableOpcodes(
     "analysis-display-unstable-clusters",
     cl::desc("if there is more than one benchmark for an opcode, said "
@@ -174,6 +181,13 @@ static cl::opt<std::string> CpuName(
     cl::desc("cpu name to use for pfm counters, leave empty to autodetect"),
     cl::cat(Options), cl::init(""));
 
+static cl::opt<std::string>
+    TripleName("mtriple",
+               cl::desc("target triple, for targets whose snippets are "
+                        "measured on a simulator or a board instead of the "
+                        "host, leave empty to use the host"),
+               cl::cat(Options), cl::init(""));
+
 static cl::opt<bool>
     DumpObjectToDisk("dump-object-to-disk",
                      cl::desc("dumps the generated benchmark object to disk "
@@ -281,20 +295,33 @@ generateSnippets(const LLVMState &State, unsigned Opcode,
   return Benchmarks;
 }
 
+// Creates the state of the host, or of the target of -mtriple.
+static std::unique_ptr<LLVMState> createState() {
+  if (TripleName.empty())
+    return std::make_unique<LLVMState>(CpuName);
+  return std::make_unique<LLVMState>(TripleName, CpuName);
+}
+
 void benchmarkMain() {
+  // Cross targets measure their snippets themselves.
+  if (TripleName.empty()) {
 #ifndef HAVE_LIBPFM
-  ExitWithError("benchmarking unavailable, LLVM was built without libpfm.");
+    ExitWithError("benchmarking unavailable, LLVM was built without libpfm.");
 #endif
 
-  if (exegesis::pfm::pfmInitialize())
-    ExitWithError("cannot initialize libpfm");
+    if (exegesis::pfm::pfmInitialize())
+      ExitWithError("cannot initialize libpfm");
 
-  InitializeNativeTarget();
-  InitializeNativeTargetAsmPrinter();
-  InitializeNativeTargetAsmParser();
-  InitializeNativeExegesisTarget();
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+    InitializeNativeExegesisTarget();
+  } else {
+    InitializeCrossExegesisTargets();
+  }
 
-  const LLVMState State(CpuName);
+  const std::unique_ptr<LLVMState> StatePtr = createState();
+  const LLVMState &State = *StatePtr;
 
   // Preliminary check to ensure features needed for requested
   // benchmark mode are present on target CPU and/or OS.
@@ -366,7 +393,8 @@ void benchmarkMain() {
         Conf, NumRepetitions, Repetitors, DumpObjectToDisk));
     ExitOnFileError(BenchmarkFile, Result.writeYaml(State, BenchmarkFile));
   }
-  exegesis::pfm::pfmTerminate();
+  if (TripleName.empty())
+    exegesis::pfm::pfmTerminate();
 }
 
 // Prints the results of running analysis pass `Pass` to file `OutputFilename`
@@ -395,18 +423,25 @@ static void analysisMain() {
     ExitWithError("--benchmarks-file must be set");
 
   if (AnalysisClustersOutputFile.empty() &&
-      AnalysisInconsistenciesOutputFile.empty()) {
+      AnalysisInconsistenciesOutputFile.empty() &&
+      AnalysisItinerariesOutputFile.empty()) {
     ExitWithError(
-        "for --mode=analysis: At least one of --analysis-clusters-output-file "
-        "and --analysis-inconsistencies-output-file must be specified");
+        "for --mode=analysis: At least one of --analysis-clusters-output-file, "
+        "--analysis-inconsistencies-output-file and "
+        "--analysis-itineraries-output-file must be specified");
   }
 
-  InitializeNativeTarget();
-  InitializeNativeTargetAsmPrinter();
-  InitializeNativeTargetDisassembler();
+  if (TripleName.empty()) {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetDisassembler();
+  } else {
+    InitializeCrossExegesisTargets();
+  }
 
   // Read benchmarks.
-  const LLVMState State("");
+  const std::unique_ptr<LLVMState> StatePtr = createState();
+  const LLVMState &State = *StatePtr;
   const std::vector<InstructionBenchmark> Points = ExitOnFileError(
       BenchmarkFile, InstructionBenchmark::readYamls(State, BenchmarkFile));
 
@@ -442,6 +477,8 @@ static void analysisMain() {
   maybeRunAnalysis<Analysis::PrintSchedClassInconsistencies>(
       Analyzer, "sched class consistency analysis",
       AnalysisInconsistenciesOutputFile);
+  maybeRunAnalysis<Analysis::PrintItineraryLatencies>(
+      Analyzer, "itinerary latency analysis", AnalysisItinerariesOutputFile);
 }
 
 } // namespace exegesis
@@ -23,6 +23,7 @@
 #include "llvm/IR/ModuleSummaryIndex.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/LazyArchiveLinker.h"
 #include "llvm/Linker/Linker.h"
 #include "llvm/Object/Archive.h"
 #include "llvm/Support/CommandLine.h"
@@ -31,6 +32,7 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/SystemUtils.h"
+#include "llvm/Support/TimeProfiler.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/WithColor.h"
 #include "llvm/Transforms/IPO/FunctionImport.h"
@@ -80,6 +82,17 @@ static cl::opt<bool>
 static cl::opt<bool>
 OnlyNeeded("only-needed", cl::desc("Link only needed symbols"));
 
+static cl::opt<bool>
+LazyArchives("lazy-archives",
+             cl::desc("Link only the archive members defining a needed "
+                      "symbol, after all other files"));
+
+static cl::list<std::string>
+LazyArchiveRoots("lazy-archive-roots", cl::CommaSeparated,
+                 cl::value_desc("symbol list"),
+                 cl::desc("Symbols to link from archives with -lazy-archives, "
+                          "even if they are not referenced"));
+
 static cl::opt<bool>
 Force("f", cl::desc("Enable binary output on terminals"));
 
@@ -110,8 +123,40 @@ static cl::opt<bool> PreserveAssemblyUseListOrder(
     cl::desc("Preserve use-list order when writing LLVM assembly."),
     cl::init(false), cl::Hidden);
 
+static cl::opt<bool> TimeTrace(
+    "time-trace",
+    cl::desc("Record time trace"));
+
+static cl::opt<unsigned> TimeTraceGranularity(
+    "time-trace-granularity",
+    cl::desc("Minimum time granularity (in microseconds) traced by time profiler"),
+    cl::init(500), cl::Hidden);
+
+static cl::opt<std::string>
+    TimeTraceFile("time-trace-file",
+                    cl::desc("Specify time trace file destination"),
+                    cl::value_desc("filename"));
+
 static ExitOnError ExitOnErr;
 
+struct TimeTracerRAII {
+  TimeTracerRAII(StringRef ProgramName) {
+    if (TimeTrace)
+      timeTraceProfilerInitialize(TimeTraceGranularity, ProgramName);
+  }
+  ~TimeTracerRAII() {
+    if (TimeTrace) {
+      if (auto E = timeTraceProfilerWrite(TimeTraceFile, OutputFilename)) {
+        handleAllErrors(std::move(E), [&](const StringError &SE) {
+          errs() << SE.getMessage() << "\n";
+        });
+        return;
+      }
+      timeTraceProfilerCleanup();
+    }
+  }
+};
+
 // Read the specified bitcode file in and return it. This routine searches the
 // link path for the specified file to try to find it...
 //
@@ -346,21 +391,40 @@ static bool importFunctions(const char *argv0, Module &DestModule) {
   return true;
 }
 
+static void internalizeLinkedSymbols(Module &M, const StringSet<> &GVS) {
+  internalizeModule(M, [&GVS](const GlobalValue &GV) {
+    return !GV.hasName() || (GVS.count(GV.getName()) == 0);
+  });
+}
+
 static bool linkFiles(const char *argv0, LLVMContext &Context, Linker &L,
                       const cl::list<std::string> &Files,
-                      unsigned Flags) {
+                      unsigned Flags, LazyArchiveLinker *Lazy) {
   // Filter out flags that don't apply to the first file we load.
   unsigned ApplicableFlags = Flags & Linker::Flags::OverrideFromSrc;
   // Similar to some flags, internalization doesn't apply to the first file.
   bool InternalizeLinkedSymbols = false;
   for (const auto &File : Files) {
+    TimeTraceScope TimeScope("LinkFile", File);
     std::unique_ptr<MemoryBuffer> Buffer =
         ExitOnErr(errorOrToExpected(MemoryBuffer::getFileOrSTDIN(File)));
 
+    bool IsArchive = identify_magic(Buffer->getBuffer()) == file_magic::archive;
+    if (IsArchive && Lazy) {
+      // The needed members are linked after all files.
+      LazyArchiveLinker::InternalizeCallbackTy InternalizeCallback;
+      if (InternalizeLinkedSymbols)
+        InternalizeCallback = internalizeLinkedSymbols;
+      ExitOnErr(Lazy->addArchive(std::move(Buffer), ApplicableFlags,
+                                 std::move(InternalizeCallback)));
+      InternalizeLinkedSymbols = Internalize;
+      ApplicableFlags = Flags;
+      continue;
+    }
+
     std::unique_ptr<Module> M =
-        identify_magic(Buffer->getBuffer()) == file_magic::archive
-            ? loadArFile(argv0, std::move(Buffer), Context)
-            : loadFile(argv0, std::move(Buffer), Context);
+        IsArchive ? loadArFile(argv0, std::move(Buffer), Context)
+                  : loadFile(argv0, std::move(Buffer), Context);
     if (!M.get()) {
       errs() << argv0 << ": ";
       WithColor::error() << " loading file '" << File << "'\n";
@@ -403,12 +467,8 @@ static bool linkFiles(const char *argv0, LLVMContext &Context, Linker &L,
 
     bool Err = false;
     if (InternalizeLinkedSymbols) {
-      Err = L.linkInModule(
-          std::move(M), ApplicableFlags, [](Module &M, const StringSet<> &GVS) {
-            internalizeModule(M, [&GVS](const GlobalValue &GV) {
-              return !GV.hasName() || (GVS.count(GV.getName()) == 0);
-            });
-          });
+      Err = L.linkInModule(std::move(M), ApplicableFlags,
+                           internalizeLinkedSymbols);
     } else {
       Err = L.linkInModule(std::move(M), ApplicableFlags);
     }
@@ -435,6 +495,8 @@ int main(int argc, char **argv) {
     std::make_unique<LLVMLinkDiagnosticHandler>(), true);
   cl::ParseCommandLineOptions(argc, argv, "llvm linker\n");
 
+  TimeTracerRAII TimeTracer(argv[0]);
+
   if (!DisableDITypeMap)
     Context.enableDebugTypeODRUniquing();
 
@@ -445,15 +507,28 @@ int main(int argc, char **argv) {
   if (OnlyNeeded)
     Flags |= Linker::Flags::LinkOnlyNeeded;
 
+  std::unique_ptr<LazyArchiveLinker> Lazy;
+  if (LazyArchives) {
+    Lazy = std::make_unique<LazyArchiveLinker>(L, *Composite, Verbose);
+    for (const std::string &Root : LazyArchiveRoots)
+      Lazy->addRoot(Root);
+  }
+
   // First add all the regular input files
-  if (!linkFiles(argv[0], Context, L, InputFilenames, Flags))
+  if (!linkFiles(argv[0], Context, L, InputFilenames, Flags, Lazy.get()))
     return 1;
 
   // Next the -override ones.
   if (!linkFiles(argv[0], Context, L, OverridingInputs,
-                 Flags | Linker::Flags::OverrideFromSrc))
+                 Flags | Linker::Flags::OverrideFromSrc, Lazy.get()))
     return 1;
 
+  // Then the needed members of the archives.
+  if (Lazy) {
+    TimeTraceScope TimeScope("LinkArchiveMembers");
+    ExitOnErr(Lazy->link());
+  }
+
   // Import any functions requested via -import
   if (!importFunctions(argv[0], *Composite))
     return 1;
@@ -477,6 +552,7 @@ int main(int argc, char **argv) {
 
   if (Verbose)
     errs() << "Writing bitcode...\n";
+  TimeTraceScope TimeScope("WriteOutput", OutputFilename);
   if (OutputAssembly) {
     Composite->print(Out.os(), nullptr, PreserveAssemblyUseListOrder);
   } else if (Force || !CheckBitcodeOutputToConsole(Out.os()))
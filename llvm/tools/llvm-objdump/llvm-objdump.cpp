@@ -1536,6 +1536,28 @@ static uint64_t dumpARMELFData(uint64_t SectionAddr, uint64_t Index,
   return 1;
 }
 
+/// Patmos functions and subfunctions are preceded by a word holding the size
+/// of their first method cache block. Print it as data instead of decoding it.
+static bool isPatmosSizeWord(const SectionSymbolsTy &Symbols, size_t SI,
+                             uint64_t SectionAddr, uint64_t Index,
+                             uint64_t End) {
+  if (Index + 4 != End || SI + 1 >= Symbols.size())
+    return false;
+  const SymbolInfoTy &Next = Symbols[SI + 1];
+  return Next.Type == ELF::STT_FUNC && Next.Addr == SectionAddr + End;
+}
+
+static uint64_t dumpPatmosSizeWord(uint64_t SectionAddr, uint64_t Index,
+                                   ArrayRef<uint8_t> Bytes, StringRef NextSym,
+                                   raw_ostream &OS) {
+  uint32_t Size = support::endian::read32be(Bytes.data() + Index);
+  OS << format("%8" PRIx64 ":\t", SectionAddr + Index);
+  dumpBytes(Bytes.slice(Index, 4), OS);
+  OS << "\t.word\t" << format_hex(Size, 10) << "\t# method cache block <"
+     << NextSym << ">: " << Size << " bytes";
+  return 4;
+}
+
 static void dumpELFData(uint64_t SectionAddr, uint64_t Index, uint64_t End,
                         ArrayRef<uint8_t> Bytes) {
   // print out data up to 8 bytes at a time in hex and ascii
@@ -1939,6 +1961,7 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
                              Symbols[SI].Type != ELF::STT_OBJECT &&
                              !DisassembleAll;
       bool DumpARMELFData = false;
+      bool IsPatmos = Obj->isELF() && STI->getTargetTriple().isPatmos();
       formatted_raw_ostream FOS(outs());
 
       std::unordered_map<uint64_t, std::string> AllLabels;
@@ -1968,6 +1991,10 @@ static void disassembleObject(const Target *TheTarget, const ObjectFile *Obj,
         if (DumpARMELFData) {
           Size = dumpARMELFData(SectionAddr, Index, End, Obj, Bytes,
                                 MappingSymbols, FOS);
+        } else if (IsPatmos &&
+                   isPatmosSizeWord(Symbols, SI, SectionAddr, Index, End)) {
+          Size = dumpPatmosSizeWord(SectionAddr, Index, Bytes,
+                                    Symbols[SI + 1].Name, FOS);
         } else {
           // When -z or --disassemble-zeroes are given we always dissasemble
           // them. Otherwise we might want to skip zero bytes we see.
@@ -61,9 +61,12 @@
 #include <cstdint>
 #include <cstdlib>
 #include <iterator>
+#include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <system_error>
+#include <tuple>
 #include <vector>
 
 using namespace llvm;
@@ -328,6 +331,7 @@ protected:
   void printAttributes();
   void printMipsReginfo();
   void printMipsOptions();
+  void printPatmosSubfunctions();
 
   std::pair<const Elf_Phdr *, const Elf_Shdr *> findDynamic();
   void loadDynamicTable();
@@ -2475,11 +2479,302 @@ template <class ELFT> void ELFDumper<ELFT>::printArchSpecificInfo() {
       printMipsPLT(Parser);
     break;
   }
+  case EM_PATMOS:
+    printPatmosSubfunctions();
+    break;
   default:
     break;
   }
 }
 
+namespace {
+/// A Patmos subfunction, the unit of code loaded into the method cache. It
+/// starts at a function symbol and is preceded by a word holding its size.
+struct PatmosSubfunction {
+  uint64_t Section;
+  uint64_t Address;
+  uint64_t Size;
+  StringRef Name;
+  StringRef Function;
+};
+
+/// Control-flow transfers from one subfunction to the start of another,
+/// which may load the target into the method cache.
+struct PatmosTransfer {
+  const PatmosSubfunction *From = nullptr;
+  const PatmosSubfunction *To = nullptr;
+  bool IsCall = false;
+  unsigned Sites = 0;
+
+  /// The bytes loaded into the method cache in the worst case, a call also
+  /// reloads the caller on return.
+  uint64_t getBytes() const { return To->Size + (IsCall ? From->Size : 0); }
+};
+} // namespace
+
+template <class ELFT> void ELFDumper<ELFT>::printPatmosSubfunctions() {
+  // The addresses of linked files are unique, the sections are only told
+  // apart in relocatable files.
+  bool IsRelocatable = ObjF.isRelocatableObject();
+  DenseMap<uint64_t, SectionRef> TextSections;
+  for (const SectionRef &Sec : ObjF.sections())
+    if (Sec.isText())
+      TextSections[Sec.getIndex()] = Sec;
+
+  // All function symbols in code sections start a subfunction, those of
+  // whole functions also cover the following subfunctions.
+  struct FunctionSymbol {
+    uint64_t Section;
+    uint64_t Address;
+    uint64_t Size;
+    StringRef Name;
+  };
+  std::vector<FunctionSymbol> Symbols;
+  for (const ELFSymbolRef &Sym : ObjF.symbols()) {
+    if (Sym.getELFType() != STT_FUNC)
+      continue;
+    Expected<section_iterator> SecOrErr = Sym.getSection();
+    Expected<uint64_t> AddrOrErr = Sym.getAddress();
+    Expected<StringRef> NameOrErr = Sym.getName();
+    if (!SecOrErr || !AddrOrErr || !NameOrErr) {
+      reportUniqueWarning("unable to read a Patmos function symbol");
+      consumeError(SecOrErr.takeError());
+      consumeError(AddrOrErr.takeError());
+      consumeError(NameOrErr.takeError());
+      continue;
+    }
+    if (*SecOrErr == ObjF.section_end() || !(*SecOrErr)->isText())
+      continue;
+    Symbols.push_back({(*SecOrErr)->getIndex(), *AddrOrErr, Sym.getSize(),
+                       *NameOrErr});
+  }
+  llvm::stable_sort(Symbols, [](const FunctionSymbol &A,
+                                const FunctionSymbol &B) {
+    return std::make_pair(A.Section, A.Address) <
+           std::make_pair(B.Section, B.Address);
+  });
+
+  // Block labels of subfunctions are local, prefer the names of functions.
+  auto IsBlockLabel = [](StringRef Name) { return Name.startswith(".L"); };
+
+  std::vector<PatmosSubfunction> Subfunctions;
+  for (const FunctionSymbol &Sym : Symbols) {
+    if (!Subfunctions.empty() &&
+        Subfunctions.back().Section == (IsRelocatable ? Sym.Section : 0) &&
+        Subfunctions.back().Address == Sym.Address) {
+      if (IsBlockLabel(Subfunctions.back().Name) && !IsBlockLabel(Sym.Name))
+        Subfunctions.back().Name = Sym.Name;
+      continue;
+    }
+
+    // the size word of the subfunction precedes it
+    const SectionRef &Sec = TextSections[Sym.Section];
+    Expected<StringRef> ContentsOrErr = Sec.getContents();
+    if (!ContentsOrErr) {
+      reportUniqueWarning(ContentsOrErr.takeError());
+      continue;
+    }
+    uint64_t Offset = Sym.Address - Sec.getAddress();
+    if (Offset < 4 || Offset > ContentsOrErr->size()) {
+      reportUniqueWarning("Patmos subfunction '" + Sym.Name +
+                          "' is not preceded by a size word");
+      continue;
+    }
+    uint64_t Size = support::endian::read32<ELFT::TargetEndianness>(
+        ContentsOrErr->data() + Offset - 4);
+
+    Subfunctions.push_back({IsRelocatable ? Sym.Section : 0, Sym.Address,
+                            Size, Sym.Name, Sym.Name});
+  }
+
+  // The function of a subfunction is the largest function symbol covering it.
+  for (PatmosSubfunction &SF : Subfunctions) {
+    uint64_t Largest = 0;
+    for (const FunctionSymbol &Sym : Symbols) {
+      if ((IsRelocatable ? Sym.Section : 0) == SF.Section &&
+          Sym.Address <= SF.Address && SF.Address < Sym.Address + Sym.Size &&
+          Sym.Size > Largest) {
+        Largest = Sym.Size;
+        SF.Function = Sym.Name;
+      }
+    }
+  }
+
+  auto FindSubfunction = [&](uint64_t Section,
+                             uint64_t Address) -> const PatmosSubfunction * {
+    auto I = llvm::upper_bound(
+        Subfunctions, std::make_pair(Section, Address),
+        [](const std::pair<uint64_t, uint64_t> &Key,
+           const PatmosSubfunction &SF) {
+          return Key < std::make_pair(SF.Section, SF.Address);
+        });
+    if (I == Subfunctions.begin())
+      return nullptr;
+    --I;
+    if (I->Section != Section || Address >= I->Address + I->Size)
+      return nullptr;
+    return &*I;
+  };
+
+  std::map<std::pair<const PatmosSubfunction *, const PatmosSubfunction *>,
+           PatmosTransfer>
+      Transfers;
+  auto AddTransfer = [&](const PatmosSubfunction *From,
+                         const PatmosSubfunction *To, uint64_t Target) {
+    if (!From || !To || From == To || To->Address != Target)
+      return;
+    PatmosTransfer &T = Transfers[std::make_pair(From, To)];
+    T.From = From;
+    T.To = To;
+    T.IsCall = From->Function != To->Function;
+    T.Sites++;
+  };
+
+  // Calls and branches to other subfunctions in relocatable files, or linked
+  // with --emit-relocs.
+  for (const SectionRef &RelSec : ObjF.sections()) {
+    Expected<section_iterator> TargetOrErr = RelSec.getRelocatedSection();
+    if (!TargetOrErr) {
+      reportUniqueWarning(TargetOrErr.takeError());
+      continue;
+    }
+    if (*TargetOrErr == ObjF.section_end() || !(*TargetOrErr)->isText())
+      continue;
+
+    uint64_t Section = IsRelocatable ? (*TargetOrErr)->getIndex() : 0;
+    for (const RelocationRef &R : RelSec.relocations()) {
+      if (R.getType() != R_PATMOS_CFLI_ABS &&
+          R.getType() != R_PATMOS_CFLI_PCREL)
+        continue;
+
+      symbol_iterator Sym = R.getSymbol();
+      if (Sym == ObjF.symbol_end())
+        continue;
+      Expected<uint64_t> AddrOrErr = Sym->getAddress();
+      Expected<section_iterator> SecOrErr = Sym->getSection();
+      if (!AddrOrErr || !SecOrErr || *SecOrErr == ObjF.section_end()) {
+        consumeError(AddrOrErr.takeError());
+        consumeError(SecOrErr.takeError());
+        continue;
+      }
+      Expected<int64_t> AddendOrErr = ELFRelocationRef(R).getAddend();
+      int64_t Addend = AddendOrErr ? *AddendOrErr : 0;
+      if (!AddendOrErr)
+        consumeError(AddendOrErr.takeError());
+
+      uint64_t Source = R.getOffset() +
+                        (IsRelocatable ? (*TargetOrErr)->getAddress() : 0);
+      uint64_t Target = *AddrOrErr + Addend;
+      AddTransfer(FindSubfunction(Section, Source),
+                  FindSubfunction(IsRelocatable ? (*SecOrErr)->getIndex() : 0,
+                                  Target),
+                  Target);
+    }
+  }
+
+  // The call sites of linked files are also found in the stack cache
+  // summaries (see PatmosTargetStreamer.h): records of 4-byte words starting
+  // with their kind, calls hold the caller, the callee, the ensure after the
+  // call, and the bytes it fills.
+  const Elf_Shdr *SCSec =
+      IsRelocatable ? nullptr : findSectionByName(".patmos.stackcache");
+  if (SCSec) {
+    Expected<ArrayRef<uint8_t>> ContentsOrErr = Obj.getSectionContents(*SCSec);
+    if (!ContentsOrErr) {
+      reportUniqueWarning("unable to read the content of the "
+                          ".patmos.stackcache section (" + describe(*SCSec) +
+                          "): " + toString(ContentsOrErr.takeError()));
+    } else {
+      DataExtractor Data(*ContentsOrErr,
+                         ELFT::TargetEndianness == support::little, 4);
+      DataExtractor::Cursor C(0);
+      std::set<std::tuple<uint64_t, uint64_t, uint64_t>> Calls;
+      while (C && !Data.eof(C)) {
+        uint32_t Kind = Data.getU32(C);
+        if (Kind == 1) {
+          // PSC_FRAME
+          Data.skip(C, 4);
+        } else if (Kind == 2) {
+          // PSC_CALL
+          uint64_t Caller = Data.getU32(C);
+          uint64_t Callee = Data.getU32(C);
+          uint64_t Ensure = Data.getU32(C);
+          Data.skip(C, 4);
+          if (C && Callee && Calls.insert({Caller, Callee, Ensure}).second)
+            AddTransfer(FindSubfunction(0, Ensure ? Ensure : Caller),
+                        FindSubfunction(0, Callee), Callee);
+        } else if (Kind == 3) {
+          // PSC_DISPLACEMENT
+          Data.skip(C, 12);
+        } else {
+          reportUniqueWarning("unknown record kind " + Twine(Kind) +
+                              " in the .patmos.stackcache section");
+          break;
+        }
+      }
+      if (!C)
+        reportUniqueWarning(C.takeError());
+    }
+  }
+
+  unsigned CacheSize = opts::PatmosMethodCacheSize;
+  DictScope D(W, "Patmos Subfunctions");
+  W.printNumber("MethodCacheSize", CacheSize);
+  W.printNumber("Count", (uint64_t)Subfunctions.size());
+
+  {
+    ListScope L(W, "Subfunctions");
+    for (const PatmosSubfunction &SF : Subfunctions) {
+      DictScope S(W, "Subfunction");
+      W.printString("Name", SF.Name);
+      W.printString("Function", SF.Function);
+      W.printHex("Address", SF.Address);
+      W.printNumber("Size", SF.Size);
+      W.printBoolean("FitsMethodCache", SF.Size <= CacheSize);
+    }
+  }
+
+  // Sizes in eighths, quarters, and halves of the method cache, the rest
+  // overflows it.
+  {
+    const unsigned Fractions[] = {8, 4, 2, 1};
+    unsigned Counts[5] = {0, 0, 0, 0, 0};
+    for (const PatmosSubfunction &SF : Subfunctions) {
+      unsigned Bucket = 0;
+      while (Bucket < 4 && SF.Size > CacheSize / Fractions[Bucket])
+        Bucket++;
+      Counts[Bucket]++;
+    }
+
+    DictScope H(W, "Histogram");
+    for (unsigned i = 0; i < 4; i++)
+      W.printNumber("UpTo" + std::to_string(CacheSize / Fractions[i]),
+                    Counts[i]);
+    W.printNumber("Overflowing", Counts[4]);
+  }
+
+  std::vector<PatmosTransfer> Edges;
+  for (const auto &T : Transfers)
+    Edges.push_back(T.second);
+  llvm::stable_sort(Edges, [](const PatmosTransfer &A,
+                              const PatmosTransfer &B) {
+    return std::make_tuple(A.getBytes(), A.Sites) >
+           std::make_tuple(B.getBytes(), B.Sites);
+  });
+  if (Edges.size() > opts::PatmosTransferEdges)
+    Edges.resize(opts::PatmosTransferEdges);
+
+  ListScope L(W, "TransferEdges");
+  for (const PatmosTransfer &T : Edges) {
+    DictScope S(W, "Transfer");
+    W.printString("From", T.From->Name);
+    W.printString("To", T.To->Name);
+    W.printString("Kind", T.IsCall ? "call" : "branch");
+    W.printNumber("Sites", T.Sites);
+    W.printNumber("Bytes", T.getBytes());
+  }
+}
+
 template <class ELFT> void ELFDumper<ELFT>::printAttributes() {
   if (!Obj.isLE()) {
     W.startLine() << "Attributes not implemented.\n";
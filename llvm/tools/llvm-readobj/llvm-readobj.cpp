@@ -254,6 +254,18 @@ namespace opts {
   cl::alias ArchSpecifcInfoShort("A", cl::desc("Alias for --arch-specific"),
                                  cl::aliasopt(ArchSpecificInfo), cl::NotHidden);
 
+  // --patmos-method-cache-size
+  cl::opt<unsigned> PatmosMethodCacheSize(
+      "patmos-method-cache-size", cl::init(4096),
+      cl::desc("Method cache size in bytes the Patmos subfunctions are "
+               "compared to by --arch-specific (default: 4096)"));
+
+  // --patmos-transfer-edges
+  cl::opt<unsigned> PatmosTransferEdges(
+      "patmos-transfer-edges", cl::init(10),
+      cl::desc("Number of the largest transfers between Patmos subfunctions "
+               "shown by --arch-specific (default: 10)"));
+
   // --coff-imports
   cl::opt<bool>
   COFFImports("coff-imports", cl::desc("Display the PE/COFF import table"));
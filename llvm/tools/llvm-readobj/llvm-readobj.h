@@ -39,6 +39,8 @@ namespace opts {
   extern llvm::cl::opt<bool> RawRelr;
   extern llvm::cl::opt<bool> CodeViewSubsectionBytes;
   extern llvm::cl::opt<bool> Demangle;
+  extern llvm::cl::opt<unsigned> PatmosMethodCacheSize;
+  extern llvm::cl::opt<unsigned> PatmosTransferEdges;
   enum OutputStyleTy { LLVM, GNU };
   extern llvm::cl::opt<OutputStyleTy> Output;
 } // namespace opts
@@ -0,0 +1,348 @@
+//===-- patmos-autotune.cpp - Tune backend parameters per function --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Explores parameters of the Patmos backend, e.g., of the function splitter
+// and the scheduler, on the simulator, and writes the best setting of each
+// function into a tuning database for -mpatmos-tuning-db.
+//
+// The build command given after '--' compiles and links the program, every
+// '{db}' in its arguments is replaced by the tuning database of the setting
+// to explore. The program is then run with 'pasim --debug=0
+// --debug-fmt=trace', and the cost of each function is the number of trace
+// lines within its code. With -in-process, the program is run on the
+// simulator of the Patmos backend instead, and the cost of each function is
+// the number of cycles spent in its code, including the cache stalls.
+//
+// The parameters are explored one at a time: each value given with -param
+// is used for all functions, while the other parameters keep their defaults.
+// Every function then keeps, for each parameter, the value with which it had
+// the lowest cost, if that is lower than with the defaults.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosTargetMachine.h"
+#include "Simulator/PatmosSimulator.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string> DatabaseFilename("db",
+    cl::desc("The tuning database to write"), cl::value_desc("filename"),
+    cl::Required);
+
+static cl::opt<std::string> BinaryFilename("binary",
+    cl::desc("The program written by the build command"),
+    cl::value_desc("filename"), cl::Required);
+
+static cl::list<std::string> Parameters("param",
+    cl::desc("A parameter and the values to explore, e.g., "
+             "preferred-subfunction-size=128,256,512"),
+    cl::value_desc("name=values"), cl::OneOrMore);
+
+static cl::opt<std::string> Simulator("pasim",
+    cl::desc("The simulator to run the program on"), cl::init("pasim"));
+
+static cl::list<std::string> SimulatorArgs("pasim-arg",
+    cl::desc("An additional argument of the simulator"));
+
+static cl::opt<bool> InProcess("in-process",
+    cl::desc("Run the program on the built-in simulator instead of pasim, "
+             "configured by the -mpatmos-* options"));
+
+static cl::list<std::string> BuildCommand(cl::Positional, cl::OneOrMore,
+    cl::desc("-- <build command>..."));
+
+/// The values of the parameters of a function, by parameter name.
+typedef std::map<std::string, std::string> Setting;
+
+/// The costs of the functions, by function name.
+typedef std::map<std::string, uint64_t> Costs;
+
+/// The address range of a function.
+struct FunctionRange {
+  uint64_t Start, End;
+  std::string Name;
+
+  bool operator<(const FunctionRange &R) const { return Start < R.Start; }
+};
+
+/// Write a tuning database.
+static bool writeDatabase(StringRef Filename,
+                          const std::map<std::string, Setting> &Functions) {
+  std::error_code EC;
+  raw_fd_ostream OS(Filename, EC, sys::fs::OF_Text);
+  if (EC) {
+    WithColor::error() << Filename << ": " << EC.message() << "\n";
+    return false;
+  }
+
+  OS << "# <function> <parameter>=<value> ..., see -mpatmos-tuning-db\n";
+  for (const auto &F : Functions) {
+    if (F.second.empty())
+      continue;
+    OS << F.first;
+    for (const auto &P : F.second)
+      OS << ' ' << P.first << '=' << P.second;
+    OS << '\n';
+  }
+  return true;
+}
+
+/// Run a program, with its output written to the given file if not empty.
+static bool run(ArrayRef<std::string> Args, StringRef Output) {
+  ErrorOr<std::string> Program = sys::findProgramByName(Args[0]);
+  if (!Program) {
+    WithColor::error() << Args[0] << ": " << Program.getError().message()
+                       << "\n";
+    return false;
+  }
+
+  std::vector<StringRef> Argv(Args.begin(), Args.end());
+  Optional<StringRef> Redirects[] = { None, None, None };
+  if (!Output.empty())
+    Redirects[1] = Redirects[2] = Output;
+
+  std::string Error;
+  int Result = sys::ExecuteAndWait(*Program, Argv, None, Redirects, 0, 0,
+                                   &Error);
+  if (Result != 0) {
+    WithColor::error() << Args[0] << ": "
+                       << (Error.empty() ? "exited with " + itostr(Result)
+                                         : Error)
+                       << "\n";
+    return false;
+  }
+  return true;
+}
+
+/// Read the address ranges of the functions of the program.
+static bool readFunctions(std::vector<FunctionRange> &Functions) {
+  Expected<object::OwningBinary<object::ObjectFile>> Binary =
+      object::ObjectFile::createObjectFile(BinaryFilename);
+  if (!Binary) {
+    WithColor::error() << BinaryFilename << ": "
+                       << toString(Binary.takeError()) << "\n";
+    return false;
+  }
+
+  const object::ObjectFile &Obj = *Binary->getBinary();
+  for (const auto &S : object::computeSymbolSizes(Obj)) {
+    Expected<object::SymbolRef::Type> Type = S.first.getType();
+    Expected<uint64_t> Address = S.first.getAddress();
+    Expected<StringRef> Name = S.first.getName();
+    if (!Type || !Address || !Name) {
+      consumeError(Type.takeError());
+      consumeError(Address.takeError());
+      consumeError(Name.takeError());
+      continue;
+    }
+    if (*Type == object::SymbolRef::ST_Function && S.second)
+      Functions.push_back({*Address, *Address + S.second, Name->str()});
+  }
+  std::sort(Functions.begin(), Functions.end());
+  return true;
+}
+
+/// Return the function containing the address, or null.
+static const FunctionRange *
+findFunction(const std::vector<FunctionRange> &Functions, uint64_t Address) {
+  FunctionRange Key = { Address, Address, "" };
+  auto F = std::upper_bound(Functions.begin(), Functions.end(), Key);
+  if (F != Functions.begin() && Address < std::prev(F)->End)
+    return &*std::prev(F);
+  return nullptr;
+}
+
+/// Run the program on the built-in simulator, and compute the costs of its
+/// functions from the cycles spent in their blocks.
+static bool simulate(const std::vector<FunctionRange> &Functions,
+                     Costs &Result) {
+  // the target machine is shared by the runs
+  static std::unique_ptr<PatmosTargetMachine> TM;
+  if (!TM) {
+    std::string Message;
+    TM = PatmosSimulator::createTargetMachine(Message);
+    if (!TM) {
+      WithColor::error() << Message << "\n";
+      return false;
+    }
+  }
+
+  PatmosSimulator Sim(*TM, nulls());
+  Error E = Sim.load(BinaryFilename);
+  if (!E)
+    E = Sim.run();
+  if (E) {
+    WithColor::error() << BinaryFilename << ": " << toString(std::move(E))
+                       << "\n";
+    return false;
+  }
+
+  Sim.forEachBlock([&](uint32_t Start, uint32_t End, uint64_t Executions,
+                       uint64_t Cycles) {
+    if (const FunctionRange *F = findFunction(Functions, Start))
+      Result[F->Name] += Cycles;
+  });
+
+  if (Result.empty()) {
+    WithColor::error() << BinaryFilename << ": no function was executed\n";
+    return false;
+  }
+  return true;
+}
+
+/// Build and simulate the program with the given tuning database, and
+/// compute the costs of its functions.
+static bool measure(StringRef Database, StringRef TraceFile, Costs &Result) {
+  std::vector<std::string> Build(BuildCommand.begin(), BuildCommand.end());
+  for (std::string &Arg : Build) {
+    for (size_t Pos; (Pos = Arg.find("{db}")) != std::string::npos; )
+      Arg.replace(Pos, 4, Database.str());
+  }
+  if (!run(Build, ""))
+    return false;
+
+  std::vector<FunctionRange> Functions;
+  if (!readFunctions(Functions))
+    return false;
+
+  if (InProcess)
+    return simulate(Functions, Result);
+
+  std::vector<std::string> Simulate;
+  Simulate.push_back(Simulator);
+  Simulate.push_back("--debug=0");
+  Simulate.push_back("--debug-fmt=trace");
+  Simulate.insert(Simulate.end(), SimulatorArgs.begin(), SimulatorArgs.end());
+  Simulate.push_back(BinaryFilename);
+  if (!run(Simulate, TraceFile))
+    return false;
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Trace =
+      MemoryBuffer::getFile(TraceFile);
+  if (std::error_code EC = Trace.getError()) {
+    WithColor::error() << TraceFile << ": " << EC.message() << "\n";
+    return false;
+  }
+
+  // Lines without an address are other output of the simulator.
+  for (line_iterator I(**Trace, /*SkipBlanks=*/true), E; I != E; ++I) {
+    StringRef Token = getToken(*I).first;
+    Token.consume_front("0x");
+
+    uint64_t Address;
+    if (Token.getAsInteger(16, Address))
+      continue;
+
+    if (const FunctionRange *F = findFunction(Functions, Address))
+      Result[F->Name]++;
+  }
+
+  if (Result.empty()) {
+    WithColor::error() << Simulator << ": no addresses found in trace\n";
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+                              "Patmos per-function parameter tuning\n");
+
+  if (std::none_of(BuildCommand.begin(), BuildCommand.end(),
+                   [](const std::string &Arg) {
+                     return Arg.find("{db}") != std::string::npos;
+                   }))
+    WithColor::warning() << "the build command does not use {db}\n";
+
+  SmallString<128> Database, TraceFile;
+  if (std::error_code EC = sys::fs::createTemporaryFile("patmos-autotune",
+                                                        "db", Database)) {
+    WithColor::error() << EC.message() << "\n";
+    return 1;
+  }
+  FileRemover DatabaseRemover(Database);
+  if (std::error_code EC = sys::fs::createTemporaryFile("patmos-autotune",
+                                                        "trace", TraceFile)) {
+    WithColor::error() << EC.message() << "\n";
+    return 1;
+  }
+  FileRemover TraceRemover(TraceFile);
+
+  // The costs with the default parameters.
+  Costs Defaults;
+  if (!writeDatabase(Database, {}) || !measure(Database, TraceFile, Defaults))
+    return 1;
+
+  std::map<std::string, Setting> Best;
+  std::map<std::string, std::map<std::string, uint64_t>> BestCosts;
+  for (StringRef Parameter : Parameters) {
+    StringRef Name, Values;
+    std::tie(Name, Values) = Parameter.split('=');
+    SmallVector<StringRef, 8> Candidates;
+    Values.split(Candidates, ',', -1, false);
+    if (Name.empty() || Candidates.empty()) {
+      WithColor::error() << "invalid parameter '" << Parameter << "'\n";
+      return 1;
+    }
+
+    for (StringRef Value : Candidates) {
+      errs() << "Exploring " << Name << '=' << Value << "\n";
+
+      std::map<std::string, Setting> All;
+      All["*"][Name.str()] = Value.str();
+      Costs Current;
+      if (!writeDatabase(Database, All) ||
+          !measure(Database, TraceFile, Current))
+        return 1;
+
+      for (const auto &F : Current) {
+        auto D = Defaults.find(F.first);
+        if (D == Defaults.end())
+          continue;
+
+        auto C = BestCosts[F.first].insert(std::make_pair(Name.str(),
+                                                          D->second));
+        if (F.second < C.first->second) {
+          C.first->second = F.second;
+          Best[F.first][Name.str()] = Value.str();
+        }
+      }
+    }
+  }
+
+  for (const auto &F : Best) {
+    errs() << F.first << ":";
+    for (const auto &P : F.second)
+      errs() << ' ' << P.first << '=' << P.second << " ("
+             << BestCosts[F.first][P.first] << " instead of "
+             << Defaults[F.first] << ")";
+    errs() << "\n";
+  }
+
+  return writeDatabase(DatabaseFilename, Best) ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+//===-- patmos-sim.cpp - Simulate Patmos programs -------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Runs a Patmos executable on the simulator of the Patmos backend, see
+// PatmosSimulator.h. The output of the program to the UART is written to
+// stdout, and the simulator exits with the exit code of the program. The
+// caches are configured by the -mpatmos-* options of the backend, e.g.,
+// -mpatmos-hw-config.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PatmosTargetMachine.h"
+#include "Simulator/PatmosSimulator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> InputFilename(cl::Positional, cl::Required,
+                                          cl::desc("<executable>"));
+
+static cl::opt<uint64_t> MaxCycles("max-cycles",
+    cl::desc("Stop the program after the given number of cycles "
+             "(default: 0, i.e., no limit)"), cl::init(0));
+
+static cl::opt<bool> PrintStats("stats",
+    cl::desc("Print the cycles and the cache statistics to stderr"));
+
+static cl::opt<bool> PrintProfile("profile",
+    cl::desc("Print the executions and cycles of the blocks to stderr"));
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "Patmos simulator\n");
+
+  std::string Message;
+  std::unique_ptr<PatmosTargetMachine> TM =
+      PatmosSimulator::createTargetMachine(Message);
+  if (!TM) {
+    WithColor::error() << Message << "\n";
+    return 1;
+  }
+
+  PatmosSimulator Sim(*TM, outs());
+  if (Error E = Sim.load(InputFilename)) {
+    WithColor::error() << InputFilename << ": " << toString(std::move(E))
+                       << "\n";
+    return 1;
+  }
+
+  Error E = Sim.run(MaxCycles);
+  outs().flush();
+
+  const PatmosSimulatorStats &S = Sim.getStats();
+  if (PrintStats) {
+    errs() << "cycles:               " << S.Cycles << "\n"
+           << "bundles:              " << S.Bundles << "\n"
+           << "instructions:         " << S.Instructions << "\n"
+           << "method cache:         " << S.MethodCacheHits << " hits, "
+           << S.MethodCacheMisses << " misses, " << S.MethodCacheStalls
+           << " cycles\n"
+           << "stack cache:          " << S.StackCacheSpillBytes
+           << " bytes spilled, " << S.StackCacheFillBytes << " bytes filled, "
+           << S.StackCacheStalls << " cycles\n"
+           << "data cache:           " << S.DataCacheHits << " hits, "
+           << S.DataCacheMisses << " misses, " << S.DataCacheStalls
+           << " cycles\n"
+           << "main memory:          " << S.MemoryStalls << " cycles\n"
+           << "non-delayed branches: " << S.BranchStalls << " cycles\n";
+  }
+
+  if (PrintProfile) {
+    Sim.forEachBlock([](uint32_t Start, uint32_t End, uint64_t Executions,
+                        uint64_t Cycles) {
+      errs() << format_hex(Start, 10) << '-' << format_hex(End, 10) << ' '
+             << Executions << ' ' << Cycles << "\n";
+    });
+  }
+
+  if (E) {
+    WithColor::error() << InputFilename << ": " << toString(std::move(E))
+                       << "\n";
+    return 1;
+  }
+  if (!Sim.hasHalted()) {
+    WithColor::warning() << InputFilename << ": stopped after " << S.Cycles
+                         << " cycles\n";
+    return 1;
+  }
+  return Sim.getExitCode();
+}
@@ -0,0 +1,195 @@
+//===-- patmos-trace2prof.cpp - Sample profiles from Patmos traces --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Converts instruction traces of a Patmos program, as printed by
+// 'pasim --debug=0 --debug-fmt=trace', into sample profiles that can be
+// merged with llvm-profdata and used with -fprofile-sample-use.
+//
+// Every line of the trace starts with the (hexadecimal) address of an executed
+// bundle, the remainder of the line is ignored. Addresses are mapped to source
+// lines using the debug information of the traced binary, which should be
+// compiled with -gline-tables-only or -g. As usual for sample profiles, the
+// count of a source line is the largest count of its instructions.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/DebugInfo/Symbolize/Symbolize.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/ProfileData/SampleProf.h"
+#include "llvm/ProfileData/SampleProfWriter.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/WithColor.h"
+
+using namespace llvm;
+using namespace sampleprof;
+
+static cl::opt<std::string> BinaryFilename(cl::Positional,
+                                           cl::desc("<binary>"),
+                                           cl::Required);
+
+static cl::opt<std::string> TraceFilename(cl::Positional,
+                                          cl::desc("<trace file>"),
+                                          cl::init("-"));
+
+static cl::opt<std::string> OutputFilename("o", cl::desc("Output filename"),
+                                           cl::value_desc("filename"),
+                                           cl::init("-"));
+
+static cl::opt<SampleProfileFormat> OutputFormat(
+    "format", cl::desc("Format of the sample profile"), cl::init(SPF_Text),
+    cl::values(clEnumValN(SPF_Text, "text", "Text encoding"),
+               clEnumValN(SPF_Binary, "binary", "Binary encoding"),
+               clEnumValN(SPF_Ext_Binary, "extbinary",
+                          "Extensible binary encoding")));
+
+/// Line offset of a source location relative to the start of its function.
+static LineLocation getLocation(const DILineInfo &Info) {
+  return LineLocation(
+      (Info.Line - Info.StartLine) & 0xffff,
+      DILocation::getBaseDiscriminatorFromDiscriminator(Info.Discriminator));
+}
+
+/// Count how often each address appears in the trace.
+static bool readTrace(const MemoryBuffer &Trace,
+                      DenseMap<uint64_t, uint64_t> &Counts) {
+  uint64_t Ignored = 0;
+  for (line_iterator I(Trace, /*SkipBlanks=*/true), E; I != E; ++I) {
+    StringRef Token = getToken(*I).first;
+    Token.consume_front("0x");
+
+    uint64_t Address;
+    if (Token.getAsInteger(16, Address)) {
+      // Skip other output of the simulator.
+      Ignored++;
+      continue;
+    }
+    Counts[Address]++;
+  }
+
+  if (Counts.empty()) {
+    WithColor::error() << TraceFilename << ": no addresses found in trace\n";
+    return false;
+  }
+  if (Ignored)
+    WithColor::warning() << TraceFilename << ": ignored " << Ignored
+                         << " lines without an address\n";
+  return true;
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+                              "Patmos trace to sample profile converter\n");
+
+  Expected<object::OwningBinary<object::ObjectFile>> Binary =
+      object::ObjectFile::createObjectFile(BinaryFilename);
+  if (!Binary) {
+    WithColor::error() << BinaryFilename << ": "
+                       << toString(Binary.takeError()) << "\n";
+    return 1;
+  }
+
+  // Function entries, to count the calls of functions.
+  DenseSet<uint64_t> FunctionStarts;
+  for (const object::SymbolRef &Sym : Binary->getBinary()->symbols()) {
+    Expected<object::SymbolRef::Type> Type = Sym.getType();
+    Expected<uint64_t> Address = Sym.getAddress();
+    if (!Type || !Address) {
+      consumeError(Type.takeError());
+      consumeError(Address.takeError());
+      continue;
+    }
+    if (*Type == object::SymbolRef::ST_Function)
+      FunctionStarts.insert(*Address);
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Trace =
+      MemoryBuffer::getFileOrSTDIN(TraceFilename);
+  if (std::error_code EC = Trace.getError()) {
+    WithColor::error() << TraceFilename << ": " << EC.message() << "\n";
+    return 1;
+  }
+
+  DenseMap<uint64_t, uint64_t> Counts;
+  if (!readTrace(**Trace, Counts))
+    return 1;
+
+  symbolize::LLVMSymbolizer::Options Opts;
+  Opts.Demangle = false;
+  symbolize::LLVMSymbolizer Symbolizer(Opts);
+
+  StringMap<FunctionSamples> Profiles;
+  for (const auto &C : Counts) {
+    Expected<DIInliningInfo> Frames = Symbolizer.symbolizeInlinedCode(
+        BinaryFilename, {C.first, object::SectionedAddress::UndefSection});
+    if (!Frames) {
+      WithColor::error() << BinaryFilename << ": "
+                         << toString(Frames.takeError()) << "\n";
+      return 1;
+    }
+
+    unsigned NumFrames = Frames->getNumberOfFrames();
+    if (NumFrames == 0 ||
+        Frames->getFrame(0).FunctionName == DILineInfo::BadString)
+      continue;
+
+    // Walk from the outermost function to the innermost inlined callee.
+    const DILineInfo &Outer = Frames->getFrame(NumFrames - 1);
+    FunctionSamples *FS = &Profiles[Outer.FunctionName];
+    FS->setName(Profiles.find(Outer.FunctionName)->getKey());
+    if (FunctionStarts.count(C.first))
+      FS->addHeadSamples(C.second);
+
+    // The totals of the callers include the samples of inlined callees.
+    SmallVector<FunctionSamples *, 4> Callers;
+    for (unsigned I = NumFrames - 1; I > 0; I--) {
+      const DILineInfo &Callee = Frames->getFrame(I - 1);
+      FunctionSamplesMap &Callees =
+          FS->functionSamplesAt(getLocation(Frames->getFrame(I)));
+      Callers.push_back(FS);
+      FS = &Callees[Callee.FunctionName];
+      FS->setName(Callees.find(Callee.FunctionName)->first);
+    }
+
+    // Keep the largest count of all instructions of a line.
+    LineLocation Loc = getLocation(Frames->getFrame(0));
+    ErrorOr<uint64_t> Samples = FS->findSamplesAt(Loc.LineOffset,
+                                                  Loc.Discriminator);
+    uint64_t Current = Samples ? *Samples : 0;
+    if (C.second <= Current)
+      continue;
+
+    uint64_t Delta = C.second - Current;
+    FS->addBodySamples(Loc.LineOffset, Loc.Discriminator, Delta);
+    FS->addTotalSamples(Delta);
+    for (FunctionSamples *Caller : Callers)
+      Caller->addTotalSamples(Delta);
+  }
+
+  ErrorOr<std::unique_ptr<SampleProfileWriter>> Writer =
+      SampleProfileWriter::create(OutputFilename, OutputFormat);
+  if (std::error_code EC = Writer.getError()) {
+    WithColor::error() << OutputFilename << ": " << EC.message() << "\n";
+    return 1;
+  }
+  if (std::error_code EC = (*Writer)->write(Profiles)) {
+    WithColor::error() << OutputFilename << ": " << EC.message() << "\n";
+    return 1;
+  }
+  return 0;
+}
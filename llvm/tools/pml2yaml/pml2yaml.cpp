@@ -0,0 +1,75 @@
+//===-- pml2yaml.cpp - Convert binary PML files to YAML -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Prints PML files written with -mpatmos-serialize-format=binary as the YAML
+// documents the export would have written otherwise. With -entry, only the
+// entries of the given name are printed, found through the index of the file.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PMLBinary.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/WithColor.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> InputFilename(cl::Positional,
+                                          cl::desc("<input file>"),
+                                          cl::init("-"));
+
+static cl::opt<std::string> OutputFilename("o", cl::desc("Output filename"),
+                                           cl::value_desc("filename"),
+                                           cl::init("-"));
+
+static cl::opt<std::string> EntryName("entry",
+    cl::desc("Print only the entries of the given name, e.g., of a function"),
+    cl::value_desc("name"));
+
+static cl::opt<std::string> EntryList("entry-list",
+    cl::desc("The list holding the entries printed with -entry"),
+    cl::init("machine-functions"));
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "binary PML to YAML converter\n");
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      MemoryBuffer::getFileOrSTDIN(InputFilename, /*FileSize=*/-1,
+                                   /*RequiresNullTerminator=*/false);
+  if (std::error_code EC = Buffer.getError()) {
+    WithColor::error() << InputFilename << ": " << EC.message() << "\n";
+    return 1;
+  }
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::OF_Text);
+  if (EC) {
+    WithColor::error() << OutputFilename << ": " << EC.message() << "\n";
+    return 1;
+  }
+
+  std::string Error;
+  if (!EntryName.empty()) {
+    std::unique_ptr<PMLBinaryFile> File =
+                               PMLBinaryFile::create(std::move(*Buffer), Error);
+    if (!File || !File->lookup(EntryList, EntryName, Out.os(), Error)) {
+      WithColor::error() << InputFilename << ": " << Error << "\n";
+      return 1;
+    }
+  } else if (!convertPMLBinaryToYAML((*Buffer)->getBuffer(), Out.os(),
+                                     Error)) {
+    WithColor::error() << InputFilename << ": " << Error << "\n";
+    return 1;
+  }
+  Out.keep();
+  return 0;
+}
@@ -0,0 +1,220 @@
+#include "gtest/gtest.h"
+#include "PatmosILPSolver.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+
+using namespace llvm;
+
+namespace {
+
+double solveBuiltin(StringRef LP, PatmosILPSolver::Status Expected =
+                                                     PatmosILPSolver::OPTIMAL) {
+  std::unique_ptr<PatmosILPSolver> Solver(createPatmosBuiltinILPSolver(1000));
+  double Result = -1;
+  EXPECT_EQ(Expected, Solver->solve(LP, Result));
+  return Result;
+}
+
+TEST(PatmosILPSolverTest, SimpleMaximize){
+  EXPECT_EQ(12, solveBuiltin("Maximize\n"
+                             " + 3 x + 2 y\n"
+                             "Subject To\n"
+                             "c1:\t x + y <= 4\n"
+                             "c2:\t x + 3 y <= 6\n"
+                             "c3:\t x <= 4\n"
+                             "Generals\n"
+                             "x\n"
+                             "y\n"
+                             "End\n"));
+}
+
+TEST(PatmosILPSolverTest, SimpleMinimize){
+  EXPECT_EQ(5, solveBuiltin("Minimize\n"
+                            " + 2 x + 3 y\n"
+                            "Subject To\n"
+                            "c1:\t + x + y >= 2\n"
+                            "c2:\t + y >= 1\n"
+                            "Generals\n"
+                            "x\n"
+                            "y\n"
+                            "End\n"));
+}
+
+TEST(PatmosILPSolverTest, Equalities){
+  // flow through a diamond, the path over the heavier edge is chosen
+  EXPECT_EQ(6, solveBuiltin("Maximize\n"
+                            " + 2 a + 5 b + 1 c \\ comment\n"
+                            "Subject To\n"
+                            "src:\t + a + b = 1\n"
+                            "snk:\t + a + b - c = 0\n"
+                            "Generals\n"
+                            "a\nb\nc\n"
+                            "End\n"));
+}
+
+TEST(PatmosILPSolverTest, Branching){
+  // the LP relaxation is fractional (x = 1.5)
+  EXPECT_EQ(1, solveBuiltin("Maximize\n"
+                            " + x\n"
+                            "Subject To\n"
+                            " c: + 2 x <= 3\n"
+                            "Generals\n"
+                            " x\n"
+                            "End\n"));
+
+  EXPECT_EQ(15, solveBuiltin("Maximize\n"
+                             " + 5 x + 4 y\n"
+                             "Subject To\n"
+                             " c1: + 6 x + 4 y <= 24\n"
+                             " c2: + x + 2 y <= 6\n"
+                             " c3: + 2 x + 2 y <= 7\n"
+                             "Generals\n"
+                             " x y\n"
+                             "End\n"));
+}
+
+TEST(PatmosILPSolverTest, Bounds){
+  EXPECT_EQ(-2, solveBuiltin("Minimize\n"
+                             " + x - y\n"
+                             "Subject To\n"
+                             " c: + x + y >= 1\n"
+                             "Bounds\n"
+                             " 1 <= x <= 3\n"
+                             " y <= 3\n"
+                             "Generals\n"
+                             " x y\n"
+                             "End\n"));
+}
+
+TEST(PatmosILPSolverTest, Infeasible){
+  solveBuiltin("Maximize\n"
+               " + x\n"
+               "Subject To\n"
+               " c1: + x <= 1\n"
+               " c2: + x >= 2\n"
+               "End\n", PatmosILPSolver::INFEASIBLE);
+}
+
+TEST(PatmosILPSolverTest, Unbounded){
+  // a recursion without user-supplied bounds
+  solveBuiltin("Maximize\n"
+               " + 4 WXf\n"
+               "Subject To\n"
+               "path:\tWXf >= 1\n"
+               "ifW0:\t + WS1 + WS2 - WXf = 0\n"
+               "ofW0:\t + WS1 + OFXf - WXf = 0\n"
+               "enx:\t + WS2 = 1\n"
+               "ex:\t + OFXf = 1\n"
+               "Generals\n"
+               "WXf\nWS1\nWS2\nOFXf\n"
+               "End\n", PatmosILPSolver::UNBOUNDED);
+}
+
+TEST(PatmosILPSolverTest, UserBounds){
+  // the same recursion bounded by a user-supplied constraint
+  EXPECT_EQ(12, solveBuiltin("Maximize\n"
+                             " + 4 WXf\n"
+                             "Subject To\n"
+                             "path:\tWXf >= 1\n"
+                             "ifW0:\t + WS1 + WS2 - WXf = 0\n"
+                             "ofW0:\t + WS1 + OFXf - WXf = 0\n"
+                             "enx:\t + WS2 = 1\n"
+                             "ex:\t + OFXf = 1\n"
+                             "usr:     + WXf <= 3\n"
+                             "Generals\n"
+                             "WXf\nWS1\nWS2\nOFXf\n"
+                             "End\n"));
+}
+
+TEST(PatmosILPSolverTest, Normalize){
+  // equal up to comments, white space, and names
+  EXPECT_EQ(normalizePatmosLP("Maximize\n"
+                              " + 3 x + 2 y \\ objective\n"
+                              "Subject To\n"
+                              "c1:\t x + y <= 4\n"
+                              "Generals\n"
+                              "x\ny\n"
+                              "End\n"),
+            normalizePatmosLP("maximize + 3 a   + 2 b\n"
+                              "subject to\n"
+                              "other: a + b <= 4\n"
+                              "generals\n"
+                              "a b\n"
+                              "end\n"));
+
+  // the objective differs
+  EXPECT_NE(normalizePatmosLP("Maximize\n + x\nSubject To\n x <= 4\nEnd\n"),
+            normalizePatmosLP("Minimize\n + x\nSubject To\n x <= 4\nEnd\n"));
+
+  // variables are not interchangeable
+  EXPECT_NE(normalizePatmosLP("Maximize\n + x\nSubject To\n"
+                              " x <= 4\n y <= 3\nEnd\n"),
+            normalizePatmosLP("Maximize\n + x\nSubject To\n"
+                              " y <= 4\n x <= 3\nEnd\n"));
+}
+
+/// Solver counting how often it is invoked.
+class CountingILPSolver : public PatmosILPSolver {
+  unsigned &Count;
+
+public:
+  CountingILPSolver(unsigned &count) : Count(count) {}
+
+  Status solve(StringRef LP, double &Objective) override {
+    Count++;
+    return createPatmosBuiltinILPSolver(1000)->solve(LP, Objective);
+  }
+
+  StringRef getName() const override { return "counting"; }
+};
+
+TEST(PatmosILPSolverTest, Cache){
+  unsigned Count = 0;
+  std::unique_ptr<PatmosILPSolver> Solver(createPatmosCachingILPSolver(
+                             std::make_unique<CountingILPSolver>(Count), ""));
+
+  double Result = -1;
+  EXPECT_EQ(PatmosILPSolver::OPTIMAL,
+            Solver->solve("Maximize\n + x\nSubject To\n"
+                          "c: + 2 x <= 3\nGenerals\n x\nEnd\n", Result));
+  EXPECT_EQ(1, Result);
+
+  Result = -1;
+  EXPECT_EQ(PatmosILPSolver::OPTIMAL,
+            Solver->solve("Maximize\n + y\nSubject To\n"
+                          "d: + 2 y <= 3\nGenerals\n y\nEnd\n", Result));
+  EXPECT_EQ(1, Result);
+  EXPECT_EQ(1u, Count);
+
+  EXPECT_EQ(PatmosILPSolver::INFEASIBLE,
+            Solver->solve("Maximize\n + x\nSubject To\n"
+                          " + x <= 1\n + x >= 2\nEnd\n", Result));
+  EXPECT_EQ(PatmosILPSolver::INFEASIBLE,
+            Solver->solve("Maximize\n + x\nSubject To\n"
+                          " + x <= 1\n + x >= 2\nEnd\n", Result));
+  EXPECT_EQ(2u, Count);
+}
+
+TEST(PatmosILPSolverTest, CacheDir){
+  SmallString<128> Dir;
+  ASSERT_FALSE(sys::fs::createUniqueDirectory("ilp-cache", Dir));
+
+  StringRef LP("Maximize\n + 5 x + 4 y\nSubject To\n"
+               " + 6 x + 4 y <= 24\n + x + 2 y <= 6\n + 2 x + 2 y <= 7\n"
+               "Generals\n x y\nEnd\n");
+
+  unsigned Count = 0;
+  for(unsigned i = 0; i < 2; i++) {
+    // a new solver, as in a later compilation
+    std::unique_ptr<PatmosILPSolver> Solver(createPatmosCachingILPSolver(
+                            std::make_unique<CountingILPSolver>(Count), Dir));
+    double Result = -1;
+    EXPECT_EQ(PatmosILPSolver::OPTIMAL, Solver->solve(LP, Result));
+    EXPECT_EQ(15, Result);
+  }
+  EXPECT_EQ(1u, Count);
+
+  sys::fs::remove_directories(Dir);
+}
+
+} // end anonymous namespace
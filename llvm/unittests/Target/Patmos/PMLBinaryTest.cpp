@@ -0,0 +1,163 @@
+#include "gtest/gtest.h"
+#include "PML.h"
+#include "PMLBinary.h"
+
+using namespace llvm;
+using namespace llvm::yaml;
+
+namespace {
+
+typedef PMLDoc<PMLMachineFunction, UnsignedValue> MachineDoc;
+
+/// A machine function touching most of the PML constructs.
+PMLMachineFunction *makeFunction(uint64_t Name, const char *MapsTo) {
+  PMLMachineFunction *F = new PMLMachineFunction(Name);
+  F->MapsTo = MapsTo;
+  F->Level = level_machinecode;
+  F->addArgument(new yaml::Argument("%n", 0))->addReg("r3");
+
+  MachineBlock *B0 = F->addBlock(new MachineBlock(0ULL));
+  B0->MapsTo = "entry";
+  B0->Successors.push_back(1ULL);
+  MachineInstruction *I = B0->addInstruction(new MachineInstruction(0));
+  I->Opcode = "CALL";
+  I->Address = 1024;
+  I->addCallee("foo");
+  I->BranchType = branch_call;
+  I->BranchDelaySlots = 3;
+
+  MachineBlock *B1 = F->addBlock(new MachineBlock(1ULL));
+  B1->Predecessors.push_back(0ULL);
+  B1->Predecessors.push_back(1ULL);
+  B1->Successors.push_back(1ULL);
+  B1->Loops.push_back(1ULL);
+  B1->Loc = "main.c: 12";
+  B1->addInstruction(new MachineInstruction(0))->Opcode = "RET";
+  return F;
+}
+
+/// A small document touching most of the PML constructs.
+void fillDoc(MachineDoc &Doc) {
+  Doc.addFunction(makeFunction(3, "main"));
+
+  FlowFact<UnsignedValue> *FF = new FlowFact<UnsignedValue>(level_machinecode);
+  FF->setLoopScope(3ULL, 1ULL);
+  FF->addTermLHS(ProgramPoint::CreateBlock("3", "1"), -1);
+  FF->Comparison = cmp_less_equal;
+  FF->RHS = 100;
+  FF->Origin = "llvm.mc";
+  Doc.addFlowFact(FF);
+}
+
+std::string toYAML(MachineDoc &Doc) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  Output Out(OS);
+  MachineDoc *DocPtr = &Doc;
+  Out << DocPtr;
+  return OS.str();
+}
+
+std::string toBinary(ArrayRef<MachineDoc*> Docs) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  PMLBinaryOutput Out(OS);
+  for(ArrayRef<MachineDoc*>::iterator i(Docs.begin()), ie(Docs.end());
+      i != ie; i++) {
+    MachineDoc *DocPtr = *i;
+    Out << DocPtr;
+  }
+  Out.finish();
+  return OS.str();
+}
+
+TEST(PMLBinaryTest, RoundTrip){
+  MachineDoc Doc("machine-functions", "patmos-unknown-unknown-elf");
+  fillDoc(Doc);
+  MachineDoc Empty("machine-functions", "patmos-unknown-unknown-elf");
+
+  MachineDoc *Docs[] = { &Doc, &Empty };
+  std::string Binary = toBinary(Docs);
+  EXPECT_TRUE(isPMLBinary(Binary));
+
+  std::string Converted, Error;
+  raw_string_ostream OS(Converted);
+  EXPECT_TRUE(convertPMLBinaryToYAML(Binary, OS, Error));
+  EXPECT_EQ("", Error);
+  EXPECT_EQ(toYAML(Doc) + toYAML(Empty), OS.str());
+
+  // names and opcodes are interned
+  EXPECT_LT(Binary.size(), Converted.size() / 2);
+}
+
+TEST(PMLBinaryTest, Malformed){
+  MachineDoc Doc("machine-functions", "patmos-unknown-unknown-elf");
+  fillDoc(Doc);
+  MachineDoc *Docs[] = { &Doc };
+  std::string Binary = toBinary(Docs);
+
+  std::string Converted, Error;
+  raw_string_ostream OS(Converted);
+  EXPECT_FALSE(convertPMLBinaryToYAML(toYAML(Doc), OS, Error));
+  EXPECT_EQ("not a binary PML file", Error);
+
+  // a newer version
+  std::string Newer(Binary);
+  Newer[4] = PMLBinaryVersion + 1;
+  Error.clear();
+  EXPECT_FALSE(convertPMLBinaryToYAML(Newer, OS, Error));
+  EXPECT_NE("", Error);
+
+  // every truncation is detected
+  for(unsigned i = 0; i < Binary.size(); i++) {
+    Error.clear();
+    EXPECT_FALSE(convertPMLBinaryToYAML(StringRef(Binary).take_front(i), OS,
+                                        Error));
+    EXPECT_NE("", Error);
+  }
+}
+
+TEST(PMLBinaryTest, Lookup){
+  MachineDoc Doc("machine-functions", "patmos-unknown-unknown-elf");
+  fillDoc(Doc);
+  MachineDoc Other("machine-functions", "patmos-unknown-unknown-elf");
+  Other.addFunction(makeFunction(5, "foo"));
+  Other.addFunction(makeFunction(6, "bar"));
+
+  MachineDoc *Docs[] = { &Doc, &Other };
+  std::string Binary = toBinary(Docs);
+
+  std::string Error;
+  std::unique_ptr<PMLBinaryFile> File = PMLBinaryFile::create(
+               MemoryBuffer::getMemBuffer(Binary, "", false), Error);
+  ASSERT_TRUE(File != nullptr);
+  EXPECT_EQ("", Error);
+
+  // functions are found by their name and by the function they map to
+  EXPECT_TRUE(File->contains("machine-functions", "main"));
+  EXPECT_TRUE(File->contains("machine-functions", "3"));
+  EXPECT_TRUE(File->contains("machine-functions", "6"));
+  EXPECT_FALSE(File->contains("machine-functions", "baz"));
+  EXPECT_FALSE(File->contains("bitcode-functions", "main"));
+
+  MachineDoc Bar("machine-functions", "patmos-unknown-unknown-elf");
+  Bar.addFunction(makeFunction(6, "bar"));
+  std::string Found;
+  raw_string_ostream OS(Found);
+  EXPECT_TRUE(File->lookup("machine-functions", "bar", OS, Error));
+  EXPECT_EQ(toYAML(Bar), OS.str());
+
+  // nothing is written for unknown functions
+  Found.clear();
+  EXPECT_TRUE(File->lookup("machine-functions", "baz", OS, Error));
+  EXPECT_EQ("", OS.str());
+
+  // files without an entry table are rejected
+  std::string Old(Binary);
+  Old[4] = 1;
+  EXPECT_TRUE(PMLBinaryFile::create(
+               MemoryBuffer::getMemBuffer(Old, "", false), Error) == nullptr);
+  EXPECT_NE("", Error);
+}
+
+} // end anonymous namespace
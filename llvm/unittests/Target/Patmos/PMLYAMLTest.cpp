@@ -0,0 +1,108 @@
+#include "gtest/gtest.h"
+#include "PML.h"
+#include "PMLYAML.h"
+
+using namespace llvm;
+using namespace llvm::yaml;
+
+namespace {
+
+typedef PMLDoc<PMLMachineFunction, UnsignedValue> MachineDoc;
+typedef PMLDoc<BitcodeFunction, StringValue> BitcodeDoc;
+
+/// A machine function with long flow sequences and scalars to quote.
+void fillDoc(MachineDoc &Doc) {
+  PMLMachineFunction *F = new PMLMachineFunction(3ULL);
+  F->MapsTo = "main";
+  F->Level = level_machinecode;
+  F->addArgument(new yaml::Argument("%n", 0))->addReg("r3");
+
+  MachineBlock *B0 = F->addBlock(new MachineBlock(0ULL));
+  B0->MapsTo = "entry";
+  for (unsigned i = 1; i < 40; i++)
+    B0->Successors.push_back((uint64_t)i);
+  MachineInstruction *I = B0->addInstruction(new MachineInstruction(0));
+  I->Opcode = "CALL";
+  I->Address = 1024;
+  I->addCallee("foo");
+  I->addCallee("it's");
+  I->addCallee("tab\there");
+  I->BranchType = branch_call;
+  I->BranchDelaySlots = 3;
+
+  MachineBlock *B1 = F->addBlock(new MachineBlock(1ULL));
+  B1->Predecessors.push_back(0ULL);
+  B1->Predecessors.push_back(1ULL);
+  B1->Successors.push_back(1ULL);
+  B1->Loops.push_back(1ULL);
+  B1->Loc = "main.c: 12";
+  B1->addInstruction(new MachineInstruction(0))->Opcode = "RET";
+  Doc.addFunction(F);
+
+  FlowFact<UnsignedValue> *FF = new FlowFact<UnsignedValue>(level_machinecode);
+  FF->setLoopScope(3ULL, 1ULL);
+  FF->addTermLHS(ProgramPoint::CreateBlock("3", "1"), -1);
+  FF->Comparison = cmp_less_equal;
+  FF->RHS = 100;
+  FF->Origin = "llvm.mc";
+  Doc.addFlowFact(FF);
+}
+
+template <typename DocT>
+std::string toYAML(ArrayRef<DocT*> Docs) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  Output Out(OS);
+  for (DocT *DocPtr : Docs)
+    Out << DocPtr;
+  return OS.str();
+}
+
+template <typename DocT>
+std::string toPMLYAML(ArrayRef<DocT*> Docs) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  {
+    PMLYAMLOutput Out(OS);
+    for (DocT *DocPtr : Docs)
+      Out << DocPtr;
+  }
+  return OS.str();
+}
+
+TEST(PMLYAMLTest, SameAsYAMLOutput){
+  MachineDoc Doc("machine-functions", "patmos-unknown-unknown-elf");
+  fillDoc(Doc);
+  MachineDoc Empty("machine-functions", "patmos-unknown-unknown-elf");
+
+  MachineDoc *Docs[] = { &Doc, &Empty, &Doc };
+  EXPECT_EQ(toYAML<MachineDoc>(Docs), toPMLYAML<MachineDoc>(Docs));
+}
+
+TEST(PMLYAMLTest, Bitcode){
+  BitcodeDoc Doc("bitcode-functions", "patmos-unknown-unknown-elf");
+  BitcodeFunction *F = new BitcodeFunction("main");
+  F->Level = level_bitcode;
+  BitcodeBlock *B = F->addBlock(new BitcodeBlock("for.body"));
+  B->Successors.push_back("for.end");
+  B->Predecessors.push_back("entry");
+  B->addInstruction(new yaml::Instruction(0))->Opcode = "br";
+  Doc.addFunction(F);
+
+  BitcodeDoc *Docs[] = { &Doc };
+  EXPECT_EQ(toYAML<BitcodeDoc>(Docs), toPMLYAML<BitcodeDoc>(Docs));
+}
+
+TEST(PMLYAMLTest, LargeDocument){
+  // larger than the buffer, so it is written in several chunks
+  MachineDoc Doc("machine-functions", "patmos-unknown-unknown-elf");
+  for (unsigned i = 0; i < 200; i++)
+    fillDoc(Doc);
+
+  MachineDoc *Docs[] = { &Doc };
+  std::string Expected = toYAML<MachineDoc>(Docs);
+  EXPECT_LT(64u * 1024, Expected.size());
+  EXPECT_EQ(Expected, toPMLYAML<MachineDoc>(Docs));
+}
+
+} // end anonymous namespace
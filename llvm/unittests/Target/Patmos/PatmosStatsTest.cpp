@@ -0,0 +1,50 @@
+#include "gtest/gtest.h"
+#include "PatmosStats.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace {
+
+Function *makeFunction(Module &M, StringRef Name) {
+  FunctionType *Ty = FunctionType::get(Type::getVoidTy(M.getContext()), false);
+  return Function::Create(Ty, GlobalValue::ExternalLinkage, Name, M);
+}
+
+TEST(PatmosStatsTest, SumsPerFunction) {
+  LLVMContext Ctx;
+  Module M("test.c", Ctx);
+  Function *Foo = makeFunction(M, "foo");
+  Function *Bar = makeFunction(M, "bar");
+
+  addPatmosStat(*Foo, "delay-slot-filler", "nop-slots", 2);
+  addPatmosStat(*Foo, "delay-slot-filler", "nop-slots", 3);
+  addPatmosStat(*Foo, "function-splitter", "regions", 1);
+  addPatmosStat(*Bar, "delay-slot-filler", "filled-slots", 4);
+
+  std::string Out;
+  raw_string_ostream OS(Out);
+  printPatmosStats(M, OS);
+  EXPECT_EQ("{\"module\":\"test.c\",\"functions\":{"
+            "\"bar\":{\"delay-slot-filler\":{\"filled-slots\":4}},"
+            "\"foo\":{\"delay-slot-filler\":{\"nop-slots\":5},"
+            "\"function-splitter\":{\"regions\":1}}}}\n", OS.str());
+}
+
+TEST(PatmosStatsTest, ClearedAfterPrinting) {
+  LLVMContext Ctx;
+  Module M("test.c", Ctx);
+  addPatmosStat(*makeFunction(M, "foo"), "single-path", "nops", 1);
+
+  std::string First, Second;
+  raw_string_ostream OS1(First), OS2(Second);
+  printPatmosStats(M, OS1);
+  printPatmosStats(M, OS2);
+  EXPECT_EQ("{\"module\":\"test.c\",\"functions\":{}}\n", OS2.str());
+}
+
+} // end anonymous namespace
@@ -1865,4 +1865,173 @@ TEST(ListSchedulerTest, PredicateWriteThenIndependentUse){
   );
 }
 
+TEST(ListSchedulerTest, CriticalPathPriority){
+  /* Tests that with critical path priority, the instruction leading to a high-latency
+   * instruction is scheduled first, even though it doesn't have more successors.
+   */
+  block(mockMBB, arr({
+    MockInstr({Operand::R0},{Operand::R1},InstrAttr::simple()),
+    MockInstr({Operand::R1},{Operand::R2},InstrAttr::simple()),
+    // Leads to the high-latency instruction
+    MockInstr({Operand::R0},{Operand::R4},InstrAttr::simple()),
+    MockInstr({Operand::R4},{Operand::R4},InstrAttr::poison(2)),
+    MockInstr({Operand::R4},{},InstrAttr::simple()),
+  }));
+  ListScheduleOptions options;
+  options.critical_path = true;
+
+  // Without critical path priority, a nop is needed before the last instruction
+  auto new_schedule = list_schedule(mockMBB.begin(), mockMBB.end(),
+      reads, writes, uses_predicate, poisons, memory_access, latency, is_constant, conditional_branch, disable_dual_issue, default_dependencies);
+
+  EXPECT_THAT(
+      new_schedule,
+      UnorderedElementsAreArray({
+        pair(0, 0),
+        pair(1, 2),
+        pair(2, 3),
+        pair(3, 1),
+        pair(5, 4),
+      })
+  );
+
+  new_schedule = list_schedule(mockMBB.begin(), mockMBB.end(),
+      reads, writes, uses_predicate, poisons, memory_access, latency, is_constant, conditional_branch, disable_dual_issue, default_dependencies, options);
+
+  EXPECT_THAT(
+      new_schedule,
+      UnorderedElementsAreArray({
+        pair(0, 2),
+        pair(1, 3),
+        pair(2, 0),
+        pair(3, 1),
+        pair(4, 4),
+      })
+  );
+}
+
+TEST(ListSchedulerTest, LookaheadFillsSecondSlot){
+  /* Tests that with lookahead, a lower-priority instruction is scheduled in the first
+   * slot if that allows filling the second slot.
+   */
+  block(mockMBB, arr({
+    // Highest priority, but can't be bundled with any other ready instruction
+    MockInstr({Operand::R0},{Operand::R1},InstrAttr(1,false,false,false,false,false,false,true)),
+    MockInstr({Operand::R0},{Operand::R2},InstrAttr::simple_first_only(1)),
+    MockInstr({Operand::R0},{Operand::R3},InstrAttr::simple_non_bundleable()),
+    MockInstr({Operand::R3},{Operand::R4},InstrAttr::simple()),
+  }));
+  ListScheduleOptions options;
+  options.lookahead = 2;
+
+  auto new_schedule = list_schedule(mockMBB.begin(), mockMBB.end(),
+      reads, writes, uses_predicate, poisons, memory_access, latency, is_constant, conditional_branch, enable_dual_issue, default_dependencies);
+
+  EXPECT_THAT(
+      new_schedule,
+      UnorderedElementsAreArray({
+        pair(0, 0),
+        pair(2, 1),
+        pair(3, 2),
+        pair(4, 3),
+      })
+  );
+
+  new_schedule = list_schedule(mockMBB.begin(), mockMBB.end(),
+      reads, writes, uses_predicate, poisons, memory_access, latency, is_constant, conditional_branch, enable_dual_issue, default_dependencies, options);
+
+  EXPECT_THAT(
+      new_schedule,
+      UnorderedElementsAreArray({
+        pair(0, 1),
+        pair(1, 2),
+        pair(2, 0),
+        pair(3, 3),
+      })
+  );
+}
+
+TEST(ListSchedulerTest, BoundedSearchFindsShorterSchedule){
+  /* Tests that the bounded search finds a schedule without nops where the
+   * greedy list scheduler needs one.
+   */
+  block(mockMBB, arr({
+    MockInstr({Operand::R0},{Operand::R1},InstrAttr::simple()),
+    MockInstr({Operand::R1},{Operand::R2},InstrAttr::simple()),
+    MockInstr({Operand::R0},{Operand::R4},InstrAttr::simple()),
+    MockInstr({Operand::R4},{Operand::R4},InstrAttr::poison(2)),
+    MockInstr({Operand::R4},{},InstrAttr::simple()),
+  }));
+  ListScheduleOptions options;
+  options.exact_max_instrs = 16;
+  options.exact_budget = 256;
+
+  auto new_schedule = list_schedule(mockMBB.begin(), mockMBB.end(),
+      reads, writes, uses_predicate, poisons, memory_access, latency, is_constant, conditional_branch, disable_dual_issue, default_dependencies, options);
+
+  EXPECT_THAT(
+      new_schedule,
+      UnorderedElementsAreArray({
+        pair(0, 2),
+        pair(1, 3),
+        pair(2, 0),
+        pair(3, 1),
+        pair(4, 4),
+      })
+  );
+
+  // Blocks larger than the limit keep the greedy schedule
+  options.exact_max_instrs = 4;
+  new_schedule = list_schedule(mockMBB.begin(), mockMBB.end(),
+      reads, writes, uses_predicate, poisons, memory_access, latency, is_constant, conditional_branch, disable_dual_issue, default_dependencies, options);
+
+  EXPECT_THAT(
+      new_schedule,
+      UnorderedElementsAreArray({
+        pair(0, 0),
+        pair(1, 2),
+        pair(2, 3),
+        pair(3, 1),
+        pair(5, 4),
+      })
+  );
+}
+
+TEST(ListSchedulerTest, PendingOperandsFromPrecedingBlock){
+  /* Tests that operands still being produced by a preceding block are not accessed
+   * until they are ready, and that the delay is filled with independent instructions.
+   */
+  block(mockMBB, arr({
+    MockInstr({Operand::R1},{Operand::R2},InstrAttr::simple()),
+    MockInstr({Operand::R3},{Operand::R3},InstrAttr::simple()),
+  }));
+  std::map<Operand, unsigned> pending = {{Operand::R1, 1}};
+
+  auto new_schedule = list_schedule(mockMBB.begin(), mockMBB.end(),
+      reads, writes, uses_predicate, poisons, memory_access, latency, is_constant, conditional_branch, disable_dual_issue, default_dependencies,
+      ListScheduleOptions(), pending);
+
+  EXPECT_THAT(
+      new_schedule,
+      UnorderedElementsAreArray({
+        pair(0, 1),
+        pair(1, 0),
+      })
+  );
+
+  // Nothing can hide the latency, so the first bundle is left empty.
+  pending = {{Operand::R1, 1}, {Operand::R3, 1}};
+  new_schedule = list_schedule(mockMBB.begin(), mockMBB.end(),
+      reads, writes, uses_predicate, poisons, memory_access, latency, is_constant, conditional_branch, enable_dual_issue, default_dependencies,
+      ListScheduleOptions(), pending);
+
+  EXPECT_THAT(
+      new_schedule,
+      UnorderedElementsAreArray({
+        pair(2, 0),
+        pair(3, 1),
+      })
+  );
+}
+
 }
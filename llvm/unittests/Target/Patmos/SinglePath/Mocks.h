@@ -1,9 +1,10 @@
 #ifndef UNITTESTS_TARGET_PATMOS_SINGLEPATH_MOCKS_H_
 #define UNITTESTS_TARGET_PATMOS_SINGLEPATH_MOCKS_H_
 
-#include "gtest/gtest.h"
-#include "gmock/gmock.h"
+#include "llvm/ADT/SmallVector.h"
 #include <algorithm>
+#include <string>
+#include <vector>
 
 template<
   typename Payload
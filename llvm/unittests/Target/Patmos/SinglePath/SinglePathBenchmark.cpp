@@ -0,0 +1,239 @@
+//===-- SinglePathBenchmark.cpp - Microbenchmarks of the single-path code -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Microbenchmarks of the list scheduler, the merging of predicated blocks, the
+// constant loop dominator analysis and the memory access analysis on
+// synthetic blocks and graphs of growing size, using the mocks of the tests.
+//
+// The graphs are a sequence of segments, each a diamond followed by a loop
+// with one latch. The mocked loop info searches all loops, which adds a
+// linear factor to the analyses that the real MachineLoopInfo does not have.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "SinglePath/ConstantLoopDominatorAnalysis.h"
+#include "SinglePath/MemoryAccessAnalysis.h"
+#include "SinglePath/PredicatedBlock.h"
+#include "SinglePath/SPListScheduler.h"
+#include "Mocks.h"
+#include <deque>
+
+using namespace llvm;
+
+namespace {
+
+//===----------------------------------------------------------------------===//
+// Graphs
+//===----------------------------------------------------------------------===//
+
+/// A synthetic function of the given number of segments. Payloads are given
+/// by 'header' for the loop headers and by 'other' for all other blocks.
+template<typename Payload>
+class MockGraph {
+public:
+  std::deque<std::string> names;
+  std::deque<std::vector<MockMBB<Payload>*>> edges;
+  std::deque<MockMBB<Payload>> mbbs;
+  std::deque<MockLoop<Payload>> loops;
+  MockLoopInfo<Payload> LI;
+
+  MockGraph(unsigned segments, Payload (*header)(unsigned),
+            Payload (*other)(unsigned))
+  {
+    std::vector<MockMBB<Payload>*> blocks;
+    for (unsigned i = 0; i < 5 * segments + 1; i++) {
+      names.push_back("mbb" + std::to_string(i));
+      bool is_header = i % 5 == 3;
+      mbbs.emplace_back(&names.back()[0], is_header ? header(i) : other(i));
+      blocks.push_back(&mbbs.back());
+    }
+
+    std::vector<std::vector<MockMBB<Payload>*>> preds(blocks.size()),
+                                                succs(blocks.size());
+    auto edge = [&](unsigned from, unsigned to){
+      succs[from].push_back(blocks[to]);
+      preds[to].push_back(blocks[from]);
+    };
+    for (unsigned s = 0; s < segments; s++) {
+      // Diamond: 0 -> {1, 2} -> 3, loop: 3 -> 4 -> 3, exit: 3 -> next
+      unsigned b = 5 * s;
+      edge(b, b + 1);
+      edge(b, b + 2);
+      edge(b + 1, b + 3);
+      edge(b + 2, b + 3);
+      edge(b + 3, b + 4);
+      edge(b + 4, b + 3);
+      edge(b + 3, b + 5);
+    }
+    for (unsigned i = 0; i < blocks.size(); i++) {
+      edges.push_back(preds[i]);
+      blocks[i]->set_preds(&edges.back());
+      edges.push_back(succs[i]);
+      blocks[i]->set_succs(&edges.back());
+    }
+
+    for (unsigned s = 0; s < segments; s++) {
+      unsigned b = 5 * s;
+      loops.emplace_back(nullptr,
+          std::vector<MockMBB<Payload>*>{blocks[b + 3], blocks[b + 4]},
+          std::vector<MockMBB<Payload>*>{blocks[b + 4]},
+          std::vector<MockMBB<Payload>*>{blocks[b + 3]});
+      LI.add_loop(&loops.back());
+    }
+  }
+
+  const MockMBB<Payload> *entry() const { return &mbbs.front(); }
+};
+
+bool constantBounds(const MockMBB<bool> *mbb){
+  return mbb->payload;
+}
+
+void BM_ConstantLoopDominators(benchmark::State &state) {
+  MockGraph<bool> G(state.range(0),
+      [](unsigned i){ return i % 2 == 1; },
+      [](unsigned){ return false; });
+  for (auto _ : state) {
+    auto doms = constantLoopDominatorsAnalysis(G.entry(), &G.LI,
+                                               constantBounds, false);
+    benchmark::DoNotOptimize(doms);
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_ConstantLoopDominators)
+  ->RangeMultiplier(2)->Range(4, 256)->Complexity();
+
+typedef std::tuple<int,int,int> AccessPayload;
+
+unsigned countAccess(const MockMBB<AccessPayload> *mbb){
+  return std::get<0>(mbb->payload);
+}
+
+std::pair<uint64_t, uint64_t> loopbounds(const MockMBB<AccessPayload> *mbb){
+  return std::make_pair(std::get<1>(mbb->payload), std::get<2>(mbb->payload));
+}
+
+void BM_MemoryAccessAnalysis(benchmark::State &state) {
+  MockGraph<AccessPayload> G(state.range(0),
+      [](unsigned i){ return std::make_tuple((int) i % 3, 1, 1 + (int) i % 7); },
+      [](unsigned i){ return std::make_tuple((int) i % 4, -1, -1); });
+  for (auto _ : state) {
+    auto counts = memoryAccessAnalysis(G.entry(), &G.LI, countAccess,
+                                       loopbounds);
+    benchmark::DoNotOptimize(counts);
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_MemoryAccessAnalysis)
+  ->RangeMultiplier(2)->Range(4, 256)->Complexity();
+
+//===----------------------------------------------------------------------===//
+// Predicated blocks
+//===----------------------------------------------------------------------===//
+
+class MockInstr {};
+
+class MockBlock {
+public:
+  std::vector<MockInstr> instr;
+
+  MockBlock(unsigned nrInstr): instr(nrInstr) {}
+
+  std::vector<MockInstr>::iterator instr_begin() { return instr.begin(); }
+  std::vector<MockInstr>::iterator instr_end() { return instr.end(); }
+};
+
+typedef _PredicatedBlock<MockBlock, MockInstr, int> PredicatedBlock;
+
+/// Predicates the given number of blocks, each with one definition and one
+/// successor, and merges them into the first one, like the single-path
+/// reducer does for the blocks of a function.
+void BM_PredicatedBlockMerge(benchmark::State &state) {
+  std::vector<MockBlock> mbbs(state.range(0), MockBlock(8));
+  for (auto _ : state) {
+    std::deque<PredicatedBlock> blocks;
+    for (unsigned i = 0; i < mbbs.size(); i++) {
+      blocks.emplace_back(&mbbs[i]);
+      blocks.back().setPredicate(i);
+    }
+    for (unsigned i = 0; i + 1 < blocks.size(); i++) {
+      blocks[i].addDefinition(
+          PredicatedBlock::Definition{i + 1, i, &blocks[i + 1], 0, 0});
+      blocks[i].addSuccessor(&blocks[i + 1], i + 1);
+    }
+    for (unsigned i = 1; i < blocks.size(); i++)
+      blocks.front().merge(&blocks[i]);
+    benchmark::DoNotOptimize(blocks.front().getBlockPredicates());
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_PredicatedBlockMerge)
+  ->RangeMultiplier(2)->Range(8, 1024)->Complexity();
+
+//===----------------------------------------------------------------------===//
+// List scheduler
+//===----------------------------------------------------------------------===//
+
+/// An instruction of the synthetic blocks, operand 0 is constant.
+class MockSchedInstr {
+public:
+  std::set<unsigned> reads, writes;
+  bool load;
+
+  bool isCall() const { return false; }
+};
+
+std::set<unsigned> reads(const MockSchedInstr *instr) { return instr->reads; }
+std::set<unsigned> writes(const MockSchedInstr *instr) { return instr->writes; }
+Optional<unsigned> uses_predicate(const MockSchedInstr *) { return None; }
+bool poisons(const MockSchedInstr *instr) { return instr->load; }
+bool memory_access(const MockSchedInstr *instr) { return instr->load; }
+unsigned latency(const MockSchedInstr *instr) { return instr->load ? 1 : 0; }
+bool is_constant(unsigned op) { return op == 0; }
+bool conditional_branch(const MockSchedInstr *) { return false; }
+bool may_second_slot(void *, const MockSchedInstr *instr) {
+  return !instr->load;
+}
+bool is_long(const MockSchedInstr *) { return false; }
+bool may_bundle(const MockSchedInstr *, const MockSchedInstr *) {
+  return true;
+}
+
+/// Schedules a block of the given number of instructions with dual-issue.
+/// Every fourth instruction is a load, the others are ALU instructions, all
+/// of them use a few of 16 registers, such that there are true, anti and
+/// output dependencies throughout the block.
+void BM_ListSchedule(benchmark::State &state) {
+  std::vector<MockSchedInstr> instrs;
+  for (unsigned i = 0; i < (unsigned) state.range(0); i++) {
+    instrs.push_back(MockSchedInstr{
+        {0, 1 + i % 16, 1 + (i * 7) % 16}, {1 + (i * 5 + 3) % 16}, i % 4 == 0});
+  }
+  Optional<std::tuple<
+    void*,
+    bool (*)(void*, const MockSchedInstr *),
+    bool (*)(const MockSchedInstr *),
+    bool (*)(const MockSchedInstr *, const MockSchedInstr *)
+  >> dual_issue = std::make_tuple((void*)nullptr, may_second_slot, is_long,
+                                  may_bundle);
+  for (auto _ : state) {
+    auto schedule = list_schedule(instrs.begin(), instrs.end(), reads, writes,
+        uses_predicate, poisons, memory_access, latency, is_constant,
+        conditional_branch, dual_issue);
+    benchmark::DoNotOptimize(schedule);
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_ListSchedule)
+  ->RangeMultiplier(2)->Range(8, 512)->Complexity();
+
+} // end anonymous namespace
+
+BENCHMARK_MAIN();
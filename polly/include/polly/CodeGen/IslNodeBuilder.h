@@ -232,6 +232,19 @@ protected:
   /// isl_ast_op_lt type.
   int getNumberOfIterations(isl::ast_node For);
 
+  /// Return the maximal number of iterations of a loop in any execution of
+  /// its enclosing loops, or -1 if it is not bounded by a constant.
+  ///
+  /// The iterations of the point loops of a tile, for example, never exceed
+  /// the tile size, independently of the parameters of the SCoP.
+  int getMaxNumberOfIterations(isl::ast_node For);
+
+  /// Annotate the loop whose header is being generated with its maximal
+  /// number of iterations, in form of a call to "llvm.loop.bound".
+  ///
+  /// The call is understood by the single-path and WCET analyses of Patmos.
+  void createLoopBound(int MaxIterations);
+
   /// Compute the values and loops referenced in this subtree.
   ///
   /// This function looks at all ScopStmts scheduled below the provided For node
@@ -273,7 +273,7 @@ private:
   ///
   /// @param Node The schedule node to (possibly) optimize.
   /// @param User A pointer to forward some use information
-  ///        (currently unused).
+  ///        (the target cache size is used for the tile size).
   static isl::schedule_node standardBandOpts(isl::schedule_node Node,
                                              void *User);
 
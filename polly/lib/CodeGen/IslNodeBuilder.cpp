@@ -29,6 +29,7 @@
 #include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/RegionInfo.h"
 #include "llvm/Analysis/ScalarEvolution.h"
@@ -43,6 +44,7 @@
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Value.h"
 #include "llvm/Support/Casting.h"
@@ -60,6 +62,7 @@
 #include "isl/union_set.h"
 #include "isl/val.h"
 #include <algorithm>
+#include <climits>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
@@ -96,6 +99,12 @@ static cl::opt<bool> PollyGenerateExpressions(
     cl::desc("Generate AST expressions for unmodified and modified accesses"),
     cl::Hidden, cl::init(false), cl::ZeroOrMore, cl::cat(PollyCategory));
 
+static cl::opt<bool> PollyLoopBounds(
+    "polly-codegen-loop-bounds",
+    cl::desc("Annotate the generated loops with their maximal number of "
+             "iterations (default: only for Patmos)"),
+    cl::Hidden, cl::init(false), cl::ZeroOrMore, cl::cat(PollyCategory));
+
 static cl::opt<int> PollyTargetFirstLevelCacheLineSize(
     "polly-target-first-level-cache-line-size",
     cl::desc("The size of the first level cache line size specified in bytes."),
@@ -204,6 +213,72 @@ int IslNodeBuilder::getNumberOfIterations(isl::ast_node For) {
     return NumberIterations + 1;
 }
 
+int IslNodeBuilder::getMaxNumberOfIterations(isl::ast_node For) {
+  isl::ast_expr Inc = For.for_get_inc();
+  if (isl_ast_expr_get_type(Inc.get()) != isl_ast_expr_int)
+    return -1;
+  long Stride = Inc.get_val().get_num_si();
+  if (Stride <= 0)
+    return -1;
+
+  // The last dimension of the schedule at the loop is the loop itself.
+  isl_union_map *Schedule = getScheduleForAstNode(For.get());
+  if (!Schedule)
+    return -1;
+  isl_union_set *Range = isl_union_map_range(Schedule);
+  if (isl_union_set_n_set(Range) != 1) {
+    isl_union_set_free(Range);
+    return -1;
+  }
+  isl_set *Iterations = isl_set_from_union_set(Range);
+  isl_size Dims = isl_set_dim(Iterations, isl_dim_set);
+  if (Dims < 1) {
+    isl_set_free(Iterations);
+    return -1;
+  }
+
+  // The distances between two iterations of the loop in the same iteration of
+  // the enclosing loops, for any values of the parameters.
+  isl_map *Loop = isl_map_from_range(Iterations);
+  Loop = isl_map_move_dims(Loop, isl_dim_in, 0, isl_dim_out, 0, Dims - 1);
+  isl_map *Pairs =
+      isl_map_apply_range(isl_map_reverse(isl_map_copy(Loop)), Loop);
+  isl::val Distance =
+      isl::manage(isl_set_dim_max_val(isl_map_deltas(Pairs), 0));
+  if (Distance.is_null() || !Distance.is_int() || Distance.is_neg())
+    return -1;
+
+  long MaxDistance = Distance.get_num_si();
+  if (MaxDistance / Stride >= INT_MAX)
+    return -1;
+  return MaxDistance / Stride + 1;
+}
+
+void IslNodeBuilder::createLoopBound(int MaxIterations) {
+  // The arguments (a, b) denote a minimum of a+1 and a maximum of a+b+1
+  // executions of the loop header, which executes once per iteration.
+  Module *M = Builder.GetInsertBlock()->getModule();
+  Type *Int32Ty = Builder.getInt32Ty();
+  FunctionType *FT =
+      FunctionType::get(Builder.getVoidTy(), {Int32Ty, Int32Ty}, false);
+  Function *LoopBound = M->getFunction("llvm.loop.bound");
+  if (!LoopBound) {
+    LoopBound = Function::Create(FT, Function::ExternalLinkage,
+                                 "llvm.loop.bound", M);
+    // Optimizations must not duplicate or merge the bounds, as for the bounds
+    // emitted by Clang for '#pragma loopbound'.
+    LoopBound->addFnAttr(Attribute::Convergent);
+    LoopBound->addFnAttr(Attribute::NoDuplicate);
+    LoopBound->addFnAttr(Attribute::NoInline);
+    LoopBound->addFnAttr(Attribute::NoRecurse);
+    LoopBound->addFnAttr(Attribute::NoMerge);
+    LoopBound->addFnAttr(Attribute::OptimizeNone);
+  }
+  Value *Min = Builder.getInt32(0);
+  Value *Max = Builder.getInt32(MaxIterations - 1);
+  Builder.CreateCall(FT, LoopBound, {Min, Max});
+}
+
 /// Extract the values and SCEVs needed to generate code for a block.
 static int findReferencesInBlock(struct SubtreeReferences &References,
                                  const ScopStmt *Stmt, BasicBlock *BB) {
@@ -559,6 +634,19 @@ void IslNodeBuilder::createForSequential(isl::ast_node For, bool MarkParallel) {
                   LoopVectorizerDisabled);
   IDToValue[IteratorID.get()] = IV;
 
+  // The WCET analysis of Patmos needs a bound for every loop, the single-path
+  // code executes this many iterations.
+  Module *M = Builder.GetInsertBlock()->getModule();
+  Triple TargetTriple(M->getTargetTriple());
+  bool EmitLoopBound = PollyLoopBounds.getNumOccurrences()
+                           ? PollyLoopBounds
+                           : TargetTriple.getArch() == Triple::patmos;
+  if (EmitLoopBound) {
+    int MaxIterations = getMaxNumberOfIterations(For);
+    if (MaxIterations > 0)
+      createLoopBound(MaxIterations);
+  }
+
   create(Body.release());
 
   Annotator.popLoop(MarkParallel);
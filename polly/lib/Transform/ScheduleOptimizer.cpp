@@ -510,11 +510,39 @@ bool ScheduleTreeOptimizer::isTileableBandNode(isl::schedule_node Node) {
   return isSimpleInnermostBand(Node);
 }
 
+/// Get the default size of the first level tiles.
+///
+/// Unless it is given by --polly-default-tile-size, the default tile size is
+/// halved as long as a tile of three two-dimensional arrays of 8-byte elements
+/// exceeds the first level data cache reported by the target. Targets with
+/// small data caches, such as Patmos, would otherwise thrash their cache within
+/// each tile.
+///
+/// @param OAI Target Transform Info and the dependences analysis, if any.
+/// @return    The default tile size.
+static int
+getFirstLevelDefaultTileSize(const OptimizerAdditionalInfoTy *OAI) {
+  int TileSize = FirstLevelDefaultTileSize;
+  if (FirstLevelDefaultTileSize.getNumOccurrences() || !OAI || !OAI->TTI)
+    return TileSize;
+
+  auto L1DCache = llvm::TargetTransformInfo::CacheLevel::L1D;
+  Optional<unsigned> CacheSize = OAI->TTI->getCacheSize(L1DCache);
+  if (!CacheSize.hasValue())
+    return TileSize;
+
+  while (TileSize > 2 && 3 * 8 * TileSize * TileSize > int(*CacheSize))
+    TileSize /= 2;
+  return TileSize;
+}
+
 __isl_give isl::schedule_node
 ScheduleTreeOptimizer::standardBandOpts(isl::schedule_node Node, void *User) {
   if (FirstLevelTiling) {
+    const OptimizerAdditionalInfoTy *OAI =
+        static_cast<const OptimizerAdditionalInfoTy *>(User);
     Node = tileNode(Node, "1st level tiling", FirstLevelTileSizes,
-                    FirstLevelDefaultTileSize);
+                    getFirstLevelDefaultTileSize(OAI));
     FirstLevelTileOpts++;
   }
 